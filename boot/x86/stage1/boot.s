@@ -64,6 +64,8 @@ BOOT_DISK: db 0
 MEM_DESC:
     dw 0x00 ; mem table size
     dw 0x00 ; kernel size
+    dd 0x00 ; initrd start
+    dd 0x00 ; initrd size
 
 
 times (510-($-$$)) db 0
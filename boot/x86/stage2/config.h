@@ -1,4 +1,13 @@
 #pragma once
 
 #define KERNEL_PATH "/boot/kernel.bin"
-#define KERNEL_BASE 0x100000
\ No newline at end of file
+#define KERNEL_BASE 0x100000
+
+/* Packed kernel, it is preferred over KERNEL_PATH when present. The elf is
+   decompressed in place at KERNEL_IMAGE_BASE, away from the kernel and the
+   initramfs, and the segments are copied out of it. */
+#define KERNEL_LZ4_PATH "/boot/kernel.lz4"
+#define KERNEL_IMAGE_BASE 0x2000000
+
+#define INITRD_PATH "/boot/initrd.img"
+#define INITRD_BASE 0x1000000
@@ -82,6 +82,7 @@ int indentify_ata_device(drive_desc_t* drive_desc)
     }
 
     drive_desc->read = ata_read;
+    drive_desc->read_sectors = ata_read_sectors;
     printh((uint32_t)ata_read);
     printh((uint32_t)&ata_read);
     printh((uint32_t)drive_desc->read);
@@ -89,23 +90,17 @@ int indentify_ata_device(drive_desc_t* drive_desc)
     return 0;
 }
 
-// Returning 2 head read bytes (used to get size of kernel)
-int ata_read(uint32_t sector, uint8_t* read_to)
+// Reading the alternate status 4 times gives the drive the 400ns it needs to set BSY.
+static void _ata_delay_400ns()
 {
-    uint8_t dev_config = 0xA0;
-    // lba support
-    dev_config |= (1 << 6);
-    if (!active_ata_drive.is_master) {
-        dev_config |= (1 << 4);
+    for (int i = 0; i < 4; i++) {
+        port_8bit_in(active_ata_drive.control_port);
     }
+}
 
-    port_8bit_out(active_ata_drive.device_port, dev_config);
-    port_8bit_out(active_ata_drive.sector_count_port, 1);
-    port_8bit_out(active_ata_drive.lba_lo_port, sector & 0x000000FF);
-    port_8bit_out(active_ata_drive.lba_mid_port, (sector & 0x0000FF00) >> 8);
-    port_8bit_out(active_ata_drive.lba_hi_port, (sector & 0x00FF0000) >> 16);
-    port_8bit_out(active_ata_drive.error_port, 0);
-    port_8bit_out(active_ata_drive.command_port, 0x21);
+static int _ata_wait_for_data()
+{
+    _ata_delay_400ns();
 
     // waiting for processing
     // while BSY is on and no Errors
@@ -123,11 +118,51 @@ int ata_read(uint32_t sector, uint8_t* read_to)
         return -1;
     }
 
-    for (int i = 0; i < 256; i++) {
-        uint16_t data = port_16bit_in(active_ata_drive.data_port);
-        read_to[2 * i + 1] = (data >> 8) & 0xFF;
-        read_to[2 * i] = data & 0xFF;
+    return 0;
+}
+
+int ata_read(uint32_t sector, uint8_t* read_to)
+{
+    return ata_read_sectors(sector, 1, read_to);
+}
+
+/**
+ * One READ SECTORS command brings up to ATA_MAX_SECTORS_PER_CMD sectors,
+ * the drive raises DRQ for each of them and the words are moved with
+ * rep insw. Issuing a command per sector was what made loading slow.
+ */
+int ata_read_sectors(uint32_t sector, uint32_t count, uint8_t* read_to)
+{
+    while (count) {
+        uint32_t chunk = count < ATA_MAX_SECTORS_PER_CMD ? count : ATA_MAX_SECTORS_PER_CMD;
+
+        uint8_t dev_config = 0xA0;
+        // lba support
+        dev_config |= (1 << 6);
+        if (!active_ata_drive.is_master) {
+            dev_config |= (1 << 4);
+        }
+        dev_config |= (sector >> 24) & 0x0F;
+
+        port_8bit_out(active_ata_drive.device_port, dev_config);
+        port_8bit_out(active_ata_drive.error_port, 0);
+        port_8bit_out(active_ata_drive.sector_count_port, chunk & 0xFF);
+        port_8bit_out(active_ata_drive.lba_lo_port, sector & 0x000000FF);
+        port_8bit_out(active_ata_drive.lba_mid_port, (sector & 0x0000FF00) >> 8);
+        port_8bit_out(active_ata_drive.lba_hi_port, (sector & 0x00FF0000) >> 16);
+        port_8bit_out(active_ata_drive.command_port, 0x20);
+
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (_ata_wait_for_data() != 0) {
+                return -1;
+            }
+            port_16bit_in_rep(active_ata_drive.data_port, read_to, 256);
+            read_to += 512;
+        }
+
+        sector += chunk;
+        count -= chunk;
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -19,4 +19,8 @@ typedef struct { // LBA28 | LBA48
 
 void init_ata(uint32_t port, char is_master);
 int indentify_ata_device(drive_desc_t* drive_desc);
-int ata_read(uint32_t sector, uint8_t* read_to);
\ No newline at end of file
+/* The sector count register is 8 bit, 0 stands for 256 sectors. */
+#define ATA_MAX_SECTORS_PER_CMD 256
+
+int ata_read(uint32_t sector, uint8_t* read_to);
+int ata_read_sectors(uint32_t sector, uint32_t count, uint8_t* read_to);
\ No newline at end of file
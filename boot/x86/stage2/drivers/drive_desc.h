@@ -3,5 +3,6 @@
 typedef struct {
     void* init;
     void* read;
+    void* read_sectors;
     void* write;
 } drive_desc_t;
\ No newline at end of file
@@ -29,17 +29,29 @@ uint32_t _ext2_lite_get_offset_of_block(uint32_t block_index)
 static uint8_t tmp_read_buf[8192];
 void _ext2_lite_read(uint8_t* buf, uint32_t start, uint32_t len)
 {
-    void (*read)(uint32_t sector, uint8_t * read_to) = active_drive_desc->read;
-    int already_read = 0;
+    int (*read_sectors)(uint32_t sector, uint32_t count, uint8_t * read_to) = active_drive_desc->read_sectors;
     while (len != 0) {
         uint32_t sector = start / 512;
         uint32_t start_offset = start % 512;
-        read(sector, tmp_read_buf);
-        for (int i = 0; i < _ext2_lite_min(512 - start_offset, len); i++) {
-            buf[already_read++] = tmp_read_buf[start_offset + i];
+
+        // Whole sectors go straight to the destination with one request.
+        if (start_offset == 0 && len >= 512) {
+            uint32_t count = len / 512;
+            read_sectors(sector, count, buf);
+            buf += count * 512;
+            start += count * 512;
+            len -= count * 512;
+            continue;
+        }
+
+        uint32_t chunk = _ext2_lite_min(512 - start_offset, len);
+        read_sectors(sector, 1, tmp_read_buf);
+        for (int i = 0; i < chunk; i++) {
+            buf[i] = tmp_read_buf[start_offset + i];
         }
-        len -= _ext2_lite_min(512 - start_offset, len);
-        start += _ext2_lite_min(512 - start_offset, len);
+        buf += chunk;
+        start += chunk;
+        len -= chunk;
     }
 }
 
@@ -168,10 +180,17 @@ int ext2_lite_get_inode(drive_desc_t* drive_desc, char* path, inode_t* file_inod
 }
 
 static uint8_t tmp_block_buf[8192];
+
+// The last block of pointers is kept, since the blocks of a file are looked up in a row.
+static uint8_t lev0_block_buf[8192];
+static uint32_t lev0_cached_block = 0;
 uint32_t _ext2_lite_get_block_of_file_lev0(uint32_t cur_block, uint32_t file_block_index)
 {
-    _ext2_lite_read(tmp_block_buf, _ext2_lite_get_offset_of_block(cur_block), _ext2_lite_get_block_len());
-    uint32_t* buf = (uint32_t*)tmp_block_buf;
+    if (lev0_cached_block != cur_block) {
+        _ext2_lite_read(lev0_block_buf, _ext2_lite_get_offset_of_block(cur_block), _ext2_lite_get_block_len());
+        lev0_cached_block = cur_block;
+    }
+    uint32_t* buf = (uint32_t*)lev0_block_buf;
     return buf[file_block_index];
 }
 
@@ -228,31 +247,66 @@ uint32_t _ext2_lite_get_block_of_file(inode_t* inode, uint32_t file_block_index)
     }
 }
 
-// TODO think of more effecient version
-// Note to save mem: the func reuses tmp_block_buf.
+/**
+ * The elf loader reads a file piece by piece, so the inode of the last path
+ * is kept instead of walking the dirs on every read.
+ */
+static char cached_path[EXT2_LITE_MAX_PATH_LEN];
+static inode_t cached_inode;
+static int _ext2_lite_get_inode_cached(char* path, inode_t* file_inode)
+{
+    int i = 0;
+    while (path[i] && path[i] == cached_path[i]) {
+        i++;
+    }
+    if (path[i] == cached_path[i] && path[0]) {
+        *file_inode = cached_inode;
+        return 0;
+    }
+
+    if (ext2_lite_get_inode(active_drive_desc, path, file_inode) != 0) {
+        return -1;
+    }
+
+    for (i = 0; path[i] && i < EXT2_LITE_MAX_PATH_LEN - 1; i++) {
+        cached_path[i] = path[i];
+    }
+    cached_path[path[i] ? 0 : i] = '\0';
+    cached_inode = *file_inode;
+    return 0;
+}
+
+/**
+ * Blocks of the file which follow each other on the disk are read with one
+ * request, right into @buf.
+ */
 int ext2_lite_read(drive_desc_t* drive_desc, char* path, uint8_t* buf, uint32_t from, uint32_t len)
 {
     active_drive_desc = drive_desc;
     inode_t inode;
-    ext2_lite_get_inode(drive_desc, path, &inode);
+    if (_ext2_lite_get_inode_cached(path, &inode) != 0) {
+        return -1;
+    }
 
     const uint32_t block_len = _ext2_lite_get_block_len();
-    uint32_t start_block_index = from / block_len;
-    uint32_t end_block_index = (from + len) / block_len;
+    uint32_t block_index = from / block_len;
     uint32_t read_offset = from % block_len;
-    uint32_t write_offset = 0;
 
-    for (uint32_t block_index = start_block_index; block_index <= end_block_index; block_index++) {
+    while (len != 0) {
         uint32_t data_block_index = _ext2_lite_get_block_of_file(&inode, block_index);
-        _ext2_lite_read(tmp_block_buf, _ext2_lite_get_offset_of_block(data_block_index), _ext2_lite_get_block_len());
-        for (int i = 0; i < _ext2_lite_min(len, block_len - read_offset); i++) {
-            buf[write_offset++] = tmp_block_buf[read_offset + i];
+        uint32_t run_blocks = 1;
+        uint32_t run_len = block_len - read_offset;
+        while (run_len < len && run_blocks < EXT2_LITE_MAX_RUN_BLOCKS && _ext2_lite_get_block_of_file(&inode, block_index + run_blocks) == data_block_index + run_blocks) {
+            run_blocks++;
+            run_len += block_len;
         }
-        len -= _ext2_lite_min(len, block_len - read_offset);
+
+        uint32_t chunk = _ext2_lite_min(run_len, len);
+        _ext2_lite_read(buf, _ext2_lite_get_offset_of_block(data_block_index) + read_offset, chunk);
+        buf += chunk;
+        len -= chunk;
+        block_index += run_blocks;
         read_offset = 0;
     }
-    if (len != 0) {
-        return -1;
-    }
     return 0;
-}
\ No newline at end of file
+}
@@ -5,6 +5,11 @@
 #include "fs_desc.h"
 
 #define SUPERBLOCK_START 1024
+
+/* Longest run of blocks ext2_lite_read brings with one disk request. */
+#define EXT2_LITE_MAX_RUN_BLOCKS 1024
+#define EXT2_LITE_MAX_PATH_LEN 64
+
 #define SUPERBLOCK_LEN (sizeof(superblock_t))
 typedef struct {
     uint32_t inodes_count;
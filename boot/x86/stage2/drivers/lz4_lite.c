@@ -0,0 +1,178 @@
+/**
+ * Lz4 Lite decompresses a kernel image packed in the LZ4 frame format.
+ * Checksums are not verified, the disk reads are trusted as they are.
+ */
+
+#include "lz4_lite.h"
+
+#define FLG_VERSION_MASK 0xC0
+#define FLG_VERSION 0x40
+#define FLG_BLOCK_CHECKSUM 0x10
+#define FLG_CONTENT_SIZE 0x08
+#define FLG_DICT_ID 0x01
+#define BLOCK_UNCOMPRESSED 0x80000000
+#define MIN_MATCH 4
+
+static uint32_t _lz4_lite_read32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t _lz4_lite_header_len(const uint8_t* src, uint32_t src_len)
+{
+    if (src_len < 7 || _lz4_lite_read32(src) != LZ4_LITE_FRAME_MAGIC) {
+        return 0;
+    }
+    uint8_t flg = src[4];
+    if ((flg & FLG_VERSION_MASK) != FLG_VERSION) {
+        return 0;
+    }
+    uint32_t len = 7;
+    if (flg & FLG_CONTENT_SIZE) {
+        len += 8;
+    }
+    if (flg & FLG_DICT_ID) {
+        len += 4;
+    }
+    return len <= src_len ? len : 0;
+}
+
+int lz4_lite_content_size(const uint8_t* src, uint32_t src_len, uint32_t* content_len)
+{
+    if (!_lz4_lite_header_len(src, src_len) || !(src[4] & FLG_CONTENT_SIZE)) {
+        return -1;
+    }
+    // Images above 4GB are not a thing here.
+    if (_lz4_lite_read32(src + 10)) {
+        return -1;
+    }
+    *content_len = _lz4_lite_read32(src + 6);
+    return 0;
+}
+
+// Lengths of 15 go on in the following bytes, each 255 says one more follows.
+static int _lz4_lite_read_len(const uint8_t** ip, const uint8_t* iend, uint32_t* len)
+{
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+/**
+ * A block is a list of sequences: a token, literals, then a 2 byte offset
+ * and the length of a match which is copied from the output. The last
+ * sequence has literals only. Copying moves forward, which keeps in place
+ * decoding safe since the input stays ahead of the output.
+ */
+static uint8_t* _lz4_lite_decompress_block(const uint8_t* ip, const uint8_t* iend, uint8_t* op, uint8_t* oend, const uint8_t* ostart)
+{
+    for (;;) {
+        if (ip >= iend) {
+            return 0;
+        }
+        uint8_t token = *ip++;
+
+        uint32_t lit_len = token >> 4;
+        if (lit_len == 15 && _lz4_lite_read_len(&ip, iend, &lit_len) != 0) {
+            return 0;
+        }
+        if (lit_len > (uint32_t)(iend - ip) || lit_len > (uint32_t)(oend - op)) {
+            return 0;
+        }
+        for (; lit_len >= 4; lit_len -= 4, ip += 4, op += 4) {
+            *(uint32_t*)op = *(const uint32_t*)ip;
+        }
+        while (lit_len--) {
+            *op++ = *ip++;
+        }
+
+        if (ip == iend) {
+            return op;
+        }
+        if (iend - ip < 2) {
+            return 0;
+        }
+
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > (uint32_t)(op - ostart)) {
+            return 0;
+        }
+
+        uint32_t match_len = token & 15;
+        if (match_len == 15 && _lz4_lite_read_len(&ip, iend, &match_len) != 0) {
+            return 0;
+        }
+        match_len += MIN_MATCH;
+        if (match_len > (uint32_t)(oend - op)) {
+            return 0;
+        }
+
+        const uint8_t* match = op - offset;
+        if (offset >= 4) {
+            for (; match_len >= 4; match_len -= 4, match += 4, op += 4) {
+                *(uint32_t*)op = *(const uint32_t*)match;
+            }
+        }
+        while (match_len--) {
+            *op++ = *match++;
+        }
+    }
+}
+
+// Returns the count of bytes written to @dst or -1 if the frame is broken.
+int lz4_lite_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len)
+{
+    uint32_t header_len = _lz4_lite_header_len(src, src_len);
+    if (!header_len) {
+        return -1;
+    }
+
+    bool has_block_checksum = (src[4] & FLG_BLOCK_CHECKSUM) != 0;
+    const uint8_t* ip = src + header_len;
+    const uint8_t* iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_len;
+
+    // Blocks are decompressed into one buffer, so linked blocks find their matches too.
+    for (;;) {
+        if (iend - ip < 4) {
+            return -1;
+        }
+        uint32_t block_len = _lz4_lite_read32(ip);
+        ip += 4;
+        if (!block_len) {
+            return op - dst;
+        }
+
+        uint32_t data_len = block_len & ~BLOCK_UNCOMPRESSED;
+        if (data_len > (uint32_t)(iend - ip)) {
+            return -1;
+        }
+
+        if (block_len & BLOCK_UNCOMPRESSED) {
+            if (data_len > (uint32_t)(oend - op)) {
+                return -1;
+            }
+            for (uint32_t i = 0; i < data_len; i++) {
+                *op++ = ip[i];
+            }
+        } else {
+            op = _lz4_lite_decompress_block(ip, ip + data_len, op, oend, dst);
+            if (!op) {
+                return -1;
+            }
+        }
+
+        ip += data_len;
+        if (has_block_checksum) {
+            ip += 4;
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../types.h"
+
+/**
+ * Decoder of the LZ4 frame format, as `lz4 --content-size` writes it. The
+ * frame has to carry the content size, so the image can be decompressed in
+ * place: the compressed data is put at the end of a buffer of
+ * LZ4_LITE_INPLACE_BUF_LEN and decompressed to its start.
+ */
+#define LZ4_LITE_FRAME_MAGIC 0x184D2204
+#define LZ4_LITE_MAX_HEADER_LEN 19
+#define LZ4_LITE_INPLACE_MARGIN(packed_len) (((packed_len) >> 8) + 32)
+#define LZ4_LITE_INPLACE_BUF_LEN(content_len, packed_len) \
+    ((content_len) + LZ4_LITE_INPLACE_MARGIN(packed_len) > (packed_len) ? (content_len) + LZ4_LITE_INPLACE_MARGIN(packed_len) : (packed_len))
+
+int lz4_lite_content_size(const uint8_t* src, uint32_t src_len, uint32_t* content_len);
+int lz4_lite_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len);
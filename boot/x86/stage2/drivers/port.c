@@ -80,6 +80,14 @@ void port_16bit_out(unsigned short port, unsigned short data)
                  : "a"(data), "d"(port));
 }
 
+void port_16bit_in_rep(unsigned short port, void* buf, unsigned int count)
+{
+    asm volatile("rep insw"
+                 : "+D"(buf), "+c"(count)
+                 : "d"(port)
+                 : "memory");
+}
+
 unsigned int port_32bit_in(unsigned short port)
 {
     unsigned int result_data;
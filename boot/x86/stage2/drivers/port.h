@@ -10,6 +10,7 @@ unsigned char port_8bit_in(unsigned short port);
 void port_8bit_out(unsigned short port, unsigned char data);
 unsigned short port_16bit_in(unsigned short port);
 void port_16bit_out(unsigned short port, unsigned short data);
+void port_16bit_in_rep(unsigned short port, void* buf, unsigned int count);
 unsigned int port_32bit_in(unsigned short port);
 void port_32bit_out(unsigned short port, unsigned int data);
 void io_wait();
\ No newline at end of file
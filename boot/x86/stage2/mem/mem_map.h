@@ -14,4 +14,6 @@ typedef struct {
 typedef struct {
     uint16_t memory_map_size;
     uint16_t kernel_size;
+    uint32_t initrd_start; /* Physical address of the initramfs image, if any. */
+    uint32_t initrd_size;
 } mem_desc_t;
\ No newline at end of file
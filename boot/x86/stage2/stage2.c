@@ -9,6 +9,7 @@
 #include "drivers/elf_lite.h"
 #include "drivers/ext2_lite.h"
 #include "drivers/fs_desc.h"
+#include "drivers/lz4_lite.h"
 #include "mem/mem_map.h"
 #include "mem/vm.h"
 #include "types.h"
@@ -31,6 +32,50 @@ int get_fs_of_disk(drive_desc_t* drive_desc, fs_desc_t* fs_desc)
     return -1;
 }
 
+static uint8_t* kernel_image;
+static uint32_t kernel_image_size;
+
+// Lets elf_lite read the decompressed image as if it was the file.
+int kernel_image_read(drive_desc_t* drive_desc, char* path, uint8_t* buf, uint32_t from, uint32_t len)
+{
+    if (from > kernel_image_size || len > kernel_image_size - from) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        buf[i] = kernel_image[from + i];
+    }
+    return 0;
+}
+
+int load_packed_kernel(drive_desc_t* drive_desc, fs_desc_t* image_fs_desc)
+{
+    inode_t packed_inode;
+    if (ext2_lite_get_inode(drive_desc, KERNEL_LZ4_PATH, &packed_inode) != 0 || !packed_inode.size) {
+        return -1;
+    }
+
+    uint8_t header[LZ4_LITE_MAX_HEADER_LEN];
+    uint32_t header_len = packed_inode.size < LZ4_LITE_MAX_HEADER_LEN ? packed_inode.size : LZ4_LITE_MAX_HEADER_LEN;
+    if (ext2_lite_read(drive_desc, KERNEL_LZ4_PATH, header, 0, header_len) != 0) {
+        return -1;
+    }
+    if (lz4_lite_content_size(header, header_len, &kernel_image_size) != 0) {
+        return -1;
+    }
+
+    kernel_image = (uint8_t*)KERNEL_IMAGE_BASE;
+    uint8_t* packed = kernel_image + LZ4_LITE_INPLACE_BUF_LEN(kernel_image_size, packed_inode.size) - packed_inode.size;
+    if (ext2_lite_read(drive_desc, KERNEL_LZ4_PATH, packed, 0, packed_inode.size) != 0) {
+        return -1;
+    }
+    if (lz4_lite_decompress(packed, packed_inode.size, kernel_image, kernel_image_size) != kernel_image_size) {
+        return -1;
+    }
+
+    image_fs_desc->read = kernel_image_read;
+    return 0;
+}
+
 void stage2(mem_desc_t* mem_desc)
 {
     clean_screen();
@@ -56,11 +101,29 @@ void stage2(mem_desc_t* mem_desc)
     // read_kernel(&drive_desc, KERNEL_PATH, (uint8_t*)KERNEL_BASE, 0, 128);
 
     uint32_t kernel_size;
-    printd(elf_load_kernel(&drive_desc, &fs_desc, KERNEL_PATH, &kernel_size));
+    fs_desc_t image_fs_desc;
+    if (load_packed_kernel(&drive_desc, &image_fs_desc) == 0) {
+        printf("LZ4\n");
+        printd(elf_load_kernel(&drive_desc, &image_fs_desc, KERNEL_LZ4_PATH, &kernel_size));
+    } else {
+        printd(elf_load_kernel(&drive_desc, &fs_desc, KERNEL_PATH, &kernel_size));
+    }
 
     // TODO fix
     mem_desc->kernel_size = kernel_size / 1024 + 1;
 
+    // The initramfs image is optional, the kernel boots from the disk without it.
+    inode_t initrd_inode;
+    mem_desc->initrd_start = 0;
+    mem_desc->initrd_size = 0;
+    if (ext2_lite_get_inode(&drive_desc, INITRD_PATH, &initrd_inode) == 0 && initrd_inode.size) {
+        printf("INITRD\n");
+        if (ext2_lite_read(&drive_desc, INITRD_PATH, (uint8_t*)INITRD_BASE, 0, initrd_inode.size) == 0) {
+            mem_desc->initrd_start = INITRD_BASE;
+            mem_desc->initrd_size = initrd_inode.size;
+        }
+    }
+
     vm_setup();
 
     // enabling paging
@@ -21,7 +21,7 @@ if arch == "x86":
 if arch == "aarch32":
     QEMU_PATH_ENV_VAR = "PRANAOS_QEMU_ARM"
     QEMU_STD_PATH = "qemu-system-arm"
-    qemu_run_cmd = "${2} -M vexpress-a15 -cpu cortex-a15 -kernel {1}/base/boot/kernel.bin  -smp ${3} -serial mon:stdio -vga std -drive id=disk,if=sd,format=raw,file={1}/pranaos.img".format(
+    qemu_run_cmd = "${2} -M vexpress-a15 -cpu cortex-a15 -kernel {1}/base/boot/kernel.bin  -smp ${3} -serial mon:stdio -vga std -drive id=disk,if=sd,format=raw,file={1}/pranaos.img -device loader,file={1}/initrd.img,addr=0x84000000,force-raw=on".format(
         base, out, QEMU_PATH_VAR, QEMU_SMP_VAR)
 
 if base[-1] == '/':
@@ -48,6 +48,17 @@ sudo mkdir -p {0}/mountpoint/dev
 sudo mkdir -p {0}/mountpoint/tmp
 sudo cp -r {0}/base/* {0}/mountpoint/
 sudo cp -r {1}/base/* {0}/mountpoint/
+rm -rf {1}/initrd
+mkdir -p {1}/initrd/proc {1}/initrd/dev {1}/initrd/tmp {1}/initrd/disk
+cp -r {0}/base/* {1}/initrd/
+cp -r {1}/base/* {1}/initrd/
+rm -rf {1}/initrd/boot
+(cd {1}/initrd && find . | cpio -o -H newc -R 0:0 --quiet > {1}/initrd.img)
+if [ $? -ne 0 ]; then echo -e "${{ERROR}} Can't pack {1}/initrd.img" && exit 1; fi
+sudo cp {1}/initrd.img {0}/mountpoint/boot/initrd.img
+# stage2 loads the packed kernel if it's present, it must never be stale.
+sudo rm -f {0}/mountpoint/boot/kernel.lz4
+if command -v lz4 > /dev/null && [ -f {1}/base/boot/kernel.bin ]; then sudo lz4 -q -9 -f --content-size {1}/base/boot/kernel.bin {0}/mountpoint/boot/kernel.lz4; fi
 sudo umount {0}/mountpoint
 if [ $? -ne 0 ]; then echo -e "${{ERROR}} Can't umount {0}/mountpoint" && exit 1; fi
 echo -e "${{SUCCESS}} Sync"
@@ -21,4 +21,5 @@ int bitmap_find_space_aligned(bitmap_t bitmap, int req, int alignment);
 int bitmap_set(bitmap_t bitmap, int where);
 int bitmap_unset(bitmap_t bitmap, int where);
 int bitmap_set_range(bitmap_t bitmap, int start, int len);
-int bitmap_unset_range(bitmap_t bitmap, int start, int len);
\ No newline at end of file
+int bitmap_unset_range(bitmap_t bitmap, int start, int len);
+bool bitmap_is_range_unset(bitmap_t bitmap, int start, int len);
\ No newline at end of file
@@ -31,4 +31,6 @@ int dynamic_array_free(dynamic_array_t* v);
 void* dynamic_array_get(dynamic_array_t* v, int index);
 int dynamic_array_push(dynamic_array_t* v, void* element);
 int dynamic_array_pop(dynamic_array_t* v);
+int dynamic_array_insert(dynamic_array_t* v, int index, void* element);
+int dynamic_array_remove(dynamic_array_t* v, int index);
 int dynamic_array_clear(dynamic_array_t* v);
\ No newline at end of file
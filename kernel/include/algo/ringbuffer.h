@@ -26,6 +26,7 @@ void ringbuffer_free(ringbuffer_t* buf);
 uint32_t ringbuffer_space_to_read(ringbuffer_t* buf);
 uint32_t ringbuffer_space_to_read_with_custom_start(ringbuffer_t* buf, uint32_t start);
 uint32_t ringbuffer_space_to_write(ringbuffer_t* buf);
+uint32_t ringbuffer_space_to_read_until(ringbuffer_t* buf, uint8_t stop);
 uint32_t ringbuffer_read(ringbuffer_t* buf, uint8_t*, uint32_t);
 uint32_t ringbuffer_read_with_start(ringbuffer_t* buf, uint32_t start, uint8_t* holder, uint32_t siz);
 uint32_t ringbuffer_write(ringbuffer_t* buf, const uint8_t*, uint32_t);
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <algo/ringbuffer.h>
+#include <libkern/atomic.h>
+#include <libkern/libkern.h>
+
+/**
+ * Ringbuffer with one producer and one consumer which needs no lock: only
+ * the producer moves end and only the consumer moves start. Fits buffers
+ * filled from an irq and drained by a single reader.
+ */
+struct __spsc_ringbuffer {
+    ringbuffer_t ringbuffer;
+};
+typedef struct __spsc_ringbuffer spsc_ringbuffer_t;
+
+static ALWAYS_INLINE spsc_ringbuffer_t spsc_ringbuffer_create(uint32_t size)
+{
+    spsc_ringbuffer_t res;
+    res.ringbuffer = ringbuffer_create(size);
+    return res;
+}
+
+#define spsc_ringbuffer_create_std() spsc_ringbuffer_create(RINGBUFFER_STD_SIZE)
+static ALWAYS_INLINE void spsc_ringbuffer_free(spsc_ringbuffer_t* buf)
+{
+    ringbuffer_free(&buf->ringbuffer);
+}
+
+/* Takes a snapshot with the index owned by the other side loaded atomically. */
+static ALWAYS_INLINE ringbuffer_t _spsc_ringbuffer_view(spsc_ringbuffer_t* buf)
+{
+    ringbuffer_t view = buf->ringbuffer;
+    view.start = atomic_load(&buf->ringbuffer.start);
+    view.end = atomic_load(&buf->ringbuffer.end);
+    return view;
+}
+
+static ALWAYS_INLINE uint32_t spsc_ringbuffer_space_to_read(spsc_ringbuffer_t* buf)
+{
+    ringbuffer_t view = _spsc_ringbuffer_view(buf);
+    return ringbuffer_space_to_read(&view);
+}
+
+static ALWAYS_INLINE uint32_t spsc_ringbuffer_space_to_write(spsc_ringbuffer_t* buf)
+{
+    ringbuffer_t view = _spsc_ringbuffer_view(buf);
+    return ringbuffer_space_to_write(&view);
+}
+
+/* Consumer side. The data is copied out before start is published. */
+static ALWAYS_INLINE uint32_t spsc_ringbuffer_read(spsc_ringbuffer_t* buf, uint8_t* holder, uint32_t siz)
+{
+    ringbuffer_t view = _spsc_ringbuffer_view(buf);
+    uint32_t res = ringbuffer_read(&view, holder, siz);
+    atomic_store(&buf->ringbuffer.start, view.start);
+    return res;
+}
+
+/* Producer side. The data is copied in before end is published. */
+static ALWAYS_INLINE uint32_t spsc_ringbuffer_write(spsc_ringbuffer_t* buf, const uint8_t* holder, uint32_t siz)
+{
+    ringbuffer_t view = _spsc_ringbuffer_view(buf);
+    uint32_t res = ringbuffer_write(&view, holder, siz);
+    atomic_store(&buf->ringbuffer.end, view.end);
+    return res;
+}
@@ -55,6 +55,13 @@ static ALWAYS_INLINE uint32_t sync_ringbuffer_space_to_write(sync_ringbuffer_t*
     lock_release(&buf->lock);
     return res;
 }
+static ALWAYS_INLINE uint32_t sync_ringbuffer_space_to_read_until(sync_ringbuffer_t* buf, uint8_t stop)
+{
+    lock_acquire(&buf->lock);
+    uint32_t res = ringbuffer_space_to_read_until(&buf->ringbuffer, stop);
+    lock_release(&buf->lock);
+    return res;
+}
 static ALWAYS_INLINE uint32_t sync_ringbuffer_read(sync_ringbuffer_t* buf, uint8_t* v, uint32_t a)
 {
     lock_acquire(&buf->lock);
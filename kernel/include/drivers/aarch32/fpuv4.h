@@ -15,6 +15,7 @@
 
 typedef struct {
     uint64_t d[32];
+    uint32_t fpscr;
 } fpu_state_t;
 
 void fpuv4_install();
@@ -67,6 +67,8 @@ struct gicv2_cpu_interface_registers {
 typedef struct gicv2_cpu_interface_registers gicv2_cpu_interface_registers_t;
 
 void gicv2_enable_irq(irq_line_t id, irq_priority_t prior, irq_type_t type, int cpu_mask);
+void gicv2_set_affinity(irq_line_t id, int cpu_mask);
+int gicv2_this_cpu_mask();
 void gicv2_install();
 void gicv2_install_secondary_cpu();
 uint32_t gicv2_interrupt_descriptor();
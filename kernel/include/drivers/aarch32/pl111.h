@@ -23,6 +23,14 @@ enum PL111RegisterMasks {
     MASKDEFINE(LCD_BW, 4, 1),
     MASKDEFINE(LCD_BPP, 1, 3),
     MASKDEFINE(LCD_EN, 0, 1),
+
+    MASKDEFINE(CRSR_ON, 0, 1),
+    MASKDEFINE(CRSR_SIZE, 0, 1),
+    MASKDEFINE(CRSR_FRAME_SYNC, 1, 1),
+    MASKDEFINE(CRSR_X, 0, 12),
+    MASKDEFINE(CRSR_Y, 16, 12),
+    MASKDEFINE(CRSR_CLIP_X, 0, 6),
+    MASKDEFINE(CRSR_CLIP_Y, 8, 6),
 };
 
 enum PL111Consts {
@@ -30,6 +38,17 @@ enum PL111Consts {
     NUM_PALETTE_WORDS = 0x378,
     LCD_16_BPP = 4, // Register constant for 16 bits per pixel
     LCD_24_BPP = 5, // Register constant for 24 bits per pixel
+    LCD_16_BPP_565 = 6, // Register constant for 16 bits per pixel, 5:6:5
+    CRSR_IMAGE_WORDS = 256,
+    CRSR_DIMENSION = 64, // The image is 64x64 with CRSR_SIZE set.
+};
+
+/* Cursor pixels take 2 bits each. */
+enum PL111CursorPixels {
+    CRSR_PIXEL_COLOR0 = 0,
+    CRSR_PIXEL_COLOR1 = 1,
+    CRSR_PIXEL_TRANSPARENT = 2,
+    CRSR_PIXEL_INVERTED = 3,
 };
 
 struct pl111_registers {
@@ -46,7 +65,19 @@ struct pl111_registers {
     uint32_t lcd_icr;
     uint32_t lcd_upcurr;
     uint32_t lcd_lpcurr;
-    // TO BE CONTINUED
+    uint32_t reserved_0[0x1f3];
+    uint32_t crsr_image[CRSR_IMAGE_WORDS];
+    uint32_t crsr_ctrl;
+    uint32_t crsr_config;
+    uint32_t crsr_palette_0;
+    uint32_t crsr_palette_1;
+    uint32_t crsr_xy;
+    uint32_t crsr_clip;
+    uint32_t reserved_1[2];
+    uint32_t crsr_imsc;
+    uint32_t crsr_icr;
+    uint32_t crsr_ris;
+    uint32_t crsr_mis;
 };
 typedef struct pl111_registers pl111_registers_t;
 
@@ -12,6 +12,12 @@
 #include <platform/aarch32/target/cortex-a15/device_settings.h>
 
 #define PL181_SECTOR_SIZE 512
+#define PL181_SECTOR_SIZE_LOG2 9
+
+/* data_length is 16 bits wide, a command moves up to this many blocks. */
+#define PL181_MAX_BLOCKS_PER_CMD 64
+#define PL181_FIFO_HALF_WORDS 8
+#define PL181_DATA_TIMEOUT 0xFFFFFFFF
 
 enum PL181CommandMasks {
     MASKDEFINE(MMC_CMD_IDX, 0, 6),
@@ -24,14 +30,30 @@ enum PL181CommandMasks {
 
 enum PL181StatusMasks {
     MASKDEFINE(MMC_STAT_CRC_FAIL, 0, 1),
+    MASKDEFINE(MMC_STAT_DATA_CRC_FAIL, 1, 1),
     MASKDEFINE(MMC_STAT_CMD_TIMEOUT, 2, 1),
+    MASKDEFINE(MMC_STAT_DATA_TIMEOUT, 3, 1),
+    MASKDEFINE(MMC_STAT_TX_UNDERRUN, 4, 1),
+    MASKDEFINE(MMC_STAT_RX_OVERRUN, 5, 1),
     MASKDEFINE(MMC_STAT_CMD_RESP_END, 6, 1),
     MASKDEFINE(MMC_STAT_CMD_SENT, 7, 1),
+    MASKDEFINE(MMC_STAT_DATA_END, 8, 1),
     MASKDEFINE(MMC_STAT_CMD_ACTIVE, 11, 1),
+    MASKDEFINE(MMC_STAT_TX_FIFO_HALF_EMPTY, 14, 1),
+    MASKDEFINE(MMC_STAT_RX_FIFO_HALF_FULL, 15, 1),
+    MASKDEFINE(MMC_STAT_TX_FIFO_FULL, 16, 1),
     MASKDEFINE(MMC_STAT_TRANSMIT_FIFO_EMPTY, 18, 1),
     MASKDEFINE(MMC_STAT_FIFO_DATA_AVAIL_TO_READ, 21, 1),
 };
 
+#define MMC_STAT_DATA_ERRORS_MASK (MMC_STAT_DATA_CRC_FAIL_MASK | MMC_STAT_DATA_TIMEOUT_MASK | MMC_STAT_TX_UNDERRUN_MASK | MMC_STAT_RX_OVERRUN_MASK)
+
+enum PL181DataControlMasks {
+    MASKDEFINE(MMC_DATA_ENABLE, 0, 1),
+    MASKDEFINE(MMC_DATA_FROM_CARD, 1, 1),
+    MASKDEFINE(MMC_DATA_BLOCK_SIZE, 4, 4),
+};
+
 enum PL181Commands {
     CMD_GO_IDLE_STATE = 0,
     CMD_ALL_SEND_CID = 2,
@@ -39,9 +61,12 @@ enum PL181Commands {
     CMD_SELECT = 7,
     CMD_SEND_CSD = 9,
     CMD_SEND_CID = 10,
+    CMD_STOP_TRANSMISSION = 12,
     CMD_SET_SECTOR_SIZE = 16,
     CMD_READ_SINGLE_BLOCK = 17,
+    CMD_READ_MULTIPLE_BLOCK = 18,
     CMD_WRITE_SINGLE_BLOCK = 24,
+    CMD_WRITE_MULTIPLE_BLOCK = 25,
     CMD_SD_SEND_OP_COND = 41,
     CMD_APP_CMD = 55,
 };
@@ -37,4 +37,7 @@ struct sp804_registers {
 };
 typedef struct sp804_registers sp804_registers_t;
 
-void sp804_install();
\ No newline at end of file
+void sp804_install();
+void sp804_stop_ticks(uint32_t ticks);
+uint32_t sp804_resume_ticks();
+uint32_t sp804_read_counter();
\ No newline at end of file
@@ -6,11 +6,27 @@
 
 #pragma once
 
+#include <drivers/driver_manager.h>
 #include <libkern/types.h>
+#include <platform/aarch32/target/cortex-a15/device_settings.h>
 
-#define COM1 0x1c090000
+#define COM1 UART_BASE
+
+/* PL011 registers, as indexes of 32 bit words. */
+#define UART_DR (0x00 / 4)
+#define UART_FR (0x18 / 4)
+#define UART_IFLS (0x34 / 4)
+#define UART_IMSC (0x38 / 4)
+#define UART_ICR (0x44 / 4)
+
+#define UART_FR_RXFE (1 << 4)
+#define UART_FR_TXFF (1 << 5)
+#define UART_INT_RX (1 << 4)
+#define UART_INT_TX (1 << 5)
+#define UART_INT_RT (1 << 6)
 
 void uart_setup();
 void uart_remap();
+void uart_install();
 int uart_write(int port, uint8_t data);
 int uart_read(int port, uint8_t* data);
\ No newline at end of file
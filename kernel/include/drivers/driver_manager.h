@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <libkern/lock.h>
 #include <libkern/types.h>
 
 #define MINORBITS 20
@@ -74,8 +75,58 @@ enum DRIVER_STORAGE_OPERTAION {
     DRIVER_STORAGE_WRITE,
     DRIVER_STORAGE_FLUSH,
     DRIVER_STORAGE_CAPACITY,
+    DRIVER_STORAGE_READ_SECTORS, // optional, see storage_request_t
+    DRIVER_STORAGE_WRITE_SECTORS, // optional, see storage_request_t
 };
 
+/**
+ * Storage request moves count sectors starting at lba in one call.
+ * The data is scattered over segments, every segment holds a whole
+ * number of sectors and their total length is count sectors.
+ * Drivers serve it with int (*)(device_t*, storage_request_t*).
+ */
+#define STORAGE_SECTOR_SIZE (512)
+
+typedef struct {
+    uint8_t* data;
+    uint32_t len;
+} storage_segment_t;
+
+struct storage_request {
+    uint32_t lba;
+    uint32_t count;
+    uint32_t segments_count;
+    storage_segment_t* segments;
+
+    /* Queue data, drivers don't look at it. */
+    bool write;
+    void (*callback)(struct storage_request* req, int status);
+    void* callback_arg;
+    uint32_t deadline;
+    struct storage_request* next;
+};
+typedef struct storage_request storage_request_t;
+
+/**
+ * Every storage device has a queue of submitted requests. The queue is
+ * served in the ascending order of lba starting at the last served
+ * position (C-LOOK), a request which has waited for STORAGE_QUEUE_DEADLINE
+ * dispatches is served first. Adjacent requests of the same direction
+ * are merged into one driver request.
+ */
+#define STORAGE_QUEUE_DEADLINE (16)
+#define STORAGE_QUEUE_MAX_MERGE_SEGMENTS (32)
+#define STORAGE_QUEUE_MAX_MERGE_SECTORS (256)
+
+struct storage_queue {
+    lock_t lock;
+    lock_t dispatch_lock;
+    storage_request_t* head; /* Sorted by lba. */
+    uint32_t last_lba;
+    uint32_t dispatches;
+};
+typedef struct storage_queue storage_queue_t;
+
 // Api function of DRIVER_INPUT_SYSTEMS type
 enum DRIVER_INPUT_SYSTEMS_OPERTAION {
     DRIVER_INPUT_SYSTEMS_ADD_DEVICE = 0x1, // function called when a device is found
@@ -122,6 +173,7 @@ enum DRIVER_FILE_SYSTEM_OPERTAION {
     DRIVER_FILE_SYSTEM_FSTAT,
     DRIVER_FILE_SYSTEM_IOCTL,
     DRIVER_FILE_SYSTEM_MMAP,
+    DRIVER_FILE_SYSTEM_READAHEAD,
 };
 
 typedef struct {
@@ -161,14 +213,32 @@ typedef struct {
     uint32_t args[4];
 } device_desc_t; // device desriptor
 
+struct storage_ops;
+
 typedef struct {
     uint8_t id;
     uint8_t type;
     bool is_virtual;
     int16_t driver_id;
     device_desc_t device_desc;
+    const struct storage_ops* storage_ops; // NULL unless a storage driver serves the device
 } device_t; // device
 
+/**
+ * Storage functions of the driver of a device, resolved once when the
+ * device is installed. I/O paths call through it instead of looking the
+ * functions up in the driver's table on every request. read_sectors and
+ * write_sectors are optional, capacity is in bytes.
+ */
+struct storage_ops {
+    int (*read)(device_t* dev, uint32_t sector, uint8_t* data);
+    int (*write)(device_t* dev, uint32_t sector, uint8_t* data, uint32_t size);
+    uint32_t (*capacity)(device_t* dev);
+    int (*read_sectors)(device_t* dev, storage_request_t* req);
+    int (*write_sectors)(device_t* dev, storage_request_t* req);
+};
+typedef struct storage_ops storage_ops_t;
+
 extern driver_t drivers[MAX_DRIVERS_COUNT];
 extern device_t devices[MAX_DEVICES_COUNT];
 
@@ -186,6 +256,11 @@ device_t* new_virtual_device(uint8_t type);
 int dm_get_driver_id_by_name();
 void dm_send_notification(uint32_t msg, uint32_t param);
 
+void dm_storage_submit(device_t* dev, storage_request_t* req);
+void dm_storage_unplug(device_t* dev);
+int dm_storage_read(device_t* dev, storage_request_t* req);
+int dm_storage_write(device_t* dev, storage_request_t* req);
+
 static inline void* dm_driver_function(int driver_id, int function_id)
 {
     return drivers[driver_id].desc.functions[function_id];
@@ -181,9 +181,11 @@ typedef uint32_t key_t;
 /* The keyboard packet should be aligned to 4 bytes */
 struct kbd_packet {
     key_t key;
+    uint32_t time_ms; /* Since boot. */
 };
 typedef struct kbd_packet kbd_packet_t;
 
 int generic_keyboard_create_devfs();
 void generic_keyboard_init();
-void generic_emit_key_set1(uint32_t scancode);
\ No newline at end of file
+void generic_emit_key_set1(uint32_t scancode);
+void generic_queue_key_set1(uint8_t scancode);
\ No newline at end of file
@@ -6,11 +6,18 @@
 
 #pragma once
 
+#include <libkern/types.h>
+
 /* The mouse packet should be aligned to 4 bytes */
 struct mouse_packet {
     int16_t x_offset;
     int16_t y_offset;
     uint16_t button_states;
     int16_t wheel_data;
+    uint32_t time_ms; /* Since boot, of the latest motion merged into it. */
 };
-typedef struct mouse_packet mouse_packet_t;
\ No newline at end of file
+typedef struct mouse_packet mouse_packet_t;
+
+int generic_mouse_create_devfs();
+void generic_mouse_init();
+void generic_mouse_emit(mouse_packet_t* packet);
@@ -1,5 +1,28 @@
+#pragma once
+
 #ifdef __i386__
 #include <drivers/x86/uart.h>
 #elif __arm__
 #include <drivers/aarch32/uart.h>
-#endif
\ No newline at end of file
+#endif
+
+#include <libkern/types.h>
+
+/**
+ * Buffered side of the console UART. Writes are queued in a ring which the
+ * TX interrupt moves to the FIFO, received bytes are kept in another ring
+ * and read through /dev/ttyS0. Until generic_uart_init() is called writes
+ * go to the UART straight away.
+ */
+void generic_uart_init();
+int generic_uart_create_devfs();
+void generic_uart_irq();
+uint32_t uart_write_buffered(const uint8_t* data, uint32_t len);
+void uart_flush_sync();
+
+/* Implemented by the platform driver, they act on the console UART. */
+bool uart_hw_tx_full();
+void uart_hw_put(uint8_t data);
+bool uart_hw_rx_ready();
+uint8_t uart_hw_get();
+void uart_hw_set_tx_irq(bool enabled);
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <drivers/driver_manager.h>
+#include <libkern/c_attrs.h>
+#include <libkern/lock.h>
+#include <libkern/types.h>
+
+#define AHCI_PCI_CLASS 0x01
+#define AHCI_PCI_SUBCLASS 0x06
+#define AHCI_ABAR 5
+
+#define AHCI_MAX_CONTROLLERS 4
+#define AHCI_MAX_PORTS 32
+
+/* Generic host control */
+#define AHCI_CAP_NCS(cap) ((((cap) >> 8) & 0x1f) + 1)
+#define AHCI_CAP_SNCQ (1 << 30)
+#define AHCI_GHC_IE (1 << 1)
+#define AHCI_GHC_AE (1u << 31)
+
+/* Port registers */
+#define AHCI_PORT_CMD_ST (1 << 0)
+#define AHCI_PORT_CMD_FRE (1 << 4)
+#define AHCI_PORT_CMD_FR (1 << 14)
+#define AHCI_PORT_CMD_CR (1 << 15)
+
+#define AHCI_PORT_IS_DHRS (1 << 0)
+#define AHCI_PORT_IS_PSS (1 << 1)
+#define AHCI_PORT_IS_SDBS (1 << 3)
+#define AHCI_PORT_IS_IFS (1 << 27)
+#define AHCI_PORT_IS_HBDS (1 << 28)
+#define AHCI_PORT_IS_HBFS (1 << 29)
+#define AHCI_PORT_IS_TFES (1 << 30)
+#define AHCI_PORT_IS_ERRORS (AHCI_PORT_IS_IFS | AHCI_PORT_IS_HBDS | AHCI_PORT_IS_HBFS | AHCI_PORT_IS_TFES)
+
+#define AHCI_PORT_SSTS_DET_PRESENT 0x3
+#define AHCI_PORT_SIG_ATA 0x00000101
+
+#define ATA_STATUS_ERR (1 << 0)
+#define ATA_STATUS_DRQ (1 << 3)
+#define ATA_STATUS_BSY (1 << 7)
+
+enum ATA_COMMANDS {
+    ATA_CMD_READ_DMA_EXT = 0x25,
+    ATA_CMD_WRITE_DMA_EXT = 0x35,
+    ATA_CMD_READ_FPDMA_QUEUED = 0x60,
+    ATA_CMD_WRITE_FPDMA_QUEUED = 0x61,
+    ATA_CMD_IDENTIFY = 0xec,
+    ATA_CMD_FLUSH_CACHE_EXT = 0xea,
+};
+
+struct ahci_port_regs {
+    uint32_t clb;
+    uint32_t clbu;
+    uint32_t fb;
+    uint32_t fbu;
+    uint32_t is;
+    uint32_t ie;
+    uint32_t cmd;
+    uint32_t reserved0;
+    uint32_t tfd;
+    uint32_t sig;
+    uint32_t ssts;
+    uint32_t sctl;
+    uint32_t serr;
+    uint32_t sact;
+    uint32_t ci;
+    uint32_t sntf;
+    uint32_t fbs;
+    uint32_t reserved1[11];
+    uint32_t vendor[4];
+};
+typedef struct ahci_port_regs ahci_port_regs_t;
+
+struct ahci_hba_regs {
+    uint32_t cap;
+    uint32_t ghc;
+    uint32_t is;
+    uint32_t pi;
+    uint32_t vs;
+    uint32_t ccc_ctl;
+    uint32_t ccc_pts;
+    uint32_t em_loc;
+    uint32_t em_ctl;
+    uint32_t cap2;
+    uint32_t bohc;
+    uint8_t reserved[0xa0 - 0x2c];
+    uint8_t vendor[0x100 - 0xa0];
+    ahci_port_regs_t ports[AHCI_MAX_PORTS];
+};
+typedef struct ahci_hba_regs ahci_hba_regs_t;
+
+#define AHCI_FIS_TYPE_REG_H2D 0x27
+#define AHCI_FIS_H2D_COMMAND (1 << 7)
+
+struct PACKED ahci_fis_reg_h2d {
+    uint8_t fis_type;
+    uint8_t flags;
+    uint8_t command;
+    uint8_t featurel;
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t featureh;
+    uint8_t countl;
+    uint8_t counth;
+    uint8_t icc;
+    uint8_t control;
+    uint8_t reserved[4];
+};
+typedef struct ahci_fis_reg_h2d ahci_fis_reg_h2d_t;
+
+#define AHCI_CMD_HEADER_WRITE (1 << 6)
+
+struct PACKED ahci_cmd_header {
+    uint16_t flags; /* Length of the command FIS in dwords and the W bit. */
+    uint16_t prdtl;
+    uint32_t prdbc;
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t reserved[4];
+};
+typedef struct ahci_cmd_header ahci_cmd_header_t;
+
+struct PACKED ahci_prdt_entry {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc; /* Byte count minus one. */
+};
+typedef struct ahci_prdt_entry ahci_prdt_entry_t;
+
+struct PACKED ahci_cmd_table {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    ahci_prdt_entry_t prdt[1];
+};
+typedef struct ahci_cmd_table ahci_cmd_table_t;
+
+/**
+ * Every port takes a page for its command list (1KB) and FIS receive area,
+ * a page for the command tables, 256 bytes each, and a bounce buffer of
+ * AHCI_SLOT_BUF_SIZE per slot. Longer storage requests are cut into
+ * several slots which are in flight at once. With NCQ the drive may serve
+ * them in any order, without it the HBA issues them one by one.
+ */
+#define AHCI_MAX_SLOTS 16
+#define AHCI_SLOT_BUF_SIZE (32 * KB)
+#define AHCI_CMD_TABLE_SIZE 256
+#define AHCI_FIS_OFFSET 1024
+
+enum AHCI_SLOT_STATES {
+    AHCI_SLOT_FREE = 0,
+    AHCI_SLOT_BUSY,
+    AHCI_SLOT_DONE,
+};
+
+struct ahci_hba;
+
+struct ahci_port {
+    struct ahci_hba* hba;
+    volatile ahci_port_regs_t* regs;
+    int index;
+    uint32_t capacity;
+    bool ncq;
+    int slots;
+
+    volatile ahci_cmd_header_t* cmd_list;
+    uint32_t cmd_list_paddr;
+    uint8_t* tables;
+    uint32_t tables_paddr;
+    uint8_t* bufs;
+    uint32_t bufs_paddr;
+
+    uint32_t issued; /* Slots the port owns, taken with the lock. */
+    volatile uint8_t slot_state[AHCI_MAX_SLOTS];
+    volatile uint8_t slot_failed[AHCI_MAX_SLOTS];
+    lock_t lock;
+};
+typedef struct ahci_port ahci_port_t;
+
+struct ahci_hba {
+    volatile ahci_hba_regs_t* regs;
+    uint32_t cap;
+    uint8_t irq;
+    ahci_port_t* ports[AHCI_MAX_PORTS];
+};
+typedef struct ahci_hba ahci_hba_t;
+
+void ahci_install();
+void ahci_add_device(device_t* dev);
@@ -8,6 +8,7 @@
 
 #include <drivers/driver_manager.h>
 #include <drivers/x86/display.h>
+#include <libkern/c_attrs.h>
 #include <libkern/types.h>
 #include <mem/kmalloc.h>
 #include <platform/x86/port.h>
@@ -24,8 +25,30 @@ typedef struct { // LBA28 | LBA48
     uint32_t control;
 } ata_ports_t;
 
+/**
+ * Bus master DMA moves data between the drive and a physically contiguous
+ * buffer of ATA_DMA_BUF_SIZE, which is described by a PRD table. The buffer
+ * is 64KB aligned, so a single PRD never crosses a 64KB boundary.
+ */
+#define ATA_DMA_BUF_SIZE (64 * KB)
+#define ATA_DMA_MAX_SECTORS (ATA_DMA_BUF_SIZE / 512)
+
+struct PACKED ata_prd {
+    uint32_t paddr;
+    uint16_t len; // 0 means 64KB
+    uint16_t flags;
+};
+typedef struct ata_prd ata_prd_t;
+
+typedef struct {
+    uint32_t command; // 8 bit
+    uint32_t status; // 8 bit
+    uint32_t prdt; // 32 bit
+} ata_bus_master_ports_t;
+
 typedef struct {
     ata_ports_t port;
+    ata_bus_master_ports_t bm_port;
     bool is_master;
     uint16_t cylindres;
     uint16_t heads;
@@ -33,6 +56,12 @@ typedef struct {
     bool dma;
     bool lba;
     uint32_t capacity; // in sectors
+
+    /* DMA data */
+    ata_prd_t* prdt;
+    uint32_t prdt_paddr;
+    uint8_t* dma_buf;
+    uint32_t dma_buf_paddr;
 } ata_t;
 
 extern ata_t _ata_drives[MAX_DEVICES_COUNT];
@@ -41,4 +70,5 @@ void ata_add_new_device(device_t* t_new_device);
 
 void ata_install();
 void ata_init(ata_t* ata, uint32_t port, bool is_master);
+int ata_init_dma(ata_t* ata, uint32_t bm_port);
 bool ata_indentify(ata_t* ata);
\ No newline at end of file
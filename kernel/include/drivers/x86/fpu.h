@@ -15,6 +15,7 @@ typedef struct {
 
 void fpu_handler();
 void fpu_init();
+void fpu_init_secondary_cpu();
 void fpu_init_state(fpu_state_t* new_fpu_state);
 
 static inline void fpu_save(fpu_state_t* fpu_state)
@@ -41,10 +41,45 @@ typedef struct {
     uint8_t type;
 } bar_t;
 
+#define PCI_MAX_DEVICES (64)
+
+#define PCI_STATUS_CAP_LIST (1 << 4)
+#define PCI_CAP_ID_MSI 0x05
+#define PCI_CAP_ID_MSIX 0x11
+
+#define PCI_MSI_CTRL_ENABLE (1 << 0)
+#define PCI_MSI_CTRL_64BIT (1 << 7)
+#define PCI_MSIX_CTRL_FUNC_MASK (1 << 14)
+#define PCI_MSIX_CTRL_ENABLE (1 << 15)
+#define PCI_MSI_ADDRESS_BASE 0xfee00000
+
+enum PCI_IRQ_KIND {
+    PCI_IRQ_LEGACY = 0,
+    PCI_IRQ_MSI = 1,
+    PCI_IRQ_MSIX = 2,
+};
+
+/**
+ * Functions are enumerated once at boot, config space is not probed again
+ * to find a device or its capabilities.
+ */
+struct pci_device {
+    device_desc_t desc;
+    uint8_t msi_cap;
+    uint8_t msix_cap;
+    uint8_t irq_kind;
+    uint8_t msi_vector;
+};
+typedef struct pci_device pci_device_t;
+
 void pci_install();
 uint32_t pci_read(uint16_t bus, uint16_t device, uint16_t function, uint32_t offset);
 void pci_write(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint32_t data);
 char pci_has_device_functions(uint8_t bus, uint8_t device);
 void pci_find_devices();
 device_desc_t pci_get_device_desriptor(uint8_t bus, uint8_t device, uint8_t function);
-uint32_t pci_read_bar(device_t* dev, int bar_id);
\ No newline at end of file
+uint32_t pci_read_bar(device_t* dev, int bar_id);
+
+pci_device_t* pci_find_device(uint8_t class_id, uint8_t subclass_id, uint16_t vendor_id, pci_device_t* after);
+pci_device_t* pci_device_of(device_t* dev);
+int pci_msi_setup(device_t* dev, void (*handler)());
\ No newline at end of file
@@ -11,6 +11,8 @@
 
 #define PIT_BASE_FREQ 1193180
 #define TIMER_TICKS_PER_SECOND 125
+#define PIT_CALIBRATE_MS 50
 
 void pit_setup();
-void pit_handler();
\ No newline at end of file
+void pit_handler();
+uint32_t pit_measure_cycles_per_second();
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <drivers/driver_manager.h>
 #include <libkern/types.h>
 
 #define COM1 0x3F8
@@ -13,6 +14,13 @@
 #define COM3 0x3E8
 #define COM4 0x2E8
 
+#define UART_IER_RX (1 << 0)
+#define UART_IER_THRE (1 << 1)
+#define UART_LSR_DATA_READY (1 << 0)
+#define UART_LSR_THRE (1 << 5)
+#define UART_FIFO_SIZE 16
+
 void uart_setup();
+void uart_install();
 int uart_write(int port, uint8_t data);
 int uart_read(int port, uint8_t* data);
\ No newline at end of file
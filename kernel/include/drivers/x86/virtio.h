@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/c_attrs.h>
+#include <libkern/types.h>
+
+#define VIRTIO_PCI_VENDOR_ID 0x1af4
+
+/* PCI capabilities which locate the virtio structures in the BARs. */
+#define VIRTIO_PCI_CAP_VENDOR 0x09
+#define VIRTIO_PCI_CAP_COMMON_CFG 1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG 2
+#define VIRTIO_PCI_CAP_ISR_CFG 3
+#define VIRTIO_PCI_CAP_DEVICE_CFG 4
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 1
+#define VIRTIO_STATUS_DRIVER 2
+#define VIRTIO_STATUS_DRIVER_OK 4
+#define VIRTIO_STATUS_FEATURES_OK 8
+
+/* The bit of VIRTIO_F_VERSION_1 in the second word of features. */
+#define VIRTIO_F_VERSION_1_HI (1 << 0)
+/* Lets a descriptor of the ring point to a table of descriptors. */
+#define VIRTIO_F_INDIRECT_DESC (1 << 28)
+
+/* Reading the ISR status acknowledges the interrupt. */
+#define VIRTIO_ISR_QUEUE 1
+
+#define VIRTIO_MSI_NO_VECTOR 0xffff
+
+struct PACKED virtio_pci_common_cfg {
+    uint32_t device_feature_select;
+    uint32_t device_feature;
+    uint32_t driver_feature_select;
+    uint32_t driver_feature;
+    uint16_t msix_config;
+    uint16_t num_queues;
+    uint8_t device_status;
+    uint8_t config_generation;
+    uint16_t queue_select;
+    uint16_t queue_size;
+    uint16_t queue_msix_vector;
+    uint16_t queue_enable;
+    uint16_t queue_notify_off;
+    uint32_t queue_desc_lo;
+    uint32_t queue_desc_hi;
+    uint32_t queue_driver_lo;
+    uint32_t queue_driver_hi;
+    uint32_t queue_device_lo;
+    uint32_t queue_device_hi;
+};
+typedef struct virtio_pci_common_cfg virtio_pci_common_cfg_t;
+
+#define VIRTQ_DESC_F_NEXT 1
+#define VIRTQ_DESC_F_WRITE 2
+#define VIRTQ_DESC_F_INDIRECT 4
+
+struct virtq_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+typedef struct virtq_desc virtq_desc_t;
+
+struct virtq_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+};
+typedef struct virtq_avail virtq_avail_t;
+
+struct virtq_used_elem {
+    uint32_t id;
+    uint32_t len;
+};
+typedef struct virtq_used_elem virtq_used_elem_t;
+
+struct virtq_used {
+    uint16_t flags;
+    uint16_t idx;
+    virtq_used_elem_t ring[];
+};
+typedef struct virtq_used virtq_used_t;
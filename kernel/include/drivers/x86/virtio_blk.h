@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <drivers/driver_manager.h>
+#include <drivers/x86/virtio.h>
+#include <libkern/c_attrs.h>
+#include <libkern/lock.h>
+#include <libkern/types.h>
+
+#define VIRTIO_BLK_PCI_DEVICE_ID 0x1042
+#define VIRTIO_BLK_TRANSITIONAL_PCI_DEVICE_ID 0x1001
+
+/* Feature bits, all of them are in the first word of features. */
+#define VIRTIO_BLK_F_SIZE_MAX (1 << 1)
+#define VIRTIO_BLK_F_RO (1 << 5)
+#define VIRTIO_BLK_F_FLUSH (1 << 9)
+
+struct PACKED virtio_blk_config {
+    uint64_t capacity; /* In 512 byte sectors. */
+    uint32_t size_max;
+    uint32_t seg_max;
+};
+typedef struct virtio_blk_config virtio_blk_config_t;
+
+enum VIRTIO_BLK_REQUEST_TYPES {
+    VIRTIO_BLK_T_IN = 0,
+    VIRTIO_BLK_T_OUT = 1,
+    VIRTIO_BLK_T_FLUSH = 4,
+};
+
+#define VIRTIO_BLK_S_OK 0
+
+struct virtio_blk_req_hdr {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+};
+typedef struct virtio_blk_req_hdr virtio_blk_req_hdr_t;
+
+/**
+ * A request is a chain of 3 descriptors: the header, the data and the
+ * status byte. With indirect descriptors the chain is in a table of its
+ * own and takes one entry of the ring, otherwise it takes 3 of them.
+ * Every slot owns a bounce buffer of VIRTIO_BLK_SLOT_BUF_SIZE, longer
+ * storage requests are cut into several slots which are in flight at once.
+ */
+#define VIRTIO_BLK_QUEUE_SIZE 16
+#define VIRTIO_BLK_SLOT_BUF_SIZE (32 * KB)
+#define VIRTIO_BLK_SLOT_META_SIZE 64 /* 3 descriptors and the header. */
+#define VIRTIO_BLK_STATUS_OFFSET (VIRTIO_BLK_QUEUE_SIZE * VIRTIO_BLK_SLOT_META_SIZE)
+
+enum VIRTIO_BLK_SLOT_STATES {
+    VIRTIO_BLK_SLOT_FREE = 0,
+    VIRTIO_BLK_SLOT_BUSY,
+    VIRTIO_BLK_SLOT_DONE,
+};
+
+struct virtio_blk {
+    volatile virtio_pci_common_cfg_t* common_cfg;
+    volatile virtio_blk_config_t* config;
+    volatile uint8_t* isr;
+    uint8_t* notify_base;
+    uint32_t notify_off_multiplier;
+    uint32_t features;
+    uint32_t capacity;
+    uint32_t max_chunk_sectors;
+    uint8_t irq;
+    bool msix; /* The ISR status is not raised then, every irq is a queue one. */
+
+    volatile virtq_desc_t* desc;
+    volatile virtq_avail_t* avail;
+    volatile virtq_used_t* used;
+    volatile uint16_t* notify;
+    uint16_t queue_size;
+    uint16_t last_used;
+    uint16_t slots;
+    bool indirect;
+
+    uint8_t* meta; /* Tables and headers of the slots, then their status bytes. */
+    uint32_t meta_paddr;
+    uint8_t* bufs;
+    uint32_t bufs_paddr;
+    volatile uint8_t slot_state[VIRTIO_BLK_QUEUE_SIZE];
+    lock_t lock;
+};
+typedef struct virtio_blk virtio_blk_t;
+
+void virtio_blk_install();
+void virtio_blk_add_device(device_t* dev);
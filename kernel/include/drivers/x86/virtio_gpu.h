@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <drivers/driver_manager.h>
+#include <drivers/x86/display.h>
+#include <drivers/x86/virtio.h>
+#include <libkern/c_attrs.h>
+#include <libkern/types.h>
+
+#define VIRTIO_GPU_PCI_DEVICE_ID 0x1050
+
+/**
+ * Commands are sent one at a time and waited for, so a queue needs only a
+ * few descriptors and one buffer for the command and its response.
+ */
+#define VIRTIO_GPU_QUEUE_SIZE 16
+#define VIRTIO_GPU_RESP_OFFSET 2048
+
+struct virtio_gpu_queue {
+    uint16_t index;
+    uint16_t size;
+    uint16_t last_used;
+    volatile virtq_desc_t* desc;
+    volatile virtq_avail_t* avail;
+    volatile virtq_used_t* used;
+    volatile uint16_t* notify;
+    uint8_t* buf;
+    uint32_t buf_paddr;
+};
+typedef struct virtio_gpu_queue virtio_gpu_queue_t;
+
+enum VIRTIO_GPU_COMMANDS {
+    VIRTIO_GPU_CMD_RESOURCE_CREATE_2D = 0x0101,
+    VIRTIO_GPU_CMD_SET_SCANOUT = 0x0103,
+    VIRTIO_GPU_CMD_RESOURCE_FLUSH = 0x0104,
+    VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D = 0x0105,
+    VIRTIO_GPU_CMD_RESOURCE_ATTACH_BACKING = 0x0106,
+    VIRTIO_GPU_CMD_UPDATE_CURSOR = 0x0300,
+    VIRTIO_GPU_CMD_MOVE_CURSOR = 0x0301,
+    VIRTIO_GPU_RESP_OK_NODATA = 0x1100,
+};
+
+/* Bytes go B, G, R, X in memory, as 0xOORRGGBB is kept on a little endian cpu. */
+#define VIRTIO_GPU_FORMAT_B8G8R8A8_UNORM 1
+#define VIRTIO_GPU_FORMAT_B8G8R8X8_UNORM 2
+
+struct virtio_gpu_ctrl_hdr {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t fence_id;
+    uint32_t ctx_id;
+    uint32_t padding;
+};
+typedef struct virtio_gpu_ctrl_hdr virtio_gpu_ctrl_hdr_t;
+
+struct virtio_gpu_rect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+typedef struct virtio_gpu_rect virtio_gpu_rect_t;
+
+struct virtio_gpu_resource_create_2d {
+    virtio_gpu_ctrl_hdr_t hdr;
+    uint32_t resource_id;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct virtio_gpu_resource_attach_backing {
+    virtio_gpu_ctrl_hdr_t hdr;
+    uint32_t resource_id;
+    uint32_t nr_entries;
+    uint64_t addr;
+    uint32_t length;
+    uint32_t padding;
+};
+
+struct virtio_gpu_set_scanout {
+    virtio_gpu_ctrl_hdr_t hdr;
+    virtio_gpu_rect_t r;
+    uint32_t scanout_id;
+    uint32_t resource_id;
+};
+
+struct virtio_gpu_transfer_to_host_2d {
+    virtio_gpu_ctrl_hdr_t hdr;
+    virtio_gpu_rect_t r;
+    uint64_t offset;
+    uint32_t resource_id;
+    uint32_t padding;
+};
+
+struct virtio_gpu_resource_flush {
+    virtio_gpu_ctrl_hdr_t hdr;
+    virtio_gpu_rect_t r;
+    uint32_t resource_id;
+    uint32_t padding;
+};
+
+struct virtio_gpu_update_cursor {
+    virtio_gpu_ctrl_hdr_t hdr;
+    uint32_t scanout_id;
+    uint32_t x;
+    uint32_t y;
+    uint32_t pos_padding;
+    uint32_t resource_id;
+    uint32_t hot_x;
+    uint32_t hot_y;
+    uint32_t padding;
+};
+
+void virtio_gpu_install();
+void virtio_gpu_init(device_t* dev);
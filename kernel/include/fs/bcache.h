@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <drivers/driver_manager.h>
+#include <libkern/types.h>
+#include <mem/vmm/vmm.h>
+
+/**
+ * Bcache keeps blocks of storage devices in memory. A block is found by
+ * (device, block index) through a hash table, and the least recently used
+ * block is reused when the cache is full or free memory runs low.
+ * Writes only make cached blocks dirty. Dirty blocks reach the device when
+ * the flusher runs, on sync, on eviction or when there are more than
+ * BCACHE_MAX_DIRTY_BLOCKS of them.
+ * Misses of a multi-block read are fetched together with one unplug of
+ * the device queue.
+ */
+
+#define BCACHE_SECTOR_SIZE (STORAGE_SECTOR_SIZE)
+#define BCACHE_BLOCK_SIZE (VMM_PAGE_SIZE)
+#define BCACHE_SECTORS_PER_BLOCK (BCACHE_BLOCK_SIZE / BCACHE_SECTOR_SIZE)
+#define BCACHE_MAX_BLOCKS (1024)
+#define BCACHE_HASH_SIZE (256)
+#define BCACHE_LOW_MEMORY (2 * MB) /* Below this amount of free memory the cache stops growing. */
+#define BCACHE_SHRINK_BATCH (8)
+#define BCACHE_READ_BATCH (16)
+#define BCACHE_MAX_DIRTY_BLOCKS (256)
+#define BCACHE_FLUSH_INTERVAL (5) /* In seconds. */
+
+void bcache_init();
+
+int bcache_read(device_t* dev, uint8_t* buf, uint32_t start, uint32_t len);
+int bcache_write(device_t* dev, uint8_t* buf, uint32_t start, uint32_t len);
+int bcache_prefetch(device_t* dev, uint32_t start, uint32_t len);
+int bcache_sync(device_t* dev);
+
+void bcache_start_flusher();
@@ -10,6 +10,12 @@
 #include <libkern/c_attrs.h>
 #include <libkern/types.h>
 
+/**
+ * Children of a dir are listed in the order of registration, which getdents
+ * walks, and are also hashed by name for lookups.
+ */
+#define DEVFS_DIR_MIN_BUCKETS (16)
+
 #define DEVFS_INODE_LEN (sizeof(struct devfs_inode))
 struct PACKED devfs_inode {
     mode_t mode;
@@ -35,7 +41,12 @@ struct PACKED devfs_inode {
     struct devfs_inode* next;
     struct devfs_inode* first;
     struct devfs_inode* last;
-    uint8_t padding[24];
+    struct devfs_inode* hash_next;
+    struct devfs_inode** buckets;
+    uint32_t buckets_count;
+    uint32_t entries_count;
+    uint32_t hash;
+    void* private_data; /* Set by the driver, comes with the inode to its dentries. */
     /* Block hack ends here */
 
     uint32_t generation;
@@ -50,4 +61,10 @@ void devfs_install();
 int devfs_mount();
 
 devfs_inode_t* devfs_mkdir(dentry_t* dir, const char* name, uint32_t len);
-devfs_inode_t* devfs_register(dentry_t* dir, uint32_t devid, const char* name, uint32_t len, mode_t mode, const file_ops_t* handlers);
\ No newline at end of file
+devfs_inode_t* devfs_register(dentry_t* dir, uint32_t devid, const char* name, uint32_t len, mode_t mode, const file_ops_t* handlers);
+devfs_inode_t* devfs_register_private(dentry_t* dir, uint32_t devid, const char* name, uint32_t len, mode_t mode, const file_ops_t* handlers, void* private_data);
+
+static inline void* devfs_private_data(dentry_t* dentry)
+{
+    return ((devfs_inode_t*)dentry->inode)->private_data;
+}
\ No newline at end of file
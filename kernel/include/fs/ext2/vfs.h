@@ -167,7 +167,7 @@ typedef struct socket socket_t;
  * DENTRIES
  */
 
-void dentry_flusher();
+void dentry_start_flusher();
 
 void dentry_set_parent(dentry_t* to, dentry_t* parent);
 dentry_t* dentry_get(uint32_t dev_indx, uint32_t inode_indx);
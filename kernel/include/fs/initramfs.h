@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/types.h>
+#include <mem/pmm.h>
+
+/**
+ * The bootloader may put a cpio image (newc format) in memory. When it does,
+ * the image is unpacked into a tmpfs which becomes the root, and the storage
+ * device which would have been the root is mounted at INITRAMFS_DISK_PATH.
+ */
+#define INITRAMFS_DISK_PATH "/disk"
+
+void initramfs_setup(mem_desc_t* mem_desc);
+int initramfs_mount();
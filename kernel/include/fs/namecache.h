@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/types.h>
+
+/**
+ * Namecache remembers results of lookups: (dev, dir inode, name) -> inode.
+ * Misses are cached too, such entries hold inode 0. Vfs keeps the cache
+ * valid by dropping entries on create, mkdir, unlink, rmdir and umount,
+ * so it is used only for file systems whose names change only through vfs.
+ * Hits are served without the lock under a seqcount, so path walks of many
+ * processes don't serialize on it.
+ */
+
+#define NAMECACHE_SIZE (512)
+#define NAMECACHE_HASH_SIZE (128)
+#define NAMECACHE_MAX_NAME (28) /* Longer names are not cached. */
+#define NAMECACHE_NEGATIVE (0)
+
+void namecache_init();
+
+int namecache_lookup(uint32_t dev_indx, uint32_t dir_indx, const char* name, uint32_t len, uint32_t* inode_indx);
+void namecache_add(uint32_t dev_indx, uint32_t dir_indx, const char* name, uint32_t len, uint32_t inode_indx);
+
+void namecache_remove_name(uint32_t dev_indx, uint32_t dir_indx, const char* name, uint32_t len);
+void namecache_remove_inode(uint32_t dev_indx, uint32_t inode_indx);
+void namecache_remove_dev(uint32_t dev_indx);
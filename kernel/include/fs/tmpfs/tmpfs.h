@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <fs/vfs.h>
+#include <libkern/c_attrs.h>
+#include <libkern/types.h>
+
+/**
+ * Tmpfs keeps the whole tree in memory. File data lives in pages of a
+ * kernel zone of TMPFS_MAX_PAGES, which caps the size of the files of all
+ * mounts together. Children of a dir are hashed by name and also listed in
+ * the order of creation, which getdents walks.
+ */
+#define TMPFS_MAX_PAGES (8192)
+#define TMPFS_MAX_INODES (4096) /* Per mount. */
+#define TMPFS_DIR_MIN_BUCKETS (16)
+
+struct tmpfs_dirent {
+    struct tmpfs_dirent* hash_next;
+    struct tmpfs_dirent* prev;
+    struct tmpfs_dirent* next;
+    uint32_t inode_indx;
+    uint32_t hash;
+    uint32_t pos; /* Offset of getdents which returns the entry. */
+    uint32_t len;
+    char name[];
+};
+typedef struct tmpfs_dirent tmpfs_dirent_t;
+
+struct tmpfs_node {
+    uint32_t parent_indx;
+
+    /* Dirs */
+    tmpfs_dirent_t** buckets;
+    uint32_t buckets_count;
+    uint32_t entries_count;
+    uint32_t next_pos;
+    tmpfs_dirent_t* first;
+    tmpfs_dirent_t* last;
+
+    /* Files, a slot of 0 is a hole which reads as zeroes. */
+    uint32_t* pages;
+    uint32_t pages_capacity;
+};
+typedef struct tmpfs_node tmpfs_node_t;
+
+#define TMPFS_INODE_LEN (sizeof(struct tmpfs_inode))
+struct PACKED tmpfs_inode {
+    mode_t mode;
+    uint16_t uid;
+    uint32_t size;
+    uint32_t atime;
+    uint32_t ctime;
+    uint32_t mtime;
+    uint32_t dtime;
+    uint16_t gid;
+    uint16_t links_count;
+    uint32_t blocks;
+    uint32_t flags;
+    uint32_t osd1;
+
+    /* NOTE: Instead of blocks here, we store tmpfs required things */
+    uint32_t index;
+    tmpfs_node_t* node;
+    uint8_t padding[52];
+    /* Block hack ends here */
+
+    uint32_t generation;
+    uint32_t file_acl;
+    uint32_t dir_acl;
+    uint32_t faddr;
+    uint32_t osd2[3];
+};
+typedef struct tmpfs_inode tmpfs_inode_t;
+
+void tmpfs_install();
+int tmpfs_mount(const char* path);
@@ -11,6 +11,7 @@
 #include <fs/ext2/ext2.h>
 #include <libkern/lock.h>
 #include <libkern/syscall_structs.h>
+#include <tasking/mutex.h>
 
 #define DENTRY_WAS_IN_CACHE 0
 #define DENTRY_NEWLY_ALLOCATED 1
@@ -20,6 +21,10 @@
 #define VFS_MAX_FILENAME 16
 #define VFS_MAX_FILENAME_EXT 4
 #define VFS_ATTR_NOTFILE 0xff
+#define VFS_GETDENTS_STAT_CHUNK (16 * KB) /* Max size of entries read by one getdents or getdents_stat. */
+#define VFS_READAHEAD_MIN_WINDOW (16 * KB)
+#define VFS_READAHEAD_MAX_WINDOW (128 * KB)
+#define VFS_COPY_CHUNK (16 * KB) /* Size of the kernel buffer of read, write, sendfile and copy_file_range. */
 #define VFS_USE_STD_MMAP 0xffffffff /* If custom mmap impl isn't support for such a file, you can return the flag and std impl will be used */
 
 typedef struct {
@@ -35,7 +40,8 @@ typedef struct {
 typedef struct {
     int fs;
     device_t* dev;
-    lock_t lock;
+    const storage_ops_t* ops; /* Cached from dev, NULL for virtual devices. */
+    krwlock_t lock; /* Reads of files share it, other operations are exclusive. */
 } vfs_device_t;
 
 struct dirent {
@@ -47,6 +53,20 @@ struct dirent {
 };
 typedef struct dirent dirent_t;
 
+/**
+ * Records of getdents_stat carry the stat data of the entry, so a listing
+ * with attributes doesn't need a lookup and an fstat for every entry.
+ */
+struct dirent_stat {
+    uint32_t inode;
+    uint16_t rec_len;
+    uint8_t name_len;
+    uint8_t file_type;
+    fstat_t stat;
+    char name[];
+};
+typedef struct dirent_stat dirent_stat_t;
+
 #define DENTRY_DIRTY 0x1
 #define DENTRY_MOUNTPOINT 0x2
 #define DENTRY_MOUNTED 0x4
@@ -70,6 +90,14 @@ struct dentry {
     struct dentry* mounted_dentry;
 
     struct socket* sock;
+
+    /* Cache data, protected by locks of dentry.c */
+    struct dentry* hash_next;
+    struct dentry* lru_prev;
+    struct dentry* lru_next;
+    uint32_t hash_bucket;
+    bool in_hash;
+    bool in_lru;
 };
 typedef struct dentry dentry_t;
 
@@ -99,6 +127,7 @@ struct file_ops {
     int (*ioctl)(dentry_t* dentry, uint32_t cmd, uint32_t arg);
     int (*fstat)(dentry_t* dentry, fstat_t* stat);
     struct proc_zone* (*mmap)(dentry_t* dentry, mmap_params_t* params);
+    int (*readahead)(dentry_t* dentry, uint32_t start, uint32_t len);
 };
 typedef struct file_ops file_ops_t;
 
@@ -129,28 +158,48 @@ typedef struct fs_desc fs_desc_t;
 enum FD_TYPE {
     FD_TYPE_FILE,
     FD_TYPE_SOCKET,
+    FD_TYPE_EPOLL,
 };
 
-// TODO: Locks might be implemented as RWLocks.
 struct file_descriptor {
     uint32_t type;
     union {
         dentry_t* dentry; // type == FD_TYPE_FILE
         struct socket* sock_entry; // type == FD_TYPE_SOCKET
+        struct epoll* epoll_entry; // type == FD_TYPE_EPOLL
     };
     uint32_t offset;
     uint32_t flags;
     file_ops_t* ops;
-    lock_t lock;
+    kmutex_t lock;
+
+    /* Read-ahead state, see vfs_read. */
+    uint32_t ra_next; /* Offset where the next sequential read starts. */
+    uint32_t ra_end; /* End of the data which is already read ahead. */
+    uint32_t ra_window;
 };
 typedef struct file_descriptor file_descriptor_t;
 
+#define SOCKET_BACKLOG_SIZE 16
+
+/**
+ * A bound socket only takes connections: connect() creates the server end
+ * of a new connection and queues it in the backlog until accept(). Each end
+ * of a connection reads its own buffer, the peer writes into it.
+ * peer, backlog and the seqs are protected by the lock of socket.c.
+ */
 struct socket {
     uint32_t d_count;
     int domain;
     int type;
     int protocol;
     sync_ringbuffer_t buffer;
+    struct socket* peer;
+    bool peer_closed;
+    struct socket* backlog[SOCKET_BACKLOG_SIZE];
+    uint32_t backlog_count;
+    uint32_t space_seq; // bumped when the peer frees space in its buffer
+    wait_queue_t space_waiters; // writers of this end waiting for space_seq
     file_descriptor_t bind_file;
     lock_t lock;
 };
@@ -160,7 +209,10 @@ typedef struct socket socket_t;
  * DENTRIES
  */
 
-void dentry_flusher();
+void dentry_init();
+void dentry_start_flusher();
+void dentry_flush(dentry_t* dentry);
+void dentry_flush_all();
 
 void dentry_set_parent(dentry_t* to, dentry_t* parent);
 void dentry_set_filename(dentry_t* to, char* filename);
@@ -214,22 +266,31 @@ int vfs_unlink(dentry_t* file);
 int vfs_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result);
 int vfs_open(dentry_t* file, file_descriptor_t* fd, uint32_t flags);
 int vfs_close(file_descriptor_t* fd);
+int vfs_dup(file_descriptor_t* fd, file_descriptor_t* new_fd);
 bool vfs_can_read(file_descriptor_t* fd);
 bool vfs_can_write(file_descriptor_t* fd);
 int vfs_read(file_descriptor_t* fd, void* buf, uint32_t len);
 int vfs_write(file_descriptor_t* fd, void* buf, uint32_t len);
+int vfs_pread(file_descriptor_t* fd, void* buf, uint32_t start, uint32_t len);
+int vfs_pwrite(file_descriptor_t* fd, void* buf, uint32_t start, uint32_t len);
 int vfs_mkdir(dentry_t* dir, const char* name, size_t len, mode_t mode, uid_t uid, gid_t gid);
 int vfs_rmdir(dentry_t* dir);
 int vfs_getdents(file_descriptor_t* dir_fd, uint8_t* buf, uint32_t len);
+int vfs_getdents_stat(file_descriptor_t* dir_fd, uint8_t* buf, uint32_t len);
 int vfs_fstat(file_descriptor_t* fd, fstat_t* stat);
+int vfs_fsync(file_descriptor_t* fd);
+int vfs_sync();
 
 int vfs_get_absolute_path(dentry_t* dent, char* buf, int len);
 int vfs_mount(dentry_t* mountpoint, device_t* dev, uint32_t fs_indx);
+int vfs_mount_dev(dentry_t* mountpoint, uint32_t dev_indx);
+int vfs_switch_root(device_t* dev, uint32_t fs_indx);
 int vfs_umount(dentry_t* mountpoint);
 
 struct proc;
 struct proc_zone* vfs_mmap(file_descriptor_t* fd, mmap_params_t* params);
 int vfs_munmap(struct proc* p, struct proc_zone*);
+int vfs_msync(struct proc_zone* zone, uint32_t start, uint32_t len, int flags);
 
 struct thread;
 int vfs_perm_to_read(dentry_t* dentry, struct thread* t);
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <fs/vfs.h>
+#include <libkern/bits/sys/epoll.h>
+#include <libkern/lock.h>
+#include <libkern/types.h>
+
+struct proc;
+
+struct epoll_item {
+    int fd;
+    epoll_event_t event;
+    bool disabled; // a reported EPOLLONESHOT item
+};
+typedef struct epoll_item epoll_item_t;
+
+/**
+ * Fds of the interest list are numbers in the fd table of the owner, the
+ * process which created the epoll. An fd which is closed is skipped until
+ * it is removed or its number is taken again.
+ */
+struct epoll {
+    uint32_t d_count;
+    struct proc* owner;
+    epoll_item_t* items;
+    uint32_t count;
+    uint32_t capacity;
+    lock_t lock;
+};
+typedef struct epoll epoll_t;
+
+int epoll_create(struct proc* owner, file_descriptor_t* fd);
+epoll_t* epoll_duplicate(epoll_t* ep);
+void epoll_put(epoll_t* ep);
+
+int epoll_ctl(epoll_t* ep, int op, int fd, epoll_event_t* event);
+bool epoll_has_ready(epoll_t* ep);
+int epoll_collect(epoll_t* ep, epoll_event_t* events, int maxevents);
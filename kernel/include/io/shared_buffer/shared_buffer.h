@@ -11,4 +11,10 @@
 int shared_buffer_init();
 int shared_buffer_create(uint8_t** buffer, size_t size);
 int shared_buffer_get(int id, uint8_t** buffer);
-int shared_buffer_free(int id);
\ No newline at end of file
+int shared_buffer_resize(int id, uint8_t** buffer, size_t size);
+int shared_buffer_free(int id);
+int shared_buffer_hand_over(int id);
+int shared_buffer_seal(int id);
+
+void shared_buffer_duplicate(int id);
+void shared_buffer_put(int id);
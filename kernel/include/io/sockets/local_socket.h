@@ -16,3 +16,4 @@ int local_socket_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t
 
 int local_socket_bind(file_descriptor_t* sock, char* name, uint32_t len);
 int local_socket_connect(file_descriptor_t* sock, char* name, uint32_t len);
+int local_socket_accept(file_descriptor_t* sock, file_descriptor_t* new_sock);
@@ -10,8 +10,10 @@
 #include <libkern/syscall_structs.h>
 #include <libkern/types.h>
 
-#define MAX_SOCKET_COUNT 16
+extern lock_t socket_lock;
 
 int socket_create(int domain, int type, int protocol, file_descriptor_t* fd, file_ops_t* ops);
+int socket_connect(socket_t* listener, socket_t* sock);
+socket_t* socket_accept(socket_t* listener);
 socket_t* socket_duplicate(socket_t* sock);
 int socket_put(socket_t* sock);
\ No newline at end of file
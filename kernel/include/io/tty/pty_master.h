@@ -9,18 +9,19 @@
 #include <algo/sync_ringbuffer.h>
 #include <fs/vfs.h>
 
-#ifndef PTYS_COUNT
-#define PTYS_COUNT 16
-#endif
-
+/**
+ * Pairs are allocated on demand and are never freed: a closed master goes
+ * to a free list with its slave, and the next open of /dev/ptmx takes it
+ * again, so /dev/ptsN keeps its number.
+ */
 struct pty_slave_entry;
 struct pty_master_entry {
     sync_ringbuffer_t buffer;
     struct pty_slave_entry* pts;
+    struct pty_master_entry* next_free;
+    int id;
     dentry_t dentry;
 };
 typedef struct pty_master_entry pty_master_entry_t;
 
-extern pty_master_entry_t pty_masters[PTYS_COUNT];
-
 int pty_master_alloc(file_descriptor_t* fd);
\ No newline at end of file
@@ -8,10 +8,6 @@
 
 #include <algo/sync_ringbuffer.h>
 
-#ifndef PTYS_COUNT
-#define PTYS_COUNT 4
-#endif
-
 struct pty_master_entry;
 struct pty_slave_entry {
     int inode_indx;
@@ -20,6 +16,4 @@ struct pty_slave_entry {
 };
 typedef struct pty_slave_entry pty_slave_entry_t;
 
-extern pty_slave_entry_t pty_slaves[PTYS_COUNT];
-
-int pty_slave_create(int id, struct pty_master_entry* ptm);
+pty_slave_entry_t* pty_slave_create(int id, struct pty_master_entry* ptm);
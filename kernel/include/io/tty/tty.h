@@ -86,4 +86,5 @@ typedef struct tty_entry tty_entry_t;
 extern tty_entry_t ttys[TTY_MAX_COUNT];
 
 tty_entry_t* tty_new();
+void tty_receive(tty_entry_t* tty, const uint8_t* buf, uint32_t len);
 void tty_eat_key(key_t key);
\ No newline at end of file
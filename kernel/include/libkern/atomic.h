@@ -12,4 +12,5 @@
 
 #define atomic_add(x, val) (__atomic_add_fetch(x, val, __ATOMIC_SEQ_CST))
 #define atomic_store(x, val) (__atomic_store_n(x, val, __ATOMIC_SEQ_CST))
-#define atomic_load(x) (__atomic_load_n(x, __ATOMIC_SEQ_CST))
\ No newline at end of file
+#define atomic_load(x) (__atomic_load_n(x, __ATOMIC_SEQ_CST))
+#define atomic_exchange(x, val) (__atomic_exchange_n(x, val, __ATOMIC_SEQ_CST))
\ No newline at end of file
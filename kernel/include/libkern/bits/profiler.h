@@ -0,0 +1,27 @@
+#pragma once
+
+#include <libkern/types.h>
+
+#define PROFILER_MAX_DEPTH 8
+
+enum PROFILER_SAMPLE_FLAGS {
+    PROFILER_SAMPLE_USER = 0x1,
+};
+
+/**
+ * A sample read from /dev/profiler. pcs[0] is the interrupted instruction,
+ * the rest are return addresses found by walking the frame pointers.
+ * event is the PERF_EVENT whose counter triggered the sample, or
+ * PROFILER_SAMPLE_TICK for a sample of a timer tick.
+ */
+#define PROFILER_SAMPLE_TICK (0xff)
+
+struct profiler_sample {
+    uint32_t tid;
+    uint16_t cpu;
+    uint8_t flags;
+    uint8_t event;
+    uint32_t depth;
+    uint32_t pcs[PROFILER_MAX_DEPTH];
+};
+typedef struct profiler_sample profiler_sample_t;
@@ -11,4 +11,45 @@
 /* BGA */
 #define BGA_SWAP_BUFFERS 0x0101
 #define BGA_GET_HEIGHT 0x0102
-#define BGA_GET_WIDTH 0x0103
\ No newline at end of file
+#define BGA_GET_WIDTH 0x0103
+#define BGA_GET_NEXT_VBLANK 0x0104
+#define BGA_GET_ACCEL_OPS 0x0105
+#define BGA_FLUSH_RECTS 0x0106
+#define BGA_SET_CURSOR 0x0107
+#define BGA_MOVE_CURSOR 0x0108
+/* A non zero arg routes the display and input irqs to the calling cpu, 0 spreads them again. */
+#define BGA_PIN_IRQS 0x0109
+/* Bytes per pixel of the buffers: 4 for 0xAARRGGBB, 2 for RGB565. */
+#define BGA_GET_DEPTH 0x010a
+
+/* 2D operations a display may run on its own, as returned by BGA_GET_ACCEL_OPS. */
+#define BGA_ACCEL_FILL (1 << 0)
+#define BGA_ACCEL_COPY (1 << 1)
+#define BGA_ACCEL_BLEND (1 << 2)
+/* The screen is shown from the first buffer, changes reach it with BGA_FLUSH_RECTS. */
+#define BGA_ACCEL_FLUSH (1 << 3)
+/* The display has a cursor plane, set with BGA_SET_CURSOR and BGA_MOVE_CURSOR. */
+#define BGA_ACCEL_CURSOR (1 << 4)
+
+struct bga_rect {
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+};
+
+struct bga_flush_rects {
+    unsigned int count;
+    const struct bga_rect* rects;
+};
+
+/*
+ * The cursor image is BGA_CURSOR_SIZE pixels square, BGA_MOVE_CURSOR takes (x << 16) | y.
+ * Pixels are 0xAARRGGBB with straight alpha, a display may show them in fewer colors.
+ */
+#define BGA_CURSOR_SIZE 64
+struct bga_cursor {
+    const unsigned int* pixels;
+    unsigned int hot_x;
+    unsigned int hot_y;
+};
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <libkern/types.h>
+
+#define IOV_MAX 1024
+
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+typedef struct iovec iovec_t;
@@ -45,4 +45,37 @@ typedef enum {
     CLOCK_MONOTONIC,
     CLOCK_PROCESS_CPUTIME_ID,
     CLOCK_THREAD_CPUTIME_ID,
-} clockid_t;
\ No newline at end of file
+} clockid_t;
+
+/**
+ * The time page is mapped read-only at TIME_PAGE_VADDR into every process,
+ * so clocks could be read without a syscall. The kernel keeps seq odd while
+ * it updates the page.
+ */
+#define TIME_PAGE_VADDR 0xbffff000
+
+/* Counters the clock of the time page can be interpolated with. */
+#define TIME_PAGE_CLOCK_TICKS 0 /* None which userspace can read. */
+#define TIME_PAGE_CLOCK_TSC 1
+#define TIME_PAGE_CLOCK_CNTVCT 2 /* Virtual count of the arm generic timer. */
+
+struct time_page {
+    uint32_t seq;
+    time_t secs_since_boot;
+    time_t secs_since_epoch;
+    time_t ticks_since_second;
+    time_t ticks_per_second;
+    /* Rate of the cycle counter which userspace may read (the TSC on x86,
+       the PMU cycle counter divided by 64 on arm), 0 till it's measured. */
+    uint32_t cycles_per_second;
+    /* CLOCK_MONOTONIC at the last update and the clocksource counter then.
+       A reader adds (counter - clock_cycles) * clock_mult >> clock_shift
+       nanoseconds when it can read the counter named by clock_id. */
+    uint32_t clock_id;
+    uint32_t clock_mult;
+    uint32_t clock_shift;
+    uint32_t clock_cycles;
+    time_t clock_secs;
+    uint32_t clock_nsec;
+};
+typedef struct time_page time_page_t;
\ No newline at end of file
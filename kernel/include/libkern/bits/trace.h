@@ -0,0 +1,30 @@
+#pragma once
+
+#include <libkern/types.h>
+
+enum TRACE_EVENTS {
+    TRACE_SCHED_SWITCH = 1, // a: prev tid, b: next tid, c: next prio
+    TRACE_PAGE_FAULT, // a: vaddr, b: info
+    TRACE_SYSCALL_ENTER, // a: syscall id, b: param1, c: param2
+    TRACE_SYSCALL_EXIT, // a: syscall id, b: result
+    TRACE_BLOCK_ISSUE, // a: device id, b: lba, c: count | write << 31
+    TRACE_BLOCK_COMPLETE, // a: device id, b: lba, c: status
+    TRACE_IPC_SEND, // a: socket, b: len, c: written
+    TRACE_EVENTS_COUNT,
+};
+
+/**
+ * A record read from /dev/trace. ticks are global timer ticks, cycles
+ * is the low word of the cycle counter of the cpu which wrote it.
+ */
+struct trace_record {
+    uint32_t ticks;
+    uint32_t cycles;
+    uint16_t event;
+    uint16_t cpu;
+    uint32_t tid;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+typedef struct trace_record trace_record_t;
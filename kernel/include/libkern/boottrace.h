@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/c_attrs.h>
+#include <libkern/types.h>
+
+/**
+ * Boot trace points stamp the steps of the boot: kernel subsystems, driver
+ * probes and every exec, until BOOTTRACE_MAX_POINTS are taken. Points are
+ * stamped with the cycle counter, since interrupts are off for most of the
+ * kernel part and ticks don't move there. /proc/boottrace prints them.
+ */
+#define BOOTTRACE_MAX_POINTS (128)
+#define BOOTTRACE_NAME_LEN (32)
+
+struct boottrace_point {
+    uint32_t cycles;
+    time_t ticks;
+    int cpu;
+    pid_t pid;
+    bool ready;
+    char name[BOOTTRACE_NAME_LEN];
+};
+typedef struct boottrace_point boottrace_point_t;
+
+void boottrace_point(const char* what, const char* arg);
+int boottrace_count();
+boottrace_point_t* boottrace_get(int id);
@@ -3,4 +3,17 @@
 #include <libkern/types.h>
 
 void kpanic_at_test(char* t_err_msg, uint16_t test_no);
-bool kernel_self_test(bool throw_kernel_panic);
\ No newline at end of file
+bool kernel_self_test(bool throw_kernel_panic);
+
+/**
+ * Kernel benches are run by the launching thread before init is started,
+ * when the kernel is built with KERNEL_BENCHMARK. Every bench times
+ * KBENCH_RUNS batches of KBENCH_BATCH operations with the cycle counter
+ * and prints one line with the cost of an operation in ns, in the format
+ * of the userland benches, so bench.py takes both.
+ */
+#define KBENCH_WARMUP_RUNS (1)
+#define KBENCH_RUNS (16)
+#define KBENCH_BATCH (64)
+
+void kernel_bench();
@@ -13,30 +13,132 @@
 
 // #define DEBUG_LOCK
 
+#define LOCK_STAT_MAX (8)
+
+/**
+ * Contention counters of a lock, see lock_stat_register(). They are
+ * updated with the lock taken, so need no atomics.
+ */
+struct lock_stat {
+    const char* name;
+    uint32_t acquisitions;
+    uint32_t contended; /* Acquisitions which had to wait. */
+    uint32_t spins;
+    uint32_t max_hold; /* In lock_cycles(). */
+    uint32_t hold_start;
+};
+typedef struct lock_stat lock_stat_t;
+
+/**
+ * Locks are ticket spinlocks: cpus get the lock in the order they came, so
+ * none of them can be starved by others.
+ */
 struct lock {
-    int status;
+    uint32_t next_ticket;
+    uint32_t now_serving;
+    lock_stat_t* stat;
 #ifdef DEBUG_LOCK
 
 #endif // DEBUG_LOCK
 };
 typedef struct lock lock_t;
 
+void lock_stat_register(lock_t* lock, const char* name);
+int lock_stat_count();
+lock_stat_t* lock_stat_get(int id);
+
+static ALWAYS_INLINE void lock_relax()
+{
+#ifdef __i386__
+    asm volatile("pause");
+#elif __arm__
+    asm volatile("wfe");
+#endif
+}
+
+/**
+ * Wakes up cpus which wait in lock_relax().
+ */
+static ALWAYS_INLINE void lock_notify()
+{
+#ifdef __arm__
+    asm volatile("dsb\n"
+                 "sev");
+#endif
+}
+
+static ALWAYS_INLINE uint32_t lock_cycles()
+{
+    uint32_t lo = 0;
+#ifdef __i386__
+    uint32_t hi;
+    asm volatile("rdtsc"
+                 : "=a"(lo), "=d"(hi));
+#elif __arm__
+    uint32_t hi;
+    asm volatile("mrrc p15, 1, %0, %1, c14"
+                 : "=r"(lo), "=r"(hi));
+#endif
+    return lo;
+}
+
 static ALWAYS_INLINE void lock_init(lock_t* lock)
 {
-    __atomic_store_n(&lock->status, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->next_ticket, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->now_serving, 0, __ATOMIC_RELAXED);
+    lock->stat = NULL;
 }
 
 static ALWAYS_INLINE void lock_acquire(lock_t* lock)
 {
-    while (__atomic_exchange_n(&lock->status, 1, __ATOMIC_ACQUIRE) == 1) {
-        // TODO: May be some cpu sleep?
+    uint32_t ticket = __atomic_fetch_add(&lock->next_ticket, 1, __ATOMIC_RELAXED);
+    uint32_t spins = 0;
+    while (__atomic_load_n(&lock->now_serving, __ATOMIC_ACQUIRE) != ticket) {
+        lock_relax();
+        spins++;
+    }
+
+    lock_stat_t* stat = lock->stat;
+    if (unlikely(stat != NULL)) {
+        stat->acquisitions++;
+        stat->contended += (spins != 0);
+        stat->spins += spins;
+        stat->hold_start = lock_cycles();
     }
 }
 
+/**
+ * Takes the lock only if nobody holds or waits for it. Used where waiting
+ * could deadlock, since the caller may already hold the lock.
+ */
+static ALWAYS_INLINE bool lock_try_acquire(lock_t* lock)
+{
+    uint32_t ticket = __atomic_load_n(&lock->now_serving, __ATOMIC_RELAXED);
+    uint32_t expected = ticket;
+    if (!__atomic_compare_exchange_n(&lock->next_ticket, &expected, ticket + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+    lock_stat_t* stat = lock->stat;
+    if (unlikely(stat != NULL)) {
+        stat->acquisitions++;
+        stat->hold_start = lock_cycles();
+    }
+    return true;
+}
+
 static ALWAYS_INLINE void lock_release(lock_t* lock)
 {
-    ASSERT(lock->status == 1);
-    __atomic_store_n(&lock->status, 0, __ATOMIC_RELEASE);
+    ASSERT(lock->next_ticket != lock->now_serving);
+    lock_stat_t* stat = lock->stat;
+    if (unlikely(stat != NULL)) {
+        uint32_t hold = lock_cycles() - stat->hold_start;
+        if (hold > stat->max_hold) {
+            stat->max_hold = hold;
+        }
+    }
+    __atomic_store_n(&lock->now_serving, lock->now_serving + 1, __ATOMIC_RELEASE);
+    lock_notify();
 }
 
 #ifdef DEBUG_LOCK
@@ -47,4 +149,4 @@ static ALWAYS_INLINE void lock_release(lock_t* lock)
 #define lock_release(x)                                    \
     log("release lock %s %s:%d ", #x, __FILE__, __LINE__); \
     lock_release(x);
-#endif
\ No newline at end of file
+#endif
@@ -2,7 +2,14 @@
 
 #include <libkern/types.h>
 
+#define LOG_RING_SIZE (16 * 1024)
+#define LOG_FLUSH_CHUNK (256)
+#define LOG_FLUSH_INTERVAL (2) /* In ticks. */
+
 void logger_setup();
+void logger_start_flusher();
+void logger_flush_sync();
+int logger_read(uint8_t* buf, uint32_t start, uint32_t len);
 
 int vsnprintf(char* s, size_t n, const char* format, va_list arg);
 int vsprintf(char* s, const char* format, va_list arg);
@@ -12,4 +19,5 @@ int sprintf(char* s, const char* format, ...);
 int log(const char* format, ...);
 int log_warn(const char* format, ...);
 int log_error(const char* format, ...);
-int log_not_formatted(const char* format, ...);
\ No newline at end of file
+int log_not_formatted(const char* format, ...);
+int log_write(const char* data, size_t len);
\ No newline at end of file
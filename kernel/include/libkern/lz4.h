@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/types.h>
+
+/*
+ * Compressor and decompressor of the LZ4 block format, the same as the
+ * one of libfoundation, so data packed in userland is read back here. The
+ * compressor is a greedy single-hash one which trades ratio for speed. Its
+ * table lives in a context, which doesn't need to be cleared between calls.
+ */
+#define LZ4_HASH_LOG 12
+#define LZ4_MAX_DISTANCE 65535
+
+struct lz4_ctx {
+    uint32_t table[1 << LZ4_HASH_LOG];
+};
+typedef struct lz4_ctx lz4_ctx_t;
+
+/* Output of lz4_compress never exceeds this for len bytes of input. */
+#define LZ4_COMPRESS_BOUND(len) ((len) + (len) / 255 + 16)
+
+#define LZ4_ERR_OUTPUT -2 /* output doesn't fit into dst_len */
+#define LZ4_ERR_DATA -3 /* the block is malformed */
+
+/* Returns the length of the block or LZ4_ERR_OUTPUT. */
+int lz4_compress(lz4_ctx_t* ctx, const void* src, size_t src_len, void* dst, size_t dst_len);
+
+/* Returns the length of the data or an error, src_len is the exact block length. */
+int lz4_decompress(const void* src, size_t src_len, void* dst, size_t dst_len);
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/atomic.h>
+#include <libkern/c_attrs.h>
+#include <libkern/types.h>
+
+/**
+ * Seqcount lets readers go without a lock. Writers are serialized by their
+ * own lock and keep the count odd while they change the data. A reader takes
+ * the count before reading and throws the result away if the count was odd
+ * or has changed by the end, readers never wait for writers.
+ */
+struct seqcount {
+    uint32_t seq;
+};
+typedef struct seqcount seqcount_t;
+
+static ALWAYS_INLINE void seqcount_init(seqcount_t* sc)
+{
+    atomic_store(&sc->seq, 0);
+}
+
+static ALWAYS_INLINE uint32_t seqcount_read_begin(seqcount_t* sc)
+{
+    uint32_t seq = atomic_load(&sc->seq);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return seq;
+}
+
+static ALWAYS_INLINE bool seqcount_read_retry(seqcount_t* sc, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (seq & 1) || atomic_load(&sc->seq) != seq;
+}
+
+static ALWAYS_INLINE void seqcount_write_begin(seqcount_t* sc)
+{
+    atomic_add(&sc->seq, 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static ALWAYS_INLINE void seqcount_write_end(seqcount_t* sc)
+{
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    atomic_add(&sc->seq, 1);
+}
@@ -6,6 +6,7 @@
 #include <libkern/bits/sys/select.h>
 #include <libkern/bits/sys/socket.h>
 #include <libkern/bits/sys/stat.h>
+#include <libkern/bits/sys/uio.h>
 #include <libkern/bits/sys/utsname.h>
 #include <libkern/bits/syscalls.h>
 #include <libkern/bits/thread.h>
\ No newline at end of file
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/bits/trace.h>
+#include <libkern/c_attrs.h>
+#include <libkern/types.h>
+
+/**
+ * Tracepoints write fixed-size records into a ring of each cpu, which
+ * /dev/trace drains. A record written when the ring is full is dropped.
+ * Writing "1" to /dev/trace clears the rings and enables tracing,
+ * writing "0" disables it. utils/trace/decode_trace.py prints a dump.
+ * While tracing is disabled a tracepoint costs one load and a branch,
+ * comment out TRACEPOINTS to compile them out.
+ */
+#define TRACEPOINTS
+
+#define TRACE_RECORDS_PER_CPU (1024)
+
+extern bool trace_enabled;
+
+int trace_install();
+void trace_record(uint32_t event, uint32_t a, uint32_t b, uint32_t c);
+
+#ifdef TRACEPOINTS
+#define trace_point(event, a, b, c)                                           \
+    do {                                                                      \
+        if (unlikely(__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED))) {    \
+            trace_record(event, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c)); \
+        }                                                                     \
+    } while (0)
+#else
+#define trace_point(event, a, b, c) \
+    do {                            \
+    } while (0)
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/types.h>
+
+/**
+ * Kmemcache is a slab allocator for objects of a fixed size.
+ * Every slab is one page, the header of the slab is placed at the start
+ * of the page, so an object finds its slab by rounding the address down.
+ * Each cpu keeps a small stack of free objects, so most of allocations
+ * and frees don't take the lock of the cache.
+ */
+
+#define KMEMCACHE_SPACE_SIZE (8 * MB)
+#define KMEMCACHE_CPU_CACHE_SIZE (16)
+#define KMEMCACHE_CPU_CACHE_BATCH (KMEMCACHE_CPU_CACHE_SIZE / 2)
+#define KMEMCACHE_MAX_EMPTY_SLABS (2)
+
+struct kmemcache;
+typedef struct kmemcache kmemcache_t;
+
+struct kmemcache_stat {
+    uint32_t obj_size;
+    uint32_t slabs;
+    uint32_t objs_in_use;
+    uint32_t alloc_calls;
+    uint32_t free_calls;
+};
+typedef struct kmemcache_stat kmemcache_stat_t;
+
+void kmemcache_init();
+kmemcache_t* kmemcache_create(const char* name, uint32_t obj_size);
+
+void* kmemcache_alloc(kmemcache_t* cache);
+void kmemcache_free(kmemcache_t* cache, void* ptr);
+
+bool kmemcache_owns(void* ptr);
+kmemcache_t* kmemcache_of(void* ptr);
+uint32_t kmemcache_obj_size(kmemcache_t* cache);
+int kmemcache_stat(kmemcache_t* cache, kmemcache_stat_t* stat);
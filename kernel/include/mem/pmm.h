@@ -12,9 +12,25 @@ typedef struct {
     uint32_t acpi_3_0;
 } memory_map_t;
 
+/**
+ * Per-CPU magazine of free frames (VMM_PAGE_SIZE each). Single-frame
+ * allocations are served from here, the global allocator is touched only
+ * to refill or drain PMM_FRAME_CACHE_BATCH frames at once.
+ */
+#define PMM_FRAME_CACHE_SIZE (32)
+#define PMM_FRAME_CACHE_BATCH (PMM_FRAME_CACHE_SIZE / 2)
+
+struct pmm_frame_cache {
+    uint32_t count;
+    uint32_t frames[PMM_FRAME_CACHE_SIZE];
+};
+typedef struct pmm_frame_cache pmm_frame_cache_t;
+
 typedef struct {
     uint16_t memory_map_size;
     uint16_t kernel_size;
+    uint32_t initrd_start; /* Physical address of the initramfs image, if any. */
+    uint32_t initrd_size;
 } mem_desc_t;
 
 static uint32_t pmm_ram_size;
@@ -33,6 +49,9 @@ bool pmm_free(void* block, uint32_t act_size);
 bool pmm_free_block(void* t_block);
 bool pmm_free_blocks(void* t_block, uint32_t t_size);
 
+void* pmm_alloc_frame();
+bool pmm_free_frame(void* frame);
+
 uint32_t pmm_get_ram_size();
 uint32_t pmm_get_max_blocks();
 uint32_t pmm_get_used_blocks();
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/types.h>
+#include <mem/vmm/vmm.h>
+#include <platform/generic/tasking/trapframe.h>
+
+/**
+ * Copies between the kernel and the address space of the running process.
+ * The data is moved at memcpy speed without checking the user pages first:
+ * a fault on them goes to the page fault handler like any other, and if the
+ * handler can't serve it (the address isn't mapped or may not be accessed)
+ * the copy stops where it is instead of the process being killed.
+ * Kernel writes don't respect read-only pages, so copy_to_user copies
+ * nothing if the range isn't in zones the process could write.
+ *
+ * Both return the count of bytes which were NOT copied, so 0 is success and
+ * callers usually turn anything else into -EFAULT.
+ */
+uint32_t copy_to_user(void* udest, const void* src, uint32_t len);
+uint32_t copy_from_user(void* dest, const void* usrc, uint32_t len);
+
+static inline bool uaccess_range_ok(uint32_t uaddr, uint32_t len)
+{
+    return uaddr + len >= uaddr && uaddr + len <= KERNEL_BASE;
+}
+
+/**
+ * Every instruction of the platform copy routine which touches user memory
+ * has an entry in the .uaccess_fixup section, the fault handler moves a
+ * faulting copy to its fixup address.
+ */
+struct uaccess_fixup_entry {
+    uint32_t insn;
+    uint32_t fixup;
+};
+typedef struct uaccess_fixup_entry uaccess_fixup_entry_t;
+
+/* Platform code, returns the count of bytes left when a fault stopped it. */
+uint32_t uaccess_copy_raw(void* dest, const void* src, uint32_t len);
+
+bool uaccess_fixup(trapframe_t* tf);
@@ -22,6 +22,7 @@ enum PAGE_FLAGS {
     PAGE_NOT_CACHEABLE = 0x8,
     PAGE_COW = 0x10,
     PAGE_USER = 0x20,
+    PAGE_WRITE_COMBINING = 0x40, /* Stores are gathered, for framebuffers. */
 };
 
 #define USER_PAGE true
@@ -43,12 +44,32 @@ typedef struct pdirectory {
     table_desc_t entities[VMM_PDE_COUNT];
 } pdirectory_t;
 
+/**
+ * A large page is mapped by a table descriptor directly (4MB pages on x86,
+ * 1MB sections on arm). User tables are allocated by groups which cover a
+ * page, so user large pages are placed by whole groups.
+ */
+#define VMM_LARGE_PAGE_SIZE (VMM_PAGE_SIZE * VMM_PTE_COUNT)
+#define VMM_USER_LARGE_PAGE_SIZE (VMM_LARGE_PAGE_SIZE * (VMM_PAGE_SIZE / sizeof(ptable_t)))
+
 enum VMM_PF_HANDLER {
     OK = 0,
     SHOULD_CRASH = -1,
 };
 
 struct dynamic_array;
+struct proc_zone;
+
+struct vmm_swap_stat {
+    uint32_t stored_pages; /* Pages kept compressed in the pool. */
+    uint32_t stored_bytes;
+    uint32_t pool_pages; /* Frames the pool takes. */
+    uint32_t swapouts;
+    uint32_t swapins;
+    uint32_t rejected; /* Pages which didn't compress well enough. */
+    uint32_t dropped_file_pages;
+};
+typedef struct vmm_swap_stat vmm_swap_stat_t;
 
 /**
  * PUBLIC FUNCTIONS
@@ -72,6 +93,7 @@ pdirectory_t* vmm_new_forked_user_pdir();
 void* vmm_bring_to_kernel(uint8_t* src, uint32_t length);
 void vmm_prepare_active_pdir_for_copying_at(uint32_t dest_vaddr, uint32_t length);
 void vmm_copy_to_user(void* dest, void* src, uint32_t length);
+int vmm_prepare_active_pdir_for_user_write(uint32_t dest_vaddr, uint32_t length);
 void vmm_copy_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length);
 void vmm_zero_user_pages(pdirectory_t* pdir);
 
@@ -82,9 +104,18 @@ int vmm_load_page(uint32_t vaddr, uint32_t settings);
 int vmm_tune_page(uint32_t vaddr, uint32_t settings);
 int vmm_tune_pages(uint32_t vaddr, uint32_t length, uint32_t settings);
 int vmm_free_page(uint32_t vaddr, page_desc_t* page, struct dynamic_array* zones);
+bool vmm_is_page_present_lockless(uint32_t vaddr);
+int vmm_map_object_pages(uint32_t vaddr, uint32_t* frames, uint32_t n_pages, uint32_t settings);
+int vmm_unmap_object_pages(uint32_t vaddr, uint32_t n_pages);
+int vmm_release_pages(uint32_t vaddr, uint32_t length);
 
 int vmm_switch_pdir(pdirectory_t* pdir);
 void vmm_enable_paging();
 void vmm_disable_paging();
 
-int vmm_page_fault_handler(uint32_t info, uint32_t vaddr);
\ No newline at end of file
+int vmm_page_fault_handler(uint32_t info, uint32_t vaddr);
+
+void vmm_file_cache_invalidate(uint32_t dev_indx, uint32_t inode_indx);
+int vmm_sync_shared_file_pages(struct proc_zone* zone, uint32_t start, uint32_t len, bool release);
+
+void vmm_get_swap_stat(vmm_swap_stat_t* stat);
\ No newline at end of file
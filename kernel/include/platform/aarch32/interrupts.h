@@ -12,6 +12,8 @@
 #define IRQ_HANDLERS_MAX 256
 #define ALL_CPU_MASK 0xff
 #define BOOT_CPU_MASK 0x01
+/* Spreads the irqs with this mask over the online cpus, one cpu each. */
+#define BALANCED_CPU_MASK 0x00
 
 typedef int irq_type_t;
 typedef int irq_line_t;
@@ -20,12 +22,15 @@ typedef void (*irq_handler_t)();
 
 enum IRQTypeMasks {
     MASKDEFINE(IRQ_TYPE_EDGE_TRIGGERED, 0, 1),
+    MASKDEFINE(IRQ_TYPE_INTERACTIVE, 1, 1), /* Input and display irqs, they follow irq_pin_interactive(). */
 };
 
 struct gic_descritptor {
     uint32_t (*interrupt_descriptor)();
     void (*end_interrupt)(uint32_t int_desc);
     void (*enable_irq)(irq_line_t line, irq_priority_t prior, irq_type_t type, int cpu_mask);
+    void (*set_affinity)(irq_line_t line, int cpu_mask);
+    int (*this_cpu_mask)();
 };
 typedef struct gic_descritptor gic_descritptor_t;
 
@@ -54,6 +59,9 @@ extern void fast_irq_handler();
 
 void irq_register_handler(irq_line_t line, irq_priority_t prior, irq_type_t type, irq_handler_t func, int cpu_mask);
 void irq_set_gic_desc(gic_descritptor_t gic_desc);
+void irq_set_affinity(irq_line_t line, int cpu_mask);
+void irq_pin_interactive(int cpu_mask);
+int irq_this_cpu_mask();
 
 void gic_setup();
 void gic_setup_secondary_cpu();
\ No newline at end of file
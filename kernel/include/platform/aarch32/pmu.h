@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/bits/sys/perf.h>
+#include <libkern/types.h>
+
+/**
+ * Event counters of the cpu, programmed by perf on context switches. They
+ * are read as 32 bit values, deltas are taken modulo 2^32.
+ */
+int pmu_counters_count();
+bool pmu_supports(int event);
+void pmu_start(int counter, int event);
+void pmu_stop(int counter);
+uint32_t pmu_read(int counter);
@@ -124,4 +124,130 @@ static inline uint32_t read_cpu_id_register()
                  : "=r"(res)
                  :);
     return res;
-}
\ No newline at end of file
+}
+
+static inline void write_tpidruro(uint32_t val)
+{
+    asm volatile("mcr p15, 0, %0, c13, c0, 3"
+                 :
+                 : "r"(val)
+                 : "memory");
+}
+
+static inline void write_pmcr(uint32_t val)
+{
+    asm volatile("mcr p15, 0, %0, c9, c12, 0"
+                 :
+                 : "r"(val)
+                 : "memory");
+}
+
+static inline void write_pmcntenset(uint32_t val)
+{
+    asm volatile("mcr p15, 0, %0, c9, c12, 1"
+                 :
+                 : "r"(val)
+                 : "memory");
+}
+
+static inline void write_pmuserenr(uint32_t val)
+{
+    asm volatile("mcr p15, 0, %0, c9, c14, 0"
+                 :
+                 : "r"(val)
+                 : "memory");
+}
+
+static inline uint32_t read_pmcr()
+{
+    uint32_t val;
+    asm volatile("mrc p15, 0, %0, c9, c12, 0"
+                 : "=r"(val)
+                 :);
+    return val;
+}
+
+static inline void write_pmcntenclr(uint32_t val)
+{
+    asm volatile("mcr p15, 0, %0, c9, c12, 2"
+                 :
+                 : "r"(val)
+                 : "memory");
+}
+
+static inline void write_pmselr(uint32_t val)
+{
+    asm volatile("mcr p15, 0, %0, c9, c12, 5"
+                 :
+                 : "r"(val)
+                 : "memory");
+    system_instruction_barrier();
+}
+
+static inline void write_pmxevtyper(uint32_t val)
+{
+    asm volatile("mcr p15, 0, %0, c9, c13, 1"
+                 :
+                 : "r"(val)
+                 : "memory");
+}
+
+static inline uint32_t read_pmxevcntr()
+{
+    uint32_t val;
+    asm volatile("mrc p15, 0, %0, c9, c13, 2"
+                 : "=r"(val)
+                 :);
+    return val;
+}
+
+static inline void write_pmxevcntr(uint32_t val)
+{
+    asm volatile("mcr p15, 0, %0, c9, c13, 2"
+                 :
+                 : "r"(val)
+                 : "memory");
+}
+
+static inline uint32_t read_id_pfr1()
+{
+    uint32_t val;
+    asm volatile("mrc p15, 0, %0, c0, c1, 1"
+                 : "=r"(val)
+                 :);
+    return val;
+}
+
+static inline uint32_t read_cntfrq()
+{
+    uint32_t val;
+    asm volatile("mrc p15, 0, %0, c14, c0, 0"
+                 : "=r"(val)
+                 :);
+    return val;
+}
+
+static inline uint32_t read_cntkctl()
+{
+    uint32_t val;
+    asm volatile("mrc p15, 0, %0, c14, c1, 0"
+                 : "=r"(val)
+                 :);
+    return val;
+}
+
+static inline void write_cntkctl(uint32_t val)
+{
+    asm volatile("mcr p15, 0, %0, c14, c1, 0"
+                 :
+                 : "r"(val)
+                 : "memory");
+}
+
+static inline uint32_t read_cntvct_low()
+{
+    uint32_t lo, hi;
+    asm volatile("mrrc p15, 1, %0, %1, c14"
+                 : "=r"(lo), "=r"(hi));
+    return lo;
+}
@@ -56,6 +56,29 @@ inline static void system_flush_whole_tlb()
     system_data_synchronise_barrier();
 }
 
+/* Inner shareable variants are broadcasted by hardware to all cpus, no IPI is needed. */
+inline static void system_flush_tlb_entry_all_cpus(uint32_t vaddr)
+{
+    system_data_synchronise_barrier();
+    asm volatile("mcr p15, 0, %0, c8, c3, 3"
+                 :
+                 : "r"(vaddr)
+                 : "memory");
+    system_data_synchronise_barrier();
+    system_instruction_barrier();
+}
+
+inline static void system_flush_whole_tlb_all_cpus()
+{
+    system_data_synchronise_barrier();
+    asm volatile("mcr p15, 0, %0, c8, c3, 0"
+                 :
+                 : "r"(0)
+                 : "memory");
+    system_data_synchronise_barrier();
+    system_instruction_barrier();
+}
+
 inline static void system_set_pdir(uint32_t pdir)
 {
     system_data_synchronise_barrier();
@@ -66,6 +89,41 @@ inline static void system_set_pdir(uint32_t pdir)
     system_flush_whole_tlb();
 }
 
+/**
+ * Non-global entries are tagged with the ASID in CONTEXTIDR, so they
+ * survive a switch of TTBR0. The reserved id 0 is held while TTBR0
+ * changes, walks of the new table can't be tagged with the old id then.
+ */
+inline static uint32_t system_tlb_asid_count()
+{
+    return 256;
+}
+
+inline static void system_set_pdir_asid(uint32_t pdir, uint32_t asid)
+{
+    system_data_synchronise_barrier();
+    asm volatile("mcr p15, 0, %0, c13, c0, 1"
+                 :
+                 : "r"(0)
+                 : "memory");
+    system_instruction_barrier();
+    asm volatile("mcr p15, 0, %0, c2, c0, 0"
+                 :
+                 : "r"(pdir)
+                 : "memory");
+    system_instruction_barrier();
+    asm volatile("mcr p15, 0, %0, c13, c0, 1"
+                 :
+                 : "r"(asid)
+                 : "memory");
+    system_instruction_barrier();
+}
+
+// Kernel pages are global as long as their nG bit is clear.
+inline static void system_enable_global_pages()
+{
+}
+
 inline static void system_enable_write_protect()
 {
 }
@@ -74,6 +132,11 @@ inline static void system_disable_write_protect()
 {
 }
 
+// Sections are always supported by short-descriptor tables.
+inline static void system_enable_large_pages()
+{
+}
+
 inline static void system_enable_paging()
 {
     volatile uint32_t val;
@@ -115,4 +178,14 @@ inline static int system_cpu_id()
                  : "=r"(res)
                  :);
     return res & 0x3;
-}
\ No newline at end of file
+}
+
+/* The PMU cycle counter, it's 32 bit wide, so deltas are taken modulo 2^32. */
+inline static uint32_t system_read_cycles()
+{
+    uint32_t res;
+    asm volatile("mrc p15, 0, %0, c9, c13, 0"
+                 : "=r"(res)
+                 :);
+    return res;
+}
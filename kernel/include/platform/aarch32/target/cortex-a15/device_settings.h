@@ -42,5 +42,7 @@
 
 #define SP804_TIMER1_IRQ_LINE (32 + 2)
 
+#define UART_IRQ_LINE (32 + 5)
+
 #define PL050_KEYBOARD_IRQ_LINE (32 + 12)
 #define PL050_MOUSE_IRQ_LINE (32 + 13)
\ No newline at end of file
@@ -9,5 +9,8 @@
 #include <libkern/types.h>
 struct thread;
 
+/* Words signal_impl_prepare_stack pushes to the user stack. */
+#define SIGNAL_IMPL_STACK_WORDS 18
+
 int signal_impl_prepare_stack(struct thread* thread, int signo, uint32_t old_sp, uint32_t magic);
 int signal_impl_restore_stack(struct thread* thread, uint32_t* old_sp, uint32_t* magic);
\ No newline at end of file
@@ -57,6 +57,20 @@ static inline void set_instruction_pointer(trapframe_t* tf, uint32_t ip)
     tf->user_ip = ip;
 }
 
+/**
+ * Frame pointer of the interrupted code, the chain is only meaningful
+ * when the code is built with frame pointers.
+ */
+static inline uint32_t get_frame_pointer(trapframe_t* tf)
+{
+    return tf->r[11];
+}
+
+static inline bool tf_is_from_user(trapframe_t* tf)
+{
+    return (tf->user_flags & CPSR_M_SYS) == CPSR_M_USR;
+}
+
 static inline uint32_t get_syscall_result(trapframe_t* tf)
 {
     return tf->r[0];
@@ -21,6 +21,22 @@ struct PACKED table_desc {
             int imp : 1;
             int baddr : 22;
         };
+        struct {
+            unsigned int type : 2; /* 0b10 for sections */
+            unsigned int b : 1;
+            unsigned int c : 1;
+            unsigned int xn : 1;
+            unsigned int domain : 4;
+            unsigned int imp : 1;
+            unsigned int ap1 : 2;
+            unsigned int tex : 3;
+            unsigned int ap2 : 1;
+            unsigned int s : 1;
+            unsigned int ng : 1;
+            unsigned int zero : 1;
+            unsigned int ns : 1;
+            unsigned int baddr : 12;
+        } section; /* Maps 1MB directly, used for TABLE_DESC_4MB */
         uint32_t data;
     };
 };
@@ -28,6 +44,7 @@ typedef struct table_desc table_desc_t;
 
 #define pde_t table_desc_t
 #define TABLE_DESC_FRAME_OFFSET 10
+#define TABLE_DESC_SECTION_FRAME_OFFSET 20
 
 enum TABLE_DESC_PAGE_FLAGS {
     TABLE_DESC_PRESENT = 0x1,
@@ -44,6 +61,9 @@ enum TABLE_DESC_PAGE_FLAGS {
     TABLE_DESC_ZEROING_ON_DEMAND = 0x800
 };
 
+/* Sections get the same attributes as PAGE_DESC_WRITE_COMBINING pages. */
+#define TABLE_DESC_WRITE_COMBINING TABLE_DESC_PWT
+
 void table_desc_init(table_desc_t* pde);
 void table_desc_set_allocated_state(table_desc_t* pde);
 bool table_desc_is_in_allocated_state(table_desc_t* pde);
@@ -46,6 +46,9 @@ enum PAGE_DESC_PAGE_FLAGS {
     PAGE_DESC_ZEROING_ON_DEMAND = 0x800
 };
 
+/* Normal memory, outer and inner non-cacheable (TEX 001, C 0, B 0). */
+#define PAGE_DESC_WRITE_COMBINING PAGE_DESC_WRITETHOUGH
+
 void page_desc_init(page_desc_t* pte);
 void page_desc_set_attrs(page_desc_t* pte, uint32_t attrs);
 void page_desc_del_attrs(page_desc_t* pte, uint32_t attrs);
@@ -59,6 +62,16 @@ bool page_desc_is_writable(page_desc_t pte);
 bool page_desc_is_user(page_desc_t pte);
 bool page_desc_is_not_cacheable(page_desc_t pte);
 bool page_desc_is_cow(page_desc_t pte);
+bool page_desc_is_write_combining(page_desc_t pte);
+
+/**
+ * A swapped out page is a fault entry (bits 0 and 1 are clear) with the
+ * ap2 bit set, which no mapped page has, baddr keeps the swap slot. Slots
+ * start with 1, so a cleared descriptor is never taken for a swapped one.
+ */
+void page_desc_set_swapped(page_desc_t* pte, uint32_t slot);
+bool page_desc_is_swapped(page_desc_t pte);
+uint32_t page_desc_get_swap_slot(page_desc_t pte);
 
 uint32_t page_desc_get_frame(page_desc_t pte);
 uint32_t page_desc_get_settings(page_desc_t pte);
@@ -11,6 +11,7 @@
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
 #include <platform/generic/tasking/context.h>
+#include <platform/generic/tasking/trapframe.h>
 #include <tasking/bits/sched.h>
 
 #define CPU_CNT 4
@@ -34,8 +35,11 @@ typedef struct {
     struct thread* running_thread;
     cpu_state_t current_state;
     struct thread* idle_thread;
+    trapframe_t* irq_tf; // frame of the irq being handled
+    bool in_tasklets; // the thread below tasklets must not be switched, see tasklets_run()
 
     sched_data_t sched;
+    pmm_frame_cache_t frame_cache;
 
     /* Stat */
     time_t stat_ticks_since_boot;
@@ -46,6 +50,8 @@ typedef struct {
     // Information about current state of fpu.
     struct thread* fpu_for_thread;
     pid_t fpu_for_pid;
+    uint32_t stat_fpu_traps;
+    uint32_t stat_fpu_saves;
 #endif // FPU_ENABLED
 } cpu_t;
 
@@ -0,0 +1,5 @@
+#ifdef __i386__
+#include <platform/x86/pmu.h>
+#elif __arm__
+#include <platform/aarch32/pmu.h>
+#endif
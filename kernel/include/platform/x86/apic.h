@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/c_attrs.h>
+#include <libkern/types.h>
+
+/**
+ * With an APIC the legacy irqs come through the IO APIC to the same
+ * vectors the 8259 used, so drivers keep using set_irq_handler(IRQn).
+ * Every cpu ticks with its own local APIC timer.
+ */
+#define APIC_TIMER_VECTOR 0xf0
+#define APIC_IPI_TLB_VECTOR 0xf1
+#define APIC_SPURIOUS_VECTOR 0xff
+
+#define APIC_ISA_IRQS 16
+
+/* Local APIC registers, the offsets are in bytes. */
+#define LAPIC_ID 0x020
+#define LAPIC_TPR 0x080
+#define LAPIC_EOI 0x0b0
+#define LAPIC_SVR 0x0f0
+#define LAPIC_ICR_LO 0x300
+#define LAPIC_ICR_HI 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIV 0x3e0
+
+#define LAPIC_SVR_ENABLE (1 << 8)
+#define LAPIC_LVT_MASKED (1 << 16)
+#define LAPIC_TIMER_PERIODIC (1 << 17)
+#define LAPIC_TIMER_DIV_16 0x3
+
+#define LAPIC_ICR_INIT (0x5 << 8)
+#define LAPIC_ICR_STARTUP (0x6 << 8)
+#define LAPIC_ICR_PENDING (1 << 12)
+#define LAPIC_ICR_ASSERT (1 << 14)
+#define LAPIC_ICR_ALL_BUT_SELF (0x3 << 18)
+
+/* IO APIC registers are reached through an index and a window. */
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WIN 0x10
+#define IOAPIC_REG_VER 0x01
+#define IOAPIC_REG_REDTBL 0x10
+
+#define IOAPIC_ACTIVE_LOW (1 << 13)
+#define IOAPIC_LEVEL (1 << 15)
+#define IOAPIC_MASKED (1 << 16)
+
+/**
+ * The cpus and the IO APIC are listed by the ACPI MADT, or by the MP
+ * configuration table on machines without ACPI.
+ */
+enum ACPI_MADT_ENTRY_TYPES {
+    ACPI_MADT_LAPIC = 0,
+    ACPI_MADT_IOAPIC = 1,
+    ACPI_MADT_IRQ_OVERRIDE = 2,
+};
+
+struct PACKED acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_paddr;
+};
+typedef struct acpi_rsdp acpi_rsdp_t;
+
+struct PACKED acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+};
+typedef struct acpi_sdt_header acpi_sdt_header_t;
+
+struct PACKED acpi_madt {
+    acpi_sdt_header_t header;
+    uint32_t lapic_paddr;
+    uint32_t flags;
+};
+typedef struct acpi_madt acpi_madt_t;
+
+enum MP_ENTRY_TYPES {
+    MP_ENTRY_CPU = 0,
+    MP_ENTRY_BUS = 1,
+    MP_ENTRY_IOAPIC = 2,
+    MP_ENTRY_IO_IRQ = 3,
+    MP_ENTRY_LOCAL_IRQ = 4,
+};
+
+struct PACKED mp_floating_pointer {
+    char signature[4];
+    uint32_t config_paddr;
+    uint8_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t features[5];
+};
+typedef struct mp_floating_pointer mp_floating_pointer_t;
+
+struct PACKED mp_config {
+    char signature[4];
+    uint16_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table_paddr;
+    uint16_t oem_table_size;
+    uint16_t entries_count;
+    uint32_t lapic_paddr;
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+};
+typedef struct mp_config mp_config_t;
+
+bool apic_setup();
+void apic_setup_secondary_cpu();
+bool apic_enabled();
+void lapic_eoi();
+
+int apic_cpus_count();
+uint8_t apic_cpu_lapic_id(int cpu);
+void apic_send_init(uint8_t lapic_id);
+void apic_send_startup(uint8_t lapic_id, uint8_t page);
+void apic_delay_us(uint32_t us);
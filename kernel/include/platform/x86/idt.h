@@ -19,6 +19,10 @@
 #define IRQ_MASTER_OFFSET 32
 #define IRQ_SLAVE_OFFSET 40
 
+/* Vectors handed out to devices which raise MSIs, see pci_msi_setup(). */
+#define IRQ_MSI_BASE 48
+#define IRQ_MSI_COUNT 16
+
 struct PACKED idt_entry { // call gate
     uint16_t offset_lower;
     uint16_t segment;
@@ -32,6 +36,7 @@ extern void** handlers[IDT_ENTRIES];
 
 void idt_element_setup(uint8_t n, void* handler_addr, bool user);
 void interrupts_setup();
+void interrupts_setup_secondary_cpu();
 
 void set_irq_handler(uint8_t interrupt_no, void (*handler)());
 void init_irq_handlers();
@@ -86,6 +91,25 @@ extern void irq12();
 extern void irq13();
 extern void irq14();
 extern void irq15();
+extern void irq_msi0();
+extern void irq_msi1();
+extern void irq_msi2();
+extern void irq_msi3();
+extern void irq_msi4();
+extern void irq_msi5();
+extern void irq_msi6();
+extern void irq_msi7();
+extern void irq_msi8();
+extern void irq_msi9();
+extern void irq_msi10();
+extern void irq_msi11();
+extern void irq_msi12();
+extern void irq_msi13();
+extern void irq_msi14();
+extern void irq_msi15();
+extern void irq_apic_timer();
+extern void irq_apic_tlb();
+extern void irq_apic_spurious();
 extern void irq_null();
 extern void irq_empty_handler();
 
@@ -14,4 +14,5 @@
 #define SLAVE_PIC_DATA 0x00A1
 #define ICW4_8086 0x01
 
-void pic_remap(unsigned int offset1, unsigned int offset2);
\ No newline at end of file
+void pic_remap(unsigned int offset1, unsigned int offset2);
+void pic_disable();
\ No newline at end of file
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/c_attrs.h>
+#include <libkern/types.h>
+
+/**
+ * The startup IPI takes the page the secondary cpus begin at. It lies in
+ * the low memory which is reserved by pmm and mapped 1:1 by the kernel
+ * pdir, so the trampoline keeps running once paging is on.
+ */
+#define SMP_TRAMPOLINE_PADDR 0x8000
+#define SMP_CPU_STACK_SIZE (16 * KB)
+
+/* Filled by the boot cpu right after smp_trampoline_args. */
+struct PACKED smp_trampoline_args {
+    uint32_t pdir_paddr;
+    uint32_t stack;
+    uint32_t entry;
+};
+typedef struct smp_trampoline_args smp_trampoline_args_t;
+
+void smp_start_secondary_cpus();
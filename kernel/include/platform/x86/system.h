@@ -35,11 +35,51 @@ inline static void system_flush_tlb_entry(uint32_t vaddr)
                  : "memory");
 }
 
+/* Global entries survive a load of CR3, they are dropped by toggling CR4.PGE. */
 inline static void system_flush_whole_tlb()
 {
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0"
+                 : "=r"(cr4));
+    if (cr4 & 0x80) {
+        asm volatile("mov %0, %%cr4" ::"r"(cr4 & ~0x80)
+                     : "memory");
+        asm volatile("mov %0, %%cr4" ::"r"(cr4)
+                     : "memory");
+        return;
+    }
     system_set_pdir(read_cr3());
 }
 
+/**
+ * PCIDs exist only in IA-32e mode, so with 32-bit paging the TLB is not
+ * tagged and a load of CR3 drops every non-global entry.
+ */
+inline static uint32_t system_tlb_asid_count()
+{
+    return 0;
+}
+
+inline static void system_set_pdir_asid(uint32_t pdir, uint32_t asid)
+{
+    system_set_pdir(pdir);
+}
+
+/* Other cpus are asked with an IPI, see apic_flush_tlb_other_cpus(). */
+void apic_flush_tlb_other_cpus(uint32_t vaddr, bool whole);
+
+inline static void system_flush_tlb_entry_all_cpus(uint32_t vaddr)
+{
+    system_flush_tlb_entry(vaddr);
+    apic_flush_tlb_other_cpus(vaddr, false);
+}
+
+inline static void system_flush_whole_tlb_all_cpus()
+{
+    system_flush_whole_tlb();
+    apic_flush_tlb_other_cpus(0, true);
+}
+
 inline static void system_enable_write_protect()
 {
     asm volatile("mov %cr0, %eax");
@@ -54,6 +94,31 @@ inline static void system_disable_write_protect()
     asm volatile("mov %eax, %cr0");
 }
 
+// Enables 4MB pages (CR4.PSE), they are used for big aligned mappings.
+inline static void system_enable_large_pages()
+{
+    asm volatile("mov %cr4, %eax");
+    asm volatile("or $0x10, %eax");
+    asm volatile("mov %eax, %cr4");
+}
+
+// Enables global pages (CR4.PGE) if the cpu has them, kernel pages are
+// marked global and stay in the TLB over a switch of pdir.
+inline static void system_enable_global_pages()
+{
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid"
+                 : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                 : "a"(1));
+    if (!((edx >> 13) & 1)) {
+        return;
+    }
+
+    asm volatile("mov %cr4, %eax");
+    asm volatile("or $0x80, %eax");
+    asm volatile("mov %eax, %cr4");
+}
+
 inline static void system_enable_paging()
 {
     asm volatile("mov %cr0, %eax");
@@ -84,7 +149,23 @@ NORETURN inline static void system_stop()
  * CPU
  */
 
+extern volatile uint32_t* lapic_regs;
+extern uint8_t lapic_id_to_cpu[256];
+
+/* Cpus are told apart by the id of their local APIC, the one at 0x20 of its registers. */
 inline static int system_cpu_id()
 {
-    return 0;
+    if (!lapic_regs) {
+        return 0;
+    }
+    return lapic_id_to_cpu[lapic_regs[0x20 / 4] >> 24];
+}
+
+/* Low half of the TSC, deltas are taken modulo 2^32 as on arm. */
+inline static uint32_t system_read_cycles()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc"
+                 : "=a"(lo), "=d"(hi));
+    return lo;
 }
\ No newline at end of file
@@ -9,4 +9,5 @@
 #include <libkern/types.h>
 #include <tasking/tasking.h>
 
-void switchuvm(thread_t* thread);
\ No newline at end of file
+void switchuvm(thread_t* thread);
+void switchtls(thread_t* thread);
\ No newline at end of file
@@ -77,6 +77,20 @@ static inline void set_instruction_pointer(trapframe_t* tf, uint32_t ip)
     tf->eip = ip;
 }
 
+/**
+ * Frame pointer of the interrupted code, the chain is only meaningful
+ * when the code is built with frame pointers.
+ */
+static inline uint32_t get_frame_pointer(trapframe_t* tf)
+{
+    return tf->ebp;
+}
+
+static inline bool tf_is_from_user(trapframe_t* tf)
+{
+    return (tf->cs & 3) == DPL_USER;
+}
+
 static inline uint32_t get_syscall_result(trapframe_t* tf)
 {
     return tf->eax;
@@ -115,6 +129,7 @@ static inline void tf_setup_as_user_thread(trapframe_t* tf)
     tf->ds = (SEG_UDATA << 3) | DPL_USER;
     tf->es = tf->ds;
     tf->ss = tf->ds;
+    tf->gs = (SEG_UTLS << 3) | DPL_USER;
     tf->eflags = FL_IF;
 }
 
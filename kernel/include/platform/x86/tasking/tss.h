@@ -54,6 +54,6 @@ struct PACKED tss {
 };
 typedef struct tss tss_t;
 
-extern tss_t tss;
+extern tss_t tss[]; /* One per cpu. */
 
 void ltr(uint16_t seg);
\ No newline at end of file
@@ -28,6 +28,9 @@ enum TABLE_DESC_PAGE_FLAGS {
     TABLE_DESC_ZEROING_ON_DEMAND = 0x800
 };
 
+/* The same PAT entry as PAGE_DESC_WRITE_COMBINING, PAT bit 12 stays clear. */
+#define TABLE_DESC_WRITE_COMBINING TABLE_DESC_PWT
+
 void table_desc_init(table_desc_t* pde);
 void table_desc_set_allocated_state(table_desc_t* pde);
 bool table_desc_is_in_allocated_state(table_desc_t* pde);
@@ -28,6 +28,18 @@ enum PAGE_DESC_PAGE_FLAGS {
     PAGE_DESC_ZEROING_ON_DEMAND = 0x800
 };
 
+/* PWT alone selects PAT entry 1, which page_desc_setup_pat() makes WC. */
+#define PAGE_DESC_WRITE_COMBINING PAGE_DESC_WRITETHOUGH
+
+/**
+ * A swapped out page is not present, its descriptor keeps the swap slot
+ * where the frame goes. Slots start with 1, so a cleared descriptor is
+ * never taken for a swapped one.
+ */
+#define PAGE_DESC_SWAPPED PAGE_DESC_ZEROING_ON_DEMAND
+
+#define IA32_PAT_MSR 0x277
+
 void page_desc_init(page_desc_t* pte);
 void page_desc_set_attrs(page_desc_t* pte, uint32_t attrs);
 void page_desc_del_attrs(page_desc_t* pte, uint32_t attrs);
@@ -41,7 +53,14 @@ bool page_desc_is_writable(page_desc_t pte);
 bool page_desc_is_user(page_desc_t pte);
 bool page_desc_is_not_cacheable(page_desc_t pte);
 bool page_desc_is_cow(page_desc_t pte);
+bool page_desc_is_write_combining(page_desc_t pte);
+
+void page_desc_set_swapped(page_desc_t* pte, uint32_t slot);
+bool page_desc_is_swapped(page_desc_t pte);
+uint32_t page_desc_get_swap_slot(page_desc_t pte);
 
 uint32_t page_desc_get_frame(page_desc_t pte);
 uint32_t page_desc_get_settings(page_desc_t pte);
-uint32_t page_desc_get_settings_ignore_cow(page_desc_t pte);
\ No newline at end of file
+uint32_t page_desc_get_settings_ignore_cow(page_desc_t pte);
+
+void page_desc_setup_pat();
\ No newline at end of file
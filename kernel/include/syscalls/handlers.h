@@ -18,13 +18,18 @@
 int ksyscall_impl(int sysid, int a, int b, int c, int d);
 
 void sys_handler(trapframe_t* tf);
+int sys_handler_nested(uint32_t id, uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t e);
 void sys_restart_syscall(trapframe_t* tf);
 void sys_exit(trapframe_t* tf);
 void sys_fork(trapframe_t* tf);
 void sys_read(trapframe_t* tf);
 void sys_write(trapframe_t* tf);
+void sys_writev(trapframe_t* tf);
+void sys_sendfile(trapframe_t* tf);
+void sys_copy_file_range(trapframe_t* tf);
 void sys_open(trapframe_t* tf);
 void sys_close(trapframe_t* tf);
+void sys_dup2(trapframe_t* tf);
 void sys_waitpid(trapframe_t* tf);
 void sys_creat(trapframe_t* tf);
 void sys_exec(trapframe_t* tf);
@@ -42,19 +47,29 @@ void sys_rmdir(trapframe_t* tf);
 void sys_unlink(trapframe_t* tf);
 void sys_mmap(trapframe_t* tf);
 void sys_munmap(trapframe_t* tf);
+void sys_madvise(trapframe_t* tf);
+void sys_msync(trapframe_t* tf);
 void sys_socket(trapframe_t* tf);
 void sys_bind(trapframe_t* tf);
 void sys_connect(trapframe_t* tf);
+void sys_accept(trapframe_t* tf);
 void sys_getdents(trapframe_t* tf);
+void sys_getdents_stat(trapframe_t* tf);
 void sys_ioctl(trapframe_t* tf);
 void sys_setpgid(trapframe_t* tf);
 void sys_getpgid(trapframe_t* tf);
 void sys_create_thread(trapframe_t* tf);
 void sys_sleep(trapframe_t* tf);
 void sys_select(trapframe_t* tf);
+void sys_epoll_create(trapframe_t* tf);
+void sys_epoll_ctl(trapframe_t* tf);
+void sys_epoll_wait(trapframe_t* tf);
 void sys_fstat(trapframe_t* tf);
 void sys_sched_yield(trapframe_t* tf);
 void sys_uname(trapframe_t* tf);
+void sys_perf_open(trapframe_t* tf);
+void sys_perf_read(trapframe_t* tf);
+void sys_perf_close(trapframe_t* tf);
 void sys_clock_settime(trapframe_t* tf);
 void sys_clock_gettime(trapframe_t* tf);
 void sys_clock_getres(trapframe_t* tf);
@@ -62,5 +77,14 @@ void sys_nice(trapframe_t* tf);
 void sys_shbuf_create(trapframe_t* tf);
 void sys_shbuf_get(trapframe_t* tf);
 void sys_shbuf_free(trapframe_t* tf);
+void sys_shbuf_resize(trapframe_t* tf);
+void sys_shbuf_hand_over(trapframe_t* tf);
+void sys_shbuf_seal(trapframe_t* tf);
+void sys_spawn(trapframe_t* tf);
+void sys_fsync(trapframe_t* tf);
+void sys_sync(trapframe_t* tf);
+void sys_futex(trapframe_t* tf);
+void sys_exit_thread(trapframe_t* tf);
+void sys_ring_enter(trapframe_t* tf);
 
 void sys_none(trapframe_t* tf);
\ No newline at end of file
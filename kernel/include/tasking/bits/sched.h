@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <libkern/lock.h>
+
 #define MAX_PRIO 0
 #define MIN_PRIO 11
 #define IDLE_PRIO (MIN_PRIO + 1)
@@ -14,6 +16,11 @@
 #define DEFAULT_PRIO 6
 #define SCHED_INT 10
 #define LAST_CPU_NOT_SET 0xffff
+#define SCHED_CACHE_HOT_TICKS 2 /* A thread ran so recently is not moved to other cpu. */
+#define SCHED_BALANCE_IMBALANCE 2 /* Difference of loads which makes a cpu pull a thread. */
+#define SCHED_INTERACTIVITY_MAX 16
+#define SCHED_INTERACTIVITY_WAKEUP 2 /* Added on every wakeup, 1 is taken for every used up timeslice. */
+#define SCHED_INTERACTIVE_THRESHOLD 8
 
 struct thread;
 
@@ -23,10 +30,20 @@ struct runqueue {
 };
 typedef struct runqueue runqueue_t;
 
+/**
+ * Bit N of a map is set when the runqueue of prio N is not empty, so the
+ * next thread is found with one ctz instead of a walk over all prios.
+ */
 struct sched_data {
-    int next_read_prio;
     runqueue_t* master_buf;
     runqueue_t* slave_buf;
+    uint32_t master_map;
+    uint32_t slave_map;
     int enqueued_tasks;
+    lock_t lock;
+
+    /* Stat */
+    uint32_t stat_picks;
+    uint32_t stat_swaps;
 };
 typedef struct sched_data sched_data_t;
\ No newline at end of file
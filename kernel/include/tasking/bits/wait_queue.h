@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/types.h>
+
+struct thread;
+
+/**
+ * A wait queue keeps threads blocked for the same kind of event. Producers
+ * mark the queue as woken and the scheduler re-checks only the threads of
+ * woken queues instead of every thread in the system. Sleeps and select
+ * timeouts are woken by their timer.
+ */
+struct wait_queue {
+    struct thread* head;
+    struct thread* tail;
+    volatile bool woken;
+};
+typedef struct wait_queue wait_queue_t;
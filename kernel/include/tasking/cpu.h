@@ -26,9 +26,16 @@ static inline void cpu_leave_kernel_space()
 
 static inline void cpu_tick()
 {
-    if (THIS_CPU->running_thread->process->is_kthread) {
+    thread_t* thread = THIS_CPU->running_thread;
+    if (thread->process->is_kthread) {
         THIS_CPU->stat_system_and_idle_ticks++;
     } else {
         THIS_CPU->stat_user_ticks++;
     }
+
+    if (THIS_CPU->current_state == CPU_IN_USERLAND) {
+        thread->stat_user_ticks++;
+    } else {
+        thread->stat_system_ticks++;
+    }
 }
\ No newline at end of file
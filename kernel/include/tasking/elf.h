@@ -82,6 +82,12 @@ typedef struct {
     uint32_t p_align;
 } elf_program_header_32_t;
 
+enum P_FLAGS_FIELDS {
+    PF_X = 0x1,
+    PF_W = 0x2,
+    PF_R = 0x4,
+};
+
 enum SH_TYPE_FIELDS {
     SHT_NULL,
     SHT_PROGBITS,
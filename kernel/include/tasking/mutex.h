@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/lock.h>
+#include <libkern/types.h>
+#include <tasking/bits/wait_queue.h>
+
+/**
+ * Kernel mutexes are taken for long sections, such as reads of files,
+ * where spinning would waste the cpu. A locker spins for a while when the
+ * owner is running on another cpu and then sleeps on the wait queue of the
+ * mutex. Spinlocks are still used for short sections and those which are
+ * entered from interrupt handlers.
+ * A mutex must not be taken with a spinlock held. Where sleeping is not
+ * possible (the scheduler, boot) the locker keeps spinning.
+ */
+
+#define KMUTEX_SPIN_COUNT (1024)
+
+enum KMUTEX_STATE {
+    KMUTEX_FREE = 0,
+    KMUTEX_TAKEN,
+    KMUTEX_TAKEN_WITH_WAITERS,
+};
+
+struct thread;
+struct kmutex {
+    uint32_t state;
+    struct thread* owner;
+    wait_queue_t waiters;
+};
+typedef struct kmutex kmutex_t;
+
+void kmutex_init(kmutex_t* mutex);
+void kmutex_lock(kmutex_t* mutex);
+bool kmutex_trylock(kmutex_t* mutex);
+void kmutex_unlock(kmutex_t* mutex);
+
+/**
+ * A reader/writer mutex lets readers hold the lock together. Writers are
+ * preferred: new readers wait once a writer waits, so a stream of readers
+ * can't starve writers.
+ */
+struct krwlock {
+    lock_t lock;
+    uint32_t readers;
+    uint32_t writer;
+    uint32_t waiting_writers;
+    uint32_t seq; /* Changes every time waiters might proceed. */
+    wait_queue_t readers_queue;
+    wait_queue_t writers_queue;
+};
+typedef struct krwlock krwlock_t;
+
+void krwlock_init(krwlock_t* rwlock);
+void krwlock_read_lock(krwlock_t* rwlock);
+void krwlock_read_unlock(krwlock_t* rwlock);
+void krwlock_write_lock(krwlock_t* rwlock);
+void krwlock_write_unlock(krwlock_t* rwlock);
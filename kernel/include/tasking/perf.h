@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/bits/sys/perf.h>
+#include <libkern/types.h>
+
+/**
+ * Counters of a thread, allocated by its first perf_open(). Hardware
+ * counters are started from 0 when the thread is switched in and added to
+ * counts when it's switched out, so counts doesn't hold the current run.
+ */
+struct perf_state {
+    uint32_t used_mask;
+    uint8_t events[PERF_MAX_COUNTERS];
+    uint32_t periods[PERF_MAX_COUNTERS];
+    uint64_t counts[PERF_MAX_COUNTERS];
+    uint64_t next_sample[PERF_MAX_COUNTERS];
+};
+typedef struct perf_state perf_state_t;
+
+struct thread;
+
+int perf_open(struct thread* thread, int event, uint32_t sample_period);
+int perf_read(struct thread* thread, int counter, uint64_t* value);
+int perf_close(struct thread* thread, int counter);
+void perf_free(struct thread* thread);
+
+void perf_switch_in(struct thread* thread);
+void perf_switch_out(struct thread* thread);
+bool perf_should_sample(struct thread* thread, int* event);
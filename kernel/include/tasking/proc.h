@@ -16,7 +16,8 @@
 #include <mem/vmm/zoner.h>
 
 #define MAX_PROCESS_COUNT 1024
-#define MAX_OPENED_FILES 16
+#define PROC_FDS_INITIAL 32 /* Keep it a multiple of 32, the bitmaps are made of words. */
+#define PROC_FDS_MAX 1024
 
 struct blocker;
 
@@ -28,6 +29,7 @@ enum ZONE_FLAGS {
     ZONE_NOT_CACHEABLE = 0x8,
     ZONE_COW = 0x10,
     ZONE_USER = 0x20,
+    ZONE_WRITE_COMBINING = 0x40,
 };
 
 enum ZONE_TYPES {
@@ -40,6 +42,7 @@ enum ZONE_TYPES {
     ZONE_TYPE_MAPPED = 0x20,
     ZONE_TYPE_MAPPED_FILE_PRIVATLY = 0x40,
     ZONE_TYPE_MAPPED_FILE_SHAREDLY = 0x80,
+    ZONE_TYPE_SHARED_BUFFER = 0x100,
 };
 
 struct proc_zone {
@@ -49,9 +52,27 @@ struct proc_zone {
     uint32_t flags;
     dentry_t* file;
     uint32_t offset;
+    uint32_t file_len; /* Bytes from the start backed by the file, the rest is zeroed. */
+    int shared_buffer; /* Id of the mapped buffer for ZONE_TYPE_SHARED_BUFFER. */
 };
 typedef struct proc_zone proc_zone_t;
 
+/**
+ * The table keeps pointers to descriptors, so a descriptor never moves
+ * when the table grows and pointers from proc_get_fd() stay valid.
+ * Descriptors are allocated once per slot and live until the process is
+ * freed. used has a bit for every open descriptor and free slots are
+ * found with find-first-zero starting from the word of first_free.
+ */
+struct fd_table {
+    file_descriptor_t** fds;
+    uint32_t* used;
+    uint32_t* cloexec;
+    uint32_t size;
+    uint32_t first_free; /* No free slot lies below it. */
+};
+typedef struct fd_table fd_table_t;
+
 enum PROC_STATUS {
     PROC_INVALID = 0,
     PROC_ALIVE,
@@ -69,6 +90,7 @@ struct proc {
     uint32_t status;
     struct thread* main_thread;
     lock_t lock;
+    uint32_t dying_threads; /* Threads which exited alone, see proc_free_dying_threads(). */
 
     uid_t uid;
     gid_t gid;
@@ -77,11 +99,11 @@ struct proc {
     uid_t suid;
     gid_t sgid;
 
-    dynamic_array_t zones;
+    dynamic_array_t zones; /* Sorted by start, see proc_zoner.c. */
 
     dentry_t* proc_file;
     dentry_t* cwd;
-    file_descriptor_t* fds;
+    fd_table_t fd_table;
     tty_entry_t* tty;
 
     bool is_kthread;
@@ -103,8 +125,10 @@ int proc_free(proc_t* p);
 int proc_free_lockless(proc_t* p);
 
 struct thread* proc_alloc_thread();
+void proc_put_thread(struct thread* thread);
 struct thread* proc_create_thread(proc_t* p);
 void proc_kill_all_threads(proc_t* p);
+void proc_free_dying_threads(proc_t* p);
 void proc_kill_all_threads_except(proc_t* p, struct thread* gthread);
 
 /**
@@ -119,6 +143,7 @@ int kthread_free(proc_t* p);
 
 int proc_load(proc_t* p, struct thread* main_thread, const char* path);
 int proc_copy_of(proc_t* new_proc, struct thread* from_thread);
+int proc_inherit(proc_t* new_proc, proc_t* from_proc);
 
 int proc_die(proc_t* p);
 int proc_block_all_threads(proc_t* p, struct blocker* blocker);
@@ -128,9 +153,21 @@ int proc_block_all_threads(proc_t* p, struct blocker* blocker);
  */
 
 int proc_chdir(proc_t* p, const char* path);
-file_descriptor_t* proc_get_free_fd(proc_t* p);
+
+void proc_fd_init_storage();
+int proc_fd_table_init(proc_t* p);
+int proc_fd_table_copy(proc_t* new_proc, proc_t* from_proc);
+void proc_fd_table_free(proc_t* p);
+void proc_close_cloexec_fds(proc_t* p);
+
+file_descriptor_t* proc_alloc_fd_lockless(proc_t* p, int* index);
+file_descriptor_t* proc_alloc_fd(proc_t* p, int* index);
+void proc_free_fd(proc_t* p, int index);
+int proc_close_fd(proc_t* p, int index);
+int proc_dup_fd(proc_t* p, int oldfd, int newfd);
+void proc_set_cloexec(proc_t* p, int index, bool cloexec);
+file_descriptor_t* proc_get_fd_lockless(proc_t* p, uint32_t index);
 file_descriptor_t* proc_get_fd(proc_t* p, uint32_t index);
-int proc_get_fd_id(proc_t* proc, file_descriptor_t* fd);
 
 /**
  * PROC ZONER FUNCTIONS
@@ -139,8 +176,11 @@ int proc_get_fd_id(proc_t* proc, file_descriptor_t* fd);
 proc_zone_t* proc_new_zone(proc_t* p, uint32_t start, uint32_t len);
 proc_zone_t* proc_extend_zone(proc_t* proc, uint32_t start, uint32_t len);
 proc_zone_t* proc_new_random_zone(proc_t* p, uint32_t len);
+proc_zone_t* proc_new_random_zone_aligned(proc_t* p, uint32_t len, uint32_t alignment);
 proc_zone_t* proc_new_random_zone_backward(proc_t* p, uint32_t len);
 proc_zone_t* proc_find_zone(proc_t* p, uint32_t addr);
 proc_zone_t* proc_find_zone_no_proc(dynamic_array_t* zones, uint32_t addr);
 int proc_delete_zone_no_proc(dynamic_array_t*, proc_zone_t*);
-int proc_delete_zone(proc_t*, proc_zone_t*);
\ No newline at end of file
+int proc_delete_zone(proc_t*, proc_zone_t*);
+int proc_cut_zone(proc_t* proc, proc_zone_t* zone, uint32_t start, uint32_t len);
+int proc_release_reserved_range(proc_t* proc, uint32_t start, uint32_t len);
\ No newline at end of file
@@ -15,16 +15,22 @@ void scheduler_init();
 void schedule_activate_cpu();
 void resched_dont_save_context();
 void resched();
+void sched_resume_saved_context();
 void sched();
 void sched_enqueue(thread_t* thread);
+void sched_wakeup(thread_t* thread);
 void sched_dequeue(thread_t* thread);
 uint32_t active_cpu_count();
 
 static inline void sched_tick()
 {
-    if (RUNNING_THREAD) {
+    if (RUNNING_THREAD && !THIS_CPU->in_tasklets) {
         RUNNING_THREAD->ticks_until_preemption--;
         if (!RUNNING_THREAD->ticks_until_preemption) {
+            if (RUNNING_THREAD->interactivity) {
+                RUNNING_THREAD->interactivity--;
+            }
+            RUNNING_THREAD->stat_involuntary_switches++;
             resched();
         }
     }
@@ -10,6 +10,9 @@
 
 #define SIGNALS_CNT 32
 
+/* Flags of sigaction */
+#define SA_RESTART (0x10000000) /* An interrupted wait goes on after the handler. */
+
 /* TODO: Add more */
 enum SIGNAL_ACTION {
     SIGNAL_ACTION_TERMINATE,
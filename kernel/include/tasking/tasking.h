@@ -19,7 +19,6 @@
 
 #define MAX_PROCESS_COUNT 1024
 #define MAX_DYING_PROCESS_COUNT 8
-#define MAX_OPENED_FILES 16
 #define SIGNALS_CNT 32
 
 extern proc_t proc[MAX_PROCESS_COUNT];
@@ -32,6 +31,7 @@ proc_t* tasking_get_proc_by_pdir(pdirectory_t* pdir);
  */
 
 void switchuvm(thread_t* p);
+void switchtls(thread_t* p);
 
 /**
  * TASK LOADING FUNCTIONS
@@ -47,6 +47,7 @@ proc_t* tasking_run_kernel_thread(void* entry_point, void* data);
 
 void tasking_init();
 void tasking_kill_dying();
+void tasking_wake_reaper();
 
 /**
  * SYSCALL IMPLEMENTATION
@@ -54,6 +55,7 @@ void tasking_kill_dying();
 
 void tasking_fork(trapframe_t* tf);
 int tasking_exec(const char* path, const char** argv, const char** env);
+int tasking_spawn(const char* path, const char** argv, const char** env);
 void tasking_exit(int exit_code);
 int tasking_waitpid(int pid);
 int tasking_kill(thread_t* thread, int signo);
@@ -64,7 +66,7 @@ int tasking_kill(thread_t* thread, int signo);
 
 void signal_init();
 
-int signal_set_handler(thread_t* thread, int signo, void* handler);
+int signal_set_handler(thread_t* thread, int signo, void* handler, int flags);
 int signal_set_allow(thread_t* thread, int signo);
 int signal_set_private(thread_t* thread, int signo);
 int signal_set_pending(thread_t* thread, int signo);
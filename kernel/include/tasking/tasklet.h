@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/types.h>
+
+/**
+ * Tasklets are the bottom halves of irq handlers. A top half only acks its
+ * device, saves what it read and schedules a tasklet. Scheduled tasklets
+ * run when the outermost irq handler of the cpu leaves, with interrupts
+ * on, so a long one doesn't hold back the irqs of other devices.
+ * A tasklet never runs on two cpus at once and runs once for any number of
+ * schedules made before it starts. It runs in interrupt context, so it
+ * must not sleep or take a lock which is held with interrupts on.
+ */
+
+enum TASKLET_STATE {
+    TASKLET_SCHEDULED = (1 << 0),
+    TASKLET_RUNNING = (1 << 1),
+};
+
+typedef void (*tasklet_func_t)(void* data);
+
+struct tasklet {
+    tasklet_func_t func;
+    void* data;
+    uint32_t state;
+    struct tasklet* next;
+};
+typedef struct tasklet tasklet_t;
+
+void tasklet_init(tasklet_t* tasklet, tasklet_func_t func, void* data);
+void tasklet_schedule(tasklet_t* tasklet);
+void tasklets_run();
@@ -12,8 +12,10 @@
 #include <libkern/types.h>
 #include <platform/generic/tasking/context.h>
 #include <platform/generic/tasking/trapframe.h>
+#include <tasking/bits/wait_queue.h>
 #include <tasking/signal.h>
 #include <time/time_manager.h>
+#include <time/timers.h>
 
 enum THREAD_STATUS {
     THREAD_INVALID = 0,
@@ -30,6 +32,7 @@ struct blocker {
     int reason;
     int (*should_unblock)(struct thread* p);
     bool should_unblock_for_signal;
+    bool interrupted; /* A signal handler without SA_RESTART ran, the wait ends with -EINTR. */
 };
 typedef struct blocker blocker_t;
 
@@ -41,19 +44,42 @@ enum BLOCKER_REASON {
     BLOCKER_SLEEP,
     BLOCKER_SELECT,
     BLOCKER_DUMPING,
+    BLOCKER_FUTEX,
+    BLOCKER_MUTEX,
+    BLOCKER_EPOLL,
 };
 
+/**
+ * State which only select and signal delivery touch. It lives in its own
+ * array of the thread storage node, so the scheduler and blockers walk
+ * smaller threads and don't pull it into the cache.
+ */
+struct thread_cold {
+    int nfds;
+    fd_set_t readfds;
+    fd_set_t writefds;
+    fd_set_t exceptfds;
+    void* signal_handlers[SIGNALS_CNT];
+};
+typedef struct thread_cold thread_cold_t;
+
 struct proc;
 struct thread {
     struct proc* process;
     uint32_t tid;
     uint32_t status;
+    struct thread* free_next; /* Free list of thread_list, while the thread is free. */
+    thread_cold_t* cold;
 
     /* Kernel data */
     zone_t kstack;
     context_t* context; // context of kernel's registers
     trapframe_t* tf;
     fpu_state_t* fpu_state;
+    int fpu_cpu; /* Cpu whose registers hold fpu_state, FPU_NOT_LOADED if none. */
+    uint32_t tls; /* Thread pointer of the user thread, see thread_tcb_t. */
+    uint32_t zone_hint; /* Index of the zone proc_find_zone() found last. */
+    struct perf_state* perf; /* Hardware counters, NULL till the thread opens one. */
 
     /* Scheduler data */
     struct thread* sched_prev;
@@ -61,41 +87,59 @@ struct thread {
     int last_cpu;
     time_t ticks_until_preemption;
     time_t start_time_in_ticks; // Time when the task was put to run.
+    time_t last_ran_at; // In ticks of the boot cpu, used not to move cache hot threads.
+    uint32_t interactivity; // Grows when the thread wakes up, drops when it uses up its timeslice.
 
     /* Blocker data */
     blocker_t blocker;
+    wait_queue_t* wait_queue;
+    struct thread* wait_prev;
+    struct thread* wait_next;
     int exit_code;
     struct thread* joinee;
     file_descriptor_t* blocker_fd;
-    time_t unblock_time;
-    int nfds;
-    fd_set_t readfds;
-    fd_set_t writefds;
-    fd_set_t exceptfds;
+    time_t unblock_time; /* In ticks since boot, see timeman_global_ticks(). */
+    timer_entry_t blocker_timer;
+    struct epoll* epoll;
+    uint32_t* futex_addr;
 
     /* Stat data */
     time_t stat_total_running_ticks;
+    time_t stat_user_ticks;
+    time_t stat_system_ticks;
+    uint32_t stat_switches;
+    uint32_t stat_involuntary_switches; // Preemptions at the end of a timeslice.
+    uint32_t stat_minor_faults;
+    uint32_t stat_cow_faults;
+    uint32_t stat_file_faults;
+    uint32_t stat_read_bytes;
+    uint32_t stat_written_bytes;
+    uint32_t stat_syscalls;
 
     uint32_t signals_mask;
     uint32_t pending_signals_mask;
-    void* signal_handlers[SIGNALS_CNT];
+    uint32_t signals_restart_mask; /* Handlers set with SA_RESTART. */
 };
 typedef struct thread thread_t;
 
 #define THREADS_PER_NODE (128)
 struct thread_list_node {
     thread_t thread_storage[THREADS_PER_NODE];
+    thread_cold_t cold_storage[THREADS_PER_NODE];
     struct thread_list_node* next;
-    int empty_spots;
 };
 typedef struct thread_list_node thread_list_node_t;
 
+/**
+ * Freed threads are put to a free list and taken again first, slots of the
+ * tail node which have never been used come next.
+ */
 struct thread_list {
     struct thread_list_node* head;
-    struct thread_list_node* next_empty_node;
-    int next_empty_index;
-    lock_t lock;
     struct thread_list_node* tail;
+    int next_empty_index; /* First never used slot of the tail. */
+    thread_t* free_head;
+    lock_t lock;
 };
 typedef struct thread_list thread_list_t;
 
@@ -108,6 +152,14 @@ int thread_setup(struct proc* p, thread_t* thread);
 int thread_setup_kstack(thread_t* thread);
 int thread_copy_of(thread_t* thread, thread_t* from_thread);
 
+#ifdef FPU_ENABLED
+#define FPU_NOT_LOADED (-1)
+void thread_fpu_switch(thread_t* next);
+void thread_fpu_handle_trap();
+void thread_fpu_sync(thread_t* thread);
+void thread_fpu_forget(thread_t* thread);
+#endif // FPU_ENABLED
+
 int thread_fill_up_stack(thread_t* thread, int argc, char** argv, char** env);
 
 int thread_kstack_free(thread_t* thread);
@@ -120,11 +172,24 @@ static ALWAYS_INLINE int thread_is_free(thread_t* thread) { return (thread->stat
  * BLOCKER FUNCTIONS
  */
 
+void blocker_init();
+void blocker_unblock_threads();
+void blocker_remove(thread_t* thread);
+void blocker_interrupt(thread_t* thread);
+void blocker_wake_io();
+void blocker_wake_joiners();
+
 int init_join_blocker(thread_t* p);
 int init_read_blocker(thread_t* p, file_descriptor_t* bfd);
 int init_write_blocker(thread_t* thread, file_descriptor_t* bfd);
 int init_sleep_blocker(thread_t* thread, uint32_t time);
+int init_sleep_ticks_blocker(thread_t* thread, time_t ticks);
 int init_select_blocker(thread_t* thread, int nfds, fd_set_t* readfds, fd_set_t* writefds, fd_set_t* exceptfds, timeval_t* timeout);
+int init_epoll_blocker(thread_t* thread, struct epoll* ep, int timeout_ms);
+int init_futex_blocker(thread_t* thread, uint32_t* uaddr, uint32_t val);
+int blocker_futex_wake(struct proc* p, uint32_t* uaddr, int count);
+int init_wait_blocker(thread_t* thread, wait_queue_t* queue, uint32_t* addr, uint32_t val);
+int blocker_wake_queue(wait_queue_t* queue, int count);
 
 /**
  * DEBUG FUNCTIONS
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/types.h>
+#include <time/timers.h>
+
+/**
+ * Work items are background jobs of the kernel, like flushers and the
+ * reaper, run by shared kernel threads instead of a thread per job. Every
+ * cpu has a pool with its own worker, a work is queued to the pool of the
+ * cpu which queued it. Workers are threads, so unlike tasklets a work may
+ * sleep and take mutexes, but it holds back the rest of its pool while it
+ * does so.
+ * A work runs once for any number of queues made before it starts and
+ * never runs on two workers at once: while it runs, it is queued again to
+ * the pool which runs it. Pools run works of higher priority first.
+ */
+
+enum WORK_PRIO {
+    WORK_PRIO_HIGH,
+    WORK_PRIO_NORMAL,
+    WORK_PRIO_LOW,
+    WORK_PRIO_COUNT,
+};
+
+enum WORK_STATE {
+    WORK_PENDING = (1 << 0),
+    WORK_RUNNING = (1 << 1),
+    WORK_DELAYED = (1 << 2), /* The timer of a delayed work is armed. */
+};
+
+typedef void (*work_func_t)(void* data);
+
+struct work_pool;
+
+struct work {
+    work_func_t func;
+    void* data;
+    uint32_t prio;
+    uint32_t state;
+    struct work_pool* pool; /* The pool which runs the work or ran it last. */
+    struct work* next;
+};
+typedef struct work work_t;
+
+struct delayed_work {
+    work_t work;
+    timer_entry_t timer;
+    int cpu;
+};
+typedef struct delayed_work delayed_work_t;
+
+void workqueue_init();
+
+void work_init(work_t* work, work_func_t func, void* data, uint32_t prio);
+bool work_queue(work_t* work);
+bool work_queue_on(work_t* work, int cpu);
+
+void delayed_work_init(delayed_work_t* dwork, work_func_t func, void* data, uint32_t prio);
+bool work_queue_delayed(delayed_work_t* dwork, uint32_t ms);
+void work_cancel_delayed(delayed_work_t* dwork);
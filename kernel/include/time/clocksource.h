@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/types.h>
+
+/**
+ * A free running counter which the time between ticks is interpolated
+ * with. Its rate is turned into mult and shift once, so a delta becomes
+ * nanoseconds with a multiplication: (delta * mult) >> shift.
+ */
+struct clocksource {
+    const char* name;
+    uint32_t (*read)();
+    uint32_t user_id; /* TIME_PAGE_CLOCK_*, how userspace reads the counter. */
+    uint32_t freq;
+    uint32_t mult;
+    uint32_t shift;
+};
+typedef struct clocksource clocksource_t;
+
+void clocksource_setup();
+/* The counter in use, NULL if there is none and the clock moves by ticks. */
+clocksource_t* clocksource_current();
+
+/**
+ * The delta has to stay under a few seconds of the counter, time_manager
+ * takes a new base on every tick.
+ */
+static inline uint32_t clocksource_delta_to_ns(clocksource_t* cs, uint32_t delta)
+{
+    if ((int32_t)delta < 0) {
+        return 0; /* Counters of cpus may be a bit apart. */
+    }
+    return ((uint64_t)delta * cs->mult) >> cs->shift;
+}
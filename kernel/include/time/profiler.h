@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/bits/profiler.h>
+#include <libkern/types.h>
+
+/**
+ * The profiler takes a sample of the interrupted code on every timer tick
+ * of each cpu while it's enabled. Samples are put into a per-cpu ring of
+ * PROFILER_SAMPLES_PER_CPU entries, which the interrupt of that cpu fills
+ * and readers of /dev/profiler drain. A sample taken when the ring is full
+ * is dropped. A thread with a sampling perf counter is sampled only on the
+ * ticks after its counter passes the period, see perf_should_sample().
+ * Writing "1" to /dev/profiler enables it and clears the rings, writing
+ * "0" disables it.
+ */
+
+#define PROFILER_SAMPLES_PER_CPU (512)
+
+int profiler_install();
+void profiler_tick();
@@ -12,6 +12,8 @@
 #include <libkern/types.h>
 #include <platform/generic/cpu.h>
 
+#define TIMEMAN_MAX_IDLE_TICKS (TIMER_TICKS_PER_SECOND)
+
 extern time_t ticks_since_boot;
 extern time_t ticks_since_second;
 
@@ -22,9 +24,18 @@ time_t timeman_to_seconds_since_epoch(uint8_t secs, uint8_t mins, uint8_t hrs, u
 
 int timeman_setup();
 void timeman_timer_tick();
+void timeman_skip_ticks(time_t ticks);
+void timeman_idle(bool can_stop_ticks);
+uint32_t timeman_page_paddr();
 
 time_t timeman_now();
 time_t timeman_seconds_since_boot();
 time_t timeman_get_ticks_from_last_second();
+/* Rate of system_read_cycles() measured over the last good second, 0 until one passed. */
+uint32_t timeman_cycles_per_second();
+/* CLOCK_MONOTONIC or CLOCK_REALTIME with the resolution of the clocksource. */
+void timeman_clock_read(clockid_t clk_id, timespec_t* ts);
 static inline time_t timeman_ticks_per_second() { return TIMER_TICKS_PER_SECOND; };
-static inline time_t timeman_ticks_since_boot() { return THIS_CPU->stat_ticks_since_boot; };
\ No newline at end of file
+static inline time_t timeman_ticks_since_boot() { return THIS_CPU->stat_ticks_since_boot; };
+/* Ticks of the boot cpu, which drives timers. */
+static inline time_t timeman_global_ticks() { return atomic_load(&ticks_since_boot); };
\ No newline at end of file
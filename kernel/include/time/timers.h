@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libkern/types.h>
+#include <time/time_manager.h>
+
+/**
+ * Timers are kept in a hashed wheel of TIMERS_WHEEL_SIZE slots indexed by
+ * the tick they expire at, so adding, removing and firing a timer are O(1).
+ * A timer which expires more than TIMERS_WHEEL_SIZE ticks later stays in
+ * its slot for several turns of the wheel.
+ * The wheel is driven by the timer tick of the boot cpu and callbacks run
+ * from it, without the lock of the wheel taken.
+ */
+
+#define TIMERS_WHEEL_SIZE (256)
+
+struct timer_entry {
+    struct timer_entry* prev;
+    struct timer_entry* next;
+    time_t expires; /* In ticks since boot. */
+    void (*callback)(struct timer_entry* timer);
+    void* data;
+    bool pending;
+};
+typedef struct timer_entry timer_entry_t;
+
+void timers_init();
+void timers_add(timer_entry_t* timer, time_t expires);
+void timers_remove(timer_entry_t* timer);
+void timers_tick(time_t now);
+time_t timers_ticks_to_next(time_t limit);
+
+static inline time_t timers_ms_to_ticks(uint32_t ms)
+{
+    return (ms * TIMER_TICKS_PER_SECOND + 999) / 1000;
+}
+
+static inline uint32_t timers_ticks_to_ms(time_t ticks)
+{
+    return ticks * (1000 / TIMER_TICKS_PER_SECOND);
+}
@@ -246,4 +246,39 @@ int bitmap_unset_range(bitmap_t bitmap, int start, int len)
     }
 
     return 0;
+}
+
+bool bitmap_is_range_unset(bitmap_t bitmap, int start, int len)
+{
+    if (start + len - 1 >= bitmap.len * BITMAP_BLOCKS_PER_BYTE) {
+        return false;
+    }
+
+    int where = start;
+
+    while (len && (where % BITMAP_BLOCKS_PER_BYTE) != 0) {
+        if (bitmap_get(bitmap, where)) {
+            return false;
+        }
+        where++;
+        len--;
+    }
+
+    while (len >= BITMAP_BLOCKS_PER_BYTE) {
+        if (bitmap.data[where / BITMAP_BLOCKS_PER_BYTE]) {
+            return false;
+        }
+        where += BITMAP_BLOCKS_PER_BYTE;
+        len -= BITMAP_BLOCKS_PER_BYTE;
+    }
+
+    while (len) {
+        if (bitmap_get(bitmap, where)) {
+            return false;
+        }
+        where++;
+        len--;
+    }
+
+    return true;
 }
\ No newline at end of file
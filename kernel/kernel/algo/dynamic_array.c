@@ -97,6 +97,40 @@ int dynamic_array_pop(dynamic_array_t* v)
     return -1;
 }
 
+/**
+ * Puts the element at @index, the elements from @index on move one place
+ * up. Keeps sorted arrays sorted without a full resort.
+ */
+int dynamic_array_insert(dynamic_array_t* v, int index, void* element)
+{
+    if (index > v->size) {
+        return -1;
+    }
+    if (v->size == v->capacity) {
+        if (_dynamic_array_grow(v) != 0) {
+            return -1;
+        }
+    }
+
+    void* place = v->data + index * v->element_size;
+    memmove(place + v->element_size, place, (v->size - index) * v->element_size);
+    memcpy(place, element, v->element_size);
+    v->size++;
+    return 0;
+}
+
+int dynamic_array_remove(dynamic_array_t* v, int index)
+{
+    if (index >= v->size) {
+        return -1;
+    }
+
+    void* place = v->data + index * v->element_size;
+    memmove(place, place + v->element_size, (v->size - index - 1) * v->element_size);
+    v->size--;
+    return 0;
+}
+
 int dynamic_array_clear(dynamic_array_t* v)
 {
     v->size = 0;
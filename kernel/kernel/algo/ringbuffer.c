@@ -44,48 +44,64 @@ uint32_t ringbuffer_space_to_read_with_custom_start(ringbuffer_t* buf, uint32_t
     return res;
 }
 
+/* One byte is kept free, otherwise a full buffer would look empty. */
 uint32_t ringbuffer_space_to_write(ringbuffer_t* buf)
 {
-    uint32_t res = buf->zone.len - buf->end + buf->start;
-    if (buf->start > buf->end) {
-        res = buf->start - buf->end;
-    }
-    return res;
+    return buf->zone.len - 1 - ringbuffer_space_to_read(buf);
 }
 
-uint32_t ringbuffer_read(ringbuffer_t* buf, uint8_t* holder, uint32_t siz)
+/**
+ * Counts the bytes up to and including the first @stop, or all of them
+ * when there is none.
+ */
+uint32_t ringbuffer_space_to_read_until(ringbuffer_t* buf, uint8_t stop)
 {
-    uint32_t i = 0;
-    if (buf->start > buf->end) {
-        for (; i < siz && buf->start < buf->zone.len; i++, buf->start++) {
-            holder[i] = buf->zone.ptr[buf->start];
-        }
-        if (buf->start == buf->zone.len) {
-            buf->start = 0;
-        }
+    uint32_t avail = ringbuffer_space_to_read(buf);
+    uint32_t first = min(avail, buf->zone.len - buf->start);
+    uint8_t* found = memchr(&buf->zone.ptr[buf->start], stop, first);
+    if (found) {
+        return found - &buf->zone.ptr[buf->start] + 1;
     }
-    for (; i < siz && buf->start < buf->end; i++, buf->start++) {
-        holder[i] = buf->zone.ptr[buf->start];
+    found = memchr(buf->zone.ptr, stop, avail - first);
+    if (found) {
+        return first + (found - buf->zone.ptr) + 1;
     }
-    return i;
+    return avail;
+}
+
+/**
+ * Copies @siz bytes starting at @start of the zone, in at most two spans.
+ * Returns the position after the last copied byte.
+ */
+static inline uint32_t _ringbuffer_copy_out(ringbuffer_t* buf, uint32_t start, uint8_t* holder, uint32_t siz)
+{
+    uint32_t first = min(siz, buf->zone.len - start);
+    memcpy(holder, &buf->zone.ptr[start], first);
+    memcpy(holder + first, buf->zone.ptr, siz - first);
+    return (start + siz) % buf->zone.len;
+}
+
+static inline uint32_t _ringbuffer_copy_in(ringbuffer_t* buf, uint32_t end, const uint8_t* holder, uint32_t siz)
+{
+    uint32_t first = min(siz, buf->zone.len - end);
+    memcpy(&buf->zone.ptr[end], holder, first);
+    memcpy(buf->zone.ptr, holder + first, siz - first);
+    return (end + siz) % buf->zone.len;
+}
+
+uint32_t ringbuffer_read(ringbuffer_t* buf, uint8_t* holder, uint32_t siz)
+{
+    siz = min(siz, ringbuffer_space_to_read(buf));
+    buf->start = _ringbuffer_copy_out(buf, buf->start, holder, siz);
+    return siz;
 }
 
 uint32_t ringbuffer_read_with_start(ringbuffer_t* buf, uint32_t start, uint8_t* holder, uint32_t siz)
 {
-    uint32_t i = 0;
     start %= buf->zone.len;
-    if (start > buf->end) {
-        for (; i < siz && start < buf->zone.len; i++, start++) {
-            holder[i] = buf->zone.ptr[start];
-        }
-        if (start == buf->zone.len) {
-            start = 0;
-        }
-    }
-    for (; i < siz && start < buf->end; i++, start++) {
-        holder[i] = buf->zone.ptr[start];
-    }
-    return i;
+    siz = min(siz, ringbuffer_space_to_read_with_custom_start(buf, start));
+    _ringbuffer_copy_out(buf, start, holder, siz);
+    return siz;
 }
 
 uint32_t ringbuffer_read_one(ringbuffer_t* buf, uint8_t* data)
@@ -103,36 +119,25 @@ uint32_t ringbuffer_read_one(ringbuffer_t* buf, uint8_t* data)
 
 uint32_t ringbuffer_write(ringbuffer_t* buf, const uint8_t* holder, uint32_t siz)
 {
-    uint32_t i = 0;
-    if (buf->end >= buf->start) {
-        for (; i < siz && buf->end < buf->zone.len; i++, buf->end++) {
-            buf->zone.ptr[buf->end] = holder[i];
-        }
-        if (buf->end == buf->zone.len) {
-            buf->end = 0;
-        }
-    }
-    for (; i < siz && buf->end < buf->start; i++, buf->end++) {
-        buf->zone.ptr[buf->end] = holder[i];
-    }
-    return i;
+    siz = min(siz, ringbuffer_space_to_write(buf));
+    buf->end = _ringbuffer_copy_in(buf, buf->end, holder, siz);
+    return siz;
 }
 
 uint32_t ringbuffer_write_ignore_bounds(ringbuffer_t* buf, const uint8_t* holder, uint32_t siz)
 {
-    uint32_t i = 0;
-    for (; i < siz; i++) {
-        buf->zone.ptr[buf->end++] = holder[i];
-        if (buf->end == buf->zone.len) {
-            buf->end = 0;
-        }
+    uint32_t done = 0;
+    while (done < siz) {
+        uint32_t chunk = min(siz - done, buf->zone.len);
+        buf->end = _ringbuffer_copy_in(buf, buf->end, holder + done, chunk);
+        done += chunk;
     }
-    return i;
+    return siz;
 }
 
 uint32_t ringbuffer_write_one(ringbuffer_t* buf, uint8_t data)
 {
-    if (buf->end + 1 != buf->start) {
+    if ((buf->end + 1) % buf->zone.len != buf->start) {
         buf->zone.ptr[buf->end] = data;
         buf->end++;
         if (buf->end == buf->zone.len) {
@@ -2,12 +2,16 @@
 fpu_save:
     vstm    r0!, {d0-d15}
     vstm    r0!, {d16-d31}
+    vmrs    r1, fpscr
+    str     r1, [r0]
     bx      lr
 
 .global fpu_restore
 fpu_restore:
     vldm    r0!, {d0-d15}
     vldm    r0!, {d16-d31}
+    ldr     r1, [r0]
+    vmsr    fpscr, r1
     bx      lr
 
 .global read_fpexc
@@ -21,6 +21,8 @@ static gic_descritptor_t gicv2_descriptor = {
     .interrupt_descriptor = gicv2_interrupt_descriptor,
     .end_interrupt = gicv2_end,
     .enable_irq = gicv2_enable_irq,
+    .set_affinity = gicv2_set_affinity,
+    .this_cpu_mask = gicv2_this_cpu_mask,
 };
 static zone_t distributor_zone;
 static zone_t cpu_interface_zone;
@@ -66,14 +68,39 @@ void gicv2_enable_irq(irq_line_t id, irq_priority_t prior, irq_type_t type, int
 
     distributor_registers->icfgr[id_2bit_offset] |= (0b11 << id_2bit_bitpos);
 
-    if (IS_SPI(id)) {
-        distributor_registers->itargetsr[id_8bit_offset] |= (cpu_mask << id_8bit_bitpos);
-    }
+    gicv2_set_affinity(id, cpu_mask);
 
     /* Enabling */
     distributor_registers->isenabler[id_1bit_offset] |= (1 << id_1bit_bitpos);
 }
 
+/**
+ * Only SPIs have targets, SGIs and PPIs are private to their cpu. The
+ * target byte is replaced, so an irq can be moved to another cpu later.
+ */
+void gicv2_set_affinity(irq_line_t id, int cpu_mask)
+{
+    if (!IS_SPI(id)) {
+        return;
+    }
+
+    int id_8bit_offset = id / 4;
+    int id_8bit_bitpos = (id % 4) * 8;
+    uint32_t targets = distributor_registers->itargetsr[id_8bit_offset];
+    targets &= ~(uint32_t)(0xff << id_8bit_bitpos);
+    targets |= (uint32_t)(cpu_mask & 0xff) << id_8bit_bitpos;
+    distributor_registers->itargetsr[id_8bit_offset] = targets;
+}
+
+/**
+ * The first target registers are banked and read as the mask of the cpu
+ * interface which reads them.
+ */
+int gicv2_this_cpu_mask()
+{
+    return distributor_registers->itargetsr[0] & 0xff;
+}
+
 void gicv2_install()
 {
     if (_gicv2_map_itself()) {
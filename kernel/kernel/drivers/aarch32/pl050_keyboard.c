@@ -39,8 +39,7 @@ static void pl050_keyboard_recieve_notification(uint32_t msg, uint32_t param)
 
 static void _pl050_keyboard_int_handler()
 {
-    uint32_t data = registers->data;
-    generic_emit_key_set1(data);
+    generic_queue_key_set1(registers->data);
 }
 
 static inline void _keyboard_send_cmd(uint8_t cmd)
@@ -62,7 +61,7 @@ void pl050_keyboard_init(device_t* dev)
     _keyboard_send_cmd(0xF0);
     _keyboard_send_cmd(0x01);
 
-    irq_register_handler(PL050_KEYBOARD_IRQ_LINE, 0, 0, _pl050_keyboard_int_handler, BOOT_CPU_MASK);
+    irq_register_handler(PL050_KEYBOARD_IRQ_LINE, 0, IRQ_TYPE_INTERACTIVE_MASK, _pl050_keyboard_int_handler, BALANCED_CPU_MASK);
     generic_keyboard_init();
 }
 
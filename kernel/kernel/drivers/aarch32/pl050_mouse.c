@@ -5,7 +5,7 @@
  */
 
 // includes
-#include <algo/ringbuffer.h>
+#include <algo/spsc_ringbuffer.h>
 #include <drivers/aarch32/pl050.h>
 #include <drivers/generic/mouse.h>
 #include <fs/devfs/devfs.h>
@@ -16,9 +16,13 @@
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
 #include <platform/aarch32/interrupts.h>
+#include <tasking/tasklet.h>
 #include <tasking/tasking.h>
 
-static ringbuffer_t mouse_buffer;
+#define PL050_MOUSE_RAW_PACKET_SIZE 4
+
+static spsc_ringbuffer_t mouse_raw_buffer; /* Bytes read by the irq, not decoded yet. */
+static tasklet_t mouse_tasklet;
 static zone_t mapped_zone;
 static volatile pl050_registers_t* registers = (pl050_registers_t*)PL050_MOUSE_BASE;
 
@@ -30,34 +34,12 @@ static inline int _pl050_map_itself()
     return 0;
 }
 
-static bool _mouse_can_read(dentry_t* dentry, uint32_t start)
-{
-    return ringbuffer_space_to_read(&mouse_buffer) >= 1;
-}
-
-static int _mouse_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
-{
-    uint32_t leno = ringbuffer_space_to_read(&mouse_buffer);
-    if (leno > len) {
-        leno = len;
-    }
-    int res = ringbuffer_read(&mouse_buffer, buf, leno);
-    return leno;
-}
 static void pl050_mouse_recieve_notification(uint32_t msg, uint32_t param)
 {
     if (msg == DM_NOTIFICATION_DEVFS_READY) {
-        dentry_t* mp;
-        if (vfs_resolve_path("/dev", &mp) < 0) {
+        if (generic_mouse_create_devfs() < 0) {
             kpanic("Can't init pl050_mouse in /dev");
         }
-
-        file_ops_t fops = { 0 };
-        fops.can_read = _mouse_can_read;
-        fops.read = _mouse_read;
-        devfs_inode_t* res = devfs_register(mp, MKDEV(10, 1), "mouse", 5, 0500, &fops);
-
-        dentry_put(mp);
     }
 }
 
@@ -88,26 +70,12 @@ static inline int16_t int8_to_int16_t_safe_convert(int8_t x)
     return x < 128 ? x : x - 256;
 }
 
-static void _pl050_mouse_int_handler()
+static void _pl050_mouse_emit_packet(uint8_t* raw)
 {
-    uint32_t statusrx = registers->stat;
-    uint32_t status = registers->ir;
-    uint32_t buffer[15];
-    int indx = 0;
-
-    if (!(status & KMIIR_RXINTR)) {
-        return;
-    }
-
-    while (status & KMIIR_RXINTR) {
-        buffer[indx++] = registers->data;
-        status = registers->ir;
-    }
-
-    uint8_t resp = buffer[0];
-    uint8_t xm = buffer[1];
-    uint8_t ym = buffer[2];
-    int16_t wheel = int8_to_int16_t_safe_convert(buffer[3]);
+    uint8_t resp = raw[0];
+    uint8_t xm = raw[1];
+    uint8_t ym = raw[2];
+    int16_t wheel = int8_to_int16_t_safe_convert(raw[3]);
 
     uint8_t y_overflow = (resp >> 7) & 1;
     uint8_t x_overflow = (resp >> 6) & 1;
@@ -131,7 +99,7 @@ static void _pl050_mouse_int_handler()
         packet.y_offset = 0;
     }
 
-    ringbuffer_write(&mouse_buffer, (uint8_t*)&packet, sizeof(mouse_packet_t));
+    generic_mouse_emit(&packet);
 
 #ifdef MOUSE_DRIVER_DEBUG
     log("%x ", packet.button_states);
@@ -148,6 +116,40 @@ static void _pl050_mouse_int_handler()
 #endif /* MOUSE_DRIVER_DEBUG */
 }
 
+static void _pl050_mouse_tasklet(void* data)
+{
+    uint8_t raw[PL050_MOUSE_RAW_PACKET_SIZE];
+    while (spsc_ringbuffer_space_to_read(&mouse_raw_buffer) >= PL050_MOUSE_RAW_PACKET_SIZE) {
+        spsc_ringbuffer_read(&mouse_raw_buffer, raw, PL050_MOUSE_RAW_PACKET_SIZE);
+        _pl050_mouse_emit_packet(raw);
+    }
+}
+
+/* Top half, only drains the controller. */
+static void _pl050_mouse_int_handler()
+{
+    uint32_t status = registers->ir;
+    uint8_t raw[PL050_MOUSE_RAW_PACKET_SIZE] = { 0 };
+    int indx = 0;
+
+    if (!(status & KMIIR_RXINTR)) {
+        return;
+    }
+
+    while (status & KMIIR_RXINTR) {
+        uint8_t data = registers->data;
+        if (indx < PL050_MOUSE_RAW_PACKET_SIZE) {
+            raw[indx++] = data;
+        }
+        status = registers->ir;
+    }
+
+    if (spsc_ringbuffer_space_to_write(&mouse_raw_buffer) >= PL050_MOUSE_RAW_PACKET_SIZE) {
+        spsc_ringbuffer_write(&mouse_raw_buffer, raw, PL050_MOUSE_RAW_PACKET_SIZE);
+    }
+    tasklet_schedule(&mouse_tasklet);
+}
+
 void pl050_mouse_init(device_t* dev)
 {
 #ifdef DEBUG_PL050
@@ -159,8 +161,10 @@ void pl050_mouse_init(device_t* dev)
     _mouse_send_cmd_and_data(0xF3, 200);
     _mouse_send_cmd_and_data(0xF3, 100);
     _mouse_send_cmd_and_data(0xF3, 80);
-    irq_register_handler(PL050_MOUSE_IRQ_LINE, 0, 0, _pl050_mouse_int_handler, BOOT_CPU_MASK);
-    mouse_buffer = ringbuffer_create_std();
+    generic_mouse_init();
+    mouse_raw_buffer = spsc_ringbuffer_create_std();
+    tasklet_init(&mouse_tasklet, _pl050_mouse_tasklet, NULL);
+    irq_register_handler(PL050_MOUSE_IRQ_LINE, 0, IRQ_TYPE_INTERACTIVE_MASK, _pl050_mouse_int_handler, BALANCED_CPU_MASK);
 }
 
 static driver_desc_t _pl050_mouse_driver_info()
@@ -12,9 +12,19 @@
 #include <libkern/log.h>
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
+#include <platform/aarch32/interrupts.h>
 #include <tasking/tasking.h>
+#include <time/time_manager.h>
 
 #define DEBUG_PL111
+#define PL111_REFRESH_RATE 60
+
+/**
+ * The buffers are scanned out as RGB565, which takes half the memory
+ * bandwidth of 32 bit pixels. The window server composites in 32 bits
+ * and converts the damage when it presents. Set to 4 for 32 bit pixels.
+ */
+#define PL111_BYTES_PER_PIXEL 2
 
 static zone_t mapped_zone;
 static volatile pl111_registers_t* registers = (pl111_registers_t*)PL111_BASE;
@@ -22,6 +32,8 @@ static char* pl111_bufs_paddr[2];
 static uint32_t pl111_screen_width;
 static uint32_t pl111_screen_height;
 static uint32_t pl111_screen_buffer_size;
+static bool pl111_has_cursor;
+static uint32_t pl111_cursor_hot_x, pl111_cursor_hot_y;
 
 static inline int _pl111_map_itself()
 {
@@ -41,15 +53,95 @@ static inline uint32_t roundup_to_page_size(uint32_t size)
 
 static int _pl111_init_buffer(uint32_t width, uint32_t height)
 {
-    uint32_t one_screen_len = width * 4 * height;
+    uint32_t one_screen_len = width * PL111_BYTES_PER_PIXEL * height;
     pl111_screen_buffer_size = one_screen_len * 2;
-    char* paddr_zone = pmm_alloc(pl111_screen_buffer_size);
+    // Aligned buffers are mapped with large pages, see _pl111_mmap.
+    char* paddr_zone = pmm_alloc_aligned(pl111_screen_buffer_size, VMM_USER_LARGE_PAGE_SIZE);
+    if (!paddr_zone) {
+        paddr_zone = pmm_alloc(pl111_screen_buffer_size);
+    }
     pl111_bufs_paddr[0] = (char*)(paddr_zone);
     pl111_bufs_paddr[1] = (char*)(paddr_zone + one_screen_len);
     registers->lcd_upbase = (uint32_t)pl111_bufs_paddr[0];
     return 0;
 }
 
+/**
+ * The vertical compare interrupt is not used, so vblanks are put on the
+ * clock of the timer tick at the refresh rate, like bga does.
+ */
+static uint32_t _pl111_ms_to_next_vblank()
+{
+    uint32_t ticks = timeman_get_ticks_from_last_second() % TIMER_TICKS_PER_SECOND;
+    uint32_t us_in_second = ticks * 1000000 / TIMER_TICKS_PER_SECOND;
+    uint32_t frame_us = 1000000 / PL111_REFRESH_RATE;
+    uint32_t us_to_vblank = frame_us - us_in_second % frame_us;
+    return (us_to_vblank + 999) / 1000;
+}
+
+/**
+ * The cursor registers may be missing on models of the controller, so the
+ * palette is written and read back to find them.
+ */
+static void _pl111_init_cursor()
+{
+    registers->crsr_ctrl = 0;
+    registers->crsr_palette_1 = 0x00ffffff;
+    pl111_has_cursor = (registers->crsr_palette_1 == 0x00ffffff);
+    if (!pl111_has_cursor) {
+        return;
+    }
+
+    registers->crsr_palette_0 = 0x00000000;
+    registers->crsr_config = CRSR_SIZE_MASK | CRSR_FRAME_SYNC_MASK;
+    registers->crsr_imsc = 0;
+}
+
+/**
+ * The cursor has 2 colors, black and white, so pixels are put to the
+ * nearest of them or left transparent. Pixels are 2 bits each, 4 in a byte
+ * with the first one in the top bits of it.
+ */
+static int _pl111_set_cursor(struct bga_cursor* cursor)
+{
+    registers->crsr_ctrl = 0;
+    for (int word = 0; word < CRSR_IMAGE_WORDS; word++) {
+        uint32_t val = 0;
+        for (int i = 0; i < 16; i++) {
+            uint32_t index = word * 16 + i;
+            uint32_t clr = cursor->pixels[(index / CRSR_DIMENSION) * BGA_CURSOR_SIZE + index % CRSR_DIMENSION];
+            uint32_t pixel = CRSR_PIXEL_TRANSPARENT;
+            if ((clr >> 24) >= 0x80) {
+                uint32_t luma = ((clr >> 16) & 0xff) * 3 + ((clr >> 8) & 0xff) * 6 + (clr & 0xff);
+                pixel = luma >= 128 * 10 ? CRSR_PIXEL_COLOR1 : CRSR_PIXEL_COLOR0;
+            }
+            val |= pixel << ((i / 4) * 8 + (3 - i % 4) * 2);
+        }
+        registers->crsr_image[word] = val;
+    }
+
+    pl111_cursor_hot_x = min(cursor->hot_x, (uint32_t)CRSR_DIMENSION - 1);
+    pl111_cursor_hot_y = min(cursor->hot_y, (uint32_t)CRSR_DIMENSION - 1);
+    registers->crsr_ctrl = CRSR_ON_MASK;
+    return 0;
+}
+
+/**
+ * The image can't be put at negative coords, the part of it over the top
+ * left edge is clipped instead.
+ */
+static int _pl111_move_cursor(uint32_t pos)
+{
+    uint32_t x = pos >> 16;
+    uint32_t y = pos & 0xffff;
+    uint32_t clip_x = x < pl111_cursor_hot_x ? pl111_cursor_hot_x - x : 0;
+    uint32_t clip_y = y < pl111_cursor_hot_y ? pl111_cursor_hot_y - y : 0;
+
+    registers->crsr_clip = ((clip_x << CRSR_CLIP_X_POS) & CRSR_CLIP_X_MASK) | ((clip_y << CRSR_CLIP_Y_POS) & CRSR_CLIP_Y_MASK);
+    registers->crsr_xy = (((x + clip_x - pl111_cursor_hot_x) << CRSR_X_POS) & CRSR_X_MASK) | (((y + clip_y - pl111_cursor_hot_y) << CRSR_Y_POS) & CRSR_Y_MASK);
+    return 0;
+}
+
 static int _pl111_ioctl(dentry_t* dentry, uint32_t cmd, uint32_t arg)
 {
     switch (cmd) {
@@ -57,9 +149,29 @@ static int _pl111_ioctl(dentry_t* dentry, uint32_t cmd, uint32_t arg)
         return pl111_screen_height;
     case BGA_GET_WIDTH:
         return pl111_screen_width;
+    case BGA_GET_DEPTH:
+        return PL111_BYTES_PER_PIXEL;
     case BGA_SWAP_BUFFERS:
         registers->lcd_upbase = (uint32_t)pl111_bufs_paddr[(arg & 1)];
         return 0;
+    case BGA_GET_NEXT_VBLANK:
+        return _pl111_ms_to_next_vblank();
+    case BGA_GET_ACCEL_OPS:
+        /* The controller only scans the buffer out, it has no 2D engine. */
+        return pl111_has_cursor ? BGA_ACCEL_CURSOR : 0;
+    case BGA_SET_CURSOR:
+        if (!pl111_has_cursor) {
+            return -EINVAL;
+        }
+        return _pl111_set_cursor((struct bga_cursor*)arg);
+    case BGA_MOVE_CURSOR:
+        if (!pl111_has_cursor) {
+            return -EINVAL;
+        }
+        return _pl111_move_cursor(arg);
+    case BGA_PIN_IRQS:
+        irq_pin_interactive(arg ? irq_this_cpu_mask() : BALANCED_CPU_MASK);
+        return 0;
     default:
         return -EINVAL;
     }
@@ -73,18 +185,16 @@ static proc_zone_t* _pl111_mmap(dentry_t* dentry, mmap_params_t* params)
         return 0;
     }
 
-    proc_zone_t* zone = proc_new_random_zone(RUNNING_THREAD->process, pl111_screen_buffer_size);
+    proc_zone_t* zone = proc_new_random_zone_aligned(RUNNING_THREAD->process, pl111_screen_buffer_size, VMM_USER_LARGE_PAGE_SIZE);
     if (!zone) {
         return 0;
     }
 
-    zone->flags |= ZONE_WRITABLE | ZONE_READABLE | ZONE_NOT_CACHEABLE;
+    zone->flags |= ZONE_WRITABLE | ZONE_READABLE | ZONE_WRITE_COMBINING;
     zone->type |= ZONE_TYPE_DEVICE;
     zone->file = dentry_duplicate(dentry);
 
-    for (int offset = 0; offset < pl111_screen_buffer_size; offset += VMM_PAGE_SIZE) {
-        vmm_map_page(zone->start + offset, (uint32_t)(pl111_bufs_paddr[0] + offset), zone->flags);
-    }
+    vmm_map_pages(zone->start, (uint32_t)pl111_bufs_paddr[0], zone->len / VMM_PAGE_SIZE, zone->flags);
 
     return zone;
 }
@@ -143,18 +253,20 @@ void pl111_init(device_t* dev)
 #endif
 
     volatile uint32_t ctl = registers->lcd_control;
-    ctl &= ~LCD_POWER_MASK
-        | ~LCD_BGR_MASK
-        | ~LCD_BPP_MASK
-        | ~LCD_EN_MASK;
+    ctl &= ~(LCD_POWER_MASK
+        | LCD_BGR_MASK
+        | LCD_BPP_MASK
+        | LCD_EN_MASK);
 
+    uint32_t bpp = PL111_BYTES_PER_PIXEL == 2 ? LCD_16_BPP_565 : LCD_24_BPP;
     ctl |= LCD_POWER_MASK
         | LCD_BGR_MASK
         | LCD_TFT_MASK
-        | (LCD_24_BPP << LCD_BPP_POS)
+        | ((bpp << LCD_BPP_POS) & LCD_BPP_MASK)
         | LCD_EN_MASK;
 
     registers->lcd_control = ctl;
+    _pl111_init_cursor();
 }
 
 static driver_desc_t _pl111_driver_info()
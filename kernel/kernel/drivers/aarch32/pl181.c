@@ -5,6 +5,8 @@
  */
 
 #include <drivers/aarch32/pl181.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
@@ -67,50 +69,145 @@ inline static int _pl181_select_card(uint32_t rca)
     return _pl181_send_cmd(CMD_SELECT | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, rca);
 }
 
-static int _pl181_read_block(device_t* device, uint32_t lba_like, void* read_data)
+/**
+ * Moves one sector through the FIFO. Half a FIFO is moved at once when the
+ * status allows it, a word at a time otherwise.
+ */
+static int _pl181_read_sector(uint32_t* data)
 {
-    sd_card_t* sd_card = &sd_cards[device->id];
-    uint32_t* read_data32 = (uint32_t*)read_data;
-    uint32_t bytes_read = 0;
+    int words = PL181_SECTOR_SIZE / 4;
+    for (int i = 0; i < words;) {
+        uint32_t status = registers->status;
+        if (status & MMC_STAT_DATA_ERRORS_MASK) {
+            return -EIO;
+        }
 
-    registers->data_length = PL181_SECTOR_SIZE; // Set length of bytes to transfer
-    registers->data_control = 0b11; // Enable dpsm and set direction from card to host
+        if ((status & MMC_STAT_RX_FIFO_HALF_FULL_MASK) && i + PL181_FIFO_HALF_WORDS <= words) {
+            for (int j = 0; j < PL181_FIFO_HALF_WORDS; j++) {
+                data[i++] = registers->fifo_data[j];
+            }
+        } else if (status & MMC_STAT_FIFO_DATA_AVAIL_TO_READ_MASK) {
+            data[i++] = registers->fifo_data[0];
+        }
+    }
+    return 0;
+}
 
-    if (sd_card->ishc) {
-        _pl181_send_cmd(CMD_READ_SINGLE_BLOCK | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, lba_like);
-    } else {
-        _pl181_send_cmd(CMD_READ_SINGLE_BLOCK | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, lba_like * PL181_SECTOR_SIZE);
+static int _pl181_write_sector(uint32_t* data)
+{
+    int words = PL181_SECTOR_SIZE / 4;
+    for (int i = 0; i < words;) {
+        uint32_t status = registers->status;
+        if (status & MMC_STAT_DATA_ERRORS_MASK) {
+            return -EIO;
+        }
+
+        if ((status & MMC_STAT_TX_FIFO_HALF_EMPTY_MASK) && i + PL181_FIFO_HALF_WORDS <= words) {
+            for (int j = 0; j < PL181_FIFO_HALF_WORDS; j++) {
+                registers->fifo_data[j] = data[i++];
+            }
+        } else if (!(status & MMC_STAT_TX_FIFO_FULL_MASK)) {
+            registers->fifo_data[0] = data[i++];
+        }
     }
+    return 0;
+}
 
-    while (registers->status & MMC_STAT_FIFO_DATA_AVAIL_TO_READ_MASK) {
-        *read_data32 = registers->fifo_data[0];
-        read_data32++;
-        bytes_read += 4;
+static int _pl181_wait_data_end()
+{
+    uint32_t status = registers->status;
+    while (!(status & MMC_STAT_DATA_END_MASK)) {
+        if (status & MMC_STAT_DATA_ERRORS_MASK) {
+            return -EIO;
+        }
+        status = registers->status;
     }
-    return bytes_read;
+    return 0;
 }
 
-static int _pl181_write_block(device_t* device, uint32_t lba_like, void* write_data)
+/**
+ * A request is served with one READ/WRITE_MULTIPLE_BLOCK per up to
+ * PL181_MAX_BLOCKS_PER_CMD sectors, ended with STOP_TRANSMISSION, instead
+ * of a command per sector.
+ */
+static int _pl181_transfer(device_t* device, storage_request_t* req, bool write)
 {
     sd_card_t* sd_card = &sd_cards[device->id];
-    uint32_t* write_data32 = (uint32_t*)write_data;
-    uint32_t bytes_written = 0;
+    uint32_t lba = req->lba;
+    uint32_t left = req->count;
+    int seg_index = 0;
+    uint32_t seg_offset = 0;
+
+    while (left) {
+        uint32_t count = min(left, (uint32_t)PL181_MAX_BLOCKS_PER_CMD);
+        uint32_t cmd;
+        if (write) {
+            cmd = count > 1 ? CMD_WRITE_MULTIPLE_BLOCK : CMD_WRITE_SINGLE_BLOCK;
+        } else {
+            cmd = count > 1 ? CMD_READ_MULTIPLE_BLOCK : CMD_READ_SINGLE_BLOCK;
+        }
 
-    registers->data_length = PL181_SECTOR_SIZE; // Set length of bytes to transfer
-    registers->data_control = 0b01; // Enable dpsm and set direction from host to card
+        registers->data_timer = PL181_DATA_TIMEOUT;
+        registers->data_length = count * PL181_SECTOR_SIZE;
+        registers->data_control = MMC_DATA_ENABLE_MASK | (write ? 0 : MMC_DATA_FROM_CARD_MASK) | (PL181_SECTOR_SIZE_LOG2 << MMC_DATA_BLOCK_SIZE_POS);
 
-    if (sd_card->ishc) {
-        _pl181_send_cmd(CMD_WRITE_SINGLE_BLOCK | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, lba_like);
-    } else {
-        _pl181_send_cmd(CMD_WRITE_SINGLE_BLOCK | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, lba_like * PL181_SECTOR_SIZE);
-    }
+        uint32_t addr = sd_card->ishc ? lba : lba * PL181_SECTOR_SIZE;
+        if (_pl181_send_cmd(cmd | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, addr)) {
+            return -EIO;
+        }
+
+        int err = 0;
+        for (uint32_t sector = 0; sector < count && !err; sector++) {
+            uint32_t* data = (uint32_t*)(req->segments[seg_index].data + seg_offset);
+            err = write ? _pl181_write_sector(data) : _pl181_read_sector(data);
+
+            seg_offset += PL181_SECTOR_SIZE;
+            if (seg_offset == req->segments[seg_index].len) {
+                seg_index++;
+                seg_offset = 0;
+            }
+        }
+
+        if (!err) {
+            err = _pl181_wait_data_end();
+        }
+        if (count > 1) {
+            _pl181_send_cmd(CMD_STOP_TRANSMISSION | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, 0);
+        }
+        if (err) {
+            return err;
+        }
 
-    while (registers->status & MMC_STAT_TRANSMIT_FIFO_EMPTY_MASK) {
-        registers->fifo_data[0] = *write_data32;
-        write_data32++;
-        bytes_written += 4;
+        lba += count;
+        left -= count;
     }
-    return bytes_written;
+    return 0;
+}
+
+static int _pl181_read_sectors(device_t* device, storage_request_t* req)
+{
+    return _pl181_transfer(device, req, false);
+}
+
+static int _pl181_write_sectors(device_t* device, storage_request_t* req)
+{
+    return _pl181_transfer(device, req, true);
+}
+
+static int _pl181_read_block(device_t* device, uint32_t lba_like, void* read_data)
+{
+    storage_segment_t seg = { .data = (uint8_t*)read_data, .len = PL181_SECTOR_SIZE };
+    storage_request_t req = { .lba = lba_like, .count = 1, .segments_count = 1, .segments = &seg };
+    int err = _pl181_transfer(device, &req, false);
+    return err ? err : PL181_SECTOR_SIZE;
+}
+
+static int _pl181_write_block(device_t* device, uint32_t lba_like, void* write_data)
+{
+    storage_segment_t seg = { .data = (uint8_t*)write_data, .len = PL181_SECTOR_SIZE };
+    storage_request_t req = { .lba = lba_like, .count = 1, .segments_count = 1, .segments = &seg };
+    int err = _pl181_transfer(device, &req, true);
+    return err ? err : PL181_SECTOR_SIZE;
 }
 
 static void _pl181_add_new_device(device_t* new_device)
@@ -161,6 +258,8 @@ static driver_desc_t _pl181_driver_info()
     ata_desc.functions[DRIVER_STORAGE_WRITE] = _pl181_write_block;
     ata_desc.functions[DRIVER_STORAGE_FLUSH] = 0;
     ata_desc.functions[DRIVER_STORAGE_CAPACITY] = _pl181_get_capacity;
+    ata_desc.functions[DRIVER_STORAGE_READ_SECTORS] = _pl181_read_sectors;
+    ata_desc.functions[DRIVER_STORAGE_WRITE_SECTORS] = _pl181_write_sectors;
     ata_desc.pci_serve_class = 0x08;
     ata_desc.pci_serve_subclass = 0x05;
     ata_desc.pci_serve_vendor_id = 0x00;
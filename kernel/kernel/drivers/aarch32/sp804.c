@@ -5,24 +5,31 @@
  */
 
 #include <drivers/aarch32/sp804.h>
+#include <libkern/atomic.h>
 #include <libkern/log.h>
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
 #include <platform/aarch32/interrupts.h>
 #include <tasking/cpu.h>
 #include <tasking/sched.h>
+#include <time/profiler.h>
 #include <time/time_manager.h>
 
 // #define DEBUG_SP804
 
+#define SP804_TICK_LOAD (SP804_CLK_HZ / TIMER_TICKS_PER_SECOND)
+
 static zone_t mapped_zone;
 volatile sp804_registers_t* timer1 = (sp804_registers_t*)SP804_TIMER1_BASE;
+volatile sp804_registers_t* timer2 = (sp804_registers_t*)SP804_TIMER2_BASE;
+static uint32_t _sp804_stopped_ticks = 0; /* Length of the one-shot period, 0 while ticking. */
 
 static inline int _sp804_map_itself()
 {
     mapped_zone = zoner_new_zone(VMM_PAGE_SIZE);
     vmm_map_page(mapped_zone.start, SP804_TIMER1_BASE, PAGE_READABLE | PAGE_WRITABLE | PAGE_EXECUTABLE);
     timer1 = (sp804_registers_t*)mapped_zone.ptr;
+    timer2 = (sp804_registers_t*)(mapped_zone.ptr + (SP804_TIMER2_BASE - SP804_TIMER1_BASE));
     return 0;
 }
 
@@ -31,18 +38,75 @@ static inline void _sp804_clear_interrupt(volatile sp804_registers_t* timer)
     timer->intclr = 1;
 }
 
+static inline void _sp804_set_periodic(volatile sp804_registers_t* timer)
+{
+    timer->control = 0;
+    timer->load = SP804_TICK_LOAD;
+    timer->control = SP804_ENABLE_MASK | SP804_PERIODIC_MASK | SP804_32_BIT_MASK | SP804_INTS_ENABLED_MASK;
+}
+
 static void _sp804_int_handler()
 {
     _sp804_clear_interrupt(timer1);
+    uint32_t skipped = sp804_resume_ticks();
+    if (skipped > 1) {
+        timeman_skip_ticks(skipped - 1);
+    }
     cpu_tick();
+    profiler_tick();
     timeman_timer_tick();
     sched_tick();
 }
 
+/**
+ * Timer2 counts down from 0xffffffff and wraps, it serves as a clocksource
+ * when there is no generic timer.
+ */
+static inline void _sp804_set_free_running(volatile sp804_registers_t* timer)
+{
+    timer->control = 0;
+    timer->load = 0xffffffff;
+    timer->control = SP804_ENABLE_MASK | SP804_32_BIT_MASK;
+}
+
 void sp804_install()
 {
     _sp804_map_itself();
-    timer1->load = SP804_CLK_HZ / TIMER_TICKS_PER_SECOND;
-    timer1->control = SP804_ENABLE_MASK | SP804_PERIODIC_MASK | SP804_32_BIT_MASK | SP804_INTS_ENABLED_MASK;
+    _sp804_set_periodic(timer1);
+    _sp804_set_free_running(timer2);
     irq_register_handler(SP804_TIMER1_IRQ_LINE, 0, IRQ_TYPE_EDGE_TRIGGERED_MASK, _sp804_int_handler, ALL_CPU_MASK);
-}
\ No newline at end of file
+}
+
+/**
+ * Replaces the periodic tick with one interrupt after the given number
+ * of ticks. Used when all cpus are idle.
+ */
+void sp804_stop_ticks(uint32_t ticks)
+{
+    timer1->control = 0;
+    timer1->load = ticks * SP804_TICK_LOAD;
+    atomic_store(&_sp804_stopped_ticks, ticks);
+    timer1->control = SP804_ENABLE_MASK | SP804_ONE_SHOT_MASK | SP804_32_BIT_MASK | SP804_INTS_ENABLED_MASK;
+}
+
+/**
+ * Goes back to the periodic tick. Returns the number of whole ticks which
+ * have passed since sp804_stop_ticks(), 0 when the tick was not stopped.
+ */
+uint32_t sp804_resume_ticks()
+{
+    uint32_t ticks = atomic_exchange(&_sp804_stopped_ticks, 0);
+    if (!ticks) {
+        return 0;
+    }
+
+    uint32_t left = timer1->value;
+    _sp804_clear_interrupt(timer1);
+    _sp804_set_periodic(timer1);
+    return (ticks * SP804_TICK_LOAD - left) / SP804_TICK_LOAD;
+}
+
+uint32_t sp804_read_counter()
+{
+    return ~timer2->value;
+}
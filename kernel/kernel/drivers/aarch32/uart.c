@@ -5,16 +5,20 @@
  */
 
 #include <drivers/aarch32/uart.h>
+#include <drivers/generic/uart.h>
+#include <libkern/libkern.h>
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
+#include <platform/aarch32/interrupts.h>
 
 volatile uint32_t* output = (uint32_t*)COM1;
 static zone_t mapped_zone;
+static uint32_t _uart_imsc = 0;
 
 static inline int _uart_map_itself()
 {
     mapped_zone = zoner_new_zone(VMM_PAGE_SIZE);
-    vmm_map_page(mapped_zone.start, COM1, PAGE_READABLE | PAGE_WRITABLE | PAGE_EXECUTABLE);
+    vmm_map_page(mapped_zone.start, COM1, PAGE_READABLE | PAGE_WRITABLE | PAGE_EXECUTABLE | PAGE_NOT_CACHEABLE);
     output = (uint32_t*)mapped_zone.ptr;
     return 0;
 }
@@ -31,11 +35,93 @@ void uart_remap()
 
 int uart_write(int port, uint8_t data)
 {
-    *output = data;
+    while (output[UART_FR] & UART_FR_TXFF) { }
+    output[UART_DR] = data;
     return 0;
 }
 
 int uart_read(int port, uint8_t* data)
 {
+    while (output[UART_FR] & UART_FR_RXFE) { }
+    *data = output[UART_DR];
     return 0;
-}
\ No newline at end of file
+}
+
+bool uart_hw_tx_full()
+{
+    return output[UART_FR] & UART_FR_TXFF;
+}
+
+void uart_hw_put(uint8_t data)
+{
+    output[UART_DR] = data;
+}
+
+bool uart_hw_rx_ready()
+{
+    return !(output[UART_FR] & UART_FR_RXFE);
+}
+
+uint8_t uart_hw_get()
+{
+    return output[UART_DR];
+}
+
+void uart_hw_set_tx_irq(bool enabled)
+{
+    uint32_t imsc = enabled ? (_uart_imsc | UART_INT_TX) : (_uart_imsc & ~UART_INT_TX);
+    if (imsc != _uart_imsc) {
+        _uart_imsc = imsc;
+        output[UART_IMSC] = imsc;
+    }
+}
+
+static void _uart_int_handler()
+{
+    output[UART_ICR] = UART_INT_RX | UART_INT_TX | UART_INT_RT;
+    generic_uart_irq();
+}
+
+static void _uart_recieve_notification(uint32_t msg, uint32_t param)
+{
+    if (msg == DM_NOTIFICATION_DEVFS_READY) {
+        if (generic_uart_create_devfs() < 0) {
+            kpanic("Can't init uart in /dev");
+        }
+    }
+}
+
+/**
+ * The TX interrupt comes when the FIFO drains to the level set in IFLS,
+ * 0 is 1/8 of it. RX comes at the same level or after a timeout.
+ */
+static void _uart_start()
+{
+    output[UART_IFLS] = 0;
+    generic_uart_init();
+    irq_register_handler(UART_IRQ_LINE, 0, 0, _uart_int_handler, BALANCED_CPU_MASK);
+    _uart_imsc = UART_INT_RX | UART_INT_RT;
+    output[UART_IMSC] = _uart_imsc;
+}
+
+static driver_desc_t _uart_driver_info()
+{
+    driver_desc_t desc = { 0 };
+    desc.type = DRIVER_OTHER;
+    desc.auto_start = true;
+    desc.is_device_driver = false;
+    desc.is_device_needed = false;
+    desc.is_driver_needed = false;
+    desc.functions[DRIVER_NOTIFICATION] = _uart_recieve_notification;
+    desc.functions[DM_FUNC_DRIVER_START] = _uart_start;
+    desc.pci_serve_class = 0xff;
+    desc.pci_serve_subclass = 0xff;
+    desc.pci_serve_vendor_id = 0x00;
+    desc.pci_serve_device_id = 0x00;
+    return desc;
+}
+
+void uart_install()
+{
+    driver_install(_uart_driver_info(), "uart");
+}
@@ -1,6 +1,8 @@
 #include <drivers/driver_manager.h>
+#include <libkern/boottrace.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
+#include <libkern/trace.h>
 
 // ------------
 // Private
@@ -81,6 +83,7 @@ void drivers_run()
             drivers[i].is_active = true;
             void (*rd)() = dm_driver_function(i, DM_FUNC_DRIVER_START);
             rd();
+            boottrace_point("start", drivers[i].name);
         }
     }
     pass_drivers_to_master_drivers();
@@ -97,6 +100,7 @@ void pass_drivers_to_master_drivers()
                     drivers[j].is_active = true;
                     void (*rd)(driver_t * nd) = dm_driver_function(i, DM_FUNC_DRIVER_EMIT_DRIVER);
                     rd(&drivers[j]);
+                    boottrace_point("attach", drivers[i].name);
                 }
             }
         }
@@ -112,12 +116,26 @@ void pass_devices_to_master_drivers()
                     drivers[i].is_active = true;
                     void (*rd)(device_t * nd) = dm_driver_function(i, DM_FUNC_DRIVER_EMIT_DEVICE);
                     rd(&devices[j]);
+                    boottrace_point("probe", drivers[i].name);
                 }
             }
         }
     }
 }
 
+static storage_ops_t _dm_storage_ops[MAX_DEVICES_COUNT];
+
+static void _dm_resolve_storage_ops(device_t* dev)
+{
+    storage_ops_t* ops = &_dm_storage_ops[dev->id];
+    ops->read = dm_function_handler(dev, DRIVER_STORAGE_READ);
+    ops->write = dm_function_handler(dev, DRIVER_STORAGE_WRITE);
+    ops->capacity = dm_function_handler(dev, DRIVER_STORAGE_CAPACITY);
+    ops->read_sectors = dm_function_handler(dev, DRIVER_STORAGE_READ_SECTORS);
+    ops->write_sectors = dm_function_handler(dev, DRIVER_STORAGE_WRITE_SECTORS);
+    dev->storage_ops = ops;
+}
+
 // device_install registers a new device and find a driver for the device
 void device_install(device_desc_t device_info)
 {
@@ -132,8 +150,12 @@ void device_install(device_desc_t device_info)
         _dm_no_driver_for_device(device_info);
     } else {
         devices[dev_id].type = drivers[devices[dev_id].driver_id].desc.type;
+        if (devices[dev_id].type == DEVICE_STORAGE) {
+            _dm_resolve_storage_ops(&devices[dev_id]);
+        }
         void (*rd)(device_t * nd) = dm_function_handler(&devices[dev_id], DM_FUNC_DEVICE_START);
         rd(&devices[dev_id]);
+        boottrace_point("device", drivers[devices[dev_id].driver_id].name);
     }
 }
 
@@ -208,4 +230,178 @@ int dm_get_driver_id_by_name(const char* name)
         }
     }
     return -1;
-}
\ No newline at end of file
+}
+/**
+ * STORAGE QUEUE FUNCTIONS
+ */
+
+static storage_queue_t _dm_storage_queues[MAX_DEVICES_COUNT];
+
+/**
+ * Drivers which can't serve multi-sector requests get them sector by sector.
+ */
+static int _dm_storage_request_by_sectors(device_t* dev, storage_request_t* req, bool write)
+{
+    const storage_ops_t* ops = dev->storage_ops;
+    uint32_t lba = req->lba;
+
+    for (int i = 0; i < req->segments_count; i++) {
+        storage_segment_t* seg = &req->segments[i];
+        for (uint32_t off = 0; off < seg->len; off += STORAGE_SECTOR_SIZE, lba++) {
+            int err = write ? ops->write(dev, lba, seg->data + off, STORAGE_SECTOR_SIZE) : ops->read(dev, lba, seg->data + off);
+            if (err < 0) {
+                return err;
+            }
+        }
+    }
+    return 0;
+}
+
+static int _dm_storage_do_request(device_t* dev, storage_request_t* req)
+{
+    int status;
+    int (*handler)(device_t * d, storage_request_t * r) = req->write ? dev->storage_ops->write_sectors : dev->storage_ops->read_sectors;
+    trace_point(TRACE_BLOCK_ISSUE, dev->id, req->lba, req->count | ((uint32_t)req->write << 31));
+    if (handler) {
+        status = handler(dev, req);
+    } else {
+        status = _dm_storage_request_by_sectors(dev, req, req->write);
+    }
+    trace_point(TRACE_BLOCK_COMPLETE, dev->id, req->lba, status);
+    return status;
+}
+
+static void _dm_storage_queue_remove(storage_queue_t* queue, storage_request_t* req)
+{
+    storage_request_t** it = &queue->head;
+    while (*it != req) {
+        it = &(*it)->next;
+    }
+    *it = req->next;
+    req->next = NULL;
+}
+
+/**
+ * Picks the next request to serve: an expired one, otherwise the first one
+ * at or after the last served position, wrapping to the lowest lba.
+ */
+static storage_request_t* _dm_storage_queue_pick(storage_queue_t* queue)
+{
+    storage_request_t* next = NULL;
+    for (storage_request_t* req = queue->head; req; req = req->next) {
+        if ((int)(queue->dispatches - req->deadline) >= 0) {
+            return req;
+        }
+        if (!next && req->lba >= queue->last_lba) {
+            next = req;
+        }
+    }
+    return next ? next : queue->head;
+}
+
+void dm_storage_submit(device_t* dev, storage_request_t* req)
+{
+    storage_queue_t* queue = &_dm_storage_queues[dev->id];
+    lock_acquire(&queue->lock);
+    req->deadline = queue->dispatches + STORAGE_QUEUE_DEADLINE;
+    storage_request_t** it = &queue->head;
+    while (*it && (*it)->lba <= req->lba) {
+        it = &(*it)->next;
+    }
+    req->next = *it;
+    *it = req;
+    lock_release(&queue->lock);
+}
+
+/**
+ * Serves the queue until it is empty. Requests which follow the picked one
+ * in the sorted list and continue it on the disk are merged into it.
+ */
+void dm_storage_unplug(device_t* dev)
+{
+    storage_queue_t* queue = &_dm_storage_queues[dev->id];
+    storage_request_t* batch[STORAGE_QUEUE_MAX_MERGE_SEGMENTS];
+    storage_segment_t segments[STORAGE_QUEUE_MAX_MERGE_SEGMENTS];
+
+    lock_acquire(&queue->dispatch_lock);
+    for (;;) {
+        lock_acquire(&queue->lock);
+        storage_request_t* first = _dm_storage_queue_pick(queue);
+        if (!first) {
+            lock_release(&queue->lock);
+            break;
+        }
+
+        storage_request_t merged = { .lba = first->lba, .count = 0, .segments_count = 0, .segments = segments, .write = first->write };
+        int batch_size = 0;
+        storage_request_t* req = first;
+        if (first->segments_count > STORAGE_QUEUE_MAX_MERGE_SEGMENTS) {
+            _dm_storage_queue_remove(queue, first);
+            queue->last_lba = first->lba + first->count;
+            queue->dispatches++;
+            lock_release(&queue->lock);
+
+            int status = _dm_storage_do_request(dev, first);
+            if (first->callback) {
+                first->callback(first, status);
+            }
+            continue;
+        }
+
+        while (req && req->write == merged.write && req->lba == merged.lba + merged.count) {
+            if (merged.segments_count + req->segments_count > STORAGE_QUEUE_MAX_MERGE_SEGMENTS) {
+                break;
+            }
+            if (batch_size && merged.count + req->count > STORAGE_QUEUE_MAX_MERGE_SECTORS) {
+                break;
+            }
+
+            storage_request_t* next = req->next;
+            for (int i = 0; i < req->segments_count; i++) {
+                segments[merged.segments_count++] = req->segments[i];
+            }
+            merged.count += req->count;
+            batch[batch_size++] = req;
+            _dm_storage_queue_remove(queue, req);
+            req = next;
+        }
+
+        queue->last_lba = merged.lba + merged.count;
+        queue->dispatches++;
+        lock_release(&queue->lock);
+
+        int status = _dm_storage_do_request(dev, &merged);
+        for (int i = 0; i < batch_size; i++) {
+            if (batch[i]->callback) {
+                batch[i]->callback(batch[i], status);
+            }
+        }
+    }
+    lock_release(&queue->dispatch_lock);
+}
+
+static void _dm_storage_sync_callback(storage_request_t* req, int status)
+{
+    *(int*)req->callback_arg = status;
+}
+
+static int _dm_storage_sync_request(device_t* dev, storage_request_t* req, bool write)
+{
+    int status = 0;
+    req->write = write;
+    req->callback = _dm_storage_sync_callback;
+    req->callback_arg = &status;
+    dm_storage_submit(dev, req);
+    dm_storage_unplug(dev);
+    return status;
+}
+
+int dm_storage_read(device_t* dev, storage_request_t* req)
+{
+    return _dm_storage_sync_request(dev, req, false);
+}
+
+int dm_storage_write(device_t* dev, storage_request_t* req)
+{
+    return _dm_storage_sync_request(dev, req, true);
+}
@@ -4,13 +4,19 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <algo/spsc_ringbuffer.h>
 #include <drivers/generic/keyboard.h>
 #include <drivers/generic/keyboard_mappings/scancode_set1.h>
 #include <fs/devfs/devfs.h>
 #include <fs/vfs.h>
 #include <libkern/libkern.h>
+#include <tasking/tasklet.h>
+#include <tasking/tasking.h>
+#include <time/timers.h>
 
-static ringbuffer_t gkeyboard_buffer;
+static spsc_ringbuffer_t gkeyboard_buffer;
+static spsc_ringbuffer_t gkeyboard_scancodes; /* Read by the irq, not decoded yet. */
+static tasklet_t gkeyboard_tasklet;
 static bool _gkeyboard_has_prefix_e0 = false;
 static bool _gkeyboard_shift_enabled = false;
 static bool _gkeyboard_ctrl_enabled = false;
@@ -28,7 +34,7 @@ struct alternative_key {
 
 static bool _generic_keyboard_can_read(dentry_t* dentry, uint32_t start)
 {
-    return ringbuffer_space_to_read(&gkeyboard_buffer) >= 1;
+    return spsc_ringbuffer_space_to_read(&gkeyboard_buffer) >= 1;
 }
 
 static int _generic_keyboard_read(dentry_t* dentry, uint8_t* buf,
@@ -36,11 +42,13 @@ static int _generic_keyboard_read(dentry_t* dentry, uint8_t* buf,
 {
     uint32_t read_len;
 
-    read_len = ringbuffer_space_to_read(&gkeyboard_buffer);
+    /* Only whole packets are given, keys are never merged. */
+    read_len = spsc_ringbuffer_space_to_read(&gkeyboard_buffer);
     if (read_len > len)
         read_len = len;
+    read_len -= read_len % sizeof(kbd_packet_t);
 
-    ringbuffer_read(&gkeyboard_buffer, buf, read_len);
+    spsc_ringbuffer_read(&gkeyboard_buffer, buf, read_len);
     return read_len;
 }
 
@@ -59,9 +67,29 @@ int generic_keyboard_create_devfs()
     return 0;
 }
 
+static void _generic_keyboard_tasklet(void* data)
+{
+    uint8_t scancode;
+    while (spsc_ringbuffer_read(&gkeyboard_scancodes, &scancode, 1) == 1) {
+        generic_emit_key_set1(scancode);
+    }
+}
+
 void generic_keyboard_init()
 {
-    gkeyboard_buffer = ringbuffer_create_std();
+    gkeyboard_buffer = spsc_ringbuffer_create_std();
+    gkeyboard_scancodes = spsc_ringbuffer_create_std();
+    tasklet_init(&gkeyboard_tasklet, _generic_keyboard_tasklet, NULL);
+}
+
+/**
+ * Called by the irq handlers of keyboards, the scancode is decoded later
+ * by a tasklet with interrupts on.
+ */
+void generic_queue_key_set1(uint8_t scancode)
+{
+    spsc_ringbuffer_write(&gkeyboard_scancodes, &scancode, 1);
+    tasklet_schedule(&gkeyboard_tasklet);
 }
 
 void generic_emit_key_set1(uint32_t scancode)
@@ -78,6 +106,7 @@ void generic_emit_key_set1(uint32_t scancode)
 
     key_t key;
     kbd_packet_t packet;
+    packet.time_ms = timers_ticks_to_ms(timeman_global_ticks());
 
     /* Add modifiers */
     if (scancode & 0x80) {
@@ -134,7 +163,11 @@ void generic_emit_key_set1(uint32_t scancode)
         }
     }
 
-    ringbuffer_write(&gkeyboard_buffer, (uint8_t*)&packet, sizeof(kbd_packet_t));
+    /* A packet which doesn't fit is dropped, readers never see a part of it. */
+    if (spsc_ringbuffer_space_to_write(&gkeyboard_buffer) >= sizeof(kbd_packet_t)) {
+        spsc_ringbuffer_write(&gkeyboard_buffer, (uint8_t*)&packet, sizeof(kbd_packet_t));
+    }
+    blocker_wake_io();
 }
 
 static key_t _generic_keyboard_apply_modifiers(key_t key)
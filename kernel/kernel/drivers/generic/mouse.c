@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/generic/mouse.h>
+#include <fs/devfs/devfs.h>
+#include <fs/vfs.h>
+#include <libkern/atomic.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <platform/generic/system.h>
+#include <tasking/tasking.h>
+#include <time/timers.h>
+
+#define MOUSE_RING_SIZE (256)
+
+/* Motion which comes within one frame is merged while it waits for the reader. */
+#define MOUSE_MERGE_WINDOW_MS (16)
+
+/* Positions are total counts of packets, taken modulo the size of the ring. */
+static mouse_packet_t _gmouse_ring[MOUSE_RING_SIZE];
+static uint32_t _gmouse_head = 0;
+static uint32_t _gmouse_tail = 0;
+static uint32_t _gmouse_merge_started_at = 0;
+
+/* Taken with interrupts off, the drivers emit from tasklets. */
+static lock_t _gmouse_lock;
+
+static inline int16_t _generic_mouse_merge_offsets(int16_t a, int16_t b)
+{
+    int32_t res = (int32_t)a + (int32_t)b;
+    if (res > 32767) {
+        return 32767;
+    }
+    if (res < -32768) {
+        return -32768;
+    }
+    return res;
+}
+
+/**
+ * Only pure motion is merged, a packet which changes buttons or scrolls
+ * keeps its place, so clicks land where they were made.
+ */
+static inline bool _generic_mouse_can_merge_locked(mouse_packet_t* last, mouse_packet_t* packet)
+{
+    if (_gmouse_head == _gmouse_tail) {
+        return false;
+    }
+    return !last->wheel_data && !packet->wheel_data && last->button_states == packet->button_states
+        && packet->time_ms - _gmouse_merge_started_at < MOUSE_MERGE_WINDOW_MS;
+}
+
+/**
+ * Called by the mouse drivers with a decoded packet. A packet which doesn't
+ * fit is dropped, readers never see a part of it.
+ */
+void generic_mouse_emit(mouse_packet_t* packet)
+{
+    packet->time_ms = timers_ticks_to_ms(timeman_global_ticks());
+
+    system_disable_interrupts();
+    lock_acquire(&_gmouse_lock);
+    mouse_packet_t* last = &_gmouse_ring[(_gmouse_head - 1) % MOUSE_RING_SIZE];
+    if (_generic_mouse_can_merge_locked(last, packet)) {
+        last->x_offset = _generic_mouse_merge_offsets(last->x_offset, packet->x_offset);
+        last->y_offset = _generic_mouse_merge_offsets(last->y_offset, packet->y_offset);
+        last->time_ms = packet->time_ms;
+    } else if (_gmouse_head - _gmouse_tail < MOUSE_RING_SIZE) {
+        _gmouse_ring[_gmouse_head % MOUSE_RING_SIZE] = *packet;
+        _gmouse_head++;
+        _gmouse_merge_started_at = packet->time_ms;
+    }
+    lock_release(&_gmouse_lock);
+    system_enable_interrupts();
+
+    blocker_wake_io();
+}
+
+void generic_mouse_init()
+{
+    lock_init(&_gmouse_lock);
+}
+
+/**
+ * DEVFS
+ */
+
+static bool _generic_mouse_can_read(dentry_t* dentry, uint32_t start)
+{
+    return atomic_load(&_gmouse_head) != atomic_load(&_gmouse_tail);
+}
+
+/* Gives all ready packets which fit into buf, never a part of one. */
+static int _generic_mouse_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    mouse_packet_t* packets = (mouse_packet_t*)buf;
+
+    system_disable_interrupts();
+    lock_acquire(&_gmouse_lock);
+    uint32_t cnt = min(len / sizeof(mouse_packet_t), _gmouse_head - _gmouse_tail);
+    for (uint32_t i = 0; i < cnt; i++) {
+        packets[i] = _gmouse_ring[(_gmouse_tail + i) % MOUSE_RING_SIZE];
+    }
+    _gmouse_tail += cnt;
+    lock_release(&_gmouse_lock);
+    system_enable_interrupts();
+    return cnt * sizeof(mouse_packet_t);
+}
+
+int generic_mouse_create_devfs()
+{
+    dentry_t* mp;
+    if (vfs_resolve_path("/dev", &mp) < 0) {
+        return -1;
+    }
+
+    file_ops_t fops = { 0 };
+    fops.can_read = _generic_mouse_can_read;
+    fops.read = _generic_mouse_read;
+    devfs_inode_t* res = devfs_register(mp, MKDEV(10, 1), "mouse", 5, 0500, &fops);
+
+    dentry_put(mp);
+    return 0;
+}
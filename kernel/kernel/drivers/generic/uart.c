@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/generic/uart.h>
+#include <fs/devfs/devfs.h>
+#include <fs/vfs.h>
+#include <libkern/atomic.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <platform/generic/system.h>
+#include <tasking/tasking.h>
+
+#define UART_TX_RING_SIZE (16 * KB)
+#define UART_RX_RING_SIZE (4 * KB)
+
+/* Positions are total counts of bytes, taken modulo the size of the ring. */
+static uint8_t _uart_tx_ring[UART_TX_RING_SIZE];
+static uint32_t _uart_tx_head = 0;
+static uint32_t _uart_tx_tail = 0;
+static uint8_t _uart_rx_ring[UART_RX_RING_SIZE];
+static uint32_t _uart_rx_head = 0;
+static uint32_t _uart_rx_tail = 0;
+
+/* Taken with interrupts off, the irq handler takes it too. */
+static lock_t _uart_lock;
+static bool _uart_buffered = false;
+
+static void _uart_tx_fill_locked()
+{
+    while (_uart_tx_tail != _uart_tx_head && !uart_hw_tx_full()) {
+        uart_hw_put(_uart_tx_ring[_uart_tx_tail % UART_TX_RING_SIZE]);
+        _uart_tx_tail++;
+    }
+    uart_hw_set_tx_irq(_uart_tx_tail != _uart_tx_head);
+}
+
+/**
+ * Queues as much of data as fits and returns its length. The bytes reach
+ * the UART from the TX interrupt, the caller never waits for it.
+ */
+uint32_t uart_write_buffered(const uint8_t* data, uint32_t len)
+{
+    if (!atomic_load(&_uart_buffered)) {
+        for (uint32_t i = 0; i < len; i++) {
+            uart_write(COM1, data[i]);
+        }
+        return len;
+    }
+
+    system_disable_interrupts();
+    lock_acquire(&_uart_lock);
+    len = min(len, UART_TX_RING_SIZE - (_uart_tx_head - _uart_tx_tail));
+    for (uint32_t i = 0; i < len; i++) {
+        _uart_tx_ring[(_uart_tx_head + i) % UART_TX_RING_SIZE] = data[i];
+    }
+    _uart_tx_head += len;
+    _uart_tx_fill_locked();
+    lock_release(&_uart_lock);
+    system_enable_interrupts();
+    return len;
+}
+
+/**
+ * Sends the queued bytes by polling and turns buffering off, used when the
+ * kernel is going down. Doesn't wait for _uart_lock.
+ */
+void uart_flush_sync()
+{
+    atomic_store(&_uart_buffered, false);
+    while (_uart_tx_tail != _uart_tx_head) {
+        uart_write(COM1, _uart_tx_ring[_uart_tx_tail % UART_TX_RING_SIZE]);
+        _uart_tx_tail++;
+    }
+}
+
+/**
+ * Called by the irq handler of the platform driver.
+ */
+void generic_uart_irq()
+{
+    bool received = false;
+    lock_acquire(&_uart_lock);
+    while (uart_hw_rx_ready()) {
+        uint8_t data = uart_hw_get();
+        if (_uart_rx_head - _uart_rx_tail < UART_RX_RING_SIZE) {
+            _uart_rx_ring[_uart_rx_head % UART_RX_RING_SIZE] = data;
+            _uart_rx_head++;
+        }
+        received = true;
+    }
+
+    uint32_t tail = _uart_tx_tail;
+    _uart_tx_fill_locked();
+    lock_release(&_uart_lock);
+
+    if (received || tail != _uart_tx_tail) {
+        blocker_wake_io();
+    }
+}
+
+void generic_uart_init()
+{
+    lock_init(&_uart_lock);
+    atomic_store(&_uart_buffered, true);
+}
+
+/**
+ * DEVFS
+ */
+
+static bool _uart_can_read(dentry_t* dentry, uint32_t start)
+{
+    return atomic_load(&_uart_rx_head) != atomic_load(&_uart_rx_tail);
+}
+
+static bool _uart_can_write(dentry_t* dentry, uint32_t start)
+{
+    return atomic_load(&_uart_tx_head) - atomic_load(&_uart_tx_tail) < UART_TX_RING_SIZE;
+}
+
+static int _uart_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    system_disable_interrupts();
+    lock_acquire(&_uart_lock);
+    len = min(len, _uart_rx_head - _uart_rx_tail);
+    for (uint32_t i = 0; i < len; i++) {
+        buf[i] = _uart_rx_ring[(_uart_rx_tail + i) % UART_RX_RING_SIZE];
+    }
+    _uart_rx_tail += len;
+    lock_release(&_uart_lock);
+    system_enable_interrupts();
+    return len;
+}
+
+static int _uart_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    return uart_write_buffered(buf, len);
+}
+
+int generic_uart_create_devfs()
+{
+    dentry_t* mp;
+    if (vfs_resolve_path("/dev", &mp) < 0) {
+        return -1;
+    }
+
+    file_ops_t fops = { 0 };
+    fops.can_read = _uart_can_read;
+    fops.can_write = _uart_can_write;
+    fops.read = _uart_read;
+    fops.write = _uart_write;
+    devfs_inode_t* res = devfs_register(mp, MKDEV(4, 64), "ttyS0", 5, 0600, &fops);
+
+    dentry_put(mp);
+    return 0;
+}
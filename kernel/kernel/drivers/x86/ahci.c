@@ -0,0 +1,653 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/driver_manager.h>
+#include <drivers/x86/ahci.h>
+#include <drivers/x86/pci.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/log.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/generic/cpu.h>
+#include <platform/generic/system.h>
+#include <platform/x86/idt.h>
+
+#define AHCI_SPIN_LIMIT (50000000)
+
+/* Set in args[0] of the devices which the driver installs for more ports. */
+#define AHCI_PORT_DEVICE (1 << 8)
+
+static ahci_hba_t _ahci_hbas[AHCI_MAX_CONTROLLERS];
+static int _ahci_hbas_count = 0;
+static ahci_port_t _ahci_ports[MAX_DEVICES_COUNT];
+static bool _ahci_present[MAX_DEVICES_COUNT];
+
+static int ahci_read(device_t* device, uint32_t sector, uint8_t* read_data);
+static int ahci_write(device_t* device, uint32_t sector, uint8_t* data, uint32_t size);
+static int ahci_flush(device_t* device);
+static int ahci_read_sectors(device_t* device, storage_request_t* req);
+static int ahci_write_sectors(device_t* device, storage_request_t* req);
+static uint32_t ahci_get_capacity(device_t* device);
+
+static void* _ahci_map(uint32_t paddr, uint32_t len)
+{
+    uint32_t page_offset = paddr % VMM_PAGE_SIZE;
+    uint32_t pages = (page_offset + len + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    zone_t zone = zoner_new_zone(pages * VMM_PAGE_SIZE);
+    if (!zone.start) {
+        return NULL;
+    }
+    vmm_map_pages(zone.start, paddr - page_offset, pages, PAGE_READABLE | PAGE_WRITABLE | PAGE_NOT_CACHEABLE);
+    return zone.ptr + page_offset;
+}
+
+static void* _ahci_alloc_dma(uint32_t len, uint32_t* paddr)
+{
+    *paddr = (uint32_t)pmm_alloc_aligned(len, VMM_PAGE_SIZE);
+    if (!*paddr) {
+        return NULL;
+    }
+
+    zone_t zone = zoner_new_zone(len);
+    vmm_map_pages(zone.start, *paddr, len / VMM_PAGE_SIZE, PAGE_READABLE | PAGE_WRITABLE);
+    memset(zone.ptr, 0, len);
+    return zone.ptr;
+}
+
+static bool _ahci_wait_clear(volatile uint32_t* reg, uint32_t mask)
+{
+    for (uint32_t spins = 0; spins < AHCI_SPIN_LIMIT; spins++) {
+        if (!(*reg & mask)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline ahci_cmd_table_t* _ahci_slot_table(ahci_port_t* port, int slot)
+{
+    return (ahci_cmd_table_t*)(port->tables + slot * AHCI_CMD_TABLE_SIZE);
+}
+
+static inline uint8_t* _ahci_slot_buf(ahci_port_t* port, int slot)
+{
+    return port->bufs + slot * AHCI_SLOT_BUF_SIZE;
+}
+
+/**
+ * PORT ENGINE
+ */
+
+static bool _ahci_port_stop(ahci_port_t* port)
+{
+    port->regs->cmd &= ~AHCI_PORT_CMD_ST;
+    if (!_ahci_wait_clear(&port->regs->cmd, AHCI_PORT_CMD_CR)) {
+        return false;
+    }
+    port->regs->cmd &= ~AHCI_PORT_CMD_FRE;
+    return _ahci_wait_clear(&port->regs->cmd, AHCI_PORT_CMD_FR);
+}
+
+static bool _ahci_port_start(ahci_port_t* port)
+{
+    if (!_ahci_wait_clear(&port->regs->tfd, ATA_STATUS_BSY | ATA_STATUS_DRQ)) {
+        return false;
+    }
+    port->regs->cmd |= AHCI_PORT_CMD_FRE;
+    port->regs->cmd |= AHCI_PORT_CMD_ST;
+    return true;
+}
+
+/**
+ * An error stops the port. All commands it owned fail, the engine is
+ * restarted so the next ones can go.
+ */
+static void _ahci_port_recover_locked(ahci_port_t* port)
+{
+    log_warn("AHCI: port %d error, tfd %x serr %x", port->index, port->regs->tfd, port->regs->serr);
+    _ahci_port_stop(port);
+    for (int slot = 0; slot < port->slots; slot++) {
+        if (port->issued & (1 << slot)) {
+            port->slot_failed[slot] = true;
+            port->slot_state[slot] = AHCI_SLOT_DONE;
+        }
+    }
+    port->issued = 0;
+    port->regs->serr = 0xffffffff;
+    port->regs->is = 0xffffffff;
+    _ahci_port_start(port);
+}
+
+/**
+ * Marks the slots which the port has finished as done. Called with the lock
+ * taken, both from the interrupt and from waiters, so requests complete even
+ * while interrupts are off. A queued command stays in sact until its data is
+ * moved, a plain one stays in ci.
+ */
+static void _ahci_reap_locked(ahci_port_t* port)
+{
+    uint32_t is = port->regs->is;
+    port->regs->is = is;
+    if (is & AHCI_PORT_IS_ERRORS) {
+        _ahci_port_recover_locked(port);
+        return;
+    }
+
+    uint32_t done = port->issued & ~(port->regs->ci | port->regs->sact);
+    for (int slot = 0; done && slot < port->slots; slot++) {
+        if (done & (1 << slot)) {
+            port->slot_state[slot] = AHCI_SLOT_DONE;
+        }
+    }
+    port->issued &= ~done;
+}
+
+static void ahci_handler()
+{
+    for (int i = 0; i < _ahci_hbas_count; i++) {
+        ahci_hba_t* hba = &_ahci_hbas[i];
+        uint32_t is = hba->regs->is;
+        if (!is) {
+            continue;
+        }
+
+        for (int p = 0; p < AHCI_MAX_PORTS; p++) {
+            ahci_port_t* port = hba->ports[p];
+            if ((is & (1 << p)) && port) {
+                lock_acquire(&port->lock);
+                _ahci_reap_locked(port);
+                lock_release(&port->lock);
+            }
+        }
+        hba->regs->is = is;
+    }
+}
+
+/**
+ * SLOTS
+ */
+
+/**
+ * Takes a free slot. With wait set spins until one is given back, otherwise
+ * returns -1 if all of them are in flight.
+ */
+static int _ahci_reserve_slot(ahci_port_t* port, bool wait)
+{
+    for (uint32_t spins = 0; spins < AHCI_SPIN_LIMIT; spins++) {
+        system_disable_interrupts();
+        lock_acquire(&port->lock);
+        _ahci_reap_locked(port);
+        for (int slot = 0; slot < port->slots; slot++) {
+            if (port->slot_state[slot] == AHCI_SLOT_FREE) {
+                port->slot_state[slot] = AHCI_SLOT_BUSY;
+                port->slot_failed[slot] = false;
+                lock_release(&port->lock);
+                system_enable_interrupts();
+                return slot;
+            }
+        }
+        lock_release(&port->lock);
+        system_enable_interrupts();
+
+        if (!wait) {
+            return -1;
+        }
+        lock_relax();
+    }
+    return -1;
+}
+
+/**
+ * Builds the command of the slot and issues it. A queued command takes the
+ * slot number as its tag and is marked in sact before ci.
+ */
+static void _ahci_issue_slot(ahci_port_t* port, int slot, uint8_t command, uint32_t lba, uint32_t count, uint32_t len)
+{
+    bool write = command == ATA_CMD_WRITE_DMA_EXT || command == ATA_CMD_WRITE_FPDMA_QUEUED;
+    bool queued = command == ATA_CMD_READ_FPDMA_QUEUED || command == ATA_CMD_WRITE_FPDMA_QUEUED;
+
+    ahci_cmd_table_t* table = _ahci_slot_table(port, slot);
+    ahci_fis_reg_h2d_t* fis = (ahci_fis_reg_h2d_t*)table->cfis;
+    memset(fis, 0, sizeof(ahci_fis_reg_h2d_t));
+    fis->fis_type = AHCI_FIS_TYPE_REG_H2D;
+    fis->flags = AHCI_FIS_H2D_COMMAND;
+    fis->command = command;
+    fis->device = command == ATA_CMD_IDENTIFY ? 0 : (1 << 6);
+    fis->lba0 = lba & 0xff;
+    fis->lba1 = (lba >> 8) & 0xff;
+    fis->lba2 = (lba >> 16) & 0xff;
+    fis->lba3 = (lba >> 24) & 0xff;
+    if (queued) {
+        fis->featurel = count & 0xff;
+        fis->featureh = (count >> 8) & 0xff;
+        fis->countl = slot << 3;
+    } else {
+        fis->countl = count & 0xff;
+        fis->counth = (count >> 8) & 0xff;
+    }
+
+    volatile ahci_cmd_header_t* header = &port->cmd_list[slot];
+    header->flags = (sizeof(ahci_fis_reg_h2d_t) / sizeof(uint32_t)) | (write ? AHCI_CMD_HEADER_WRITE : 0);
+    header->prdbc = 0;
+    header->prdtl = 0;
+    if (len) {
+        table->prdt[0].dba = port->bufs_paddr + slot * AHCI_SLOT_BUF_SIZE;
+        table->prdt[0].dbau = 0;
+        table->prdt[0].dbc = len - 1;
+        header->prdtl = 1;
+    }
+
+    system_disable_interrupts();
+    lock_acquire(&port->lock);
+    port->issued |= (1 << slot);
+    __sync_synchronize();
+    if (queued) {
+        port->regs->sact = (1 << slot);
+    }
+    port->regs->ci = (1 << slot);
+    lock_release(&port->lock);
+    system_enable_interrupts();
+}
+
+/**
+ * Waits for the slot and frees it. While interrupts are on the cpu sleeps
+ * until the next one instead of spinning, sti delays them by an instruction
+ * so the interrupt of the slot can't slip in before hlt.
+ */
+static int _ahci_complete_slot(ahci_port_t* port, int slot)
+{
+    for (uint32_t spins = 0; spins < AHCI_SPIN_LIMIT; spins++) {
+        system_disable_interrupts();
+        lock_acquire(&port->lock);
+        _ahci_reap_locked(port);
+        if (port->slot_state[slot] == AHCI_SLOT_DONE) {
+            bool failed = port->slot_failed[slot];
+            port->slot_state[slot] = AHCI_SLOT_FREE;
+            lock_release(&port->lock);
+            system_enable_interrupts();
+            return failed ? -EIO : 0;
+        }
+        lock_release(&port->lock);
+
+        if (port->hba->irq && THIS_CPU->int_depth_counter == 1) {
+            system_enable_interrupts_only_counter();
+            asm volatile("sti\n"
+                         "hlt");
+        } else {
+            system_enable_interrupts();
+            lock_relax();
+        }
+    }
+
+    // The port still owns the slot, so it is never given out again.
+    log_warn("AHCI: request timed out");
+    return -EIO;
+}
+
+/* A plain command can't be issued while queued ones are in flight. */
+static void _ahci_wait_idle(ahci_port_t* port)
+{
+    for (uint32_t spins = 0; spins < AHCI_SPIN_LIMIT; spins++) {
+        system_disable_interrupts();
+        lock_acquire(&port->lock);
+        _ahci_reap_locked(port);
+        bool idle = !port->issued;
+        lock_release(&port->lock);
+        system_enable_interrupts();
+        if (idle) {
+            return;
+        }
+        lock_relax();
+    }
+}
+
+static int _ahci_do_command(ahci_port_t* port, uint8_t command, uint32_t lba, uint32_t count, uint32_t len)
+{
+    int slot = _ahci_reserve_slot(port, true);
+    if (slot < 0) {
+        return -EIO;
+    }
+    _ahci_wait_idle(port);
+    _ahci_issue_slot(port, slot, command, lba, count, len);
+    return _ahci_complete_slot(port, slot);
+}
+
+static void _ahci_copy(storage_request_t* req, int* seg_index, uint32_t* seg_offset, uint8_t* buf, uint32_t len, bool to_buf)
+{
+    while (len) {
+        storage_segment_t* seg = &req->segments[*seg_index];
+        uint32_t part = min(len, seg->len - *seg_offset);
+        if (to_buf) {
+            memcpy(buf, seg->data + *seg_offset, part);
+        } else {
+            memcpy(seg->data + *seg_offset, buf, part);
+        }
+        buf += part;
+        len -= part;
+        *seg_offset += part;
+        if (*seg_offset == seg->len) {
+            (*seg_index)++;
+            *seg_offset = 0;
+        }
+    }
+}
+
+/**
+ * Cuts the request into chunks of one slot each and keeps as many of them
+ * in flight as there are free slots. Chunks are waited for in the order
+ * they were issued, which is the order their data has in the segments.
+ */
+static int _ahci_transfer(ahci_port_t* port, storage_request_t* req, bool write)
+{
+    int inflight_slots[AHCI_MAX_SLOTS];
+    uint32_t inflight_len[AHCI_MAX_SLOTS];
+    int head = 0, inflight = 0;
+    int seg_index = 0;
+    uint32_t seg_offset = 0;
+    uint32_t lba = req->lba;
+    uint32_t left = req->count;
+    int err = 0;
+
+    if (req->lba + req->count > port->capacity) {
+        return -EINVAL;
+    }
+
+    uint8_t command;
+    if (port->ncq) {
+        command = write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED;
+    } else {
+        command = write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+    }
+
+    while (left || inflight) {
+        while (left && !err && inflight < port->slots) {
+            int slot = _ahci_reserve_slot(port, inflight == 0);
+            if (slot < 0) {
+                if (inflight == 0) {
+                    err = -EIO;
+                }
+                break;
+            }
+
+            uint32_t count = min(left, AHCI_SLOT_BUF_SIZE / STORAGE_SECTOR_SIZE);
+            uint32_t len = count * STORAGE_SECTOR_SIZE;
+            if (write) {
+                _ahci_copy(req, &seg_index, &seg_offset, _ahci_slot_buf(port, slot), len, true);
+            }
+            _ahci_issue_slot(port, slot, command, lba, count, len);
+
+            int pos = (head + inflight) % AHCI_MAX_SLOTS;
+            inflight_slots[pos] = slot;
+            inflight_len[pos] = len;
+            inflight++;
+            lba += count;
+            left -= count;
+        }
+        if (err) {
+            left = 0;
+        }
+        if (!inflight) {
+            break;
+        }
+
+        int slot = inflight_slots[head];
+        int status = _ahci_complete_slot(port, slot);
+        if (!write && !status && !err) {
+            _ahci_copy(req, &seg_index, &seg_offset, _ahci_slot_buf(port, slot), inflight_len[head], false);
+        }
+        if (status && !err) {
+            err = status;
+        }
+        head = (head + 1) % AHCI_MAX_SLOTS;
+        inflight--;
+    }
+    return err;
+}
+
+/**
+ * SETUP
+ */
+
+static inline driver_desc_t _ahci_driver_info()
+{
+    driver_desc_t ahci_desc = { 0 };
+    ahci_desc.type = DRIVER_STORAGE_DEVICE;
+    ahci_desc.auto_start = false;
+    ahci_desc.is_device_driver = true;
+    ahci_desc.is_device_needed = false;
+    ahci_desc.is_driver_needed = false;
+    ahci_desc.functions[DRIVER_NOTIFICATION] = 0;
+    ahci_desc.functions[DRIVER_STORAGE_ADD_DEVICE] = ahci_add_device;
+    ahci_desc.functions[DRIVER_STORAGE_READ] = ahci_read;
+    ahci_desc.functions[DRIVER_STORAGE_WRITE] = ahci_write;
+    ahci_desc.functions[DRIVER_STORAGE_FLUSH] = ahci_flush;
+    ahci_desc.functions[DRIVER_STORAGE_CAPACITY] = ahci_get_capacity;
+    ahci_desc.functions[DRIVER_STORAGE_READ_SECTORS] = ahci_read_sectors;
+    ahci_desc.functions[DRIVER_STORAGE_WRITE_SECTORS] = ahci_write_sectors;
+    ahci_desc.pci_serve_class = AHCI_PCI_CLASS;
+    ahci_desc.pci_serve_subclass = AHCI_PCI_SUBCLASS;
+    ahci_desc.pci_serve_vendor_id = 0x00;
+    ahci_desc.pci_serve_device_id = 0x00;
+    return ahci_desc;
+}
+
+void ahci_install()
+{
+    driver_install(_ahci_driver_info(), "ahci86");
+}
+
+static bool _ahci_port_has_drive(volatile ahci_port_regs_t* regs)
+{
+    return (regs->ssts & 0xf) == AHCI_PORT_SSTS_DET_PRESENT && regs->sig == AHCI_PORT_SIG_ATA;
+}
+
+static int _ahci_identify(ahci_port_t* port)
+{
+    int err = _ahci_do_command(port, ATA_CMD_IDENTIFY, 0, 0, STORAGE_SECTOR_SIZE);
+    if (err) {
+        return err;
+    }
+
+    // The identify data is in slot 0, the only one given out so far.
+    uint16_t* id = (uint16_t*)_ahci_slot_buf(port, 0);
+    if (!(id[83] & (1 << 10))) {
+        return -ENODEV;
+    }
+
+    uint32_t capacity_hi = id[102] | ((uint32_t)id[103] << 16);
+    port->capacity = capacity_hi ? 0xffffffff : (id[100] | ((uint32_t)id[101] << 16));
+
+    if ((port->hba->cap & AHCI_CAP_SNCQ) && (id[76] & (1 << 8))) {
+        port->ncq = true;
+        port->slots = min(port->slots, (id[75] & 0x1f) + 1);
+    }
+    return 0;
+}
+
+static int _ahci_port_setup(ahci_port_t* port, ahci_hba_t* hba, int index)
+{
+    port->hba = hba;
+    port->regs = &hba->regs->ports[index];
+    port->index = index;
+    port->slots = min(AHCI_CAP_NCS(hba->cap), AHCI_MAX_SLOTS);
+    lock_init(&port->lock);
+
+    if (!_ahci_port_stop(port)) {
+        return -EBUSY;
+    }
+
+    uint8_t* cmd_page = _ahci_alloc_dma(VMM_PAGE_SIZE, &port->cmd_list_paddr);
+    port->tables = _ahci_alloc_dma(AHCI_MAX_SLOTS * AHCI_CMD_TABLE_SIZE, &port->tables_paddr);
+    port->bufs = _ahci_alloc_dma(AHCI_MAX_SLOTS * AHCI_SLOT_BUF_SIZE, &port->bufs_paddr);
+    if (!cmd_page || !port->tables || !port->bufs) {
+        return -ENOMEM;
+    }
+
+    port->cmd_list = (ahci_cmd_header_t*)cmd_page;
+    for (int slot = 0; slot < AHCI_MAX_SLOTS; slot++) {
+        port->cmd_list[slot].ctba = port->tables_paddr + slot * AHCI_CMD_TABLE_SIZE;
+        port->cmd_list[slot].ctbau = 0;
+    }
+
+    port->regs->clb = port->cmd_list_paddr;
+    port->regs->clbu = 0;
+    port->regs->fb = port->cmd_list_paddr + AHCI_FIS_OFFSET;
+    port->regs->fbu = 0;
+    port->regs->serr = 0xffffffff;
+    port->regs->is = 0xffffffff;
+    port->regs->ie = AHCI_PORT_IS_DHRS | AHCI_PORT_IS_PSS | AHCI_PORT_IS_SDBS | AHCI_PORT_IS_ERRORS;
+    if (!_ahci_port_start(port)) {
+        return -EBUSY;
+    }
+    return _ahci_identify(port);
+}
+
+static int _ahci_bind_port(device_t* dev, ahci_hba_t* hba, int index)
+{
+    ahci_port_t* port = &_ahci_ports[dev->id];
+    memset(port, 0, sizeof(ahci_port_t));
+    int err = _ahci_port_setup(port, hba, index);
+    if (err) {
+        log_warn("AHCI: can't start port %d (%d)", index, err);
+        return err;
+    }
+
+    hba->ports[index] = port;
+    _ahci_present[dev->id] = true;
+    kprintf("Device added to ahci driver: port %d, ncq %d\n", index, port->ncq);
+    return 0;
+}
+
+/**
+ * The PCI function becomes the drive at the first port with one, every
+ * other drive is installed as a device of its own which comes back here
+ * with AHCI_PORT_DEVICE set.
+ */
+static void _ahci_start_controller(device_t* dev)
+{
+    if (_ahci_hbas_count >= AHCI_MAX_CONTROLLERS) {
+        return;
+    }
+
+    uint8_t bus = dev->device_desc.bus;
+    uint8_t device = dev->device_desc.device;
+    uint8_t function = dev->device_desc.function;
+
+    // Memory space and bus mastering, the HBA moves the data itself.
+    pci_write(bus, device, function, 0x04, pci_read(bus, device, function, 0x04) | 0x6);
+
+    uint32_t abar = pci_read_bar(dev, AHCI_ABAR) & 0xfffffff0;
+    if (!abar) {
+        return;
+    }
+
+    int hba_id = _ahci_hbas_count++;
+    ahci_hba_t* hba = &_ahci_hbas[hba_id];
+    memset(hba, 0, sizeof(ahci_hba_t));
+    hba->regs = _ahci_map(abar, sizeof(ahci_hba_regs_t));
+    if (!hba->regs) {
+        return;
+    }
+    hba->regs->ghc |= AHCI_GHC_AE;
+    hba->cap = hba->regs->cap;
+
+    uint32_t implemented = hba->regs->pi;
+    bool bound = false;
+    for (int index = 0; index < AHCI_MAX_PORTS; index++) {
+        if (!(implemented & (1 << index)) || !_ahci_port_has_drive(&hba->regs->ports[index])) {
+            continue;
+        }
+
+        if (!bound) {
+            bound = _ahci_bind_port(dev, hba, index) == 0;
+            continue;
+        }
+
+        device_desc_t port_desc = dev->device_desc;
+        port_desc.args[0] = AHCI_PORT_DEVICE | index;
+        port_desc.args[1] = hba_id;
+        device_install(port_desc);
+    }
+
+    // Lines above 15 don't go through the pic, without an irq the waiters poll.
+    int irq_kind = pci_msi_setup(dev, ahci_handler);
+    if (irq_kind == PCI_IRQ_MSI || irq_kind == PCI_IRQ_MSIX) {
+        hba->irq = pci_device_of(dev)->msi_vector;
+    } else if (dev->device_desc.interrupt < 16) {
+        hba->irq = IRQ0 + dev->device_desc.interrupt;
+        set_irq_handler(hba->irq, ahci_handler);
+    }
+    hba->regs->is = 0xffffffff;
+    hba->regs->ghc |= AHCI_GHC_IE;
+}
+
+void ahci_add_device(device_t* dev)
+{
+    uint32_t port_arg = dev->device_desc.args[0];
+    if (port_arg & AHCI_PORT_DEVICE) {
+        _ahci_bind_port(dev, &_ahci_hbas[dev->device_desc.args[1]], port_arg & 0xff);
+        return;
+    }
+    _ahci_start_controller(dev);
+}
+
+/**
+ * STORAGE API
+ */
+
+static int ahci_read_sectors(device_t* device, storage_request_t* req)
+{
+    if (!_ahci_present[device->id]) {
+        return -ENODEV;
+    }
+    return _ahci_transfer(&_ahci_ports[device->id], req, false);
+}
+
+static int ahci_write_sectors(device_t* device, storage_request_t* req)
+{
+    if (!_ahci_present[device->id]) {
+        return -ENODEV;
+    }
+    return _ahci_transfer(&_ahci_ports[device->id], req, true);
+}
+
+static int ahci_read(device_t* device, uint32_t sector, uint8_t* read_data)
+{
+    storage_segment_t seg = { .data = read_data, .len = STORAGE_SECTOR_SIZE };
+    storage_request_t req = { .lba = sector, .count = 1, .segments_count = 1, .segments = &seg };
+    return ahci_read_sectors(device, &req);
+}
+
+static int ahci_write(device_t* device, uint32_t sector, uint8_t* data, uint32_t size)
+{
+    // A short write is padded with zeroes to the whole sector, like ata does it.
+    uint8_t sector_data[STORAGE_SECTOR_SIZE];
+    if (size < STORAGE_SECTOR_SIZE) {
+        memset(sector_data, 0, STORAGE_SECTOR_SIZE);
+        memcpy(sector_data, data, size);
+        data = sector_data;
+    }
+
+    storage_segment_t seg = { .data = data, .len = STORAGE_SECTOR_SIZE };
+    storage_request_t req = { .lba = sector, .count = 1, .segments_count = 1, .segments = &seg };
+    return ahci_write_sectors(device, &req);
+}
+
+static int ahci_flush(device_t* device)
+{
+    if (!_ahci_present[device->id]) {
+        return -ENODEV;
+    }
+    return _ahci_do_command(&_ahci_ports[device->id], ATA_CMD_FLUSH_CACHE_EXT, 0, 0, 0);
+}
+
+static uint32_t ahci_get_capacity(device_t* device)
+{
+    return _ahci_present[device->id] ? _ahci_ports[device->id].capacity : 0;
+}
@@ -6,6 +6,10 @@
 
 #include <drivers/x86/ata.h>
 #include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
 
 ata_t _ata_drives[MAX_DEVICES_COUNT];
 
@@ -17,6 +21,8 @@ static uint8_t _ata_gen_drive_head_register(bool is_lba, bool is_master, uint8_t
 static int ata_write(device_t* device, uint32_t sector, uint8_t* data, uint32_t size);
 static int ata_read(device_t* device, uint32_t sector, uint8_t* read_data);
 static int ata_flush(device_t* device);
+static int ata_read_sectors(device_t* device, storage_request_t* req);
+static int ata_write_sectors(device_t* device, storage_request_t* req);
 static uint32_t ata_get_capacity(device_t* device);
 
 /**
@@ -48,6 +54,8 @@ driver_desc_t _ata_driver_info()
     ata_desc.functions[DRIVER_STORAGE_WRITE] = ata_write;
     ata_desc.functions[DRIVER_STORAGE_FLUSH] = ata_flush;
     ata_desc.functions[DRIVER_STORAGE_CAPACITY] = ata_get_capacity;
+    ata_desc.functions[DRIVER_STORAGE_READ_SECTORS] = ata_read_sectors;
+    ata_desc.functions[DRIVER_STORAGE_WRITE_SECTORS] = ata_write_sectors;
     ata_desc.pci_serve_class = 0x01;
     ata_desc.pci_serve_subclass = 0x05;
     ata_desc.pci_serve_vendor_id = 0x00;
@@ -62,6 +70,10 @@ void ata_add_new_device(device_t* new_device)
     ata_init(&_ata_drives[new_device->id], port, is_master);
     if (ata_indentify(&_ata_drives[new_device->id])) {
         kprintf("Device added to ata driver\n");
+        uint32_t bm_port = new_device->device_desc.args[0];
+        if (bm_port && _ata_drives[new_device->id].dma) {
+            ata_init_dma(&_ata_drives[new_device->id], bm_port);
+        }
     }
 }
 
@@ -85,6 +97,34 @@ void ata_init(ata_t* ata, uint32_t port, bool is_master)
     ata->port.control = port + 0x206;
 }
 
+int ata_init_dma(ata_t* ata, uint32_t bm_port)
+{
+    uint32_t prdt_paddr = (uint32_t)pmm_alloc_aligned(VMM_PAGE_SIZE, VMM_PAGE_SIZE);
+    if (!prdt_paddr) {
+        return -ENOMEM;
+    }
+
+    uint32_t dma_buf_paddr = (uint32_t)pmm_alloc_aligned(ATA_DMA_BUF_SIZE, ATA_DMA_BUF_SIZE);
+    if (!dma_buf_paddr) {
+        pmm_free((void*)prdt_paddr, VMM_PAGE_SIZE);
+        return -ENOMEM;
+    }
+
+    zone_t prdt_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(prdt_zone.start, prdt_paddr, PAGE_READABLE | PAGE_WRITABLE);
+    zone_t dma_buf_zone = zoner_new_zone(ATA_DMA_BUF_SIZE);
+    vmm_map_pages(dma_buf_zone.start, dma_buf_paddr, ATA_DMA_BUF_SIZE / VMM_PAGE_SIZE, PAGE_READABLE | PAGE_WRITABLE);
+
+    ata->bm_port.command = bm_port;
+    ata->bm_port.status = bm_port + 0x2;
+    ata->bm_port.prdt = bm_port + 0x4;
+    ata->prdt = (ata_prd_t*)prdt_zone.ptr;
+    ata->prdt_paddr = prdt_paddr;
+    ata->dma_buf = dma_buf_zone.ptr;
+    ata->dma_buf_paddr = dma_buf_paddr;
+    return 0;
+}
+
 bool ata_indentify(ata_t* ata)
 {
     port_8bit_out(ata->port.device, ata->is_master ? 0xA0 : 0xB0);
@@ -224,6 +264,187 @@ int ata_read(device_t* device, uint32_t sectorNum, uint8_t* read_data)
     return 0;
 }
 
+/**
+ * Multi-sector transfers issue one command for up to ATA_MAX_SECTORS_PER_CMD
+ * sectors, the drive raises DRQ before every sector of the command.
+ */
+#define ATA_MAX_SECTORS_PER_CMD (255)
+
+static int _ata_wait_for_drq(ata_t* dev)
+{
+    uint8_t status = port_8bit_in(dev->port.command);
+    while (((status >> 7) & 1) == 1 && ((status >> 0) & 1) != 1) {
+        status = port_8bit_in(dev->port.command);
+    }
+
+    if (((status >> 0) & 1) == 1) {
+        return -EBUSY;
+    }
+
+    if (((status >> 3) & 1) == 0) {
+        return -ENODEV;
+    }
+    return 0;
+}
+
+static void _ata_send_cmd(ata_t* dev, uint32_t lba, uint8_t count, uint8_t cmd)
+{
+    uint8_t dev_config = _ata_gen_drive_head_register(true, !dev->is_master, 0);
+
+    port_8bit_out(dev->port.device, dev_config | ((lba >> 24) & 0x0F));
+    port_8bit_out(dev->port.sector_count, count);
+    port_8bit_out(dev->port.lba_lo, lba & 0x000000FF);
+    port_8bit_out(dev->port.lba_mid, (lba & 0x0000FF00) >> 8);
+    port_8bit_out(dev->port.lba_hi, (lba & 0x00FF0000) >> 16);
+    port_8bit_out(dev->port.error, 0);
+    port_8bit_out(dev->port.command, cmd);
+}
+
+static int _ata_pio_transfer(ata_t* dev, storage_request_t* req, bool write)
+{
+    uint32_t lba = req->lba;
+    uint32_t left = req->count;
+    int seg_index = 0;
+    uint32_t seg_offset = 0;
+
+    while (left) {
+        uint32_t count = min(left, (uint32_t)ATA_MAX_SECTORS_PER_CMD);
+        _ata_send_cmd(dev, lba, count, write ? 0x30 : 0x20);
+
+        for (uint32_t sector = 0; sector < count; sector++) {
+            int err = _ata_wait_for_drq(dev);
+            if (err) {
+                return err;
+            }
+
+            uint16_t* data = (uint16_t*)(req->segments[seg_index].data + seg_offset);
+            if (write) {
+                for (int i = 0; i < 256; i++) {
+                    port_16bit_out(dev->port.data, data[i]);
+                }
+            } else {
+                for (int i = 0; i < 256; i++) {
+                    data[i] = port_16bit_in(dev->port.data);
+                }
+            }
+
+            seg_offset += STORAGE_SECTOR_SIZE;
+            if (seg_offset == req->segments[seg_index].len) {
+                seg_index++;
+                seg_offset = 0;
+            }
+        }
+
+        lba += count;
+        left -= count;
+    }
+
+    return 0;
+}
+
+/**
+ * Copies len bytes between the dma buffer and segments of the request,
+ * starting at (seg_index, seg_offset) and advancing it.
+ */
+static void _ata_dma_copy(ata_t* dev, storage_request_t* req, int* seg_index, uint32_t* seg_offset, uint32_t len, bool to_dma_buf)
+{
+    uint8_t* dma_buf = dev->dma_buf;
+    while (len) {
+        storage_segment_t* seg = &req->segments[*seg_index];
+        uint32_t part = min(seg->len - *seg_offset, len);
+        if (to_dma_buf) {
+            memcpy(dma_buf, seg->data + *seg_offset, part);
+        } else {
+            memcpy(seg->data + *seg_offset, dma_buf, part);
+        }
+
+        dma_buf += part;
+        len -= part;
+        *seg_offset += part;
+        if (*seg_offset == seg->len) {
+            (*seg_index)++;
+            *seg_offset = 0;
+        }
+    }
+}
+
+/**
+ * The drive moves data by itself, the cpu only waits for the bus master
+ * to report the end of the transfer.
+ */
+static int _ata_dma_transfer(ata_t* dev, storage_request_t* req, bool write)
+{
+    uint32_t lba = req->lba;
+    uint32_t left = req->count;
+    int seg_index = 0;
+    uint32_t seg_offset = 0;
+
+    while (left) {
+        uint32_t count = min(left, (uint32_t)ATA_DMA_MAX_SECTORS);
+        uint32_t len = count * STORAGE_SECTOR_SIZE;
+        if (write) {
+            _ata_dma_copy(dev, req, &seg_index, &seg_offset, len, true);
+        }
+
+        dev->prdt[0].paddr = dev->dma_buf_paddr;
+        dev->prdt[0].len = len & 0xFFFF;
+        dev->prdt[0].flags = 0x8000; // Last entry of the table.
+
+        port_8bit_out(dev->bm_port.command, 0);
+        port_32bit_out(dev->bm_port.prdt, dev->prdt_paddr);
+        port_8bit_out(dev->bm_port.status, port_8bit_in(dev->bm_port.status) | 0x06); // Clear interrupt and error bits.
+
+        uint8_t bm_command = write ? 0x00 : 0x08;
+        port_8bit_out(dev->bm_port.command, bm_command);
+        _ata_send_cmd(dev, lba, count & 0xFF, write ? 0xCA : 0xC8);
+        port_8bit_out(dev->bm_port.command, bm_command | 0x01);
+
+        uint8_t bm_status = port_8bit_in(dev->bm_port.status);
+        while ((bm_status & 0x01) && !(bm_status & 0x06)) {
+            bm_status = port_8bit_in(dev->bm_port.status);
+        }
+
+        port_8bit_out(dev->bm_port.command, 0);
+        port_8bit_out(dev->bm_port.status, 0x06);
+        uint8_t status = port_8bit_in(dev->port.command); // Also acknowledges the drive's interrupt.
+        if ((bm_status & 0x02) || (status & 0x01)) {
+            return -EIO;
+        }
+
+        if (!write) {
+            _ata_dma_copy(dev, req, &seg_index, &seg_offset, len, false);
+        }
+
+        lba += count;
+        left -= count;
+    }
+
+    return 0;
+}
+
+static int _ata_transfer_sectors(device_t* device, storage_request_t* req, bool write)
+{
+    ata_t* dev = &_ata_drives[device->id];
+    if (dev->prdt) {
+        return _ata_dma_transfer(dev, req, write);
+    }
+    return _ata_pio_transfer(dev, req, write);
+}
+
+int ata_read_sectors(device_t* device, storage_request_t* req)
+{
+    return _ata_transfer_sectors(device, req, false);
+}
+
+int ata_write_sectors(device_t* device, storage_request_t* req)
+{
+    int err = _ata_transfer_sectors(device, req, true);
+    if (err) {
+        return err;
+    }
+    return ata_flush(device);
+}
+
 int ata_flush(device_t* device)
 {
     ata_t* dev = &_ata_drives[device->id];
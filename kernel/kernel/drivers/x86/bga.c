@@ -14,6 +14,7 @@
 #include <libkern/log.h>
 #include <tasking/proc.h>
 #include <tasking/tasking.h>
+#include <time/time_manager.h>
 
 #define VBE_DISPI_IOPORT_INDEX 0x01CE
 #define VBE_DISPI_IOPORT_DATA 0x01CF
@@ -33,6 +34,8 @@
 #define VBE_DISPI_ENABLED 0x01
 #define VBE_DISPI_LFB_ENABLED 0x40
 
+#define BGA_REFRESH_RATE 60
+
 static uint16_t bga_screen_width, bga_screen_height;
 static uint32_t bga_screen_line_size, bga_screen_buffer_size;
 static uint32_t bga_buf_paddr;
@@ -65,6 +68,20 @@ static void _bga_set_resolution(uint16_t width, uint16_t height)
     bga_screen_line_size = (uint32_t)width * 4;
 }
 
+/**
+ * The adapter raises no vblank interrupt, so vblanks are put on the clock of
+ * the timer tick at the refresh rate. The rate divides a second, so the
+ * ticks of the current second are enough to find the phase.
+ */
+static uint32_t _bga_ms_to_next_vblank()
+{
+    uint32_t ticks = timeman_get_ticks_from_last_second() % TIMER_TICKS_PER_SECOND;
+    uint32_t us_in_second = ticks * 1000000 / TIMER_TICKS_PER_SECOND;
+    uint32_t frame_us = 1000000 / BGA_REFRESH_RATE;
+    uint32_t us_to_vblank = frame_us - us_in_second % frame_us;
+    return (us_to_vblank + 999) / 1000;
+}
+
 static int _bga_ioctl(dentry_t* dentry, uint32_t cmd, uint32_t arg)
 {
     uint32_t y_offset = 0;
@@ -73,10 +90,17 @@ static int _bga_ioctl(dentry_t* dentry, uint32_t cmd, uint32_t arg)
         return bga_screen_height;
     case BGA_GET_WIDTH:
         return bga_screen_width;
+    case BGA_GET_DEPTH:
+        return 4;
     case BGA_SWAP_BUFFERS:
         y_offset = bga_screen_height * (arg & 1);
         _bga_write_reg(VBE_DISPI_INDEX_Y_OFFSET, (uint16_t)y_offset);
         return 0;
+    case BGA_GET_NEXT_VBLANK:
+        return _bga_ms_to_next_vblank();
+    case BGA_GET_ACCEL_OPS:
+        /* The adapter is a plain framebuffer, all drawing stays in software. */
+        return 0;
     default:
         return -EINVAL;
     }
@@ -90,25 +114,26 @@ static proc_zone_t* _bga_mmap(dentry_t* dentry, mmap_params_t* params)
         return 0;
     }
 
-    proc_zone_t* zone = proc_new_random_zone(RUNNING_THREAD->process, bga_screen_buffer_size);
+    // The buffer is aligned by the device, so the zone is aligned to be mapped with large pages.
+    proc_zone_t* zone = proc_new_random_zone_aligned(RUNNING_THREAD->process, bga_screen_buffer_size, VMM_USER_LARGE_PAGE_SIZE);
     if (!zone) {
         return 0;
     }
 
-    zone->flags |= ZONE_WRITABLE | ZONE_READABLE | ZONE_NOT_CACHEABLE;
+    // Compositor stores are gathered into bursts, nothing reads the buffer back.
+    zone->flags |= ZONE_WRITABLE | ZONE_READABLE | ZONE_WRITE_COMBINING;
     zone->type |= ZONE_TYPE_DEVICE;
     zone->file = dentry_duplicate(dentry);
 
-    for (int offset = 0; offset < bga_screen_buffer_size; offset += VMM_PAGE_SIZE) {
-        vmm_map_page(zone->start + offset, bga_buf_paddr + offset, zone->flags);
-    }
+    vmm_map_pages(zone->start, bga_buf_paddr, zone->len / VMM_PAGE_SIZE, zone->flags);
 
     return zone;
 }
 
 static void bga_recieve_notification(uint32_t msg, uint32_t param)
 {
-    if (msg == DM_NOTIFICATION_DEVFS_READY) {
+    // Only a found adapter takes /dev/bga, other display drivers use the same node.
+    if (msg == DM_NOTIFICATION_DEVFS_READY && bga_buf_paddr) {
         dentry_t* mp;
         if (vfs_resolve_path("/dev", &mp) < 0) {
             kpanic("Can't init bga in /dev");
@@ -45,19 +45,7 @@ void fpu_handler()
         return;
     }
 
-    fpu_make_avail();
-
-    if (RUNNING_THREAD->tid == THIS_CPU->fpu_for_pid) {
-        return;
-    }
-
-    if (THIS_CPU->fpu_for_thread && THIS_CPU->fpu_for_thread->tid == THIS_CPU->fpu_for_pid) {
-        fpu_save(THIS_CPU->fpu_for_thread->fpu_state);
-    }
-
-    fpu_restore(RUNNING_THREAD->fpu_state);
-    THIS_CPU->fpu_for_thread = RUNNING_THREAD;
-    THIS_CPU->fpu_for_pid = RUNNING_THREAD->tid;
+    thread_fpu_handle_trap();
 }
 
 void fpu_init()
@@ -68,6 +56,13 @@ void fpu_init()
                  : "=m"(fpu_state));
 }
 
+// The initial state is already saved by the boot cpu.
+void fpu_init_secondary_cpu()
+{
+    fpu_setup();
+    asm volatile("fninit");
+}
+
 void fpu_init_state(fpu_state_t* new_fpu_state)
 {
     memcpy(new_fpu_state, &fpu_state, sizeof(fpu_state_t));
@@ -5,6 +5,7 @@
  */
 
 #include <drivers/x86/ide.h>
+#include <drivers/x86/pci.h>
 
 // ------------
 // Private
@@ -47,6 +48,17 @@ void ide_find_devices(device_t* t_device)
     const uint8_t DRIVES_COUNT = 2;
     uint32_t ask_ports[] = { 0x1F0, 0x1F0 };
     bool is_masters[] = { true, false };
+
+    // Bus master registers of the primary channel are at BAR4, drives get them only
+    // if the controller is able to be a bus master.
+    uint32_t bm_port = 0;
+    uint32_t bar4 = pci_read_bar(t_device, 4);
+    if (bar4 & 0x1) {
+        uint32_t command = pci_read(t_device->device_desc.bus, t_device->device_desc.device, t_device->device_desc.function, 0x04) & 0xFFFF;
+        pci_write(t_device->device_desc.bus, t_device->device_desc.device, t_device->device_desc.function, 0x04, command | 0x04);
+        bm_port = bar4 & 0xFFFC;
+    }
+
     for (uint8_t i = 0; i < DRIVES_COUNT; i++) {
         ata_t new_drive;
         ata_init(&new_drive, ask_ports[i], is_masters[i]);
@@ -58,6 +70,7 @@ void ide_find_devices(device_t* t_device)
             new_device.revision_id = 0;
             new_device.port_base = ask_ports[i] | (1 << 31);
             new_device.interrupt = IRQ14;
+            new_device.args[0] = bm_port;
             device_install(new_device);
         }
     }
@@ -56,6 +56,5 @@ void kbdriver_run()
 /* Keyboard interrupt handler */
 void keyboard_handler()
 {
-    uint32_t scancode = (uint32_t)port_byte_in(0x60);
-    generic_emit_key_set1(scancode);
+    generic_queue_key_set1(port_byte_in(0x60));
 }
\ No newline at end of file
@@ -4,7 +4,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
-#include <algo/ringbuffer.h>
+#include <algo/spsc_ringbuffer.h>
 #include <drivers/driver_manager.h>
 #include <drivers/x86/display.h>
 #include <drivers/x86/mouse.h>
@@ -14,42 +14,24 @@
 #include <libkern/types.h>
 #include <platform/x86/idt.h>
 #include <platform/x86/port.h>
+#include <tasking/tasklet.h>
+#include <tasking/tasking.h>
 
 // #define MOUSE_DRIVER_DEBUG
 
-static ringbuffer_t mouse_buffer;
+#define MOUSE_RAW_PACKET_SIZE 4
 
-void mouse_run();
-
-static bool _mouse_can_read(dentry_t* dentry, uint32_t start)
-{
-    return ringbuffer_space_to_read(&mouse_buffer) >= 1;
-}
+static spsc_ringbuffer_t mouse_raw_buffer; /* Bytes read by the irq, not decoded yet. */
+static tasklet_t mouse_tasklet;
 
-static int _mouse_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
-{
-    uint32_t leno = ringbuffer_space_to_read(&mouse_buffer);
-    if (leno > len) {
-        leno = len;
-    }
-    int res = ringbuffer_read(&mouse_buffer, buf, leno);
-    return leno;
-}
+void mouse_run();
 
 static void _mouse_recieve_notification(uint32_t msg, uint32_t param)
 {
     if (msg == DM_NOTIFICATION_DEVFS_READY) {
-        dentry_t* mp;
-        if (vfs_resolve_path("/dev", &mp) < 0) {
+        if (generic_mouse_create_devfs() < 0) {
             kpanic("Can't init mouse in /dev");
         }
-
-        file_ops_t fops = { 0 };
-        fops.can_read = _mouse_can_read;
-        fops.read = _mouse_read;
-        devfs_inode_t* res = devfs_register(mp, MKDEV(10, 1), "mouse", 5, 0500, &fops);
-
-        dentry_put(mp);
     }
 }
 
@@ -121,16 +103,12 @@ static inline void _mouse_enable_aux()
     _mouse_wait_then_write(0x60, res);
 }
 
-void mouse_handler()
+static void _mouse_emit_packet(uint8_t* raw)
 {
-    uint8_t status = port_8bit_in(0x64);
-    if ((status & 0x1) == 0 || (status & 0x20) != 0x20) {
-        return;
-    }
-    uint8_t resp = port_8bit_in(0x60);
-    uint8_t xm = port_8bit_in(0x60);
-    uint8_t ym = port_8bit_in(0x60);
-    int8_t wheel = port_8bit_in(0x60);
+    uint8_t resp = raw[0];
+    uint8_t xm = raw[1];
+    uint8_t ym = raw[2];
+    int8_t wheel = raw[3];
 
     uint8_t y_overflow = (resp >> 7) & 1;
     uint8_t x_overflow = (resp >> 6) & 1;
@@ -154,7 +132,7 @@ void mouse_handler()
         packet.y_offset = 0;
     }
 
-    ringbuffer_write(&mouse_buffer, (uint8_t*)&packet, sizeof(mouse_packet_t));
+    generic_mouse_emit(&packet);
 
 #ifdef MOUSE_DRIVER_DEBUG
     log("%x", packet.button_states);
@@ -171,6 +149,33 @@ void mouse_handler()
 #endif /* MOUSE_DRIVER_DEBUG */
 }
 
+static void _mouse_tasklet(void* data)
+{
+    uint8_t raw[MOUSE_RAW_PACKET_SIZE];
+    while (spsc_ringbuffer_space_to_read(&mouse_raw_buffer) >= MOUSE_RAW_PACKET_SIZE) {
+        spsc_ringbuffer_read(&mouse_raw_buffer, raw, MOUSE_RAW_PACKET_SIZE);
+        _mouse_emit_packet(raw);
+    }
+}
+
+/* Top half, only takes the bytes off the controller. */
+void mouse_handler()
+{
+    uint8_t status = port_8bit_in(0x64);
+    if ((status & 0x1) == 0 || (status & 0x20) != 0x20) {
+        return;
+    }
+
+    uint8_t raw[MOUSE_RAW_PACKET_SIZE];
+    for (int i = 0; i < MOUSE_RAW_PACKET_SIZE; i++) {
+        raw[i] = port_8bit_in(0x60);
+    }
+    if (spsc_ringbuffer_space_to_write(&mouse_raw_buffer) >= MOUSE_RAW_PACKET_SIZE) {
+        spsc_ringbuffer_write(&mouse_raw_buffer, raw, MOUSE_RAW_PACKET_SIZE);
+    }
+    tasklet_schedule(&mouse_tasklet);
+}
+
 void mouse_run()
 {
     _mouse_wait_then_write(0x64, 0xa8);
@@ -180,9 +185,10 @@ void mouse_run()
     _mouse_send_cmd_and_data(0xF3, 200);
     _mouse_send_cmd_and_data(0xF3, 100);
     _mouse_send_cmd_and_data(0xF3, 80);
+    generic_mouse_init();
+    mouse_raw_buffer = spsc_ringbuffer_create_std();
+    tasklet_init(&mouse_tasklet, _mouse_tasklet, NULL);
     set_irq_handler(IRQ12, mouse_handler);
-
-    mouse_buffer = ringbuffer_create_std();
 }
 
 bool mouse_install()
@@ -5,6 +5,18 @@
  */
 
 #include <drivers/x86/pci.h>
+#include <libkern/atomic.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/log.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/x86/apic.h>
+#include <platform/x86/idt.h>
+
+static pci_device_t _pci_devices[PCI_MAX_DEVICES];
+static int _pci_devices_count = 0;
+static int _pci_msi_vectors_used = 0;
 
 static driver_desc_t _pci_driver_info()
 {
@@ -82,34 +94,73 @@ char pci_has_device_functions(uint8_t bus, uint8_t device)
     return pci_read(bus, device, 0, 0x0e) & (1 << 7);
 }
 
+static void _pci_find_caps(pci_device_t* pdev)
+{
+    device_desc_t* desc = &pdev->desc;
+    if (!((pci_read(desc->bus, desc->device, desc->function, 0x04) >> 16) & PCI_STATUS_CAP_LIST)) {
+        return;
+    }
+
+    uint8_t cap = pci_read(desc->bus, desc->device, desc->function, 0x34) & 0xfc;
+    for (int guard = 0; cap && guard < 48; guard++) {
+        uint32_t header = pci_read(desc->bus, desc->device, desc->function, cap);
+        if ((header & 0xff) == PCI_CAP_ID_MSI) {
+            pdev->msi_cap = cap;
+        } else if ((header & 0xff) == PCI_CAP_ID_MSIX) {
+            pdev->msix_cap = cap;
+        }
+        cap = (header >> 8) & 0xfc;
+    }
+}
+
+static void _pci_add_function(uint8_t bus, uint8_t device, uint8_t function)
+{
+    device_desc_t dev = pci_get_device_desriptor(bus, device, function);
+    for (uint8_t bar_id = 0; bar_id < 6; bar_id++) {
+        bar_t bar = _pci_get_bar(bus, device, function, bar_id);
+        if (bar.address && (bar.type == INPUT_OUTPUT)) {
+            dev.port_base = (uint32_t)bar.address;
+        }
+    }
+
+    if (_pci_devices_count < PCI_MAX_DEVICES) {
+        pci_device_t* pdev = &_pci_devices[_pci_devices_count++];
+        memset(pdev, 0, sizeof(pci_device_t));
+        pdev->desc = dev;
+        _pci_find_caps(pdev);
+    }
+
+    device_install(dev);
+    kprintf("Vendor %x, devID %x, cl %x scl %x\n", dev.vendor_id, dev.device_id, dev.class_id, dev.subclass_id);
+}
+
+/**
+ * An absent device answers with all ones at vendor id, its functions are
+ * not probed then. Only a multi-function device has more than function 0.
+ */
 void pci_find_devices()
 {
     kprintf("Pci scanning\n");
-    uint8_t bus, device, function;
-    for (bus = 0; bus < 8; bus++) {
-        for (device = 0; device < 32; device++) {
-            uint8_t functions_count = pci_has_device_functions(bus, device) == 0 ? 8 : 1;
-            for (function = 0; function < functions_count; function++) {
-                device_desc_t dev = pci_get_device_desriptor(bus, device, function);
-                if (dev.vendor_id == 0x0000 || dev.vendor_id == 0xffff) {
-                    continue;
-                }
+    for (uint16_t bus = 0; bus < 8; bus++) {
+        for (uint8_t device = 0; device < 32; device++) {
+            uint16_t vendor_id = pci_read(bus, device, 0, 0x00);
+            if (vendor_id == 0x0000 || vendor_id == 0xffff) {
+                continue;
+            }
 
-                for (uint8_t bar_id = 0; bar_id < 6; bar_id++) {
-                    bar_t bar = _pci_get_bar(bus, device, function, bar_id);
-                    if (bar.address && (bar.type == INPUT_OUTPUT)) {
-                        dev.port_base = (uint32_t)bar.address;
-                    }
+            uint8_t functions_count = pci_has_device_functions(bus, device) ? 8 : 1;
+            for (uint8_t function = 0; function < functions_count; function++) {
+                vendor_id = pci_read(bus, device, function, 0x00);
+                if (vendor_id == 0x0000 || vendor_id == 0xffff) {
+                    continue;
                 }
-
-                device_install(dev);
-
-                kprintf("Vendor %x, devID %x, cl %x scl %x\n", dev.vendor_id, dev.device_id, dev.class_id, dev.subclass_id);
+                _pci_add_function(bus, device, function);
             }
         }
     }
 }
 
+/* Reads the header by dwords, each access is a pair of port writes and reads. */
 device_desc_t pci_get_device_desriptor(uint8_t bus, uint8_t device, uint8_t function)
 {
     device_desc_t new_device = { 0 };
@@ -118,15 +169,17 @@ device_desc_t pci_get_device_desriptor(uint8_t bus, uint8_t device, uint8_t func
     new_device.device = device;
     new_device.function = function;
 
-    new_device.vendor_id = pci_read(bus, device, function, 0x00);
-    new_device.device_id = pci_read(bus, device, function, 0x02);
+    uint32_t ids = pci_read(bus, device, function, 0x00);
+    new_device.vendor_id = ids & 0xffff;
+    new_device.device_id = ids >> 16;
 
-    new_device.class_id = pci_read(bus, device, function, 0x0b);
-    new_device.subclass_id = pci_read(bus, device, function, 0x0a);
-    new_device.interface_id = pci_read(bus, device, function, 0x09);
-    new_device.revision_id = pci_read(bus, device, function, 0x08);
+    uint32_t class_rev = pci_read(bus, device, function, 0x08);
+    new_device.revision_id = class_rev & 0xff;
+    new_device.interface_id = (class_rev >> 8) & 0xff;
+    new_device.subclass_id = (class_rev >> 16) & 0xff;
+    new_device.class_id = class_rev >> 24;
 
-    new_device.interrupt = pci_read(bus, device, function, 0x3c);
+    new_device.interrupt = pci_read(bus, device, function, 0x3c) & 0xff;
 
     return new_device;
 }
@@ -135,3 +188,140 @@ uint32_t pci_read_bar(device_t* dev, int bar_id)
 {
     return _pci_do_read_bar(dev->device_desc.bus, dev->device_desc.device, dev->device_desc.function, bar_id);
 }
+
+/**
+ * Looks up the enumerated functions. A vendor_id of 0xffff matches any
+ * vendor. Pass the previous result as after to get the next match.
+ */
+pci_device_t* pci_find_device(uint8_t class_id, uint8_t subclass_id, uint16_t vendor_id, pci_device_t* after)
+{
+    int start = after ? (after - _pci_devices) + 1 : 0;
+    for (int i = start; i < _pci_devices_count; i++) {
+        device_desc_t* desc = &_pci_devices[i].desc;
+        if (desc->class_id == class_id && desc->subclass_id == subclass_id && (vendor_id == 0xffff || desc->vendor_id == vendor_id)) {
+            return &_pci_devices[i];
+        }
+    }
+    return NULL;
+}
+
+pci_device_t* pci_device_of(device_t* dev)
+{
+    device_desc_t* desc = &dev->device_desc;
+    for (int i = 0; i < _pci_devices_count; i++) {
+        device_desc_t* cached = &_pci_devices[i].desc;
+        if (cached->bus == desc->bus && cached->device == desc->device && cached->function == desc->function) {
+            return &_pci_devices[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * MSI
+ */
+
+static inline void _pci_write_ctrl(device_desc_t* desc, uint8_t cap, uint16_t ctrl)
+{
+    uint32_t header = pci_read(desc->bus, desc->device, desc->function, cap);
+    pci_write(desc->bus, desc->device, desc->function, cap, (header & 0xffff) | ((uint32_t)ctrl << 16));
+}
+
+static void* _pci_map_mmio(uint32_t paddr, uint32_t len)
+{
+    uint32_t page_offset = paddr % VMM_PAGE_SIZE;
+    uint32_t pages = (page_offset + len + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    zone_t zone = zoner_new_zone(pages * VMM_PAGE_SIZE);
+    if (!zone.start) {
+        return NULL;
+    }
+    vmm_map_pages(zone.start, paddr - page_offset, pages, PAGE_READABLE | PAGE_WRITABLE | PAGE_NOT_CACHEABLE);
+    return zone.ptr + page_offset;
+}
+
+/* Entry 0 of the table gets the vector, the other entries stay masked. */
+static int _pci_msix_setup(pci_device_t* pdev, device_t* dev, uint32_t address, uint32_t data)
+{
+    device_desc_t* desc = &pdev->desc;
+    uint16_t ctrl = pci_read(desc->bus, desc->device, desc->function, pdev->msix_cap) >> 16;
+    uint32_t table = pci_read(desc->bus, desc->device, desc->function, pdev->msix_cap + 4);
+    uint32_t bar = pci_read_bar(dev, table & 0x7);
+    if (bar & 0x1) {
+        return -ENODEV;
+    }
+
+    uint32_t entries = (ctrl & 0x7ff) + 1;
+    volatile uint32_t* entry = _pci_map_mmio((bar & 0xfffffff0) + (table & ~0x7), entries * 16);
+    if (!entry) {
+        return -ENOMEM;
+    }
+
+    _pci_write_ctrl(desc, pdev->msix_cap, ctrl | PCI_MSIX_CTRL_ENABLE | PCI_MSIX_CTRL_FUNC_MASK);
+    for (uint32_t i = 1; i < entries; i++) {
+        entry[4 * i + 3] |= 0x1;
+    }
+    entry[0] = address;
+    entry[1] = 0;
+    entry[2] = data;
+    entry[3] &= ~0x1;
+    _pci_write_ctrl(desc, pdev->msix_cap, (ctrl | PCI_MSIX_CTRL_ENABLE) & ~PCI_MSIX_CTRL_FUNC_MASK);
+    return PCI_IRQ_MSIX;
+}
+
+static int _pci_msi_setup(pci_device_t* pdev, uint32_t address, uint32_t data)
+{
+    device_desc_t* desc = &pdev->desc;
+    uint8_t cap = pdev->msi_cap;
+    uint16_t ctrl = pci_read(desc->bus, desc->device, desc->function, cap) >> 16;
+
+    pci_write(desc->bus, desc->device, desc->function, cap + 4, address);
+    if (ctrl & PCI_MSI_CTRL_64BIT) {
+        pci_write(desc->bus, desc->device, desc->function, cap + 8, 0);
+        pci_write(desc->bus, desc->device, desc->function, cap + 12, data);
+    } else {
+        pci_write(desc->bus, desc->device, desc->function, cap + 8, data);
+    }
+
+    // One vector: multiple message enable (bits 4-6) stays 0.
+    ctrl &= ~(0x7 << 4);
+    _pci_write_ctrl(desc, cap, ctrl | PCI_MSI_CTRL_ENABLE);
+    return PCI_IRQ_MSI;
+}
+
+/**
+ * Gives the device its own vector, through MSI-X when it has it and MSI
+ * otherwise, and turns its legacy line off. Returns the kind of the set up
+ * irq, its vector is kept in the pci_device_t. Messages go to the boot cpu,
+ * they need the local APIC.
+ */
+int pci_msi_setup(device_t* dev, void (*handler)())
+{
+    pci_device_t* pdev = pci_device_of(dev);
+    if (!pdev || !apic_enabled() || (!pdev->msi_cap && !pdev->msix_cap)) {
+        return -ENODEV;
+    }
+    if (pdev->irq_kind != PCI_IRQ_LEGACY) {
+        return pdev->irq_kind;
+    }
+
+    int vector_index = atomic_add(&_pci_msi_vectors_used, 1) - 1;
+    if (vector_index >= IRQ_MSI_COUNT) {
+        return -EBUSY;
+    }
+
+    uint8_t vector = IRQ_MSI_BASE + vector_index;
+    set_irq_handler(vector, handler);
+    uint32_t address = PCI_MSI_ADDRESS_BASE | ((uint32_t)apic_cpu_lapic_id(0) << 12);
+
+    int kind = pdev->msix_cap ? _pci_msix_setup(pdev, dev, address, vector) : _pci_msi_setup(pdev, address, vector);
+    if (kind < 0) {
+        return kind;
+    }
+
+    // Interrupt disable bit of the command register.
+    device_desc_t* desc = &pdev->desc;
+    pci_write(desc->bus, desc->device, desc->function, 0x04, (pci_read(desc->bus, desc->device, desc->function, 0x04) & 0xffff) | (1 << 10));
+    pdev->irq_kind = kind;
+    pdev->msi_vector = vector;
+    return kind;
+}
@@ -10,6 +10,7 @@
 #include <platform/generic/system.h>
 #include <tasking/cpu.h>
 #include <tasking/sched.h>
+#include <time/profiler.h>
 #include <time/time_manager.h>
 
 static int ticks_to_sched = 0;
@@ -41,9 +42,34 @@ void pit_setup()
     set_irq_handler(IRQ0, pit_handler);
 }
 
+/**
+ * Counts system_read_cycles() over PIT_CALIBRATE_MS of channel 2. The
+ * channel is gated through port 0x61 and its output is polled there, so
+ * no interrupt is needed.
+ */
+uint32_t pit_measure_cycles_per_second()
+{
+    uint32_t count = PIT_BASE_FREQ / (1000 / PIT_CALIBRATE_MS);
+    system_disable_interrupts();
+    uint8_t gate = port_byte_in(0x61);
+    port_byte_out(0x61, (gate & ~0x02) | 0x01); // Gate on, speaker off
+    port_byte_out(0x43, 0xb0); // Channel 2, mode 0
+    port_byte_out(0x42, count & 0xff);
+    port_byte_out(0x42, (count >> 8) & 0xff);
+
+    uint32_t start = system_read_cycles();
+    while (!(port_byte_in(0x61) & 0x20)) { }
+    uint32_t cycles = system_read_cycles() - start;
+
+    port_byte_out(0x61, gate);
+    system_enable_interrupts();
+    return cycles * (1000 / PIT_CALIBRATE_MS);
+}
+
 void pit_handler()
 {
     cpu_tick();
+    profiler_tick();
     timeman_timer_tick();
     sched_tick();
 }
@@ -4,9 +4,16 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <drivers/generic/uart.h>
 #include <drivers/x86/uart.h>
+#include <libkern/libkern.h>
+#include <platform/x86/idt.h>
 #include <platform/x86/port.h>
 
+/* Bytes put to the FIFO since the THRE interrupt, it holds UART_FIFO_SIZE. */
+static int _uart_tx_in_fifo = 0;
+static uint8_t _uart_ier = 0;
+
 static int _uart_setup_impl(int port)
 {
     port_byte_out(port + 1, 0x00);
@@ -26,12 +33,12 @@ void uart_setup()
 
 static inline bool _uart_is_free_in(int port)
 {
-    return port_byte_in(port + 5) & 0x01;
+    return port_byte_in(port + 5) & UART_LSR_DATA_READY;
 }
 
 static inline bool _uart_is_free_out(int port)
 {
-    return port_byte_in(port + 5) & 0x20;
+    return port_byte_in(port + 5) & UART_LSR_THRE;
 }
 
 int uart_write(int port, uint8_t data)
@@ -43,7 +50,93 @@ int uart_write(int port, uint8_t data)
 
 int uart_read(int port, uint8_t* data)
 {
-    while (!_uart_is_free_out(port)) { }
+    while (!_uart_is_free_in(port)) { }
     *data = port_byte_in(port);
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * The line status tells only that the FIFO is empty, so after that up to
+ * UART_FIFO_SIZE bytes are put without checking again.
+ */
+bool uart_hw_tx_full()
+{
+    if (_uart_tx_in_fifo && _uart_is_free_out(COM1)) {
+        _uart_tx_in_fifo = 0;
+    }
+    if (!_uart_tx_in_fifo && !_uart_is_free_out(COM1)) {
+        return true;
+    }
+    return _uart_tx_in_fifo >= UART_FIFO_SIZE;
+}
+
+void uart_hw_put(uint8_t data)
+{
+    port_byte_out(COM1, data);
+    _uart_tx_in_fifo++;
+}
+
+bool uart_hw_rx_ready()
+{
+    return _uart_is_free_in(COM1);
+}
+
+uint8_t uart_hw_get()
+{
+    return port_byte_in(COM1);
+}
+
+void uart_hw_set_tx_irq(bool enabled)
+{
+    uint8_t ier = enabled ? (_uart_ier | UART_IER_THRE) : (_uart_ier & ~UART_IER_THRE);
+    if (ier != _uart_ier) {
+        _uart_ier = ier;
+        port_byte_out(COM1 + 1, ier);
+    }
+}
+
+static void _uart_irq_handler()
+{
+    // Reading the identification acks a THRE interrupt.
+    port_byte_in(COM1 + 2);
+    generic_uart_irq();
+}
+
+static void _uart_recieve_notification(uint32_t msg, uint32_t param)
+{
+    if (msg == DM_NOTIFICATION_DEVFS_READY) {
+        if (generic_uart_create_devfs() < 0) {
+            kpanic("Can't init uart in /dev");
+        }
+    }
+}
+
+static void _uart_start()
+{
+    set_irq_handler(IRQ4, _uart_irq_handler);
+    generic_uart_init();
+    _uart_ier = UART_IER_RX;
+    port_byte_out(COM1 + 1, _uart_ier);
+}
+
+static driver_desc_t _uart_driver_info()
+{
+    driver_desc_t desc = { 0 };
+    desc.type = DRIVER_OTHER;
+    desc.auto_start = true;
+    desc.is_device_driver = false;
+    desc.is_device_needed = false;
+    desc.is_driver_needed = false;
+    desc.functions[DRIVER_NOTIFICATION] = _uart_recieve_notification;
+    desc.functions[DM_FUNC_DRIVER_START] = _uart_start;
+    desc.pci_serve_class = 0xff;
+    desc.pci_serve_subclass = 0xff;
+    desc.pci_serve_vendor_id = 0x00;
+    desc.pci_serve_device_id = 0x00;
+    return desc;
+}
+
+void uart_install()
+{
+    driver_install(_uart_driver_info(), "uart86");
+}
@@ -0,0 +1,586 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/driver_manager.h>
+#include <drivers/x86/pci.h>
+#include <drivers/x86/virtio_blk.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/log.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/generic/cpu.h>
+#include <platform/generic/system.h>
+#include <platform/x86/idt.h>
+
+#define VIRTIO_BLK_SPIN_LIMIT (50000000)
+
+static virtio_blk_t _virtio_blk_drives[MAX_DEVICES_COUNT];
+static bool _virtio_blk_present[MAX_DEVICES_COUNT];
+
+static int virtio_blk_read(device_t* device, uint32_t sector, uint8_t* read_data);
+static int virtio_blk_write(device_t* device, uint32_t sector, uint8_t* data, uint32_t size);
+static int virtio_blk_flush(device_t* device);
+static int virtio_blk_read_sectors(device_t* device, storage_request_t* req);
+static int virtio_blk_write_sectors(device_t* device, storage_request_t* req);
+static uint32_t virtio_blk_get_capacity(device_t* device);
+
+static void* _virtio_blk_map(uint32_t paddr, uint32_t len)
+{
+    uint32_t page_offset = paddr % VMM_PAGE_SIZE;
+    uint32_t pages = (page_offset + len + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    zone_t zone = zoner_new_zone(pages * VMM_PAGE_SIZE);
+    if (!zone.start) {
+        return NULL;
+    }
+    vmm_map_pages(zone.start, paddr - page_offset, pages, PAGE_READABLE | PAGE_WRITABLE | PAGE_NOT_CACHEABLE);
+    return zone.ptr + page_offset;
+}
+
+static void* _virtio_blk_alloc_dma(uint32_t len, uint32_t* paddr)
+{
+    *paddr = (uint32_t)pmm_alloc_aligned(len, VMM_PAGE_SIZE);
+    if (!*paddr) {
+        return NULL;
+    }
+
+    zone_t zone = zoner_new_zone(len);
+    vmm_map_pages(zone.start, *paddr, len / VMM_PAGE_SIZE, PAGE_READABLE | PAGE_WRITABLE);
+    memset(zone.ptr, 0, len);
+    return zone.ptr;
+}
+
+static uint32_t _virtio_blk_bar_paddr(device_t* dev, int bar_id)
+{
+    uint32_t bar = pci_read_bar(dev, bar_id);
+    if (bar & 0x1) {
+        return 0;
+    }
+
+    // A 64bit bar placed above 4GB can't be reached.
+    if (((bar >> 1) & 0x3) == 0x2 && pci_read_bar(dev, bar_id + 1)) {
+        return 0;
+    }
+    return bar & 0xfffffff0;
+}
+
+static int _virtio_blk_find_caps(virtio_blk_t* blk, device_t* dev)
+{
+    uint8_t bus = dev->device_desc.bus;
+    uint8_t device = dev->device_desc.device;
+    uint8_t function = dev->device_desc.function;
+
+    uint8_t cap = pci_read(bus, device, function, 0x34) & 0xfc;
+    while (cap) {
+        uint8_t vendor = pci_read(bus, device, function, cap) & 0xff;
+        uint8_t cfg_type = pci_read(bus, device, function, cap + 3) & 0xff;
+        uint8_t bar = pci_read(bus, device, function, cap + 4) & 0xff;
+        uint32_t offset = pci_read(bus, device, function, cap + 8);
+        uint32_t length = pci_read(bus, device, function, cap + 12);
+
+        uint32_t bar_paddr = (vendor == VIRTIO_PCI_CAP_VENDOR && bar < 6) ? _virtio_blk_bar_paddr(dev, bar) : 0;
+        if (bar_paddr) {
+            if (cfg_type == VIRTIO_PCI_CAP_COMMON_CFG && !blk->common_cfg) {
+                blk->common_cfg = _virtio_blk_map(bar_paddr + offset, length);
+            } else if (cfg_type == VIRTIO_PCI_CAP_NOTIFY_CFG && !blk->notify_base) {
+                blk->notify_off_multiplier = pci_read(bus, device, function, cap + 16);
+                blk->notify_base = _virtio_blk_map(bar_paddr + offset, length);
+            } else if (cfg_type == VIRTIO_PCI_CAP_ISR_CFG && !blk->isr) {
+                blk->isr = _virtio_blk_map(bar_paddr + offset, length);
+            } else if (cfg_type == VIRTIO_PCI_CAP_DEVICE_CFG && !blk->config) {
+                blk->config = _virtio_blk_map(bar_paddr + offset, length);
+            }
+        }
+        cap = pci_read(bus, device, function, cap + 1) & 0xfc;
+    }
+
+    if (!blk->common_cfg || !blk->notify_base || !blk->isr || !blk->config) {
+        return -ENODEV;
+    }
+    return 0;
+}
+
+/**
+ * The rings fit in one page: descriptors at the start, the available ring
+ * at 512 and the used ring at 1024. Without indirect descriptors slot i
+ * owns descriptors 3i..3i+2 of the ring, with them the ring descriptor i
+ * points to the table of slot i once and for all.
+ */
+static int _virtio_blk_setup_queue(virtio_blk_t* blk)
+{
+    volatile virtio_pci_common_cfg_t* common_cfg = blk->common_cfg;
+    common_cfg->queue_select = 0;
+    uint16_t size = common_cfg->queue_size;
+    if (size < 3) {
+        return -ENODEV;
+    }
+    if (size > VIRTIO_BLK_QUEUE_SIZE) {
+        size = VIRTIO_BLK_QUEUE_SIZE;
+        common_cfg->queue_size = size;
+    }
+
+    uint32_t rings_paddr;
+    uint8_t* rings = _virtio_blk_alloc_dma(VMM_PAGE_SIZE, &rings_paddr);
+    blk->meta = _virtio_blk_alloc_dma(VMM_PAGE_SIZE, &blk->meta_paddr);
+    blk->bufs = _virtio_blk_alloc_dma(VIRTIO_BLK_QUEUE_SIZE * VIRTIO_BLK_SLOT_BUF_SIZE, &blk->bufs_paddr);
+    if (!rings || !blk->meta || !blk->bufs) {
+        return -ENOMEM;
+    }
+
+    blk->queue_size = size;
+    blk->last_used = 0;
+    blk->slots = blk->indirect ? size : size / 3;
+    blk->desc = (virtq_desc_t*)rings;
+    blk->avail = (virtq_avail_t*)(rings + 512);
+    blk->used = (virtq_used_t*)(rings + 1024);
+    blk->notify = (uint16_t*)(blk->notify_base + common_cfg->queue_notify_off * blk->notify_off_multiplier);
+
+    if (blk->indirect) {
+        for (int i = 0; i < blk->slots; i++) {
+            blk->desc[i].addr = blk->meta_paddr + i * VIRTIO_BLK_SLOT_META_SIZE;
+            blk->desc[i].len = 3 * sizeof(virtq_desc_t);
+            blk->desc[i].flags = VIRTQ_DESC_F_INDIRECT;
+            blk->desc[i].next = 0;
+        }
+    }
+
+    common_cfg->queue_desc_lo = rings_paddr;
+    common_cfg->queue_desc_hi = 0;
+    common_cfg->queue_driver_lo = rings_paddr + 512;
+    common_cfg->queue_driver_hi = 0;
+    common_cfg->queue_device_lo = rings_paddr + 1024;
+    common_cfg->queue_device_hi = 0;
+    common_cfg->queue_msix_vector = VIRTIO_MSI_NO_VECTOR;
+    common_cfg->queue_enable = 1;
+    return 0;
+}
+
+static inline volatile virtq_desc_t* _virtio_blk_slot_table(virtio_blk_t* blk, int slot)
+{
+    if (blk->indirect) {
+        return (virtq_desc_t*)(blk->meta + slot * VIRTIO_BLK_SLOT_META_SIZE);
+    }
+    return &blk->desc[slot * 3];
+}
+
+static inline uint8_t* _virtio_blk_slot_buf(virtio_blk_t* blk, int slot)
+{
+    return blk->bufs + slot * VIRTIO_BLK_SLOT_BUF_SIZE;
+}
+
+/**
+ * Marks the slots which the device has given back as done. Called with
+ * the lock taken, both from the interrupt and from waiters, so requests
+ * complete even while interrupts are off.
+ */
+static void _virtio_blk_reap_locked(virtio_blk_t* blk)
+{
+    while (blk->last_used != blk->used->idx) {
+        __sync_synchronize();
+        uint32_t id = blk->used->ring[blk->last_used % blk->queue_size].id;
+        int slot = blk->indirect ? id : id / 3;
+        if (slot < blk->slots && blk->slot_state[slot] == VIRTIO_BLK_SLOT_BUSY) {
+            blk->slot_state[slot] = VIRTIO_BLK_SLOT_DONE;
+        }
+        blk->last_used++;
+    }
+}
+
+static void virtio_blk_handler()
+{
+    for (int i = 0; i < MAX_DEVICES_COUNT; i++) {
+        if (!_virtio_blk_present[i]) {
+            continue;
+        }
+
+        virtio_blk_t* blk = &_virtio_blk_drives[i];
+        if (blk->msix || (*blk->isr & VIRTIO_ISR_QUEUE)) {
+            lock_acquire(&blk->lock);
+            _virtio_blk_reap_locked(blk);
+            lock_release(&blk->lock);
+        }
+    }
+}
+
+/**
+ * Takes a free slot. With wait set spins until one is given back, otherwise
+ * returns -1 if all of them are in flight.
+ */
+static int _virtio_blk_reserve_slot(virtio_blk_t* blk, bool wait)
+{
+    for (uint32_t spins = 0; spins < VIRTIO_BLK_SPIN_LIMIT; spins++) {
+        system_disable_interrupts();
+        lock_acquire(&blk->lock);
+        _virtio_blk_reap_locked(blk);
+        for (int slot = 0; slot < blk->slots; slot++) {
+            if (blk->slot_state[slot] == VIRTIO_BLK_SLOT_FREE) {
+                blk->slot_state[slot] = VIRTIO_BLK_SLOT_BUSY;
+                lock_release(&blk->lock);
+                system_enable_interrupts();
+                return slot;
+            }
+        }
+        lock_release(&blk->lock);
+        system_enable_interrupts();
+
+        if (!wait) {
+            return -1;
+        }
+        lock_relax();
+    }
+    return -1;
+}
+
+/**
+ * Fills the chain of the slot and puts it to the available ring. The device
+ * is told about it by _virtio_blk_kick(), so a batch of slots costs one
+ * notification.
+ */
+static void _virtio_blk_queue_slot(virtio_blk_t* blk, int slot, uint32_t type, uint32_t sector, uint32_t len)
+{
+    volatile virtq_desc_t* table = _virtio_blk_slot_table(blk, slot);
+    uint32_t table_paddr = blk->meta_paddr + slot * VIRTIO_BLK_SLOT_META_SIZE;
+    uint16_t first = blk->indirect ? 0 : slot * 3;
+
+    virtio_blk_req_hdr_t* hdr = (virtio_blk_req_hdr_t*)(blk->meta + slot * VIRTIO_BLK_SLOT_META_SIZE + 3 * sizeof(virtq_desc_t));
+    hdr->type = type;
+    hdr->reserved = 0;
+    hdr->sector = sector;
+    blk->meta[VIRTIO_BLK_STATUS_OFFSET + slot] = 0xff;
+
+    table[0].addr = table_paddr + 3 * sizeof(virtq_desc_t);
+    table[0].len = sizeof(virtio_blk_req_hdr_t);
+    table[0].flags = VIRTQ_DESC_F_NEXT;
+    table[0].next = first + 1;
+
+    volatile virtq_desc_t* status = &table[1];
+    if (len) {
+        table[1].addr = blk->bufs_paddr + slot * VIRTIO_BLK_SLOT_BUF_SIZE;
+        table[1].len = len;
+        table[1].flags = VIRTQ_DESC_F_NEXT | (type == VIRTIO_BLK_T_IN ? VIRTQ_DESC_F_WRITE : 0);
+        table[1].next = first + 2;
+        status = &table[2];
+    }
+    status->addr = blk->meta_paddr + VIRTIO_BLK_STATUS_OFFSET + slot;
+    status->len = 1;
+    status->flags = VIRTQ_DESC_F_WRITE;
+    status->next = 0;
+
+    system_disable_interrupts();
+    lock_acquire(&blk->lock);
+    blk->avail->ring[blk->avail->idx % blk->queue_size] = blk->indirect ? slot : slot * 3;
+    __sync_synchronize();
+    blk->avail->idx++;
+    lock_release(&blk->lock);
+    system_enable_interrupts();
+}
+
+static inline void _virtio_blk_kick(virtio_blk_t* blk)
+{
+    __sync_synchronize();
+    *blk->notify = 0;
+}
+
+/**
+ * Waits for the slot and frees it. While interrupts are on the cpu sleeps
+ * until the next one instead of spinning, sti delays them by an instruction
+ * so the interrupt of the slot can't slip in before hlt.
+ */
+static int _virtio_blk_complete_slot(virtio_blk_t* blk, int slot)
+{
+    for (uint32_t spins = 0; spins < VIRTIO_BLK_SPIN_LIMIT; spins++) {
+        system_disable_interrupts();
+        lock_acquire(&blk->lock);
+        _virtio_blk_reap_locked(blk);
+        if (blk->slot_state[slot] == VIRTIO_BLK_SLOT_DONE) {
+            int status = blk->meta[VIRTIO_BLK_STATUS_OFFSET + slot];
+            blk->slot_state[slot] = VIRTIO_BLK_SLOT_FREE;
+            lock_release(&blk->lock);
+            system_enable_interrupts();
+            return status == VIRTIO_BLK_S_OK ? 0 : -EIO;
+        }
+        lock_release(&blk->lock);
+
+        if (blk->irq && THIS_CPU->int_depth_counter == 1) {
+            system_enable_interrupts_only_counter();
+            asm volatile("sti\n"
+                         "hlt");
+        } else {
+            system_enable_interrupts();
+            lock_relax();
+        }
+    }
+
+    // The device still owns the slot, so it is never given out again.
+    log_warn("virtio-blk: request timed out");
+    return -EIO;
+}
+
+static void _virtio_blk_copy(storage_request_t* req, int* seg_index, uint32_t* seg_offset, uint8_t* buf, uint32_t len, bool to_buf)
+{
+    while (len) {
+        storage_segment_t* seg = &req->segments[*seg_index];
+        uint32_t part = min(len, seg->len - *seg_offset);
+        if (to_buf) {
+            memcpy(buf, seg->data + *seg_offset, part);
+        } else {
+            memcpy(seg->data + *seg_offset, buf, part);
+        }
+        buf += part;
+        len -= part;
+        *seg_offset += part;
+        if (*seg_offset == seg->len) {
+            (*seg_index)++;
+            *seg_offset = 0;
+        }
+    }
+}
+
+/**
+ * Cuts the request into chunks of one slot each and keeps as many of them
+ * in flight as there are free slots. Chunks complete in the order they were
+ * queued, which is the order their data has in the segments.
+ */
+static int _virtio_blk_transfer(virtio_blk_t* blk, storage_request_t* req, bool write)
+{
+    int inflight_slots[VIRTIO_BLK_QUEUE_SIZE];
+    uint32_t inflight_len[VIRTIO_BLK_QUEUE_SIZE];
+    int head = 0, inflight = 0;
+    int seg_index = 0;
+    uint32_t seg_offset = 0;
+    uint32_t lba = req->lba;
+    uint32_t left = req->count;
+    int err = 0;
+
+    if (write && (blk->features & VIRTIO_BLK_F_RO)) {
+        return -EROFS;
+    }
+    if (req->lba + req->count > blk->capacity) {
+        return -EINVAL;
+    }
+
+    while (left || inflight) {
+        bool queued = false;
+        while (left && !err && inflight < blk->slots) {
+            int slot = _virtio_blk_reserve_slot(blk, inflight == 0);
+            if (slot < 0) {
+                if (inflight == 0) {
+                    err = -EIO;
+                }
+                break;
+            }
+
+            uint32_t count = min(left, blk->max_chunk_sectors);
+            uint32_t len = count * STORAGE_SECTOR_SIZE;
+            if (write) {
+                _virtio_blk_copy(req, &seg_index, &seg_offset, _virtio_blk_slot_buf(blk, slot), len, true);
+            }
+            _virtio_blk_queue_slot(blk, slot, write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, lba, len);
+
+            int pos = (head + inflight) % VIRTIO_BLK_QUEUE_SIZE;
+            inflight_slots[pos] = slot;
+            inflight_len[pos] = len;
+            inflight++;
+            lba += count;
+            left -= count;
+            queued = true;
+        }
+        if (queued) {
+            _virtio_blk_kick(blk);
+        }
+        if (err) {
+            left = 0;
+        }
+        if (!inflight) {
+            break;
+        }
+
+        int slot = inflight_slots[head];
+        int status = _virtio_blk_complete_slot(blk, slot);
+        if (!write && !status && !err) {
+            _virtio_blk_copy(req, &seg_index, &seg_offset, _virtio_blk_slot_buf(blk, slot), inflight_len[head], false);
+        }
+        if (status && !err) {
+            err = status;
+        }
+        head = (head + 1) % VIRTIO_BLK_QUEUE_SIZE;
+        inflight--;
+    }
+    return err;
+}
+
+static inline driver_desc_t _virtio_blk_driver_info()
+{
+    driver_desc_t virtio_blk_desc = { 0 };
+    virtio_blk_desc.type = DRIVER_STORAGE_DEVICE;
+    virtio_blk_desc.auto_start = false;
+    virtio_blk_desc.is_device_driver = true;
+    virtio_blk_desc.is_device_needed = false;
+    virtio_blk_desc.is_driver_needed = false;
+    virtio_blk_desc.functions[DRIVER_NOTIFICATION] = 0;
+    virtio_blk_desc.functions[DRIVER_STORAGE_ADD_DEVICE] = virtio_blk_add_device;
+    virtio_blk_desc.functions[DRIVER_STORAGE_READ] = virtio_blk_read;
+    virtio_blk_desc.functions[DRIVER_STORAGE_WRITE] = virtio_blk_write;
+    virtio_blk_desc.functions[DRIVER_STORAGE_FLUSH] = virtio_blk_flush;
+    virtio_blk_desc.functions[DRIVER_STORAGE_CAPACITY] = virtio_blk_get_capacity;
+    virtio_blk_desc.functions[DRIVER_STORAGE_READ_SECTORS] = virtio_blk_read_sectors;
+    virtio_blk_desc.functions[DRIVER_STORAGE_WRITE_SECTORS] = virtio_blk_write_sectors;
+    virtio_blk_desc.pci_serve_class = 0x01;
+    virtio_blk_desc.pci_serve_subclass = 0x00;
+    virtio_blk_desc.pci_serve_vendor_id = VIRTIO_PCI_VENDOR_ID;
+    virtio_blk_desc.pci_serve_device_id = VIRTIO_BLK_PCI_DEVICE_ID;
+    return virtio_blk_desc;
+}
+
+void virtio_blk_install()
+{
+    driver_install(_virtio_blk_driver_info(), "vblk86");
+}
+
+static int _virtio_blk_start(virtio_blk_t* blk, device_t* dev)
+{
+    uint8_t bus = dev->device_desc.bus;
+    uint8_t device = dev->device_desc.device;
+    uint8_t function = dev->device_desc.function;
+
+    // Memory space and bus mastering, the device moves the data itself.
+    pci_write(bus, device, function, 0x04, pci_read(bus, device, function, 0x04) | 0x6);
+
+    int err = _virtio_blk_find_caps(blk, dev);
+    if (err) {
+        return err;
+    }
+
+    volatile virtio_pci_common_cfg_t* common_cfg = blk->common_cfg;
+    common_cfg->device_status = 0;
+    common_cfg->device_status |= VIRTIO_STATUS_ACKNOWLEDGE;
+    common_cfg->device_status |= VIRTIO_STATUS_DRIVER;
+
+    common_cfg->device_feature_select = 1;
+    if (!(common_cfg->device_feature & VIRTIO_F_VERSION_1_HI)) {
+        return -ENODEV;
+    }
+    common_cfg->device_feature_select = 0;
+    blk->features = common_cfg->device_feature & (VIRTIO_F_INDIRECT_DESC | VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_RO | VIRTIO_BLK_F_FLUSH);
+    blk->indirect = (blk->features & VIRTIO_F_INDIRECT_DESC) != 0;
+    common_cfg->driver_feature_select = 0;
+    common_cfg->driver_feature = blk->features;
+    common_cfg->driver_feature_select = 1;
+    common_cfg->driver_feature = VIRTIO_F_VERSION_1_HI;
+    common_cfg->device_status |= VIRTIO_STATUS_FEATURES_OK;
+    if (!(common_cfg->device_status & VIRTIO_STATUS_FEATURES_OK)) {
+        return -ENODEV;
+    }
+    common_cfg->msix_config = VIRTIO_MSI_NO_VECTOR;
+
+    if ((err = _virtio_blk_setup_queue(blk))) {
+        return err;
+    }
+
+    blk->capacity = (blk->config->capacity >> 32) ? 0xffffffff : (uint32_t)blk->config->capacity;
+    blk->max_chunk_sectors = VIRTIO_BLK_SLOT_BUF_SIZE / STORAGE_SECTOR_SIZE;
+    if ((blk->features & VIRTIO_BLK_F_SIZE_MAX) && blk->config->size_max >= STORAGE_SECTOR_SIZE) {
+        blk->max_chunk_sectors = min(blk->max_chunk_sectors, blk->config->size_max / STORAGE_SECTOR_SIZE);
+    }
+
+    // A device with its own vector doesn't share a legacy line. Lines above
+    // 15 don't go through the pic, without an irq the waiters poll.
+    int irq_kind = pci_msi_setup(dev, virtio_blk_handler);
+    if (irq_kind == PCI_IRQ_MSIX) {
+        common_cfg->queue_select = 0;
+        common_cfg->queue_msix_vector = 0;
+        if (common_cfg->queue_msix_vector == 0) {
+            blk->irq = pci_device_of(dev)->msi_vector;
+            blk->msix = true;
+        }
+    } else if (irq_kind == PCI_IRQ_MSI) {
+        blk->irq = pci_device_of(dev)->msi_vector;
+    } else {
+        uint8_t line = dev->device_desc.interrupt;
+        if (line < 16) {
+            blk->irq = IRQ0 + line;
+            set_irq_handler(blk->irq, virtio_blk_handler);
+        }
+    }
+
+    common_cfg->device_status |= VIRTIO_STATUS_DRIVER_OK;
+    return 0;
+}
+
+void virtio_blk_add_device(device_t* dev)
+{
+    uint16_t device_id = dev->device_desc.device_id;
+    if (device_id != VIRTIO_BLK_PCI_DEVICE_ID && device_id != VIRTIO_BLK_TRANSITIONAL_PCI_DEVICE_ID) {
+        return;
+    }
+
+    virtio_blk_t* blk = &_virtio_blk_drives[dev->id];
+    memset(blk, 0, sizeof(virtio_blk_t));
+    lock_init(&blk->lock);
+
+    int err = _virtio_blk_start(blk, dev);
+    if (err) {
+        log_warn("virtio-blk: can't start the device (%d)", err);
+        return;
+    }
+    _virtio_blk_present[dev->id] = true;
+    kprintf("Device added to virtio-blk driver\n");
+}
+
+static int virtio_blk_read_sectors(device_t* device, storage_request_t* req)
+{
+    return _virtio_blk_transfer(&_virtio_blk_drives[device->id], req, false);
+}
+
+static int virtio_blk_write_sectors(device_t* device, storage_request_t* req)
+{
+    return _virtio_blk_transfer(&_virtio_blk_drives[device->id], req, true);
+}
+
+static int virtio_blk_read(device_t* device, uint32_t sector, uint8_t* read_data)
+{
+    storage_segment_t seg = { .data = read_data, .len = STORAGE_SECTOR_SIZE };
+    storage_request_t req = { .lba = sector, .count = 1, .segments_count = 1, .segments = &seg };
+    return _virtio_blk_transfer(&_virtio_blk_drives[device->id], &req, false);
+}
+
+static int virtio_blk_write(device_t* device, uint32_t sector, uint8_t* data, uint32_t size)
+{
+    // A short write is padded with zeroes to the whole sector, like ata does it.
+    uint8_t sector_data[STORAGE_SECTOR_SIZE];
+    if (size < STORAGE_SECTOR_SIZE) {
+        memset(sector_data, 0, STORAGE_SECTOR_SIZE);
+        memcpy(sector_data, data, size);
+        data = sector_data;
+    }
+
+    storage_segment_t seg = { .data = data, .len = STORAGE_SECTOR_SIZE };
+    storage_request_t req = { .lba = sector, .count = 1, .segments_count = 1, .segments = &seg };
+    return _virtio_blk_transfer(&_virtio_blk_drives[device->id], &req, true);
+}
+
+static int virtio_blk_flush(device_t* device)
+{
+    virtio_blk_t* blk = &_virtio_blk_drives[device->id];
+    if (!(blk->features & VIRTIO_BLK_F_FLUSH)) {
+        return 0;
+    }
+
+    int slot = _virtio_blk_reserve_slot(blk, true);
+    if (slot < 0) {
+        return -EIO;
+    }
+    _virtio_blk_queue_slot(blk, slot, VIRTIO_BLK_T_FLUSH, 0, 0);
+    _virtio_blk_kick(blk);
+    return _virtio_blk_complete_slot(blk, slot);
+}
+
+static uint32_t virtio_blk_get_capacity(device_t* device)
+{
+    return _virtio_blk_drives[device->id].capacity;
+}
@@ -0,0 +1,479 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/driver_manager.h>
+#include <drivers/x86/pci.h>
+#include <drivers/x86/virtio_gpu.h>
+#include <fs/devfs/devfs.h>
+#include <fs/vfs.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/log.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <tasking/proc.h>
+#include <tasking/tasking.h>
+
+#define VIRTIO_GPU_SCREEN_RESOURCE 1
+#define VIRTIO_GPU_CURSOR_RESOURCE 2
+#define VIRTIO_GPU_CURSOR_BUFFER_SIZE (BGA_CURSOR_SIZE * BGA_CURSOR_SIZE * 4)
+#define VIRTIO_GPU_SPIN_LIMIT (50000000)
+
+/**
+ * The screen is a single resource which is backed by the buffer userland
+ * draws into. Nothing is flipped: the damaged rects are transferred to the
+ * host and flushed to the scanout, so only changed pixels leave the guest.
+ * The cursor is a resource of its own, shown on the cursor plane.
+ */
+static volatile virtio_pci_common_cfg_t* common_cfg;
+static uint8_t* notify_base;
+static uint32_t notify_off_multiplier;
+static virtio_gpu_queue_t control_queue;
+static virtio_gpu_queue_t cursor_queue;
+static lock_t vgpu_lock;
+
+static bool vgpu_ready;
+static uint32_t vgpu_screen_width, vgpu_screen_height, vgpu_screen_buffer_size;
+static uint32_t vgpu_buf_paddr;
+static uint32_t* vgpu_cursor;
+static uint32_t vgpu_cursor_paddr;
+static uint32_t vgpu_cursor_hot_x, vgpu_cursor_hot_y;
+
+static void* _virtio_gpu_map(uint32_t paddr, uint32_t len)
+{
+    uint32_t page_offset = paddr % VMM_PAGE_SIZE;
+    uint32_t pages = (page_offset + len + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    zone_t zone = zoner_new_zone(pages * VMM_PAGE_SIZE);
+    if (!zone.start) {
+        return NULL;
+    }
+    vmm_map_pages(zone.start, paddr - page_offset, pages, PAGE_READABLE | PAGE_WRITABLE | PAGE_NOT_CACHEABLE);
+    return zone.ptr + page_offset;
+}
+
+static void* _virtio_gpu_alloc_dma(uint32_t len, uint32_t* paddr)
+{
+    *paddr = (uint32_t)pmm_alloc_aligned(len, VMM_PAGE_SIZE);
+    if (!*paddr) {
+        return NULL;
+    }
+
+    zone_t zone = zoner_new_zone(len);
+    vmm_map_pages(zone.start, *paddr, len / VMM_PAGE_SIZE, PAGE_READABLE | PAGE_WRITABLE);
+    memset(zone.ptr, 0, len);
+    return zone.ptr;
+}
+
+static uint32_t _virtio_gpu_bar_paddr(device_t* dev, int bar_id)
+{
+    uint32_t bar = pci_read_bar(dev, bar_id);
+    if (bar & 0x1) {
+        return 0;
+    }
+
+    // A 64bit bar placed above 4GB can't be reached.
+    if (((bar >> 1) & 0x3) == 0x2 && pci_read_bar(dev, bar_id + 1)) {
+        return 0;
+    }
+    return bar & 0xfffffff0;
+}
+
+static int _virtio_gpu_find_caps(device_t* dev)
+{
+    uint8_t bus = dev->device_desc.bus;
+    uint8_t device = dev->device_desc.device;
+    uint8_t function = dev->device_desc.function;
+
+    uint8_t cap = pci_read(bus, device, function, 0x34) & 0xfc;
+    while (cap) {
+        uint8_t vendor = pci_read(bus, device, function, cap) & 0xff;
+        uint8_t cfg_type = pci_read(bus, device, function, cap + 3) & 0xff;
+        uint8_t bar = pci_read(bus, device, function, cap + 4) & 0xff;
+        uint32_t offset = pci_read(bus, device, function, cap + 8);
+        uint32_t length = pci_read(bus, device, function, cap + 12);
+
+        if (vendor == VIRTIO_PCI_CAP_VENDOR && bar < 6) {
+            uint32_t bar_paddr = _virtio_gpu_bar_paddr(dev, bar);
+            if (bar_paddr && cfg_type == VIRTIO_PCI_CAP_COMMON_CFG && !common_cfg) {
+                common_cfg = _virtio_gpu_map(bar_paddr + offset, length);
+            } else if (bar_paddr && cfg_type == VIRTIO_PCI_CAP_NOTIFY_CFG && !notify_base) {
+                notify_off_multiplier = pci_read(bus, device, function, cap + 16);
+                notify_base = _virtio_gpu_map(bar_paddr + offset, length);
+            }
+        }
+        cap = pci_read(bus, device, function, cap + 1) & 0xfc;
+    }
+
+    if (!common_cfg || !notify_base) {
+        return -ENODEV;
+    }
+    return 0;
+}
+
+/**
+ * The rings of a queue fit in one page: descriptors at the start, the
+ * available ring at 512 and the used ring at 1024.
+ */
+static int _virtio_gpu_setup_queue(virtio_gpu_queue_t* queue, uint16_t index)
+{
+    common_cfg->queue_select = index;
+    uint16_t size = common_cfg->queue_size;
+    if (!size) {
+        return -ENODEV;
+    }
+    if (size > VIRTIO_GPU_QUEUE_SIZE) {
+        size = VIRTIO_GPU_QUEUE_SIZE;
+        common_cfg->queue_size = size;
+    }
+
+    uint32_t rings_paddr;
+    uint8_t* rings = _virtio_gpu_alloc_dma(VMM_PAGE_SIZE, &rings_paddr);
+    queue->buf = _virtio_gpu_alloc_dma(VMM_PAGE_SIZE, &queue->buf_paddr);
+    if (!rings || !queue->buf) {
+        return -ENOMEM;
+    }
+
+    queue->index = index;
+    queue->size = size;
+    queue->last_used = 0;
+    queue->desc = (virtq_desc_t*)rings;
+    queue->avail = (virtq_avail_t*)(rings + 512);
+    queue->used = (virtq_used_t*)(rings + 1024);
+    queue->notify = (uint16_t*)(notify_base + common_cfg->queue_notify_off * notify_off_multiplier);
+
+    common_cfg->queue_desc_lo = rings_paddr;
+    common_cfg->queue_desc_hi = 0;
+    common_cfg->queue_driver_lo = rings_paddr + 512;
+    common_cfg->queue_driver_hi = 0;
+    common_cfg->queue_device_lo = rings_paddr + 1024;
+    common_cfg->queue_device_hi = 0;
+    common_cfg->queue_msix_vector = 0xffff;
+    common_cfg->queue_enable = 1;
+    return 0;
+}
+
+/**
+ * Sends the command which is in the buffer of the queue and spins until the
+ * device is done with it. The response, if any, is put at
+ * VIRTIO_GPU_RESP_OFFSET of the buffer.
+ */
+static int _virtio_gpu_submit(virtio_gpu_queue_t* queue, uint32_t len, bool needs_response)
+{
+    queue->desc[0].addr = queue->buf_paddr;
+    queue->desc[0].len = len;
+    queue->desc[0].flags = needs_response ? VIRTQ_DESC_F_NEXT : 0;
+    queue->desc[0].next = 1;
+    if (needs_response) {
+        queue->desc[1].addr = queue->buf_paddr + VIRTIO_GPU_RESP_OFFSET;
+        queue->desc[1].len = sizeof(virtio_gpu_ctrl_hdr_t);
+        queue->desc[1].flags = VIRTQ_DESC_F_WRITE;
+        queue->desc[1].next = 0;
+    }
+
+    queue->avail->ring[queue->avail->idx % queue->size] = 0;
+    __sync_synchronize();
+    queue->avail->idx++;
+    __sync_synchronize();
+    *queue->notify = queue->index;
+
+    uint32_t spins = 0;
+    while (queue->used->idx == queue->last_used) {
+        if (++spins == VIRTIO_GPU_SPIN_LIMIT) {
+            return -EIO;
+        }
+    }
+    queue->last_used = queue->used->idx;
+
+    if (needs_response) {
+        virtio_gpu_ctrl_hdr_t* resp = (virtio_gpu_ctrl_hdr_t*)(queue->buf + VIRTIO_GPU_RESP_OFFSET);
+        if (resp->type != VIRTIO_GPU_RESP_OK_NODATA) {
+            return -EIO;
+        }
+    }
+    return 0;
+}
+
+static inline void* _virtio_gpu_command(virtio_gpu_queue_t* queue, uint32_t type, uint32_t len)
+{
+    memset(queue->buf, 0, len);
+    ((virtio_gpu_ctrl_hdr_t*)queue->buf)->type = type;
+    return queue->buf;
+}
+
+static int _virtio_gpu_create_resource(uint32_t resource_id, uint32_t format, uint32_t width, uint32_t height, uint32_t paddr, uint32_t len)
+{
+    struct virtio_gpu_resource_create_2d* create = _virtio_gpu_command(&control_queue, VIRTIO_GPU_CMD_RESOURCE_CREATE_2D, sizeof(*create));
+    create->resource_id = resource_id;
+    create->format = format;
+    create->width = width;
+    create->height = height;
+    int err = _virtio_gpu_submit(&control_queue, sizeof(*create), true);
+    if (err) {
+        return err;
+    }
+
+    struct virtio_gpu_resource_attach_backing* attach = _virtio_gpu_command(&control_queue, VIRTIO_GPU_CMD_RESOURCE_ATTACH_BACKING, sizeof(*attach));
+    attach->resource_id = resource_id;
+    attach->nr_entries = 1;
+    attach->addr = paddr;
+    attach->length = len;
+    return _virtio_gpu_submit(&control_queue, sizeof(*attach), true);
+}
+
+static int _virtio_gpu_transfer(uint32_t resource_id, virtio_gpu_rect_t* rect, uint32_t line_size)
+{
+    struct virtio_gpu_transfer_to_host_2d* transfer = _virtio_gpu_command(&control_queue, VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D, sizeof(*transfer));
+    transfer->r = *rect;
+    transfer->offset = rect->y * line_size + rect->x * 4;
+    transfer->resource_id = resource_id;
+    return _virtio_gpu_submit(&control_queue, sizeof(*transfer), true);
+}
+
+static int _virtio_gpu_flush_rects(struct bga_flush_rects* flush)
+{
+    for (uint32_t i = 0; i < flush->count; i++) {
+        virtio_gpu_rect_t rect;
+        rect.x = min(flush->rects[i].x, vgpu_screen_width);
+        rect.y = min(flush->rects[i].y, vgpu_screen_height);
+        rect.width = min(flush->rects[i].width, vgpu_screen_width - rect.x);
+        rect.height = min(flush->rects[i].height, vgpu_screen_height - rect.y);
+        if (!rect.width || !rect.height) {
+            continue;
+        }
+
+        int err = _virtio_gpu_transfer(VIRTIO_GPU_SCREEN_RESOURCE, &rect, vgpu_screen_width * 4);
+        if (err) {
+            return err;
+        }
+
+        struct virtio_gpu_resource_flush* res_flush = _virtio_gpu_command(&control_queue, VIRTIO_GPU_CMD_RESOURCE_FLUSH, sizeof(*res_flush));
+        res_flush->r = rect;
+        res_flush->resource_id = VIRTIO_GPU_SCREEN_RESOURCE;
+        err = _virtio_gpu_submit(&control_queue, sizeof(*res_flush), true);
+        if (err) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+static int _virtio_gpu_set_cursor(struct bga_cursor* cursor)
+{
+    memcpy(vgpu_cursor, cursor->pixels, VIRTIO_GPU_CURSOR_BUFFER_SIZE);
+    vgpu_cursor_hot_x = cursor->hot_x;
+    vgpu_cursor_hot_y = cursor->hot_y;
+
+    virtio_gpu_rect_t rect = { 0, 0, BGA_CURSOR_SIZE, BGA_CURSOR_SIZE };
+    int err = _virtio_gpu_transfer(VIRTIO_GPU_CURSOR_RESOURCE, &rect, BGA_CURSOR_SIZE * 4);
+    if (err) {
+        return err;
+    }
+
+    struct virtio_gpu_update_cursor* update = _virtio_gpu_command(&cursor_queue, VIRTIO_GPU_CMD_UPDATE_CURSOR, sizeof(*update));
+    update->resource_id = VIRTIO_GPU_CURSOR_RESOURCE;
+    update->hot_x = vgpu_cursor_hot_x;
+    update->hot_y = vgpu_cursor_hot_y;
+    return _virtio_gpu_submit(&cursor_queue, sizeof(*update), false);
+}
+
+static int _virtio_gpu_move_cursor(uint32_t pos)
+{
+    struct virtio_gpu_update_cursor* move = _virtio_gpu_command(&cursor_queue, VIRTIO_GPU_CMD_MOVE_CURSOR, sizeof(*move));
+    move->x = pos >> 16;
+    move->y = pos & 0xffff;
+    move->resource_id = VIRTIO_GPU_CURSOR_RESOURCE;
+    return _virtio_gpu_submit(&cursor_queue, sizeof(*move), false);
+}
+
+static int _virtio_gpu_ioctl(dentry_t* dentry, uint32_t cmd, uint32_t arg)
+{
+    int res = 0;
+    lock_acquire(&vgpu_lock);
+    switch (cmd) {
+    case BGA_GET_HEIGHT:
+        res = vgpu_screen_height;
+        break;
+    case BGA_GET_WIDTH:
+        res = vgpu_screen_width;
+        break;
+    case BGA_GET_DEPTH:
+        res = 4;
+        break;
+    case BGA_SWAP_BUFFERS:
+        res = 0;
+        break;
+    case BGA_GET_NEXT_VBLANK:
+        // The host shows a flush when it gets it, there is no vblank to wait for.
+        res = 0;
+        break;
+    case BGA_GET_ACCEL_OPS:
+        res = BGA_ACCEL_FLUSH | BGA_ACCEL_CURSOR;
+        break;
+    case BGA_FLUSH_RECTS:
+        res = _virtio_gpu_flush_rects((struct bga_flush_rects*)arg);
+        break;
+    case BGA_SET_CURSOR:
+        res = _virtio_gpu_set_cursor((struct bga_cursor*)arg);
+        break;
+    case BGA_MOVE_CURSOR:
+        res = _virtio_gpu_move_cursor(arg);
+        break;
+    default:
+        res = -EINVAL;
+    }
+    lock_release(&vgpu_lock);
+    return res;
+}
+
+static proc_zone_t* _virtio_gpu_mmap(dentry_t* dentry, mmap_params_t* params)
+{
+    bool map_shared = ((params->flags & MAP_SHARED) > 0);
+
+    if (!map_shared) {
+        return 0;
+    }
+
+    proc_zone_t* zone = proc_new_random_zone_aligned(RUNNING_THREAD->process, vgpu_screen_buffer_size, VMM_USER_LARGE_PAGE_SIZE);
+    if (!zone) {
+        return 0;
+    }
+
+    // The buffer is guest memory which the host reads on transfers, so it
+    // stays cacheable.
+    zone->flags |= ZONE_WRITABLE | ZONE_READABLE;
+    zone->type |= ZONE_TYPE_DEVICE;
+    zone->file = dentry_duplicate(dentry);
+
+    vmm_map_pages(zone->start, vgpu_buf_paddr, zone->len / VMM_PAGE_SIZE, zone->flags);
+
+    return zone;
+}
+
+static void virtio_gpu_recieve_notification(uint32_t msg, uint32_t param)
+{
+    if (msg == DM_NOTIFICATION_DEVFS_READY && vgpu_ready) {
+        dentry_t* mp;
+        if (vfs_resolve_path("/dev", &mp) < 0) {
+            kpanic("Can't init virtio-gpu in /dev");
+        }
+
+        file_ops_t fops = { 0 };
+        fops.ioctl = _virtio_gpu_ioctl;
+        fops.mmap = _virtio_gpu_mmap;
+        devfs_inode_t* res = devfs_register(mp, MKDEV(10, 156), "bga", 3, 0, &fops);
+
+        dentry_put(mp);
+    }
+}
+
+static inline driver_desc_t _virtio_gpu_driver_info()
+{
+    driver_desc_t virtio_gpu_desc = { 0 };
+    virtio_gpu_desc.type = DRIVER_VIDEO_DEVICE;
+    virtio_gpu_desc.auto_start = false;
+    virtio_gpu_desc.is_device_driver = true;
+    virtio_gpu_desc.is_device_needed = false;
+    virtio_gpu_desc.is_driver_needed = false;
+    virtio_gpu_desc.functions[DRIVER_NOTIFICATION] = virtio_gpu_recieve_notification;
+    virtio_gpu_desc.functions[DRIVER_VIDEO_INIT] = virtio_gpu_init;
+    virtio_gpu_desc.pci_serve_class = 0x03;
+    virtio_gpu_desc.pci_serve_subclass = 0x80;
+    virtio_gpu_desc.pci_serve_vendor_id = VIRTIO_PCI_VENDOR_ID;
+    virtio_gpu_desc.pci_serve_device_id = VIRTIO_GPU_PCI_DEVICE_ID;
+    return virtio_gpu_desc;
+}
+
+void virtio_gpu_install()
+{
+    driver_install(_virtio_gpu_driver_info(), "vgpu86");
+}
+
+static int _virtio_gpu_start(device_t* dev)
+{
+    uint8_t bus = dev->device_desc.bus;
+    uint8_t device = dev->device_desc.device;
+    uint8_t function = dev->device_desc.function;
+
+    // Memory space and bus mastering, the device reads the buffers itself.
+    pci_write(bus, device, function, 0x04, pci_read(bus, device, function, 0x04) | 0x6);
+
+    int err = _virtio_gpu_find_caps(dev);
+    if (err) {
+        return err;
+    }
+
+    common_cfg->device_status = 0;
+    common_cfg->device_status |= VIRTIO_STATUS_ACKNOWLEDGE;
+    common_cfg->device_status |= VIRTIO_STATUS_DRIVER;
+
+    common_cfg->device_feature_select = 1;
+    if (!(common_cfg->device_feature & VIRTIO_F_VERSION_1_HI)) {
+        return -ENODEV;
+    }
+    common_cfg->driver_feature_select = 0;
+    common_cfg->driver_feature = 0;
+    common_cfg->driver_feature_select = 1;
+    common_cfg->driver_feature = VIRTIO_F_VERSION_1_HI;
+    common_cfg->device_status |= VIRTIO_STATUS_FEATURES_OK;
+    if (!(common_cfg->device_status & VIRTIO_STATUS_FEATURES_OK)) {
+        return -ENODEV;
+    }
+
+    if ((err = _virtio_gpu_setup_queue(&control_queue, 0))) {
+        return err;
+    }
+    if ((err = _virtio_gpu_setup_queue(&cursor_queue, 1))) {
+        return err;
+    }
+    common_cfg->device_status |= VIRTIO_STATUS_DRIVER_OK;
+
+    vgpu_buf_paddr = (uint32_t)pmm_alloc_aligned(vgpu_screen_buffer_size, VMM_USER_LARGE_PAGE_SIZE);
+    if (!vgpu_buf_paddr) {
+        vgpu_buf_paddr = (uint32_t)pmm_alloc(vgpu_screen_buffer_size);
+    }
+    vgpu_cursor = _virtio_gpu_alloc_dma(VIRTIO_GPU_CURSOR_BUFFER_SIZE, &vgpu_cursor_paddr);
+    if (!vgpu_buf_paddr || !vgpu_cursor) {
+        return -ENOMEM;
+    }
+
+    err = _virtio_gpu_create_resource(VIRTIO_GPU_SCREEN_RESOURCE, VIRTIO_GPU_FORMAT_B8G8R8X8_UNORM, vgpu_screen_width, vgpu_screen_height, vgpu_buf_paddr, vgpu_screen_buffer_size);
+    if (err) {
+        return err;
+    }
+    err = _virtio_gpu_create_resource(VIRTIO_GPU_CURSOR_RESOURCE, VIRTIO_GPU_FORMAT_B8G8R8A8_UNORM, BGA_CURSOR_SIZE, BGA_CURSOR_SIZE, vgpu_cursor_paddr, VIRTIO_GPU_CURSOR_BUFFER_SIZE);
+    if (err) {
+        return err;
+    }
+
+    struct virtio_gpu_set_scanout* scanout = _virtio_gpu_command(&control_queue, VIRTIO_GPU_CMD_SET_SCANOUT, sizeof(*scanout));
+    scanout->r.width = vgpu_screen_width;
+    scanout->r.height = vgpu_screen_height;
+    scanout->scanout_id = 0;
+    scanout->resource_id = VIRTIO_GPU_SCREEN_RESOURCE;
+    return _virtio_gpu_submit(&control_queue, sizeof(*scanout), true);
+}
+
+void virtio_gpu_init(device_t* dev)
+{
+    lock_init(&vgpu_lock);
+#ifdef TARGET_DESKTOP
+    vgpu_screen_width = 1024;
+    vgpu_screen_height = 768;
+#elif TARGET_MOBILE
+    vgpu_screen_width = 320;
+    vgpu_screen_height = 568;
+#endif
+    vgpu_screen_buffer_size = vgpu_screen_width * 4 * vgpu_screen_height;
+
+    int err = _virtio_gpu_start(dev);
+    if (err) {
+        log_warn("virtio-gpu: can't start the device (%d)", err);
+        return;
+    }
+    vgpu_ready = true;
+}
@@ -0,0 +1,488 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <fs/bcache.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <syscalls/handlers.h>
+#include <tasking/workqueue.h>
+
+struct bcache_block {
+    device_t* dev;
+    uint32_t index;
+    uint8_t* data;
+    uint32_t paddr;
+    struct bcache_block* lru_prev;
+    struct bcache_block* lru_next;
+    struct bcache_block* hash_next; /* Also links blocks without a frame. */
+    bool dirty;
+    storage_segment_t io_seg;
+    storage_request_t io_req;
+};
+typedef struct bcache_block bcache_block_t;
+
+static lock_t _bcache_lock;
+static zone_t _bcache_zone;
+static bcache_block_t* _bcache_blocks;
+static bcache_block_t* _bcache_hash[BCACHE_HASH_SIZE];
+static bcache_block_t* _bcache_unused;
+static bcache_block_t* _bcache_lru_head; /* Most recently used. */
+static bcache_block_t* _bcache_lru_tail; /* Least recently used. */
+static uint32_t _bcache_dirty_count;
+
+/**
+ * LIST FUNCTIONS
+ */
+
+static inline uint32_t _bcache_hash_of(device_t* dev, uint32_t index)
+{
+    return (dev->id * 31 + index) % BCACHE_HASH_SIZE;
+}
+
+static inline void _bcache_lru_remove(bcache_block_t* block)
+{
+    if (block->lru_prev) {
+        block->lru_prev->lru_next = block->lru_next;
+    } else {
+        _bcache_lru_head = block->lru_next;
+    }
+    if (block->lru_next) {
+        block->lru_next->lru_prev = block->lru_prev;
+    } else {
+        _bcache_lru_tail = block->lru_prev;
+    }
+    block->lru_prev = NULL;
+    block->lru_next = NULL;
+}
+
+static inline void _bcache_lru_push_front(bcache_block_t* block)
+{
+    block->lru_prev = NULL;
+    block->lru_next = _bcache_lru_head;
+    if (_bcache_lru_head) {
+        _bcache_lru_head->lru_prev = block;
+    }
+    _bcache_lru_head = block;
+    if (!_bcache_lru_tail) {
+        _bcache_lru_tail = block;
+    }
+}
+
+static inline void _bcache_hash_remove(bcache_block_t* block)
+{
+    bcache_block_t** it = &_bcache_hash[_bcache_hash_of(block->dev, block->index)];
+    while (*it) {
+        if (*it == block) {
+            *it = block->hash_next;
+            break;
+        }
+        it = &(*it)->hash_next;
+    }
+    block->hash_next = NULL;
+}
+
+static inline void _bcache_hash_add(bcache_block_t* block)
+{
+    uint32_t hash = _bcache_hash_of(block->dev, block->index);
+    block->hash_next = _bcache_hash[hash];
+    _bcache_hash[hash] = block;
+}
+
+static bcache_block_t* _bcache_lookup(device_t* dev, uint32_t index)
+{
+    bcache_block_t* block = _bcache_hash[_bcache_hash_of(dev, index)];
+    while (block) {
+        if (block->dev == dev && block->index == index) {
+            return block;
+        }
+        block = block->hash_next;
+    }
+    return NULL;
+}
+
+/**
+ * BLOCK FUNCTIONS
+ */
+
+static inline bool _bcache_is_memory_low()
+{
+    return pmm_get_free_blocks() * pmm_get_block_size() < BCACHE_LOW_MEMORY;
+}
+
+static void _bcache_submit_io(bcache_block_t* block, bool write);
+
+static bcache_block_t* _bcache_evict_lru_lockless()
+{
+    bcache_block_t* block = _bcache_lru_tail;
+    if (!block) {
+        return NULL;
+    }
+
+    if (block->dirty) {
+        _bcache_submit_io(block, true);
+        dm_storage_unplug(block->dev);
+        block->dirty = false;
+        _bcache_dirty_count--;
+    }
+
+    _bcache_lru_remove(block);
+    _bcache_hash_remove(block);
+    return block;
+}
+
+/**
+ * Gives frames of the least recently used blocks back to the system.
+ */
+static uint32_t _bcache_shrink_lockless(uint32_t blocks)
+{
+    uint32_t freed = 0;
+    while (freed < blocks) {
+        bcache_block_t* block = _bcache_evict_lru_lockless();
+        if (!block) {
+            break;
+        }
+
+        vmm_unmap_page((uint32_t)block->data);
+        pmm_free_frame((void*)block->paddr);
+        block->hash_next = _bcache_unused;
+        _bcache_unused = block;
+        freed++;
+    }
+    return freed;
+}
+
+static bcache_block_t* _bcache_new_block_lockless()
+{
+    if (_bcache_unused && !_bcache_is_memory_low()) {
+        void* frame = pmm_alloc_frame();
+        if (frame) {
+            bcache_block_t* block = _bcache_unused;
+            _bcache_unused = block->hash_next;
+            block->hash_next = NULL;
+            block->paddr = (uint32_t)frame;
+            vmm_map_page((uint32_t)block->data, block->paddr, PAGE_READABLE | PAGE_WRITABLE);
+            return block;
+        }
+    }
+
+    bcache_block_t* block = _bcache_evict_lru_lockless();
+    if (block && _bcache_is_memory_low()) {
+        _bcache_shrink_lockless(BCACHE_SHRINK_BATCH);
+    }
+    return block;
+}
+
+static inline int _bcache_transfer(device_t* dev, uint32_t lba, uint8_t* data, uint32_t count, bool write)
+{
+    storage_segment_t seg = { .data = data, .len = count * BCACHE_SECTOR_SIZE };
+    storage_request_t req = { .lba = lba, .count = count, .segments_count = 1, .segments = &seg };
+    return write ? dm_storage_write(dev, &req) : dm_storage_read(dev, &req);
+}
+
+/**
+ * Queues a read or a write of the block, the request is served on unplug
+ * of the device.
+ */
+static void _bcache_submit_io(bcache_block_t* block, bool write)
+{
+    uint32_t (*get_size)(device_t * d) = block->dev->storage_ops->capacity;
+
+    // The last block of a device could be partial, its tail stays zeroed.
+    uint32_t sectors = BCACHE_SECTORS_PER_BLOCK;
+    if (get_size) {
+        uint32_t capacity = get_size(block->dev);
+        uint32_t block_start = block->index * BCACHE_BLOCK_SIZE;
+        if (capacity < block_start + BCACHE_BLOCK_SIZE) {
+            sectors = capacity > block_start ? (capacity - block_start) / BCACHE_SECTOR_SIZE : 0;
+            if (!write) {
+                memset(block->data, 0, BCACHE_BLOCK_SIZE);
+            }
+        }
+    }
+
+    if (!sectors) {
+        return;
+    }
+
+    block->io_seg.data = block->data;
+    block->io_seg.len = sectors * BCACHE_SECTOR_SIZE;
+    memset(&block->io_req, 0, sizeof(storage_request_t));
+    block->io_req.lba = block->index * BCACHE_SECTORS_PER_BLOCK;
+    block->io_req.count = sectors;
+    block->io_req.segments_count = 1;
+    block->io_req.segments = &block->io_seg;
+    block->io_req.write = write;
+    dm_storage_submit(block->dev, &block->io_req);
+}
+
+/**
+ * Writes dirty blocks of the device (of all devices if dev is NULL) back.
+ * All writes are queued first, so the device queue sorts and merges them.
+ */
+static void _bcache_writeback_lockless(device_t* dev)
+{
+    bool need_unplug[MAX_DEVICES_COUNT] = { 0 };
+
+    for (int i = 0; i < BCACHE_MAX_BLOCKS; i++) {
+        bcache_block_t* block = &_bcache_blocks[i];
+        if (!block->dirty || (dev && block->dev != dev)) {
+            continue;
+        }
+        _bcache_submit_io(block, true);
+        need_unplug[block->dev->id] = true;
+    }
+
+    for (int i = 0; i < MAX_DEVICES_COUNT; i++) {
+        if (need_unplug[i]) {
+            dm_storage_unplug(&devices[i]);
+        }
+    }
+
+    for (int i = 0; i < BCACHE_MAX_BLOCKS; i++) {
+        bcache_block_t* block = &_bcache_blocks[i];
+        if (block->dirty && (!dev || block->dev == dev)) {
+            block->dirty = false;
+            _bcache_dirty_count--;
+        }
+    }
+}
+
+/**
+ * Brings up to BCACHE_READ_BATCH missing blocks of [first, last] in. Their
+ * reads are queued together, so the device queue merges them into few
+ * requests. The blocks join the lists only after the reads are served, so
+ * they can't be evicted by the batch itself.
+ */
+static void _bcache_fetch_blocks_lockless(device_t* dev, uint32_t first, uint32_t last)
+{
+    bcache_block_t* batch[BCACHE_READ_BATCH];
+    int batch_size = 0;
+
+    for (uint32_t index = first; index <= last && batch_size < BCACHE_READ_BATCH; index++) {
+        if (_bcache_lookup(dev, index)) {
+            continue;
+        }
+
+        bcache_block_t* block = _bcache_new_block_lockless();
+        if (!block) {
+            break;
+        }
+
+        block->dev = dev;
+        block->index = index;
+        _bcache_submit_io(block, false);
+        batch[batch_size++] = block;
+    }
+
+    if (!batch_size) {
+        return;
+    }
+
+    dm_storage_unplug(dev);
+    for (int i = 0; i < batch_size; i++) {
+        _bcache_hash_add(batch[i]);
+        _bcache_lru_push_front(batch[i]);
+    }
+}
+
+/**
+ * A block which is going to be overwritten completely isn't read.
+ */
+static bcache_block_t* _bcache_get_block_to_overwrite_lockless(device_t* dev, uint32_t index)
+{
+    bcache_block_t* block = _bcache_lookup(dev, index);
+    if (block) {
+        _bcache_lru_remove(block);
+        _bcache_lru_push_front(block);
+        return block;
+    }
+
+    block = _bcache_new_block_lockless();
+    if (!block) {
+        return NULL;
+    }
+
+    block->dev = dev;
+    block->index = index;
+    _bcache_hash_add(block);
+    _bcache_lru_push_front(block);
+    return block;
+}
+
+static bcache_block_t* _bcache_get_block_lockless(device_t* dev, uint32_t index, uint32_t last)
+{
+    bcache_block_t* block = _bcache_lookup(dev, index);
+    if (!block) {
+        _bcache_fetch_blocks_lockless(dev, index, last);
+        block = _bcache_lookup(dev, index);
+        if (!block) {
+            return NULL;
+        }
+    }
+
+    _bcache_lru_remove(block);
+    _bcache_lru_push_front(block);
+    return block;
+}
+
+/**
+ * Writes sectors which are not cached. Whole sectors are written with one
+ * request, partial ones at the edges are read from the device first.
+ */
+static void _bcache_write_to_dev(device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    uint32_t sector = start / BCACHE_SECTOR_SIZE;
+    uint32_t start_offset = start % BCACHE_SECTOR_SIZE;
+    uint8_t tmp_buf[BCACHE_SECTOR_SIZE];
+
+    while (len) {
+        uint32_t part = min(BCACHE_SECTOR_SIZE - start_offset, len);
+        if (part == BCACHE_SECTOR_SIZE) {
+            uint32_t count = len / BCACHE_SECTOR_SIZE;
+            _bcache_transfer(dev, sector, buf, count, true);
+            part = count * BCACHE_SECTOR_SIZE;
+            sector += count;
+        } else {
+            _bcache_transfer(dev, sector, tmp_buf, 1, false);
+            memcpy(tmp_buf + start_offset, buf, part);
+            _bcache_transfer(dev, sector, tmp_buf, 1, true);
+            sector++;
+        }
+        buf += part;
+        len -= part;
+        start_offset = 0;
+    }
+}
+
+/**
+ * PUBLIC FUNCTIONS
+ */
+
+void bcache_init()
+{
+    lock_init(&_bcache_lock);
+    _bcache_zone = zoner_new_zone(BCACHE_MAX_BLOCKS * BCACHE_BLOCK_SIZE);
+    _bcache_blocks = (bcache_block_t*)kmalloc(BCACHE_MAX_BLOCKS * sizeof(bcache_block_t));
+    memset(_bcache_blocks, 0, BCACHE_MAX_BLOCKS * sizeof(bcache_block_t));
+
+    _bcache_unused = NULL;
+    for (int i = BCACHE_MAX_BLOCKS - 1; i >= 0; i--) {
+        _bcache_blocks[i].data = _bcache_zone.ptr + i * BCACHE_BLOCK_SIZE;
+        _bcache_blocks[i].hash_next = _bcache_unused;
+        _bcache_unused = &_bcache_blocks[i];
+    }
+}
+
+int bcache_read(device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    lock_acquire(&_bcache_lock);
+    while (len) {
+        uint32_t offset = start % BCACHE_BLOCK_SIZE;
+        uint32_t part = min(BCACHE_BLOCK_SIZE - offset, len);
+        bcache_block_t* block = _bcache_get_block_lockless(dev, start / BCACHE_BLOCK_SIZE, (start + len - 1) / BCACHE_BLOCK_SIZE);
+        if (!block) {
+            lock_release(&_bcache_lock);
+            return -ENOMEM;
+        }
+
+        memcpy(buf, block->data + offset, part);
+        buf += part;
+        start += part;
+        len -= part;
+    }
+    lock_release(&_bcache_lock);
+    return 0;
+}
+
+int bcache_write(device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    lock_acquire(&_bcache_lock);
+    while (len) {
+        uint32_t offset = start % BCACHE_BLOCK_SIZE;
+        uint32_t part = min(BCACHE_BLOCK_SIZE - offset, len);
+        uint32_t index = start / BCACHE_BLOCK_SIZE;
+        bcache_block_t* block;
+        if (part == BCACHE_BLOCK_SIZE) {
+            block = _bcache_get_block_to_overwrite_lockless(dev, index);
+        } else {
+            block = _bcache_get_block_lockless(dev, index, index);
+        }
+
+        if (!block) {
+            // No memory to hold the data, so it goes to the device directly.
+            _bcache_write_to_dev(dev, buf, start, part);
+        } else {
+            memcpy(block->data + offset, buf, part);
+            if (!block->dirty) {
+                block->dirty = true;
+                _bcache_dirty_count++;
+            }
+        }
+
+        buf += part;
+        start += part;
+        len -= part;
+    }
+
+    if (_bcache_dirty_count > BCACHE_MAX_DIRTY_BLOCKS) {
+        _bcache_writeback_lockless(NULL);
+    }
+    lock_release(&_bcache_lock);
+    return 0;
+}
+
+/**
+ * Brings the blocks of the range to the cache without copying them out.
+ * Nothing is read while memory is low, read-ahead shouldn't push the
+ * cache to shrink.
+ */
+int bcache_prefetch(device_t* dev, uint32_t start, uint32_t len)
+{
+    if (!len) {
+        return 0;
+    }
+
+    lock_acquire(&_bcache_lock);
+    if (_bcache_is_memory_low()) {
+        lock_release(&_bcache_lock);
+        return -ENOMEM;
+    }
+
+    uint32_t last = (start + len - 1) / BCACHE_BLOCK_SIZE;
+    for (uint32_t index = start / BCACHE_BLOCK_SIZE; index <= last; index += BCACHE_READ_BATCH) {
+        _bcache_fetch_blocks_lockless(dev, index, min(last, index + BCACHE_READ_BATCH - 1));
+    }
+    lock_release(&_bcache_lock);
+    return 0;
+}
+
+int bcache_sync(device_t* dev)
+{
+    lock_acquire(&_bcache_lock);
+    _bcache_writeback_lockless(dev);
+    lock_release(&_bcache_lock);
+    return 0;
+}
+
+static delayed_work_t _bcache_flush_work;
+
+static void _bcache_flush(void* data)
+{
+    bcache_sync(NULL);
+    work_queue_delayed(&_bcache_flush_work, BCACHE_FLUSH_INTERVAL * 1000);
+}
+
+void bcache_start_flusher()
+{
+    delayed_work_init(&_bcache_flush_work, _bcache_flush, NULL, WORK_PRIO_NORMAL);
+    work_queue_delayed(&_bcache_flush_work, BCACHE_FLUSH_INTERVAL * 1000);
+}
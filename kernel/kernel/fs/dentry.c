@@ -11,54 +11,233 @@
 #include <libkern/lock.h>
 #include <libkern/log.h>
 #include <libkern/mem.h>
+#include <libkern/seqcount.h>
 #include <mem/kmalloc.h>
+#include <mem/kmemcache.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
 #include <platform/generic/system.h>
 #include <syscalls/handlers.h>
+#include <tasking/workqueue.h>
 
 // #define DENTRY_DEBUG
 
 #define NOT_READ_INODE 0
 #define READ_INODE 1
 #define DENTRY_ALLOC_SIZE (4 * KB) /* Shows the size of list's parts. */
-#define DENTRY_SWAP_THRESHOLD_FOR_INODE_CACHE (16 * KB)
+#define DENTRY_HASH_SIZE (256)
+#define DENTRY_MAX_BLOCKS (64) /* Blocks of entries the cache grows to while memory is plentiful. */
+#define DENTRY_LOW_MEMORY (4 * MB) /* Below this amount of free memory cached inodes are reclaimed. */
+#define DENTRY_SHRINK_BATCH (16)
+#define DENTRY_FLUSH_INTERVAL (2000) /* In ms. */
 
 extern vfs_device_t _vfs_devices[MAX_DEVICES_COUNT];
 extern dynamic_array_t _vfs_fses;
 extern uint32_t root_fs_dev_id;
 
-static bool can_cache_inodes = 1;
 static uint32_t stat_cached_dentries = 0; /* Count of dentries which are held. */
 static uint32_t stat_cached_inodes_area_size = 0; /* Sum of all areas which is used for holding inodes. */
 static dentry_cache_list_t* dentry_cache;
+static uint32_t dentry_cache_blocks = 0;
 static uint16_t* dentry_cahced;
+static kmemcache_t* inode_cache;
 
-static inline bool need_to_free_inode_cache()
+/**
+ * Valid dentries are found by (dev_indx, inode_indx) in dentry_hash.
+ * Entries which aren't held by someone are kept in the lru list: valid ones
+ * are added to the head, deleted or never used ones to the tail, so the tail
+ * is always the best entry to be replaced.
+ * Lock order: dentry_hash_lock -> dentry->lock -> dentry_lru_lock.
+ * Writers of the hash also hold dentry_hash_seq odd, so dentries which are
+ * held can be found without dentry_hash_lock, see dentry_hash_find_fast().
+ */
+static dentry_t* dentry_hash[DENTRY_HASH_SIZE];
+static seqcount_t dentry_hash_seq;
+static dentry_t* dentry_lru_head;
+static dentry_t* dentry_lru_tail;
+static lock_t dentry_hash_lock;
+static lock_t dentry_lru_lock;
+
+static inline inode_t* dentry_alloc_inode()
+{
+    inode_t* inode = NULL;
+    if (inode_cache) {
+        inode = (inode_t*)kmemcache_alloc(inode_cache);
+    }
+    if (!inode) {
+        inode = (inode_t*)kmalloc(INODE_LEN);
+    }
+    return inode;
+}
+
+static inline bool dentry_is_memory_low()
 {
-    return (stat_cached_inodes_area_size > DENTRY_SWAP_THRESHOLD_FOR_INODE_CACHE);
+    return pmm_get_free_blocks() * pmm_get_block_size() < DENTRY_LOW_MEMORY;
 }
 
-static inline bool free_inode_cache()
+/**
+ * LRU FUNCTIONS
+ */
+
+static void dentry_lru_add(dentry_t* dentry)
 {
-    dentry_cache_list_t* dentry_cache_block = dentry_cache;
-    dentry_t* valid_dentry_candidate = NULL;
-    while (dentry_cache_block) {
-        lock_acquire(&dentry_cache_block->lock);
-        int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
-        for (int i = 0; i < dentries_in_block; i++) {
-            if (dentry_cache_block->data[i].d_count == 0) {
-                dentry_cache_block->data[i].inode_indx = 0;
-                stat_cached_inodes_area_size -= INODE_LEN;
-                kfree(dentry_cache_block->data[i].inode);
-            }
+    lock_acquire(&dentry_lru_lock);
+    if (dentry->in_lru) {
+        lock_release(&dentry_lru_lock);
+        return;
+    }
+
+    if (dentry->inode_indx != 0) {
+        dentry->lru_prev = NULL;
+        dentry->lru_next = dentry_lru_head;
+        if (dentry_lru_head) {
+            dentry_lru_head->lru_prev = dentry;
+        } else {
+            dentry_lru_tail = dentry;
         }
-        lock_release(&dentry_cache_block->lock);
-        dentry_cache_block = dentry_cache_block->next;
+        dentry_lru_head = dentry;
+    } else {
+        dentry->lru_next = NULL;
+        dentry->lru_prev = dentry_lru_tail;
+        if (dentry_lru_tail) {
+            dentry_lru_tail->lru_next = dentry;
+        } else {
+            dentry_lru_head = dentry;
+        }
+        dentry_lru_tail = dentry;
+    }
+    dentry->in_lru = true;
+    lock_release(&dentry_lru_lock);
+}
+
+static void dentry_lru_remove_lockless(dentry_t* dentry)
+{
+    if (dentry->lru_prev) {
+        dentry->lru_prev->lru_next = dentry->lru_next;
+    } else {
+        dentry_lru_head = dentry->lru_next;
+    }
+    if (dentry->lru_next) {
+        dentry->lru_next->lru_prev = dentry->lru_prev;
+    } else {
+        dentry_lru_tail = dentry->lru_prev;
+    }
+    dentry->lru_prev = NULL;
+    dentry->lru_next = NULL;
+    dentry->in_lru = false;
+}
+
+static void dentry_lru_remove(dentry_t* dentry)
+{
+    lock_acquire(&dentry_lru_lock);
+    if (dentry->in_lru) {
+        dentry_lru_remove_lockless(dentry);
+    }
+    lock_release(&dentry_lru_lock);
+}
+
+static inline bool dentry_lru_has_free_entry()
+{
+    lock_acquire(&dentry_lru_lock);
+    bool res = dentry_lru_tail && dentry_lru_tail->inode_indx == 0;
+    lock_release(&dentry_lru_lock);
+    return res;
+}
+
+static dentry_t* dentry_lru_pop()
+{
+    lock_acquire(&dentry_lru_lock);
+    dentry_t* dentry = dentry_lru_tail;
+    if (dentry) {
+        dentry_lru_remove_lockless(dentry);
+    }
+    lock_release(&dentry_lru_lock);
+    return dentry;
+}
+
+/**
+ * HASH FUNCTIONS
+ * All of them should be called with dentry_hash_lock held.
+ */
+
+static inline uint32_t dentry_hash_of(uint32_t dev_indx, uint32_t inode_indx)
+{
+    return (inode_indx ^ (dev_indx * 0x9e3779b1)) % DENTRY_HASH_SIZE;
+}
+
+static dentry_t* dentry_hash_find_lockless(uint32_t dev_indx, uint32_t inode_indx)
+{
+    dentry_t* dentry = dentry_hash[dentry_hash_of(dev_indx, inode_indx)];
+    while (dentry) {
+        if (dentry->dev_indx == dev_indx && dentry->inode_indx == inode_indx) {
+            return dentry;
+        }
+        dentry = dentry->hash_next;
+    }
+    return NULL;
+}
+
+/**
+ * Finds a dentry which is held by someone and takes a reference to it
+ * without dentry_hash_lock. Held dentries can't be replaced, but the entry
+ * could be taken for another inode while we walk, so the result counts only
+ * if no writer of the hash showed up till the reference is taken. Entries
+ * are never freed, so the walk is safe anyway. Returns NULL when the locked
+ * path should be used.
+ */
+static dentry_t* dentry_hash_find_fast(uint32_t dev_indx, uint32_t inode_indx)
+{
+    uint32_t seq = seqcount_read_begin(&dentry_hash_seq);
+    dentry_t* dentry = dentry_hash[dentry_hash_of(dev_indx, inode_indx)];
+    while (dentry) {
+        if (seqcount_read_retry(&dentry_hash_seq, seq)) {
+            return NULL;
+        }
+        if (dentry->dev_indx == dev_indx && dentry->inode_indx == inode_indx) {
+            break;
+        }
+        dentry = dentry->hash_next;
+    }
+
+    if (!dentry) {
+        return NULL;
     }
 
-    if (need_to_free_inode_cache()) {
-        can_cache_inodes = 0;
+    lock_acquire(&dentry->lock);
+    bool valid = dentry->d_count > 0 && dentry->dev_indx == dev_indx && dentry->inode_indx == inode_indx;
+    if (!valid || seqcount_read_retry(&dentry_hash_seq, seq)) {
+        lock_release(&dentry->lock);
+        return NULL;
     }
-    return true;
+    dentry->d_count++;
+    lock_release(&dentry->lock);
+    return dentry;
+}
+
+static void dentry_hash_insert_lockless(dentry_t* dentry)
+{
+    uint32_t bucket = dentry_hash_of(dentry->dev_indx, dentry->inode_indx);
+    dentry->hash_bucket = bucket;
+    dentry->hash_next = dentry_hash[bucket];
+    dentry_hash[bucket] = dentry;
+    dentry->in_hash = true;
+}
+
+static void dentry_hash_remove_lockless(dentry_t* dentry)
+{
+    if (!dentry->in_hash) {
+        return;
+    }
+
+    dentry_t** link = &dentry_hash[dentry->hash_bucket];
+    while (*link && *link != dentry) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = dentry->hash_next;
+    }
+    dentry->hash_next = NULL;
+    dentry->in_hash = false;
 }
 
 static void dentry_cache_alloc()
@@ -79,47 +258,45 @@ static void dentry_cache_alloc()
         last->next = list_block;
         list_block->prev = last;
     }
+    dentry_cache_blocks++;
+
+    int dentries_in_block = list_block->len / sizeof(dentry_t);
+    for (int i = 0; i < dentries_in_block; i++) {
+        lock_init(&list_block->data[i].lock);
+        dentry_lru_add(&list_block->data[i]);
+    }
+}
+
+/**
+ * The cache grows instead of replacing a valid dentry only while it's
+ * small and there is enough free memory.
+ */
+static inline bool dentry_cache_can_grow()
+{
+    return dentry_cache_blocks < DENTRY_MAX_BLOCKS && !dentry_is_memory_low();
 }
 
 /**
  * In this function, we try to find an entry to fill it with a new dentry.
- * Since we have a valid dentries in the cache, which isn't held by someone, they are
- * also condidates to be replaced. But because we want to have more valid entries in the
- * cache, we will start to look for a complitely free entry.
+ * Free entries and valid dentries which aren't held by someone are kept in the
+ * lru list, free ones are at its tail, so we take the tail. If there are no free
+ * entries, a new block is allocated while the cache can grow, otherwise the least
+ * recently used dentry is replaced. Should be called with dentry_hash_lock held.
  */
 static dentry_t* dentry_cache_find_empty_entry()
 {
-    dentry_cache_list_t* dentry_cache_block = dentry_cache;
-    dentry_t* valid_dentry_candidate = NULL;
-    while (dentry_cache_block) {
-        lock_acquire(&dentry_cache_block->lock);
-        int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
-        for (int i = 0; i < dentries_in_block; i++) {
-            if (dentry_cache_block->data[i].inode_indx == 0) {
-                lock_release(&dentry_cache_block->lock);
-                return &dentry_cache_block->data[i];
-            }
-            if (dentry_cache_block->data[i].d_count == 0) {
-                valid_dentry_candidate = &dentry_cache_block->data[i];
-            }
-        }
-        lock_release(&dentry_cache_block->lock);
-        dentry_cache_block = dentry_cache_block->next;
+    if (!dentry_lru_has_free_entry() && dentry_cache_can_grow()) {
+        dentry_cache_alloc();
     }
 
-    /* If we hasn't found a complitely free entry, let's erase a 
-       valid dentries in the cache, which isn't held by someone. */
-    if (valid_dentry_candidate) {
-        return valid_dentry_candidate;
+    dentry_t* dentry = dentry_lru_pop();
+    if (!dentry) {
+        dentry_cache_alloc();
+        dentry = dentry_lru_pop();
     }
 
-    /* If there is no space, let's allocate a bigger area. */
-    dentry_cache_alloc();
-    dentry_cache_list_t* last = dentry_cache;
-    while (last->next != NULL) {
-        last = last->next;
-    }
-    return &last->data[0];
+    dentry_hash_remove_lockless(dentry);
+    return dentry;
 }
 
 static inline void dentry_delete_inode(dentry_t* dentry)
@@ -144,20 +321,53 @@ static inline void dentry_flush_inode(dentry_t* dentry)
  */
 static void dentry_delete_from_cache(dentry_t* dentry)
 {
+    vmm_file_cache_invalidate(dentry->dev_indx, dentry->inode_indx);
+
     /* This marks the dentry as deleted. */
     dentry->inode_indx = 0;
     if (dentry->inode) {
         kfree(dentry->inode);
+        dentry->inode = NULL;
+        stat_cached_inodes_area_size -= INODE_LEN;
     }
 
     if (dentry->filename) {
         kfree(dentry->filename);
+        dentry->filename = NULL;
     }
+}
 
-    stat_cached_inodes_area_size -= INODE_LEN;
-    if (!need_to_free_inode_cache()) {
-        can_cache_inodes = 1;
+/**
+ * dentry_shrink_cache drops up to @count least recently used dentries which
+ * aren't held by someone, returning memory of their inodes. Their inodes were
+ * flushed when they were put. Returns the number of dropped dentries.
+ */
+static uint32_t dentry_shrink_cache(uint32_t count)
+{
+    uint32_t dropped = 0;
+    lock_acquire(&dentry_hash_lock);
+    while (dropped < count) {
+        lock_acquire(&dentry_lru_lock);
+        dentry_t* victim = dentry_lru_tail;
+        while (victim && victim->inode_indx == 0) {
+            victim = victim->lru_prev;
+        }
+        if (!victim) {
+            lock_release(&dentry_lru_lock);
+            break;
+        }
+        dentry_lru_remove_lockless(victim);
+        lock_release(&dentry_lru_lock);
+
+        seqcount_write_begin(&dentry_hash_seq);
+        dentry_hash_remove_lockless(victim);
+        dentry_delete_from_cache(victim);
+        seqcount_write_end(&dentry_hash_seq);
+        dentry_lru_add(victim);
+        dropped++;
     }
+    lock_release(&dentry_hash_lock);
+    return dropped;
 }
 
 /**
@@ -168,29 +378,23 @@ static void dentry_delete_from_cache(dentry_t* dentry)
  */
 static void dentry_prefree(dentry_t* dentry)
 {
-    if (!can_cache_inodes) {
-        dentry_delete_from_cache(dentry);
-    } else {
-        if (need_to_free_inode_cache()) {
-            free_inode_cache();
-        }
-    }
     stat_cached_dentries--;
 }
 
-static dentry_t* dentry_alloc_new(uint32_t dev_indx, uint32_t inode_indx, int need_to_read_inode)
+/**
+ * dentry_alloc_new_lockless takes an entry and makes it a new dentry in the hash.
+ * The inode is not read here, since reading could be long and it's done
+ * without dentry_hash_lock held.
+ */
+static dentry_t* dentry_alloc_new_lockless(uint32_t dev_indx, uint32_t inode_indx)
 {
-    if (inode_indx == 0) {
-        return NULL;
-    }
-
+    seqcount_write_begin(&dentry_hash_seq);
     dentry_t* dentry = dentry_cache_find_empty_entry();
     fs_desc_t* fs_desc;
 
-    /* If inode_indx isn't 0, so we can say that we replace a valid dentry, which
-       has area for storing inode allocated. */
-    bool already_allocated_inode = (dentry->inode_indx != 0);
-    lock_init(&dentry->lock);
+    /* If we replace a valid dentry, it has area for storing inode allocated.
+       The lock isn't reinitialized, a lockless finder could be holding it. */
+    bool already_allocated_inode = (dentry->inode != NULL);
     dentry->d_count = 1;
     dentry->flags = 0;
     dentry->dev_indx = dev_indx;
@@ -203,10 +407,51 @@ static dentry_t* dentry_alloc_new(uint32_t dev_indx, uint32_t inode_indx, int ne
     dentry->filename = NULL;
 
     if (!already_allocated_inode) {
-        dentry->inode = (inode_t*)kmalloc(INODE_LEN);
+        dentry->inode = dentry_alloc_inode();
         stat_cached_inodes_area_size += INODE_LEN;
     }
 
+    dentry_hash_insert_lockless(dentry);
+    seqcount_write_end(&dentry_hash_seq);
+    return dentry;
+}
+
+/**
+ * There are 3 cases for each entry in a cache array:
+ * 1) We have a valid dentry which is held by someone.
+ * 2) We have a valid dentry which isn'y held by someone and ready to swapped out.
+ * 3) We have an unsed entry in the cache array.
+ */
+static dentry_t* dentry_get_impl(uint32_t dev_indx, uint32_t inode_indx, int need_to_read_inode, int* newly_allocated)
+{
+    if (inode_indx == 0) {
+        return NULL;
+    }
+
+    dentry_t* dentry = dentry_hash_find_fast(dev_indx, inode_indx);
+    if (dentry) {
+        *newly_allocated = DENTRY_WAS_IN_CACHE;
+        return dentry;
+    }
+
+    /* We try to find the dentry in the cache */
+    lock_acquire(&dentry_hash_lock);
+    dentry = dentry_hash_find_lockless(dev_indx, inode_indx);
+    if (dentry) {
+        if (!dentry->d_count) {
+            stat_cached_dentries++;
+        }
+        dentry_duplicate(dentry);
+        lock_release(&dentry_hash_lock);
+        *newly_allocated = DENTRY_WAS_IN_CACHE;
+        return dentry;
+    }
+
+    /* It means no dentry in the cache. Let's add it. */
+    dentry = dentry_alloc_new_lockless(dev_indx, inode_indx);
+    lock_release(&dentry_hash_lock);
+    *newly_allocated = DENTRY_NEWLY_ALLOCATED;
+
     if (need_to_read_inode && dentry->ops->dentry.read_inode(dentry) < 0) {
         log_error("[Dentry] Can't read inode %d %d (dev, ino)", dev_indx, inode_indx);
         return NULL;
@@ -216,6 +461,14 @@ static dentry_t* dentry_alloc_new(uint32_t dev_indx, uint32_t inode_indx, int ne
     return dentry;
 }
 
+void dentry_init()
+{
+    lock_init(&dentry_hash_lock);
+    lock_init(&dentry_lru_lock);
+    seqcount_init(&dentry_hash_seq);
+    inode_cache = kmemcache_create("inode", INODE_LEN);
+}
+
 void dentry_set_inode(dentry_t* dentry, inode_t* inode)
 {
     lock_acquire(&dentry->lock);
@@ -248,102 +501,94 @@ dentry_t* dentry_get_parent(dentry_t* dentry)
     return res;
 }
 
-/**
- * Is a thread enrty point. The function flushes all inodes to drive.
- */
-void dentry_flusher()
+void dentry_flush(dentry_t* dentry)
 {
-    for (;;) {
-#ifdef DENTRY_DEBUG
-        log("WORK dentry_flusher");
-#endif
-        dentry_cache_list_t* dentry_cache_block = dentry_cache;
-        while (dentry_cache_block) {
-            lock_acquire(&dentry_cache_block->lock);
-            int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
-            for (int i = 0; i < dentries_in_block; i++) {
-                if (dentry_cache_block->data[i].inode_indx != 0) {
-                    // Keep only locks here might not be as effective as with disabled interrupts.
-                    lock_acquire(&dentry_cache_block->data[i].lock);
-                    system_disable_interrupts();
-                    dentry_flush_inode(&dentry_cache_block->data[i]);
-                    system_enable_interrupts();
-                    lock_release(&dentry_cache_block->data[i].lock);
-                }
-            }
-            lock_release(&dentry_cache_block->lock);
-            dentry_cache_block = dentry_cache_block->next;
-        }
-        ksys1(SYS_SLEEP, 2);
-    }
+    lock_acquire(&dentry->lock);
+    dentry_flush_inode(dentry);
+    lock_release(&dentry->lock);
 }
 
-/**
- * There are 3 cases for each entry in a cache array:
- * 1) We have a valid dentry which is held by someone.
- * 2) We have a valid dentry which isn'y held by someone and ready to swapped out.
- * 3) We have an unsed entry in the cache array.
- */
-dentry_t* dentry_get(uint32_t dev_indx, uint32_t inode_indx)
+void dentry_flush_all()
 {
-    /* We try to find the dentry in the cache */
     dentry_cache_list_t* dentry_cache_block = dentry_cache;
     while (dentry_cache_block) {
         lock_acquire(&dentry_cache_block->lock);
         int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
         for (int i = 0; i < dentries_in_block; i++) {
-            if (dentry_cache_block->data[i].dev_indx == dev_indx && dentry_cache_block->data[i].inode_indx == inode_indx) {
-                if (!dentry_cache_block->data[i].d_count)
-                    stat_cached_dentries++;
-                lock_release(&dentry_cache_block->lock);
-                return dentry_duplicate(&dentry_cache_block->data[i]);
+            if (dentry_cache_block->data[i].inode_indx != 0) {
+                // Keep only locks here might not be as effective as with disabled interrupts.
+                lock_acquire(&dentry_cache_block->data[i].lock);
+                system_disable_interrupts();
+                dentry_flush_inode(&dentry_cache_block->data[i]);
+                system_enable_interrupts();
+                lock_release(&dentry_cache_block->data[i].lock);
             }
         }
         lock_release(&dentry_cache_block->lock);
         dentry_cache_block = dentry_cache_block->next;
     }
-
-    /* It means no dentry in the cache. Let's add it. */
-    return dentry_alloc_new(dev_indx, inode_indx, READ_INODE);
 }
 
-dentry_t* dentry_get_no_inode(uint32_t dev_indx, uint32_t inode_indx, int* newly_allocated)
+static delayed_work_t _dentry_flush_work;
+
+/**
+ * Flushes all inodes to drive, runs on the workqueue.
+ */
+static void _dentry_flush(void* data)
 {
-    /* We try to find the dentry in the cache */
-    dentry_cache_list_t* dentry_cache_block = dentry_cache;
-    while (dentry_cache_block) {
-        lock_acquire(&dentry_cache_block->lock);
-        int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
-        for (int i = 0; i < dentries_in_block; i++) {
-            if (dentry_cache_block->data[i].dev_indx == dev_indx && dentry_cache_block->data[i].inode_indx == inode_indx) {
-                if (!dentry_cache_block->data[i].d_count)
-                    stat_cached_dentries++;
-                *newly_allocated = DENTRY_WAS_IN_CACHE;
-                lock_release(&dentry_cache_block->lock);
-                return dentry_duplicate(&dentry_cache_block->data[i]);
-            }
-        }
-        lock_release(&dentry_cache_block->lock);
-        dentry_cache_block = dentry_cache_block->next;
+#ifdef DENTRY_DEBUG
+    log("WORK dentry_flusher");
+#endif
+    dentry_flush_all();
+    if (dentry_is_memory_low()) {
+        dentry_shrink_cache(DENTRY_SHRINK_BATCH);
     }
+    work_queue_delayed(&_dentry_flush_work, DENTRY_FLUSH_INTERVAL);
+}
 
-    /* It means no dentry in the cache. Let's add it. */
-    *newly_allocated = DENTRY_NEWLY_ALLOCATED;
-    return dentry_alloc_new(dev_indx, inode_indx, NOT_READ_INODE);
+void dentry_start_flusher()
+{
+    delayed_work_init(&_dentry_flush_work, _dentry_flush, NULL, WORK_PRIO_NORMAL);
+    work_queue_delayed(&_dentry_flush_work, DENTRY_FLUSH_INTERVAL);
+}
+
+dentry_t* dentry_get(uint32_t dev_indx, uint32_t inode_indx)
+{
+    int newly_allocated;
+    return dentry_get_impl(dev_indx, inode_indx, READ_INODE, &newly_allocated);
+}
+
+dentry_t* dentry_get_no_inode(uint32_t dev_indx, uint32_t inode_indx, int* newly_allocated)
+{
+    return dentry_get_impl(dev_indx, inode_indx, NOT_READ_INODE, newly_allocated);
 }
 
 dentry_t* dentry_duplicate(dentry_t* dentry)
 {
     lock_acquire(&dentry->lock);
+    if (dentry->d_count == 0) {
+        dentry_lru_remove(dentry);
+    }
     dentry->d_count++;
     lock_release(&dentry->lock);
     return dentry;
 }
 
+/**
+ * dentry_put_ref drops a reference without shrinking the cache, since it's
+ * also called with the lock of a child held.
+ */
+static inline void dentry_put_ref(dentry_t* dentry)
+{
+    lock_acquire(&dentry->lock);
+    dentry_put_lockless(dentry);
+    lock_release(&dentry->lock);
+}
+
 static inline void dentry_put_impl(dentry_t* dentry)
 {
     if (dentry->parent) {
-        dentry_put(dentry->parent);
+        dentry_put_ref(dentry->parent);
     }
 
     if (dentry_test_flag_lockless(dentry, DENTRY_CUSTOM)) {
@@ -379,6 +624,7 @@ void dentry_force_put(dentry_t* dentry)
 
     dentry->d_count = 0;
     dentry_put_impl(dentry);
+    dentry_lru_add(dentry);
     lock_release(&dentry->lock);
 }
 
@@ -389,14 +635,16 @@ inline void dentry_put_lockless(dentry_t* dentry)
 
     if (dentry->d_count == 0) {
         dentry_put_impl(dentry);
+        dentry_lru_add(dentry);
     }
 }
 
 void dentry_put(dentry_t* dentry)
 {
-    lock_acquire(&dentry->lock);
-    dentry_put_lockless(dentry);
-    lock_release(&dentry->lock);
+    dentry_put_ref(dentry);
+    if (dentry_is_memory_low()) {
+        dentry_shrink_cache(DENTRY_SHRINK_BATCH);
+    }
 }
 
 void dentry_put_all_dentries_of_dev(uint32_t dev_indx)
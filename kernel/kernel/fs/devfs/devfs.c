@@ -175,6 +175,89 @@ static int _devfs_add_to_list(devfs_inode_t* parent, devfs_inode_t* new_entry)
     return 0;
 }
 
+static uint32_t _devfs_hash_of(const char* name, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* Buckets are doubled once the dir has twice as many entries. */
+static int _devfs_grow_buckets_lockless(devfs_inode_t* dir)
+{
+    if (dir->buckets_count && dir->entries_count < dir->buckets_count * 2) {
+        return 0;
+    }
+
+    uint32_t count = max(dir->buckets_count * 2, DEVFS_DIR_MIN_BUCKETS);
+    devfs_inode_t** buckets = kmalloc(count * sizeof(devfs_inode_t*));
+    if (!buckets) {
+        return dir->buckets_count ? 0 : -ENOMEM;
+    }
+
+    memset(buckets, 0, count * sizeof(devfs_inode_t*));
+    for (devfs_inode_t* entry = dir->first; entry; entry = entry->next) {
+        if (entry->name) {
+            entry->hash_next = buckets[entry->hash % count];
+            buckets[entry->hash % count] = entry;
+        }
+    }
+
+    if (dir->buckets) {
+        kfree(dir->buckets);
+    }
+    dir->buckets = buckets;
+    dir->buckets_count = count;
+    return 0;
+}
+
+/**
+ * Hashes the entry by its name, so it should be called once the name is set.
+ */
+static int _devfs_hash_add_lockless(devfs_inode_t* dir, devfs_inode_t* entry)
+{
+    if (!entry->name) {
+        return -EINVAL;
+    }
+
+    entry->hash = _devfs_hash_of(entry->name, strlen(entry->name));
+    dir->entries_count++;
+    if (_devfs_grow_buckets_lockless(dir) < 0) {
+        dir->entries_count--;
+        return -ENOMEM;
+    }
+
+    /* Growing could already hash the entry, since it's listed in the dir. */
+    devfs_inode_t* it = dir->buckets[entry->hash % dir->buckets_count];
+    for (; it; it = it->hash_next) {
+        if (it == entry) {
+            return 0;
+        }
+    }
+
+    entry->hash_next = dir->buckets[entry->hash % dir->buckets_count];
+    dir->buckets[entry->hash % dir->buckets_count] = entry;
+    return 0;
+}
+
+static devfs_inode_t* _devfs_find_lockless(devfs_inode_t* dir, const char* name, uint32_t len)
+{
+    if (!dir->buckets_count) {
+        return NULL;
+    }
+
+    uint32_t hash = _devfs_hash_of(name, len);
+    devfs_inode_t* entry = dir->buckets[hash % dir->buckets_count];
+    for (; entry; entry = entry->hash_next) {
+        if (entry->hash == hash && strlen(entry->name) == len && strncmp(entry->name, name, len) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
 static devfs_inode_t* _devfs_alloc_entry(devfs_inode_t* parent)
 {
     devfs_inode_t* new_entry = _devfs_new_entry();
@@ -390,19 +473,15 @@ int devfs_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** resul
         }
     }
 
-    devfs_inode_t* child = devfs_inode->first;
-    while (child) {
-        uint32_t child_name_len = strlen(child->name);
-        if (len == child_name_len) {
-            if (strncmp(name, child->name, len) == 0) {
-                *result = dentry_get(dir->dev_indx, child->index);
-                return 0;
-            }
-        }
-        child = child->next;
+    lock_acquire(&_devfs_lock);
+    devfs_inode_t* child = _devfs_find_lockless(devfs_inode, name, len);
+    lock_release(&_devfs_lock);
+    if (!child) {
+        return -ENOENT;
     }
 
-    return -ENOENT;
+    *result = dentry_get(dir->dev_indx, child->index);
+    return 0;
 }
 
 int devfs_mkdir_dummy(dentry_t* dir, const char* name, uint32_t len, mode_t mode, uid_t uid)
@@ -557,12 +636,22 @@ devfs_inode_t* devfs_mkdir(dentry_t* dir, const char* name, uint32_t len)
 
     new_entry->mode = S_IFDIR;
     _devfs_set_name(new_entry, name, len);
+    _devfs_hash_add_lockless(devfs_inode, new_entry);
 
     lock_release(&_devfs_lock);
     return new_entry;
 }
 
 devfs_inode_t* devfs_register(dentry_t* dir, uint32_t devid, const char* name, uint32_t len, mode_t mode, const file_ops_t* handlers)
+{
+    return devfs_register_private(dir, devid, name, len, mode, handlers, NULL);
+}
+
+/**
+ * The private data is set before the entry can be looked up, so every
+ * dentry of it carries the pointer and handlers find their device in O(1).
+ */
+devfs_inode_t* devfs_register_private(dentry_t* dir, uint32_t devid, const char* name, uint32_t len, mode_t mode, const file_ops_t* handlers, void* private_data)
 {
     lock_acquire(&_devfs_lock);
     devfs_inode_t* devfs_inode = (devfs_inode_t*)dir->inode;
@@ -574,7 +663,9 @@ devfs_inode_t* devfs_register(dentry_t* dir, uint32_t devid, const char* name, u
 
     new_entry->dev_id = devid;
     new_entry->mode = mode;
+    new_entry->private_data = private_data;
     _devfs_set_name(new_entry, name, len);
+    _devfs_hash_add_lockless(devfs_inode, new_entry);
     _devfs_set_handlers(new_entry, handlers);
     dentry_set_flag(dir, DENTRY_DIRTY);
 
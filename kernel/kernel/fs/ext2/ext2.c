@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <fs/bcache.h>
 #include <fs/vfs.h>
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
@@ -22,10 +23,46 @@
 #define BLOCK_LEN(sb) (1024 << (sb->log_block_size))
 #define TO_EXT_BLOCKS_CNT(sb, x) (x / (2 << (sb->log_block_size)))
 #define NORM_FILENAME(x) (x + ((4 - (x & 0b11)) & 0b11))
+#define EXT2_BMAP_CACHE_SIZE (64)
+#define EXT2_BMAP_MAX_RUN (64)
+#define EXT2_RESERVE_WINDOWS (16)
+#define EXT2_RESERVE_WINDOW_LEN (16)
+
+/**
+ * Bmap cache keeps the last found run of contiguous blocks of inodes,
+ * so sequential access doesn't walk indirect blocks for every block.
+ * An inode owns the slot its (dev, inode) pair hashes to.
+ */
+struct ext2_bmap_run {
+    uint32_t dev_indx;
+    uint32_t inode_indx;
+    uint32_t inode_block_index;
+    uint32_t block_index;
+    uint32_t len;
+};
+typedef struct ext2_bmap_run ext2_bmap_run_t;
+
+/**
+ * A growing file reserves a window of blocks after its last allocated one.
+ * Windows are kept only in memory, so nothing leaks if they are dropped:
+ * other inodes just avoid these blocks while there are other free ones.
+ */
+struct ext2_reserve_window {
+    uint32_t dev_indx;
+    uint32_t inode_indx;
+    uint32_t start;
+    uint32_t len;
+};
+typedef struct ext2_reserve_window ext2_reserve_window_t;
 
 static superblock_t* _ext2_superblocks[MAX_DEVICES_COUNT];
 static groups_info_t _ext2_group_table_info[MAX_DEVICES_COUNT];
 static lock_t _ext2_lock;
+static ext2_bmap_run_t _ext2_bmap_cache[EXT2_BMAP_CACHE_SIZE];
+static lock_t _ext2_bmap_lock;
+static ext2_reserve_window_t _ext2_reserve_windows[EXT2_RESERVE_WINDOWS];
+static uint32_t _ext2_reserve_next_window;
+static lock_t _ext2_reserve_lock;
 
 driver_desc_t _ext2_driver_info();
 
@@ -49,18 +86,25 @@ static uint32_t _ext2_get_block_offset(superblock_t* sb, uint32_t block_index);
 static uint32_t _ext2_get_block_of_inode_lev0(dentry_t* dentry, uint32_t cur_block, uint32_t inode_block_index);
 static uint32_t _ext2_get_block_of_inode_lev1(dentry_t* dentry, uint32_t cur_block, uint32_t inode_block_index);
 static uint32_t _ext2_get_block_of_inode_lev2(dentry_t* dentry, uint32_t cur_block, uint32_t inode_block_index);
+static uint32_t _ext2_walk_block_of_inode(dentry_t* dentry, uint32_t inode_block_index);
 static uint32_t _ext2_get_block_of_inode(dentry_t* dentry, uint32_t inode_block_index);
+static uint32_t _ext2_get_block_run_of_inode(dentry_t* dentry, uint32_t inode_block_index, uint32_t* run_len);
+static void _ext2_bmap_invalidate(dentry_t* dentry);
 
 static int _ext2_set_block_of_inode_lev0(dentry_t* dentry, uint32_t cur_block, uint32_t inode_block_index, uint32_t val);
 static int _ext2_set_block_of_inode_lev1(dentry_t* dentry, uint32_t cur_block, uint32_t inode_block_index, uint32_t val);
 static int _ext2_set_block_of_inode_lev2(dentry_t* dentry, uint32_t cur_block, uint32_t inode_block_index, uint32_t val);
 static int _ext2_set_block_of_inode(dentry_t* dentry, uint32_t inode_block_index, uint32_t val);
 
-static int _ext2_find_free_block_index(vfs_device_t* dev, fsdata_t fsdata, uint32_t* block_index, uint32_t group_index);
-static int _ext2_allocate_block_index(vfs_device_t* dev, fsdata_t fsdata, uint32_t* block_index, uint32_t pref_group);
+static bool _ext2_reserved_by_other(dentry_t* owner, uint32_t block_index);
+static void _ext2_reserve_window(dentry_t* owner, uint32_t block_index);
+static void _ext2_drop_reserve_window(dentry_t* owner);
+
+static int _ext2_find_free_block_index(vfs_device_t* dev, fsdata_t fsdata, dentry_t* owner, uint32_t* block_index, uint32_t group_index, uint32_t goal_offset);
+static int _ext2_allocate_block_index(vfs_device_t* dev, fsdata_t fsdata, dentry_t* owner, uint32_t* block_index, uint32_t goal);
 static int _ext2_free_block_index(vfs_device_t* dev, fsdata_t fsdata, uint32_t block_index);
 
-static int _ext2_allocate_block_for_inode(dentry_t* dentry, uint32_t pref_group, uint32_t* block_index);
+static int _ext2_allocate_block_for_inode(dentry_t* dentry, uint32_t* block_index);
 
 /* INODE FUNCTIONS */
 int ext2_read_inode(dentry_t* dentry);
@@ -85,6 +129,28 @@ static int _ext2_add_child(dentry_t* dir, dentry_t* child_dentry, const char* na
 static int _ext2_rm_child(dentry_t* dir, dentry_t* child_dentry);
 static int _ext2_setup_dir(dentry_t* dir, dentry_t* parent_dir, mode_t mode, uid_t uid, gid_t gid);
 
+/* HTREE FUNCTIONS */
+typedef struct {
+    uint32_t hash;
+    uint8_t hash_version;
+    uint32_t node_block; /* Disk block of the lowest node of the path. */
+    uint32_t entries_offset; /* Offset of entries inside of the node. */
+    uint32_t at; /* Index of the entry which covers the hash. */
+    uint32_t leaf; /* Dir block of the leaf. */
+} ext2_dx_path_t;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t offset;
+} ext2_dx_map_entry_t;
+
+static int _ext2_dx_hash(superblock_t* sb, uint8_t hash_version, const char* name, uint32_t len, uint32_t* result);
+static inline bool _ext2_dx_is_indexed(dentry_t* dir);
+static void _ext2_dx_drop_index(dentry_t* dir);
+static int _ext2_dx_probe(dentry_t* dir, const char* name, uint32_t len, uint8_t* buf, ext2_dx_path_t* path);
+static int _ext2_dx_lookup(dentry_t* dir, const char* name, uint32_t len, uint32_t* found_inode_index);
+static int _ext2_dx_add_child(dentry_t* dir, dentry_t* child_dentry, const char* name, uint32_t len);
+
 /* FILE FUNCTIONS */
 static int _ext2_setup_file(dentry_t* file, mode_t mode, uid_t uid, gid_t gid);
 
@@ -95,6 +161,7 @@ int ext2_save_state(vfs_device_t* dev);
 fsdata_t get_fsdata(dentry_t* dentry);
 
 int ext2_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+int ext2_readahead(dentry_t* dentry, uint32_t start, uint32_t len);
 int ext2_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
 int ext2_truncate(dentry_t* dentry, uint32_t len);
 int ext2_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result);
@@ -109,49 +176,17 @@ int ext2_rm(dentry_t* dentry);
 
 static void _ext2_read_from_dev(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
 {
-    void (*read)(device_t * d, uint32_t s, uint8_t * r) = dm_function_handler(dev->dev, DRIVER_STORAGE_READ);
-    int already_read = 0;
-    uint32_t sector = start / 512;
-    uint32_t start_offset = start % 512;
-    uint8_t tmp_buf[512];
-
-    while (len) {
-        read(dev->dev, sector, tmp_buf);
-        for (int i = 0; i < min(512 - start_offset, len); i++) {
-            buf[already_read++] = tmp_buf[start_offset + i];
-        }
-        len -= min(512 - start_offset, len);
-        sector++;
-        start_offset = 0;
-    }
+    bcache_read(dev->dev, buf, start, len);
 }
 
 static void _ext2_write_to_dev(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
 {
-    void (*read)(device_t * d, uint32_t s, uint8_t * r) = dm_function_handler(dev->dev, DRIVER_STORAGE_READ);
-    void (*write)(device_t * d, uint32_t s, uint8_t * r, uint32_t siz) = dm_function_handler(dev->dev, DRIVER_STORAGE_WRITE);
-    int already_written = 0;
-    uint32_t sector = start / 512;
-    uint32_t start_offset = start % 512;
-    uint8_t tmp_buf[512];
-    while (len != 0) {
-        if (start_offset != 0 || len < 512) {
-            read(dev->dev, sector, tmp_buf);
-        }
-        for (int i = 0; i < min(512 - start_offset, len); i++) {
-            tmp_buf[start_offset + i] = buf[already_written++];
-        }
-        write(dev->dev, sector, tmp_buf, 512);
-        len -= min(512 - start_offset, len);
-        sector++;
-        start_offset = 0;
-    }
+    bcache_write(dev->dev, buf, start, len);
 }
 
 static uint32_t _ext2_get_disk_size(vfs_device_t* dev)
 {
-    uint32_t (*get_size)(device_t * d) = dm_function_handler(dev->dev, DRIVER_STORAGE_CAPACITY);
-    return get_size(dev->dev);
+    return dev->ops->capacity(dev->dev);
 }
 
 /**
@@ -231,8 +266,7 @@ static uint32_t _ext2_get_block_of_inode_lev2(dentry_t* dentry, uint32_t cur_blo
     return res ? _ext2_get_block_of_inode_lev1(dentry, res, offset_inner) : 0;
 }
 
-/* FIXME: think of more effecient way */
-static uint32_t _ext2_get_block_of_inode(dentry_t* dentry, uint32_t inode_block_index)
+static uint32_t _ext2_walk_block_of_inode(dentry_t* dentry, uint32_t inode_block_index)
 {
     uint32_t block_len = BLOCK_LEN(dentry->fsdata.sb) / 4;
     if (inode_block_index < 12) {
@@ -247,6 +281,107 @@ static uint32_t _ext2_get_block_of_inode(dentry_t* dentry, uint32_t inode_block_
     return _ext2_get_block_of_inode_lev2(dentry, dentry->inode->block[14], inode_block_index - (12 + block_len + block_len * block_len));
 }
 
+static inline ext2_bmap_run_t* _ext2_bmap_slot(dentry_t* dentry)
+{
+    return &_ext2_bmap_cache[(dentry->inode_indx ^ (dentry->dev_indx * 0x9e3779b1)) % EXT2_BMAP_CACHE_SIZE];
+}
+
+static uint32_t _ext2_scan_run(uint32_t* blocks, uint32_t count, uint32_t* run_len)
+{
+    uint32_t len = 1;
+    while (len < count && blocks[0] && blocks[len] == blocks[0] + len) {
+        len++;
+    }
+    *run_len = len;
+    return blocks[0];
+}
+
+/**
+ * _ext2_find_block_run returns the block of @inode_block_index and how many
+ * following blocks of the inode are placed right after it on the disk.
+ * Runs are looked for only inside of one block map.
+ */
+static uint32_t _ext2_find_block_run(dentry_t* dentry, uint32_t inode_block_index, uint32_t* run_len)
+{
+    uint32_t per_block = BLOCK_LEN(dentry->fsdata.sb) / 4;
+    uint32_t map_block, map_offset, map_count;
+
+    if (inode_block_index < 12) {
+        return _ext2_scan_run(&dentry->inode->block[inode_block_index], min(12 - inode_block_index, EXT2_BMAP_MAX_RUN), run_len);
+    }
+
+    if (inode_block_index < 12 + per_block) {
+        map_block = dentry->inode->block[12];
+        map_offset = inode_block_index - 12;
+    } else if (inode_block_index < 12 + per_block + per_block * per_block) {
+        uint32_t inner_index = inode_block_index - 12 - per_block;
+        map_block = dentry->inode->block[13] ? _ext2_get_block_of_inode_lev0(dentry, dentry->inode->block[13], inner_index / per_block) : 0;
+        map_offset = inner_index % per_block;
+    } else {
+        *run_len = 1;
+        return _ext2_walk_block_of_inode(dentry, inode_block_index);
+    }
+
+    if (!map_block) {
+        *run_len = 1;
+        return 0;
+    }
+
+    uint32_t blocks[EXT2_BMAP_MAX_RUN];
+    map_count = min(per_block - map_offset, EXT2_BMAP_MAX_RUN);
+    _ext2_read_from_dev(dentry->dev, (uint8_t*)blocks, _ext2_get_block_offset(dentry->fsdata.sb, map_block) + map_offset * 4, map_count * 4);
+    return _ext2_scan_run(blocks, map_count, run_len);
+}
+
+static uint32_t _ext2_get_block_run_of_inode(dentry_t* dentry, uint32_t inode_block_index, uint32_t* run_len)
+{
+    ext2_bmap_run_t* run = _ext2_bmap_slot(dentry);
+    lock_acquire(&_ext2_bmap_lock);
+    if (run->len && run->dev_indx == dentry->dev_indx && run->inode_indx == dentry->inode_indx) {
+        if (run->inode_block_index <= inode_block_index && inode_block_index < run->inode_block_index + run->len) {
+            uint32_t offset = inode_block_index - run->inode_block_index;
+            uint32_t res = run->block_index + offset;
+            *run_len = run->len - offset;
+            lock_release(&_ext2_bmap_lock);
+            return res;
+        }
+    }
+    lock_release(&_ext2_bmap_lock);
+
+    uint32_t res = _ext2_find_block_run(dentry, inode_block_index, run_len);
+    if (!res) {
+        return 0;
+    }
+
+    lock_acquire(&_ext2_bmap_lock);
+    run->dev_indx = dentry->dev_indx;
+    run->inode_indx = dentry->inode_indx;
+    run->inode_block_index = inode_block_index;
+    run->block_index = res;
+    run->len = *run_len;
+    lock_release(&_ext2_bmap_lock);
+    return res;
+}
+
+static uint32_t _ext2_get_block_of_inode(dentry_t* dentry, uint32_t inode_block_index)
+{
+    uint32_t run_len;
+    return _ext2_get_block_run_of_inode(dentry, inode_block_index, &run_len);
+}
+
+/**
+ * Should be called when the block map of the inode is changed.
+ */
+static void _ext2_bmap_invalidate(dentry_t* dentry)
+{
+    ext2_bmap_run_t* run = _ext2_bmap_slot(dentry);
+    lock_acquire(&_ext2_bmap_lock);
+    if (run->dev_indx == dentry->dev_indx && run->inode_indx == dentry->inode_indx) {
+        run->len = 0;
+    }
+    lock_release(&_ext2_bmap_lock);
+}
+
 static int _ext2_set_block_of_inode_lev0(dentry_t* dentry, uint32_t cur_block, uint32_t inode_block_index, uint32_t val)
 {
     uint32_t offset = inode_block_index;
@@ -279,6 +414,7 @@ static int _ext2_set_block_of_inode_lev2(dentry_t* dentry, uint32_t cur_block, u
 int _ext2_set_block_of_inode(dentry_t* dentry, uint32_t inode_block_index, uint32_t val)
 {
     uint32_t block_len = BLOCK_LEN(dentry->fsdata.sb) / 4;
+    _ext2_bmap_invalidate(dentry);
     if (inode_block_index < 12) {
         dentry->inode->block[inode_block_index] = val;
         dentry_set_flag(dentry, DENTRY_DIRTY);
@@ -293,63 +429,174 @@ int _ext2_set_block_of_inode(dentry_t* dentry, uint32_t inode_block_index, uint3
     return _ext2_set_block_of_inode_lev2(dentry, dentry->inode->block[14], inode_block_index - (12 + block_len + block_len * block_len), val);
 }
 
-static int _ext2_find_free_block_index(vfs_device_t* dev, fsdata_t fsdata, uint32_t* block_index, uint32_t group_index)
+static bool _ext2_reserved_by_other(dentry_t* owner, uint32_t block_index)
+{
+    bool res = false;
+    lock_acquire(&_ext2_reserve_lock);
+    for (int i = 0; i < EXT2_RESERVE_WINDOWS; i++) {
+        ext2_reserve_window_t* window = &_ext2_reserve_windows[i];
+        if (window->len && window->dev_indx == owner->dev_indx && window->inode_indx != owner->inode_indx) {
+            if (window->start <= block_index && block_index < window->start + window->len) {
+                res = true;
+                break;
+            }
+        }
+    }
+    lock_release(&_ext2_reserve_lock);
+    return res;
+}
+
+/**
+ * _ext2_reserve_window moves the window of the owner to start right
+ * after @block_index, unless the block is already inside of the window.
+ */
+static void _ext2_reserve_window(dentry_t* owner, uint32_t block_index)
+{
+    ext2_reserve_window_t* window = NULL;
+    lock_acquire(&_ext2_reserve_lock);
+    for (int i = 0; i < EXT2_RESERVE_WINDOWS; i++) {
+        ext2_reserve_window_t* cur = &_ext2_reserve_windows[i];
+        if (cur->len && cur->dev_indx == owner->dev_indx && cur->inode_indx == owner->inode_indx) {
+            window = cur;
+            break;
+        }
+        if (!cur->len && !window) {
+            window = cur;
+        }
+    }
+    if (!window) {
+        window = &_ext2_reserve_windows[_ext2_reserve_next_window];
+        _ext2_reserve_next_window = (_ext2_reserve_next_window + 1) % EXT2_RESERVE_WINDOWS;
+    }
+
+    if (window->len && window->start <= block_index && block_index + 1 < window->start + window->len) {
+        lock_release(&_ext2_reserve_lock);
+        return;
+    }
+
+    window->dev_indx = owner->dev_indx;
+    window->inode_indx = owner->inode_indx;
+    window->start = block_index + 1;
+    window->len = EXT2_RESERVE_WINDOW_LEN;
+    lock_release(&_ext2_reserve_lock);
+}
+
+static void _ext2_drop_reserve_window(dentry_t* owner)
+{
+    lock_acquire(&_ext2_reserve_lock);
+    for (int i = 0; i < EXT2_RESERVE_WINDOWS; i++) {
+        ext2_reserve_window_t* window = &_ext2_reserve_windows[i];
+        if (window->len && window->dev_indx == owner->dev_indx && window->inode_indx == owner->inode_indx) {
+            window->len = 0;
+        }
+    }
+    lock_release(&_ext2_reserve_lock);
+}
+
+/**
+ * _ext2_find_free_block_index looks for a free block of the group starting
+ * at @goal_offset. If @owner is set, blocks reserved by other inodes are skipped.
+ */
+static int _ext2_find_free_block_index(vfs_device_t* dev, fsdata_t fsdata, dentry_t* owner, uint32_t* block_index, uint32_t group_index, uint32_t goal_offset)
 {
     uint8_t block_bitmap[MAX_BLOCK_LEN];
     _ext2_read_from_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), BLOCK_LEN(fsdata.sb));
 
-    for (uint32_t off = 0; off < 8 * BLOCK_LEN(fsdata.sb); off++) {
-        if (!_ext2_bitmap_get(block_bitmap, off)) {
-            *block_index = fsdata.sb->blocks_per_group * group_index + off + 1;
-            _ext2_bitmap_set_bit(block_bitmap, off);
-            _ext2_write_to_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), BLOCK_LEN(fsdata.sb));
-            return 0;
+    uint32_t blocks_in_group = min(8 * BLOCK_LEN(fsdata.sb), fsdata.sb->blocks_per_group);
+    for (uint32_t i = 0; i < blocks_in_group; i++) {
+        uint32_t off = (goal_offset + i) % blocks_in_group;
+        if (_ext2_bitmap_get(block_bitmap, off)) {
+            continue;
+        }
+
+        uint32_t candidate = fsdata.sb->first_data_block + fsdata.sb->blocks_per_group * group_index + off;
+        if (owner && _ext2_reserved_by_other(owner, candidate)) {
+            continue;
         }
+
+        *block_index = candidate;
+        _ext2_bitmap_set_bit(block_bitmap, off);
+        _ext2_write_to_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), BLOCK_LEN(fsdata.sb));
+        fsdata.gt->table[group_index].free_blocks_count--;
+        fsdata.sb->free_blocks_count--;
+        return 0;
     }
     return -ENOSPC;
 }
 
-static int _ext2_allocate_block_index(vfs_device_t* dev, fsdata_t fsdata, uint32_t* block_index, uint32_t pref_group)
+/**
+ * _ext2_allocate_block_index allocates a block as close to @goal as possible.
+ * Groups without free blocks are skipped by the counts of the group table.
+ * Reserve windows of other inodes are respected, while possible.
+ */
+static int _ext2_allocate_block_index(vfs_device_t* dev, fsdata_t fsdata, dentry_t* owner, uint32_t* block_index, uint32_t goal)
 {
     uint32_t groups_cnt = GROUPS_COUNT;
-    for (int i = 0; i < groups_cnt; i++) {
-        uint32_t group_id = (pref_group + i) % groups_cnt;
-        if (GROUP_TABLES[group_id].free_blocks_count) {
-            if (_ext2_find_free_block_index(dev, fsdata, block_index, group_id) == 0) {
-                return 0;
+    uint32_t goal_rel = goal > fsdata.sb->first_data_block ? goal - fsdata.sb->first_data_block : 0;
+    uint32_t goal_group = (goal_rel / fsdata.sb->blocks_per_group) % groups_cnt;
+    uint32_t goal_offset = goal_rel % fsdata.sb->blocks_per_group;
+
+    for (int pass = 0; pass < 2; pass++) {
+        dentry_t* pass_owner = pass ? NULL : owner;
+        for (int i = 0; i < groups_cnt; i++) {
+            uint32_t group_id = (goal_group + i) % groups_cnt;
+            if (GROUP_TABLES[group_id].free_blocks_count) {
+                if (_ext2_find_free_block_index(dev, fsdata, pass_owner, block_index, group_id, i ? 0 : goal_offset) == 0) {
+                    return 0;
+                }
             }
         }
+        if (!owner) {
+            break;
+        }
     }
     return -ENOSPC;
 }
 
 static int _ext2_free_block_index(vfs_device_t* dev, fsdata_t fsdata, uint32_t block_index)
 {
-    block_index--;
+    block_index -= fsdata.sb->first_data_block;
     uint32_t block_len = BLOCK_LEN(fsdata.sb);
-    uint32_t group_index = block_index / block_len;
-    uint32_t off = block_index % block_len;
+    uint32_t group_index = block_index / fsdata.sb->blocks_per_group;
+    uint32_t off = block_index % fsdata.sb->blocks_per_group;
 
     uint8_t block_bitmap[MAX_BLOCK_LEN];
     _ext2_read_from_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), block_len);
 
+    if (_ext2_bitmap_get(block_bitmap, off)) {
+        fsdata.gt->table[group_index].free_blocks_count++;
+        fsdata.sb->free_blocks_count++;
+    }
     _ext2_bitmap_unset_bit(block_bitmap, off);
     _ext2_write_to_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), block_len);
     return 0;
 }
 
 /**
- * Returns allocated block in @block_index
+ * Returns allocated block in @block_index.
+ * The goal is the block after the last one of the inode, or the start of
+ * the inode's group for an empty inode.
  */
-static int _ext2_allocate_block_for_inode(dentry_t* dentry, uint32_t pref_group, uint32_t* block_index)
+static int _ext2_allocate_block_for_inode(dentry_t* dentry, uint32_t* block_index)
 {
-    if (_ext2_allocate_block_index(dentry->dev, dentry->fsdata, block_index, pref_group) == 0) {
-        uint32_t blocks_per_inode = TO_EXT_BLOCKS_CNT(dentry->fsdata.sb, dentry->inode->blocks);
+    superblock_t* sb = dentry->fsdata.sb;
+    uint32_t blocks_per_inode = TO_EXT_BLOCKS_CNT(sb, dentry->inode->blocks);
+    uint32_t goal = 0;
+    if (blocks_per_inode) {
+        goal = _ext2_get_block_of_inode(dentry, blocks_per_inode - 1) + 1;
+    } else {
+        uint32_t inode_group = (dentry->inode_indx - 1) / sb->inodes_per_group;
+        goal = sb->first_data_block + inode_group * sb->blocks_per_group;
+    }
+
+    if (_ext2_allocate_block_index(dentry->dev, dentry->fsdata, dentry, block_index, goal) == 0) {
         if (_ext2_set_block_of_inode(dentry, blocks_per_inode, *block_index) == 0) {
-            dentry->inode->blocks += BLOCK_LEN(dentry->fsdata.sb) / 512;
+            _ext2_reserve_window(dentry, *block_index);
+            dentry->inode->blocks += BLOCK_LEN(sb) / 512;
             dentry_set_flag(dentry, DENTRY_DIRTY);
             return 0;
         }
+        _ext2_free_block_index(dentry->dev, dentry->fsdata, *block_index);
     }
     return -ENOSPC;
 }
@@ -435,6 +682,8 @@ int ext2_free_inode(dentry_t* dentry)
         _ext2_free_block_index(dentry->dev, dentry->fsdata, data_block_index);
     }
 
+    _ext2_bmap_invalidate(dentry);
+    _ext2_drop_reserve_window(dentry);
     _ext2_free_inode_index(dentry->dev, dentry->fsdata, dentry->inode_indx);
     return 0;
 }
@@ -720,11 +969,465 @@ static int _ext2_rm_from_dir_block(vfs_device_t* dev, fsdata_t fsdata, uint32_t
     }
 }
 
+/**
+ * HTREE FUNCTIONS
+ */
+
+#define EXT2_DX_TEA_DELTA 0x9e3779b9
+#define EXT2_DX_MD4_K2 013240474631UL
+#define EXT2_DX_MD4_K3 015666365641UL
+#define EXT2_DX_HASH_EOF 0x7fffffff
+#define EXT2_DX_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define EXT2_DX_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT2_DX_H(x, y, z) ((x) ^ (y) ^ (z))
+#define EXT2_DX_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + x, a = _ext2_dx_rol(a, s))
+
+static inline uint32_t _ext2_dx_rol(uint32_t x, int s)
+{
+    return (x << s) | (x >> (32 - s));
+}
+
+static void _ext2_dx_tea_transform(uint32_t* buf, const uint32_t* in)
+{
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+    for (int n = 0; n < 16; n++) {
+        sum += EXT2_DX_TEA_DELTA;
+        b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+        b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    }
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+static void _ext2_dx_half_md4_transform(uint32_t* buf, const uint32_t* in)
+{
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    EXT2_DX_ROUND(EXT2_DX_F, a, b, c, d, in[0], 3);
+    EXT2_DX_ROUND(EXT2_DX_F, d, a, b, c, in[1], 7);
+    EXT2_DX_ROUND(EXT2_DX_F, c, d, a, b, in[2], 11);
+    EXT2_DX_ROUND(EXT2_DX_F, b, c, d, a, in[3], 19);
+    EXT2_DX_ROUND(EXT2_DX_F, a, b, c, d, in[4], 3);
+    EXT2_DX_ROUND(EXT2_DX_F, d, a, b, c, in[5], 7);
+    EXT2_DX_ROUND(EXT2_DX_F, c, d, a, b, in[6], 11);
+    EXT2_DX_ROUND(EXT2_DX_F, b, c, d, a, in[7], 19);
+
+    EXT2_DX_ROUND(EXT2_DX_G, a, b, c, d, in[1] + EXT2_DX_MD4_K2, 3);
+    EXT2_DX_ROUND(EXT2_DX_G, d, a, b, c, in[3] + EXT2_DX_MD4_K2, 5);
+    EXT2_DX_ROUND(EXT2_DX_G, c, d, a, b, in[5] + EXT2_DX_MD4_K2, 9);
+    EXT2_DX_ROUND(EXT2_DX_G, b, c, d, a, in[7] + EXT2_DX_MD4_K2, 13);
+    EXT2_DX_ROUND(EXT2_DX_G, a, b, c, d, in[0] + EXT2_DX_MD4_K2, 3);
+    EXT2_DX_ROUND(EXT2_DX_G, d, a, b, c, in[2] + EXT2_DX_MD4_K2, 5);
+    EXT2_DX_ROUND(EXT2_DX_G, c, d, a, b, in[4] + EXT2_DX_MD4_K2, 9);
+    EXT2_DX_ROUND(EXT2_DX_G, b, c, d, a, in[6] + EXT2_DX_MD4_K2, 13);
+
+    EXT2_DX_ROUND(EXT2_DX_H, a, b, c, d, in[3] + EXT2_DX_MD4_K3, 3);
+    EXT2_DX_ROUND(EXT2_DX_H, d, a, b, c, in[7] + EXT2_DX_MD4_K3, 9);
+    EXT2_DX_ROUND(EXT2_DX_H, c, d, a, b, in[2] + EXT2_DX_MD4_K3, 11);
+    EXT2_DX_ROUND(EXT2_DX_H, b, c, d, a, in[6] + EXT2_DX_MD4_K3, 15);
+    EXT2_DX_ROUND(EXT2_DX_H, a, b, c, d, in[1] + EXT2_DX_MD4_K3, 3);
+    EXT2_DX_ROUND(EXT2_DX_H, d, a, b, c, in[5] + EXT2_DX_MD4_K3, 9);
+    EXT2_DX_ROUND(EXT2_DX_H, c, d, a, b, in[0] + EXT2_DX_MD4_K3, 11);
+    EXT2_DX_ROUND(EXT2_DX_H, b, c, d, a, in[4] + EXT2_DX_MD4_K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+static inline int _ext2_dx_char(const char* str, int i, bool is_unsigned)
+{
+    return is_unsigned ? (int)(uint8_t)str[i] : (int)(int8_t)str[i];
+}
+
+static uint32_t _ext2_dx_legacy_hash(const char* name, uint32_t len, bool is_unsigned)
+{
+    uint32_t hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+    for (int i = 0; i < len; i++) {
+        hash = hash1 + (hash0 ^ (uint32_t)(_ext2_dx_char(name, i, is_unsigned) * 7152373));
+        if (hash & 0x80000000) {
+            hash -= 0x7fffffff;
+        }
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+static void _ext2_dx_str2hashbuf(const char* msg, int len, uint32_t* buf, int num, bool is_unsigned)
+{
+    uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+    pad |= pad << 16;
+
+    uint32_t val = pad;
+    if (len > num * 4) {
+        len = num * 4;
+    }
+    for (int i = 0; i < len; i++) {
+        val = (uint32_t)_ext2_dx_char(msg, i, is_unsigned) + (val << 8);
+        if ((i % 4) == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0) {
+        *buf++ = val;
+    }
+    while (--num >= 0) {
+        *buf++ = pad;
+    }
+}
+
+/**
+ * _ext2_dx_hash computes the hash of a name the same way as Linux does.
+ * @hash_version: version of the hash with EXT2_FLAGS_UNSIGNED_HASH applied.
+ */
+static int _ext2_dx_hash(superblock_t* sb, uint8_t hash_version, const char* name, uint32_t len, uint32_t* result)
+{
+    uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    uint32_t in[8];
+    uint32_t hash;
+
+    if (sb->hash_seed[0] || sb->hash_seed[1] || sb->hash_seed[2] || sb->hash_seed[3]) {
+        memcpy(buf, sb->hash_seed, sizeof(buf));
+    }
+
+    bool is_unsigned = (hash_version >= EXT2_DX_HASH_LEGACY_UNSIGNED);
+    switch (hash_version) {
+    case EXT2_DX_HASH_LEGACY:
+    case EXT2_DX_HASH_LEGACY_UNSIGNED:
+        hash = _ext2_dx_legacy_hash(name, len, is_unsigned);
+        break;
+    case EXT2_DX_HASH_HALF_MD4:
+    case EXT2_DX_HASH_HALF_MD4_UNSIGNED:
+        for (int left = len; left > 0; left -= 32, name += 32) {
+            _ext2_dx_str2hashbuf(name, left, in, 8, is_unsigned);
+            _ext2_dx_half_md4_transform(buf, in);
+        }
+        hash = buf[1];
+        break;
+    case EXT2_DX_HASH_TEA:
+    case EXT2_DX_HASH_TEA_UNSIGNED:
+        for (int left = len; left > 0; left -= 16, name += 16) {
+            _ext2_dx_str2hashbuf(name, left, in, 4, is_unsigned);
+            _ext2_dx_tea_transform(buf, in);
+        }
+        hash = buf[0];
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    hash &= ~1;
+    if (hash == (EXT2_DX_HASH_EOF << 1)) {
+        hash = (EXT2_DX_HASH_EOF - 1) << 1;
+    }
+    *result = hash;
+    return 0;
+}
+
+static inline bool _ext2_dx_is_indexed(dentry_t* dir)
+{
+    return (dir->fsdata.sb->feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) && (dir->inode->flags & EXT2_INDEX_FL);
+}
+
+/**
+ * _ext2_dx_drop_index turns the dir into a linear one. The tree is hidden
+ * inside of the ".." entry and interior nodes look like empty blocks, so
+ * nothing else has to be changed. fsck can rebuild the index later.
+ */
+static void _ext2_dx_drop_index(dentry_t* dir)
+{
+    dir->inode->flags &= ~EXT2_INDEX_FL;
+    dentry_set_flag(dir, DENTRY_DIRTY);
+}
+
+/**
+ * _ext2_dx_probe walks the tree from the root to the leaf which covers
+ * the hash of the name. Returns -EINVAL if the tree can't be used.
+ * @buf: a buffer of a block len, keeps the lowest node on return.
+ */
+static int _ext2_dx_probe(dentry_t* dir, const char* name, uint32_t len, uint8_t* buf, ext2_dx_path_t* path)
+{
+    superblock_t* sb = dir->fsdata.sb;
+    const uint32_t block_len = BLOCK_LEN(sb);
+
+    uint32_t node_block = _ext2_get_block_of_inode(dir, 0);
+    if (!node_block) {
+        return -EINVAL;
+    }
+    _ext2_read_from_dev(dir->dev, buf, _ext2_get_block_offset(sb, node_block), block_len);
+
+    dx_root_info_t* info = (dx_root_info_t*)&buf[EXT2_DX_ROOT_INFO_OFFSET];
+    if (info->reserved_zero != 0 || info->indirect_levels >= EXT2_DX_MAX_LEVELS) {
+        return -EINVAL;
+    }
+
+    path->hash_version = info->hash_version;
+    if (path->hash_version <= EXT2_DX_HASH_TEA && (sb->flags & EXT2_FLAGS_UNSIGNED_HASH)) {
+        path->hash_version += EXT2_DX_HASH_LEGACY_UNSIGNED;
+    }
+    if (_ext2_dx_hash(sb, path->hash_version, name, len, &path->hash) < 0) {
+        return -EINVAL;
+    }
+
+    uint32_t levels = info->indirect_levels;
+    uint32_t entries_offset = EXT2_DX_ROOT_INFO_OFFSET + info->info_length;
+    for (;;) {
+        dx_countlimit_t* countlimit = (dx_countlimit_t*)&buf[entries_offset];
+        dx_entry_t* entries = (dx_entry_t*)countlimit;
+        if (countlimit->count == 0 || countlimit->count > countlimit->limit || entries_offset + countlimit->limit * sizeof(dx_entry_t) > block_len) {
+            return -EINVAL;
+        }
+
+        /* Looking for the last entry with hash <= path->hash, the first one covers all smaller hashes. */
+        int left = 1, right = countlimit->count - 1;
+        while (left <= right) {
+            int mid = (left + right) / 2;
+            if (entries[mid].hash > path->hash) {
+                right = mid - 1;
+            } else {
+                left = mid + 1;
+            }
+        }
+
+        uint32_t at = left - 1;
+        uint32_t next_block = entries[at].block & EXT2_DX_BLOCK_MASK;
+        if (levels == 0) {
+            path->node_block = node_block;
+            path->entries_offset = entries_offset;
+            path->at = at;
+            path->leaf = next_block;
+            return 0;
+        }
+
+        levels--;
+        node_block = _ext2_get_block_of_inode(dir, next_block);
+        if (!node_block) {
+            return -EINVAL;
+        }
+        _ext2_read_from_dev(dir->dev, buf, _ext2_get_block_offset(sb, node_block), block_len);
+        entries_offset = EXT2_DX_NODE_ENTRIES_OFFSET;
+    }
+}
+
+/**
+ * Names with the same hash could be split between 2 leaves, in such case
+ * the hash of the next entry has the lowest bit set. Only the next entry of
+ * the same node is checked.
+ */
+static bool _ext2_dx_next_leaf(uint8_t* node, ext2_dx_path_t* path)
+{
+    dx_countlimit_t* countlimit = (dx_countlimit_t*)&node[path->entries_offset];
+    dx_entry_t* entries = (dx_entry_t*)countlimit;
+    if (path->at + 1 >= countlimit->count || (entries[path->at + 1].hash & ~1) != path->hash) {
+        return false;
+    }
+
+    path->at++;
+    path->leaf = entries[path->at].block & EXT2_DX_BLOCK_MASK;
+    return true;
+}
+
+static int _ext2_dx_lookup(dentry_t* dir, const char* name, uint32_t len, uint32_t* found_inode_index)
+{
+    ext2_dx_path_t path;
+    uint8_t* node = kmalloc(BLOCK_LEN(dir->fsdata.sb));
+    if (!node) {
+        return -EINVAL;
+    }
+
+    int err = _ext2_dx_probe(dir, name, len, node, &path);
+    if (err) {
+        kfree(node);
+        return err;
+    }
+
+    do {
+        uint32_t leaf_block = _ext2_get_block_of_inode(dir, path.leaf);
+        if (_ext2_lookup_block(dir->dev, dir->fsdata, leaf_block, name, len, found_inode_index) == 0) {
+            kfree(node);
+            return 0;
+        }
+    } while (_ext2_dx_next_leaf(node, &path));
+
+    kfree(node);
+    return -ENOENT;
+}
+
+/**
+ * _ext2_dx_split_leaf moves the upper half (by hash) of entries of the leaf
+ * to a new block of the dir.
+ * @node: the lowest node of the path, the new leaf is inserted into it.
+ * @split_hash: the smallest hash which lives in the new leaf.
+ */
+static int _ext2_dx_split_leaf(dentry_t* dir, uint8_t* node, ext2_dx_path_t* path, uint32_t leaf_block, uint32_t* split_hash, uint32_t* new_leaf_block)
+{
+    superblock_t* sb = dir->fsdata.sb;
+    const uint32_t block_len = BLOCK_LEN(sb);
+    const uint32_t max_entries = block_len / 12;
+    int err = -EFAULT;
+
+    uint8_t* leaf = kmalloc(block_len);
+    uint8_t* res = kmalloc(block_len);
+    ext2_dx_map_entry_t* map = kmalloc(max_entries * sizeof(ext2_dx_map_entry_t));
+    if (!leaf || !res || !map) {
+        goto free_bufs;
+    }
+
+    _ext2_read_from_dev(dir->dev, leaf, _ext2_get_block_offset(sb, leaf_block), block_len);
+    uint32_t count = 0;
+    for (uint32_t offset = 0; offset < block_len && count < max_entries;) {
+        dir_entry_t* entry = (dir_entry_t*)&leaf[offset];
+        if (entry->rec_len == 0) {
+            goto free_bufs;
+        }
+        if (entry->inode != 0) {
+            map[count].offset = offset;
+            if (_ext2_dx_hash(sb, path->hash_version, (char*)entry + 8, entry->name_len, &map[count].hash) < 0) {
+                goto free_bufs;
+            }
+            count++;
+        }
+        offset += entry->rec_len;
+    }
+    if (count < 2) {
+        goto free_bufs;
+    }
+
+    /* Sorting entries by hash, leaves are small, so insertion sort is enough. */
+    for (int i = 1; i < count; i++) {
+        ext2_dx_map_entry_t tmp = map[i];
+        int j = i - 1;
+        for (; j >= 0 && map[j].hash > tmp.hash; j--) {
+            map[j + 1] = map[j];
+        }
+        map[j + 1] = tmp;
+    }
+
+    uint32_t split = count / 2;
+    bool continued = (map[split].hash == map[split - 1].hash);
+    *split_hash = map[split].hash;
+
+    uint32_t new_leaf = TO_EXT_BLOCKS_CNT(sb, dir->inode->blocks);
+    if (_ext2_allocate_block_for_inode(dir, new_leaf_block) < 0) {
+        err = -ENOSPC;
+        goto free_bufs;
+    }
+    dir->inode->size += block_len;
+
+    /* Writing both halves compacted, the last entry of a block covers the rest of it. */
+    for (int part = 0; part < 2; part++) {
+        uint32_t from = part ? split : 0;
+        uint32_t to = part ? count : split;
+        uint32_t res_offset = 0;
+        dir_entry_t* last_entry = NULL;
+
+        memset(res, 0, block_len);
+        for (uint32_t i = from; i < to; i++) {
+            dir_entry_t* entry = (dir_entry_t*)&leaf[map[i].offset];
+            uint32_t rec_len = 8 + NORM_FILENAME(entry->name_len);
+            memcpy(&res[res_offset], entry, rec_len);
+            last_entry = (dir_entry_t*)&res[res_offset];
+            last_entry->rec_len = rec_len;
+            res_offset += rec_len;
+        }
+        last_entry->rec_len += block_len - res_offset;
+        _ext2_write_to_dev(dir->dev, res, _ext2_get_block_offset(sb, part ? *new_leaf_block : leaf_block), block_len);
+    }
+
+    /* Inserting the new leaf right after the split one. */
+    dx_countlimit_t* countlimit = (dx_countlimit_t*)&node[path->entries_offset];
+    dx_entry_t* entries = (dx_entry_t*)countlimit;
+    for (uint32_t i = countlimit->count; i > path->at + 1; i--) {
+        entries[i] = entries[i - 1];
+    }
+    entries[path->at + 1].hash = *split_hash + continued;
+    entries[path->at + 1].block = new_leaf;
+    countlimit->count++;
+    _ext2_write_to_dev(dir->dev, node, _ext2_get_block_offset(sb, path->node_block), block_len);
+    err = 0;
+
+free_bufs:
+    if (leaf) {
+        kfree(leaf);
+    }
+    if (res) {
+        kfree(res);
+    }
+    if (map) {
+        kfree(map);
+    }
+    return err;
+}
+
+/**
+ * _ext2_dx_add_child puts the entry into the leaf which covers its hash,
+ * splitting the leaf if it's full. Returns an error if the tree can't be
+ * kept, the caller should drop the index then.
+ */
+static int _ext2_dx_add_child(dentry_t* dir, dentry_t* child_dentry, const char* name, uint32_t len)
+{
+    ext2_dx_path_t path;
+    uint8_t* node = kmalloc(BLOCK_LEN(dir->fsdata.sb));
+    if (!node) {
+        return -EINVAL;
+    }
+
+    int err = _ext2_dx_probe(dir, name, len, node, &path);
+    if (err) {
+        goto free_node;
+    }
+
+    uint32_t leaf_block = _ext2_get_block_of_inode(dir, path.leaf);
+    if (!leaf_block) {
+        err = -EINVAL;
+        goto free_node;
+    }
+
+    if (_ext2_add_to_dir_block(dir->dev, dir->fsdata, leaf_block, child_dentry, name, len) == 0) {
+        err = 0;
+        goto free_node;
+    }
+
+    dx_countlimit_t* countlimit = (dx_countlimit_t*)&node[path.entries_offset];
+    if (countlimit->count >= countlimit->limit) {
+        /* FIXME: Splitting of index nodes is unsupported. */
+        err = -ENOSPC;
+        goto free_node;
+    }
+
+    uint32_t split_hash, new_leaf_block;
+    err = _ext2_dx_split_leaf(dir, node, &path, leaf_block, &split_hash, &new_leaf_block);
+    if (err) {
+        goto free_node;
+    }
+
+    uint32_t target_block = (path.hash >= split_hash) ? new_leaf_block : leaf_block;
+    err = _ext2_add_to_dir_block(dir->dev, dir->fsdata, target_block, child_dentry, name, len);
+
+free_node:
+    kfree(node);
+    return err;
+}
+
 static int _ext2_add_child(dentry_t* dir, dentry_t* child_dentry, const char* name, int len)
 {
     uint32_t block_index;
     uint32_t blocks_per_dir = TO_EXT_BLOCKS_CNT(dir->fsdata.sb, dir->inode->blocks);
 
+    if (_ext2_dx_is_indexed(dir)) {
+        if (_ext2_dx_add_child(dir, child_dentry, name, len) == 0) {
+            goto updated_inode;
+        }
+        /* The root of the tree would be overwritten by a linear add. */
+        _ext2_dx_drop_index(dir);
+    }
+
     for (int i = 0; i < blocks_per_dir; i++) {
         if ((block_index = _ext2_get_block_of_inode(dir, i))) {
             if (_ext2_add_to_dir_block(dir->dev, dir->fsdata, block_index, child_dentry, name, len) == 0) {
@@ -733,9 +1436,8 @@ static int _ext2_add_child(dentry_t* dir, dentry_t* child_dentry, const char* na
         }
     }
 
-    // FIXME: group
     uint32_t new_block_index;
-    if (_ext2_allocate_block_for_inode(dir, 0, &new_block_index) == 0) {
+    if (_ext2_allocate_block_for_inode(dir, &new_block_index) == 0) {
         if (_ext2_add_first_entry_to_dir_block(dir->dev, dir->fsdata, new_block_index, child_dentry, name, len) == 0) {
             goto updated_inode;
         }
@@ -816,14 +1518,14 @@ bool ext2_can_write(dentry_t* dentry, uint32_t start)
 
 int ext2_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
-    lock_acquire(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
     const uint32_t block_len = BLOCK_LEN(dentry->fsdata.sb);
     uint32_t blocks_allocated = TO_EXT_BLOCKS_CNT(dentry->fsdata.sb, dentry->inode->blocks);
     uint32_t start_block_index = start / block_len;
     uint32_t end_block_index = min((start + len - 1) / block_len, blocks_allocated - 1);
 
     if (start >= dentry->inode->size) {
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
         return 0;
     }
 
@@ -831,22 +1533,54 @@ int ext2_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
     uint32_t read_offset = start % block_len;
     uint32_t already_read = 0;
 
-    for (uint32_t virt_block_index = start_block_index; virt_block_index <= end_block_index; virt_block_index++) {
-        uint32_t data_block_index = _ext2_get_block_of_inode(dentry, virt_block_index);
-        uint32_t read_from_block = min(have_to_read, block_len - read_offset);
-        _ext2_read_from_dev(dentry->dev, buf + already_read, _ext2_get_block_offset(dentry->fsdata.sb, data_block_index) + read_offset, read_from_block);
-        have_to_read -= read_from_block;
-        already_read += read_from_block;
+    /* Blocks which lie contiguously on the disk are read with one request. */
+    for (uint32_t virt_block_index = start_block_index, run_len; virt_block_index <= end_block_index; virt_block_index += run_len) {
+        uint32_t data_block_index = _ext2_get_block_run_of_inode(dentry, virt_block_index, &run_len);
+        run_len = min(run_len, end_block_index - virt_block_index + 1);
+        uint32_t read_from_run = min(have_to_read, run_len * block_len - read_offset);
+        _ext2_read_from_dev(dentry->dev, buf + already_read, _ext2_get_block_offset(dentry->fsdata.sb, data_block_index) + read_offset, read_from_run);
+        have_to_read -= read_from_run;
+        already_read += read_from_run;
         read_offset = 0;
     }
 
-    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
     return already_read;
 }
 
+/**
+ * Brings blocks of the file to bcache for read-ahead of vfs, runs of
+ * blocks which lie contiguously on the disk are fetched together.
+ */
+int ext2_readahead(dentry_t* dentry, uint32_t start, uint32_t len)
+{
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    const uint32_t block_len = BLOCK_LEN(dentry->fsdata.sb);
+    uint32_t blocks_allocated = TO_EXT_BLOCKS_CNT(dentry->fsdata.sb, dentry->inode->blocks);
+    if (start >= dentry->inode->size || !blocks_allocated || !len) {
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+        return 0;
+    }
+
+    len = min(len, dentry->inode->size - start);
+    uint32_t start_block_index = start / block_len;
+    uint32_t end_block_index = min((start + len - 1) / block_len, blocks_allocated - 1);
+    for (uint32_t virt_block_index = start_block_index, run_len; virt_block_index <= end_block_index; virt_block_index += run_len) {
+        uint32_t data_block_index = _ext2_get_block_run_of_inode(dentry, virt_block_index, &run_len);
+        if (!data_block_index) {
+            break;
+        }
+        run_len = min(run_len, end_block_index - virt_block_index + 1);
+        bcache_prefetch(dentry->dev->dev, _ext2_get_block_offset(dentry->fsdata.sb, data_block_index), run_len * block_len);
+    }
+
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    return 0;
+}
+
 int ext2_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
-    lock_acquire(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
     const uint32_t block_len = BLOCK_LEN(dentry->fsdata.sb);
     uint32_t start_block_index = start / block_len;
     uint32_t end_block_index = (start + len) / block_len;
@@ -859,7 +1593,7 @@ int ext2_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
         uint32_t write_to_block = min(to_write, block_len - write_offset);
 
         if (blocks_allocated <= virt_block_index) {
-            _ext2_allocate_block_for_inode(dentry, 0, &data_block_index);
+            _ext2_allocate_block_for_inode(dentry, &data_block_index);
         } else {
             data_block_index = _ext2_get_block_of_inode(dentry, virt_block_index);
         }
@@ -876,15 +1610,15 @@ int ext2_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
     dentry->inode->mtime = (uint32_t)timeman_now();
     dentry_set_flag(dentry, DENTRY_DIRTY);
 
-    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
     return already_written;
 }
 
 int ext2_truncate(dentry_t* dentry, uint32_t len)
 {
-    lock_acquire(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
     if (dentry->inode->size <= len) {
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
         return 0;
     }
 
@@ -899,36 +1633,53 @@ int ext2_truncate(dentry_t* dentry, uint32_t len)
         _ext2_free_block_index(dentry->dev, dentry->fsdata, block_index);
     }
 
+    _ext2_bmap_invalidate(dentry);
+    _ext2_drop_reserve_window(dentry);
     dentry->inode->size = len;
     dentry->inode->mtime = (uint32_t)timeman_now();
     dentry_set_flag(dentry, DENTRY_DIRTY);
-    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
     return 0;
 }
 
 int ext2_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result)
 {
-    lock_acquire(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    if (_ext2_dx_is_indexed(dir)) {
+        uint32_t res_inode_indx = 0;
+        int err = _ext2_dx_lookup(dir, name, len, &res_inode_indx);
+        if (err == 0) {
+            *result = dentry_get(dir->dev_indx, res_inode_indx);
+            krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+            return 0;
+        }
+        if (err == -ENOENT) {
+            krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+            return -ENOENT;
+        }
+        /* The tree can't be used, but the dir is still readable linearly. */
+    }
+
     uint32_t block_per_dir = TO_EXT_BLOCKS_CNT(dir->fsdata.sb, dir->inode->blocks);
     for (int block_index = 0; block_index < block_per_dir; block_index++) {
         uint32_t data_block_index = _ext2_get_block_of_inode(dir, block_index);
         uint32_t res_inode_indx = 0;
         if (_ext2_lookup_block(dir->dev, dir->fsdata, data_block_index, name, len, &res_inode_indx) == 0) {
             *result = dentry_get(dir->dev_indx, res_inode_indx);
-            lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+            krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
             return 0;
         }
     }
-    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
     return -ENOENT;
 }
 
 int ext2_mkdir(dentry_t* dir, const char* name, uint32_t len, mode_t mode, uid_t uid, gid_t gid)
 {
-    lock_acquire(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
     uint32_t new_dir_inode_indx = 0;
     if (_ext2_allocate_inode_index(dir->dev, dir->fsdata, &new_dir_inode_indx, 0) < 0) {
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
         return -ENOSPC;
     }
 
@@ -936,70 +1687,70 @@ int ext2_mkdir(dentry_t* dir, const char* name, uint32_t len, mode_t mode, uid_t
 
     if (_ext2_setup_dir(new_dir, dir, mode, uid, gid) < 0) {
         dentry_put(new_dir);
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
         return -EFAULT;
     }
     if (_ext2_add_child(dir, new_dir, name, len) < 0) {
         dentry_put(new_dir);
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
         return -EFAULT;
     }
 
     dentry_put(new_dir);
-    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
     return 0;
 }
 
 int ext2_rmdir(dentry_t* dir)
 {
-    lock_acquire(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
     dentry_t* parent_dir = dentry_get_parent(dir);
 
     if (!parent_dir) {
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
         return -EPERM;
     }
 
     if (_ext2_is_dir_empty(dir)) {
         if (_ext2_rm_child(parent_dir, dir) < 0) {
-            lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+            krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
             return -EFAULT;
         }
         parent_dir->inode->links_count--;
         dir->inode->links_count--;
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
         return 0;
     }
 
-    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
     return -ENOTEMPTY;
 }
 
 int ext2_getdirent(dentry_t* dir, uint32_t* offset, dirent_t* res)
 {
-    lock_acquire(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
     const uint32_t block_len = BLOCK_LEN(dir->fsdata.sb);
     uint32_t blocks_per_dir = TO_EXT_BLOCKS_CNT(dir->fsdata.sb, dir->inode->blocks);
     if (*offset >= blocks_per_dir * block_len) {
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
         return -1;
     }
 
     for (uint32_t block_index = *offset / block_len; block_index < blocks_per_dir; block_index++) {
         uint32_t data_block_index = _ext2_get_block_of_inode(dir, block_index);
         if (_ext2_getdirent_block(dir->dev, dir->fsdata, data_block_index, offset, res) == 0) {
-            lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+            krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
             return 0;
         }
     }
 
-    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
     return 0;
 }
 
 int ext2_getdents(dentry_t* dentry, uint8_t* buf, uint32_t* offset, uint32_t len)
 {
-    lock_acquire(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
     const uint32_t block_len = BLOCK_LEN(dentry->fsdata.sb);
     uint32_t start_block_index = *offset / block_len;
     uint32_t end_block_index = TO_EXT_BLOCKS_CNT(dentry->fsdata.sb, dentry->inode->blocks);
@@ -1011,7 +1762,7 @@ int ext2_getdents(dentry_t* dentry, uint8_t* buf, uint32_t* offset, uint32_t len
         uint32_t read_from_block = min(len, block_len - read_offset);
         int act_read = _ext2_getdents_block(dentry->dev, dentry->fsdata, data_block_index, buf + already_read, read_from_block, read_offset, offset);
         if (act_read < 0) {
-            lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+            krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
             if (already_read == 0) {
                 return act_read;
             }
@@ -1022,81 +1773,81 @@ int ext2_getdents(dentry_t* dentry, uint8_t* buf, uint32_t* offset, uint32_t len
         read_offset = 0;
     }
 
-    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
     return already_read;
 }
 
 int ext2_create(dentry_t* dir, const char* name, uint32_t len, mode_t mode, uid_t uid, gid_t gid)
 {
-    lock_acquire(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
     uint32_t new_file_inode_indx = 0;
     if (_ext2_allocate_inode_index(dir->dev, dir->fsdata, &new_file_inode_indx, 0) < 0) {
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
         return -ENOSPC;
     }
     dentry_t* new_file = dentry_get(dir->dev_indx, new_file_inode_indx);
 
     if (_ext2_setup_file(new_file, mode, uid, gid) < 0) {
         dentry_put(new_file);
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
         return -EFAULT;
     }
 
     if (_ext2_add_child(dir, new_file, name, len) < 0) {
         dentry_put(new_file);
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
         return -EFAULT;
     }
 
     dentry_put(new_file);
-    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dir));
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dir));
     return 0;
 }
 
 int ext2_rm(dentry_t* dentry)
 {
-    lock_acquire(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    krwlock_write_lock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
     dentry_t* parent_dir = dentry_get_parent(dentry);
 
     if (!parent_dir) {
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
         return -EPERM;
     }
 
     if (_ext2_rm_child(parent_dir, dentry) < 0) {
-        lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+        krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
         return -EFAULT;
     }
 
-    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+    krwlock_write_unlock(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
     return 0;
 }
 
 int ext2_recognize_drive(vfs_device_t* dev)
 {
-    lock_acquire(&VFS_DEVICE_LOCK);
+    krwlock_write_lock(&VFS_DEVICE_LOCK);
     superblock_t* superblock = (superblock_t*)kmalloc(SUPERBLOCK_LEN);
     _ext2_read_from_dev(dev, (uint8_t*)superblock, SUPERBLOCK_START, SUPERBLOCK_LEN);
 
     if (superblock->magic != 0xEF53) {
         kfree(superblock);
-        lock_release(&VFS_DEVICE_LOCK);
+        krwlock_write_unlock(&VFS_DEVICE_LOCK);
         return -EINVAL;
     }
     if (superblock->rev_level != 0) {
         kfree(superblock);
-        lock_release(&VFS_DEVICE_LOCK);
+        krwlock_write_unlock(&VFS_DEVICE_LOCK);
         return -EINVAL;
     }
 
     kfree(superblock);
-    lock_release(&VFS_DEVICE_LOCK);
+    krwlock_write_unlock(&VFS_DEVICE_LOCK);
     return 0;
 }
 
 int ext2_prepare_fs(vfs_device_t* dev)
 {
-    lock_acquire(&VFS_DEVICE_LOCK);
+    krwlock_write_lock(&VFS_DEVICE_LOCK);
     superblock_t* superblock = (superblock_t*)kmalloc(SUPERBLOCK_LEN);
     _ext2_read_from_dev(dev, (uint8_t*)superblock, SUPERBLOCK_START, SUPERBLOCK_LEN);
     _ext2_superblocks[dev->dev->id] = superblock;
@@ -1108,15 +1859,15 @@ int ext2_prepare_fs(vfs_device_t* dev)
 
     _ext2_group_table_info[dev->dev->id].count = groups_cnt;
     _ext2_group_table_info[dev->dev->id].table = group_table;
-    lock_release(&VFS_DEVICE_LOCK);
+    krwlock_write_unlock(&VFS_DEVICE_LOCK);
     return 0;
 }
 
 int ext2_save_state(vfs_device_t* dev)
 {
-    lock_acquire(&VFS_DEVICE_LOCK);
+    krwlock_write_lock(&VFS_DEVICE_LOCK);
     if (!_ext2_superblocks[dev->dev->id]) {
-        lock_release(&VFS_DEVICE_LOCK);
+        krwlock_write_unlock(&VFS_DEVICE_LOCK);
         return -1;
     }
 
@@ -1129,7 +1880,7 @@ int ext2_save_state(vfs_device_t* dev)
 
     _ext2_write_to_dev(dev, (uint8_t*)superblock, SUPERBLOCK_START, SUPERBLOCK_LEN);
     kfree(superblock);
-    lock_release(&VFS_DEVICE_LOCK);
+    krwlock_write_unlock(&VFS_DEVICE_LOCK);
     return 0;
 }
 
@@ -1179,11 +1930,14 @@ driver_desc_t _ext2_driver_info()
     fs_desc.functions[DRIVER_FILE_SYSTEM_FSTAT] = NULL;
     fs_desc.functions[DRIVER_FILE_SYSTEM_IOCTL] = NULL;
     fs_desc.functions[DRIVER_FILE_SYSTEM_MMAP] = NULL;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_READAHEAD] = ext2_readahead;
 
     return fs_desc;
 }
 
 void ext2_install()
 {
+    lock_init(&_ext2_bmap_lock);
+    lock_init(&_ext2_reserve_lock);
     driver_install(_ext2_driver_info(), "ext2");
 }
\ No newline at end of file
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <fs/initramfs.h>
+#include <fs/vfs.h>
+#include <libkern/bits/errno.h>
+#include <libkern/c_attrs.h>
+#include <libkern/libkern.h>
+#include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+
+#define CPIO_NEWC_MAGIC "070701"
+#define CPIO_TRAILER "TRAILER!!!"
+#define CPIO_ALIGN(x) (((x) + 3) & ~(uint32_t)3)
+
+struct PACKED cpio_newc_header {
+    char magic[6];
+    char ino[8];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char nlink[8];
+    char mtime[8];
+    char filesize[8];
+    char devmajor[8];
+    char devminor[8];
+    char rdevmajor[8];
+    char rdevminor[8];
+    char namesize[8];
+    char check[8];
+};
+typedef struct cpio_newc_header cpio_newc_header_t;
+
+static uint32_t _initramfs_paddr = 0;
+static uint32_t _initramfs_size = 0;
+
+static uint32_t _initramfs_hex(const char* str)
+{
+    uint32_t res = 0;
+    for (int i = 0; i < 8; i++) {
+        char c = str[i];
+        res <<= 4;
+        if (c >= '0' && c <= '9') {
+            res |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            res |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            res |= c - 'A' + 10;
+        }
+    }
+    return res;
+}
+
+static int _initramfs_unpack_entry(char* path, mode_t mode, uid_t uid, gid_t gid, uint8_t* data, uint32_t size)
+{
+    while (path[0] == '.' && path[1] == '/') {
+        path += 2;
+    }
+    while (path[0] == '/') {
+        path++;
+    }
+    uint32_t path_len = strlen(path);
+    if (!path_len || (path_len == 1 && path[0] == '.')) {
+        return 0;
+    }
+
+    char* name = vfs_helper_split_path_with_name(path, path_len);
+    uint32_t name_len = strlen(name);
+    dentry_t* dir;
+    int err = vfs_resolve_path(path, &dir);
+    if (err) {
+        kfree(name);
+        return err;
+    }
+
+    if (mode & S_IFDIR) {
+        err = vfs_mkdir(dir, name, name_len, mode & 07777, uid, gid);
+        if (err == -EEXIST) {
+            err = 0;
+        }
+    } else if (mode & S_IFREG) {
+        err = vfs_create(dir, name, name_len, mode, uid, gid);
+        dentry_t* file;
+        if (!err && size && vfs_lookup(dir, name, name_len, &file) == 0) {
+            int written = file->ops->file.write(file, data, 0, size);
+            if (written != size) {
+                err = written < 0 ? written : -ENOSPC;
+            }
+            dentry_put(file);
+        }
+    } else {
+        log_warn("initramfs: %s/%s: only files and dirs are supported", path, name);
+    }
+
+    dentry_put(dir);
+    kfree(name);
+    return err;
+}
+
+static int _initramfs_unpack(uint8_t* image, uint32_t size)
+{
+    uint32_t offset = 0;
+    while (offset + sizeof(cpio_newc_header_t) <= size) {
+        cpio_newc_header_t* header = (cpio_newc_header_t*)&image[offset];
+        if (memcmp(header->magic, CPIO_NEWC_MAGIC, 6) != 0) {
+            return -EINVAL;
+        }
+
+        uint32_t namesize = _initramfs_hex(header->namesize);
+        uint32_t filesize = _initramfs_hex(header->filesize);
+        uint32_t name_offset = offset + sizeof(cpio_newc_header_t);
+        uint32_t data_offset = CPIO_ALIGN(name_offset + namesize);
+        if (!namesize || data_offset + filesize > size) {
+            return -EINVAL;
+        }
+
+        char* path = (char*)&image[name_offset];
+        path[namesize - 1] = '\0';
+        if (strcmp(path, CPIO_TRAILER) == 0) {
+            return 0;
+        }
+
+        mode_t mode = _initramfs_hex(header->mode);
+        int err = _initramfs_unpack_entry(path, mode, _initramfs_hex(header->uid), _initramfs_hex(header->gid), &image[data_offset], filesize);
+        if (err) {
+            log_warn("initramfs: can't unpack %s: %d", path, err);
+        }
+        offset = CPIO_ALIGN(data_offset + filesize);
+    }
+    return -EINVAL;
+}
+
+/**
+ * Called right after pmm_setup, which keeps the image away from allocations.
+ */
+void initramfs_setup(mem_desc_t* mem_desc)
+{
+    _initramfs_paddr = mem_desc->initrd_start;
+    _initramfs_size = mem_desc->initrd_size;
+}
+
+static void _initramfs_mount_disk(int disk_dev_indx)
+{
+    dentry_t* root;
+    if (vfs_resolve_path("/", &root) < 0) {
+        return;
+    }
+    const char* name = &INITRAMFS_DISK_PATH[1];
+    vfs_mkdir(root, name, strlen(name), 0755, 0, 0);
+    dentry_put(root);
+
+    dentry_t* mp;
+    if (vfs_resolve_path(INITRAMFS_DISK_PATH, &mp) < 0) {
+        return;
+    }
+    if (vfs_mount_dev(mp, disk_dev_indx) < 0) {
+        log_warn("initramfs: can't mount the disk at %s", INITRAMFS_DISK_PATH);
+    }
+    dentry_put(mp);
+}
+
+/**
+ * The pages of the image are given back in any case, the files are copied
+ * out of them.
+ */
+int initramfs_mount()
+{
+    if (!_initramfs_size) {
+        return -ENOENT;
+    }
+
+    uint32_t pages = (_initramfs_size + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    zone_t zone = zoner_new_zone(pages * VMM_PAGE_SIZE);
+    vmm_map_pages(zone.start, _initramfs_paddr, pages, PAGE_READABLE | PAGE_WRITABLE);
+
+    int err = -ENOENT;
+    int fs_indx = vfs_get_fs_id("tmpfs");
+    if (fs_indx >= 0 && memcmp(zone.ptr, CPIO_NEWC_MAGIC, 6) == 0) {
+        /* -ENOENT means there is no disk, anything else means the root stays. */
+        int disk_dev_indx = vfs_switch_root(new_virtual_device(DEVICE_STORAGE), fs_indx);
+        err = disk_dev_indx;
+        if (disk_dev_indx >= 0 || disk_dev_indx == -ENOENT) {
+            err = _initramfs_unpack(zone.ptr, _initramfs_size);
+            log("initramfs: unpacked, %d KB, res %d", _initramfs_size / KB, err);
+        }
+        if (disk_dev_indx >= 0) {
+            _initramfs_mount_disk(disk_dev_indx);
+        }
+    }
+
+    vmm_unmap_pages(zone.start, pages);
+    zoner_free_zone(zone);
+    pmm_free((void*)_initramfs_paddr, _initramfs_size);
+    _initramfs_size = 0;
+    return err;
+}
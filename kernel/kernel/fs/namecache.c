@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <fs/namecache.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/seqcount.h>
+
+struct namecache_entry {
+    bool valid;
+    bool referenced; /* Set by lockless hits, gives the entry a second chance. */
+    uint32_t dev_indx;
+    uint32_t dir_indx;
+    uint32_t inode_indx; /* NAMECACHE_NEGATIVE if there is no such name. */
+    uint32_t hash;
+    uint32_t len;
+    char name[NAMECACHE_MAX_NAME];
+
+    struct namecache_entry* hash_next;
+    struct namecache_entry* lru_prev;
+    struct namecache_entry* lru_next;
+};
+typedef struct namecache_entry namecache_entry_t;
+
+static namecache_entry_t _namecache_entries[NAMECACHE_SIZE];
+static namecache_entry_t* _namecache_hash[NAMECACHE_HASH_SIZE];
+static namecache_entry_t* _namecache_lru_head; /* Most recently used. */
+static namecache_entry_t* _namecache_lru_tail;
+static lock_t _namecache_lock;
+static seqcount_t _namecache_seq; /* Changed by writers of the hash chains, which hold the lock. */
+
+static uint32_t _namecache_hash_of(uint32_t dev_indx, uint32_t dir_indx, const char* name, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash ^ (dir_indx * 0x9e3779b1) ^ dev_indx;
+}
+
+/**
+ * LRU FUNCTIONS
+ */
+
+static void _namecache_lru_remove_lockless(namecache_entry_t* entry)
+{
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        _namecache_lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        _namecache_lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void _namecache_lru_push_front_lockless(namecache_entry_t* entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = _namecache_lru_head;
+    if (_namecache_lru_head) {
+        _namecache_lru_head->lru_prev = entry;
+    } else {
+        _namecache_lru_tail = entry;
+    }
+    _namecache_lru_head = entry;
+}
+
+static void _namecache_lru_push_back_lockless(namecache_entry_t* entry)
+{
+    entry->lru_next = NULL;
+    entry->lru_prev = _namecache_lru_tail;
+    if (_namecache_lru_tail) {
+        _namecache_lru_tail->lru_next = entry;
+    } else {
+        _namecache_lru_head = entry;
+    }
+    _namecache_lru_tail = entry;
+}
+
+/**
+ * HASH FUNCTIONS
+ */
+
+static namecache_entry_t* _namecache_find_lockless(uint32_t dev_indx, uint32_t dir_indx, const char* name, uint32_t len, uint32_t hash)
+{
+    namecache_entry_t* entry = _namecache_hash[hash % NAMECACHE_HASH_SIZE];
+    while (entry) {
+        if (entry->hash == hash && entry->dev_indx == dev_indx && entry->dir_indx == dir_indx && entry->len == len && memcmp(entry->name, name, len) == 0) {
+            return entry;
+        }
+        entry = entry->hash_next;
+    }
+    return NULL;
+}
+
+/**
+ * Lookups which hit are served without the lock. The walk gives up as soon
+ * as a writer shows up, since chains which are changed under it could lead
+ * anywhere.
+ */
+static int _namecache_lookup_fast(uint32_t dev_indx, uint32_t dir_indx, const char* name, uint32_t len, uint32_t hash, uint32_t* inode_indx)
+{
+    uint32_t seq = seqcount_read_begin(&_namecache_seq);
+    namecache_entry_t* entry = _namecache_hash[hash % NAMECACHE_HASH_SIZE];
+    while (entry) {
+        if (seqcount_read_retry(&_namecache_seq, seq)) {
+            return -EAGAIN;
+        }
+        if (entry->hash == hash && entry->dev_indx == dev_indx && entry->dir_indx == dir_indx && entry->len == len && memcmp(entry->name, name, len) == 0) {
+            break;
+        }
+        entry = entry->hash_next;
+    }
+
+    uint32_t res = entry ? entry->inode_indx : 0;
+    if (seqcount_read_retry(&_namecache_seq, seq)) {
+        return -EAGAIN;
+    }
+    if (!entry) {
+        return -ENOENT;
+    }
+
+    entry->referenced = true;
+    *inode_indx = res;
+    return 0;
+}
+
+/**
+ * Takes the entry to be reused. It's the tail of the lru list, but entries
+ * which were hit without the lock since they got there are moved to the
+ * head once instead.
+ */
+static namecache_entry_t* _namecache_victim_lockless()
+{
+    for (int i = 0; i < NAMECACHE_SIZE; i++) {
+        namecache_entry_t* entry = _namecache_lru_tail;
+        if (!entry->valid || !entry->referenced) {
+            return entry;
+        }
+        entry->referenced = false;
+        _namecache_lru_remove_lockless(entry);
+        _namecache_lru_push_front_lockless(entry);
+    }
+    return _namecache_lru_tail;
+}
+
+/**
+ * _namecache_drop_lockless unlinks the entry from its hash chain and moves
+ * it to the tail of the lru list, so it's reused first.
+ */
+static void _namecache_drop_lockless(namecache_entry_t* entry)
+{
+    if (!entry->valid) {
+        return;
+    }
+
+    namecache_entry_t** link = &_namecache_hash[entry->hash % NAMECACHE_HASH_SIZE];
+    while (*link && *link != entry) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = entry->hash_next;
+    }
+    entry->hash_next = NULL;
+    entry->valid = false;
+
+    _namecache_lru_remove_lockless(entry);
+    _namecache_lru_push_back_lockless(entry);
+}
+
+/**
+ * PUBLIC FUNCTIONS
+ */
+
+void namecache_init()
+{
+    lock_init(&_namecache_lock);
+    seqcount_init(&_namecache_seq);
+    memset((uint8_t*)_namecache_entries, 0, sizeof(_namecache_entries));
+    memset((uint8_t*)_namecache_hash, 0, sizeof(_namecache_hash));
+    _namecache_lru_head = NULL;
+    _namecache_lru_tail = NULL;
+    for (int i = 0; i < NAMECACHE_SIZE; i++) {
+        _namecache_lru_push_back_lockless(&_namecache_entries[i]);
+    }
+}
+
+/**
+ * namecache_lookup returns 0 and sets inode_indx if the name is cached.
+ * inode_indx is NAMECACHE_NEGATIVE when the name is known to be missing.
+ */
+int namecache_lookup(uint32_t dev_indx, uint32_t dir_indx, const char* name, uint32_t len, uint32_t* inode_indx)
+{
+    if (len > NAMECACHE_MAX_NAME) {
+        return -ENOENT;
+    }
+
+    uint32_t hash = _namecache_hash_of(dev_indx, dir_indx, name, len);
+    int res = _namecache_lookup_fast(dev_indx, dir_indx, name, len, hash, inode_indx);
+    if (res != -EAGAIN) {
+        return res;
+    }
+
+    lock_acquire(&_namecache_lock);
+    namecache_entry_t* entry = _namecache_find_lockless(dev_indx, dir_indx, name, len, hash);
+    if (!entry) {
+        lock_release(&_namecache_lock);
+        return -ENOENT;
+    }
+
+    *inode_indx = entry->inode_indx;
+    _namecache_lru_remove_lockless(entry);
+    _namecache_lru_push_front_lockless(entry);
+    lock_release(&_namecache_lock);
+    return 0;
+}
+
+void namecache_add(uint32_t dev_indx, uint32_t dir_indx, const char* name, uint32_t len, uint32_t inode_indx)
+{
+    if (len > NAMECACHE_MAX_NAME) {
+        return;
+    }
+
+    uint32_t hash = _namecache_hash_of(dev_indx, dir_indx, name, len);
+    lock_acquire(&_namecache_lock);
+    seqcount_write_begin(&_namecache_seq);
+    namecache_entry_t* entry = _namecache_find_lockless(dev_indx, dir_indx, name, len, hash);
+    if (!entry) {
+        entry = _namecache_victim_lockless();
+        _namecache_drop_lockless(entry);
+
+        entry->valid = true;
+        entry->referenced = false;
+        entry->dev_indx = dev_indx;
+        entry->dir_indx = dir_indx;
+        entry->hash = hash;
+        entry->len = len;
+        memcpy(entry->name, name, len);
+        entry->hash_next = _namecache_hash[hash % NAMECACHE_HASH_SIZE];
+        _namecache_hash[hash % NAMECACHE_HASH_SIZE] = entry;
+    }
+
+    entry->inode_indx = inode_indx;
+    _namecache_lru_remove_lockless(entry);
+    _namecache_lru_push_front_lockless(entry);
+    seqcount_write_end(&_namecache_seq);
+    lock_release(&_namecache_lock);
+}
+
+void namecache_remove_name(uint32_t dev_indx, uint32_t dir_indx, const char* name, uint32_t len)
+{
+    if (len > NAMECACHE_MAX_NAME) {
+        return;
+    }
+
+    uint32_t hash = _namecache_hash_of(dev_indx, dir_indx, name, len);
+    lock_acquire(&_namecache_lock);
+    namecache_entry_t* entry = _namecache_find_lockless(dev_indx, dir_indx, name, len, hash);
+    if (entry) {
+        seqcount_write_begin(&_namecache_seq);
+        _namecache_drop_lockless(entry);
+        seqcount_write_end(&_namecache_seq);
+    }
+    lock_release(&_namecache_lock);
+}
+
+/**
+ * namecache_remove_inode drops all names of the inode and all names inside
+ * of it (if it's a dir). The name which was removed isn't known to callers,
+ * so the whole table is scanned, it's done only on unlink and rmdir.
+ */
+void namecache_remove_inode(uint32_t dev_indx, uint32_t inode_indx)
+{
+    lock_acquire(&_namecache_lock);
+    seqcount_write_begin(&_namecache_seq);
+    for (int i = 0; i < NAMECACHE_SIZE; i++) {
+        namecache_entry_t* entry = &_namecache_entries[i];
+        if (entry->valid && entry->dev_indx == dev_indx && (entry->inode_indx == inode_indx || entry->dir_indx == inode_indx)) {
+            _namecache_drop_lockless(entry);
+        }
+    }
+    seqcount_write_end(&_namecache_seq);
+    lock_release(&_namecache_lock);
+}
+
+void namecache_remove_dev(uint32_t dev_indx)
+{
+    lock_acquire(&_namecache_lock);
+    seqcount_write_begin(&_namecache_seq);
+    for (int i = 0; i < NAMECACHE_SIZE; i++) {
+        namecache_entry_t* entry = &_namecache_entries[i];
+        if (entry->valid && entry->dev_indx == dev_indx) {
+            _namecache_drop_lockless(entry);
+        }
+    }
+    seqcount_write_end(&_namecache_seq);
+    lock_release(&_namecache_lock);
+}
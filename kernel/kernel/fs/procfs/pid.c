@@ -21,6 +21,9 @@ int procfs_pid_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t**
 static bool procfs_pid_memstat_can_read(dentry_t* dentry, uint32_t start);
 static int procfs_pid_memstat_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
 
+static bool procfs_pid_stat_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_pid_stat_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+
 static bool procfs_pid_exe_can_read(dentry_t* dentry, uint32_t start);
 static int procfs_pid_exe_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
 
@@ -39,8 +42,8 @@ const file_ops_t procfs_pid_memstat_ops = {
 };
 
 const file_ops_t procfs_pid_stat_ops = {
-    .can_read = procfs_pid_memstat_can_read,
-    .read = procfs_pid_memstat_read,
+    .can_read = procfs_pid_stat_can_read,
+    .read = procfs_pid_stat_read,
 };
 
 const file_ops_t procfs_pid_exe_ops = {
@@ -158,6 +161,44 @@ static int procfs_pid_memstat_read(dentry_t* dentry, uint8_t* buf, uint32_t star
     return 12;
 }
 
+static bool procfs_pid_stat_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+/**
+ * The line is: pid user_ticks system_ticks voluntary_switches
+ * involuntary_switches minor_faults cow_faults file_faults read_bytes
+ * written_bytes syscalls.
+ */
+static int procfs_pid_stat_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    int pid = procfs_pid_get_pid_from_inode_index(dentry->inode_indx);
+    thread_t* th = thread_by_pid(pid);
+    if (!th) {
+        return -EFAULT;
+    }
+
+    char res[128];
+    snprintf(res, sizeof(res), "%d %u %u %u %u %u %u %u %u %u %u\n",
+        pid, th->stat_user_ticks, th->stat_system_ticks,
+        th->stat_switches - th->stat_involuntary_switches, th->stat_involuntary_switches,
+        th->stat_minor_faults, th->stat_cow_faults, th->stat_file_faults,
+        th->stat_read_bytes, th->stat_written_bytes, th->stat_syscalls);
+    size_t size = strlen(res);
+
+    if (start == size) {
+        return 0;
+    }
+
+    if (len < size) {
+        return -EFAULT;
+    }
+
+    memcpy(buf, res, size);
+    return size;
+}
+
 static bool procfs_pid_exe_can_read(dentry_t* dentry, uint32_t start)
 {
     return true;
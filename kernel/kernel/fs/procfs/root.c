@@ -7,7 +7,10 @@
 #include <fs/procfs/procfs.h>
 #include <fs/vfs.h>
 #include <libkern/bits/errno.h>
+#include <libkern/bits/sys/procstat.h>
+#include <libkern/boottrace.h>
 #include <libkern/libkern.h>
+#include <libkern/log.h>
 #include <tasking/sched.h>
 #include <tasking/tasking.h>
 #include <time/time_manager.h>
@@ -26,10 +29,72 @@ int procfs_root_getdents(dentry_t* dir, uint8_t* buf, uint32_t* offset, uint32_t
 int procfs_root_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result);
 
 /* FILES */
+static bool procfs_root_boottrace_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_root_boottrace_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+static bool procfs_root_boottrace_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+/**
+ * Every line is: usecs_since_first_point pid name. Cycle counters wrap
+ * within a few seconds and aren't synced between cpus on arm, so a gap of
+ * a second or more, or one between two cpus, is taken from the ticks.
+ */
+static int procfs_root_boottrace_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    const uint32_t usecs_per_tick = 1000000 / TIMER_TICKS_PER_SECOND;
+    uint32_t cycles_per_usec = timeman_cycles_per_second() / 1000000;
+
+    char line[BOOTTRACE_NAME_LEN + 32];
+    boottrace_point_t* prev = NULL;
+    uint32_t usecs = 0;
+    uint32_t offset = 0;
+    uint32_t read = 0;
+
+    for (int i = 0; i < boottrace_count() && read < len; i++) {
+        boottrace_point_t* point = boottrace_get(i);
+        if (!point) {
+            break;
+        }
+
+        if (prev) {
+            time_t ticks = point->ticks - prev->ticks;
+            if (!cycles_per_usec || ticks >= TIMER_TICKS_PER_SECOND || point->cpu != prev->cpu) {
+                usecs += ticks * usecs_per_tick;
+            } else {
+                usecs += (point->cycles - prev->cycles) / cycles_per_usec;
+            }
+        }
+        prev = point;
+
+        snprintf(line, sizeof(line), "%u %d %s\n", usecs, point->pid, point->name);
+        uint32_t size = strlen(line);
+        for (uint32_t j = 0; j < size && read < len; j++, offset++) {
+            if (offset >= start) {
+                buf[read++] = line[j];
+            }
+        }
+    }
+    return read;
+}
+
 static bool procfs_root_uptime_can_read(dentry_t* dentry, uint32_t start);
 static int procfs_root_uptime_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
 static bool procfs_root_stat_can_read(dentry_t* dentry, uint32_t start);
 static int procfs_root_stat_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+static bool procfs_root_kmsg_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_root_kmsg_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+static bool procfs_root_locks_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_root_locks_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+static bool procfs_root_statbin_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_root_statbin_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+static bool procfs_root_swap_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_root_swap_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+#ifdef FPU_ENABLED
+static bool procfs_root_fpu_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_root_fpu_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+#endif
 
 /**
  * DATA
@@ -40,6 +105,11 @@ const file_ops_t procfs_root_ops = {
     .lookup = procfs_root_lookup,
 };
 
+const file_ops_t procfs_root_boottrace_ops = {
+    .can_read = procfs_root_boottrace_can_read,
+    .read = procfs_root_boottrace_read,
+};
+
 const file_ops_t procfs_root_uptime_ops = {
     .can_read = procfs_root_uptime_can_read,
     .read = procfs_root_uptime_read,
@@ -50,8 +120,43 @@ const file_ops_t procfs_root_stat_ops = {
     .read = procfs_root_stat_read,
 };
 
+const file_ops_t procfs_root_kmsg_ops = {
+    .can_read = procfs_root_kmsg_can_read,
+    .read = procfs_root_kmsg_read,
+};
+
+const file_ops_t procfs_root_locks_ops = {
+    .can_read = procfs_root_locks_can_read,
+    .read = procfs_root_locks_read,
+};
+
+const file_ops_t procfs_root_statbin_ops = {
+    .can_read = procfs_root_statbin_can_read,
+    .read = procfs_root_statbin_read,
+};
+
+const file_ops_t procfs_root_swap_ops = {
+    .can_read = procfs_root_swap_can_read,
+    .read = procfs_root_swap_read,
+};
+
+#ifdef FPU_ENABLED
+const file_ops_t procfs_root_fpu_ops = {
+    .can_read = procfs_root_fpu_can_read,
+    .read = procfs_root_fpu_read,
+};
+#endif
+
 static const procfs_files_t static_procfs_files[] = {
+    { .name = "boottrace", .mode = 0, .ops = &procfs_root_boottrace_ops },
+#ifdef FPU_ENABLED
+    { .name = "fpu", .mode = 0, .ops = &procfs_root_fpu_ops },
+#endif
+    { .name = "kmsg", .mode = 0, .ops = &procfs_root_kmsg_ops },
+    { .name = "locks", .mode = 0, .ops = &procfs_root_locks_ops },
     { .name = "stat", .mode = 0, .ops = &procfs_root_stat_ops },
+    { .name = "statbin", .mode = 0, .ops = &procfs_root_statbin_ops },
+    { .name = "swap", .mode = 0, .ops = &procfs_root_swap_ops },
     { .name = "uptime", .mode = 0, .ops = &procfs_root_uptime_ops },
 };
 #define PROCFS_STATIC_FILES_COUNT_AT_LEVEL (sizeof(static_procfs_files) / sizeof(procfs_files_t))
@@ -236,4 +341,163 @@ static int procfs_root_stat_read(dentry_t* dentry, uint8_t* buf, uint32_t start,
 
     memcpy(buf, res, size);
     return size;
-}
\ No newline at end of file
+}
+
+static bool procfs_root_kmsg_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+static int procfs_root_kmsg_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    return logger_read(buf, start, len);
+}
+
+static bool procfs_root_locks_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+/**
+ * Every line is: name acquisitions contended spins max_hold.
+ */
+static int procfs_root_locks_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    char res[LOCK_STAT_MAX * 64];
+    res[0] = '\0';
+    int offset = 0;
+    for (int i = 0; i < lock_stat_count(); i++) {
+        lock_stat_t* stat = lock_stat_get(i);
+        snprintf(res + offset, sizeof(res) - offset, "%s %u %u %u %u\n", stat->name, stat->acquisitions, stat->contended, stat->spins, stat->max_hold);
+        offset = strlen(res);
+    }
+    size_t size = strlen(res);
+
+    if (start == size) {
+        return 0;
+    }
+
+    if (len < size) {
+        return -EFAULT;
+    }
+
+    memcpy(buf, res, size);
+    return size;
+}
+
+static bool procfs_root_statbin_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+/**
+ * Counters are copied straight to the buffer, one read returns the whole
+ * snapshot. Records which don't fit into the buffer are left out and
+ * aren't counted in the header.
+ */
+static int procfs_root_statbin_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    if (start != 0) {
+        return 0;
+    }
+
+    if (len < sizeof(procstat_header_t)) {
+        return -EFAULT;
+    }
+
+    procstat_header_t* header = (procstat_header_t*)buf;
+    procstat_t* records = (procstat_t*)(buf + sizeof(procstat_header_t));
+    uint32_t max_count = (len - sizeof(procstat_header_t)) / sizeof(procstat_t);
+    uint32_t count = 0;
+    for (int i = 0; i < MAX_PROCESS_COUNT && count < max_count; i++) {
+        proc_t* p = &proc[i];
+        thread_t* th = p->main_thread;
+        if (p->status != PROC_ALIVE || !th) {
+            continue;
+        }
+
+        procstat_t* rec = &records[count++];
+        rec->pid = p->pid;
+        rec->ppid = p->ppid;
+        rec->uid = p->uid;
+        rec->prio = p->prio;
+        rec->user_ticks = th->stat_user_ticks;
+        rec->system_ticks = th->stat_system_ticks;
+        rec->voluntary_switches = th->stat_switches - th->stat_involuntary_switches;
+        rec->involuntary_switches = th->stat_involuntary_switches;
+        rec->minor_faults = th->stat_minor_faults;
+        rec->cow_faults = th->stat_cow_faults;
+        rec->file_faults = th->stat_file_faults;
+        rec->read_bytes = th->stat_read_bytes;
+        rec->written_bytes = th->stat_written_bytes;
+        rec->syscalls = th->stat_syscalls;
+    }
+
+    header->version = PROCSTAT_VERSION;
+    header->record_size = sizeof(procstat_t);
+    header->count = count;
+    header->uptime = timeman_seconds_since_boot();
+    return sizeof(procstat_header_t) + count * sizeof(procstat_t);
+}
+
+static bool procfs_root_swap_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+/**
+ * The line is: stored_pages stored_bytes pool_pages swapouts swapins
+ * rejected dropped_file_pages.
+ */
+static int procfs_root_swap_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    char res[96];
+    vmm_swap_stat_t stat;
+    vmm_get_swap_stat(&stat);
+    snprintf(res, sizeof(res), "%u %u %u %u %u %u %u\n", stat.stored_pages, stat.stored_bytes, stat.pool_pages, stat.swapouts, stat.swapins, stat.rejected, stat.dropped_file_pages);
+    size_t size = strlen(res);
+
+    if (start == size) {
+        return 0;
+    }
+
+    if (len < size) {
+        return -EFAULT;
+    }
+
+    memcpy(buf, res, size);
+    return size;
+}
+
+#ifdef FPU_ENABLED
+static bool procfs_root_fpu_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+/**
+ * Every line is: cpu traps saves.
+ */
+static int procfs_root_fpu_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    char res[CPU_CNT * 32];
+    res[0] = '\0';
+    int offset = 0;
+    for (int i = 0; i < active_cpu_count(); i++) {
+        snprintf(res + offset, sizeof(res) - offset, "cpu%d %u %u\n", i, cpus[i].stat_fpu_traps, cpus[i].stat_fpu_saves);
+        offset = strlen(res);
+    }
+    size_t size = strlen(res);
+
+    if (start == size) {
+        return 0;
+    }
+
+    if (len < size) {
+        return -EFAULT;
+    }
+
+    memcpy(buf, res, size);
+    return size;
+}
+#endif // FPU_ENABLED
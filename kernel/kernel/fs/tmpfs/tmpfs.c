@@ -0,0 +1,737 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/driver_manager.h>
+#include <fs/tmpfs/tmpfs.h>
+#include <fs/vfs.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <tasking/mutex.h>
+#include <time/time_manager.h>
+
+#define TMPFS_SECTORS_PER_PAGE (VMM_PAGE_SIZE / 512)
+
+/**
+ * Every mount is a tree of its own, pages are shared by all of them.
+ * Inode indexes start from 2, which is the root, as in the rest of vfs.
+ */
+struct tmpfs_sb {
+    tmpfs_inode_t** inodes;
+    uint16_t* free_inodes;
+    uint32_t free_inodes_count;
+};
+typedef struct tmpfs_sb tmpfs_sb_t;
+
+static tmpfs_sb_t* _tmpfs_sbs[MAX_DEVICES_COUNT];
+
+/* Page slots are numbered from 1, slot n lives at the (n - 1)th page of the zone. */
+static zone_t _tmpfs_zone;
+static uint16_t* _tmpfs_free_slots;
+static uint32_t _tmpfs_free_slots_count;
+static uint32_t* _tmpfs_slot_frames;
+
+/* Protects the tree and the pools. Data is copied with it held, so it sleeps. */
+static kmutex_t _tmpfs_lock;
+
+static inline tmpfs_sb_t* _tmpfs_sb(dentry_t* dentry)
+{
+    return _tmpfs_sbs[dentry->dev_indx];
+}
+
+static inline tmpfs_inode_t* _tmpfs_get_inode(tmpfs_sb_t* sb, uint32_t inode_indx)
+{
+    if (!sb || inode_indx < 2 || inode_indx >= TMPFS_MAX_INODES + 2) {
+        return NULL;
+    }
+    return sb->inodes[inode_indx - 2];
+}
+
+static inline tmpfs_node_t* _tmpfs_node(dentry_t* dentry)
+{
+    return ((tmpfs_inode_t*)dentry->inode)->node;
+}
+
+static uint32_t _tmpfs_hash_of(const char* name, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Pages
+ */
+
+static inline uint8_t* _tmpfs_slot_data(uint32_t slot)
+{
+    return _tmpfs_zone.ptr + (slot - 1) * VMM_PAGE_SIZE;
+}
+
+static uint32_t _tmpfs_alloc_slot_lockless()
+{
+    if (!_tmpfs_free_slots_count) {
+        return 0;
+    }
+
+    void* frame = pmm_alloc_frame();
+    if (!frame) {
+        return 0;
+    }
+
+    uint32_t slot = _tmpfs_free_slots[--_tmpfs_free_slots_count];
+    uint8_t* data = _tmpfs_slot_data(slot);
+    _tmpfs_slot_frames[slot - 1] = (uint32_t)frame;
+    vmm_map_page((uint32_t)data, (uint32_t)frame, PAGE_READABLE | PAGE_WRITABLE);
+    memset(data, 0, VMM_PAGE_SIZE);
+    return slot;
+}
+
+static void _tmpfs_free_slot_lockless(uint32_t slot)
+{
+    vmm_unmap_page((uint32_t)_tmpfs_slot_data(slot));
+    pmm_free_frame((void*)_tmpfs_slot_frames[slot - 1]);
+    _tmpfs_free_slots[_tmpfs_free_slots_count++] = slot;
+}
+
+static int _tmpfs_reserve_pages_lockless(tmpfs_node_t* node, uint32_t count)
+{
+    if (node->pages_capacity >= count) {
+        return 0;
+    }
+
+    uint32_t capacity = max(count, max(node->pages_capacity * 2, 4));
+    uint32_t* pages = krealloc(node->pages, capacity * sizeof(uint32_t));
+    if (!pages) {
+        return -ENOMEM;
+    }
+    memset(&pages[node->pages_capacity], 0, (capacity - node->pages_capacity) * sizeof(uint32_t));
+    node->pages = pages;
+    node->pages_capacity = capacity;
+    return 0;
+}
+
+/* Frees pages from @from, the part of the page @len falls in is zeroed. */
+static void _tmpfs_cut_pages_lockless(tmpfs_inode_t* inode, uint32_t len)
+{
+    tmpfs_node_t* node = inode->node;
+    uint32_t from = (len + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    for (uint32_t i = from; i < node->pages_capacity; i++) {
+        if (node->pages[i]) {
+            _tmpfs_free_slot_lockless(node->pages[i]);
+            node->pages[i] = 0;
+            inode->blocks -= TMPFS_SECTORS_PER_PAGE;
+        }
+    }
+
+    uint32_t tail = len % VMM_PAGE_SIZE;
+    if (tail && from <= node->pages_capacity && node->pages[from - 1]) {
+        memset(_tmpfs_slot_data(node->pages[from - 1]) + tail, 0, VMM_PAGE_SIZE - tail);
+    }
+}
+
+/**
+ * Inodes
+ */
+
+static tmpfs_inode_t* _tmpfs_new_inode_lockless(tmpfs_sb_t* sb, mode_t mode, uid_t uid, gid_t gid)
+{
+    if (!sb->free_inodes_count) {
+        return NULL;
+    }
+
+    tmpfs_inode_t* inode = kmalloc(TMPFS_INODE_LEN);
+    if (!inode) {
+        return NULL;
+    }
+    tmpfs_node_t* node = kmalloc(sizeof(tmpfs_node_t));
+    if (!node) {
+        kfree(inode);
+        return NULL;
+    }
+
+    memset(inode, 0, TMPFS_INODE_LEN);
+    memset(node, 0, sizeof(tmpfs_node_t));
+    uint32_t now = (uint32_t)timeman_now();
+    inode->mode = mode;
+    inode->uid = uid;
+    inode->gid = gid;
+    inode->atime = now;
+    inode->ctime = now;
+    inode->mtime = now;
+    inode->node = node;
+    inode->index = sb->free_inodes[--sb->free_inodes_count];
+    sb->inodes[inode->index - 2] = inode;
+    return inode;
+}
+
+static void _tmpfs_free_inode_lockless(tmpfs_sb_t* sb, tmpfs_inode_t* inode)
+{
+    tmpfs_node_t* node = inode->node;
+    _tmpfs_cut_pages_lockless(inode, 0);
+    if (node->pages) {
+        kfree(node->pages);
+    }
+    if (node->buckets) {
+        kfree(node->buckets);
+    }
+    kfree(node);
+
+    sb->inodes[inode->index - 2] = NULL;
+    sb->free_inodes[sb->free_inodes_count++] = inode->index;
+    kfree(inode);
+}
+
+/**
+ * Dir entries
+ */
+
+static tmpfs_dirent_t* _tmpfs_find_lockless(tmpfs_node_t* dir, const char* name, uint32_t len)
+{
+    if (!dir->buckets_count) {
+        return NULL;
+    }
+
+    uint32_t hash = _tmpfs_hash_of(name, len);
+    tmpfs_dirent_t* entry = dir->buckets[hash % dir->buckets_count];
+    for (; entry; entry = entry->hash_next) {
+        if (entry->hash == hash && entry->len == len && strncmp(entry->name, name, len) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Buckets are doubled once the dir has twice as many entries. */
+static int _tmpfs_grow_buckets_lockless(tmpfs_node_t* dir)
+{
+    if (dir->buckets_count && dir->entries_count < dir->buckets_count * 2) {
+        return 0;
+    }
+
+    uint32_t count = max(dir->buckets_count * 2, TMPFS_DIR_MIN_BUCKETS);
+    tmpfs_dirent_t** buckets = kmalloc(count * sizeof(tmpfs_dirent_t*));
+    if (!buckets) {
+        return dir->buckets_count ? 0 : -ENOMEM;
+    }
+
+    memset(buckets, 0, count * sizeof(tmpfs_dirent_t*));
+    for (tmpfs_dirent_t* entry = dir->first; entry; entry = entry->next) {
+        entry->hash_next = buckets[entry->hash % count];
+        buckets[entry->hash % count] = entry;
+    }
+
+    if (dir->buckets) {
+        kfree(dir->buckets);
+    }
+    dir->buckets = buckets;
+    dir->buckets_count = count;
+    return 0;
+}
+
+static int _tmpfs_add_child_lockless(tmpfs_node_t* dir, const char* name, uint32_t len, uint32_t inode_indx)
+{
+    if (len > 255) {
+        return -ENAMETOOLONG;
+    }
+    if (_tmpfs_grow_buckets_lockless(dir) < 0) {
+        return -ENOMEM;
+    }
+
+    tmpfs_dirent_t* entry = kmalloc(sizeof(tmpfs_dirent_t) + len + 1);
+    if (!entry) {
+        return -ENOMEM;
+    }
+
+    memcpy(entry->name, name, len);
+    entry->name[len] = '\0';
+    entry->len = len;
+    entry->hash = _tmpfs_hash_of(name, len);
+    entry->inode_indx = inode_indx;
+    entry->pos = dir->next_pos++;
+
+    uint32_t bucket = entry->hash % dir->buckets_count;
+    entry->hash_next = dir->buckets[bucket];
+    dir->buckets[bucket] = entry;
+
+    entry->next = NULL;
+    entry->prev = dir->last;
+    if (dir->last) {
+        dir->last->next = entry;
+    } else {
+        dir->first = entry;
+    }
+    dir->last = entry;
+    dir->entries_count++;
+    return 0;
+}
+
+static int _tmpfs_rm_child_lockless(tmpfs_node_t* dir, uint32_t inode_indx)
+{
+    tmpfs_dirent_t* entry = dir->first;
+    while (entry && entry->inode_indx != inode_indx) {
+        entry = entry->next;
+    }
+    if (!entry) {
+        return -ENOENT;
+    }
+
+    tmpfs_dirent_t** link = &dir->buckets[entry->hash % dir->buckets_count];
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        dir->first = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        dir->last = entry->prev;
+    }
+    dir->entries_count--;
+    kfree(entry);
+    return 0;
+}
+
+/**
+ * VFS Api
+ */
+
+fsdata_t tmpfs_data(dentry_t* dentry)
+{
+    fsdata_t fsdata;
+    fsdata.sb = 0;
+    fsdata.gt = 0;
+    return fsdata;
+}
+
+static int _tmpfs_init_pages()
+{
+    kmutex_init(&_tmpfs_lock);
+    _tmpfs_free_slots = kmalloc(TMPFS_MAX_PAGES * sizeof(uint16_t));
+    _tmpfs_slot_frames = kmalloc(TMPFS_MAX_PAGES * sizeof(uint32_t));
+    if (!_tmpfs_free_slots || !_tmpfs_slot_frames) {
+        return -ENOMEM;
+    }
+    _tmpfs_zone = zoner_new_zone(TMPFS_MAX_PAGES * VMM_PAGE_SIZE);
+
+    /* Stacks are filled backwards, so the lowest numbers go first. */
+    for (uint32_t i = 0; i < TMPFS_MAX_PAGES; i++) {
+        _tmpfs_free_slots[i] = TMPFS_MAX_PAGES - i;
+    }
+    _tmpfs_free_slots_count = TMPFS_MAX_PAGES;
+    return 0;
+}
+
+int tmpfs_prepare_fs(vfs_device_t* vdev)
+{
+    if (!_tmpfs_slot_frames && _tmpfs_init_pages() < 0) {
+        return -ENOMEM;
+    }
+
+    uint32_t dev_indx = vdev->dev->id;
+    if (_tmpfs_sbs[dev_indx]) {
+        return 0;
+    }
+
+    tmpfs_sb_t* sb = kmalloc(sizeof(tmpfs_sb_t));
+    if (!sb) {
+        return -ENOMEM;
+    }
+    sb->inodes = kmalloc(TMPFS_MAX_INODES * sizeof(tmpfs_inode_t*));
+    sb->free_inodes = kmalloc(TMPFS_MAX_INODES * sizeof(uint16_t));
+    if (!sb->inodes || !sb->free_inodes) {
+        return -ENOMEM;
+    }
+
+    memset(sb->inodes, 0, TMPFS_MAX_INODES * sizeof(tmpfs_inode_t*));
+    for (uint32_t i = 0; i < TMPFS_MAX_INODES; i++) {
+        sb->free_inodes[i] = TMPFS_MAX_INODES + 1 - i;
+    }
+    sb->free_inodes_count = TMPFS_MAX_INODES;
+
+    tmpfs_inode_t* root = _tmpfs_new_inode_lockless(sb, S_IFDIR | S_ISVTX | 0777, 0, 0);
+    if (!root) {
+        return -ENOMEM;
+    }
+    root->links_count = 2;
+    root->node->parent_indx = root->index;
+    _tmpfs_sbs[dev_indx] = sb;
+    return 0;
+}
+
+int tmpfs_read_inode(dentry_t* dentry)
+{
+    kmutex_lock(&_tmpfs_lock);
+    tmpfs_inode_t* tmpfs_inode = _tmpfs_get_inode(_tmpfs_sb(dentry), dentry->inode_indx);
+    if (!tmpfs_inode) {
+        kmutex_unlock(&_tmpfs_lock);
+        return -EFAULT;
+    }
+    memcpy((void*)dentry->inode, (void*)tmpfs_inode, TMPFS_INODE_LEN);
+    kmutex_unlock(&_tmpfs_lock);
+    return 0;
+}
+
+int tmpfs_write_inode(dentry_t* dentry)
+{
+    kmutex_lock(&_tmpfs_lock);
+    tmpfs_inode_t* tmpfs_inode = _tmpfs_get_inode(_tmpfs_sb(dentry), dentry->inode_indx);
+    if (!tmpfs_inode) {
+        kmutex_unlock(&_tmpfs_lock);
+        return -EFAULT;
+    }
+    memcpy((void*)tmpfs_inode, (void*)dentry->inode, TMPFS_INODE_LEN);
+    kmutex_unlock(&_tmpfs_lock);
+    return 0;
+}
+
+int tmpfs_free_inode(dentry_t* dentry)
+{
+    kmutex_lock(&_tmpfs_lock);
+    tmpfs_sb_t* sb = _tmpfs_sb(dentry);
+    tmpfs_inode_t* tmpfs_inode = _tmpfs_get_inode(sb, dentry->inode_indx);
+    if (tmpfs_inode) {
+        /* The dentry holds the latest copy, pages are counted in it. */
+        memcpy((void*)tmpfs_inode, (void*)dentry->inode, TMPFS_INODE_LEN);
+        _tmpfs_free_inode_lockless(sb, tmpfs_inode);
+    }
+    kmutex_unlock(&_tmpfs_lock);
+    return 0;
+}
+
+int tmpfs_getdents(dentry_t* dir, uint8_t* buf, uint32_t* offset, uint32_t len)
+{
+    tmpfs_inode_t* tmpfs_inode = (tmpfs_inode_t*)dir->inode;
+    tmpfs_node_t* node = tmpfs_inode->node;
+    int already_read = 0;
+
+    kmutex_lock(&_tmpfs_lock);
+
+    /* Positions 0 and 1 are . and .., entries take the following ones. */
+    if (*offset == 0) {
+        ssize_t read = vfs_helper_write_dirent((dirent_t*)(buf + already_read), len, tmpfs_inode->index, ".");
+        if (read <= 0) {
+            kmutex_unlock(&_tmpfs_lock);
+            return already_read ? already_read : -EINVAL;
+        }
+        already_read += read;
+        len -= read;
+        *offset = 1;
+    }
+
+    if (*offset == 1) {
+        ssize_t read = vfs_helper_write_dirent((dirent_t*)(buf + already_read), len, node->parent_indx, "..");
+        if (read <= 0) {
+            kmutex_unlock(&_tmpfs_lock);
+            return already_read ? already_read : -EINVAL;
+        }
+        already_read += read;
+        len -= read;
+        *offset = 2;
+    }
+
+    tmpfs_dirent_t* entry = node->first;
+    while (entry && entry->pos + 2 < *offset) {
+        entry = entry->next;
+    }
+
+    for (; entry; entry = entry->next) {
+        ssize_t read = vfs_helper_write_dirent((dirent_t*)(buf + already_read), len, entry->inode_indx, entry->name);
+        if (read <= 0) {
+            kmutex_unlock(&_tmpfs_lock);
+            return already_read ? already_read : -EINVAL;
+        }
+        already_read += read;
+        len -= read;
+        *offset = entry->pos + 3;
+    }
+
+    kmutex_unlock(&_tmpfs_lock);
+    return already_read;
+}
+
+int tmpfs_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result)
+{
+    tmpfs_node_t* node = _tmpfs_node(dir);
+
+    if (len == 2 && name[0] == '.' && name[1] == '.') {
+        *result = dentry_get(dir->dev_indx, node->parent_indx);
+        return 0;
+    }
+
+    kmutex_lock(&_tmpfs_lock);
+    tmpfs_dirent_t* entry = _tmpfs_find_lockless(node, name, len);
+    uint32_t inode_indx = entry ? entry->inode_indx : 0;
+    kmutex_unlock(&_tmpfs_lock);
+
+    /* dentry_get reads the inode, which takes the lock. */
+    if (!inode_indx) {
+        return -ENOENT;
+    }
+    *result = dentry_get(dir->dev_indx, inode_indx);
+    return 0;
+}
+
+static int _tmpfs_create_impl(dentry_t* dir, const char* name, uint32_t len, mode_t mode, uid_t uid, gid_t gid)
+{
+    kmutex_lock(&_tmpfs_lock);
+    tmpfs_node_t* dir_node = _tmpfs_node(dir);
+    tmpfs_inode_t* inode = _tmpfs_new_inode_lockless(_tmpfs_sb(dir), mode, uid, gid);
+    if (!inode) {
+        kmutex_unlock(&_tmpfs_lock);
+        return -ENOSPC;
+    }
+
+    inode->node->parent_indx = dir->inode_indx;
+    inode->links_count = (mode & S_IFDIR) ? 2 : 1;
+
+    int err = _tmpfs_add_child_lockless(dir_node, name, len, inode->index);
+    if (err) {
+        _tmpfs_free_inode_lockless(_tmpfs_sb(dir), inode);
+        kmutex_unlock(&_tmpfs_lock);
+        return err;
+    }
+    kmutex_unlock(&_tmpfs_lock);
+
+    dir->inode->mtime = inode->mtime;
+    if (mode & S_IFDIR) {
+        dir->inode->links_count++;
+    }
+    dentry_set_flag(dir, DENTRY_DIRTY);
+    return 0;
+}
+
+int tmpfs_create(dentry_t* dir, const char* name, uint32_t len, mode_t mode, uid_t uid, gid_t gid)
+{
+    return _tmpfs_create_impl(dir, name, len, mode, uid, gid);
+}
+
+int tmpfs_mkdir(dentry_t* dir, const char* name, uint32_t len, mode_t mode, uid_t uid, gid_t gid)
+{
+    /* vfs_mkdir doesn't look for a file with the same name. */
+    kmutex_lock(&_tmpfs_lock);
+    tmpfs_dirent_t* entry = _tmpfs_find_lockless(_tmpfs_node(dir), name, len);
+    kmutex_unlock(&_tmpfs_lock);
+    if (entry) {
+        return -EEXIST;
+    }
+    return _tmpfs_create_impl(dir, name, len, mode | S_IFDIR, uid, gid);
+}
+
+static int _tmpfs_rm_impl(dentry_t* dentry, bool is_dir)
+{
+    dentry_t* parent_dir = dentry_get_parent(dentry);
+    if (!parent_dir) {
+        return -EPERM;
+    }
+
+    kmutex_lock(&_tmpfs_lock);
+    if (is_dir && _tmpfs_node(dentry)->entries_count) {
+        kmutex_unlock(&_tmpfs_lock);
+        dentry_put(parent_dir);
+        return -ENOTEMPTY;
+    }
+
+    int err = _tmpfs_rm_child_lockless(_tmpfs_node(parent_dir), dentry->inode_indx);
+    kmutex_unlock(&_tmpfs_lock);
+    if (err) {
+        dentry_put(parent_dir);
+        return err;
+    }
+
+    if (is_dir) {
+        parent_dir->inode->links_count--;
+        dentry->inode->links_count = 0;
+    } else {
+        dentry->inode->links_count--;
+    }
+    parent_dir->inode->mtime = (uint32_t)timeman_now();
+    dentry_set_flag(parent_dir, DENTRY_DIRTY);
+    dentry_set_flag(dentry, DENTRY_DIRTY);
+    dentry_put(parent_dir);
+    return 0;
+}
+
+int tmpfs_unlink(dentry_t* dentry)
+{
+    return _tmpfs_rm_impl(dentry, false);
+}
+
+int tmpfs_rmdir(dentry_t* dir)
+{
+    return _tmpfs_rm_impl(dir, true);
+}
+
+int tmpfs_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    tmpfs_inode_t* inode = (tmpfs_inode_t*)dentry->inode;
+    tmpfs_node_t* node = inode->node;
+
+    kmutex_lock(&_tmpfs_lock);
+    if (start >= inode->size) {
+        kmutex_unlock(&_tmpfs_lock);
+        return 0;
+    }
+
+    len = min(len, inode->size - start);
+    uint32_t done = 0;
+    while (done < len) {
+        uint32_t page = (start + done) / VMM_PAGE_SIZE;
+        uint32_t offset = (start + done) % VMM_PAGE_SIZE;
+        uint32_t part = min(VMM_PAGE_SIZE - offset, len - done);
+        if (page < node->pages_capacity && node->pages[page]) {
+            memcpy(buf + done, _tmpfs_slot_data(node->pages[page]) + offset, part);
+        } else {
+            memset(buf + done, 0, part);
+        }
+        done += part;
+    }
+    kmutex_unlock(&_tmpfs_lock);
+    return done;
+}
+
+int tmpfs_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    tmpfs_inode_t* inode = (tmpfs_inode_t*)dentry->inode;
+    tmpfs_node_t* node = inode->node;
+    if (!len) {
+        return 0;
+    }
+
+    /* Holes take no pages, but no file can be larger than the whole fs. */
+    uint32_t end = start + len;
+    if (end < start || end > TMPFS_MAX_PAGES * VMM_PAGE_SIZE) {
+        return -EFBIG;
+    }
+
+    kmutex_lock(&_tmpfs_lock);
+    if (_tmpfs_reserve_pages_lockless(node, (end + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE) < 0) {
+        kmutex_unlock(&_tmpfs_lock);
+        return -ENOMEM;
+    }
+
+    uint32_t done = 0;
+    while (done < len) {
+        uint32_t page = (start + done) / VMM_PAGE_SIZE;
+        uint32_t offset = (start + done) % VMM_PAGE_SIZE;
+        uint32_t part = min(VMM_PAGE_SIZE - offset, len - done);
+        if (!node->pages[page]) {
+            node->pages[page] = _tmpfs_alloc_slot_lockless();
+            if (!node->pages[page]) {
+                break;
+            }
+            inode->blocks += TMPFS_SECTORS_PER_PAGE;
+        }
+        memcpy(_tmpfs_slot_data(node->pages[page]) + offset, buf + done, part);
+        done += part;
+    }
+
+    if (start + done > inode->size) {
+        inode->size = start + done;
+    }
+    inode->mtime = (uint32_t)timeman_now();
+    kmutex_unlock(&_tmpfs_lock);
+
+    dentry_set_flag(dentry, DENTRY_DIRTY);
+    if (!done) {
+        return -ENOSPC;
+    }
+    return done;
+}
+
+int tmpfs_truncate(dentry_t* dentry, uint32_t len)
+{
+    tmpfs_inode_t* inode = (tmpfs_inode_t*)dentry->inode;
+    kmutex_lock(&_tmpfs_lock);
+    if (inode->size <= len) {
+        kmutex_unlock(&_tmpfs_lock);
+        return 0;
+    }
+
+    _tmpfs_cut_pages_lockless(inode, len);
+    inode->size = len;
+    inode->mtime = (uint32_t)timeman_now();
+    kmutex_unlock(&_tmpfs_lock);
+
+    dentry_set_flag(dentry, DENTRY_DIRTY);
+    return 0;
+}
+
+/**
+ * Driver install functions.
+ */
+
+driver_desc_t _tmpfs_driver_info()
+{
+    driver_desc_t fs_desc = { 0 };
+    fs_desc.type = DRIVER_FILE_SYSTEM;
+    fs_desc.auto_start = false;
+    fs_desc.is_device_driver = false;
+    fs_desc.is_device_needed = false;
+    fs_desc.is_driver_needed = false;
+    fs_desc.functions[DRIVER_NOTIFICATION] = NULL;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_RECOGNIZE] = NULL;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_PREPARE_FS] = tmpfs_prepare_fs;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_CAN_READ] = NULL;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_CAN_WRITE] = NULL;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_OPEN] = NULL;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_READ] = tmpfs_read;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_WRITE] = tmpfs_write;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_TRUNCATE] = tmpfs_truncate;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_MKDIR] = tmpfs_mkdir;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_RMDIR] = tmpfs_rmdir;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_EJECT_DEVICE] = NULL;
+
+    fs_desc.functions[DRIVER_FILE_SYSTEM_READ_INODE] = tmpfs_read_inode;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_WRITE_INODE] = tmpfs_write_inode;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_FREE_INODE] = tmpfs_free_inode;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_GET_FSDATA] = tmpfs_data;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_LOOKUP] = tmpfs_lookup;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_GETDENTS] = tmpfs_getdents;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_CREATE] = tmpfs_create;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_UNLINK] = tmpfs_unlink;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_FSTAT] = NULL;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_IOCTL] = NULL;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_MMAP] = NULL;
+
+    return fs_desc;
+}
+
+void tmpfs_install()
+{
+    driver_install(_tmpfs_driver_info(), "tmpfs");
+}
+
+/**
+ * Every call mounts a new empty tree at @path.
+ */
+int tmpfs_mount(const char* path)
+{
+    dentry_t* mp;
+    if (vfs_resolve_path(path, &mp) < 0) {
+        return -ENOENT;
+    }
+    int driver_id = vfs_get_fs_id("tmpfs");
+    if (driver_id < 0) {
+        log("Tmpfs: no driver is installed, exiting");
+        dentry_put(mp);
+        return -ENOENT;
+    }
+    int err = vfs_mount(mp, new_virtual_device(DEVICE_STORAGE), driver_id);
+    dentry_put(mp);
+    return err;
+}
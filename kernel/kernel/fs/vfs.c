@@ -5,7 +5,10 @@
  */
 
 #include <algo/dynamic_array.h>
+#include <fs/bcache.h>
+#include <fs/namecache.h>
 #include <fs/vfs.h>
+#include <io/epoll/epoll.h>
 #include <io/sockets/socket.h>
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
@@ -46,6 +49,9 @@ void vfs_install()
 {
     driver_install(_vfs_driver_info(), "vfs");
     dynamic_array_init_of_size(&_vfs_fses, sizeof(fs_desc_t), MAX_FS);
+    dentry_init();
+    bcache_init();
+    namecache_init();
 }
 
 int vfs_choose_fs_of_dev(vfs_device_t* vfs_dev)
@@ -92,7 +98,8 @@ int vfs_add_dev(device_t* dev)
     }
 
     _vfs_devices[dev->id].dev = dev;
-    lock_init(&_vfs_devices[dev->id].lock);
+    _vfs_devices[dev->id].ops = dev->storage_ops;
+    krwlock_init(&_vfs_devices[dev->id].lock);
     if (!dev->is_virtual) {
         if (vfs_choose_fs_of_dev(&_vfs_devices[dev->id]) < 0) {
             return -ENOENT;
@@ -112,6 +119,7 @@ int vfs_add_dev_with_fs(device_t* dev, int fs_id)
     }
 
     _vfs_devices[dev->id].dev = dev;
+    _vfs_devices[dev->id].ops = dev->storage_ops;
     _vfs_devices[dev->id].fs = fs_id;
 
     fs_desc_t* fs = dynamic_array_get(&_vfs_fses, fs_id);
@@ -135,6 +143,7 @@ void vfs_eject_device(device_t* dev)
         int (*eject)(vfs_device_t * nd) = fs->ops->eject_device;
         eject(&_vfs_devices[dev->id]);
     }
+    namecache_remove_dev(dev->id);
     dentry_put_all_dentries_of_dev(dev->id);
 }
 
@@ -165,6 +174,7 @@ void vfs_add_fs(driver_t* new_driver)
     new_ops->file.fstat = new_driver->desc.functions[DRIVER_FILE_SYSTEM_FSTAT];
     new_ops->file.ioctl = new_driver->desc.functions[DRIVER_FILE_SYSTEM_IOCTL];
     new_ops->file.mmap = new_driver->desc.functions[DRIVER_FILE_SYSTEM_MMAP];
+    new_ops->file.readahead = new_driver->desc.functions[DRIVER_FILE_SYSTEM_READAHEAD];
 
     new_ops->dentry.write_inode = new_driver->desc.functions[DRIVER_FILE_SYSTEM_WRITE_INODE];
     new_ops->dentry.read_inode = new_driver->desc.functions[DRIVER_FILE_SYSTEM_READ_INODE];
@@ -235,16 +245,25 @@ int vfs_open(dentry_t* file, file_descriptor_t* fd, uint32_t flags)
     fd->dentry = dentry_duplicate(file);
     fd->offset = 0;
     fd->ops = &file->ops->file;
-    lock_init(&fd->lock);
+    fd->ra_next = 0;
+    fd->ra_end = 0;
+    fd->ra_window = 0;
+    kmutex_init(&fd->lock);
     return 0;
 }
 
 static int _int_vfs_do_close(file_descriptor_t* fd)
 {
-    if (fd->type == FD_TYPE_FILE) {
+    switch (fd->type) {
+    case FD_TYPE_FILE:
         dentry_put(fd->dentry);
-    } else {
+        break;
+    case FD_TYPE_SOCKET:
         socket_put(fd->sock_entry);
+        break;
+    case FD_TYPE_EPOLL:
+        epoll_put(fd->epoll_entry);
+        break;
     }
     fd->dentry = NULL;
     fd->ops = NULL;
@@ -257,9 +276,34 @@ int vfs_close(file_descriptor_t* fd)
     if (!fd) {
         return -EFAULT;
     }
-    lock_acquire(&fd->lock);
+    kmutex_lock(&fd->lock);
     int res = _int_vfs_do_close(fd);
-    lock_release(&fd->lock);
+    kmutex_unlock(&fd->lock);
+    return res;
+}
+
+/**
+ * Opens @new_fd as a copy of @fd, the offset is copied and not shared.
+ */
+int vfs_dup(file_descriptor_t* fd, file_descriptor_t* new_fd)
+{
+    kmutex_lock(&fd->lock);
+    int res = 0;
+    if (fd->type == FD_TYPE_FILE) {
+        res = vfs_open(fd->dentry, new_fd, fd->flags);
+    } else {
+        new_fd->type = fd->type;
+        if (fd->type == FD_TYPE_SOCKET) {
+            new_fd->sock_entry = socket_duplicate(fd->sock_entry);
+        } else {
+            new_fd->epoll_entry = epoll_duplicate(fd->epoll_entry);
+        }
+        new_fd->flags = fd->flags;
+        new_fd->ops = fd->ops;
+        kmutex_init(&new_fd->lock);
+    }
+    new_fd->offset = fd->offset;
+    kmutex_unlock(&fd->lock);
     return res;
 }
 
@@ -272,7 +316,11 @@ int vfs_create(dentry_t* dir, const char* name, uint32_t len, mode_t mode, uid_t
         return -EEXIST;
     }
 
-    return dir->ops->file.create(dir, name, len, mode, uid, gid);
+    int err = dir->ops->file.create(dir, name, len, mode, uid, gid);
+    if (!err) {
+        namecache_remove_name(dir->dev_indx, dir->inode_indx, name, len);
+    }
+    return err;
 }
 
 int vfs_unlink(dentry_t* file)
@@ -289,7 +337,20 @@ int vfs_unlink(dentry_t* file)
 #endif
     }
 
-    return file->ops->file.unlink(file);
+    int err = file->ops->file.unlink(file);
+    if (!err) {
+        namecache_remove_inode(file->dev_indx, file->inode_indx);
+    }
+    return err;
+}
+
+/**
+ * Names of file systems on virtual devices (devfs, procfs) can change without
+ * vfs knowing it, so only dirs on real storage devices are cached.
+ */
+static inline bool _vfs_can_use_namecache(dentry_t* dir)
+{
+    return dir->dev->dev && !dir->dev->dev->is_virtual;
 }
 
 int vfs_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result)
@@ -322,7 +383,26 @@ int vfs_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result)
         return -ENOEXEC;
     }
 
+    bool use_namecache = _vfs_can_use_namecache(dir);
+    uint32_t cached_inode_indx;
+    if (use_namecache && namecache_lookup(dir->dev_indx, dir->inode_indx, name, len, &cached_inode_indx) == 0) {
+        if (cached_inode_indx == NAMECACHE_NEGATIVE) {
+            return -ENOENT;
+        }
+        *result = dentry_get(dir->dev_indx, cached_inode_indx);
+        if (*result) {
+            return 0;
+        }
+    }
+
     int err = dir->ops->file.lookup(dir, name, len, result);
+    if (use_namecache) {
+        if (err == -ENOENT) {
+            namecache_add(dir->dev_indx, dir->inode_indx, name, len, NAMECACHE_NEGATIVE);
+        } else if (!err && (*result)->dev_indx == dir->dev_indx && !dentry_test_flag(*result, DENTRY_CUSTOM)) {
+            namecache_add(dir->dev_indx, dir->inode_indx, name, len, (*result)->inode_indx);
+        }
+    }
     if (err) {
         return err;
     }
@@ -332,43 +412,114 @@ int vfs_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result)
 
 bool vfs_can_read(file_descriptor_t* fd)
 {
-    lock_acquire(&fd->lock);
+    kmutex_lock(&fd->lock);
     bool res = true;
     if (fd->ops->can_read) {
         res = fd->ops->can_read(fd->dentry, fd->offset);
     }
-    lock_release(&fd->lock);
+    kmutex_unlock(&fd->lock);
     return res;
 }
 
 bool vfs_can_write(file_descriptor_t* fd)
 {
-    lock_acquire(&fd->lock);
+    kmutex_lock(&fd->lock);
     bool res = true;
     if (fd->ops->can_write) {
         res = fd->ops->can_write(fd->dentry, fd->offset);
     }
-    lock_release(&fd->lock);
+    kmutex_unlock(&fd->lock);
     return res;
 }
 
+/**
+ * A read which starts where the previous one ended is sequential. Once the
+ * reader comes within half a window of the data read ahead, the next window
+ * is read ahead and the window doubles. Any other read resets the state.
+ * Storage requests are served in the context of the caller, so the window
+ * is fetched before the read returns, but with one batch of requests
+ * instead of a request per small read.
+ */
+static void _vfs_readahead(file_descriptor_t* fd, uint32_t start, uint32_t end)
+{
+    bool sequential = (start == fd->ra_next);
+    fd->ra_next = end;
+    if (!sequential) {
+        fd->ra_window = 0;
+        fd->ra_end = 0;
+        return;
+    }
+
+    if (!fd->ra_window) {
+        fd->ra_window = VFS_READAHEAD_MIN_WINDOW;
+        fd->ra_end = end;
+    }
+
+    if (end + fd->ra_window / 2 < fd->ra_end) {
+        return;
+    }
+
+    uint32_t from = max(fd->ra_end, end);
+    fd->ops->readahead(fd->dentry, from, fd->ra_window);
+    fd->ra_end = from + fd->ra_window;
+    fd->ra_window = min(fd->ra_window * 2, VFS_READAHEAD_MAX_WINDOW);
+}
+
 int vfs_read(file_descriptor_t* fd, void* buf, uint32_t len)
 {
-    lock_acquire(&fd->lock);
-    int read = fd->ops->read(fd->dentry, (uint8_t*)buf, fd->offset, len);
+    kmutex_lock(&fd->lock);
+    uint32_t start = fd->offset;
+    int read = fd->ops->read(fd->dentry, (uint8_t*)buf, start, len);
     if (read > 0) {
         fd->offset += read;
+        if (fd->type == FD_TYPE_FILE && fd->ops->readahead) {
+            _vfs_readahead(fd, start, fd->offset);
+        }
+    }
+    kmutex_unlock(&fd->lock);
+    return read;
+}
+
+/**
+ * vfs_pread and vfs_pwrite work at the given offset of a file and leave
+ * the offset of the descriptor untouched.
+ */
+int vfs_pread(file_descriptor_t* fd, void* buf, uint32_t start, uint32_t len)
+{
+    if (fd->type != FD_TYPE_FILE) {
+        return -ESPIPE;
     }
-    lock_release(&fd->lock);
+
+    kmutex_lock(&fd->lock);
+    int read = fd->ops->read(fd->dentry, (uint8_t*)buf, start, len);
+    kmutex_unlock(&fd->lock);
     return read;
 }
 
+int vfs_pwrite(file_descriptor_t* fd, void* buf, uint32_t start, uint32_t len)
+{
+    if (fd->type != FD_TYPE_FILE) {
+        return -ESPIPE;
+    }
+
+    kmutex_lock(&fd->lock);
+    int written = fd->ops->write(fd->dentry, (uint8_t*)buf, start, len);
+    if (written > 0) {
+        vmm_file_cache_invalidate(fd->dentry->dev_indx, fd->dentry->inode_indx);
+    }
+    kmutex_unlock(&fd->lock);
+    return written;
+}
+
 int vfs_write(file_descriptor_t* fd, void* buf, uint32_t len)
 {
-    lock_acquire(&fd->lock);
+    kmutex_lock(&fd->lock);
     int written = fd->ops->write(fd->dentry, (uint8_t*)buf, fd->offset, len);
     if (written > 0) {
         fd->offset += written;
+        if (fd->type == FD_TYPE_FILE) {
+            vmm_file_cache_invalidate(fd->dentry->dev_indx, fd->dentry->inode_indx);
+        }
     }
 
     if (fd->flags & O_TRUNC) {
@@ -377,7 +528,7 @@ int vfs_write(file_descriptor_t* fd, void* buf, uint32_t len)
         }
     }
 
-    lock_release(&fd->lock);
+    kmutex_unlock(&fd->lock);
     return written;
 }
 
@@ -389,7 +540,11 @@ int vfs_mkdir(dentry_t* dir, const char* name, size_t len, mode_t mode, uid_t ui
     if (!dentry_inode_test_flag(dir, S_IFDIR)) {
         return -ENOTDIR;
     }
-    return dir->ops->file.mkdir(dir, name, len, mode | S_IFDIR, uid, gid);
+    int err = dir->ops->file.mkdir(dir, name, len, mode | S_IFDIR, uid, gid);
+    if (!err) {
+        namecache_remove_name(dir->dev_indx, dir->inode_indx, name, len);
+    }
+    return err;
 }
 
 /**
@@ -408,6 +563,7 @@ int vfs_rmdir(dentry_t* dir)
     if (!err) {
         log("Rmdir: will be deleted %d", dir->inode_indx);
         dentry_set_flag(dir, DENTRY_INODE_TO_BE_DELETED);
+        namecache_remove_inode(dir->dev_indx, dir->inode_indx);
     }
     return err;
 }
@@ -417,33 +573,146 @@ int vfs_getdents(file_descriptor_t* dir_fd, uint8_t* buf, uint32_t len)
     if (!dentry_inode_test_flag(dir_fd->dentry, S_IFDIR)) {
         return -ENOTDIR;
     }
-    lock_acquire(&dir_fd->lock);
+    kmutex_lock(&dir_fd->lock);
     int res = dir_fd->ops->getdents(dir_fd->dentry, buf, &dir_fd->offset, len);
-    lock_release(&dir_fd->lock);
+    kmutex_unlock(&dir_fd->lock);
+    return res;
+}
+
+static inline uint32_t _vfs_dirent_stat_len(uint32_t name_len)
+{
+    return (sizeof(dirent_stat_t) + name_len + 1 + 3) & ~3;
+}
+
+static void _vfs_fill_stat(dentry_t* dentry, fstat_t* stat)
+{
+    // For drives we set MAJOR=0 and MINOR=drive's id.
+    stat->dev = MKDEV(0, dentry->dev_indx);
+    stat->ino = dentry->inode_indx;
+    stat->mode = dentry->inode->mode;
+    stat->size = dentry->inode->size;
+    // TODO: Fill more stat data here.
+}
+
+static uint32_t _vfs_getdents_stat_len(uint8_t* dirents, uint32_t len)
+{
+    uint32_t res = 0;
+    for (uint32_t pos = 0; pos < len;) {
+        dirent_t* ent = (dirent_t*)(dirents + pos);
+        if (!ent->rec_len) {
+            break;
+        }
+        res += _vfs_dirent_stat_len(ent->name_len);
+        pos += ent->rec_len;
+    }
     return res;
 }
 
+/**
+ * Reads as many entries as fit into @buf, each with the stat data of its
+ * inode. Entries are read into a kernel buffer with getdents, if they don't
+ * fit with their stats, the offset is restored and a smaller part is read.
+ */
+int vfs_getdents_stat(file_descriptor_t* dir_fd, uint8_t* buf, uint32_t len)
+{
+    if (!dentry_inode_test_flag(dir_fd->dentry, S_IFDIR)) {
+        return -ENOTDIR;
+    }
+
+    uint32_t chunk = min(len, VFS_GETDENTS_STAT_CHUNK);
+    uint8_t* dirents = kmalloc(chunk);
+    if (!dirents) {
+        return -ENOMEM;
+    }
+
+    kmutex_lock(&dir_fd->lock);
+    dentry_t* dir = dir_fd->dentry;
+    int read;
+    for (;;) {
+        uint32_t offset = dir_fd->offset;
+        read = dir_fd->ops->getdents(dir, dirents, &dir_fd->offset, chunk);
+        if (read <= 0 || _vfs_getdents_stat_len(dirents, read) <= len) {
+            break;
+        }
+        dir_fd->offset = offset;
+        chunk /= 2;
+        if (chunk < sizeof(dirent_t)) {
+            read = -EINVAL;
+            break;
+        }
+    }
+
+    uint32_t written = 0;
+    for (int pos = 0; pos < read;) {
+        dirent_t* ent = (dirent_t*)(dirents + pos);
+        if (!ent->rec_len) {
+            break;
+        }
+
+        dirent_stat_t* res = (dirent_stat_t*)(buf + written);
+        res->inode = ent->inode;
+        res->rec_len = _vfs_dirent_stat_len(ent->name_len);
+        res->name_len = ent->name_len;
+        res->file_type = ent->file_type;
+        memcpy(res->name, (char*)&ent->name, ent->name_len);
+        res->name[ent->name_len] = '\0';
+
+        memset(&res->stat, 0, sizeof(fstat_t));
+        dentry_t* entry = dentry_get(dir->dev_indx, ent->inode);
+        if (entry) {
+            if (entry->ops->file.fstat) {
+                entry->ops->file.fstat(entry, &res->stat);
+            } else {
+                _vfs_fill_stat(entry, &res->stat);
+            }
+            dentry_put(entry);
+        }
+
+        written += res->rec_len;
+        pos += ent->rec_len;
+    }
+    kmutex_unlock(&dir_fd->lock);
+
+    kfree(dirents);
+    return read < 0 ? read : written;
+}
+
 int vfs_fstat(file_descriptor_t* fd, fstat_t* stat)
 {
-    lock_acquire(&fd->lock);
+    kmutex_lock(&fd->lock);
     // Check if we have a custom fstat
     if (fd->ops->fstat) {
         int res = fd->ops->fstat(fd->dentry, stat);
-        lock_release(&fd->lock);
+        kmutex_unlock(&fd->lock);
         return res;
     }
 
-    // For drives we set MAJOR=0 and MINOR=drive's id.
-    stat->dev = MKDEV(0, fd->dentry->dev_indx);
-    stat->ino = fd->dentry->inode_indx;
-    stat->mode = fd->dentry->inode->mode;
-    stat->size = fd->dentry->inode->size;
-    // TODO: Fill more stat data here.
+    _vfs_fill_stat(fd->dentry, stat);
+    kmutex_unlock(&fd->lock);
+    return 0;
+}
 
-    lock_release(&fd->lock);
+/**
+ * Inodes are written by dentries and data by blocks of bcache, both are
+ * pushed to the device.
+ */
+int vfs_fsync(file_descriptor_t* fd)
+{
+    kmutex_lock(&fd->lock);
+    dentry_flush(fd->dentry);
+    if (fd->dentry->dev) {
+        bcache_sync(fd->dentry->dev->dev);
+    }
+    kmutex_unlock(&fd->lock);
     return 0;
 }
 
+int vfs_sync()
+{
+    dentry_flush_all();
+    return bcache_sync(NULL);
+}
+
 int vfs_resolve_path_start_from(dentry_t* dentry, const char* path, dentry_t** result)
 {
     if (!path) {
@@ -505,7 +774,21 @@ int vfs_resolve_path(const char* path, dentry_t** result)
     return vfs_resolve_path_start_from((dentry_t*)NULL, path, result);
 }
 
-int vfs_mount(dentry_t* mountpoint, device_t* dev, uint32_t fs_indx)
+static int _vfs_do_mount(dentry_t* mountpoint, uint32_t dev_indx)
+{
+    mountpoint = dentry_duplicate(mountpoint); /* We keep mounts in mem until to umount. */
+    dentry_set_flag(mountpoint, DENTRY_MOUNTPOINT);
+
+    dentry_t* mounted_dentry = dentry_get(dev_indx, 2); /* Not going to put it, to keep mounts in mem until to umount */
+    dentry_set_flag(mounted_dentry, DENTRY_MOUNTED);
+
+    mountpoint->mounted_dentry = mounted_dentry;
+    mounted_dentry->mountpoint = mountpoint;
+
+    return 0;
+}
+
+static int _vfs_check_mountpoint(dentry_t* mountpoint)
 {
     if (dentry_test_flag(mountpoint, DENTRY_MOUNTPOINT)) {
 #ifdef VFS_DEBUG
@@ -519,19 +802,55 @@ int vfs_mount(dentry_t* mountpoint, device_t* dev, uint32_t fs_indx)
 #endif
         return -ENOTDIR;
     }
+    return 0;
+}
+
+int vfs_mount(dentry_t* mountpoint, device_t* dev, uint32_t fs_indx)
+{
+    int err = _vfs_check_mountpoint(mountpoint);
+    if (err) {
+        return err;
+    }
 
     vfs_add_dev_with_fs(dev, fs_indx);
+    return _vfs_do_mount(mountpoint, dev->id);
+}
 
-    mountpoint = dentry_duplicate(mountpoint); /* We keep mounts in mem until to umount. */
-    dentry_set_flag(mountpoint, DENTRY_MOUNTPOINT);
+/**
+ * Mounts a device which is already known to vfs, e.g. the former root
+ * after vfs_switch_root.
+ */
+int vfs_mount_dev(dentry_t* mountpoint, uint32_t dev_indx)
+{
+    if (dev_indx >= MAX_DEVICES_COUNT || !_vfs_devices[dev_indx].dev) {
+        return -ENODEV;
+    }
 
-    dentry_t* mounted_dentry = dentry_get(dev->id, 2); /* Not going to put it, to keep mounts in mem until to umount */
-    dentry_set_flag(mounted_dentry, DENTRY_MOUNTED);
+    int err = _vfs_check_mountpoint(mountpoint);
+    if (err) {
+        return err;
+    }
+    return _vfs_do_mount(mountpoint, dev_indx);
+}
 
-    mountpoint->mounted_dentry = mounted_dentry;
-    mounted_dentry->mountpoint = mountpoint;
+/**
+ * Makes the file system on @dev the root of the tree. Must be called before
+ * anything is resolved from the root. Returns the index of the device which
+ * was the root so far, or -ENOENT if there was none.
+ */
+int vfs_switch_root(device_t* dev, uint32_t fs_indx)
+{
+    int32_t old_root = root_fs_dev_id;
+    int err = vfs_add_dev_with_fs(dev, fs_indx);
+    if (err) {
+        return err;
+    }
 
-    return 0;
+    root_fs_dev_id = dev->id;
+    if (old_root < 0 || old_root == dev->id) {
+        return -ENOENT;
+    }
+    return old_root;
 }
 
 int vfs_umount(dentry_t* mounted_dentry)
@@ -568,6 +887,8 @@ int vfs_umount(dentry_t* mounted_dentry)
         vfs_umount(mountpoint);
     }
 
+    namecache_remove_dev(mounted_dentry->dev_indx);
+    bcache_sync(mounted_dentry->dev->dev);
     lock_release(&mounted_dentry->lock);
     return 0;
 }
@@ -576,51 +897,90 @@ static proc_zone_t* _vfs_do_mmap(file_descriptor_t* fd, mmap_params_t* params)
 {
     bool map_shared = ((params->flags & MAP_SHARED) > 0);
     bool map_private = ((params->flags & MAP_PRIVATE) > 0);
+    bool map_fixed = ((params->flags & MAP_FIXED) > 0);
 
     proc_zone_t* zone;
 
-    if (map_private) {
-        zone = proc_new_random_zone(RUNNING_THREAD->process, params->size);
-        zone->type = ZONE_TYPE_MAPPED_FILE_PRIVATLY;
-        zone->file = dentry_duplicate(fd->dentry);
-        zone->offset = params->offset;
+    if (!map_private && !map_shared) {
+        return 0;
+    }
+
+    // Pages of shared mappings are found by their file offset.
+    if (map_shared) {
+        if (params->offset % VMM_PAGE_SIZE) {
+            return 0;
+        }
+        if ((params->prot & PROT_WRITE) && !(fd->flags & (O_WRONLY | O_RDWR))) {
+            return 0;
+        }
+    }
+
+    if (map_fixed) {
+        zone = proc_new_zone(RUNNING_THREAD->process, (uint32_t)params->addr, params->size);
     } else {
-        /* TODO */
+        zone = proc_new_random_zone(RUNNING_THREAD->process, params->size);
+    }
+    if (!zone) {
         return 0;
     }
 
+    zone->type = map_shared ? ZONE_TYPE_MAPPED_FILE_SHAREDLY : ZONE_TYPE_MAPPED_FILE_PRIVATLY;
+    zone->file = dentry_duplicate(fd->dentry);
+    zone->offset = params->offset;
+    zone->file_len = zone->len;
     return zone;
 }
 
 proc_zone_t* vfs_mmap(file_descriptor_t* fd, mmap_params_t* params)
 {
-    lock_acquire(&fd->lock);
+    kmutex_lock(&fd->lock);
     /* Check if we have a custom mmap for a dentry */
     if (fd->dentry->ops->file.mmap) {
         proc_zone_t* res = fd->dentry->ops->file.mmap(fd->dentry, params);
         if ((uint32_t)res != VFS_USE_STD_MMAP) {
-            lock_release(&fd->lock);
+            kmutex_unlock(&fd->lock);
             return res;
         }
     }
     proc_zone_t* res = _vfs_do_mmap(fd, params);
-    lock_release(&fd->lock);
+    kmutex_unlock(&fd->lock);
     return res;
 }
 
 int vfs_munmap(proc_t* p, proc_zone_t* zone)
 {
-    if (!(zone->flags & ZONE_TYPE_MAPPED_FILE_PRIVATLY) && !(zone->flags & ZONE_TYPE_MAPPED_FILE_SHAREDLY)) {
+    if (!(zone->type & ZONE_TYPE_MAPPED_FILE_PRIVATLY) && !(zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY)) {
         return -EFAULT;
     }
 
+    vmm_release_pages(zone->start, zone->len);
+    if (zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY) {
+        vmm_sync_shared_file_pages(zone, zone->start, zone->len, true);
+    }
+
     dentry_put(zone->file);
+    proc_delete_zone(p, zone);
+    return 0;
+}
 
-    for (uint32_t vaddr = zone->start; vaddr < zone->start + zone->len + 1; vaddr += VMM_PAGE_SIZE) {
-        system_flush_tlb_entry(vaddr);
+/**
+ * Dirty pages of a shared mapping are written to the file, MS_SYNC also
+ * pushes the file to the device like fsync does. Private mappings have
+ * nothing to write back.
+ */
+int vfs_msync(proc_zone_t* zone, uint32_t start, uint32_t len, int flags)
+{
+    if (!(zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY)) {
+        return 0;
     }
-    proc_delete_zone(p, zone);
 
+    vmm_sync_shared_file_pages(zone, start, len, false);
+    if (flags & MS_SYNC) {
+        dentry_flush(zone->file);
+        if (zone->file->dev) {
+            bcache_sync(zone->file->dev->dev);
+        }
+    }
     return 0;
 }
 
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <io/epoll/epoll.h>
+#include <libkern/bits/errno.h>
+#include <libkern/kassert.h>
+#include <libkern/libkern.h>
+#include <mem/kmalloc.h>
+#include <tasking/proc.h>
+#include <tasking/tasking.h>
+
+#define EPOLL_ITEMS_INITIAL 8
+
+static bool _epoll_can_read(dentry_t* dentry, uint32_t start);
+static bool _epoll_can_write(dentry_t* dentry, uint32_t start);
+static int _epoll_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+static int _epoll_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+
+static file_ops_t _epoll_ops = {
+    .can_read = _epoll_can_read,
+    .can_write = _epoll_can_write,
+    .read = _epoll_read,
+    .write = _epoll_write,
+    .open = 0,
+    .truncate = 0,
+    .create = 0,
+    .unlink = 0,
+    .getdents = 0,
+    .lookup = 0,
+    .mkdir = 0,
+    .rmdir = 0,
+    .fstat = 0,
+    .ioctl = 0,
+    .mmap = 0,
+};
+
+/**
+ * HELPERS
+ */
+
+static epoll_item_t* _epoll_find_lockless(epoll_t* ep, int fd)
+{
+    for (uint32_t i = 0; i < ep->count; i++) {
+        if (ep->items[i].fd == fd) {
+            return &ep->items[i];
+        }
+    }
+    return NULL;
+}
+
+static int _epoll_add_lockless(epoll_t* ep, int fd, epoll_event_t* event)
+{
+    if (_epoll_find_lockless(ep, fd)) {
+        return -EEXIST;
+    }
+    if (ep->count == EPOLL_ITEMS_MAX) {
+        return -ENOSPC;
+    }
+
+    if (ep->count == ep->capacity) {
+        uint32_t new_capacity = ep->capacity ? ep->capacity * 2 : EPOLL_ITEMS_INITIAL;
+        epoll_item_t* items = krealloc(ep->items, new_capacity * sizeof(epoll_item_t));
+        if (!items) {
+            return -ENOMEM;
+        }
+        ep->items = items;
+        ep->capacity = new_capacity;
+    }
+
+    epoll_item_t* item = &ep->items[ep->count++];
+    item->fd = fd;
+    item->event = *event;
+    item->disabled = false;
+    return 0;
+}
+
+/**
+ * Returns the events of @item which are ready now. Like the select blocker
+ * does, fds are read without the lock of the process, since this runs
+ * under the blocker lock.
+ */
+static uint32_t _epoll_ready_events_lockless(epoll_t* ep, epoll_item_t* item)
+{
+    if (item->disabled) {
+        return 0;
+    }
+
+    file_descriptor_t* fd = proc_get_fd_lockless(ep->owner, item->fd);
+    if (!fd) {
+        return 0;
+    }
+
+    uint32_t ready = 0;
+    if ((item->event.events & EPOLLIN) && fd->ops->can_read(fd->dentry, fd->offset)) {
+        ready |= EPOLLIN;
+    }
+    if ((item->event.events & EPOLLOUT) && fd->ops->can_write(fd->dentry, fd->offset)) {
+        ready |= EPOLLOUT;
+    }
+    return ready;
+}
+
+/**
+ * FILE OPS
+ */
+
+static bool _epoll_can_read(dentry_t* dentry, uint32_t start)
+{
+    return epoll_has_ready((epoll_t*)dentry);
+}
+
+static bool _epoll_can_write(dentry_t* dentry, uint32_t start)
+{
+    return false;
+}
+
+static int _epoll_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    return -EINVAL;
+}
+
+static int _epoll_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    return -EINVAL;
+}
+
+/**
+ * PUBLIC FUNCTIONS
+ */
+
+int epoll_create(struct proc* owner, file_descriptor_t* fd)
+{
+    epoll_t* ep = kmalloc(sizeof(epoll_t));
+    if (!ep) {
+        return -ENOMEM;
+    }
+    memset(ep, 0, sizeof(epoll_t));
+    ep->d_count = 1;
+    ep->owner = owner;
+    lock_init(&ep->lock);
+
+    fd->type = FD_TYPE_EPOLL;
+    fd->epoll_entry = ep;
+    fd->ops = &_epoll_ops;
+    kmutex_init(&fd->lock);
+    return 0;
+}
+
+epoll_t* epoll_duplicate(epoll_t* ep)
+{
+    lock_acquire(&ep->lock);
+    ep->d_count++;
+    lock_release(&ep->lock);
+    return ep;
+}
+
+void epoll_put(epoll_t* ep)
+{
+    lock_acquire(&ep->lock);
+    ASSERT(ep->d_count > 0);
+    ep->d_count--;
+    if (ep->d_count > 0) {
+        lock_release(&ep->lock);
+        return;
+    }
+    lock_release(&ep->lock);
+
+    kfree(ep->items);
+    kfree(ep);
+}
+
+int epoll_ctl(epoll_t* ep, int op, int fd, epoll_event_t* event)
+{
+    /* A closed fd can still be removed. */
+    if (op != EPOLL_CTL_DEL) {
+        file_descriptor_t* target = proc_get_fd(ep->owner, fd);
+        if (!target) {
+            return -EBADF;
+        }
+        /* Nested epolls would take their locks recursively. */
+        if (target->type == FD_TYPE_EPOLL) {
+            return -EINVAL;
+        }
+    }
+
+    int err = 0;
+    lock_acquire(&ep->lock);
+    epoll_item_t* item = _epoll_find_lockless(ep, fd);
+    switch (op) {
+    case EPOLL_CTL_ADD:
+        err = _epoll_add_lockless(ep, fd, event);
+        break;
+    case EPOLL_CTL_MOD:
+        if (!item) {
+            err = -ENOENT;
+            break;
+        }
+        item->event = *event;
+        item->disabled = false;
+        break;
+    case EPOLL_CTL_DEL:
+        if (!item) {
+            err = -ENOENT;
+            break;
+        }
+        *item = ep->items[--ep->count];
+        break;
+    default:
+        err = -EINVAL;
+    }
+    lock_release(&ep->lock);
+
+    /* A waiter could be blocked on an item which is ready already. */
+    if (!err && op != EPOLL_CTL_DEL) {
+        blocker_wake_io();
+    }
+    return err;
+}
+
+bool epoll_has_ready(epoll_t* ep)
+{
+    lock_acquire(&ep->lock);
+    for (uint32_t i = 0; i < ep->count; i++) {
+        if (_epoll_ready_events_lockless(ep, &ep->items[i])) {
+            lock_release(&ep->lock);
+            return true;
+        }
+    }
+    lock_release(&ep->lock);
+    return false;
+}
+
+/**
+ * Fills @events with up to @maxevents ready items and returns their count.
+ * Reported EPOLLONESHOT items are disabled.
+ */
+int epoll_collect(epoll_t* ep, epoll_event_t* events, int maxevents)
+{
+    int ready_count = 0;
+    lock_acquire(&ep->lock);
+    for (uint32_t i = 0; i < ep->count && ready_count < maxevents; i++) {
+        epoll_item_t* item = &ep->items[i];
+        uint32_t ready = _epoll_ready_events_lockless(ep, item);
+        if (!ready) {
+            continue;
+        }
+
+        events[ready_count].events = ready;
+        events[ready_count].data = item->event.data;
+        ready_count++;
+        if (item->event.events & EPOLLONESHOT) {
+            item->disabled = true;
+        }
+    }
+    lock_release(&ep->lock);
+    return ready_count;
+}
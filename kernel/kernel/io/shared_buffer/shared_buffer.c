@@ -4,102 +4,265 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
-#include <algo/bitmap.h>
 #include <io/shared_buffer/shared_buffer.h>
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/lock.h>
 #include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <mem/pmm.h>
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
+#include <tasking/tasking.h>
 
 // #define SHARED_BUFFER_DEBUG
 
-#define SHBUF_SPACE_SIZE (128 * MB)
-#define SHBUF_BLOCK_SIZE (4 * KB)
-#define SHBUF_MAX_BUFFERS 128
+#define SHBUF_TABLE_START_SIZE 32
 
-uint8_t* buffers[SHBUF_MAX_BUFFERS];
-
-struct shared_buffer_header {
+/**
+ * A buffer is a set of frames which is mapped only into processes which
+ * got it, it lives while it has mappings. A handed over buffer is kept
+ * without mappings until another process gets it.
+ */
+struct shared_buffer {
+    uint32_t* frames;
+    uint32_t frames_count;
     size_t len;
+    int mappings;
+    pid_t owner;
+    bool handing_over;
+    bool sealed;
 };
-typedef struct shared_buffer_header shared_buffer_header_t;
+typedef struct shared_buffer shared_buffer_t;
 
 static lock_t _shared_buffer_lock;
-static zone_t _shared_buffer_zone;
-static uint32_t _shared_buffer_bitmap_len = 0;
-static uint8_t* _shared_buffer_bitmap;
-static bitmap_t bitmap;
+static shared_buffer_t** _shared_buffers;
+static uint32_t _shared_buffers_size = 0;
 
-static inline uint32_t _shared_buffer_to_vaddr(int start)
+static inline uint32_t _shared_buffer_pages(size_t len)
 {
-    return (uint32_t)_shared_buffer_zone.start + start * SHBUF_BLOCK_SIZE;
+    return (len + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
 }
 
-static inline int _shared_buffer_to_index(uint32_t vaddr)
+static inline shared_buffer_t* _shared_buffer_get_lockless(int id)
 {
-    return (vaddr - (uint32_t)_shared_buffer_zone.start) / SHBUF_BLOCK_SIZE;
+    if (unlikely(id < 0 || _shared_buffers_size <= id)) {
+        return NULL;
+    }
+    return _shared_buffers[id];
 }
 
-static inline int _shared_buffer_alloc_id()
+static int _shared_buffer_alloc_id_lockless()
 {
-    for (int i = 0; i < SHBUF_MAX_BUFFERS; i++) {
-        if (!buffers[i]) {
+    for (int i = 0; i < _shared_buffers_size; i++) {
+        if (!_shared_buffers[i]) {
             return i;
         }
     }
-    return -1;
+
+    uint32_t new_size = _shared_buffers_size ? 2 * _shared_buffers_size : SHBUF_TABLE_START_SIZE;
+    shared_buffer_t** new_table = kmalloc(new_size * sizeof(shared_buffer_t*));
+    if (!new_table) {
+        return -ENOMEM;
+    }
+    memset(new_table, 0, new_size * sizeof(shared_buffer_t*));
+    if (_shared_buffers) {
+        memcpy(new_table, _shared_buffers, _shared_buffers_size * sizeof(shared_buffer_t*));
+        kfree(_shared_buffers);
+    }
+
+    int id = _shared_buffers_size;
+    _shared_buffers = new_table;
+    _shared_buffers_size = new_size;
+    return id;
 }
 
-static void _shared_buffer_init_bitmap()
+static void _shared_buffer_zero_frame(uint32_t frame)
 {
-    _shared_buffer_bitmap = _shared_buffer_zone.ptr;
-    _shared_buffer_bitmap_len = (SHBUF_SPACE_SIZE / SHBUF_BLOCK_SIZE / 8);
+    zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(tmp_zone.start, frame, PAGE_READABLE | PAGE_WRITABLE);
+    memset(tmp_zone.ptr, 0, VMM_PAGE_SIZE);
+    vmm_unmap_page(tmp_zone.start);
+    zoner_free_zone(tmp_zone);
+}
+
+/**
+ * Grows the buffer to @pages frames, frames it already has are kept.
+ */
+static int _shared_buffer_reserve_lockless(shared_buffer_t* buf, uint32_t pages)
+{
+    if (pages <= buf->frames_count) {
+        return 0;
+    }
+
+    uint32_t* frames = kmalloc(pages * sizeof(uint32_t));
+    if (!frames) {
+        return -ENOMEM;
+    }
+    if (buf->frames) {
+        memcpy(frames, buf->frames, buf->frames_count * sizeof(uint32_t));
+    }
+
+    for (uint32_t i = buf->frames_count; i < pages; i++) {
+        frames[i] = (uint32_t)pmm_alloc_frame();
+        if (!frames[i]) {
+            for (uint32_t j = buf->frames_count; j < i; j++) {
+                pmm_free_frame((void*)frames[j]);
+            }
+            kfree(frames);
+            return -ENOMEM;
+        }
+        _shared_buffer_zero_frame(frames[i]);
+    }
 
-    bitmap = bitmap_wrap(_shared_buffer_bitmap, _shared_buffer_bitmap_len);
-    memset(_shared_buffer_bitmap, 0, _shared_buffer_bitmap_len);
+    if (buf->frames) {
+        kfree(buf->frames);
+    }
+    buf->frames = frames;
+    buf->frames_count = pages;
+    return 0;
+}
 
-    /* Setting bitmap as a busy region. */
-    int blocks_needed = (_shared_buffer_bitmap_len + SHBUF_BLOCK_SIZE - 1) / SHBUF_BLOCK_SIZE;
-    bitmap_set_range(bitmap, _shared_buffer_to_index((uint32_t)_shared_buffer_bitmap), blocks_needed);
+static void _shared_buffer_destroy_lockless(int id)
+{
+    shared_buffer_t* buf = _shared_buffers[id];
+    for (uint32_t i = 0; i < buf->frames_count; i++) {
+        pmm_free_frame((void*)buf->frames[i]);
+    }
+    if (buf->frames) {
+        kfree(buf->frames);
+    }
+    kfree(buf);
+    _shared_buffers[id] = NULL;
+#ifdef SHARED_BUFFER_DEBUG
+    log("Buffer destroyed %d", id);
+#endif
+}
+
+static proc_zone_t* _shared_buffer_find_zone(proc_t* p, int id)
+{
+    for (int i = 0; i < p->zones.size; i++) {
+        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&p->zones, i);
+        if ((zone->type & ZONE_TYPE_SHARED_BUFFER) && zone->shared_buffer == id) {
+            return zone;
+        }
+    }
+    return NULL;
+}
+
+static void _shared_buffer_unmap_zone(proc_t* p, proc_zone_t* zone)
+{
+    vmm_unmap_object_pages(zone->start, zone->len / VMM_PAGE_SIZE);
+    proc_delete_zone(p, zone);
+}
+
+static void _shared_buffer_put_lockless(int id)
+{
+    shared_buffer_t* buf = _shared_buffer_get_lockless(id);
+    if (!buf) {
+        return;
+    }
+
+    buf->mappings--;
+    if (buf->mappings > 0 || buf->handing_over) {
+        return;
+    }
+    _shared_buffer_destroy_lockless(id);
+}
+
+/**
+ * Maps all frames of the buffer into the running process. A mapping which
+ * the process already has is reused while it covers every frame.
+ */
+static int _shared_buffer_map_lockless(int id, shared_buffer_t* buf, uint8_t** res_buffer)
+{
+    proc_t* p = RUNNING_THREAD->process;
+    uint32_t len = buf->frames_count * VMM_PAGE_SIZE;
+
+    proc_zone_t* zone = _shared_buffer_find_zone(p, id);
+    if (zone && zone->len >= len) {
+        *res_buffer = (uint8_t*)zone->start;
+        return 0;
+    }
+
+    bool remap = (zone != NULL);
+    if (remap) {
+        _shared_buffer_unmap_zone(p, zone);
+    }
+
+    zone = proc_new_random_zone(p, len);
+    if (!zone) {
+        if (remap) {
+            _shared_buffer_put_lockless(id);
+        }
+        return -ENOMEM;
+    }
+    zone->type = ZONE_TYPE_SHARED_BUFFER;
+    zone->flags |= ZONE_READABLE;
+    if (!buf->sealed || p->pid == buf->owner) {
+        zone->flags |= ZONE_WRITABLE;
+    }
+    zone->shared_buffer = id;
+    vmm_map_object_pages(zone->start, buf->frames, buf->frames_count, zone->flags);
+
+    if (!remap) {
+        buf->mappings++;
+        if (p->pid != buf->owner) {
+            buf->handing_over = false;
+        }
+    }
+    *res_buffer = (uint8_t*)zone->start;
+#ifdef SHARED_BUFFER_DEBUG
+    log("Buffer %d mapped at %x for %d", id, zone->start, p->pid);
+#endif
+    return 0;
 }
 
 int shared_buffer_init()
 {
-    _shared_buffer_zone = zoner_new_zone(SHBUF_SPACE_SIZE);
-    _shared_buffer_init_bitmap();
     lock_init(&_shared_buffer_lock);
+    lock_stat_register(&_shared_buffer_lock, "shared_buffer");
     return 0;
 }
 
 int shared_buffer_create(uint8_t** res_buffer, size_t size)
 {
+    if (!size) {
+        return -EINVAL;
+    }
+
+    shared_buffer_t* buf = kmalloc(sizeof(shared_buffer_t));
+    if (!buf) {
+        return -ENOMEM;
+    }
+    memset(buf, 0, sizeof(shared_buffer_t));
+    buf->len = size;
+    buf->owner = RUNNING_THREAD->process->pid;
+
     lock_acquire(&_shared_buffer_lock);
-    int buf_id = _shared_buffer_alloc_id();
+    int buf_id = _shared_buffer_alloc_id_lockless();
     if (buf_id < 0) {
         lock_release(&_shared_buffer_lock);
-        return -ENOMEM;
+        kfree(buf);
+        return buf_id;
     }
 
-    size_t act_size = size + sizeof(shared_buffer_header_t);
-
-    int blocks_needed = (act_size + SHBUF_BLOCK_SIZE - 1) / SHBUF_BLOCK_SIZE;
-    int start = bitmap_find_space(bitmap, blocks_needed);
-    if (start < 0) {
+    int err = _shared_buffer_reserve_lockless(buf, _shared_buffer_pages(size));
+    if (err) {
         lock_release(&_shared_buffer_lock);
-        return -ENOMEM;
+        kfree(buf);
+        return err;
     }
 
-    shared_buffer_header_t* space = (shared_buffer_header_t*)_shared_buffer_to_vaddr(start);
-    space->len = act_size;
-    bitmap_set_range(bitmap, start, blocks_needed);
-    vmm_tune_pages((uint32_t)space, act_size, PAGE_WRITABLE | PAGE_EXECUTABLE | PAGE_READABLE | PAGE_USER);
-
-    *res_buffer = (uint8_t*)&space[1];
-    buffers[buf_id] = (uint8_t*)&space[1];
+    _shared_buffers[buf_id] = buf;
+    err = _shared_buffer_map_lockless(buf_id, buf, res_buffer);
+    if (err) {
+        _shared_buffer_destroy_lockless(buf_id);
+        lock_release(&_shared_buffer_lock);
+        return err;
+    }
 #ifdef SHARED_BUFFER_DEBUG
-    log("Buffer created at %x %d", buffers[buf_id], buf_id);
+    log("Buffer created %d", buf_id);
 #endif
     lock_release(&_shared_buffer_lock);
     return buf_id;
@@ -107,39 +270,129 @@ int shared_buffer_create(uint8_t** res_buffer, size_t size)
 
 int shared_buffer_get(int id, uint8_t** res_buffer)
 {
-    if (unlikely(id < 0 || SHBUF_MAX_BUFFERS <= id)) {
+    lock_acquire(&_shared_buffer_lock);
+    shared_buffer_t* buf = _shared_buffer_get_lockless(id);
+    if (unlikely(!buf)) {
+        lock_release(&_shared_buffer_lock);
+        return -EINVAL;
+    }
+
+    int err = _shared_buffer_map_lockless(id, buf, res_buffer);
+    lock_release(&_shared_buffer_lock);
+    return err;
+}
+
+/**
+ * Only the owner could resize the buffer. Frames are never moved, so other
+ * processes keep their mappings and see the new frames once they get the
+ * buffer again. Shrinking keeps the frames for the next growth.
+ */
+int shared_buffer_resize(int id, uint8_t** res_buffer, size_t size)
+{
+    if (!size) {
         return -EINVAL;
     }
 
     lock_acquire(&_shared_buffer_lock);
-    if (unlikely(buffers[id] == 0)) {
+    shared_buffer_t* buf = _shared_buffer_get_lockless(id);
+    if (unlikely(!buf)) {
         lock_release(&_shared_buffer_lock);
         return -EINVAL;
     }
-#ifdef SHARED_BUFFER_DEBUG
-    log("Buffer opened at %x %d", buffers[id], id);
-#endif
-    *res_buffer = buffers[id];
+    if (buf->owner != RUNNING_THREAD->process->pid || buf->sealed) {
+        lock_release(&_shared_buffer_lock);
+        return -EPERM;
+    }
+
+    int err = _shared_buffer_reserve_lockless(buf, _shared_buffer_pages(size));
+    if (!err) {
+        buf->len = size;
+        err = _shared_buffer_map_lockless(id, buf, res_buffer);
+    }
     lock_release(&_shared_buffer_lock);
-    return 0;
+    return err;
 }
 
-int shared_buffer_free(int id)
+static int _shared_buffer_unmap(int id, bool hand_over)
 {
-    if (unlikely(id < 0 || SHBUF_MAX_BUFFERS <= id)) {
+    proc_t* p = RUNNING_THREAD->process;
+
+    lock_acquire(&_shared_buffer_lock);
+    shared_buffer_t* buf = _shared_buffer_get_lockless(id);
+    proc_zone_t* zone = buf ? _shared_buffer_find_zone(p, id) : NULL;
+    if (unlikely(!zone)) {
+        lock_release(&_shared_buffer_lock);
         return -EINVAL;
     }
 
+    if (hand_over) {
+        buf->handing_over = true;
+    }
+    _shared_buffer_unmap_zone(p, zone);
+    _shared_buffer_put_lockless(id);
+    lock_release(&_shared_buffer_lock);
+    return 0;
+}
+
+/**
+ * Unmaps the buffer from the running process.
+ */
+int shared_buffer_free(int id)
+{
+    return _shared_buffer_unmap(id, false);
+}
+
+/**
+ * Unmaps the buffer from the running process, but keeps it for a process
+ * which gets it later. Used to pass data with a single reader.
+ */
+int shared_buffer_hand_over(int id)
+{
+    return _shared_buffer_unmap(id, true);
+}
+
+/**
+ * Only the owner could seal the buffer. Once sealed the buffer can't be
+ * resized and other processes map it read-only, so the owner could share
+ * data which nobody else may change.
+ */
+int shared_buffer_seal(int id)
+{
     lock_acquire(&_shared_buffer_lock);
-    if (unlikely(buffers[id] == 0)) {
+    shared_buffer_t* buf = _shared_buffer_get_lockless(id);
+    if (unlikely(!buf)) {
         lock_release(&_shared_buffer_lock);
         return -EINVAL;
     }
+    if (buf->owner != RUNNING_THREAD->process->pid) {
+        lock_release(&_shared_buffer_lock);
+        return -EPERM;
+    }
 
-    shared_buffer_header_t* sptr = (shared_buffer_header_t*)buffers[id];
-    size_t blocks_to_delete = (sptr[-1].len + SHBUF_BLOCK_SIZE - 1) / SHBUF_BLOCK_SIZE;
-    bitmap_unset_range(bitmap, _shared_buffer_to_index((uint32_t)&sptr[-1]), blocks_to_delete);
-    buffers[id] = 0;
+    buf->sealed = true;
     lock_release(&_shared_buffer_lock);
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * A mapping was copied to a forked process.
+ */
+void shared_buffer_duplicate(int id)
+{
+    lock_acquire(&_shared_buffer_lock);
+    shared_buffer_t* buf = _shared_buffer_get_lockless(id);
+    if (buf) {
+        buf->mappings++;
+    }
+    lock_release(&_shared_buffer_lock);
+}
+
+/**
+ * A mapping is gone with its address space, the pages are already unmapped.
+ */
+void shared_buffer_put(int id)
+{
+    lock_acquire(&_shared_buffer_lock);
+    _shared_buffer_put_lockless(id);
+    lock_release(&_shared_buffer_lock);
+}
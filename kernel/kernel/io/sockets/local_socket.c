@@ -5,9 +5,11 @@
  */
 
 #include <io/sockets/local_socket.h>
+#include <libkern/atomic.h>
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
+#include <libkern/trace.h>
 #include <mem/kmalloc.h>
 #include <tasking/proc.h>
 #include <tasking/tasking.h>
@@ -40,34 +42,89 @@ int local_socket_create(int type, int protocol, file_descriptor_t* fd)
 bool local_socket_can_read(dentry_t* dentry, uint32_t start)
 {
     socket_t* sock_entry = (socket_t*)dentry;
-    return sync_ringbuffer_space_to_read_with_custom_start(&sock_entry->buffer, start) != 0;
+    if (sock_entry->bind_file.dentry) {
+        return atomic_load(&sock_entry->backlog_count) != 0;
+    }
+    return sync_ringbuffer_space_to_read(&sock_entry->buffer) != 0 || atomic_load(&sock_entry->peer_closed);
 }
 
+/* Reads consume the buffer of this end, freed space is reported to the
+   writers of the peer. Returns 0 once the peer is closed and all is read. */
 int local_socket_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
     socket_t* sock_entry = (socket_t*)dentry;
-    uint32_t read = sync_ringbuffer_read_with_start(&sock_entry->buffer, start, buf, len);
+    if (sock_entry->bind_file.dentry) {
+        return -EINVAL;
+    }
+
+    uint32_t read = sync_ringbuffer_read(&sock_entry->buffer, buf, len);
+    if (!read) {
+        return 0;
+    }
+
+    lock_acquire(&socket_lock);
+    socket_t* peer = sock_entry->peer;
+    if (peer) {
+        peer->space_seq++;
+        blocker_wake_queue(&peer->space_waiters, FUTEX_WAKE_ALL);
+    }
+    lock_release(&socket_lock);
     return read;
 }
 
-/* Each process has it's own start when reading from a local socket.
-   We ignore their offsets and write always, hope all readers could
-   read all needed data. */
+static inline uint32_t _local_socket_space_lockless(socket_t* peer)
+{
+    return sync_ringbuffer_space_to_write(&peer->buffer);
+}
+
 bool local_socket_can_write(dentry_t* dentry, uint32_t start)
 {
-    return true;
+    socket_t* sock_entry = (socket_t*)dentry;
+    lock_acquire(&socket_lock);
+    socket_t* peer = sock_entry->peer;
+    bool res = !peer || _local_socket_space_lockless(peer) != 0;
+    lock_release(&socket_lock);
+    return res;
 }
 
+/* A write which fits into the buffer of the peer goes there at once, so
+   messages are never interleaved. Bigger writes go in parts. The writer
+   sleeps while there is no room. */
 int local_socket_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
     socket_t* sock_entry = (socket_t*)dentry;
-    uint32_t written = sync_ringbuffer_write_ignore_bounds(&sock_entry->buffer, buf, len);
-    return 0;
+    uint32_t capacity = sock_entry->buffer.ringbuffer.zone.len - 1;
+    uint32_t written = 0;
+
+    while (written < len) {
+        lock_acquire(&socket_lock);
+        socket_t* peer = sock_entry->peer;
+        if (!peer) {
+            lock_release(&socket_lock);
+            return written ? written : -EPIPE;
+        }
+
+        uint32_t left = len - written;
+        uint32_t space = _local_socket_space_lockless(peer);
+        if (space >= left || (space && left > capacity)) {
+            written += sync_ringbuffer_write(&peer->buffer, buf + written, min(space, left));
+            lock_release(&socket_lock);
+            blocker_wake_io();
+            continue;
+        }
+
+        uint32_t seq = sock_entry->space_seq;
+        lock_release(&socket_lock);
+        init_wait_blocker(RUNNING_THREAD, &sock_entry->space_waiters, &sock_entry->space_seq, seq);
+    }
+
+    trace_point(TRACE_IPC_SEND, sock_entry, len, written);
+    return written;
 }
 
 int local_socket_bind(file_descriptor_t* sock, char* path, uint32_t len)
 {
-    lock_acquire(&sock->lock);
+    kmutex_lock(&sock->lock);
     proc_t* p = RUNNING_THREAD->process;
 
     char* name = vfs_helper_split_path_with_name(path, strlen(path));
@@ -75,7 +132,7 @@ int local_socket_bind(file_descriptor_t* sock, char* path, uint32_t len)
     if (vfs_resolve_path_start_from(p->cwd, path, &location) < 0) {
         vfs_helper_restore_full_path_after_split(path, name);
         kfree(name);
-        lock_release(&sock->lock);
+        kmutex_unlock(&sock->lock);
         return -ENOENT;
     }
 
@@ -89,7 +146,7 @@ int local_socket_bind(file_descriptor_t* sock, char* path, uint32_t len)
         log_error("Bind: can't find path to file : %d pid\n", p->pid);
 #endif
         dentry_put(location);
-        lock_release(&sock->lock);
+        kmutex_unlock(&sock->lock);
         return res;
     }
     dentry_put(location);
@@ -99,7 +156,7 @@ int local_socket_bind(file_descriptor_t* sock, char* path, uint32_t len)
 #ifdef LOCAL_SOCKET_DEBUG
         log_error("Bind: can't open file [%d] : %d pid\n", -res, p->pid);
 #endif
-        lock_release(&sock->lock);
+        kmutex_unlock(&sock->lock);
         return res;
     }
 #ifdef LOCAL_SOCKET_DEBUG
@@ -107,13 +164,13 @@ int local_socket_bind(file_descriptor_t* sock, char* path, uint32_t len)
 #endif
     sock->sock_entry->bind_file.dentry->sock = socket_duplicate(sock->sock_entry);
     vfs_helper_restore_full_path_after_split(path, name);
-    lock_release(&sock->lock);
+    kmutex_unlock(&sock->lock);
     return 0;
 }
 
 int local_socket_connect(file_descriptor_t* sock, char* path, uint32_t len)
 {
-    lock_acquire(&sock->lock);
+    kmutex_lock(&sock->lock);
     proc_t* p = RUNNING_THREAD->process;
 
     dentry_t* bind_dentry;
@@ -122,26 +179,59 @@ int local_socket_connect(file_descriptor_t* sock, char* path, uint32_t len)
 #ifdef LOCAL_SOCKET_DEBUG
         log_error("Connect: can't find path to file %s : %d pid\n", path, p->pid);
 #endif
-        lock_release(&sock->lock);
+        kmutex_unlock(&sock->lock);
         return res;
     }
     if ((bind_dentry->inode->mode & S_IFSOCK) == 0) {
 #ifdef LOCAL_SOCKET_DEBUG
         log_error("Connect: file not a socket : %d pid\n", p->pid);
 #endif
-        lock_release(&sock->lock);
+        kmutex_unlock(&sock->lock);
         return -ENOTSOCK;
     }
 
     if (!bind_dentry->sock) {
-        lock_release(&sock->lock);
-        return -EBADF;
+        dentry_put(bind_dentry);
+        kmutex_unlock(&sock->lock);
+        return -ECONNREFUSED;
     }
-    sock->sock_entry = socket_duplicate(bind_dentry->sock);
-    sock->offset = bind_dentry->sock->buffer.ringbuffer.end; /* Starting to read from the end */
+    res = socket_connect(bind_dentry->sock, sock->sock_entry);
 #ifdef LOCAL_SOCKET_DEBUG
     log("Connected to local socket at %x : %d pid", bind_dentry->sock, p->pid);
 #endif
-    lock_release(&sock->lock);
+    dentry_put(bind_dentry);
+    kmutex_unlock(&sock->lock);
+    return res;
+}
+
+/**
+ * Blocks until there is a connection to the bound socket and opens its
+ * server end as @new_sock.
+ */
+int local_socket_accept(file_descriptor_t* sock, file_descriptor_t* new_sock)
+{
+    if (!sock->sock_entry->bind_file.dentry) {
+        return -EINVAL;
+    }
+
+    int err = init_read_blocker(RUNNING_THREAD, sock);
+    if (err) {
+        return err;
+    }
+
+    socket_t* conn = socket_accept(sock->sock_entry);
+    if (!conn) {
+        return -EAGAIN;
+    }
+
+    new_sock->type = FD_TYPE_SOCKET;
+    new_sock->sock_entry = conn;
+    new_sock->ops = &local_socket_ops;
+    new_sock->offset = 0;
+    new_sock->flags = 0;
+    kmutex_init(&new_sock->lock);
+#ifdef LOCAL_SOCKET_DEBUG
+    log("Accepted local socket at %x : %d pid", conn, RUNNING_THREAD->process->pid);
+#endif
     return 0;
 }
\ No newline at end of file
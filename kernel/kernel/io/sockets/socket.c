@@ -6,20 +6,60 @@
 
 #include <algo/sync_ringbuffer.h>
 #include <io/sockets/socket.h>
+#include <libkern/bits/errno.h>
 #include <libkern/kassert.h>
+#include <mem/kmalloc.h>
+#include <tasking/tasking.h>
 
-socket_t socket_list[MAX_SOCKET_COUNT];
-static int next_socket = 0;
+/* A zeroed ticket lock is free, so it's usable before any socket exists. */
+lock_t socket_lock;
 
 static socket_t* _socket_create(int domain, int type, int protocol)
 {
-    socket_list[next_socket].domain = domain;
-    socket_list[next_socket].type = type;
-    socket_list[next_socket].protocol = protocol;
-    socket_list[next_socket].buffer = sync_ringbuffer_create_std();
-    socket_list[next_socket].d_count = 1;
-    lock_init(&socket_list[next_socket].lock);
-    return &socket_list[next_socket++];
+    socket_t* sock = kmalloc(sizeof(socket_t));
+    if (!sock) {
+        return NULL;
+    }
+    memset(sock, 0, sizeof(socket_t));
+    sock->domain = domain;
+    sock->type = type;
+    sock->protocol = protocol;
+    sock->buffer = sync_ringbuffer_create_std();
+    if (!sock->buffer.ringbuffer.zone.start) {
+        kfree(sock);
+        return NULL;
+    }
+    sock->d_count = 1;
+    lock_init(&sock->lock);
+    return sock;
+}
+
+/**
+ * Detaches the socket from its peer and drops the ends which still wait
+ * for accept(), called once the last reference is gone.
+ */
+static void _socket_disconnect(socket_t* sock)
+{
+    lock_acquire(&socket_lock);
+    socket_t* peer = sock->peer;
+    if (peer) {
+        peer->peer = NULL;
+        peer->peer_closed = true;
+        sock->peer = NULL;
+    }
+    uint32_t backlog_count = sock->backlog_count;
+    sock->backlog_count = 0;
+    lock_release(&socket_lock);
+
+    /* Writers of the peer wait for space in our buffer. */
+    if (peer) {
+        blocker_wake_queue(&peer->space_waiters, FUTEX_WAKE_ALL);
+        blocker_wake_io();
+    }
+
+    for (int i = 0; i < backlog_count; i++) {
+        socket_put(sock->backlog[i]);
+    }
 }
 
 int socket_create(int domain, int type, int protocol, file_descriptor_t* fd, file_ops_t* ops)
@@ -28,11 +68,63 @@ int socket_create(int domain, int type, int protocol, file_descriptor_t* fd, fil
     fd->sock_entry = _socket_create(domain, type, protocol);
     fd->ops = ops;
     if (!fd->sock_entry) {
-        return -1;
+        return -ENOMEM;
+    }
+    kmutex_init(&fd->lock);
+    return 0;
+}
+
+/**
+ * Creates the server end of a connection from @sock and queues it in the
+ * backlog of @listener.
+ */
+int socket_connect(socket_t* listener, socket_t* sock)
+{
+    socket_t* peer = _socket_create(sock->domain, sock->type, sock->protocol);
+    if (!peer) {
+        return -ENOMEM;
+    }
+
+    lock_acquire(&socket_lock);
+    if (sock->peer) {
+        lock_release(&socket_lock);
+        socket_put(peer);
+        return -EISCONN;
     }
+    if (listener->backlog_count == SOCKET_BACKLOG_SIZE) {
+        lock_release(&socket_lock);
+        socket_put(peer);
+        return -ECONNREFUSED;
+    }
+    sock->peer = peer;
+    sock->peer_closed = false;
+    peer->peer = sock;
+    listener->backlog[listener->backlog_count++] = peer;
+    lock_release(&socket_lock);
+    blocker_wake_io();
     return 0;
 }
 
+/**
+ * Takes the oldest connection of the backlog, the reference is passed to
+ * the caller.
+ */
+socket_t* socket_accept(socket_t* listener)
+{
+    lock_acquire(&socket_lock);
+    if (!listener->backlog_count) {
+        lock_release(&socket_lock);
+        return NULL;
+    }
+    socket_t* sock = listener->backlog[0];
+    listener->backlog_count--;
+    for (int i = 0; i < listener->backlog_count; i++) {
+        listener->backlog[i] = listener->backlog[i + 1];
+    }
+    lock_release(&socket_lock);
+    return sock;
+}
+
 socket_t* socket_duplicate(socket_t* sock)
 {
     lock_acquire(&sock->lock);
@@ -44,11 +136,16 @@ socket_t* socket_duplicate(socket_t* sock)
 int socket_put(socket_t* sock)
 {
     lock_acquire(&sock->lock);
-    sock->d_count--;
     ASSERT(sock->d_count > 0);
-    if (sock->d_count == 0) {
-        sync_ringbuffer_free(&sock->buffer);
+    sock->d_count--;
+    if (sock->d_count > 0) {
+        lock_release(&sock->lock);
+        return 0;
     }
     lock_release(&sock->lock);
+
+    _socket_disconnect(sock);
+    sync_ringbuffer_free(&sock->buffer);
+    kfree(sock);
     return 0;
-}
\ No newline at end of file
+}
@@ -10,16 +10,19 @@
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <tasking/tasking.h>
 
-#define INODE2PTSNO(x) (x - 1)
 #define PTSNO2INODE(x) (x + 1)
 
 /**
- * Since pty masters are virtual files and don't present on real hd,
- * we use an array of dentries. This dentries won't be present in the
- * list of dentries (dentry.c), so other threads con't access it.
+ * Pty masters are virtual files and aren't present on a disk, so their
+ * dentries live in the entries. They aren't in the lists of dentry.c,
+ * other threads can't find them.
  */
-pty_master_entry_t pty_masters[PTYS_COUNT];
+static pty_master_entry_t* _ptm_free_list = NULL;
+static int _ptm_next_id = 0;
+static lock_t _ptm_lock;
 
 int _pty_master_free_dentry_data(dentry_t* dentry);
 bool pty_master_can_read(dentry_t* dentry, uint32_t start);
@@ -57,80 +60,95 @@ static fs_ops_t pty_master_ops = {
     }
 };
 
-static pty_master_entry_t* _ptm_get(dentry_t* dentry)
+static inline pty_master_entry_t* _ptm_get(dentry_t* dentry)
 {
-    for (int i = 0; i < PTYS_COUNT; i++) {
-        if (dentry == &pty_masters[i].dentry) {
-            return &pty_masters[i];
-        }
-    }
-    return NULL;
+    return (pty_master_entry_t*)((uint8_t*)dentry - __builtin_offsetof(pty_master_entry_t, dentry));
 }
 
 int _pty_master_free_dentry_data(dentry_t* dentry)
 {
     pty_master_entry_t* ptm = _ptm_get(dentry);
-    ASSERT(ptm);
-    ptm->dentry.inode_indx = 0;
+    lock_acquire(&_ptm_lock);
+    ptm->next_free = _ptm_free_list;
+    _ptm_free_list = ptm;
+    lock_release(&_ptm_lock);
     return 0;
 }
 
 bool pty_master_can_read(dentry_t* dentry, uint32_t start)
 {
     pty_master_entry_t* ptm = _ptm_get(dentry);
-    ASSERT(ptm);
     return sync_ringbuffer_space_to_read(&ptm->buffer) >= 1;
 }
 
 bool pty_master_can_write(dentry_t* dentry, uint32_t start)
 {
     pty_master_entry_t* ptm = _ptm_get(dentry);
-    ASSERT(ptm);
     return sync_ringbuffer_space_to_write(&ptm->pts->buffer) >= 0;
 }
 
 int pty_master_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
     pty_master_entry_t* ptm = _ptm_get(dentry);
-    ASSERT(ptm);
-    uint32_t leno = sync_ringbuffer_space_to_read(&ptm->buffer);
-    if (leno > len) {
-        leno = len;
-    }
-    int res = sync_ringbuffer_read(&ptm->buffer, buf, leno);
-    return leno;
+    /* The ringbuffer clamps len itself, so it's taken under one lock. */
+    return sync_ringbuffer_read(&ptm->buffer, buf, len);
 }
 
 int pty_master_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
     pty_master_entry_t* ptm = _ptm_get(dentry);
-    ASSERT(ptm);
     sync_ringbuffer_write(&ptm->pts->buffer, buf, len);
+    blocker_wake_io();
     return len;
 }
 
 int pty_master_fstat(dentry_t* dentry, fstat_t* stat)
 {
     pty_master_entry_t* ptm = _ptm_get(dentry);
-    ASSERT(ptm);
-    stat->dev = MKDEV(128, INODE2PTSNO(dentry->inode_indx));
+    stat->dev = MKDEV(128, ptm->id);
     return 0;
 }
 
-int pty_master_alloc(file_descriptor_t* fd)
+static pty_master_entry_t* _ptm_create()
 {
-    pty_master_entry_t* ptm = 0;
-    for (int i = 0; i < PTYS_COUNT; i++) {
-        if (pty_masters[i].dentry.inode_indx == 0) {
-            /* According to dentry.c when inode_indx==0, dentry is free */
-            ptm = &pty_masters[i];
-            ptm->dentry.inode_indx = PTSNO2INODE(i);
-            break;
-        }
+    pty_master_entry_t* ptm = kmalloc(sizeof(pty_master_entry_t));
+    if (!ptm) {
+        return NULL;
     }
+    memset(ptm, 0, sizeof(pty_master_entry_t));
 
-    if (!ptm) {
-        return -EBUSY;
+    lock_acquire(&_ptm_lock);
+    ptm->id = _ptm_next_id++;
+    lock_release(&_ptm_lock);
+
+    ptm->buffer = sync_ringbuffer_create_std();
+    ptm->pts = pty_slave_create(ptm->id, ptm);
+    if (!ptm->pts) {
+        sync_ringbuffer_free(&ptm->buffer);
+        kfree(ptm);
+        return NULL;
+    }
+    return ptm;
+}
+
+int pty_master_alloc(file_descriptor_t* fd)
+{
+    lock_acquire(&_ptm_lock);
+    pty_master_entry_t* ptm = _ptm_free_list;
+    if (ptm) {
+        _ptm_free_list = ptm->next_free;
+    }
+    lock_release(&_ptm_lock);
+
+    if (ptm) {
+        /* Whatever the last user left unread is dropped. */
+        sync_ringbuffer_clear(&ptm->buffer);
+        sync_ringbuffer_clear(&ptm->pts->buffer);
+    } else {
+        ptm = _ptm_create();
+        if (!ptm) {
+            return -ENOMEM;
+        }
     }
 
     /* 
@@ -139,6 +157,8 @@ int pty_master_alloc(file_descriptor_t* fd)
        type of dentries free_inode, which is called when dentry is
        freed.
     */
+    ptm->next_free = NULL;
+    ptm->dentry.inode_indx = PTSNO2INODE(ptm->id);
     ptm->dentry.d_count = 1;
     ptm->dentry.flags = 0;
     dentry_set_flag(&ptm->dentry, DENTRY_CUSTOM);
@@ -149,9 +169,5 @@ int pty_master_alloc(file_descriptor_t* fd)
     fd->flags = 0;
     fd->offset = 0;
     fd->type = FD_TYPE_FILE;
-
-    pty_slave_create(INODE2PTSNO(ptm->dentry.inode_indx), ptm);
-    ptm->buffer = sync_ringbuffer_create_std();
-
     return 0;
-}
\ No newline at end of file
+}
@@ -9,37 +9,29 @@
 #include <io/tty/pty_slave.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <tasking/tasking.h>
 
-pty_slave_entry_t pty_slaves[PTYS_COUNT];
-
-static pty_slave_entry_t* _pts_get(dentry_t* dentry)
+static inline pty_slave_entry_t* _pts_get(dentry_t* dentry)
 {
-    for (int i = 0; i < PTYS_COUNT; i++) {
-        if (dentry->inode_indx == pty_slaves[i].inode_indx) {
-            return &pty_slaves[i];
-        }
-    }
-    return NULL;
+    return (pty_slave_entry_t*)devfs_private_data(dentry);
 }
 
 bool pty_slave_can_read(dentry_t* dentry, uint32_t start)
 {
     pty_slave_entry_t* pts = _pts_get(dentry);
-    ASSERT(pts);
     return sync_ringbuffer_space_to_read(&pts->buffer) >= 1;
 }
 
 bool pty_slave_can_write(dentry_t* dentry, uint32_t start)
 {
     pty_slave_entry_t* pts = _pts_get(dentry);
-    ASSERT(pts);
     return sync_ringbuffer_space_to_write(&pts->ptm->buffer) >= 0;
 }
 
 int pty_slave_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
     pty_slave_entry_t* pts = _pts_get(dentry);
-    ASSERT(pts);
     uint32_t leno = sync_ringbuffer_space_to_read(&pts->buffer);
     if (leno > len) {
         leno = len;
@@ -51,8 +43,8 @@ int pty_slave_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 int pty_slave_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
     pty_slave_entry_t* pts = _pts_get(dentry);
-    ASSERT(pts);
     sync_ringbuffer_write(&pts->ptm->buffer, buf, len);
+    blocker_wake_io();
     return len;
 }
 
@@ -61,35 +53,42 @@ int pty_slave_ioctl(dentry_t* dentry, uint32_t cmd, uint32_t arg)
     return 0;
 }
 
-int pty_slave_create(int id, pty_master_entry_t* ptm)
+/**
+ * Called once per pair, the slave stays registered in devfs after its
+ * master is closed and is used again with it.
+ */
+pty_slave_entry_t* pty_slave_create(int id, pty_master_entry_t* ptm)
 {
-    ASSERT(0 <= id && id < 10 && id <= PTYS_COUNT);
-
     dentry_t* mp;
     if (vfs_resolve_path("/dev", &mp) < 0) {
-        return 0;
+        return NULL;
     }
 
-    // FIXME: Check if the we already have pty file created
-    if (!pty_slaves[id].inode_indx) {
-        char name[8];
-        snprintf(name, 8, "pts%d", id);
-        file_ops_t fops = { 0 };
-        fops.can_read = pty_slave_can_read;
-        fops.can_write = pty_slave_can_write;
-        fops.read = pty_slave_read;
-        fops.write = pty_slave_write;
-        fops.ioctl = pty_slave_ioctl;
-        devfs_inode_t* res = devfs_register(mp, MKDEV(136, id), name, 4, 0, &fops);
-        pty_slaves[id].inode_indx = res->index;
-        pty_slaves[id].ptm = ptm;
-        pty_slaves[id].buffer = sync_ringbuffer_create_std();
-        ASSERT(pty_slaves[id].buffer.ringbuffer.zone.start);
-        ptm->pts = &pty_slaves[id];
-    } else {
-        pty_slaves[id].buffer.ringbuffer.start = pty_slaves[id].buffer.ringbuffer.end = 0;
+    pty_slave_entry_t* pts = kmalloc(sizeof(pty_slave_entry_t));
+    if (!pts) {
+        dentry_put(mp);
+        return NULL;
     }
+    pts->ptm = ptm;
+    pts->buffer = sync_ringbuffer_create_std();
+    ASSERT(pts->buffer.ringbuffer.zone.start);
 
+    char name[16];
+    int len = snprintf(name, sizeof(name), "pts%d", id);
+    file_ops_t fops = { 0 };
+    fops.can_read = pty_slave_can_read;
+    fops.can_write = pty_slave_can_write;
+    fops.read = pty_slave_read;
+    fops.write = pty_slave_write;
+    fops.ioctl = pty_slave_ioctl;
+    devfs_inode_t* res = devfs_register_private(mp, MKDEV(136, id), name, len, 0, &fops, pts);
     dentry_put(mp);
-    return 0;
-}
\ No newline at end of file
+
+    if (!res) {
+        sync_ringbuffer_free(&pts->buffer);
+        kfree(pts);
+        return NULL;
+    }
+    pts->inode_indx = res->index;
+    return pts;
+}
@@ -13,6 +13,7 @@
 #include <libkern/log.h>
 #include <libkern/syscall_structs.h>
 #include <mem/kmalloc.h>
+#include <mem/vmm/uaccess.h>
 #include <tasking/signal.h>
 #include <tasking/tasking.h>
 
@@ -22,14 +23,9 @@ static int next_tty = 0;
 static tty_entry_t* active_tty = 0;
 tty_entry_t ttys[TTY_MAX_COUNT];
 
-static tty_entry_t* _tty_get(dentry_t* dentry)
+static inline tty_entry_t* _tty_get(dentry_t* dentry)
 {
-    for (int i = 0; i < TTY_MAX_COUNT; i++) {
-        if (dentry->inode_indx == ttys[i].inode_indx) {
-            return &ttys[i];
-        }
-    }
-    return 0;
+    return (tty_entry_t*)devfs_private_data(dentry);
 }
 
 static inline void _tty_flush_input(tty_entry_t* tty)
@@ -57,18 +53,26 @@ bool tty_can_write(dentry_t* dentry, uint32_t start)
     return true;
 }
 
+/**
+ * A canonical read returns at most one line, a line is counted as
+ * consumed once its newline is read.
+ */
 int tty_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
     tty_entry_t* tty = _tty_get(dentry);
-    uint32_t leno = sync_ringbuffer_space_to_read(&tty->buffer);
+    if (!(tty->termios.c_lflag & ICANON)) {
+        return sync_ringbuffer_read(&tty->buffer, buf, len);
+    }
+
+    uint32_t leno = sync_ringbuffer_space_to_read_until(&tty->buffer, '\n');
     if (leno > len) {
         leno = len;
     }
     int res = sync_ringbuffer_read(&tty->buffer, buf, leno);
-    if (tty->termios.c_lflag & ICANON && res == leno) {
+    if (res > 0 && buf[res - 1] == '\n') {
         tty->lines_avail--;
     }
-    return leno;
+    return res;
 }
 
 int _tty_process_esc_seq(uint8_t* buf)
@@ -128,13 +132,21 @@ int tty_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
     time_t ticks = timeman_get_ticks_from_last_second();
     log_not_formatted("[%d:%d:%d.%d] ", hrs, mins, secs, ticks);
 #endif
-    for (int i = 0; i < len; i++) {
-        if (buf[i] == '\x1b') {
-            i += _tty_process_esc_seq(&buf[i]);
-        } else {
-            log_not_formatted("%c", buf[i]);
-            // print_char(buf[i], WHITE_ON_BLACK, -1, -1);
+    // Text between escape sequences goes out as one span.
+    uint8_t* p = buf;
+    uint8_t* end = buf + len;
+    while (p < end) {
+        uint8_t* esc = memchr(p, '\x1b', end - p);
+        uint8_t* span_end = esc ? esc : end;
+        if (span_end != p) {
+            log_write((char*)p, span_end - p);
+            // print_string(p, span_end - p, WHITE_ON_BLACK);
         }
+        if (!esc) {
+            break;
+        }
+        int seq_len = _tty_process_esc_seq(esc);
+        p = esc + (seq_len ? seq_len : 1);
     }
 
     return len;
@@ -151,17 +163,24 @@ int tty_ioctl(dentry_t* dentry, uint32_t cmd, uint32_t arg)
         tty->pgid = arg;
         return 0;
     case TCGETS:
-        memcpy((void*)arg, (void*)&tty->termios, sizeof(termios_t));
+        if (copy_to_user((void*)arg, &tty->termios, sizeof(termios_t))) {
+            return -EFAULT;
+        }
         return 0;
     case TCSETS:
     case TCSETSW:
-    case TCSETSF:
-        memcpy((void*)&tty->termios, (void*)arg, sizeof(termios_t));
+    case TCSETSF: {
+        termios_t termios;
+        if (copy_from_user(&termios, (void*)arg, sizeof(termios_t))) {
+            return -EFAULT;
+        }
+        tty->termios = termios;
         if (cmd == TCSETSF) {
             _tty_flush_input(tty);
         }
         return 0;
     }
+    }
 
     return -EINVAL;
 }
@@ -178,15 +197,15 @@ tty_entry_t* tty_new()
         return 0;
     }
 
-    char* name = "tty ";
-    name[3] = next_tty + '0';
+    char name[8];
+    int len = snprintf(name, sizeof(name), "tty%d", next_tty);
     file_ops_t fops = { 0 };
     fops.can_read = tty_can_read;
     fops.can_write = tty_can_write;
     fops.read = tty_read;
     fops.write = tty_write;
     fops.ioctl = tty_ioctl;
-    devfs_inode_t* res = devfs_register(mp, MKDEV(4, next_tty), name, 4, 0, &fops);
+    devfs_inode_t* res = devfs_register_private(mp, MKDEV(4, next_tty), name, len, 0, &fops, &ttys[next_tty]);
     ttys[next_tty].id = next_tty;
     ttys[next_tty].inode_indx = res->index;
     ttys[next_tty].buffer = sync_ringbuffer_create_std();
@@ -203,36 +222,112 @@ tty_entry_t* tty_new()
     return &ttys[next_tty - 1];
 }
 
-static void _tty_echo_key(tty_entry_t* tty, key_t key)
+static void _tty_echo(tty_entry_t* tty, const uint8_t* buf, uint32_t len)
 {
     if (tty->termios.c_lflag & ECHO) {
-        // print_char(key, WHITE_ON_BLACK, -1, -1);
+        // print_string(buf, len, WHITE_ON_BLACK);
     }
 }
 
-void tty_eat_key(key_t key)
+static void _tty_interrupt(tty_entry_t* tty)
 {
-    tty_entry_t* tty = _tty_active();
-    if (key == KEY_CTRLC) {
-        proc_t* p = tasking_get_proc(tty->pgid);
-        if (p) {
-            signal_set_pending(p->main_thread, SIGINT);
-            signal_dispatch_pending(p->main_thread);
-        }
-        return;
+    proc_t* p = tasking_get_proc(tty->pgid);
+    if (p) {
+        signal_set_pending(p->main_thread, SIGINT);
+        signal_dispatch_pending(p->main_thread);
     }
+}
 
-    if (key == KEY_RETURN) {
-        _tty_echo_key(tty, '\n');
-        sync_ringbuffer_write_one(&tty->buffer, '\n');
-        tty->lines_avail++;
-    } else if (key == KEY_BACKSPACE) {
-        if (sync_ringbuffer_space_to_read(&tty->buffer) > 0) {
+/* Drops the last char of the line being typed, committed lines stay. */
+static void _tty_erase(tty_entry_t* tty)
+{
+    ringbuffer_t* rb = &tty->buffer.ringbuffer;
+    lock_acquire(&tty->buffer.lock);
+    if (rb->start != rb->end) {
+        uint32_t last = rb->end ? rb->end - 1 : rb->zone.len - 1;
+        if (rb->zone.ptr[last] != '\n') {
+            rb->end = last;
             // delete_char(WHITE_ON_BLACK, -1, -1, 1);
-            tty->buffer.ringbuffer.end--;
+        }
+    }
+    lock_release(&tty->buffer.lock);
+}
+
+static uint8_t _tty_canon_special[256] = {
+    [KEY_CTRLC] = 1,
+    [KEY_RETURN] = 1,
+    [KEY_BACKSPACE] = 1,
+    ['\n'] = 1,
+};
+
+/**
+ * The line discipline. Runs of plain chars between specials are copied
+ * with one ringbuffer write and readers are woken once per call. In raw
+ * mode only ^C is special, so a burst of input is usually a single copy.
+ */
+void tty_receive(tty_entry_t* tty, const uint8_t* buf, uint32_t len)
+{
+    const uint8_t* p = buf;
+    const uint8_t* end = buf + len;
+    bool wake = false;
+
+    if (!(tty->termios.c_lflag & ICANON)) {
+        while (p < end) {
+            const uint8_t* intr = memchr(p, KEY_CTRLC, end - p);
+            const uint8_t* span_end = intr ? intr : end;
+            if (span_end != p) {
+                sync_ringbuffer_write(&tty->buffer, p, span_end - p);
+                _tty_echo(tty, p, span_end - p);
+                wake = true;
+            }
+            if (!intr) {
+                break;
+            }
+            _tty_interrupt(tty);
+            p = intr + 1;
         }
     } else {
-        sync_ringbuffer_write_one(&tty->buffer, (char)key);
-        _tty_echo_key(tty, key);
+        while (p < end) {
+            const uint8_t* span_end = p;
+            while (span_end < end && !_tty_canon_special[*span_end]) {
+                span_end++;
+            }
+            if (span_end != p) {
+                sync_ringbuffer_write(&tty->buffer, p, span_end - p);
+                _tty_echo(tty, p, span_end - p);
+                wake = true;
+            }
+            if (span_end == end) {
+                break;
+            }
+
+            switch (*span_end) {
+            case KEY_CTRLC:
+                _tty_interrupt(tty);
+                break;
+            case KEY_BACKSPACE:
+                _tty_erase(tty);
+                break;
+            default: {
+                uint8_t nl = '\n';
+                _tty_echo(tty, &nl, 1);
+                if (sync_ringbuffer_write_one(&tty->buffer, nl)) {
+                    tty->lines_avail++;
+                }
+                wake = true;
+            } break;
+            }
+            p = span_end + 1;
+        }
+    }
+
+    if (wake) {
+        blocker_wake_io();
     }
-}
\ No newline at end of file
+}
+
+void tty_eat_key(key_t key)
+{
+    uint8_t c = (uint8_t)key;
+    tty_receive(_tty_active(), &c, 1);
+}
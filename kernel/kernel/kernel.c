@@ -15,20 +15,28 @@
 #include <mem/kmalloc.h>
 #include <mem/pmm.h>
 
+#include <fs/bcache.h>
 #include <fs/devfs/devfs.h>
 #include <fs/ext2/ext2.h>
+#include <fs/initramfs.h>
 #include <fs/procfs/procfs.h>
+#include <fs/tmpfs/tmpfs.h>
 #include <fs/vfs.h>
 
 #include <io/shared_buffer/shared_buffer.h>
 #include <io/tty/ptmx.h>
 #include <io/tty/tty.h>
 
+#include <time/profiler.h>
 #include <time/time_manager.h>
 
 #include <tasking/sched.h>
+#include <tasking/workqueue.h>
 
+#include <libkern/boottrace.h>
+#include <libkern/kernel_self_test.h>
 #include <libkern/log.h>
+#include <libkern/trace.h>
 
 #include <syscalls/handlers.h>
 
@@ -50,7 +58,14 @@ static inline void wait_for_boot_cpu_to_finish(int* wt)
 
 void launching()
 {
-    tasking_run_kernel_thread(dentry_flusher, NULL);
+    workqueue_init();
+    logger_start_flusher();
+    dentry_start_flusher();
+    bcache_start_flusher();
+    boottrace_point("kthreads", NULL);
+#ifdef KERNEL_BENCHMARK
+    kernel_bench();
+#endif
     tasking_start_init_proc();
     ksys1(SYS_EXIT, 0);
 }
@@ -59,39 +74,59 @@ void stage3(mem_desc_t* mem_desc)
 {
     boot_cpu_finish(&__boot_cpu_launched);
     system_disable_interrupts();
+    boottrace_point("stage3", NULL);
     logger_setup();
     platform_init_boot_cpu();
+    boottrace_point("boot_cpu", NULL);
 
     // mem setup
     pmm_setup(mem_desc);
+    initramfs_setup(mem_desc);
     vmm_setup();
+    boottrace_point("mem", NULL);
     platform_setup_boot_cpu();
+    boottrace_point("boot_cpu_setup", NULL);
     boot_cpu_finish(&__boot_cpu_setup_devices);
 
     // installing drivers
     driver_manager_init();
     platform_drivers_setup();
+    boottrace_point("drivers_setup", NULL);
     timeman_setup();
+    boottrace_point("timeman", NULL);
     vfs_install();
     ext2_install();
     procfs_install();
     devfs_install();
+    tmpfs_install();
+    boottrace_point("fs_install", NULL);
     drivers_run();
+    boottrace_point("drivers_run", NULL);
     boot_cpu_finish(&__boot_cpu_setup_drivers);
 
     // mounting filesystems
+    initramfs_mount();
     procfs_mount();
     devfs_mount();
+    tmpfs_mount("/tmp");
+    boottrace_point("mount", NULL);
 
     // ipc
     shared_buffer_init();
 
     // pty
     ptmx_install();
+    boottrace_point("ipc_pty", NULL);
+
+    // profiling and tracing
+    profiler_install();
+    trace_install();
+    boottrace_point("profiling", NULL);
 
     // init scheduling
     tasking_init();
     scheduler_init();
+    boottrace_point("sched", NULL);
     schedule_activate_cpu();
     tasking_run_kernel_thread(launching, NULL);
     boot_cpu_finish(&__boot_cpu_setup_tasking);
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/atomic.h>
+#include <libkern/boottrace.h>
+#include <libkern/libkern.h>
+#include <platform/generic/system.h>
+#include <tasking/cpu.h>
+#include <tasking/proc.h>
+#include <tasking/thread.h>
+#include <time/time_manager.h>
+
+static boottrace_point_t _boottrace_points[BOOTTRACE_MAX_POINTS];
+static int _boottrace_taken = 0;
+
+static void _boottrace_copy_name(char* dst, int* at, const char* src)
+{
+    while (*src && *at < BOOTTRACE_NAME_LEN - 1) {
+        dst[(*at)++] = *src++;
+    }
+}
+
+/**
+ * A slot is claimed with one atomic add, so points can be taken on any cpu
+ * and from the exec path without a lock. Readers skip slots which are not
+ * filled up yet.
+ */
+void boottrace_point(const char* what, const char* arg)
+{
+    if (atomic_load(&_boottrace_taken) >= BOOTTRACE_MAX_POINTS) {
+        return;
+    }
+
+    int id = atomic_add(&_boottrace_taken, 1) - 1;
+    if (id >= BOOTTRACE_MAX_POINTS) {
+        return;
+    }
+
+    boottrace_point_t* point = &_boottrace_points[id];
+    point->cycles = system_read_cycles();
+    point->ticks = timeman_global_ticks();
+    point->cpu = system_cpu_id();
+    point->pid = (RUNNING_THREAD && RUNNING_THREAD->process) ? RUNNING_THREAD->process->pid : 0;
+
+    int at = 0;
+    _boottrace_copy_name(point->name, &at, what);
+    if (arg) {
+        _boottrace_copy_name(point->name, &at, " ");
+        _boottrace_copy_name(point->name, &at, arg);
+    }
+    point->name[at] = '\0';
+    __atomic_store_n(&point->ready, true, __ATOMIC_RELEASE);
+}
+
+int boottrace_count()
+{
+    int taken = atomic_load(&_boottrace_taken);
+    return taken < BOOTTRACE_MAX_POINTS ? taken : BOOTTRACE_MAX_POINTS;
+}
+
+boottrace_point_t* boottrace_get(int id)
+{
+    boottrace_point_t* point = &_boottrace_points[id];
+    if (!__atomic_load_n(&point->ready, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return point;
+}
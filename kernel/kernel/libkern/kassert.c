@@ -5,16 +5,19 @@
  */
 
 #include <libkern/kassert.h>
+#include <libkern/log.h>
 #include <tasking/dump.h>
 
 void kpanic(const char* err_msg)
 {
+    logger_flush_sync();
     dump_kernel(err_msg);
     system_stop();
 }
 
 void kpanic_tf(const char* err_msg, trapframe_t* tf)
 {
+    logger_flush_sync();
     dump_kernel_from_tf(err_msg, tf);
     system_stop();
 }
\ No newline at end of file
@@ -1,9 +1,16 @@
-#ifdef __i386__
-
-#include <drivers/x86/display.h>
+#include <algo/ringbuffer.h>
+#include <fs/vfs.h>
+#include <libkern/atomic.h>
 #include <libkern/kernel_self_test.h>
+#include <libkern/log.h>
 #include <mem/kmalloc.h>
+#include <mem/pmm.h>
 #include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/generic/system.h>
+#include <syscalls/handlers.h>
+#include <tasking/tasking.h>
+#include <time/time_manager.h>
 
 bool _test_kmalloc();
 bool _test_page_fault();
@@ -53,4 +60,231 @@ bool kernel_self_test(bool throw_kernel_panic)
     return true;
 }
 
-#endif
\ No newline at end of file
+/**
+ * KERNEL BENCHES
+ */
+
+#define KBENCH(name) for (_kbench_begin(name); _kbench_next();)
+#define KBENCH_NAME_LEN (32)
+#define KBENCH_LINE_LEN (384)
+#define KBENCH_LOOKUP_PATH "/dev"
+#define KBENCH_RINGBUFFER_CHUNK (1 * KB)
+
+static const char* _kbench_name;
+static int _kbench_run;
+static uint32_t _kbench_cycles_per_us;
+static uint32_t _kbench_started_at;
+static uint32_t _kbench_elapsed;
+static uint32_t _kbench_samples[KBENCH_RUNS];
+static void* _kbench_ptrs[KBENCH_BATCH];
+
+static int _kbench_turn;
+static int _kbench_partner_done;
+
+static inline void _kbench_resume()
+{
+    _kbench_started_at = system_read_cycles();
+}
+
+/* Work between pause and resume, like cleaning up a batch, is not timed. */
+static inline void _kbench_pause()
+{
+    _kbench_elapsed += system_read_cycles() - _kbench_started_at;
+}
+
+static void _kbench_report()
+{
+    static char line[KBENCH_LINE_LEN];
+    uint32_t* samples = _kbench_samples;
+    for (int i = 1; i < KBENCH_RUNS; i++) {
+        uint32_t val = samples[i];
+        int j = i - 1;
+        for (; j >= 0 && samples[j] > val; j--) {
+            samples[j + 1] = samples[j];
+        }
+        samples[j + 1] = val;
+    }
+
+    int p99 = (KBENCH_RUNS * 99 + 99) / 100 - 1;
+    int at = snprintf(line, KBENCH_LINE_LEN, "[BENCH][%s] {\"unit\": \"ns\", \"samples\": [", _kbench_name);
+    for (int i = 0; i < KBENCH_RUNS; i++) {
+        at += snprintf(line + at, KBENCH_LINE_LEN - at, i ? ", %u" : "%u", samples[i]);
+    }
+    snprintf(line + at, KBENCH_LINE_LEN - at, "], \"min\": %u, \"median\": %u, \"p99\": %u}\n", samples[0], samples[KBENCH_RUNS / 2], samples[p99]);
+    log_not_formatted("%s", line);
+}
+
+static void _kbench_begin(const char* name)
+{
+    _kbench_name = name;
+    _kbench_run = -1;
+}
+
+/**
+ * The counter is 32 bit wide, so a batch is timed in cycles and only the
+ * cost of one operation is scaled to ns.
+ */
+static bool _kbench_next()
+{
+    if (_kbench_run >= 0) {
+        _kbench_pause();
+        if (_kbench_run >= KBENCH_WARMUP_RUNS) {
+            _kbench_samples[_kbench_run - KBENCH_WARMUP_RUNS] = _kbench_elapsed / KBENCH_BATCH * 1000 / _kbench_cycles_per_us;
+        }
+    }
+
+    _kbench_run++;
+    if (_kbench_run == KBENCH_WARMUP_RUNS + KBENCH_RUNS) {
+        _kbench_report();
+        return false;
+    }
+
+    _kbench_elapsed = 0;
+    _kbench_resume();
+    return true;
+}
+
+static void _kbench_kmalloc()
+{
+    static const uint32_t sizes[] = { 16, 64, 256, 1 * KB, 4 * KB, 16 * KB };
+    char name[KBENCH_NAME_LEN];
+
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        snprintf(name, KBENCH_NAME_LEN, "KERNEL KMALLOC %u", sizes[s]);
+        KBENCH(name)
+        {
+            for (int i = 0; i < KBENCH_BATCH; i++) {
+                _kbench_ptrs[i] = kmalloc(sizes[s]);
+            }
+            for (int i = 0; i < KBENCH_BATCH; i++) {
+                kfree(_kbench_ptrs[i]);
+            }
+        }
+    }
+}
+
+/* A batch is bigger than the per-cpu frame cache, so it refills and drains it. */
+static void _kbench_pmm()
+{
+    KBENCH("KERNEL PMM FRAME")
+    {
+        for (int i = 0; i < KBENCH_BATCH; i++) {
+            _kbench_ptrs[i] = pmm_alloc_frame();
+        }
+        for (int i = 0; i < KBENCH_BATCH; i++) {
+            pmm_free_frame(_kbench_ptrs[i]);
+        }
+    }
+}
+
+/* Kernel zones are backed on the first touch, released pages fault again. */
+static void _kbench_page_fault()
+{
+    zone_t zone = zoner_new_zone(KBENCH_BATCH * VMM_PAGE_SIZE);
+    if (!zone.start) {
+        log_warn("[KBENCH] No space for PAGE FAULT");
+        return;
+    }
+
+    KBENCH("KERNEL PAGE FAULT")
+    {
+        for (int i = 0; i < KBENCH_BATCH; i++) {
+            ((volatile uint8_t*)zone.ptr)[i * VMM_PAGE_SIZE] = 1;
+        }
+        _kbench_pause();
+        vmm_release_pages(zone.start, zone.len);
+        _kbench_resume();
+    }
+    zoner_free_zone(zone);
+}
+
+static void _kbench_dentry_lookup()
+{
+    dentry_t* dentry;
+    if (vfs_resolve_path(KBENCH_LOOKUP_PATH, &dentry) < 0) {
+        log_warn("[KBENCH] No %s for DENTRY LOOKUP", KBENCH_LOOKUP_PATH);
+        return;
+    }
+    dentry_put(dentry);
+
+    KBENCH("KERNEL DENTRY LOOKUP")
+    {
+        for (int i = 0; i < KBENCH_BATCH; i++) {
+            vfs_resolve_path(KBENCH_LOOKUP_PATH, &dentry);
+            dentry_put(dentry);
+        }
+    }
+}
+
+static void _kbench_ringbuffer()
+{
+    static uint8_t chunk[KBENCH_RINGBUFFER_CHUNK];
+    ringbuffer_t buf = ringbuffer_create_std();
+    if (!buf.zone.start) {
+        log_warn("[KBENCH] No space for RINGBUFFER");
+        return;
+    }
+
+    KBENCH("KERNEL RINGBUFFER 1K")
+    {
+        for (int i = 0; i < KBENCH_BATCH; i++) {
+            ringbuffer_write(&buf, chunk, KBENCH_RINGBUFFER_CHUNK);
+            ringbuffer_read(&buf, chunk, KBENCH_RINGBUFFER_CHUNK);
+        }
+    }
+    ringbuffer_free(&buf);
+}
+
+static void _kbench_switch_partner()
+{
+    while (!atomic_load(&_kbench_partner_done)) {
+        if (atomic_load(&_kbench_turn) == 1) {
+            atomic_store(&_kbench_turn, 0);
+        } else {
+            ksys0(SYS_SCHEDYIELD);
+        }
+    }
+    ksys1(SYS_EXIT, 0);
+}
+
+/**
+ * The turn goes to a partner thread and back, which is two switches when
+ * both threads run on one cpu. On other cpus it's the cost of a handoff.
+ */
+static void _kbench_context_switch()
+{
+    atomic_store(&_kbench_turn, 0);
+    atomic_store(&_kbench_partner_done, 0);
+    tasking_run_kernel_thread(_kbench_switch_partner, NULL);
+
+    KBENCH("KERNEL CONTEXT SWITCH")
+    {
+        for (int i = 0; i < KBENCH_BATCH / 2; i++) {
+            atomic_store(&_kbench_turn, 1);
+            while (atomic_load(&_kbench_turn) == 1) {
+                ksys0(SYS_SCHEDYIELD);
+            }
+        }
+    }
+    atomic_store(&_kbench_partner_done, 1);
+}
+
+void kernel_bench()
+{
+    // The rate of the cycle counter is known after the first second.
+    for (int i = 0; i < 3 && !timeman_cycles_per_second(); i++) {
+        ksys1(SYS_SLEEP, 1);
+    }
+    _kbench_cycles_per_us = timeman_cycles_per_second() / 1000000;
+    if (!_kbench_cycles_per_us) {
+        log_warn("[KBENCH] Cycle counter rate is unknown, skipping");
+        return;
+    }
+
+    _kbench_kmalloc();
+    _kbench_pmm();
+    _kbench_page_fault();
+    _kbench_dentry_lookup();
+    _kbench_ringbuffer();
+    _kbench_context_switch();
+}
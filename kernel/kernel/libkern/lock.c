@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+
+static lock_stat_t _lock_stats[LOCK_STAT_MAX];
+static int _lock_stats_count = 0;
+
+/**
+ * Starts to count contention of the lock, the counters are shown in
+ * /proc/locks. Should be called once the lock is initialized.
+ */
+void lock_stat_register(lock_t* lock, const char* name)
+{
+    int id = __atomic_fetch_add(&_lock_stats_count, 1, __ATOMIC_RELAXED);
+    if (id >= LOCK_STAT_MAX) {
+        log_warn("Lock stat: no space for %s", name);
+        return;
+    }
+
+    memset(&_lock_stats[id], 0, sizeof(lock_stat_t));
+    _lock_stats[id].name = name;
+    lock->stat = &_lock_stats[id];
+}
+
+int lock_stat_count()
+{
+    return min(__atomic_load_n(&_lock_stats_count, __ATOMIC_RELAXED), LOCK_STAT_MAX);
+}
+
+lock_stat_t* lock_stat_get(int id)
+{
+    if (id < 0 || id >= lock_stat_count()) {
+        return NULL;
+    }
+    return &_lock_stats[id];
+}
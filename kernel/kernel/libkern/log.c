@@ -5,10 +5,14 @@
  */
 
 #include <drivers/generic/uart.h>
+#include <libkern/atomic.h>
 #include <libkern/libkern.h>
 #include <libkern/lock.h>
 #include <libkern/log.h>
 #include <libkern/stdarg.h>
+#include <tasking/cpu.h>
+#include <tasking/thread.h>
+#include <tasking/workqueue.h>
 
 // Turn off lock debug output for log.
 #ifdef DEBUG_LOCK
@@ -16,230 +20,184 @@
 #undef lock_release
 #endif
 
-typedef int (*_putch_callback)(char ch, char* buf_base, size_t* written, void* callback_params);
+typedef int (*_write_callback)(const char* data, size_t len, char* buf_base, size_t* written, void* callback_params);
 
 static lock_t _log_lock;
 static const char* HEX_alphabet = "0123456789ABCDEF";
 static const char* hex_alphabet = "0123456789abcdef";
 
-static int _printf_hex32_impl(unsigned int value, const char* alph, char* base_buf, size_t* written, _putch_callback callback, void* callback_params)
-{
-    int nxt = 0;
-    char tmp_buf[16];
-
-    while (value > 0) {
-        tmp_buf[nxt++] = alph[(value % 16)];
-        value /= 16;
-    }
-
-    callback('0', base_buf, written, callback_params);
-    callback('x', base_buf, written, callback_params);
-    if (nxt == 0) {
-        callback('0', base_buf, written, callback_params);
-    }
-
-    while (nxt) {
-        callback(tmp_buf[--nxt], base_buf, written, callback_params);
-    }
-    return 0;
-}
-
-static int _printf_hex64_impl(unsigned long value, const char* alph, char* base_buf, size_t* written, _putch_callback callback, void* callback_params)
-{
-    int nxt = 0;
-    char tmp_buf[32];
-
-    while (value > 0) {
-        tmp_buf[nxt++] = alph[(value % 16)];
-        value /= 16;
-    }
-
-    callback('0', base_buf, written, callback_params);
-    callback('x', base_buf, written, callback_params);
-    if (nxt == 0) {
-        callback('0', base_buf, written, callback_params);
-    }
-
-    while (nxt) {
-        callback(tmp_buf[--nxt], base_buf, written, callback_params);
-    }
-    return 0;
-}
-
-static int _printf_hex32(unsigned int value, char* base_buf, size_t* written, _putch_callback callback, void* callback_params)
-{
-    return _printf_hex32_impl(value, hex_alphabet, base_buf, written, callback, callback_params);
-}
-
-static int _printf_HEX32(unsigned int value, char* base_buf, size_t* written, _putch_callback callback, void* callback_params)
-{
-    return _printf_hex32_impl(value, HEX_alphabet, base_buf, written, callback, callback_params);
-}
-
-static int _printf_hex64(unsigned long value, char* base_buf, size_t* written, _putch_callback callback, void* callback_params)
-{
-    return _printf_hex64_impl(value, hex_alphabet, base_buf, written, callback, callback_params);
-}
-
-static int _printf_HEX64(unsigned long value, char* base_buf, size_t* written, _putch_callback callback, void* callback_params)
-{
-    return _printf_hex64_impl(value, HEX_alphabet, base_buf, written, callback, callback_params);
-}
-
-static int _printf_u32(unsigned int value, char* base_buf, size_t* written, _putch_callback callback, void* callback_params)
+/* Decimal digits are produced two at a time, halving the divisions. */
+static const char _printf_digit_pairs[] = "00010203040506070809"
+                                          "10111213141516171819"
+                                          "20212223242526272829"
+                                          "30313233343536373839"
+                                          "40414243444546474849"
+                                          "50515253545556575859"
+                                          "60616263646566676869"
+                                          "70717273747576777879"
+                                          "80818283848586878889"
+                                          "90919293949596979899";
+
+/* Big enough for "-", 20 decimal digits of a 64 bit value or "0x" and 16 hex digits. */
+#define PRINTF_NUM_BUF 24
+
+/**
+ * The converters write the number backward ending at end and return its
+ * first char, so the caller passes the whole span to the callback at once.
+ */
+static char* _printf_format_u32(uint32_t value, char* end)
 {
-    int nxt = 0;
-    char tmp_buf[16];
-
-    while (value > 0) {
-        tmp_buf[nxt++] = (value % 10) + '0';
-        value /= 10;
-    }
-
-    if (nxt == 0) {
-        callback('0', base_buf, written, callback_params);
+    while (value >= 100) {
+        const char* pair = &_printf_digit_pairs[(value % 100) * 2];
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
     }
 
-    while (nxt) {
-        callback(tmp_buf[--nxt], base_buf, written, callback_params);
+    if (value >= 10) {
+        const char* pair = &_printf_digit_pairs[value * 2];
+        *--end = pair[1];
+        *--end = pair[0];
+    } else {
+        *--end = '0' + value;
     }
-    return 0;
+    return end;
 }
 
-static int _printf_u64(unsigned long value, char* base_buf, size_t* written, _putch_callback callback, void* callback_params)
-{
-    int nxt = 0;
-    char tmp_buf[32];
-
-    while (value > 0) {
-        tmp_buf[nxt++] = (value % 10) + '0';
-        value /= 10;
-    }
-
-    if (nxt == 0) {
-        callback('0', base_buf, written, callback_params);
-    }
-
-    while (nxt) {
-        callback(tmp_buf[--nxt], base_buf, written, callback_params);
-    }
-    return 0;
-}
-
-static int _printf_i32(int value, char* buf, size_t* written, _putch_callback callback, void* callback_params)
+/**
+ * Divides by 100 with 32 bit divisions only, a 64 bit one is a libgcc call
+ * and the x86 kernel does not link libgcc. Returns the remainder.
+ */
+static uint32_t _printf_div100(uint64_t* value)
 {
-    if (value < 0) {
-        callback('-', buf, written, callback_params);
-        value = -value;
-    }
-    return _printf_u32(value, buf, written, callback, callback_params);
+    uint32_t hi = *value >> 32;
+    uint32_t lo = (uint32_t)*value;
+    uint32_t part = ((hi % 100) << 16) | (lo >> 16);
+    uint32_t q_mid = part / 100;
+    part = ((part % 100) << 16) | (lo & 0xffff);
+    *value = ((uint64_t)(hi / 100) << 32) | (q_mid << 16) | (part / 100);
+    return part % 100;
 }
 
-static int _printf_i64(long value, char* buf, size_t* written, _putch_callback callback, void* callback_params)
+static char* _printf_format_u64(uint64_t value, char* end)
 {
-    if (value < 0) {
-        callback('-', buf, written, callback_params);
-        value = -value;
+    while (value > 0xffffffff) {
+        const char* pair = &_printf_digit_pairs[_printf_div100(&value) * 2];
+        *--end = pair[1];
+        *--end = pair[0];
     }
-    return _printf_u64(value, buf, written, callback, callback_params);
+    return _printf_format_u32((uint32_t)value, end);
 }
 
-static int _printf_string(const char* value, char* buf, size_t* written, _putch_callback callback, void* callback_params)
+static char* _printf_format_hex(uint64_t value, const char* alph, char* end)
 {
-    size_t len = strlen(value);
-    for (size_t i = 0; i < len; i++) {
-        callback(value[i], buf, written, callback_params);
-    }
-    return 0;
+    do {
+        *--end = alph[value & 0xf];
+        value >>= 4;
+    } while (value);
+
+    *--end = 'x';
+    *--end = '0';
+    return end;
 }
 
-static ssize_t _printf_internal(char* buf, const char* format, _putch_callback callback, void* callback_params, va_list arg)
+static ssize_t _printf_internal(char* buf, const char* format, _write_callback callback, void* callback_params, va_list arg)
 {
     const char* p = format;
     size_t written = 0;
+    char num_buf[PRINTF_NUM_BUF];
+    char* num_end = &num_buf[PRINTF_NUM_BUF];
+
     while (*p) {
+        // Text up to the next conversion goes as one span.
+        const char* span = p;
+        while (*p && !(*p == '%' && *(p + 1))) {
+            p++;
+        }
+        if (p != span) {
+            callback(span, p - span, buf, &written, callback_params);
+            continue;
+        }
+
         int l_arg = 0;
         int h_arg = 0;
-        if (*p == '%' && *(p + 1)) {
-            // Reading arguments
-        parse_args:
-            p++;
-            switch (*p) {
-            case 'l':
-                l_arg++;
-                if (*(p + 1)) {
-                    goto parse_args;
-                }
-                break;
-            case 'h':
-                h_arg++;
-                if (*(p + 1)) {
-                    goto parse_args;
-                }
-                break;
-            default:
-                break;
+        char* num = NULL;
+
+        // Reading arguments
+    parse_args:
+        p++;
+        switch (*p) {
+        case 'l':
+            l_arg++;
+            if (*(p + 1)) {
+                goto parse_args;
             }
+            break;
+        case 'h':
+            h_arg++;
+            if (*(p + 1)) {
+                goto parse_args;
+            }
+            break;
+        default:
+            break;
+        }
 
-            // Reading conversion specifiers
-            switch (*p) {
-            case 'i':
-            case 'd':
-                if (l_arg) {
-                    long value = va_arg(arg, long);
-                    _printf_i64(value, buf, &written, callback, callback_params);
-                } else {
-                    int value = va_arg(arg, int);
-                    _printf_i32(value, buf, &written, callback, callback_params);
-                }
-                break;
-            case 'u':
-                if (l_arg) {
-                    uint64_t value = va_arg(arg, uint64_t);
-                    _printf_u64(value, buf, &written, callback, callback_params);
-                } else {
-                    uint32_t value = va_arg(arg, uint32_t);
-                    _printf_u32(value, buf, &written, callback, callback_params);
-                }
-                break;
-            case 'x':
-                if (l_arg) {
-                    uint64_t value = va_arg(arg, uint64_t);
-                    _printf_hex64(value, buf, &written, callback, callback_params);
-                } else {
-                    uint32_t value = va_arg(arg, uint32_t);
-                    _printf_hex32(value, buf, &written, callback, callback_params);
+        // Reading conversion specifiers
+        switch (*p) {
+        case 'i':
+        case 'd':
+            if (l_arg) {
+                long value = va_arg(arg, long);
+                num = _printf_format_u64(value < 0 ? -(unsigned long)value : value, num_end);
+                if (value < 0) {
+                    *--num = '-';
                 }
-                break;
-            case 'X':
-                if (l_arg) {
-                    uint64_t value = va_arg(arg, uint64_t);
-                    _printf_HEX64(value, buf, &written, callback, callback_params);
-                } else {
-                    uint32_t value = va_arg(arg, uint32_t);
-                    _printf_HEX32(value, buf, &written, callback, callback_params);
+            } else {
+                int value = va_arg(arg, int);
+                num = _printf_format_u32(value < 0 ? -(unsigned int)value : value, num_end);
+                if (value < 0) {
+                    *--num = '-';
                 }
-                break;
-            case 'c': {
-                char value = (char)va_arg(arg, int);
-                callback(value, buf, &written, callback_params);
-            } break;
-            case 's': {
-                const char* value = va_arg(arg, const char*);
-                _printf_string(value, buf, &written, callback, callback_params);
-            } break;
-            default:
-                break;
             }
-        } else {
-            callback(*p, buf, &written, callback_params);
+            break;
+        case 'u':
+            if (l_arg) {
+                num = _printf_format_u64(va_arg(arg, uint64_t), num_end);
+            } else {
+                num = _printf_format_u32(va_arg(arg, uint32_t), num_end);
+            }
+            break;
+        case 'x':
+        case 'X': {
+            const char* alph = *p == 'x' ? hex_alphabet : HEX_alphabet;
+            if (l_arg) {
+                num = _printf_format_hex(va_arg(arg, uint64_t), alph, num_end);
+            } else {
+                num = _printf_format_hex(va_arg(arg, uint32_t), alph, num_end);
+            }
+        } break;
+        case 'c': {
+            char value = (char)va_arg(arg, int);
+            callback(&value, 1, buf, &written, callback_params);
+        } break;
+        case 's': {
+            const char* value = va_arg(arg, const char*);
+            callback(value, strlen(value), buf, &written, callback_params);
+        } break;
+        default:
+            break;
+        }
+
+        if (num) {
+            callback(num, num_end - num, buf, &written, callback_params);
         }
         p++;
     }
     return written;
 }
 
-static int putch_callback_sized_buf(char ch, char* buf_base, size_t* written, void* callback_params)
+static int write_callback_sized_buf(const char* data, size_t len, char* buf_base, size_t* written, void* callback_params)
 {
     if (!callback_params) {
         return -1;
@@ -251,11 +209,11 @@ static int putch_callback_sized_buf(char ch, char* buf_base, size_t* written, vo
 
     size_t n = *(size_t*)callback_params;
     size_t vw = *written;
-    if (vw >= n) {
-        return -1;
+    if (vw + len > n) {
+        len = n - vw;
     }
-    buf_base[vw++] = ch;
-    *written = vw;
+    memcpy(&buf_base[vw], data, len);
+    *written = vw + len;
     return 0;
 }
 
@@ -269,7 +227,7 @@ int vsnprintf(char* s, size_t n, const char* format, va_list arg)
         return 0;
     }
 
-    ssize_t wr = _printf_internal(s, format, putch_callback_sized_buf, &n, arg);
+    ssize_t wr = _printf_internal(s, format, write_callback_sized_buf, &n, arg);
     if (wr == n) {
         s[n - 1] = '\0';
     } else {
@@ -287,15 +245,15 @@ int snprintf(char* s, size_t n, const char* format, ...)
     return res;
 }
 
-static int putch_callback_buf(char ch, char* buf_base, size_t* written, void* callback_params)
+static int write_callback_buf(const char* data, size_t len, char* buf_base, size_t* written, void* callback_params)
 {
     if (!written) {
         return -1;
     }
 
     size_t vw = *written;
-    buf_base[vw++] = ch;
-    *written = vw;
+    memcpy(&buf_base[vw], data, len);
+    *written = vw + len;
     return 0;
 }
 
@@ -304,7 +262,7 @@ int vsprintf(char* s, const char* format, va_list arg)
     if (!s) {
         return 0;
     }
-    ssize_t wr = _printf_internal(s, format, putch_callback_buf, NULL, arg);
+    ssize_t wr = _printf_internal(s, format, write_callback_buf, NULL, arg);
     s[wr] = '\0';
     return (int)wr;
 }
@@ -318,14 +276,76 @@ int sprintf(char* s, const char* format, ...)
     return res;
 }
 
-static int putch_callback_stream(char c, char* buf_base, size_t* written, void* callback_params)
+/**
+ * KMSG RING
+ * Messages are formatted into the ring. Until logger_start_flusher() is
+ * called, and again after logger_flush_sync(), they go straight to the UART
+ * too. Otherwise the flusher thread moves them to the UART, so log() never
+ * waits for the UART.
+ */
+
+static char _log_ring[LOG_RING_SIZE];
+static uint32_t _log_head = 0; // total bytes written, under _log_lock
+static uint32_t _log_uart_tail = 0; // next byte for the UART, under _log_lock
+static bool _log_deferred = false;
+
+static int write_callback_stream(const char* data, size_t len, char* buf_base, size_t* written, void* callback_params)
 {
-    return uart_write(COM1, c);
+    *written += len;
+    if (!_log_deferred) {
+        for (size_t i = 0; i < len; i++) {
+            uart_write(COM1, data[i]);
+        }
+    }
+
+    /* Only the tail of a span longer than the ring is kept. */
+    if (len > LOG_RING_SIZE) {
+        _log_head += len - LOG_RING_SIZE;
+        data += len - LOG_RING_SIZE;
+        len = LOG_RING_SIZE;
+    }
+
+    uint32_t at = _log_head % LOG_RING_SIZE;
+    uint32_t first = len < LOG_RING_SIZE - at ? len : LOG_RING_SIZE - at;
+    memcpy(&_log_ring[at], data, first);
+    memcpy(_log_ring, data + first, len - first);
+    _log_head += len;
+
+    if (!_log_deferred) {
+        _log_uart_tail = _log_head;
+        return 0;
+    }
+
+    /* The UART is behind by the whole ring, its oldest bytes are lost. */
+    if (_log_head - _log_uart_tail > LOG_RING_SIZE) {
+        _log_uart_tail = _log_head - LOG_RING_SIZE;
+    }
+    return 0;
+}
+
+static uint32_t _log_oldest_lockless()
+{
+    return _log_head > LOG_RING_SIZE ? _log_head - LOG_RING_SIZE : 0;
+}
+
+/**
+ * Moves up to len pending bytes to buf, returns the count.
+ */
+static uint32_t _log_take_uart_pending(char* buf, uint32_t len)
+{
+    uint32_t taken = 0;
+    lock_acquire(&_log_lock);
+    while (_log_uart_tail != _log_head && taken < len) {
+        buf[taken++] = _log_ring[_log_uart_tail % LOG_RING_SIZE];
+        _log_uart_tail++;
+    }
+    lock_release(&_log_lock);
+    return taken;
 }
 
 static int vlog_unfmt(const char* format, va_list arg)
 {
-    return _printf_internal(NULL, format, putch_callback_stream, NULL, arg);
+    return _printf_internal(NULL, format, write_callback_stream, NULL, arg);
 }
 
 static int vlog_fmt(const char* init_msg, const char* format, va_list arg)
@@ -382,8 +402,75 @@ int log_not_formatted(const char* format, ...)
     return ret;
 }
 
+/* Writes a span as is, there is no format to scan. */
+int log_write(const char* data, size_t len)
+{
+    size_t written = 0;
+    lock_acquire(&_log_lock);
+    write_callback_stream(data, len, NULL, &written, NULL);
+    lock_release(&_log_lock);
+    return written;
+}
+
 void logger_setup()
 {
     lock_init(&_log_lock);
     uart_setup(COM1);
+}
+
+static delayed_work_t _log_flush_work;
+
+/**
+ * Runs on the workqueue. The UART ring drains in its irq, a full one is
+ * waited out by a sleep of a tick: the worker is shared, so it stays short.
+ */
+static void _log_flush(void* data)
+{
+    char buf[LOG_FLUSH_CHUNK];
+    uint32_t len;
+    while ((len = _log_take_uart_pending(buf, sizeof(buf))) > 0) {
+        uint32_t sent = 0;
+        while ((sent += uart_write_buffered((uint8_t*)buf + sent, len - sent)) < len) {
+            init_sleep_ticks_blocker(RUNNING_THREAD, 1);
+        }
+    }
+    work_queue_delayed(&_log_flush_work, timers_ticks_to_ms(LOG_FLUSH_INTERVAL));
+}
+
+void logger_start_flusher()
+{
+    delayed_work_init(&_log_flush_work, _log_flush, NULL, WORK_PRIO_HIGH);
+    atomic_store(&_log_deferred, true);
+    work_queue(&_log_flush_work.work);
+}
+
+/**
+ * Writes out whatever is pending and makes the following logs synchronous
+ * again, used when the kernel is going down. Doesn't wait for _log_lock,
+ * the cpu which holds it may be the one which panicked.
+ */
+void logger_flush_sync()
+{
+    atomic_store(&_log_deferred, false);
+    uart_flush_sync();
+    while (_log_uart_tail != _log_head) {
+        uart_write(COM1, _log_ring[_log_uart_tail % LOG_RING_SIZE]);
+        _log_uart_tail++;
+    }
+}
+
+/**
+ * Reads the ring as a file which starts at its oldest kept byte.
+ */
+int logger_read(uint8_t* buf, uint32_t start, uint32_t len)
+{
+    lock_acquire(&_log_lock);
+    uint32_t pos = _log_oldest_lockless() + start;
+    uint32_t read = 0;
+    while (pos < _log_head && read < len) {
+        buf[read++] = _log_ring[pos % LOG_RING_SIZE];
+        pos++;
+    }
+    lock_release(&_log_lock);
+    return read;
 }
\ No newline at end of file
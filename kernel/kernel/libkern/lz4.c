@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/libkern.h>
+#include <libkern/lz4.h>
+
+/* Copies of a constant size are inlined, the rest calls memcpy. */
+#define memcpy __builtin_memcpy
+
+/*
+ * A block is a list of sequences: a token with 4 bits of literal length and
+ * 4 bits of match length, the literals, a 2 byte offset and the rest of the
+ * match length. The last sequence has literals only. The format wants the
+ * last MATCH_LIMIT bytes to be literals and no match to start in the last
+ * START_LIMIT bytes.
+ */
+#define MIN_MATCH 4
+#define MATCH_LIMIT 5
+#define START_LIMIT 12
+#define RUN_MASK 15
+#define SKIP_SHIFT 6
+#define WILD_COPY 16
+
+static inline uint32_t _lz4_read32(const uint8_t* p)
+{
+    uint32_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+static inline uint32_t _lz4_hash(uint32_t seq)
+{
+    return (seq * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+/**
+ * COMPRESS
+ */
+
+static inline uint8_t* _lz4_write_len(uint8_t* op, size_t len)
+{
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t* _lz4_write_sequence(uint8_t* op, uint8_t* oend, const uint8_t* lit, size_t lit_len, size_t offset, size_t match_len)
+{
+    /* Token, literals, offset and the longest length tails. */
+    if (lit_len + lit_len / 255 + match_len / 255 + 5 > (size_t)(oend - op)) {
+        return NULL;
+    }
+
+    uint8_t* token = op++;
+    if (lit_len >= RUN_MASK) {
+        *token = RUN_MASK << 4;
+        op = _lz4_write_len(op, lit_len - RUN_MASK);
+    } else {
+        *token = lit_len << 4;
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    if (!match_len) {
+        return op;
+    }
+
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    match_len -= MIN_MATCH;
+    if (match_len >= RUN_MASK) {
+        *token |= RUN_MASK;
+        op = _lz4_write_len(op, match_len - RUN_MASK);
+    } else {
+        *token |= match_len;
+    }
+    return op;
+}
+
+/*
+ * The table keeps positions, the ones left from an older input are either
+ * ahead of ip or fail the compare, so it's never cleared. Misses make the
+ * step grow, which gets incompressible data through fast.
+ */
+int lz4_compress(lz4_ctx_t* ctx, const void* src, size_t src_len, void* dst, size_t dst_len)
+{
+    const uint8_t* base = (const uint8_t*)src;
+    const uint8_t* ip = base;
+    const uint8_t* anchor = base;
+    const uint8_t* iend = base + src_len;
+    uint8_t* op = (uint8_t*)dst;
+    uint8_t* oend = op + dst_len;
+
+    if (src_len > START_LIMIT) {
+        const uint8_t* start_limit = iend - START_LIMIT;
+        const uint8_t* match_limit = iend - MATCH_LIMIT;
+
+        while (ip <= start_limit) {
+            uint32_t seq = _lz4_read32(ip);
+            uint32_t h = _lz4_hash(seq);
+            uint32_t pos = ip - base;
+            uint32_t ref_pos = ctx->table[h];
+            ctx->table[h] = pos;
+
+            if (ref_pos >= pos || pos - ref_pos > LZ4_MAX_DISTANCE || _lz4_read32(base + ref_pos) != seq) {
+                ip += 1 + ((ip - anchor) >> SKIP_SHIFT);
+                continue;
+            }
+
+            const uint8_t* ref = base + ref_pos;
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            size_t match_len = MIN_MATCH;
+            while (ip + match_len < match_limit && ip[match_len] == ref[match_len]) {
+                match_len++;
+            }
+
+            op = _lz4_write_sequence(op, oend, anchor, ip - anchor, ip - ref, match_len);
+            if (!op) {
+                return LZ4_ERR_OUTPUT;
+            }
+            ip += match_len;
+            anchor = ip;
+
+            /* The bytes just before the next search are likely to repeat. */
+            if (ip <= start_limit) {
+                ctx->table[_lz4_hash(_lz4_read32(ip - 2))] = ip - 2 - base;
+            }
+        }
+    }
+
+    op = _lz4_write_sequence(op, oend, anchor, iend - anchor, 0, 0);
+    if (!op) {
+        return LZ4_ERR_OUTPUT;
+    }
+    return op - (uint8_t*)dst;
+}
+
+/**
+ * DECOMPRESS
+ */
+
+static inline int _lz4_read_len(const uint8_t** ip, const uint8_t* iend, size_t* len)
+{
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+/*
+ * Most literal runs and matches are short: with room left in both buffers
+ * they are moved as whole 16 byte pieces, the bytes written past the end
+ * are overwritten by what follows. Others which don't overlap their
+ * destination are moved with memcpy. An overlapping match repeats its first offset bytes, so it's
+ * copied from its start in steps which double each time.
+ */
+int lz4_decompress(const void* src, size_t src_len, void* dst, size_t dst_len)
+{
+    const uint8_t* ip = (const uint8_t*)src;
+    const uint8_t* iend = ip + src_len;
+    uint8_t* op = (uint8_t*)dst;
+    uint8_t* oend = op + dst_len;
+
+    for (;;) {
+        if (ip >= iend) {
+            return LZ4_ERR_DATA;
+        }
+        uint8_t token = *ip++;
+
+        size_t lit_len = token >> 4;
+        if (lit_len == RUN_MASK && _lz4_read_len(&ip, iend, &lit_len) != 0) {
+            return LZ4_ERR_DATA;
+        }
+        if (lit_len > (size_t)(iend - ip)) {
+            return LZ4_ERR_DATA;
+        }
+        if (lit_len > (size_t)(oend - op)) {
+            return LZ4_ERR_OUTPUT;
+        }
+        if (lit_len <= WILD_COPY && iend - ip >= WILD_COPY && oend - op >= WILD_COPY) {
+            memcpy(op, ip, WILD_COPY);
+        } else {
+            memcpy(op, ip, lit_len);
+        }
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip == iend) {
+            return op - (uint8_t*)dst;
+        }
+        if (iend - ip < 2) {
+            return LZ4_ERR_DATA;
+        }
+
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > (size_t)(op - (uint8_t*)dst)) {
+            return LZ4_ERR_DATA;
+        }
+
+        size_t match_len = token & RUN_MASK;
+        if (match_len == RUN_MASK && _lz4_read_len(&ip, iend, &match_len) != 0) {
+            return LZ4_ERR_DATA;
+        }
+        match_len += MIN_MATCH;
+        if (match_len > (size_t)(oend - op)) {
+            return LZ4_ERR_OUTPUT;
+        }
+
+        const uint8_t* match = op - offset;
+        if (offset >= WILD_COPY && match_len <= 2 * WILD_COPY && oend - op >= 2 * WILD_COPY) {
+            memcpy(op, match, WILD_COPY);
+            memcpy(op + WILD_COPY, match + WILD_COPY, WILD_COPY);
+            op += match_len;
+            continue;
+        }
+        if (offset >= match_len) {
+            memcpy(op, match, match_len);
+            op += match_len;
+            continue;
+        }
+
+        while (match_len) {
+            size_t step = (size_t)(op - match) < match_len ? (size_t)(op - match) : match_len;
+            memcpy(op, match, step);
+            op += step;
+            match_len -= step;
+        }
+    }
+}
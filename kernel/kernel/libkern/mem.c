@@ -7,23 +7,60 @@
 #include <libkern/libkern.h>
 #include <mem/kmalloc.h>
 
+/* Interrupt entries do not clear the direction flag, so the string
+   instructions set it themselves. The aarch32 versions live in routines. */
 #ifdef __i386__
 void* memset(void* dest, uint8_t fll, uint32_t nbytes)
 {
-    for (int i = 0; i < nbytes; ++i) {
-        *((uint8_t*)dest + i) = fll;
+    void* res = dest;
+    uint32_t pattern = fll * 0x01010101;
+    uint32_t head = -(uint32_t)dest & 3;
+    if (head > nbytes) {
+        head = nbytes;
     }
-    return dest;
+
+    uint32_t words = (nbytes - head) >> 2;
+    uint32_t tail = (nbytes - head) & 3;
+    asm volatile("cld\n\trep stosb"
+                 : "+D"(dest), "+c"(head)
+                 : "a"(pattern)
+                 : "memory");
+    asm volatile("rep stosl"
+                 : "+D"(dest), "+c"(words)
+                 : "a"(pattern)
+                 : "memory");
+    asm volatile("rep stosb"
+                 : "+D"(dest), "+c"(tail)
+                 : "a"(pattern)
+                 : "memory");
+    return res;
 }
-#endif
 
 void* memcpy(void* dest, const void* src, uint32_t nbytes)
 {
-    for (int i = 0; i < nbytes; ++i) {
-        *(char*)(dest + i) = *(char*)(src + i);
+    void* res = dest;
+    uint32_t head = -(uint32_t)dest & 3;
+    if (head > nbytes) {
+        head = nbytes;
     }
-    return dest;
+
+    uint32_t words = (nbytes - head) >> 2;
+    uint32_t tail = (nbytes - head) & 3;
+    asm volatile("cld\n\trep movsb"
+                 : "+D"(dest), "+S"(src), "+c"(head)
+                 :
+                 : "memory");
+    asm volatile("rep movsl"
+                 : "+D"(dest), "+S"(src), "+c"(words)
+                 :
+                 : "memory");
+    asm volatile("rep movsb"
+                 : "+D"(dest), "+S"(src), "+c"(tail)
+                 :
+                 : "memory");
+    return res;
 }
+#endif
 
 void* memmove(void* dest, const void* src, uint32_t nbytes)
 {
@@ -50,8 +87,45 @@ void* memccpy(void* dest, const void* src, uint8_t stop, uint32_t nbytes)
     return NULL;
 }
 
+/**
+ * Tests a word at a time once src is aligned: a byte of the xor with the
+ * pattern is zero exactly where c is.
+ */
+void* memchr(const void* src, uint8_t c, uint32_t nbytes)
+{
+    const uint8_t* p = (const uint8_t*)src;
+    for (; nbytes && ((uint32_t)p & 3); p++, nbytes--) {
+        if (*p == c) {
+            return (void*)p;
+        }
+    }
+
+    uint32_t pattern = c * 0x01010101;
+    for (; nbytes >= 4; p += 4, nbytes -= 4) {
+        uint32_t word = *(const uint32_t*)p ^ pattern;
+        if ((word - 0x01010101) & ~word & 0x80808080) {
+            break;
+        }
+    }
+
+    for (; nbytes; p++, nbytes--) {
+        if (*p == c) {
+            return (void*)p;
+        }
+    }
+    return NULL;
+}
+
 int memcmp(const void* src1, const void* src2, uint32_t nbytes)
 {
+    if ((((uint32_t)src1 | (uint32_t)src2) & 3) == 0) {
+        while (nbytes >= 4 && *(uint32_t*)src1 == *(uint32_t*)src2) {
+            src1 += 4;
+            src2 += 4;
+            nbytes -= 4;
+        }
+    }
+
     for (int i = 0; i < nbytes; ++i) {
         if (*(uint8_t*)(src1 + i) < *((uint8_t*)src2 + i)) {
             return -1;
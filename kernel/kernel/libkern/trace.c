@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <fs/devfs/devfs.h>
+#include <fs/vfs.h>
+#include <libkern/atomic.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/trace.h>
+#include <mem/kmalloc.h>
+#include <platform/generic/system.h>
+#include <tasking/cpu.h>
+#include <tasking/thread.h>
+#include <time/time_manager.h>
+
+typedef struct {
+    trace_record_t* records;
+    uint32_t head; // only the cpu moves it, with interrupts disabled
+    uint32_t tail; // only readers move it, under _trace_lock
+} trace_ring_t;
+
+bool trace_enabled = false;
+static trace_ring_t _trace_rings[CPU_CNT];
+static lock_t _trace_lock;
+
+/**
+ * HELPERS
+ */
+
+static void _trace_clear_rings_lockless()
+{
+    for (int i = 0; i < CPU_CNT; i++) {
+        atomic_store(&_trace_rings[i].tail, atomic_load(&_trace_rings[i].head));
+    }
+}
+
+static int _trace_alloc_rings_lockless()
+{
+    if (_trace_rings[0].records) {
+        return 0;
+    }
+
+    for (int i = 0; i < CPU_CNT; i++) {
+        _trace_rings[i].records = kmalloc(TRACE_RECORDS_PER_CPU * sizeof(trace_record_t));
+        if (!_trace_rings[i].records) {
+            for (int j = 0; j < i; j++) {
+                kfree(_trace_rings[j].records);
+                _trace_rings[j].records = NULL;
+            }
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+
+/**
+ * DEVFS OPS
+ */
+
+static bool _trace_can_read(dentry_t* dentry, uint32_t start)
+{
+    if (!atomic_load(&trace_enabled)) {
+        return true;
+    }
+
+    for (int i = 0; i < CPU_CNT; i++) {
+        if (atomic_load(&_trace_rings[i].head) != atomic_load(&_trace_rings[i].tail)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _trace_can_write(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+/**
+ * Drains whole records of all rings. Records of one cpu come in order,
+ * the decoder merges cpus by their ticks.
+ */
+static int _trace_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    if (len < sizeof(trace_record_t)) {
+        return -EINVAL;
+    }
+
+    uint32_t read = 0;
+    lock_acquire(&_trace_lock);
+    for (int i = 0; i < CPU_CNT && _trace_rings[i].records; i++) {
+        trace_ring_t* ring = &_trace_rings[i];
+        uint32_t head = atomic_load(&ring->head);
+        while (ring->tail != head && read + sizeof(trace_record_t) <= len) {
+            memcpy(buf + read, &ring->records[ring->tail % TRACE_RECORDS_PER_CPU], sizeof(trace_record_t));
+            read += sizeof(trace_record_t);
+            atomic_store(&ring->tail, ring->tail + 1);
+        }
+    }
+    lock_release(&_trace_lock);
+    return read;
+}
+
+static int _trace_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    if (!len) {
+        return 0;
+    }
+
+    int err = 0;
+    lock_acquire(&_trace_lock);
+    switch (buf[0]) {
+    case '1':
+        err = _trace_alloc_rings_lockless();
+        if (!err) {
+            _trace_clear_rings_lockless();
+            atomic_store(&trace_enabled, true);
+        }
+        break;
+    case '0':
+        atomic_store(&trace_enabled, false);
+        break;
+    default:
+        err = -EINVAL;
+    }
+    lock_release(&_trace_lock);
+    return err ? err : (int)len;
+}
+
+/**
+ * PUBLIC FUNCTIONS
+ */
+
+int trace_install()
+{
+    dentry_t* mp;
+    if (vfs_resolve_path("/dev", &mp) < 0) {
+        return -1;
+    }
+
+    lock_init(&_trace_lock);
+    file_ops_t fops = { 0 };
+    fops.can_read = _trace_can_read;
+    fops.can_write = _trace_can_write;
+    fops.read = _trace_read;
+    fops.write = _trace_write;
+    devfs_inode_t* res = devfs_register(mp, MKDEV(10, 201), "trace", 5, 0600, &fops);
+    dentry_put(mp);
+    return 0;
+}
+
+/**
+ * Slow path of trace_point(). Takes no locks, so it is safe in interrupts
+ * and under any other lock.
+ */
+void trace_record(uint32_t event, uint32_t a, uint32_t b, uint32_t c)
+{
+    system_disable_interrupts();
+    trace_ring_t* ring = &_trace_rings[THIS_CPU->id];
+    uint32_t head = ring->head;
+    if (!ring->records || head - atomic_load(&ring->tail) >= TRACE_RECORDS_PER_CPU) {
+        system_enable_interrupts();
+        return;
+    }
+
+    trace_record_t* rec = &ring->records[head % TRACE_RECORDS_PER_CPU];
+    rec->ticks = timeman_global_ticks();
+    rec->cycles = lock_cycles();
+    rec->event = event;
+    rec->cpu = THIS_CPU->id;
+    rec->tid = RUNNING_THREAD ? RUNNING_THREAD->tid : 0;
+    rec->a = a;
+    rec->b = b;
+    rec->c = c;
+    atomic_store(&ring->head, head + 1);
+    system_enable_interrupts();
+}
@@ -69,12 +69,23 @@ void reverse(char s[])
     }
 }
 
+/* Goes a word at a time once aligned, see libc's string.c. */
 uint32_t strlen(const char* s)
 {
-    uint32_t i = 0;
-    while (s[i] != '\0')
-        ++i;
-    return i;
+    const char* p = s;
+    for (; (uint32_t)p & 3; p++) {
+        if (*p == '\0') {
+            return p - s;
+        }
+    }
+
+    const uint32_t* w = (const uint32_t*)p;
+    while (!((*w - 0x01010101) & ~*w & 0x80808080)) {
+        w++;
+    }
+
+    for (p = (const char*)w; *p != '\0'; p++) { }
+    return p - s;
 }
 
 int strcmp(const char* a, const char* b)
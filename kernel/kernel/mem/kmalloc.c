@@ -9,8 +9,17 @@
 #include <libkern/lock.h>
 #include <libkern/log.h>
 #include <mem/kmalloc.h>
+#include <mem/kmemcache.h>
 #include <mem/vmm/zoner.h>
 
+/**
+ * Small allocations are served by size-class slab caches (see kmemcache.c),
+ * the bitmap allocator below is the fallback path for bigger ones.
+ */
+#define KMALLOC_SLAB_CLASSES_COUNT 6
+#define KMALLOC_SLAB_MIN_SIZE 16
+#define KMALLOC_SLAB_MAX_SIZE (KMALLOC_SLAB_MIN_SIZE << (KMALLOC_SLAB_CLASSES_COUNT - 1))
+
 struct kmalloc_header {
     uint32_t len;
 };
@@ -21,6 +30,26 @@ static zone_t _kmalloc_zone;
 static uint32_t _kmalloc_bitmap_len = 0;
 static uint8_t* _kmalloc_bitmap;
 static bitmap_t bitmap;
+static kmemcache_t* _kmalloc_slab_classes[KMALLOC_SLAB_CLASSES_COUNT];
+static const char* _kmalloc_slab_names[KMALLOC_SLAB_CLASSES_COUNT] = {
+    "kmalloc-16",
+    "kmalloc-32",
+    "kmalloc-64",
+    "kmalloc-128",
+    "kmalloc-256",
+    "kmalloc-512",
+};
+
+static inline int _kmalloc_slab_class_of(uint32_t size)
+{
+    int res = 0;
+    uint32_t class_size = KMALLOC_SLAB_MIN_SIZE;
+    while (class_size < size) {
+        class_size <<= 1;
+        res++;
+    }
+    return res;
+}
 
 static inline uint32_t kmalloc_to_vaddr(int start)
 {
@@ -49,21 +78,39 @@ static void _kmalloc_init_bitmap()
 void kmalloc_init()
 {
     lock_init(&_kmalloc_lock);
+    lock_stat_register(&_kmalloc_lock, "kmalloc");
     _kmalloc_zone = zoner_new_zone(KMALLOC_SPACE_SIZE);
     _kmalloc_init_bitmap();
+
+    kmemcache_init();
+    for (int i = 0; i < KMALLOC_SLAB_CLASSES_COUNT; i++) {
+        _kmalloc_slab_classes[i] = kmemcache_create(_kmalloc_slab_names[i], KMALLOC_SLAB_MIN_SIZE << i);
+    }
 }
 
 void* kmalloc(uint32_t size)
 {
+    if (size <= KMALLOC_SLAB_MAX_SIZE) {
+        kmemcache_t* cache = _kmalloc_slab_classes[_kmalloc_slab_class_of(size)];
+        if (cache) {
+            void* res = kmemcache_alloc(cache);
+            if (res) {
+                return res;
+            }
+        }
+    }
+
     lock_acquire(&_kmalloc_lock);
     int act_size = size + sizeof(kmalloc_header_t);
 
     int blocks_needed = (act_size + KMALLOC_BLOCK_SIZE - 1) / KMALLOC_BLOCK_SIZE;
 
+    /* Callers handle NULL as -ENOMEM, the machine keeps running. */
     int start = bitmap_find_space(bitmap, blocks_needed);
     if (start < 0) {
-        log_error("[Err] NO SPACE AT KMALLOC");
-        system_stop();
+        lock_release(&_kmalloc_lock);
+        log_warn("kmalloc: no space for %u bytes", size);
+        return NULL;
     }
 
     kmalloc_header_t* space = (kmalloc_header_t*)kmalloc_to_vaddr(start);
@@ -77,6 +124,9 @@ void* kmalloc(uint32_t size)
 void* kmalloc_aligned(uint32_t size, uint32_t alignment)
 {
     void* ptr = kmalloc(size + alignment + sizeof(void*));
+    if (!ptr) {
+        return NULL;
+    }
     uint32_t max_addr = (uint32_t)ptr + sizeof(void*) + alignment;
     void* aligned_ptr = (void*)(max_addr - (max_addr % alignment));
     ((void**)aligned_ptr)[-1] = ptr;
@@ -90,6 +140,15 @@ void* kmalloc_page_aligned()
 
 void kfree(void* ptr)
 {
+    if (!ptr) {
+        return;
+    }
+
+    if (kmemcache_owns(ptr)) {
+        kmemcache_free(kmemcache_of(ptr), ptr);
+        return;
+    }
+
     kmalloc_header_t* sptr = (kmalloc_header_t*)ptr;
     int blocks_to_delete = (sptr[-1].len + KMALLOC_BLOCK_SIZE - 1) / KMALLOC_BLOCK_SIZE;
     lock_acquire(&_kmalloc_lock);
@@ -99,23 +158,66 @@ void kfree(void* ptr)
 
 void kfree_aligned(void* ptr)
 {
+    if (!ptr) {
+        return;
+    }
     kfree(((void**)ptr)[-1]);
 }
 
 void* krealloc(void* ptr, uint32_t new_size)
 {
-    uint32_t old_size = ((kmalloc_header_t*)ptr)[-1].len;
-    if (old_size == new_size) {
+    if (!ptr) {
+        return kmalloc(new_size);
+    }
+
+    if (kmemcache_owns(ptr)) {
+        uint32_t obj_size = kmemcache_obj_size(kmemcache_of(ptr));
+        if (new_size <= obj_size) {
+            return ptr;
+        }
+
+        uint8_t* new_area = kmalloc(new_size);
+        if (new_area == 0) {
+            return 0;
+        }
+        memcpy(new_area, ptr, obj_size);
+        kfree(ptr);
+        return new_area;
+    }
+
+    kmalloc_header_t* space = &((kmalloc_header_t*)ptr)[-1];
+    uint32_t old_size = space->len - sizeof(kmalloc_header_t);
+    uint32_t act_size = new_size + sizeof(kmalloc_header_t);
+    int start = kmalloc_to_index((uint32_t)space);
+    int old_blocks = (space->len + KMALLOC_BLOCK_SIZE - 1) / KMALLOC_BLOCK_SIZE;
+    int new_blocks = (act_size + KMALLOC_BLOCK_SIZE - 1) / KMALLOC_BLOCK_SIZE;
+
+    lock_acquire(&_kmalloc_lock);
+    if (new_blocks <= old_blocks) {
+        if (new_blocks < old_blocks) {
+            bitmap_unset_range(bitmap, start + new_blocks, old_blocks - new_blocks);
+        }
+        space->len = act_size;
+        lock_release(&_kmalloc_lock);
         return ptr;
     }
 
+    /* Trying to grow in place, if the following blocks are free. */
+    if (bitmap_is_range_unset(bitmap, start + old_blocks, new_blocks - old_blocks)) {
+        bitmap_set_range(bitmap, start + old_blocks, new_blocks - old_blocks);
+        space->len = act_size;
+        lock_release(&_kmalloc_lock);
+        return ptr;
+    }
+    lock_release(&_kmalloc_lock);
+
     uint8_t* new_area = kmalloc(new_size);
     if (new_area == 0) {
         return 0;
     }
 
-    memcpy(new_area, ptr, new_size > old_size ? new_size : old_size);
+    memcpy(new_area, ptr, min(old_size, new_size));
     kfree(ptr);
 
     return new_area;
-}
\ No newline at end of file
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <mem/kmemcache.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/generic/cpu.h>
+#include <platform/generic/system.h>
+
+#define KMEMCACHE_ALIGNMENT (8)
+#define KMEMCACHE_ROUND_UP(x) (((x) + KMEMCACHE_ALIGNMENT - 1) & ~(KMEMCACHE_ALIGNMENT - 1))
+
+struct kmemcache_slab {
+    struct kmemcache* cache;
+    struct kmemcache_slab* prev;
+    struct kmemcache_slab* next;
+    void* free_list;
+    uint32_t inuse;
+};
+typedef struct kmemcache_slab kmemcache_slab_t;
+
+struct kmemcache_cpu {
+    uint32_t count;
+    void* objs[KMEMCACHE_CPU_CACHE_SIZE];
+
+    /* Stat */
+    uint32_t alloc_calls;
+    uint32_t free_calls;
+};
+typedef struct kmemcache_cpu kmemcache_cpu_t;
+
+struct kmemcache {
+    const char* name;
+    uint32_t obj_size;
+    uint32_t objs_per_slab;
+    uint32_t objs_offset;
+
+    lock_t lock;
+    kmemcache_slab_t* partial; /* Slabs which have at least one free object. */
+    uint32_t empty_slabs;
+    uint32_t slabs;
+
+    kmemcache_cpu_t cpu[CPU_CNT];
+};
+
+static zone_t _kmemcache_zone;
+static uint32_t _kmemcache_next_page;
+static void* _kmemcache_free_pages;
+static lock_t _kmemcache_pages_lock;
+
+/**
+ * PAGES
+ */
+
+static void* _kmemcache_page_alloc()
+{
+    void* res = NULL;
+    lock_acquire(&_kmemcache_pages_lock);
+    if (_kmemcache_free_pages) {
+        res = _kmemcache_free_pages;
+        _kmemcache_free_pages = *(void**)res;
+    } else if (_kmemcache_next_page < _kmemcache_zone.len) {
+        res = (void*)(_kmemcache_zone.start + _kmemcache_next_page);
+        _kmemcache_next_page += VMM_PAGE_SIZE;
+    }
+    lock_release(&_kmemcache_pages_lock);
+    return res;
+}
+
+static void _kmemcache_page_free(void* page)
+{
+    lock_acquire(&_kmemcache_pages_lock);
+    *(void**)page = _kmemcache_free_pages;
+    _kmemcache_free_pages = page;
+    lock_release(&_kmemcache_pages_lock);
+}
+
+/**
+ * SLABS
+ */
+
+static inline kmemcache_slab_t* _kmemcache_slab_of(void* ptr)
+{
+    return (kmemcache_slab_t*)PAGE_START((uint32_t)ptr);
+}
+
+static inline void _kmemcache_list_add(kmemcache_t* cache, kmemcache_slab_t* slab)
+{
+    slab->prev = NULL;
+    slab->next = cache->partial;
+    if (cache->partial) {
+        cache->partial->prev = slab;
+    }
+    cache->partial = slab;
+}
+
+static inline void _kmemcache_list_remove(kmemcache_t* cache, kmemcache_slab_t* slab)
+{
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        cache->partial = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = NULL;
+    slab->next = NULL;
+}
+
+static kmemcache_slab_t* _kmemcache_slab_new(kmemcache_t* cache)
+{
+    kmemcache_slab_t* slab = (kmemcache_slab_t*)_kmemcache_page_alloc();
+    if (!slab) {
+        return NULL;
+    }
+
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free_list = NULL;
+
+    uint8_t* obj = (uint8_t*)slab + cache->objs_offset + (cache->objs_per_slab - 1) * cache->obj_size;
+    for (int i = 0; i < cache->objs_per_slab; i++, obj -= cache->obj_size) {
+        *(void**)obj = slab->free_list;
+        slab->free_list = obj;
+    }
+
+    cache->slabs++;
+    cache->empty_slabs++;
+    _kmemcache_list_add(cache, slab);
+    return slab;
+}
+
+static void* _kmemcache_alloc_lockless(kmemcache_t* cache)
+{
+    kmemcache_slab_t* slab = cache->partial;
+    if (!slab) {
+        slab = _kmemcache_slab_new(cache);
+        if (!slab) {
+            return NULL;
+        }
+    }
+
+    void* obj = slab->free_list;
+    slab->free_list = *(void**)obj;
+    if (slab->inuse == 0) {
+        cache->empty_slabs--;
+    }
+    slab->inuse++;
+    if (slab->inuse == cache->objs_per_slab) {
+        _kmemcache_list_remove(cache, slab);
+    }
+    return obj;
+}
+
+static void _kmemcache_free_lockless(kmemcache_t* cache, void* obj)
+{
+    kmemcache_slab_t* slab = _kmemcache_slab_of(obj);
+    ASSERT(slab->cache == cache);
+
+    *(void**)obj = slab->free_list;
+    slab->free_list = obj;
+    if (slab->inuse == cache->objs_per_slab) {
+        _kmemcache_list_add(cache, slab);
+    }
+    slab->inuse--;
+
+    if (slab->inuse == 0) {
+        if (cache->empty_slabs >= KMEMCACHE_MAX_EMPTY_SLABS) {
+            _kmemcache_list_remove(cache, slab);
+            cache->slabs--;
+            _kmemcache_page_free(slab);
+        } else {
+            cache->empty_slabs++;
+        }
+    }
+}
+
+/**
+ * PUBLIC FUNCTIONS
+ */
+
+void kmemcache_init()
+{
+    lock_init(&_kmemcache_pages_lock);
+    _kmemcache_zone = zoner_new_zone(KMEMCACHE_SPACE_SIZE);
+    _kmemcache_next_page = 0;
+    _kmemcache_free_pages = NULL;
+}
+
+kmemcache_t* kmemcache_create(const char* name, uint32_t obj_size)
+{
+    obj_size = KMEMCACHE_ROUND_UP(max(obj_size, (uint32_t)sizeof(void*)));
+    uint32_t objs_offset = KMEMCACHE_ROUND_UP(sizeof(kmemcache_slab_t));
+    if (obj_size > VMM_PAGE_SIZE - objs_offset) {
+        return NULL;
+    }
+
+    kmemcache_t* cache = (kmemcache_t*)kmalloc(sizeof(kmemcache_t));
+    if (!cache) {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(kmemcache_t));
+    cache->name = name;
+    cache->obj_size = obj_size;
+    cache->objs_offset = objs_offset;
+    cache->objs_per_slab = (VMM_PAGE_SIZE - objs_offset) / obj_size;
+    lock_init(&cache->lock);
+    return cache;
+}
+
+void* kmemcache_alloc(kmemcache_t* cache)
+{
+    void* res = NULL;
+    system_disable_interrupts();
+    kmemcache_cpu_t* cpu_cache = &cache->cpu[system_cpu_id()];
+    if (!cpu_cache->count) {
+        lock_acquire(&cache->lock);
+        while (cpu_cache->count < KMEMCACHE_CPU_CACHE_BATCH) {
+            void* obj = _kmemcache_alloc_lockless(cache);
+            if (!obj) {
+                break;
+            }
+            cpu_cache->objs[cpu_cache->count++] = obj;
+        }
+        lock_release(&cache->lock);
+    }
+
+    if (cpu_cache->count) {
+        res = cpu_cache->objs[--cpu_cache->count];
+        cpu_cache->alloc_calls++;
+    }
+    system_enable_interrupts();
+    return res;
+}
+
+void kmemcache_free(kmemcache_t* cache, void* ptr)
+{
+    system_disable_interrupts();
+    kmemcache_cpu_t* cpu_cache = &cache->cpu[system_cpu_id()];
+    if (cpu_cache->count == KMEMCACHE_CPU_CACHE_SIZE) {
+        lock_acquire(&cache->lock);
+        while (cpu_cache->count > KMEMCACHE_CPU_CACHE_BATCH) {
+            _kmemcache_free_lockless(cache, cpu_cache->objs[--cpu_cache->count]);
+        }
+        lock_release(&cache->lock);
+    }
+
+    cpu_cache->objs[cpu_cache->count++] = ptr;
+    cpu_cache->free_calls++;
+    system_enable_interrupts();
+}
+
+bool kmemcache_owns(void* ptr)
+{
+    uint32_t addr = (uint32_t)ptr;
+    return _kmemcache_zone.start <= addr && addr < _kmemcache_zone.start + _kmemcache_zone.len;
+}
+
+kmemcache_t* kmemcache_of(void* ptr)
+{
+    return _kmemcache_slab_of(ptr)->cache;
+}
+
+uint32_t kmemcache_obj_size(kmemcache_t* cache)
+{
+    return cache->obj_size;
+}
+
+int kmemcache_stat(kmemcache_t* cache, kmemcache_stat_t* stat)
+{
+    stat->obj_size = cache->obj_size;
+    stat->slabs = cache->slabs;
+    stat->alloc_calls = 0;
+    stat->free_calls = 0;
+    for (int i = 0; i < CPU_CNT; i++) {
+        stat->alloc_calls += cache->cpu[i].alloc_calls;
+        stat->free_calls += cache->cpu[i].free_calls;
+    }
+    stat->objs_in_use = stat->alloc_calls - stat->free_calls;
+    return 0;
+}
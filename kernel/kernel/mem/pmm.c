@@ -1,5 +1,30 @@
+#include <libkern/lock.h>
 #include <libkern/log.h>
 #include <mem/pmm.h>
+#include <platform/generic/cpu.h>
+#include <platform/generic/system.h>
+#include <platform/generic/vmm/consts.h>
+
+/**
+ * The allocator is a buddy system kept as a binary tree over all blocks.
+ * Every node stores (order + 1) of the biggest free aligned chunk inside
+ * its subtree, 0 means the subtree is fully used. A node which is fully
+ * free or fully used says nothing about its children, they are updated
+ * lazily while walking down. The tree lives right after the MAT.
+ *
+ * The tree has to fit into the kernel mapping next to the MAT, so it is
+ * kept small in two ways. Its lowest nodes are of PMM_BUDDY_MIN_ORDER and
+ * each of them covers one byte of the MAT, which tells about the blocks
+ * inside. And it covers blocks from _pmm_buddy_base only, as RAM of arm
+ * boards starts high. Blocks are given to the tree relatively to the base,
+ * which is aligned to the size of the tree, so chunks stay aligned
+ * physically.
+ */
+
+#define PMM_BUDDY_FULL(order) ((order) + 1)
+#define PMM_BUDDY_MIN_ORDER (3) /* 1 << PMM_BUDDY_MIN_ORDER == PMM_BLOCKS_PER_BYTE */
+#define PMM_BUDDY_NODE(block_id, order) ((1U << (_pmm_buddy_max_order - (order))) + ((block_id) >> (order)))
+#define PMM_BLOCKS_PER_FRAME (VMM_PAGE_SIZE / PMM_BLOCK_SIZE)
 
 // [Privates Prototypes]
 static inline uint32_t _pmm_round_ceil(uint32_t value);
@@ -7,14 +32,31 @@ static inline uint32_t _pmm_round_floor(uint32_t value);
 static inline void _pmm_mat_alloc_block(uint32_t block_id);
 static inline void _pmm_mat_free_block(uint32_t block_id);
 static inline bool _pmm_mat_tesblock(uint32_t block_id);
-uint32_t _pmm_first_free_block();
-uint32_t _pmm_first_free_block_n(uint32_t t_size);
+static inline uint32_t _pmm_buddy_order_of(uint32_t blocks);
+static inline uint8_t _pmm_buddy_byte_value(uint8_t byte);
+static inline uint8_t* _pmm_buddy_mat_byte(uint32_t node);
+static inline void _pmm_buddy_push_down(uint32_t node, uint32_t order);
+static inline uint8_t _pmm_buddy_combine(uint32_t node, uint32_t order);
+static void _pmm_buddy_update_parents(uint32_t node, uint32_t order);
+static void _pmm_buddy_set_node(uint32_t block_id, uint32_t order, bool used);
+static void _pmm_buddy_set_range(uint32_t block_id, uint32_t count, bool used);
+static uint32_t _pmm_buddy_alloc(uint32_t order);
+static void _pmm_buddy_place(uint32_t first_block);
+static void _pmm_buddy_build();
+static void _pmm_frame_cache_refill(pmm_frame_cache_t* cache);
+static void _pmm_frame_cache_drain(pmm_frame_cache_t* cache);
 void _pmm_init_region(uint32_t t_region_start, uint32_t t_region_length);
 void _pmm_deinit_region(uint32_t t_region_start, uint32_t t_region_length);
 void _pmm_deinit_mat();
-void _pmm_calc_ram_size(mem_desc_t* mem_desc);
-void _pmm_allocate_mat(void* t_mat_base);
-static int last_i = 0;
+uint32_t _pmm_calc_ram_size(mem_desc_t* mem_desc);
+void _pmm_allocate_mat(void* t_mat_base, uint32_t ram_start);
+
+static lock_t _pmm_lock;
+static uint8_t* _pmm_buddy_tree;
+static uint32_t _pmm_buddy_base;
+static uint32_t _pmm_buddy_max_order;
+static uint32_t _pmm_buddy_tree_size;
+static uint32_t _pmm_frame_order;
 
 static inline uint32_t _pmm_round_ceil(uint32_t value)
 {
@@ -48,75 +90,183 @@ static inline bool _pmm_mat_tesblock(uint32_t block_id)
     return (pmm_mat[block_id / PMM_BLOCKS_PER_BYTE] >> (block_id % PMM_BLOCKS_PER_BYTE)) & 1;
 }
 
-// _pmm_first_free_block returns block_id
-uint32_t _pmm_first_free_block()
+// _pmm_buddy_order_of returns the smallest order which covers @blocks
+static inline uint32_t _pmm_buddy_order_of(uint32_t blocks)
+{
+    uint32_t order = 0;
+    while ((1U << order) < blocks) {
+        order++;
+    }
+    return order;
+}
+
+// _pmm_buddy_byte_value returns the value of the lowest node which covers the MAT @byte
+static inline uint8_t _pmm_buddy_byte_value(uint8_t byte)
 {
-    uint32_t* mat_big = (uint32_t*)pmm_mat;
-    for (uint32_t i = last_i; i < pmm_mat_size / 4; i++) {
-        // log("W %x", &mat_big[i]);
-        if (mat_big[i] != 0xffffffff) {
-            for (uint8_t j = 0; j < 32; j++) {
-                uint32_t currenblock = i * 32 + j;
-                if (!_pmm_mat_tesblock(currenblock)) {
-                    // last_i = pmm_mat_size / 8;
-                    return currenblock;
-                }
+    for (int order = PMM_BUDDY_MIN_ORDER; order >= 0; order--) {
+        uint32_t len = 1U << order;
+        uint32_t mask = (1U << len) - 1;
+        for (uint32_t at = 0; at < PMM_BLOCKS_PER_BYTE; at += len) {
+            if ((byte & (mask << at)) == 0) {
+                return PMM_BUDDY_FULL(order);
             }
         }
     }
-    return 0x0;
-}
-
-// _pmm_first_free_block_n returns block_id of block sequence
-uint32_t _pmm_first_free_block_n(uint32_t t_size)
-{
-    if (t_size == 1) {
-        return _pmm_first_free_block();
-    }
-    uint32_t* mat_big = (uint32_t*)pmm_mat;
-    for (uint32_t i = last_i; i < pmm_mat_size / 4; i++) {
-        if (mat_big[i] != 0xffffffff) {
-            for (uint8_t j = 0; j < 32; j++) {
-                uint32_t currenblock = i * 32 + j;
-                uint32_t free = 0;
-                for (uint32_t x = 0; x < t_size; x++) {
-                    if (!_pmm_mat_tesblock(currenblock + x)) {
-                        free++;
-                    }
-                }
-                if (free == t_size) {
-                    // last_i = pmm_mat_size / 8;
-                    return currenblock;
-                }
-            }
+    return 0;
+}
+
+// _pmm_buddy_mat_byte returns the MAT byte of the lowest @node, NULL if it's past the MAT
+static inline uint8_t* _pmm_buddy_mat_byte(uint32_t node)
+{
+    uint32_t byte_id = _pmm_buddy_base / PMM_BLOCKS_PER_BYTE + node - (1U << (_pmm_buddy_max_order - PMM_BUDDY_MIN_ORDER));
+    return byte_id < pmm_mat_size ? &pmm_mat[byte_id] : NULL;
+}
+
+// _pmm_buddy_push_down moves the state of a fully free or fully used node to its children
+static inline void _pmm_buddy_push_down(uint32_t node, uint32_t order)
+{
+    uint8_t val = _pmm_buddy_tree[node];
+    if (order == PMM_BUDDY_MIN_ORDER) {
+        uint8_t* byte = _pmm_buddy_mat_byte(node);
+        if (byte && val == 0) {
+            *byte = 0xff;
+        } else if (byte && val == PMM_BUDDY_FULL(order)) {
+            *byte = 0;
         }
+        return;
     }
-    return 0x0;
-}
-
-uint32_t _pmm_first_free_block_n_aligned(uint32_t t_size, uint32_t alignment)
-{
-    uint32_t* mat_big = (uint32_t*)pmm_mat;
-    for (uint32_t i = last_i; i < pmm_mat_size / 4; i++) {
-        if (mat_big[i] != 0xffffffff) {
-            for (uint8_t j = 0; j < 32; j++) {
-                uint32_t currenblock = i * 32 + j;
-                uint32_t free = 0;
-                if (currenblock % alignment == 0) {
-                    for (uint32_t x = 0; x < t_size; x++) {
-                        if (!_pmm_mat_tesblock(currenblock + x)) {
-                            free++;
-                        }
-                    }
-                    if (free == t_size) {
-                        // last_i = pmm_mat_size / 8;
-                        return currenblock;
-                    }
-                }
-            }
+
+    if (val == 0) {
+        _pmm_buddy_tree[2 * node] = 0;
+        _pmm_buddy_tree[2 * node + 1] = 0;
+    } else if (val == PMM_BUDDY_FULL(order)) {
+        _pmm_buddy_tree[2 * node] = PMM_BUDDY_FULL(order - 1);
+        _pmm_buddy_tree[2 * node + 1] = PMM_BUDDY_FULL(order - 1);
+    }
+}
+
+// _pmm_buddy_combine recalculates the node from its children
+static inline uint8_t _pmm_buddy_combine(uint32_t node, uint32_t order)
+{
+    uint8_t left = _pmm_buddy_tree[2 * node];
+    uint8_t right = _pmm_buddy_tree[2 * node + 1];
+    if (left == PMM_BUDDY_FULL(order - 1) && right == PMM_BUDDY_FULL(order - 1)) {
+        return PMM_BUDDY_FULL(order);
+    }
+    return left > right ? left : right;
+}
+
+static void _pmm_buddy_update_parents(uint32_t node, uint32_t order)
+{
+    while (node > 1) {
+        node >>= 1;
+        order++;
+        _pmm_buddy_tree[node] = _pmm_buddy_combine(node, order);
+    }
+}
+
+// _pmm_buddy_set_node marks the aligned chunk of (1 << @order) blocks
+static void _pmm_buddy_set_node(uint32_t block_id, uint32_t order, bool used)
+{
+    uint32_t node_order = order > PMM_BUDDY_MIN_ORDER ? order : PMM_BUDDY_MIN_ORDER;
+    uint32_t depth = _pmm_buddy_max_order - node_order;
+    uint32_t node = PMM_BUDDY_NODE(block_id, node_order);
+    for (uint32_t d = 0; d < depth; d++) {
+        _pmm_buddy_push_down(node >> (depth - d), _pmm_buddy_max_order - d);
+    }
+
+    if (order >= PMM_BUDDY_MIN_ORDER) {
+        _pmm_buddy_tree[node] = used ? 0 : PMM_BUDDY_FULL(order);
+    } else {
+        _pmm_buddy_push_down(node, PMM_BUDDY_MIN_ORDER);
+        uint8_t* byte = _pmm_buddy_mat_byte(node);
+        uint8_t mask = ((1U << (1U << order)) - 1) << (block_id % PMM_BLOCKS_PER_BYTE);
+        *byte = used ? (*byte | mask) : (*byte & ~mask);
+        _pmm_buddy_tree[node] = _pmm_buddy_byte_value(*byte);
+    }
+    _pmm_buddy_update_parents(node, node_order);
+}
+
+// _pmm_buddy_set_range splits the range into aligned chunks and marks them
+static void _pmm_buddy_set_range(uint32_t block_id, uint32_t count, bool used)
+{
+    while (count) {
+        uint32_t order = 0;
+        while (order < _pmm_buddy_max_order && (block_id & (1U << order)) == 0 && (2U << order) <= count) {
+            order++;
+        }
+        _pmm_buddy_set_node(block_id, order, used);
+        block_id += (1U << order);
+        count -= (1U << order);
+    }
+}
+
+// _pmm_buddy_alloc returns block_id of a free chunk of (1 << @order) blocks
+// will return 0x0 if unsuccesfully
+static uint32_t _pmm_buddy_alloc(uint32_t order)
+{
+    if (order > _pmm_buddy_max_order || _pmm_buddy_tree[1] < PMM_BUDDY_FULL(order)) {
+        return 0x0;
+    }
+
+    uint32_t node_order = order > PMM_BUDDY_MIN_ORDER ? order : PMM_BUDDY_MIN_ORDER;
+    uint32_t node = 1;
+    for (uint32_t cur_order = _pmm_buddy_max_order; cur_order > node_order; cur_order--) {
+        _pmm_buddy_push_down(node, cur_order);
+        node = 2 * node;
+        if (_pmm_buddy_tree[node] < PMM_BUDDY_FULL(order)) {
+            node++;
+        }
+    }
+
+    uint32_t block_id = (node - (1U << (_pmm_buddy_max_order - node_order))) << node_order;
+    if (order >= PMM_BUDDY_MIN_ORDER) {
+        _pmm_buddy_tree[node] = 0;
+    } else {
+        // The node has a free chunk of the order, so the byte has it too.
+        _pmm_buddy_push_down(node, PMM_BUDDY_MIN_ORDER);
+        uint8_t* byte = _pmm_buddy_mat_byte(node);
+        uint32_t len = 1U << order;
+        uint32_t mask = (1U << len) - 1;
+        uint32_t at = 0;
+        while (*byte & (mask << at)) {
+            at += len;
+        }
+        *byte |= mask << at;
+        _pmm_buddy_tree[node] = _pmm_buddy_byte_value(*byte);
+        block_id += at;
+    }
+    _pmm_buddy_update_parents(node, node_order);
+    return block_id;
+}
+
+// _pmm_buddy_place picks the base and the size of the tree to cover blocks from @first_block
+static void _pmm_buddy_place(uint32_t first_block)
+{
+    _pmm_buddy_max_order = PMM_BUDDY_MIN_ORDER;
+    _pmm_buddy_base = first_block & ~((1U << _pmm_buddy_max_order) - 1);
+    while ((1U << _pmm_buddy_max_order) < pmm_max_blocks - _pmm_buddy_base) {
+        _pmm_buddy_max_order++;
+        _pmm_buddy_base = first_block & ~((1U << _pmm_buddy_max_order) - 1);
+    }
+    _pmm_buddy_tree_size = 2U << (_pmm_buddy_max_order - PMM_BUDDY_MIN_ORDER);
+}
+
+// _pmm_buddy_build fills the tree based on the MAT
+static void _pmm_buddy_build()
+{
+    uint32_t first = 1U << (_pmm_buddy_max_order - PMM_BUDDY_MIN_ORDER);
+    for (uint32_t node = first; node < 2 * first; node++) {
+        uint8_t* byte = _pmm_buddy_mat_byte(node);
+        _pmm_buddy_tree[node] = byte ? _pmm_buddy_byte_value(*byte) : 0;
+    }
+
+    for (uint32_t order = PMM_BUDDY_MIN_ORDER + 1; order <= _pmm_buddy_max_order; order++) {
+        first = 1U << (_pmm_buddy_max_order - order);
+        for (uint32_t node = first; node < 2 * first; node++) {
+            _pmm_buddy_tree[node] = _pmm_buddy_combine(node, order);
         }
     }
-    return 0x0;
 }
 
 // _pmm_init_region marks the region as writable
@@ -161,26 +311,33 @@ void _pmm_deinit_region(uint32_t t_region_start, uint32_t t_region_length)
     }
 }
 
-// _pmm_deinit_mat marks the region where MAT is placed as NOT writable
+// _pmm_deinit_mat marks the region where MAT and buddy tree are placed as NOT writable
 void _pmm_deinit_mat()
 {
-    _pmm_deinit_region((uint32_t)pmm_mat, pmm_mat_size);
+    uint32_t mat_paddr = (uint32_t)pmm_mat - KERNEL_BASE + KERNEL_PM_BASE;
+    _pmm_deinit_region(mat_paddr, pmm_mat_size + _pmm_buddy_tree_size);
 }
 
 // _pmm_calc_ram_size calculates ram size depends on the memory map
-void _pmm_calc_ram_size(mem_desc_t* mem_desc)
+// returns the start of the lowest ram region
+uint32_t _pmm_calc_ram_size(mem_desc_t* mem_desc)
 {
     pmm_ram_size = 0;
+    uint32_t ram_start = 0xffffffff;
     memory_map_t* memory_map = (memory_map_t*)MEMORY_MAP_REGION;
     for (int i = 0; i < mem_desc->memory_map_size; i++) {
         if (memory_map[i].type == 1) {
             pmm_ram_size = memory_map[i].startLo + memory_map[i].sizeLo;
+            if (memory_map[i].startLo < ram_start) {
+                ram_start = memory_map[i].startLo;
+            }
         }
     }
+    return ram_start < pmm_ram_size ? ram_start : 0;
 }
 
-// _pmm_allocate_mat puts MAT (Memory allocation table) in the ram
-void _pmm_allocate_mat(void* t_mat_base)
+// _pmm_allocate_mat puts MAT (Memory allocation table) and buddy tree in the ram
+void _pmm_allocate_mat(void* t_mat_base, uint32_t ram_start)
 {
     pmm_mat = t_mat_base;
     pmm_mat_size = pmm_ram_size / PMM_BLOCK_SIZE / PMM_BLOCKS_PER_BYTE;
@@ -190,14 +347,19 @@ void _pmm_allocate_mat(void* t_mat_base)
     for (uint32_t i = 0; i < pmm_mat_size; ++i) {
         pmm_mat[i] = 0xff;
     }
+
+    _pmm_buddy_place(ram_start / PMM_BLOCK_SIZE);
+    _pmm_buddy_tree = pmm_mat + pmm_mat_size;
+    _pmm_frame_order = _pmm_buddy_order_of(PMM_BLOCKS_PER_FRAME);
 }
 
 void pmm_setup(mem_desc_t* mem_desc)
 {
+    lock_init(&_pmm_lock);
     uint32_t kernel_base_c = _pmm_round_ceil(KERNEL_BASE);
     uint32_t kernel_size = _pmm_round_ceil(mem_desc->kernel_size * 1024);
-    _pmm_calc_ram_size(mem_desc);
-    _pmm_allocate_mat((void*)(kernel_base_c + kernel_size));
+    uint32_t ram_start = _pmm_calc_ram_size(mem_desc);
+    _pmm_allocate_mat((void*)(kernel_base_c + kernel_size), ram_start);
 
     memory_map_t* memory_map = (memory_map_t*)MEMORY_MAP_REGION;
     for (int i = 0; i < mem_desc->memory_map_size; i++) {
@@ -207,7 +369,7 @@ void pmm_setup(mem_desc_t* mem_desc)
         }
     }
 
-    log("PMM: MAT size: %x", pmm_mat_size);
+    log("PMM: MAT size: %x, buddy tree size: %x", pmm_mat_size, _pmm_buddy_tree_size);
 
     // FIXME
 #ifdef __i386__
@@ -215,38 +377,68 @@ void pmm_setup(mem_desc_t* mem_desc)
 #elif __arm__
     _pmm_deinit_region(0x0, 0x80200000);
 #endif
-    // FIXME: DEINIT MAT DOES NOT WORK;
     _pmm_deinit_mat(); // mat deinit
     _pmm_deinit_region(0x0, KERNEL_PM_BASE); // kernel stack deinit
     _pmm_deinit_region(KERNEL_PM_BASE, mem_desc->kernel_size * 1024); // kernel deinit
+    if (mem_desc->initrd_size) {
+        _pmm_deinit_region(mem_desc->initrd_start, mem_desc->initrd_size); // initrd deinit, initramfs frees it
+    }
+    _pmm_buddy_build();
+
+    // Deinit regions overlap, so recounting used blocks based on the final MAT.
+    pmm_used_blocks = 0;
+    for (uint32_t i = 0; i < pmm_max_blocks; i++) {
+        pmm_used_blocks += _pmm_mat_tesblock(i);
+    }
 }
 
 // pmm_alloc_blocks allocates blocks
 // will return 0x0 if unsuccesfully
 void* pmm_alloc_blocks(uint32_t t_size)
 {
-    uint32_t block_id = _pmm_first_free_block_n(t_size);
-    if (block_id == 0) {
+    if (!t_size) {
         return 0x0;
     }
-    for (uint32_t i = 0; i < t_size; i++) {
-        _pmm_mat_alloc_block(block_id + i);
-        pmm_used_blocks++;
+
+    uint32_t order = _pmm_buddy_order_of(t_size);
+    lock_acquire(&_pmm_lock);
+    uint32_t block_id = _pmm_buddy_alloc(order);
+    if (block_id == 0) {
+        lock_release(&_pmm_lock);
+        return 0x0;
     }
-    return (void*)(block_id * PMM_BLOCK_SIZE);
+    // Giving the tail of the chunk back, so only @t_size blocks are taken.
+    _pmm_buddy_set_range(block_id + t_size, (1U << order) - t_size, false);
+    pmm_used_blocks += t_size;
+    lock_release(&_pmm_lock);
+    return (void*)((_pmm_buddy_base + block_id) * PMM_BLOCK_SIZE);
 }
 
+// pmm_alloc_blocks_aligned allocates blocks, the first one is aligned to @al blocks
+// will return 0x0 if unsuccesfully
 void* pmm_alloc_blocks_aligned(uint32_t t_size, uint32_t al)
 {
-    uint32_t block_id = _pmm_first_free_block_n_aligned(t_size, al);
-    if (block_id == 0) {
+    if (!t_size) {
         return 0x0;
     }
-    for (uint32_t i = 0; i < t_size; i++) {
-        _pmm_mat_alloc_block(block_id + i);
-        pmm_used_blocks++;
+
+    // Buddy chunks are aligned to their size, so it's enough to take a big enough chunk.
+    uint32_t order = _pmm_buddy_order_of(t_size);
+    uint32_t al_order = _pmm_buddy_order_of(al);
+    if (al_order > order) {
+        order = al_order;
     }
-    return (void*)(block_id * PMM_BLOCK_SIZE);
+
+    lock_acquire(&_pmm_lock);
+    uint32_t block_id = _pmm_buddy_alloc(order);
+    if (block_id == 0) {
+        lock_release(&_pmm_lock);
+        return 0x0;
+    }
+    _pmm_buddy_set_range(block_id + t_size, (1U << order) - t_size, false);
+    pmm_used_blocks += t_size;
+    lock_release(&_pmm_lock);
+    return (void*)((_pmm_buddy_base + block_id) * PMM_BLOCK_SIZE);
 }
 
 // pmm_free_blocks frees the blocks
@@ -258,10 +450,15 @@ bool pmm_free_blocks(void* block, uint32_t t_size)
         return false;
     }
     uint32_t block_id = (uint32_t)block / PMM_BLOCK_SIZE;
-    for (uint32_t i = 0; i < t_size; i++) {
-        _pmm_mat_free_block(block_id + i);
-        pmm_used_blocks--;
+    if (block_id < _pmm_buddy_base || block_id + t_size > pmm_max_blocks) {
+        return false;
     }
+    block_id -= _pmm_buddy_base;
+
+    lock_acquire(&_pmm_lock);
+    _pmm_buddy_set_range(block_id, t_size, false);
+    pmm_used_blocks -= t_size;
+    lock_release(&_pmm_lock);
     return true;
 }
 
@@ -269,26 +466,18 @@ bool pmm_free_blocks(void* block, uint32_t t_size)
 // will return 0x0 if unsuccesfully
 void* pmm_alloc_block()
 {
-    uint32_t block_id = _pmm_first_free_block();
-    if (block_id == 0) {
-        return 0x0;
-    }
-    _pmm_mat_alloc_block(block_id);
-    pmm_used_blocks++;
-    return (void*)(block_id * PMM_BLOCK_SIZE);
+    return pmm_alloc_blocks(1);
 }
 
 // pmm_alloc allocates space of @size bytes
 void* pmm_alloc(uint32_t act_size)
 {
-    // log("MAT LOC %x", pmm_mat);
     uint32_t n = (act_size + PMM_BLOCK_SIZE - 1) / PMM_BLOCK_SIZE;
     return pmm_alloc_blocks(n);
 }
 
 void* pmm_alloc_aligned(uint32_t act_size, uint32_t alignment)
 {
-    // log("MAT LOC %x", pmm_mat);
     uint32_t n = (act_size + PMM_BLOCK_SIZE - 1) / PMM_BLOCK_SIZE;
     uint32_t al = (alignment + PMM_BLOCK_SIZE - 1) / PMM_BLOCK_SIZE;
     return pmm_alloc_blocks_aligned(n, al);
@@ -305,12 +494,73 @@ bool pmm_free(void* block, uint32_t act_size)
 // will return false if unsuccesfully
 bool pmm_free_block(void* block)
 {
-    if (((uint32_t)block & (PMM_BLOCK_SIZE - 1)) != 0) {
+    return pmm_free_blocks(block, 1);
+}
+
+/**
+ * FRAME CACHE FUNCTIONS
+ */
+
+// _pmm_frame_cache_refill takes a batch of frames from the buddy allocator
+static void _pmm_frame_cache_refill(pmm_frame_cache_t* cache)
+{
+    lock_acquire(&_pmm_lock);
+    while (cache->count < PMM_FRAME_CACHE_BATCH) {
+        uint32_t block_id = _pmm_buddy_alloc(_pmm_frame_order);
+        if (block_id == 0) {
+            break;
+        }
+        pmm_used_blocks += PMM_BLOCKS_PER_FRAME;
+        cache->frames[cache->count++] = (_pmm_buddy_base + block_id) * PMM_BLOCK_SIZE;
+    }
+    lock_release(&_pmm_lock);
+}
+
+// _pmm_frame_cache_drain gives a batch of frames back to the buddy allocator
+static void _pmm_frame_cache_drain(pmm_frame_cache_t* cache)
+{
+    lock_acquire(&_pmm_lock);
+    while (cache->count > PMM_FRAME_CACHE_BATCH) {
+        uint32_t block_id = cache->frames[--cache->count] / PMM_BLOCK_SIZE - _pmm_buddy_base;
+        _pmm_buddy_set_node(block_id, _pmm_frame_order, false);
+        pmm_used_blocks -= PMM_BLOCKS_PER_FRAME;
+    }
+    lock_release(&_pmm_lock);
+}
+
+// pmm_alloc_frame allocates a frame of VMM_PAGE_SIZE from the cache of the cpu
+// will return 0x0 if unsuccesfully
+void* pmm_alloc_frame()
+{
+    void* res = 0x0;
+    system_disable_interrupts();
+    pmm_frame_cache_t* cache = &THIS_CPU->frame_cache;
+    if (!cache->count) {
+        _pmm_frame_cache_refill(cache);
+    }
+    if (cache->count) {
+        res = (void*)cache->frames[--cache->count];
+    }
+    system_enable_interrupts();
+    return res;
+}
+
+// pmm_free_frame puts the frame back to the cache of the cpu
+// will return true if succesfully
+// will return false if unsuccesfully
+bool pmm_free_frame(void* frame)
+{
+    if (((uint32_t)frame & (VMM_PAGE_SIZE - 1)) != 0) {
         return false;
     }
-    uint32_t block_id = (uint32_t)block / PMM_BLOCK_SIZE;
-    _pmm_mat_free_block(block_id);
-    pmm_used_blocks--;
+
+    system_disable_interrupts();
+    pmm_frame_cache_t* cache = &THIS_CPU->frame_cache;
+    if (cache->count == PMM_FRAME_CACHE_SIZE) {
+        _pmm_frame_cache_drain(cache);
+    }
+    cache->frames[cache->count++] = (uint32_t)frame;
+    system_enable_interrupts();
     return true;
 }
 
@@ -334,7 +584,7 @@ uint32_t pmm_get_free_blocks()
     return pmm_max_blocks - pmm_used_blocks;
 }
 
-uint32_t pmm_geblock_size()
+uint32_t pmm_get_block_size()
 {
     return PMM_BLOCK_SIZE;
 }
\ No newline at end of file
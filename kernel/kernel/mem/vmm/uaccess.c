@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <mem/vmm/uaccess.h>
+#include <mem/vmm/vmm.h>
+
+/* Defined by the linker script. */
+extern const uaccess_fixup_entry_t __uaccess_fixup_start[];
+extern const uaccess_fixup_entry_t __uaccess_fixup_end[];
+
+uint32_t copy_to_user(void* udest, const void* src, uint32_t len)
+{
+    if (!uaccess_range_ok((uint32_t)udest, len)) {
+        return len;
+    }
+
+    if (vmm_prepare_active_pdir_for_user_write((uint32_t)udest, len)) {
+        return len;
+    }
+    return uaccess_copy_raw(udest, src, len);
+}
+
+uint32_t copy_from_user(void* dest, const void* usrc, uint32_t len)
+{
+    if (!uaccess_range_ok((uint32_t)usrc, len)) {
+        return len;
+    }
+    return uaccess_copy_raw(dest, usrc, len);
+}
+
+/**
+ * Called for a kernel fault which the vmm could not serve. The table holds
+ * a handful of entries, so it's scanned.
+ */
+bool uaccess_fixup(trapframe_t* tf)
+{
+    uint32_t ip = get_instruction_pointer(tf);
+    for (const uaccess_fixup_entry_t* it = __uaccess_fixup_start; it != __uaccess_fixup_end; it++) {
+        if (it->insn == ip) {
+            set_instruction_pointer(tf, it->fixup);
+            return true;
+        }
+    }
+    return false;
+}
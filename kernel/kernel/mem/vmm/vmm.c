@@ -8,6 +8,8 @@
 #include <libkern/libkern.h>
 #include <libkern/lock.h>
 #include <libkern/log.h>
+#include <libkern/lz4.h>
+#include <libkern/trace.h>
 #include <mem/kmalloc.h>
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
@@ -15,10 +17,23 @@
 #include <platform/generic/system.h>
 #include <platform/generic/vmm/mapping_table.h>
 #include <platform/generic/vmm/pf_types.h>
+#include <tasking/proc.h>
 #include <tasking/tasking.h>
 
 // #define VMM_DEBUG
 
+#define VMM_TLB_BATCH_SIZE (32)
+#define VMM_FILE_READ_AHEAD_PAGES (8)
+#define VMM_FILE_CACHE_SIZE (256)
+#define VMM_SHARED_PAGES_BUCKETS (256)
+#define VMM_SPACE_LOCKS (32)
+#define VMM_SWAP_POOL_PAGES (1024)
+#define VMM_SWAP_CHUNK_SIZE (256)
+#define VMM_SWAP_CHUNKS_PER_PAGE (VMM_PAGE_SIZE / VMM_SWAP_CHUNK_SIZE)
+#define VMM_SWAP_MAX_CHUNKS (12) /* Pages which don't compress below 3/4 stay in memory. */
+#define VMM_SWAP_SLOTS (4 * VMM_SWAP_POOL_PAGES)
+#define VMM_RECLAIM_BATCH (32)
+
 #define pdir_t pdirectory_t
 #define VMM_TOTAL_PAGES_PER_TABLE VMM_PTE_COUNT
 #define VMM_TOTAL_TABLES_PER_DIRECTORY VMM_PDE_COUNT
@@ -28,11 +43,106 @@
 
 static pdir_t* _vmm_kernel_pdir;
 static lock_t _vmm_lock;
+static lock_t _vmm_space_locks[VMM_SPACE_LOCKS];
 static zone_t pspace_zone;
 static uint32_t kernel_ptables_start_paddr = 0x0;
+static uint32_t _vmm_zero_page_paddr = 0x0;
+static uint16_t* _vmm_frame_refs = NULL;
+static uint32_t _vmm_frame_refs_count = 0;
+
+#define VMM_ASID_SLOTS (256)
+
+struct vmm_asid_slot {
+    pdirectory_t* pdir;
+    uint32_t asid; /* The generation in the high bits, the id in the low ones. */
+};
+typedef struct vmm_asid_slot vmm_asid_slot_t;
+static vmm_asid_slot_t _vmm_asid_slots[VMM_ASID_SLOTS];
+static uint32_t _vmm_asid_generation = 0;
+static uint32_t _vmm_asid_next = 0;
+static uint32_t _vmm_cpu_asid_generation[CPU_CNT];
+static lock_t _vmm_asid_lock;
+
+struct vmm_file_page {
+    uint32_t dev_indx;
+    uint32_t inode_indx; /* 0 marks a free entry. */
+    uint32_t offset;
+    uint32_t paddr;
+};
+typedef struct vmm_file_page vmm_file_page_t;
+static vmm_file_page_t _vmm_file_cache[VMM_FILE_CACHE_SIZE];
+static uint32_t _vmm_file_cache_used = 0;
+
+struct vmm_shared_page {
+    struct vmm_shared_page* next;
+    uint32_t dev_indx;
+    uint32_t inode_indx;
+    uint32_t offset;
+    uint32_t paddr;
+    bool dirty;
+};
+typedef struct vmm_shared_page vmm_shared_page_t;
+static vmm_shared_page_t* _vmm_shared_pages[VMM_SHARED_PAGES_BUCKETS];
+
+struct vmm_swap_slot {
+    uint16_t pool_page;
+    uint8_t chunk;
+    uint8_t chunks;
+    uint16_t len;
+    uint16_t refs; /* Descriptors which keep the slot, 0 marks a free slot. */
+};
+typedef struct vmm_swap_slot vmm_swap_slot_t;
+static lock_t _vmm_swap_lock;
+static vmm_swap_slot_t _vmm_swap_slots[VMM_SWAP_SLOTS + 1]; /* Slot 0 is never used. */
+static uint32_t _vmm_swap_next_slot = 1;
+static uint32_t _vmm_swap_pool_frames[VMM_SWAP_POOL_PAGES]; /* 0 if the page isn't backed. */
+static uint16_t _vmm_swap_pool_used[VMM_SWAP_POOL_PAGES]; /* A bit per chunk. */
+static uint32_t _vmm_swap_pool_limit = 0;
+static zone_t _vmm_swap_pool_zone;
+static zone_t _vmm_swap_window;
+static lz4_ctx_t _vmm_swap_lz4;
+static uint8_t _vmm_swap_buf[VMM_SWAP_MAX_CHUNKS * VMM_SWAP_CHUNK_SIZE];
+static vmm_swap_stat_t _vmm_swap_stat;
+static int _vmm_reclaiming = 0;
+static uint32_t _vmm_reclaim_hand_proc = 0;
+static uint32_t _vmm_reclaim_hand_vaddr = 0;
 
 #define vmm_kernel_pdir_phys2virt(paddr) ((void*)((uint32_t)paddr + KERNEL_BASE - KERNEL_PM_BASE))
 
+/**
+ * LOCKS
+ *
+ * The user half of an address space is guarded by a space lock, picked by
+ * its pdir from a small array, so processes fault and map in parallel.
+ * _vmm_lock guards the kernel half, the caches of file pages and pdirs
+ * which are created or freed. A space lock is always taken first.
+ */
+
+static ALWAYS_INLINE lock_t* _vmm_space_lock(pdirectory_t* pdir)
+{
+    return &_vmm_space_locks[((uint32_t)pdir / PDIR_SIZE) % VMM_SPACE_LOCKS];
+}
+
+static ALWAYS_INLINE lock_t* _vmm_lock_for(uint32_t vaddr)
+{
+    if (PAGE_CHOOSE_OWNER(vaddr) == PAGE_USER && THIS_CPU->pdir && THIS_CPU->pdir != _vmm_kernel_pdir) {
+        return _vmm_space_lock(THIS_CPU->pdir);
+    }
+    return &_vmm_lock;
+}
+
+static ALWAYS_INLINE void _vmm_lock_space_and_caches(lock_t* space)
+{
+    lock_acquire(space);
+    lock_acquire(&_vmm_lock);
+}
+
+static ALWAYS_INLINE void _vmm_unlock_space_and_caches(lock_t* space)
+{
+    lock_release(&_vmm_lock);
+    lock_release(space);
+}
+
 /**
  * PRIVATE FUNCTIONS
  */
@@ -60,14 +170,62 @@ inline static uint32_t _vmm_round_floor_to_page(uint32_t value);
 inline static table_desc_t* _vmm_pdirectory_lookup(pdirectory_t* t_pdir, uint32_t t_addr);
 inline static page_desc_t* _vmm_ptable_lookup(ptable_t* t_ptable, uint32_t t_addr);
 
+struct vmm_tlb_batch {
+    pdirectory_t* pdir;
+    uint32_t count;
+    uint32_t vaddrs[VMM_TLB_BATCH_SIZE];
+};
+typedef struct vmm_tlb_batch vmm_tlb_batch_t;
+
+static bool _vmm_is_pdir_active_on_other_cpus(pdirectory_t* pdir);
+static bool _vmm_is_global_vaddr(uint32_t vaddr);
+static void _vmm_asid_release(pdirectory_t* pdir);
+static void _vmm_flush_tlb_entry(uint32_t vaddr);
+static inline void _vmm_tlb_batch_init(vmm_tlb_batch_t* batch, pdirectory_t* pdir);
+static inline void _vmm_tlb_batch_add(vmm_tlb_batch_t* batch, uint32_t vaddr);
+static void _vmm_tlb_batch_add_table(vmm_tlb_batch_t* batch, uint32_t table_index);
+static void _vmm_tlb_batch_flush(vmm_tlb_batch_t* batch);
+
+static bool _vmm_is_large_page(uint32_t vaddr);
+static bool _vmm_can_map_large_page(uint32_t vaddr, uint32_t paddr, uint32_t n_pages);
+static int _vmm_map_large_page_lockless(uint32_t vaddr, uint32_t paddr, uint32_t settings);
+static int _vmm_split_large_page_lockless(uint32_t vaddr);
+
+static void _vmm_frame_refs_init();
+static inline bool _vmm_frame_is_shared(uint32_t paddr);
+static inline void _vmm_frame_share(uint32_t paddr);
+static inline bool _vmm_frame_unshare(uint32_t paddr);
+
+static uint32_t _vmm_table_group_frame(table_desc_t* start_ptable_desc);
+static bool _vmm_is_table_copy_on_write(uint32_t vaddr);
+static int _vmm_resolve_table_copy_on_write(uint32_t vaddr);
 static bool _vmm_is_copy_on_write(uint32_t vaddr);
 static int _vmm_resolve_copy_on_write(proc_t* p, uint32_t vaddr);
 static void _vmm_ensure_cow_for_page(uint32_t vaddr);
 static void _vmm_ensure_cow_for_range(uint32_t vaddr, uint32_t length);
-static int _vmm_copy_page_to_resolve_cow(proc_t* p, uint32_t vaddr, ptable_t* src_ptable, int page_index);
 
+static void _vmm_zero_page_init();
+static inline bool _vmm_is_accessible_zone(proc_zone_t* zone);
+static bool _vmm_is_zero_fillable_zone(proc_zone_t* zone);
+static bool _vmm_try_map_zero_page(uint32_t vaddr);
 static bool _vmm_is_zeroing_on_demand(uint32_t vaddr);
-static void _vmm_resolve_zeroing_on_demand(uint32_t vaddr);
+static int _vmm_resolve_zeroing_on_demand(proc_t* p, uint32_t vaddr);
+static void _vmm_ensure_zeroing_on_demand_for_page(uint32_t vaddr);
+
+static bool _vmm_is_file_page_cacheable(proc_zone_t* zone, uint32_t vaddr);
+static uint32_t _vmm_file_cache_find_lockless(proc_zone_t* zone, uint32_t vaddr);
+static void _vmm_file_cache_insert_lockless(proc_zone_t* zone, uint32_t vaddr, uint32_t paddr);
+static void _vmm_file_cache_drop_lockless(vmm_file_page_t* page);
+static int _vmm_load_file_pages(proc_t* p, uint32_t vaddr);
+static void _vmm_mark_shared_page_dirty_lockless(proc_zone_t* zone, uint32_t vaddr);
+static int _vmm_load_shared_file_page(proc_t* p, uint32_t vaddr, bool write);
+
+static void _vmm_swap_init();
+static void _vmm_swap_dup(uint32_t slot);
+static void _vmm_swap_put(uint32_t slot);
+static bool _vmm_is_swapped(uint32_t vaddr);
+static int _vmm_try_swap_in(uint32_t vaddr);
+static uint32_t _vmm_reclaim(uint32_t target);
 
 static int _vmm_self_test();
 
@@ -121,22 +279,26 @@ inline static uint32_t _vmm_alloc_ptable_paddr()
 
 inline static uint32_t _vmm_alloc_ptables_to_cover_page()
 {
-    return (uint32_t)pmm_alloc_aligned(VMM_PAGE_SIZE, VMM_PAGE_SIZE);
+    return (uint32_t)pmm_alloc_frame();
 }
 
 inline static void _vmm_free_ptables_to_cover_page(uint32_t addr)
 {
-    pmm_free((void*)addr, VMM_PAGE_SIZE);
+    pmm_free_frame((void*)addr);
 }
 
 inline static uint32_t _vmm_alloc_page_paddr()
 {
-    return (uint32_t)pmm_alloc_aligned(VMM_PAGE_SIZE, VMM_PAGE_SIZE);
+    uint32_t paddr = (uint32_t)pmm_alloc_frame();
+    if (!paddr && _vmm_reclaim(VMM_RECLAIM_BATCH)) {
+        paddr = (uint32_t)pmm_alloc_frame();
+    }
+    return paddr;
 }
 
 inline static void _vmm_free_page_paddr(uint32_t addr)
 {
-    pmm_free((void*)addr, VMM_PAGE_SIZE);
+    pmm_free_frame((void*)addr);
 }
 
 static zone_t _vmm_alloc_mapped_zone(uint32_t size, uint32_t alignment)
@@ -157,9 +319,7 @@ static zone_t _vmm_alloc_mapped_zone(uint32_t size, uint32_t alignment)
 
 static int _vmm_free_mapped_zone(zone_t zone)
 {
-    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(zone.start);
-    page_desc_t* page = _vmm_ptable_lookup(ptable, zone.start);
-    pmm_free((void*)page_desc_get_frame(*page), zone.len);
+    pmm_free(_vmm_convert_vaddr2paddr(zone.start), zone.len);
     vmm_unmap_pages_lockless(zone.start, zone.len / VMM_PAGE_SIZE);
     zoner_free_zone(zone);
     return 0;
@@ -298,7 +458,7 @@ static void _vmm_free_pspace(pdirectory_t* pdir)
     if (!table_desc_has_attrs(*ptable_desc, TABLE_DESC_PRESENT)) {
         return;
     }
-    pmm_free_block((void*)table_desc_get_frame(*ptable_desc));
+    _vmm_free_ptables_to_cover_page(table_desc_get_frame(*ptable_desc));
     table_desc_del_frame(ptable_desc);
 }
 
@@ -308,6 +468,11 @@ static void _vmm_free_pspace(pdirectory_t* pdir)
  */
 static void* _vmm_kernel_convert_vaddr2paddr(uint32_t vaddr)
 {
+    table_desc_t* ptable_desc = _vmm_pdirectory_lookup(_vmm_kernel_pdir, vaddr);
+    if (table_desc_is_4mb(*ptable_desc)) {
+        return (void*)(table_desc_get_frame(*ptable_desc) | (vaddr & (VMM_LARGE_PAGE_SIZE - 1)));
+    }
+
     ptable_t* ptable_paddr = (ptable_t*)(kernel_ptables_start_paddr + (VMM_OFFSET_IN_DIRECTORY(vaddr) - VMM_KERNEL_TABLES_START) * PTABLE_SIZE);
     page_desc_t* page_desc = _vmm_ptable_lookup(ptable_paddr, vaddr);
     return (void*)((page_desc_get_frame(*page_desc)) | (vaddr & 0xfff));
@@ -318,6 +483,11 @@ static void* _vmm_kernel_convert_vaddr2paddr(uint32_t vaddr)
  */
 static void* _vmm_convert_vaddr2paddr(uint32_t vaddr)
 {
+    if (_vmm_is_large_page(vaddr)) {
+        table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
+        return (void*)(table_desc_get_frame(*ptable_desc) | (vaddr & (VMM_LARGE_PAGE_SIZE - 1)));
+    }
+
     ptable_t* ptable_vaddr = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
     page_desc_t* page_desc = _vmm_ptable_lookup(ptable_vaddr, vaddr);
     return (void*)((page_desc_get_frame(*page_desc)) | (vaddr & 0xfff));
@@ -342,6 +512,16 @@ static bool _vmm_init_switch_to_kernel_pdir()
  */
 static void _vmm_map_init_kernel_pages(uint32_t paddr, uint32_t vaddr)
 {
+    // The whole table is mapped, so a large page is used when addresses allow it.
+    // The kernel table stays allocated, it is restored if the large page is split.
+    if (((paddr | vaddr) & (VMM_LARGE_PAGE_SIZE - 1)) == 0) {
+        table_desc_t* ptable_desc = _vmm_pdirectory_lookup(_vmm_kernel_pdir, vaddr);
+        table_desc_init(ptable_desc);
+        table_desc_set_attrs(ptable_desc, TABLE_DESC_PRESENT | TABLE_DESC_4MB | TABLE_DESC_WRITABLE);
+        table_desc_set_frame(ptable_desc, paddr);
+        return;
+    }
+
     ptable_t* ptable_paddr = (ptable_t*)(kernel_ptables_start_paddr + (VMM_OFFSET_IN_DIRECTORY(vaddr) - VMM_KERNEL_TABLES_START) * PTABLE_SIZE);
     for (uint32_t phyz = paddr, virt = vaddr, i = 0; i < VMM_TOTAL_PAGES_PER_TABLE; phyz += VMM_PAGE_SIZE, virt += VMM_PAGE_SIZE, i++) {
         page_desc_t new_page;
@@ -352,6 +532,23 @@ static void _vmm_map_init_kernel_pages(uint32_t paddr, uint32_t vaddr)
     }
 }
 
+static void _vmm_kernel_table_desc_init(table_desc_t* ptable_desc, uint32_t index, uint32_t paddr)
+{
+    table_desc_init(ptable_desc);
+    table_desc_set_attrs(ptable_desc, TABLE_DESC_PRESENT | TABLE_DESC_WRITABLE);
+
+    /**
+     * VMM_OFFSET_IN_DIRECTORY(pspace_zone.start) shows number of table where pspace starts. 
+     * Since pspace is right after kernel, let's protect them and not give user access to the whole
+     * ptable (and since ptable is not user, all pages inside it are not user too).
+     */
+    if (index > VMM_OFFSET_IN_DIRECTORY(pspace_zone.start)) {
+        table_desc_set_attrs(ptable_desc, TABLE_DESC_USER);
+    }
+
+    table_desc_set_frame(ptable_desc, paddr);
+}
+
 /**
  * The function is supposed to create all kernel tables and map necessary
  * data into _vmm_kernel_pdir.
@@ -373,19 +570,7 @@ static bool _vmm_create_kernel_ptables()
         if (!kernel_ptables_start_paddr) {
             kernel_ptables_start_paddr = paddr;
         }
-        table_desc_init(ptable_desc);
-        table_desc_set_attrs(ptable_desc, TABLE_DESC_PRESENT | TABLE_DESC_WRITABLE);
-
-        /**
-         * VMM_OFFSET_IN_DIRECTORY(pspace_zone.start) shows number of table where pspace starts. 
-         * Since pspace is right after kernel, let's protect them and not give user access to the whole
-         * ptable (and since ptable is not user, all pages inside it are not user too).
-         */
-        if (i > VMM_OFFSET_IN_DIRECTORY(pspace_zone.start)) {
-            table_desc_set_attrs(ptable_desc, TABLE_DESC_USER);
-        }
-
-        table_desc_set_frame(ptable_desc, paddr);
+        _vmm_kernel_table_desc_init(ptable_desc, i, paddr);
     }
 
     int te = 0;
@@ -415,6 +600,15 @@ static bool _vmm_map_kernel()
 int vmm_setup()
 {
     lock_init(&_vmm_lock);
+    lock_stat_register(&_vmm_lock, "vmm");
+    for (int i = 0; i < VMM_SPACE_LOCKS; i++) {
+        lock_init(&_vmm_space_locks[i]);
+    }
+    lock_init(&_vmm_asid_lock);
+    _vmm_asid_generation = system_tlb_asid_count();
+    _vmm_asid_next = 1;
+    system_enable_large_pages();
+    system_enable_global_pages();
     zoner_init(0xc0400000);
     _vmm_split_pspace();
     _vmm_create_kernel_ptables();
@@ -423,11 +617,16 @@ int vmm_setup()
     _vmm_map_kernel();
     zoner_place_bitmap();
     kmalloc_init();
+    _vmm_frame_refs_init();
+    _vmm_zero_page_init();
+    _vmm_swap_init();
     return 0;
 }
 
 int vmm_setup_secondary_cpu()
 {
+    system_enable_large_pages();
+    system_enable_global_pages();
     _vmm_init_switch_to_kernel_pdir();
     return 0;
 }
@@ -474,6 +673,301 @@ static inline void _vmm_table_desc_init_from_allocated_state(table_desc_t* ptabl
     table_desc_set_frame(ptable_desc, frame);
 }
 
+static inline void _vmm_page_desc_init_with_settings(page_desc_t* page, uint32_t paddr, uint32_t settings)
+{
+    bool is_writable = ((settings & PAGE_WRITABLE) > 0);
+    bool is_readable = ((settings & PAGE_READABLE) > 0);
+    bool is_executable = ((settings & PAGE_EXECUTABLE) > 0);
+    bool is_not_cacheable = ((settings & PAGE_NOT_CACHEABLE) > 0);
+    bool is_write_combining = ((settings & PAGE_WRITE_COMBINING) > 0);
+    bool is_cow = ((settings & PAGE_COW) > 0);
+    bool is_user = ((settings & PAGE_USER) > 0);
+
+    page_desc_init(page);
+    page_desc_set_attrs(page, PAGE_DESC_PRESENT);
+    page_desc_set_frame(page, paddr);
+
+    if (is_writable) {
+        page_desc_set_attrs(page, PAGE_DESC_WRITABLE);
+    }
+
+    if (is_user) {
+        page_desc_set_attrs(page, PAGE_DESC_USER);
+    }
+
+    if (is_not_cacheable) {
+        page_desc_set_attrs(page, PAGE_DESC_NOT_CACHEABLE);
+    } else if (is_write_combining) {
+        page_desc_set_attrs(page, PAGE_DESC_WRITE_COMBINING);
+    }
+}
+
+/**
+ * TLB FUNCTIONS
+ *
+ * Invalidations are collected into a batch and issued at once. Up to
+ * VMM_TLB_BATCH_SIZE entries are invalidated one by one, a bigger batch
+ * is cheaper to handle with a flush of the whole TLB. Other cpus are
+ * involved only when the pdir is active on them, or always on a tagged
+ * TLB: entries of a pdir stay there after a cpu switched away from it.
+ */
+
+static bool _vmm_is_pdir_active_on_other_cpus(pdirectory_t* pdir)
+{
+    int this_cpu_id = system_cpu_id();
+    for (int i = 0; i < CPU_CNT; i++) {
+        if (i != this_cpu_id && cpus[i].pdir == pdir) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool _vmm_may_be_cached_on_other_cpus(pdirectory_t* pdir)
+{
+    return system_tlb_asid_count() || _vmm_is_pdir_active_on_other_cpus(pdir);
+}
+
+static void _vmm_flush_tlb_entry(uint32_t vaddr)
+{
+    // Kernel tables are shared by all pdirs, so the entry could be cached by any cpu.
+    if (PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER || _vmm_may_be_cached_on_other_cpus(THIS_CPU->pdir)) {
+        system_flush_tlb_entry_all_cpus(vaddr);
+    } else {
+        system_flush_tlb_entry(vaddr);
+    }
+}
+
+static inline void _vmm_tlb_batch_init(vmm_tlb_batch_t* batch, pdirectory_t* pdir)
+{
+    batch->pdir = pdir;
+    batch->count = 0;
+}
+
+// _vmm_tlb_batch_add keeps counting after the batch is full, so an overflow turns into a whole flush.
+static inline void _vmm_tlb_batch_add(vmm_tlb_batch_t* batch, uint32_t vaddr)
+{
+    if (batch->count < VMM_TLB_BATCH_SIZE) {
+        batch->vaddrs[batch->count] = vaddr;
+    }
+    batch->count++;
+}
+
+/**
+ * Adds all present pages of the active table @table_index. Pages which
+ * are not present could not be cached, so they are skipped.
+ */
+static void _vmm_tlb_batch_add_table(vmm_tlb_batch_t* batch, uint32_t table_index)
+{
+    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_nth_active_ptable(table_index);
+    for (int i = 0; i < VMM_TOTAL_PAGES_PER_TABLE && batch->count <= VMM_TLB_BATCH_SIZE; i++) {
+        if (page_desc_is_present(ptable->entities[i])) {
+            _vmm_tlb_batch_add(batch, table_index * table_coverage + i * VMM_PAGE_SIZE);
+        }
+    }
+}
+
+static void _vmm_tlb_batch_flush(vmm_tlb_batch_t* batch)
+{
+    if (!batch->count) {
+        return;
+    }
+
+    bool all_cpus = _vmm_may_be_cached_on_other_cpus(batch->pdir);
+    if (batch->count > VMM_TLB_BATCH_SIZE) {
+        all_cpus ? system_flush_whole_tlb_all_cpus() : system_flush_whole_tlb();
+    } else {
+        for (int i = 0; i < batch->count; i++) {
+            all_cpus ? system_flush_tlb_entry_all_cpus(batch->vaddrs[i]) : system_flush_tlb_entry(batch->vaddrs[i]);
+        }
+    }
+    batch->count = 0;
+}
+
+/**
+ * LARGE PAGE FUNCTIONS
+ *
+ * A large page replaces a whole table with a single descriptor, so it
+ * takes one TLB entry instead of VMM_TOTAL_PAGES_PER_TABLE ones. Kernel
+ * tables are preallocated and shared by all pdirs: a kernel large page
+ * keeps its table, which is restored when the large page is split. User
+ * tables are allocated by groups which cover a page, so a user large page
+ * takes the whole group and the group is split as a whole.
+ */
+
+static bool _vmm_is_large_page(uint32_t vaddr)
+{
+    table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
+    return table_desc_is_present(*ptable_desc) && table_desc_is_4mb(*ptable_desc);
+}
+
+static inline uint32_t _vmm_large_page_attrs(uint32_t settings)
+{
+    uint32_t attrs = TABLE_DESC_PRESENT | TABLE_DESC_4MB;
+    if (settings & PAGE_WRITABLE) {
+        attrs |= TABLE_DESC_WRITABLE;
+    }
+    if (settings & PAGE_USER) {
+        attrs |= TABLE_DESC_USER;
+    }
+    if (settings & PAGE_NOT_CACHEABLE) {
+        attrs |= TABLE_DESC_PCD;
+    } else if (settings & PAGE_WRITE_COMBINING) {
+        attrs |= TABLE_DESC_WRITE_COMBINING;
+    }
+    return attrs;
+}
+
+static inline uint32_t _vmm_large_page_settings(table_desc_t ptable_desc)
+{
+    uint32_t settings = PAGE_READABLE | PAGE_EXECUTABLE;
+    if (table_desc_has_attrs(ptable_desc, TABLE_DESC_WRITABLE)) {
+        settings |= PAGE_WRITABLE;
+    }
+    if (table_desc_has_attrs(ptable_desc, TABLE_DESC_USER)) {
+        settings |= PAGE_USER;
+    }
+    if (table_desc_has_attrs(ptable_desc, TABLE_DESC_PCD)) {
+        settings |= PAGE_NOT_CACHEABLE;
+    } else if (table_desc_has_attrs(ptable_desc, TABLE_DESC_WRITE_COMBINING)) {
+        settings |= PAGE_WRITE_COMBINING;
+    }
+    return settings;
+}
+
+// _vmm_group_find_large_page returns true if a table of the group which serves @vaddr is a large page.
+static bool _vmm_group_find_large_page(uint32_t vaddr, uint32_t* large_page_vaddr)
+{
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
+    uint32_t ptable_serve_vaddr_start = (vaddr / (table_coverage * ptables_per_page)) * (table_coverage * ptables_per_page);
+    table_desc_t* start_ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, ptable_serve_vaddr_start);
+    for (int it = 0; it < ptables_per_page; it++) {
+        if (table_desc_is_present(start_ptable_desc[it]) && table_desc_is_4mb(start_ptable_desc[it])) {
+            *large_page_vaddr = ptable_serve_vaddr_start + it * table_coverage;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Large pages are used only for user space, where tables are individual
+ * per pdir. The group of tables should be free (or mapped with large
+ * pages already), so no mapped page is lost.
+ */
+static bool _vmm_can_map_large_page(uint32_t vaddr, uint32_t paddr, uint32_t n_pages)
+{
+    if (PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER) {
+        return false;
+    }
+
+    if (((vaddr | paddr) & (VMM_USER_LARGE_PAGE_SIZE - 1)) != 0 || n_pages < VMM_USER_LARGE_PAGE_SIZE / VMM_PAGE_SIZE) {
+        return false;
+    }
+
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    table_desc_t* start_ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
+    for (int it = 0; it < ptables_per_page; it++) {
+        if (table_desc_is_in_allocated_state(&start_ptable_desc[it])) {
+            return false;
+        }
+        if (table_desc_is_present(start_ptable_desc[it]) && !table_desc_is_4mb(start_ptable_desc[it])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int _vmm_map_large_page_lockless(uint32_t vaddr, uint32_t paddr, uint32_t settings)
+{
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
+    uint32_t attrs = _vmm_large_page_attrs(settings);
+    for (int it = 0; it < ptables_per_page; it++, vaddr += table_coverage, paddr += table_coverage) {
+        table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
+        table_desc_init(ptable_desc);
+        table_desc_set_attrs(ptable_desc, attrs);
+        table_desc_set_frame(ptable_desc, paddr);
+        _vmm_flush_tlb_entry(vaddr);
+    }
+    return 0;
+}
+
+static inline void _vmm_fill_ptable_from_large_page(ptable_t* ptable, table_desc_t large_page_desc)
+{
+    uint32_t paddr = table_desc_get_frame(large_page_desc);
+    uint32_t settings = _vmm_large_page_settings(large_page_desc);
+    for (int i = 0; i < VMM_TOTAL_PAGES_PER_TABLE; i++, paddr += VMM_PAGE_SIZE) {
+        _vmm_page_desc_init_with_settings(&ptable->entities[i], paddr, settings);
+    }
+}
+
+/**
+ * Kernel descriptors are copied into every pdir, so the restored
+ * descriptor is set in all of them.
+ */
+static int _vmm_split_kernel_large_page_lockless(uint32_t vaddr)
+{
+    uint32_t index = VMM_OFFSET_IN_DIRECTORY(vaddr);
+    table_desc_t large_page_desc = *_vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
+
+    // Kernel tables are always mapped to pspace, see _vmm_pspace_init.
+    _vmm_fill_ptable_from_large_page((ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr), large_page_desc);
+
+    table_desc_t ptable_desc;
+    _vmm_kernel_table_desc_init(&ptable_desc, index, kernel_ptables_start_paddr + (index - VMM_KERNEL_TABLES_START) * PTABLE_SIZE);
+    _vmm_kernel_pdir->entities[index] = ptable_desc;
+    for (int i = 0; i < MAX_PROCESS_COUNT; i++) {
+        if (proc[i].pdir) {
+            proc[i].pdir->entities[index] = ptable_desc;
+        }
+    }
+
+    _vmm_flush_tlb_entry(TABLE_START(vaddr));
+    return 0;
+}
+
+static int _vmm_split_large_page_lockless(uint32_t vaddr)
+{
+    if (PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER) {
+        return _vmm_split_kernel_large_page_lockless(vaddr);
+    }
+
+    table_desc_t orig_table_desc[VMM_PAGE_SIZE / PTABLE_SIZE];
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
+    uint32_t ptable_serve_vaddr_start = (vaddr / (table_coverage * ptables_per_page)) * (table_coverage * ptables_per_page);
+    table_desc_t* start_ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, ptable_serve_vaddr_start);
+
+    // Large pages are cleared, so the group is allocated as a free one.
+    for (int it = 0; it < ptables_per_page; it++) {
+        orig_table_desc[it] = start_ptable_desc[it];
+        if (table_desc_is_4mb(orig_table_desc[it])) {
+            table_desc_clear(&start_ptable_desc[it]);
+        }
+    }
+
+    int err = vmm_allocate_ptable_lockless(ptable_serve_vaddr_start);
+    if (err) {
+        for (int it = 0; it < ptables_per_page; it++) {
+            start_ptable_desc[it] = orig_table_desc[it];
+        }
+        return err;
+    }
+
+    uint32_t first_ptable_index = VMM_OFFSET_IN_DIRECTORY(ptable_serve_vaddr_start);
+    for (int it = 0; it < ptables_per_page; it++) {
+        if (table_desc_is_present(orig_table_desc[it]) && table_desc_is_4mb(orig_table_desc[it])) {
+            _vmm_table_desc_init_from_allocated_state(&start_ptable_desc[it]);
+            _vmm_fill_ptable_from_large_page((ptable_t*)_vmm_pspace_get_nth_active_ptable(first_ptable_index + it), orig_table_desc[it]);
+            _vmm_flush_tlb_entry(ptable_serve_vaddr_start + it * table_coverage);
+        }
+    }
+    return 0;
+}
+
 /**
  * The function creates new ptable (not kernel) and
  * rebuilds pspace to match to the new setup.
@@ -486,6 +980,15 @@ static int vmm_allocate_ptable_lockless(uint32_t vaddr)
         return -VMM_ERR_PDIR;
     }
 
+    // Tables of the group are allocated together, so large pages of the group are split first.
+    uint32_t large_page_vaddr = 0;
+    if (_vmm_group_find_large_page(vaddr, &large_page_vaddr)) {
+        int err = _vmm_split_large_page_lockless(large_page_vaddr);
+        if (err) {
+            return err;
+        }
+    }
+
     table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
     if (table_desc_is_in_allocated_state(ptable_desc)) {
         goto skip_allocation;
@@ -522,9 +1025,10 @@ skip_allocation:
 
 int vmm_allocate_ptable(uint32_t vaddr)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_allocate_ptable_lockless(vaddr);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -542,9 +1046,10 @@ static ALWAYS_INLINE int vmm_force_allocate_ptable_lockless(uint32_t vaddr)
 
 int vmm_force_allocate_ptable(uint32_t vaddr)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_force_allocate_ptable_lockless(vaddr);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -563,8 +1068,32 @@ static ALWAYS_INLINE int vmm_free_ptable_lockless(uint32_t vaddr, dynamic_array_
         return -EFAULT;
     }
 
-    if (table_desc_has_attrs(*ptable_desc, TABLE_DESC_COPY_ON_WRITE)) {
-        return -EFAULT;
+    // Frames of a large page are released the same way as frames of pages.
+    if (table_desc_is_4mb(*ptable_desc)) {
+        uint32_t frame = table_desc_get_frame(*ptable_desc);
+        uint32_t pages_vstart = TABLE_START(vaddr);
+        table_desc_clear(ptable_desc);
+        _vmm_flush_tlb_entry(pages_vstart);
+        for (uint32_t i = 0, pages_voffset = 0; i < VMM_TOTAL_PAGES_PER_TABLE; i++, pages_voffset += VMM_PAGE_SIZE) {
+            page_desc_t page;
+            _vmm_page_desc_init_with_settings(&page, frame + pages_voffset, PAGE_READABLE);
+            vmm_free_page_lockless(pages_vstart + pages_voffset, &page, zones);
+        }
+        return 0;
+    }
+
+    uint32_t ptable_vaddr_start = PAGE_START((uint32_t)_vmm_pspace_get_vaddr_of_active_ptable(vaddr));
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
+    uint32_t ptable_serve_vaddr_start = (vaddr / (table_coverage * ptables_per_page)) * (table_coverage * ptables_per_page);
+
+    // Shared tables are still used by other address spaces, so only our reference is dropped.
+    if (table_desc_is_copy_on_write(*ptable_desc) && _vmm_frame_unshare(PAGE_START(table_desc_get_frame(*ptable_desc)))) {
+        for (uint32_t i = 0, pvaddr = ptable_serve_vaddr_start; i < ptables_per_page; i++, pvaddr += table_coverage) {
+            table_desc_clear(_vmm_pdirectory_lookup(THIS_CPU->pdir, pvaddr));
+        }
+        vmm_unmap_page_lockless(ptable_vaddr_start);
+        return 0;
     }
 
     // Entering allocated state, since table is alloacted but not valid.
@@ -580,11 +1109,6 @@ static ALWAYS_INLINE int vmm_free_ptable_lockless(uint32_t vaddr, dynamic_array_
         vmm_free_page_lockless(pages_vstart + pages_voffset, page, zones);
     }
 
-    uint32_t ptable_vaddr_start = PAGE_START((uint32_t)_vmm_pspace_get_vaddr_of_active_ptable(vaddr));
-    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
-    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
-    uint32_t ptable_serve_vaddr_start = (vaddr / (table_coverage * ptables_per_page)) * (table_coverage * ptables_per_page);
-
     // Chechking if we can delete thw whole page of tables.
     for (uint32_t i = 0, pvaddr = ptable_serve_vaddr_start; i < ptables_per_page; i++, pvaddr += table_coverage) {
         table_desc_t* ptable_desc_c = _vmm_pdirectory_lookup(THIS_CPU->pdir, pvaddr);
@@ -609,9 +1133,10 @@ static ALWAYS_INLINE int vmm_free_ptable_lockless(uint32_t vaddr, dynamic_array_
 
 int vmm_free_ptable(uint32_t vaddr, dynamic_array_t* zones)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_free_ptable_lockless(vaddr, zones);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -626,63 +1151,72 @@ static bool _vmm_is_page_present(uint32_t vaddr)
         return false;
     }
 
+    if (table_desc_is_4mb(*ptable_desc)) {
+        return true;
+    }
+
     ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
     page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
     return page_desc_is_present(*page);
 }
 
+/**
+ * Doesn't take the lock and never faults, so the answer could be stale.
+ * Used to peek at memory from interrupts.
+ */
+bool vmm_is_page_present_lockless(uint32_t vaddr)
+{
+    if (!THIS_CPU->pdir) {
+        return false;
+    }
+    return _vmm_is_page_present(vaddr);
+}
+
 static ALWAYS_INLINE int vmm_map_page_lockless(uint32_t vaddr, uint32_t paddr, uint32_t settings)
 {
     if (!THIS_CPU->pdir) {
         return -VMM_ERR_PDIR;
     }
 
-    bool is_writable = ((settings & PAGE_WRITABLE) > 0);
-    bool is_readable = ((settings & PAGE_READABLE) > 0);
-    bool is_executable = ((settings & PAGE_EXECUTABLE) > 0);
-    bool is_not_cacheable = ((settings & PAGE_NOT_CACHEABLE) > 0);
-    bool is_cow = ((settings & PAGE_COW) > 0);
-    bool is_user = ((settings & PAGE_USER) > 0);
+    if (_vmm_is_large_page(vaddr)) {
+        _vmm_split_large_page_lockless(vaddr);
+    }
 
     table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
     if (!table_desc_is_present(*ptable_desc)) {
         vmm_allocate_ptable_lockless(vaddr);
     }
 
+    // If we are in COW, no write is allowed anyway.
+    if (table_desc_is_copy_on_write(*ptable_desc)) {
+        settings &= ~PAGE_WRITABLE;
+    }
+
     ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
     page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
-
-    page_desc_init(page);
-    page_desc_set_attrs(page, PAGE_DESC_PRESENT);
-    page_desc_set_frame(page, paddr);
-
-    // If we are in COW, no write is allowed anyway.
-    if (is_writable && !table_desc_is_copy_on_write(*ptable_desc)) {
-        page_desc_set_attrs(page, PAGE_DESC_WRITABLE);
-    }
-
-    if (is_user) {
-        page_desc_set_attrs(page, PAGE_DESC_USER);
-    }
-
-    if (is_not_cacheable) {
-        page_desc_set_attrs(page, PAGE_DESC_NOT_CACHEABLE);
+    if (page_desc_is_swapped(*page)) {
+        _vmm_swap_put(page_desc_get_swap_slot(*page));
+    }
+    _vmm_page_desc_init_with_settings(page, paddr, settings);
+    if (_vmm_is_global_vaddr(vaddr)) {
+        page_desc_set_attrs(page, PAGE_DESC_CPU_GLOBAL);
     }
 
 #ifdef VMM_DEBUG
     log("Page mapped %x in pdir: %x", vaddr, vmm_get_active_pdir());
 #endif
 
-    system_flush_tlb_entry(vaddr);
+    _vmm_flush_tlb_entry(vaddr);
 
     return 0;
 }
 
 int vmm_map_page(uint32_t vaddr, uint32_t paddr, uint32_t settings)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_map_page_lockless(vaddr, paddr, settings);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -697,21 +1231,29 @@ static ALWAYS_INLINE int vmm_unmap_page_lockless(uint32_t vaddr)
         return -VMM_ERR_PTABLE;
     }
 
+    if (table_desc_is_4mb(*ptable_desc)) {
+        _vmm_split_large_page_lockless(vaddr);
+    }
+
     ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
     page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    if (page_desc_is_swapped(*page)) {
+        _vmm_swap_put(page_desc_get_swap_slot(*page));
+    }
     page_desc_del_attrs(page, PAGE_DESC_PRESENT);
     page_desc_del_attrs(page, PAGE_DESC_WRITABLE);
     page_desc_del_frame(page);
-    system_flush_tlb_entry(vaddr);
+    _vmm_flush_tlb_entry(vaddr);
 
     return 0;
 }
 
 int vmm_unmap_page(uint32_t vaddr)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_unmap_page_lockless(vaddr);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -725,10 +1267,22 @@ static ALWAYS_INLINE int vmm_map_pages_lockless(uint32_t vaddr, uint32_t paddr,
     }
 
     int status = 0;
-    for (; n_pages; paddr += VMM_PAGE_SIZE, vaddr += VMM_PAGE_SIZE, n_pages--) {
-        if ((status = vmm_map_page_lockless(vaddr, paddr, settings) < 0)) {
+    while (n_pages) {
+        uint32_t mapped_pages = 1;
+        if (_vmm_can_map_large_page(vaddr, paddr, n_pages)) {
+            mapped_pages = VMM_USER_LARGE_PAGE_SIZE / VMM_PAGE_SIZE;
+            status = _vmm_map_large_page_lockless(vaddr, paddr, settings);
+        } else {
+            status = vmm_map_page_lockless(vaddr, paddr, settings);
+        }
+
+        if (status < 0) {
             return status;
         }
+
+        paddr += mapped_pages * VMM_PAGE_SIZE;
+        vaddr += mapped_pages * VMM_PAGE_SIZE;
+        n_pages -= mapped_pages;
     }
 
     return 0;
@@ -736,9 +1290,10 @@ static ALWAYS_INLINE int vmm_map_pages_lockless(uint32_t vaddr, uint32_t paddr,
 
 int vmm_map_pages(uint32_t vaddr, uint32_t paddr, uint32_t n_pages, uint32_t settings)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_map_pages_lockless(vaddr, paddr, n_pages, settings);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -760,9 +1315,10 @@ static ALWAYS_INLINE int vmm_unmap_pages_lockless(uint32_t vaddr, uint32_t n_pag
 
 int vmm_unmap_pages(uint32_t vaddr, uint32_t n_pages)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_unmap_pages_lockless(vaddr, n_pages);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -793,59 +1349,186 @@ static inline void _vmm_tables_set_cow(uint32_t table_index, table_desc_t* cur,
 #endif
 }
 
-static bool _vmm_is_copy_on_write(uint32_t vaddr)
+/**
+ * Returns the frame which holds the group of tables starting with
+ * @start_ptable_desc, or 0 if none of the tables is present.
+ */
+static uint32_t _vmm_table_group_frame(table_desc_t* start_ptable_desc)
 {
-    table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
-    return table_desc_is_copy_on_write(*ptable_desc);
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    for (int it = 0; it < ptables_per_page; it++) {
+        if (table_desc_is_present(start_ptable_desc[it]) && !table_desc_is_4mb(start_ptable_desc[it])) {
+            return PAGE_START(table_desc_get_frame(start_ptable_desc[it]));
+        }
+    }
+    return 0;
 }
 
-static int _vmm_resolve_copy_on_write(proc_t* p, uint32_t vaddr)
+/**
+ * Tables are shared by groups which cover a page, so the whole group
+ * is checked (arm has 4 tables per page).
+ */
+static bool _vmm_is_table_copy_on_write(uint32_t vaddr)
+{
+    if (!THIS_CPU->pdir) {
+        return false;
+    }
+
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
+    uint32_t ptable_serve_vaddr_start = (vaddr / (table_coverage * ptables_per_page)) * (table_coverage * ptables_per_page);
+    table_desc_t* start_ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, ptable_serve_vaddr_start);
+    for (int it = 0; it < ptables_per_page; it++) {
+        if (table_desc_is_copy_on_write(start_ptable_desc[it])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * The function gives the active pdir its own copy of shared tables.
+ * Only descriptors are copied: pages become shared, write-protected and
+ * are copied one by one on write (see _vmm_resolve_copy_on_write).
+ */
+static int _vmm_resolve_table_copy_on_write(uint32_t vaddr)
 {
     table_desc_t orig_table_desc[VMM_PAGE_SIZE / PTABLE_SIZE];
     uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
     uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
     uint32_t ptable_serve_vaddr_start = (vaddr / (table_coverage * ptables_per_page)) * (table_coverage * ptables_per_page);
+    table_desc_t* start_ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, ptable_serve_vaddr_start);
+    uint32_t tables_paddr = _vmm_table_group_frame(start_ptable_desc);
+
+    if (!_vmm_frame_is_shared(tables_paddr)) {
+        // Other owners are gone, so the tables are taken over. Pages which
+        // are still shared were write-protected when the tables were copied.
+        for (int it = 0; it < ptables_per_page; it++) {
+            if (table_desc_is_copy_on_write(start_ptable_desc[it])) {
+                _vmm_table_desc_init_from_allocated_state(&start_ptable_desc[it]);
+            }
+        }
+        // Access rights are only extended here, so no flush is needed. A stale
+        // entry causes one more fault, see _vmm_is_write_fault_spurious.
+        return 0;
+    }
 
-    /* Copying old ptables which cover the full page. See a comment above vmm_allocate_ptable. */
-    zone_t src_ptable_zone = _vmm_alloc_mapped_zone(VMM_PAGE_SIZE, VMM_PAGE_SIZE);
+    /* Mapping shared ptables which cover the full page. See a comment above vmm_allocate_ptable. */
+    zone_t src_ptable_zone = zoner_new_zone(VMM_PAGE_SIZE);
     ptable_t* src_ptable = (ptable_t*)src_ptable_zone.ptr;
-    ptable_t* root_ptable = (ptable_t*)PAGE_START((uint32_t)_vmm_pspace_get_vaddr_of_active_ptable(ptable_serve_vaddr_start));
-    memcpy(src_ptable, root_ptable, VMM_PAGE_SIZE);
+    vmm_map_page_lockless(src_ptable_zone.start, tables_paddr, PAGE_READABLE | PAGE_WRITABLE);
 
     // Saving descriptors of original ptables
     for (int it = 0; it < ptables_per_page; it++) {
-        table_desc_t* tmp_table_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, ptable_serve_vaddr_start);
-        orig_table_desc[it] = tmp_table_desc[it];
+        orig_table_desc[it] = start_ptable_desc[it];
     }
 
     /* Setting up new ptables. */
     int err = vmm_force_allocate_ptable_lockless(vaddr);
     if (err) {
+        vmm_unmap_page_lockless(src_ptable_zone.start);
+        zoner_free_zone(src_ptable_zone);
         return err;
     }
 
-    /* Copying all pages from this tables to newly allocated. */
-    uint32_t table_start = TABLE_START(ptable_serve_vaddr_start);
-    table_desc_t* start_ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, ptable_serve_vaddr_start);
+    /* Copying descriptors of all pages from the old tables, both copies become read-only. */
+    vmm_tlb_batch_t batch;
+    _vmm_tlb_batch_init(&batch, THIS_CPU->pdir);
+    ptable_t* new_ptable = (ptable_t*)PAGE_START((uint32_t)_vmm_pspace_get_vaddr_of_active_ptable(ptable_serve_vaddr_start));
     for (int ptable_idx = 0; ptable_idx < ptables_per_page; ptable_idx++) {
         if (table_desc_is_present(orig_table_desc[ptable_idx])) {
             _vmm_table_desc_init_from_allocated_state(&start_ptable_desc[ptable_idx]);
             for (int page_idx = 0; page_idx < VMM_TOTAL_PAGES_PER_TABLE; page_idx++) {
                 uint32_t offset_in_table_set = ptable_idx * VMM_TOTAL_PAGES_PER_TABLE + page_idx;
-                uint32_t page_vaddr = table_start + (offset_in_table_set * VMM_PAGE_SIZE);
                 page_desc_t* page_desc = &src_ptable->entities[offset_in_table_set];
                 if (page_desc_is_present(*page_desc)) {
-                    _vmm_copy_page_to_resolve_cow(p, page_vaddr, src_ptable, offset_in_table_set);
+                    page_desc_del_attrs(page_desc, PAGE_DESC_WRITABLE);
+                    new_ptable->entities[offset_in_table_set] = *page_desc;
+                    _vmm_frame_share(page_desc_get_frame(*page_desc));
+                    _vmm_tlb_batch_add(&batch, ptable_serve_vaddr_start + offset_in_table_set * VMM_PAGE_SIZE);
+                } else if (page_desc_is_swapped(*page_desc)) {
+                    new_ptable->entities[offset_in_table_set] = *page_desc;
+                    _vmm_swap_dup(page_desc_get_swap_slot(*page_desc));
                 }
             }
         }
     }
 
-    return _vmm_free_mapped_zone(src_ptable_zone);
+    vmm_unmap_page_lockless(src_ptable_zone.start);
+    zoner_free_zone(src_ptable_zone);
+    _vmm_frame_unshare(tables_paddr);
+    _vmm_tlb_batch_flush(&batch);
+    return 0;
+}
+
+/**
+ * A user page is copy-on-write when it is present but write-protected.
+ * Whether the write is allowed at all is decided by its zone.
+ */
+static bool _vmm_is_copy_on_write(uint32_t vaddr)
+{
+    if (PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER || vmm_get_active_pdir() == vmm_get_kernel_pdir()) {
+        return false;
+    }
+
+    if (_vmm_is_table_copy_on_write(vaddr) || !_vmm_is_page_present(vaddr) || _vmm_is_large_page(vaddr)) {
+        return false;
+    }
+
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    return !page_desc_has_attrs(*page, PAGE_DESC_WRITABLE) && page_desc_get_frame(*page) != _vmm_zero_page_paddr;
+}
+
+/**
+ * The function copies only the page at @vaddr. If nobody else maps the
+ * frame anymore, the write access is just restored.
+ */
+static int _vmm_resolve_copy_on_write(proc_t* p, uint32_t vaddr)
+{
+    proc_zone_t* zone = proc_find_zone(p, vaddr);
+    if (!zone || !(zone->flags & ZONE_WRITABLE)) {
+        return SHOULD_CRASH;
+    }
+
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    uint32_t old_page_paddr = page_desc_get_frame(*page);
+
+    if (zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY) {
+        lock_acquire(&_vmm_lock);
+        _vmm_mark_shared_page_dirty_lockless(zone, vaddr);
+        lock_release(&_vmm_lock);
+    }
+
+    bool keep_frame = (zone->type & (ZONE_TYPE_DEVICE | ZONE_TYPE_MAPPED_FILE_SHAREDLY | ZONE_TYPE_SHARED_BUFFER)) || !_vmm_frame_is_shared(old_page_paddr);
+    if (keep_frame) {
+        return vmm_map_page_lockless(vaddr, old_page_paddr, zone->flags);
+    }
+
+    uint32_t new_page_paddr = _vmm_alloc_page_paddr();
+    if (!new_page_paddr) {
+        kpanic("NO PHYSICAL SPACE");
+    }
+
+    /* Mapping the new page to do a copy */
+    zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page_lockless(tmp_zone.start, new_page_paddr, PAGE_READABLE | PAGE_WRITABLE);
+    memcpy(tmp_zone.ptr, (uint8_t*)PAGE_START(vaddr), VMM_PAGE_SIZE);
+    vmm_unmap_page_lockless(tmp_zone.start);
+    zoner_free_zone(tmp_zone);
+
+    vmm_map_page_lockless(vaddr, new_page_paddr, zone->flags);
+    _vmm_frame_unshare(old_page_paddr);
+    return 0;
 }
 
 static void _vmm_ensure_cow_for_page(uint32_t vaddr)
 {
+    if (_vmm_is_table_copy_on_write(vaddr)) {
+        _vmm_resolve_table_copy_on_write(vaddr);
+    }
+
     if (_vmm_is_copy_on_write(vaddr)) {
         proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
         if (!holder_proc) {
@@ -895,10 +1578,11 @@ static int _vmm_load_page_with_perm(uint32_t vaddr)
  */
 static void _vmm_ensure_write_to_page(uint32_t vaddr)
 {
-    if (!_vmm_is_page_present(vaddr)) {
+    _vmm_ensure_cow_for_page(vaddr);
+    if (!_vmm_is_page_present(vaddr) && !_vmm_try_swap_in(vaddr)) {
         _vmm_load_page_with_perm(vaddr);
     }
-    _vmm_ensure_cow_for_page(vaddr);
+    _vmm_ensure_zeroing_on_demand_for_page(vaddr);
 }
 
 static void _vmm_ensure_write_to_range(uint32_t vaddr, uint32_t length)
@@ -911,40 +1595,139 @@ static void _vmm_ensure_write_to_range(uint32_t vaddr, uint32_t length)
 }
 
 /**
- * The function is supposed to copy a page from @src_ptable to active
- * ptable. The page which is copied has address @vaddr. ONLY TO RESOLVE COW!
+ * FRAME REFERENCE FUNCTIONS
+ *
+ * A frame can be mapped by several address spaces after fork. The counter
+ * keeps the number of extra owners, so 0 means that the frame has a single
+ * owner and can be freed or written directly.
  */
-static int _vmm_copy_page_to_resolve_cow(proc_t* p, uint32_t vaddr, ptable_t* src_ptable, int page_index)
+
+static void _vmm_frame_refs_init()
 {
-    page_desc_t* old_page_desc = &src_ptable->entities[page_index];
+    _vmm_frame_refs_count = (pmm_get_max_blocks() * pmm_get_block_size()) / VMM_PAGE_SIZE;
+    uint32_t refs_size = _vmm_frame_refs_count * sizeof(uint16_t);
+    zone_t refs_zone = _vmm_alloc_mapped_zone(refs_size, VMM_PAGE_SIZE);
+    _vmm_frame_refs = (uint16_t*)refs_zone.ptr;
+    memset(_vmm_frame_refs, 0, refs_size);
+}
 
-    proc_zone_t* zone = proc_find_zone(p, vaddr);
-    if (!zone) {
-        log_error("Cow: No page in zone");
-        return SHOULD_CRASH;
+static inline bool _vmm_frame_is_shared(uint32_t paddr)
+{
+    uint32_t frame_id = paddr / VMM_PAGE_SIZE;
+    return frame_id < _vmm_frame_refs_count && __atomic_load_n(&_vmm_frame_refs[frame_id], __ATOMIC_RELAXED);
+}
+
+static inline void _vmm_frame_share(uint32_t paddr)
+{
+    uint32_t frame_id = paddr / VMM_PAGE_SIZE;
+    if (frame_id < _vmm_frame_refs_count && paddr != _vmm_zero_page_paddr) {
+        __atomic_add_fetch(&_vmm_frame_refs[frame_id], 1, __ATOMIC_RELAXED);
     }
+}
 
-    if ((zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY)) {
-        uint32_t old_page_paddr = page_desc_get_frame(*old_page_desc);
-        return vmm_map_page_lockless(vaddr, old_page_paddr, zone->flags);
+/**
+ * _vmm_frame_unshare drops one extra owner, returns false if the caller was
+ * the only one. Address spaces sharing a frame are guarded by different
+ * locks, so when two of them drop it at once exactly one sees 0 and frees.
+ */
+static inline bool _vmm_frame_unshare(uint32_t paddr)
+{
+    uint32_t frame_id = paddr / VMM_PAGE_SIZE;
+    if (frame_id >= _vmm_frame_refs_count) {
+        return false;
     }
 
-    vmm_load_page_lockless(vaddr, zone->flags);
+    uint16_t refs = __atomic_load_n(&_vmm_frame_refs[frame_id], __ATOMIC_RELAXED);
+    do {
+        if (!refs) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&_vmm_frame_refs[frame_id], &refs, refs - 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return true;
+}
 
-    /* Mapping the old page to do a copy */
-    zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
-    uint32_t old_page_vaddr = (uint32_t)tmp_zone.start;
-    uint32_t old_page_paddr = page_desc_get_frame(*old_page_desc);
-    vmm_map_page_lockless(old_page_vaddr, old_page_paddr, PAGE_READABLE);
+/**
+ * OBJECT PAGES FUNCTIONS
+ *
+ * Frames of memory objects, like shared buffers, belong to the object and
+ * are never freed by the VMM. The pages are put into the active pdir, its
+ * copy-on-write tables are taken over first to not touch other pdirs.
+ */
 
-    /*  We don't need to check if there is a problem with cow, since this is a special copy function
-        to resolve cow. So, we know that pages were created recently. Checking cow here would cause an
-        ub, since table has not been setup correctly yet. */
-    memcpy((uint8_t*)vaddr, (uint8_t*)old_page_vaddr, VMM_PAGE_SIZE);
+int vmm_map_object_pages(uint32_t vaddr, uint32_t* frames, uint32_t n_pages, uint32_t settings)
+{
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
+    for (uint32_t i = 0; i < n_pages; i++, vaddr += VMM_PAGE_SIZE) {
+        if (_vmm_is_table_copy_on_write(vaddr)) {
+            _vmm_resolve_table_copy_on_write(vaddr);
+        }
+        vmm_map_page_lockless(vaddr, frames[i], settings);
+    }
+    lock_release(lock);
+    return 0;
+}
 
-    /* Freeing */
-    vmm_unmap_page_lockless(old_page_vaddr);
-    zoner_free_zone(tmp_zone);
+int vmm_unmap_object_pages(uint32_t vaddr, uint32_t n_pages)
+{
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
+    for (uint32_t i = 0; i < n_pages; i++, vaddr += VMM_PAGE_SIZE) {
+        if (_vmm_is_table_copy_on_write(vaddr)) {
+            _vmm_resolve_table_copy_on_write(vaddr);
+        }
+        if (!_vmm_is_page_present(vaddr)) {
+            continue;
+        }
+        ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+        page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+        _vmm_frame_unshare(page_desc_get_frame(*page));
+        vmm_unmap_page_lockless(vaddr);
+    }
+    lock_release(lock);
+    return 0;
+}
+
+/**
+ * Drops the pages of the active address space in [@vaddr, @vaddr + @length).
+ * Their frames are freed unless other address spaces still map them, and
+ * the next access gets zeroed pages on demand again.
+ */
+int vmm_release_pages(uint32_t vaddr, uint32_t length)
+{
+    lock_t* lock = _vmm_lock_for(vaddr);
+    if (vaddr & 0xfff) {
+        return -VMM_ERR_BAD_ADDR;
+    }
+
+    lock_acquire(lock);
+    uint32_t end = vaddr + length;
+    for (; vaddr < end; vaddr += VMM_PAGE_SIZE) {
+        if (_vmm_is_table_copy_on_write(vaddr)) {
+            _vmm_resolve_table_copy_on_write(vaddr);
+        }
+        if (_vmm_is_swapped(vaddr)) {
+            vmm_unmap_page_lockless(vaddr);
+            continue;
+        }
+        if (!_vmm_is_page_present(vaddr)) {
+            continue;
+        }
+        if (_vmm_is_large_page(vaddr)) {
+            _vmm_split_large_page_lockless(vaddr);
+        }
+
+        ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+        page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+        uint32_t frame = page_desc_get_frame(*page);
+
+        // The frame is freed only when no TLB could reach it.
+        vmm_unmap_page_lockless(vaddr);
+        if (frame != _vmm_zero_page_paddr && !_vmm_frame_unshare(frame)) {
+            _vmm_free_page_paddr(frame);
+        }
+    }
+    lock_release(lock);
     return 0;
 }
 
@@ -952,38 +1735,106 @@ static int _vmm_copy_page_to_resolve_cow(proc_t* p, uint32_t vaddr, ptable_t* sr
  * ZEROING ON DEMAND FUNCTIONS
  */
 
-// static bool _vmm_is_zeroing_on_demand(uint32_t vaddr)
-// {
-//     table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
-//     if (table_desc_has_attrs(*ptable_desc, TABLE_DESC_ZEROING_ON_DEMAND)) {
-//         return true;
-//     }
-//     ptable_t* ptable = _vmm_pspace_get_vaddr_of_active_ptable(vaddr);
-//     table_desc_t* ppage_desc = _vmm_ptable_lookup(ptable, vaddr);
-//     return page_desc_has_attrs(*ppage_desc, PAGE_DESC_ZEROING_ON_DEMAND);
-// }
+/**
+ * Anonymous pages and BSS are not backed by a frame until they are touched.
+ * A read maps the shared zero page as read-only, the first write replaces it
+ * with a freshly allocated and zeroed frame.
+ */
+
+static void _vmm_zero_page_init()
+{
+    _vmm_zero_page_paddr = _vmm_alloc_page_paddr();
+    if (!_vmm_zero_page_paddr) {
+        kpanic("VMM: can't allocate zero page");
+    }
+
+    zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(tmp_zone.start, _vmm_zero_page_paddr, PAGE_READABLE | PAGE_WRITABLE);
+    memset(tmp_zone.ptr, 0, VMM_PAGE_SIZE);
+    vmm_unmap_page(tmp_zone.start);
+    zoner_free_zone(tmp_zone);
+}
+
+/**
+ * Zones mapped with PROT_NONE, like guard pages of thread stacks, never
+ * get pages.
+ */
+static inline bool _vmm_is_accessible_zone(proc_zone_t* zone)
+{
+    return (zone->flags & (ZONE_READABLE | ZONE_WRITABLE | ZONE_EXECUTABLE)) != 0;
+}
+
+static bool _vmm_is_zero_fillable_zone(proc_zone_t* zone)
+{
+    if (!_vmm_is_accessible_zone(zone)) {
+        return false;
+    }
+
+    if (zone->type == ZONE_TYPE_BSS) {
+        return true;
+    }
+
+    uint32_t not_anonymous = ZONE_TYPE_DEVICE | ZONE_TYPE_MAPPED_FILE_PRIVATLY | ZONE_TYPE_MAPPED_FILE_SHAREDLY;
+    return (zone->type & ZONE_TYPE_MAPPED) && !(zone->type & not_anonymous);
+}
+
+/**
+ * The function maps the zero page to @vaddr if the page is not backed by
+ * any data, returns false if a real frame should be loaded instead.
+ */
+static bool _vmm_try_map_zero_page(uint32_t vaddr)
+{
+    if (PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER || vmm_get_active_pdir() == vmm_get_kernel_pdir()) {
+        return false;
+    }
+
+    proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
+    if (!holder_proc) {
+        return false;
+    }
+
+    proc_zone_t* zone = proc_find_zone(holder_proc, vaddr);
+    if (!zone || !_vmm_is_zero_fillable_zone(zone)) {
+        return false;
+    }
+
+    vmm_map_page_lockless(vaddr, _vmm_zero_page_paddr, zone->flags & ~ZONE_WRITABLE);
+    return true;
+}
 
-// static void _vmm_resolve_zeroing_on_demand(uint32_t vaddr)
-// {
-//     table_desc_t* ptable_desc = (table_desc_t*)_vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
-//     ptable_t* ptable = _vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+static bool _vmm_is_zeroing_on_demand(uint32_t vaddr)
+{
+    if (!_vmm_is_page_present(vaddr) || _vmm_is_large_page(vaddr)) {
+        return false;
+    }
 
-//     if (table_desc_has_attrs(*ptable_desc, TABLE_DESC_ZEROING_ON_DEMAND)) {
-//         for (int i = 0; i < VMM_TOTAL_PAGES_PER_TABLE; i++) {
-//             page_desc_set_attrs(&ptable->entities[i], PAGE_DESC_ZEROING_ON_DEMAND);
-//             page_desc_del_attrs(&ptable->entities[i], PAGE_DESC_WRITABLE);
-//         }
-//         table_desc_del_attrs(ptable_desc, TABLE_DESC_ZEROING_ON_DEMAND);
-//     }
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    return page_desc_get_frame(*page) == _vmm_zero_page_paddr;
+}
 
-//     table_desc_t* ppage_desc = (table_desc_t*)_vmm_ptable_lookup(ptable, vaddr);
+static int _vmm_resolve_zeroing_on_demand(proc_t* p, uint32_t vaddr)
+{
+    proc_zone_t* zone = proc_find_zone(p, vaddr);
+    if (!zone || !(zone->flags & ZONE_WRITABLE)) {
+        return SHOULD_CRASH;
+    }
 
-//     uint8_t* dest = (uint8_t*)_vmm_round_floor_to_page(vaddr);
-//     memset(dest, 0, VMM_PAGE_SIZE);
+    // Remapping over the zero page, the zero page itself is never freed.
+    vmm_load_page_lockless(vaddr, zone->flags);
+    return 0;
+}
 
-//     page_desc_del_attrs(ppage_desc, PAGE_DESC_ZEROING_ON_DEMAND);
-//     page_desc_set_attrs(ppage_desc, PAGE_DESC_WRITABLE);
-// }
+static void _vmm_ensure_zeroing_on_demand_for_page(uint32_t vaddr)
+{
+    if (_vmm_is_zeroing_on_demand(vaddr)) {
+        proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
+        if (!holder_proc) {
+            kpanic("No proc with the pdir\n");
+        }
+        _vmm_resolve_zeroing_on_demand(holder_proc, vaddr);
+    }
+}
 
 /**
  * USER PDIR FUNCTIONS
@@ -1020,11 +1871,14 @@ pdirectory_t* vmm_new_user_pdir()
 
 /**
  * The function created a new user's pdir from the active pdir.
- * After copying the task we need to flush tlb.
+ * After copying the task only pages of the tables which became
+ * write-protected are invalidated.
  */
 static ALWAYS_INLINE pdirectory_t* vmm_new_forked_user_pdir_lockless()
 {
     pdirectory_t* new_pdir = _vmm_alloc_pdir();
+    vmm_tlb_batch_t batch;
+    _vmm_tlb_batch_init(&batch, THIS_CPU->pdir);
 
     // coping all tables
     for (int i = 0; i < VMM_TOTAL_TABLES_PER_DIRECTORY; i++) {
@@ -1034,21 +1888,43 @@ static ALWAYS_INLINE pdirectory_t* vmm_new_forked_user_pdir_lockless()
 
     for (int i = 0; i < VMM_KERNEL_TABLES_START; i++) {
         table_desc_t* act_ptable_desc = &THIS_CPU->pdir->entities[i];
+        if (table_desc_is_present(*act_ptable_desc) && table_desc_is_4mb(*act_ptable_desc)) {
+            // Large pages are shared as they are, every frame gets one more owner.
+            uint32_t frame = table_desc_get_frame(*act_ptable_desc);
+            for (uint32_t offset = 0; offset < VMM_LARGE_PAGE_SIZE; offset += VMM_PAGE_SIZE) {
+                _vmm_frame_share(frame + offset);
+            }
+            continue;
+        }
+
         if (table_desc_has_attrs(*act_ptable_desc, TABLE_DESC_PRESENT)) {
             table_desc_t* new_ptable_desc = &new_pdir->entities[i];
             _vmm_tables_set_cow(i, act_ptable_desc, new_ptable_desc);
+            _vmm_tlb_batch_add_table(&batch, i);
+        }
+    }
+
+    // Every group of tables which covers a page gets one more owner.
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    for (int i = 0; i < VMM_KERNEL_TABLES_START; i += ptables_per_page) {
+        uint32_t tables_paddr = _vmm_table_group_frame(&THIS_CPU->pdir->entities[i]);
+        if (tables_paddr) {
+            _vmm_frame_share(tables_paddr);
         }
     }
 
-    system_flush_whole_tlb();
+    _vmm_tlb_batch_flush(&batch);
     return new_pdir;
 }
 
 pdirectory_t* vmm_new_forked_user_pdir()
 {
+    lock_t* space = _vmm_space_lock(THIS_CPU->pdir);
+    lock_acquire(space);
     lock_acquire(&_vmm_lock);
     pdirectory_t* res = vmm_new_forked_user_pdir_lockless();
     lock_release(&_vmm_lock);
+    lock_release(space);
     return res;
 }
 
@@ -1076,15 +1952,19 @@ static ALWAYS_INLINE int vmm_free_pdir_lockless(pdirectory_t* pdir, dynamic_arra
         vmm_switch_pdir_lockless(cur_pdir);
     }
     _vmm_free_pspace(pdir);
+    _vmm_asid_release(pdir);
     _vmm_free_pdir(pdir);
     return 0;
 }
 
 int vmm_free_pdir(pdirectory_t* pdir, dynamic_array_t* zones)
 {
+    lock_t* space = _vmm_space_lock(pdir);
+    lock_acquire(space);
     lock_acquire(&_vmm_lock);
     int res = vmm_free_pdir_lockless(pdir, zones);
     lock_release(&_vmm_lock);
+    lock_release(space);
     return res;
 }
 
@@ -1106,34 +1986,99 @@ static ALWAYS_INLINE void vmm_prepare_active_pdir_for_copying_at_lockless(uint32
 
 void vmm_prepare_active_pdir_for_copying_at(uint32_t dest_vaddr, uint32_t length)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(dest_vaddr);
+    lock_acquire(lock);
     vmm_prepare_active_pdir_for_copying_at_lockless(dest_vaddr, length);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
 }
 
-static ALWAYS_INLINE void vmm_copy_to_user_lockless(void* dest, void* src, uint32_t length)
+/**
+ * A present writable page and a missing one (the fault loads a private or
+ * a dirty shared page for a write) can be written right away. Shared
+ * tables, copy-on-write and zero pages are read-only, which kernel writes
+ * don't respect, so only they need work.
+ */
+static bool _vmm_is_ready_for_user_write(uint32_t vaddr)
 {
-    vmm_prepare_active_pdir_for_copying_at_lockless((uint32_t)dest, length);
-    memcpy(dest, src, length);
-}
+    if (_vmm_is_table_copy_on_write(vaddr)) {
+        return false;
+    }
+    if (!_vmm_is_page_present(vaddr) || _vmm_is_large_page(vaddr)) {
+        return true;
+    }
 
-void vmm_copy_to_user(void* dest, void* src, uint32_t length)
-{
-    lock_acquire(&_vmm_lock);
-    vmm_prepare_active_pdir_for_copying_at_lockless((uint32_t)dest, length);
-    lock_release(&_vmm_lock);
-    memcpy(dest, src, length);
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    return page_desc_has_attrs(*page, PAGE_DESC_WRITABLE);
 }
 
-static ALWAYS_INLINE void vmm_copy_to_pdir_lockless(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length)
+/**
+ * Used by copy_to_user and by every other kernel write into the running
+ * address space. The pages are checked without the lock, which is taken
+ * only for the pages which have to be copied or zeroed, so a large read
+ * into an already written buffer doesn't hold it at all.
+ * Kernel writes go through read-only pages, so the range has to lie in
+ * zones the process could write itself, otherwise -EFAULT is returned
+ * and nothing should be written.
+ */
+int vmm_prepare_active_pdir_for_user_write(uint32_t dest_vaddr, uint32_t length)
 {
-    pdirectory_t* prev_pdir = vmm_get_active_pdir();
-    uint8_t* ksrc;
-    if ((uint32_t)src < KERNEL_BASE) {
-        /* Means that it's in user space, so it should be copied here. */
-        ksrc = vmm_bring_to_kernel(src, length);
-    } else {
-        ksrc = src;
+    if (PAGE_CHOOSE_OWNER(dest_vaddr) != PAGE_USER || vmm_get_active_pdir() == vmm_get_kernel_pdir()) {
+        return 0;
+    }
+
+    proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
+    if (!holder_proc) {
+        return -EFAULT;
+    }
+
+    lock_t* lock = _vmm_lock_for(dest_vaddr);
+    proc_zone_t* zone = NULL;
+    uint32_t page_addr = PAGE_START(dest_vaddr);
+    for (; page_addr < dest_vaddr + length; page_addr += VMM_PAGE_SIZE) {
+        if (!zone || page_addr >= zone->start + zone->len) {
+            zone = proc_find_zone(holder_proc, page_addr);
+            if (!zone || !(zone->flags & ZONE_WRITABLE)) {
+                return -EFAULT;
+            }
+        }
+
+        if (_vmm_is_ready_for_user_write(page_addr)) {
+            continue;
+        }
+
+        lock_acquire(lock);
+        _vmm_ensure_cow_for_page(page_addr);
+        _vmm_ensure_zeroing_on_demand_for_page(page_addr);
+        lock_release(lock);
+    }
+    return 0;
+}
+
+static ALWAYS_INLINE void vmm_copy_to_user_lockless(void* dest, void* src, uint32_t length)
+{
+    vmm_prepare_active_pdir_for_copying_at_lockless((uint32_t)dest, length);
+    memcpy(dest, src, length);
+}
+
+void vmm_copy_to_user(void* dest, void* src, uint32_t length)
+{
+    lock_t* lock = _vmm_lock_for((uint32_t)dest);
+    lock_acquire(lock);
+    vmm_prepare_active_pdir_for_copying_at_lockless((uint32_t)dest, length);
+    lock_release(lock);
+    memcpy(dest, src, length);
+}
+
+static ALWAYS_INLINE void vmm_copy_to_pdir_lockless(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length)
+{
+    pdirectory_t* prev_pdir = vmm_get_active_pdir();
+    uint8_t* ksrc;
+    if ((uint32_t)src < KERNEL_BASE) {
+        /* Means that it's in user space, so it should be copied here. */
+        ksrc = vmm_bring_to_kernel(src, length);
+    } else {
+        ksrc = src;
     }
 
     vmm_switch_pdir_lockless(pdir);
@@ -1160,10 +2105,10 @@ void vmm_copy_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32
         ksrc = src;
     }
 
-    lock_acquire(&_vmm_lock);
+    lock_acquire(_vmm_space_lock(pdir));
     vmm_switch_pdir_lockless(pdir);
     vmm_prepare_active_pdir_for_copying_at_lockless(dest_vaddr, length);
-    lock_release(&_vmm_lock);
+    lock_release(_vmm_space_lock(pdir));
 
     uint8_t* dest = (uint8_t*)dest_vaddr;
     memcpy(dest, ksrc, length);
@@ -1177,13 +2122,13 @@ void vmm_copy_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32
 
 void vmm_zero_user_pages(pdirectory_t* pdir)
 {
-    lock_acquire(&_vmm_lock);
+    lock_acquire(_vmm_space_lock(pdir));
     for (int i = 0; i < VMM_KERNEL_TABLES_START; i++) {
         table_desc_t* ptable_desc = &pdir->entities[i];
         table_desc_del_attrs(ptable_desc, TABLE_DESC_WRITABLE);
         table_desc_set_attrs(ptable_desc, TABLE_DESC_ZEROING_ON_DEMAND);
     }
-    lock_release(&_vmm_lock);
+    lock_release(_vmm_space_lock(pdir));
 }
 
 pdirectory_t* vmm_get_active_pdir()
@@ -1197,6 +2142,863 @@ pdirectory_t* vmm_get_kernel_pdir()
     return _vmm_kernel_pdir;
 }
 
+/**
+ * FILE MAPPING FUNCTIONS
+ */
+
+/**
+ * Frames of read-only file mappings, program text mostly, are kept in a
+ * small direct-mapped cache keyed by (device, inode, file offset), so all
+ * processes running the same binary share its text frames. The cache is
+ * one more owner of a frame: a replaced entry frees the frame only when no
+ * address space maps it anymore. Only pages which are fully backed by the
+ * file are cached, since the zeroed tail differs from mapping to mapping.
+ */
+
+static inline uint32_t _vmm_file_page_offset(proc_zone_t* zone, uint32_t vaddr)
+{
+    return zone->offset + (PAGE_START(vaddr) - zone->start);
+}
+
+static inline vmm_file_page_t* _vmm_file_cache_slot(uint32_t dev_indx, uint32_t inode_indx, uint32_t offset)
+{
+    uint32_t hash = (inode_indx * 31 + dev_indx) * 8 + offset / VMM_PAGE_SIZE;
+    return &_vmm_file_cache[hash % VMM_FILE_CACHE_SIZE];
+}
+
+static bool _vmm_is_file_page_cacheable(proc_zone_t* zone, uint32_t vaddr)
+{
+    // Content of custom dentries is generated, it could change at any read.
+    if ((zone->flags & ZONE_WRITABLE) || dentry_test_flag_lockless(zone->file, DENTRY_CUSTOM)) {
+        return false;
+    }
+    return PAGE_START(vaddr) - zone->start + VMM_PAGE_SIZE <= zone->file_len;
+}
+
+static uint32_t _vmm_file_cache_find_lockless(proc_zone_t* zone, uint32_t vaddr)
+{
+    dentry_t* file = zone->file;
+    uint32_t offset = _vmm_file_page_offset(zone, vaddr);
+    vmm_file_page_t* page = _vmm_file_cache_slot(file->dev_indx, file->inode_indx, offset);
+    if (page->inode_indx == file->inode_indx && page->dev_indx == file->dev_indx && page->offset == offset) {
+        return page->paddr;
+    }
+    return 0;
+}
+
+static void _vmm_file_cache_insert_lockless(proc_zone_t* zone, uint32_t vaddr, uint32_t paddr)
+{
+    dentry_t* file = zone->file;
+    uint32_t offset = _vmm_file_page_offset(zone, vaddr);
+    vmm_file_page_t* page = _vmm_file_cache_slot(file->dev_indx, file->inode_indx, offset);
+    _vmm_file_cache_drop_lockless(page);
+
+    page->dev_indx = file->dev_indx;
+    page->inode_indx = file->inode_indx;
+    page->offset = offset;
+    page->paddr = paddr;
+    _vmm_frame_share(paddr);
+    _vmm_file_cache_used++;
+}
+
+static void _vmm_file_cache_drop_lockless(vmm_file_page_t* page)
+{
+    if (!page->inode_indx) {
+        return;
+    }
+
+    if (!_vmm_frame_unshare(page->paddr)) {
+        _vmm_free_page_paddr(page->paddr);
+    }
+    page->inode_indx = 0;
+    _vmm_file_cache_used--;
+}
+
+/**
+ * Called when the content of the file changes or its inode is freed.
+ * Processes which have the pages mapped already keep the old frames.
+ */
+void vmm_file_cache_invalidate(uint32_t dev_indx, uint32_t inode_indx)
+{
+    if (!_vmm_file_cache_used) {
+        return;
+    }
+
+    lock_acquire(&_vmm_lock);
+    for (int i = 0; i < VMM_FILE_CACHE_SIZE; i++) {
+        vmm_file_page_t* page = &_vmm_file_cache[i];
+        if (page->inode_indx == inode_indx && page->dev_indx == dev_indx) {
+            _vmm_file_cache_drop_lockless(page);
+        }
+    }
+    lock_release(&_vmm_lock);
+}
+
+static void _vmm_map_file_page_lockless(uint32_t vaddr, uint32_t paddr, uint32_t settings)
+{
+    if (_vmm_is_table_copy_on_write(vaddr)) {
+        _vmm_resolve_table_copy_on_write(vaddr);
+    }
+    vmm_map_page_lockless(vaddr, paddr, settings);
+}
+
+/**
+ * Pages of a file mapping are read ahead: the faulting page and up to
+ * VMM_FILE_READ_AHEAD_PAGES - 1 next pages which are not present yet are
+ * filled with one read. The read could sleep and take vmm lock itself, so
+ * it is done into kernel mappings of new frames without holding vmm lock,
+ * and the frames are mapped to the user afterwards.
+ * Bytes past the file length of the zone are not read and stay zeroed.
+ *
+ * Other threads of the proc could mmap or munmap meanwhile, which moves or
+ * changes zones. So the zone is looked up under the lock every time, the
+ * read uses a copy of its fields and a reference of its file, and the
+ * pages are mapped only if the zone still maps the same part of the file.
+ */
+static inline bool _vmm_is_same_file_zone(proc_zone_t* zone, uint32_t type, dentry_t* file, uint32_t zone_start, uint32_t file_offset)
+{
+    return zone && (zone->type & type) && zone->file == file && zone->offset - file_offset == zone->start - zone_start;
+}
+
+static int _vmm_load_file_pages(proc_t* p, uint32_t vaddr)
+{
+    lock_t* space = _vmm_space_lock(THIS_CPU->pdir);
+    uint32_t paddrs[VMM_FILE_READ_AHEAD_PAGES];
+    uint32_t start_vaddr = PAGE_START(vaddr);
+    uint32_t n_pages = 0;
+
+    // The file is locked while it is read, which takes vmm lock, so the
+    // reference is taken holding only the space lock.
+    lock_acquire(space);
+    proc_zone_t* zone = proc_find_zone(p, start_vaddr);
+    if (!zone || !(zone->type & ZONE_TYPE_MAPPED_FILE_PRIVATLY)) {
+        lock_release(space);
+        return SHOULD_CRASH;
+    }
+    dentry_t* file = dentry_duplicate(zone->file);
+    uint32_t zone_start = zone->start;
+    uint32_t zone_end = zone->start + zone->len;
+    uint32_t file_offset = zone->offset;
+    uint32_t file_len = zone->file_len;
+
+    lock_acquire(&_vmm_lock);
+    if (_vmm_is_page_present(start_vaddr)) {
+        _vmm_unlock_space_and_caches(space);
+        dentry_put(file);
+        return OK;
+    }
+
+    if (_vmm_is_file_page_cacheable(zone, start_vaddr)) {
+        uint32_t cached_paddr = _vmm_file_cache_find_lockless(zone, start_vaddr);
+        if (cached_paddr) {
+            _vmm_frame_share(cached_paddr);
+            _vmm_map_file_page_lockless(start_vaddr, cached_paddr, zone->flags);
+            _vmm_unlock_space_and_caches(space);
+            dentry_put(file);
+            return OK;
+        }
+    }
+
+    while (n_pages < VMM_FILE_READ_AHEAD_PAGES && start_vaddr + n_pages * VMM_PAGE_SIZE < zone_end) {
+        if (_vmm_is_page_present(start_vaddr + n_pages * VMM_PAGE_SIZE)) {
+            break;
+        }
+        n_pages++;
+    }
+    _vmm_unlock_space_and_caches(space);
+
+    if (!n_pages) {
+        dentry_put(file);
+        return OK;
+    }
+
+    // Read ahead is cut short when memory is low, only the faulting page
+    // has to be loaded.
+    zone_t tmp_zone = zoner_new_zone(n_pages * VMM_PAGE_SIZE);
+    uint32_t mapped_pages = 0;
+    for (; mapped_pages < n_pages; mapped_pages++) {
+        paddrs[mapped_pages] = _vmm_alloc_page_paddr();
+        if (!paddrs[mapped_pages]) {
+            break;
+        }
+        vmm_map_page(tmp_zone.start + mapped_pages * VMM_PAGE_SIZE, paddrs[mapped_pages], PAGE_READABLE | PAGE_WRITABLE);
+    }
+    n_pages = mapped_pages;
+    if (!n_pages) {
+        zoner_free_zone(tmp_zone);
+        dentry_put(file);
+        return SHOULD_CRASH;
+    }
+
+    // The tail after the end of the file stays zeroed.
+    memset(tmp_zone.ptr, 0, n_pages * VMM_PAGE_SIZE);
+    uint32_t zone_offset = start_vaddr - zone_start;
+    if (zone_offset < file_len) {
+        uint32_t read_len = min(n_pages * VMM_PAGE_SIZE, file_len - zone_offset);
+        lock_acquire(&file->lock);
+        file->ops->file.read(file, tmp_zone.ptr, file_offset + zone_offset, read_len);
+        lock_release(&file->lock);
+    }
+
+    vmm_unmap_pages(tmp_zone.start, n_pages);
+    zoner_free_zone(tmp_zone);
+
+    _vmm_lock_space_and_caches(space);
+    zone = proc_find_zone(p, start_vaddr);
+    bool same_zone = _vmm_is_same_file_zone(zone, ZONE_TYPE_MAPPED_FILE_PRIVATLY, file, zone_start, file_offset);
+    for (int i = 0; i < n_pages; i++) {
+        uint32_t page_vaddr = start_vaddr + i * VMM_PAGE_SIZE;
+
+        // Other thread of the proc could fault on the page meanwhile, or
+        // change the mapping, then the access faults again.
+        if (!same_zone || page_vaddr >= zone->start + zone->len || _vmm_is_page_present(page_vaddr)) {
+            _vmm_free_page_paddr(paddrs[i]);
+            continue;
+        }
+
+        uint32_t paddr = paddrs[i];
+        if (_vmm_is_file_page_cacheable(zone, page_vaddr)) {
+            // Other process could bring the page to the cache meanwhile.
+            uint32_t cached_paddr = _vmm_file_cache_find_lockless(zone, page_vaddr);
+            if (cached_paddr) {
+                _vmm_free_page_paddr(paddr);
+                paddr = cached_paddr;
+                _vmm_frame_share(paddr);
+            } else {
+                _vmm_file_cache_insert_lockless(zone, page_vaddr, paddr);
+            }
+        }
+        _vmm_map_file_page_lockless(page_vaddr, paddr, zone->flags);
+    }
+    _vmm_unlock_space_and_caches(space);
+    dentry_put(file);
+    return OK;
+}
+
+/**
+ * SHARED FILE MAPPING FUNCTIONS
+ */
+
+/**
+ * Pages of MAP_SHARED file mappings live in a table keyed by (device,
+ * inode, file offset), every mapping of the file maps the very same frame.
+ * The table owns one reference of the frame, so a page outlives the
+ * mappings until it is written back. Clean pages are mapped read-only and
+ * the first write faults and marks the page dirty; dirty pages are written
+ * to the file by msync and when the last mapping of the page goes away.
+ */
+
+static inline vmm_shared_page_t** _vmm_shared_page_bucket(uint32_t dev_indx, uint32_t inode_indx, uint32_t offset)
+{
+    uint32_t hash = (inode_indx * 31 + dev_indx) * 8 + offset / VMM_PAGE_SIZE;
+    return &_vmm_shared_pages[hash % VMM_SHARED_PAGES_BUCKETS];
+}
+
+static vmm_shared_page_t* _vmm_shared_page_find_lockless(dentry_t* file, uint32_t offset)
+{
+    vmm_shared_page_t* page = *_vmm_shared_page_bucket(file->dev_indx, file->inode_indx, offset);
+    for (; page; page = page->next) {
+        if (page->inode_indx == file->inode_indx && page->dev_indx == file->dev_indx && page->offset == offset) {
+            return page;
+        }
+    }
+    return NULL;
+}
+
+static void _vmm_shared_page_remove_lockless(vmm_shared_page_t* page)
+{
+    vmm_shared_page_t** link = _vmm_shared_page_bucket(page->dev_indx, page->inode_indx, page->offset);
+    while (*link != page) {
+        link = &(*link)->next;
+    }
+    *link = page->next;
+}
+
+// The owners of a frame are the table and every address space which maps it.
+static inline uint32_t _vmm_frame_owners(uint32_t paddr)
+{
+    uint32_t frame_id = paddr / VMM_PAGE_SIZE;
+    return frame_id < _vmm_frame_refs_count ? _vmm_frame_refs[frame_id] + 1 : 1;
+}
+
+static void _vmm_mark_shared_page_dirty_lockless(proc_zone_t* zone, uint32_t vaddr)
+{
+    vmm_shared_page_t* page = _vmm_shared_page_find_lockless(zone->file, _vmm_file_page_offset(zone, vaddr));
+    if (page) {
+        page->dirty = true;
+    }
+}
+
+static void _vmm_map_shared_page_lockless(proc_zone_t* zone, uint32_t vaddr, vmm_shared_page_t* page, bool write)
+{
+    if (write && (zone->flags & ZONE_WRITABLE)) {
+        page->dirty = true;
+    }
+
+    uint32_t settings = page->dirty ? zone->flags : (zone->flags & ~ZONE_WRITABLE);
+    _vmm_frame_share(page->paddr);
+    _vmm_map_file_page_lockless(vaddr, page->paddr, settings);
+}
+
+/**
+ * The read could sleep and take vmm lock itself, so like for private
+ * mappings it is done into a kernel mapping of a new frame without holding
+ * vmm lock, and the zone is looked up again after it.
+ */
+static int _vmm_load_shared_file_page(proc_t* p, uint32_t vaddr, bool write)
+{
+    lock_t* space = _vmm_space_lock(THIS_CPU->pdir);
+    uint32_t page_vaddr = PAGE_START(vaddr);
+
+    lock_acquire(space);
+    proc_zone_t* zone = proc_find_zone(p, page_vaddr);
+    if (!zone || !(zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY)) {
+        lock_release(space);
+        return SHOULD_CRASH;
+    }
+    dentry_t* file = dentry_duplicate(zone->file);
+    uint32_t zone_start = zone->start;
+    uint32_t file_offset = zone->offset;
+    uint32_t offset = _vmm_file_page_offset(zone, page_vaddr);
+
+    lock_acquire(&_vmm_lock);
+    if (_vmm_is_page_present(page_vaddr)) {
+        _vmm_unlock_space_and_caches(space);
+        dentry_put(file);
+        return OK;
+    }
+
+    vmm_shared_page_t* page = _vmm_shared_page_find_lockless(file, offset);
+    if (page) {
+        _vmm_map_shared_page_lockless(zone, page_vaddr, page, write);
+        _vmm_unlock_space_and_caches(space);
+        dentry_put(file);
+        return OK;
+    }
+    _vmm_unlock_space_and_caches(space);
+
+    vmm_shared_page_t* new_page = (vmm_shared_page_t*)kmalloc(sizeof(vmm_shared_page_t));
+    uint32_t paddr = _vmm_alloc_page_paddr();
+    if (!new_page || !paddr) {
+        if (paddr) {
+            _vmm_free_page_paddr(paddr);
+        }
+        kfree(new_page);
+        dentry_put(file);
+        return SHOULD_CRASH;
+    }
+
+    // The tail after the end of the file stays zeroed.
+    zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(tmp_zone.start, paddr, PAGE_READABLE | PAGE_WRITABLE);
+    memset(tmp_zone.ptr, 0, VMM_PAGE_SIZE);
+    lock_acquire(&file->lock);
+    file->ops->file.read(file, tmp_zone.ptr, offset, VMM_PAGE_SIZE);
+    lock_release(&file->lock);
+    vmm_unmap_page(tmp_zone.start);
+    zoner_free_zone(tmp_zone);
+
+    _vmm_lock_space_and_caches(space);
+    // Other process could bring the page to the table meanwhile.
+    page = _vmm_shared_page_find_lockless(file, offset);
+    if (page) {
+        _vmm_free_page_paddr(paddr);
+    } else {
+        page = new_page;
+        new_page = NULL;
+        page->dev_indx = file->dev_indx;
+        page->inode_indx = file->inode_indx;
+        page->offset = offset;
+        page->paddr = paddr;
+        page->dirty = false;
+
+        vmm_shared_page_t** bucket = _vmm_shared_page_bucket(file->dev_indx, file->inode_indx, offset);
+        page->next = *bucket;
+        *bucket = page;
+    }
+
+    // Other thread of the proc could fault on the page or change the
+    // mapping meanwhile, then the access faults again.
+    zone = proc_find_zone(p, page_vaddr);
+    if (_vmm_is_same_file_zone(zone, ZONE_TYPE_MAPPED_FILE_SHAREDLY, file, zone_start, file_offset) && !_vmm_is_page_present(page_vaddr)) {
+        _vmm_map_shared_page_lockless(zone, page_vaddr, page, write);
+    }
+    _vmm_unlock_space_and_caches(space);
+    dentry_put(file);
+
+    if (new_page) {
+        kfree(new_page);
+    }
+    return OK;
+}
+
+/**
+ * Writes the dirty pages of the shared file mapping @zone in
+ * [@start, @start + @len) back to the file. Pages mapped by the running
+ * address space are write-protected again, so the next write marks them
+ * dirty. A page stays dirty while other address spaces map it, since they
+ * could keep writing through their entries.
+ * With @release the zone is going away and its pages are already unmapped,
+ * pages which nobody maps anymore are dropped from the table.
+ */
+int vmm_sync_shared_file_pages(proc_zone_t* zone, uint32_t start, uint32_t len, bool release)
+{
+    lock_t* space = _vmm_space_lock(THIS_CPU->pdir);
+    dentry_t* file = zone->file;
+    uint32_t end = min(start + len, zone->start + zone->len);
+    bool written = false;
+    zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
+
+    for (uint32_t vaddr = PAGE_START(start); vaddr < end; vaddr += VMM_PAGE_SIZE) {
+        uint32_t offset = _vmm_file_page_offset(zone, vaddr);
+
+        _vmm_lock_space_and_caches(space);
+        vmm_shared_page_t* page = _vmm_shared_page_find_lockless(file, offset);
+        if (!page) {
+            _vmm_unlock_space_and_caches(space);
+            continue;
+        }
+
+        uint32_t mapped_here = 0;
+        if (!release && _vmm_is_page_present(vaddr)) {
+            _vmm_map_file_page_lockless(vaddr, page->paddr, zone->flags & ~ZONE_WRITABLE);
+            mapped_here = 1;
+        }
+
+        bool dirty = page->dirty;
+        page->dirty = dirty && _vmm_frame_owners(page->paddr) > 1 + mapped_here;
+
+        // The extra reference keeps the page in the table while it is written.
+        uint32_t paddr = page->paddr;
+        _vmm_frame_share(paddr);
+        _vmm_unlock_space_and_caches(space);
+
+        if (dirty) {
+            vmm_map_page(tmp_zone.start, paddr, PAGE_READABLE);
+            lock_acquire(&file->lock);
+            if (offset < file->inode->size) {
+                file->ops->file.write(file, tmp_zone.ptr, offset, min(VMM_PAGE_SIZE, file->inode->size - offset));
+                written = true;
+            }
+            lock_release(&file->lock);
+            vmm_unmap_page(tmp_zone.start);
+        }
+
+        vmm_shared_page_t* freed_page = NULL;
+        _vmm_lock_space_and_caches(space);
+        _vmm_frame_unshare(paddr);
+        if (release && !_vmm_frame_is_shared(paddr)) {
+            _vmm_shared_page_remove_lockless(page);
+            _vmm_free_page_paddr(paddr);
+            freed_page = page;
+        }
+        _vmm_unlock_space_and_caches(space);
+
+        if (freed_page) {
+            kfree(freed_page);
+        }
+    }
+
+    zoner_free_zone(tmp_zone);
+
+    // Frames of private mappings could keep the old content of the file.
+    if (written) {
+        vmm_file_cache_invalidate(file->dev_indx, file->inode_indx);
+    }
+    return 0;
+}
+
+/**
+ * SWAP FUNCTIONS
+ *
+ * Private pages are swapped out into a pool of compressed pages kept in
+ * memory. The pool is a window of kernel space, backed frame by frame as
+ * it grows. A frame is split into chunks and a compressed page takes a
+ * run of chunks within one frame. A slot describes where the page is, it
+ * is kept by descriptors of the page instead of the frame and counts them,
+ * since fork makes a swapped out page belong to several address spaces.
+ */
+
+static void _vmm_swap_init()
+{
+    lock_init(&_vmm_swap_lock);
+    uint32_t frames = (pmm_get_max_blocks() * pmm_get_block_size()) / VMM_PAGE_SIZE;
+    _vmm_swap_pool_limit = min(frames / 4, VMM_SWAP_POOL_PAGES);
+    _vmm_swap_pool_zone = zoner_new_zone(VMM_SWAP_POOL_PAGES * VMM_PAGE_SIZE);
+    _vmm_swap_window = zoner_new_zone(VMM_PAGE_SIZE);
+}
+
+static inline uint8_t* _vmm_swap_slot_data(vmm_swap_slot_t* slot)
+{
+    return _vmm_swap_pool_zone.ptr + slot->pool_page * VMM_PAGE_SIZE + slot->chunk * VMM_SWAP_CHUNK_SIZE;
+}
+
+static inline uint16_t _vmm_swap_chunks_mask(uint32_t chunk, uint32_t chunks)
+{
+    return (uint16_t)(((1 << chunks) - 1) << chunk);
+}
+
+/**
+ * Takes @chunks contiguous chunks from the first page of the pool which
+ * has them. A new page is backed only when none has. The frame comes from
+ * the pmm directly, the pool is never grown with a reclaim.
+ */
+static bool _vmm_swap_pool_alloc_lockless(vmm_swap_slot_t* slot, uint32_t chunks)
+{
+    int unbacked = -1;
+    for (uint32_t id = 0; id < _vmm_swap_pool_limit; id++) {
+        if (!_vmm_swap_pool_frames[id]) {
+            unbacked = (unbacked < 0) ? id : unbacked;
+            continue;
+        }
+
+        for (uint32_t chunk = 0; chunk + chunks <= VMM_SWAP_CHUNKS_PER_PAGE; chunk++) {
+            uint16_t mask = _vmm_swap_chunks_mask(chunk, chunks);
+            if (!(_vmm_swap_pool_used[id] & mask)) {
+                _vmm_swap_pool_used[id] |= mask;
+                slot->pool_page = id;
+                slot->chunk = chunk;
+                slot->chunks = chunks;
+                return true;
+            }
+        }
+    }
+
+    if (unbacked < 0) {
+        return false;
+    }
+
+    uint32_t frame = (uint32_t)pmm_alloc_frame();
+    if (!frame) {
+        return false;
+    }
+
+    _vmm_swap_pool_frames[unbacked] = frame;
+    vmm_map_page_lockless(_vmm_swap_pool_zone.start + unbacked * VMM_PAGE_SIZE, frame, PAGE_READABLE | PAGE_WRITABLE);
+    _vmm_swap_stat.pool_pages++;
+
+    _vmm_swap_pool_used[unbacked] = _vmm_swap_chunks_mask(0, chunks);
+    slot->pool_page = unbacked;
+    slot->chunk = 0;
+    slot->chunks = chunks;
+    return true;
+}
+
+// A page of the pool goes back to the pmm as soon as it's empty.
+static void _vmm_swap_pool_free_lockless(vmm_swap_slot_t* slot)
+{
+    uint32_t id = slot->pool_page;
+    _vmm_swap_pool_used[id] &= ~_vmm_swap_chunks_mask(slot->chunk, slot->chunks);
+    if (_vmm_swap_pool_used[id]) {
+        return;
+    }
+
+    vmm_unmap_page_lockless(_vmm_swap_pool_zone.start + id * VMM_PAGE_SIZE);
+    pmm_free_frame((void*)_vmm_swap_pool_frames[id]);
+    _vmm_swap_pool_frames[id] = 0;
+    _vmm_swap_stat.pool_pages--;
+}
+
+static uint32_t _vmm_swap_find_free_slot_lockless()
+{
+    for (uint32_t i = 0; i < VMM_SWAP_SLOTS; i++) {
+        uint32_t id = _vmm_swap_next_slot;
+        _vmm_swap_next_slot = (id == VMM_SWAP_SLOTS) ? 1 : id + 1;
+        if (!_vmm_swap_slots[id].refs) {
+            return id;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Compresses the page at @src into the pool. Returns the slot, or 0 if
+ * the page doesn't compress well or the pool is full.
+ */
+static uint32_t _vmm_swap_store_lockless(const void* src)
+{
+    uint32_t id = _vmm_swap_find_free_slot_lockless();
+    if (!id) {
+        return 0;
+    }
+
+    // The length is known only after the compression, so chunks are taken afterwards.
+    int len = lz4_compress(&_vmm_swap_lz4, src, VMM_PAGE_SIZE, _vmm_swap_buf, sizeof(_vmm_swap_buf));
+    if (len <= 0) {
+        _vmm_swap_stat.rejected++;
+        return 0;
+    }
+
+    vmm_swap_slot_t* slot = &_vmm_swap_slots[id];
+    uint32_t chunks = (len + VMM_SWAP_CHUNK_SIZE - 1) / VMM_SWAP_CHUNK_SIZE;
+    if (!_vmm_swap_pool_alloc_lockless(slot, chunks)) {
+        return 0;
+    }
+
+    memcpy(_vmm_swap_slot_data(slot), _vmm_swap_buf, len);
+    slot->len = len;
+    slot->refs = 1;
+    _vmm_swap_stat.stored_pages++;
+    _vmm_swap_stat.stored_bytes += len;
+    _vmm_swap_stat.swapouts++;
+    return id;
+}
+
+static void _vmm_swap_dup(uint32_t id)
+{
+    lock_acquire(&_vmm_swap_lock);
+    _vmm_swap_slots[id].refs++;
+    lock_release(&_vmm_swap_lock);
+}
+
+static void _vmm_swap_put(uint32_t id)
+{
+    lock_acquire(&_vmm_swap_lock);
+    vmm_swap_slot_t* slot = &_vmm_swap_slots[id];
+    if (slot->refs && !--slot->refs) {
+        _vmm_swap_pool_free_lockless(slot);
+        _vmm_swap_stat.stored_pages--;
+        _vmm_swap_stat.stored_bytes -= slot->len;
+    }
+    lock_release(&_vmm_swap_lock);
+}
+
+static bool _vmm_is_swapped(uint32_t vaddr)
+{
+    table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
+    if (!table_desc_is_present(*ptable_desc) || table_desc_is_4mb(*ptable_desc)) {
+        return false;
+    }
+
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    return page_desc_is_swapped(*page);
+}
+
+/**
+ * Brings the page at @vaddr of the active address space back from the
+ * pool. Returns 1 if the page is back, 0 if it is not swapped out, and
+ * SHOULD_CRASH if it can't be brought back, then the page stays swapped
+ * out and the access which needs it kills the process.
+ */
+static int _vmm_try_swap_in(uint32_t vaddr)
+{
+    if (PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER || vmm_get_active_pdir() == vmm_get_kernel_pdir()) {
+        return 0;
+    }
+
+    if (!_vmm_is_swapped(vaddr)) {
+        return 0;
+    }
+
+    // The page is brought back into own tables, other address spaces keep their slot.
+    if (_vmm_is_table_copy_on_write(vaddr)) {
+        _vmm_resolve_table_copy_on_write(vaddr);
+    }
+
+    proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
+    if (!holder_proc) {
+        kpanic("No proc with the pdir\n");
+    }
+
+    proc_zone_t* zone = proc_find_zone(holder_proc, vaddr);
+    if (!zone) {
+        return 0;
+    }
+
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    vmm_swap_slot_t* slot = &_vmm_swap_slots[page_desc_get_swap_slot(*page)];
+
+    uint32_t paddr = _vmm_alloc_page_paddr();
+    if (!paddr) {
+        return SHOULD_CRASH;
+    }
+
+    lock_acquire(&_vmm_swap_lock);
+    vmm_map_page_lockless(_vmm_swap_window.start, paddr, PAGE_READABLE | PAGE_WRITABLE);
+    int len = lz4_decompress(_vmm_swap_slot_data(slot), slot->len, _vmm_swap_window.ptr, VMM_PAGE_SIZE);
+    vmm_unmap_page_lockless(_vmm_swap_window.start);
+    _vmm_swap_stat.swapins++;
+    lock_release(&_vmm_swap_lock);
+
+    if (len != VMM_PAGE_SIZE) {
+        log_warn("VMM: swapped page at %x is broken", vaddr);
+        _vmm_free_page_paddr(paddr);
+        return SHOULD_CRASH;
+    }
+
+    // Mapping over the swapped descriptor drops its slot.
+    vmm_map_page_lockless(vaddr, paddr, zone->flags);
+    return 1;
+}
+
+/**
+ * RECLAIM FUNCTIONS
+ *
+ * Reclaim runs when the pmm is out of frames. Frames of the file cache
+ * which nobody maps are dropped first, then private pages of processes
+ * are compressed into the pool. Pages are picked by a clock: its hand
+ * walks user tables of processes one after another, a page accessed since
+ * the hand passed it last time gets a second chance. Arm has no accessed
+ * bit, so pages are just taken in the order of the walk there.
+ *
+ * The allocation which failed could hold any of the vmm locks, so reclaim
+ * only tries to take them. Busy address spaces are skipped.
+ */
+
+static uint32_t _vmm_reclaim_file_cache()
+{
+    if (!_vmm_file_cache_used || !lock_try_acquire(&_vmm_lock)) {
+        return 0;
+    }
+
+    uint32_t freed = 0;
+    for (int i = 0; i < VMM_FILE_CACHE_SIZE; i++) {
+        vmm_file_page_t* page = &_vmm_file_cache[i];
+        if (page->inode_indx && !_vmm_frame_is_shared(page->paddr)) {
+            _vmm_file_cache_drop_lockless(page);
+            freed++;
+        }
+    }
+    _vmm_swap_stat.dropped_file_pages += freed;
+    lock_release(&_vmm_lock);
+    return freed;
+}
+
+// Shared frames, device memory and pages of files are left where they are.
+static inline bool _vmm_is_swappable_zone(proc_zone_t* zone)
+{
+    uint32_t not_private = ZONE_TYPE_DEVICE | ZONE_TYPE_MAPPED_FILE_SHAREDLY | ZONE_TYPE_SHARED_BUFFER;
+    return _vmm_is_accessible_zone(zone) && !(zone->type & not_private);
+}
+
+/**
+ * Threads of the process could write to the page through their TLBs, so
+ * the page is taken away before it's compressed.
+ */
+static bool _vmm_swap_out_page_lockless(page_desc_t* page, uint32_t vaddr)
+{
+    page_desc_t orig_page = *page;
+    uint32_t frame = page_desc_get_frame(*page);
+    page_desc_del_attrs(page, PAGE_DESC_PRESENT);
+    _vmm_flush_tlb_entry(vaddr);
+
+    lock_acquire(&_vmm_swap_lock);
+    vmm_map_page_lockless(_vmm_swap_window.start, frame, PAGE_READABLE);
+    uint32_t slot = _vmm_swap_store_lockless(_vmm_swap_window.ptr);
+    vmm_unmap_page_lockless(_vmm_swap_window.start);
+    lock_release(&_vmm_swap_lock);
+
+    if (!slot) {
+        *page = orig_page;
+        return false;
+    }
+
+    page_desc_set_swapped(page, slot);
+    _vmm_free_page_paddr(frame);
+    return true;
+}
+
+/**
+ * Moves the hand through the active address space, which belongs to @p,
+ * until @target pages are swapped out. The hand is reset to 0 once it
+ * reaches the kernel.
+ */
+static uint32_t _vmm_swap_out_proc_lockless(proc_t* p, uint32_t target)
+{
+    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
+    uint32_t freed = 0;
+    uint32_t vaddr = _vmm_reclaim_hand_vaddr;
+
+    while (freed < target && vaddr < KERNEL_BASE) {
+        table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
+        if (!table_desc_is_present(*ptable_desc) || table_desc_is_4mb(*ptable_desc) || _vmm_is_table_copy_on_write(vaddr)) {
+            vaddr = TABLE_START(vaddr) + table_coverage;
+            continue;
+        }
+
+        ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+        page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+        uint32_t page_vaddr = vaddr;
+        vaddr += VMM_PAGE_SIZE;
+
+        if (!page_desc_is_present(*page)) {
+            continue;
+        }
+
+        uint32_t frame = page_desc_get_frame(*page);
+        if (frame == _vmm_zero_page_paddr || _vmm_frame_is_shared(frame)) {
+            continue;
+        }
+
+#ifdef __i386__
+        // Clearing the bit without a flush only makes the cpu set it later.
+        if (page_desc_has_attrs(*page, PAGE_DESC_ACCESSED)) {
+            page_desc_del_attrs(page, PAGE_DESC_ACCESSED);
+            continue;
+        }
+#endif
+
+        proc_zone_t* zone = proc_find_zone(p, page_vaddr);
+        if (!zone || !_vmm_is_swappable_zone(zone)) {
+            continue;
+        }
+
+        freed += _vmm_swap_out_page_lockless(page, page_vaddr);
+    }
+
+    _vmm_reclaim_hand_vaddr = (vaddr < KERNEL_BASE) ? vaddr : 0;
+    return freed;
+}
+
+/**
+ * Frees up to @target frames, returns how many were freed. Only one cpu
+ * reclaims at a time, others just fail their allocations.
+ */
+static uint32_t _vmm_reclaim(uint32_t target)
+{
+    int reclaiming = 0;
+    if (!_vmm_swap_pool_limit || !__atomic_compare_exchange_n(&_vmm_reclaiming, &reclaiming, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    uint32_t freed = _vmm_reclaim_file_cache();
+    pdirectory_t* prev_pdir = vmm_get_active_pdir();
+
+    // Every process is visited twice, so pages which got the second chance are taken too.
+    for (uint32_t visited = 0; freed < target && visited < 2 * MAX_PROCESS_COUNT; visited++) {
+        proc_t* p = &proc[_vmm_reclaim_hand_proc];
+        pdirectory_t* pdir = p->pdir;
+        bool swapped_out = false;
+        if (p->status == PROC_ALIVE && pdir && pdir != _vmm_kernel_pdir && lock_try_acquire(_vmm_space_lock(pdir))) {
+            // The process could die before the lock was taken.
+            if (p->status == PROC_ALIVE && p->pdir == pdir) {
+                vmm_switch_pdir_lockless(pdir);
+                freed += _vmm_swap_out_proc_lockless(p, target - freed);
+                swapped_out = true;
+            }
+            lock_release(_vmm_space_lock(pdir));
+        }
+
+        if (!swapped_out || !_vmm_reclaim_hand_vaddr) {
+            _vmm_reclaim_hand_proc = (_vmm_reclaim_hand_proc + 1) % MAX_PROCESS_COUNT;
+            _vmm_reclaim_hand_vaddr = 0;
+        }
+    }
+
+    vmm_switch_pdir_lockless(prev_pdir);
+    __atomic_store_n(&_vmm_reclaiming, 0, __ATOMIC_RELEASE);
+    return freed;
+}
+
+void vmm_get_swap_stat(vmm_swap_stat_t* stat)
+{
+    lock_acquire(&_vmm_swap_lock);
+    *stat = _vmm_swap_stat;
+    lock_release(&_vmm_swap_lock);
+}
+
 /**
  * PF HANDLER FUNCTIONS
  */
@@ -1207,29 +3009,43 @@ static ALWAYS_INLINE int vmm_tune_page_lockless(uint32_t vaddr, uint32_t setting
     bool is_readable = ((settings & PAGE_READABLE) > 0);
     bool is_executable = ((settings & PAGE_EXECUTABLE) > 0);
     bool is_not_cacheable = ((settings & PAGE_NOT_CACHEABLE) > 0);
+    bool is_write_combining = ((settings & PAGE_WRITE_COMBINING) > 0) && !is_not_cacheable;
     bool is_cow = ((settings & PAGE_COW) > 0);
     bool is_user = ((settings & PAGE_USER) > 0);
 
+    if (_vmm_is_large_page(vaddr)) {
+        _vmm_split_large_page_lockless(vaddr);
+    }
+
+    // The content of a swapped out page is brought back before the new rights are applied.
+    if (_vmm_try_swap_in(vaddr) == SHOULD_CRASH) {
+        return -ENOMEM;
+    }
+
     ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
     page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
 
     if (page_desc_is_present(*page)) {
+        // The zero page stays read-only, it gets a private frame on the first write.
+        is_writable &= (page_desc_get_frame(*page) != _vmm_zero_page_paddr);
         is_user ? page_desc_set_attrs(page, PAGE_DESC_USER) : page_desc_del_attrs(page, PAGE_DESC_USER);
         is_writable ? page_desc_set_attrs(page, PAGE_DESC_WRITABLE) : page_desc_del_attrs(page, PAGE_DESC_WRITABLE);
         is_not_cacheable ? page_desc_set_attrs(page, PAGE_DESC_NOT_CACHEABLE) : page_desc_del_attrs(page, PAGE_DESC_NOT_CACHEABLE);
+        is_write_combining ? page_desc_set_attrs(page, PAGE_DESC_WRITE_COMBINING) : page_desc_del_attrs(page, PAGE_DESC_WRITE_COMBINING);
     } else {
         vmm_load_page_lockless(vaddr, settings);
     }
 
-    system_flush_tlb_entry(vaddr);
+    _vmm_flush_tlb_entry(vaddr);
     return 0;
 }
 
 int vmm_tune_page(uint32_t vaddr, uint32_t settings)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_tune_page_lockless(vaddr, settings);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -1245,9 +3061,10 @@ static ALWAYS_INLINE int vmm_tune_pages_lockless(uint32_t vaddr, uint32_t length
 
 int vmm_tune_pages(uint32_t vaddr, uint32_t length, uint32_t settings)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_tune_pages_lockless(vaddr, length, settings);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -1255,7 +3072,6 @@ static ALWAYS_INLINE int vmm_load_page_lockless(uint32_t vaddr, uint32_t setting
 {
     uint32_t paddr = _vmm_alloc_page_paddr();
     if (!paddr) {
-        /* TODO: Swap pages to make it able to allocate. */
         kpanic("NO PHYSICAL SPACE");
     }
     int res = vmm_map_page_lockless(vaddr, paddr, settings);
@@ -1266,20 +3082,20 @@ static ALWAYS_INLINE int vmm_load_page_lockless(uint32_t vaddr, uint32_t setting
 
 int vmm_load_page(uint32_t vaddr, uint32_t settings)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     if (_vmm_is_page_present(vaddr)) {
-        lock_release(&_vmm_lock);
+        lock_release(lock);
         return -EALREADY;
     }
 
     uint32_t paddr = _vmm_alloc_page_paddr();
     if (!paddr) {
-        /* TODO: Swap pages to make it able to allocate. */
         kpanic("NO PHYSICAL SPACE");
     }
     int res = vmm_map_page_lockless(vaddr, paddr, settings);
     uint8_t* dest = (uint8_t*)_vmm_round_floor_to_page(vaddr);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     memset(dest, 0, VMM_PAGE_SIZE);
     return res;
 }
@@ -1292,6 +3108,10 @@ static ALWAYS_INLINE int vmm_copy_page_lockless(uint32_t to_vaddr, uint32_t src_
 {
     page_desc_t* old_page_desc = _vmm_ptable_lookup(src_ptable, src_vaddr);
 
+    if (_vmm_is_large_page(to_vaddr)) {
+        _vmm_split_large_page_lockless(to_vaddr);
+    }
+
     /* Based on an old page */
     ptable_t* cur_ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(to_vaddr);
     page_desc_t* cur_page = _vmm_ptable_lookup(cur_ptable, to_vaddr);
@@ -1318,14 +3138,21 @@ static ALWAYS_INLINE int vmm_copy_page_lockless(uint32_t to_vaddr, uint32_t src_
 
 int vmm_copy_page(uint32_t to_vaddr, uint32_t src_vaddr, ptable_t* src_ptable)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(to_vaddr);
+    lock_acquire(lock);
     int res = vmm_copy_page_lockless(to_vaddr, src_vaddr, src_ptable);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
 static ALWAYS_INLINE int vmm_free_page_lockless(uint32_t vaddr, page_desc_t* page, dynamic_array_t* zones)
 {
+    if (page_desc_is_swapped(*page)) {
+        _vmm_swap_put(page_desc_get_swap_slot(*page));
+        page_desc_del_frame(page);
+        return 0;
+    }
+
     if (!page_desc_has_attrs(*page, PAGE_DESC_PRESENT)) {
         return 0;
     }
@@ -1336,31 +3163,114 @@ static ALWAYS_INLINE int vmm_free_page_lockless(uint32_t vaddr, page_desc_t* pag
         if (zone->type & ZONE_TYPE_DEVICE) {
             return 0;
         }
+        if (zone->type & ZONE_TYPE_SHARED_BUFFER) {
+            _vmm_frame_unshare(page_desc_get_frame(*page));
+            return 0;
+        }
+    }
+
+    // The zero page and frames mapped by other address spaces are not freed.
+    uint32_t frame = page_desc_get_frame(*page);
+    if (frame == _vmm_zero_page_paddr || _vmm_frame_unshare(frame)) {
+        return 0;
     }
-    _vmm_free_page_paddr(page_desc_get_frame(*page));
+    _vmm_free_page_paddr(frame);
     return 0;
 }
 
 int vmm_free_page(uint32_t vaddr, page_desc_t* page, dynamic_array_t* zones)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_free_page_lockless(vaddr, page, zones);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
+/**
+ * The write is allowed by descriptors already, the fault was caused by
+ * a stale TLB entry which was left after access rights were extended.
+ */
+static bool _vmm_is_write_fault_spurious(uint32_t vaddr)
+{
+    if (!_vmm_is_page_present(vaddr)) {
+        return false;
+    }
+
+    table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
+    if (table_desc_is_4mb(*ptable_desc)) {
+        return table_desc_is_writable(*ptable_desc);
+    }
+
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    return table_desc_is_writable(*ptable_desc) && page_desc_is_writable(*page);
+}
+
+enum VMM_FAULT_TYPES {
+    VMM_FAULT_MINOR,
+    VMM_FAULT_COW,
+    VMM_FAULT_FILE,
+    VMM_FAULT_SWAP,
+};
+
+/**
+ * Counts a resolved fault of a user page to the running thread.
+ */
+static void _vmm_account_fault(uint32_t vaddr, int type)
+{
+    thread_t* thread = RUNNING_THREAD;
+    if (!thread || PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER) {
+        return;
+    }
+
+    switch (type) {
+    case VMM_FAULT_MINOR:
+        thread->stat_minor_faults++;
+        break;
+    case VMM_FAULT_COW:
+        thread->stat_cow_faults++;
+        break;
+    // Both bring the content in from outside of the address space.
+    case VMM_FAULT_FILE:
+    case VMM_FAULT_SWAP:
+        thread->stat_file_faults++;
+        break;
+    }
+}
+
 int vmm_page_fault_handler(uint32_t info, uint32_t vaddr)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    trace_point(TRACE_PAGE_FAULT, vaddr, info, 0);
+    lock_acquire(lock);
     if (_vmm_is_table_not_present(info) || _vmm_is_page_not_present(info)) {
         // Check again with locks, since other cpu could already load this page.
         if (_vmm_is_page_present(vaddr)) {
-            lock_release(&_vmm_lock);
+            lock_release(lock);
+            return OK;
+        }
+
+        // Loading a page into shared tables would make it visible to other address spaces.
+        if (_vmm_is_table_copy_on_write(vaddr)) {
+            _vmm_resolve_table_copy_on_write(vaddr);
+        }
+
+        int swapped = _vmm_try_swap_in(vaddr);
+        if (swapped) {
+            if (swapped > 0) {
+                _vmm_account_fault(vaddr, VMM_FAULT_SWAP);
+            }
+            lock_release(lock);
+            return swapped > 0 ? OK : SHOULD_CRASH;
+        }
+
+        if (_vmm_is_caused_reading(info) && _vmm_try_map_zero_page(vaddr)) {
+            _vmm_account_fault(vaddr, VMM_FAULT_MINOR);
+            lock_release(lock);
             return OK;
         }
 
-        int res = _vmm_load_page_with_perm(vaddr);
-        lock_release(&_vmm_lock);
         if (PAGE_CHOOSE_OWNER(vaddr) == PAGE_USER && vmm_get_active_pdir() != vmm_get_kernel_pdir()) {
             proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
             if (!holder_proc) {
@@ -1368,44 +3278,144 @@ int vmm_page_fault_handler(uint32_t info, uint32_t vaddr)
             }
 
             proc_zone_t* zone = proc_find_zone(holder_proc, vaddr);
-            if (!zone) {
+            if (!zone || !_vmm_is_accessible_zone(zone)) {
+                lock_release(lock);
                 return SHOULD_CRASH;
             }
 
             if (zone->type & ZONE_TYPE_MAPPED_FILE_PRIVATLY) {
-                uint32_t offset = zone->offset + (PAGE_START(vaddr) - zone->start);
-                lock_acquire(&zone->file->lock);
-                zone->file->ops->file.read(zone->file, (void*)PAGE_START(vaddr), offset, VMM_PAGE_SIZE);
-                lock_release(&zone->file->lock);
+                _vmm_account_fault(vaddr, VMM_FAULT_FILE);
+                lock_release(lock);
+                return _vmm_load_file_pages(holder_proc, vaddr);
+            }
+
+            if (zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY) {
+                _vmm_account_fault(vaddr, VMM_FAULT_FILE);
+                lock_release(lock);
+                return _vmm_load_shared_file_page(holder_proc, vaddr, _vmm_is_caused_writing(info));
             }
         }
+
+        int res = _vmm_load_page_with_perm(vaddr);
+        _vmm_account_fault(vaddr, VMM_FAULT_MINOR);
+        lock_release(lock);
         return res;
     }
 
     if (_vmm_is_caused_writing(info)) {
         int visited = 0;
+        if (_vmm_is_table_copy_on_write(vaddr)) {
+            _vmm_resolve_table_copy_on_write(vaddr);
+            visited++;
+        }
         if (_vmm_is_copy_on_write(vaddr)) {
             proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
             if (!holder_proc) {
                 kpanic("No proc with the pdir\n");
             }
-            _vmm_resolve_copy_on_write(holder_proc, vaddr);
+            if (_vmm_resolve_copy_on_write(holder_proc, vaddr) == 0) {
+                _vmm_account_fault(vaddr, VMM_FAULT_COW);
+                visited++;
+            }
+        }
+        if (_vmm_is_zeroing_on_demand(vaddr)) {
+            proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
+            if (!holder_proc) {
+                kpanic("No proc with the pdir\n");
+            }
+            if (_vmm_resolve_zeroing_on_demand(holder_proc, vaddr) == 0) {
+                _vmm_account_fault(vaddr, VMM_FAULT_MINOR);
+                visited++;
+            }
+        }
+        if (!visited && _vmm_is_write_fault_spurious(vaddr)) {
+            system_flush_tlb_entry(vaddr);
             visited++;
         }
-        // if (_vmm_is_zeroing_on_demand(vaddr)) {
-        //     _vmm_resolve_zeroing_on_demand(vaddr);
-        //     visited++;
-        // }
         if (!visited) {
-            lock_release(&_vmm_lock);
+            lock_release(lock);
             return SHOULD_CRASH;
         }
     }
 
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return OK;
 }
 
+/**
+ * ASIDS
+ *
+ * On a tagged TLB every pdir gets an address space id, so entries of the
+ * pdirs a cpu switched away from stay warm till it comes back. The id of
+ * a pdir is kept in a slot picked by the pdir, like space locks are, a pdir
+ * which lost its slot gets a fresh id on its next switch. Ids are handed
+ * out in generations and never twice in one, once they run out the
+ * generation is bumped and every cpu flushes its TLB before it takes an id
+ * of the new one. Id 0 is reserved for the switch itself.
+ */
+
+static bool _vmm_is_global_vaddr(uint32_t vaddr)
+{
+    // Pspace is the only part of the kernel half which differs between pdirs.
+    return PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER && (vaddr < pspace_zone.start || vaddr >= pspace_zone.start + pspace_zone.len);
+}
+
+static ALWAYS_INLINE vmm_asid_slot_t* _vmm_asid_slot(pdirectory_t* pdir)
+{
+    return &_vmm_asid_slots[((uint32_t)pdir / PDIR_SIZE) % VMM_ASID_SLOTS];
+}
+
+/**
+ * Returns the id of the pdir, called with interrupts off. A cpu which
+ * missed a rollover flushes its TLB here.
+ */
+static uint32_t _vmm_asid_get(pdirectory_t* pdir)
+{
+    uint32_t count = system_tlb_asid_count();
+    lock_acquire(&_vmm_asid_lock);
+    vmm_asid_slot_t* slot = _vmm_asid_slot(pdir);
+    if (slot->pdir != pdir || slot->asid - (slot->asid % count) != _vmm_asid_generation) {
+        if (_vmm_asid_next == count) {
+            _vmm_asid_generation += count;
+            _vmm_asid_next = 1;
+        }
+        slot->pdir = pdir;
+        slot->asid = _vmm_asid_generation + _vmm_asid_next++;
+    }
+
+    uint32_t asid = slot->asid % count;
+    int cpu = system_cpu_id();
+    bool missed_rollover = _vmm_cpu_asid_generation[cpu] != _vmm_asid_generation;
+    _vmm_cpu_asid_generation[cpu] = _vmm_asid_generation;
+    lock_release(&_vmm_asid_lock);
+
+    if (missed_rollover) {
+        system_flush_whole_tlb();
+    }
+    return asid;
+}
+
+/**
+ * A freed pdir gives up its slot, so a pdir allocated at the same place
+ * can't take over the entries which are still tagged with its id.
+ */
+static void _vmm_asid_release(pdirectory_t* pdir)
+{
+    if (!system_tlb_asid_count()) {
+        return;
+    }
+
+    system_disable_interrupts();
+    lock_acquire(&_vmm_asid_lock);
+    vmm_asid_slot_t* slot = _vmm_asid_slot(pdir);
+    if (slot->pdir == pdir) {
+        slot->pdir = NULL;
+        slot->asid = 0;
+    }
+    lock_release(&_vmm_asid_lock);
+    system_enable_interrupts();
+}
+
 /**
  * CPU BASED FUNCTIONS
  */
@@ -1426,7 +3436,12 @@ static ALWAYS_INLINE int vmm_switch_pdir_lockless(pdirectory_t* pdir)
         return 0;
     }
     THIS_CPU->pdir = pdir;
-    system_set_pdir((uint32_t)_vmm_convert_vaddr2paddr((uint32_t)pdir));
+    uint32_t pdir_paddr = (uint32_t)_vmm_convert_vaddr2paddr((uint32_t)pdir);
+    if (system_tlb_asid_count()) {
+        system_set_pdir_asid(pdir_paddr, _vmm_asid_get(pdir));
+    } else {
+        system_set_pdir(pdir_paddr);
+    }
     system_enable_interrupts();
     return 0;
 }
@@ -13,6 +13,7 @@
 #include <drivers/aarch32/uart.h>
 #include <platform/aarch32/init.h>
 #include <platform/aarch32/interrupts.h>
+#include <platform/aarch32/registers.h>
 
 /**
  * platform_init_boot_cpu initializes bare minimum to setup VM.
@@ -22,10 +23,35 @@ void platform_init_boot_cpu()
     interrupts_setup();
 }
 
+/**
+ * Starts the cycle counter and lets userspace read it. It ticks once in 64
+ * cycles (PMCR.D), so it wraps in minutes and not in seconds.
+ */
+static void _platform_enable_cycle_counter()
+{
+    write_pmcr((1 << 0) | (1 << 2) | (1 << 3));
+    write_pmcntenset(1 << 31);
+    write_pmuserenr(1);
+}
+
+/**
+ * Lets userspace read the virtual count of the generic timer (PL0VCTEN),
+ * the clock of the time page is interpolated with it.
+ */
+static void _platform_enable_virtual_counter()
+{
+    if (!((read_id_pfr1() >> 16) & 0xf)) {
+        return;
+    }
+    write_cntkctl(read_cntkctl() | (1 << 1));
+}
+
 void platform_setup_boot_cpu()
 {
     fpuv4_install();
     gic_setup();
+    _platform_enable_cycle_counter();
+    _platform_enable_virtual_counter();
 }
 
 void platform_setup_secondary_cpu()
@@ -33,6 +59,8 @@ void platform_setup_secondary_cpu()
     interrupts_setup_secondary_cpu();
     fpuv4_install();
     gic_setup_secondary_cpu();
+    _platform_enable_cycle_counter();
+    _platform_enable_virtual_counter();
 }
 
 void platform_drivers_setup()
@@ -44,4 +72,5 @@ void platform_drivers_setup()
     pl050_keyboard_install();
     pl050_mouse_install();
     pl031_install();
+    uart_install();
 }
\ No newline at end of file
@@ -6,7 +6,9 @@
 
 #include <drivers/aarch32/gicv2.h>
 #include <libkern/libkern.h>
+#include <libkern/lock.h>
 #include <libkern/log.h>
+#include <mem/vmm/uaccess.h>
 #include <mem/vmm/vmm.h>
 #include <platform/aarch32/interrupts.h>
 #include <platform/aarch32/system.h>
@@ -15,6 +17,7 @@
 #include <syscalls/handlers.h>
 #include <tasking/cpu.h>
 #include <tasking/dump.h>
+#include <tasking/tasklet.h>
 #include <tasking/tasking.h>
 
 #define ERR_BUF_SIZE 64
@@ -28,6 +31,15 @@ static void _irq_empty_handler();
 static inline void _irq_redirect(int int_no);
 static void init_irq_handlers();
 
+/* IRQ affinity */
+static lock_t _irq_affinity_lock;
+static int _irq_requested_mask[IRQ_HANDLERS_MAX];
+static bool _irq_interactive[IRQ_HANDLERS_MAX];
+static int _irq_interactive_mask = BALANCED_CPU_MASK;
+static int _irq_online_cpu_masks[CPU_CNT];
+static int _irq_online_cpus = 0;
+static void _irq_add_online_cpu();
+
 static inline uint32_t is_interrupt_enabled()
 {
     return ((read_cpsr() >> 7) & 1) == 0;
@@ -63,12 +75,15 @@ void interrupts_setup_secondary_cpu()
 
 void gic_setup()
 {
+    lock_init(&_irq_affinity_lock);
     gicv2_install();
+    _irq_add_online_cpu();
 }
 
 void gic_setup_secondary_cpu()
 {
     gicv2_install_secondary_cpu();
+    _irq_add_online_cpu();
 }
 
 void irq_set_gic_desc(gic_descritptor_t gic_desc)
@@ -88,19 +103,7 @@ void undefined_handler(trapframe_t* tf)
         goto undefined_h;
     }
 
-    fpu_make_avail();
-
-    if (RUNNING_THREAD->tid == THIS_CPU->fpu_for_pid) {
-        return;
-    }
-
-    if (THIS_CPU->fpu_for_thread && THIS_CPU->fpu_for_thread->tid == THIS_CPU->fpu_for_pid) {
-        fpu_save(THIS_CPU->fpu_for_thread->fpu_state);
-    }
-
-    fpu_restore(RUNNING_THREAD->fpu_state);
-    THIS_CPU->fpu_for_thread = RUNNING_THREAD;
-    THIS_CPU->fpu_for_pid = RUNNING_THREAD->tid;
+    thread_fpu_handle_trap();
     system_enable_interrupts_only_counter();
     return;
 #endif // FPU_ENABLED
@@ -146,6 +149,9 @@ void data_abort_handler(trapframe_t* tf)
     uint32_t is_pl0 = read_spsr() & 0xf; // See CPSR M field values
     info |= ((is_pl0 != 0) << 31); // Set the 31bit as type
     int res = vmm_page_fault_handler(info, fault_addr);
+    if (res == SHOULD_CRASH && !tf_is_from_user(tf) && uaccess_fixup(tf)) {
+        res = OK;
+    }
     if (res == SHOULD_CRASH) {
         if (THIS_CPU->current_state == CPU_IN_KERNEL || !RUNNING_THREAD) {
             snprintf(err_buf, ERR_BUF_SIZE, "Kernel trap at %x, data_abort_handler", tf->user_ip);
@@ -184,11 +190,13 @@ void irq_handler(trapframe_t* tf)
 {
     system_disable_interrupts();
     cpu_enter_kernel_space();
+    THIS_CPU->irq_tf = tf;
     uint32_t int_disc = gic_descriptor.interrupt_descriptor();
     /* We end the interrupt before handle it, since we can
        call sched() and not return here. */
     gic_descriptor.end_interrupt(int_disc);
     _irq_redirect(int_disc & 0x1ff);
+    tasklets_run();
     cpu_leave_kernel_space();
     system_enable_interrupts_only_counter();
 }
@@ -199,8 +207,75 @@ void fast_irq_handler()
     ASSERT(false);
 }
 
+/**
+ * Targets every registered irq again. Balanced irqs are dealt round robin
+ * over the online cpus, so a cpu coming online takes its share of them.
+ * Interactive irqs are kept together on the cpu they were pinned to.
+ */
+static void _irq_rebalance_locked()
+{
+    int next_cpu = 0;
+    for (irq_line_t line = 0; line < IRQ_HANDLERS_MAX; line++) {
+        if (_irq_handlers[line] == _irq_empty_handler) {
+            continue;
+        }
+
+        int mask = _irq_requested_mask[line];
+        if (_irq_interactive[line] && _irq_interactive_mask != BALANCED_CPU_MASK) {
+            mask = _irq_interactive_mask;
+        }
+        if (mask == BALANCED_CPU_MASK) {
+            mask = _irq_online_cpus ? _irq_online_cpu_masks[next_cpu++ % _irq_online_cpus] : BOOT_CPU_MASK;
+        }
+        gic_descriptor.set_affinity(line, mask);
+    }
+}
+
+static void _irq_add_online_cpu()
+{
+    lock_acquire(&_irq_affinity_lock);
+    if (_irq_online_cpus < CPU_CNT) {
+        _irq_online_cpu_masks[_irq_online_cpus++] = gic_descriptor.this_cpu_mask();
+    }
+    _irq_rebalance_locked();
+    lock_release(&_irq_affinity_lock);
+}
+
 void irq_register_handler(irq_line_t line, irq_priority_t prior, irq_type_t type, irq_handler_t func, int cpu_mask)
 {
+    lock_acquire(&_irq_affinity_lock);
     _irq_handlers[line] = func;
-    gic_descriptor.enable_irq(line, prior, type, cpu_mask);
+    _irq_requested_mask[line] = cpu_mask;
+    _irq_interactive[line] = ((type & IRQ_TYPE_INTERACTIVE_MASK) == IRQ_TYPE_INTERACTIVE_MASK);
+    gic_descriptor.enable_irq(line, prior, type, cpu_mask == BALANCED_CPU_MASK ? BOOT_CPU_MASK : cpu_mask);
+    _irq_rebalance_locked();
+    lock_release(&_irq_affinity_lock);
+}
+
+void irq_set_affinity(irq_line_t line, int cpu_mask)
+{
+    lock_acquire(&_irq_affinity_lock);
+    _irq_requested_mask[line] = cpu_mask;
+    _irq_rebalance_locked();
+    lock_release(&_irq_affinity_lock);
+}
+
+/**
+ * Routes all interactive irqs to the cpus of the mask, so their data is
+ * hot in the cache of the cpu running window_server. BALANCED_CPU_MASK
+ * gives them back to their own affinity.
+ */
+void irq_pin_interactive(int cpu_mask)
+{
+    lock_acquire(&_irq_affinity_lock);
+    if (_irq_interactive_mask != cpu_mask) {
+        _irq_interactive_mask = cpu_mask;
+        _irq_rebalance_locked();
+    }
+    lock_release(&_irq_affinity_lock);
+}
+
+int irq_this_cpu_mask()
+{
+    return gic_descriptor.this_cpu_mask();
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/libkern.h>
+#include <platform/aarch32/pmu.h>
+#include <platform/aarch32/registers.h>
+
+/**
+ * ARMv7 PMU, the counters are enabled together with the cycle counter in
+ * platform setup. Cache and TLB misses are refills of L1D and its TLB.
+ */
+static const uint8_t _pmu_events[PERF_EVENT_COUNT] = {
+    [PERF_EVENT_CYCLES] = 0x11,
+    [PERF_EVENT_INSTRUCTIONS] = 0x08,
+    [PERF_EVENT_CACHE_MISSES] = 0x03,
+    [PERF_EVENT_BRANCH_MISSES] = 0x10,
+    [PERF_EVENT_TLB_MISSES] = 0x05,
+};
+
+int pmu_counters_count()
+{
+    return min((read_pmcr() >> 11) & 0x1f, (uint32_t)PERF_MAX_COUNTERS);
+}
+
+bool pmu_supports(int event)
+{
+    return event >= 0 && event < PERF_EVENT_COUNT && pmu_counters_count();
+}
+
+void pmu_start(int counter, int event)
+{
+    write_pmselr(counter);
+    write_pmxevtyper(_pmu_events[event]);
+    write_pmxevcntr(0);
+    write_pmcntenset(1 << counter);
+}
+
+void pmu_stop(int counter)
+{
+    write_pmcntenclr(1 << counter);
+}
+
+uint32_t pmu_read(int counter)
+{
+    write_pmselr(counter);
+    return read_pmxevcntr();
+}
@@ -9,6 +9,8 @@
 mem_desc_t arm_mem_desc = {
     .memory_map_size = 2,
     .kernel_size = 500, // TODO: do it automatically
+    .initrd_start = 0x84000000, // Put there by the loader device of qemu, checked for a cpio magic before use.
+    .initrd_size = 0x1000000,
 };
 
 static memory_map_t arm_memmap_local[] = {
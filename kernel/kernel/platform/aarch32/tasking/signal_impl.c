@@ -18,7 +18,7 @@ int signal_impl_prepare_stack(thread_t* thread, int signo, uint32_t old_sp, uint
     tf_push_to_stack(thread->tf, thread->tf->user_flags);
     tf_push_to_stack(thread->tf, magic);
     thread->tf->r[0] = signo;
-    thread->tf->r[1] = (uint32_t)thread->signal_handlers[signo];
+    thread->tf->r[1] = (uint32_t)thread->cold->signal_handlers[signo];
     return 0;
 }
 
@@ -7,16 +7,27 @@
 #include <drivers/generic/fpu.h>
 #include <mem/vmm/vmm.h>
 #include <platform/aarch32/interrupts.h>
+#include <platform/aarch32/registers.h>
 #include <platform/generic/system.h>
 #include <platform/generic/tasking/trapframe.h>
 #include <tasking/tasking.h>
 
+/**
+ * The thread pointer lives in TPIDRURO, userspace reads it with
+ * mrc p15, 0, rX, c13, c0, 3.
+ */
+void switchtls(thread_t* thread)
+{
+    write_tpidruro(thread->tls);
+}
+
 /* switching the page dir and tss to the current proc */
 void switchuvm(thread_t* thread)
 {
     system_disable_interrupts();
+    thread_fpu_switch(thread);
     RUNNING_THREAD = thread;
+    switchtls(thread);
     vmm_switch_pdir(thread->process->pdir);
-    fpu_make_unavail();
     system_enable_interrupts();
 }
\ No newline at end of file
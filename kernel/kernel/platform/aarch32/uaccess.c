@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <mem/vmm/uaccess.h>
+
+/**
+ * Words while both pointers are aligned, bytes otherwise. The pointers and
+ * the count move only after a store, so at a fault len is the bytes left.
+ */
+uint32_t uaccess_copy_raw(void* dest, const void* src, uint32_t len)
+{
+    uint32_t tmp;
+    asm volatile("   orr %3, %0, %1\n"
+                 "   tst %3, #3\n"
+                 "   bne 3f\n"
+                 "1: cmp %2, #4\n"
+                 "   blo 3f\n"
+                 "2: ldr %3, [%1]\n"
+                 "5: str %3, [%0]\n"
+                 "   add %1, %1, #4\n"
+                 "   add %0, %0, #4\n"
+                 "   sub %2, %2, #4\n"
+                 "   b 1b\n"
+                 "3: cmp %2, #0\n"
+                 "   beq 4f\n"
+                 "6: ldrb %3, [%1]\n"
+                 "7: strb %3, [%0]\n"
+                 "   add %1, %1, #1\n"
+                 "   add %0, %0, #1\n"
+                 "   sub %2, %2, #1\n"
+                 "   b 3b\n"
+                 "4:\n"
+                 ".pushsection .uaccess_fixup, \"a\"\n"
+                 ".long 2b, 4b\n"
+                 ".long 5b, 4b\n"
+                 ".long 6b, 4b\n"
+                 ".long 7b, 4b\n"
+                 ".popsection\n"
+                 : "+r"(dest), "+r"(src), "+r"(len), "=&r"(tmp)
+                 :
+                 : "cc", "memory");
+    return len;
+}
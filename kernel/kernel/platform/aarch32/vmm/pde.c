@@ -6,6 +6,33 @@
 
 #include <platform/aarch32/vmm/pde.h>
 
+static inline bool _table_desc_is_section(table_desc_t pde)
+{
+    return pde.section.type == 0b10;
+}
+
+/**
+ * Turns the descriptor into a section. Access rights are the same
+ * as page_desc_init sets for pages.
+ */
+static inline void _table_desc_init_section(table_desc_t* pde)
+{
+    pde->data = 0;
+    pde->section.type = 0b10;
+    pde->section.domain = 0b0011;
+    pde->section.ap1 = 0b01; // Kernel -- R/W and User -- No access
+    pde->section.c = 1;
+    pde->section.s = 1;
+    pde->section.b = 1;
+    pde->section.tex = 0b001;
+    pde->section.ng = 1; // User sections must not survive a switch of ASID.
+}
+
+static inline bool _table_desc_section_is_writable(table_desc_t pde)
+{
+    return pde.section.ap1 == 0b01;
+}
+
 void table_desc_init(table_desc_t* pde)
 {
     pde->data = 0;
@@ -41,6 +68,26 @@ void table_desc_clear(table_desc_t* pde)
 
 void table_desc_set_attrs(table_desc_t* pde, uint32_t attrs)
 {
+    if ((attrs & TABLE_DESC_4MB) == TABLE_DESC_4MB) {
+        _table_desc_init_section(pde);
+    }
+    if (_table_desc_is_section(*pde)) {
+        if ((attrs & TABLE_DESC_USER) == TABLE_DESC_USER) {
+            pde->section.ap1 = 0b10 | _table_desc_section_is_writable(*pde);
+        }
+        if ((attrs & TABLE_DESC_WRITABLE) == TABLE_DESC_WRITABLE) {
+            pde->section.ap1 |= 0b01;
+        }
+        if ((attrs & TABLE_DESC_PCD) == TABLE_DESC_PCD) {
+            pde->section.c = 0;
+        }
+        if ((attrs & TABLE_DESC_WRITE_COMBINING) == TABLE_DESC_WRITE_COMBINING) {
+            pde->section.tex = 0b001;
+            pde->section.c = 0;
+            pde->section.b = 0;
+        }
+        return;
+    }
     if ((attrs & TABLE_DESC_PRESENT) == TABLE_DESC_PRESENT) {
         pde->valid = 1;
     }
@@ -51,6 +98,25 @@ void table_desc_set_attrs(table_desc_t* pde, uint32_t attrs)
 
 void table_desc_del_attrs(table_desc_t* pde, uint32_t attrs)
 {
+    if (_table_desc_is_section(*pde)) {
+        if ((attrs & TABLE_DESC_PRESENT) == TABLE_DESC_PRESENT) {
+            pde->data = 0;
+        }
+        if ((attrs & TABLE_DESC_WRITABLE) == TABLE_DESC_WRITABLE) {
+            pde->section.ap1 = 0b10;
+        }
+        if ((attrs & TABLE_DESC_USER) == TABLE_DESC_USER) {
+            pde->section.ap1 = 0b01;
+        }
+        if ((attrs & TABLE_DESC_PCD) == TABLE_DESC_PCD) {
+            pde->section.c = 1;
+        }
+        if ((attrs & TABLE_DESC_WRITE_COMBINING) == TABLE_DESC_WRITE_COMBINING) {
+            pde->section.c = 1;
+            pde->section.b = 1;
+        }
+        return;
+    }
     if ((attrs & TABLE_DESC_PRESENT) == TABLE_DESC_PRESENT) {
         pde->valid = 0;
     }
@@ -61,6 +127,21 @@ void table_desc_del_attrs(table_desc_t* pde, uint32_t attrs)
 
 bool table_desc_has_attrs(table_desc_t pde, uint32_t attrs)
 {
+    if (_table_desc_is_section(pde)) {
+        if ((attrs & TABLE_DESC_WRITABLE) == TABLE_DESC_WRITABLE && !_table_desc_section_is_writable(pde)) {
+            return false;
+        }
+        if ((attrs & TABLE_DESC_USER) == TABLE_DESC_USER && pde.section.ap1 == 0b01) {
+            return false;
+        }
+        if ((attrs & TABLE_DESC_PCD) == TABLE_DESC_PCD && (pde.section.c || !pde.section.b)) {
+            return false;
+        }
+        if ((attrs & TABLE_DESC_WRITE_COMBINING) == TABLE_DESC_WRITE_COMBINING && (pde.section.c || pde.section.b)) {
+            return false;
+        }
+        return (attrs & TABLE_DESC_COPY_ON_WRITE) != TABLE_DESC_COPY_ON_WRITE;
+    }
     if ((attrs & TABLE_DESC_PRESENT) == TABLE_DESC_PRESENT) {
         if (pde.valid == 0) {
             return false;
@@ -77,35 +158,49 @@ bool table_desc_has_attrs(table_desc_t pde, uint32_t attrs)
 void table_desc_set_frame(table_desc_t* pde, uint32_t paddr)
 {
     table_desc_del_frame(pde);
+    if (_table_desc_is_section(*pde)) {
+        pde->section.baddr = (paddr >> TABLE_DESC_SECTION_FRAME_OFFSET);
+        return;
+    }
     pde->baddr = (paddr >> TABLE_DESC_FRAME_OFFSET);
 }
 
 void table_desc_del_frame(table_desc_t* pde)
 {
+    if (_table_desc_is_section(*pde)) {
+        pde->section.baddr = 0;
+        return;
+    }
     pde->baddr = 0;
 }
 
 bool table_desc_is_present(table_desc_t pde)
 {
-    return pde.valid;
+    return pde.valid || _table_desc_is_section(pde);
 }
 
 bool table_desc_is_writable(table_desc_t pde)
 {
+    if (_table_desc_is_section(pde)) {
+        return _table_desc_section_is_writable(pde);
+    }
     return 1;
 }
 
 bool table_desc_is_4mb(table_desc_t pde)
 {
-    return 0;
+    return _table_desc_is_section(pde);
 }
 
 bool table_desc_is_copy_on_write(table_desc_t pde)
 {
-    return pde.imp;
+    return !_table_desc_is_section(pde) && pde.imp;
 }
 
 uint32_t table_desc_get_frame(table_desc_t pde)
 {
+    if (_table_desc_is_section(pde)) {
+        return ((pde.section.baddr) << TABLE_DESC_SECTION_FRAME_OFFSET);
+    }
     return ((pde.baddr) << TABLE_DESC_FRAME_OFFSET);
 }
@@ -19,6 +19,7 @@ void page_desc_init(page_desc_t* pte)
     pte->s = 1;
     pte->b = 1;
     pte->tex = 0b001;
+    pte->ng = 1; // Tagged with the ASID, PAGE_DESC_CPU_GLOBAL clears it.
 }
 
 void page_desc_set_attrs(page_desc_t* pte, uint32_t attrs)
@@ -35,6 +36,14 @@ void page_desc_set_attrs(page_desc_t* pte, uint32_t attrs)
     if ((attrs & PAGE_DESC_NOT_CACHEABLE) == PAGE_DESC_NOT_CACHEABLE) {
         pte->c = 0;
     }
+    if ((attrs & PAGE_DESC_WRITE_COMBINING) == PAGE_DESC_WRITE_COMBINING) {
+        pte->tex = 0b001;
+        pte->c = 0;
+        pte->b = 0;
+    }
+    if ((attrs & PAGE_DESC_CPU_GLOBAL) == PAGE_DESC_CPU_GLOBAL) {
+        pte->ng = 0;
+    }
 }
 
 void page_desc_del_attrs(page_desc_t* pte, uint32_t attrs)
@@ -51,6 +60,13 @@ void page_desc_del_attrs(page_desc_t* pte, uint32_t attrs)
     if ((attrs & PAGE_DESC_NOT_CACHEABLE) == PAGE_DESC_NOT_CACHEABLE) {
         pte->c = 1;
     }
+    if ((attrs & PAGE_DESC_WRITE_COMBINING) == PAGE_DESC_WRITE_COMBINING) {
+        pte->c = 1;
+        pte->b = 1;
+    }
+    if ((attrs & PAGE_DESC_CPU_GLOBAL) == PAGE_DESC_CPU_GLOBAL) {
+        pte->ng = 1;
+    }
 }
 
 bool page_desc_has_attrs(page_desc_t pte, uint32_t attrs)
@@ -101,7 +117,29 @@ bool page_desc_is_user(page_desc_t pte)
 
 bool page_desc_is_not_cacheable(page_desc_t pte)
 {
-    return (pte.c == 0);
+    return (pte.c == 0 && pte.b == 1);
+}
+
+bool page_desc_is_write_combining(page_desc_t pte)
+{
+    return (pte.tex == 0b001 && pte.c == 0 && pte.b == 0);
+}
+
+void page_desc_set_swapped(page_desc_t* pte, uint32_t slot)
+{
+    pte->data = 0;
+    pte->ap2 = 1;
+    pte->baddr = slot;
+}
+
+bool page_desc_is_swapped(page_desc_t pte)
+{
+    return !pte.one && !pte.xn && pte.ap2 && pte.baddr;
+}
+
+uint32_t page_desc_get_swap_slot(page_desc_t pte)
+{
+    return pte.baddr;
 }
 
 uint32_t page_desc_get_frame(page_desc_t pte)
@@ -121,6 +159,9 @@ uint32_t page_desc_get_settings(page_desc_t pte)
     if (page_desc_is_not_cacheable(pte)) {
         res |= PAGE_NOT_CACHEABLE;
     }
+    if (page_desc_is_write_combining(pte)) {
+        res |= PAGE_WRITE_COMBINING;
+    }
     return res;
 }
 
@@ -136,5 +177,8 @@ uint32_t page_desc_get_settings_ignore_cow(page_desc_t pte)
     if (page_desc_is_not_cacheable(pte)) {
         res |= PAGE_NOT_CACHEABLE;
     }
+    if (page_desc_is_write_combining(pte)) {
+        res |= PAGE_WRITE_COMBINING;
+    }
     return res;
 }
\ No newline at end of file
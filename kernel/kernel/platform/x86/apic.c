@@ -0,0 +1,553 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/x86/pit.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/log.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/generic/system.h>
+#include <platform/x86/apic.h>
+#include <platform/x86/idt.h>
+#include <platform/x86/pic.h>
+#include <tasking/cpu.h>
+#include <tasking/sched.h>
+#include <time/profiler.h>
+#include <time/time_manager.h>
+
+#define IA32_APIC_BASE_MSR 0x1b
+#define IA32_APIC_BASE_ENABLE (1 << 11)
+
+#define BIOS_ROM_PADDR 0xe0000
+#define BIOS_ROM_SIZE 0x20000
+#define EBDA_SEGMENT_PTR 0x40e
+#define EBDA_SCAN_SIZE (1 * KB)
+
+volatile uint32_t* lapic_regs = NULL;
+uint8_t lapic_id_to_cpu[256];
+
+static volatile uint32_t* _ioapic_regs;
+static uint32_t _lapic_paddr;
+static uint32_t _ioapic_paddr;
+static uint32_t _ioapic_gsi_base;
+static uint32_t _lapic_ticks_per_tick;
+
+static int _apic_cpus_count;
+static uint8_t _apic_cpu_lapic_ids[CPU_CNT];
+static uint32_t _apic_isa_gsi[APIC_ISA_IRQS];
+static uint32_t _apic_isa_flags[APIC_ISA_IRQS];
+static uint16_t _apic_isa_overridden;
+
+static volatile bool _apic_cpu_online[CPU_CNT];
+static volatile bool _apic_smp_active;
+
+/* Shootdown in progress, only one at a time. */
+static uint8_t _apic_tlb_busy;
+static uint8_t _apic_tlb_requested[CPU_CNT];
+static volatile uint32_t _apic_tlb_vaddr;
+static volatile bool _apic_tlb_whole;
+
+static void* _apic_map(uint32_t paddr, uint32_t len)
+{
+    uint32_t page_offset = paddr % VMM_PAGE_SIZE;
+    uint32_t pages = (page_offset + len + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    zone_t zone = zoner_new_zone(pages * VMM_PAGE_SIZE);
+    if (!zone.start) {
+        return NULL;
+    }
+    vmm_map_pages(zone.start, paddr - page_offset, pages, PAGE_READABLE | PAGE_WRITABLE | PAGE_NOT_CACHEABLE);
+    return zone.ptr + page_offset;
+}
+
+static inline uint32_t _lapic_read(uint32_t reg)
+{
+    return lapic_regs[reg / 4];
+}
+
+static inline void _lapic_write(uint32_t reg, uint32_t value)
+{
+    lapic_regs[reg / 4] = value;
+}
+
+static inline uint32_t _ioapic_read(uint32_t reg)
+{
+    _ioapic_regs[IOAPIC_REGSEL / 4] = reg;
+    return _ioapic_regs[IOAPIC_WIN / 4];
+}
+
+static inline void _ioapic_write(uint32_t reg, uint32_t value)
+{
+    _ioapic_regs[IOAPIC_REGSEL / 4] = reg;
+    _ioapic_regs[IOAPIC_WIN / 4] = value;
+}
+
+static bool _apic_cpu_has_lapic()
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid"
+                 : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx >> 9) & 0x1;
+}
+
+static void _apic_global_enable()
+{
+    uint32_t lo, hi;
+    asm volatile("rdmsr"
+                 : "=a"(lo), "=d"(hi)
+                 : "c"(IA32_APIC_BASE_MSR));
+    lo |= IA32_APIC_BASE_ENABLE;
+    asm volatile("wrmsr" ::"a"(lo), "d"(hi), "c"(IA32_APIC_BASE_MSR));
+}
+
+/**
+ * TABLES
+ */
+
+static bool _apic_checksum_ok(void* ptr, uint32_t len)
+{
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += ((uint8_t*)ptr)[i];
+    }
+    return sum == 0;
+}
+
+static void* _apic_scan(uint8_t* area, uint32_t len, const char* sig, uint32_t sig_len, uint32_t struct_len)
+{
+    if (!area) {
+        return NULL;
+    }
+    for (uint32_t off = 0; off + struct_len <= len; off += 16) {
+        if (memcmp(area + off, sig, sig_len) == 0 && _apic_checksum_ok(area + off, struct_len)) {
+            return area + off;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Both the RSDP and the MP floating pointer are in the first KB of EBDA
+ * or in the BIOS ROM, on a 16 byte boundary.
+ */
+static void* _apic_find_in_bios(const char* sig, uint32_t sig_len, uint32_t struct_len)
+{
+    static uint8_t* ebda = NULL;
+    static uint8_t* rom = NULL;
+    if (!rom) {
+        uint8_t* low = _apic_map(0, VMM_PAGE_SIZE);
+        uint32_t ebda_paddr = low ? (uint32_t)(*(uint16_t*)(low + EBDA_SEGMENT_PTR)) << 4 : 0;
+        ebda = ebda_paddr ? _apic_map(ebda_paddr, EBDA_SCAN_SIZE) : NULL;
+        rom = _apic_map(BIOS_ROM_PADDR, BIOS_ROM_SIZE);
+    }
+
+    void* res = _apic_scan(ebda, EBDA_SCAN_SIZE, sig, sig_len, struct_len);
+    if (res) {
+        return res;
+    }
+    return _apic_scan(rom, BIOS_ROM_SIZE, sig, sig_len, struct_len);
+}
+
+static void _apic_add_cpu(uint8_t lapic_id)
+{
+    if (_apic_cpus_count < CPU_CNT) {
+        _apic_cpu_lapic_ids[_apic_cpus_count++] = lapic_id;
+    }
+}
+
+/* Polarity and trigger mode are encoded the same way by ACPI and MP. */
+static void _apic_add_isa_override(uint8_t irq, uint32_t gsi, uint16_t mps_flags)
+{
+    if (irq >= APIC_ISA_IRQS) {
+        return;
+    }
+
+    uint32_t flags = 0;
+    if ((mps_flags & 0x3) == 0x3) {
+        flags |= IOAPIC_ACTIVE_LOW;
+    }
+    if (((mps_flags >> 2) & 0x3) == 0x3) {
+        flags |= IOAPIC_LEVEL;
+    }
+    _apic_isa_gsi[irq] = gsi;
+    _apic_isa_flags[irq] = flags;
+    _apic_isa_overridden |= (1 << irq);
+}
+
+static void _apic_parse_madt(acpi_madt_t* madt)
+{
+    _lapic_paddr = madt->lapic_paddr;
+    uint8_t* entry = (uint8_t*)madt + sizeof(acpi_madt_t);
+    uint8_t* end = (uint8_t*)madt + madt->header.length;
+
+    while (entry + 2 <= end && entry[1]) {
+        switch (entry[0]) {
+        case ACPI_MADT_LAPIC:
+            if (*(uint32_t*)(entry + 4) & 0x1) {
+                _apic_add_cpu(entry[3]);
+            }
+            break;
+        case ACPI_MADT_IOAPIC:
+            if (!_ioapic_paddr) {
+                _ioapic_paddr = *(uint32_t*)(entry + 4);
+                _ioapic_gsi_base = *(uint32_t*)(entry + 8);
+            }
+            break;
+        case ACPI_MADT_IRQ_OVERRIDE:
+            _apic_add_isa_override(entry[3], *(uint32_t*)(entry + 4), *(uint16_t*)(entry + 8));
+            break;
+        }
+        entry += entry[1];
+    }
+}
+
+static bool _apic_find_acpi()
+{
+    acpi_rsdp_t* rsdp = _apic_find_in_bios("RSD PTR ", 8, sizeof(acpi_rsdp_t));
+    if (!rsdp) {
+        return false;
+    }
+
+    acpi_sdt_header_t* rsdt = _apic_map(rsdp->rsdt_paddr, sizeof(acpi_sdt_header_t));
+    if (!rsdt || memcmp(rsdt->signature, "RSDT", 4) != 0) {
+        return false;
+    }
+    rsdt = _apic_map(rsdp->rsdt_paddr, rsdt->length);
+
+    uint32_t* tables = (uint32_t*)((uint8_t*)rsdt + sizeof(acpi_sdt_header_t));
+    uint32_t tables_count = (rsdt->length - sizeof(acpi_sdt_header_t)) / sizeof(uint32_t);
+    for (uint32_t i = 0; i < tables_count; i++) {
+        acpi_sdt_header_t* header = _apic_map(tables[i], sizeof(acpi_sdt_header_t));
+        if (header && memcmp(header->signature, "APIC", 4) == 0) {
+            _apic_parse_madt(_apic_map(tables[i], header->length));
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _apic_find_mp()
+{
+    mp_floating_pointer_t* fp = _apic_find_in_bios("_MP_", 4, sizeof(mp_floating_pointer_t));
+    if (!fp || !fp->config_paddr) {
+        return false;
+    }
+
+    mp_config_t* config = _apic_map(fp->config_paddr, sizeof(mp_config_t));
+    if (!config || memcmp(config->signature, "PCMP", 4) != 0) {
+        return false;
+    }
+    config = _apic_map(fp->config_paddr, config->length);
+    _lapic_paddr = config->lapic_paddr;
+
+    // Entries are sorted by type, so buses are known before irqs refer to them.
+    uint32_t isa_buses = 0;
+    uint8_t* entry = (uint8_t*)config + sizeof(mp_config_t);
+    for (int i = 0; i < config->entries_count; i++) {
+        switch (entry[0]) {
+        case MP_ENTRY_CPU:
+            if (entry[3] & 0x1) {
+                _apic_add_cpu(entry[1]);
+            }
+            entry += 20;
+            break;
+        case MP_ENTRY_BUS:
+            if (entry[1] < 32 && memcmp(entry + 2, "ISA", 3) == 0) {
+                isa_buses |= (1 << entry[1]);
+            }
+            entry += 8;
+            break;
+        case MP_ENTRY_IOAPIC:
+            if ((entry[3] & 0x1) && !_ioapic_paddr) {
+                _ioapic_paddr = *(uint32_t*)(entry + 4);
+                _ioapic_gsi_base = 0;
+            }
+            entry += 8;
+            break;
+        case MP_ENTRY_IO_IRQ:
+            if (entry[1] == 0 && entry[4] < 32 && (isa_buses & (1 << entry[4])) && entry[5] != entry[7]) {
+                _apic_add_isa_override(entry[5], entry[7], *(uint16_t*)(entry + 2));
+            }
+            entry += 8;
+            break;
+        default:
+            entry += 8;
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * LOCAL APIC
+ */
+
+static void _lapic_enable()
+{
+    _apic_global_enable();
+    _lapic_write(LAPIC_TPR, 0);
+    _lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    _lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    _lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    lapic_eoi();
+}
+
+/**
+ * The bus clock of the APIC timer is unknown, it is measured against
+ * 10ms of PIT once on the boot cpu and used by all of them.
+ */
+static void _lapic_timer_calibrate()
+{
+    _lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    _lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    _lapic_write(LAPIC_TIMER_INIT, 0xffffffff);
+    apic_delay_us(10000);
+    uint32_t elapsed = 0xffffffff - _lapic_read(LAPIC_TIMER_CURRENT);
+    _lapic_write(LAPIC_TIMER_INIT, 0);
+    _lapic_ticks_per_tick = elapsed * 100 / TIMER_TICKS_PER_SECOND;
+}
+
+static void _lapic_timer_start()
+{
+    _lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    _lapic_write(LAPIC_LVT_TIMER, APIC_TIMER_VECTOR | LAPIC_TIMER_PERIODIC);
+    _lapic_write(LAPIC_TIMER_INIT, _lapic_ticks_per_tick);
+}
+
+static void _lapic_send_ipi(uint8_t lapic_id, uint32_t icr)
+{
+    while (_lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING) { }
+    _lapic_write(LAPIC_ICR_HI, (uint32_t)lapic_id << 24);
+    _lapic_write(LAPIC_ICR_LO, icr);
+    while (_lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING) { }
+}
+
+static void _apic_timer_handler()
+{
+    cpu_tick();
+    profiler_tick();
+    timeman_timer_tick();
+    sched_tick();
+}
+
+static void _apic_tlb_serve(int cpu)
+{
+    if (!__atomic_load_n(&_apic_tlb_requested[cpu], __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    if (_apic_tlb_whole) {
+        system_flush_whole_tlb();
+    } else {
+        system_flush_tlb_entry(_apic_tlb_vaddr);
+    }
+    __atomic_store_n(&_apic_tlb_requested[cpu], 0, __ATOMIC_RELEASE);
+}
+
+static void _apic_tlb_handler()
+{
+    _apic_tlb_serve(system_cpu_id());
+}
+
+/**
+ * IO APIC
+ */
+
+/**
+ * Routes the legacy irqs to the boot cpu at the vectors the 8259 used. An irq
+ * which is moved to another line by an override gives its own line up. The
+ * PIT stays masked, the local APIC timers tick instead.
+ */
+static void _ioapic_route_isa_irqs(uint8_t lapic_id)
+{
+    uint32_t lines = ((_ioapic_read(IOAPIC_REG_VER) >> 16) & 0xff) + 1;
+    for (uint32_t line = 0; line < lines; line++) {
+        _ioapic_write(IOAPIC_REG_REDTBL + 2 * line, IOAPIC_MASKED);
+    }
+
+    for (int irq = 0; irq < APIC_ISA_IRQS; irq++) {
+        bool line_taken = false;
+        for (int other = 0; other < APIC_ISA_IRQS; other++) {
+            if (other != irq && (_apic_isa_overridden & (1 << other)) && _apic_isa_gsi[other] == _apic_isa_gsi[irq]) {
+                line_taken = !(_apic_isa_overridden & (1 << irq));
+            }
+        }
+
+        uint32_t line = _apic_isa_gsi[irq] - _ioapic_gsi_base;
+        if (line_taken || line >= lines) {
+            continue;
+        }
+
+        uint32_t low = (IRQ0 + irq) | _apic_isa_flags[irq];
+        if (irq == 0) {
+            low |= IOAPIC_MASKED;
+        }
+        _ioapic_write(IOAPIC_REG_REDTBL + 2 * line + 1, (uint32_t)lapic_id << 24);
+        _ioapic_write(IOAPIC_REG_REDTBL + 2 * line, low);
+    }
+}
+
+/**
+ * PUBLIC
+ */
+
+bool apic_setup()
+{
+    if (!_apic_cpu_has_lapic()) {
+        return false;
+    }
+
+    for (int irq = 0; irq < APIC_ISA_IRQS; irq++) {
+        _apic_isa_gsi[irq] = irq;
+        _apic_isa_flags[irq] = 0;
+    }
+    if (!_apic_find_acpi() && !_apic_find_mp()) {
+        log_warn("APIC: no MADT or MP table, staying with 8259");
+        return false;
+    }
+    if (!_lapic_paddr || !_ioapic_paddr) {
+        return false;
+    }
+
+    volatile uint32_t* regs = _apic_map(_lapic_paddr, VMM_PAGE_SIZE);
+    _ioapic_regs = _apic_map(_ioapic_paddr, VMM_PAGE_SIZE);
+    if (!regs || !_ioapic_regs) {
+        return false;
+    }
+
+    // The boot cpu is cpu 0, the rest keep the order of the table.
+    uint8_t boot_lapic_id = regs[LAPIC_ID / 4] >> 24;
+    int boot_index = -1;
+    for (int i = 0; i < _apic_cpus_count; i++) {
+        if (_apic_cpu_lapic_ids[i] == boot_lapic_id) {
+            boot_index = i;
+        }
+    }
+    if (boot_index < 0) {
+        boot_index = _apic_cpus_count < CPU_CNT ? _apic_cpus_count++ : CPU_CNT - 1;
+        _apic_cpu_lapic_ids[boot_index] = boot_lapic_id;
+    }
+    _apic_cpu_lapic_ids[boot_index] = _apic_cpu_lapic_ids[0];
+    _apic_cpu_lapic_ids[0] = boot_lapic_id;
+    memset(lapic_id_to_cpu, 0, sizeof(lapic_id_to_cpu));
+    for (int i = 0; i < _apic_cpus_count; i++) {
+        lapic_id_to_cpu[_apic_cpu_lapic_ids[i]] = i;
+    }
+
+    system_disable_interrupts();
+    pic_disable();
+    _ioapic_route_isa_irqs(boot_lapic_id);
+    lapic_regs = regs;
+    _lapic_enable();
+    set_irq_handler(APIC_TIMER_VECTOR, _apic_timer_handler);
+    set_irq_handler(APIC_IPI_TLB_VECTOR, _apic_tlb_handler);
+    _lapic_timer_calibrate();
+    _lapic_timer_start();
+    _apic_cpu_online[0] = true;
+    system_enable_interrupts();
+
+    log("APIC: %d cpus, timer %d per tick", _apic_cpus_count, _lapic_ticks_per_tick);
+    return true;
+}
+
+void apic_setup_secondary_cpu()
+{
+    _lapic_enable();
+    _lapic_timer_start();
+    __atomic_store_n(&_apic_cpu_online[system_cpu_id()], true, __ATOMIC_RELEASE);
+    __atomic_store_n(&_apic_smp_active, true, __ATOMIC_RELEASE);
+}
+
+bool apic_enabled()
+{
+    return lapic_regs != NULL;
+}
+
+void lapic_eoi()
+{
+    _lapic_write(LAPIC_EOI, 0);
+}
+
+int apic_cpus_count()
+{
+    return _apic_cpus_count;
+}
+
+uint8_t apic_cpu_lapic_id(int cpu)
+{
+    return _apic_cpu_lapic_ids[cpu];
+}
+
+void apic_send_init(uint8_t lapic_id)
+{
+    _lapic_send_ipi(lapic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+}
+
+void apic_send_startup(uint8_t lapic_id, uint8_t page)
+{
+    _lapic_send_ipi(lapic_id, LAPIC_ICR_STARTUP | page);
+}
+
+/**
+ * Busy waits on PIT channel 2, which is not connected to any irq. Used
+ * before the timers tick.
+ */
+void apic_delay_us(uint32_t us)
+{
+    while (us) {
+        uint32_t part = min(us, 50000);
+        uint32_t count = part * (PIT_BASE_FREQ / 1000) / 1000;
+        if (!count) {
+            count = 1;
+        }
+
+        uint8_t gate = port_byte_in(0x61) & ~0x3;
+        port_byte_out(0x61, gate);
+        port_byte_out(0x43, 0xb0); // channel 2, lobyte/hibyte, mode 0
+        port_byte_out(0x42, count & 0xff);
+        port_byte_out(0x42, (count >> 8) & 0xff);
+        port_byte_out(0x61, gate | 0x1);
+        while (!(port_byte_in(0x61) & 0x20)) { }
+        us -= part;
+    }
+}
+
+/**
+ * Asks the other online cpus to drop the entry and waits until all of them
+ * have done it. Who waits for the shootdown lock serves the requests sent to
+ * it meanwhile, so two cpus shooting at each other can't deadlock. Other
+ * cpus must not spin with interrupts off on a lock the caller holds.
+ */
+void apic_flush_tlb_other_cpus(uint32_t vaddr, bool whole)
+{
+    if (!__atomic_load_n(&_apic_smp_active, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    system_disable_interrupts();
+    int this_cpu = system_cpu_id();
+    while (__atomic_exchange_n(&_apic_tlb_busy, 1, __ATOMIC_ACQUIRE)) {
+        _apic_tlb_serve(this_cpu);
+        lock_relax();
+    }
+
+    _apic_tlb_vaddr = vaddr;
+    _apic_tlb_whole = whole;
+    for (int cpu = 0; cpu < _apic_cpus_count; cpu++) {
+        if (cpu != this_cpu && __atomic_load_n(&_apic_cpu_online[cpu], __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&_apic_tlb_requested[cpu], 1, __ATOMIC_RELEASE);
+            _lapic_send_ipi(_apic_cpu_lapic_ids[cpu], APIC_IPI_TLB_VECTOR);
+        }
+    }
+    for (int cpu = 0; cpu < _apic_cpus_count; cpu++) {
+        while (__atomic_load_n(&_apic_tlb_requested[cpu], __ATOMIC_ACQUIRE)) {
+            lock_relax();
+        }
+    }
+
+    __atomic_store_n(&_apic_tlb_busy, 0, __ATOMIC_RELEASE);
+    system_enable_interrupts();
+}
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <drivers/x86/ahci.h>
 #include <drivers/x86/ata.h>
 #include <drivers/x86/bga.h>
 #include <drivers/x86/display.h>
@@ -13,9 +14,15 @@
 #include <drivers/x86/mouse.h>
 #include <drivers/x86/pci.h>
 #include <drivers/x86/pit.h>
+#include <drivers/x86/uart.h>
+#include <drivers/x86/virtio_blk.h>
+#include <drivers/x86/virtio_gpu.h>
+#include <platform/x86/apic.h>
 #include <platform/x86/gdt.h>
 #include <platform/x86/idt.h>
 #include <platform/x86/init.h>
+#include <platform/x86/smp.h>
+#include <platform/x86/vmm/pte.h>
 
 void platform_init_boot_cpu()
 {
@@ -28,10 +35,19 @@ void platform_setup_boot_cpu()
     clean_screen();
     pit_setup();
     fpu_init();
+    page_desc_setup_pat();
+    if (apic_setup()) {
+        smp_start_secondary_cpus();
+    }
 }
 
 void platform_setup_secondary_cpu()
 {
+    gdt_setup();
+    interrupts_setup_secondary_cpu();
+    fpu_init_secondary_cpu();
+    page_desc_setup_pat();
+    apic_setup_secondary_cpu();
 }
 
 void platform_drivers_setup()
@@ -39,7 +55,11 @@ void platform_drivers_setup()
     pci_install();
     ide_install();
     ata_install();
+    virtio_blk_install();
+    ahci_install();
     kbdriver_install();
     mouse_install();
     bga_install();
+    virtio_gpu_install();
+    uart_install();
 }
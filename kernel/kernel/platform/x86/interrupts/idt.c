@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <platform/x86/apic.h>
 #include <platform/x86/idt.h>
 #include <platform/x86/syscalls/params.h>
 #include <syscalls/handlers.h>
@@ -79,10 +80,30 @@ void interrupts_setup()
     idt_element_setup(46, (void*)irq14, SYS);
     idt_element_setup(47, (void*)irq15, SYS);
 
-    for (int i = 48; i < 256; i++) {
+    for (int i = IRQ_MSI_BASE + IRQ_MSI_COUNT; i < 256; i++) {
         idt_element_setup(i, (void*)syscall, SYS);
     }
 
+    idt_element_setup(IRQ_MSI_BASE + 0, (void*)irq_msi0, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 1, (void*)irq_msi1, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 2, (void*)irq_msi2, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 3, (void*)irq_msi3, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 4, (void*)irq_msi4, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 5, (void*)irq_msi5, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 6, (void*)irq_msi6, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 7, (void*)irq_msi7, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 8, (void*)irq_msi8, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 9, (void*)irq_msi9, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 10, (void*)irq_msi10, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 11, (void*)irq_msi11, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 12, (void*)irq_msi12, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 13, (void*)irq_msi13, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 14, (void*)irq_msi14, SYS);
+    idt_element_setup(IRQ_MSI_BASE + 15, (void*)irq_msi15, SYS);
+
+    idt_element_setup(APIC_TIMER_VECTOR, (void*)irq_apic_timer, SYS);
+    idt_element_setup(APIC_IPI_TLB_VECTOR, (void*)irq_apic_tlb, SYS);
+    idt_element_setup(APIC_SPURIOUS_VECTOR, (void*)irq_apic_spurious, SYS);
     idt_element_setup(SYSCALL_HANDLER_NO, (void*)syscall, USER);
 
     init_irq_handlers();
@@ -90,6 +111,12 @@ void interrupts_setup()
     asm volatile("sti");
 }
 
+/* The table is shared, a secondary cpu only loads it. */
+void interrupts_setup_secondary_cpu()
+{
+    lidt(idt, sizeof(idt));
+}
+
 void set_irq_handler(uint8_t interrupt_no, void (*handler)())
 {
     handlers[interrupt_no] = (void*)handler;
@@ -104,6 +131,9 @@ inline void init_irq_handlers()
     for (i = IRQ_SLAVE_OFFSET; i < IRQ_SLAVE_OFFSET + 8; i++) {
         handlers[i] = (void*)irq_empty_handler;
     }
+    for (i = IRQ_MSI_BASE; i < IRQ_MSI_BASE + IRQ_MSI_COUNT; i++) {
+        handlers[i] = (void*)irq_empty_handler;
+    }
 }
 
 inline void idt_element_setup(uint8_t n, void* handler_addr, bool is_user)
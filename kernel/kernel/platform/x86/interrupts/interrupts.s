@@ -47,6 +47,25 @@ global irq12
 global irq13
 global irq14
 global irq15
+global irq_msi0
+global irq_msi1
+global irq_msi2
+global irq_msi3
+global irq_msi4
+global irq_msi5
+global irq_msi6
+global irq_msi7
+global irq_msi8
+global irq_msi9
+global irq_msi10
+global irq_msi11
+global irq_msi12
+global irq_msi13
+global irq_msi14
+global irq_msi15
+global irq_apic_timer
+global irq_apic_tlb
+global irq_apic_spurious
 
 global syscall
 
@@ -415,6 +434,121 @@ irq15:
     push 47
     jmp  irq_common
 
+
+; MSI vectors, see drivers/x86/pci.c
+irq_msi0:
+    push 0
+    push 48
+    jmp  irq_common
+
+
+irq_msi1:
+    push 0
+    push 49
+    jmp  irq_common
+
+
+irq_msi2:
+    push 0
+    push 50
+    jmp  irq_common
+
+
+irq_msi3:
+    push 0
+    push 51
+    jmp  irq_common
+
+
+irq_msi4:
+    push 0
+    push 52
+    jmp  irq_common
+
+
+irq_msi5:
+    push 0
+    push 53
+    jmp  irq_common
+
+
+irq_msi6:
+    push 0
+    push 54
+    jmp  irq_common
+
+
+irq_msi7:
+    push 0
+    push 55
+    jmp  irq_common
+
+
+irq_msi8:
+    push 0
+    push 56
+    jmp  irq_common
+
+
+irq_msi9:
+    push 0
+    push 57
+    jmp  irq_common
+
+
+irq_msi10:
+    push 0
+    push 58
+    jmp  irq_common
+
+
+irq_msi11:
+    push 0
+    push 59
+    jmp  irq_common
+
+
+irq_msi12:
+    push 0
+    push 60
+    jmp  irq_common
+
+
+irq_msi13:
+    push 0
+    push 61
+    jmp  irq_common
+
+
+irq_msi14:
+    push 0
+    push 62
+    jmp  irq_common
+
+
+irq_msi15:
+    push 0
+    push 63
+    jmp  irq_common
+
+
+; Local APIC vectors, see platform/x86/apic.h
+irq_apic_timer:
+    push 0
+    push 0xf0
+    jmp  irq_common
+
+
+irq_apic_tlb:
+    push 0
+    push 0xf1
+    jmp  irq_common
+
+
+; A spurious interrupt is not acknowledged.
+irq_apic_spurious:
+    iret
+
 syscall:
     push 0
     push 0x80
@@ -5,8 +5,10 @@
  */
 
 #include <platform/generic/system.h>
+#include <platform/x86/apic.h>
 #include <platform/x86/irq_handler.h>
 #include <tasking/cpu.h>
+#include <tasking/tasklet.h>
 #include <tasking/tasking.h>
 
 static inline void irq_redirect(uint8_t int_no)
@@ -19,11 +21,16 @@ void irq_handler(trapframe_t* tf)
 {
     system_disable_interrupts();
     cpu_enter_kernel_space();
+    THIS_CPU->irq_tf = tf;
 
-    if (tf->int_no >= IRQ_SLAVE_OFFSET) {
-        port_byte_out(0xA0, 0x20);
+    if (apic_enabled()) {
+        lapic_eoi();
+    } else {
+        if (tf->int_no >= IRQ_SLAVE_OFFSET) {
+            port_byte_out(0xA0, 0x20);
+        }
+        port_byte_out(0x20, 0x20);
     }
-    port_byte_out(0x20, 0x20);
 
     if (likely(RUNNING_THREAD)) {
         if (RUNNING_THREAD->process->is_kthread) {
@@ -32,6 +39,7 @@ void irq_handler(trapframe_t* tf)
     }
 
     irq_redirect(tf->int_no);
+    tasklets_run();
     /* We are leaving interrupt, and later interrupts will be on,
        when flags are restored */
     cpu_leave_kernel_space();
@@ -7,6 +7,7 @@
 #include <drivers/x86/fpu.h>
 #include <libkern/kassert.h>
 #include <libkern/log.h>
+#include <mem/vmm/uaccess.h>
 #include <mem/vmm/vmm.h>
 #include <platform/generic/registers.h>
 #include <platform/generic/system.h>
@@ -132,6 +133,10 @@ void isr_handler(trapframe_t* frame)
         if (res != SHOULD_CRASH)
             break;
 
+        /* A user copy hit a bad address, it returns what is left. */
+        if (!tf_is_from_user(frame) && uaccess_fixup(frame))
+            break;
+
         if (proc) {
             log_warn("Crash: pf err %d at %x: %d pid, %x eip\n",
                 frame->err, read_cr2(), proc->pid, frame->eip);
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/libkern.h>
+#include <platform/x86/pmu.h>
+
+#define IA32_PMC0 0xc1
+#define IA32_PERFEVTSEL0 0x186
+
+#define PERFEVTSEL_USR (1 << 16)
+#define PERFEVTSEL_OS (1 << 17)
+#define PERFEVTSEL_EN (1 << 22)
+
+#define PMU_NOT_PROBED (-1)
+
+/**
+ * Architectural performance monitoring (CPUID leaf 0xA). The TLB event is
+ * not architectural, the one used is DTLB_LOAD_MISSES.MISS_CAUSES_A_WALK
+ * of Intel cores since Nehalem.
+ */
+typedef struct {
+    uint8_t select;
+    uint8_t umask;
+    int8_t cpuid_bit; /* Bit of CPUID.0xA:EBX which is set if the event is missing. */
+} pmu_event_t;
+
+static const pmu_event_t _pmu_events[PERF_EVENT_COUNT] = {
+    [PERF_EVENT_CYCLES] = { 0x3c, 0x00, 0 },
+    [PERF_EVENT_INSTRUCTIONS] = { 0xc0, 0x00, 1 },
+    [PERF_EVENT_CACHE_MISSES] = { 0x2e, 0x41, 4 },
+    [PERF_EVENT_BRANCH_MISSES] = { 0xc5, 0x00, 6 },
+    [PERF_EVENT_TLB_MISSES] = { 0x08, 0x01, -1 },
+};
+
+static int _pmu_counters = PMU_NOT_PROBED;
+static uint32_t _pmu_missing_events;
+
+static inline void _pmu_cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx)
+{
+    uint32_t ecx, edx;
+    asm volatile("cpuid"
+                 : "=a"(*eax), "=b"(*ebx), "=c"(ecx), "=d"(edx)
+                 : "a"(leaf), "c"(0));
+}
+
+static inline void _pmu_write_msr(uint32_t msr, uint32_t val)
+{
+    asm volatile("wrmsr" ::"a"(val), "d"(0), "c"(msr));
+}
+
+static inline uint32_t _pmu_read_msr(uint32_t msr)
+{
+    uint32_t lo, hi;
+    asm volatile("rdmsr"
+                 : "=a"(lo), "=d"(hi)
+                 : "c"(msr));
+    return lo;
+}
+
+static void _pmu_probe()
+{
+    uint32_t eax, ebx;
+    _pmu_cpuid(0, &eax, &ebx);
+    if (eax < 0xa) {
+        _pmu_counters = 0;
+        return;
+    }
+
+    _pmu_cpuid(0xa, &eax, &ebx);
+    uint32_t version = eax & 0xff;
+    uint32_t counters = (eax >> 8) & 0xff;
+    uint32_t events_len = (eax >> 24) & 0xff;
+    _pmu_missing_events = ebx | ~((1u << events_len) - 1);
+    _pmu_counters = version ? min(counters, (uint32_t)PERF_MAX_COUNTERS) : 0;
+}
+
+int pmu_counters_count()
+{
+    if (unlikely(_pmu_counters == PMU_NOT_PROBED)) {
+        _pmu_probe();
+    }
+    return _pmu_counters;
+}
+
+bool pmu_supports(int event)
+{
+    if (event < 0 || event >= PERF_EVENT_COUNT || !pmu_counters_count()) {
+        return false;
+    }
+    int bit = _pmu_events[event].cpuid_bit;
+    return bit < 0 || !((_pmu_missing_events >> bit) & 1);
+}
+
+void pmu_start(int counter, int event)
+{
+    const pmu_event_t* ev = &_pmu_events[event];
+    _pmu_write_msr(IA32_PERFEVTSEL0 + counter, 0);
+    _pmu_write_msr(IA32_PMC0 + counter, 0);
+    _pmu_write_msr(IA32_PERFEVTSEL0 + counter, ev->select | (ev->umask << 8) | PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_EN);
+}
+
+void pmu_stop(int counter)
+{
+    _pmu_write_msr(IA32_PERFEVTSEL0 + counter, 0);
+}
+
+uint32_t pmu_read(int counter)
+{
+    return _pmu_read_msr(IA32_PMC0 + counter);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/libkern.h>
+#include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/generic/cpu.h>
+#include <platform/x86/apic.h>
+#include <platform/x86/registers.h>
+#include <platform/x86/smp.h>
+
+// #define SMP_DEBUG
+
+#define SMP_STARTUP_WAIT_US 200
+#define SMP_STARTUP_TIMEOUT_US 100000
+#define SMP_POLL_US 10
+
+extern uint8_t smp_trampoline_start[];
+extern uint8_t smp_trampoline_end[];
+extern uint8_t smp_trampoline_args[];
+
+void boot_secondary_cpu();
+
+static volatile int _smp_cpu_started;
+
+static void _smp_secondary_entry()
+{
+    __atomic_store_n(&_smp_cpu_started, 1, __ATOMIC_RELEASE);
+    boot_secondary_cpu();
+}
+
+static bool _smp_wait_started(uint32_t us)
+{
+    for (uint32_t waited = 0; waited < us; waited += SMP_POLL_US) {
+        if (__atomic_load_n(&_smp_cpu_started, __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+        apic_delay_us(SMP_POLL_US);
+    }
+    return __atomic_load_n(&_smp_cpu_started, __ATOMIC_ACQUIRE);
+}
+
+static smp_trampoline_args_t* _smp_install_trampoline()
+{
+    zone_t zone = zoner_new_zone(VMM_PAGE_SIZE);
+    if (!zone.start) {
+        return NULL;
+    }
+    vmm_map_page(zone.start, SMP_TRAMPOLINE_PADDR, PAGE_READABLE | PAGE_WRITABLE | PAGE_EXECUTABLE);
+
+    uint32_t size = smp_trampoline_end - smp_trampoline_start;
+    memcpy(zone.ptr, smp_trampoline_start, size);
+
+    smp_trampoline_args_t* args = (smp_trampoline_args_t*)(zone.ptr + (smp_trampoline_args - smp_trampoline_start));
+    args->pdir_paddr = read_cr3();
+    args->entry = (uint32_t)_smp_secondary_entry;
+    return args;
+}
+
+/**
+ * Wakes the cpus one by one with the INIT, SIPI, SIPI sequence. They share
+ * the trampoline, so the next one is started only after the previous one
+ * has left it. A started cpu waits in boot_secondary_cpu() until the boot
+ * cpu has set up devices and tasking.
+ */
+void smp_start_secondary_cpus()
+{
+    int cpus = min(apic_cpus_count(), CPU_CNT);
+    if (cpus < 2) {
+        return;
+    }
+
+    smp_trampoline_args_t* args = _smp_install_trampoline();
+    if (!args) {
+        log_warn("SMP: no room for the trampoline");
+        return;
+    }
+
+    for (int cpu = 1; cpu < cpus; cpu++) {
+        uint8_t* stack = kmalloc(SMP_CPU_STACK_SIZE);
+        if (!stack) {
+            log_warn("SMP: no stack for cpu %d", cpu);
+            return;
+        }
+        args->stack = (uint32_t)stack + SMP_CPU_STACK_SIZE;
+        __atomic_store_n(&_smp_cpu_started, 0, __ATOMIC_RELEASE);
+
+        uint8_t lapic_id = apic_cpu_lapic_id(cpu);
+        apic_send_init(lapic_id);
+        apic_delay_us(10000);
+        apic_send_startup(lapic_id, SMP_TRAMPOLINE_PADDR / VMM_PAGE_SIZE);
+        if (!_smp_wait_started(SMP_STARTUP_WAIT_US)) {
+            apic_send_startup(lapic_id, SMP_TRAMPOLINE_PADDR / VMM_PAGE_SIZE);
+        }
+
+        if (!_smp_wait_started(SMP_STARTUP_TIMEOUT_US)) {
+            log_warn("SMP: cpu %d (apic %d) didn't start", cpu, lapic_id);
+            kfree(stack);
+            continue;
+        }
+#ifdef SMP_DEBUG
+        log("SMP: cpu %d (apic %d) started", cpu, lapic_id);
+#endif
+    }
+}
@@ -0,0 +1,62 @@
+; The secondary cpus wake up in real mode at SMP_TRAMPOLINE_PADDR, smp.c
+; copies this code there. Labels are linked at kernel addresses, so every
+; address used before paging is relocated by hand with REL().
+
+%define SMP_TRAMPOLINE_PADDR 0x8000
+%define REL(x) (SMP_TRAMPOLINE_PADDR + (x - smp_trampoline_start))
+
+global smp_trampoline_start
+global smp_trampoline_end
+global smp_trampoline_args
+
+[bits 16]
+smp_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [REL(smp_trampoline_gdt_descriptor)]
+    mov eax, cr0
+    or eax, 0x1
+    mov cr0, eax
+    jmp dword 0x08:REL(smp_trampoline_pm)
+
+[bits 32]
+smp_trampoline_pm:
+    mov ax, 0x10
+    mov ds, ax
+    mov ss, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    mov eax, [REL(smp_trampoline_args)] ; pdir
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000
+    mov cr0, eax
+
+    mov esp, [REL(smp_trampoline_args) + 4] ; stack
+    mov ebp, esp
+    mov eax, [REL(smp_trampoline_args) + 8] ; entry
+    call eax
+
+smp_trampoline_halt:
+    hlt
+    jmp smp_trampoline_halt
+
+align 8
+smp_trampoline_gdt:
+    dq 0x0
+    dq 0x00cf9a000000ffff ; code
+    dq 0x00cf92000000ffff ; data
+smp_trampoline_gdt_descriptor:
+    dw 3 * 8 - 1
+    dd REL(smp_trampoline_gdt)
+
+align 4
+smp_trampoline_args:
+    dd 0x0
+    dd 0x0
+    dd 0x0
+smp_trampoline_end:
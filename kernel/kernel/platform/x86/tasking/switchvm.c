@@ -11,17 +11,28 @@
 #include <platform/x86/tasking/switchvm.h>
 #include <platform/x86/tasking/tss.h>
 
+/**
+ * The base of the gs segment is the thread pointer. The segment register
+ * is reloaded from gdt when the trapframe is popped.
+ */
+void switchtls(thread_t* thread)
+{
+    gdt[system_cpu_id()][SEG_UTLS] = SEG_PG(SEGF_W, thread->tls, 0xffffffff, DPL_USER);
+}
+
 /* switching the page dir and tss to the current proc */
 void switchuvm(thread_t* thread)
 {
     system_disable_interrupts();
-    gdt[SEG_TSS] = SEG_BG(SEGTSS_TYPE, &tss, sizeof(tss) - 1, 0);
+    int cpu = system_cpu_id();
+    gdt[cpu][SEG_TSS] = SEG_BG(SEGTSS_TYPE, &tss[cpu], sizeof(tss_t) - 1, 0);
+    switchtls(thread);
     uint32_t esp0 = ((uint32_t)thread->tf + sizeof(trapframe_t));
-    tss.esp0 = esp0;
-    tss.ss0 = (SEG_KDATA << 3);
+    tss[cpu].esp0 = esp0;
+    tss[cpu].ss0 = (SEG_KDATA << 3);
     // tss.iomap_offset = 0xffff;
+    thread_fpu_switch(thread);
     RUNNING_THREAD = thread;
-    fpu_make_unavail();
     ltr(SEG_TSS << 3);
     vmm_switch_pdir(thread->process->pdir);
     system_enable_interrupts();
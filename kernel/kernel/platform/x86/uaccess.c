@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <mem/vmm/uaccess.h>
+
+/**
+ * A string copy keeps ecx, esi and edi exact when it faults, so the fixup
+ * only has to turn the words left into bytes left.
+ */
+uint32_t uaccess_copy_raw(void* dest, const void* src, uint32_t len)
+{
+    uint32_t left = len >> 2;
+    uint32_t tail = len & 3;
+    asm volatile("cld\n"
+                 "1: rep movsl\n"
+                 "   mov %3, %%ecx\n"
+                 "2: rep movsb\n"
+                 "   jmp 4f\n"
+                 "3: lea (%3, %%ecx, 4), %%ecx\n"
+                 "4:\n"
+                 ".pushsection .uaccess_fixup, \"a\"\n"
+                 ".long 1b, 3b\n"
+                 ".long 2b, 4b\n"
+                 ".popsection\n"
+                 : "+D"(dest), "+S"(src), "+c"(left)
+                 : "r"(tail)
+                 : "memory");
+    return left;
+}
@@ -5,6 +5,7 @@
  */
 
 #include <mem/vmm/vmm.h>
+#include <platform/x86/system.h>
 #include <platform/x86/vmm/pte.h>
 
 void page_desc_init(page_desc_t* pte)
@@ -64,6 +65,26 @@ bool page_desc_is_cow(page_desc_t pte)
     return ((pte & PAGE_DESC_COPY_ON_WRITE) > 0);
 }
 
+bool page_desc_is_write_combining(page_desc_t pte)
+{
+    return ((pte & (PAGE_DESC_WRITE_COMBINING | PAGE_DESC_NOT_CACHEABLE)) == PAGE_DESC_WRITE_COMBINING);
+}
+
+void page_desc_set_swapped(page_desc_t* pte, uint32_t slot)
+{
+    *pte = (slot << PAGE_DESC_FRAME_OFFSET) | PAGE_DESC_SWAPPED;
+}
+
+bool page_desc_is_swapped(page_desc_t pte)
+{
+    return !(pte & PAGE_DESC_PRESENT) && (pte & PAGE_DESC_SWAPPED) && (pte >> PAGE_DESC_FRAME_OFFSET);
+}
+
+uint32_t page_desc_get_swap_slot(page_desc_t pte)
+{
+    return pte >> PAGE_DESC_FRAME_OFFSET;
+}
+
 uint32_t page_desc_get_frame(page_desc_t pte)
 {
     return ((pte >> PAGE_DESC_FRAME_OFFSET) << PAGE_DESC_FRAME_OFFSET);
@@ -81,6 +102,9 @@ uint32_t page_desc_get_settings(page_desc_t pte)
     if (page_desc_is_not_cacheable(pte)) {
         res |= PAGE_NOT_CACHEABLE;
     }
+    if (page_desc_is_write_combining(pte)) {
+        res |= PAGE_WRITE_COMBINING;
+    }
     if (page_desc_is_cow(pte)) {
         res |= PAGE_COW;
     }
@@ -99,5 +123,37 @@ uint32_t page_desc_get_settings_ignore_cow(page_desc_t pte)
     if (page_desc_is_not_cacheable(pte)) {
         res |= PAGE_NOT_CACHEABLE;
     }
+    if (page_desc_is_write_combining(pte)) {
+        res |= PAGE_WRITE_COMBINING;
+    }
     return res;
-}
\ No newline at end of file
+}
+
+static bool _page_desc_cpu_has_pat()
+{
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid"
+                 : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                 : "a"(1));
+    return (edx >> 16) & 1;
+}
+
+/**
+ * Entry 1 of the PAT, taken by pages with PWT set and PCD clear, becomes
+ * write-combining instead of write-through, nothing else maps write-through.
+ * The other entries keep their power-on types. Every cpu loads the same
+ * table, without PAT such pages stay write-through.
+ */
+void page_desc_setup_pat()
+{
+    if (!_page_desc_cpu_has_pat()) {
+        return;
+    }
+
+    // WB, WC, UC-, UC in entries 0-3 and again in 4-7.
+    uint32_t lo = 0x00070106;
+    uint32_t hi = 0x00070106;
+    asm volatile("wbinvd");
+    asm volatile("wrmsr" ::"a"(lo), "d"(hi), "c"(IA32_PAT_MSR));
+    system_flush_whole_tlb();
+}
@@ -8,6 +8,7 @@
 #include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <mem/kmalloc.h>
+#include <mem/vmm/uaccess.h>
 #include <platform/generic/syscalls/params.h>
 #include <syscalls/handlers.h>
 #include <tasking/tasking.h>
@@ -15,7 +16,6 @@
 void sys_open(trapframe_t* tf)
 {
     proc_t* p = RUNNING_THREAD->process;
-    file_descriptor_t* fd = proc_get_free_fd(p);
     dentry_t* file;
     const char* path = (char*)param1;
     char* kpath = 0;
@@ -60,48 +60,317 @@ void sys_open(trapframe_t* tf)
     if (vfs_resolve_path_start_from(p->cwd, kpath, &file) < 0) {
         return_with_val(-ENOENT);
     }
+
+    int index;
+    file_descriptor_t* fd = proc_alloc_fd(p, &index);
+    if (!fd) {
+        dentry_put(file);
+        return_with_val(-EMFILE);
+    }
+
     int res = vfs_open(file, fd, flags);
     dentry_put(file);
-    if (!res) {
-        return_with_val(proc_get_fd_id(p, fd));
+    if (res) {
+        proc_free_fd(p, index);
+        return_with_val(res);
     }
-    return_with_val(res);
+
+    if (flags & O_CLOEXEC) {
+        proc_set_cloexec(p, index, true);
+    }
+    return_with_val(index);
 }
 
 void sys_close(trapframe_t* tf)
 {
-    file_descriptor_t* fd = proc_get_fd(RUNNING_THREAD->process, param1);
+    return_with_val(proc_close_fd(RUNNING_THREAD->process, (int)param1));
+}
+
+void sys_dup2(trapframe_t* tf)
+{
+    return_with_val(proc_dup_fd(RUNNING_THREAD->process, (int)param1, (int)param2));
+}
+
+/**
+ * Data goes between the file and the process through a kernel buffer, the
+ * file ops never see a user pointer, so a bad one ends the syscall with
+ * -EFAULT. Only files are read in several chunks, other descriptors could
+ * block again, and a short read is fine for them.
+ * Both return the count of moved bytes, an error only if nothing moved.
+ */
+static int _sys_read_to_user(file_descriptor_t* fd, uint8_t* ubuf, uint32_t len)
+{
+    int err = init_read_blocker(RUNNING_THREAD, fd);
+    if (err) {
+        return err;
+    }
+
+    uint8_t* buf = kmalloc(min(len, VFS_COPY_CHUNK));
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    int total = 0;
+    while (len) {
+        uint32_t part = min(len, VFS_COPY_CHUNK);
+        int read = vfs_read(fd, buf, part);
+        if (read <= 0) {
+            err = read;
+            break;
+        }
+        if (copy_to_user(ubuf + total, buf, read)) {
+            err = -EFAULT;
+            break;
+        }
+
+        total += read;
+        len -= read;
+        if (read < part || fd->type != FD_TYPE_FILE) {
+            break;
+        }
+    }
+
+    kfree(buf);
+    RUNNING_THREAD->stat_read_bytes += total;
+    return total ? total : err;
+}
+
+static int _sys_write_from_user(file_descriptor_t* fd, const uint8_t* ubuf, uint32_t len)
+{
+    uint8_t* buf = kmalloc(min(len, VFS_COPY_CHUNK));
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    int total = 0;
+    int err = 0;
+    while (len) {
+        uint32_t part = min(len, VFS_COPY_CHUNK);
+        if (copy_from_user(buf, ubuf + total, part)) {
+            err = -EFAULT;
+            break;
+        }
+
+        int written = init_write_blocker(RUNNING_THREAD, fd);
+        if (!written) {
+            written = vfs_write(fd, buf, part);
+        }
+        if (written <= 0) {
+            err = written;
+            break;
+        }
+
+        total += written;
+        len -= written;
+        if (written < part) {
+            break;
+        }
+    }
+
+    kfree(buf);
+    RUNNING_THREAD->stat_written_bytes += total;
+    return total ? total : err;
+}
+
+void sys_read(trapframe_t* tf)
+{
+    file_descriptor_t* fd = proc_get_fd(RUNNING_THREAD->process, (int)param1);
     if (!fd) {
         return_with_val(-EBADF);
     }
-    return_with_val(vfs_close(fd));
+    if (!param3) {
+        return_with_val(0);
+    }
+    return_with_val(_sys_read_to_user(fd, (uint8_t*)param2, (uint32_t)param3));
 }
 
-/* TODO: copying to/from user! */
-void sys_read(trapframe_t* tf)
+void sys_write(trapframe_t* tf)
+{
+    file_descriptor_t* fd = proc_get_fd(RUNNING_THREAD->process, (int)param1);
+    if (!fd) {
+        return_with_val(-EBADF);
+    }
+    if (!param3) {
+        return_with_val(0);
+    }
+    return_with_val(_sys_write_from_user(fd, (const uint8_t*)param2, (uint32_t)param3));
+}
+
+/**
+ * Writes the buffers in order, stops at the first one which is not written
+ * whole. An error is returned only if nothing was written.
+ */
+void sys_writev(trapframe_t* tf)
 {
     file_descriptor_t* fd = proc_get_fd(RUNNING_THREAD->process, (int)param1);
     if (!fd) {
         return_with_val(-EBADF);
     }
 
-    init_read_blocker(RUNNING_THREAD, fd);
+    int iovcnt = (int)param3;
+    if (iovcnt < 0 || iovcnt > IOV_MAX) {
+        return_with_val(-EINVAL);
+    }
 
-    int res = vfs_read(fd, (uint8_t*)param2, (uint32_t)param3);
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        iovec_t iov;
+        if (copy_from_user(&iov, (const iovec_t*)param2 + i, sizeof(iovec_t))) {
+            return_with_val(total ? total : -EFAULT);
+        }
+        if (!iov.iov_len) {
+            continue;
+        }
+
+        int res = _sys_write_from_user(fd, (const uint8_t*)iov.iov_base, (uint32_t)iov.iov_len);
+        if (res < 0) {
+            if (!total) {
+                return_with_val(res);
+            }
+            break;
+        }
+
+        total += res;
+        if ((uint32_t)res != iov.iov_len) {
+            break;
+        }
+    }
+
+    return_with_val(total);
+}
+
+/**
+ * Moves up to len bytes from in to out through a kernel buffer, so the data
+ * doesn't bounce through userspace. A NULL offset means the offset of the
+ * descriptor, others are advanced by the copied amount. Input is a file,
+ * so the data which wasn't written is given back by moving its offset.
+ * An error is returned only if nothing was copied.
+ */
+static int _sys_copy_between_fds(file_descriptor_t* out, uint32_t* out_off, file_descriptor_t* in, uint32_t* in_off, uint32_t len)
+{
+    uint8_t* buf = kmalloc(min(len, VFS_COPY_CHUNK));
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    int total = 0;
+    int err = 0;
+    while (len) {
+        uint32_t part = min(len, VFS_COPY_CHUNK);
+        int read;
+        if (in_off) {
+            read = vfs_pread(in, buf, *in_off, part);
+        } else {
+            read = init_read_blocker(RUNNING_THREAD, in);
+            if (!read) {
+                read = vfs_read(in, buf, part);
+            }
+        }
+        if (read <= 0) {
+            err = read;
+            break;
+        }
+
+        int written;
+        if (out_off) {
+            written = vfs_pwrite(out, buf, *out_off, read);
+        } else {
+            written = init_write_blocker(RUNNING_THREAD, out);
+            if (!written) {
+                written = vfs_write(out, buf, read);
+            }
+        }
+        if (written < 0) {
+            err = written;
+            written = 0;
+        }
+
+        if (in_off) {
+            *in_off += written;
+        } else if (written < read) {
+            kmutex_lock(&in->lock);
+            in->offset -= read - written;
+            kmutex_unlock(&in->lock);
+        }
+        if (out_off) {
+            *out_off += written;
+        }
+
+        total += written;
+        len -= written;
+        if (written < read) {
+            break;
+        }
+    }
+
+    kfree(buf);
+    RUNNING_THREAD->stat_read_bytes += total;
+    RUNNING_THREAD->stat_written_bytes += total;
+    return total ? total : err;
+}
+
+void sys_sendfile(trapframe_t* tf)
+{
+    file_descriptor_t* out = proc_get_fd(RUNNING_THREAD->process, (int)param1);
+    file_descriptor_t* in = proc_get_fd(RUNNING_THREAD->process, (int)param2);
+    off_t* offset = (off_t*)param3;
+    if (!out || !in) {
+        return_with_val(-EBADF);
+    }
+    if (in->type != FD_TYPE_FILE) {
+        return_with_val(-EINVAL);
+    }
+
+    if (!offset) {
+        return_with_val(_sys_copy_between_fds(out, NULL, in, NULL, (uint32_t)param4));
+    }
+
+    off_t in_off;
+    if (copy_from_user(&in_off, offset, sizeof(off_t))) {
+        return_with_val(-EFAULT);
+    }
+    uint32_t in_pos = in_off;
+    int res = _sys_copy_between_fds(out, NULL, in, &in_pos, (uint32_t)param4);
+    in_off = in_pos;
+    if (copy_to_user(offset, &in_off, sizeof(off_t))) {
+        return_with_val(-EFAULT);
+    }
     return_with_val(res);
 }
 
-/* TODO: copying to/from user! */
-void sys_write(trapframe_t* tf)
+void sys_copy_file_range(trapframe_t* tf)
 {
-    file_descriptor_t* fd = proc_get_fd(RUNNING_THREAD->process, (int)param1);
-    if (!fd) {
+    file_descriptor_t* in = proc_get_fd(RUNNING_THREAD->process, (int)param1);
+    off_t* off_in = (off_t*)param2;
+    file_descriptor_t* out = proc_get_fd(RUNNING_THREAD->process, (int)param3);
+    off_t* off_out = (off_t*)param4;
+    if (!out || !in) {
         return_with_val(-EBADF);
     }
+    if (in->type != FD_TYPE_FILE || out->type != FD_TYPE_FILE) {
+        return_with_val(-EINVAL);
+    }
 
-    init_write_blocker(RUNNING_THREAD, fd);
+    off_t in_off = 0;
+    off_t out_off = 0;
+    if (off_in && copy_from_user(&in_off, off_in, sizeof(off_t))) {
+        return_with_val(-EFAULT);
+    }
+    if (off_out && copy_from_user(&out_off, off_out, sizeof(off_t))) {
+        return_with_val(-EFAULT);
+    }
 
-    int res = vfs_write(fd, (uint8_t*)param2, (uint32_t)param3);
+    uint32_t in_pos = in_off;
+    uint32_t out_pos = out_off;
+    int res = _sys_copy_between_fds(out, off_out ? &out_pos : NULL, in, off_in ? &in_pos : NULL, (uint32_t)param5);
+    in_off = in_pos;
+    out_off = out_pos;
+    if (off_in && copy_to_user(off_in, &in_off, sizeof(off_t))) {
+        return_with_val(-EFAULT);
+    }
+    if (off_out && copy_to_user(off_out, &out_off, sizeof(off_t))) {
+        return_with_val(-EFAULT);
+    }
     return_with_val(res);
 }
 
@@ -181,8 +450,13 @@ void sys_fstat(trapframe_t* tf)
     if (!stat) {
         return_with_val(-EINVAL);
     }
-    int res = vfs_fstat(fd, stat);
-    return_with_val(res);
+
+    fstat_t kstat = { 0 };
+    int res = vfs_fstat(fd, &kstat);
+    if (res) {
+        return_with_val(res);
+    }
+    return_with_val(copy_to_user(stat, &kstat, sizeof(fstat_t)) ? -EFAULT : 0);
 }
 
 void sys_mkdir(trapframe_t* tf)
@@ -245,12 +519,48 @@ void sys_chdir(trapframe_t* tf)
     return_with_val(proc_chdir(RUNNING_THREAD->process, path));
 }
 
+/**
+ * Entries are read into a kernel buffer and copied out. The buffer is
+ * capped, a caller reads the directory until it gets 0 anyway.
+ */
+static int _sys_getdents_to_user(file_descriptor_t* fd, uint8_t* ubuf, uint32_t len, bool with_stat)
+{
+    if (!len) {
+        return -EINVAL;
+    }
+
+    len = min(len, VFS_GETDENTS_STAT_CHUNK);
+    uint8_t* buf = kmalloc(len);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    int read = with_stat ? vfs_getdents_stat(fd, buf, len) : vfs_getdents(fd, buf, len);
+    if (read > 0 && copy_to_user(ubuf, buf, read)) {
+        read = -EFAULT;
+    }
+    kfree(buf);
+    return read;
+}
+
 void sys_getdents(trapframe_t* tf)
 {
     proc_t* p = RUNNING_THREAD->process;
     file_descriptor_t* fd = (file_descriptor_t*)proc_get_fd(p, (uint32_t)param1);
-    int read = vfs_getdents(fd, (uint8_t*)param2, param3);
-    return_with_val(read);
+    if (!fd) {
+        return_with_val(-EBADF);
+    }
+    return_with_val(_sys_getdents_to_user(fd, (uint8_t*)param2, param3, false));
+}
+
+void sys_getdents_stat(trapframe_t* tf)
+{
+    proc_t* p = RUNNING_THREAD->process;
+    file_descriptor_t* fd = (file_descriptor_t*)proc_get_fd(p, (uint32_t)param1);
+    if (!fd) {
+        return_with_val(-EBADF);
+    }
+    return_with_val(_sys_getdents_to_user(fd, (uint8_t*)param2, param3, true));
 }
 
 void sys_select(trapframe_t* tf)
@@ -259,23 +569,40 @@ void sys_select(trapframe_t* tf)
     file_descriptor_t* fd;
 
     int nfds = param1;
-    fd_set_t* readfds = (fd_set_t*)param2;
-    fd_set_t* writefds = (fd_set_t*)param3;
-    fd_set_t* exceptfds = (fd_set_t*)param4;
-    timeval_t* timeout = (timeval_t*)param5;
+    fd_set_t* ureadfds = (fd_set_t*)param2;
+    fd_set_t* uwritefds = (fd_set_t*)param3;
+    fd_set_t* uexceptfds = (fd_set_t*)param4;
+    timeval_t* utimeout = (timeval_t*)param5;
     if (nfds < 0 || nfds > FD_SETSIZE) {
         return_with_val(-EINVAL);
     }
 
+    // The sets are worked on in the kernel and copied back at the end.
+    fd_set_t kreadfds, kwritefds, kexceptfds;
+    timeval_t ktimeout;
+    fd_set_t* readfds = ureadfds ? &kreadfds : NULL;
+    fd_set_t* writefds = uwritefds ? &kwritefds : NULL;
+    fd_set_t* exceptfds = uexceptfds ? &kexceptfds : NULL;
+    timeval_t* timeout = utimeout ? &ktimeout : NULL;
+    if ((readfds && copy_from_user(readfds, ureadfds, sizeof(fd_set_t)))
+        || (writefds && copy_from_user(writefds, uwritefds, sizeof(fd_set_t)))
+        || (exceptfds && copy_from_user(exceptfds, uexceptfds, sizeof(fd_set_t)))
+        || (timeout && copy_from_user(timeout, utimeout, sizeof(timeval_t)))) {
+        return_with_val(-EFAULT);
+    }
+
     for (int i = 0; i < nfds; i++) {
-        if (FD_ISSET(i, readfds) || FD_ISSET(i, writefds) || FD_ISSET(i, exceptfds)) {
+        if ((readfds && FD_ISSET(i, readfds)) || (writefds && FD_ISSET(i, writefds)) || (exceptfds && FD_ISSET(i, exceptfds))) {
             if (!proc_get_fd(p, i)) {
                 return_with_val(-EBADF);
             }
         }
     }
 
-    init_select_blocker(RUNNING_THREAD, nfds, readfds, writefds, exceptfds, timeout);
+    int err = init_select_blocker(RUNNING_THREAD, nfds, readfds, writefds, exceptfds, timeout);
+    if (err) {
+        return_with_val(err);
+    }
 
     if (readfds) {
         FD_ZERO(readfds);
@@ -289,21 +616,33 @@ void sys_select(trapframe_t* tf)
 
     for (int i = 0; i < nfds; i++) {
         fd = proc_get_fd(p, i);
-        if (readfds && FD_ISSET(i, &(RUNNING_THREAD->readfds))) {
+        if (readfds && FD_ISSET(i, &(RUNNING_THREAD->cold->readfds))) {
             if (fd->ops->can_read && fd->ops->can_read(fd->dentry, fd->offset)) {
                 FD_SET(i, readfds);
             }
         }
-        if (writefds && FD_ISSET(i, &(RUNNING_THREAD->writefds))) {
+        if (writefds && FD_ISSET(i, &(RUNNING_THREAD->cold->writefds))) {
             if (fd->ops->can_write && fd->ops->can_write(fd->dentry, fd->offset)) {
                 FD_SET(i, writefds);
             }
         }
     }
 
+    if ((readfds && copy_to_user(ureadfds, readfds, sizeof(fd_set_t)))
+        || (writefds && copy_to_user(uwritefds, writefds, sizeof(fd_set_t)))
+        || (exceptfds && copy_to_user(uexceptfds, exceptfds, sizeof(fd_set_t)))) {
+        return_with_val(-EFAULT);
+    }
     return_with_val(0);
 }
 
+// Only pages of anonymous mappings could be dropped, nothing else backs them.
+static inline bool _sys_is_anonymous_zone(proc_zone_t* zone)
+{
+    uint32_t not_anonymous = ZONE_TYPE_DEVICE | ZONE_TYPE_MAPPED_FILE_PRIVATLY | ZONE_TYPE_MAPPED_FILE_SHAREDLY | ZONE_TYPE_SHARED_BUFFER;
+    return (zone->type & ZONE_TYPE_MAPPED) && !(zone->type & not_anonymous);
+}
+
 void sys_mmap(trapframe_t* tf)
 {
     proc_t* p = RUNNING_THREAD->process;
@@ -328,7 +667,21 @@ void sys_mmap(trapframe_t* tf)
         return_with_val(-EINVAL);
     }
 
-    if (map_stack) {
+    if (map_fixed) {
+        uint32_t start = (uint32_t)params->addr;
+        if ((start % VMM_PAGE_SIZE) || start >= KERNEL_BASE || params->size > KERNEL_BASE - start) {
+            return_with_val(-EINVAL);
+        }
+        uint32_t len = PAGE_START(params->size + VMM_PAGE_SIZE - 1);
+        int err = proc_release_reserved_range(p, start, len);
+        if (err) {
+            return_with_val(err);
+        }
+    }
+
+    if (map_fixed && (map_stack || map_anonymous)) {
+        zone = proc_new_zone(p, (uint32_t)params->addr, params->size);
+    } else if (map_stack) {
         zone = proc_new_random_zone_backward(p, params->size);
     } else if (map_anonymous) {
         zone = proc_new_random_zone(p, params->size);
@@ -377,6 +730,97 @@ void sys_munmap(trapframe_t* tf)
         return_with_val(vfs_munmap(p, zone));
     }
 
-    // TODO: Split or remove zone
+    if (!_sys_is_anonymous_zone(zone)) {
+        return_with_val(0);
+    }
+
+    uint32_t start = (uint32_t)ptr;
+    uint32_t len = PAGE_START((uint32_t)param2 + VMM_PAGE_SIZE - 1);
+    if (start % VMM_PAGE_SIZE) {
+        return_with_val(-EINVAL);
+    }
+    if (len > zone->start + zone->len - start) {
+        len = zone->start + zone->len - start;
+    }
+
+    vmm_release_pages(start, len);
+    return_with_val(proc_cut_zone(p, zone, start, len));
+}
+
+/**
+ * MADV_DONTNEED drops the pages of an anonymous mapping, they read as zeroes
+ * after. Other advice is accepted and ignored.
+ */
+void sys_madvise(trapframe_t* tf)
+{
+    proc_t* p = RUNNING_THREAD->process;
+    uint32_t start = (uint32_t)param1;
+    uint32_t len = PAGE_START((uint32_t)param2 + VMM_PAGE_SIZE - 1);
+    int advice = (int)param3;
+
+    if (start % VMM_PAGE_SIZE) {
+        return_with_val(-EINVAL);
+    }
+    if (advice != MADV_DONTNEED) {
+        return_with_val(0);
+    }
+
+    proc_zone_t* zone = proc_find_zone(p, start);
+    if (!zone) {
+        return_with_val(-ENOMEM);
+    }
+    if (!_sys_is_anonymous_zone(zone) || len > zone->start + zone->len - start) {
+        return_with_val(-EINVAL);
+    }
+
+    return_with_val(vmm_release_pages(start, len));
+}
+
+/**
+ * The range could span several zones, every shared file mapping in it is
+ * written back.
+ */
+void sys_msync(trapframe_t* tf)
+{
+    proc_t* p = RUNNING_THREAD->process;
+    uint32_t start = (uint32_t)param1;
+    uint32_t end = start + (uint32_t)param2;
+    int flags = (int)param3;
+
+    if (start % VMM_PAGE_SIZE || end < start) {
+        return_with_val(-EINVAL);
+    }
+    if ((flags & MS_ASYNC) && (flags & MS_SYNC)) {
+        return_with_val(-EINVAL);
+    }
+
+    while (start < end) {
+        proc_zone_t* zone = proc_find_zone(p, start);
+        if (!zone) {
+            return_with_val(-ENOMEM);
+        }
+
+        uint32_t len = min(end - start, zone->start + zone->len - start);
+        int err = vfs_msync(zone, start, len, flags);
+        if (err) {
+            return_with_val(err);
+        }
+        start += len;
+    }
+
     return_with_val(0);
-}
\ No newline at end of file
+}
+
+void sys_fsync(trapframe_t* tf)
+{
+    file_descriptor_t* fd = proc_get_fd(RUNNING_THREAD->process, (int)param1);
+    if (!fd) {
+        return_with_val(-EBADF);
+    }
+    return_with_val(vfs_fsync(fd));
+}
+
+void sys_sync(trapframe_t* tf)
+{
+    return_with_val(vfs_sync());
+}
@@ -7,6 +7,7 @@
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
+#include <libkern/trace.h>
 #include <mem/kmalloc.h>
 #include <platform/generic/syscalls/params.h>
 #include <platform/generic/system.h>
@@ -62,6 +63,29 @@ static const void* syscalls[] = {
     [SYS_SHBUF_CREATE] = sys_shbuf_create,
     [SYS_SHBUF_GET] = sys_shbuf_get,
     [SYS_SHBUF_FREE] = sys_shbuf_free,
+    [SYS_SPAWN] = sys_spawn,
+    [SYS_FSYNC] = sys_fsync,
+    [SYS_SYNC] = sys_sync,
+    [SYS_FUTEX] = sys_futex,
+    [SYS_PTHREADEXIT] = sys_exit_thread,
+    [SYS_DUP2] = sys_dup2,
+    [SYS_RING_ENTER] = sys_ring_enter,
+    [SYS_ACCEPT] = sys_accept,
+    [SYS_SHBUF_RESIZE] = sys_shbuf_resize,
+    [SYS_SHBUF_HAND_OVER] = sys_shbuf_hand_over,
+    [SYS_EPOLL_CREATE] = sys_epoll_create,
+    [SYS_EPOLL_CTL] = sys_epoll_ctl,
+    [SYS_EPOLL_WAIT] = sys_epoll_wait,
+    [SYS_SHBUF_SEAL] = sys_shbuf_seal,
+    [SYS_MADVISE] = sys_madvise,
+    [SYS_WRITEV] = sys_writev,
+    [SYS_GETDENTS_STAT] = sys_getdents_stat,
+    [SYS_SENDFILE] = sys_sendfile,
+    [SYS_COPY_FILE_RANGE] = sys_copy_file_range,
+    [SYS_MSYNC] = sys_msync,
+    [SYS_PERF_OPEN] = sys_perf_open,
+    [SYS_PERF_READ] = sys_perf_read,
+    [SYS_PERF_CLOSE] = sys_perf_close,
 };
 
 #ifdef __i386__
@@ -107,12 +131,39 @@ void sys_handler(trapframe_t* tf)
 {
     system_disable_interrupts();
     cpu_enter_kernel_space();
-    void (*callee)(trapframe_t*) = (void*)syscalls[sys_id];
+    if (RUNNING_THREAD) {
+        RUNNING_THREAD->stat_syscalls++;
+    }
+    uint32_t id = sys_id;
+    trace_point(TRACE_SYSCALL_ENTER, id, param1, param2);
+    void (*callee)(trapframe_t*) = (void*)syscalls[id];
     callee(tf);
+    trace_point(TRACE_SYSCALL_EXIT, id, return_val, 0);
     cpu_leave_kernel_space();
     system_enable_interrupts_only_counter();
 }
 
+/**
+ * Runs @id for the running thread from inside of another syscall. The
+ * handler gets its own trapframe, so it can't touch the user context.
+ */
+int sys_handler_nested(uint32_t id, uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t e)
+{
+    trapframe_t* tf;
+    trapframe_t tf_on_stack;
+    memset(&tf_on_stack, 0, sizeof(tf_on_stack));
+    tf = &tf_on_stack;
+    sys_id = id;
+    param1 = a;
+    param2 = b;
+    param3 = c;
+    param4 = d;
+    param5 = e;
+    void (*callee)(trapframe_t*) = (void*)syscalls[id];
+    callee(tf);
+    return return_val;
+}
+
 void sys_restart_syscall(trapframe_t* tf)
 {
 }
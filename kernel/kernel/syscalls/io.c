@@ -4,11 +4,17 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <io/epoll/epoll.h>
 #include <io/shared_buffer/shared_buffer.h>
 #include <io/sockets/local_socket.h>
 #include <libkern/bits/errno.h>
+#include <libkern/bits/sys/ring.h>
+#include <libkern/bits/syscalls.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <mem/vmm/uaccess.h>
+#include <mem/vmm/vmm.h>
 #include <platform/generic/syscalls/params.h>
 #include <syscalls/handlers.h>
 #include <tasking/tasking.h>
@@ -20,7 +26,8 @@ void sys_socket(trapframe_t* tf)
     int type = param2;
     int protocol = param3;
 
-    file_descriptor_t* fd = proc_get_free_fd(p);
+    int index;
+    file_descriptor_t* fd = proc_alloc_fd(p, &index);
     if (!fd) {
         return_with_val(-1);
     }
@@ -28,10 +35,12 @@ void sys_socket(trapframe_t* tf)
     if (domain == PF_LOCAL) {
         int res = local_socket_create(type, protocol, fd);
         if (!res) {
-            return_with_val(proc_get_fd_id(p, fd));
+            return_with_val(index);
         }
+        proc_free_fd(p, index);
         return_with_val(res);
     }
+    proc_free_fd(p, index);
     return_with_val(-1);
 }
 
@@ -73,6 +82,32 @@ void sys_connect(trapframe_t* tf)
     return_with_val(-EFAULT);
 }
 
+void sys_accept(trapframe_t* tf)
+{
+    proc_t* p = RUNNING_THREAD->process;
+    file_descriptor_t* sfd = proc_get_fd(p, param1);
+    if (!sfd || sfd->type != FD_TYPE_SOCKET || !sfd->sock_entry) {
+        return_with_val(-EBADF);
+    }
+
+    if (sfd->sock_entry->domain != PF_LOCAL) {
+        return_with_val(-EOPNOTSUPP);
+    }
+
+    int index;
+    file_descriptor_t* fd = proc_alloc_fd(p, &index);
+    if (!fd) {
+        return_with_val(-EMFILE);
+    }
+
+    int res = local_socket_accept(sfd, fd);
+    if (res < 0) {
+        proc_free_fd(p, index);
+        return_with_val(res);
+    }
+    return_with_val(index);
+}
+
 void sys_ioctl(trapframe_t* tf)
 {
     proc_t* p = RUNNING_THREAD->process;
@@ -92,18 +127,234 @@ void sys_shbuf_create(trapframe_t* tf)
 {
     uint8_t** buffer = (uint8_t**)param1;
     size_t size = param2;
-    return_with_val(shared_buffer_create(buffer, size));
+    uint8_t* kbuffer;
+    int id = shared_buffer_create(&kbuffer, size);
+    if (id >= 0 && copy_to_user(buffer, &kbuffer, sizeof(uint8_t*))) {
+        shared_buffer_free(id);
+        return_with_val(-EFAULT);
+    }
+    return_with_val(id);
 }
 
 void sys_shbuf_get(trapframe_t* tf)
 {
     int id = param1;
     uint8_t** buffer = (uint8_t**)param2;
-    return_with_val(shared_buffer_get(id, buffer));
+    uint8_t* kbuffer;
+    int err = shared_buffer_get(id, &kbuffer);
+    if (!err && copy_to_user(buffer, &kbuffer, sizeof(uint8_t*))) {
+        return_with_val(-EFAULT);
+    }
+    return_with_val(err);
 }
 
 void sys_shbuf_free(trapframe_t* tf)
 {
     int id = param1;
     return_with_val(shared_buffer_free(id));
-}
\ No newline at end of file
+}
+
+void sys_shbuf_resize(trapframe_t* tf)
+{
+    int id = param1;
+    uint8_t** buffer = (uint8_t**)param2;
+    size_t size = param3;
+    uint8_t* kbuffer;
+    int err = shared_buffer_resize(id, &kbuffer, size);
+    if (!err && copy_to_user(buffer, &kbuffer, sizeof(uint8_t*))) {
+        return_with_val(-EFAULT);
+    }
+    return_with_val(err);
+}
+
+void sys_shbuf_hand_over(trapframe_t* tf)
+{
+    int id = param1;
+    return_with_val(shared_buffer_hand_over(id));
+}
+
+void sys_shbuf_seal(trapframe_t* tf)
+{
+    int id = param1;
+    return_with_val(shared_buffer_seal(id));
+}
+
+/**
+ * EPOLL
+ */
+
+static epoll_t* _epoll_of(proc_t* p, int epfd)
+{
+    file_descriptor_t* fd = proc_get_fd(p, epfd);
+    if (!fd || fd->type != FD_TYPE_EPOLL) {
+        return NULL;
+    }
+    return fd->epoll_entry;
+}
+
+void sys_epoll_create(trapframe_t* tf)
+{
+    proc_t* p = RUNNING_THREAD->process;
+    int index;
+    file_descriptor_t* fd = proc_alloc_fd(p, &index);
+    if (!fd) {
+        return_with_val(-EMFILE);
+    }
+
+    int res = epoll_create(p, fd);
+    if (res < 0) {
+        proc_free_fd(p, index);
+        return_with_val(res);
+    }
+    return_with_val(index);
+}
+
+void sys_epoll_ctl(trapframe_t* tf)
+{
+    epoll_t* ep = _epoll_of(RUNNING_THREAD->process, param1);
+    if (!ep) {
+        return_with_val(-EBADF);
+    }
+
+    int op = param2;
+    int fd = param3;
+    epoll_event_t event = { 0 };
+    if (op != EPOLL_CTL_DEL) {
+        if (!param4) {
+            return_with_val(-EFAULT);
+        }
+        event = *(epoll_event_t*)param4;
+    }
+    return_with_val(epoll_ctl(ep, op, fd, &event));
+}
+
+/**
+ * Waits for the interest list as a whole: the fds are not passed and
+ * checked again on each call like select does. Returns the count of
+ * events put into the buffer, 0 on timeout.
+ */
+void sys_epoll_wait(trapframe_t* tf)
+{
+    epoll_t* ep = _epoll_of(RUNNING_THREAD->process, param1);
+    if (!ep) {
+        return_with_val(-EBADF);
+    }
+
+    epoll_event_t* events = (epoll_event_t*)param2;
+    int maxevents = param3;
+    int timeout_ms = param4;
+    if (maxevents <= 0) {
+        return_with_val(-EINVAL);
+    }
+    maxevents = min(maxevents, EPOLL_ITEMS_MAX);
+
+    int err = init_epoll_blocker(RUNNING_THREAD, ep, timeout_ms);
+    if (err) {
+        return_with_val(err);
+    }
+
+    /* Collected into the kernel first, the user buffer may fault. */
+    epoll_event_t* ready = kmalloc(maxevents * sizeof(epoll_event_t));
+    if (!ready) {
+        return_with_val(-ENOMEM);
+    }
+    int count = epoll_collect(ep, ready, maxevents);
+    if (copy_to_user(events, ready, count * sizeof(epoll_event_t))) {
+        count = -EFAULT;
+    }
+    kfree(ready);
+    return_with_val(count);
+}
+
+/**
+ * SYSCALL RING
+ */
+
+static bool _ring_is_allowed(uint32_t id)
+{
+    switch (id) {
+    case SYS_READ:
+    case SYS_WRITE:
+    case SYS_SELECT:
+    case SYS_SHBUF_CREATE:
+    case SYS_SHBUF_GET:
+    case SYS_SHBUF_FREE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline bool _ring_is_user_range(uint32_t start, size_t len)
+{
+    return start < KERNEL_BASE && len <= KERNEL_BASE - start;
+}
+
+/**
+ * Runs up to @to_submit queued entries one by one, the same way as separate
+ * syscalls would run, so an entry which blocks holds back the ones after it.
+ * Stops early when the completion queue is full. Returns the count of
+ * consumed entries.
+ */
+void sys_ring_enter(trapframe_t* tf)
+{
+    ring_t* ring = (ring_t*)param1;
+    uint32_t to_submit = param2;
+
+    ring_t kring;
+    if (!_ring_is_user_range((uint32_t)ring, sizeof(ring_t)) || copy_from_user(&kring, ring, sizeof(ring_t))) {
+        return_with_val(-EFAULT);
+    }
+
+    uint32_t entries = kring.entries;
+    ring_sqe_t* sqes = kring.sqes;
+    ring_cqe_t* cqes = kring.cqes;
+    if (!entries || entries > RING_ENTRIES_MAX || (entries & (entries - 1))) {
+        return_with_val(-EINVAL);
+    }
+    if (!_ring_is_user_range((uint32_t)sqes, entries * sizeof(ring_sqe_t))) {
+        return_with_val(-EFAULT);
+    }
+    if (!_ring_is_user_range((uint32_t)cqes, entries * sizeof(ring_cqe_t))) {
+        return_with_val(-EFAULT);
+    }
+
+    uint32_t mask = entries - 1;
+    uint32_t done = 0;
+    int err = 0;
+    while (done < to_submit) {
+        /* The process moves sq_tail and cq_head while the kernel works, so
+           the indexes are read again for every entry. */
+        if (copy_from_user(&kring, ring, sizeof(ring_t))) {
+            err = -EFAULT;
+            break;
+        }
+        if (kring.sq_head == kring.sq_tail || kring.cq_tail - kring.cq_head >= entries) {
+            break;
+        }
+
+        /* The process could change the entry while the syscall runs. */
+        ring_sqe_t sqe;
+        if (copy_from_user(&sqe, &sqes[kring.sq_head & mask], sizeof(ring_sqe_t))) {
+            err = -EFAULT;
+            break;
+        }
+        int res = -ENOSYS;
+        if (_ring_is_allowed(sqe.id)) {
+            res = sys_handler_nested(sqe.id, sqe.params[0], sqe.params[1], sqe.params[2], sqe.params[3], sqe.params[4]);
+        }
+
+        ring_cqe_t cqe = { .user_data = sqe.user_data, .res = res };
+        kring.cq_tail++;
+        kring.sq_head++;
+        if (copy_to_user(&cqes[(kring.cq_tail - 1) & mask], &cqe, sizeof(ring_cqe_t))
+            || copy_to_user(&ring->cq_tail, &kring.cq_tail, sizeof(uint32_t))
+            || copy_to_user(&ring->sq_head, &kring.sq_head, sizeof(uint32_t))) {
+            err = -EFAULT;
+            break;
+        }
+        done++;
+    }
+
+    return_with_val(done ? (int)done : err);
+}
@@ -8,16 +8,40 @@
 #include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <libkern/version.h>
+#include <mem/vmm/uaccess.h>
 #include <mem/vmm/vmm.h>
 #include <platform/generic/syscalls/params.h>
 #include <syscalls/handlers.h>
+#include <tasking/cpu.h>
+#include <tasking/perf.h>
+#include <tasking/thread.h>
 
 void sys_uname(trapframe_t* tf)
 {
     utsname_t* buf = (utsname_t*)param1;
-    vmm_copy_to_user(buf->sysname, OSTYPE, sizeof(OSTYPE));
-    vmm_copy_to_user(buf->release, OSRELEASE, sizeof(OSRELEASE));
-    vmm_copy_to_user(buf->version, VERSION_VARIANT, sizeof(VERSION_VARIANT));
-    vmm_copy_to_user(buf->machine, MACHINE, sizeof(MACHINE));
-    return_with_val(0);
-}
\ No newline at end of file
+    uint32_t left = copy_to_user(buf->sysname, OSTYPE, sizeof(OSTYPE));
+    left |= copy_to_user(buf->release, OSRELEASE, sizeof(OSRELEASE));
+    left |= copy_to_user(buf->version, VERSION_VARIANT, sizeof(VERSION_VARIANT));
+    left |= copy_to_user(buf->machine, MACHINE, sizeof(MACHINE));
+    return_with_val(left ? -EFAULT : 0);
+}
+
+void sys_perf_open(trapframe_t* tf)
+{
+    return_with_val(perf_open(RUNNING_THREAD, param1, param2));
+}
+
+void sys_perf_read(trapframe_t* tf)
+{
+    uint64_t value;
+    int err = perf_read(RUNNING_THREAD, param1, &value);
+    if (err) {
+        return_with_val(err);
+    }
+    return_with_val(copy_to_user((uint64_t*)param2, &value, sizeof(value)) ? -EFAULT : 0);
+}
+
+void sys_perf_close(trapframe_t* tf)
+{
+    return_with_val(perf_close(RUNNING_THREAD, param1));
+}
@@ -7,6 +7,7 @@
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
+#include <mem/vmm/uaccess.h>
 #include <platform/generic/syscalls/params.h>
 #include <syscalls/handlers.h>
 #include <tasking/sched.h>
@@ -36,9 +37,15 @@ void sys_exec(trapframe_t* tf)
     }
 }
 
+void sys_spawn(trapframe_t* tf)
+{
+    int res = tasking_spawn((char*)param1, (const char**)param2, (const char**)param3);
+    return_with_val(res);
+}
+
 void sys_sigaction(trapframe_t* tf)
 {
-    int res = signal_set_handler(RUNNING_THREAD, (int)param1, (void*)param2);
+    int res = signal_set_handler(RUNNING_THREAD, (int)param1, (void*)param2, (int)param3);
     return_with_val(res);
 }
 
@@ -109,18 +116,47 @@ void sys_create_thread(trapframe_t* tf)
     uint32_t esp = params->stack_start + params->stack_size;
     set_stack_pointer(thread->tf, esp);
     set_base_pointer(thread->tf, esp);
+    thread->tls = params->tls;
 
     return_with_val(thread->tid);
 }
 
+/**
+ * The thread stops, the process keeps running. If @param1 is set, the
+ * kernel clears the word and wakes its futex waiters once the thread
+ * doesn't touch its stack anymore, so the stack could be reused.
+ */
+void sys_exit_thread(trapframe_t* tf)
+{
+    thread_t* thread = RUNNING_THREAD;
+    proc_t* p = thread->process;
+    uint32_t* clear_addr = (uint32_t*)param1;
+
+    if (thread == p->main_thread) {
+        tasking_exit(0);
+        return;
+    }
+
+    if (clear_addr && !((uint32_t)clear_addr & 3)) {
+        uint32_t zero = 0;
+        if (!copy_to_user(clear_addr, &zero, sizeof(uint32_t))) {
+            blocker_futex_wake(p, clear_addr, FUTEX_WAKE_ALL);
+        }
+    }
+
+    lock_acquire(&p->lock);
+    thread_die(thread);
+    p->dying_threads++;
+    lock_release(&p->lock);
+    resched();
+}
+
 void sys_sleep(trapframe_t* tf)
 {
     thread_t* p = RUNNING_THREAD;
     time_t time = param1;
 
-    init_sleep_blocker(p, time);
-
-    return_with_val(0);
+    return_with_val(init_sleep_blocker(p, time));
 }
 
 void sys_sched_yield(trapframe_t* tf)
@@ -128,6 +164,25 @@ void sys_sched_yield(trapframe_t* tf)
     resched();
 }
 
+void sys_futex(trapframe_t* tf)
+{
+    uint32_t* uaddr = (uint32_t*)param1;
+    int op = param2;
+
+    if (!uaddr || ((uint32_t)uaddr & 3)) {
+        return_with_val(-EINVAL);
+    }
+
+    switch (op) {
+    case FUTEX_WAIT:
+        return_with_val(init_futex_blocker(RUNNING_THREAD, uaddr, param3));
+    case FUTEX_WAKE:
+        return_with_val(blocker_futex_wake(RUNNING_THREAD->process, uaddr, param3));
+    default:
+        return_with_val(-EINVAL);
+    }
+}
+
 void sys_nice(trapframe_t* tf)
 {
     int inc = param1;
@@ -7,6 +7,7 @@
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
+#include <mem/vmm/uaccess.h>
 #include <platform/generic/syscalls/params.h>
 #include <platform/generic/tasking/trapframe.h>
 #include <syscalls/handlers.h>
@@ -16,19 +17,20 @@ void sys_clock_gettime(trapframe_t* tf)
 {
     clockid_t clk_id = param1;
     timespec_t* u_ts = (timespec_t*)param2;
+    timespec_t ts;
 
     switch (clk_id) {
     case CLOCK_MONOTONIC:
-        u_ts->tv_sec = timeman_seconds_since_boot();
-        u_ts->tv_nsec = timeman_get_ticks_from_last_second() * (1000000000 / timeman_ticks_per_second());
-        break;
     case CLOCK_REALTIME:
-        u_ts->tv_sec = timeman_now();
-        u_ts->tv_nsec = timeman_get_ticks_from_last_second() * (1000000000 / timeman_ticks_per_second());
+        timeman_clock_read(clk_id, &ts);
         break;
     default:
         return_with_val(-EINVAL);
     }
+
+    if (copy_to_user(u_ts, &ts, sizeof(timespec_t))) {
+        return_with_val(-EFAULT);
+    }
     return_with_val(0);
 }
 
@@ -41,11 +43,18 @@ void sys_gettimeofday(trapframe_t* tf)
         return_with_val(-EINVAL);
     }
 
-    tv->tv_sec = timeman_now();
-    tv->tv_usec = timeman_get_ticks_from_last_second() * (1000000 / timeman_ticks_per_second());
+    timespec_t ts;
+    timeman_clock_read(CLOCK_REALTIME, &ts);
+    timeval_t ktv;
+    ktv.tv_sec = ts.tv_sec;
+    ktv.tv_usec = ts.tv_nsec / 1000;
 
-    tz->tz_dsttime = DST_NONE;
-    tz->tz_minuteswest = 0;
+    timezone_t ktz;
+    ktz.tz_dsttime = DST_NONE;
+    ktz.tz_minuteswest = 0;
 
+    if (copy_to_user(tv, &ktv, sizeof(timeval_t)) || copy_to_user(tz, &ktz, sizeof(timezone_t))) {
+        return_with_val(-EFAULT);
+    }
     return_with_val(0);
 }
\ No newline at end of file
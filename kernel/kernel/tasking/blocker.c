@@ -4,6 +4,8 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <io/epoll/epoll.h>
+#include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <libkern/syscall_structs.h>
@@ -11,6 +13,215 @@
 #include <tasking/thread.h>
 #include <time/time_manager.h>
 
+#define BLOCKER_FUTEX_QUEUES (32)
+
+static lock_t _blocker_lock;
+static wait_queue_t _blocker_join_queue;
+static wait_queue_t _blocker_io_queue;
+static wait_queue_t _blocker_sleep_queue;
+static wait_queue_t _blocker_futex_queues[BLOCKER_FUTEX_QUEUES];
+static time_t _blocker_io_last_check;
+
+/**
+ * WAIT QUEUE FUNCTIONS
+ */
+
+static void _blocker_queue_remove_lockless(thread_t* thread)
+{
+    wait_queue_t* queue = thread->wait_queue;
+    if (thread->wait_prev) {
+        thread->wait_prev->wait_next = thread->wait_next;
+    } else {
+        queue->head = thread->wait_next;
+    }
+    if (thread->wait_next) {
+        thread->wait_next->wait_prev = thread->wait_prev;
+    } else {
+        queue->tail = thread->wait_prev;
+    }
+    thread->wait_queue = NULL;
+    thread->wait_prev = NULL;
+    thread->wait_next = NULL;
+    timers_remove(&thread->blocker_timer);
+}
+
+static void _blocker_queue_add_lockless(wait_queue_t* queue, thread_t* thread)
+{
+    thread->wait_queue = queue;
+    thread->wait_next = NULL;
+    thread->wait_prev = queue->tail;
+    if (queue->tail) {
+        queue->tail->wait_next = thread;
+    } else {
+        queue->head = thread;
+    }
+    queue->tail = thread;
+
+    /* An event could come between the check in init_*_blocker and this point,
+       so a newly blocked thread is always checked once. */
+    queue->woken = true;
+}
+
+static inline void _blocker_unblock_lockless(thread_t* thread)
+{
+    _blocker_queue_remove_lockless(thread);
+    thread->status = THREAD_RUNNING;
+    thread->blocker.reason = BLOCKER_INVALID;
+    sched_wakeup(thread);
+}
+
+static void _blocker_check_queue_lockless(wait_queue_t* queue)
+{
+    thread_t* thread = queue->head;
+    while (thread) {
+        thread_t* next = thread->wait_next;
+        if (thread->status != THREAD_BLOCKED) {
+            /* The thread runs a signal handler and will block again after it,
+               the queue is checked on the next pass not to lose the event. */
+            queue->woken = true;
+        } else if (thread->blocker.should_unblock && thread->blocker.should_unblock(thread)) {
+            _blocker_unblock_lockless(thread);
+        }
+        thread = next;
+    }
+}
+
+static inline bool _blocker_is_timed(thread_t* thread)
+{
+    int reason = thread->blocker.reason;
+    if (reason != BLOCKER_SLEEP && reason != BLOCKER_SELECT && reason != BLOCKER_EPOLL) {
+        return false;
+    }
+    return thread->unblock_time != 0 && thread->unblock_time <= timeman_global_ticks();
+}
+
+/**
+ * Fires when the unblock_time of a sleep or a select has come. A thread
+ * which runs a signal handler will block again after it, so its timer is
+ * added again to check it on the next tick.
+ */
+static void _blocker_timer_callback(timer_entry_t* timer)
+{
+    thread_t* thread = (thread_t*)timer->data;
+    lock_acquire(&_blocker_lock);
+    if (!thread->wait_queue || !thread->blocker.should_unblock) {
+        lock_release(&_blocker_lock);
+        return;
+    }
+
+    if (thread->status == THREAD_BLOCKED && thread->blocker.should_unblock(thread)) {
+        _blocker_unblock_lockless(thread);
+    } else if (thread->status != THREAD_BLOCKED && _blocker_is_timed(thread) && !thread->blocker_timer.pending) {
+        timers_add(&thread->blocker_timer, timeman_global_ticks() + 1);
+    }
+    lock_release(&_blocker_lock);
+}
+
+static inline int _blocker_end_wait(thread_t* thread)
+{
+    if (thread->blocker.interrupted) {
+        thread->blocker.interrupted = false;
+        return -EINTR;
+    }
+    return 0;
+}
+
+/**
+ * Returns -EINTR if the wait was ended by a signal handler which doesn't
+ * restart it, see signal_dispatch_pending().
+ */
+static int _blocker_block(thread_t* thread, wait_queue_t* queue, int reason, int (*should_unblock)(thread_t*), bool timed)
+{
+    thread->status = THREAD_BLOCKED;
+    thread->blocker.interrupted = false;
+    thread->blocker.reason = reason;
+    thread->blocker.should_unblock = should_unblock;
+    thread->blocker.should_unblock_for_signal = true;
+    sched_dequeue(thread);
+
+    lock_acquire(&_blocker_lock);
+    if (thread->wait_queue) {
+        _blocker_queue_remove_lockless(thread);
+    }
+    _blocker_queue_add_lockless(queue, thread);
+    if (timed) {
+        thread->blocker_timer.callback = _blocker_timer_callback;
+        thread->blocker_timer.data = thread;
+        timers_add(&thread->blocker_timer, thread->unblock_time);
+    }
+    lock_release(&_blocker_lock);
+    resched();
+    return _blocker_end_wait(thread);
+}
+
+void blocker_init()
+{
+    lock_init(&_blocker_lock);
+}
+
+/**
+ * Called by the scheduler, checks only threads of woken queues. The io
+ * queue is also checked once a second for devices which don't wake it.
+ */
+void blocker_unblock_threads()
+{
+    time_t now = timeman_now();
+    lock_acquire(&_blocker_lock);
+    if (_blocker_join_queue.woken) {
+        _blocker_join_queue.woken = false;
+        _blocker_check_queue_lockless(&_blocker_join_queue);
+    }
+
+    if (_blocker_io_queue.woken || _blocker_io_last_check != now) {
+        _blocker_io_queue.woken = false;
+        _blocker_io_last_check = now;
+        _blocker_check_queue_lockless(&_blocker_io_queue);
+    }
+    lock_release(&_blocker_lock);
+}
+
+void blocker_remove(thread_t* thread)
+{
+    lock_acquire(&_blocker_lock);
+    if (thread->wait_queue) {
+        _blocker_queue_remove_lockless(thread);
+    }
+    lock_release(&_blocker_lock);
+}
+
+/**
+ * Ends the wait of a thread whose signal handler has returned, the blocker
+ * function returns -EINTR.
+ */
+void blocker_interrupt(thread_t* thread)
+{
+    lock_acquire(&_blocker_lock);
+    if (thread->wait_queue) {
+        _blocker_queue_remove_lockless(thread);
+    }
+    thread->futex_addr = NULL;
+    thread->blocker.reason = BLOCKER_INVALID;
+    lock_release(&_blocker_lock);
+}
+
+/**
+ * Called by producers of data (drivers, ttys, sockets) after their buffers
+ * have changed. Safe to call from interrupt handlers.
+ */
+void blocker_wake_io()
+{
+    _blocker_io_queue.woken = true;
+}
+
+void blocker_wake_joiners()
+{
+    _blocker_join_queue.woken = true;
+}
+
+/**
+ * BLOCKER FUNCTIONS
+ */
+
 int should_unblock_join_block(thread_t* thread)
 {
     // TODO: Add more checks here.
@@ -26,13 +237,7 @@ int init_join_blocker(thread_t* thread)
         return 0;
     }
 
-    thread->status = THREAD_BLOCKED;
-    thread->blocker.reason = BLOCKER_JOIN;
-    thread->blocker.should_unblock = should_unblock_join_block;
-    thread->blocker.should_unblock_for_signal = true;
-    sched_dequeue(thread);
-    resched();
-    return 0;
+    return _blocker_block(thread, &_blocker_join_queue, BLOCKER_JOIN, should_unblock_join_block, false);
 }
 
 int should_unblock_read_block(thread_t* thread)
@@ -48,13 +253,7 @@ int init_read_blocker(thread_t* thread, file_descriptor_t* bfd)
         return 0;
     }
 
-    thread->status = THREAD_BLOCKED;
-    thread->blocker.reason = BLOCKER_READ;
-    thread->blocker.should_unblock = should_unblock_read_block;
-    thread->blocker.should_unblock_for_signal = true;
-    sched_dequeue(thread);
-    resched();
-    return 0;
+    return _blocker_block(thread, &_blocker_io_queue, BLOCKER_READ, should_unblock_read_block, false);
 }
 
 int should_unblock_write_block(thread_t* thread)
@@ -70,56 +269,54 @@ int init_write_blocker(thread_t* thread, file_descriptor_t* bfd)
         return 0;
     }
 
-    thread->status = THREAD_BLOCKED;
-    thread->blocker.reason = BLOCKER_WRITE;
-    thread->blocker.should_unblock = should_unblock_write_block;
-    thread->blocker.should_unblock_for_signal = true;
-    sched_dequeue(thread);
-    resched();
-    return 0;
+    return _blocker_block(thread, &_blocker_io_queue, BLOCKER_WRITE, should_unblock_write_block, false);
 }
 
 int should_unblock_sleep_block(thread_t* thread)
 {
-    return thread->unblock_time <= timeman_now();
+    return thread->unblock_time <= timeman_global_ticks();
 }
 
 int init_sleep_blocker(thread_t* thread, uint32_t time)
 {
-    thread->unblock_time = timeman_now() + time;
+    return init_sleep_ticks_blocker(thread, time * timeman_ticks_per_second());
+}
+
+/**
+ * Like init_sleep_blocker(), for kernel threads which need a finer sleep.
+ */
+int init_sleep_ticks_blocker(thread_t* thread, time_t ticks)
+{
+    thread->unblock_time = timeman_global_ticks() + ticks;
 
     if (should_unblock_sleep_block(thread)) {
         return 0;
     }
 
-    thread->status = THREAD_BLOCKED;
-    thread->blocker.reason = BLOCKER_SLEEP;
-    thread->blocker.should_unblock = should_unblock_sleep_block;
-    thread->blocker.should_unblock_for_signal = true;
-    sched_dequeue(thread);
-    resched();
-    return 0;
+    return _blocker_block(thread, &_blocker_sleep_queue, BLOCKER_SLEEP, should_unblock_sleep_block, true);
 }
 
 int should_unblock_select_block(thread_t* thread)
 {
-    if (thread->unblock_time != 0 && thread->unblock_time <= timeman_now()) {
+    if (thread->unblock_time != 0 && thread->unblock_time <= timeman_global_ticks()) {
         return true;
     }
 
+    /* The scheduler calls this with the blocker lock taken, which thread_die
+       takes under the lock of the process, so fds are read without it. */
     file_descriptor_t* fd;
-    for (int i = 0; i < thread->nfds; i++) {
-        if (FD_ISSET(i, &thread->readfds)) {
-            fd = proc_get_fd(thread->process, i);
+    for (int i = 0; i < thread->cold->nfds; i++) {
+        if (FD_ISSET(i, &thread->cold->readfds)) {
+            fd = proc_get_fd_lockless(thread->process, i);
             if (fd->ops->can_read(fd->dentry, fd->offset)) {
                 return true;
             }
         }
     }
 
-    for (int i = 0; i < thread->nfds; i++) {
-        if (FD_ISSET(i, &thread->writefds)) {
-            fd = proc_get_fd(thread->process, i);
+    for (int i = 0; i < thread->cold->nfds; i++) {
+        if (FD_ISSET(i, &thread->cold->writefds)) {
+            fd = proc_get_fd_lockless(thread->process, i);
             if (fd->ops->can_write(fd->dentry, fd->offset)) {
                 return true;
             }
@@ -130,34 +327,177 @@ int should_unblock_select_block(thread_t* thread)
 
 int init_select_blocker(thread_t* thread, int nfds, fd_set_t* readfds, fd_set_t* writefds, fd_set_t* exceptfds, timeval_t* timeout)
 {
-    FD_ZERO(&(thread->readfds));
-    FD_ZERO(&(thread->writefds));
-    FD_ZERO(&(thread->exceptfds));
+    FD_ZERO(&(thread->cold->readfds));
+    FD_ZERO(&(thread->cold->writefds));
+    FD_ZERO(&(thread->cold->exceptfds));
     thread->unblock_time = 0;
 
     if (readfds) {
-        thread->readfds = *readfds;
+        thread->cold->readfds = *readfds;
     }
     if (writefds) {
-        thread->writefds = *writefds;
+        thread->cold->writefds = *writefds;
     }
     if (exceptfds) {
-        thread->exceptfds = *exceptfds;
+        thread->cold->exceptfds = *exceptfds;
     }
     if (timeout) {
-        thread->unblock_time = timeman_now() + timeout->tv_sec;
+        /* Rounded up to the next tick, it is never 0 since ticks start before user threads. */
+        thread->unblock_time = timeman_global_ticks() + timeout->tv_sec * timeman_ticks_per_second() + timers_ms_to_ticks((timeout->tv_usec + 999) / 1000);
     }
-    thread->nfds = nfds;
+    thread->cold->nfds = nfds;
 
     if (should_unblock_select_block(thread)) {
         return 0;
     }
 
+    return _blocker_block(thread, &_blocker_io_queue, BLOCKER_SELECT, should_unblock_select_block, thread->unblock_time != 0);
+}
+
+int should_unblock_epoll_block(thread_t* thread)
+{
+    if (thread->unblock_time != 0 && thread->unblock_time <= timeman_global_ticks()) {
+        return true;
+    }
+    return epoll_has_ready(thread->epoll);
+}
+
+/**
+ * Blocks until an item of @ep is ready, a negative @timeout_ms waits with
+ * no limit.
+ */
+int init_epoll_blocker(thread_t* thread, struct epoll* ep, int timeout_ms)
+{
+    thread->epoll = ep;
+    thread->unblock_time = 0;
+    if (timeout_ms >= 0) {
+        thread->unblock_time = timeman_global_ticks() + timers_ms_to_ticks(timeout_ms);
+    }
+
+    if (should_unblock_epoll_block(thread)) {
+        return 0;
+    }
+
+    return _blocker_block(thread, &_blocker_io_queue, BLOCKER_EPOLL, should_unblock_epoll_block, thread->unblock_time != 0);
+}
+
+int should_unblock_futex_block(thread_t* thread)
+{
+    return thread->futex_addr == NULL;
+}
+
+static inline wait_queue_t* _blocker_futex_queue(uint32_t* uaddr)
+{
+    return &_blocker_futex_queues[((uint32_t)uaddr >> 2) % BLOCKER_FUTEX_QUEUES];
+}
+
+/**
+ * Blocks the thread while *uaddr equals val. The value is checked with the
+ * blocker lock taken, so a wakeup which comes after the value has changed
+ * can't be missed.
+ */
+int init_futex_blocker(thread_t* thread, uint32_t* uaddr, uint32_t val)
+{
+    lock_acquire(&_blocker_lock);
+    if (*uaddr != val) {
+        lock_release(&_blocker_lock);
+        return -EAGAIN;
+    }
+
+    thread->futex_addr = uaddr;
     thread->status = THREAD_BLOCKED;
-    thread->blocker.reason = BLOCKER_SELECT;
-    thread->blocker.should_unblock = should_unblock_select_block;
+    thread->blocker.reason = BLOCKER_FUTEX;
+    thread->blocker.should_unblock = should_unblock_futex_block;
     thread->blocker.should_unblock_for_signal = true;
+    thread->blocker.interrupted = false;
+    sched_dequeue(thread);
+    if (thread->wait_queue) {
+        _blocker_queue_remove_lockless(thread);
+    }
+    _blocker_queue_add_lockless(_blocker_futex_queue(uaddr), thread);
+    lock_release(&_blocker_lock);
+    resched();
+    return _blocker_end_wait(thread);
+}
+
+/**
+ * Wakes up to count threads of the process which wait on uaddr.
+ * Returns the number of woken threads.
+ */
+int blocker_futex_wake(proc_t* p, uint32_t* uaddr, int count)
+{
+    int woken = 0;
+    lock_acquire(&_blocker_lock);
+    wait_queue_t* queue = _blocker_futex_queue(uaddr);
+    thread_t* thread = queue->head;
+    while (thread && woken < count) {
+        thread_t* next = thread->wait_next;
+        if (thread->process == p && thread->futex_addr == uaddr) {
+            thread->futex_addr = NULL;
+            if (thread->status == THREAD_BLOCKED) {
+                _blocker_unblock_lockless(thread);
+            } else {
+                /* Runs a signal handler, it must not block again after it. */
+                _blocker_queue_remove_lockless(thread);
+                thread->blocker.reason = BLOCKER_INVALID;
+            }
+            woken++;
+        }
+        thread = next;
+    }
+    lock_release(&_blocker_lock);
+    return woken;
+}
+
+/**
+ * Blocks the thread on a kernel wait queue while *addr equals val, used by
+ * kernel mutexes. Signals don't interrupt such a wait, it ends only by
+ * blocker_wake_queue().
+ */
+int init_wait_blocker(thread_t* thread, wait_queue_t* queue, uint32_t* addr, uint32_t val)
+{
+    lock_acquire(&_blocker_lock);
+    if (*(volatile uint32_t*)addr != val) {
+        lock_release(&_blocker_lock);
+        return -EAGAIN;
+    }
+
+    thread->futex_addr = addr;
+    thread->status = THREAD_BLOCKED;
+    thread->blocker.reason = BLOCKER_MUTEX;
+    thread->blocker.should_unblock = should_unblock_futex_block;
+    thread->blocker.should_unblock_for_signal = false;
     sched_dequeue(thread);
+    if (thread->wait_queue) {
+        _blocker_queue_remove_lockless(thread);
+    }
+    _blocker_queue_add_lockless(queue, thread);
+    lock_release(&_blocker_lock);
     resched();
     return 0;
 }
+
+/**
+ * Wakes up to count threads waiting on the queue in the order they came.
+ * Returns the number of woken threads.
+ */
+int blocker_wake_queue(wait_queue_t* queue, int count)
+{
+    int woken = 0;
+    lock_acquire(&_blocker_lock);
+    thread_t* thread = queue->head;
+    while (thread && woken < count) {
+        thread_t* next = thread->wait_next;
+        thread->futex_addr = NULL;
+        if (thread->status == THREAD_BLOCKED) {
+            _blocker_unblock_lockless(thread);
+        } else {
+            _blocker_queue_remove_lockless(thread);
+            thread->blocker.reason = BLOCKER_INVALID;
+        }
+        woken++;
+        thread = next;
+    }
+    lock_release(&_blocker_lock);
+    return woken;
+}
@@ -6,12 +6,14 @@
 
 #include <fs/vfs.h>
 #include <libkern/bits/errno.h>
+#include <libkern/bits/thread.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <mem/kmalloc.h>
 #include <mem/vmm/zoner.h>
 #include <tasking/elf.h>
 #include <tasking/tasking.h>
+#include <time/time_manager.h>
 
 // #define ELF_DEBUG
 
@@ -30,22 +32,14 @@ static int _elf_load_do_copy_to_ram(proc_t* p, file_descriptor_t* fd, elf_progra
     pdirectory_t* prev_pdir = vmm_get_active_pdir();
     vmm_switch_pdir(p->pdir);
 
-    uint32_t zones_count = proc->zones.size;
-
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&proc->zones, i);
-        if (zone->type == ZONE_TYPE_BSS) {
-            memset((void*)zone->start, 0, zone->len);
-        }
-    }
-
     zone_t coping_zone = zoner_new_zone(COPING_BUFFER_LEN);
     uint32_t mem_remaining = ph->p_memsz;
     uint32_t file_remaining = ph->p_filesz;
     uint32_t mem_offset = ph->p_vaddr;
     uint32_t file_offset = ph->p_offset;
+    uint32_t file_end = ph->p_vaddr + ph->p_filesz;
 
-    while (mem_remaining) {
+    while (mem_remaining && mem_offset < file_end) {
         memset(coping_zone.ptr, 0, COPING_BUFFER_LEN);
         if (file_remaining) {
             uint32_t file_read_len = min(file_remaining, COPING_BUFFER_LEN);
@@ -57,7 +51,8 @@ static int _elf_load_do_copy_to_ram(proc_t* p, file_descriptor_t* fd, elf_progra
         void* write_ptr = coping_zone.ptr;
         for (int i = 0; i < PAGES_PER_COPING_BUFFER && mem_remaining; i++) {
             uint32_t mem_write_len = min(mem_remaining, VMM_PAGE_SIZE);
-            if (proc_find_zone(p, mem_offset)) {
+            // Pages past the file data are left untouched, they are zero-filled on demand.
+            if (mem_offset < file_end && proc_find_zone(p, mem_offset)) {
                 vmm_copy_to_user((void*)mem_offset, write_ptr, mem_write_len);
             }
             mem_offset += mem_write_len;
@@ -70,20 +65,90 @@ static int _elf_load_do_copy_to_ram(proc_t* p, file_descriptor_t* fd, elf_progra
     return vmm_switch_pdir(prev_pdir);
 }
 
-static int _elf_load_interpret_program_header_entry(proc_t* p, file_descriptor_t* fd)
+/**
+ * A PT_LOAD segment is not copied at exec. Its file part becomes a private
+ * mapping of the executable, which pages are read once they are touched,
+ * and the BSS pages which follow it become a zero-filled zone.
+ */
+static int _elf_load_map_segment(proc_t* p, file_descriptor_t* fd, elf_program_header_32_t* ph)
 {
-    elf_program_header_32_t ph;
-    int err = vfs_read(fd, &ph, sizeof(ph));
-    if (err != sizeof(ph)) {
-        return err;
+    uint32_t zone_flags = ZONE_READABLE;
+    if (ph->p_flags & PF_W) {
+        zone_flags |= ZONE_WRITABLE;
+    }
+    if (ph->p_flags & PF_X) {
+        zone_flags |= ZONE_EXECUTABLE;
+    }
+
+    uint32_t start = PAGE_START(ph->p_vaddr);
+    uint32_t file_end = ph->p_vaddr + ph->p_filesz;
+    uint32_t mem_end = ph->p_vaddr + ph->p_memsz;
+    uint32_t bss_start = start;
+
+    if (ph->p_filesz) {
+        proc_zone_t* zone = proc_new_zone(p, start, file_end - start);
+        if (!zone) {
+            return -ENOEXEC;
+        }
+        zone->type = ZONE_TYPE_MAPPED_FILE_PRIVATLY | ((ph->p_flags & PF_X) ? ZONE_TYPE_CODE : ZONE_TYPE_DATA);
+        zone->flags |= zone_flags;
+        zone->file = dentry_duplicate(fd->dentry);
+        zone->offset = ph->p_offset - (ph->p_vaddr - start);
+        // The tail of the last page is zeroed only when BSS starts there.
+        zone->file_len = (ph->p_memsz > ph->p_filesz) ? file_end - start : zone->len;
+        bss_start = zone->start + zone->len;
     }
 
+    if (mem_end > bss_start) {
+        proc_zone_t* zone = proc_new_zone(p, bss_start, mem_end - bss_start);
+        if (!zone) {
+            return -ENOEXEC;
+        }
+        zone->type = ZONE_TYPE_BSS;
+        zone->flags |= zone_flags;
+    }
+    return 0;
+}
+
+/**
+ * Segments could be mapped when their file offsets are congruent with
+ * addresses modulo the page size and no two of them share a page.
+ * Otherwise the image is loaded the old way: zones are built from the
+ * sections and the segments are copied.
+ */
+static bool _elf_load_can_map_segments(elf_program_header_32_t* phs, int ph_num)
+{
+    uint32_t prev_end = 0;
+    for (int i = 0; i < ph_num; i++) {
+        elf_program_header_32_t* ph = &phs[i];
+        if (ph->p_type != PT_LOAD || !ph->p_memsz) {
+            continue;
+        }
+        if ((ph->p_offset % VMM_PAGE_SIZE) != (ph->p_vaddr % VMM_PAGE_SIZE)) {
+            return false;
+        }
+        if (PAGE_START(ph->p_vaddr) < prev_end) {
+            return false;
+        }
+        prev_end = PAGE_START(ph->p_vaddr + ph->p_memsz + VMM_PAGE_SIZE - 1);
+    }
+    return true;
+}
+
+static int _elf_load_interpret_program_header_entry(proc_t* p, file_descriptor_t* fd, elf_program_header_32_t* ph, bool map_segments, elf_program_header_32_t* tls_ph)
+{
 #ifdef ELF_DEBUG
-    log("Header type %x %x - %x", ph.p_type, ph.p_vaddr, ph.p_memsz);
+    log("Header type %x %x - %x", ph->p_type, ph->p_vaddr, ph->p_memsz);
 #endif
-    switch (ph.p_type) {
+    switch (ph->p_type) {
     case PT_LOAD:
-        _elf_load_do_copy_to_ram(p, fd, &ph);
+        if (map_segments) {
+            return _elf_load_map_segment(p, fd, ph);
+        }
+        _elf_load_do_copy_to_ram(p, fd, ph);
+        break;
+    case PT_TLS:
+        memcpy(tls_ph, ph, sizeof(*ph));
         break;
     default:
         break;
@@ -144,6 +209,22 @@ static int _elf_load_interpret_section_header_entry(proc_t* p, file_descriptor_t
     return 0;
 }
 
+/**
+ * The time page takes the last user page, so it has to be mapped before
+ * the stack is placed.
+ */
+static int _elf_load_map_time_page(proc_t* p)
+{
+    proc_zone_t* zone = proc_new_zone(p, TIME_PAGE_VADDR, VMM_PAGE_SIZE);
+    if (!zone) {
+        return -ENOMEM;
+    }
+    zone->type = ZONE_TYPE_DEVICE;
+    zone->flags |= ZONE_READABLE;
+    vmm_map_page(zone->start, timeman_page_paddr(), zone->flags);
+    return 0;
+}
+
 static int _elf_load_alloc_stack(proc_t* p)
 {
     proc_zone_t* stack_zone = proc_new_random_zone_backward(p, USER_STACK_SIZE);
@@ -154,21 +235,120 @@ static int _elf_load_alloc_stack(proc_t* p)
     return 0;
 }
 
+static inline uint32_t _elf_align_up(uint32_t val, uint32_t align)
+{
+    return (val + align - 1) & ~(align - 1);
+}
+
+/**
+ * The main thread gets its TLS block right at exec. The block holds the
+ * thread control block and the description of the TLS image, so libc
+ * could build blocks for other threads, see thread_tcb_t.
+ * The block is built even when the program has no PT_TLS.
+ */
+static int _elf_load_alloc_tls(proc_t* p, file_descriptor_t* fd, elf_program_header_32_t* tls_ph)
+{
+    uint32_t align = max(tls_ph->p_align, (uint32_t)sizeof(void*));
+    if (align > VMM_PAGE_SIZE) {
+        return -ENOEXEC;
+    }
+
+#ifdef __i386__
+    /* Variant II: the TLS data ends right at the thread pointer. */
+    uint32_t data_offset = 0;
+    uint32_t tcb_offset = _elf_align_up(tls_ph->p_memsz, align);
+    uint32_t template_offset = tcb_offset + sizeof(thread_tcb_t);
+#elif __arm__
+    /* Variant I: the TLS data follows the thread control block. */
+    uint32_t tcb_offset = 0;
+    uint32_t data_offset = _elf_align_up(sizeof(thread_tcb_t), align);
+    uint32_t template_offset = _elf_align_up(data_offset + tls_ph->p_memsz, sizeof(void*));
+#endif
+    uint32_t block_size = template_offset + sizeof(tls_template_t);
+
+    proc_zone_t* tls_zone = proc_new_random_zone(p, block_size);
+    if (!tls_zone) {
+        return -ENOMEM;
+    }
+    tls_zone->type = ZONE_TYPE_DATA;
+    tls_zone->flags |= ZONE_READABLE | ZONE_WRITABLE;
+
+    uint8_t* block = kmalloc(block_size);
+    if (!block) {
+        return -ENOMEM;
+    }
+    memset(block, 0, block_size);
+
+    // The image is read from the file, its pages might not be loaded yet.
+    if (tls_ph->p_filesz) {
+        fd->ops->read(fd->dentry, block + data_offset, tls_ph->p_offset, tls_ph->p_filesz);
+    }
+
+    thread_tcb_t* tcb = (thread_tcb_t*)(block + tcb_offset);
+    tls_template_t* tls_template = (tls_template_t*)(block + template_offset);
+#ifdef __i386__
+    tcb->self = (thread_tcb_t*)(tls_zone->start + tcb_offset);
+#endif
+    tcb->tls_template = (tls_template_t*)(tls_zone->start + template_offset);
+    tls_template->image = tls_ph->p_vaddr;
+    tls_template->filesz = tls_ph->p_filesz;
+    tls_template->memsz = tls_ph->p_memsz;
+    tls_template->align = align;
+
+    pdirectory_t* prev_pdir = vmm_get_active_pdir();
+    vmm_switch_pdir(p->pdir);
+    vmm_copy_to_user((void*)tls_zone->start, block, block_size);
+    vmm_switch_pdir(prev_pdir);
+    kfree(block);
+
+    p->main_thread->tls = tls_zone->start + tcb_offset;
+    return 0;
+}
+
 static inline int _elf_do_load(proc_t* p, file_descriptor_t* fd, elf_header_32_t* header)
 {
-    fd->offset = header->e_shoff;
-    int sh_num = header->e_shnum;
-    for (int i = 0; i < sh_num; i++) {
-        _elf_load_interpret_section_header_entry(p, fd);
+    int ph_num = header->e_phnum;
+    uint32_t phs_size = ph_num * sizeof(elf_program_header_32_t);
+    elf_program_header_32_t* phs = kmalloc(phs_size);
+    if (!phs) {
+        return -ENOMEM;
     }
 
     fd->offset = header->e_phoff;
-    int ph_num = header->e_phnum;
+    int err = vfs_read(fd, phs, phs_size);
+    if (err != (int)phs_size) {
+        kfree(phs);
+        return err < 0 ? err : -ENOEXEC;
+    }
+
+    bool map_segments = _elf_load_can_map_segments(phs, ph_num);
+    if (!map_segments) {
+        fd->offset = header->e_shoff;
+        int sh_num = header->e_shnum;
+        for (int i = 0; i < sh_num; i++) {
+            _elf_load_interpret_section_header_entry(p, fd);
+        }
+    }
+
+    elf_program_header_32_t tls_ph = { 0 };
     for (int i = 0; i < ph_num; i++) {
-        _elf_load_interpret_program_header_entry(p, fd);
+        err = _elf_load_interpret_program_header_entry(p, fd, &phs[i], map_segments, &tls_ph);
+        if (err) {
+            kfree(phs);
+            return err;
+        }
     }
+    kfree(phs);
 
     proc_zone_t* stack_zone = proc_new_random_zone(p, VMM_PAGE_SIZE); // Forbid 0 allocations to make it work well
+    err = _elf_load_map_time_page(p);
+    if (err) {
+        return err;
+    }
+    err = _elf_load_alloc_tls(p, fd, &tls_ph);
+    if (err) {
+        return err;
+    }
     _elf_load_alloc_stack(p);
     set_instruction_pointer(p->main_thread->tf, header->e_entry);
     return 0;
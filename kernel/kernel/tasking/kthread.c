@@ -47,6 +47,7 @@ int kthread_setup(proc_t* p)
     p->main_thread->tid = p->pid;
     p->main_thread->process = p;
     p->main_thread->last_cpu = LAST_CPU_NOT_SET;
+    p->main_thread->perf = NULL;
 
     p->main_thread->kstack = zoner_new_zone(KSTACK_ZONE_SIZE);
     if (!p->main_thread->kstack.start) {
@@ -58,12 +59,13 @@ int kthread_setup(proc_t* p)
     p->proc_file = NULL;
     p->cwd = NULL;
 
-    p->fds = NULL;
+    memset(&p->fd_table, 0, sizeof(fd_table_t));
 
     /* setting signal handlers to 0 */
     p->main_thread->signals_mask = 0x0; /* All signals are disabled. */
     p->main_thread->pending_signals_mask = 0x0;
-    memset((void*)p->main_thread->signal_handlers, 0, sizeof(p->main_thread->signal_handlers));
+    p->main_thread->signals_restart_mask = 0;
+    memset((void*)p->main_thread->cold->signal_handlers, 0, sizeof(p->main_thread->cold->signal_handlers));
 
     return 0;
 }
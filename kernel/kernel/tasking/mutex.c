@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/atomic.h>
+#include <libkern/bits/thread.h>
+#include <libkern/libkern.h>
+#include <tasking/cpu.h>
+#include <tasking/mutex.h>
+#include <tasking/thread.h>
+
+/**
+ * A locker can sleep only when it runs on the kernel stack of a thread,
+ * the scheduler and boot code have no thread to block.
+ */
+static bool _kmutex_can_sleep()
+{
+    thread_t* thread = RUNNING_THREAD;
+    if (!thread || thread == THIS_CPU->idle_thread) {
+        return false;
+    }
+
+    uint32_t frame = (uint32_t)__builtin_frame_address(0);
+    return thread->kstack.start <= frame && frame < thread->kstack.start + thread->kstack.len;
+}
+
+static bool _kmutex_is_running(thread_t* thread)
+{
+    if (!thread) {
+        return false;
+    }
+
+    for (int i = 0; i < CPU_CNT; i++) {
+        if (cpus[i].running_thread == thread) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool _kmutex_try_take(kmutex_t* mutex)
+{
+    uint32_t expected = KMUTEX_FREE;
+    return __atomic_compare_exchange_n(&mutex->state, &expected, KMUTEX_TAKEN, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/**
+ * KMUTEX
+ */
+
+void kmutex_init(kmutex_t* mutex)
+{
+    memset(mutex, 0, sizeof(kmutex_t));
+}
+
+void kmutex_lock(kmutex_t* mutex)
+{
+    if (_kmutex_try_take(mutex)) {
+        mutex->owner = RUNNING_THREAD;
+        return;
+    }
+
+    /* The owner is likely to release the mutex soon while it runs. */
+    for (int i = 0; i < KMUTEX_SPIN_COUNT && _kmutex_is_running(mutex->owner); i++) {
+        if (atomic_load(&mutex->state) == KMUTEX_FREE && _kmutex_try_take(mutex)) {
+            mutex->owner = RUNNING_THREAD;
+            return;
+        }
+    }
+
+    while (atomic_exchange(&mutex->state, KMUTEX_TAKEN_WITH_WAITERS) != KMUTEX_FREE) {
+        if (_kmutex_can_sleep()) {
+            init_wait_blocker(RUNNING_THREAD, &mutex->waiters, &mutex->state, KMUTEX_TAKEN_WITH_WAITERS);
+        }
+    }
+    mutex->owner = RUNNING_THREAD;
+}
+
+bool kmutex_trylock(kmutex_t* mutex)
+{
+    if (_kmutex_try_take(mutex)) {
+        mutex->owner = RUNNING_THREAD;
+        return true;
+    }
+    return false;
+}
+
+void kmutex_unlock(kmutex_t* mutex)
+{
+    ASSERT(mutex->state != KMUTEX_FREE);
+    mutex->owner = NULL;
+    if (atomic_exchange(&mutex->state, KMUTEX_FREE) == KMUTEX_TAKEN_WITH_WAITERS) {
+        blocker_wake_queue(&mutex->waiters, 1);
+    }
+}
+
+/**
+ * KRWLOCK
+ */
+
+void krwlock_init(krwlock_t* rwlock)
+{
+    memset(rwlock, 0, sizeof(krwlock_t));
+    lock_init(&rwlock->lock);
+}
+
+void krwlock_read_lock(krwlock_t* rwlock)
+{
+    for (int spins = 0;; spins++) {
+        lock_acquire(&rwlock->lock);
+        if (!rwlock->writer && !rwlock->waiting_writers) {
+            rwlock->readers++;
+            lock_release(&rwlock->lock);
+            return;
+        }
+        uint32_t seq = rwlock->seq;
+        lock_release(&rwlock->lock);
+
+        if (spins >= KMUTEX_SPIN_COUNT && _kmutex_can_sleep()) {
+            init_wait_blocker(RUNNING_THREAD, &rwlock->readers_queue, &rwlock->seq, seq);
+        }
+    }
+}
+
+void krwlock_read_unlock(krwlock_t* rwlock)
+{
+    lock_acquire(&rwlock->lock);
+    ASSERT(rwlock->readers > 0);
+    rwlock->readers--;
+    bool wake_writer = !rwlock->readers && rwlock->waiting_writers;
+    if (wake_writer) {
+        rwlock->seq++;
+    }
+    lock_release(&rwlock->lock);
+
+    if (wake_writer) {
+        blocker_wake_queue(&rwlock->writers_queue, 1);
+    }
+}
+
+void krwlock_write_lock(krwlock_t* rwlock)
+{
+    lock_acquire(&rwlock->lock);
+    rwlock->waiting_writers++;
+    for (int spins = 0;; spins++) {
+        if (!rwlock->writer && !rwlock->readers) {
+            rwlock->waiting_writers--;
+            rwlock->writer = 1;
+            lock_release(&rwlock->lock);
+            return;
+        }
+        uint32_t seq = rwlock->seq;
+        lock_release(&rwlock->lock);
+
+        if (spins >= KMUTEX_SPIN_COUNT && _kmutex_can_sleep()) {
+            init_wait_blocker(RUNNING_THREAD, &rwlock->writers_queue, &rwlock->seq, seq);
+        }
+        lock_acquire(&rwlock->lock);
+    }
+}
+
+/**
+ * Waiting writers go first, readers are woken together once there are none.
+ */
+void krwlock_write_unlock(krwlock_t* rwlock)
+{
+    lock_acquire(&rwlock->lock);
+    ASSERT(rwlock->writer);
+    rwlock->writer = 0;
+    rwlock->seq++;
+    bool wake_writer = rwlock->waiting_writers > 0;
+    lock_release(&rwlock->lock);
+
+    if (wake_writer) {
+        blocker_wake_queue(&rwlock->writers_queue, 1);
+    } else {
+        blocker_wake_queue(&rwlock->readers_queue, FUTEX_WAKE_ALL);
+    }
+}
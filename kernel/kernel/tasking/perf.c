@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/bits/errno.h>
+#include <libkern/bits/profiler.h>
+#include <libkern/libkern.h>
+#include <mem/kmalloc.h>
+#include <platform/generic/pmu.h>
+#include <tasking/perf.h>
+#include <tasking/thread.h>
+
+/**
+ * Counters are opened, read and closed only by the thread itself, which
+ * runs on the cpu whose hardware counters hold its current run. Callers
+ * are syscalls and the timer interrupt, both run with interrupts off.
+ */
+
+static inline bool _perf_is_used(perf_state_t* perf, int counter)
+{
+    return counter >= 0 && counter < PERF_MAX_COUNTERS && ((perf->used_mask >> counter) & 1);
+}
+
+static inline uint64_t _perf_current(perf_state_t* perf, int counter)
+{
+    return perf->counts[counter] + pmu_read(counter);
+}
+
+int perf_open(thread_t* thread, int event, uint32_t sample_period)
+{
+    if (!pmu_supports(event)) {
+        return -ENODEV;
+    }
+
+    if (!thread->perf) {
+        thread->perf = kmalloc(sizeof(perf_state_t));
+        if (!thread->perf) {
+            return -ENOMEM;
+        }
+        memset(thread->perf, 0, sizeof(perf_state_t));
+    }
+
+    perf_state_t* perf = thread->perf;
+    int counters = pmu_counters_count();
+    for (int i = 0; i < counters; i++) {
+        if (_perf_is_used(perf, i)) {
+            continue;
+        }
+
+        perf->used_mask |= (1 << i);
+        perf->events[i] = event;
+        perf->periods[i] = sample_period;
+        perf->counts[i] = 0;
+        perf->next_sample[i] = sample_period;
+        pmu_start(i, event);
+        return i;
+    }
+    return -EBUSY;
+}
+
+int perf_read(thread_t* thread, int counter, uint64_t* value)
+{
+    perf_state_t* perf = thread->perf;
+    if (!perf || !_perf_is_used(perf, counter)) {
+        return -EBADF;
+    }
+
+    *value = _perf_current(perf, counter);
+    return 0;
+}
+
+int perf_close(thread_t* thread, int counter)
+{
+    perf_state_t* perf = thread->perf;
+    if (!perf || !_perf_is_used(perf, counter)) {
+        return -EBADF;
+    }
+
+    pmu_stop(counter);
+    perf->used_mask &= ~(1 << counter);
+    return 0;
+}
+
+void perf_free(thread_t* thread)
+{
+    if (thread->perf) {
+        kfree(thread->perf);
+        thread->perf = NULL;
+    }
+}
+
+/**
+ * CONTEXT SWITCH
+ */
+
+void perf_switch_in(thread_t* thread)
+{
+    perf_state_t* perf = thread->perf;
+    if (likely(!perf)) {
+        return;
+    }
+
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++) {
+        if (_perf_is_used(perf, i)) {
+            pmu_start(i, perf->events[i]);
+        }
+    }
+}
+
+void perf_switch_out(thread_t* thread)
+{
+    perf_state_t* perf = thread->perf;
+    if (likely(!perf)) {
+        return;
+    }
+
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++) {
+        if (_perf_is_used(perf, i)) {
+            perf->counts[i] += pmu_read(i);
+            pmu_stop(i);
+        }
+    }
+}
+
+/**
+ * SAMPLING
+ *
+ * There is no overflow interrupt wired up, the timer tick checks instead
+ * whether a counter has passed its period, so a sample lands on the first
+ * tick after that. A thread without sampling counters is sampled on every
+ * tick and event is set to PROFILER_SAMPLE_TICK.
+ */
+
+bool perf_should_sample(thread_t* thread, int* event)
+{
+    *event = PROFILER_SAMPLE_TICK;
+    perf_state_t* perf = thread ? thread->perf : NULL;
+    if (likely(!perf)) {
+        return true;
+    }
+
+    bool has_periods = false;
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++) {
+        if (!_perf_is_used(perf, i) || !perf->periods[i]) {
+            continue;
+        }
+
+        has_periods = true;
+        uint64_t now = _perf_current(perf, i);
+        if (now >= perf->next_sample[i]) {
+            perf->next_sample[i] = now + perf->periods[i];
+            *event = perf->events[i];
+            return true;
+        }
+    }
+    return !has_periods;
+}
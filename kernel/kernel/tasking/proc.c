@@ -5,12 +5,14 @@
  */
 
 #include <fs/vfs.h>
+#include <io/shared_buffer/shared_buffer.h>
 #include <io/tty/tty.h>
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <libkern/syscall_structs.h>
 #include <mem/kmalloc.h>
+#include <mem/kmemcache.h>
 #include <tasking/elf.h>
 #include <tasking/proc.h>
 #include <tasking/sched.h>
@@ -30,12 +32,25 @@ static ALWAYS_INLINE void proc_kill_all_threads_lockless(proc_t* p);
 static ALWAYS_INLINE int proc_setup_lockless(proc_t* p);
 static ALWAYS_INLINE int proc_setup_tty_lockless(proc_t* p, tty_entry_t* tty);
 
+static void _proc_put_zone_refs(dynamic_array_t* zones)
+{
+    for (int i = 0; i < zones->size; i++) {
+        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(zones, i);
+        if (zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY) {
+            vmm_sync_shared_file_pages(zone, zone->start, zone->len, true);
+        }
+        if (zone->file) {
+            dentry_put(zone->file);
+        }
+        if (zone->type & ZONE_TYPE_SHARED_BUFFER) {
+            shared_buffer_put(zone->shared_buffer);
+        }
+    }
+}
+
 static ALWAYS_INLINE int proc_load_lockless(proc_t* p, thread_t* main_thread, const char* path);
 static ALWAYS_INLINE int proc_chdir_lockless(proc_t* p, const char* path);
 
-static ALWAYS_INLINE file_descriptor_t* proc_get_free_fd_lockless(proc_t* p);
-static ALWAYS_INLINE file_descriptor_t* proc_get_fd_lockless(proc_t* p, uint32_t index);
-
 /**
  * THREAD STORAGE
  */
@@ -43,36 +58,54 @@ static ALWAYS_INLINE file_descriptor_t* proc_get_fd_lockless(proc_t* p, uint32_t
 static thread_list_node_t* proc_alloc_thread_storage_node()
 {
     thread_list_node_t* res = (thread_list_node_t*)kmalloc(sizeof(thread_list_node_t));
+    if (!res) {
+        return NULL;
+    }
+
     memset(res->thread_storage, 0, sizeof(res->thread_storage));
-    res->empty_spots = THREADS_PER_NODE;
+    memset(res->cold_storage, 0, sizeof(res->cold_storage));
+    for (int i = 0; i < THREADS_PER_NODE; i++) {
+        res->thread_storage[i].cold = &res->cold_storage[i];
+    }
     res->next = NULL;
     return res;
 }
 
-// TODO: Implement clear and think of race cond.
 static thread_t* _proc_alloc_thread()
 {
-    ASSERT(thread_list.next_empty_node != NULL);
     lock_acquire(&thread_list.lock);
-    if (!thread_list.next_empty_node->empty_spots) {
-        thread_list_node_t* node = proc_alloc_thread_storage_node();
-        thread_list.tail->next = node;
-        thread_list.tail = node;
-        thread_list.next_empty_node = node;
-        thread_list.next_empty_index = 0;
-    }
-
-    for (int i = 0; i < THREADS_PER_NODE; i++) {
-        if (thread_is_free(&thread_list.next_empty_node->thread_storage[i])) {
-            thread_list.next_empty_node->empty_spots--;
-            thread_list.next_empty_index++;
-            thread_list.next_empty_node->thread_storage[i].status = THREAD_ALLOCATED;
-            lock_release(&thread_list.lock);
-            return &thread_list.next_empty_node->thread_storage[i];
+    thread_t* thread = thread_list.free_head;
+    if (thread) {
+        thread_list.free_head = thread->free_next;
+    } else {
+        if (thread_list.next_empty_index == THREADS_PER_NODE) {
+            thread_list_node_t* node = proc_alloc_thread_storage_node();
+            if (!node) {
+                lock_release(&thread_list.lock);
+                return NULL;
+            }
+            thread_list.tail->next = node;
+            thread_list.tail = node;
+            thread_list.next_empty_index = 0;
         }
+        thread = &thread_list.tail->thread_storage[thread_list.next_empty_index++];
     }
 
-    ASSERT(false);
+    thread->free_next = NULL;
+    thread->status = THREAD_ALLOCATED;
+    lock_release(&thread_list.lock);
+    return thread;
+}
+
+/**
+ * Called by thread_free(), the slot is taken again by the next allocation.
+ */
+void proc_put_thread(thread_t* thread)
+{
+    lock_acquire(&thread_list.lock);
+    thread->free_next = thread_list.free_head;
+    thread_list.free_head = thread;
+    lock_release(&thread_list.lock);
 }
 
 /**
@@ -116,8 +149,9 @@ int proc_init_storage()
     thread_list_node_t* node = proc_alloc_thread_storage_node();
     thread_list.head = node;
     thread_list.tail = node;
-    thread_list.next_empty_node = node;
     thread_list.next_empty_index = 0;
+    thread_list.free_head = NULL;
+    proc_fd_init_storage();
     return 0;
 }
 
@@ -137,8 +171,12 @@ static ALWAYS_INLINE int proc_setup_lockless(proc_t* p)
     p->suid = 0;
     p->sgid = 0;
     p->is_kthread = false;
+    p->dying_threads = 0;
 
     p->main_thread = proc_alloc_thread();
+    if (!p->main_thread) {
+        return -ENOMEM;
+    }
     int res = thread_setup_main(p, p->main_thread);
     if (res != 0) {
         return res;
@@ -149,11 +187,9 @@ static ALWAYS_INLINE int proc_setup_lockless(proc_t* p)
     p->cwd = NULL;
 
     /* allocating space for open files */
-    p->fds = kmalloc(MAX_OPENED_FILES * sizeof(file_descriptor_t));
-    if (!p->fds) {
+    if (proc_fd_table_init(p) != 0) {
         return -ENOMEM;
     }
-    memset((void*)p->fds, 0, MAX_OPENED_FILES * sizeof(file_descriptor_t));
 
     /* setting up zones */
     if (dynamic_array_init_of_size(&p->zones, sizeof(proc_zone_t), 8) != 0) {
@@ -189,9 +225,13 @@ int proc_setup_with_uid(proc_t* p, uid_t uid, gid_t gid)
 
 static ALWAYS_INLINE int proc_setup_tty_lockless(proc_t* p, tty_entry_t* tty)
 {
-    file_descriptor_t* fd0 = &p->fds[0];
-    file_descriptor_t* fd1 = &p->fds[1];
-    file_descriptor_t* fd2 = &p->fds[2];
+    int index;
+    file_descriptor_t* fd0 = proc_alloc_fd_lockless(p, &index);
+    file_descriptor_t* fd1 = proc_alloc_fd_lockless(p, &index);
+    file_descriptor_t* fd2 = proc_alloc_fd_lockless(p, &index);
+    if (!fd0 || !fd1 || !fd2) {
+        return -ENOMEM;
+    }
     p->tty = tty;
 
     char* path_to_tty = "/dev/tty ";
@@ -224,11 +264,12 @@ int proc_setup_tty(proc_t* p, tty_entry_t* tty)
     return res;
 }
 
-int proc_copy_of(proc_t* new_proc, thread_t* from_thread)
+/**
+ * The function copies identity, cwd, tty and opened files of @from_proc.
+ * The address space is not touched, so it's used by fork and spawn.
+ */
+int proc_inherit(proc_t* new_proc, proc_t* from_proc)
 {
-    proc_t* from_proc = from_thread->process;
-    thread_copy_of(new_proc->main_thread, from_thread);
-
     new_proc->ppid = from_proc->pid;
     new_proc->uid = from_proc->uid;
     new_proc->gid = from_proc->gid;
@@ -239,22 +280,23 @@ int proc_copy_of(proc_t* new_proc, thread_t* from_thread)
     new_proc->cwd = dentry_duplicate(from_proc->cwd);
     new_proc->tty = from_proc->tty;
 
-    if (from_proc->fds) {
-        for (int i = 0; i < MAX_OPENED_FILES; i++) {
-            if (from_proc->fds[i].dentry) {
-                file_descriptor_t* fd = &new_proc->fds[i];
-                if (from_proc->fds[i].type == FD_TYPE_FILE) {
-                    vfs_open(from_proc->fds[i].dentry, fd, from_proc->fds[i].flags);
-                }
-            }
-        }
-    }
+    return proc_fd_table_copy(new_proc, from_proc);
+}
+
+int proc_copy_of(proc_t* new_proc, thread_t* from_thread)
+{
+    proc_t* from_proc = from_thread->process;
+    thread_copy_of(new_proc->main_thread, from_thread);
+    proc_inherit(new_proc, from_proc);
 
     for (int i = 0; i < from_proc->zones.size; i++) {
         proc_zone_t* zone_to_copy = (proc_zone_t*)dynamic_array_get(&from_proc->zones, i);
         if (zone_to_copy->file) {
             dentry_duplicate(zone_to_copy->file); // For the copied zone.
         }
+        if (zone_to_copy->type & ZONE_TYPE_SHARED_BUFFER) {
+            shared_buffer_duplicate(zone_to_copy->shared_buffer);
+        }
         dynamic_array_push(&new_proc->zones, zone_to_copy);
     }
 
@@ -337,17 +379,20 @@ success:
 
     // Clearing proc
     proc_kill_all_threads_except_lockless(p, p->main_thread);
+    p->dying_threads = 0;
     p->pid = p->main_thread->tid;
     if (p->proc_file) {
         dentry_put(p->proc_file);
     }
 #ifdef FPU_ENABLED
     fpu_init_state(p->main_thread->fpu_state);
+    thread_fpu_forget(p->main_thread);
 #endif
 
     if (old_pdir) {
         vmm_free_pdir(old_pdir, &old_zones);
     }
+    _proc_put_zone_refs(&old_zones);
     dynamic_array_clear(&old_zones);
 
     // Setting up proc
@@ -362,6 +407,7 @@ restore:
     p->pdir = old_pdir;
     vmm_switch_pdir(old_pdir);
     vmm_free_pdir(new_pdir, &p->zones);
+    _proc_put_zone_refs(&p->zones);
     dynamic_array_clear(&p->zones);
     p->zones = old_zones;
     vfs_close(&fd);
@@ -388,15 +434,7 @@ int proc_free_lockless(proc_t* p)
     }
 
     /* closing opend fds */
-    if (p->fds) {
-        for (int i = 0; i < MAX_OPENED_FILES; i++) {
-            if (p->fds[i].dentry) {
-                /* think as an active fd */
-                vfs_close(&p->fds[i]);
-            }
-        }
-        kfree(p->fds);
-    }
+    proc_fd_table_free(p);
 
     if (p->proc_file) {
         dentry_put(p->proc_file);
@@ -414,6 +452,7 @@ int proc_free_lockless(proc_t* p)
         p->pdir = NULL;
     }
 
+    _proc_put_zone_refs(&p->zones);
     dynamic_array_free(&p->zones);
     return 0;
 }
@@ -435,6 +474,7 @@ int proc_die(proc_t* p)
     }
     p->status = PROC_DYING;
     lock_release(&p->lock);
+    tasking_wake_reaper();
     return 0;
 }
 
@@ -461,6 +501,10 @@ thread_t* proc_create_thread(proc_t* p)
 {
     lock_acquire(&p->lock);
     thread_t* thread = proc_alloc_thread();
+    if (!thread) {
+        lock_release(&p->lock);
+        return NULL;
+    }
     thread_setup(p, thread);
     sched_enqueue(thread);
     lock_release(&p->lock);
@@ -477,6 +521,35 @@ static ALWAYS_INLINE void proc_kill_all_threads_except_lockless(proc_t* p, threa
     }
 }
 
+/**
+ * Frees threads which exited on their own while the process keeps running.
+ * A thread is left alone while a cpu still runs on its kernel stack.
+ */
+void proc_free_dying_threads(proc_t* p)
+{
+    if (!atomic_load(&p->dying_threads)) {
+        return;
+    }
+
+    lock_acquire(&p->lock);
+    foreach_thread(p)
+    {
+        if (thread->status != THREAD_DYING || thread == p->main_thread) {
+            continue;
+        }
+
+        bool running = false;
+        for (int cpu = 0; cpu < CPU_CNT; cpu++) {
+            running |= (cpus[cpu].running_thread == thread);
+        }
+        if (!running) {
+            thread_free(thread);
+            p->dying_threads--;
+        }
+    }
+    lock_release(&p->lock);
+}
+
 static ALWAYS_INLINE void proc_kill_all_threads_lockless(proc_t* p)
 {
     proc_kill_all_threads_except_lockless(p, NULL);
@@ -532,64 +605,3 @@ int proc_chdir(proc_t* p, const char* path)
     lock_release(&p->lock);
     return res;
 }
-
-int proc_get_fd_id(proc_t* p, file_descriptor_t* fd)
-{
-    lock_acquire(&p->lock);
-    ASSERT(p->fds);
-    /* Calculating id with pointers */
-    uint32_t start = (uint32_t)p->fds;
-    uint32_t fd_ptr = (uint32_t)fd;
-    fd_ptr -= start;
-    int fd_res = fd_ptr / sizeof(file_descriptor_t);
-    if (!(fd_ptr % sizeof(file_descriptor_t))) {
-        lock_release(&p->lock);
-        return fd_res;
-    }
-    lock_release(&p->lock);
-    return -1;
-}
-
-static ALWAYS_INLINE file_descriptor_t* proc_get_free_fd_lockless(proc_t* p)
-{
-    ASSERT(p->fds);
-
-    for (int i = 0; i < MAX_OPENED_FILES; i++) {
-        if (!p->fds[i].dentry) {
-            return &p->fds[i];
-        }
-    }
-
-    return NULL;
-}
-
-file_descriptor_t* proc_get_free_fd(proc_t* p)
-{
-    lock_acquire(&p->lock);
-    file_descriptor_t* res = proc_get_free_fd_lockless(p);
-    lock_release(&p->lock);
-    return res;
-}
-
-static ALWAYS_INLINE file_descriptor_t* proc_get_fd_lockless(proc_t* p, uint32_t index)
-{
-    ASSERT(p->fds);
-
-    if (index >= MAX_OPENED_FILES) {
-        return NULL;
-    }
-
-    if (!p->fds[index].dentry) {
-        return NULL;
-    }
-
-    return &p->fds[index];
-}
-
-file_descriptor_t* proc_get_fd(proc_t* p, uint32_t index)
-{
-    lock_acquire(&p->lock);
-    file_descriptor_t* res = proc_get_fd_lockless(p, index);
-    lock_release(&p->lock);
-    return res;
-}
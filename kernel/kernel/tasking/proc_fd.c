@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <fs/vfs.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/platform.h>
+#include <mem/kmalloc.h>
+#include <mem/kmemcache.h>
+#include <tasking/proc.h>
+
+#define PROC_FDS_WORD(index) ((index) / 32)
+#define PROC_FDS_BIT(index) (1u << ((index) % 32))
+
+static kmemcache_t* _proc_fd_cache;
+
+/**
+ * HELPERS
+ */
+
+static inline bool _proc_fd_test(uint32_t* bitmap, uint32_t index)
+{
+    return (bitmap[PROC_FDS_WORD(index)] & PROC_FDS_BIT(index)) != 0;
+}
+
+static inline void _proc_fd_set(uint32_t* bitmap, uint32_t index)
+{
+    bitmap[PROC_FDS_WORD(index)] |= PROC_FDS_BIT(index);
+}
+
+static inline void _proc_fd_clear(uint32_t* bitmap, uint32_t index)
+{
+    bitmap[PROC_FDS_WORD(index)] &= ~PROC_FDS_BIT(index);
+}
+
+static int _proc_fd_table_alloc(fd_table_t* table, uint32_t size)
+{
+    table->fds = kmalloc(size * sizeof(file_descriptor_t*));
+    if (!table->fds) {
+        return -ENOMEM;
+    }
+    table->used = kmalloc(size / 8);
+    if (!table->used) {
+        kfree(table->fds);
+        return -ENOMEM;
+    }
+    table->cloexec = kmalloc(size / 8);
+    if (!table->cloexec) {
+        kfree(table->fds);
+        kfree(table->used);
+        return -ENOMEM;
+    }
+
+    memset(table->fds, 0, size * sizeof(file_descriptor_t*));
+    memset(table->used, 0, size / 8);
+    memset(table->cloexec, 0, size / 8);
+    table->size = size;
+    table->first_free = 0;
+    return 0;
+}
+
+/**
+ * Doubles the table until @index fits into it.
+ */
+static int _proc_fd_table_grow_lockless(fd_table_t* table, uint32_t index)
+{
+    if (index >= PROC_FDS_MAX) {
+        return -EMFILE;
+    }
+
+    uint32_t new_size = table->size;
+    while (new_size <= index) {
+        new_size *= 2;
+    }
+    new_size = min(new_size, (uint32_t)PROC_FDS_MAX);
+
+    file_descriptor_t** fds = krealloc(table->fds, new_size * sizeof(file_descriptor_t*));
+    if (!fds) {
+        return -ENOMEM;
+    }
+    table->fds = fds;
+    uint32_t* used = krealloc(table->used, new_size / 8);
+    if (!used) {
+        return -ENOMEM;
+    }
+    table->used = used;
+    uint32_t* cloexec = krealloc(table->cloexec, new_size / 8);
+    if (!cloexec) {
+        return -ENOMEM;
+    }
+    table->cloexec = cloexec;
+
+    memset(&table->fds[table->size], 0, (new_size - table->size) * sizeof(file_descriptor_t*));
+    memset(&table->used[PROC_FDS_WORD(table->size)], 0, (new_size - table->size) / 8);
+    memset(&table->cloexec[PROC_FDS_WORD(table->size)], 0, (new_size - table->size) / 8);
+    table->size = new_size;
+    return 0;
+}
+
+static int _proc_fd_find_free_lockless(fd_table_t* table)
+{
+    for (uint32_t word = PROC_FDS_WORD(table->first_free); word < PROC_FDS_WORD(table->size); word++) {
+        if (table->used[word] != 0xffffffff) {
+            return word * 32 + ctz32(~table->used[word]);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Takes the slot, its descriptor is zeroed and not opened yet.
+ */
+static file_descriptor_t* _proc_fd_take_lockless(fd_table_t* table, uint32_t index)
+{
+    if (!table->fds[index]) {
+        table->fds[index] = _proc_fd_cache ? kmemcache_alloc(_proc_fd_cache) : kmalloc(sizeof(file_descriptor_t));
+        if (!table->fds[index]) {
+            return NULL;
+        }
+    }
+
+    memset(table->fds[index], 0, sizeof(file_descriptor_t));
+    _proc_fd_set(table->used, index);
+    _proc_fd_clear(table->cloexec, index);
+    return table->fds[index];
+}
+
+/**
+ * TABLE FUNCTIONS
+ */
+
+void proc_fd_init_storage()
+{
+    _proc_fd_cache = kmemcache_create("fds", sizeof(file_descriptor_t));
+}
+
+int proc_fd_table_init(proc_t* p)
+{
+    return _proc_fd_table_alloc(&p->fd_table, PROC_FDS_INITIAL);
+}
+
+/**
+ * Opens all files of @from_proc at the same indexes in @new_proc, which
+ * should have an empty table and not be running yet. Sockets are not
+ * inherited.
+ */
+int proc_fd_table_copy(proc_t* new_proc, proc_t* from_proc)
+{
+    fd_table_t* from_table = &from_proc->fd_table;
+    fd_table_t* new_table = &new_proc->fd_table;
+
+    for (uint32_t i = 0; i < from_table->size; i++) {
+        lock_acquire(&from_proc->lock);
+        file_descriptor_t* fd = proc_get_fd_lockless(from_proc, i);
+        bool cloexec = _proc_fd_test(from_table->cloexec, i);
+        lock_release(&from_proc->lock);
+        if (!fd || fd->type != FD_TYPE_FILE) {
+            continue;
+        }
+
+        if (i >= new_table->size && _proc_fd_table_grow_lockless(new_table, i) < 0) {
+            return -EMFILE;
+        }
+        file_descriptor_t* new_fd = _proc_fd_take_lockless(new_table, i);
+        if (!new_fd) {
+            return -ENOMEM;
+        }
+        if (vfs_dup(fd, new_fd) < 0) {
+            _proc_fd_clear(new_table->used, i);
+        } else if (cloexec) {
+            _proc_fd_set(new_table->cloexec, i);
+        }
+    }
+    new_table->first_free = 0;
+    return 0;
+}
+
+void proc_fd_table_free(proc_t* p)
+{
+    fd_table_t* table = &p->fd_table;
+    if (!table->fds) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < table->size; i++) {
+        file_descriptor_t* fd = table->fds[i];
+        if (!fd) {
+            continue;
+        }
+        if (_proc_fd_test(table->used, i) && fd->dentry) {
+            vfs_close(fd);
+        }
+        kfree(fd);
+    }
+
+    kfree(table->fds);
+    kfree(table->used);
+    kfree(table->cloexec);
+    memset(table, 0, sizeof(fd_table_t));
+}
+
+/**
+ * Called when a new image is loaded into the process.
+ */
+void proc_close_cloexec_fds(proc_t* p)
+{
+    fd_table_t* table = &p->fd_table;
+    for (uint32_t i = 0; i < table->size; i++) {
+        lock_acquire(&p->lock);
+        bool close = _proc_fd_test(table->used, i) && _proc_fd_test(table->cloexec, i);
+        lock_release(&p->lock);
+
+        if (close) {
+            proc_close_fd(p, i);
+        }
+    }
+}
+
+/**
+ * FD FUNCTIONS
+ */
+
+/**
+ * Takes the lowest free slot. The caller opens the returned descriptor
+ * and gives the slot back with proc_free_fd() if that fails.
+ */
+file_descriptor_t* proc_alloc_fd_lockless(proc_t* p, int* index)
+{
+    fd_table_t* table = &p->fd_table;
+    if (!table->fds) {
+        return NULL;
+    }
+
+    int res = _proc_fd_find_free_lockless(table);
+    if (res < 0) {
+        res = table->size;
+        if (_proc_fd_table_grow_lockless(table, res) < 0) {
+            return NULL;
+        }
+    }
+
+    file_descriptor_t* fd = _proc_fd_take_lockless(table, res);
+    if (!fd) {
+        return NULL;
+    }
+    table->first_free = res + 1;
+    *index = res;
+    return fd;
+}
+
+file_descriptor_t* proc_alloc_fd(proc_t* p, int* index)
+{
+    lock_acquire(&p->lock);
+    file_descriptor_t* res = proc_alloc_fd_lockless(p, index);
+    lock_release(&p->lock);
+    return res;
+}
+
+void proc_free_fd(proc_t* p, int index)
+{
+    fd_table_t* table = &p->fd_table;
+    lock_acquire(&p->lock);
+    if (index >= 0 && index < table->size) {
+        _proc_fd_clear(table->used, index);
+        _proc_fd_clear(table->cloexec, index);
+        table->first_free = min(table->first_free, (uint32_t)index);
+    }
+    lock_release(&p->lock);
+}
+
+int proc_close_fd(proc_t* p, int index)
+{
+    file_descriptor_t* fd = proc_get_fd(p, index);
+    if (!fd) {
+        return -EBADF;
+    }
+
+    int err = vfs_close(fd);
+    proc_free_fd(p, index);
+    return err;
+}
+
+/**
+ * Makes @newfd refer to the file of @oldfd, @newfd is closed first if it's
+ * open. Like after fork, the two descriptors don't share the offset.
+ */
+int proc_dup_fd(proc_t* p, int oldfd, int newfd)
+{
+    if (newfd < 0 || newfd >= PROC_FDS_MAX) {
+        return -EBADF;
+    }
+
+    file_descriptor_t* fd = proc_get_fd(p, oldfd);
+    if (!fd) {
+        return -EBADF;
+    }
+    if (oldfd == newfd) {
+        return newfd;
+    }
+
+    proc_close_fd(p, newfd);
+
+    fd_table_t* table = &p->fd_table;
+    lock_acquire(&p->lock);
+    if (newfd >= table->size && _proc_fd_table_grow_lockless(table, newfd) < 0) {
+        lock_release(&p->lock);
+        return -EMFILE;
+    }
+    if (_proc_fd_test(table->used, newfd)) {
+        /* Other thread has taken it in the meantime. */
+        lock_release(&p->lock);
+        return -EBUSY;
+    }
+    file_descriptor_t* new_fd = _proc_fd_take_lockless(table, newfd);
+    lock_release(&p->lock);
+    if (!new_fd) {
+        return -ENOMEM;
+    }
+
+    int err = vfs_dup(fd, new_fd);
+    if (err) {
+        proc_free_fd(p, newfd);
+        return err;
+    }
+    return newfd;
+}
+
+void proc_set_cloexec(proc_t* p, int index, bool cloexec)
+{
+    fd_table_t* table = &p->fd_table;
+    lock_acquire(&p->lock);
+    if (index >= 0 && index < table->size && _proc_fd_test(table->used, index)) {
+        if (cloexec) {
+            _proc_fd_set(table->cloexec, index);
+        } else {
+            _proc_fd_clear(table->cloexec, index);
+        }
+    }
+    lock_release(&p->lock);
+}
+
+file_descriptor_t* proc_get_fd_lockless(proc_t* p, uint32_t index)
+{
+    fd_table_t* table = &p->fd_table;
+    if (index >= table->size || !_proc_fd_test(table->used, index)) {
+        return NULL;
+    }
+
+    /* The slot is taken, but the file is not opened yet. */
+    if (!table->fds[index]->dentry) {
+        return NULL;
+    }
+
+    return table->fds[index];
+}
+
+file_descriptor_t* proc_get_fd(proc_t* p, uint32_t index)
+{
+    lock_acquire(&p->lock);
+    file_descriptor_t* res = proc_get_fd_lockless(p, index);
+    lock_release(&p->lock);
+    return res;
+}
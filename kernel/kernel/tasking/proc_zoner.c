@@ -8,10 +8,18 @@
 #include <libkern/bits/errno.h>
 #include <libkern/log.h>
 #include <mem/kmalloc.h>
+#include <tasking/cpu.h>
 #include <tasking/proc.h>
+#include <tasking/thread.h>
 
 /**
  * PROC ZONING
+ *
+ * Zones of a process are kept sorted by start, they never overlap, so ends
+ * are sorted too and a zone is found with a binary search. Every thread
+ * remembers the index of the zone it found last, faults mostly hit the
+ * same zone again. Inserting or deleting a zone moves the ones after it,
+ * so zone pointers are valid only until the next change of the zones.
  */
 
 static inline bool _proc_zones_intersect(uint32_t start1, uint32_t size1, uint32_t start2, uint32_t size2)
@@ -21,38 +29,51 @@ static inline bool _proc_zones_intersect(uint32_t start1, uint32_t size1, uint32
     return (start1 <= start2 && start2 <= end1) || (start1 <= end2 && end2 <= end1) || (start2 <= start1 && start1 <= end2) || (start2 <= end1 && end1 <= end2);
 }
 
-static inline bool _proc_can_fixup_zone(proc_t* proc, uint32_t* start_ptr, int* len_ptr)
+static ALWAYS_INLINE proc_zone_t* _proc_zone_at(dynamic_array_t* zones, uint32_t indx)
 {
-    uint32_t zones_count = proc->zones.size;
+    return (proc_zone_t*)(zones->data + indx * sizeof(proc_zone_t));
+}
 
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&proc->zones, i);
-        if (_proc_zones_intersect(*start_ptr, *len_ptr, zone->start, zone->len)) {
-            if (*start_ptr >= zone->start) {
-                int move = (zone->start + zone->len) - (*start_ptr);
-                *start_ptr += move;
-                *len_ptr -= move;
-            } else {
-                int move = (*start_ptr + *len_ptr) - zone->start;
-                *len_ptr -= move;
-            }
-
-            if (*len_ptr <= 0) {
-                return false;
-            }
+/**
+ * Returns the index of the first zone which ends after @addr, that is the
+ * zone containing @addr or the first one above it.
+ */
+static uint32_t _proc_zone_lower_bound(dynamic_array_t* zones, uint32_t addr)
+{
+    uint32_t lo = 0;
+    uint32_t hi = zones->size;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        proc_zone_t* zone = _proc_zone_at(zones, mid);
+        if (zone->start + zone->len <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
-
-    return true;
+    return lo;
 }
 
-static inline bool _proc_can_add_zone(proc_t* proc, uint32_t start, uint32_t len)
+static inline bool _proc_can_fixup_zone(proc_t* proc, uint32_t* start_ptr, int* len_ptr)
 {
     uint32_t zones_count = proc->zones.size;
 
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&proc->zones, i);
-        if (_proc_zones_intersect(start, len, zone->start, zone->len)) {
+    for (uint32_t i = _proc_zone_lower_bound(&proc->zones, *start_ptr); i < zones_count; i++) {
+        proc_zone_t* zone = _proc_zone_at(&proc->zones, i);
+        if (!_proc_zones_intersect(*start_ptr, *len_ptr, zone->start, zone->len)) {
+            break;
+        }
+
+        if (*start_ptr >= zone->start) {
+            int move = (zone->start + zone->len) - (*start_ptr);
+            *start_ptr += move;
+            *len_ptr -= move;
+        } else {
+            int move = (*start_ptr + *len_ptr) - zone->start;
+            *len_ptr -= move;
+        }
+
+        if (*len_ptr <= 0) {
             return false;
         }
     }
@@ -60,22 +81,24 @@ static inline bool _proc_can_add_zone(proc_t* proc, uint32_t start, uint32_t len
     return true;
 }
 
-static inline void _proc_swap_zones(proc_zone_t* one, proc_zone_t* two)
+static inline bool _proc_can_add_zone(proc_t* proc, uint32_t start, uint32_t len)
 {
-    proc_zone_t tmp = *one;
-    one->file = two->file;
-    one->flags = two->flags;
-    one->len = two->len;
-    one->offset = two->offset;
-    one->start = two->start;
-    one->type = two->type;
+    uint32_t indx = _proc_zone_lower_bound(&proc->zones, start);
+    if (indx == proc->zones.size) {
+        return true;
+    }
 
-    two->file = tmp.file;
-    two->flags = tmp.flags;
-    two->len = tmp.len;
-    two->offset = tmp.offset;
-    two->start = tmp.start;
-    two->type = tmp.type;
+    proc_zone_t* zone = _proc_zone_at(&proc->zones, indx);
+    return !_proc_zones_intersect(start, len, zone->start, zone->len);
+}
+
+static proc_zone_t* _proc_insert_zone(proc_t* proc, proc_zone_t* new_zone)
+{
+    uint32_t indx = _proc_zone_lower_bound(&proc->zones, new_zone->start);
+    if (dynamic_array_insert(&proc->zones, indx, new_zone) != 0) {
+        return 0;
+    }
+    return _proc_zone_at(&proc->zones, indx);
 }
 
 /**
@@ -96,10 +119,7 @@ proc_zone_t* proc_extend_zone(proc_t* proc, uint32_t start, uint32_t len)
     if (_proc_can_fixup_zone(proc, &start, (int*)&len)) {
         new_zone.start = start;
         new_zone.len = len;
-        if (dynamic_array_push(&proc->zones, &new_zone) != 0) {
-            return 0;
-        }
-        return (proc_zone_t*)dynamic_array_get(&proc->zones, proc->zones.size - 1);
+        return _proc_insert_zone(proc, &new_zone);
     }
 
     return 0;
@@ -120,16 +140,16 @@ proc_zone_t* proc_new_zone(proc_t* proc, uint32_t start, uint32_t len)
     new_zone.flags = ZONE_USER;
 
     if (_proc_can_add_zone(proc, start, len)) {
-        if (dynamic_array_push(&proc->zones, &new_zone) != 0) {
-            return 0;
-        }
-        return (proc_zone_t*)dynamic_array_get(&proc->zones, proc->zones.size - 1);
+        return _proc_insert_zone(proc, &new_zone);
     }
 
     return 0;
 }
 
-/* FIXME: Think of more efficient way */
+/**
+ * Takes the lowest free range right after a zone. Zones are sorted, so the
+ * first one which fits is the lowest.
+ */
 proc_zone_t* proc_new_random_zone(proc_t* proc, uint32_t len)
 {
     if (len % VMM_PAGE_SIZE) {
@@ -147,11 +167,10 @@ proc_zone_t* proc_new_random_zone(proc_t* proc, uint32_t len)
     uint32_t min_start = 0xffffffff;
 
     for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&proc->zones, i);
+        proc_zone_t* zone = _proc_zone_at(&proc->zones, i);
         if (_proc_can_add_zone(proc, zone->start + zone->len, len)) {
-            if (min_start > zone->start + zone->len) {
-                min_start = zone->start + zone->len;
-            }
+            min_start = zone->start + zone->len;
+            break;
         }
     }
 
@@ -162,7 +181,52 @@ proc_zone_t* proc_new_random_zone(proc_t* proc, uint32_t len)
     return proc_new_zone(proc, min_start, len);
 }
 
-/* FIXME: Think of more efficient way */
+/**
+ * The zone starts at an address which is a multiple of @alignment,
+ * so it could be mapped with large pages (see VMM_USER_LARGE_PAGE_SIZE).
+ */
+proc_zone_t* proc_new_random_zone_aligned(proc_t* proc, uint32_t len, uint32_t alignment)
+{
+    if (len % VMM_PAGE_SIZE) {
+        len += VMM_PAGE_SIZE - (len % VMM_PAGE_SIZE);
+    }
+
+    uint32_t zones_count = proc->zones.size;
+
+    /* Check if we can put it at the beginning */
+    proc_zone_t* ret = proc_new_zone(proc, 0, len);
+    if (ret) {
+        return ret;
+    }
+
+    uint32_t min_start = 0xffffffff;
+
+    for (uint32_t i = 0; i < zones_count; i++) {
+        proc_zone_t* zone = _proc_zone_at(&proc->zones, i);
+        uint32_t start = zone->start + zone->len;
+        if (start % alignment) {
+            start += alignment - (start % alignment);
+        }
+        if (start < zone->start) {
+            continue;
+        }
+        if (_proc_can_add_zone(proc, start, len)) {
+            min_start = start;
+            break;
+        }
+    }
+
+    if (min_start == 0xffffffff) {
+        return 0;
+    }
+
+    return proc_new_zone(proc, min_start, len);
+}
+
+/**
+ * Takes the highest free range right before a zone, zones are walked from
+ * the top.
+ */
 proc_zone_t* proc_new_random_zone_backward(proc_t* proc, uint32_t len)
 {
     if (len % VMM_PAGE_SIZE) {
@@ -179,12 +243,11 @@ proc_zone_t* proc_new_random_zone_backward(proc_t* proc, uint32_t len)
 
     uint32_t max_end = 0;
 
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&proc->zones, i);
+    for (uint32_t i = zones_count; i > 0; i--) {
+        proc_zone_t* zone = _proc_zone_at(&proc->zones, i - 1);
         if (_proc_can_add_zone(proc, zone->start - len, len)) {
-            if (max_end < zone->start) {
-                max_end = zone->start;
-            }
+            max_end = zone->start;
+            break;
         }
     }
 
@@ -197,40 +260,100 @@ proc_zone_t* proc_new_random_zone_backward(proc_t* proc, uint32_t len)
 
 proc_zone_t* proc_find_zone_no_proc(dynamic_array_t* zones, uint32_t addr)
 {
-    uint32_t zones_count = zones->size;
-
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(zones, i);
-        if (zone->start <= addr && addr < zone->start + zone->len) {
-            return zone;
-        }
+    uint32_t indx = _proc_zone_lower_bound(zones, addr);
+    if (indx == zones->size) {
+        return 0;
     }
 
+    proc_zone_t* zone = _proc_zone_at(zones, indx);
+    if (zone->start <= addr) {
+        return zone;
+    }
     return 0;
 }
 
 proc_zone_t* proc_find_zone(proc_t* proc, uint32_t addr)
 {
-    return proc_find_zone_no_proc(&proc->zones, addr);
+    thread_t* thread = RUNNING_THREAD;
+    if (!thread || thread->process != proc) {
+        return proc_find_zone_no_proc(&proc->zones, addr);
+    }
+
+    // The hint is only an index, so a stale one just misses.
+    uint32_t hint = thread->zone_hint;
+    if (hint < proc->zones.size) {
+        proc_zone_t* zone = _proc_zone_at(&proc->zones, hint);
+        if (zone->start <= addr && addr < zone->start + zone->len) {
+            return zone;
+        }
+    }
+
+    proc_zone_t* zone = proc_find_zone_no_proc(&proc->zones, addr);
+    if (zone) {
+        thread->zone_hint = zone - _proc_zone_at(&proc->zones, 0);
+    }
+    return zone;
 }
 
 int proc_delete_zone_no_proc(dynamic_array_t* zones, proc_zone_t* givzone)
 {
-    uint32_t zones_count = zones->size;
-
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(zones, i);
-        if (givzone == zone) {
-            _proc_swap_zones(zone, dynamic_array_get(zones, zones_count - 1));
-            dynamic_array_pop(zones);
-            return 0;
-        }
+    proc_zone_t* first = _proc_zone_at(zones, 0);
+    if (givzone < first || givzone >= first + zones->size) {
+        return -EALREADY;
     }
 
-    return -EALREADY;
+    dynamic_array_remove(zones, givzone - first);
+    return 0;
 }
 
 int proc_delete_zone(proc_t* proc, proc_zone_t* givzone)
 {
     return proc_delete_zone_no_proc(&proc->zones, givzone);
+}
+
+/**
+ * Removes [@start, @start + @len) from @zone, which contains the range. A
+ * cut in the middle leaves two zones. Pages are not touched, the caller
+ * has released them.
+ */
+int proc_cut_zone(proc_t* proc, proc_zone_t* zone, uint32_t start, uint32_t len)
+{
+    uint32_t end = start + len;
+    uint32_t zone_end = zone->start + zone->len;
+
+    proc_zone_t tail = *zone;
+    tail.start = end;
+    tail.len = zone_end - end;
+    zone->len = start - zone->start;
+    if (!zone->len) {
+        proc_delete_zone(proc, zone);
+    }
+    if (tail.len && !_proc_insert_zone(proc, &tail)) {
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+/**
+ * A mapping without access rights could be used to reserve a range of
+ * addresses, the dynamic loader does so for libraries. Such a zone never
+ * has pages, so a part of it could be cut out simply to let MAP_FIXED take
+ * it. Returns 0 when the range is free after the call.
+ */
+int proc_release_reserved_range(proc_t* proc, uint32_t start, uint32_t len)
+{
+    proc_zone_t* zone = proc_find_zone(proc, start);
+    if (!zone) {
+        return 0;
+    }
+
+    uint32_t any_access = ZONE_READABLE | ZONE_WRITABLE | ZONE_EXECUTABLE;
+    if (!(zone->type & ZONE_TYPE_MAPPED) || zone->file || (zone->flags & any_access)) {
+        return -EEXIST;
+    }
+
+    if (start + len > zone->start + zone->len) {
+        return -EEXIST;
+    }
+    return proc_cut_zone(proc, zone, start, len);
 }
\ No newline at end of file
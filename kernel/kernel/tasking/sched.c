@@ -8,12 +8,15 @@
 #include <libkern/atomic.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
+#include <libkern/platform.h>
+#include <libkern/trace.h>
 #include <mem/kmalloc.h>
 #include <platform/generic/registers.h>
 #include <platform/generic/system.h>
 #include <platform/generic/tasking/context.h>
 #include <platform/generic/tasking/trapframe.h>
 #include <tasking/cpu.h>
+#include <tasking/perf.h>
 #include <tasking/sched.h>
 #include <tasking/tasking.h>
 #include <time/time_manager.h>
@@ -24,6 +27,7 @@
 static time_t _sched_timeslices[];
 static int _enqueued_tasks;
 static uint32_t _active_cpus;
+static uint32_t _idle_cpus;
 
 extern void switch_contexts(context_t** old, context_t* new);
 extern void switch_to_context(context_t* new);
@@ -34,20 +38,66 @@ static void _init_cpu(cpu_t* cpu);
 static inline void _sched_swap_buffers();
 static inline thread_t* _master_buf_back();
 static inline void _sched_save_running_proc();
+static inline void _sched_add_to_start_of_master_runqueue(sched_data_t* sched, thread_t* thread)
+{
+    int prio = thread->process->prio;
+    thread->sched_prev = NULL;
+    thread->sched_next = sched->master_buf[prio].head;
+    if (thread->sched_next) {
+        thread->sched_next->sched_prev = thread;
+    } else {
+        sched->master_buf[prio].tail = thread;
+    }
+    sched->master_buf[prio].head = thread;
+    sched->master_map |= 1 << prio;
+}
+
 static inline void _sched_enqueue_impl(sched_data_t* sched, thread_t* thread);
 /* DEBUG */
 static void _debug_print_runqueue(runqueue_t* it);
 
+/**
+ * The tick is stopped only when every cpu is idle and has nothing to run,
+ * since the timer is shared by all cpus.
+ */
+static bool _sched_can_stop_ticks()
+{
+    if (atomic_load(&_idle_cpus) != active_cpu_count()) {
+        return false;
+    }
+    for (int i = 0; i < active_cpu_count(); i++) {
+        if (cpus[i].sched.enqueued_tasks > 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static void _idle_thread()
 {
     while (1) {
-        system_stop_until_interrupt();
+        atomic_add(&_idle_cpus, 1);
+        timeman_idle(_sched_can_stop_ticks());
+        atomic_add(&_idle_cpus, -1);
     }
 }
 
+static inline bool _sched_is_interactive(thread_t* thread)
+{
+    return thread->interactivity >= SCHED_INTERACTIVE_THRESHOLD;
+}
+
+/**
+ * Interactive threads run in the round they are woken up in, so they get
+ * a half of the timeslice not to starve others.
+ */
 static inline time_t _sched_get_timeslice(thread_t* thread)
 {
-    return _sched_timeslices[thread->process->prio];
+    time_t timeslice = _sched_timeslices[thread->process->prio];
+    if (_sched_is_interactive(thread)) {
+        timeslice = max(timeslice / 2, (time_t)1);
+    }
+    return timeslice;
 }
 
 static void _create_idle_thread(cpu_t* cpu)
@@ -85,12 +135,18 @@ static void _init_cpu(cpu_t* cpu)
     cpu->sched.slave_buf = kmalloc(sizeof(runqueue_t) * TOTAL_PRIOS_COUNT);
     memset(cpu->sched.master_buf, 0, sizeof(runqueue_t) * TOTAL_PRIOS_COUNT);
     memset(cpu->sched.slave_buf, 0, sizeof(runqueue_t) * TOTAL_PRIOS_COUNT);
-    cpu->sched.next_read_prio = 0;
+    cpu->sched.master_map = 0;
+    cpu->sched.slave_map = 0;
     cpu->sched.enqueued_tasks = 0;
+    cpu->sched.stat_picks = 0;
+    cpu->sched.stat_swaps = 0;
+    lock_init(&cpu->sched.lock);
 
 #ifdef FPU_ENABLED
     cpu->fpu_for_thread = NULL;
     cpu->fpu_for_pid = 0;
+    cpu->stat_fpu_traps = 0;
+    cpu->stat_fpu_saves = 0;
 #endif // FPU_ENABLED
     _create_idle_thread(cpu);
     _add_cpu_count();
@@ -101,7 +157,17 @@ static inline void _sched_swap_buffers(sched_data_t* sched)
     runqueue_t* tmp = sched->master_buf;
     sched->master_buf = sched->slave_buf;
     sched->slave_buf = tmp;
-    sched->next_read_prio = 0;
+
+    uint32_t tmp_map = sched->master_map;
+    sched->master_map = sched->slave_map;
+    sched->slave_map = tmp_map;
+    sched->stat_swaps++;
+}
+
+static inline void _sched_update_map(uint32_t* map, runqueue_t* buf, int prio)
+{
+    uint32_t bit = 1 << prio;
+    *map = (*map & ~bit) | ((uint32_t)(buf[prio].head != NULL) << prio);
 }
 
 static inline void _sched_add_to_start_of_runqueue(sched_data_t* sched, thread_t* thread)
@@ -113,6 +179,7 @@ static inline void _sched_add_to_start_of_runqueue(sched_data_t* sched, thread_t
         sched->slave_buf[thread->process->prio].tail = thread;
     }
     sched->slave_buf[thread->process->prio].head = thread;
+    sched->slave_map |= 1 << thread->process->prio;
 }
 
 static inline void _sched_add_to_end_of_runqueue(sched_data_t* sched, thread_t* thread)
@@ -124,6 +191,7 @@ static inline void _sched_add_to_end_of_runqueue(sched_data_t* sched, thread_t*
         sched->slave_buf[thread->process->prio].head = thread;
     }
     sched->slave_buf[thread->process->prio].tail = thread;
+    sched->slave_map |= 1 << thread->process->prio;
 }
 
 static inline void _sched_enqueue_impl(sched_data_t* sched, thread_t* thread)
@@ -159,9 +227,27 @@ void _sched_dequeue_impl(sched_data_t* sched, thread_t* thread)
     }
 
     thread->sched_next = thread->sched_prev = NULL;
+    _sched_update_map(&sched->slave_map, sched->slave_buf, thread->process->prio);
+    _sched_update_map(&sched->master_map, sched->master_buf, thread->process->prio);
     sched->enqueued_tasks--;
 }
 
+/**
+ * Takes the lock of the runqueue the thread belongs to. The thread can be
+ * moved to other cpu while we are waiting for the lock, so it's checked again.
+ */
+static sched_data_t* _sched_lock_cpu_of(thread_t* thread)
+{
+    for (;;) {
+        int cpu = thread->last_cpu;
+        lock_acquire(&cpus[cpu].sched.lock);
+        if (likely(thread->last_cpu == cpu)) {
+            return &cpus[cpu].sched;
+        }
+        lock_release(&cpus[cpu].sched.lock);
+    }
+}
+
 int _sched_find_cpu_with_less_load()
 {
     int mx = cpus[0].sched.enqueued_tasks;
@@ -177,6 +263,7 @@ int _sched_find_cpu_with_less_load()
 
 void scheduler_init()
 {
+    blocker_init();
 }
 
 void schedule_activate_cpu()
@@ -187,43 +274,132 @@ void schedule_activate_cpu()
     cpus[id].id = id;
 }
 
-extern thread_list_t thread_list;
-void sched_unblock_threads()
+/**
+ * LOAD BALANCING
+ */
+
+static inline bool _sched_can_migrate(thread_t* thread)
 {
-    thread_t* thread;
-
-    thread_list_node_t* __thread_list_node = thread_list.head;
-    while (__thread_list_node) {
-        for (int i = 0; i < THREADS_PER_NODE; i++) {
-            thread = &__thread_list_node->thread_storage[i];
-            if (thread->status == THREAD_BLOCKED && thread->blocker.reason != BLOCKER_INVALID) {
-                if (thread->blocker.should_unblock && thread->blocker.should_unblock(thread)) {
-                    thread->status = THREAD_RUNNING;
-                    thread->blocker.reason = BLOCKER_INVALID;
-                    sched_enqueue(thread);
-                }
+    if (thread->process->prio == IDLE_PRIO) {
+        return false;
+    }
+    return timeman_global_ticks() - thread->last_ran_at >= SCHED_CACHE_HOT_TICKS;
+}
+
+static thread_t* _sched_find_thread_to_migrate(runqueue_t* buf)
+{
+    for (int prio = MAX_PRIO; prio <= MIN_PRIO; prio++) {
+        /* Threads at the tail have been waiting for the cpu since longer ago. */
+        for (thread_t* thread = buf[prio].tail; thread; thread = thread->sched_prev) {
+            if (_sched_can_migrate(thread)) {
+                return thread;
             }
         }
-        __thread_list_node = __thread_list_node->next;
     }
+    return NULL;
+}
+
+static int _sched_find_busiest_cpu()
+{
+    int id = -1;
+    int mx = 0;
+    for (int i = 0; i < active_cpu_count(); i++) {
+        if (i != THIS_CPU->id && mx < cpus[i].sched.enqueued_tasks) {
+            mx = cpus[i].sched.enqueued_tasks;
+            id = i;
+        }
+    }
+    return id;
+}
+
+/**
+ * Moves one thread from the busiest cpu to the current one. An idle cpu
+ * steals if the busiest one has any other thread to run, a busy one only
+ * when the gap of loads is at least SCHED_BALANCE_IMBALANCE, so threads
+ * don't bounce between cpus with nearly the same load.
+ * The thread is put to master_buf, so it runs in the current round.
+ * Should be called with the lock of the current cpu taken.
+ */
+static void _sched_pull_thread(sched_data_t* sched, bool idle)
+{
+    int victim_id = _sched_find_busiest_cpu();
+    if (victim_id < 0) {
+        return;
+    }
+
+    sched_data_t* victim = &cpus[victim_id].sched;
+    /* Both locks are taken from the lowest cpu id, our one is already held. */
+    if (victim_id < THIS_CPU->id) {
+        lock_release(&sched->lock);
+        lock_acquire(&victim->lock);
+        lock_acquire(&sched->lock);
+    } else {
+        lock_acquire(&victim->lock);
+    }
+
+    int threshold = idle ? 1 : sched->enqueued_tasks + SCHED_BALANCE_IMBALANCE;
+    if (victim->enqueued_tasks <= threshold) {
+        lock_release(&victim->lock);
+        return;
+    }
+
+    thread_t* thread = _sched_find_thread_to_migrate(victim->master_buf);
+    if (!thread) {
+        thread = _sched_find_thread_to_migrate(victim->slave_buf);
+    }
+    if (!thread) {
+        lock_release(&victim->lock);
+        return;
+    }
+
+    _sched_dequeue_impl(victim, thread);
+    thread->last_cpu = THIS_CPU->id;
+    lock_release(&victim->lock);
+
+    _sched_add_to_start_of_master_runqueue(sched, thread);
+    sched->enqueued_tasks++;
+
+#ifdef SCHED_DEBUG
+    log("migrate task %d from cpu %d to cpu %d", thread->tid, victim_id, THIS_CPU->id);
+#endif
 }
 
+/**
+ * SCHEDULER FUNCTIONS
+ */
+
 void resched_dont_save_context()
 {
     if (RUNNING_THREAD && RUNNING_THREAD->status == THREAD_RUNNING) {
         RUNNING_THREAD->stat_total_running_ticks += timeman_ticks_since_boot() - RUNNING_THREAD->start_time_in_ticks;
-        _sched_add_to_end_of_runqueue(&cpus[RUNNING_THREAD->last_cpu].sched, RUNNING_THREAD);
+        sched_data_t* sched = _sched_lock_cpu_of(RUNNING_THREAD);
+        _sched_add_to_end_of_runqueue(sched, RUNNING_THREAD);
+        lock_release(&sched->lock);
     }
     switch_to_context(THIS_CPU->sched_context);
 }
 
+/**
+ * Drops the current kernel stack of the running thread and goes on from its
+ * saved context, used by sigreturn to get back into the interrupted kernel
+ * path without giving the cpu away.
+ */
+void sched_resume_saved_context()
+{
+    switch_to_context(RUNNING_THREAD->context);
+}
+
 void resched()
 {
     if (RUNNING_THREAD) {
         RUNNING_THREAD->stat_total_running_ticks += timeman_ticks_since_boot() - RUNNING_THREAD->start_time_in_ticks;
+        RUNNING_THREAD->stat_switches++;
         if (RUNNING_THREAD->status == THREAD_RUNNING) {
-            _sched_add_to_end_of_runqueue(&cpus[RUNNING_THREAD->last_cpu].sched, RUNNING_THREAD);
+            sched_data_t* sched = _sched_lock_cpu_of(RUNNING_THREAD);
+            _sched_add_to_end_of_runqueue(sched, RUNNING_THREAD);
+            lock_release(&sched->lock);
         }
+        perf_switch_out(RUNNING_THREAD);
         switch_contexts(&RUNNING_THREAD->context, THIS_CPU->sched_context);
     } else {
         switch_to_context(THIS_CPU->sched_context);
@@ -238,11 +414,15 @@ void sched_enqueue(thread_t* thread)
     }
 
     if (thread->last_cpu != LAST_CPU_NOT_SET) {
-        _sched_enqueue_impl(&cpus[thread->last_cpu].sched, thread);
+        sched_data_t* sched = _sched_lock_cpu_of(thread);
+        _sched_enqueue_impl(sched, thread);
+        lock_release(&sched->lock);
     } else {
         int cpu = _sched_find_cpu_with_less_load();
+        lock_acquire(&cpus[cpu].sched.lock);
         _sched_enqueue_impl(&cpus[cpu].sched, thread);
         thread->last_cpu = cpu;
+        lock_release(&cpus[cpu].sched.lock);
     }
 
 #ifdef SCHED_DEBUG
@@ -251,13 +431,39 @@ void sched_enqueue(thread_t* thread)
     _enqueued_tasks++;
 }
 
+/**
+ * Enqueues a thread which has been blocked. Frequent wakeups make a thread
+ * interactive, such a thread is put to master_buf to run in the current round.
+ */
+void sched_wakeup(thread_t* thread)
+{
+    thread->interactivity = min(thread->interactivity + SCHED_INTERACTIVITY_WAKEUP, (uint32_t)SCHED_INTERACTIVITY_MAX);
+    if (!_sched_is_interactive(thread) || thread->last_cpu == LAST_CPU_NOT_SET) {
+        sched_enqueue(thread);
+        return;
+    }
+
+    thread->status = THREAD_RUNNING;
+    if (thread->process->prio > MIN_PRIO) {
+        thread->process->prio = MIN_PRIO;
+    }
+
+    sched_data_t* sched = _sched_lock_cpu_of(thread);
+    _sched_add_to_start_of_master_runqueue(sched, thread);
+    sched->enqueued_tasks++;
+    lock_release(&sched->lock);
+    _enqueued_tasks++;
+}
+
 void sched_dequeue(thread_t* thread)
 {
 #ifdef SCHED_DEBUG
     log("dequeue task %d", thread->tid);
 #endif
     if (likely(thread->last_cpu != LAST_CPU_NOT_SET)) {
-        _sched_dequeue_impl(&cpus[thread->last_cpu].sched, thread);
+        sched_data_t* sched = _sched_lock_cpu_of(thread);
+        _sched_dequeue_impl(sched, thread);
+        lock_release(&sched->lock);
     } else {
         log("dequeue error task %d", thread->tid);
     }
@@ -267,34 +473,51 @@ void sched()
 {
     for (;;) {
         sched_data_t* sched = &THIS_CPU->sched;
-        while (!sched->master_buf[sched->next_read_prio].head) {
-            sched->next_read_prio++;
-            if (sched->next_read_prio >= TOTAL_PRIOS_COUNT) {
-                if (THIS_CPU->id == 0) {
-                    tasking_kill_dying();
-                    sched_unblock_threads();
-                }
-                _sched_swap_buffers(sched);
+        lock_acquire(&sched->lock);
+        if (sched->enqueued_tasks <= 1) {
+            /* Only the idle thread is left. */
+            _sched_pull_thread(sched, true);
+        }
+
+        while (!sched->master_map) {
+            lock_release(&sched->lock);
+            if (THIS_CPU->id == 0) {
+                tasking_kill_dying();
+                blocker_unblock_threads();
             }
+            lock_acquire(&sched->lock);
+            _sched_swap_buffers(sched);
+            _sched_pull_thread(sched, false);
         }
 
-        thread_t* thread = sched->master_buf[sched->next_read_prio].head;
-        sched->master_buf[sched->next_read_prio].head = thread->sched_next;
-        if (sched->master_buf[sched->next_read_prio].tail == thread) {
-            sched->master_buf[sched->next_read_prio].tail = NULL;
+        int prio = ctz32(sched->master_map);
+        runqueue_t* runqueue = &sched->master_buf[prio];
+        thread_t* thread = runqueue->head;
+        runqueue->head = thread->sched_next;
+        if (runqueue->head) {
+            runqueue->head->sched_prev = NULL;
+        } else {
+            runqueue->tail = NULL;
         }
+        _sched_update_map(&sched->master_map, sched->master_buf, prio);
         thread->sched_next = thread->sched_prev = NULL;
+        sched->stat_picks++;
+        lock_release(&sched->lock);
 #ifdef SCHED_DEBUG
         log("next to run %d %x %x [cpu %d]", thread->tid, thread->process->prio, thread->tf, THIS_CPU->id);
 #endif
 #ifdef SCHED_SHOW_STAT
+        log("picks %d swaps %d map %x", sched->stat_picks, sched->stat_swaps, sched->master_map);
         _debug_print_runqueue(sched->master_buf);
 #endif
         ASSERT(thread->status == THREAD_RUNNING);
+        trace_point(TRACE_SCHED_SWITCH, RUNNING_THREAD ? RUNNING_THREAD->tid : 0, thread->tid, thread->process->prio);
         thread->last_cpu = THIS_CPU->id;
         thread->start_time_in_ticks = timeman_ticks_since_boot();
+        thread->last_ran_at = timeman_global_ticks();
         thread->ticks_until_preemption = _sched_get_timeslice(thread);
         switchuvm(thread);
+        perf_switch_in(thread);
         switch_contexts(&(THIS_CPU->sched_context), thread->context);
     }
 }
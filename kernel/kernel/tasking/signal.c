@@ -56,12 +56,17 @@ void signal_init()
  * HELPER FUNCTIONS
  */
 
-int signal_set_handler(thread_t* thread, int signo, void* handler)
+int signal_set_handler(thread_t* thread, int signo, void* handler, int flags)
 {
     if (signo < 0 || signo >= SIGNALS_CNT) {
         return -EINVAL;
     }
-    thread->signal_handlers[signo] = handler;
+    thread->cold->signal_handlers[signo] = handler;
+    if (flags & SA_RESTART) {
+        thread->signals_restart_mask |= (1 << signo);
+    } else {
+        thread->signals_restart_mask &= ~((uint32_t)(1 << signo));
+    }
     return 0;
 }
 
@@ -118,6 +123,14 @@ static int signal_setup_stack_to_handle_signal(thread_t* thread, int signo)
     uint32_t old_sp = get_stack_pointer(thread->tf);
     uint32_t magic = MAGIC_STATE_JUST_TF; /* helps to restore thread after sgnal to the right state */
 
+    /* The state is pushed below the user stack pointer, 3 more words are taken when a new kernel state is set up. */
+    uint32_t frame_size = (SIGNAL_IMPL_STACK_WORDS + 3) * sizeof(uint32_t);
+    if (old_sp < frame_size || vmm_prepare_active_pdir_for_user_write(old_sp - frame_size, frame_size)) {
+        vmm_switch_pdir(prev_pdir);
+        system_enable_interrupts();
+        return -EFAULT;
+    }
+
     /* TODO: Add support for SMP */
     if (thread != RUNNING_THREAD) {
         /* 
@@ -182,6 +195,11 @@ int signal_restore_thread_after_handling_signal(thread_t* thread)
         log_error("SPs are diff after signal");
     }
 
+    /* The wait ends with -EINTR, the blocker function returns it when its context is resumed below. */
+    if (thread->blocker.interrupted) {
+        blocker_interrupt(thread);
+    }
+
     /* If our thread was blocked, that means that it already has a context on stack, we need not to overwrite it */
     if (thread->blocker.reason != BLOCKER_INVALID) {
         thread->status = THREAD_BLOCKED;
@@ -189,9 +207,9 @@ int signal_restore_thread_after_handling_signal(thread_t* thread)
         resched_dont_save_context();
     }
 
-    /* Since we already have a context on stack, we need not to overwrite it */
+    /* The thread keeps the cpu and goes on from the context it was stopped at, without a pass through the scheduler. */
     if (magic == MAGIC_STATE_NEW_STACK) {
-        resched_dont_save_context();
+        sched_resume_saved_context();
     }
 
     return ret;
@@ -208,8 +226,12 @@ static int signal_default_action(int signo)
 /* FIXME: Don't allow to run a signal while other is in process */
 static int signal_process(thread_t* thread, int signo)
 {
-    if (thread->signal_handlers[signo]) {
-        signal_setup_stack_to_handle_signal(thread, signo);
+    if (thread->cold->signal_handlers[signo]) {
+        /* The handler can't run without a stack, so the process is killed. */
+        if (signal_setup_stack_to_handle_signal(thread, signo)) {
+            proc_die(thread->process);
+            return SKIP;
+        }
         set_instruction_pointer(thread->tf, _signal_jumper_zone.start);
         return UNBLOCK;
     } else {
@@ -244,9 +266,11 @@ int signal_dispatch_pending(thread_t* thread)
         return ret;
     }
 
+    /* The handler runs right away, a wait without SA_RESTART doesn't go on after it. */
     if (ret == UNBLOCK) {
         if (thread && thread->status == THREAD_BLOCKED && thread->blocker.should_unblock_for_signal) {
-            sched_enqueue(thread);
+            thread->blocker.interrupted = !(thread->signals_restart_mask & (1 << signo));
+            sched_wakeup(thread);
         }
     }
 
@@ -9,6 +9,7 @@
 #endif
 #include <io/tty/tty.h>
 #include <libkern/bits/errno.h>
+#include <libkern/boottrace.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <mem/kmalloc.h>
@@ -18,6 +19,7 @@
 #include <tasking/sched.h>
 #include <tasking/tasking.h>
 #include <tasking/thread.h>
+#include <tasking/workqueue.h>
 
 #define TASKING_DEBUG
 
@@ -176,21 +178,72 @@ void tasking_init()
     dump_prepare_kernel_data();
 }
 
-void tasking_kill_dying()
+/**
+ * REAPER
+ *
+ * Dying processes are freed by a work of the lowest priority, so the
+ * teardown of a big address space doesn't delay the thread which runs
+ * next. A process is freed only once no cpu runs any of its threads, its
+ * kernel stacks and pdir could be still in use till then.
+ */
+
+static bool _tasking_proc_is_on_cpu(proc_t* p)
+{
+    for (int cpu = 0; cpu < CPU_CNT; cpu++) {
+        thread_t* thread = cpus[cpu].running_thread;
+        if (thread && thread->process == p) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void _tasking_reap(void* data)
 {
-    proc_t* p;
     for (int i = 0; i < _tasking_get_proc_count(); i++) {
-        p = &proc[i];
-        if (p->status == PROC_DYING) {
-            lock_acquire(&p->lock);
-            if (unlikely(p->status != PROC_DYING)) {
-                lock_release(&p->lock);
-                continue;
-            }
+        proc_t* p = &proc[i];
+        if (p->status != PROC_DYING || _tasking_proc_is_on_cpu(p)) {
+            continue;
+        }
+
+        lock_acquire(&p->lock);
+        if (likely(p->status == PROC_DYING)) {
             proc_free_lockless(p);
             p->status = PROC_DEAD;
-            lock_release(&p->lock);
         }
+        lock_release(&p->lock);
+    }
+}
+
+static work_t _tasking_reaper_work = {
+    .func = _tasking_reap,
+    .prio = WORK_PRIO_LOW,
+};
+
+void tasking_wake_reaper()
+{
+    work_queue(&_tasking_reaper_work);
+}
+
+/**
+ * Called by the scheduler when it has nothing to run. Threads which exited
+ * on their own are cheap to free and are freed here, dying processes are
+ * passed to the reaper.
+ */
+void tasking_kill_dying()
+{
+    bool has_dying = false;
+    for (int i = 0; i < _tasking_get_proc_count(); i++) {
+        proc_t* p = &proc[i];
+        if (p->status == PROC_ALIVE) {
+            proc_free_dying_threads(p);
+        } else if (p->status == PROC_DYING) {
+            has_dying = true;
+        }
+    }
+
+    if (has_dying) {
+        tasking_wake_reaper();
     }
 }
 
@@ -222,17 +275,20 @@ static int _tasking_do_exec(proc_t* p, thread_t* main_thread, const char* path,
     if (err) {
         return err;
     }
+    proc_close_cloexec_fds(p);
+    boottrace_point("exec", path);
     return thread_fill_up_stack(p->main_thread, argc, argv, env);
 }
 
-int tasking_exec(const char* path, const char** argv, const char** env)
+/**
+ * The function brings @path and @argv to the kernel. On success @kargv
+ * holds the path as the first argument, it's freed with _tasking_free_args.
+ */
+static int _tasking_bring_args_to_kernel(const char* path, const char** argv, int* kargc_out, char*** kargv_out)
 {
-    thread_t* thread = RUNNING_THREAD;
-    proc_t* p = RUNNING_THREAD->process;
     char* kpath = NULL;
     int kargc = 1;
     char** kargv = NULL;
-    char** kenv = NULL;
 
     if (!str_validate_len(path, 128)) {
         return -EINVAL;
@@ -270,21 +326,85 @@ int tasking_exec(const char* path, const char** argv, const char** env)
         kargv[i] = kmem_bring_to_kernel(argv[i - 1], strlen(argv[i - 1]) + 1);
     }
 
-    int err = _tasking_do_exec(p, thread, kpath, kargc, kargv, 0);
+    *kargc_out = kargc;
+    *kargv_out = kargv;
+    return 0;
+}
+
+static void _tasking_free_args(int kargc, char** kargv)
+{
+    for (int argi = 0; argi < kargc; argi++) {
+        kfree(kargv[argi]);
+    }
+    kfree(kargv);
+}
+
+int tasking_exec(const char* path, const char** argv, const char** env)
+{
+    thread_t* thread = RUNNING_THREAD;
+    proc_t* p = RUNNING_THREAD->process;
+    int kargc = 0;
+    char** kargv = NULL;
+
+    int err = _tasking_bring_args_to_kernel(path, argv, &kargc, &kargv);
+    if (err) {
+        return err;
+    }
+
+    err = _tasking_do_exec(p, thread, kargv[0], kargc, kargv, 0);
+    if (!err) {
+        /* The new image has its own TLS block. */
+        switchtls(thread);
+    }
 
 #ifdef TASKING_DEBUG
     if (!err) {
-        log("Exec %s : pid %d", kpath, p->pid);
+        log("Exec %s : pid %d", kargv[0], p->pid);
     }
 #endif
 
-    kfree(kpath);
-    for (int argi = 0; argi < kargc; argi++) {
-        kfree(kargv[argi]);
+    _tasking_free_args(kargc, kargv);
+    return err;
+}
+
+/**
+ * Spawn creates a child right from an executable. Unlike fork + exec,
+ * the address space of the caller is never duplicated.
+ */
+int tasking_spawn(const char* path, const char** argv, const char** env)
+{
+    proc_t* p = RUNNING_THREAD->process;
+    int kargc = 0;
+    char** kargv = NULL;
+
+    int err = _tasking_bring_args_to_kernel(path, argv, &kargc, &kargv);
+    if (err) {
+        return err;
     }
-    kfree(kargv);
 
-    return err;
+    proc_t* new_proc = _tasking_setup_proc();
+    proc_inherit(new_proc, p);
+    err = _tasking_do_exec(new_proc, new_proc->main_thread, kargv[0], kargc, kargv, 0);
+
+    // Loading switches to the pdir of the new proc.
+    vmm_switch_pdir(p->pdir);
+
+    if (err) {
+        new_proc->status = PROC_DYING;
+        proc_free(new_proc);
+        new_proc->status = PROC_DEAD;
+        _tasking_free_args(kargc, kargv);
+        return err;
+    }
+
+#ifdef TASKING_DEBUG
+    log("Spawn %s : pid %d", kargv[0], new_proc->pid);
+#endif
+
+    _tasking_free_args(kargc, kargv);
+    new_proc->main_thread->status = THREAD_RUNNING;
+    sched_enqueue(new_proc->main_thread);
+    return new_proc->pid;
 }
 
 int tasking_waitpid(int pid)
@@ -295,8 +415,7 @@ int tasking_waitpid(int pid)
         return -ESRCH;
     }
     thread->joinee = joinee_thread;
-    init_join_blocker(thread);
-    return 0;
+    return init_join_blocker(thread);
 }
 
 void tasking_exit(int exit_code)
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/atomic.h>
+#include <libkern/libkern.h>
+#include <platform/generic/system.h>
+#include <tasking/cpu.h>
+#include <tasking/tasklet.h>
+
+/* Tasklets run by one irq exit, the rest wait for the next one. */
+#define TASKLET_RUN_BUDGET (16)
+
+struct tasklet_queue {
+    tasklet_t* head;
+    tasklet_t* tail;
+};
+typedef struct tasklet_queue tasklet_queue_t;
+
+/* Touched only by their own cpu with interrupts off. */
+static tasklet_queue_t _tasklet_queues[CPU_CNT];
+
+static inline void _tasklet_enqueue(tasklet_queue_t* queue, tasklet_t* tasklet)
+{
+    tasklet->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = tasklet;
+    } else {
+        queue->head = tasklet;
+    }
+    queue->tail = tasklet;
+}
+
+static inline tasklet_t* _tasklet_dequeue(tasklet_queue_t* queue)
+{
+    tasklet_t* tasklet = queue->head;
+    queue->head = tasklet->next;
+    if (!queue->head) {
+        queue->tail = NULL;
+    }
+    tasklet->next = NULL;
+    return tasklet;
+}
+
+void tasklet_init(tasklet_t* tasklet, tasklet_func_t func, void* data)
+{
+    tasklet->func = func;
+    tasklet->data = data;
+    tasklet->state = 0;
+    tasklet->next = NULL;
+}
+
+/**
+ * Safe in irq handlers. The tasklet is queued on the calling cpu, when
+ * called by a thread it runs after the next irq of the cpu.
+ */
+void tasklet_schedule(tasklet_t* tasklet)
+{
+    uint32_t state = __atomic_fetch_or(&tasklet->state, TASKLET_SCHEDULED, __ATOMIC_ACQ_REL);
+    if (state & TASKLET_SCHEDULED) {
+        return;
+    }
+
+    system_disable_interrupts();
+    _tasklet_enqueue(&_tasklet_queues[system_cpu_id()], tasklet);
+    system_enable_interrupts();
+}
+
+/**
+ * Called at the end of irq handlers with interrupts off. Only the outermost
+ * handler runs tasklets, it turns interrupts on around each of them. The
+ * interrupted thread is not switched until they are done: the queue belongs
+ * to this cpu and the thread could be resumed on another one.
+ */
+void tasklets_run()
+{
+    int id = system_cpu_id();
+    cpu_t* cpu = &cpus[id];
+    tasklet_queue_t* queue = &_tasklet_queues[id];
+    if (cpu->in_tasklets || !queue->head || cpu->int_depth_counter != 1) {
+        return;
+    }
+
+    cpu->in_tasklets = true;
+    tasklet_queue_t busy = { 0 };
+    for (int budget = TASKLET_RUN_BUDGET; queue->head && budget > 0; budget--) {
+        tasklet_t* tasklet = _tasklet_dequeue(queue);
+        uint32_t state = __atomic_fetch_or(&tasklet->state, TASKLET_RUNNING, __ATOMIC_ACQUIRE);
+        if (state & TASKLET_RUNNING) {
+            /* Another cpu runs it, it stays scheduled here. */
+            _tasklet_enqueue(&busy, tasklet);
+            continue;
+        }
+
+        /* Cleared before the run, so a schedule from now on runs it again. */
+        __atomic_fetch_and(&tasklet->state, ~(uint32_t)TASKLET_SCHEDULED, __ATOMIC_ACQ_REL);
+        system_enable_interrupts();
+        tasklet->func(tasklet->data);
+        system_disable_interrupts();
+        __atomic_fetch_and(&tasklet->state, ~(uint32_t)TASKLET_RUNNING, __ATOMIC_RELEASE);
+    }
+
+    while (busy.head) {
+        _tasklet_enqueue(queue, _tasklet_dequeue(&busy));
+    }
+    cpu->in_tasklets = false;
+}
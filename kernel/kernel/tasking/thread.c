@@ -9,7 +9,9 @@
 #include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <mem/kmalloc.h>
+#include <platform/generic/system.h>
 #include <tasking/proc.h>
+#include <tasking/perf.h>
 #include <tasking/sched.h>
 #include <tasking/tasking.h>
 #include <tasking/thread.h>
@@ -40,10 +42,71 @@ int _thread_setup_kstack(thread_t* thread, uint32_t esp)
     return 0;
 }
 
+/**
+ * KERNEL STACKS
+ *
+ * Every cpu keeps a few kernel stacks of freed threads. Their pages are
+ * still mapped, so a new thread gets one without the zoner and doesn't
+ * fault its stack in again. Only stacks of THREAD_KSTACK_SIZE are kept,
+ * kthreads have bigger zones.
+ */
+
+#define THREAD_KSTACK_SIZE VMM_PAGE_SIZE
+#define THREAD_KSTACK_CACHE_SIZE (8)
+
+struct thread_kstack_cache {
+    zone_t stacks[THREAD_KSTACK_CACHE_SIZE];
+    int count;
+};
+static struct thread_kstack_cache _thread_kstack_caches[CPU_CNT];
+
+static zone_t _thread_kstack_alloc()
+{
+    system_disable_interrupts();
+    struct thread_kstack_cache* cache = &_thread_kstack_caches[THIS_CPU->id];
+    if (cache->count) {
+        zone_t res = cache->stacks[--cache->count];
+        system_enable_interrupts();
+        return res;
+    }
+    system_enable_interrupts();
+    return zoner_new_zone(THREAD_KSTACK_SIZE);
+}
+
+static void _thread_kstack_put(zone_t kstack)
+{
+    if (kstack.len == THREAD_KSTACK_SIZE) {
+        system_disable_interrupts();
+        struct thread_kstack_cache* cache = &_thread_kstack_caches[THIS_CPU->id];
+        if (cache->count < THREAD_KSTACK_CACHE_SIZE) {
+            cache->stacks[cache->count++] = kstack;
+            system_enable_interrupts();
+            return;
+        }
+        system_enable_interrupts();
+    }
+    zoner_free_zone(kstack);
+}
+
+static void _thread_reset_stat(thread_t* thread)
+{
+    thread->stat_total_running_ticks = 0;
+    thread->stat_user_ticks = 0;
+    thread->stat_system_ticks = 0;
+    thread->stat_switches = 0;
+    thread->stat_involuntary_switches = 0;
+    thread->stat_minor_faults = 0;
+    thread->stat_cow_faults = 0;
+    thread->stat_file_faults = 0;
+    thread->stat_read_bytes = 0;
+    thread->stat_written_bytes = 0;
+    thread->stat_syscalls = 0;
+}
+
 int thread_setup_main(proc_t* p, thread_t* thread)
 {
     /* allocating kernel stack */
-    thread->kstack = zoner_new_zone(VMM_PAGE_SIZE);
+    thread->kstack = _thread_kstack_alloc();
     if (!thread->kstack.start) {
         return -ENOMEM;
     }
@@ -51,17 +114,23 @@ int thread_setup_main(proc_t* p, thread_t* thread)
     thread->process = p;
     thread->tid = p->pid;
     thread->last_cpu = LAST_CPU_NOT_SET;
+    thread->interactivity = 0;
+    thread->tls = 0;
+    thread->perf = NULL;
+    _thread_reset_stat(thread);
 
     /* setting signal handlers to 0 */
     thread->signals_mask = 0xffffffff; /* for now all signals are legal */
     thread->pending_signals_mask = 0;
-    memset((void*)thread->signal_handlers, 0, sizeof(thread->signal_handlers));
+    thread->signals_restart_mask = 0;
+    memset((void*)thread->cold->signal_handlers, 0, sizeof(thread->cold->signal_handlers));
 
     _thread_setup_kstack(thread, thread->kstack.start + VMM_PAGE_SIZE);
     tf_setup_as_user_thread(thread->tf);
 #ifdef FPU_ENABLED
     /* setting fpu */
     thread->fpu_state = kmalloc_aligned(sizeof(fpu_state_t), 16);
+    thread->fpu_cpu = FPU_NOT_LOADED;
     fpu_init_state(thread->fpu_state);
 #endif
     return 0;
@@ -70,7 +139,7 @@ int thread_setup_main(proc_t* p, thread_t* thread)
 int thread_setup(proc_t* p, thread_t* thread)
 {
     /* allocating kernel stack */
-    thread->kstack = zoner_new_zone(VMM_PAGE_SIZE);
+    thread->kstack = _thread_kstack_alloc();
     if (!thread->kstack.start) {
         return -ENOMEM;
     }
@@ -78,17 +147,23 @@ int thread_setup(proc_t* p, thread_t* thread)
     thread->process = p;
     thread->tid = proc_alloc_pid();
     thread->last_cpu = LAST_CPU_NOT_SET;
+    thread->interactivity = 0;
+    thread->tls = 0;
+    thread->perf = NULL;
+    _thread_reset_stat(thread);
 
     /* setting signal handlers to 0 */
     thread->signals_mask = 0xffffffff; /* for now all signals are legal */
     thread->pending_signals_mask = 0;
-    memset((void*)thread->signal_handlers, 0, sizeof(thread->signal_handlers));
+    thread->signals_restart_mask = 0;
+    memset((void*)thread->cold->signal_handlers, 0, sizeof(thread->cold->signal_handlers));
 
     _thread_setup_kstack(thread, thread->kstack.start + VMM_PAGE_SIZE);
     tf_setup_as_user_thread(thread->tf);
 #ifdef FPU_ENABLED
     /* setting fpu */
     thread->fpu_state = kmalloc_aligned(sizeof(fpu_state_t), 16);
+    thread->fpu_cpu = FPU_NOT_LOADED;
     fpu_init_state(thread->fpu_state);
 #endif
     return 0;
@@ -97,7 +172,9 @@ int thread_setup(proc_t* p, thread_t* thread)
 int thread_copy_of(thread_t* thread, thread_t* from_thread)
 {
     memcpy(thread->tf, from_thread->tf, sizeof(trapframe_t));
+    thread->tls = from_thread->tls;
 #ifdef FPU_ENABLED
+    thread_fpu_sync(from_thread);
     memcpy(thread->fpu_state, from_thread->fpu_state, sizeof(fpu_state_t));
 #endif
     return 0;
@@ -107,6 +184,100 @@ int thread_copy_of(thread_t* thread, thread_t* from_thread)
  * STACK FUNCTIONS
  */
 
+#ifdef FPU_ENABLED
+/**
+ * FPU
+ *
+ * The fpu is switched lazily. Its registers stay loaded with the state of
+ * the last thread which used it on the cpu (the owner), and other threads
+ * get it unavailable, so their first use traps. Threads which never touch
+ * the fpu are never saved nor restored.
+ * The owner is saved when it leaves the cpu after a timeslice in which the
+ * fpu was available to it, so fpu_state in memory is always up to date for
+ * a thread which doesn't run and it could be moved to other cpu.
+ */
+
+static ALWAYS_INLINE bool _thread_fpu_is_loaded(cpu_t* cpu, thread_t* thread)
+{
+    return thread && cpu->fpu_for_thread == thread && cpu->fpu_for_pid == thread->tid && thread->fpu_cpu == cpu->id;
+}
+
+/**
+ * Called with interrupts disabled right before @next becomes the running
+ * thread of the cpu.
+ */
+void thread_fpu_switch(thread_t* next)
+{
+    cpu_t* cpu = THIS_CPU;
+    thread_t* owner = cpu->fpu_for_thread;
+    bool loaded = _thread_fpu_is_loaded(cpu, owner);
+
+    /* The fpu is available only to the owner, which is still the running thread. */
+    if (loaded && fpu_is_avail()) {
+        fpu_save(owner->fpu_state);
+        cpu->stat_fpu_saves++;
+    }
+
+    if (loaded && owner == next) {
+        fpu_make_avail();
+    } else {
+        fpu_make_unavail();
+    }
+}
+
+/**
+ * Called with interrupts disabled when the running thread uses the fpu
+ * while it's unavailable. The state of the previous owner has been saved
+ * already, when it left the cpu.
+ */
+void thread_fpu_handle_trap()
+{
+    cpu_t* cpu = THIS_CPU;
+    thread_t* thread = RUNNING_THREAD;
+    fpu_make_avail();
+    cpu->stat_fpu_traps++;
+    if (_thread_fpu_is_loaded(cpu, thread)) {
+        return;
+    }
+
+    fpu_restore(thread->fpu_state);
+    cpu->fpu_for_thread = thread;
+    cpu->fpu_for_pid = thread->tid;
+    thread->fpu_cpu = cpu->id;
+}
+
+/**
+ * Makes fpu_state of the running @thread up to date.
+ */
+void thread_fpu_sync(thread_t* thread)
+{
+    system_disable_interrupts();
+    cpu_t* cpu = THIS_CPU;
+    if (_thread_fpu_is_loaded(cpu, thread) && fpu_is_avail()) {
+        fpu_save(thread->fpu_state);
+        cpu->stat_fpu_saves++;
+    }
+    system_enable_interrupts();
+}
+
+/**
+ * Should be called after fpu_state of @thread is changed in memory, so the
+ * registers are reloaded on the next use.
+ */
+void thread_fpu_forget(thread_t* thread)
+{
+    system_disable_interrupts();
+    cpu_t* cpu = THIS_CPU;
+    if (_thread_fpu_is_loaded(cpu, thread)) {
+        cpu->fpu_for_thread = NULL;
+        cpu->fpu_for_pid = 0;
+        fpu_make_unavail();
+    }
+    thread->fpu_cpu = FPU_NOT_LOADED;
+    system_enable_interrupts();
+}
+#endif // FPU_ENABLED
+
 int thread_fill_up_stack(thread_t* thread, int argc, char** argv, char** env)
 {
     /* TODO: Add env */
@@ -168,7 +339,8 @@ int thread_fill_up_stack(thread_t* thread, int argc, char** argv, char** env)
 
 int thread_kstack_free(thread_t* thread)
 {
-    zoner_free_zone(thread->kstack);
+    _thread_kstack_put(thread->kstack);
+    perf_free(thread);
 #ifdef FPU_ENABLED
     kfree_aligned(thread->fpu_state);
 #endif
@@ -183,6 +355,7 @@ int thread_free(thread_t* thread)
 
     thread_kstack_free(thread);
     thread->status = THREAD_DEAD;
+    proc_put_thread(thread);
     return 0;
 }
 
@@ -194,6 +367,8 @@ int thread_die(thread_t* thread)
 
     thread->status = THREAD_DYING;
     sched_dequeue(thread);
+    blocker_remove(thread);
+    blocker_wake_joiners();
     return 0;
 }
 
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/atomic.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <platform/generic/system.h>
+#include <tasking/cpu.h>
+#include <tasking/sched.h>
+#include <tasking/tasking.h>
+#include <tasking/thread.h>
+#include <tasking/workqueue.h>
+
+struct work_list {
+    work_t* head;
+    work_t* tail;
+};
+typedef struct work_list work_list_t;
+
+/**
+ * The lock of a pool is taken with interrupts off, so works can be queued
+ * from irq handlers and timer callbacks. Pools are ready before their
+ * workers start, works queued early wait for workqueue_init().
+ */
+struct work_pool {
+    lock_t lock;
+    work_list_t lists[WORK_PRIO_COUNT];
+    wait_queue_t waiters;
+    uint32_t seq;
+    proc_t* worker;
+};
+typedef struct work_pool work_pool_t;
+
+static work_pool_t _work_pools[CPU_CNT];
+
+static inline void _work_enqueue(work_list_t* list, work_t* work)
+{
+    work->next = NULL;
+    if (list->tail) {
+        list->tail->next = work;
+    } else {
+        list->head = work;
+    }
+    list->tail = work;
+}
+
+static work_t* _work_dequeue_lockless(work_pool_t* pool)
+{
+    for (int prio = 0; prio < WORK_PRIO_COUNT; prio++) {
+        work_list_t* list = &pool->lists[prio];
+        work_t* work = list->head;
+        if (!work) {
+            continue;
+        }
+
+        list->head = work->next;
+        if (!list->head) {
+            list->tail = NULL;
+        }
+        work->next = NULL;
+        return work;
+    }
+    return NULL;
+}
+
+static void _work_pool_add(work_pool_t* pool, work_t* work)
+{
+    system_disable_interrupts();
+    lock_acquire(&pool->lock);
+    work->pool = pool;
+    _work_enqueue(&pool->lists[work->prio], work);
+    lock_release(&pool->lock);
+    system_enable_interrupts();
+
+    atomic_add(&pool->seq, 1);
+    blocker_wake_queue(&pool->waiters, 1);
+}
+
+/**
+ * Body of a worker thread. The seq of the pool is read before the lists are
+ * drained, so a work queued after the last check wakes the worker up again.
+ */
+static void _work_worker(work_pool_t* pool)
+{
+    for (;;) {
+        uint32_t seq = atomic_load(&pool->seq);
+        for (;;) {
+            system_disable_interrupts();
+            lock_acquire(&pool->lock);
+            work_t* work = _work_dequeue_lockless(pool);
+            if (work) {
+                /* PENDING is set and RUNNING is clear for a queued work. */
+                __atomic_fetch_xor(&work->state, WORK_PENDING | WORK_RUNNING, __ATOMIC_ACQ_REL);
+            }
+            lock_release(&pool->lock);
+            system_enable_interrupts();
+            if (!work) {
+                break;
+            }
+
+            work->func(work->data);
+            __atomic_fetch_and(&work->state, ~(uint32_t)WORK_RUNNING, __ATOMIC_RELEASE);
+        }
+        init_wait_blocker(RUNNING_THREAD, &pool->waiters, &pool->seq, seq);
+    }
+}
+
+void workqueue_init()
+{
+    for (int i = 0; i < active_cpu_count(); i++) {
+        work_pool_t* pool = &_work_pools[i];
+        pool->worker = tasking_create_kernel_thread(_work_worker, pool);
+        pool->worker->main_thread->last_cpu = i;
+        sched_enqueue(pool->worker->main_thread);
+    }
+}
+
+void work_init(work_t* work, work_func_t func, void* data, uint32_t prio)
+{
+    ASSERT(prio < WORK_PRIO_COUNT);
+    work->func = func;
+    work->data = data;
+    work->prio = prio;
+    work->state = 0;
+    work->pool = NULL;
+    work->next = NULL;
+}
+
+/**
+ * Safe in irq handlers. Returns false if the work is already queued and
+ * hasn't started yet, it runs once for both queues then.
+ */
+bool work_queue_on(work_t* work, int cpu)
+{
+    uint32_t state = __atomic_fetch_or(&work->state, WORK_PENDING, __ATOMIC_ACQ_REL);
+    if (state & WORK_PENDING) {
+        return false;
+    }
+
+    /* A running work goes back to its worker, it never runs on two at once. */
+    work_pool_t* pool = (state & WORK_RUNNING) ? work->pool : &_work_pools[cpu];
+    _work_pool_add(pool, work);
+    return true;
+}
+
+bool work_queue(work_t* work)
+{
+    return work_queue_on(work, system_cpu_id());
+}
+
+static void _work_delayed_fire(timer_entry_t* timer)
+{
+    delayed_work_t* dwork = (delayed_work_t*)timer->data;
+    uint32_t state = __atomic_fetch_and(&dwork->work.state, ~(uint32_t)WORK_DELAYED, __ATOMIC_ACQ_REL);
+    if (state & WORK_DELAYED) {
+        work_queue_on(&dwork->work, dwork->cpu);
+    }
+}
+
+void delayed_work_init(delayed_work_t* dwork, work_func_t func, void* data, uint32_t prio)
+{
+    work_init(&dwork->work, func, data, prio);
+    memset(&dwork->timer, 0, sizeof(timer_entry_t));
+    dwork->timer.callback = _work_delayed_fire;
+    dwork->timer.data = dwork;
+    dwork->cpu = 0;
+}
+
+/**
+ * Queues the work once ms have passed, to the pool of the calling cpu. A
+ * delayed work re-arms itself by calling this from its func. Returns false
+ * if the timer is armed already.
+ */
+bool work_queue_delayed(delayed_work_t* dwork, uint32_t ms)
+{
+    uint32_t state = __atomic_fetch_or(&dwork->work.state, WORK_DELAYED, __ATOMIC_ACQ_REL);
+    if (state & WORK_DELAYED) {
+        return false;
+    }
+
+    dwork->cpu = system_cpu_id();
+    timers_add(&dwork->timer, timeman_global_ticks() + timers_ms_to_ticks(ms));
+    return true;
+}
+
+/**
+ * Disarms the timer, a work which is queued already still runs. Must not
+ * race with work_queue_delayed() of the same work.
+ */
+void work_cancel_delayed(delayed_work_t* dwork)
+{
+    uint32_t state = __atomic_fetch_and(&dwork->work.state, ~(uint32_t)WORK_DELAYED, __ATOMIC_ACQ_REL);
+    if (state & WORK_DELAYED) {
+        timers_remove(&dwork->timer);
+    }
+}
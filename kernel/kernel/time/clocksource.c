@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/generic/timer.h>
+#include <libkern/bits/time.h>
+#include <libkern/log.h>
+#include <platform/generic/system.h>
+#include <time/clocksource.h>
+#ifdef __arm__
+#include <platform/aarch32/registers.h>
+#endif
+
+// #define CLOCKSOURCE_DEBUG
+
+static clocksource_t* _clocksource = NULL;
+
+/**
+ * 64 by 32 bit division for the setup, the kernel isn't linked with the
+ * helpers gcc would call for it on x86.
+ */
+static uint64_t _clocksource_div(uint64_t n, uint32_t d)
+{
+    uint64_t q = 0, r = 0;
+    for (int i = 63; i >= 0; i--) {
+        r = (r << 1) | ((n >> i) & 1);
+        if (r >= d) {
+            r -= d;
+            q |= (uint64_t)1 << i;
+        }
+    }
+    return q;
+}
+
+/**
+ * Picks the biggest shift which keeps mult in 32 bits, the delta of a
+ * second or so times mult still fits in 64 bits then.
+ */
+static void _clocksource_set_freq(clocksource_t* cs, uint32_t freq)
+{
+    cs->freq = freq;
+    for (uint32_t shift = 32; shift > 0; shift--) {
+        uint64_t mult = _clocksource_div((uint64_t)1000000000 << shift, freq);
+        if (mult <= 0xffffffff) {
+            cs->mult = mult;
+            cs->shift = shift;
+            return;
+        }
+    }
+}
+
+#ifdef __i386__
+static clocksource_t _clocksource_tsc = {
+    .name = "tsc",
+    .read = system_read_cycles,
+    .user_id = TIME_PAGE_CLOCK_TSC,
+};
+
+static clocksource_t* _clocksource_probe()
+{
+    uint32_t freq = pit_measure_cycles_per_second();
+    if (!freq) {
+        return NULL;
+    }
+    _clocksource_set_freq(&_clocksource_tsc, freq);
+    return &_clocksource_tsc;
+}
+#elif __arm__
+static clocksource_t _clocksource_cntvct = {
+    .name = "cntvct",
+    .read = read_cntvct_low,
+    .user_id = TIME_PAGE_CLOCK_CNTVCT,
+};
+
+static clocksource_t _clocksource_sp804 = {
+    .name = "sp804",
+    .read = sp804_read_counter,
+    .user_id = TIME_PAGE_CLOCK_TICKS,
+};
+
+/**
+ * The generic timer needs no calibration, its rate is in CNTFRQ. Without
+ * it the second SP804 timer runs free, userspace can't read that one.
+ */
+static clocksource_t* _clocksource_probe()
+{
+    uint32_t has_generic_timer = (read_id_pfr1() >> 16) & 0xf;
+    uint32_t freq = has_generic_timer ? read_cntfrq() : 0;
+    if (freq) {
+        _clocksource_set_freq(&_clocksource_cntvct, freq);
+        return &_clocksource_cntvct;
+    }
+
+    _clocksource_set_freq(&_clocksource_sp804, SP804_CLK_HZ);
+    return &_clocksource_sp804;
+}
+#endif
+
+void clocksource_setup()
+{
+    _clocksource = _clocksource_probe();
+#ifdef CLOCKSOURCE_DEBUG
+    if (_clocksource) {
+        log("Clocksource: %s at %d Hz", _clocksource->name, _clocksource->freq);
+    }
+#endif
+}
+
+clocksource_t* clocksource_current()
+{
+    return _clocksource;
+}
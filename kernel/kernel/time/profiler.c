@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <fs/devfs/devfs.h>
+#include <fs/vfs.h>
+#include <libkern/atomic.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <mem/kmalloc.h>
+#include <mem/vmm/vmm.h>
+#include <platform/generic/tasking/trapframe.h>
+#include <tasking/cpu.h>
+#include <tasking/perf.h>
+#include <tasking/thread.h>
+#include <time/profiler.h>
+
+/* Offsets of the words of a frame record from the frame pointer. */
+#ifdef __i386__
+#define PROFILER_FRAME_RET (1)
+#define PROFILER_FRAME_NEXT (0)
+#elif __arm__
+#define PROFILER_FRAME_RET (0)
+#define PROFILER_FRAME_NEXT (-1)
+#endif
+
+typedef struct {
+    profiler_sample_t* samples;
+    uint32_t head; // only the interrupt of the cpu moves it
+    uint32_t tail; // only readers move it, under _profiler_lock
+} profiler_ring_t;
+
+static profiler_ring_t _profiler_rings[CPU_CNT];
+static bool _profiler_enabled = false;
+static lock_t _profiler_lock;
+
+/**
+ * HELPERS
+ */
+
+static bool _profiler_can_peek(uint32_t addr, bool user)
+{
+    if (addr % sizeof(uint32_t)) {
+        return false;
+    }
+    if (vmm_is_kernel_address(addr) == user) {
+        return false;
+    }
+    return vmm_is_page_present_lockless(addr);
+}
+
+static uint32_t _profiler_walk_frames(profiler_sample_t* sample, uint32_t fp, bool user)
+{
+    uint32_t depth = 1;
+    while (depth < PROFILER_MAX_DEPTH && fp) {
+        uint32_t* ret = (uint32_t*)fp + PROFILER_FRAME_RET;
+        uint32_t* next = (uint32_t*)fp + PROFILER_FRAME_NEXT;
+        if (!_profiler_can_peek((uint32_t)ret, user) || !_profiler_can_peek((uint32_t)next, user)) {
+            break;
+        }
+
+        sample->pcs[depth++] = *ret;
+
+        /* Stacks grow down, a frame which is not above is garbage. */
+        if (*next <= fp) {
+            break;
+        }
+        fp = *next;
+    }
+    return depth;
+}
+
+static void _profiler_clear_rings_lockless()
+{
+    for (int i = 0; i < CPU_CNT; i++) {
+        atomic_store(&_profiler_rings[i].tail, atomic_load(&_profiler_rings[i].head));
+    }
+}
+
+static int _profiler_alloc_rings_lockless()
+{
+    if (_profiler_rings[0].samples) {
+        return 0;
+    }
+
+    for (int i = 0; i < CPU_CNT; i++) {
+        _profiler_rings[i].samples = kmalloc(PROFILER_SAMPLES_PER_CPU * sizeof(profiler_sample_t));
+        if (!_profiler_rings[i].samples) {
+            for (int j = 0; j < i; j++) {
+                kfree(_profiler_rings[j].samples);
+                _profiler_rings[j].samples = NULL;
+            }
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+
+/**
+ * DEVFS OPS
+ */
+
+/**
+ * Readers wait for samples while the profiler is enabled, once it's
+ * disabled they drain the rest and get 0.
+ */
+static bool _profiler_can_read(dentry_t* dentry, uint32_t start)
+{
+    if (!atomic_load(&_profiler_enabled)) {
+        return true;
+    }
+
+    for (int i = 0; i < CPU_CNT; i++) {
+        if (atomic_load(&_profiler_rings[i].head) != atomic_load(&_profiler_rings[i].tail)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _profiler_can_write(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+/**
+ * Drains whole samples of all rings.
+ */
+static int _profiler_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    if (len < sizeof(profiler_sample_t)) {
+        return -EINVAL;
+    }
+
+    uint32_t read = 0;
+    lock_acquire(&_profiler_lock);
+    for (int i = 0; i < CPU_CNT && _profiler_rings[i].samples; i++) {
+        profiler_ring_t* ring = &_profiler_rings[i];
+        uint32_t head = atomic_load(&ring->head);
+        while (ring->tail != head && read + sizeof(profiler_sample_t) <= len) {
+            memcpy(buf + read, &ring->samples[ring->tail % PROFILER_SAMPLES_PER_CPU], sizeof(profiler_sample_t));
+            read += sizeof(profiler_sample_t);
+            atomic_store(&ring->tail, ring->tail + 1);
+        }
+    }
+    lock_release(&_profiler_lock);
+    return read;
+}
+
+static int _profiler_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    if (!len) {
+        return 0;
+    }
+
+    int err = 0;
+    lock_acquire(&_profiler_lock);
+    switch (buf[0]) {
+    case '1':
+        err = _profiler_alloc_rings_lockless();
+        if (!err) {
+            _profiler_clear_rings_lockless();
+            atomic_store(&_profiler_enabled, true);
+        }
+        break;
+    case '0':
+        atomic_store(&_profiler_enabled, false);
+        break;
+    default:
+        err = -EINVAL;
+    }
+    lock_release(&_profiler_lock);
+    return err ? err : (int)len;
+}
+
+/**
+ * PUBLIC FUNCTIONS
+ */
+
+int profiler_install()
+{
+    dentry_t* mp;
+    if (vfs_resolve_path("/dev", &mp) < 0) {
+        return -1;
+    }
+
+    lock_init(&_profiler_lock);
+    file_ops_t fops = { 0 };
+    fops.can_read = _profiler_can_read;
+    fops.can_write = _profiler_can_write;
+    fops.read = _profiler_read;
+    fops.write = _profiler_write;
+    devfs_inode_t* res = devfs_register(mp, MKDEV(10, 200), "profiler", 8, 0600, &fops);
+    dentry_put(mp);
+    return 0;
+}
+
+/**
+ * Called from the timer interrupt of each cpu, so it takes no locks and
+ * reads only the words which are mapped.
+ */
+void profiler_tick()
+{
+    if (likely(!atomic_load(&_profiler_enabled))) {
+        return;
+    }
+
+    trapframe_t* tf = THIS_CPU->irq_tf;
+    profiler_ring_t* ring = &_profiler_rings[THIS_CPU->id];
+    if (!tf || !ring->samples) {
+        return;
+    }
+
+    int event;
+    if (!perf_should_sample(RUNNING_THREAD, &event)) {
+        return;
+    }
+
+    uint32_t head = ring->head;
+    if (head - atomic_load(&ring->tail) >= PROFILER_SAMPLES_PER_CPU) {
+        return;
+    }
+
+    bool user = tf_is_from_user(tf);
+    profiler_sample_t* sample = &ring->samples[head % PROFILER_SAMPLES_PER_CPU];
+    sample->tid = RUNNING_THREAD ? RUNNING_THREAD->tid : 0;
+    sample->cpu = THIS_CPU->id;
+    sample->flags = user ? PROFILER_SAMPLE_USER : 0;
+    sample->event = event;
+    sample->pcs[0] = get_instruction_pointer(tf);
+    sample->depth = _profiler_walk_frames(sample, get_frame_pointer(tf), user);
+    atomic_store(&ring->head, head + 1);
+}
@@ -6,8 +6,15 @@
 
 #include <drivers/generic/rtc.h>
 #include <drivers/generic/timer.h>
+#include <libkern/lock.h>
 #include <libkern/log.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/generic/system.h>
+#include <time/clocksource.h>
 #include <time/time_manager.h>
+#include <time/timers.h>
 
 // #define TIME_MANAGER_DEBUG
 
@@ -16,6 +23,19 @@ time_t ticks_since_second = 0;
 static time_t time_since_boot = 0;
 static time_t time_since_epoch = 0;
 
+static lock_t _timeman_page_lock;
+static uint32_t _timeman_page_paddr = 0;
+static time_page_t* _timeman_page;
+
+/* Cycle counter at the start of the current second, 0 if the second is
+   not a good sample: the first one or one with skipped ticks. */
+static uint32_t _timeman_second_start_cycles = 0;
+
+/* CLOCK_MONOTONIC at the last update of the page, see _timeman_advance_clock(). */
+static time_t _timeman_clock_secs = 0;
+static uint32_t _timeman_clock_nsec = 0;
+static uint32_t _timeman_clock_cycles = 0;
+
 static uint32_t pref_sum_of_days_in_mounts[] = {
     0,
     31,
@@ -67,6 +87,83 @@ time_t timeman_to_seconds_since_epoch(uint8_t secs, uint8_t mins, uint8_t hrs, u
     return res;
 }
 
+/**
+ * TIME PAGE
+ */
+
+static void _timeman_setup_page()
+{
+    _timeman_page_paddr = (uint32_t)pmm_alloc_frame();
+    if (!_timeman_page_paddr) {
+        kpanic("Can't alloc the time page");
+    }
+
+    zone_t mapped_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(mapped_zone.start, _timeman_page_paddr, PAGE_READABLE | PAGE_WRITABLE);
+    _timeman_page = (time_page_t*)mapped_zone.ptr;
+    memset(_timeman_page, 0, VMM_PAGE_SIZE);
+    _timeman_page->ticks_per_second = TIMER_TICKS_PER_SECOND;
+    lock_init(&_timeman_page_lock);
+
+    clocksource_t* cs = clocksource_current();
+    if (cs) {
+        _timeman_page->clock_id = cs->user_id;
+        _timeman_page->clock_mult = cs->mult;
+        _timeman_page->clock_shift = cs->shift;
+        _timeman_clock_cycles = cs->read();
+    }
+}
+
+static inline void _timeman_normalize(time_t* secs, uint32_t* nsec)
+{
+    while (*nsec >= 1000000000) {
+        *nsec -= 1000000000;
+        (*secs)++;
+    }
+}
+
+/**
+ * Moves the monotonic clock by the clocksource, or by whole ticks when
+ * there is none. It is called on every tick and at most a second of
+ * skipped ticks apart, so the delta of the counter stays short.
+ */
+static void _timeman_advance_clock(time_t ticks)
+{
+    clocksource_t* cs = clocksource_current();
+    if (cs) {
+        uint32_t now = cs->read();
+        _timeman_clock_nsec += clocksource_delta_to_ns(cs, now - _timeman_clock_cycles);
+        _timeman_clock_cycles = now;
+    } else {
+        _timeman_clock_nsec += ticks * (1000000000 / TIMER_TICKS_PER_SECOND);
+    }
+    _timeman_normalize(&_timeman_clock_secs, &_timeman_clock_nsec);
+}
+
+static void _timeman_update_page(uint32_t cycles_per_second, time_t ticks)
+{
+    lock_acquire(&_timeman_page_lock);
+    atomic_add(&_timeman_page->seq, 1);
+    _timeman_advance_clock(ticks);
+    _timeman_page->clock_cycles = _timeman_clock_cycles;
+    _timeman_page->clock_secs = _timeman_clock_secs;
+    _timeman_page->clock_nsec = _timeman_clock_nsec;
+    _timeman_page->secs_since_boot = atomic_load(&time_since_boot);
+    _timeman_page->secs_since_epoch = atomic_load(&time_since_epoch);
+    _timeman_page->ticks_since_second = atomic_load(&ticks_since_second);
+    _timeman_page->cycles_per_second = cycles_per_second;
+    atomic_add(&_timeman_page->seq, 1);
+    lock_release(&_timeman_page_lock);
+}
+
+/**
+ * Returns the frame of the time page, it's mapped into a process at exec.
+ */
+uint32_t timeman_page_paddr()
+{
+    return _timeman_page_paddr;
+}
+
 int timeman_setup()
 {
     uint8_t secs = 0, mins = 0, hrs = 0, day = 0, month = 0;
@@ -83,9 +180,54 @@ int timeman_setup()
 #ifdef TIME_MANAGER_DEBUG
     log("Loaded date: %d", time_since_epoch);
 #endif
+    clocksource_setup();
+    _timeman_setup_page();
+    _timeman_update_page(0, 0);
+    timers_init();
     return 0;
 }
 
+/**
+ * The cycle counter of cpu0 is measured against whole seconds of ticks.
+ * A second with skipped ticks is not used, the counter may stop while a
+ * cpu idles, and neither is one ended by another cpu.
+ */
+static uint32_t _timeman_measure_cycles(bool new_second, bool skipped)
+{
+    uint32_t cycles_per_second = _timeman_page->cycles_per_second;
+    if (skipped || system_cpu_id() != 0) {
+        _timeman_second_start_cycles = 0;
+        return cycles_per_second;
+    }
+    if (!new_second) {
+        return cycles_per_second;
+    }
+
+    uint32_t now = system_read_cycles();
+    if (_timeman_second_start_cycles) {
+        cycles_per_second = now - _timeman_second_start_cycles;
+    }
+    _timeman_second_start_cycles = now ? now : 1;
+    return cycles_per_second;
+}
+
+static void _timeman_add_ticks(time_t ticks)
+{
+    atomic_add(&ticks_since_boot, ticks);
+    time_t in_second = atomic_add(&ticks_since_second, ticks);
+    bool new_second = in_second >= TIMER_TICKS_PER_SECOND;
+
+    if (new_second) {
+        time_t secs = in_second / TIMER_TICKS_PER_SECOND;
+        atomic_add(&time_since_boot, secs);
+        atomic_add(&time_since_epoch, secs);
+        atomic_store(&ticks_since_second, in_second % TIMER_TICKS_PER_SECOND);
+    }
+    _timeman_update_page(_timeman_measure_cycles(new_second, ticks > 1), ticks);
+
+    timers_tick(atomic_load(&ticks_since_boot));
+}
+
 void timeman_timer_tick()
 {
     THIS_CPU->stat_ticks_since_boot++;
@@ -93,13 +235,45 @@ void timeman_timer_tick()
         return;
     }
 
-    atomic_add(&ticks_since_second, 1);
+    _timeman_add_ticks(1);
+}
 
-    if (ticks_since_second >= TIMER_TICKS_PER_SECOND) {
-        atomic_add(&time_since_boot, 1);
-        atomic_add(&time_since_epoch, 1);
-        atomic_store(&ticks_since_second, 0);
+/**
+ * Accounts ticks which have passed while the periodic tick was stopped.
+ */
+void timeman_skip_ticks(time_t ticks)
+{
+    THIS_CPU->stat_ticks_since_boot += ticks;
+    _timeman_add_ticks(ticks);
+}
+
+/**
+ * Waits for an interrupt on an idle cpu. When the scheduler allows it, the
+ * periodic tick is stopped until the next timer, but at most for
+ * TIMEMAN_MAX_IDLE_TICKS, and the skipped ticks are accounted on wakeup.
+ * Only SP804 can be reprogrammed so, PIT keeps ticking.
+ */
+void timeman_idle(bool can_stop_ticks)
+{
+#ifdef __arm__
+    system_disable_interrupts();
+    if (can_stop_ticks) {
+        time_t ticks = timers_ticks_to_next(TIMEMAN_MAX_IDLE_TICKS);
+        if (ticks > 1) {
+            sp804_stop_ticks(ticks);
+        }
     }
+
+    /* Wfi wakes up on a pending interrupt even if they are masked. */
+    system_stop_until_interrupt();
+    uint32_t skipped = sp804_resume_ticks();
+    if (skipped) {
+        timeman_skip_ticks(skipped);
+    }
+    system_enable_interrupts();
+#else
+    system_stop_until_interrupt();
+#endif
 }
 
 time_t timeman_now()
@@ -112,6 +286,44 @@ time_t timeman_seconds_since_boot()
     return atomic_load(&time_since_boot);
 }
 
+uint32_t timeman_cycles_per_second()
+{
+    if (!_timeman_page) {
+        return 0;
+    }
+    return atomic_load(&_timeman_page->cycles_per_second);
+}
+
+/**
+ * Reads the clock of the time page and adds the time since its update,
+ * the same way userspace does.
+ */
+void timeman_clock_read(clockid_t clk_id, timespec_t* ts)
+{
+    uint32_t seq, cycles;
+    time_t secs, realtime_offset;
+    uint32_t nsec;
+    do {
+        seq = atomic_load(&_timeman_page->seq);
+        secs = _timeman_page->clock_secs;
+        nsec = _timeman_page->clock_nsec;
+        cycles = _timeman_page->clock_cycles;
+        realtime_offset = _timeman_page->secs_since_epoch - _timeman_page->secs_since_boot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != atomic_load(&_timeman_page->seq));
+
+    clocksource_t* cs = clocksource_current();
+    if (cs) {
+        nsec += clocksource_delta_to_ns(cs, cs->read() - cycles);
+        _timeman_normalize(&secs, &nsec);
+    }
+    if (clk_id == CLOCK_REALTIME) {
+        secs += realtime_offset;
+    }
+    ts->tv_sec = secs;
+    ts->tv_nsec = nsec;
+}
+
 time_t timeman_get_ticks_from_last_second()
 {
     return atomic_load(&ticks_since_second);
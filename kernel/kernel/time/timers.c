@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <time/timers.h>
+
+static timer_entry_t* _timers_wheel[TIMERS_WHEEL_SIZE];
+static time_t _timers_now;
+static uint32_t _timers_pending;
+static lock_t _timers_lock;
+
+static inline timer_entry_t** _timers_slot(time_t tick)
+{
+    return &_timers_wheel[tick % TIMERS_WHEEL_SIZE];
+}
+
+static void _timers_remove_lockless(timer_entry_t* timer)
+{
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        *_timers_slot(timer->expires) = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->pending = false;
+    _timers_pending--;
+}
+
+/**
+ * Returns a timer of the slot which has expired by the tick.
+ */
+static timer_entry_t* _timers_find_expired_lockless(time_t tick)
+{
+    timer_entry_t* timer = *_timers_slot(tick);
+    while (timer && timer->expires > tick) {
+        timer = timer->next;
+    }
+    return timer;
+}
+
+void timers_init()
+{
+    lock_init(&_timers_lock);
+    memset(_timers_wheel, 0, sizeof(_timers_wheel));
+    _timers_now = 0;
+    _timers_pending = 0;
+}
+
+void timers_add(timer_entry_t* timer, time_t expires)
+{
+    lock_acquire(&_timers_lock);
+    ASSERT(!timer->pending);
+
+    /* The slot of the current tick has been already passed. */
+    if (expires <= _timers_now) {
+        expires = _timers_now + 1;
+    }
+
+    timer_entry_t** slot = _timers_slot(expires);
+    timer->expires = expires;
+    timer->pending = true;
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot) {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+    _timers_pending++;
+    lock_release(&_timers_lock);
+}
+
+void timers_remove(timer_entry_t* timer)
+{
+    lock_acquire(&_timers_lock);
+    if (timer->pending) {
+        _timers_remove_lockless(timer);
+    }
+    lock_release(&_timers_lock);
+}
+
+/**
+ * Called on every tick of the boot cpu. A timer is taken out of the
+ * wheel before its callback runs, so the callback may add it again.
+ */
+void timers_tick(time_t now)
+{
+    lock_acquire(&_timers_lock);
+    if (!_timers_pending) {
+        _timers_now = now;
+        lock_release(&_timers_lock);
+        return;
+    }
+
+    /* After a long gap every slot is visited only once. */
+    time_t tick = _timers_now + 1;
+    if (now - _timers_now > TIMERS_WHEEL_SIZE) {
+        tick = now - TIMERS_WHEEL_SIZE + 1;
+    }
+
+    for (; tick <= now; tick++) {
+        _timers_now = tick;
+        timer_entry_t* timer;
+        while ((timer = _timers_find_expired_lockless(tick))) {
+            _timers_remove_lockless(timer);
+            lock_release(&_timers_lock);
+            timer->callback(timer);
+            lock_acquire(&_timers_lock);
+        }
+    }
+    lock_release(&_timers_lock);
+}
+
+/**
+ * Returns the number of ticks until the first pending timer, or limit if
+ * no timer expires earlier.
+ */
+time_t timers_ticks_to_next(time_t limit)
+{
+    lock_acquire(&_timers_lock);
+    if (!_timers_pending) {
+        lock_release(&_timers_lock);
+        return limit;
+    }
+
+    time_t now = _timers_now;
+    for (time_t tick = now + 1; tick <= now + limit; tick++) {
+        if (_timers_find_expired_lockless(tick)) {
+            lock_release(&_timers_lock);
+            return tick - now;
+        }
+    }
+    lock_release(&_timers_lock);
+    return limit;
+}
@@ -44,4 +44,9 @@ int closedir(DIR* dir)
 ssize_t getdents(int fd, char* buf, size_t len)
 {
     return (ssize_t)DO_SYSCALL_3(SYS_GETDENTS, fd, buf, len);
+}
+
+ssize_t getdents_stat(int fd, char* buf, size_t len)
+{
+    return (ssize_t)DO_SYSCALL_3(SYS_GETDENTS_STAT, fd, buf, len);
 }
\ No newline at end of file
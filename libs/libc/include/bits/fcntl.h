@@ -18,4 +18,5 @@
 #define O_TRUNC 0x20
 #define O_APPEND 0x40
 #define O_EXCL 0x80
-#define O_EXEC 0x100
\ No newline at end of file
+#define O_EXEC 0x100
+#define O_CLOEXEC 0x200
\ No newline at end of file
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <sys/types.h>
+
+/**
+ * Readiness notification: a persistent interest list of fds, waited on as
+ * a whole. Events are level-triggered, an fd added with EPOLLONESHOT is
+ * reported once and then disabled until it is modified with EPOLL_CTL_MOD.
+ */
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define EPOLLIN 0x001
+#define EPOLLOUT 0x004
+#define EPOLLONESHOT (1u << 30)
+
+#define EPOLL_ITEMS_MAX 1024
+
+struct epoll_event {
+    uint32_t events;
+    uint32_t data;
+};
+typedef struct epoll_event epoll_event_t;
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <sys/types.h>
+
+/**
+ * Per-thread hardware event counters. A thread opens up to
+ * PERF_MAX_COUNTERS counters, they count only while it runs. A counter
+ * opened with a sample period makes the profiler sample the thread once
+ * the counter has advanced by the period, instead of on every tick.
+ */
+enum PERF_EVENT {
+    PERF_EVENT_CYCLES,
+    PERF_EVENT_INSTRUCTIONS,
+    PERF_EVENT_CACHE_MISSES,
+    PERF_EVENT_BRANCH_MISSES,
+    PERF_EVENT_TLB_MISSES,
+    PERF_EVENT_COUNT,
+};
+
+#define PERF_MAX_COUNTERS (4)
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+/**
+ * /proc/statbin returns a snapshot of all processes in one read: the header
+ * and then count records of record_size bytes. New fields are added only at
+ * the end of the record and bump the version, so readers step by
+ * record_size and old readers keep working.
+ */
+#define PROCSTAT_VERSION 1
+
+struct procstat_header {
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t count;
+    uint32_t uptime; /* In seconds. */
+};
+typedef struct procstat_header procstat_header_t;
+
+struct procstat {
+    int32_t pid;
+    int32_t ppid;
+    uint32_t uid;
+    uint32_t prio;
+    uint32_t user_ticks;
+    uint32_t system_ticks;
+    uint32_t voluntary_switches;
+    uint32_t involuntary_switches;
+    uint32_t minor_faults;
+    uint32_t cow_faults;
+    uint32_t file_faults;
+    uint32_t read_bytes;
+    uint32_t written_bytes;
+    uint32_t syscalls;
+};
+typedef struct procstat procstat_t;
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <sys/types.h>
+
+/**
+ * Submission/completion ring, lives in the memory of the process. The
+ * process fills entries at sq_tail, the kernel consumes them from sq_head
+ * and posts the results at cq_tail. Both arrays hold @entries items, which
+ * has to be a power of two.
+ */
+#define RING_ENTRIES_MAX 256
+
+struct ring_sqe {
+    uint32_t id;
+    uint32_t params[5];
+    uint32_t user_data;
+};
+typedef struct ring_sqe ring_sqe_t;
+
+struct ring_cqe {
+    uint32_t user_data;
+    int32_t res;
+};
+typedef struct ring_cqe ring_cqe_t;
+
+struct ring {
+    uint32_t entries;
+    uint32_t sq_head;
+    uint32_t sq_tail;
+    uint32_t cq_head;
+    uint32_t cq_tail;
+    ring_sqe_t* sqes;
+    ring_cqe_t* cqes;
+};
+typedef struct ring ring_t;
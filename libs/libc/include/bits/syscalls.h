@@ -55,6 +55,29 @@ enum __sysid {
     SYS_SHBUF_CREATE,
     SYS_SHBUF_GET,
     SYS_SHBUF_FREE,
+    SYS_SPAWN,
+    SYS_FSYNC,
+    SYS_SYNC,
+    SYS_FUTEX,
+    SYS_PTHREADEXIT,
+    SYS_DUP2,
+    SYS_RING_ENTER,
+    SYS_ACCEPT,
+    SYS_SHBUF_RESIZE,
+    SYS_SHBUF_HAND_OVER,
+    SYS_EPOLL_CREATE,
+    SYS_EPOLL_CTL,
+    SYS_EPOLL_WAIT,
+    SYS_SHBUF_SEAL,
+    SYS_MADVISE,
+    SYS_WRITEV,
+    SYS_GETDENTS_STAT,
+    SYS_SENDFILE,
+    SYS_COPY_FILE_RANGE,
+    SYS_MSYNC,
+    SYS_PERF_OPEN,
+    SYS_PERF_READ,
+    SYS_PERF_CLOSE,
 };
 
 typedef enum __sysid sysid_t;
\ No newline at end of file
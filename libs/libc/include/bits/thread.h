@@ -13,6 +13,36 @@ struct thread_create_params {
     uint32_t entry_point;
     uint32_t stack_start;
     uint32_t stack_size;
+    uint32_t tls; /* Thread pointer of the new thread, 0 for none. */
 };
 
 typedef struct thread_create_params thread_create_params_t;
+
+/**
+ * The TLS image of a program, which is copied into every TLS block.
+ */
+struct tls_template {
+    uint32_t image;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t align;
+};
+typedef struct tls_template tls_template_t;
+
+/**
+ * The thread control block is placed at the thread pointer.
+ * On x86 the TLS block lies right below it and %gs:0 must point to
+ * the block itself. On arm the TLS block follows the two words of it.
+ */
+struct thread_tcb {
+#ifdef __i386__
+    struct thread_tcb* self;
+#endif
+    tls_template_t* tls_template;
+    void* thread;
+};
+typedef struct thread_tcb thread_tcb_t;
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_WAKE_ALL (0x7fffffff)
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <bits/sys/stat.h>
 #include <stddef.h>
 #include <sys/_structs.h>
 #include <sys/cdefs.h>
@@ -23,6 +24,18 @@ struct __dirent {
 };
 typedef struct __dirent dirent_t;
 
+/* Record of getdents_stat, an entry together with the stat of its inode. */
+struct __dirent_stat {
+    uint32_t d_ino;
+    uint16_t d_reclen;
+    uint8_t d_namelen;
+    uint8_t d_type;
+    fstat_t d_stat;
+    char d_name[];
+};
+typedef struct __dirent_stat dirent_stat_t;
+
 ssize_t getdents(int fd, char* buf, size_t len);
+ssize_t getdents_stat(int fd, char* buf, size_t len);
 
 __END_DECLS
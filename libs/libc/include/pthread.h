@@ -1,12 +1,69 @@
 #pragma once
 
 #include <bits/thread.h>
+#include <stddef.h>
 #include <sys/_structs.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
 __BEGIN_DECLS
 
-int pthread_create(void* func);
+#define PTHREAD_STACK_MIN (4096)
+#define PTHREAD_STACK_DEFAULT (16 * 4096)
+#define PTHREAD_GUARD_DEFAULT (4096)
+
+typedef int pthread_t;
+
+struct pthread_attr {
+    size_t stack_size;
+    size_t guard_size;
+};
+typedef struct pthread_attr pthread_attr_t;
+
+struct pthread_mutex {
+    uint32_t state; /* 0 - unlocked, 1 - locked, 2 - locked and someone may wait. */
+};
+typedef struct pthread_mutex pthread_mutex_t;
+typedef int pthread_mutexattr_t;
+
+struct pthread_cond {
+    uint32_t seq;
+};
+typedef struct pthread_cond pthread_cond_t;
+typedef int pthread_condattr_t;
+
+#define PTHREAD_MUTEX_INITIALIZER \
+    {                             \
+        0                         \
+    }
+#define PTHREAD_COND_INITIALIZER \
+    {                            \
+        0                        \
+    }
+
+int pthread_attr_init(pthread_attr_t* attr);
+int pthread_attr_destroy(pthread_attr_t* attr);
+int pthread_attr_setstacksize(pthread_attr_t* attr, size_t stack_size);
+int pthread_attr_getstacksize(const pthread_attr_t* attr, size_t* stack_size);
+int pthread_attr_setguardsize(pthread_attr_t* attr, size_t guard_size);
+int pthread_attr_getguardsize(const pthread_attr_t* attr, size_t* guard_size);
+
+/* Non-zero once the process created a thread, runtimes skip atomics until then. */
+extern int __pthread_threaded;
+
+int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*start_routine)(void*), void* arg);
+void pthread_exit(void* retval);
+
+int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr);
+int pthread_mutex_destroy(pthread_mutex_t* mutex);
+int pthread_mutex_lock(pthread_mutex_t* mutex);
+int pthread_mutex_trylock(pthread_mutex_t* mutex);
+int pthread_mutex_unlock(pthread_mutex_t* mutex);
+
+int pthread_cond_init(pthread_cond_t* cond, const pthread_condattr_t* attr);
+int pthread_cond_destroy(pthread_cond_t* cond);
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex);
+int pthread_cond_signal(pthread_cond_t* cond);
+int pthread_cond_broadcast(pthread_cond_t* cond);
 
 __END_DECLS
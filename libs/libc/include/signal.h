@@ -11,8 +11,13 @@
 
 __BEGIN_DECLS
 
+/* A wait interrupted by the handler goes on after it instead of failing
+   with EINTR. Handlers set with sigaction() restart, see siginterrupt(). */
+#define SA_RESTART 0x10000000
+
 int kill(pid_t pid, int sig);
 int sigaction(int signo, void* callback);
+int siginterrupt(int sig, int flag);
 int raise(int sig);
 
 __END_DECLS
\ No newline at end of file
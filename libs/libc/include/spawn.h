@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+__BEGIN_DECLS
+
+/* File actions and attributes are not supported yet, only NULL is accepted (EINVAL otherwise). */
+struct __posix_spawn_file_actions;
+typedef struct __posix_spawn_file_actions posix_spawn_file_actions_t;
+struct __posix_spawnattr;
+typedef struct __posix_spawnattr posix_spawnattr_t;
+
+/* @argv follows the execve() convention, the path is passed as argv[0] by the kernel. */
+int posix_spawn(pid_t* pid, const char* path, const posix_spawn_file_actions_t* file_actions, const posix_spawnattr_t* attrp, char** argv, char** envp);
+
+__END_DECLS
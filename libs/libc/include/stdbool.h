@@ -4,7 +4,8 @@
 
 __BEGIN_DECLS
 
-#ifndef __bool_true_false_are_defined
+/* C++ has bool, true and false as keywords. */
+#if !defined(__bool_true_false_are_defined) && !defined(__cplusplus)
 #define bool _Bool
 #define true (1)
 #define false (0)
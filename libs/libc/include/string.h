@@ -18,8 +18,7 @@ void* memset(void* dest, int fill, size_t nbytes);
 /* Move 'nbytes' from 'src' to 'dest' */
 void* memmove(void* dest, const void* __restrict src, size_t nbytes);
 
-/* Copy 'nbytes' from 'src' to 'dest'. See the comment in the source file
-   about optimization and restricting pointers. */
+/* Copy 'nbytes' from 'src' to 'dest'. The regions must not overlap. */
 void* memcpy(void* __restrict dest, const void* __restrict src, size_t nbytes);
 
 /* Copy 'nbytes' from 'src' to 'dest', stopping if the current byte matches
@@ -33,6 +32,9 @@ int memcmp(const void* src1, const void* src2, size_t nbytes);
 /* Calculate the string length starting from 'str'. */
 size_t strlen(const char* str);
 
+/* Find the first 'ch' in 'str', the null byte counts as a part of it. */
+char* strchr(const char* str, int ch);
+
 /* Copy 'src' into 'dest' until it finds a null byte in the source string.
    Note that this is dangerous because it writes memory no matter the size
    the 'dest' buffer is. */
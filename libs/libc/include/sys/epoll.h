@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+#include <bits/sys/epoll.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+__BEGIN_DECLS
+
+/**
+ * Keeps the interest list in the kernel, so fds are registered once with
+ * epoll_ctl() instead of being passed to every wait like with select().
+ * A negative timeout of epoll_wait() waits with no limit.
+ */
+int epoll_create();
+int epoll_ctl(int epfd, int op, int fd, epoll_event_t* event);
+int epoll_wait(int epfd, epoll_event_t* events, int maxevents, int timeout);
+
+__END_DECLS
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+__BEGIN_DECLS
+
+/* A whole regular file mapped read only for a sequential pass over it, so
+   the data is read in by page faults instead of copied by read(). An empty
+   file has no mapping and a NULL data. */
+struct mapped_file {
+    void* data;
+    size_t size;
+};
+typedef struct mapped_file mapped_file_t;
+
+int mapped_file_open(const char* path, mapped_file_t* file);
+int mapped_file_map_fd(int fd, mapped_file_t* file);
+int mapped_file_close(mapped_file_t* file);
+
+__END_DECLS
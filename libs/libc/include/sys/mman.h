@@ -15,5 +15,7 @@ __BEGIN_DECLS
 
 void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset);
 int munmap(void* addr, size_t length);
+int madvise(void* addr, size_t length, int advice);
+int msync(void* addr, size_t length, int flags);
 
 __END_DECLS
\ No newline at end of file
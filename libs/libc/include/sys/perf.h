@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <bits/sys/perf.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+__BEGIN_DECLS
+
+int perf_open(int event, uint32_t sample_period);
+int perf_read(int counter, uint64_t* value);
+int perf_close(int counter);
+
+__END_DECLS
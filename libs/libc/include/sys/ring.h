@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+#include <bits/sys/ring.h>
+#include <bits/sys/select.h>
+#include <bits/time.h>
+#include <stddef.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+__BEGIN_DECLS
+
+/**
+ * Batches read, write, select and shbuf calls into one trap. Queue entries
+ * with ring_get_sqe() and one of ring_prep_*(), run them with ring_submit()
+ * and collect the results with ring_peek_cqe()/ring_cqe_seen().
+ */
+int ring_init(ring_t* ring, uint32_t entries);
+void ring_free(ring_t* ring);
+
+ring_sqe_t* ring_get_sqe(ring_t* ring);
+void ring_prep_read(ring_sqe_t* sqe, int fd, void* buf, size_t count, uint32_t user_data);
+void ring_prep_write(ring_sqe_t* sqe, int fd, const void* buf, size_t count, uint32_t user_data);
+void ring_prep_select(ring_sqe_t* sqe, int nfds, fd_set_t* readfds, fd_set_t* writefds, fd_set_t* exceptfds, timeval_t* timeout, uint32_t user_data);
+void ring_prep_shbuf_create(ring_sqe_t* sqe, uint8_t** buffer, size_t size, uint32_t user_data);
+void ring_prep_shbuf_get(ring_sqe_t* sqe, int id, uint8_t** buffer, uint32_t user_data);
+void ring_prep_shbuf_free(ring_sqe_t* sqe, int id, uint32_t user_data);
+
+int ring_submit(ring_t* ring);
+ring_cqe_t* ring_peek_cqe(ring_t* ring);
+void ring_cqe_seen(ring_t* ring);
+
+__END_DECLS
@@ -17,5 +17,8 @@ __BEGIN_DECLS
 int shared_buffer_create(uint8_t** buffer, size_t size);
 int shared_buffer_get(int id, uint8_t** buffer);
 int shared_buffer_free(int id);
+int shared_buffer_resize(int id, uint8_t** buffer, size_t size);
+int shared_buffer_hand_over(int id);
+int shared_buffer_seal(int id);
 
 __END_DECLS
\ No newline at end of file
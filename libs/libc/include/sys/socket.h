@@ -10,5 +10,6 @@ __BEGIN_DECLS
 int socket(int domain, int type, int protocol);
 int bind(int sockfd, const char* name, int len);
 int connect(int sockfd, const char* name, int len);
+int accept(int sockfd);
 
 __END_DECLS
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <bits/sys/uio.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+__BEGIN_DECLS
+
+ssize_t writev(int fd, const iovec_t* iov, int iovcnt);
+
+__END_DECLS
@@ -11,6 +11,10 @@
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
+#define STDIN_FILENO 0
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+
 __BEGIN_DECLS
 
 int fork();
@@ -21,12 +25,17 @@ int setpgid(pid_t cmd, pid_t arg);
 pid_t getpgid(pid_t arg);
 
 int close(int fd);
+int dup2(int oldfd, int newfd);
 ssize_t read(int fd, char* buf, size_t count);
 ssize_t write(int fd, const void* buf, size_t count);
 int rmdir(const char* path);
 int chdir(const char* path);
 int unlink(const char* path);
 off_t lseek(int fd, off_t off, int whence);
+int fsync(int fd);
+ssize_t copy_file_range(int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t len);
+int isatty(int fd);
+void sync();
 
 uid_t getuid();
 int setuid(uid_t uid);
@@ -1,142 +1,376 @@
 #include "malloc.h"
 #include <stdbool.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/mman.h>
 
-#define ALIGNMENT (4)
-#define DEVIDE_SPACE_BOUNDARY (32)
+#define ALIGNMENT (8)
+#define MIN_CHUNK_SIZE (16)
+#define BITMAP_WORDS ((MALLOC_BINS + 31) / 32)
 
-static malloc_header_t* memory[MALLOC_MAX_ALLOCATED_BLOCKS];
-static size_t allocated_blocks = 0;
+static malloc_header_t* bins[MALLOC_BINS];
+static uint32_t bins_bitmap[BITMAP_WORDS];
+static size_t free_regions = 0;
 
-static int _alloc_new_block(size_t sz);
+/* The heap is locked only once a second thread has been started. */
+static bool malloc_threaded = false;
+static pthread_mutex_t malloc_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static int _alloc_new_block(size_t sz)
+void _malloc_set_threaded()
 {
-    sz += sizeof(malloc_header_t);
+    malloc_threaded = true;
+}
 
-    // this will reduce system calls for the small memory allocations
-    size_t allocated_sz = sz > MALLOC_DEFAULT_BLOCK_SIZE ? sz : MALLOC_DEFAULT_BLOCK_SIZE;
+void _malloc_lock()
+{
+    if (malloc_threaded) {
+        pthread_mutex_lock(&malloc_lock);
+    }
+}
 
-    int ret = (int)mmap(NULL, allocated_sz, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
-    if (ret < 0) {
-        return -1;
+void _malloc_unlock()
+{
+    if (malloc_threaded) {
+        pthread_mutex_unlock(&malloc_lock);
+    }
+}
+
+static inline size_t _malloc_round_up(size_t sz, size_t to)
+{
+    return (sz + to - 1) & ~(to - 1);
+}
+
+static inline int _malloc_bin_index(size_t sz)
+{
+    if (sz <= MALLOC_SMALL_BINS * ALIGNMENT) {
+        return sz / ALIGNMENT - 1;
     }
-    memory[allocated_blocks] = (void*)ret; // allocating a new block of memory
-    memory[allocated_blocks]->flags = 0;
-    memory[allocated_blocks]->next = 0;
-    memory[allocated_blocks]->prev = 0;
-    memory[allocated_blocks]->size = allocated_sz - sizeof(malloc_header_t);
 
-    allocated_blocks++;
-    return 0;
+    int log = 31 - __builtin_clz(sz);
+    int sub = (sz >> (log - 2)) & 3;
+    int index = MALLOC_SMALL_BINS + (log - 9) * 4 + sub;
+    return index < MALLOC_BINS ? index : MALLOC_BINS - 1;
 }
 
-static inline char _malloc_need_to_divide_space(malloc_header_t* space, size_t alloc_size)
+static inline malloc_header_t* _malloc_next_chunk(malloc_header_t* chunk)
 {
-    return alloc_size + DEVIDE_SPACE_BOUNDARY <= space->size;
+    return (malloc_header_t*)((uintptr_t)chunk + sizeof(malloc_header_t) + chunk->size);
 }
 
-static inline char _malloc_can_fit_allocation(malloc_header_t* space, size_t alloc_size)
+static inline malloc_header_t* _malloc_prev_chunk(malloc_header_t* chunk)
 {
-    uint32_t add[] = { 0, sizeof(malloc_header_t) };
-    return space->size >= (alloc_size + add[_malloc_need_to_divide_space(space, alloc_size)]);
+    size_t prev_size = ((size_t*)chunk)[-1];
+    return (malloc_header_t*)((uintptr_t)chunk - prev_size - sizeof(malloc_header_t));
 }
 
-void* malloc(size_t sz)
+static inline void _malloc_set_footer(malloc_header_t* chunk)
 {
-    if (!sz) {
-        return NULL;
+    *(size_t*)((uintptr_t)chunk + sizeof(malloc_header_t) + chunk->size - sizeof(size_t)) = chunk->size;
+}
+
+static inline bool _malloc_is_whole_region(malloc_header_t* chunk)
+{
+    return block_has_flags(chunk, FLAG_FIRST | FLAG_LAST);
+}
+
+static void _malloc_bin_insert(malloc_header_t* chunk)
+{
+    if (_malloc_is_whole_region(chunk)) {
+        free_regions++;
     }
-    sz += (ALIGNMENT - 1);
-    sz &= ~(uint32_t)(ALIGNMENT - 1);
 
-    void* res = slab_alloc(sz);
-    if (res) {
-        return res;
+    int index = _malloc_bin_index(chunk->size);
+    chunk->prev = NULL;
+    chunk->next = bins[index];
+    if (bins[index]) {
+        bins[index]->prev = chunk;
+    }
+    bins[index] = chunk;
+    bins_bitmap[index / 32] |= (1u << (index % 32));
+}
+
+static void _malloc_bin_remove(malloc_header_t* chunk)
+{
+    if (_malloc_is_whole_region(chunk)) {
+        free_regions--;
+    }
+
+    int index = _malloc_bin_index(chunk->size);
+    if (chunk->prev) {
+        chunk->prev->next = chunk->next;
+    } else {
+        bins[index] = chunk->next;
+    }
+    if (chunk->next) {
+        chunk->next->prev = chunk->prev;
     }
+    if (!bins[index]) {
+        bins_bitmap[index / 32] &= ~(1u << (index % 32));
+    }
+}
 
-    /* iterating over allocated by mmap blocks
-       and finding a first fit memory chunk */
-    malloc_header_t* first_fit = 0;
-    for (size_t i = 0; i < allocated_blocks; i++) {
-        malloc_header_t* cur_block = memory[i];
-        while (cur_block->next && !(block_is_free(cur_block) && _malloc_can_fit_allocation(cur_block, sz))) {
-            cur_block = cur_block->next;
+/* Returns the first non-empty bin starting with index, or -1. */
+static inline int _malloc_next_bin(int index)
+{
+    for (int word = index / 32; word < BITMAP_WORDS; word++) {
+        uint32_t mask = bins_bitmap[word];
+        if (word == index / 32) {
+            mask &= ~0u << (index % 32);
         }
-        if (block_is_free(cur_block) && _malloc_can_fit_allocation(cur_block, sz)) {
-            first_fit = cur_block;
-            break;
+        if (mask) {
+            return word * 32 + __builtin_ctz(mask);
         }
     }
+    return -1;
+}
 
-    if (!first_fit) {
-        int err = _alloc_new_block(sz);
-        if (err) {
-            return NULL;
+static malloc_header_t* _malloc_find_chunk(size_t sz)
+{
+    int index = _malloc_bin_index(sz);
+
+    // Chunks in the bins of longer sizes may be shorter than asked.
+    if (index >= MALLOC_SMALL_BINS) {
+        for (malloc_header_t* chunk = bins[index]; chunk; chunk = chunk->next) {
+            if (chunk->size >= sz) {
+                return chunk;
+            }
         }
-        first_fit = memory[allocated_blocks - 1];
+        index++;
+    }
+
+    // Every chunk of the later bins fits.
+    index = _malloc_next_bin(index);
+    if (index < 0) {
+        return NULL;
+    }
+    return bins[index];
+}
+
+static malloc_header_t* _malloc_alloc_region(size_t sz)
+{
+    size_t region_size = _malloc_round_up(sz + sizeof(malloc_header_t), MALLOC_DEFAULT_BLOCK_SIZE);
+    if (region_size < MALLOC_REGION_SIZE) {
+        region_size = MALLOC_REGION_SIZE;
+    }
+
+    int ret = (int)mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
+    if (ret < 0) {
+        return NULL;
+    }
+
+    malloc_header_t* chunk = (malloc_header_t*)ret;
+    chunk->flags = FLAG_FIRST | FLAG_LAST;
+    chunk->size = region_size - sizeof(malloc_header_t);
+    _malloc_set_footer(chunk);
+    return chunk;
+}
+
+/* A region which got free is unmapped, unless it is kept as a spare. A spare
+   keeps only the page with its header, the rest is dropped until reused. */
+static bool _malloc_trim_region(malloc_header_t* chunk)
+{
+    size_t region_size = chunk->size + sizeof(malloc_header_t);
+    if (free_regions >= MALLOC_SPARE_REGIONS) {
+        munmap(chunk, region_size);
+        return true;
     }
 
-    malloc_header_t* copy_next = first_fit->next;
-    size_t copy_size = first_fit->size;
+    uintptr_t first_page = _malloc_round_up((uintptr_t)&chunk[1], MALLOC_DEFAULT_BLOCK_SIZE);
+    uintptr_t region_end = (uintptr_t)chunk + region_size;
+    if (first_page < region_end) {
+        madvise((void*)first_page, region_end - first_page, MADV_DONTNEED);
+    }
+    return false;
+}
 
-    first_fit->flags |= FLAG_ALLOCATED;
-    if (_malloc_need_to_divide_space(first_fit, sz)) {
-        first_fit->size = sz;
-        first_fit->next = (malloc_header_t*)((uintptr_t)first_fit + sz + sizeof(malloc_header_t));
+static void* _malloc_large(size_t sz)
+{
+    size_t map_size = _malloc_round_up(sz + sizeof(malloc_header_t), MALLOC_DEFAULT_BLOCK_SIZE);
+    int ret = (int)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
+    if (ret < 0) {
+        return NULL;
+    }
 
-        // adjust the firstfit chunk
-        first_fit->next->flags = 0;
-        first_fit->next->size = copy_size - sz - sizeof(malloc_header_t);
-        first_fit->next->next = copy_next;
-        first_fit->next->prev = first_fit;
+    malloc_header_t* chunk = (malloc_header_t*)ret;
+    chunk->flags = FLAG_ALLOCATED | FLAG_LARGE;
+    chunk->size = map_size - sizeof(malloc_header_t);
+    chunk->next = NULL;
+    chunk->prev = NULL;
+    return (void*)&chunk[1];
+}
 
-        if (first_fit->next->next) {
-            first_fit->next->next->prev = first_fit->next;
+/* Cuts the chunk, which is taken out of the bins, down to sz. */
+static void _malloc_split(malloc_header_t* chunk, size_t sz)
+{
+    // The rest goes back to the bins if a chunk can be made of it.
+    if (chunk->size >= sz + sizeof(malloc_header_t) + MIN_CHUNK_SIZE) {
+        malloc_header_t* rest = (malloc_header_t*)((uintptr_t)chunk + sizeof(malloc_header_t) + sz);
+        rest->flags = chunk->flags & FLAG_LAST;
+        rest->size = chunk->size - sz - sizeof(malloc_header_t);
+        _malloc_set_footer(rest);
+        _malloc_bin_insert(rest);
+
+        chunk->size = sz;
+        block_rem_flags(chunk, FLAG_LAST);
+    } else if (!block_has_flags(chunk, FLAG_LAST)) {
+        block_rem_flags(_malloc_next_chunk(chunk), FLAG_PREV_FREE);
+    }
+}
+
+/* Sets zeroed if the memory comes right from mmap and is zero yet. */
+static void* _malloc_locked(size_t sz, bool* zeroed)
+{
+    void* res = slab_alloc(sz);
+    if (res) {
+        return res;
+    }
+
+    if (sz >= MALLOC_LARGE_SIZE) {
+        *zeroed = true;
+        return _malloc_large(sz);
+    }
+
+    malloc_header_t* chunk = _malloc_find_chunk(sz);
+    if (chunk) {
+        _malloc_bin_remove(chunk);
+    } else {
+        chunk = _malloc_alloc_region(sz);
+        if (!chunk) {
+            return NULL;
         }
+        *zeroed = true;
     }
 
-    return (void*)&((malloc_header_t*)first_fit)[1];
+    _malloc_split(chunk, sz);
+    block_set_flags(chunk, FLAG_ALLOCATED);
+    return (void*)&chunk[1];
 }
 
-void free(void* mem)
+/* Grows the chunk into the free chunk after it, if that one is long enough. */
+static bool _malloc_grow_locked(malloc_header_t* chunk, size_t sz)
 {
-    if (!mem) {
-        return;
+    if (block_has_flags(chunk, FLAG_LAST)) {
+        return false;
     }
 
-    malloc_header_t* mem_header = &((malloc_header_t*)mem)[-1];
+    malloc_header_t* next = _malloc_next_chunk(chunk);
+    if (!block_is_free(next) || chunk->size + sizeof(malloc_header_t) + next->size < sz) {
+        return false;
+    }
+
+    _malloc_bin_remove(next);
+    chunk->size += next->size + sizeof(malloc_header_t);
+    chunk->flags |= next->flags & FLAG_LAST;
+    _malloc_split(chunk, sz);
+    return true;
+}
 
+static void _free_locked(malloc_header_t* mem_header)
+{
     if (block_is_slab(mem_header)) {
         return slab_free(mem_header);
     }
 
-    block_rem_flags(mem_header, FLAG_ALLOCATED);
-    while (mem_header->prev && block_is_free(mem_header->prev)) {
-        mem_header = mem_header->prev;
+    if (block_has_flags(mem_header, FLAG_LARGE)) {
+        munmap(mem_header, mem_header->size + sizeof(malloc_header_t));
+        return;
     }
 
+    block_rem_flags(mem_header, FLAG_ALLOCATED);
+
     // Trying to glue the freed chunk with its neighbours.
-    while (mem_header->next && block_is_free(mem_header->next)) {
-        mem_header->size += mem_header->next->size + sizeof(malloc_header_t);
+    if (!block_has_flags(mem_header, FLAG_LAST)) {
+        malloc_header_t* next = _malloc_next_chunk(mem_header);
+        if (block_is_free(next)) {
+            _malloc_bin_remove(next);
+            mem_header->size += next->size + sizeof(malloc_header_t);
+            mem_header->flags |= next->flags & FLAG_LAST;
+        }
+    }
+
+    if (block_has_flags(mem_header, FLAG_PREV_FREE)) {
+        malloc_header_t* prev = _malloc_prev_chunk(mem_header);
+        _malloc_bin_remove(prev);
+        prev->size += mem_header->size + sizeof(malloc_header_t);
+        prev->flags |= mem_header->flags & FLAG_LAST;
+        mem_header = prev;
+    }
+
+    if (_malloc_is_whole_region(mem_header) && _malloc_trim_region(mem_header)) {
+        return;
+    }
+
+    _malloc_set_footer(mem_header);
+    if (!block_has_flags(mem_header, FLAG_LAST)) {
+        block_set_flags(_malloc_next_chunk(mem_header), FLAG_PREV_FREE);
+    }
+    _malloc_bin_insert(mem_header);
+}
 
-        if (mem_header->next->next) {
-            mem_header->next->next->prev = mem_header;
+void* malloc(size_t sz)
+{
+    if (!sz) {
+        return NULL;
+    }
+    sz = _malloc_round_up(sz, ALIGNMENT);
+
+    // Threads take small objects from their own caches without the lock.
+    if (malloc_threaded && sz <= SLAB_MAX_SIZE) {
+        void* res = tcache_alloc(sz);
+        if (res) {
+            return res;
         }
-        mem_header->next = mem_header->next->next;
     }
+
+    bool zeroed = false;
+    _malloc_lock();
+    void* res = _malloc_locked(sz, &zeroed);
+    _malloc_unlock();
+    return res;
 }
 
-void* calloc(size_t num, size_t size)
+void free(void* mem)
 {
-    void* mem = malloc(num * size);
     if (!mem) {
+        return;
+    }
+
+    malloc_header_t* mem_header = &((malloc_header_t*)mem)[-1];
+    if (malloc_threaded && block_is_slab(mem_header) && tcache_free(mem_header)) {
+        return;
+    }
+
+    _malloc_lock();
+    _free_locked(mem_header);
+    _malloc_unlock();
+}
+
+void* calloc(size_t num, size_t size)
+{
+    if (size && num > (size_t)-1 / size) {
+        return NULL;
+    }
+
+    size_t sz = _malloc_round_up(num * size, ALIGNMENT);
+    if (!sz) {
         return NULL;
     }
 
-    memset(mem, 0, num * size);
+    // Fresh mappings are zeroed by the kernel on demand, they are not touched.
+    void* mem;
+    bool zeroed = false;
+    if (sz <= SLAB_MAX_SIZE) {
+        mem = malloc(sz);
+    } else {
+        _malloc_lock();
+        mem = _malloc_locked(sz, &zeroed);
+        _malloc_unlock();
+    }
+
+    if (mem && !zeroed) {
+        memset(mem, 0, sz);
+    }
     return mem;
 }
 
@@ -146,11 +380,21 @@ void* realloc(void* ptr, size_t new_size)
         return malloc(new_size);
     }
 
-    size_t old_size = ((malloc_header_t*)ptr)[-1].size;
-    if (old_size == new_size) {
+    malloc_header_t* mem_header = &((malloc_header_t*)ptr)[-1];
+    size_t old_size = mem_header->size;
+    if (new_size <= old_size) {
         return ptr;
     }
 
+    if (!block_is_slab(mem_header) && !block_has_flags(mem_header, FLAG_LARGE)) {
+        _malloc_lock();
+        bool grown = _malloc_grow_locked(mem_header, _malloc_round_up(new_size, ALIGNMENT));
+        _malloc_unlock();
+        if (grown) {
+            return ptr;
+        }
+    }
+
     uint8_t* new_area = malloc(new_size);
     if (!new_area) {
         return NULL;
@@ -165,4 +409,4 @@ void* realloc(void* ptr, size_t new_size)
 void _malloc_init()
 {
     _slab_init();
-}
\ No newline at end of file
+}
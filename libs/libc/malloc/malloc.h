@@ -9,10 +9,25 @@
 __BEGIN_DECLS
 
 #define MALLOC_DEFAULT_BLOCK_SIZE 4096
-#define MALLOC_MAX_ALLOCATED_BLOCKS 64
+
+/* Chunks are cut from regions of this size, bigger allocations get their own mapping. */
+#define MALLOC_REGION_SIZE (128 * 1024)
+#define MALLOC_LARGE_SIZE (32 * 1024)
+
+/* Free regions kept mapped for reuse, their pages are given back to the kernel though. */
+#define MALLOC_SPARE_REGIONS 1
+
+/* Free chunks of up to 512 bytes are kept by exact size, longer ones in 4 bins per power of two. */
+#define MALLOC_SMALL_BINS 63
+#define MALLOC_BINS 96
 
 #define FLAG_ALLOCATED (0x1)
 #define FLAG_SLAB (0x2)
+#define FLAG_LARGE (0x4)
+#define FLAG_FIRST (0x8)
+#define FLAG_LAST (0x10)
+#define FLAG_PREV_FREE (0x20)
+/* A free chunk keeps its size in its last word too, so the chunk after it can find it. */
 struct __malloc_header {
     size_t size;
     uint32_t flags;
@@ -51,9 +66,28 @@ static inline bool block_is_slab(malloc_header_t* block)
     return block_has_flags(block, FLAG_SLAB);
 }
 
+/* Objects of the slab classes are kept in lists of their own, pages are carved as a list runs out. */
+#define SLAB_MAX_SIZE 512
+#define SLAB_CLASSES 12
+
+/* Objects kept by the caches of threads count as in use. */
+struct __slab_stats {
+    size_t size;
+    size_t pages;
+    size_t total;
+    size_t in_use;
+};
+typedef struct __slab_stats slab_stats_t;
+
 void _malloc_init();
 void _slab_init();
 
+/* Called by pthread_create before the first thread starts, from then on the heap is locked. */
+void _malloc_set_threaded();
+void _malloc_lock();
+void _malloc_unlock();
+void _malloc_thread_exit();
+
 void* malloc(size_t);
 void free(void*);
 void* calloc(size_t, size_t);
@@ -61,5 +95,12 @@ void* realloc(void*, size_t);
 
 void* slab_alloc(size_t);
 void slab_free(malloc_header_t* mem_header);
+int slab_class_of(size_t size);
+size_t slab_take(int class_id, size_t count, malloc_header_t** list);
+void slab_give(int class_id, malloc_header_t* list, size_t count);
+
+void* tcache_alloc(size_t size);
+bool tcache_free(malloc_header_t* mem_header);
+size_t slab_stats(slab_stats_t* stats, size_t count);
 
 __END_DECLS
\ No newline at end of file
@@ -3,77 +3,137 @@
 #include <string.h>
 #include <sys/mman.h>
 
-// Fast allocator for sizes 16, 32, 48, 64 bytes
+// Fast allocator for sizes up to 512 bytes, each class is half as long
+// again as the one before.
 
-malloc_header_t* free_blocks[5];
+static const size_t class_sizes[SLAB_CLASSES] = { 8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512 };
+static malloc_header_t* free_blocks[SLAB_CLASSES];
+static slab_stats_t class_stats[SLAB_CLASSES];
 
-void prepare_free_blocks(size_t size)
+// Class of every size which is a multiple of 8.
+static uint8_t class_of_size[SLAB_MAX_SIZE / 8 + 1];
+
+static inline int _slab_class(size_t size)
 {
-    int block_id = size >> 4;
-    const size_t alloc_size = MALLOC_DEFAULT_BLOCK_SIZE;
-    int ret = (int)mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
-    if (ret < 0) {
-        free_blocks[block_id] = NULL;
-        return;
-    }
+    return class_of_size[(size + 7) >> 3];
+}
 
-    void* raw_area = (void*)ret;
+// A page holds at least 16 objects, so the long classes get several.
+static bool _slab_refill(int class_id)
+{
+    const size_t size = class_sizes[class_id];
     const size_t sizeof_block_with_header = size + sizeof(malloc_header_t);
-    size_t passed = 0;
+    size_t alloc_size = MALLOC_DEFAULT_BLOCK_SIZE;
+    while (alloc_size < 16 * sizeof_block_with_header) {
+        alloc_size += MALLOC_DEFAULT_BLOCK_SIZE;
+    }
 
-    free_blocks[block_id] = (malloc_header_t*)raw_area;
-    malloc_header_t* prev_header = NULL;
+    int ret = (int)mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
+    if (ret < 0) {
+        return false;
+    }
 
-    while (passed + sizeof_block_with_header <= alloc_size) {
+    uint8_t* raw_area = (uint8_t*)ret;
+    size_t count = alloc_size / sizeof_block_with_header;
+    for (size_t i = 0; i < count; i++) {
         malloc_header_t* current = (malloc_header_t*)raw_area;
-
         current->flags = FLAG_SLAB | FLAG_ALLOCATED;
-        current->next = NULL;
-        current->prev = prev_header;
         current->size = size;
-
-        prev_header = current;
+        current->prev = NULL;
+        current->next = free_blocks[class_id];
+        free_blocks[class_id] = current;
         raw_area += sizeof_block_with_header;
-        passed += sizeof_block_with_header;
     }
 
-    malloc_header_t* next_header = NULL;
-    while (prev_header) {
-        prev_header->next = next_header;
-        prev_header = prev_header->prev;
-    }
+    class_stats[class_id].pages += alloc_size / MALLOC_DEFAULT_BLOCK_SIZE;
+    class_stats[class_id].total += count;
+    return true;
 }
 
 void _slab_init()
 {
-    prepare_free_blocks(16);
-    prepare_free_blocks(32);
-    prepare_free_blocks(48);
-    prepare_free_blocks(64);
+    int class_id = 0;
+    for (size_t i = 0; i <= SLAB_MAX_SIZE / 8; i++) {
+        while (class_sizes[class_id] < i * 8) {
+            class_id++;
+        }
+        class_of_size[i] = class_id;
+    }
+
+    for (int i = 0; i < SLAB_CLASSES; i++) {
+        class_stats[i].size = class_sizes[i];
+    }
 }
 
 void* slab_alloc(size_t size)
 {
-    if (size > 64) {
+    if (size > SLAB_MAX_SIZE) {
         return NULL;
     }
-    int block_id = ((size + 15) >> 4);
-    malloc_header_t* zone = free_blocks[block_id];
-    if (!zone) {
+
+    int class_id = _slab_class(size);
+    if (!free_blocks[class_id] && !_slab_refill(class_id)) {
         return NULL;
     }
 
-    free_blocks[block_id] = zone->next;
+    malloc_header_t* zone = free_blocks[class_id];
+    free_blocks[class_id] = zone->next;
+    class_stats[class_id].in_use++;
     return (void*)&((malloc_header_t*)zone)[1];
 }
 
 void slab_free(malloc_header_t* mem_header)
 {
-    malloc_header_t* next = free_blocks[((mem_header->size) >> 4)];
-    free_blocks[((mem_header->size) >> 4)] = mem_header;
-    mem_header->next = next;
-    mem_header->prev = NULL;
-    if (next) {
-        next->prev = mem_header;
+    int class_id = _slab_class(mem_header->size);
+    mem_header->next = free_blocks[class_id];
+    free_blocks[class_id] = mem_header;
+    class_stats[class_id].in_use--;
+}
+
+int slab_class_of(size_t size)
+{
+    return _slab_class(size);
+}
+
+// Moves up to count objects of the class to the front of list, returns
+// how many were moved.
+size_t slab_take(int class_id, size_t count, malloc_header_t** list)
+{
+    size_t taken = 0;
+    while (taken < count) {
+        if (!free_blocks[class_id] && !_slab_refill(class_id)) {
+            break;
+        }
+
+        malloc_header_t* zone = free_blocks[class_id];
+        free_blocks[class_id] = zone->next;
+        zone->next = *list;
+        *list = zone;
+        taken++;
+    }
+    class_stats[class_id].in_use += taken;
+    return taken;
+}
+
+// Puts count objects of the class, linked by next, back to its list.
+void slab_give(int class_id, malloc_header_t* list, size_t count)
+{
+    malloc_header_t* last = list;
+    while (last->next) {
+        last = last->next;
+    }
+    last->next = free_blocks[class_id];
+    free_blocks[class_id] = list;
+    class_stats[class_id].in_use -= count;
+}
+
+size_t slab_stats(slab_stats_t* stats, size_t count)
+{
+    _malloc_lock();
+    if (count > SLAB_CLASSES) {
+        count = SLAB_CLASSES;
     }
-}
\ No newline at end of file
+    memcpy(stats, class_stats, count * sizeof(slab_stats_t));
+    _malloc_unlock();
+    return count;
+}
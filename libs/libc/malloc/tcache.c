@@ -0,0 +1,110 @@
+#include "../pthread/thread.h"
+#include "malloc.h"
+#include <string.h>
+
+// Every thread keeps a few free objects of each slab class, so most of
+// its allocations don't take the heap lock. Objects go between a cache
+// and the slab in batches.
+
+#define TCACHE_MAX 32
+#define TCACHE_BATCH 16
+
+struct malloc_tcache {
+    malloc_header_t* lists[SLAB_CLASSES];
+    uint32_t counts[SLAB_CLASSES];
+};
+typedef struct malloc_tcache malloc_tcache_t;
+
+static malloc_tcache_t main_tcache;
+
+static malloc_tcache_t* _tcache_get()
+{
+    pthread_stack_t* stack = _pthread_self_stack();
+    if (!stack) {
+        return &main_tcache;
+    }
+
+    if (!stack->malloc_cache) {
+        _malloc_lock();
+        stack->malloc_cache = slab_alloc(sizeof(malloc_tcache_t));
+        _malloc_unlock();
+        if (stack->malloc_cache) {
+            memset(stack->malloc_cache, 0, sizeof(malloc_tcache_t));
+        }
+    }
+    return (malloc_tcache_t*)stack->malloc_cache;
+}
+
+void* tcache_alloc(size_t size)
+{
+    malloc_tcache_t* tcache = _tcache_get();
+    if (!tcache) {
+        return NULL;
+    }
+
+    int class_id = slab_class_of(size);
+    if (!tcache->lists[class_id]) {
+        _malloc_lock();
+        tcache->counts[class_id] += slab_take(class_id, TCACHE_BATCH, &tcache->lists[class_id]);
+        _malloc_unlock();
+        if (!tcache->lists[class_id]) {
+            return NULL;
+        }
+    }
+
+    malloc_header_t* zone = tcache->lists[class_id];
+    tcache->lists[class_id] = zone->next;
+    tcache->counts[class_id]--;
+    return (void*)&zone[1];
+}
+
+bool tcache_free(malloc_header_t* mem_header)
+{
+    malloc_tcache_t* tcache = _tcache_get();
+    if (!tcache) {
+        return false;
+    }
+
+    int class_id = slab_class_of(mem_header->size);
+    mem_header->next = tcache->lists[class_id];
+    tcache->lists[class_id] = mem_header;
+    if (++tcache->counts[class_id] <= TCACHE_MAX) {
+        return true;
+    }
+
+    // The objects freed last are kept, the batch after them goes back.
+    malloc_header_t* keep_last = tcache->lists[class_id];
+    for (int i = 1; i < TCACHE_MAX - TCACHE_BATCH; i++) {
+        keep_last = keep_last->next;
+    }
+    malloc_header_t* batch = keep_last->next;
+    keep_last->next = NULL;
+    size_t count = tcache->counts[class_id] - (TCACHE_MAX - TCACHE_BATCH);
+    tcache->counts[class_id] = TCACHE_MAX - TCACHE_BATCH;
+
+    _malloc_lock();
+    slab_give(class_id, batch, count);
+    _malloc_unlock();
+    return true;
+}
+
+// Gives the objects of an exiting thread back to the slab.
+void _malloc_thread_exit()
+{
+    pthread_stack_t* stack = _pthread_self_stack();
+    if (!stack || !stack->malloc_cache) {
+        return;
+    }
+
+    malloc_tcache_t* tcache = (malloc_tcache_t*)stack->malloc_cache;
+    stack->malloc_cache = NULL;
+
+    _malloc_lock();
+    for (int i = 0; i < SLAB_CLASSES; i++) {
+        if (tcache->lists[i]) {
+            slab_give(i, tcache->lists[i], tcache->counts[i]);
+        }
+    }
+    slab_free(&((malloc_header_t*)tcache)[-1]);
+    _malloc_unlock();
+}
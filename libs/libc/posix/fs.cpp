@@ -1,7 +1,9 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/select.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <sysdep.h>
 #include <unistd.h>
 
@@ -23,6 +25,12 @@ int close(int fd)
     RETURN_WITH_ERRNO(res, 0, -1);
 }
 
+int dup2(int oldfd, int newfd)
+{
+    int res = DO_SYSCALL_2(SYS_DUP2, oldfd, newfd);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
+
 ssize_t read(int fd, char* buf, size_t count)
 {
     return (ssize_t)DO_SYSCALL_3(SYS_READ, fd, buf, count);
@@ -33,11 +41,40 @@ ssize_t write(int fd, const void* buf, size_t count)
     return (ssize_t)DO_SYSCALL_3(SYS_WRITE, fd, buf, count);
 }
 
+ssize_t writev(int fd, const iovec_t* iov, int iovcnt)
+{
+    int res = DO_SYSCALL_3(SYS_WRITEV, fd, iov, iovcnt);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
+
 off_t lseek(int fd, off_t off, int whence)
 {
     return (off_t)DO_SYSCALL_3(SYS_LSEEK, fd, off, whence);
 }
 
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count)
+{
+    int res = DO_SYSCALL_4(SYS_SENDFILE, out_fd, in_fd, offset, count);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
+
+ssize_t copy_file_range(int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t len)
+{
+    int res = DO_SYSCALL_5(SYS_COPY_FILE_RANGE, fd_in, off_in, fd_out, off_out, len);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
+
+int fsync(int fd)
+{
+    int res = DO_SYSCALL_1(SYS_FSYNC, fd);
+    RETURN_WITH_ERRNO(res, 0, -1);
+}
+
+void sync()
+{
+    DO_SYSCALL_0(SYS_SYNC);
+}
+
 int mkdir(const char* path)
 {
     int res = DO_SYSCALL_1(SYS_MKDIR, path);
@@ -90,4 +127,16 @@ int munmap(void* addr, size_t length)
 {
     int res = DO_SYSCALL_2(SYS_MUNMAP, addr, length);
     RETURN_WITH_ERRNO(res, 0, -1);
+}
+
+int madvise(void* addr, size_t length, int advice)
+{
+    int res = DO_SYSCALL_3(SYS_MADVISE, addr, length, advice);
+    RETURN_WITH_ERRNO(res, 0, -1);
+}
+
+int msync(void* addr, size_t length, int flags)
+{
+    int res = DO_SYSCALL_3(SYS_MSYNC, addr, length, flags);
+    RETURN_WITH_ERRNO(res, 0, -1);
 }
\ No newline at end of file
@@ -1,12 +1,42 @@
 #include <signal.h>
 #include <sysdep.h>
 
+static void* _signal_handlers[32];
+static uint32_t _signal_interrupts;
+
+static inline int _signal_flags(int signo)
+{
+    return (_signal_interrupts & (1u << signo)) ? 0 : SA_RESTART;
+}
+
 int sigaction(int signo, void* callback)
 {
-    int res = DO_SYSCALL_2(SYS_SIGACTION, signo, callback);
+    int res = DO_SYSCALL_3(SYS_SIGACTION, signo, callback, _signal_flags(signo));
+    if (res >= 0) {
+        _signal_handlers[signo] = callback;
+    }
     RETURN_WITH_ERRNO(res, 0, -1);
 }
 
+/**
+ * With a non-zero flag the handler of sig makes an interrupted blocking
+ * call fail with EINTR, otherwise the call goes on after the handler.
+ */
+int siginterrupt(int sig, int flag)
+{
+    if (sig <= 0 || sig >= 32) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (flag) {
+        _signal_interrupts |= (1u << sig);
+    } else {
+        _signal_interrupts &= ~(1u << sig);
+    }
+    return sigaction(sig, _signal_handlers[sig]);
+}
+
 int raise(int signo)
 {
     int res = DO_SYSCALL_1(SYS_RAISE, signo);
@@ -1,3 +1,4 @@
+#include <spawn.h>
 #include <sysdep.h>
 #include <unistd.h>
 
@@ -13,6 +14,22 @@ int execve(const char* path, char** argv, char** env)
     RETURN_WITH_ERRNO(res, -1, -1);
 }
 
+int posix_spawn(pid_t* pid, const char* path, const posix_spawn_file_actions_t* file_actions, const posix_spawnattr_t* attrp, char** argv, char** envp)
+{
+    if (file_actions || attrp) {
+        return EINVAL;
+    }
+
+    int res = DO_SYSCALL_3(SYS_SPAWN, (int)path, (int)argv, (int)envp);
+    if (res < 0) {
+        return -res;
+    }
+    if (pid) {
+        *pid = res;
+    }
+    return 0;
+}
+
 int wait(int pid)
 {
     int res = DO_SYSCALL_1(SYS_WAITPID, pid);
@@ -1,10 +1,23 @@
+#include <errno.h>
 #include <sys/time.h>
 #include <sysdep.h>
+#include <time.h>
 
 int gettimeofday(timeval_t* tv, timezone_t* tz)
 {
-    int res = DO_SYSCALL_2(SYS_GET_TIME_OF_DAY, tv, tz);
-    RETURN_WITH_ERRNO(res, res, -1);
+    if (!tv || !tz) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // The time page is read by clock_gettime, so no syscall is needed.
+    timespec_t ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
+    tz->tz_dsttime = DST_NONE;
+    tz->tz_minuteswest = 0;
+    return 0;
 }
 
 int settimeofday(const timeval_t* tv, const timezone_t* tz)
@@ -0,0 +1,43 @@
+#include "futex.h"
+#include <pthread.h>
+
+#define COND_WAKE_ALL (0x7fffffff)
+
+int pthread_cond_init(pthread_cond_t* cond, const pthread_condattr_t* attr)
+{
+    cond->seq = 0;
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t* cond)
+{
+    return 0;
+}
+
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    /* A signal which comes after unlock changes seq, so futex_wait returns at once. */
+    uint32_t seq = __atomic_load_n(&cond->seq, __ATOMIC_ACQUIRE);
+    pthread_mutex_unlock(mutex);
+    futex_wait(&cond->seq, seq);
+
+    /* Other threads could be woken with us, so the mutex is taken as contended. */
+    while (__atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE) != 0) {
+        futex_wait(&mutex->state, 2);
+    }
+    return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t* cond)
+{
+    __atomic_add_fetch(&cond->seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&cond->seq, 1);
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t* cond)
+{
+    __atomic_add_fetch(&cond->seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&cond->seq, COND_WAKE_ALL);
+    return 0;
+}
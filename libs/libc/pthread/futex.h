@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <bits/thread.h>
+#include <sysdep.h>
+
+/**
+ * Blocks in the kernel while *addr equals val, returns at once otherwise.
+ */
+static inline int futex_wait(uint32_t* addr, uint32_t val)
+{
+    return DO_SYSCALL_3(SYS_FUTEX, addr, FUTEX_WAIT, val);
+}
+
+/**
+ * Wakes up to count threads waiting on addr.
+ */
+static inline int futex_wake(uint32_t* addr, int count)
+{
+    return DO_SYSCALL_3(SYS_FUTEX, addr, FUTEX_WAKE, count);
+}
@@ -0,0 +1,54 @@
+#include "futex.h"
+#include <errno.h>
+#include <pthread.h>
+
+#define MUTEX_SPIN_COUNT 32
+
+static inline bool _mutex_try_take(pthread_mutex_t* mutex)
+{
+    uint32_t expected = 0;
+    return __atomic_compare_exchange_n(&mutex->state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr)
+{
+    mutex->state = 0;
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t* mutex)
+{
+    return 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    /* The owner may leave soon, so a short spin is cheaper than a syscall. */
+    for (int i = 0; i < MUTEX_SPIN_COUNT; i++) {
+        if (_mutex_try_take(mutex)) {
+            return 0;
+        }
+    }
+
+    /* Marking as contended, so unlock knows it has to wake someone. */
+    while (__atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE) != 0) {
+        futex_wait(&mutex->state, 2);
+    }
+    return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t* mutex)
+{
+    if (_mutex_try_take(mutex)) {
+        return 0;
+    }
+    return EBUSY;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* mutex)
+{
+    if (__atomic_exchange_n(&mutex->state, 0, __ATOMIC_RELEASE) == 2) {
+        futex_wake(&mutex->state, 1);
+    }
+    return 0;
+}
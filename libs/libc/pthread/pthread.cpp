@@ -1,14 +1,195 @@
+#include "../malloc/malloc.h"
+#include "thread.h"
+#include <errno.h>
 #include <pthread.h>
 #include <sys/mman.h>
 #include <sysdep.h>
 
-int pthread_create(void* func)
+#define PTHREAD_PAGE_SIZE (4096)
+
+int __pthread_threaded = 0;
+
+static pthread_stack_t* _pthread_stacks = nullptr;
+static pthread_mutex_t _pthread_stacks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline size_t _pthread_align_up(size_t val, size_t align)
+{
+    return (val + align - 1) & ~(align - 1);
+}
+
+static inline tls_template_t* _pthread_tls_template()
+{
+    thread_tcb_t* tcb = _pthread_tcb();
+    return tcb ? tcb->tls_template : nullptr;
+}
+
+static size_t _pthread_tls_size(tls_template_t* tls_template)
+{
+    size_t align = tls_template ? tls_template->align : sizeof(void*);
+    size_t memsz = tls_template ? tls_template->memsz : 0;
+#ifdef __i386__
+    return _pthread_align_up(memsz, align) + sizeof(thread_tcb_t);
+#elif __arm__
+    return _pthread_align_up(sizeof(thread_tcb_t), align) + memsz;
+#endif
+}
+
+/**
+ * Builds the TLS block of a new thread at @block, returns its thread pointer.
+ */
+static uint32_t _pthread_setup_tls(tls_template_t* tls_template, uint8_t* block, pthread_stack_t* stack)
+{
+    size_t align = tls_template ? tls_template->align : sizeof(void*);
+    size_t memsz = tls_template ? tls_template->memsz : 0;
+#ifdef __i386__
+    uint8_t* data = block;
+    thread_tcb_t* tcb = (thread_tcb_t*)(block + _pthread_align_up(memsz, align));
+    tcb->self = tcb;
+#elif __arm__
+    thread_tcb_t* tcb = (thread_tcb_t*)block;
+    uint8_t* data = block + _pthread_align_up(sizeof(thread_tcb_t), align);
+#endif
+    tcb->tls_template = tls_template;
+    tcb->thread = stack;
+
+    if (tls_template) {
+        uint8_t* image = (uint8_t*)tls_template->image;
+        for (size_t i = 0; i < memsz; i++) {
+            data[i] = i < tls_template->filesz ? image[i] : 0;
+        }
+    }
+    return (uint32_t)tcb;
+}
+
+static pthread_stack_t* _pthread_alloc_stack(size_t size, size_t guard_size, size_t tls_size)
+{
+    size_t map_size = _pthread_align_up(size + tls_size + sizeof(pthread_stack_t), PTHREAD_PAGE_SIZE);
+    int start = (int)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_STACK | MAP_PRIVATE, 0, 0);
+    if (start < 0) {
+        return nullptr;
+    }
+
+    /* The guard is best effort, the space below could be taken already. */
+    if (guard_size) {
+        int guard = (int)mmap((void*)(start - guard_size), guard_size, PROT_NONE, MAP_FIXED | MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
+        if (guard < 0) {
+            guard_size = 0;
+        }
+    }
+
+    pthread_stack_t* stack = (pthread_stack_t*)(start + map_size - sizeof(pthread_stack_t));
+    stack->start = start;
+    stack->size = size;
+    stack->guard_size = guard_size;
+    return stack;
+}
+
+static pthread_stack_t* _pthread_get_stack(size_t size, size_t guard_size, size_t tls_size)
+{
+    pthread_mutex_lock(&_pthread_stacks_lock);
+    for (pthread_stack_t* stack = _pthread_stacks; stack; stack = stack->next) {
+        if (stack->size == size && stack->guard_size == guard_size && !__atomic_load_n(&stack->busy, __ATOMIC_ACQUIRE)) {
+            stack->busy = 1;
+            pthread_mutex_unlock(&_pthread_stacks_lock);
+            return stack;
+        }
+    }
+
+    pthread_stack_t* stack = _pthread_alloc_stack(size, guard_size, tls_size);
+    if (stack) {
+        stack->busy = 1;
+        stack->next = _pthread_stacks;
+        _pthread_stacks = stack;
+    }
+    pthread_mutex_unlock(&_pthread_stacks_lock);
+    return stack;
+}
+
+static void _pthread_entry()
 {
-    uint32_t start = (uint32_t)mmap(NULL, 4096, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_STACK | MAP_PRIVATE, 0, 0);
+    pthread_stack_t* stack = (pthread_stack_t*)_pthread_tcb()->thread;
+    pthread_exit(stack->start_routine(stack->arg));
+}
+
+int pthread_attr_init(pthread_attr_t* attr)
+{
+    attr->stack_size = PTHREAD_STACK_DEFAULT;
+    attr->guard_size = PTHREAD_GUARD_DEFAULT;
+    return 0;
+}
+
+int pthread_attr_destroy(pthread_attr_t* attr)
+{
+    return 0;
+}
+
+int pthread_attr_setstacksize(pthread_attr_t* attr, size_t stack_size)
+{
+    if (stack_size < PTHREAD_STACK_MIN) {
+        return EINVAL;
+    }
+    attr->stack_size = stack_size;
+    return 0;
+}
+
+int pthread_attr_getstacksize(const pthread_attr_t* attr, size_t* stack_size)
+{
+    *stack_size = attr->stack_size;
+    return 0;
+}
+
+int pthread_attr_setguardsize(pthread_attr_t* attr, size_t guard_size)
+{
+    attr->guard_size = guard_size;
+    return 0;
+}
+
+int pthread_attr_getguardsize(const pthread_attr_t* attr, size_t* guard_size)
+{
+    *guard_size = attr->guard_size;
+    return 0;
+}
+
+int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*start_routine)(void*), void* arg)
+{
+    size_t stack_size = attr ? attr->stack_size : PTHREAD_STACK_DEFAULT;
+    size_t guard_size = attr ? attr->guard_size : PTHREAD_GUARD_DEFAULT;
+    stack_size = _pthread_align_up(stack_size, PTHREAD_PAGE_SIZE);
+    guard_size = _pthread_align_up(guard_size, PTHREAD_PAGE_SIZE);
+
+    tls_template_t* tls_template = _pthread_tls_template();
+    pthread_stack_t* stack = _pthread_get_stack(stack_size, guard_size, _pthread_tls_size(tls_template));
+    if (!stack) {
+        return EAGAIN;
+    }
+    stack->start_routine = start_routine;
+    stack->arg = arg;
+    stack->malloc_cache = nullptr;
+    _malloc_set_threaded();
+    __atomic_store_n(&__pthread_threaded, 1, __ATOMIC_RELEASE);
+
     thread_create_params_t params;
-    params.stack_start = start;
-    params.stack_size = 4096;
-    params.entry_point = (uint32_t)func;
+    params.entry_point = (uint32_t)_pthread_entry;
+    params.stack_start = stack->start;
+    params.stack_size = stack_size;
+    params.tls = _pthread_setup_tls(tls_template, (uint8_t*)(stack->start + stack_size), stack);
     int res = DO_SYSCALL_1(SYS_PTHREADCREATE, &params);
-    RETURN_WITH_ERRNO(res, 0, res);
-}
\ No newline at end of file
+    if (res < 0) {
+        __atomic_store_n(&stack->busy, 0, __ATOMIC_RELEASE);
+        return -res;
+    }
+
+    if (thread) {
+        *thread = res;
+    }
+    return 0;
+}
+
+void pthread_exit(void* retval)
+{
+    _malloc_thread_exit();
+    pthread_stack_t* stack = _pthread_self_stack();
+    uint32_t* busy = stack ? &stack->busy : nullptr;
+    DO_SYSCALL_1(SYS_PTHREADEXIT, busy);
+    for (;;) { }
+}
@@ -0,0 +1,65 @@
+#include "futex.h"
+#include <errno.h>
+#include <semaphore.h>
+
+static inline bool _sem_try_take(sem_t* sem)
+{
+    uint32_t value = __atomic_load_n(&sem->value, __ATOMIC_RELAXED);
+    while (value > 0) {
+        if (__atomic_compare_exchange_n(&sem->value, &value, value - 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int sem_init(sem_t* sem, int pshared, unsigned int value)
+{
+    if (pshared) {
+        /* Futexes are keyed by the address space of a process. */
+        set_errno(ENOSYS);
+        return -1;
+    }
+    sem->value = value;
+    sem->waiters = 0;
+    return 0;
+}
+
+int sem_destroy(sem_t* sem)
+{
+    return 0;
+}
+
+int sem_wait(sem_t* sem)
+{
+    while (!_sem_try_take(sem)) {
+        __atomic_add_fetch(&sem->waiters, 1, __ATOMIC_ACQ_REL);
+        futex_wait(&sem->value, 0);
+        __atomic_sub_fetch(&sem->waiters, 1, __ATOMIC_ACQ_REL);
+    }
+    return 0;
+}
+
+int sem_trywait(sem_t* sem)
+{
+    if (_sem_try_take(sem)) {
+        return 0;
+    }
+    set_errno(EAGAIN);
+    return -1;
+}
+
+int sem_post(sem_t* sem)
+{
+    __atomic_add_fetch(&sem->value, 1, __ATOMIC_RELEASE);
+    if (__atomic_load_n(&sem->waiters, __ATOMIC_ACQUIRE)) {
+        futex_wake(&sem->value, 1);
+    }
+    return 0;
+}
+
+int sem_getvalue(sem_t* sem, int* sval)
+{
+    *sval = (int)__atomic_load_n(&sem->value, __ATOMIC_RELAXED);
+    return 0;
+}
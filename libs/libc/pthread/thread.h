@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <bits/thread.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Every thread stack is one mapping, from the lowest address:
+ * the stack itself, the TLS block with the thread control block and the
+ * descriptor of the stack. The guard is a PROT_NONE mapping right below.
+ * Stacks are never unmapped, once a thread exits the kernel clears
+ * busy and the stack is reused by the next pthread_create.
+ */
+struct pthread_stack {
+    uint32_t busy;
+    uint32_t start;
+    size_t size;
+    size_t guard_size;
+    void* (*start_routine)(void*);
+    void* arg;
+    void* malloc_cache; /* Objects malloc keeps for the thread, see tcache.c. */
+    struct pthread_stack* next;
+};
+typedef struct pthread_stack pthread_stack_t;
+
+static inline thread_tcb_t* _pthread_tcb()
+{
+    thread_tcb_t* tcb;
+#ifdef __i386__
+    asm volatile("movl %%gs:0, %0"
+                 : "=r"(tcb));
+#elif __arm__
+    asm volatile("mrc p15, 0, %0, c13, c0, 3"
+                 : "=r"(tcb));
+#endif
+    return tcb;
+}
+
+/**
+ * Returns the stack descriptor of the running thread, the main thread has
+ * none.
+ */
+static inline pthread_stack_t* _pthread_self_stack()
+{
+    thread_tcb_t* tcb = _pthread_tcb();
+    return tcb ? (pthread_stack_t*)tcb->thread : 0;
+}
@@ -17,4 +17,10 @@ int connect(int sockfd, const char* name, int len)
 {
     int res = DO_SYSCALL_3(SYS_CONNECT, sockfd, name, len);
     RETURN_WITH_ERRNO(res, 0, -1);
+}
+
+int accept(int sockfd)
+{
+    int res = DO_SYSCALL_1(SYS_ACCEPT, sockfd);
+    RETURN_WITH_ERRNO(res, res, -1);
 }
\ No newline at end of file
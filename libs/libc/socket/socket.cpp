@@ -35,6 +35,13 @@ int connect(int sockfd, const char* name, int len)
     RETURN_WITH_ERRNO(res, 0, -1);
 }
 
+/* take a connection of the bound socket */
+int accept(int sockfd)
+{
+    int res = DO_SYSCALL_1(SYS_ACCEPT, sockfd);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
+
 /* recive response */
 int response(int sockfd, const char* name, int len)
 {
@@ -9,6 +9,6 @@ __BEGIN_DECLS
 
 typedef int (*_lookupch_callback)(void* callback_params);
 typedef int (*_getch_callback)(void* callback_params);
-typedef int (*_putch_callback)(char ch, char* buf_base, size_t* written, void* callback_params);
+typedef int (*_write_callback)(const char* data, size_t len, char* buf_base, size_t* written, void* callback_params);
 
 __END_DECLS
\ No newline at end of file
@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #define _IO_MAGIC 0xFBAD0000 
@@ -69,6 +70,7 @@ static inline int _free_buf(FILE* stream);
 static size_t _do_system_write(const void* ptr, size_t size, FILE* stream);
 static int _resize_buf(FILE* stream, size_t size);
 static ssize_t _flush_wbuf(FILE* stream);
+static size_t _flush_wbuf_with(FILE* stream, const void* ptr, size_t size);
 static void _split_rwbuf(FILE* stream);
 static int _resize_buf(FILE* stream, size_t size);
 
@@ -457,6 +459,9 @@ static ssize_t _flush_wbuf(FILE* stream)
     size_t write_size, written;
 
     write_size = stream->_bf.wbuf.size - stream->_w;
+    if (!write_size)
+        return 0;
+
     written = _do_system_write(stream->_bf.wbuf.base, write_size, stream);
 
     if (written != write_size)
@@ -464,7 +469,38 @@ static ssize_t _flush_wbuf(FILE* stream)
 
     stream->_w = stream->_bf.wbuf.size;
     stream->_bf.wbuf.ptr = stream->_bf.wbuf.base;
-    return (ssize_t)write;
+    return (ssize_t)written;
+}
+
+/* Writes the pending data and then ptr with a single writev, so data which
+   does not fit the buffer is neither copied nor split into two writes.
+   Returns how much of ptr was written. */
+static size_t _flush_wbuf_with(FILE* stream, const void* ptr, size_t size)
+{
+    iovec_t iov[2];
+    iov[0].iov_base = stream->_bf.wbuf.base;
+    iov[0].iov_len = stream->_bf.wbuf.size - stream->_w;
+    iov[1].iov_base = (void*)ptr;
+    iov[1].iov_len = size;
+
+    while (iov[0].iov_len + iov[1].iov_len) {
+        ssize_t res = writev(stream->_file, iov, 2);
+        if (res <= 0) {
+            stream->_flags |= _IO_ERR_SEEN;
+            break;
+        }
+
+        size_t done = min((size_t)res, iov[0].iov_len);
+        iov[0].iov_base += done;
+        iov[0].iov_len -= done;
+        res -= done;
+        iov[1].iov_base += res;
+        iov[1].iov_len -= res;
+    }
+
+    stream->_w = stream->_bf.wbuf.size;
+    stream->_bf.wbuf.ptr = stream->_bf.wbuf.base;
+    return size - iov[1].iov_len;
 }
 
 static int _init_stream(FILE* file)
@@ -484,6 +520,12 @@ static int _init_file_with_fd(FILE* file, int fd)
     _init_stream(file);
     _resize_buf(file, BUFSIZ);
     file->_file = fd;
+
+    /* Files and pipes are fully buffered, only a tty shows lines as they
+       are written. */
+    if (isatty(fd))
+        file->_flags |= _IO_LINE_BUF;
+
     return 0;
 }
 
@@ -590,26 +632,29 @@ static size_t _fread_internal(char* ptr, size_t size, FILE* stream)
     return total_size;
 }
 
-static size_t _fwrite_internal(const void* ptr, size_t size, FILE* stream)
+static inline int _has_newline(const char* ptr, size_t size)
 {
-    size_t total_size;
+    for (size_t i = 0; i < size; i++) {
+        if (ptr[i] == '\n')
+            return 1;
+    }
+    return 0;
+}
 
+static size_t _fwrite_internal(const void* ptr, size_t size, FILE* stream)
+{
     if (!_can_use_buffer(stream))
         return _do_system_write(ptr, size, stream);
 
-    total_size = 0;
-    while (size > 0) {
-        size_t write_size = min(stream->_w, size);
-        memcpy(stream->_bf.wbuf.ptr, ptr, write_size);
-        ptr += write_size;
-        size -= write_size;
-        stream->_bf.wbuf.ptr += write_size;
-        stream->_w -= write_size;
-        total_size += write_size;
-
-        if (!stream->_w)
-            _flush_wbuf(stream);
-    }
+    if (size > stream->_w)
+        return _flush_wbuf_with(stream, ptr, size);
 
-    return total_size;
+    memcpy(stream->_bf.wbuf.ptr, ptr, size);
+    stream->_bf.wbuf.ptr += size;
+    stream->_w -= size;
+
+    if (!stream->_w || ((stream->_flags & _IO_LINE_BUF) && _has_newline(ptr, size)))
+        _flush_wbuf(stream);
+
+    return size;
 }
\ No newline at end of file
@@ -3,62 +3,124 @@
  *
  * SPDX-License-Identifier: BSD-2-Clause
  */
+#include <stdint.h>
 #include <string.h>
 
+/* Strings are scanned a word at a time. An aligned word never crosses a page,
+   so reading a whole word past the terminator can not fault. A word has a
+   zero byte if subtracting one from every byte borrows into a high bit which
+   was clear before. */
+typedef size_t __attribute__((__may_alias__)) word_t;
+#define WORD_MASK (sizeof(word_t) - 1)
+#define WORD_ONES ((word_t)0x01010101)
+#define WORD_HIGHS ((word_t)0x80808080)
+#define word_has_zero(w) (((w)-WORD_ONES) & ~(w)&WORD_HIGHS)
+
 #ifdef __i386__
 void* memset(void* dest, int fill, size_t nbytes)
 {
-    for (int i = 0; i < nbytes; ++i)
-        ((uint8_t*)dest)[i] = fill;
+    void* res = dest;
+    uint32_t pattern = (uint8_t)fill * 0x01010101;
+    size_t head = -(uintptr_t)dest & 3;
+    if (head > nbytes)
+        head = nbytes;
 
-    return dest;
+    size_t words = (nbytes - head) >> 2;
+    size_t tail = (nbytes - head) & 3;
+    asm volatile("rep stosb"
+                 : "+D"(dest), "+c"(head)
+                 : "a"(pattern)
+                 : "memory");
+    asm volatile("rep stosl"
+                 : "+D"(dest), "+c"(words)
+                 : "a"(pattern)
+                 : "memory");
+    asm volatile("rep stosb"
+                 : "+D"(dest), "+c"(tail)
+                 : "a"(pattern)
+                 : "memory");
+    return res;
 }
-#endif //__i386__
 
-void* memmove(void* dest, const void* src, size_t nbytes)
+/* The destination gets aligned first, then the bulk goes with rep movsl
+   which is fast on every x86 since the P6. The aarch32 version lives in
+   routines/aarch32/memcpy.S. */
+void* memcpy(void* __restrict dest, const void* __restrict src, size_t nbytes)
 {
-    if (src > dest) {
-        memcpy(dest, src, nbytes);
-        return dest;
-    }
+    void* res = dest;
+    size_t head = -(uintptr_t)dest & 3;
+    if (head > nbytes)
+        head = nbytes;
 
-    for (int i = nbytes - 1; i >= 0; --i)
-        ((uint8_t*)dest)[i] = ((uint8_t*)src)[i];
-
-    return dest;
+    size_t words = (nbytes - head) >> 2;
+    size_t tail = (nbytes - head) & 3;
+    asm volatile("rep movsb"
+                 : "+D"(dest), "+S"(src), "+c"(head)
+                 :
+                 : "memory");
+    asm volatile("rep movsl"
+                 : "+D"(dest), "+S"(src), "+c"(words)
+                 :
+                 : "memory");
+    asm volatile("rep movsb"
+                 : "+D"(dest), "+S"(src), "+c"(tail)
+                 :
+                 : "memory");
+    return res;
 }
+#endif //__i386__
 
-/* This optimized version of memcpy uses 32 bit chunks to copy over data on
-   the 32 bit architecture this library is built for. If this function gets
-   used on a 64 bit arch, be sure to use 8 byte chunks so each chunk fits
-   in a single register. The important part is this should be compiled with
-   atleast -O1 or -Os, because -O0 just makes this function too big for what
-   it does.
-
-   GCC does a better job at optimizing this if the pointers are restricted,
-   making the copying part have less instructions. Clang on the other hand
-   does not really change anything if the pointers are restricted or not. */
-void* memcpy(void* __restrict dest, const void* __restrict src, size_t nbytes)
+/* Overlapping regions with dest above src are copied backward, words are
+   stored at aligned addresses of dest. If src is not aligned the same way,
+   each word is merged from two aligned words of src (little endian), so
+   shifting a buffer by a byte does not fall back to a byte loop. Every load
+   of a word is done before the stores which may overlap it. */
+void* memmove(void* dest, const void* src, size_t nbytes)
 {
-    size_t chunks, rest, i;
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+    if (d <= s || d >= s + nbytes)
+        return memcpy(dest, src, nbytes);
 
-    rest = nbytes % 4;
-    chunks = (nbytes - rest) >> 2;
+    d += nbytes;
+    s += nbytes;
+    for (; ((uintptr_t)d & WORD_MASK) && nbytes; nbytes--)
+        *--d = *--s;
 
-    if (!chunks)
-        goto skip_chunks;
-
-    for (i = 0; i < chunks; i++)
-        ((uint32_t*)dest)[i] = ((uint32_t*)src)[i];
-
-skip_chunks:
-
-    /* Multiplying chunks by 4 will give us the offset of the 'rest' bytes,
-       which were not copied over along with the 4 byte chunks. */
-    chunks <<= 2;
+    size_t shift = ((uintptr_t)s & WORD_MASK) * 8;
+    if (!shift) {
+        for (; nbytes >= 4 * sizeof(word_t); nbytes -= 4 * sizeof(word_t)) {
+            d -= 4 * sizeof(word_t);
+            s -= 4 * sizeof(word_t);
+            word_t w0 = ((const word_t*)s)[0];
+            word_t w1 = ((const word_t*)s)[1];
+            word_t w2 = ((const word_t*)s)[2];
+            word_t w3 = ((const word_t*)s)[3];
+            ((word_t*)d)[3] = w3;
+            ((word_t*)d)[2] = w2;
+            ((word_t*)d)[1] = w1;
+            ((word_t*)d)[0] = w0;
+        }
+        for (; nbytes >= sizeof(word_t); nbytes -= sizeof(word_t)) {
+            d -= sizeof(word_t);
+            s -= sizeof(word_t);
+            *(word_t*)d = *(const word_t*)s;
+        }
+    } else if (nbytes >= sizeof(word_t)) {
+        /* The aligned words can not fault, they share a page with src bytes. */
+        const word_t* sw = (const word_t*)(s - shift / 8);
+        word_t hi = *sw;
+        for (; nbytes >= sizeof(word_t); nbytes -= sizeof(word_t)) {
+            word_t lo = *--sw;
+            d -= sizeof(word_t);
+            *(word_t*)d = (lo >> shift) | (hi << (8 * sizeof(word_t) - shift));
+            hi = lo;
+        }
+        s = (const uint8_t*)sw + shift / 8;
+    }
 
-    for (i = 0; i < rest; i++)
-        ((uint8_t*)dest)[chunks + i] = ((uint8_t*)src)[chunks + i];
+    while (nbytes--)
+        *--d = *--s;
 
     return dest;
 }
@@ -79,7 +141,17 @@ int memcmp(const void* src1, const void* src2, size_t nbytes)
     const uint8_t* first = src1;
     const uint8_t* second = src2;
 
-    for (int i = 0; i < nbytes; i++) {
+    /* Skip the equal words, the bytes of the first differing one are
+       compared below. */
+    if ((((uintptr_t)first | (uintptr_t)second) & WORD_MASK) == 0) {
+        while (nbytes >= sizeof(word_t) && *(const word_t*)first == *(const word_t*)second) {
+            first += sizeof(word_t);
+            second += sizeof(word_t);
+            nbytes -= sizeof(word_t);
+        }
+    }
+
+    for (size_t i = 0; i < nbytes; i++) {
         /* Return the difference if the byte does not match. */
         if (first[i] != second[i])
             return (int)first[i] - (int)second[i];
@@ -90,15 +162,33 @@ int memcmp(const void* src1, const void* src2, size_t nbytes)
 
 int strcmp(const char* a, const char* b)
 {
-    while (*a == *b && *a != '\0' && *b != '\0') {
+    /* Whole words can be compared only if both strings get aligned at once. */
+    if ((((uintptr_t)a ^ (uintptr_t)b) & WORD_MASK) == 0) {
+        for (; (uintptr_t)a & WORD_MASK; a++, b++) {
+            if (*a != *b || *a == '\0')
+                goto bytes;
+        }
+
+        const word_t* wa = (const word_t*)a;
+        const word_t* wb = (const word_t*)b;
+        while (*wa == *wb && !word_has_zero(*wa)) {
+            wa++;
+            wb++;
+        }
+        a = (const char*)wa;
+        b = (const char*)wb;
+    }
+
+    while (*a == *b && *a != '\0') {
         a++;
         b++;
     }
 
-    if (*a < *b) {
+bytes:
+    if ((uint8_t)*a < (uint8_t)*b) {
         return -1;
     }
-    if (*a > *b) {
+    if ((uint8_t)*a > (uint8_t)*b) {
         return 1;
     }
     return 0;
@@ -106,10 +196,41 @@ int strcmp(const char* a, const char* b)
 
 size_t strlen(const char* str)
 {
-    size_t i = 0;
-    while (str[i])
-        ++i;
-    return i;
+    const char* s = str;
+    for (; (uintptr_t)s & WORD_MASK; s++) {
+        if (!*s)
+            return s - str;
+    }
+
+    const word_t* w = (const word_t*)s;
+    while (!word_has_zero(*w))
+        w++;
+
+    for (s = (const char*)w; *s; s++) { }
+    return s - str;
+}
+
+char* strchr(const char* str, int ch)
+{
+    char c = ch;
+    for (; (uintptr_t)str & WORD_MASK; str++) {
+        if (*str == c)
+            return (char*)str;
+        if (!*str)
+            return NULL;
+    }
+
+    /* Xor turns the bytes equal to c into zeroes. */
+    word_t pattern = (uint8_t)c * WORD_ONES;
+    const word_t* w = (const word_t*)str;
+    while (!word_has_zero(*w) && !word_has_zero(*w ^ pattern))
+        w++;
+
+    for (str = (const char*)w; *str != c; str++) {
+        if (!*str)
+            return NULL;
+    }
+    return (char*)str;
 }
 
 char* strcpy(char* dest, const char* src)
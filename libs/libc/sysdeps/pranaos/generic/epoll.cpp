@@ -0,0 +1,20 @@
+#include <sys/epoll.h>
+#include <sysdep.h>
+
+int epoll_create()
+{
+    int res = DO_SYSCALL_0(SYS_EPOLL_CREATE);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
+
+int epoll_ctl(int epfd, int op, int fd, epoll_event_t* event)
+{
+    int res = DO_SYSCALL_4(SYS_EPOLL_CTL, epfd, op, fd, event);
+    RETURN_WITH_ERRNO(res, 0, -1);
+}
+
+int epoll_wait(int epfd, epoll_event_t* events, int maxevents, int timeout)
+{
+    int res = DO_SYSCALL_4(SYS_EPOLL_WAIT, epfd, events, maxevents, timeout);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
@@ -0,0 +1,61 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mapped_file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int mapped_file_map_fd(int fd, mapped_file_t* file)
+{
+    fstat_t stat;
+    if (fstat(fd, &stat) < 0) {
+        return -1;
+    }
+
+    // Pipes, ttys and devices have no size to map, they are read instead.
+    if ((stat.mode & 0xF000) != S_IFREG) {
+        set_errno(EINVAL);
+        return -1;
+    }
+
+    file->data = NULL;
+    file->size = stat.size;
+    if (!file->size) {
+        return 0;
+    }
+
+    void* data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ((int)data < 0) {
+        set_errno(-(int)data);
+        return -1;
+    }
+
+    file->data = data;
+    madvise(data, file->size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+int mapped_file_open(const char* path, mapped_file_t* file)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // The mapping keeps the file, the descriptor is not needed after.
+    int res = mapped_file_map_fd(fd, file);
+    close(fd);
+    return res;
+}
+
+int mapped_file_close(mapped_file_t* file)
+{
+    if (!file->data) {
+        return 0;
+    }
+
+    int res = munmap(file->data, file->size);
+    file->data = NULL;
+    file->size = 0;
+    return res;
+}
@@ -0,0 +1,20 @@
+#include <sys/perf.h>
+#include <sysdep.h>
+
+int perf_open(int event, uint32_t sample_period)
+{
+    int res = DO_SYSCALL_2(SYS_PERF_OPEN, event, sample_period);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
+
+int perf_read(int counter, uint64_t* value)
+{
+    int res = DO_SYSCALL_2(SYS_PERF_READ, counter, value);
+    RETURN_WITH_ERRNO(res, 0, -1);
+}
+
+int perf_close(int counter)
+{
+    int res = DO_SYSCALL_1(SYS_PERF_CLOSE, counter);
+    RETURN_WITH_ERRNO(res, 0, -1);
+}
@@ -0,0 +1,110 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ring.h>
+#include <sysdep.h>
+
+int ring_init(ring_t* ring, uint32_t entries)
+{
+    if (!entries || entries > RING_ENTRIES_MAX || (entries & (entries - 1))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(ring, 0, sizeof(ring_t));
+    ring->sqes = (ring_sqe_t*)malloc(entries * sizeof(ring_sqe_t));
+    ring->cqes = (ring_cqe_t*)malloc(entries * sizeof(ring_cqe_t));
+    if (!ring->sqes || !ring->cqes) {
+        ring_free(ring);
+        errno = ENOMEM;
+        return -1;
+    }
+    ring->entries = entries;
+    return 0;
+}
+
+void ring_free(ring_t* ring)
+{
+    free(ring->sqes);
+    free(ring->cqes);
+    memset(ring, 0, sizeof(ring_t));
+}
+
+/**
+ * Returns nullptr when the submission queue is full, ring_submit() has to be
+ * called first then.
+ */
+ring_sqe_t* ring_get_sqe(ring_t* ring)
+{
+    if (ring->sq_tail - ring->sq_head >= ring->entries) {
+        return nullptr;
+    }
+    ring_sqe_t* sqe = &ring->sqes[ring->sq_tail & (ring->entries - 1)];
+    memset(sqe, 0, sizeof(ring_sqe_t));
+    ring->sq_tail++;
+    return sqe;
+}
+
+static inline void _ring_prep(ring_sqe_t* sqe, uint32_t id, uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t e, uint32_t user_data)
+{
+    sqe->id = id;
+    sqe->params[0] = a;
+    sqe->params[1] = b;
+    sqe->params[2] = c;
+    sqe->params[3] = d;
+    sqe->params[4] = e;
+    sqe->user_data = user_data;
+}
+
+void ring_prep_read(ring_sqe_t* sqe, int fd, void* buf, size_t count, uint32_t user_data)
+{
+    _ring_prep(sqe, SYS_READ, fd, (uint32_t)buf, count, 0, 0, user_data);
+}
+
+void ring_prep_write(ring_sqe_t* sqe, int fd, const void* buf, size_t count, uint32_t user_data)
+{
+    _ring_prep(sqe, SYS_WRITE, fd, (uint32_t)buf, count, 0, 0, user_data);
+}
+
+void ring_prep_select(ring_sqe_t* sqe, int nfds, fd_set_t* readfds, fd_set_t* writefds, fd_set_t* exceptfds, timeval_t* timeout, uint32_t user_data)
+{
+    _ring_prep(sqe, SYS_SELECT, nfds, (uint32_t)readfds, (uint32_t)writefds, (uint32_t)exceptfds, (uint32_t)timeout, user_data);
+}
+
+void ring_prep_shbuf_create(ring_sqe_t* sqe, uint8_t** buffer, size_t size, uint32_t user_data)
+{
+    _ring_prep(sqe, SYS_SHBUF_CREATE, (uint32_t)buffer, size, 0, 0, 0, user_data);
+}
+
+void ring_prep_shbuf_get(ring_sqe_t* sqe, int id, uint8_t** buffer, uint32_t user_data)
+{
+    _ring_prep(sqe, SYS_SHBUF_GET, id, (uint32_t)buffer, 0, 0, 0, user_data);
+}
+
+void ring_prep_shbuf_free(ring_sqe_t* sqe, int id, uint32_t user_data)
+{
+    _ring_prep(sqe, SYS_SHBUF_FREE, id, 0, 0, 0, 0, user_data);
+}
+
+/**
+ * Runs all queued entries in one trap, returns the count of consumed ones.
+ * Results are in the completion queue, errors are negative values there.
+ */
+int ring_submit(ring_t* ring)
+{
+    int res = DO_SYSCALL_2(SYS_RING_ENTER, ring, ring->sq_tail - ring->sq_head);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
+
+ring_cqe_t* ring_peek_cqe(ring_t* ring)
+{
+    if (ring->cq_head == ring->cq_tail) {
+        return nullptr;
+    }
+    return &ring->cqes[ring->cq_head & (ring->entries - 1)];
+}
+
+void ring_cqe_seen(ring_t* ring)
+{
+    ring->cq_head++;
+}
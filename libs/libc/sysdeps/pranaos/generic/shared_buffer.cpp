@@ -18,3 +18,21 @@ int shared_buffer_free(int id)
     int res = DO_SYSCALL_1(SYS_SHBUF_FREE, id);
     RETURN_WITH_ERRNO(res, res, res);
 }
+
+int shared_buffer_resize(int id, uint8_t** buffer, size_t size)
+{
+    int res = DO_SYSCALL_3(SYS_SHBUF_RESIZE, id, buffer, size);
+    RETURN_WITH_ERRNO(res, res, res);
+}
+
+int shared_buffer_hand_over(int id)
+{
+    int res = DO_SYSCALL_1(SYS_SHBUF_HAND_OVER, id);
+    RETURN_WITH_ERRNO(res, res, res);
+}
+
+int shared_buffer_seal(int id)
+{
+    int res = DO_SYSCALL_1(SYS_SHBUF_SEAL, id);
+    RETURN_WITH_ERRNO(res, res, res);
+}
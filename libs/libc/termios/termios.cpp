@@ -1,5 +1,6 @@
 #include <sys/ioctl.h>
 #include <termios.h>
+#include <unistd.h>
 
 int tcgetpgrp(int fd)
 {
@@ -11,6 +12,12 @@ int tcsetpgrp(int fd, pid_t pgid)
     return ioctl(fd, TIOCSPGRP, pgid);
 }
 
+int isatty(int fd)
+{
+    termios_t termios;
+    return ioctl(fd, TCGETS, (int)&termios) == 0;
+}
+
 int tcgetattr(int fd, termios_t* termios_p)
 {
     return ioctl(0, TCGETS, (int)termios_p);
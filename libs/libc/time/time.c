@@ -114,8 +114,75 @@ time_t mktime(tm_t* tm)
     return 0;
 }
 
+/**
+ * Returns the counter the clock of the time page is interpolated with, or
+ * false if this one can't be read from userspace.
+ */
+static inline int __time_page_read_counter(uint32_t clock_id, uint32_t* counter)
+{
+    uint32_t lo, hi;
+#ifdef __i386__
+    if (clock_id == TIME_PAGE_CLOCK_TSC) {
+        asm volatile("rdtsc"
+                     : "=a"(lo), "=d"(hi));
+        *counter = lo;
+        return 1;
+    }
+#elif __arm__
+    if (clock_id == TIME_PAGE_CLOCK_CNTVCT) {
+        asm volatile("mrrc p15, 1, %0, %1, c14"
+                     : "=r"(lo), "=r"(hi));
+        *counter = lo;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/**
+ * Reads the time page which is mapped by the kernel, retries while the
+ * kernel updates it. The time since the update is taken from the counter
+ * of the clocksource, so the clock has its resolution and not the tick's.
+ */
+static void __time_page_read(clockid_t clk_id, timespec_t* tp)
+{
+    volatile time_page_t* page = (volatile time_page_t*)TIME_PAGE_VADDR;
+    uint32_t seq, clock_id, mult, shift, cycles, nsec, counter;
+    time_t secs, realtime_offset;
+    do {
+        seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        secs = page->clock_secs;
+        nsec = page->clock_nsec;
+        clock_id = page->clock_id;
+        mult = page->clock_mult;
+        shift = page->clock_shift;
+        cycles = page->clock_cycles;
+        realtime_offset = page->secs_since_epoch - page->secs_since_boot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != page->seq);
+
+    if (__time_page_read_counter(clock_id, &counter) && (int32_t)(counter - cycles) > 0) {
+        nsec += ((uint64_t)(counter - cycles) * mult) >> shift;
+        while (nsec >= 1000000000) {
+            nsec -= 1000000000;
+            secs++;
+        }
+    }
+    if (clk_id == CLOCK_REALTIME) {
+        secs += realtime_offset;
+    }
+
+    tp->tv_sec = secs;
+    tp->tv_nsec = nsec;
+}
+
 int clock_gettime(clockid_t clk_id, timespec_t* tp)
 {
+    if (clk_id == CLOCK_MONOTONIC || clk_id == CLOCK_REALTIME) {
+        __time_page_read(clk_id, tp);
+        return 0;
+    }
+
     int res = DO_SYSCALL_2(SYS_CLOCK_GETTIME, clk_id, tp);
     RETURN_WITH_ERRNO(res, res, -1);
 }
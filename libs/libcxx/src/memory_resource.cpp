@@ -0,0 +1,75 @@
+#include <__config>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+
+_LIBCXX_BEGIN_NAMESPACE_STD
+
+namespace pmr {
+
+class __new_delete_memory_resource final : public memory_resource {
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        if (alignment > max_align) {
+            return ::operator new(bytes, std::align_val_t(alignment));
+        }
+        return ::operator new(bytes);
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+    {
+        if (alignment > max_align) {
+            ::operator delete(ptr, std::align_val_t(alignment));
+            return;
+        }
+        ::operator delete(ptr, bytes);
+    }
+
+    bool do_is_equal(const memory_resource& other) const noexcept override { return this == &other; }
+};
+
+class __null_memory_resource final : public memory_resource {
+private:
+    void* do_allocate(size_t, size_t) override
+    {
+        // TODO: Exceptions are not supported
+        std::abort();
+        return nullptr;
+    }
+
+    void do_deallocate(void*, size_t, size_t) override { }
+
+    bool do_is_equal(const memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// Both are constant initialized, so they are ready before any constructor runs.
+static __new_delete_memory_resource new_delete_res;
+static __null_memory_resource null_res;
+static memory_resource* default_res = &new_delete_res;
+
+memory_resource* new_delete_resource() noexcept
+{
+    return &new_delete_res;
+}
+
+memory_resource* null_memory_resource() noexcept
+{
+    return &null_res;
+}
+
+memory_resource* get_default_resource() noexcept
+{
+    return default_res;
+}
+
+memory_resource* set_default_resource(memory_resource* res) noexcept
+{
+    memory_resource* old = default_res;
+    default_res = res ? res : &new_delete_res;
+    return old;
+}
+
+} // namespace pmr
+
+_LIBCXX_END_NAMESPACE_STD
@@ -7,33 +7,94 @@
 #pragma once
 
 // includes
-#include <libutils/result.h>
-#include <libc/include/string.h>
+#include <elf.h>
+#include <sys/types.h>
 
-struct DlErrorMessage {
-   DlErrorMessage(String&& other)
-       : text(move(other))
-   {
-   }
+#define DL_LIBRARY_PATH "/libs/"
+#define DL_MAX_DEPS 16
+#define DL_MAX_SCOPE 32
 
-   virtual ~DlErrorMessage() { }
+/**
+ * A shared object loaded into the process. Objects are kept in one list in
+ * the order of loading, the ones opened with RTLD_GLOBAL form the global
+ * scope which is searched first for every symbol.
+ */
+struct dl_object {
+    char* name;
+    uint32_t base;
+    uint32_t map_start;
+    uint32_t map_size;
+    uint32_t mtime;
+    uint32_t size;
+
+    Elf32_Dyn* dynamic;
+    Elf32_Sym* symtab;
+    const char* strtab;
+    uint32_t* hash;
+    uint32_t* gnu_hash;
+    Elf32_Rel* rel;
+    uint32_t relsz;
+    Elf32_Rel* jmprel;
+    uint32_t pltrelsz;
+    uint32_t* pltgot;
+    uint32_t init;
+    uint32_t* init_array;
+    uint32_t init_arraysz;
+    bool bind_now;
+    bool global;
+    bool inited;
+
+    int refs;
+    struct dl_object* deps[DL_MAX_DEPS];
+    int deps_count;
+    struct dl_object* next;
+};
+typedef struct dl_object dl_object_t;
+
+/* Loader, returns NULL and sets the error on failure. */
+dl_object_t* __dl_load(const char* name, int flags);
+void __dl_unload(dl_object_t* obj);
+void* __dl_lookup(dl_object_t* obj, const char* name);
+dl_object_t* __dl_find_object(uint32_t addr);
+Elf32_Sym* __dl_find_nearest_symbol(dl_object_t* obj, uint32_t addr);
+
+/* Relocations */
+bool __dl_binds_lazily(dl_object_t* obj, bool lazy);
+int __dl_relocate_plt(dl_object_t* obj, bool lazy);
+int __dl_scope_of(dl_object_t* obj, dl_object_t** scope, int max);
+
+/**
+ * Prelink cache of an object is stored next to it, see prelink.cpp.
+ */
+struct dl_prelink_scope {
+    uint32_t name_hash;
+    uint32_t map_start;
+    uint32_t mtime;
+    uint32_t size;
+};
+typedef struct dl_prelink_scope dl_prelink_scope_t;
 
-   String text;
+struct dl_prelink {
+    uint32_t magic;
+    uint32_t mtime;
+    uint32_t size;
+    uint32_t map_start;
+    uint32_t scope_count;
+    uint32_t rel_count;
+    uint32_t plt_count;
+    /* Followed by the scope and the values of the relocated words. */
 };
+typedef struct dl_prelink dl_prelink_t;
 
-struct __Dl_info;
-typedef struct __Dl_info Dl_info;
+dl_prelink_t* __dl_prelink_read(dl_object_t* obj);
+bool __dl_prelink_matches(dl_object_t* obj, dl_prelink_t* prelink);
+bool __dl_prelink_apply(dl_object_t* obj, dl_prelink_t* prelink);
+void __dl_prelink_write(dl_object_t* obj, bool plt_bound);
 
-/* Error Message */
-typedef Result<void, DlErrorMessage> (*DlCloseFunction)(void*);
-typedef Result<void*, DlErrorMessage> (*DlOpenFunction)(const char*, int);
-typedef Result<void*, DlErrorMessage> (*DlSymFunction)(void*, const char*);
-typedef Result<void, DlErrorMessage> (*DlAddrFunction)(void*, Dl_info*);
+/* Errors */
+void __dl_set_error(const char* what, const char* name);
 
-/* call */
 extern "C" {
-extern DlCloseFunction __dlclose;
-extern DlOpenFunction __dlopen;
-extern DlSymFunction __dlsym;
-extern DlAddrFunction __dladdr;
-}
\ No newline at end of file
+uint32_t _dl_fixup(dl_object_t* obj, uint32_t reloc_offset);
+void _dl_runtime_resolve();
+}
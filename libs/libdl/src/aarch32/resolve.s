@@ -0,0 +1,14 @@
+@ lr points to GOT[2], ip points to the GOT slot and the PLT pushed
+@ the return address of the caller.
+.global _dl_runtime_resolve
+_dl_runtime_resolve:
+    push    {r0-r4}
+    ldr     r0, [lr, #-4]
+    sub     r1, ip, lr
+    sub     r1, r1, #4
+    add     r1, r1, r1
+    bl      _dl_fixup
+    mov     ip, r0
+    pop     {r0-r4}
+    pop     {lr}
+    bx      ip
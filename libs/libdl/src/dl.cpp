@@ -5,69 +5,89 @@
 */
 
 // includes
-#include <libc/include/string.h>
-#include <libutils/types.h>
-#include <libdl/include/dl.h>
-#include <libdl/include/dl_integeration.h>
+#include <dl.h>
+#include <dl_integeration.h>
+#include <stdlib.h>
 #include <string.h>
 
+#define DL_ERROR_LEN 256
+
 /* dlerror text + retrived thread*/
-__thread char* s_dlerror_text = NULL;
-__thread bool s_dlerror_retrieved = false;
+__thread char s_dlerror_text[DL_ERROR_LEN];
+__thread bool s_dlerror_set = false;
 
-static void store_error(const String& error)
+void __dl_set_error(const char* what, const char* name)
 {
-    free(s_dlerror_text);
-    s_dlerror_text = strdup(error.characters());
-    s_dlerror_retrieved = false;
+    size_t what_len = strlen(what);
+    size_t name_len = name ? strlen(name) : 0;
+    if (what_len + name_len + 3 > DL_ERROR_LEN) {
+        name_len = 0;
+    }
+
+    s_dlerror_text[0] = '\0';
+    if (name_len) {
+        memcpy(s_dlerror_text, name, name_len);
+        memcpy(s_dlerror_text + name_len, ": ", 2);
+        name_len += 2;
+    }
+    memcpy(s_dlerror_text + name_len, what, what_len + 1);
+    s_dlerror_set = true;
 }
 
 int dlclose(void* handle)
 {
-    auto result = __dlclose(handle);
-    if (result.is_error()) {
-        store_error(result.error().text);
+    if (!handle) {
+        __dl_set_error("invalid handle", nullptr);
         return -1;
     }
+    __dl_unload((dl_object_t*)handle);
     return 0;
 }
 
 char* dlerror()
 {
-    if (s_dlerror_retrieved) {
-        free(s_dlerror_text);
-        s_dlerror_text = nullptr;
+    if (!s_dlerror_set) {
+        return nullptr;
     }
-    s_dlerror_retrieved = true;
-    return const_cast<char*>(s_dlerror_text);
+    s_dlerror_set = false;
+    return s_dlerror_text;
 }
 
 void* dlopen(const char* filename, int flags)
 {
-    auto result = __dlopen(filename, flags);
-    if (result.is_error()) {
-        store_error(result.error().text);
+    if (!filename) {
+        __dl_set_error("opening the main program is not supported", nullptr);
         return nullptr;
     }
-    return result.value();
+    return __dl_load(filename, flags);
 }
 
 void* dlsym(void* handle, const char* symbol_name)
 {
-    auto result = __dlsym(handle, symbol_name);
-    if (result.is_error()) {
-        store_error(result.error().text);
-        return nullptr;
+    void* res = __dl_lookup((dl_object_t*)handle, symbol_name);
+    if (!res) {
+        __dl_set_error("symbol not found", symbol_name);
     }
-    return result.value();
+    return res;
 }
 
 int dladdr(void* addr, Dl_info* info)
 {
-    auto result = __dladdr(addr, info);
-    if (result.is_error()) {
-        store_error(result.error().text);
+    dl_object_t* obj = __dl_find_object((uint32_t)addr);
+    if (!obj) {
+        __dl_set_error("address is not in a loaded object", nullptr);
         return 0;
     }
+
+    info->dli_fname = obj->name;
+    info->dli_fbase = (void*)obj->map_start;
+    info->dli_sname = nullptr;
+    info->dli_saddr = nullptr;
+
+    Elf32_Sym* sym = __dl_find_nearest_symbol(obj, (uint32_t)addr);
+    if (sym) {
+        info->dli_sname = obj->strtab + sym->st_name;
+        info->dli_saddr = (void*)(obj->base + sym->st_value);
+    }
     return 1;
-}
\ No newline at end of file
+}
@@ -0,0 +1,902 @@
+/*
+* Copyright (c) 2021, Krisna Pranav
+*
+* SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <dl.h>
+#include <dl_integeration.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DL_PAGE_SIZE (4096)
+#define DL_MAX_PHDRS (16)
+#define DL_PATH_LEN (256)
+
+#ifdef __i386__
+#define DL_MACHINE EM_386
+#define DL_RELATIVE R_386_RELATIVE
+#define DL_ABS32 R_386_32
+#define DL_PC32 R_386_PC32
+#define DL_GLOB_DAT R_386_GLOB_DAT
+#define DL_JUMP_SLOT R_386_JMP_SLOT
+#elif __arm__
+#define DL_MACHINE EM_ARM
+#define DL_RELATIVE R_ARM_RELATIVE
+#define DL_ABS32 R_ARM_ABS32
+#define DL_PC32 R_ARM_REL32
+#define DL_GLOB_DAT R_ARM_GLOB_DAT
+#define DL_JUMP_SLOT R_ARM_JUMP_SLOT
+#endif
+
+/**
+ * Objects are never unmapped: once the last reference is dropped, the
+ * object stays in the list and the next dlopen of it is for free.
+ * The text of an object is mapped read-only and privately from its file,
+ * the kernel shares such pages between all processes which load the file.
+ * Text relocations would make the text private, so they are refused.
+ */
+static dl_object_t* _dl_objects = nullptr;
+static pthread_mutex_t _dl_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32_t _dl_page_start(uint32_t addr)
+{
+    return addr & ~(DL_PAGE_SIZE - 1);
+}
+
+static inline uint32_t _dl_page_end(uint32_t addr)
+{
+    return (addr + DL_PAGE_SIZE - 1) & ~(DL_PAGE_SIZE - 1);
+}
+
+static inline bool _dl_mmap_failed(void* res)
+{
+    return (int)res < 0 && (int)res > -DL_PAGE_SIZE;
+}
+
+/**
+ * SYMBOLS
+ */
+
+struct dl_hash {
+    uint32_t elf;
+    uint32_t gnu;
+};
+typedef struct dl_hash dl_hash_t;
+
+static uint32_t _dl_elf_hash(const char* name)
+{
+    uint32_t h = 0;
+    while (*name) {
+        h = (h << 4) + (uint8_t)*name++;
+        uint32_t g = h & 0xf0000000;
+        if (g) {
+            h ^= g >> 24;
+        }
+        h &= ~g;
+    }
+    return h;
+}
+
+static uint32_t _dl_gnu_hash(const char* name)
+{
+    uint32_t h = 5381;
+    while (*name) {
+        h = h * 33 + (uint8_t)*name++;
+    }
+    return h;
+}
+
+static inline dl_hash_t _dl_hash_of(const char* name)
+{
+    dl_hash_t hash;
+    hash.elf = _dl_elf_hash(name);
+    hash.gnu = _dl_gnu_hash(name);
+    return hash;
+}
+
+static inline bool _dl_is_definition(Elf32_Sym* sym)
+{
+    return sym->st_shndx != SHN_UNDEF && ELF32_ST_BIND(sym->st_info) != STB_LOCAL;
+}
+
+/**
+ * DT_GNU_HASH layout: nbuckets, symoffset, bloom_size, bloom_shift, the
+ * bloom filter, buckets, and chains which hold hashes of the symbols with
+ * the lowest bit set at the end of a chain. The filter rejects most of the
+ * misses without touching the symbol table at all.
+ */
+static Elf32_Sym* _dl_lookup_gnu_hash(dl_object_t* obj, const char* name, uint32_t hash)
+{
+    uint32_t* table = obj->gnu_hash;
+    uint32_t nbuckets = table[0];
+    uint32_t symoffset = table[1];
+    uint32_t bloom_size = table[2];
+    uint32_t bloom_shift = table[3];
+    uint32_t* bloom = &table[4];
+    uint32_t* buckets = &bloom[bloom_size];
+    uint32_t* chains = &buckets[nbuckets];
+
+    uint32_t word = bloom[(hash / 32) % bloom_size];
+    uint32_t mask = (1u << (hash % 32)) | (1u << ((hash >> bloom_shift) % 32));
+    if ((word & mask) != mask) {
+        return nullptr;
+    }
+
+    uint32_t i = buckets[hash % nbuckets];
+    if (i < symoffset) {
+        return nullptr;
+    }
+
+    for (;; i++) {
+        uint32_t sym_hash = chains[i - symoffset];
+        Elf32_Sym* sym = &obj->symtab[i];
+        if ((hash | 1) == (sym_hash | 1) && _dl_is_definition(sym) && strcmp(obj->strtab + sym->st_name, name) == 0) {
+            return sym;
+        }
+        if (sym_hash & 1) {
+            return nullptr;
+        }
+    }
+}
+
+static Elf32_Sym* _dl_lookup_elf_hash(dl_object_t* obj, const char* name, uint32_t hash)
+{
+    uint32_t nbucket = obj->hash[0];
+    uint32_t* buckets = &obj->hash[2];
+    uint32_t* chains = &buckets[nbucket];
+    for (uint32_t i = buckets[hash % nbucket]; i; i = chains[i]) {
+        Elf32_Sym* sym = &obj->symtab[i];
+        if (_dl_is_definition(sym) && strcmp(obj->strtab + sym->st_name, name) == 0) {
+            return sym;
+        }
+    }
+    return nullptr;
+}
+
+static Elf32_Sym* _dl_lookup_in_object(dl_object_t* obj, const char* name, dl_hash_t* hash)
+{
+    if (obj->gnu_hash) {
+        return _dl_lookup_gnu_hash(obj, name, hash->gnu);
+    }
+    if (obj->hash) {
+        return _dl_lookup_elf_hash(obj, name, hash->elf);
+    }
+    return nullptr;
+}
+
+/**
+ * GNU hash doesn't keep the number of symbols, it ends with the longest
+ * chain of the last non-empty bucket.
+ */
+static uint32_t _dl_symbols_count(dl_object_t* obj)
+{
+    if (!obj->gnu_hash) {
+        return obj->hash ? obj->hash[1] : 0;
+    }
+
+    uint32_t* table = obj->gnu_hash;
+    uint32_t nbuckets = table[0];
+    uint32_t symoffset = table[1];
+    uint32_t* buckets = &table[4 + table[2]];
+    uint32_t* chains = &buckets[nbuckets];
+
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < nbuckets; i++) {
+        if (buckets[i] > last) {
+            last = buckets[i];
+        }
+    }
+    if (last < symoffset) {
+        return symoffset;
+    }
+    while (!(chains[last - symoffset] & 1)) {
+        last++;
+    }
+    return last + 1;
+}
+
+static Elf32_Sym* _dl_lookup_in_deps(dl_object_t* obj, const char* name, dl_hash_t* hash, dl_object_t** owner, int depth)
+{
+    Elf32_Sym* sym = _dl_lookup_in_object(obj, name, hash);
+    if (sym) {
+        *owner = obj;
+        return sym;
+    }
+
+    if (depth >= DL_MAX_DEPS) {
+        return nullptr;
+    }
+    for (int i = 0; i < obj->deps_count; i++) {
+        sym = _dl_lookup_in_deps(obj->deps[i], name, hash, owner, depth + 1);
+        if (sym) {
+            return sym;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * The global scope goes first, then the object and its dependencies.
+ */
+static Elf32_Sym* _dl_resolve(dl_object_t* obj, const char* name, dl_object_t** owner)
+{
+    dl_hash_t hash = _dl_hash_of(name);
+    for (dl_object_t* it = _dl_objects; it; it = it->next) {
+        if (!it->global || !it->refs) {
+            continue;
+        }
+        Elf32_Sym* sym = _dl_lookup_in_object(it, name, &hash);
+        if (sym) {
+            *owner = it;
+            return sym;
+        }
+    }
+
+    if (!obj) {
+        return nullptr;
+    }
+    return _dl_lookup_in_deps(obj, name, &hash, owner, 0);
+}
+
+/**
+ * Collects the objects which symbols of @obj could be resolved from, in
+ * the order of the lookup. Returns -1 if there are more than @max of them.
+ */
+static int _dl_add_to_scope(dl_object_t* obj, dl_object_t** scope, int count, int max)
+{
+    for (int i = 0; i < count; i++) {
+        if (scope[i] == obj) {
+            return count;
+        }
+    }
+    if (count >= max) {
+        return -1;
+    }
+    scope[count++] = obj;
+
+    for (int i = 0; i < obj->deps_count && count >= 0; i++) {
+        count = _dl_add_to_scope(obj->deps[i], scope, count, max);
+    }
+    return count;
+}
+
+int __dl_scope_of(dl_object_t* obj, dl_object_t** scope, int max)
+{
+    int count = 0;
+    for (dl_object_t* it = _dl_objects; it; it = it->next) {
+        if (!it->global || !it->refs) {
+            continue;
+        }
+        if (count >= max) {
+            return -1;
+        }
+        scope[count++] = it;
+    }
+
+    for (int i = 0; i < obj->deps_count && count >= 0; i++) {
+        count = _dl_add_to_scope(obj->deps[i], scope, count, max);
+    }
+    return count;
+}
+
+void* __dl_lookup(dl_object_t* obj, const char* name)
+{
+    dl_object_t* owner;
+    pthread_mutex_lock(&_dl_lock);
+    dl_hash_t hash = _dl_hash_of(name);
+    Elf32_Sym* sym = obj ? _dl_lookup_in_deps(obj, name, &hash, &owner, 0) : _dl_resolve(nullptr, name, &owner);
+    pthread_mutex_unlock(&_dl_lock);
+    if (!sym) {
+        return nullptr;
+    }
+    return (void*)(owner->base + sym->st_value);
+}
+
+dl_object_t* __dl_find_object(uint32_t addr)
+{
+    pthread_mutex_lock(&_dl_lock);
+    dl_object_t* obj = _dl_objects;
+    while (obj && !(obj->map_start <= addr && addr < obj->map_start + obj->map_size)) {
+        obj = obj->next;
+    }
+    pthread_mutex_unlock(&_dl_lock);
+    return obj;
+}
+
+Elf32_Sym* __dl_find_nearest_symbol(dl_object_t* obj, uint32_t addr)
+{
+    uint32_t nsyms = _dl_symbols_count(obj);
+    Elf32_Sym* best = nullptr;
+    for (uint32_t i = 1; i < nsyms; i++) {
+        Elf32_Sym* sym = &obj->symtab[i];
+        uint32_t sym_addr = obj->base + sym->st_value;
+        if (sym->st_shndx == SHN_UNDEF || sym_addr > addr) {
+            continue;
+        }
+        if (!best || best->st_value < sym->st_value) {
+            best = sym;
+        }
+    }
+    return best;
+}
+
+/**
+ * RELOCATIONS
+ */
+
+static int _dl_symbol_address(dl_object_t* obj, uint32_t sym_index, uint32_t* res)
+{
+    Elf32_Sym* sym = &obj->symtab[sym_index];
+    if (ELF32_ST_BIND(sym->st_info) == STB_LOCAL) {
+        *res = obj->base + sym->st_value;
+        return 0;
+    }
+
+    const char* name = obj->strtab + sym->st_name;
+    dl_object_t* owner;
+    Elf32_Sym* def = _dl_resolve(obj, name, &owner);
+    if (def) {
+        *res = owner->base + def->st_value;
+        return 0;
+    }
+
+    if (ELF32_ST_BIND(sym->st_info) == STB_WEAK) {
+        *res = 0;
+        return 0;
+    }
+    __dl_set_error("undefined symbol", name);
+    return -1;
+}
+
+static int _dl_relocate_one(dl_object_t* obj, Elf32_Rel* rel, bool lazy)
+{
+    uint32_t* where = (uint32_t*)(obj->base + rel->r_offset);
+    uint32_t sym_index = ELF32_R_SYM(rel->r_info);
+    uint32_t addr = 0;
+
+    switch (ELF32_R_TYPE(rel->r_info)) {
+    case DL_RELATIVE:
+        *where += obj->base;
+        return 0;
+    case DL_JUMP_SLOT:
+        if (lazy) {
+            // The slot points back into the PLT, which calls the resolver.
+            *where += obj->base;
+            return 0;
+        }
+        if (_dl_symbol_address(obj, sym_index, &addr) < 0) {
+            return -1;
+        }
+        *where = addr;
+        return 0;
+    case DL_GLOB_DAT:
+        if (_dl_symbol_address(obj, sym_index, &addr) < 0) {
+            return -1;
+        }
+        *where = addr;
+        return 0;
+    case DL_ABS32:
+        if (_dl_symbol_address(obj, sym_index, &addr) < 0) {
+            return -1;
+        }
+        *where += addr;
+        return 0;
+    case DL_PC32:
+        if (_dl_symbol_address(obj, sym_index, &addr) < 0) {
+            return -1;
+        }
+        *where += addr - (uint32_t)where;
+        return 0;
+    case 0:
+        return 0;
+    default:
+        __dl_set_error("unsupported relocation", obj->name);
+        return -1;
+    }
+}
+
+static int _dl_relocate(dl_object_t* obj)
+{
+    uint32_t rel_count = obj->relsz / sizeof(Elf32_Rel);
+    for (uint32_t i = 0; i < rel_count; i++) {
+        if (_dl_relocate_one(obj, &obj->rel[i], false) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Without a GOT there is nowhere to put the resolver, so such objects are
+ * bound at once.
+ */
+bool __dl_binds_lazily(dl_object_t* obj, bool lazy)
+{
+    return lazy && obj->pltgot;
+}
+
+int __dl_relocate_plt(dl_object_t* obj, bool lazy)
+{
+    lazy = __dl_binds_lazily(obj, lazy);
+    if (lazy) {
+        obj->pltgot[1] = (uint32_t)obj;
+        obj->pltgot[2] = (uint32_t)_dl_runtime_resolve;
+    }
+
+    uint32_t plt_count = obj->pltrelsz / sizeof(Elf32_Rel);
+    for (uint32_t i = 0; i < plt_count; i++) {
+        if (_dl_relocate_one(obj, &obj->jmprel[i], lazy) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Called from _dl_runtime_resolve on the first call through a PLT slot,
+ * binds the slot and returns the address to jump to.
+ */
+uint32_t _dl_fixup(dl_object_t* obj, uint32_t reloc_offset)
+{
+    Elf32_Rel* rel = (Elf32_Rel*)((uint8_t*)obj->jmprel + reloc_offset);
+    uint32_t* where = (uint32_t*)(obj->base + rel->r_offset);
+    uint32_t addr = 0;
+
+    pthread_mutex_lock(&_dl_lock);
+    int err = _dl_symbol_address(obj, ELF32_R_SYM(rel->r_info), &addr);
+    pthread_mutex_unlock(&_dl_lock);
+    if (err < 0 || !addr) {
+        const char* msg = "dl: lazy binding failed\n";
+        write(2, msg, strlen(msg));
+        exit(127);
+    }
+
+    *where = addr;
+    return addr;
+}
+
+/**
+ * LOADING
+ */
+
+static int _dl_parse_dynamic(dl_object_t* obj, uint32_t* needed, int* needed_count)
+{
+    uint32_t flags = 0;
+    bool textrel = false;
+    *needed_count = 0;
+
+    for (Elf32_Dyn* dyn = obj->dynamic; dyn->d_tag != DT_NULL; dyn++) {
+        uint32_t val = dyn->d_un.d_val;
+        switch (dyn->d_tag) {
+        case DT_NEEDED:
+            if (*needed_count >= DL_MAX_DEPS) {
+                __dl_set_error("too many dependencies", obj->name);
+                return -1;
+            }
+            needed[(*needed_count)++] = val;
+            break;
+        case DT_HASH:
+            obj->hash = (uint32_t*)(obj->base + val);
+            break;
+        case DT_GNU_HASH:
+            obj->gnu_hash = (uint32_t*)(obj->base + val);
+            break;
+        case DT_STRTAB:
+            obj->strtab = (const char*)(obj->base + val);
+            break;
+        case DT_SYMTAB:
+            obj->symtab = (Elf32_Sym*)(obj->base + val);
+            break;
+        case DT_REL:
+            obj->rel = (Elf32_Rel*)(obj->base + val);
+            break;
+        case DT_RELSZ:
+            obj->relsz = val;
+            break;
+        case DT_JMPREL:
+            obj->jmprel = (Elf32_Rel*)(obj->base + val);
+            break;
+        case DT_PLTRELSZ:
+            obj->pltrelsz = val;
+            break;
+        case DT_PLTREL:
+            if (val != DT_REL) {
+                __dl_set_error("RELA relocations are not supported", obj->name);
+                return -1;
+            }
+            break;
+        case DT_RELA:
+            __dl_set_error("RELA relocations are not supported", obj->name);
+            return -1;
+        case DT_PLTGOT:
+            obj->pltgot = (uint32_t*)(obj->base + val);
+            break;
+        case DT_INIT:
+            obj->init = obj->base + val;
+            break;
+        case DT_INIT_ARRAY:
+            obj->init_array = (uint32_t*)(obj->base + val);
+            break;
+        case DT_INIT_ARRAYSZ:
+            obj->init_arraysz = val;
+            break;
+        case DT_BIND_NOW:
+            obj->bind_now = true;
+            break;
+        case DT_TEXTREL:
+            textrel = true;
+            break;
+        case DT_FLAGS:
+            flags = val;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (flags & DF_BIND_NOW) {
+        obj->bind_now = true;
+    }
+    if (textrel || (flags & DF_TEXTREL)) {
+        __dl_set_error("text relocations are not supported, build with -fPIC", obj->name);
+        return -1;
+    }
+    if (!obj->symtab || !obj->strtab || (!obj->hash && !obj->gnu_hash)) {
+        __dl_set_error("no dynamic symbol table", obj->name);
+        return -1;
+    }
+    return 0;
+}
+
+static int _dl_read_headers(int fd, const char* name, Elf32_Ehdr* ehdr, Elf32_Phdr* phdrs)
+{
+    if (read(fd, (char*)ehdr, sizeof(*ehdr)) != sizeof(*ehdr)) {
+        __dl_set_error("can't read ELF header", name);
+        return -1;
+    }
+
+    if (ehdr->e_ident[0] != ELFMAG0 || ehdr->e_ident[1] != ELFMAG1 || ehdr->e_ident[2] != ELFMAG2 || ehdr->e_ident[3] != ELFMAG3) {
+        __dl_set_error("not an ELF file", name);
+        return -1;
+    }
+    if (ehdr->e_ident[EI_CLASS] != ELFCLASS32 || ehdr->e_type != ET_DYN || ehdr->e_machine != DL_MACHINE) {
+        __dl_set_error("not a shared object for this machine", name);
+        return -1;
+    }
+    if (ehdr->e_phnum > DL_MAX_PHDRS || ehdr->e_phentsize != sizeof(Elf32_Phdr)) {
+        __dl_set_error("bad program headers", name);
+        return -1;
+    }
+
+    size_t phdrs_size = ehdr->e_phnum * sizeof(Elf32_Phdr);
+    if (lseek(fd, ehdr->e_phoff, SEEK_SET) < 0 || read(fd, (char*)phdrs, phdrs_size) != (ssize_t)phdrs_size) {
+        __dl_set_error("can't read program headers", name);
+        return -1;
+    }
+    return 0;
+}
+
+static int _dl_prot_of(Elf32_Phdr* ph)
+{
+    int prot = 0;
+    if (ph->p_flags & PF_R) {
+        prot |= PROT_READ;
+    }
+    if (ph->p_flags & PF_W) {
+        prot |= PROT_WRITE;
+    }
+    if (ph->p_flags & PF_X) {
+        prot |= PROT_EXEC;
+    }
+    return prot;
+}
+
+/**
+ * The whole span of the object is reserved with a PROT_NONE mapping first,
+ * then the segments are mapped with MAP_FIXED over it. The reservation is
+ * placed at @preferred if that range is free.
+ */
+static int _dl_map_segments(dl_object_t* obj, int fd, Elf32_Ehdr* ehdr, Elf32_Phdr* phdrs, uint32_t preferred)
+{
+    uint32_t min_vaddr = 0xffffffff;
+    uint32_t max_vaddr = 0;
+    Elf32_Phdr* dynamic_ph = nullptr;
+
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        Elf32_Phdr* ph = &phdrs[i];
+        if (ph->p_type == PT_DYNAMIC) {
+            dynamic_ph = ph;
+        }
+        if (ph->p_type == PT_TLS) {
+            __dl_set_error("TLS in shared objects is not supported", obj->name);
+            return -1;
+        }
+        if (ph->p_type != PT_LOAD || !ph->p_memsz) {
+            continue;
+        }
+        if ((ph->p_offset % DL_PAGE_SIZE) != (ph->p_vaddr % DL_PAGE_SIZE)) {
+            __dl_set_error("misaligned segment", obj->name);
+            return -1;
+        }
+        if (_dl_page_start(ph->p_vaddr) < min_vaddr) {
+            min_vaddr = _dl_page_start(ph->p_vaddr);
+        }
+        if (_dl_page_end(ph->p_vaddr + ph->p_memsz) > max_vaddr) {
+            max_vaddr = _dl_page_end(ph->p_vaddr + ph->p_memsz);
+        }
+    }
+
+    if (!dynamic_ph || min_vaddr >= max_vaddr) {
+        __dl_set_error("not a dynamic object", obj->name);
+        return -1;
+    }
+
+    obj->map_size = max_vaddr - min_vaddr;
+    void* reserved = (void*)-1;
+    if (preferred) {
+        reserved = mmap((void*)preferred, obj->map_size, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, 0, 0);
+    }
+    if (_dl_mmap_failed(reserved)) {
+        reserved = mmap(nullptr, obj->map_size, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
+    }
+    if (_dl_mmap_failed(reserved)) {
+        __dl_set_error("no space for the object", obj->name);
+        return -1;
+    }
+    obj->map_start = (uint32_t)reserved;
+    obj->base = obj->map_start - min_vaddr;
+
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        Elf32_Phdr* ph = &phdrs[i];
+        if (ph->p_type != PT_LOAD || !ph->p_memsz) {
+            continue;
+        }
+
+        int prot = _dl_prot_of(ph);
+        uint32_t seg_start = obj->base + _dl_page_start(ph->p_vaddr);
+        uint32_t file_end = obj->base + ph->p_vaddr + ph->p_filesz;
+        uint32_t mem_end = obj->base + ph->p_vaddr + ph->p_memsz;
+        uint32_t anon_start = seg_start;
+
+        if (ph->p_filesz) {
+            uint32_t len = _dl_page_end(file_end) - seg_start;
+            void* res = mmap((void*)seg_start, len, prot, MAP_PRIVATE | MAP_FIXED, fd, _dl_page_start(ph->p_offset));
+            if (_dl_mmap_failed(res)) {
+                __dl_set_error("can't map segment", obj->name);
+                return -1;
+            }
+            anon_start = seg_start + len;
+
+            // BSS starts in the last file page, its tail holds bytes of the file.
+            if (mem_end > file_end && (prot & PROT_WRITE)) {
+                uint32_t tail_end = mem_end < anon_start ? mem_end : anon_start;
+                memset((void*)file_end, 0, tail_end - file_end);
+            }
+        }
+
+        if (mem_end > anon_start) {
+            void* res = mmap((void*)anon_start, _dl_page_end(mem_end) - anon_start, prot, MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, 0, 0);
+            if (_dl_mmap_failed(res)) {
+                __dl_set_error("can't map segment", obj->name);
+                return -1;
+            }
+        }
+    }
+
+    obj->dynamic = (Elf32_Dyn*)(obj->base + dynamic_ph->p_vaddr);
+    return 0;
+}
+
+static void _dl_call_init(dl_object_t* obj)
+{
+    if (obj->init) {
+        ((void (*)())obj->init)();
+    }
+    uint32_t count = obj->init_arraysz / sizeof(uint32_t);
+    for (uint32_t i = 0; i < count; i++) {
+        if (obj->init_array[i] && obj->init_array[i] != 0xffffffff) {
+            ((void (*)())obj->init_array[i])();
+        }
+    }
+}
+
+static const char* _dl_basename(const char* path)
+{
+    const char* res = path;
+    for (const char* it = path; *it; it++) {
+        if (*it == '/') {
+            res = it + 1;
+        }
+    }
+    return res;
+}
+
+static int _dl_open_file(const char* name, char* path)
+{
+    bool has_slash = false;
+    for (const char* it = name; *it; it++) {
+        has_slash |= (*it == '/');
+    }
+
+    size_t prefix_len = has_slash ? 0 : strlen(DL_LIBRARY_PATH);
+    size_t name_len = strlen(name);
+    if (prefix_len + name_len + 1 > DL_PATH_LEN) {
+        __dl_set_error("path is too long", name);
+        return -1;
+    }
+    memcpy(path, DL_LIBRARY_PATH, prefix_len);
+    memcpy(path + prefix_len, name, name_len + 1);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        __dl_set_error("can't open the file", path);
+    }
+    return fd;
+}
+
+static dl_object_t* _dl_find_loaded(const char* name)
+{
+    const char* base_name = _dl_basename(name);
+    for (dl_object_t* obj = _dl_objects; obj; obj = obj->next) {
+        if (strcmp(_dl_basename(obj->name), base_name) == 0) {
+            return obj;
+        }
+    }
+    return nullptr;
+}
+
+static void _dl_append(dl_object_t* obj)
+{
+    dl_object_t** it = &_dl_objects;
+    while (*it) {
+        it = &(*it)->next;
+    }
+    *it = obj;
+}
+
+static dl_object_t* _dl_load_lockless(const char* name, int flags, int depth);
+
+static dl_object_t* _dl_map_object(const char* name, int flags, int depth)
+{
+    char path[DL_PATH_LEN];
+    int fd = _dl_open_file(name, path);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    dl_object_t* obj = (dl_object_t*)malloc(sizeof(dl_object_t));
+    char* obj_name = (char*)malloc(strlen(path) + 1);
+    if (!obj || !obj_name) {
+        __dl_set_error("out of memory", name);
+        close(fd);
+        return nullptr;
+    }
+    memset(obj, 0, sizeof(dl_object_t));
+    strcpy(obj_name, path);
+    obj->name = obj_name;
+    obj->global = (flags & RTLD_GLOBAL) != 0;
+
+    fstat_t stat;
+    if (fstat(fd, &stat) == 0) {
+        obj->mtime = stat.mtime;
+        obj->size = stat.size;
+    }
+    dl_prelink_t* prelink = __dl_prelink_read(obj);
+
+    Elf32_Ehdr ehdr;
+    Elf32_Phdr phdrs[DL_MAX_PHDRS];
+    int err = _dl_read_headers(fd, path, &ehdr, phdrs);
+    if (!err) {
+        err = _dl_map_segments(obj, fd, &ehdr, phdrs, prelink ? prelink->map_start : 0);
+    }
+    close(fd);
+
+    // A failed object keeps its mappings, they are not reused.
+    uint32_t needed[DL_MAX_DEPS];
+    int needed_count = 0;
+    if (err || _dl_parse_dynamic(obj, needed, &needed_count) < 0) {
+        goto fail;
+    }
+
+    for (int i = 0; i < needed_count; i++) {
+        dl_object_t* dep = _dl_load_lockless(obj->strtab + needed[i], flags, depth + 1);
+        if (!dep) {
+            // The error of the dependency is kept.
+            goto fail;
+        }
+        obj->deps[obj->deps_count++] = dep;
+    }
+
+    {
+        bool lazy = !(flags & RTLD_NOW) && !obj->bind_now;
+        if (prelink && __dl_prelink_matches(obj, prelink)) {
+            if (!__dl_prelink_apply(obj, prelink) && __dl_relocate_plt(obj, lazy) < 0) {
+                goto fail;
+            }
+        } else {
+            if (_dl_relocate(obj) < 0 || __dl_relocate_plt(obj, lazy) < 0) {
+                goto fail;
+            }
+            __dl_prelink_write(obj, !__dl_binds_lazily(obj, lazy));
+        }
+    }
+    free(prelink);
+
+    obj->refs = 1;
+    _dl_append(obj);
+    return obj;
+
+fail:
+    free(prelink);
+    free(obj_name);
+    free(obj);
+    return nullptr;
+}
+
+static dl_object_t* _dl_load_lockless(const char* name, int flags, int depth)
+{
+    if (depth > DL_MAX_DEPS) {
+        __dl_set_error("dependencies are too deep", name);
+        return nullptr;
+    }
+
+    dl_object_t* obj = _dl_find_loaded(name);
+    if (obj) {
+        obj->refs++;
+        obj->global |= (flags & RTLD_GLOBAL) != 0;
+        return obj;
+    }
+    return _dl_map_object(name, flags, depth);
+}
+
+/**
+ * Constructors run without the lock held, so they could call dlopen too.
+ * Dependencies are earlier in the list, so they are initialized first.
+ */
+static void _dl_init_objects()
+{
+    for (;;) {
+        pthread_mutex_lock(&_dl_lock);
+        dl_object_t* obj = _dl_objects;
+        while (obj && obj->inited) {
+            obj = obj->next;
+        }
+        if (obj) {
+            obj->inited = true;
+        }
+        pthread_mutex_unlock(&_dl_lock);
+
+        if (!obj) {
+            return;
+        }
+        _dl_call_init(obj);
+    }
+}
+
+dl_object_t* __dl_load(const char* name, int flags)
+{
+    pthread_mutex_lock(&_dl_lock);
+    dl_object_t* obj = _dl_load_lockless(name, flags, 0);
+    pthread_mutex_unlock(&_dl_lock);
+
+    if (obj) {
+        _dl_init_objects();
+    }
+    return obj;
+}
+
+void __dl_unload(dl_object_t* obj)
+{
+    pthread_mutex_lock(&_dl_lock);
+    if (obj->refs > 0) {
+        obj->refs--;
+    }
+    pthread_mutex_unlock(&_dl_lock);
+}
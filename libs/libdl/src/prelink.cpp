@@ -0,0 +1,211 @@
+/*
+* Copyright (c) 2021, Krisna Pranav
+*
+* SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <dl_integeration.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DL_PRELINK_MAGIC (0x4b4e4c50)
+#define DL_PRELINK_SUFFIX ".prelink"
+#define DL_PRELINK_PATH_LEN (256)
+#define DL_PRELINK_MAX_RELS (1 << 20)
+
+/**
+ * The prelink cache of an object keeps the address it was mapped at and
+ * the final value of every word its relocations wrote. The values are
+ * valid while the object and every object of its lookup scope are the same
+ * files mapped at the same addresses, so the scope is stored too. Files
+ * are told apart by mtime and size.
+ * The loader maps an object at the address from its cache if the range is
+ * free, then the relocations are plain stores without a single symbol
+ * lookup. PLT values are stored only when the cache was written by a load
+ * which bound the PLT at once.
+ */
+
+static inline dl_prelink_scope_t* _dl_prelink_scope(dl_prelink_t* prelink)
+{
+    return (dl_prelink_scope_t*)(prelink + 1);
+}
+
+static inline uint32_t* _dl_prelink_values(dl_prelink_t* prelink)
+{
+    return (uint32_t*)(_dl_prelink_scope(prelink) + prelink->scope_count);
+}
+
+static inline uint32_t _dl_prelink_size(uint32_t scope_count, uint32_t values_count)
+{
+    return sizeof(dl_prelink_t) + scope_count * sizeof(dl_prelink_scope_t) + values_count * sizeof(uint32_t);
+}
+
+static int _dl_prelink_path(dl_object_t* obj, char* path)
+{
+    size_t name_len = strlen(obj->name);
+    size_t suffix_len = strlen(DL_PRELINK_SUFFIX);
+    if (name_len + suffix_len + 1 > DL_PRELINK_PATH_LEN) {
+        return -1;
+    }
+    memcpy(path, obj->name, name_len);
+    memcpy(path + name_len, DL_PRELINK_SUFFIX, suffix_len + 1);
+    return 0;
+}
+
+static uint32_t _dl_prelink_name_hash(const char* name)
+{
+    uint32_t h = 5381;
+    while (*name) {
+        h = h * 33 + (uint8_t)*name++;
+    }
+    return h;
+}
+
+static int _dl_prelink_fill_scope(dl_object_t* obj, dl_prelink_scope_t* out)
+{
+    dl_object_t* scope[DL_MAX_SCOPE];
+    int count = __dl_scope_of(obj, scope, DL_MAX_SCOPE);
+    for (int i = 0; i < count; i++) {
+        out[i].name_hash = _dl_prelink_name_hash(scope[i]->name);
+        out[i].map_start = scope[i]->map_start;
+        out[i].mtime = scope[i]->mtime;
+        out[i].size = scope[i]->size;
+    }
+    return count;
+}
+
+dl_prelink_t* __dl_prelink_read(dl_object_t* obj)
+{
+    char path[DL_PRELINK_PATH_LEN];
+    if ((!obj->mtime && !obj->size) || _dl_prelink_path(obj, path) < 0) {
+        return nullptr;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    dl_prelink_t header;
+    dl_prelink_t* prelink = nullptr;
+    if (read(fd, (char*)&header, sizeof(header)) != sizeof(header)) {
+        goto out;
+    }
+    if (header.magic != DL_PRELINK_MAGIC || header.mtime != obj->mtime || header.size != obj->size) {
+        goto out;
+    }
+    if (header.scope_count > DL_MAX_SCOPE || header.rel_count > DL_PRELINK_MAX_RELS || header.plt_count > DL_PRELINK_MAX_RELS) {
+        goto out;
+    }
+
+    {
+        uint32_t size = _dl_prelink_size(header.scope_count, header.rel_count + header.plt_count);
+        prelink = (dl_prelink_t*)malloc(size);
+        if (!prelink) {
+            goto out;
+        }
+        memcpy(prelink, &header, sizeof(header));
+
+        ssize_t rest = size - sizeof(header);
+        if (read(fd, (char*)(prelink + 1), rest) != rest) {
+            free(prelink);
+            prelink = nullptr;
+        }
+    }
+
+out:
+    close(fd);
+    return prelink;
+}
+
+bool __dl_prelink_matches(dl_object_t* obj, dl_prelink_t* prelink)
+{
+    if (obj->map_start != prelink->map_start) {
+        return false;
+    }
+    if (prelink->rel_count != obj->relsz / sizeof(Elf32_Rel)) {
+        return false;
+    }
+    if (prelink->plt_count && prelink->plt_count != obj->pltrelsz / sizeof(Elf32_Rel)) {
+        return false;
+    }
+
+    dl_prelink_scope_t scope[DL_MAX_SCOPE];
+    int count = _dl_prelink_fill_scope(obj, scope);
+    if (count < 0 || (uint32_t)count != prelink->scope_count) {
+        return false;
+    }
+    return memcmp(scope, _dl_prelink_scope(prelink), count * sizeof(dl_prelink_scope_t)) == 0;
+}
+
+/**
+ * Returns true if the PLT is bound by the cache too.
+ */
+bool __dl_prelink_apply(dl_object_t* obj, dl_prelink_t* prelink)
+{
+    uint32_t* values = _dl_prelink_values(prelink);
+    for (uint32_t i = 0; i < prelink->rel_count; i++) {
+        *(uint32_t*)(obj->base + obj->rel[i].r_offset) = values[i];
+    }
+
+    values += prelink->rel_count;
+    for (uint32_t i = 0; i < prelink->plt_count; i++) {
+        *(uint32_t*)(obj->base + obj->jmprel[i].r_offset) = values[i];
+    }
+    return prelink->plt_count != 0 || !obj->pltrelsz;
+}
+
+/**
+ * Called right after the relocations are done, so the values are read
+ * back from the relocated words. Failures are ignored, the cache is only
+ * a hint.
+ */
+void __dl_prelink_write(dl_object_t* obj, bool plt_bound)
+{
+    char path[DL_PRELINK_PATH_LEN];
+    if ((!obj->mtime && !obj->size) || _dl_prelink_path(obj, path) < 0) {
+        return;
+    }
+
+    dl_prelink_scope_t scope[DL_MAX_SCOPE];
+    int scope_count = _dl_prelink_fill_scope(obj, scope);
+    if (scope_count < 0) {
+        return;
+    }
+
+    uint32_t rel_count = obj->relsz / sizeof(Elf32_Rel);
+    uint32_t plt_count = plt_bound ? obj->pltrelsz / sizeof(Elf32_Rel) : 0;
+    uint32_t size = _dl_prelink_size(scope_count, rel_count + plt_count);
+    dl_prelink_t* prelink = (dl_prelink_t*)malloc(size);
+    if (!prelink) {
+        return;
+    }
+
+    prelink->magic = DL_PRELINK_MAGIC;
+    prelink->mtime = obj->mtime;
+    prelink->size = obj->size;
+    prelink->map_start = obj->map_start;
+    prelink->scope_count = scope_count;
+    prelink->rel_count = rel_count;
+    prelink->plt_count = plt_count;
+    memcpy(_dl_prelink_scope(prelink), scope, scope_count * sizeof(dl_prelink_scope_t));
+
+    uint32_t* values = _dl_prelink_values(prelink);
+    for (uint32_t i = 0; i < rel_count; i++) {
+        values[i] = *(uint32_t*)(obj->base + obj->rel[i].r_offset);
+    }
+    values += rel_count;
+    for (uint32_t i = 0; i < plt_count; i++) {
+        values[i] = *(uint32_t*)(obj->base + obj->jmprel[i].r_offset);
+    }
+
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC);
+    if (fd >= 0) {
+        write(fd, prelink, size);
+        close(fd);
+    }
+    free(prelink);
+}
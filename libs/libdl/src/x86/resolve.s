@@ -0,0 +1,18 @@
+extern _dl_fixup
+
+; The PLT pushed the relocation offset and GOT[1], which is the object.
+global _dl_runtime_resolve
+_dl_runtime_resolve:
+    push eax
+    push ecx
+    push edx
+    mov edx, [esp+16]
+    mov eax, [esp+12]
+    push edx
+    push eax
+    call _dl_fixup
+    add esp, 8
+    pop edx
+    pop ecx
+    xchg eax, [esp]
+    ret 8
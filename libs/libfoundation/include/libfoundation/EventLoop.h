@@ -9,7 +9,9 @@
 #include <libfoundation/Event.h>
 #include <libfoundation/EventReceiver.h>
 #include <libfoundation/Receivers.h>
+#include <list>
 #include <memory>
+#include <sys/epoll.h>
 #include <vector>
 
 namespace LFoundation {
@@ -52,37 +54,53 @@ public:
 
     EventLoop();
 
-    inline void add(int fd, std::function<void(void)> on_read, std::function<void(void)> on_write)
-    {
-        m_waiting_fds.push_back(FDWaiter(fd, on_read, on_write));
-    }
+    void add(int fd, std::function<void(void)> on_read, std::function<void(void)> on_write);
+    void remove(int fd);
 
-    inline void add(const Timer& timer)
-    {
-        m_timers.push_back(timer);
-    }
+    void add(const Timer& timer);
+    void add(Timer&& timer);
 
-    inline void add(Timer&& timer)
+    inline void add(EventReceiver& rec, Event* ptr)
     {
-        m_timers.push_back(std::move(timer));
+        m_event_queue.push_back(QueuedEvent(rec, ptr));
     }
 
-    inline void add(EventReceiver& rec, Event* ptr)
+    // Handlers run at the end of every pump, before the loop may block.
+    inline void add_pump_end_handler(std::function<void(void)> handler)
     {
-        m_event_queue.push_back(QueuedEvent(rec, ptr));
+        m_pump_end_handlers.push_back(handler);
     }
 
     inline void stop(int exit_code) { m_exit_code = exit_code, m_stop_flag = true; }
-    void check_fds();
+    void check_fds(bool block);
     void check_timers();
     void pump();
     int run();
 
 private:
+    Timer* alloc_timer_slot();
+    inline bool timer_expires_before(Timer* a, Timer* b) const { return b->expired(a->m_expire_time); }
+    void timer_heap_push(Timer* timer);
+    Timer* timer_heap_pop();
+    int time_to_next_timer() const;
+    void dispatch_ready_fds();
+    void dispatch_fired_timers();
+
+    int m_epoll_fd { -1 };
     bool m_stop_flag { false };
     int m_exit_code { 0 };
-    std::vector<FDWaiter> m_waiting_fds;
-    std::vector<Timer> m_timers;
+    std::list<FDWaiter> m_waiting_fds;
+    // Ready fds and fired timers are called in place, they need no events.
+    std::vector<epoll_event_t> m_ready_fds;
+    // Timers stay in list nodes, the heap orders them by deadline, so
+    // sifting moves pointers and not the callbacks.
+    std::list<Timer> m_timers;
+    std::vector<Timer*> m_timer_heap;
+    std::vector<Timer*> m_free_timer_slots;
+    std::vector<Timer*> m_fired_timers;
+    // Swapped on every pump, so both keep their capacity.
     std::vector<QueuedEvent> m_event_queue;
+    std::vector<QueuedEvent> m_dispatch_queue;
+    std::vector<std::function<void(void)>> m_pump_end_handlers;
 };
 } // namespace LFoundation
\ No newline at end of file
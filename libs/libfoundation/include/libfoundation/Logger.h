@@ -1,11 +1,159 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
 #include <ostream>
+#include <string>
+#include <string_view>
+
+/**
+ * Statements of levels below LFOUNDATION_LOG_LEVEL are compiled out: their
+ * operator<< is empty and inlined, nothing is formatted or written.
+ * 0 keeps debug, 1 info, 2 error and 3 drops all of them.
+ */
+#ifndef LFOUNDATION_LOG_LEVEL
+#define LFOUNDATION_LOG_LEVEL 0
+#endif
 
 namespace LFoundation::Logger {
 
-extern std::ostream debug;
+enum class Level {
+    Debug = 0,
+    Info = 1,
+    Error = 2,
+    Off = 3,
+};
+
+// Levels below it are skipped at runtime, before any formatting.
+extern Level runtime_level;
+inline void set_level(Level level) { runtime_level = level; }
+inline Level level() { return runtime_level; }
+
+/**
+ * Collects a line and writes it with a single write() on std::endl, or
+ * earlier if the line doesn't fit. Sinks and streams are constant
+ * initialized, so static constructors of other files can log.
+ */
+class Sink {
+public:
+    static constexpr size_t BufferSize = 256;
+
+    constexpr explicit Sink(int fd)
+        : m_fd(fd)
+    {
+    }
+
+    void append(const char* str, size_t len);
+    void append_unsigned(unsigned long long value, bool negative);
+    void flush();
+
+private:
+    int m_fd;
+    size_t m_len { 0 };
+    char m_buf[BufferSize] {};
+};
+
+template <Level L>
+class Stream {
+public:
+    static constexpr bool compiled_in = (int)L >= LFOUNDATION_LOG_LEVEL;
+
+    constexpr explicit Stream(Sink& sink)
+        : m_sink(sink)
+    {
+    }
+
+    inline bool enabled() const
+    {
+        if constexpr (compiled_in) {
+            return L >= runtime_level;
+        }
+        return false;
+    }
+
+    inline Stream& operator<<(const char* str)
+    {
+        if (enabled()) {
+            m_sink.append(str, std::strlen(str));
+        }
+        return *this;
+    }
+
+    inline Stream& operator<<(char ch)
+    {
+        if (enabled()) {
+            m_sink.append(&ch, 1);
+        }
+        return *this;
+    }
+
+    inline Stream& operator<<(const std::string& str)
+    {
+        if (enabled()) {
+            m_sink.append(str.c_str(), str.size());
+        }
+        return *this;
+    }
+
+    inline Stream& operator<<(std::string_view str)
+    {
+        if (enabled()) {
+            m_sink.append(str.data(), str.size());
+        }
+        return *this;
+    }
+
+    inline Stream& operator<<(int value) { return put_signed(value); }
+    inline Stream& operator<<(long value) { return put_signed(value); }
+    inline Stream& operator<<(long long value) { return put_signed(value); }
+    inline Stream& operator<<(unsigned int value) { return put_unsigned(value); }
+    inline Stream& operator<<(unsigned long value) { return put_unsigned(value); }
+    inline Stream& operator<<(unsigned long long value) { return put_unsigned(value); }
+
+    template <typename T, typename = std::enable_if_t<__is_enum(T)>>
+    inline Stream& operator<<(T value) { return put_signed((long long)value); }
+
+    // std::endl ends the line, other manipulators flush what is collected.
+    inline Stream& operator<<(std::ostream& (*manip)(std::ostream&))
+    {
+        if (enabled()) {
+            if (manip == static_cast<std::ostream& (*)(std::ostream&)>(std::endl)) {
+                m_sink.append("\n", 1);
+            }
+            m_sink.flush();
+        }
+        return *this;
+    }
+
+private:
+    inline Stream& put_signed(long long value)
+    {
+        if (enabled()) {
+            bool negative = value < 0;
+            m_sink.append_unsigned(negative ? 0ull - (unsigned long long)value : (unsigned long long)value, negative);
+        }
+        return *this;
+    }
+
+    inline Stream& put_unsigned(unsigned long long value)
+    {
+        if (enabled()) {
+            m_sink.append_unsigned(value, false);
+        }
+        return *this;
+    }
+
+    Sink& m_sink;
+};
+
+extern Stream<Level::Debug> debug;
+extern Stream<Level::Info> info;
+extern Stream<Level::Error> error;
 
 } // namespace LFoundation::Logger
 
 namespace Logger {
 using LFoundation::Logger::debug;
-} // namespace Logger
\ No newline at end of file
+using LFoundation::Logger::error;
+using LFoundation::Logger::info;
+} // namespace Logger
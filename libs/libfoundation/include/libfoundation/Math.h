@@ -7,9 +7,31 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
 namespace LFoundation {
 
+/**
+ * Float routines for per-pixel and per-frame code. They are accurate to a
+ * few ulp over the ranges UI code works in, but skip what libm has to care
+ * about: no errno, denormal results are flushed to zero and sin/cos lose
+ * precision past a few thousand radians.
+ */
+
+[[gnu::always_inline]] inline uint32_t float_bits(float x)
+{
+    uint32_t bits;
+    __builtin_memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+[[gnu::always_inline]] inline float float_from_bits(uint32_t bits)
+{
+    float x;
+    __builtin_memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
 [[gnu::always_inline]] inline float fast_inv_sqrt(float x)
 {
     float xhalf = 0.5f * x;
@@ -20,9 +42,171 @@ namespace LFoundation {
     return x;
 }
 
+// Both FPUs have a square root instruction, which is exact and costs about
+// as much as the divide the estimate needed.
 [[gnu::always_inline]] inline float fast_sqrt(float x)
 {
+#ifdef __i386__
+    asm("fsqrt"
+        : "+t"(x));
+    return x;
+#elif __arm__
+    float res;
+    asm("vsqrt.f32 %0, %1"
+        : "=t"(res)
+        : "t"(x));
+    return res;
+#else
     return 1.0 / fast_inv_sqrt(x);
+#endif
+}
+
+namespace Detail {
+
+// Minimax polynomials of sin and cos on [-pi/4, pi/4], z is x * x.
+[[gnu::always_inline]] inline float sin_poly(float x, float z)
+{
+    return x + x * z * ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f);
+}
+
+[[gnu::always_inline]] inline float cos_poly(float z)
+{
+    return 1.0f - 0.5f * z + z * z * ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f);
+}
+
+// Reduces |x| to [-pi/4, pi/4] and returns the octant, pi/4 is split in
+// three parts so the subtraction stays exact.
+[[gnu::always_inline]] inline float reduce_octant(float x, uint32_t& octant)
+{
+    uint32_t j = (uint32_t)(x * 1.27323954473516f);
+    float y = (float)j;
+    if (j & 1) {
+        j++;
+        y += 1.0f;
+    }
+    octant = j & 7;
+    return ((x - y * 0.78515625f) - y * 2.4187564849853515625e-4f) - y * 3.77489497744594108e-8f;
+}
+
+} // namespace Detail
+
+inline float fast_sin(float x)
+{
+    float sign = 1.0f;
+    if (x < 0) {
+        x = -x;
+        sign = -1.0f;
+    }
+
+    uint32_t octant;
+    float r = Detail::reduce_octant(x, octant);
+    if (octant > 3) {
+        sign = -sign;
+        octant -= 4;
+    }
+
+    float z = r * r;
+    float res = (octant == 1 || octant == 2) ? Detail::cos_poly(z) : Detail::sin_poly(r, z);
+    return sign * res;
+}
+
+inline float fast_cos(float x)
+{
+    if (x < 0) {
+        x = -x;
+    }
+
+    uint32_t octant;
+    float r = Detail::reduce_octant(x, octant);
+    float sign = 1.0f;
+    if (octant > 3) {
+        sign = -sign;
+        octant -= 4;
+    }
+    if (octant > 1) {
+        sign = -sign;
+    }
+
+    float z = r * r;
+    float res = (octant == 1 || octant == 2) ? Detail::sin_poly(r, z) : Detail::cos_poly(z);
+    return sign * res;
+}
+
+// e^x = 2^k * e^r with |r| <= ln(2) / 2, 2^k is put into the exponent bits.
+inline float fast_exp(float x)
+{
+    if (x > 88.72283f) {
+        return __builtin_huge_valf();
+    }
+    if (x < -87.33654f) {
+        return 0.0f;
+    }
+
+    int k = (int)(x * 1.44269504088896341f + (x < 0 ? -0.5f : 0.5f));
+    float r = x - (float)k * 0.693359375f + (float)k * 2.12194440e-4f;
+    float z = r * r;
+    float p = (((((1.9875691500e-4f * r + 1.3981999507e-3f) * r + 8.3334519073e-3f) * r + 4.1665795894e-2f) * r + 1.6666665459e-1f) * r + 5.0000001201e-1f) * z + r + 1.0f;
+    return p * float_from_bits((uint32_t)(k + 127) << 23);
+}
+
+// ln(x) for x > 0: the mantissa is brought to [sqrt(1/2), sqrt(2)) and
+// the exponent is added back times ln(2).
+inline float fast_log(float x)
+{
+    uint32_t bits = float_bits(x);
+    int e = (int)((bits >> 23) & 0xff) - 127;
+    float m = float_from_bits((bits & 0x7fffff) | 0x3f800000);
+    if (m > 1.41421356f) {
+        m *= 0.5f;
+        e++;
+    }
+
+    float f = m - 1.0f;
+    float z = f * f;
+    float p = ((((((((7.0376836292e-2f * f - 1.1514610310e-1f) * f + 1.1676998740e-1f) * f - 1.2420140846e-1f) * f + 1.4249322787e-1f) * f - 1.6668057665e-1f) * f + 2.0000714765e-1f) * f - 2.4999993993e-1f) * f + 3.3333331174e-1f);
+    float y = f * z * p - 2.12194440e-4f * (float)e - 0.5f * z;
+    return f + y + 0.693359375f * (float)e;
+}
+
+// x^y for x >= 0, the error grows with |y * ln(x)|.
+inline float fast_pow(float x, float y)
+{
+    if (x <= 0) {
+        return y == 0 ? 1.0f : 0.0f;
+    }
+    return fast_exp(y * fast_log(x));
+}
+
+/**
+ * Batch variants for rows and tables, the constants stay in registers for
+ * the whole loop.
+ */
+inline void fast_sqrt(float* out, const float* in, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; i++) {
+        out[i] = fast_sqrt(in[i]);
+    }
+}
+
+inline void fast_sin(float* out, const float* in, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; i++) {
+        out[i] = fast_sin(in[i]);
+    }
+}
+
+inline void fast_cos(float* out, const float* in, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; i++) {
+        out[i] = fast_cos(in[i]);
+    }
+}
+
+inline void fast_exp(float* out, const float* in, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; i++) {
+        out[i] = fast_exp(in[i]);
+    }
 }
 
-} // namespace LFoundation
\ No newline at end of file
+} // namespace LFoundation
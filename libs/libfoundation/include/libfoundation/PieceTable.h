@@ -0,0 +1,488 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace LFoundation {
+
+/**
+ * Text as pieces of two buffers: the original text, which is never changed,
+ * and an append-only buffer of inserted text. An edit only adds or cuts
+ * pieces, so it costs the same in a multi-MB file as in a small one.
+ *
+ * Pieces are kept in a treap ordered by their position in the text, every
+ * node sums the bytes and newlines of its subtree. Both buffers keep the
+ * offsets of their newlines, so finding a line start, the line of an offset
+ * and a byte are O(log n) too.
+ *
+ * It needs nothing of libc++, so small tools can use it as well.
+ */
+class PieceTable {
+public:
+    PieceTable() = default;
+
+    PieceTable(const char* data, size_t len)
+    {
+        set_text(data, len);
+    }
+
+    ~PieceTable()
+    {
+        for (int i = 0; i < BufferCount; i++) {
+            free(m_buffers[i].data);
+            free(m_buffers[i].newlines.data);
+        }
+        free(m_nodes.data);
+    }
+
+    PieceTable(const PieceTable&) = delete;
+    PieceTable& operator=(const PieceTable&) = delete;
+
+    void set_text(const char* data, size_t len)
+    {
+        for (int i = 0; i < BufferCount; i++) {
+            m_buffers[i].size = 0;
+            m_buffers[i].newlines.size = 0;
+        }
+        m_nodes.size = 0;
+        m_free_node = -1;
+        m_root = -1;
+
+        append_to_buffer(Original, data, len);
+        if (len) {
+            reserve_nodes(1);
+            m_root = new_node(Original, 0, len);
+        }
+    }
+
+    size_t size() const { return m_root < 0 ? 0 : node(m_root).subtree_len; }
+    size_t line_count() const { return (m_root < 0 ? 0 : node(m_root).subtree_newlines) + 1; }
+
+    void insert(size_t offset, const char* data, size_t len)
+    {
+        if (!len || offset > size()) {
+            return;
+        }
+
+        size_t start = m_buffers[Added].size;
+        append_to_buffer(Added, data, len);
+
+        // Typing appends to the piece which ends right at the cursor.
+        if (offset && extend_piece(m_root, offset, start, len)) {
+            return;
+        }
+
+        reserve_nodes(2);
+        int left, right;
+        split(m_root, offset, left, right);
+        m_root = merge(merge(left, new_node(Added, start, len)), right);
+    }
+
+    void erase(size_t offset, size_t len)
+    {
+        if (offset >= size()) {
+            return;
+        }
+        if (len > size() - offset) {
+            len = size() - offset;
+        }
+
+        reserve_nodes(2);
+        int left, middle, right, rest;
+        split(m_root, offset, left, rest);
+        split(rest, len, middle, right);
+        free_subtree(middle);
+        m_root = merge(left, right);
+    }
+
+    char at(size_t offset) const
+    {
+        int t = m_root;
+        while (t >= 0) {
+            const Node& n = node(t);
+            size_t left_len = subtree_len(n.left);
+            if (offset < left_len) {
+                t = n.left;
+            } else if (offset < left_len + n.length) {
+                return m_buffers[n.buffer].data[n.start + offset - left_len];
+            } else {
+                offset -= left_len + n.length;
+                t = n.right;
+            }
+        }
+        return '\0';
+    }
+
+    // The offset of the first byte of the line, or size() past the last one.
+    size_t line_start(size_t line) const
+    {
+        if (!line) {
+            return 0;
+        }
+
+        size_t base = 0;
+        int t = m_root;
+        while (t >= 0) {
+            const Node& n = node(t);
+            size_t left_newlines = subtree_newlines(n.left);
+            if (line <= left_newlines) {
+                t = n.left;
+                continue;
+            }
+
+            base += subtree_len(n.left);
+            line -= left_newlines;
+            if (line <= n.newlines) {
+                const Buffer& buf = m_buffers[n.buffer];
+                size_t newline = buf.newlines.data[first_newline(buf, n.start) + line - 1];
+                return base + newline - n.start + 1;
+            }
+            line -= n.newlines;
+            base += n.length;
+            t = n.right;
+        }
+        return size();
+    }
+
+    size_t line_of(size_t offset) const
+    {
+        size_t line = 0;
+        int t = m_root;
+        while (t >= 0) {
+            const Node& n = node(t);
+            size_t left_len = subtree_len(n.left);
+            if (offset < left_len) {
+                t = n.left;
+            } else if (offset < left_len + n.length) {
+                const Buffer& buf = m_buffers[n.buffer];
+                size_t from = first_newline(buf, n.start);
+                return line + subtree_newlines(n.left) + first_newline(buf, n.start + offset - left_len) - from;
+            } else {
+                line += subtree_newlines(n.left) + n.newlines;
+                offset -= left_len + n.length;
+                t = n.right;
+            }
+        }
+        return line;
+    }
+
+    // The length of the line without its newline.
+    size_t line_length(size_t line) const
+    {
+        size_t start = line_start(line);
+        size_t end = line_start(line + 1);
+        if (line + 1 < line_count()) {
+            end--;
+        }
+        return end - start;
+    }
+
+    // Calls callback(data, len) for the parts of [offset, offset + len) in
+    // order. The data stays valid until the next insert().
+    template <typename Callback>
+    void for_each_chunk(size_t offset, size_t len, Callback callback) const
+    {
+        if (len) {
+            walk(m_root, offset, offset + len, callback);
+        }
+    }
+
+    // Returns the count of bytes copied.
+    size_t copy_to(size_t offset, char* out, size_t len) const
+    {
+        size_t copied = 0;
+        for_each_chunk(offset, len, [&](const char* data, size_t chunk_len) {
+            memcpy(out + copied, data, chunk_len);
+            copied += chunk_len;
+        });
+        return copied;
+    }
+
+private:
+    enum BufferId : uint8_t {
+        Original,
+        Added,
+        BufferCount,
+    };
+
+    template <typename T>
+    struct Array {
+        T* data { nullptr };
+        size_t size { 0 };
+        size_t capacity { 0 };
+
+        void reserve(size_t count)
+        {
+            if (size + count <= capacity) {
+                return;
+            }
+            size_t new_capacity = capacity ? capacity * 2 : 16;
+            while (new_capacity < size + count) {
+                new_capacity *= 2;
+            }
+            data = (T*)realloc(data, new_capacity * sizeof(T));
+            capacity = new_capacity;
+        }
+
+        void push(const T& val)
+        {
+            reserve(1);
+            data[size++] = val;
+        }
+    };
+
+    struct Buffer {
+        char* data { nullptr };
+        size_t size { 0 };
+        size_t capacity { 0 };
+        Array<size_t> newlines;
+    };
+
+    struct Node {
+        size_t start;
+        size_t length;
+        size_t newlines;
+        size_t subtree_len;
+        size_t subtree_newlines;
+        uint32_t priority;
+        int left;
+        int right;
+        BufferId buffer;
+    };
+
+    const Node& node(int t) const { return m_nodes.data[t]; }
+    Node& node(int t) { return m_nodes.data[t]; }
+    size_t subtree_len(int t) const { return t < 0 ? 0 : node(t).subtree_len; }
+    size_t subtree_newlines(int t) const { return t < 0 ? 0 : node(t).subtree_newlines; }
+
+    // The index of the first newline of the buffer at or after offset.
+    static size_t first_newline(const Buffer& buf, size_t offset)
+    {
+        size_t lo = 0;
+        size_t hi = buf.newlines.size;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (buf.newlines.data[mid] < offset) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    size_t count_newlines(BufferId id, size_t start, size_t length) const
+    {
+        const Buffer& buf = m_buffers[id];
+        return first_newline(buf, start + length) - first_newline(buf, start);
+    }
+
+    void append_to_buffer(BufferId id, const char* data, size_t len)
+    {
+        Buffer& buf = m_buffers[id];
+        if (buf.size + len > buf.capacity) {
+            size_t new_capacity = buf.capacity ? buf.capacity * 2 : 4096;
+            while (new_capacity < buf.size + len) {
+                new_capacity *= 2;
+            }
+            buf.data = (char*)realloc(buf.data, new_capacity);
+            buf.capacity = new_capacity;
+        }
+
+        for (size_t i = 0; i < len; i++) {
+            if (data[i] == '\n') {
+                buf.newlines.push(buf.size + i);
+            }
+        }
+        memcpy(buf.data + buf.size, data, len);
+        buf.size += len;
+    }
+
+    // Nodes are taken only after reserve_nodes(), so references into the
+    // pool stay valid within an edit.
+    void reserve_nodes(size_t count)
+    {
+        size_t free_count = 0;
+        for (int t = m_free_node; t >= 0 && free_count < count; t = node(t).left) {
+            free_count++;
+        }
+        if (free_count < count) {
+            m_nodes.reserve(count - free_count);
+        }
+    }
+
+    int new_node(BufferId buffer, size_t start, size_t length)
+    {
+        int t = m_free_node;
+        if (t >= 0) {
+            m_free_node = node(t).left;
+        } else {
+            t = m_nodes.size++;
+        }
+
+        // xorshift, the treap only needs the priorities to look random.
+        m_seed ^= m_seed << 13;
+        m_seed ^= m_seed >> 17;
+        m_seed ^= m_seed << 5;
+
+        Node& n = node(t);
+        n.buffer = buffer;
+        n.start = start;
+        n.length = length;
+        n.newlines = count_newlines(buffer, start, length);
+        n.priority = m_seed;
+        n.left = n.right = -1;
+        update(t);
+        return t;
+    }
+
+    void free_subtree(int t)
+    {
+        if (t < 0) {
+            return;
+        }
+        free_subtree(node(t).left);
+        free_subtree(node(t).right);
+        node(t).left = m_free_node;
+        m_free_node = t;
+    }
+
+    void update(int t)
+    {
+        Node& n = node(t);
+        n.subtree_len = subtree_len(n.left) + n.length + subtree_len(n.right);
+        n.subtree_newlines = subtree_newlines(n.left) + n.newlines + subtree_newlines(n.right);
+    }
+
+    // Splits the tree so the left one has offset bytes, a piece across the
+    // offset is cut in two.
+    void split(int t, size_t offset, int& left, int& right)
+    {
+        if (t < 0) {
+            left = right = -1;
+            return;
+        }
+
+        size_t left_len = subtree_len(node(t).left);
+        if (offset <= left_len) {
+            int l, r;
+            split(node(t).left, offset, l, r);
+            node(t).left = r;
+            update(t);
+            left = l;
+            right = t;
+        } else if (offset >= left_len + node(t).length) {
+            int l, r;
+            split(node(t).right, offset - left_len - node(t).length, l, r);
+            node(t).right = l;
+            update(t);
+            left = t;
+            right = r;
+        } else {
+            size_t cut = offset - left_len;
+            int tail = new_node(node(t).buffer, node(t).start + cut, node(t).length - cut);
+            Node& n = node(t);
+            Node& tail_node = node(tail);
+            // The tail takes the priority of the piece, which is above the
+            // one of any node in its right subtree.
+            tail_node.priority = n.priority;
+            tail_node.right = n.right;
+            n.right = -1;
+            n.length = cut;
+            n.newlines -= tail_node.newlines;
+            update(tail);
+            update(t);
+            left = t;
+            right = tail;
+        }
+    }
+
+    int merge(int left, int right)
+    {
+        if (left < 0) {
+            return right;
+        }
+        if (right < 0) {
+            return left;
+        }
+
+        if (node(left).priority >= node(right).priority) {
+            node(left).right = merge(node(left).right, right);
+            update(left);
+            return left;
+        }
+        node(right).left = merge(left, node(right).left);
+        update(right);
+        return right;
+    }
+
+    bool extend_piece(int t, size_t offset, size_t start, size_t len)
+    {
+        if (t < 0) {
+            return false;
+        }
+
+        Node& n = node(t);
+        size_t left_len = subtree_len(n.left);
+        bool extended;
+        if (offset <= left_len) {
+            extended = extend_piece(n.left, offset, start, len);
+        } else if (offset == left_len + n.length) {
+            extended = n.buffer == Added && n.start + n.length == start;
+            if (extended) {
+                n.length += len;
+                n.newlines += count_newlines(Added, start, len);
+            }
+        } else if (offset > left_len + n.length) {
+            extended = extend_piece(n.right, offset - left_len - n.length, start, len);
+        } else {
+            extended = false;
+        }
+
+        if (extended) {
+            update(t);
+        }
+        return extended;
+    }
+
+    template <typename Callback>
+    void walk(int t, size_t from, size_t to, Callback& callback) const
+    {
+        if (t < 0 || from >= to) {
+            return;
+        }
+
+        const Node& n = node(t);
+        size_t left_len = subtree_len(n.left);
+        if (from < left_len) {
+            walk(n.left, from, to < left_len ? to : left_len, callback);
+        }
+
+        size_t piece_from = from > left_len ? from - left_len : 0;
+        size_t piece_to = to - left_len < n.length ? to - left_len : n.length;
+        if (to > left_len && piece_from < piece_to) {
+            callback(m_buffers[n.buffer].data + n.start + piece_from, piece_to - piece_from);
+        }
+
+        size_t right_start = left_len + n.length;
+        if (to > right_start) {
+            walk(n.right, from > right_start ? from - right_start : 0, to - right_start, callback);
+        }
+    }
+
+    Buffer m_buffers[BufferCount];
+    Array<Node> m_nodes;
+    int m_free_node { -1 };
+    int m_root { -1 };
+    uint32_t m_seed { 2463534242 };
+};
+
+} // namespace LFoundation
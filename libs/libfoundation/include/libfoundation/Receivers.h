@@ -71,9 +71,13 @@ public:
     void receive_event(std::unique_ptr<Event> event) override
     {
         if (event->type() == Event::Type::FdWaiterRead) {
-            m_on_read();
+            if (m_on_read) {
+                m_on_read();
+            }
         } else if (event->type() == Event::Type::FdWaiterWrite) {
-            m_on_write();
+            if (m_on_write) {
+                m_on_write();
+            }
         }
     }
 
@@ -85,15 +89,6 @@ private:
     std::function<void(void)> m_on_write;
 };
 
-class TimerEvent final : public Event {
-public:
-    TimerEvent()
-        : Event(Event::Type::DeferredInvoke)
-    {
-    }
-    ~TimerEvent() = default;
-};
-
 class Timer : public EventReceiver {
 public:
     static const bool Once = false;
@@ -129,15 +124,22 @@ public:
     {
     }
 
+    // Slots of the event loop are reused, so the whole timer is copied.
     Timer& operator=(const Timer& fdw)
     {
         m_callback = fdw.m_callback;
+        m_time_interval = fdw.m_time_interval;
+        m_repeat = fdw.m_repeat;
+        m_expire_time = fdw.m_expire_time;
         return *this;
     }
 
     Timer& operator=(Timer&& fdw)
     {
         m_callback = fdw.m_callback;
+        m_time_interval = fdw.m_time_interval;
+        m_repeat = fdw.m_repeat;
+        m_expire_time = fdw.m_expire_time;
         return *this;
     }
 
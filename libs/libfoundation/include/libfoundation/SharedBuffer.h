@@ -47,12 +47,22 @@ public:
         }
     }
 
+    // Keeps the id, so processes which got the buffer could get it again.
     inline void resize(size_t new_size)
     {
-        free();
-        create(new_size);
+        if (!alive()) {
+            create(new_size);
+            return;
+        }
+        if (shared_buffer_resize(m_id, (uint8_t**)&m_data, new_size * sizeof(T)) == 0) {
+            m_size = new_size;
+        }
     }
 
+    // Other processes get the sealed buffer read-only, and it can't be
+    // resized anymore.
+    inline bool seal() { return alive() && shared_buffer_seal(m_id) == 0; }
+
     inline bool alive() const { return m_id >= 0; }
 
     inline const T& at(size_t i) const { return data()[i]; }
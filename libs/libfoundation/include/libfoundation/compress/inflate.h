@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Table-driven inflater which writes into a buffer of a known size. Input
+ * may come in pieces: once the current one is used up, refill() is asked
+ * for the next and returns 0 if there is none. The input is read a few
+ * bytes ahead, so what follows the stream is not left at in.
+ */
+typedef int (*inflate_refill_t)(void* ctx, const unsigned char** in, size_t* in_len);
+
+struct inflate_stream {
+    const unsigned char* in;
+    size_t in_len;
+    inflate_refill_t refill;
+    void* refill_ctx;
+
+    unsigned char* out;
+    size_t out_len;
+    size_t out_pos;
+
+    uint32_t bitbuf;
+    int bitcnt;
+    int overrun;
+};
+typedef struct inflate_stream inflate_stream_t;
+
+#define INFLATE_OK 0
+#define INFLATE_ERR_INPUT -1 /* input ended before the last block */
+#define INFLATE_ERR_OUTPUT -2 /* output doesn't fit into out_len */
+#define INFLATE_ERR_DATA -3 /* the stream is malformed */
+
+/* Inflates a raw deflate stream. */
+int inflate_raw(inflate_stream_t* stream);
+
+/* Inflates a zlib stream, its adler32 is not checked. */
+int inflate_zlib(inflate_stream_t* stream);
+
+#ifdef __cplusplus
+}
+#endif
@@ -10,9 +10,7 @@
 #include <libfoundation/EventLoop.h>
 #include <libfoundation/Logger.h>
 #include <memory>
-#include <sched.h>
-#include <sys/select.h>
-#include <sys/time.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 
 namespace LFoundation {
@@ -22,85 +20,232 @@ EventLoop* s_LFoundation_EventLoop_the = nullptr;
 EventLoop::EventLoop()
 {
     s_LFoundation_EventLoop_the = this;
+    m_epoll_fd = epoll_create();
 }
 
-void EventLoop::check_fds()
+// The fd is registered in the kernel once, check_fds() only collects the
+// ready ones.
+void EventLoop::add(int fd, std::function<void(void)> on_read, std::function<void(void)> on_write)
 {
-    if (m_waiting_fds.size() == 0) {
-        return;
+    m_waiting_fds.push_back(FDWaiter(fd, on_read, on_write));
+
+    epoll_event_t event;
+    event.events = (on_read ? EPOLLIN : 0) | (on_write ? EPOLLOUT : 0);
+    event.data = (uint32_t)&m_waiting_fds.back();
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+// Queued events may still point to the waiter, so it is only disarmed
+// here and dropped by the next check_fds().
+void EventLoop::remove(int fd)
+{
+    for (auto& waiter : m_waiting_fds) {
+        if (waiter.fd() == fd) {
+            waiter.m_on_read = nullptr;
+            waiter.m_on_write = nullptr;
+        }
+    }
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+Timer* EventLoop::alloc_timer_slot()
+{
+    if (!m_free_timer_slots.empty()) {
+        Timer* slot = m_free_timer_slots.back();
+        m_free_timer_slots.pop_back();
+        return slot;
+    }
+    return nullptr;
+}
+
+void EventLoop::add(const Timer& timer)
+{
+    Timer* slot = alloc_timer_slot();
+    if (!slot) {
+        m_timers.push_back(timer);
+        slot = &m_timers.back();
+    } else {
+        *slot = timer;
     }
-    fd_set_t readfds;
-    fd_set_t writefds;
-    FD_ZERO(&readfds);
-    FD_ZERO(&writefds);
-    int nfds = -1;
-    for (int i = 0; i < m_waiting_fds.size(); i++) {
-        if (m_waiting_fds[i].m_on_read) {
-            FD_SET(m_waiting_fds[i].m_fd, &readfds);
+    timer_heap_push(slot);
+}
+
+void EventLoop::add(Timer&& timer)
+{
+    Timer* slot = alloc_timer_slot();
+    if (!slot) {
+        m_timers.push_back(std::move(timer));
+        slot = &m_timers.back();
+    } else {
+        *slot = std::move(timer);
+    }
+    timer_heap_push(slot);
+}
+
+void EventLoop::timer_heap_push(Timer* timer)
+{
+    size_t i = m_timer_heap.size();
+    m_timer_heap.push_back(timer);
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!timer_expires_before(m_timer_heap[i], m_timer_heap[parent])) {
+            break;
         }
-        if (m_waiting_fds[i].m_on_write) {
-            FD_SET(m_waiting_fds[i].m_fd, &writefds);
+        std::swap(m_timer_heap[i], m_timer_heap[parent]);
+        i = parent;
+    }
+}
+
+Timer* EventLoop::timer_heap_pop()
+{
+    Timer* top = m_timer_heap[0];
+    m_timer_heap[0] = m_timer_heap.back();
+    m_timer_heap.pop_back();
+
+    size_t i = 0;
+    size_t size = m_timer_heap.size();
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < size && timer_expires_before(m_timer_heap[left], m_timer_heap[smallest])) {
+            smallest = left;
+        }
+        if (right < size && timer_expires_before(m_timer_heap[right], m_timer_heap[smallest])) {
+            smallest = right;
         }
-        if (nfds < m_waiting_fds[i].m_fd) {
-            nfds = m_waiting_fds[i].m_fd;
+        if (smallest == i) {
+            break;
         }
+        std::swap(m_timer_heap[i], m_timer_heap[smallest]);
+        i = smallest;
     }
+    return top;
+}
 
-    // For now, that means, that we don't wait for fds.
-    timeval_t timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
+// Milliseconds left to the earliest timer, or -1 if there are no timers.
+int EventLoop::time_to_next_timer() const
+{
+    if (m_timer_heap.empty()) {
+        return -1;
+    }
 
-    int res = select(nfds + 1, &readfds, &writefds, nullptr, &timeout);
+    std::timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
 
-    for (int i = 0; i < m_waiting_fds.size(); i++) {
-        if (m_waiting_fds[i].m_on_read) {
-            if (FD_ISSET(m_waiting_fds[i].m_fd, &readfds)) {
-                m_event_queue.push_back(QueuedEvent(m_waiting_fds[i], new FDWaiterReadEvent()));
-            }
-        }
-        if (m_waiting_fds[i].m_on_write) {
-            if (FD_ISSET(m_waiting_fds[i].m_fd, &writefds)) {
-                m_event_queue.push_back(QueuedEvent(m_waiting_fds[i], new FDWaiterWriteEvent()));
-            }
+    const Timer* earliest = m_timer_heap[0];
+    if (earliest->expired(now)) {
+        return 0;
+    }
+
+    long nsec = earliest->m_expire_time.tv_nsec - now.tv_nsec;
+    long sec = earliest->m_expire_time.tv_sec - now.tv_sec;
+    return sec * 1000 + (nsec + 999999) / 1000000;
+}
+
+// With block set, waits until an fd is ready or the earliest timer is due,
+// instead of polling.
+void EventLoop::check_fds(bool block)
+{
+    // No fd events are queued at this point, so removed waiters can go.
+    for (auto it = m_waiting_fds.begin(); it != m_waiting_fds.end();) {
+        if (!it->m_on_read && !it->m_on_write) {
+            it = m_waiting_fds.erase(it);
+        } else {
+            ++it;
         }
     }
+
+    int timeout = block ? time_to_next_timer() : 0;
+
+    // Without fds there is only a timer to sleep for, an endless wait
+    // could never end.
+    if (m_waiting_fds.size() == 0 && timeout <= 0) {
+        return;
+    }
+
+    epoll_event_t events[32];
+    int res = epoll_wait(m_epoll_fd, events, sizeof(events) / sizeof(events[0]), timeout);
+    for (int i = 0; i < res; i++) {
+        m_ready_fds.push_back(events[i]);
+    }
 }
 
+// Takes the expired timers off the heap, they are fired by pump() right
+// after the queued events.
 void EventLoop::check_timers()
 {
-    if (m_timers.empty()) {
+    if (m_timer_heap.empty()) {
         return;
     }
 
     std::timespec tp;
     clock_gettime(CLOCK_MONOTONIC, &tp);
 
-    for (auto& timer : m_timers) {
-        if (!timer.expired(tp)) {
-            continue;
+    while (!m_timer_heap.empty() && m_timer_heap[0]->expired(tp)) {
+        m_fired_timers.push_back(timer_heap_pop());
+    }
+
+    // Reloaded only now, so a short interval doesn't fire twice in a pump.
+    for (size_t i = 0; i < m_fired_timers.size(); i++) {
+        Timer* timer = m_fired_timers[i];
+        if (timer->repeated()) {
+            timer->reload(tp);
+            timer_heap_push(timer);
         }
+    }
+}
 
-        m_event_queue.push_back(QueuedEvent(timer, new TimerEvent()));
+// The waiters stay in m_waiting_fds till the next check_fds(), even if
+// a callback removes them.
+void EventLoop::dispatch_ready_fds()
+{
+    for (size_t i = 0; i < m_ready_fds.size(); i++) {
+        auto& waiter = *(FDWaiter*)m_ready_fds[i].data;
+        if (waiter.m_on_read && (m_ready_fds[i].events & EPOLLIN)) {
+            waiter.m_on_read();
+        }
+        if (waiter.m_on_write && (m_ready_fds[i].events & EPOLLOUT)) {
+            waiter.m_on_write();
+        }
+    }
+    m_ready_fds.clear_remain_capacity();
+}
 
-        if (timer.repeated()) {
-            timer.reload(tp);
+// List nodes don't move, so callbacks are called in place even if they
+// add timers. One-shot slots are given back only after all of them ran.
+void EventLoop::dispatch_fired_timers()
+{
+    for (size_t i = 0; i < m_fired_timers.size(); i++) {
+        m_fired_timers[i]->m_callback();
+    }
+    for (size_t i = 0; i < m_fired_timers.size(); i++) {
+        if (!m_fired_timers[i]->repeated()) {
+            m_free_timer_slots.push_back(m_fired_timers[i]);
         }
     }
+    m_fired_timers.clear_remain_capacity();
 }
 
 [[gnu::flatten]] void EventLoop::pump()
 {
-    check_fds();
+    // Events queued while dispatching the previous ones go without a wait.
+    check_fds(m_event_queue.empty());
     check_timers();
-    std::vector<QueuedEvent> events_to_dispatch(std::move(m_event_queue));
-    m_event_queue.clear();
-    for (auto& event : events_to_dispatch) {
+
+    // Events queued by the handlers go to the other buffer and wait for
+    // the next pump.
+    std::swap(m_event_queue, m_dispatch_queue);
+    for (auto& event : m_dispatch_queue) {
         event.receiver.receive_event(std::move(event.event));
     }
+    m_dispatch_queue.clear_remain_capacity();
+
+    dispatch_ready_fds();
+    dispatch_fired_timers();
 
-    if (!events_to_dispatch.size()) {
-        sched_yield();
+    for (size_t i = 0; i < m_pump_end_handlers.size(); i++) {
+        m_pump_end_handlers[i]();
     }
 }
 
@@ -1,32 +1,57 @@
-#include <libfoundation/helpers/LoggerStreamBuf.h>
-#include <ostream>
-
-namespace LFoundation {
-
-namespace Logger {
-    _ALIGNAS_TYPE(std::ostream)
-    char debug[sizeof(std::ostream)];
-    _ALIGNAS_TYPE(std::ostream)
-    char info[sizeof(std::ostream)];
-    _ALIGNAS_TYPE(std::ostream)
-    char error[sizeof(std::ostream)];
-};
-
-class LoggerInit final {
-public:
-    LoggerInit()
-    {
-        m_ldebug_ptr = new (Logger::debug) std::ostream(new Logger::StreamBuf(stdout));
-    };
-
-    ~LoggerInit()
-    {
+#include <algorithm>
+#include <libfoundation/Logger.h>
+#include <unistd.h>
+
+namespace LFoundation::Logger {
+
+Level runtime_level = Level::Debug;
+
+static Sink stdout_sink(STDOUT_FILENO);
+static Sink stderr_sink(STDERR_FILENO);
+
+Stream<Level::Debug> debug(stdout_sink);
+Stream<Level::Info> info(stdout_sink);
+Stream<Level::Error> error(stderr_sink);
+
+void Sink::append(const char* str, size_t len)
+{
+    while (len) {
+        if (m_len == BufferSize) {
+            flush();
+        }
+        size_t chunk = std::min(len, BufferSize - m_len);
+        std::memcpy(&m_buf[m_len], str, chunk);
+        m_len += chunk;
+        str += chunk;
+        len -= chunk;
     }
+}
 
-private:
-    std::ostream* m_ldebug_ptr;
-};
+void Sink::append_unsigned(unsigned long long value, bool negative)
+{
+    char buf[24];
+    size_t pos = sizeof(buf);
+    do {
+        buf[--pos] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    if (negative) {
+        buf[--pos] = '-';
+    }
+    append(&buf[pos], sizeof(buf) - pos);
+}
 
-static LoggerInit logger_init;
+void Sink::flush()
+{
+    size_t done = 0;
+    while (done < m_len) {
+        int res = write(m_fd, &m_buf[done], m_len - done);
+        if (res <= 0) {
+            break;
+        }
+        done += res;
+    }
+    m_len = 0;
+}
 
-}
\ No newline at end of file
+} // namespace LFoundation::Logger
@@ -0,0 +1,438 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libfoundation/compress/inflate.h>
+#include <string.h>
+
+/*
+ * Codes of up to FAST_BITS bits are decoded with one lookup in fast[], it
+ * keeps (length << 9) | symbol at every index which starts with the code,
+ * bits reversed. Longer codes are found by their canonical order.
+ */
+#define FAST_BITS 9
+#define FAST_MASK ((1 << FAST_BITS) - 1)
+#define MAX_BITS 15
+#define MAX_LCODES 288
+#define MAX_DCODES 30
+
+struct huffman {
+    uint16_t fast[1 << FAST_BITS];
+    uint16_t first_code[MAX_BITS + 1];
+    uint16_t first_symbol[MAX_BITS + 1];
+    int max_code[MAX_BITS + 2];
+    uint8_t size[MAX_LCODES];
+    uint16_t value[MAX_LCODES];
+};
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+/**
+ * BITS
+ */
+
+/* Past the end of input the stream reads zeros, overrun counts them. */
+static inline int _inflate_next_byte(inflate_stream_t* s)
+{
+    if (!s->in_len) {
+        if (!s->refill || !s->refill(s->refill_ctx, &s->in, &s->in_len) || !s->in_len) {
+            s->overrun++;
+            return 0;
+        }
+    }
+    s->in_len--;
+    return *s->in++;
+}
+
+static inline void _inflate_fill(inflate_stream_t* s, int need)
+{
+    while (s->bitcnt < need) {
+        s->bitbuf |= (uint32_t)_inflate_next_byte(s) << s->bitcnt;
+        s->bitcnt += 8;
+    }
+}
+
+static inline int _inflate_bits(inflate_stream_t* s, int need)
+{
+    if (!need) {
+        return 0;
+    }
+    _inflate_fill(s, need);
+    int val = s->bitbuf & ((1u << need) - 1);
+    s->bitbuf >>= need;
+    s->bitcnt -= need;
+    return val;
+}
+
+/* Zeros read past the end of input must not be used. */
+static inline int _inflate_overran(inflate_stream_t* s)
+{
+    return s->overrun * 8 > s->bitcnt;
+}
+
+/**
+ * HUFFMAN
+ */
+
+static inline int _bit_reverse(int code, int bits)
+{
+    int res = 0;
+    for (int i = 0; i < bits; i++) {
+        res = (res << 1) | (code & 1);
+        code >>= 1;
+    }
+    return res;
+}
+
+static int _huffman_build(struct huffman* h, const uint8_t* lengths, int count)
+{
+    int sizes[MAX_BITS + 1];
+    int next_code[MAX_BITS + 1];
+    memset(sizes, 0, sizeof(sizes));
+    memset(h->fast, 0, sizeof(h->fast));
+    for (int i = 0; i < count; i++) {
+        sizes[lengths[i]]++;
+    }
+    sizes[0] = 0;
+
+    int code = 0;
+    int symbol = 0;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        next_code[len] = code;
+        h->first_code[len] = code;
+        h->first_symbol[len] = symbol;
+        code += sizes[len];
+        if (sizes[len] && code - 1 >= (1 << len)) {
+            return INFLATE_ERR_DATA;
+        }
+        /* Shifted to compare with 16 reversed bits of input. */
+        h->max_code[len] = code << (16 - len);
+        code <<= 1;
+        symbol += sizes[len];
+    }
+    h->max_code[MAX_BITS + 1] = 0x10000;
+
+    for (int i = 0; i < count; i++) {
+        int len = lengths[i];
+        if (!len) {
+            continue;
+        }
+
+        int pos = next_code[len] - h->first_code[len] + h->first_symbol[len];
+        h->size[pos] = len;
+        h->value[pos] = i;
+        if (len <= FAST_BITS) {
+            uint16_t entry = (len << 9) | i;
+            for (int j = _bit_reverse(next_code[len], len); j < (1 << FAST_BITS); j += (1 << len)) {
+                h->fast[j] = entry;
+            }
+        }
+        next_code[len]++;
+    }
+    return INFLATE_OK;
+}
+
+static int _huffman_decode_slow(inflate_stream_t* s, const struct huffman* h)
+{
+    int k = _bit_reverse(s->bitbuf & 0xffff, 16);
+    int len;
+    for (len = FAST_BITS + 1; k >= h->max_code[len]; len++) { }
+    if (len > MAX_BITS) {
+        return -1;
+    }
+
+    int pos = (k >> (16 - len)) - h->first_code[len] + h->first_symbol[len];
+    if (pos >= MAX_LCODES || h->size[pos] != len) {
+        return -1;
+    }
+    s->bitbuf >>= len;
+    s->bitcnt -= len;
+    return h->value[pos];
+}
+
+static inline int _huffman_decode(inflate_stream_t* s, const struct huffman* h)
+{
+    _inflate_fill(s, 16);
+    int entry = h->fast[s->bitbuf & FAST_MASK];
+    if (entry) {
+        int len = entry >> 9;
+        s->bitbuf >>= len;
+        s->bitcnt -= len;
+        return entry & 511;
+    }
+    return _huffman_decode_slow(s, h);
+}
+
+/**
+ * BLOCKS
+ */
+
+static int _inflate_stored(inflate_stream_t* s)
+{
+    _inflate_bits(s, s->bitcnt & 7);
+    int len = _inflate_bits(s, 16);
+    int nlen = _inflate_bits(s, 16);
+    if (len != (~nlen & 0xffff)) {
+        return INFLATE_ERR_DATA;
+    }
+    if (s->out_len - s->out_pos < (size_t)len) {
+        return INFLATE_ERR_OUTPUT;
+    }
+
+    /* Whole bytes left in the bit buffer go first. */
+    while (len && s->bitcnt) {
+        s->out[s->out_pos++] = _inflate_bits(s, 8);
+        len--;
+    }
+    if (_inflate_overran(s)) {
+        return INFLATE_ERR_INPUT;
+    }
+
+    while (len) {
+        if (!s->in_len && (!s->refill || !s->refill(s->refill_ctx, &s->in, &s->in_len) || !s->in_len)) {
+            return INFLATE_ERR_INPUT;
+        }
+        size_t chunk = s->in_len < (size_t)len ? s->in_len : (size_t)len;
+        memcpy(s->out + s->out_pos, s->in, chunk);
+        s->out_pos += chunk;
+        s->in += chunk;
+        s->in_len -= chunk;
+        len -= chunk;
+    }
+    return INFLATE_OK;
+}
+
+static int _inflate_codes(inflate_stream_t* s, const struct huffman* lencode, const struct huffman* distcode)
+{
+    for (;;) {
+        int symbol = _huffman_decode(s, lencode);
+        if (symbol < 256) {
+            if (symbol < 0) {
+                return INFLATE_ERR_DATA;
+            }
+            if (s->out_pos >= s->out_len) {
+                return INFLATE_ERR_OUTPUT;
+            }
+            s->out[s->out_pos++] = symbol;
+            continue;
+        }
+
+        if (symbol == 256) {
+            return _inflate_overran(s) ? INFLATE_ERR_INPUT : INFLATE_OK;
+        }
+
+        symbol -= 257;
+        if (symbol >= 29) {
+            return INFLATE_ERR_DATA;
+        }
+        size_t len = length_base[symbol] + _inflate_bits(s, length_extra[symbol]);
+
+        symbol = _huffman_decode(s, distcode);
+        if (symbol < 0 || symbol >= MAX_DCODES) {
+            return INFLATE_ERR_DATA;
+        }
+        size_t dist = dist_base[symbol] + _inflate_bits(s, dist_extra[symbol]);
+        if (dist > s->out_pos) {
+            return INFLATE_ERR_DATA;
+        }
+        if (s->out_len - s->out_pos < len) {
+            return INFLATE_ERR_OUTPUT;
+        }
+
+        /* The window is the output itself. The copy may overlap with what
+           it writes, then it repeats the last dist bytes. */
+        unsigned char* dest = s->out + s->out_pos;
+        const unsigned char* src = dest - dist;
+        s->out_pos += len;
+        if (dist == 1) {
+            memset(dest, *src, len);
+        } else if (dist >= len) {
+            memcpy(dest, src, len);
+        } else {
+            while (len--) {
+                *dest++ = *src++;
+            }
+        }
+    }
+}
+
+static int _inflate_fixed(inflate_stream_t* s)
+{
+    static struct huffman lencode, distcode;
+    static int built = 0;
+
+    if (!built) {
+        uint8_t lengths[MAX_LCODES];
+        int symbol = 0;
+        for (; symbol < 144; symbol++) {
+            lengths[symbol] = 8;
+        }
+        for (; symbol < 256; symbol++) {
+            lengths[symbol] = 9;
+        }
+        for (; symbol < 280; symbol++) {
+            lengths[symbol] = 7;
+        }
+        for (; symbol < MAX_LCODES; symbol++) {
+            lengths[symbol] = 8;
+        }
+        _huffman_build(&lencode, lengths, MAX_LCODES);
+
+        for (symbol = 0; symbol < MAX_DCODES; symbol++) {
+            lengths[symbol] = 5;
+        }
+        _huffman_build(&distcode, lengths, MAX_DCODES);
+        built = 1;
+    }
+
+    return _inflate_codes(s, &lencode, &distcode);
+}
+
+static int _inflate_dynamic(inflate_stream_t* s)
+{
+    struct huffman lencode, distcode;
+    uint8_t lengths[MAX_LCODES + MAX_DCODES];
+
+    int nlen = _inflate_bits(s, 5) + 257;
+    int ndist = _inflate_bits(s, 5) + 1;
+    int ncode = _inflate_bits(s, 4) + 4;
+    if (nlen > MAX_LCODES || ndist > MAX_DCODES) {
+        return INFLATE_ERR_DATA;
+    }
+
+    uint8_t code_lengths[19];
+    memset(code_lengths, 0, sizeof(code_lengths));
+    for (int i = 0; i < ncode; i++) {
+        code_lengths[code_length_order[i]] = _inflate_bits(s, 3);
+    }
+    if (_huffman_build(&lencode, code_lengths, 19) != INFLATE_OK) {
+        return INFLATE_ERR_DATA;
+    }
+
+    int index = 0;
+    while (index < nlen + ndist) {
+        int symbol = _huffman_decode(s, &lencode);
+        if (symbol < 0 || symbol > 18) {
+            return INFLATE_ERR_DATA;
+        }
+        if (symbol < 16) {
+            lengths[index++] = symbol;
+            continue;
+        }
+
+        int len = 0;
+        int repeat;
+        if (symbol == 16) {
+            if (!index) {
+                return INFLATE_ERR_DATA;
+            }
+            len = lengths[index - 1];
+            repeat = 3 + _inflate_bits(s, 2);
+        } else if (symbol == 17) {
+            repeat = 3 + _inflate_bits(s, 3);
+        } else {
+            repeat = 11 + _inflate_bits(s, 7);
+        }
+        if (index + repeat > nlen + ndist) {
+            return INFLATE_ERR_DATA;
+        }
+        memset(lengths + index, len, repeat);
+        index += repeat;
+    }
+
+    if (_inflate_overran(s)) {
+        return INFLATE_ERR_INPUT;
+    }
+    /* A block without the end-of-block code could never end. */
+    if (!lengths[256]) {
+        return INFLATE_ERR_DATA;
+    }
+    if (_huffman_build(&lencode, lengths, nlen) != INFLATE_OK) {
+        return INFLATE_ERR_DATA;
+    }
+    if (_huffman_build(&distcode, lengths + nlen, ndist) != INFLATE_OK) {
+        return INFLATE_ERR_DATA;
+    }
+    return _inflate_codes(s, &lencode, &distcode);
+}
+
+static void _inflate_reset(inflate_stream_t* s)
+{
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+    s->overrun = 0;
+}
+
+static int _inflate_blocks(inflate_stream_t* s)
+{
+    int last;
+    do {
+        last = _inflate_bits(s, 1);
+        int type = _inflate_bits(s, 2);
+        int err;
+        switch (type) {
+        case 0:
+            err = _inflate_stored(s);
+            break;
+        case 1:
+            err = _inflate_fixed(s);
+            break;
+        case 2:
+            err = _inflate_dynamic(s);
+            break;
+        default:
+            err = INFLATE_ERR_DATA;
+        }
+        if (err != INFLATE_OK) {
+            return err;
+        }
+    } while (!last);
+
+    return INFLATE_OK;
+}
+
+/**
+ * PUBLIC FUNCTIONS
+ */
+
+int inflate_raw(inflate_stream_t* s)
+{
+    _inflate_reset(s);
+    return _inflate_blocks(s);
+}
+
+int inflate_zlib(inflate_stream_t* s)
+{
+    _inflate_reset(s);
+    int cmf = _inflate_next_byte(s);
+    int flg = _inflate_next_byte(s);
+    if (s->overrun) {
+        return INFLATE_ERR_INPUT;
+    }
+
+    /* Deflate only, no preset dictionary. */
+    if ((cmf & 0x0f) != 8 || ((cmf << 8) | flg) % 31 || (flg & 0x20)) {
+        return INFLATE_ERR_DATA;
+    }
+    return _inflate_blocks(s);
+}
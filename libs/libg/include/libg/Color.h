@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <libfoundation/Logger.h>
 
@@ -102,6 +103,50 @@ public:
         m_opacity = 255 - (alpha_c / 255);
     }
 
+    // A premultiplied color keeps its channels multiplied by its alpha. Over
+    // it, or over any opaque color, a premultiplied one is mixed with one
+    // multiply-add per channel, opacity goes the same way.
+    [[gnu::always_inline]] inline void mix_with_premultiplied(const Color& clr)
+    {
+        int opacity = clr.m_opacity;
+        m_r = clr.m_r + div_255(m_r * opacity);
+        m_g = clr.m_g + div_255(m_g * opacity);
+        m_b = clr.m_b + div_255(m_b * opacity);
+        m_opacity = div_255(m_opacity * opacity);
+    }
+
+    inline Color premultiplied() const
+    {
+        Color clr(*this);
+        int a = alpha();
+        clr.m_r = div_255(m_r * a);
+        clr.m_g = div_255(m_g * a);
+        clr.m_b = div_255(m_b * a);
+        return clr;
+    }
+
+    inline Color unpremultiplied() const
+    {
+        int a = alpha();
+        if (!a || a == 255) {
+            return *this;
+        }
+        Color clr(*this);
+        clr.m_r = std::min(255, (m_r * 255 + a / 2) / a);
+        clr.m_g = std::min(255, (m_g * 255 + a / 2) / a);
+        clr.m_b = std::min(255, (m_b * 255 + a / 2) / a);
+        return clr;
+    }
+
+    // Scales a premultiplied color by coverage, 255 keeps it as is.
+    inline void scale_premultiplied(int coverage)
+    {
+        m_r = div_255(m_r * coverage);
+        m_g = div_255(m_g * coverage);
+        m_b = div_255(m_b * coverage);
+        m_opacity = 255 - div_255(alpha() * coverage);
+    }
+
     inline LG::Color darken(int percents) const
     {
         double multiplier = 1.0 - (double(percents) / 100.0);
@@ -112,10 +157,20 @@ public:
     }
 
 private:
+    // Exact rounded x / 255 for x of up to 255 * 255.
+    static inline int div_255(int x)
+    {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
     uint8_t m_b { 0 };
     uint8_t m_g { 0 };
     uint8_t m_r { 0 };
     uint8_t m_opacity { 0 };
 };
 
+// Writes count pixels as RGB565, the low bits of every channel are dropped.
+void convert_to_rgb565(uint16_t* dst, const Color* src, size_t count);
+
 } // namespace LG
\ No newline at end of file
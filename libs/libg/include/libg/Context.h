@@ -24,12 +24,20 @@ public:
 
     void add_clip(const Rect& rect);
     void reset_clip();
+    // A clip which was got with clip() may be set back, nothing else.
+    inline const Rect& clip() const { return m_clip; }
+    inline void set_clip(const Rect& clip) { m_clip = clip; }
 
     void set(const Point<int>& start, const PixelBitmap& bitmap);
     void set_with_bounds(const Rect& rect, const PixelBitmap& bitmap);
     void draw(const Point<int>& start, const PixelBitmap& bitmap);
     void draw_with_bounds(const Rect& rect, const PixelBitmap& bitmap);
     void draw(const Point<int>& start, const GlyphBitmap& bitmap);
+    // Draws a line of text with the fill color. Glyphs advance by their own width and the
+    // font spacing, or by advance when it is set, as on a character grid.
+    void draw_text(const Point<int>& start, const Font& font, const char* text, size_t len, int advance = 0);
+    // Moves the pixels of rect so that its top left corner lands at to, as scrolling does.
+    void copy_rect(const Rect& rect, const Point<int>& to);
     void draw_rounded(const Point<int>& start, const PixelBitmap& bitmap, const CornerMask& mask = { 0, false, false });
     void draw_shading(const Rect& rect, const Shading& shading);
     void draw_box_shading(const Rect& rect, const Shading& shading, const CornerMask& mask = { 0, false, false });
@@ -43,9 +51,14 @@ public:
     const Point<int>& draw_offset() const { return m_draw_offset; }
     void set_fill_color(const Color& clr) { m_color = clr; }
 
+    inline PixelBitmap& bitmap() { return m_bitmap; }
+
     inline const Color& fill_color() const { return m_color; }
 
 private:
+    // Mixes a straight color into the bitmap the way the bitmap keeps colors.
+    void mix_pixel(Color& dst, const Color& src);
+    void draw_glyph(int x, int y, const GlyphBitmap& bitmap, uint32_t color);
     void fill_rounded_helper(const Point<int>& start, size_t radius);
     void draw_rounded_helper(const Point<int>& start, size_t radius, const PixelBitmap& bitmap);
     void shadow_rounded_helper(const Point<int>& start, size_t radius, const Shading& shading);
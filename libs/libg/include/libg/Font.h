@@ -59,9 +59,30 @@ public:
     inline size_t glyph_width(size_t ch) const { return m_dynamic_width ? m_width_data[ch] : m_width; }
     inline size_t glyph_height() const { return m_height; }
     inline size_t glyph_spacing() const { return m_spacing; }
+    inline bool fixed_width() const { return !m_dynamic_width; }
+
+    // The advance of the text, every glyph followed by the spacing. Fixed
+    // width fonts measure any text without looking at it.
+    inline size_t text_width(const char* text, size_t len) const
+    {
+        if (!m_dynamic_width) {
+            return len * (m_width + m_spacing);
+        }
+
+        size_t width = len * m_spacing;
+        for (size_t i = 0; i < len; i++) {
+            width += m_width_data[(uint8_t)text[i]];
+        }
+        return width;
+    }
     GlyphBitmap glyph_bitmap(size_t ch) const;
 
+    // Glyphs without a single set bit, such as spaces, need no drawing at all.
+    inline bool glyph_blank(size_t ch) const { return ch < BlankGlyphs && (m_blank_glyphs[ch / 32] & (1u << (ch % 32))); }
+
 private:
+    static constexpr size_t BlankGlyphs = 256;
+
     uint32_t* m_raw_data;
     uint8_t* m_width_data;
     size_t m_width;
@@ -69,6 +90,7 @@ private:
     size_t m_spacing;
     size_t m_count;
     bool m_dynamic_width;
+    uint32_t m_blank_glyphs[BlankGlyphs / 32] {};
 };
 
 } // namespace LG
\ No newline at end of file
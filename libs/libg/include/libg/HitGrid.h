@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <libg/Point.h>
+#include <libg/Rect.h>
+#include <vector>
+
+namespace LG {
+
+// HitGrid answers which of a set of rects contain a point. The rects are
+// put in the cells of a coarse grid over their union, so a lookup checks only
+// the rects which share the cell of the point instead of all of them.
+// Rects are reported in the order they were added.
+template <typename T>
+class HitGrid {
+public:
+    static constexpr size_t MaxCellsPerSide = 16;
+    static constexpr size_t MinCellSize = 32;
+
+    HitGrid() = default;
+    ~HitGrid() = default;
+
+    inline void clear()
+    {
+        m_items.clear();
+        m_cells.clear();
+        m_built = false;
+    }
+
+    inline void add(const Rect& rect, const T& value)
+    {
+        if (!rect.empty()) {
+            m_items.push_back({ rect, value });
+            m_built = false;
+        }
+    }
+
+    void build()
+    {
+        m_cells.clear();
+        m_built = true;
+        if (m_items.empty()) {
+            return;
+        }
+
+        m_area = m_items[0].rect;
+        for (auto& item : m_items) {
+            m_area.unite(item.rect);
+        }
+
+        m_cols = std::min(MaxCellsPerSide, m_area.width() / MinCellSize + 1);
+        m_rows = std::min(MaxCellsPerSide, m_area.height() / MinCellSize + 1);
+        m_cell_width = (m_area.width() + m_cols - 1) / m_cols;
+        m_cell_height = (m_area.height() + m_rows - 1) / m_rows;
+        for (size_t i = 0; i < m_cols * m_rows; i++) {
+            m_cells.push_back(std::vector<size_t>());
+        }
+
+        for (size_t i = 0; i < m_items.size(); i++) {
+            auto& rect = m_items[i].rect;
+            size_t min_col = col_of(rect.min_x()), max_col = col_of(rect.max_x());
+            size_t min_row = row_of(rect.min_y()), max_row = row_of(rect.max_y());
+            for (size_t row = min_row; row <= max_row; row++) {
+                for (size_t col = min_col; col <= max_col; col++) {
+                    m_cells[row * m_cols + col].push_back(i);
+                }
+            }
+        }
+    }
+
+    inline bool built() const { return m_built; }
+    inline size_t size() const { return m_items.size(); }
+
+    template <typename Callback>
+    void foreach_containing(const Point<int>& point, Callback callback) const
+    {
+        if (m_cells.empty() || !m_area.contains(point)) {
+            return;
+        }
+
+        auto& cell = m_cells[row_of(point.y()) * m_cols + col_of(point.x())];
+        for (size_t i = 0; i < cell.size(); i++) {
+            size_t index = cell[i];
+            if (m_items[index].rect.contains(point)) {
+                callback(m_items[index].value);
+            }
+        }
+    }
+
+private:
+    struct Item {
+        Rect rect;
+        T value;
+    };
+
+    inline size_t col_of(int x) const { return (x - m_area.min_x()) / m_cell_width; }
+    inline size_t row_of(int y) const { return (y - m_area.min_y()) / m_cell_height; }
+
+    bool m_built { false };
+    Rect m_area;
+    size_t m_cols { 0 };
+    size_t m_rows { 0 };
+    size_t m_cell_width { 1 };
+    size_t m_cell_height { 1 };
+    std::vector<Item> m_items;
+    std::vector<std::vector<size_t>> m_cells;
+};
+
+} // namespace LG
@@ -137,19 +137,21 @@ namespace PNG {
         bool check_header(const uint8_t* ptr) const;
 
         void proccess_stream(PixelBitmap& bitmap);
-        void process_compressed_data(PixelBitmap& bitmap);
+        void process_scanlines(PixelBitmap& bitmap, uint8_t* data, size_t len_of_scanline);
         bool read_chunk(PixelBitmap& bitmap);
         void read_IHDR(ChunkHeader& header, PixelBitmap& bitmap);
         void read_TEXT(ChunkHeader& header, PixelBitmap& bitmap);
         void read_PHYS(ChunkHeader& header, PixelBitmap& bitmap);
         void read_ORNT(ChunkHeader& header, PixelBitmap& bitmap);
         void read_IDAT(ChunkHeader& header, PixelBitmap& bitmap);
+        static int next_IDAT(void* ctx, const unsigned char** in, size_t* in_len);
 
         uint8_t paeth_predictor(int a, int b, int c);
-        void unfilter_scanlines();
-        void copy_scanlines_to_bitmap(PixelBitmap& bitmap);
+        void unfilter_scanline(int filter, uint8_t* row, const uint8_t* prior, size_t len);
+        void copy_scanline_to_bitmap(const uint8_t* row, Color* out);
 
-        std::vector<uint8_t> m_compressed_data;
+        const uint8_t* m_idat_end { nullptr };
+        bool m_idat_done { false };
         DataStreamer m_streamer;
         IHDRChunk m_ihdr_chunk;
         ScanlineKeeper m_scanline_keeper;
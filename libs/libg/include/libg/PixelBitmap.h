@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <cstdlib>
 #include <cstring>
 #include <libg/Color.h>
 #include <libg/Rect.h>
@@ -18,13 +19,23 @@ namespace LG {
 enum PixelBitmapFormat {
     RGB,
     RGBA,
+    // RGBA with colors multiplied by their alpha, see Color::premultiplied().
+    RGBA_Premultiplied,
 };
 
+/**
+ * Rows of a bitmap are stride pixels apart. A bitmap which owns its pixels
+ * starts every row at RowAlignment bytes, so SIMD loops may load them
+ * aligned. One over a buffer has packed rows unless a stride is given, and
+ * a view() shares the rows of a rectangle of another bitmap.
+ */
 class PixelBitmap {
 public:
+    static constexpr size_t RowAlignment = 64;
+
     PixelBitmap() = default;
     PixelBitmap(size_t width, size_t height, PixelBitmapFormat format = RGB);
-    PixelBitmap(Color* buffer, size_t width, size_t height, PixelBitmapFormat format = RGB);
+    PixelBitmap(Color* buffer, size_t width, size_t height, PixelBitmapFormat format = RGB, size_t stride = 0);
     PixelBitmap(const PixelBitmap& bitmap);
     PixelBitmap(PixelBitmap&& moved_bitmap) noexcept;
     ~PixelBitmap()
@@ -35,36 +46,49 @@ public:
     void clear()
     {
         if (m_should_free) {
-            delete m_data;
+            free(m_allocation);
         }
+        m_allocation = nullptr;
         m_data = nullptr;
+        m_stride = 0;
+        m_should_free = false;
         m_bounds.set_width(0);
         m_bounds.set_height(0);
     }
 
     PixelBitmap& operator=(const PixelBitmap& bitmap)
     {
+        if (this == &bitmap) {
+            return *this;
+        }
         clear();
-        m_bounds = bitmap.bounds();
-        m_should_free = bitmap.m_should_free;
         m_format = bitmap.m_format;
-        if (m_should_free) {
-            size_t len = width() * height() * sizeof(Color);
-            m_data = (Color*)malloc(len);
-            memcpy((uint8_t*)m_data, (uint8_t*)bitmap.m_data, len);
+        if (bitmap.m_should_free) {
+            allocate(bitmap.width(), bitmap.height());
+            copy_rows_from(bitmap);
         } else {
+            m_bounds = bitmap.bounds();
             m_data = bitmap.m_data;
+            m_stride = bitmap.m_stride;
         }
         return *this;
     }
 
     PixelBitmap& operator=(PixelBitmap&& moved_bitmap) noexcept
     {
+        if (this == &moved_bitmap) {
+            return *this;
+        }
+        clear();
+        m_allocation = moved_bitmap.m_allocation;
         m_data = moved_bitmap.m_data;
+        m_stride = moved_bitmap.m_stride;
         m_bounds = moved_bitmap.bounds();
         m_should_free = moved_bitmap.m_should_free;
         m_format = moved_bitmap.m_format;
+        moved_bitmap.m_allocation = nullptr;
         moved_bitmap.m_data = nullptr;
+        moved_bitmap.m_stride = 0;
         moved_bitmap.bounds().set_width(0);
         moved_bitmap.bounds().set_height(0);
         moved_bitmap.m_should_free = false;
@@ -75,30 +99,55 @@ public:
     inline size_t height() const { return m_bounds.height(); }
     inline LG::Rect& bounds() { return m_bounds; }
     inline const LG::Rect& bounds() const { return m_bounds; }
-    inline void set_size(LG::Size size) { m_bounds.set_height(size.height()), m_bounds.set_width(size.width()); }
+    // Takes the pixels as packed rows of the new size, so it goes together
+    // with set_data() of a buffer of that size.
+    inline void set_size(LG::Size size) { m_bounds.set_height(size.height()), m_bounds.set_width(size.width()), m_stride = size.width(); }
+
+    // Distance between rows, in pixels.
+    inline size_t stride() const { return m_stride; }
+    inline bool is_contiguous() const { return m_stride == width(); }
 
     inline Color* data() const { return m_data; }
     inline void set_data(Color* data)
     {
         if (m_should_free) {
-            delete m_data;
+            free(m_allocation);
         }
+        m_allocation = nullptr;
         m_data = data;
         m_should_free = false;
     }
 
-    inline Color* line(size_t i) { return m_data + i * width(); }
-    inline const Color* line(size_t i) const { return m_data + i * width(); }
+    inline Color* line(size_t i) { return m_data + i * m_stride; }
+    inline const Color* line(size_t i) const { return m_data + i * m_stride; }
     inline Color* operator[](size_t i) { return line(i); }
     inline const Color* operator[](size_t i) const { return line(i); }
     void resize(size_t width, size_t height);
 
+    // A bitmap over the part of rect which is inside of this one. It owns
+    // nothing and is valid as long as the pixels of this one are.
+    PixelBitmap view(const Rect& rect) const;
+
+    // Writes the pixels to buffer as packed rows.
+    void copy_to(Color* buffer) const;
+
+    // Returns a copy of the given size. It is box filtered along an axis
+    // which shrinks and bilinear along one which grows. A bitmap with alpha
+    // is scaled premultiplied, so the copy is RGBA_Premultiplied.
+    PixelBitmap scaled(const Size& size) const;
+
     inline void set_format(PixelBitmapFormat format) { m_format = format; }
     inline PixelBitmapFormat format() const { return m_format; }
-    inline bool has_alpha_channel() const { return m_format == RGBA; }
+    inline bool has_alpha_channel() const { return m_format != RGB; }
+    inline bool is_premultiplied() const { return m_format == RGBA_Premultiplied; }
 
 private:
+    void allocate(size_t width, size_t height);
+    void copy_rows_from(const PixelBitmap& bitmap);
+
+    void* m_allocation { nullptr };
     Color* m_data { nullptr };
+    size_t m_stride { 0 };
     LG::Rect m_bounds { 0, 0, 0, 0 };
     bool m_should_free { false };
     PixelBitmapFormat m_format { RGB };
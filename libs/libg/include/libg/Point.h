@@ -68,10 +68,12 @@ public:
         return !(*this == p);
     }
 
-    void encode(EncodedMessage& buf) const override
+    size_t encoded_size() const override { return Encoder::encoded_size(m_x) + Encoder::encoded_size(m_y); }
+
+    void store(uint8_t* buf, size_t& offset) const override
     {
-        Encoder::append(buf, m_x);
-        Encoder::append(buf, m_y);
+        Encoder::store(buf, offset, m_x);
+        Encoder::store(buf, offset, m_y);
     }
 
     void decode(const char* buf, size_t& offset) override
@@ -64,7 +64,8 @@ public:
     bool intersects(const Rect& other) const;
     LG::Rect intersection(const Rect& other) const;
 
-    void encode(EncodedMessage& buf) const override;
+    size_t encoded_size() const override { return Encoder::encoded_size(m_origin) + Encoder::encoded_size(m_width) + Encoder::encoded_size(m_height); }
+    void store(uint8_t* buf, size_t& offset) const override;
     void decode(const char* buf, size_t& offset) override;
 
     bool operator==(const Rect& r) const
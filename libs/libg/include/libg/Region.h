@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libg/Rect.h>
+#include <vector>
+
+namespace LG {
+
+// A set of pixels kept as non-overlapping rects split into bands. Rects of a
+// band share their y and height and go left to right, bands go top to bottom.
+// Touching rects of a band are merged, and so are touching bands with the
+// same rects, so a region has only one form and its rects never overlap.
+class Region {
+public:
+    Region() = default;
+    Region(const Rect& rect);
+
+    inline bool empty() const { return m_rects.empty(); }
+    inline const std::vector<Rect>& rects() const { return m_rects; }
+    Rect bounds() const;
+
+    // Keeps the storage, so a region which is filled over and over stops
+    // allocating.
+    inline void clear() { m_rects.clear_remain_capacity(); }
+
+    void unite(const Rect& rect);
+    void unite(const Region& other) { apply(other.m_rects.data(), other.m_rects.size(), Op::Union); }
+    void intersect(const Rect& rect);
+    void intersect(const Region& other) { apply(other.m_rects.data(), other.m_rects.size(), Op::Intersect); }
+    void subtract(const Rect& rect);
+    void subtract(const Region& other) { apply(other.m_rects.data(), other.m_rects.size(), Op::Subtract); }
+
+    // Moving all rects keeps the region in its form.
+    inline void offset_by(int x, int y)
+    {
+        for (auto& rect : m_rects) {
+            rect.offset_by(x, y);
+        }
+    }
+
+    bool intersects(const Rect& rect) const;
+    bool contains(const Rect& rect) const;
+
+private:
+    enum class Op {
+        Union,
+        Intersect,
+        Subtract,
+    };
+
+    void apply(const Rect* other, size_t other_count, Op op);
+
+    std::vector<Rect> m_rects;
+};
+
+} // namespace LG
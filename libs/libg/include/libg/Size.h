@@ -31,10 +31,12 @@ public:
     inline size_t width() const { return m_width; }
     inline size_t height() const { return m_height; }
 
-    void encode(EncodedMessage& buf) const override
+    size_t encoded_size() const override { return Encoder::encoded_size(m_width) + Encoder::encoded_size(m_height); }
+
+    void store(uint8_t* buf, size_t& offset) const override
     {
-        Encoder::append(buf, m_width);
-        Encoder::append(buf, m_height);
+        Encoder::store(buf, offset, m_width);
+        Encoder::store(buf, offset, m_height);
     }
 
     void decode(const char* buf, size_t& offset) override
@@ -19,12 +19,16 @@ class string : public std::string, public Encodable<string>, public Decodable<st
 public:
     using std::string::string;
 
-    void encode(EncodedMessage& buf) const override
+    size_t encoded_size() const override { return size() + 1; }
+
+    void store(uint8_t* buf, size_t& offset) const override
     {
-        for (int i = 0; i < size(); i++) {
-            buf.push_back(at(i));
+        // An empty string may have no storage at all.
+        if (size()) {
+            memcpy(buf + offset, c_str(), size());
         }
-        buf.push_back('\0');
+        offset += size();
+        buf[offset++] = '\0';
     }
 
     void decode(const char* buf, size_t& offset) override
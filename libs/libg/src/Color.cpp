@@ -6,6 +6,12 @@
 
 #include <libg/Color.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif __ARM_NEON
+#include <arm_neon.h>
+#endif
+
 namespace LG {
 
 Color::Color(Colors clr)
@@ -61,4 +67,55 @@ Color::Color(Colors clr)
     m_opacity = rgb_color.o;
 }
 
+[[gnu::always_inline]] static inline uint16_t to_rgb565(uint32_t clr)
+{
+    return ((clr >> 8) & 0xf800) | ((clr >> 5) & 0x07e0) | ((clr >> 3) & 0x001f);
+}
+
+#ifdef __SSE2__
+// Channels are shifted into place in 32 bit lanes. The pack is signed, so
+// the lanes are moved down by 0x8000 before it and back after.
+[[gnu::always_inline]] static inline __m128i to_rgb565_4(__m128i px)
+{
+    __m128i r = _mm_and_si128(_mm_srli_epi32(px, 8), _mm_set1_epi32(0xf800));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(px, 5), _mm_set1_epi32(0x07e0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(px, 3), _mm_set1_epi32(0x001f));
+    return _mm_sub_epi32(_mm_or_si128(_mm_or_si128(r, g), b), _mm_set1_epi32(0x8000));
+}
+
+static constexpr size_t Rgb565Batch = 8;
+[[gnu::always_inline]] static inline void rgb565_batch(uint16_t* dst, const uint32_t* src)
+{
+    __m128i lo = to_rgb565_4(_mm_loadu_si128((const __m128i*)src));
+    __m128i hi = to_rgb565_4(_mm_loadu_si128((const __m128i*)(src + 4)));
+    __m128i res = _mm_xor_si128(_mm_packs_epi32(lo, hi), _mm_set1_epi16((short)0x8000));
+    _mm_storeu_si128((__m128i*)dst, res);
+}
+#elif __ARM_NEON
+// Red goes to the top byte, green and blue are shifted in under it.
+static constexpr size_t Rgb565Batch = 8;
+[[gnu::always_inline]] static inline void rgb565_batch(uint16_t* dst, const uint32_t* src)
+{
+    uint8x8x4_t px = vld4_u8((const uint8_t*)src);
+    uint16x8_t res = vshll_n_u8(px.val[2], 8);
+    res = vsriq_n_u16(res, vshll_n_u8(px.val[1], 8), 5);
+    res = vsriq_n_u16(res, vshll_n_u8(px.val[0], 8), 11);
+    vst1q_u16(dst, res);
+}
+#endif
+
+void convert_to_rgb565(uint16_t* dst, const Color* src, size_t count)
+{
+    auto* src32 = reinterpret_cast<const uint32_t*>(src);
+    size_t i = 0;
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    for (; i + Rgb565Batch <= count; i += Rgb565Batch) {
+        rgb565_batch(dst + i, src32 + i);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = to_rgb565(src32[i]);
+    }
+}
+
 } // namespace LG
\ No newline at end of file
@@ -8,9 +8,233 @@
 #include <libfoundation/Math.h>
 #include <libfoundation/Memory.h>
 #include <libg/Context.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif __ARM_NEON
+#include <arm_neon.h>
+#endif
 
 namespace LG {
 
+// Pixels are stored as 0xOORRGGBB, where OO is opacity, so 0 is fully seen.
+static constexpr uint32_t OpacityMask = 0xff000000;
+
+// Over an opaque destination the mix is a weighted sum of the channels, the
+// divide by 255 is exact as (t + (t >> 8)) >> 8 of t rounded by 128. R and B
+// are mixed together in one word.
+[[gnu::always_inline]] static inline uint32_t blend_over_opaque(uint32_t dst, uint32_t src)
+{
+    uint32_t opacity = src >> 24;
+    uint32_t alpha = 255 - opacity;
+    uint32_t rb = (src & 0xff00ff) * alpha + (dst & 0xff00ff) * opacity + 0x800080;
+    rb = ((rb + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+    uint32_t g = ((src >> 8) & 0xff) * alpha + ((dst >> 8) & 0xff) * opacity + 0x80;
+    g = ((g + (g >> 8)) >> 8) & 0xff;
+    return (dst & OpacityMask) | rb | (g << 8);
+}
+
+// A premultiplied source is added to the destination scaled by the opacity
+// of the source, see Color::mix_with_premultiplied(). Two channels go in one
+// word, opacity is scaled and gets nothing added.
+[[gnu::always_inline]] static inline uint32_t blend_premultiplied(uint32_t dst, uint32_t src)
+{
+    uint32_t opacity = src >> 24;
+    uint32_t rb = (dst & 0xff00ff) * opacity + 0x800080;
+    rb = ((rb + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+    uint32_t og = ((dst >> 8) & 0xff00ff) * opacity + 0x800080;
+    og = ((og + ((og >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+    return ((rb | (og << 8)) + (src & ~OpacityMask));
+}
+
+// An opaque destination pixel is both straight and premultiplied, the
+// others are mixed the way the destination bitmap keeps them.
+[[gnu::always_inline]] static inline void blend_pixel(uint32_t* dst, uint32_t src, bool src_premultiplied, bool dst_premultiplied)
+{
+    auto& dst_color = *reinterpret_cast<Color*>(dst);
+    const auto& src_color = *reinterpret_cast<const Color*>(&src);
+    bool dst_opaque = !(*dst & OpacityMask);
+    if (src_premultiplied) {
+        if (dst_opaque || dst_premultiplied) {
+            *dst = blend_premultiplied(*dst, src);
+        } else {
+            dst_color.mix_with(src_color.unpremultiplied());
+        }
+        return;
+    }
+
+    if (dst_opaque) {
+        *dst = blend_over_opaque(*dst, src);
+    } else if (dst_premultiplied) {
+        dst_color.mix_with_premultiplied(src_color.premultiplied());
+    } else {
+        dst_color.mix_with(src_color);
+    }
+}
+
+#ifdef __SSE2__
+[[gnu::always_inline]] static inline bool all_opaque_4(__m128i pixels)
+{
+    __m128i zero = _mm_setzero_si128();
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_srli_epi32(pixels, 24), zero)) == 0xffff;
+}
+
+// Spreads a byte of every pixel to the 16-bit lanes of its channels, the low
+// pixels go to lo and the high ones to hi.
+[[gnu::always_inline]] static inline void spread_4(__m128i bytes, __m128i& lo, __m128i& hi)
+{
+    bytes = _mm_or_si128(bytes, _mm_slli_epi32(bytes, 16));
+    lo = _mm_unpacklo_epi32(bytes, bytes);
+    hi = _mm_unpackhi_epi32(bytes, bytes);
+}
+
+[[gnu::always_inline]] static inline __m128i div_255_16(__m128i t)
+{
+    t = _mm_add_epi16(t, _mm_set1_epi16(0x80));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Mixes 4 pixels of a straight source, returns false if not all of the
+// destination is opaque.
+[[gnu::always_inline]] static inline bool blend_4_over_opaque(uint32_t* dst, const uint32_t* src)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i d = _mm_loadu_si128((const __m128i*)dst);
+    if (!all_opaque_4(d)) {
+        return false;
+    }
+
+    __m128i s = _mm_loadu_si128((const __m128i*)src);
+    __m128i opacity = _mm_srli_epi32(s, 24);
+    __m128i opacity_lo, opacity_hi, alpha_lo, alpha_hi;
+    spread_4(opacity, opacity_lo, opacity_hi);
+    spread_4(_mm_sub_epi32(_mm_set1_epi32(255), opacity), alpha_lo, alpha_hi);
+
+    __m128i lo = div_255_16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), alpha_lo),
+        _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), opacity_lo)));
+    __m128i hi = div_255_16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), alpha_hi),
+        _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), opacity_hi)));
+
+    __m128i res = _mm_and_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(~OpacityMask));
+    _mm_storeu_si128((__m128i*)dst, res);
+    return true;
+}
+
+// Mixes 4 pixels of a premultiplied source, a straight destination has to
+// be opaque, returns false if it is not.
+[[gnu::always_inline]] static inline bool blend_4_premultiplied(uint32_t* dst, const uint32_t* src, bool dst_premultiplied)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i d = _mm_loadu_si128((const __m128i*)dst);
+    if (!dst_premultiplied && !all_opaque_4(d)) {
+        return false;
+    }
+
+    __m128i s = _mm_loadu_si128((const __m128i*)src);
+    __m128i opacity_lo, opacity_hi;
+    spread_4(_mm_srli_epi32(s, 24), opacity_lo, opacity_hi);
+    __m128i lo = div_255_16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), opacity_lo));
+    __m128i hi = div_255_16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), opacity_hi));
+
+    __m128i res = _mm_add_epi8(_mm_packus_epi16(lo, hi), _mm_and_si128(s, _mm_set1_epi32(~OpacityMask)));
+    _mm_storeu_si128((__m128i*)dst, res);
+    return true;
+}
+
+static constexpr size_t BlendBatch = 4;
+[[gnu::always_inline]] static inline bool blend_batch(uint32_t* dst, const uint32_t* src, bool src_premultiplied, bool dst_premultiplied)
+{
+    if (src_premultiplied) {
+        return blend_4_premultiplied(dst, src, dst_premultiplied);
+    }
+    return blend_4_over_opaque(dst, src);
+}
+#elif __ARM_NEON
+[[gnu::always_inline]] static inline uint8x8_t div_255_8(uint16x8_t t)
+{
+    return vraddhn_u16(t, vrshrq_n_u16(t, 8));
+}
+
+// Mixes 8 pixels, a straight destination has to be opaque, returns false
+// if it is not.
+[[gnu::always_inline]] static inline bool blend_batch(uint32_t* dst, const uint32_t* src, bool src_premultiplied, bool dst_premultiplied)
+{
+    uint8x8x4_t d = vld4_u8((const uint8_t*)dst);
+    bool dst_opaque = !vget_lane_u64(vreinterpret_u64_u8(d.val[3]), 0);
+    if (!dst_opaque && !(src_premultiplied && dst_premultiplied)) {
+        return false;
+    }
+
+    uint8x8x4_t s = vld4_u8((const uint8_t*)src);
+    uint8x8_t opacity = s.val[3];
+    if (src_premultiplied) {
+        for (int c = 0; c < 3; c++) {
+            d.val[c] = vadd_u8(s.val[c], div_255_8(vmull_u8(d.val[c], opacity)));
+        }
+        d.val[3] = div_255_8(vmull_u8(d.val[3], opacity));
+    } else {
+        uint8x8_t alpha = vmvn_u8(opacity);
+        for (int c = 0; c < 3; c++) {
+            d.val[c] = div_255_8(vmlal_u8(vmull_u8(s.val[c], alpha), d.val[c], opacity));
+        }
+    }
+    vst4_u8((uint8_t*)dst, d);
+    return true;
+}
+
+static constexpr size_t BlendBatch = 8;
+#endif
+
+// Pixels of the run are neither fully seen nor fully transparent.
+static void blend_mixed_run(uint32_t* dst, const uint32_t* src, size_t count, bool src_premultiplied, bool dst_premultiplied)
+{
+    size_t i = 0;
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    for (; i + BlendBatch <= count; i += BlendBatch) {
+        if (!blend_batch(dst + i, src + i, src_premultiplied, dst_premultiplied)) {
+            for (size_t j = i; j < i + BlendBatch; j++) {
+                blend_pixel(dst + j, src[j], src_premultiplied, dst_premultiplied);
+            }
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        blend_pixel(dst + i, src[i], src_premultiplied, dst_premultiplied);
+    }
+}
+
+// Most pixels of an image are either fully seen or fully transparent, runs
+// of them are copied or skipped, only the rest is mixed.
+static void blend_span(uint32_t* dst, const uint32_t* src, size_t count, bool src_premultiplied, bool dst_premultiplied)
+{
+    size_t i = 0;
+    while (i < count) {
+        size_t start = i;
+        uint32_t opacity = src[i] & OpacityMask;
+        if (opacity == 0) {
+            while (i < count && !(src[i] & OpacityMask)) {
+                i++;
+            }
+            LFoundation::fast_copy(dst + start, src + start, i - start);
+        } else if (opacity == OpacityMask) {
+            while (i < count && (src[i] & OpacityMask) == OpacityMask) {
+                i++;
+            }
+        } else {
+            while (i < count && (src[i] & OpacityMask) && (src[i] & OpacityMask) != OpacityMask) {
+                i++;
+            }
+            blend_mixed_run(dst + start, src + start, i - start, src_premultiplied, dst_premultiplied);
+        }
+    }
+}
+
+[[gnu::always_inline]] inline void Context::mix_pixel(Color& dst, const Color& src)
+{
+    blend_pixel(reinterpret_cast<uint32_t*>(&dst), *reinterpret_cast<const uint32_t*>(&src), false, m_bitmap.is_premultiplied());
+}
+
 Context::Context(PixelBitmap& bitmap)
     : m_bitmap(bitmap)
     , m_origin_clip(0, 0, bitmap.width(), bitmap.height())
@@ -95,12 +319,11 @@ void Context::draw(const Point<int>& start, const PixelBitmap& bitmap)
     int max_y = draw_bounds.max_y();
     int offset_x = -start.x() - m_draw_offset.x() + m_bitmap_offset.x();
     int offset_y = -start.y() - m_draw_offset.y() + m_bitmap_offset.y();
+    int bitmap_x = min_x + offset_x;
     int bitmap_y = min_y + offset_y;
+    int len_x = max_x - min_x + 1;
     for (int y = min_y; y <= max_y; y++, bitmap_y++) {
-        int bitmap_x = min_x + offset_x;
-        for (int x = min_x; x <= max_x; x++, bitmap_x++) {
-            m_bitmap[y][x].mix_with(bitmap[bitmap_y][bitmap_x]);
-        }
+        blend_span((uint32_t*)&m_bitmap[y][min_x], (const uint32_t*)&bitmap[bitmap_y][bitmap_x], len_x, bitmap.is_premultiplied(), m_bitmap.is_premultiplied());
     }
 }
 
@@ -124,37 +347,103 @@ void Context::draw_with_bounds(const Rect& rect, const PixelBitmap& bitmap)
     int max_y = draw_bounds.max_y();
     int offset_x = -rect.min_x() - m_draw_offset.x() + m_bitmap_offset.x();
     int offset_y = -rect.min_y() - m_draw_offset.y() + m_bitmap_offset.y();
+    int bitmap_x = min_x + offset_x;
     int bitmap_y = min_y + offset_y;
+    int len_x = max_x - min_x + 1;
     for (int y = min_y; y <= max_y; y++, bitmap_y++) {
-        int bitmap_x = min_x + offset_x;
-        for (int x = min_x; x <= max_x; x++, bitmap_x++) {
-            m_bitmap[y][x].mix_with(bitmap[bitmap_y][bitmap_x]);
+        blend_span((uint32_t*)&m_bitmap[y][min_x], (const uint32_t*)&bitmap[bitmap_y][bitmap_x], len_x, bitmap.is_premultiplied(), m_bitmap.is_premultiplied());
+    }
+}
+
+// Fills the set bits of a glyph row, a whole run of neighbouring bits at a time.
+[[gnu::always_inline]] static inline void fill_glyph_row(uint32_t* dst, uint32_t bits, uint32_t color)
+{
+    while (bits) {
+        int skip = __builtin_ctz(bits);
+        dst += skip;
+        bits >>= skip;
+        int run = ~bits ? __builtin_ctz(~bits) : 32;
+        for (int i = 0; i < run; i++) {
+            dst[i] = color;
         }
+        dst += run;
+        bits = run < 32 ? bits >> run : 0;
     }
 }
 
-void Context::draw(const Point<int>& start, const GlyphBitmap& bitmap)
+void Context::draw_glyph(int x, int y, const GlyphBitmap& bitmap, uint32_t color)
 {
-    Rect draw_bounds(start.x() + m_draw_offset.x(), start.y() + m_draw_offset.y(), bitmap.width(), bitmap.height());
+    Rect draw_bounds(x, y, bitmap.width(), bitmap.height());
     draw_bounds.intersect(m_clip);
     if (draw_bounds.empty()) {
         return;
     }
 
-    auto& color = fill_color();
     int min_x = draw_bounds.min_x();
     int min_y = draw_bounds.min_y();
-    int max_x = draw_bounds.max_x();
     int max_y = draw_bounds.max_y();
-    int offset_x = -start.x() - m_draw_offset.x();
-    int offset_y = -start.y() - m_draw_offset.y();
-    int bitmap_y = min_y + offset_y;
-    for (int y = min_y; y <= max_y; y++, bitmap_y++) {
-        int bitmap_x = min_x + offset_x;
-        for (int x = min_x; x <= max_x; x++, bitmap_x++) {
-            if (bitmap.bit_at(bitmap_x, bitmap_y)) {
-                m_bitmap[y][x] = color;
-            }
+    int shift = min_x - x;
+    int len_x = draw_bounds.width();
+    uint32_t clip_mask = len_x >= 32 ? 0xffffffff : (1u << len_x) - 1;
+    const uint32_t* rows = bitmap.rows() + (min_y - y);
+    for (int row_y = min_y; row_y <= max_y; row_y++, rows++) {
+        uint32_t bits = (*rows >> shift) & clip_mask;
+        if (bits) {
+            fill_glyph_row((uint32_t*)&m_bitmap[row_y][min_x], bits, color);
+        }
+    }
+}
+
+void Context::draw(const Point<int>& start, const GlyphBitmap& bitmap)
+{
+    auto color = m_bitmap.is_premultiplied() ? fill_color().premultiplied() : fill_color();
+    draw_glyph(start.x() + m_draw_offset.x(), start.y() + m_draw_offset.y(), bitmap, color.u32());
+}
+
+void Context::draw_text(const Point<int>& start, const Font& font, const char* text, size_t len, int advance)
+{
+    int x = start.x() + m_draw_offset.x();
+    int y = start.y() + m_draw_offset.y();
+    if (y > m_clip.max_y() || y + (int)font.glyph_height() <= m_clip.min_y()) {
+        return;
+    }
+
+    uint32_t color = (m_bitmap.is_premultiplied() ? fill_color().premultiplied() : fill_color()).u32();
+    int spacing = font.glyph_spacing();
+    for (size_t i = 0; i < len && x <= m_clip.max_x(); i++) {
+        uint8_t ch = text[i];
+        int width = font.glyph_width(ch);
+        if (x + width > m_clip.min_x() && !font.glyph_blank(ch)) {
+            draw_glyph(x, y, font.glyph_bitmap(ch), color);
+        }
+        x += advance ? advance : width + spacing;
+    }
+}
+
+void Context::copy_rect(const Rect& rect, const Point<int>& to)
+{
+    int dx = to.x() - rect.min_x();
+    int dy = to.y() - rect.min_y();
+    Rect src(rect.min_x() + m_draw_offset.x(), rect.min_y() + m_draw_offset.y(), rect.width(), rect.height());
+    src.intersect(m_clip);
+    Rect dst = src;
+    dst.offset_by(dx, dy);
+    dst.intersect(m_clip);
+    if (dst.empty()) {
+        return;
+    }
+
+    // Rows are walked away from the destination, so overlapping rows are
+    // read before they are overwritten.
+    int min_x = dst.min_x();
+    int len_x = dst.width();
+    int min_y = dy > 0 ? dst.max_y() : dst.min_y();
+    int step = dy > 0 ? -1 : 1;
+    for (int i = 0, y = min_y; i < (int)dst.height(); i++, y += step) {
+        if (dy) {
+            LFoundation::fast_copy((uint32_t*)&m_bitmap[y][min_x], (uint32_t*)&m_bitmap[y - dy][min_x - dx], len_x);
+        } else {
+            memmove(&m_bitmap[y][min_x], &m_bitmap[y][min_x - dx], len_x * sizeof(Color));
         }
     }
 }
@@ -254,7 +543,7 @@ void Context::mix(const Rect& rect)
     const auto& color = fill_color();
     for (int y = min_y; y <= max_y; y++) {
         for (int x = min_x; x <= max_x; x++) {
-            m_bitmap[y][x].mix_with(color);
+            mix_pixel(m_bitmap[y][x], color);
         }
     }
 }
@@ -319,16 +608,17 @@ void Context::draw_rounded_helper(const Point<int>& start, size_t radius, const
             int x2 = (x - center.x()) * (x - center.x());
             int y2 = (y - center.y()) * (y - center.y());
             int dist = x2 + y2;
-            if (dist <= radius2) {
-                m_bitmap[y][x].mix_with(bitmap[bitmap_y][bitmap_x]);
-            } else {
-                auto color = bitmap[bitmap_y][bitmap_x];
+            auto color = bitmap[bitmap_y][bitmap_x];
+            if (dist > radius2) {
                 float fdist = 0.5 - (LFoundation::fast_sqrt((float)(dist)) - radius);
                 fdist = std::max(std::min(fdist, 1.0f), 0.0f);
-                int alpha = int(color.alpha() * fdist);
-                color.set_alpha(alpha);
-                m_bitmap[y][x].mix_with(color);
+                if (bitmap.is_premultiplied()) {
+                    color.scale_premultiplied(int(255 * fdist));
+                } else {
+                    color.set_alpha(int(color.alpha() * fdist));
+                }
             }
+            blend_pixel((uint32_t*)&m_bitmap[y][x], *(const uint32_t*)&color, bitmap.is_premultiplied(), m_bitmap.is_premultiplied());
         }
     }
 }
@@ -360,13 +650,13 @@ void Context::fill_rounded_helper(const Point<int>& start, size_t radius)
             int y2 = (y - center.y()) * (y - center.y());
             int dist = x2 + y2;
             if (dist <= radius2) {
-                m_bitmap[y][x].mix_with(fill_color());
+                mix_pixel(m_bitmap[y][x], fill_color());
             } else {
                 float fdist = 0.5 - (LFoundation::fast_sqrt((float)(dist)) - radius);
                 fdist = std::max(std::min(fdist, 1.0f), 0.0f);
                 int alpha = int(fill_color().alpha() * fdist);
                 color.set_alpha(alpha);
-                m_bitmap[y][x].mix_with(color);
+                mix_pixel(m_bitmap[y][x], color);
             }
         }
     }
@@ -409,7 +699,7 @@ void Context::shadow_rounded_helper(const Point<int>& start, size_t radius, cons
                     fdist = std::max(fdist, 0.0f);
                     int alpha = std_alpha * fdist;
                     color.set_alpha(alpha);
-                    m_bitmap[y][x].mix_with(color);
+                    mix_pixel(m_bitmap[y][x], color);
                 }
             }
         }
@@ -509,7 +799,7 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
 
         for (int y = min_y; y <= max_y; y++) {
             for (int x = min_x; x <= max_x; x++) {
-                m_bitmap[y][x].mix_with(color);
+                mix_pixel(m_bitmap[y][x], color);
             }
             color.set_alpha(color.alpha() - step);
         }
@@ -522,7 +812,7 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
 
         for (int y = max_y; y >= min_y; y--) {
             for (int x = min_x; x <= max_x; x++) {
-                m_bitmap[y][x].mix_with(color);
+                mix_pixel(m_bitmap[y][x], color);
             }
             color.set_alpha(color.alpha() - step);
         }
@@ -535,7 +825,7 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
 
         for (int x = min_x; x <= max_x; x++) {
             for (int y = min_y; y <= max_y; y++) {
-                m_bitmap[y][x].mix_with(color);
+                mix_pixel(m_bitmap[y][x], color);
             }
             color.set_alpha(color.alpha() - step);
         }
@@ -548,7 +838,7 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
 
         for (int x = max_x; x >= min_x; x--) {
             for (int y = min_y; y <= max_y; y++) {
-                m_bitmap[y][x].mix_with(color);
+                mix_pixel(m_bitmap[y][x], color);
             }
             color.set_alpha(color.alpha() - step);
         }
@@ -567,7 +857,7 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
         for (int y = max_y; y >= min_y; y--) {
             auto cur_color = color;
             for (int x = min_x; x <= end_x; x++) {
-                m_bitmap[y][x].mix_with(cur_color);
+                mix_pixel(m_bitmap[y][x], cur_color);
                 cur_color.set_alpha(cur_color.alpha() - step);
             }
             end_x--;
@@ -592,7 +882,7 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
         for (int y = min_y; y <= max_y; y++) {
             auto cur_color = color;
             for (int x = min_x; x <= end_x; x++) {
-                m_bitmap[y][x].mix_with(cur_color);
+                mix_pixel(m_bitmap[y][x], cur_color);
                 cur_color.set_alpha(cur_color.alpha() - step);
             }
             end_x--;
@@ -617,7 +907,7 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
         for (int y = max_y; y >= min_y; y--) {
             auto cur_color = color;
             for (int x = max_x; x >= end_x; x--) {
-                m_bitmap[y][x].mix_with(cur_color);
+                mix_pixel(m_bitmap[y][x], cur_color);
                 cur_color.set_alpha(cur_color.alpha() - step);
             }
             end_x++;
@@ -642,7 +932,7 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
         for (int y = min_y; y <= max_y; y++) {
             auto cur_color = color;
             for (int x = max_x; x >= end_x; x--) {
-                m_bitmap[y][x].mix_with(cur_color);
+                mix_pixel(m_bitmap[y][x], cur_color);
                 cur_color.set_alpha(cur_color.alpha() - step);
             }
             end_x++;
@@ -61,6 +61,16 @@ Font::Font(uint32_t* raw_data, uint8_t* width_data, uint8_t width, uint8_t heigh
     , m_dynamic_width(dynamic_width)
     , m_spacing(glyph_spacing)
 {
+    size_t blank_count = count < BlankGlyphs ? count : BlankGlyphs;
+    for (size_t ch = 0; ch < blank_count; ch++) {
+        uint32_t bits = 0;
+        for (size_t y = 0; y < m_height; y++) {
+            bits |= m_raw_data[ch * m_height + y];
+        }
+        if (!bits) {
+            m_blank_glyphs[ch / 32] |= (1u << (ch % 32));
+        }
+    }
 }
 
 Font* Font::load_from_file(const char* path)
@@ -7,13 +7,19 @@
 #include <cstring>
 #include <fcntl.h>
 #include <libfoundation/Logger.h>
-#include <libfoundation/compress/puff.h>
+#include <libfoundation/compress/inflate.h>
 #include <libg/ImageLoaders/PNGLoader.h>
 #include <memory>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif __ARM_NEON
+#include <arm_neon.h>
+#endif
+
 // #define PNGLOADER_DEGUG
 
 namespace LG {
@@ -78,161 +84,255 @@ namespace PNG {
         streamer().skip(header.len);
     }
 
+    // IDAT chunks of a file come one after another, so the inflater is given
+    // the rest of them right from the mapped file.
+    int PNGLoader::next_IDAT(void* ctx, const unsigned char** in, size_t* in_len)
+    {
+        auto* loader = (PNGLoader*)ctx;
+        const uint8_t* chunk = loader->m_idat_end + sizeof(uint32_t); // CRC of the previous chunk
+        uint32_t len = LFoundation::ByteOrder::from_network(*(uint32_t*)chunk);
+        if (memcmp(chunk + sizeof(uint32_t), (uint8_t*)"IDAT", 4) != 0) {
+            return 0;
+        }
+
+        *in = chunk + 2 * sizeof(uint32_t);
+        *in_len = len;
+        loader->m_idat_end = *in + len;
+        return 1;
+    }
+
     // TODO: Currently support only comprssion type 0
     void PNGLoader::read_IDAT(ChunkHeader& header, PixelBitmap& bitmap)
     {
-        size_t buf_size = m_compressed_data.size();
-        m_compressed_data.resize(buf_size + header.len);
-        memcpy(&m_compressed_data.data()[buf_size], streamer().ptr(), header.len);
-        streamer().skip(header.len);
+        // The first IDAT starts the stream, which takes all of them at once.
+        if (m_idat_done) {
+            streamer().skip(header.len);
+            return;
+        }
+        m_idat_done = true;
+
+        if (m_ihdr_chunk.depth != 8 || (m_ihdr_chunk.color_type != 2 && m_ihdr_chunk.color_type != 6)) {
+            Logger::debug << "PNGLoader: unsupported format" << std::endl;
+            streamer().skip(header.len);
+            return;
+        }
+
+        uint8_t color_length = m_ihdr_chunk.color_type == 6 ? 4 : 3;
+        size_t len_of_scanline = (color_length * m_ihdr_chunk.width * m_ihdr_chunk.depth + 7) / 8;
+        size_t datalen = m_ihdr_chunk.height * (len_of_scanline + 1);
+        uint8_t* unzipped_data = (uint8_t*)malloc(datalen);
+        m_scanline_keeper.init(unzipped_data, color_length);
+
+        m_idat_end = streamer().ptr() + header.len;
+        inflate_stream_t stream = {};
+        stream.in = streamer().ptr();
+        stream.in_len = header.len;
+        stream.refill = next_IDAT;
+        stream.refill_ctx = this;
+        stream.out = unzipped_data;
+        stream.out_len = datalen;
+
+        int err = inflate_zlib(&stream);
+        streamer().skip(m_idat_end - streamer().ptr());
+        if (err != INFLATE_OK || stream.out_pos != datalen) {
+            Logger::debug << "PNGLoader: broken image data " << err << std::endl;
+            m_scanline_keeper.invalidate();
+            return;
+        }
+
+        process_scanlines(bitmap, unzipped_data, len_of_scanline);
     }
 
-    void PNGLoader::process_compressed_data(PixelBitmap& bitmap)
+    // Every row is unfiltered against the one above, which is final by then,
+    // and goes to the bitmap right away while it is still in cache.
+    void PNGLoader::process_scanlines(PixelBitmap& bitmap, uint8_t* data, size_t len_of_scanline)
     {
-        size_t datalen = m_compressed_data.size();
-        size_t destlen = 0;
-        int ret = puff(0, &destlen, m_compressed_data.data() + 2, &datalen);
-        uint8_t* unzipped_data = (uint8_t*)malloc(destlen);
-        puff(unzipped_data, &destlen, m_compressed_data.data() + 2, &datalen);
-        DataStreamer local_streamer(unzipped_data);
-        m_scanline_keeper.init(unzipped_data);
+        bitmap.set_format(m_ihdr_chunk.color_type == 6 ? PixelBitmapFormat::RGBA_Premultiplied : PixelBitmapFormat::RGB);
 
-        if (m_ihdr_chunk.color_type == 2) {
-            m_scanline_keeper.set_color_length(3);
-            if (m_ihdr_chunk.depth == 8) {
-                for (int i = 0; i < m_ihdr_chunk.height; i++) {
-                    uint8_t scanline_filter;
-                    local_streamer.read(scanline_filter);
-
-                    if (scanline_filter > 4) {
-                        Logger::debug << "Invalid PNG filter: " << scanline_filter << std::endl;
-                        continue;
-                    }
-
-                    size_t len_of_scanline = (m_scanline_keeper.color_length() * m_ihdr_chunk.width * m_ihdr_chunk.depth + 7) / 8;
-                    m_scanline_keeper.add(Scanline(scanline_filter, local_streamer.ptr()));
-                    local_streamer.skip(len_of_scanline);
-                }
-            }
-        } else if (m_ihdr_chunk.color_type == 6) {
-            m_scanline_keeper.set_color_length(4);
-            if (m_ihdr_chunk.depth == 8) {
-                for (int i = 0; i < m_ihdr_chunk.height; i++) {
-                    uint8_t scanline_filter;
-                    local_streamer.read(scanline_filter);
-
-                    if (scanline_filter > 4) {
-                        Logger::debug << "Invalid PNG filter: " << scanline_filter << std::endl;
-                        continue;
-                    }
-
-                    size_t len_of_scanline = (m_scanline_keeper.color_length() * m_ihdr_chunk.width * m_ihdr_chunk.depth + 7) / 8;
-                    m_scanline_keeper.add(Scanline(scanline_filter, local_streamer.ptr()));
-                    local_streamer.skip(len_of_scanline);
-                }
+        // The row above the first one is taken as zeros.
+        uint8_t* zero_row = (uint8_t*)calloc(len_of_scanline, 1);
+        const uint8_t* prior = zero_row;
+        DataStreamer local_streamer(data);
+        for (int i = 0; i < m_ihdr_chunk.height; i++) {
+            uint8_t scanline_filter;
+            local_streamer.read(scanline_filter);
+
+            if (scanline_filter > 4) {
+                Logger::debug << "Invalid PNG filter: " << scanline_filter << std::endl;
+                break;
             }
+
+            uint8_t* row = local_streamer.ptr();
+            unfilter_scanline(scanline_filter, row, prior, len_of_scanline);
+            copy_scanline_to_bitmap(row, bitmap[i]);
+            prior = row;
+            local_streamer.skip(len_of_scanline);
         }
 
-        unfilter_scanlines();
-        copy_scanlines_to_bitmap(bitmap);
+        free(zero_row);
         m_scanline_keeper.invalidate();
     }
 
+    // Picks the one of a, b, c closest to a + b - c, ties go in that order.
+    // Compiles to selects, the pick of a filter is data driven and branches
+    // here are mispredicted about every other byte.
     uint8_t PNGLoader::paeth_predictor(int a, int b, int c)
     {
-        int p = a + b - c;
-        int pa = abs(p - a);
-        int pb = abs(p - b);
-        int pc = abs(p - c);
-        if (pa <= pb && pa <= pc)
-            return a;
-        if (pb <= pc)
-            return b;
-        return c;
+        int pa = abs(b - c);
+        int pb = abs(a - c);
+        int pc = abs(a + b - 2 * c);
+        int nearest = pb < pa ? b : a;
+        int min_ab = pb < pa ? pb : pa;
+        return pc < min_ab ? c : nearest;
     }
 
-    void PNGLoader::unfilter_scanlines()
+#ifdef __SSE2__
+    // Sub, Average and Paeth depend on the pixel to the left, so the SIMD
+    // versions take a pixel at a time with all of its channels at once.
+    static inline __m128i load_pixel(const uint8_t* ptr, int bpp)
     {
-        for (int i = 0; i < m_ihdr_chunk.height; i++) {
-            if (m_scanline_keeper.scanlines()[i].filter_type() == 1) { // Sub
-                int width = m_ihdr_chunk.width * m_scanline_keeper.color_length();
-                for (int j = 0; j < width; j++) {
-                    int prev = 0;
-                    if (j >= m_scanline_keeper.color_length()) {
-                        prev = m_scanline_keeper.scanlines()[i].data()[j - m_scanline_keeper.color_length()];
-                    }
-                    m_scanline_keeper.scanlines()[i].data()[j] += prev;
-                }
-            } else if (m_scanline_keeper.scanlines()[i].filter_type() == 2) { // Up
-                int width = m_ihdr_chunk.width * m_scanline_keeper.color_length();
-                for (int j = 0; j < width; j++) {
-                    int prev = 0;
-                    if (i > 0) {
-                        prev = m_scanline_keeper.scanlines()[i - 1].data()[j];
-                    }
-                    m_scanline_keeper.scanlines()[i].data()[j] += prev;
-                }
-            } else if (m_scanline_keeper.scanlines()[i].filter_type() == 3) { // Average
-                int width = m_ihdr_chunk.width * m_scanline_keeper.color_length();
-                for (int j = 0; j < width; j++) {
-                    int prev = 0;
-                    int prior = 0;
-                    if (i > 0) {
-                        prior = m_scanline_keeper.scanlines()[i - 1].data()[j];
-                    }
-                    if (j >= m_scanline_keeper.color_length()) {
-                        prev = m_scanline_keeper.scanlines()[i].data()[j - m_scanline_keeper.color_length()];
-                    }
-                    m_scanline_keeper.scanlines()[i].data()[j] += (prev + prior) / 2;
-                }
-            } else if (m_scanline_keeper.scanlines()[i].filter_type() == 4) { // Paeth
-                int width = m_ihdr_chunk.width * m_scanline_keeper.color_length();
-                for (int j = 0; j < width; j++) {
-                    int a = 0;
-                    int b = 0;
-                    int c = 0;
-                    if (i > 0) {
-                        b = m_scanline_keeper.scanlines()[i - 1].data()[j];
-                    }
-                    if (j >= m_scanline_keeper.color_length()) {
-                        a = m_scanline_keeper.scanlines()[i].data()[j - m_scanline_keeper.color_length()];
-                        if (i > 0) {
-                            c = m_scanline_keeper.scanlines()[i - 1].data()[j - m_scanline_keeper.color_length()];
-                        }
-                    }
-                    m_scanline_keeper.scanlines()[i].data()[j] += paeth_predictor(a, b, c);
-                }
-            }
+        uint32_t val = 0;
+        memcpy(&val, ptr, bpp);
+        return _mm_cvtsi32_si128(val);
+    }
+
+    static inline void store_pixel(uint8_t* ptr, __m128i px, int bpp)
+    {
+        uint32_t val = _mm_cvtsi128_si32(px);
+        memcpy(ptr, &val, bpp);
+    }
+
+    static inline __m128i abs_epi16(__m128i x)
+    {
+        return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+    }
+
+    static inline __m128i select_si128(__m128i mask, __m128i a, __m128i b)
+    {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+#endif
+
+    static void unfilter_sub(uint8_t* row, size_t len, int bpp)
+    {
+#ifdef __SSE2__
+        __m128i a = _mm_setzero_si128();
+        for (size_t i = 0; i < len; i += bpp) {
+            a = _mm_add_epi8(load_pixel(row + i, bpp), a);
+            store_pixel(row + i, a, bpp);
+        }
+#else
+        for (size_t i = bpp; i < len; i++) {
+            row[i] += row[i - bpp];
+        }
+#endif
+    }
+
+    static void unfilter_up(uint8_t* row, const uint8_t* prior, size_t len)
+    {
+        size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= len; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(prior + i));
+            _mm_storeu_si128((__m128i*)(row + i), _mm_add_epi8(x, b));
+        }
+#elif __ARM_NEON
+        for (; i + 16 <= len; i += 16) {
+            vst1q_u8(row + i, vaddq_u8(vld1q_u8(row + i), vld1q_u8(prior + i)));
+        }
+#endif
+        for (; i < len; i++) {
+            row[i] += prior[i];
+        }
+    }
+
+    static void unfilter_average(uint8_t* row, const uint8_t* prior, size_t len, int bpp)
+    {
+#ifdef __SSE2__
+        // avg_epu8 rounds up, the filter rounds down.
+        __m128i one = _mm_set1_epi8(1);
+        __m128i a = _mm_setzero_si128();
+        for (size_t i = 0; i < len; i += bpp) {
+            __m128i b = load_pixel(prior + i, bpp);
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(load_pixel(row + i, bpp), avg);
+            store_pixel(row + i, a, bpp);
+        }
+#else
+        for (size_t i = 0; i < (size_t)bpp; i++) {
+            row[i] += prior[i] >> 1;
         }
+        for (size_t i = bpp; i < len; i++) {
+            row[i] += (row[i - bpp] + prior[i]) >> 1;
+        }
+#endif
     }
 
-    void PNGLoader::copy_scanlines_to_bitmap(PixelBitmap& bitmap)
+    void PNGLoader::unfilter_scanline(int filter, uint8_t* row, const uint8_t* prior, size_t len)
+    {
+        int bpp = m_scanline_keeper.color_length();
+        switch (filter) {
+        case 1:
+            unfilter_sub(row, len, bpp);
+            return;
+        case 2:
+            unfilter_up(row, prior, len);
+            return;
+        case 3:
+            unfilter_average(row, prior, len, bpp);
+            return;
+        case 4:
+            break;
+        default:
+            return;
+        }
+
+#ifdef __SSE2__
+        // Paeth in 16 bits, a is the pixel to the left, b above and c above
+        // the left one.
+        __m128i zero = _mm_setzero_si128();
+        __m128i a = zero;
+        __m128i c = zero;
+        for (size_t i = 0; i < len; i += bpp) {
+            __m128i b = _mm_unpacklo_epi8(load_pixel(prior + i, bpp), zero);
+            __m128i pa = _mm_sub_epi16(b, c);
+            __m128i pb = _mm_sub_epi16(a, c);
+            __m128i pc = abs_epi16(_mm_add_epi16(pa, pb));
+            pa = abs_epi16(pa);
+            pb = abs_epi16(pb);
+
+            __m128i b_nearer = _mm_cmplt_epi16(pb, pa);
+            __m128i nearest = select_si128(b_nearer, b, a);
+            __m128i c_nearest = _mm_cmplt_epi16(pc, _mm_min_epi16(pa, pb));
+            nearest = select_si128(c_nearest, c, nearest);
+
+            __m128i x = _mm_add_epi8(load_pixel(row + i, bpp), _mm_packus_epi16(nearest, zero));
+            store_pixel(row + i, x, bpp);
+            a = _mm_unpacklo_epi8(x, zero);
+            c = b;
+        }
+#else
+        for (size_t i = 0; i < (size_t)bpp; i++) {
+            row[i] += prior[i];
+        }
+        for (size_t i = bpp; i < len; i++) {
+            row[i] += paeth_predictor(row[i - bpp], prior[i], prior[i - bpp]);
+        }
+#endif
+    }
+
+    void PNGLoader::copy_scanline_to_bitmap(const uint8_t* row, Color* out)
     {
         if (m_ihdr_chunk.color_type == 2) {
-            bitmap.set_format(PixelBitmapFormat::RGB);
-            for (int i = 0; i < m_ihdr_chunk.height; i++) {
-                auto& scanline = m_scanline_keeper.scanlines()[i];
-                for (int j = 0, bit = 0; j < m_ihdr_chunk.width; j++) {
-                    int r = scanline.data()[bit++];
-                    int g = scanline.data()[bit++];
-                    int b = scanline.data()[bit++];
-                    int alpha = 255;
-                    bitmap[i][j] = Color(r, g, b, alpha);
-                }
+            for (int j = 0; j < m_ihdr_chunk.width; j++, row += 3) {
+                out[j] = Color(row[0], row[1], row[2]);
             }
+            return;
         }
-        if (m_ihdr_chunk.color_type == 6) {
-            bitmap.set_format(PixelBitmapFormat::RGBA);
-            for (int i = 0; i < m_ihdr_chunk.height; i++) {
-                auto& scanline = m_scanline_keeper.scanlines()[i];
-                for (int j = 0, bit = 0; j < m_ihdr_chunk.width; j++) {
-                    int r = scanline.data()[bit++];
-                    int g = scanline.data()[bit++];
-                    int b = scanline.data()[bit++];
-                    int alpha = scanline.data()[bit++];
-                    bitmap[i][j] = Color(r, g, b, alpha);
-                }
-            }
+
+        for (int j = 0; j < m_ihdr_chunk.width; j++, row += 4) {
+            out[j] = Color(row[0], row[1], row[2], row[3]).premultiplied();
         }
     }
 
@@ -273,9 +373,7 @@ namespace PNG {
 
     void PNGLoader::proccess_stream(PixelBitmap& bitmap)
     {
-        int len = 0;
         while (read_chunk(bitmap)) { }
-        process_compressed_data(bitmap);
     }
 
     PixelBitmap PNGLoader::load_from_mem(const uint8_t* ptr)
@@ -4,12 +4,15 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <algorithm>
 #include <libg/PixelBitmap.h>
+#include <vector>
 
 namespace LG {
 
-PixelBitmap::PixelBitmap(Color* buffer, size_t width, size_t height, PixelBitmapFormat format)
+PixelBitmap::PixelBitmap(Color* buffer, size_t width, size_t height, PixelBitmapFormat format, size_t stride)
     : m_data(buffer)
+    , m_stride(stride ? stride : width)
     , m_bounds(0, 0, width, height)
     , m_should_free(false)
     , m_format(format)
@@ -17,47 +20,192 @@ PixelBitmap::PixelBitmap(Color* buffer, size_t width, size_t height, PixelBitmap
 }
 
 PixelBitmap::PixelBitmap(size_t width, size_t height, PixelBitmapFormat format)
-    : m_bounds(0, 0, width, height)
-    , m_data((Color*)malloc(sizeof(Color) * width * height))
-    , m_should_free(true)
-    , m_format(format)
+    : m_format(format)
 {
+    allocate(width, height);
 }
 
 PixelBitmap::PixelBitmap(const PixelBitmap& bitmap)
-    : m_data(nullptr)
+    : m_data(bitmap.m_data)
+    , m_stride(bitmap.m_stride)
     , m_bounds(bitmap.m_bounds)
-    , m_should_free(bitmap.m_should_free)
     , m_format(bitmap.m_format)
 {
-    if (m_should_free) {
-        size_t len = width() * height() * sizeof(Color);
-        m_data = (Color*)malloc(len);
-        memcpy((uint8_t*)m_data, (uint8_t*)bitmap.m_data, len);
-    } else {
-        m_data = bitmap.m_data;
+    if (bitmap.m_should_free) {
+        allocate(bitmap.width(), bitmap.height());
+        copy_rows_from(bitmap);
     }
 }
 
 PixelBitmap::PixelBitmap(PixelBitmap&& moved_bitmap) noexcept
-    : m_data(moved_bitmap.m_data)
+    : m_allocation(moved_bitmap.m_allocation)
+    , m_data(moved_bitmap.m_data)
+    , m_stride(moved_bitmap.m_stride)
     , m_bounds(moved_bitmap.m_bounds)
     , m_should_free(moved_bitmap.m_should_free)
     , m_format(moved_bitmap.m_format)
 {
+    moved_bitmap.m_allocation = nullptr;
     moved_bitmap.m_data = nullptr;
+    moved_bitmap.m_stride = 0;
     moved_bitmap.bounds().set_width(0);
     moved_bitmap.bounds().set_height(0);
     moved_bitmap.m_should_free = false;
 }
 
+// Malloc aligns to 8 bytes only, so the first row is aligned by hand and
+// the allocation is kept to be freed.
+void PixelBitmap::allocate(size_t width, size_t height)
+{
+    constexpr size_t row_pixels = RowAlignment / sizeof(Color);
+    m_stride = (width + row_pixels - 1) & ~(row_pixels - 1);
+    m_bounds = LG::Rect(0, 0, width, height);
+    m_allocation = malloc(m_stride * height * sizeof(Color) + RowAlignment);
+    m_data = (Color*)(((uintptr_t)m_allocation + RowAlignment - 1) & ~(uintptr_t)(RowAlignment - 1));
+    m_should_free = true;
+}
+
+void PixelBitmap::copy_rows_from(const PixelBitmap& bitmap)
+{
+    for (size_t y = 0; y < height(); y++) {
+        memcpy((uint8_t*)line(y), (const uint8_t*)bitmap.line(y), width() * sizeof(Color));
+    }
+}
+
 void PixelBitmap::resize(size_t width, size_t height)
 {
     clear();
-    bounds().set_width(width);
-    bounds().set_height(height);
-    m_data = (Color*)malloc(sizeof(Color) * width * height);
-    m_should_free = true;
+    allocate(width, height);
+}
+
+PixelBitmap PixelBitmap::view(const Rect& rect) const
+{
+    LG::Rect area = bounds().intersection(rect);
+    if (area.empty()) {
+        return PixelBitmap();
+    }
+    return PixelBitmap(m_data + area.min_y() * m_stride + area.min_x(), area.width(), area.height(), m_format, m_stride);
+}
+
+void PixelBitmap::copy_to(Color* buffer) const
+{
+    if (is_contiguous()) {
+        memcpy((uint8_t*)buffer, (const uint8_t*)m_data, width() * height() * sizeof(Color));
+        return;
+    }
+    for (size_t y = 0; y < height(); y++) {
+        memcpy((uint8_t*)(buffer + y * width()), (const uint8_t*)line(y), width() * sizeof(Color));
+    }
+}
+
+static inline int ceil_to_int(float x)
+{
+    int res = int(x);
+    return res < x ? res + 1 : res;
+}
+
+// Source pixels which make up every destination pixel along one axis. A
+// destination pixel takes count pixels from first, and their weights, which
+// add up to 1, are at stride * index.
+struct ScaleTaps {
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<float> weights;
+    int stride;
+};
+
+static void build_scale_taps(ScaleTaps& taps, int src, int dst)
+{
+    taps.first.resize(dst);
+    taps.count.resize(dst);
+
+    float scale = float(src) / float(dst);
+    if (dst < src) {
+        // Box: the pixel is the average of what it covers, the pixels on the
+        // edges count by the part of them which is covered.
+        taps.stride = ceil_to_int(scale) + 1;
+        taps.weights.resize(dst * taps.stride);
+        for (int i = 0; i < dst; i++) {
+            float start = i * scale;
+            float end = std::min(start + scale, float(src));
+            int first = int(start);
+            int last = std::min(ceil_to_int(end) - 1, src - 1);
+            taps.first[i] = first;
+            taps.count[i] = last - first + 1;
+            for (int j = first; j <= last; j++) {
+                float covered = std::min(end, float(j + 1)) - std::max(start, float(j));
+                taps.weights[i * taps.stride + j - first] = covered / scale;
+            }
+        }
+        return;
+    }
+
+    // Bilinear: pixel centers are matched, the pixel is taken from the two
+    // nearest ones.
+    taps.stride = 2;
+    taps.weights.resize(dst * taps.stride);
+    for (int i = 0; i < dst; i++) {
+        float center = std::max((i + 0.5f) * scale - 0.5f, 0.0f);
+        int first = std::min(int(center), src - 1);
+        float frac = center - first;
+        taps.first[i] = first;
+        taps.count[i] = first + 1 < src ? 2 : 1;
+        taps.weights[i * 2] = taps.count[i] == 2 ? 1.0f - frac : 1.0f;
+        taps.weights[i * 2 + 1] = frac;
+    }
+}
+
+// Rows are scaled first, every destination row sums its source rows into
+// one row of channels, which is then scaled along x.
+PixelBitmap PixelBitmap::scaled(const Size& size) const
+{
+    int src_width = width();
+    int src_height = height();
+    int dst_width = size.width();
+    int dst_height = size.height();
+    if (!src_width || !src_height || !dst_width || !dst_height) {
+        return PixelBitmap();
+    }
+
+    ScaleTaps x_taps;
+    ScaleTaps y_taps;
+    build_scale_taps(x_taps, src_width, dst_width);
+    build_scale_taps(y_taps, src_height, dst_height);
+
+    bool alpha = has_alpha_channel();
+    PixelBitmap result(dst_width, dst_height, alpha ? RGBA_Premultiplied : RGB);
+    float* row = (float*)malloc(src_width * 4 * sizeof(float));
+    for (int y = 0; y < dst_height; y++) {
+        memset((uint8_t*)row, 0, src_width * 4 * sizeof(float));
+        for (int k = 0; k < y_taps.count[y]; k++) {
+            float weight = y_taps.weights[y * y_taps.stride + k];
+            const Color* src = line(y_taps.first[y] + k);
+            for (int x = 0; x < src_width; x++) {
+                Color clr = m_format == RGBA ? src[x].premultiplied() : src[x];
+                row[4 * x + 0] += weight * clr.red();
+                row[4 * x + 1] += weight * clr.green();
+                row[4 * x + 2] += weight * clr.blue();
+                row[4 * x + 3] += weight * clr.alpha();
+            }
+        }
+
+        Color* dst = result.line(y);
+        for (int x = 0; x < dst_width; x++) {
+            float r = 0.5f, g = 0.5f, b = 0.5f, a = 0.5f;
+            const float* weights = &x_taps.weights[x * x_taps.stride];
+            const float* src = &row[4 * x_taps.first[x]];
+            for (int k = 0; k < x_taps.count[x]; k++, src += 4) {
+                r += weights[k] * src[0];
+                g += weights[k] * src[1];
+                b += weights[k] * src[2];
+                a += weights[k] * src[3];
+            }
+            dst[x] = Color(std::min(int(r), 255), std::min(int(g), 255), std::min(int(b), 255), alpha ? std::min(int(a), 255) : 255);
+        }
+    }
+
+    free(row);
+    return result;
 }
 
-} // namespace LG
\ No newline at end of file
+} // namespace LG
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cstdint>
+#include <libg/Region.h>
+
+namespace LG {
+
+static constexpr int Infinity = (int)INT32_MAX;
+
+// Rects of a band are stored one after another, returns the index past them.
+static size_t band_end(const Rect* rects, size_t count, size_t start)
+{
+    size_t end = start + 1;
+    while (end < count && rects[end].min_y() == rects[start].min_y()) {
+        end++;
+    }
+    return end;
+}
+
+Region::Region(const Rect& rect)
+{
+    if (!rect.empty()) {
+        m_rects.push_back(rect);
+    }
+}
+
+Rect Region::bounds() const
+{
+    if (empty()) {
+        return Rect();
+    }
+
+    int min_x = m_rects[0].min_x();
+    int max_x = m_rects[0].max_x();
+    for (int i = 1; i < m_rects.size(); i++) {
+        min_x = std::min(min_x, m_rects[i].min_x());
+        max_x = std::max(max_x, m_rects[i].max_x());
+    }
+    int min_y = m_rects[0].min_y();
+    int max_y = m_rects.back().max_y();
+    return Rect(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
+}
+
+void Region::unite(const Rect& rect)
+{
+    if (rect.empty() || contains(rect)) {
+        return;
+    }
+    if (empty()) {
+        m_rects.push_back(rect);
+        return;
+    }
+    apply(&rect, 1, Op::Union);
+}
+
+void Region::intersect(const Rect& rect)
+{
+    if (rect.empty()) {
+        clear();
+        return;
+    }
+    apply(&rect, 1, Op::Intersect);
+}
+
+void Region::subtract(const Rect& rect)
+{
+    if (!intersects(rect)) {
+        return;
+    }
+    apply(&rect, 1, Op::Subtract);
+}
+
+bool Region::intersects(const Rect& rect) const
+{
+    if (rect.empty()) {
+        return false;
+    }
+
+    for (int i = 0; i < m_rects.size() && m_rects[i].min_y() <= rect.max_y(); i++) {
+        if (m_rects[i].intersects(rect)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Region::contains(const Rect& rect) const
+{
+    // Rects of the region don't overlap, so the rect is covered if the parts
+    // of it they cover add up to its square.
+    size_t covered = 0;
+    for (int i = 0; i < m_rects.size() && m_rects[i].min_y() <= rect.max_y(); i++) {
+        if (m_rects[i].intersects(rect)) {
+            covered += m_rects[i].intersection(rect).square();
+        }
+    }
+    return covered == rect.square();
+}
+
+// Sweeps both regions top to bottom. The y axis is cut where any band starts
+// or ends, in every piece each region has one band or none, and the bands
+// are swept left to right to find where the op covers the piece. Coordinates
+// are half-open here, a rect spans [min_x, max_x + 1).
+void Region::apply(const Rect* other, size_t other_count, Op op)
+{
+    auto covers = [op](bool in_a, bool in_b) {
+        switch (op) {
+        case Op::Union:
+            return in_a || in_b;
+        case Op::Intersect:
+            return in_a && in_b;
+        case Op::Subtract:
+            return in_a && !in_b;
+        }
+        return false;
+    };
+
+    const Rect* a = m_rects.data();
+    size_t a_count = m_rects.size();
+    const Rect* b = other;
+    size_t b_count = other_count;
+    std::vector<Rect> result;
+
+    size_t prev_band = 0;
+    bool has_prev_band = false;
+    size_t ia = 0;
+    size_t ib = 0;
+    int y = -Infinity;
+    while (ia < a_count || ib < b_count) {
+        int a_top = ia < a_count ? std::max(y, a[ia].min_y()) : Infinity;
+        int b_top = ib < b_count ? std::max(y, b[ib].min_y()) : Infinity;
+        int top = std::min(a_top, b_top);
+        int a_bottom = ia < a_count ? (a_top > top ? a_top : a[ia].max_y() + 1) : Infinity;
+        int b_bottom = ib < b_count ? (b_top > top ? b_top : b[ib].max_y() + 1) : Infinity;
+        int bottom = std::min(a_bottom, b_bottom);
+
+        size_t a_end = ia < a_count ? band_end(a, a_count, ia) : ia;
+        size_t b_end = ib < b_count ? band_end(b, b_count, ib) : ib;
+
+        // A band which starts below the piece takes no part in it.
+        size_t i = a_top == top ? ia : a_end;
+        size_t j = b_top == top ? ib : b_end;
+        bool in_a = false;
+        bool in_b = false;
+        bool covered = false;
+        int start_x = 0;
+        size_t band = result.size();
+        while (i < a_end || j < b_end) {
+            int next_a = i < a_end ? (in_a ? a[i].max_x() + 1 : a[i].min_x()) : Infinity;
+            int next_b = j < b_end ? (in_b ? b[j].max_x() + 1 : b[j].min_x()) : Infinity;
+            int x = std::min(next_a, next_b);
+            if (next_a == x) {
+                i += in_a;
+                in_a = !in_a;
+            }
+            if (next_b == x) {
+                j += in_b;
+                in_b = !in_b;
+            }
+
+            bool now_covered = covers(in_a, in_b);
+            if (now_covered == covered) {
+                continue;
+            }
+            covered = now_covered;
+            if (covered) {
+                start_x = x;
+            } else if (result.size() > band && result.back().max_x() + 1 == start_x) {
+                result.back().set_width(x - result.back().min_x());
+            } else {
+                result.push_back(Rect(start_x, top, x - start_x, bottom - top));
+            }
+        }
+
+        // The band is merged into the one above if it continues it.
+        size_t band_size = result.size() - band;
+        if (band_size) {
+            bool continues_prev = has_prev_band && band - prev_band == band_size && result[prev_band].max_y() + 1 == top;
+            for (size_t k = 0; continues_prev && k < band_size; k++) {
+                const Rect& upper = result[prev_band + k];
+                const Rect& lower = result[band + k];
+                continues_prev = upper.min_x() == lower.min_x() && upper.width() == lower.width();
+            }
+
+            if (continues_prev) {
+                for (size_t k = 0; k < band_size; k++) {
+                    result[prev_band + k].set_height(bottom - result[prev_band + k].min_y());
+                }
+                while (result.size() > band) {
+                    result.pop_back();
+                }
+            } else {
+                prev_band = band;
+                has_prev_band = true;
+            }
+        }
+
+        y = bottom;
+        if (ia < a_count && a[ia].max_y() + 1 == bottom) {
+            ia = a_end;
+        }
+        if (ib < b_count && b[ib].max_y() + 1 == bottom) {
+            ib = b_end;
+        }
+    }
+
+    m_rects = std::move(result);
+}
+
+} // namespace LG
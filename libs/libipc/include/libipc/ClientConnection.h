@@ -1,17 +1,26 @@
 #pragma once
 #include <cstdlib>
+#include <functional>
+#include <list>
+#include <map>
 #include <libfoundation/Event.h>
 #include <libfoundation/EventLoop.h>
 #include <libfoundation/EventReceiver.h>
 #include <libfoundation/Logger.h>
+#include <libipc/LargeMessage.h>
 #include <libipc/Message.h>
 #include <libipc/MessageDecoder.h>
+#include <libipc/PacketBuffer.h>
+#include <libipc/RingTransport.h>
+#include <libipc/SendQueue.h>
 #include <unistd.h>
 #include <vector>
 
 template <typename ServerDecoder, typename ClientDecoder>
 class ClientConnection : public LFoundation::EventReceiver {
 public:
+    typedef std::function<void(std::unique_ptr<Message>)> ReplyCallback;
+
     ClientConnection(int sock_fd, ServerDecoder& server_decoder, ClientDecoder& client_decoder)
         : m_connection_fd(sock_fd)
         , m_server_decoder(server_decoder)
@@ -24,64 +33,85 @@ public:
 
     bool send_message(const Message& msg) const
     {
-        auto encoded_msg = msg.encode();
-        int wrote = write(m_connection_fd, encoded_msg.data(), encoded_msg.size());
-        return wrote == encoded_msg.size();
+        if (m_ring.attached()) {
+            return m_ring.push(msg);
+        }
+        return m_send_queue.push(m_connection_fd, msg);
     }
 
-    std::unique_ptr<Message> send_sync(const Message& msg)
+    bool flush() const
     {
-        bool status = send_message(msg);
-        return wait_for_answer(msg);
+        if (m_ring.attached()) {
+            return m_ring.flush(m_connection_fd);
+        }
+        return m_send_queue.flush(m_connection_fd);
     }
 
-    std::unique_ptr<Message> wait_for_answer(const Message& msg)
+    // Moves the connection to shared rings, see RingTransport. What is
+    // queued goes through the socket before the frame, so the order holds.
+    bool attach_ring()
     {
-        for (;;) {
-            for (int i = 0; i < m_messages.size(); i++) {
-                if (m_messages[i] && m_messages[i]->key() == msg.key() && m_messages[i]->id() == msg.reply_id()) {
-                    return m_messages[i].release();
-                }
-            }
+        if (m_ring.attached()) {
+            return true;
+        }
+        auto packet = m_ring.create();
+        if (!packet.size()) {
+            return false;
+        }
+        m_send_queue.flush(m_connection_fd);
+        return write(m_connection_fd, packet.data(), packet.size()) == packet.size();
+    }
+
+    // Doesn't wait for the reply, the callback gets it from the event loop.
+    // The server answers in order, so replies of one kind are matched with
+    // the requests in order too, and requests can be pipelined.
+    void send_request(const Message& msg, ReplyCallback callback)
+    {
+        m_pending_replies[msg.reply_id()].push_back(PendingReply { msg.key(), callback, nullptr });
+        send_message(msg);
+    }
+
+    std::unique_ptr<Message> send_sync(const Message& msg)
+    {
+        std::unique_ptr<Message> reply;
+        m_pending_replies[msg.reply_id()].push_back(PendingReply { msg.key(), nullptr, &reply });
+        send_message(msg);
+        flush();
+        while (!reply) {
             pump_messages();
         }
+        return reply;
     }
 
     void pump_messages()
     {
-        std::vector<char> buf;
-
-        char tmpbuf[1024];
+        // The server may wait for what is queued, so it goes first.
+        flush();
 
-        int read_cnt;
-        while ((read_cnt = read(m_connection_fd, tmpbuf, sizeof(tmpbuf)))) {
-            if (read_cnt <= 0) {
-                Logger::debug << getpid() << " :: ClientConnection read error" << std::endl;
-                return;
-            }
-            size_t buf_size = buf.size();
-            buf.resize(buf_size + read_cnt);
-            memcpy((uint8_t*)&buf.data()[buf_size], (uint8_t*)tmpbuf, read_cnt);
-            if (read_cnt < sizeof(tmpbuf)) {
-                break;
+        // The ring is drained first. The socket is read only if the ring
+        // was empty, since the read blocks until the server rings the
+        // doorbell. A doorbell left unread just wakes us once more.
+        size_t ring_packets = 0;
+        if (m_ring.attached()) {
+            bool ok = m_ring.receive(m_connection_fd, [&](const char* buf, size_t len) {
+                ring_packets++;
+                handle_packet(buf, len);
+            });
+            if (!ok) {
+                Logger::debug << getpid() << " :: ClientConnection broken ring" << std::endl;
             }
         }
 
-        size_t msg_len = 0;
-        size_t buf_size = buf.size();
-        for (size_t i = 0; i < buf_size; i += msg_len) {
-            msg_len = 0;
-            if (auto response = m_client_decoder.decode((buf.data() + i), read_cnt - i, msg_len)) {
-                m_messages.push_back(std::move(response));
-            } else if (auto response = m_server_decoder.decode((buf.data() + i), read_cnt - i, msg_len)) {
-                m_messages.push_back(std::move(response));
-            } else {
+        if (!ring_packets) {
+            int read_cnt = m_buffer.read_from(m_connection_fd);
+            if (read_cnt < 0) {
                 Logger::debug << getpid() << " :: ClientConnection read error" << std::endl;
-                std::abort();
+                return;
             }
+            m_buffer.for_each_packet([&](const char* buf, size_t len) { handle_packet(buf, len); });
         }
 
-        if (m_messages.size() > 0) {
+        if (m_messages.size() > 0 || m_ready_replies.size() > 0) {
             // Note: We send an event to ourselves and use CallEvent to recognize the
             // event as sign to start processing of messages.
             LFoundation::EventLoop::the().add(*this, new LFoundation::CallEvent(nullptr));
@@ -93,19 +123,102 @@ public:
         if (event->type() == LFoundation::Event::Type::DeferredInvoke) {
             // Note: The event was sent from pump_messages() and callback of CallEvent is 0!
             // Do NOT call callback here!
-            auto msg = std::move(m_messages);
-            for (int i = 0; i < msg.size(); i++) {
-                if (msg[i] && msg[i]->decoder_magic() == m_client_decoder.magic() && msg[i]->key() == m_accepted_key) {
-                    m_client_decoder.handle(*msg[i]);
-                }
+            dispatch_messages();
+        }
+    }
+
+    // Handles the received messages right away, not from the event loop.
+    void dispatch_messages()
+    {
+        auto msg = std::move(m_messages);
+        for (int i = 0; i < msg.size(); i++) {
+            if (msg[i] && msg[i]->decoder_magic() == m_client_decoder.magic() && msg[i]->key() == m_accepted_key) {
+                m_client_decoder.handle(*msg[i]);
             }
         }
+
+        auto replies = std::move(m_ready_replies);
+        for (int i = 0; i < replies.size(); i++) {
+            replies[i].callback(std::move(replies[i].reply));
+        }
     }
 
 private:
+    struct PendingReply {
+        message_key_t key;
+        ReplyCallback callback;
+        std::unique_ptr<Message>* sync_reply;
+    };
+
+    struct ReadyReply {
+        ReplyCallback callback;
+        std::unique_ptr<Message> reply;
+    };
+
+    // Empty packets are doorbells of the ring, they only wake us up.
+    void handle_packet(const char* buf, size_t len)
+    {
+        if (!len) {
+            return;
+        }
+        if (LargeMessage::is_frame(buf, len)) {
+            LargeMessage::unwrap(buf, m_client_decoder.magic(), m_accepted_key, [&](const char* payload, size_t payload_len) {
+                decode_message(payload, payload_len);
+            });
+            return;
+        }
+        decode_message(buf, len);
+    }
+
+    // Callbacks are not called from here, the packet buffer is being read.
+    bool take_reply(std::unique_ptr<Message>& msg)
+    {
+        auto& pending = m_pending_replies[msg->id()];
+        if (pending.empty() || pending.front().key != msg->key()) {
+            return false;
+        }
+
+        PendingReply request = pending.front();
+        pending.pop_front();
+        if (request.sync_reply) {
+            *request.sync_reply = std::move(msg);
+        } else if (request.callback) {
+            m_ready_replies.push_back(ReadyReply { request.callback, std::move(msg) });
+        }
+        return true;
+    }
+
+    // Packets are whole, so one which no decoder knows is just skipped.
+    // Messages are handled later from the event loop, so they are kept
+    // decoded, only replies go to their requests at once.
+    void decode_message(const char* buf, size_t size)
+    {
+        int magic = size >= sizeof(int) ? MessageDecoder::peek_magic(buf) : 0;
+        size_t msg_len = 0;
+        if (magic == m_client_decoder.magic()) {
+            if (auto response = m_client_decoder.decode(buf, size, msg_len)) {
+                m_messages.push_back(std::move(response));
+                return;
+            }
+        } else if (magic == m_server_decoder.magic()) {
+            if (auto response = m_server_decoder.decode(buf, size, msg_len)) {
+                if (!take_reply(response)) {
+                    m_messages.push_back(std::move(response));
+                }
+                return;
+            }
+        }
+        Logger::debug << getpid() << " :: ClientConnection unknown message" << std::endl;
+    }
+
     int m_accepted_key { -1 };
     int m_connection_fd;
+    PacketBuffer m_buffer;
+    mutable SendQueue m_send_queue;
+    mutable RingTransport m_ring;
     std::vector<std::unique_ptr<Message>> m_messages;
+    std::map<int, std::list<PendingReply>> m_pending_replies;
+    std::vector<ReadyReply> m_ready_replies;
     ServerDecoder& m_server_decoder;
     ClientDecoder& m_client_decoder;
 };
\ No newline at end of file
@@ -4,5 +4,13 @@
 template <typename T>
 class Encodable {
 public:
-    virtual void encode(EncodedMessage& buf) const { }
-};
\ No newline at end of file
+    virtual size_t encoded_size() const { return 0; }
+    virtual void store(uint8_t* buf, size_t& offset) const { }
+
+    void encode(EncodedMessage& buf) const
+    {
+        size_t offset = buf.size();
+        buf.resize(offset + encoded_size());
+        store(buf.data(), offset);
+    }
+};
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdint>
+#include <cstring>
 #include <vector>
 
 typedef std::vector<uint8_t> EncodedMessage;
@@ -79,6 +81,45 @@ public:
         value.encode(buf);
     }
 
+    // Ints take 4 bytes on the wire, whatever their type is.
+    static constexpr size_t encoded_size(int) { return sizeof(uint32_t); }
+    static constexpr size_t encoded_size(unsigned int) { return sizeof(uint32_t); }
+    static constexpr size_t encoded_size(unsigned long) { return sizeof(uint32_t); }
+
+    template <typename T>
+    static size_t encoded_size(const T& value)
+    {
+        return value.encoded_size();
+    }
+
+    // Stores write into a buffer which is already sized with encoded_size(),
+    // so a message is encoded with no reallocation. All our targets are
+    // little-endian, which is the wire order, so ints are copied as is.
+    static void store(uint8_t* buf, size_t& offset, int val)
+    {
+        memcpy(buf + offset, &val, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+    }
+
+    static void store(uint8_t* buf, size_t& offset, unsigned int val)
+    {
+        memcpy(buf + offset, &val, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+    }
+
+    static void store(uint8_t* buf, size_t& offset, unsigned long val)
+    {
+        uint32_t val32 = val;
+        memcpy(buf + offset, &val32, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+    }
+
+    template <typename T>
+    static void store(uint8_t* buf, size_t& offset, const T& value)
+    {
+        value.store(buf, offset);
+    }
+
     template <typename T>
     static void decode(const char* buf, size_t& offset, T& value)
     {
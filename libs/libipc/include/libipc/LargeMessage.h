@@ -0,0 +1,77 @@
+#pragma once
+#include <cstring>
+#include <libipc/Encoder.h>
+#include <libipc/Message.h>
+#include <sys/shared_buffer.h>
+
+// Messages of at least PayloadThreshold bytes don't go through the socket.
+// The sender puts the encoded message into a shared buffer and writes a
+// frame with its id instead. Every reader of the socket sees the frame, only
+// the one the message is for decodes it right from the buffer and frees it.
+class LargeMessage {
+public:
+    static constexpr int FrameMagic = 0x4c4d5347;
+    static constexpr size_t FrameSize = 5 * sizeof(int);
+    static constexpr size_t PayloadThreshold = 4096;
+
+    // Returns an empty frame if the message is small or no shared buffer is
+    // left, then the message is copied through the socket.
+    static EncodedMessage wrap(const Message& msg, const uint8_t* encoded_msg, size_t len)
+    {
+        EncodedMessage frame;
+        if (len < PayloadThreshold) {
+            return frame;
+        }
+
+        uint8_t* data;
+        int buffer_id = shared_buffer_create(&data, len);
+        if (buffer_id < 0) {
+            return frame;
+        }
+        memcpy(data, encoded_msg, len);
+        // The reader frees the buffer once it has decoded the message.
+        shared_buffer_hand_over(buffer_id);
+
+        Encoder::append(frame, FrameMagic);
+        Encoder::append(frame, msg.decoder_magic());
+        Encoder::append(frame, msg.key());
+        Encoder::append(frame, buffer_id);
+        Encoder::append(frame, (int)len);
+        return frame;
+    }
+
+    static bool is_frame(const char* buf, size_t size)
+    {
+        if (size < FrameSize) {
+            return false;
+        }
+        int magic;
+        size_t offset = 0;
+        Encoder::decode(buf, offset, magic);
+        return magic == FrameMagic;
+    }
+
+    // Calls callback(payload, len) if the frame carries a message of the
+    // decoder with the key, a key of -1 matches any.
+    template <typename Callback>
+    static void unwrap(const char* buf, int decoder_magic, message_key_t key, Callback callback)
+    {
+        int magic, msg_decoder_magic, msg_key, buffer_id, len;
+        size_t offset = 0;
+        Encoder::decode(buf, offset, magic);
+        Encoder::decode(buf, offset, msg_decoder_magic);
+        Encoder::decode(buf, offset, msg_key);
+        Encoder::decode(buf, offset, buffer_id);
+        Encoder::decode(buf, offset, len);
+        if (msg_decoder_magic != decoder_magic || (key != -1 && msg_key != key)) {
+            return;
+        }
+
+        uint8_t* data;
+        if (shared_buffer_get(buffer_id, &data) < 0) {
+            return;
+        }
+        callback((const char*)data, (size_t)len);
+        shared_buffer_free(buffer_id);
+    }
+};
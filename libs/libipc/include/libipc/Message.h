@@ -14,5 +14,24 @@ public:
     virtual int id() const { return 0; }
     virtual message_key_t key() const { return -1; }
     virtual int reply_id() const { return -1; } // -1 means that there is no reply.
-    virtual EncodedMessage encode() const { return std::vector<uint8_t>(); }
+    virtual size_t encoded_size() const { return 0; }
+
+    // Writes the message to data, which has room for encoded_size() bytes.
+    // The data may be a ring shared with the other process, see RingTransport.
+    virtual void encode_to(uint8_t* data) const { }
+
+    // Appends the message to the buffer, sized once for the whole message.
+    void encode_into(EncodedMessage& buffer) const
+    {
+        size_t offset = buffer.size();
+        buffer.resize(offset + encoded_size());
+        encode_to(buffer.data() + offset);
+    }
+
+    EncodedMessage encode() const
+    {
+        EncodedMessage buffer;
+        encode_into(buffer);
+        return buffer;
+    }
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include <libipc/Encoder.h>
 #include <libipc/Message.h>
 #include <memory>
 
@@ -9,5 +10,16 @@ public:
 
     virtual int magic() { return 0; }
     virtual std::unique_ptr<Message> decode(const char* buf, size_t size, size_t& decoded_msg_len) { return nullptr; }
+    virtual std::unique_ptr<Message> dispatch(const char* buf, size_t size) { return nullptr; }
     virtual std::unique_ptr<Message> handle(const Message&) { return nullptr; }
+
+    // Every message starts with the magic of its decoder, so the decoder is
+    // picked before anything is decoded.
+    static int peek_magic(const char* buf)
+    {
+        int magic;
+        size_t offset = 0;
+        Encoder::decode(buf, offset, magic);
+        return magic;
+    }
 };
\ No newline at end of file
@@ -0,0 +1,149 @@
+#pragma once
+#include <cstring>
+#include <libipc/PacketBuffer.h>
+#include <sys/types.h>
+
+// A ring of packets in memory shared by two processes, one of them only
+// writes it and the other only reads it. Packets look like the ones of the
+// socket, see PacketBuffer, and are 4 byte aligned. A packet which doesn't
+// fit before the end of the ring goes to its start after a WrapMarker.
+// Positions only grow and are taken modulo Size.
+class MessageRing {
+public:
+    static constexpr size_t Size = 16 * 1024;
+    static constexpr uint32_t WrapMarker = 0xffffffff;
+
+    // What the reader and the writer change lives on separate cache lines.
+    struct Control {
+        uint32_t head;
+        uint32_t reader_waiting;
+        uint32_t reader_pad[14];
+        uint32_t tail;
+        uint32_t writer_blocked;
+        uint32_t writer_pad[14];
+    };
+
+    void attach(Control* control, uint8_t* data)
+    {
+        m_control = control;
+        m_data = data;
+        m_head = __atomic_load_n(&control->head, __ATOMIC_ACQUIRE);
+        m_tail = __atomic_load_n(&control->tail, __ATOMIC_ACQUIRE);
+        m_published = m_tail;
+    }
+
+    // Writer: returns where a packet of len bytes goes, or nullptr if the
+    // ring has no room for it. The reader sees it after publish().
+    uint8_t* reserve(size_t len)
+    {
+        size_t need = PacketBuffer::HeaderSize + align(len);
+        size_t offset = m_tail % Size;
+        size_t to_end = Size - offset;
+        size_t total = need <= to_end ? need : to_end + need;
+        uint32_t head = __atomic_load_n(&m_control->head, __ATOMIC_SEQ_CST);
+        if (need > Size / 2 || Size - (m_tail - head) < total) {
+            return nullptr;
+        }
+
+        if (need > to_end) {
+            store_header(offset, WrapMarker);
+            m_tail += to_end;
+            offset = 0;
+        }
+        store_header(offset, len);
+        m_tail += need;
+        m_last = m_data + offset + PacketBuffer::HeaderSize;
+        m_last_len = len;
+        return m_last;
+    }
+
+    // Writer: the packet reserved last if it is not published yet and has
+    // len bytes, so a coalescer may still change it.
+    uint8_t* unpublished_last(size_t len) const { return m_last_len == len ? m_last : nullptr; }
+    void forget_last()
+    {
+        m_last = nullptr;
+        m_last_len = 0;
+    }
+
+    // Writer: makes the reserved packets visible. Returns true if the reader
+    // has gone to wait on the socket and needs a doorbell.
+    bool publish()
+    {
+        forget_last();
+        if (m_tail == m_published) {
+            return false;
+        }
+        m_published = m_tail;
+        __atomic_store_n(&m_control->tail, m_tail, __ATOMIC_SEQ_CST);
+        return __atomic_exchange_n(&m_control->reader_waiting, 0, __ATOMIC_SEQ_CST);
+    }
+
+    // Writer: asks the reader for a doorbell once it has made room.
+    void mark_blocked() { __atomic_store_n(&m_control->writer_blocked, 1, __ATOMIC_SEQ_CST); }
+
+    // Reader: calls callback(data, len) for every published packet. The
+    // other process can change the ring at any time, so the positions are
+    // checked here and the callback gets bytes which may still change.
+    // Returns false if the ring is broken.
+    template <typename Callback>
+    bool for_each_packet(Callback callback)
+    {
+        uint32_t tail = __atomic_load_n(&m_control->tail, __ATOMIC_ACQUIRE);
+        if (tail - m_head > Size) {
+            return false;
+        }
+
+        while (m_head != tail) {
+            size_t offset = m_head % Size;
+            uint32_t len = load_header(offset);
+            if (len == WrapMarker) {
+                m_head += Size - offset;
+                continue;
+            }
+
+            size_t need = PacketBuffer::HeaderSize + align(len);
+            if (len > Size || need > Size - offset || need > tail - m_head) {
+                return false;
+            }
+            callback((const char*)m_data + offset + PacketBuffer::HeaderSize, (size_t)len);
+            m_head += need;
+        }
+        __atomic_store_n(&m_control->head, m_head, __ATOMIC_SEQ_CST);
+        return true;
+    }
+
+    // Reader: no doorbells are needed while the ring is drained.
+    void stop_waiting() { __atomic_store_n(&m_control->reader_waiting, 0, __ATOMIC_RELAXED); }
+
+    // Reader: asks for a doorbell on the next publish(). Returns false if
+    // packets came after the ring was drained, they have to be read first.
+    bool wait()
+    {
+        __atomic_store_n(&m_control->reader_waiting, 1, __ATOMIC_SEQ_CST);
+        return __atomic_load_n(&m_control->tail, __ATOMIC_SEQ_CST) == m_head;
+    }
+
+    // Reader: returns true if the writer waits for room.
+    bool take_writer_blocked() { return __atomic_exchange_n(&m_control->writer_blocked, 0, __ATOMIC_SEQ_CST); }
+
+private:
+    static size_t align(size_t len) { return (len + 3) & ~(size_t)3; }
+
+    void store_header(size_t offset, uint32_t val) { memcpy(m_data + offset, &val, sizeof(val)); }
+
+    uint32_t load_header(size_t offset) const
+    {
+        uint32_t val;
+        memcpy(&val, m_data + offset, sizeof(val));
+        return val;
+    }
+
+    Control* m_control { nullptr };
+    uint8_t* m_data { nullptr };
+    uint32_t m_head { 0 };
+    uint32_t m_tail { 0 };
+    uint32_t m_published { 0 };
+    uint8_t* m_last { nullptr };
+    size_t m_last_len { 0 };
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstring>
+#include <libipc/Encoder.h>
+#include <unistd.h>
+#include <vector>
+
+// Every message goes through the socket as a packet, its length followed by
+// its bytes, see SendQueue. The buffer lives as long as the connection, so
+// a packet which is split between two reads is completed by the next one,
+// and packets are decoded right from the buffer.
+class PacketBuffer {
+public:
+    static constexpr size_t HeaderSize = sizeof(int);
+    static constexpr size_t ReadChunk = 1024;
+
+    // Returns the count of bytes read, which is 0 if there were none.
+    int read_from(int fd)
+    {
+        int total = 0;
+        for (;;) {
+            reserve_tail(ReadChunk);
+            int read_cnt = read(fd, m_data.data() + m_end, ReadChunk);
+            if (read_cnt < 0) {
+                return read_cnt;
+            }
+            m_end += read_cnt;
+            total += read_cnt;
+            if (read_cnt < ReadChunk) {
+                return total;
+            }
+        }
+    }
+
+    // Calls callback(data, len) for every whole packet, the rest stays for
+    // the next read.
+    template <typename Callback>
+    void for_each_packet(Callback callback)
+    {
+        while (m_end - m_start >= HeaderSize) {
+            size_t offset = m_start;
+            int len;
+            Encoder::decode(m_data.data(), offset, len);
+            if (m_end - offset < (size_t)len) {
+                break;
+            }
+            m_start = offset + len;
+            callback(m_data.data() + offset, (size_t)len);
+        }
+
+        if (m_start == m_end) {
+            m_start = m_end = 0;
+        }
+    }
+
+private:
+    // The buffer only grows, so a connection stops allocating once it has
+    // seen its biggest burst.
+    void reserve_tail(size_t len)
+    {
+        if (m_start && m_data.size() < m_end + len) {
+            memmove(m_data.data(), m_data.data() + m_start, m_end - m_start);
+            m_end -= m_start;
+            m_start = 0;
+        }
+        if (m_data.size() < m_end + len) {
+            m_data.resize(m_end + len);
+        }
+    }
+
+    std::vector<char> m_data;
+    size_t m_start { 0 };
+    size_t m_end { 0 };
+};
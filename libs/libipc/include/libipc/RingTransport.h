@@ -0,0 +1,203 @@
+#pragma once
+#include <cstring>
+#include <libipc/Encoder.h>
+#include <libipc/LargeMessage.h>
+#include <libipc/Message.h>
+#include <libipc/MessageRing.h>
+#include <libipc/PacketBuffer.h>
+#include <libipc/SendQueue.h>
+#include <sys/shared_buffer.h>
+#include <unistd.h>
+
+// Once the client has set it up, the messages of a connection go through
+// two MessageRings in a shared buffer, the first one from the client to the
+// server. The socket stays for the setup frame and for doorbells: an empty
+// packet which is written only if the reader has drained its ring and went
+// to wait on the socket. So a busy connection sends its messages without
+// syscalls and encodes them right into the ring.
+class RingTransport {
+public:
+    static constexpr int FrameMagic = 0x52494e47;
+    static constexpr size_t FrameSize = 2 * sizeof(int);
+    static constexpr size_t RingBytes = sizeof(MessageRing::Control) + MessageRing::Size;
+
+    bool attached() const { return m_buffer_id >= 0; }
+    void set_coalescer(SendQueue::Coalescer coalescer) { m_coalescer = coalescer; }
+
+    // Client: creates the rings and returns the packet which tells the
+    // server about them, or an empty one if no shared buffer is left.
+    EncodedMessage create()
+    {
+        EncodedMessage packet;
+        uint8_t* data;
+        int buffer_id = shared_buffer_create(&data, 2 * RingBytes);
+        if (buffer_id < 0) {
+            return packet;
+        }
+        memset(data, 0, 2 * RingBytes);
+        attach(buffer_id, data, false);
+
+        Encoder::append(packet, (int)FrameSize);
+        Encoder::append(packet, FrameMagic);
+        Encoder::append(packet, buffer_id);
+        return packet;
+    }
+
+    static bool is_frame(const char* buf, size_t size)
+    {
+        if (size != FrameSize) {
+            return false;
+        }
+        int magic;
+        size_t offset = 0;
+        Encoder::decode(buf, offset, magic);
+        return magic == FrameMagic;
+    }
+
+    // Server: maps the rings the frame tells about.
+    bool open(const char* buf)
+    {
+        int magic, buffer_id;
+        size_t offset = 0;
+        Encoder::decode(buf, offset, magic);
+        Encoder::decode(buf, offset, buffer_id);
+
+        uint8_t* data;
+        if (attached() || shared_buffer_get(buffer_id, &data) < 0) {
+            return false;
+        }
+        attach(buffer_id, data, true);
+        return true;
+    }
+
+    void close()
+    {
+        if (attached()) {
+            shared_buffer_free(m_buffer_id);
+            m_buffer_id = -1;
+        }
+    }
+
+    // Messages which don't fit wait here in order until the reader makes room.
+    bool push(const Message& msg)
+    {
+        size_t len = msg.encoded_size();
+        if (m_overflow.empty()) {
+            uint8_t* last = m_out.unpublished_last(len);
+            if (last && m_coalescer && m_coalescer(last, len, msg)) {
+                return true;
+            }
+        }
+
+        if (len >= LargeMessage::PayloadThreshold) {
+            auto encoded_msg = msg.encode();
+            auto frame = LargeMessage::wrap(msg, encoded_msg.data(), encoded_msg.size());
+            if (frame.size()) {
+                push_bytes(frame.data(), frame.size());
+                return true;
+            }
+        }
+
+        if (m_overflow.empty()) {
+            if (uint8_t* data = m_out.reserve(len)) {
+                msg.encode_to(data);
+                return true;
+            }
+        }
+
+        size_t offset = m_overflow.size();
+        m_overflow.resize(offset + PacketBuffer::HeaderSize);
+        Encoder::store(m_overflow.data(), offset, (int)len);
+        msg.encode_into(m_overflow);
+        return true;
+    }
+
+    bool flush(int fd)
+    {
+        move_overflow();
+        bool ok = !m_out.publish() || ring_doorbell(fd);
+        if (m_overflow.size() > m_overflow_start) {
+            // The reader may have made room before it saw the flag.
+            m_out.mark_blocked();
+            move_overflow();
+            ok &= !m_out.publish() || ring_doorbell(fd);
+        }
+        return ok;
+    }
+
+    // Calls callback(data, len) for every packet of the ring. Returns false
+    // if the ring is broken.
+    template <typename Callback>
+    bool receive(int fd, Callback callback)
+    {
+        m_in.stop_waiting();
+        do {
+            if (!m_in.for_each_packet(callback)) {
+                return false;
+            }
+        } while (!m_in.wait());
+
+        if (m_in.take_writer_blocked()) {
+            ring_doorbell(fd);
+        }
+        return true;
+    }
+
+private:
+    void attach(int buffer_id, uint8_t* data, bool server)
+    {
+        m_buffer_id = buffer_id;
+        uint8_t* client_ring = data;
+        uint8_t* server_ring = data + RingBytes;
+        uint8_t* in = server ? client_ring : server_ring;
+        uint8_t* out = server ? server_ring : client_ring;
+        m_in.attach((MessageRing::Control*)in, in + sizeof(MessageRing::Control));
+        m_out.attach((MessageRing::Control*)out, out + sizeof(MessageRing::Control));
+    }
+
+    static bool ring_doorbell(int fd)
+    {
+        int len = 0;
+        return write(fd, &len, sizeof(len)) == sizeof(len);
+    }
+
+    void push_bytes(const uint8_t* buf, size_t len)
+    {
+        if (m_overflow.empty()) {
+            if (uint8_t* data = m_out.reserve(len)) {
+                memcpy(data, buf, len);
+                m_out.forget_last();
+                return;
+            }
+        }
+
+        Encoder::append(m_overflow, (int)len);
+        for (size_t i = 0; i < len; i++) {
+            m_overflow.push_back(buf[i]);
+        }
+    }
+
+    void move_overflow()
+    {
+        while (m_overflow_start < m_overflow.size()) {
+            size_t offset = m_overflow_start;
+            int len;
+            Encoder::decode((const char*)m_overflow.data(), offset, len);
+            uint8_t* data = m_out.reserve(len);
+            if (!data) {
+                return;
+            }
+            memcpy(data, m_overflow.data() + offset, len);
+            m_overflow_start = offset + len;
+        }
+        m_overflow.clear();
+        m_overflow_start = 0;
+    }
+
+    int m_buffer_id { -1 };
+    MessageRing m_in;
+    MessageRing m_out;
+    EncodedMessage m_overflow;
+    size_t m_overflow_start { 0 };
+    SendQueue::Coalescer m_coalescer { nullptr };
+};
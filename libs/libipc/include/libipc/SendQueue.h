@@ -0,0 +1,89 @@
+#pragma once
+#include <libipc/Encoder.h>
+#include <libipc/LargeMessage.h>
+#include <libipc/Message.h>
+#include <libipc/PacketBuffer.h>
+#include <unistd.h>
+#include <vector>
+
+// Messages sent within one pump of the event loop are queued as packets and
+// go with one write in flush(). The owner of the connection flushes it at
+// the end of the pump, and before it waits for an answer.
+class SendQueue {
+public:
+    static constexpr size_t FlushThreshold = 4096;
+
+    // Called with the packet queued last before the next message is queued.
+    // Returns true if it has put the next message into the last one, which
+    // is fine only if the next one supersedes it.
+    typedef bool (*Coalescer)(uint8_t* last, size_t last_len, const Message& next);
+
+    void set_coalescer(Coalescer coalescer) { m_coalescer = coalescer; }
+
+    bool push(int fd, const Message& msg)
+    {
+        size_t len = msg.encoded_size();
+        if (m_last_len == len && m_coalescer && m_coalescer(m_buffer.data() + m_last_offset, m_last_len, msg)) {
+            return true;
+        }
+
+        if (len >= LargeMessage::PayloadThreshold) {
+            if (push_large(msg)) {
+                return flush_if_full(fd);
+            }
+        }
+
+        size_t offset = m_buffer.size();
+        m_buffer.resize(offset + PacketBuffer::HeaderSize);
+        Encoder::store(m_buffer.data(), offset, (int)len);
+        msg.encode_into(m_buffer);
+        m_last_offset = offset;
+        m_last_len = len;
+        return flush_if_full(fd);
+    }
+
+    bool flush(int fd)
+    {
+        m_last_len = 0;
+        if (m_buffer.empty()) {
+            return true;
+        }
+
+        int wrote = write(fd, m_buffer.data(), m_buffer.size());
+        bool ok = wrote == m_buffer.size();
+        m_buffer.clear_remain_capacity();
+        return ok;
+    }
+
+private:
+    bool flush_if_full(int fd)
+    {
+        if (m_buffer.size() < FlushThreshold) {
+            return true;
+        }
+        return flush(fd);
+    }
+
+    // Large messages go as a frame of a shared buffer, the frame is never
+    // coalesced.
+    bool push_large(const Message& msg)
+    {
+        auto encoded_msg = msg.encode();
+        auto frame = LargeMessage::wrap(msg, encoded_msg.data(), encoded_msg.size());
+        if (!frame.size()) {
+            return false;
+        }
+
+        Encoder::append(m_buffer, (int)frame.size());
+        for (size_t i = 0; i < frame.size(); i++) {
+            m_buffer.push_back(frame[i]);
+        }
+        m_last_len = 0;
+        return true;
+    }
+
+    EncodedMessage m_buffer;
+    size_t m_last_offset { 0 };
+    size_t m_last_len { 0 };
+    Coalescer m_coalescer { nullptr };
+};
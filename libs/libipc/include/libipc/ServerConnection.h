@@ -1,8 +1,13 @@
 #pragma once
 #include <cstdlib>
+#include <cstring>
 #include <libfoundation/Logger.h>
+#include <libipc/LargeMessage.h>
 #include <libipc/Message.h>
 #include <libipc/MessageDecoder.h>
+#include <libipc/PacketBuffer.h>
+#include <libipc/RingTransport.h>
+#include <libipc/SendQueue.h>
 #include <vector>
 
 template <typename ServerDecoder, typename ClientDecoder>
@@ -17,49 +22,102 @@ public:
 
     bool send_message(const Message& msg) const
     {
-        auto encoded_msg = msg.encode();
-        int wrote = write(m_connection_fd, encoded_msg.data(), encoded_msg.size());
-        return wrote == encoded_msg.size();
+        if (m_ring.attached()) {
+            return m_ring.push(msg);
+        }
+        return m_send_queue.push(m_connection_fd, msg);
     }
 
-    void pump_messages()
+    bool flush() const
     {
-        std::vector<char> buf;
+        if (m_ring.attached()) {
+            return m_ring.flush(m_connection_fd);
+        }
+        return m_send_queue.flush(m_connection_fd);
+    }
 
-        char tmpbuf[1024];
+    void set_coalescer(SendQueue::Coalescer coalescer)
+    {
+        m_send_queue.set_coalescer(coalescer);
+        m_ring.set_coalescer(coalescer);
+    }
 
-        int read_cnt;
-        while ((read_cnt = read(m_connection_fd, tmpbuf, sizeof(tmpbuf)))) {
-            if (read_cnt <= 0) {
-                Logger::debug << getpid() << " :: ServerConnection read error" << std::endl;
-                return;
-            }
-            size_t buf_size = buf.size();
-            buf.resize(buf_size + read_cnt);
-            memcpy(&buf.data()[buf_size], tmpbuf, read_cnt);
-            if (read_cnt < sizeof(tmpbuf)) {
-                break;
-            }
+    // Connections are copied around, so the rings are unmapped here and not
+    // in the destructor.
+    void close() { m_ring.close(); }
+
+    // Returns false once the client has closed its end.
+    bool pump_messages()
+    {
+        int read_cnt = m_buffer.read_from(m_connection_fd);
+        if (read_cnt < 0) {
+            Logger::debug << getpid() << " :: ServerConnection read error" << std::endl;
+            return false;
         }
 
-        size_t msg_len = 0;
-        size_t buf_size = buf.size();
-        for (int i = 0; i < buf_size; i += msg_len) {
-            msg_len = 0;
-            if (auto response = m_server_decoder.decode((buf.data() + i), read_cnt - i, msg_len)) {
-                if (auto answer = m_server_decoder.handle(*response)) {
-                    send_message(*answer);
-                }
-            } else if (auto response = m_client_decoder.decode((buf.data() + i), read_cnt - i, msg_len)) {
+        // Readable but empty means the client closed the connection.
+        if (read_cnt == 0) {
+            return false;
+        }
+
+        m_buffer.for_each_packet([&](const char* buf, size_t len) { handle_packet(buf, len); });
 
-            } else {
-                std::abort();
+        // The client can change its ring at any time, so a packet is decoded
+        // from a copy.
+        if (m_ring.attached()) {
+            bool ok = m_ring.receive(m_connection_fd, [&](const char* buf, size_t len) {
+                if (m_packet_copy.size() < len) {
+                    m_packet_copy.resize(len);
+                }
+                memcpy(m_packet_copy.data(), buf, len);
+                handle_packet(m_packet_copy.data(), len);
+            });
+            if (!ok) {
+                Logger::debug << getpid() << " :: ServerConnection broken ring" << std::endl;
+                return false;
             }
         }
+        return true;
     }
 
 private:
+    // Empty packets are doorbells of the ring, they only wake us up.
+    void handle_packet(const char* buf, size_t len)
+    {
+        if (!len) {
+            return;
+        }
+        if (RingTransport::is_frame(buf, len)) {
+            m_ring.open(buf);
+            return;
+        }
+        if (LargeMessage::is_frame(buf, len)) {
+            LargeMessage::unwrap(buf, m_server_decoder.magic(), -1, [&](const char* payload, size_t payload_len) {
+                decode_message(payload, payload_len);
+            });
+            return;
+        }
+        decode_message(buf, len);
+    }
+
+    // Packets are whole, so one which no decoder knows is just skipped.
+    void decode_message(const char* buf, size_t size)
+    {
+        if (size < sizeof(int) || MessageDecoder::peek_magic(buf) != m_server_decoder.magic()) {
+            Logger::debug << getpid() << " :: ServerConnection unknown message" << std::endl;
+            return;
+        }
+
+        if (auto answer = m_server_decoder.dispatch(buf, size)) {
+            send_message(*answer);
+        }
+    }
+
     int m_connection_fd;
+    PacketBuffer m_buffer;
+    mutable SendQueue m_send_queue;
+    mutable RingTransport m_ring;
+    std::vector<char> m_packet_copy;
     ServerDecoder& m_server_decoder;
     ClientDecoder& m_client_decoder;
 };
\ No newline at end of file
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libobjc/v1/decls.h>
+#include <stdint.h>
+
+/**
+ * Every class caches the implementations it dispatched to in an open
+ * addressing table hung off disp_table. The table is keyed by the SEL
+ * pointer of the caller, so a hit needs neither the selector pool nor a
+ * walk over the class hierarchy. objc_msgSend stubs probe the table
+ * inline, keep its layout and the hash in sync with them.
+ */
+#define METHOD_CACHE_INITIAL_SIZE 16 /* Power of 2. */
+#define METHOD_CACHE_HASH_SHIFT 3 /* Selectors are 8 bytes long. */
+
+struct objc_cache_entry {
+    SEL sel;
+    IMP imp;
+};
+
+struct objc_method_cache {
+    uint32_t mask;
+    uint32_t occupied;
+    struct objc_cache_entry buckets[1]; // Variable len
+};
+
+static inline uint32_t method_cache_index(SEL sel, uint32_t mask)
+{
+    return ((uintptr_t)sel >> METHOD_CACHE_HASH_SHIFT) & mask;
+}
+
+IMP method_cache_find(Class cls, SEL sel);
+void method_cache_insert(Class cls, SEL sel, IMP imp);
+void method_cache_flush(Class cls);
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <stdio.h>
 
 #define OBJC_EXPORT extern "C"
@@ -18,4 +19,14 @@
     fflush(stdout)
 #else
 #define OBJC_DEBUGPRINT(...) (sizeof(int))
-#endif
\ No newline at end of file
+#endif
+
+// FNV-1a, used by the selector and class tables.
+static inline uint32_t objc_hash_string(const char* str)
+{
+    uint32_t hash = 2166136261u;
+    for (; *str; str++) {
+        hash = (hash ^ (uint8_t)*str) * 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libobjc/cache.h>
+#include <libobjc/class.h>
+#include <libobjc/memory.h>
+#include <string.h>
+
+// The stubs read the cache at these offsets.
+static_assert(__builtin_offsetof(struct objc_class, disp_table) == 32, "objc_msgSend stubs expect disp_table at 32");
+static_assert(__builtin_offsetof(struct objc_method_cache, buckets) == 8, "objc_msgSend stubs expect buckets at 8");
+static_assert(sizeof(struct objc_cache_entry) == 8, "objc_msgSend stubs expect 8-byte entries");
+
+// Only writers take the lock, the stubs probe the tables without it.
+static int method_cache_lock = 0;
+
+static inline void method_cache_lock_acquire()
+{
+    while (__atomic_exchange_n(&method_cache_lock, 1, __ATOMIC_ACQUIRE)) {
+    }
+}
+
+static inline void method_cache_lock_release()
+{
+    __atomic_store_n(&method_cache_lock, 0, __ATOMIC_RELEASE);
+}
+
+static struct objc_method_cache* method_cache_alloc(uint32_t size)
+{
+    size_t len = sizeof(struct objc_method_cache) + sizeof(struct objc_cache_entry[size - 1]);
+    struct objc_method_cache* cache = (struct objc_method_cache*)objc_malloc(len);
+    if (!cache) {
+        return (struct objc_method_cache*)NULL;
+    }
+    memset(cache, 0, len);
+    cache->mask = size - 1;
+    return cache;
+}
+
+static void method_cache_put(struct objc_method_cache* cache, SEL sel, IMP imp)
+{
+    uint32_t index = method_cache_index(sel, cache->mask);
+    while (cache->buckets[index].sel) {
+        if (cache->buckets[index].sel == sel) {
+            return;
+        }
+        index = (index + 1) & cache->mask;
+    }
+
+    // A reader which sees the selector has to see the implementation too.
+    cache->buckets[index].imp = imp;
+    __atomic_store_n(&cache->buckets[index].sel, sel, __ATOMIC_RELEASE);
+    cache->occupied++;
+}
+
+IMP method_cache_find(Class cls, SEL sel)
+{
+    struct objc_method_cache* cache = (struct objc_method_cache*)__atomic_load_n(&cls->disp_table, __ATOMIC_ACQUIRE);
+    if (!cache) {
+        return nil_method;
+    }
+
+    uint32_t index = method_cache_index(sel, cache->mask);
+    for (;;) {
+        SEL entry_sel = __atomic_load_n(&cache->buckets[index].sel, __ATOMIC_ACQUIRE);
+        if (entry_sel == sel) {
+            return cache->buckets[index].imp;
+        }
+        if (!entry_sel) {
+            return nil_method;
+        }
+        index = (index + 1) & cache->mask;
+    }
+}
+
+/**
+ * A full table is replaced with a twice larger one. The old table is not
+ * freed, since another thread could still probe it; tables only grow, so
+ * the leftovers take at most as much as the final table.
+ */
+void method_cache_insert(Class cls, SEL sel, IMP imp)
+{
+    method_cache_lock_acquire();
+    struct objc_method_cache* cache = (struct objc_method_cache*)cls->disp_table;
+    if (!cache || (cache->occupied + 1) * 4 > (cache->mask + 1) * 3) {
+        uint32_t size = cache ? (cache->mask + 1) * 2 : METHOD_CACHE_INITIAL_SIZE;
+        struct objc_method_cache* new_cache = method_cache_alloc(size);
+        if (!new_cache) {
+            method_cache_lock_release();
+            return;
+        }
+
+        if (cache) {
+            for (uint32_t i = 0; i <= cache->mask; i++) {
+                if (cache->buckets[i].sel) {
+                    method_cache_put(new_cache, cache->buckets[i].sel, cache->buckets[i].imp);
+                }
+            }
+        }
+        __atomic_store_n(&cls->disp_table, (void*)new_cache, __ATOMIC_RELEASE);
+        cache = new_cache;
+    }
+
+    method_cache_put(cache, sel, imp);
+    method_cache_lock_release();
+}
+
+/**
+ * Called when methods of the class or of its ancestors change. The table
+ * is dropped, not freed, like a replaced one; the next sends fill a new one.
+ */
+void method_cache_flush(Class cls)
+{
+    method_cache_lock_acquire();
+    __atomic_store_n(&cls->disp_table, DISPATCH_TABLE_NOT_INITIALIZED, __ATOMIC_RELEASE);
+    method_cache_lock_release();
+}
@@ -5,6 +5,7 @@
  */
 
 #include <assert.h>
+#include <libobjc/cache.h>
 #include <libobjc/class.h>
 #include <libobjc/memory.h>
 #include <libobjc/module.h>
@@ -13,42 +14,77 @@
 #include <libobjc/selector.h>
 #include <string.h>
 
+/**
+ * Classes are found by name through an open addressing table, which
+ * doubles once it's 3/4 full.
+ */
+#define CLASS_TABLE_INITIAL_SIZE 64 /* Power of 2. */
+
 struct class_node {
     const char* name;
-    int length;
+    uint32_t hash;
     Class cls;
 };
 
-// FIXME: Allocate it dynamically.
-static class_node class_tabel_storage[512];
-static int class_table_next_free = 0;
+static class_node* class_table;
+static uint32_t class_table_mask;
+static uint32_t class_table_count;
 
 static Class unresolved_classes[128];
 static int unresolved_classes_next = 0;
 
 void class_table_init()
 {
+    class_table = (class_node*)objc_calloc(CLASS_TABLE_INITIAL_SIZE, sizeof(class_node));
+    class_table_mask = CLASS_TABLE_INITIAL_SIZE - 1;
+    class_table_count = 0;
+}
+
+// Returns the node of the class or the empty node where it belongs.
+static class_node* class_table_slot(const char* name, uint32_t hash)
+{
+    uint32_t index = hash & class_table_mask;
+    for (;;) {
+        class_node* node = &class_table[index];
+        if (!node->cls || (node->hash == hash && strcmp(name, node->name) == 0)) {
+            return node;
+        }
+        index = (index + 1) & class_table_mask;
+    }
 }
 
 Class class_table_find(const char* name)
 {
-    int len = strlen(name);
-    for (int i = 0; i < class_table_next_free; i++) {
-        if (len == class_tabel_storage[i].length) {
-            if (strcmp(name, class_tabel_storage[i].name) == 0) {
-                return class_tabel_storage[i].cls;
-            }
+    return class_table_slot(name, objc_hash_string(name))->cls;
+}
+
+static void class_table_grow()
+{
+    class_node* old_table = class_table;
+    uint32_t old_size = class_table_mask + 1;
+
+    class_table = (class_node*)objc_calloc(old_size * 2, sizeof(class_node));
+    class_table_mask = old_size * 2 - 1;
+    for (uint32_t i = 0; i < old_size; i++) {
+        if (old_table[i].cls) {
+            *class_table_slot(old_table[i].name, old_table[i].hash) = old_table[i];
         }
     }
-    return Nil;
+    objc_free(old_table);
 }
 
 static void class_table_add(const char* name, Class cls)
 {
-    int place = class_table_next_free++;
-    class_tabel_storage[place].name = name;
-    class_tabel_storage[place].length = strlen(name);
-    class_tabel_storage[place].cls = cls;
+    uint32_t hash = objc_hash_string(name);
+    class_node* node = class_table_slot(name, hash);
+    node->name = name;
+    node->hash = hash;
+    node->cls = cls;
+
+    class_table_count++;
+    if (class_table_count * 4 > (class_table_mask + 1) * 3) {
+        class_table_grow();
+    }
 }
 
 bool class_add(Class cls)
@@ -71,6 +107,17 @@ static inline void class_disp_table_preinit(Class cls)
     cls->disp_table = DISPATCH_TABLE_NOT_INITIALIZED;
 }
 
+// Cached lookups of subclasses could return the replaced methods as well.
+static void class_flush_all_caches()
+{
+    for (uint32_t i = 0; i <= class_table_mask; i++) {
+        if (class_table[i].cls) {
+            method_cache_flush(class_table[i].cls);
+            method_cache_flush(class_table[i].cls->get_isa());
+        }
+    }
+}
+
 static Method class_lookup_method_in_list(struct objc_method_list* objc_method_list, SEL sel)
 {
     if (!objc_method_list) {
@@ -140,11 +187,10 @@ static void class_root_add_instance_methods(Class cls)
     if (new_list->method_count) {
         new_list->method_next = cls->get_isa()->methods;
         cls->get_isa()->methods = new_list;
+        class_flush_all_caches();
     } else {
         objc_free(new_list);
     }
-
-    // TODO: Update dispatch table.
 }
 
 static void class_send_initialize(Class cls)
@@ -209,6 +255,8 @@ bool class_resolve_links(Class cls)
     Class supcls = objc_getClass((char*)cls->superclass);
     if (supcls) {
         // TODO: Fill subclass list
+        method_cache_flush(cls);
+        method_cache_flush(cls->get_isa());
         cls->superclass = supcls;
         cls->get_isa()->superclass = supcls->get_isa();
         cls->set_info(CLS_RESOLVED);
@@ -288,8 +336,14 @@ IMP class_get_implementation(Class cls, SEL sel)
     //     class_send_initialize(cls);
     // }
 
-    sel = sel_registerTypedName((char*)sel->id, sel->types);
-    Method method = class_lookup_method_in_hierarchy(cls, sel);
+    IMP imp = method_cache_find(cls, sel);
+    if (imp) {
+        return imp;
+    }
+
+    // The cache is keyed by the selector of the caller, not by the registered one.
+    SEL registered_sel = sel_registerTypedName((char*)sel->id, sel->types);
+    Method method = class_lookup_method_in_hierarchy(cls, registered_sel);
 
     if (!method) {
         return nil_method;
@@ -297,5 +351,6 @@ IMP class_get_implementation(Class cls, SEL sel)
 
     // TODO: Message forwarding
 
+    method_cache_insert(cls, sel, method->method_imp);
     return method->method_imp;
 }
\ No newline at end of file
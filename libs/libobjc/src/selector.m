@@ -10,62 +10,120 @@
 #include <libobjc/selector.h>
 #include <string.h>
 
-static struct objc_selector* selector_pool_start;
-static struct objc_selector* selector_pool_next;
+/**
+ * Selectors are allocated in chunks which never move, since method lists
+ * and callers keep pointers to them. They are found by name through an
+ * open addressing table of SEL pointers, which doubles once it's 3/4 full.
+ */
+#define SELECTOR_TABLE_INITIAL_SIZE 256 /* Power of 2. */
+#define SELECTOR_CHUNK_SIZE 128
+
+static SEL* selector_table;
+static uint32_t selector_table_mask;
+static uint32_t selector_table_count;
+
+static struct objc_selector* selector_chunk_next;
+static int selector_chunk_left;
 
 #define CONST_DATA true
 #define VOLATILE_DATA false
 
-static SEL selector_table_add(const char* name, const char* types, bool const_data)
+static inline bool selector_types_equal(const char* t1, const char* t2)
+{
+    if (t1 == 0 || t2 == 0) {
+        return t1 == t2;
+    }
+    return strcmp(t1, t2) == 0;
+}
+
+// Returns the slot of the selector or the empty slot where it belongs.
+static SEL* selector_table_slot(const char* name, const char* types)
 {
-    // Checking if we have this selector
-    for (struct objc_selector* cur_sel = selector_pool_start; cur_sel != selector_pool_next; cur_sel++) {
-        if (strcmp(name, (char*)cur_sel->id) == 0) {
-            if (cur_sel->types == 0 || types == 0) {
-                if (cur_sel->types == types) {
-                    return (SEL)cur_sel;
-                }
-            } else {
-                if (strcmp(types, cur_sel->types) == 0) {
-                    return (SEL)cur_sel;
-                }
-            }
+    uint32_t index = objc_hash_string(name) & selector_table_mask;
+    for (;;) {
+        SEL cur_sel = selector_table[index];
+        if (!cur_sel) {
+            return &selector_table[index];
         }
+        if (strcmp(name, (char*)cur_sel->id) == 0 && selector_types_equal(types, cur_sel->types)) {
+            return &selector_table[index];
+        }
+        index = (index + 1) & selector_table_mask;
     }
+}
+
+static void selector_table_grow()
+{
+    SEL* old_table = selector_table;
+    uint32_t old_size = selector_table_mask + 1;
+
+    selector_table = (SEL*)objc_calloc(old_size * 2, sizeof(SEL));
+    selector_table_mask = old_size * 2 - 1;
+    for (uint32_t i = 0; i < old_size; i++) {
+        if (old_table[i]) {
+            *selector_table_slot((char*)old_table[i]->id, old_table[i]->types) = old_table[i];
+        }
+    }
+    objc_free(old_table);
+}
 
-    SEL sel = (SEL)selector_pool_next++;
+static SEL selector_alloc()
+{
+    if (!selector_chunk_left) {
+        selector_chunk_next = (struct objc_selector*)objc_malloc(sizeof(struct objc_selector[SELECTOR_CHUNK_SIZE]));
+        selector_chunk_left = SELECTOR_CHUNK_SIZE;
+    }
+    selector_chunk_left--;
+    return (SEL)selector_chunk_next++;
+}
+
+// Names registered at runtime are copied once, later lookups find the copy.
+static char* selector_copy_string(const char* str)
+{
+    int len = strlen(str);
+    char* data = (char*)objc_malloc(len + 1);
+    memcpy(data, str, len);
+    data[len] = '\0';
+    return data;
+}
+
+static SEL selector_table_add(const char* name, const char* types, bool const_data)
+{
+    SEL* slot = selector_table_slot(name, types);
+    if (*slot) {
+        return *slot;
+    }
+
+    SEL sel = selector_alloc();
     if (const_data) {
         sel->id = (char*)name;
         sel->types = types;
     } else {
-        int name_len = strlen(name);
-        char* name_data = (char*)objc_malloc(name_len + 1);
-        memcpy(name_data, name, name_len);
-        name_data[name_len] = '\0';
-        sel->id = name_data;
-        sel->types = 0;
-
-        if (types) {
-            int types_len = strlen(types);
-            char* types_data = (char*)objc_malloc(types_len + 1);
-            memcpy(types_data, types, types_len);
-            types_data[types_len] = '\0';
-            sel->types = types_data;
-        }
+        sel->id = selector_copy_string(name);
+        sel->types = types ? selector_copy_string(types) : 0;
     }
 
+    *slot = sel;
+    selector_table_count++;
+    if (selector_table_count * 4 > (selector_table_mask + 1) * 3) {
+        selector_table_grow();
+    }
     return sel;
 }
 
 bool selector_is_valid(SEL sel)
 {
-    return (uintptr_t)selector_pool_start < (uintptr_t)sel && (uintptr_t)sel < (uintptr_t)selector_pool_next;
+    if (!sel || !sel->id) {
+        return false;
+    }
+    return *selector_table_slot((char*)sel->id, sel->types) == sel;
 }
 
-// TODO: We currently do it really stupid
 void selector_table_init()
 {
-    selector_pool_start = selector_pool_next = (struct objc_selector*)objc_malloc(1024);
+    selector_table = (SEL*)objc_calloc(SELECTOR_TABLE_INITIAL_SIZE, sizeof(SEL));
+    selector_table_mask = SELECTOR_TABLE_INITIAL_SIZE - 1;
+    selector_table_count = 0;
 }
 
 void selector_add_from_module(struct objc_selector* selectors)
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+// includes
+#include <libswift/helpers.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Heap objects start with the metadata pointer and the strong reference
+ * count, like in the Swift ABI, so the counting is done inline in the
+ * object. Objects with the immortal bit, static ones, are never counted.
+ */
+#define SWIFT_REFCOUNT_IMMORTAL 0x80000000
+
+struct swift_heap_object {
+    void* metadata;
+    uint32_t refcount;
+};
+typedef struct swift_heap_object swift_heap_object_t;
+
+SWIFT_EXPORT swift_heap_object_t* swift_allocObject(void* metadata, size_t size, size_t align_mask);
+SWIFT_EXPORT swift_heap_object_t* swift_retain(swift_heap_object_t* object);
+SWIFT_EXPORT swift_heap_object_t* swift_retain_n(swift_heap_object_t* object, uint32_t n);
+SWIFT_EXPORT void swift_release(swift_heap_object_t* object);
+SWIFT_EXPORT void swift_release_n(swift_heap_object_t* object, uint32_t n);
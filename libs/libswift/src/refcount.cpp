@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+// includes
+#include <libswift/memory.h>
+#include <libswift/refcount.h>
+#include <pthread.h>
+#include <string.h>
+
+/**
+ * Until the process creates a thread nobody else could touch the counter,
+ * so plain loads and stores are used. Once __pthread_threaded is set it
+ * stays set, and the counting switches to atomics for good.
+ */
+static inline bool swift_refcount_is_atomic()
+{
+    return __atomic_load_n(&__pthread_threaded, __ATOMIC_RELAXED);
+}
+
+static inline bool swift_refcount_is_immortal(swift_heap_object_t* object)
+{
+    return !object || (object->refcount & SWIFT_REFCOUNT_IMMORTAL);
+}
+
+// There is no deinit dispatch in the runtime yet, the memory is just freed.
+static void swift_dealloc_object(swift_heap_object_t* object)
+{
+    swift_free(object);
+}
+
+swift_heap_object_t* swift_allocObject(void* metadata, size_t size, size_t align_mask)
+{
+    // malloc aligns to 8 bytes, which covers the alignment of Swift objects.
+    swift_heap_object_t* object = (swift_heap_object_t*)swift_malloc(size);
+    if (!object) {
+        return object;
+    }
+
+    memset(object, 0, size);
+    object->metadata = metadata;
+    object->refcount = 1;
+    return object;
+}
+
+swift_heap_object_t* swift_retain_n(swift_heap_object_t* object, uint32_t n)
+{
+    if (swift_refcount_is_immortal(object)) {
+        return object;
+    }
+
+    if (swift_refcount_is_atomic()) {
+        __atomic_add_fetch(&object->refcount, n, __ATOMIC_RELAXED);
+    } else {
+        object->refcount += n;
+    }
+    return object;
+}
+
+swift_heap_object_t* swift_retain(swift_heap_object_t* object)
+{
+    return swift_retain_n(object, 1);
+}
+
+void swift_release_n(swift_heap_object_t* object, uint32_t n)
+{
+    if (swift_refcount_is_immortal(object)) {
+        return;
+    }
+
+    uint32_t refcount;
+    if (swift_refcount_is_atomic()) {
+        // Writes to the object have to be visible to the thread which frees it.
+        refcount = __atomic_sub_fetch(&object->refcount, n, __ATOMIC_ACQ_REL);
+    } else {
+        refcount = object->refcount -= n;
+    }
+
+    if (!refcount) {
+        swift_dealloc_object(object);
+    }
+}
+
+void swift_release(swift_heap_object_t* object)
+{
+    swift_release_n(object, 1);
+}
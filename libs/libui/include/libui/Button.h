@@ -55,12 +55,13 @@ protected:
 private:
     void recalc_bounds();
     size_t text_height() const;
-    size_t text_width();
+    size_t text_width() const;
 
     static constexpr uint32_t system_background_color() { return 0x00EBEBEB; }
     Type m_button_type { Type::System };
 
     std::string m_title {};
+    size_t m_title_width { 0 }; // Measured in recalc_bounds().
     LG::Color m_title_color { LG::Color::White };
     LG::Font m_font { LG::Font::system_font() };
 
@@ -27,6 +27,8 @@ public:
     virtual std::unique_ptr<Message> handle(const WindowCloseRequestMessage& msg) override;
     virtual std::unique_ptr<Message> handle(const ResizeMessage& msg) override;
     virtual std::unique_ptr<Message> handle(const MenuBarActionMessage& msg) override;
+    virtual std::unique_ptr<Message> handle(const BufferReleasedMessage& msg) override;
+    virtual std::unique_ptr<Message> handle(const FrameDoneMessage& msg) override;
 
     // Notifiers
     virtual std::unique_ptr<Message> handle(const NotifyWindowStatusChangedMessage& msg) override;
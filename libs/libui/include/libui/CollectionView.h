@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+#include <functional>
+#include <libui/ScrollView.h>
+#include <vector>
+
+namespace UI {
+
+// A list of rows of the same height which are got from the data source.
+// Only the rows which are seen have cells, a cell which is scrolled out is
+// given to the next row which comes in, so the number of subviews doesn't
+// grow with the number of rows.
+class CollectionView : public ScrollView {
+    UI_OBJECT();
+
+public:
+    ~CollectionView() = default;
+
+    using RowCountCallback = std::function<size_t()>;
+    using ConfigureCellCallback = std::function<void(View& cell, size_t row)>;
+
+    template <class CellT>
+    void set_cell_type()
+    {
+        m_make_cell = [this]() -> View* {
+            return &add_subview<CellT>(LG::Rect(0, 0, bounds().width(), m_row_height));
+        };
+    }
+
+    inline void set_number_of_rows(RowCountCallback callback) { m_number_of_rows = callback; }
+    inline void set_configure_cell(ConfigureCellCallback callback) { m_configure_cell = callback; }
+
+    inline void set_row_height(size_t height) { m_row_height = std::max(height, (size_t)1), reload_data(); }
+    inline size_t row_height() const { return m_row_height; }
+
+    // Asks the data source for the number of rows and configures the cells
+    // which are seen again.
+    void reload_data();
+
+    // Configures the cells of the given rows again, rows which are not seen
+    // are skipped. The number of rows must not have changed.
+    void reload_rows(const std::vector<size_t>& rows);
+
+    virtual void layout_subviews() override;
+
+protected:
+    CollectionView(View* superview, const LG::Rect&);
+    CollectionView(View* superview, Window* window, const LG::Rect& frame);
+
+    virtual void content_offset_did_change() override;
+
+private:
+    void update_visible_cells(bool reconfigure);
+    void park_cell(View& cell);
+
+    size_t m_row_height { 24 };
+    size_t m_row_count { 0 };
+    size_t m_first_visible_row { 0 };
+    std::vector<View*> m_visible_cells;
+    std::vector<View*> m_free_cells;
+
+    std::function<View*()> m_make_cell;
+    RowCountCallback m_number_of_rows;
+    ConfigureCellCallback m_configure_cell;
+};
+
+} // namespace UI
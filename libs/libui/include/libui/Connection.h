@@ -1,6 +1,9 @@
 #pragma once
+#include <libg/PixelBitmap.h>
 #include <libipc/ClientConnection.h>
+#include <functional>
 #include <libui/ClientDecoder.h>
+#include <string>
 #include <sys/types.h>
 
 namespace UI {
@@ -16,11 +19,30 @@ public:
     int new_window(const Window& window);
     void set_buffer(const Window& window);
 
+    // The image is decoded once by the server and mapped read-only by every
+    // process which asks for it, it is decoded here only if the server can't.
+    // The server scales it to the size unless the size is empty.
+    LG::PixelBitmap image(const std::string& path, const LG::Size& size = LG::Size());
+
+    // Doesn't wait for the server, the callback gets the image from the
+    // event loop. Views show a placeholder until then.
+    typedef std::function<void(LG::PixelBitmap)> ImageCallback;
+    void image_async(const std::string& path, const LG::Size& size, ImageCallback callback);
+
     template <class T>
     inline std::unique_ptr<T> send_sync_message(const Message& msg) { return std::unique_ptr<T>(m_connection_with_server.send_sync(msg)); }
     inline bool send_async_message(const Message& msg) const { return m_connection_with_server.send_message(msg); }
+    inline void send_request(const Message& msg, ClientConnection<BaseWindowServerDecoder, ClientDecoder>::ReplyCallback callback) { m_connection_with_server.send_request(msg, callback); }
+    inline bool flush() const { return m_connection_with_server.flush(); }
     inline void listen() { m_connection_with_server.pump_messages(); }
 
+    // Blocks until the server sends something and handles it at once.
+    inline void listen_sync()
+    {
+        m_connection_with_server.pump_messages();
+        m_connection_with_server.dispatch_messages();
+    }
+
     // We use connection id as an unique key.
     inline int key() const { return m_connection_id; }
 
@@ -19,8 +19,8 @@ class Label : public View {
 public:
     ~Label() = default;
 
-    void set_text(const std::string& text) { m_text = text, set_needs_display(); }
-    void set_text(std::string&& text) { m_text = std::move(text), set_needs_display(); }
+    void set_text(const std::string& text) { m_text = text, m_text_width = NotMeasured, set_needs_display(); }
+    void set_text(std::string&& text) { m_text = std::move(text), m_text_width = NotMeasured, set_needs_display(); }
     const std::string& text() const { return m_text; }
 
     void set_text_color(const LG::Color& color) { m_text_color = color; }
@@ -32,7 +32,7 @@ public:
     void set_alignment(Text::Alignment alignment) { m_alignment = alignment; }
     Text::Alignment alignment() const { return m_alignment; }
 
-    void set_font(const LG::Font& font) { m_font = font, set_needs_display(); }
+    void set_font(const LG::Font& font) { m_font = font, m_text_width = NotMeasured, set_needs_display(); }
     inline const LG::Font& font() const { return m_font; }
 
     inline size_t preferred_width() const { return text_width() + m_content_edge_insets.left() + m_content_edge_insets.right(); }
@@ -46,11 +46,16 @@ protected:
     Label(View* superview, Window* window, const LG::Rect&);
 
 private:
+    static constexpr size_t NotMeasured = (size_t)-1;
+
     void recalc_bounds();
     size_t text_height() const;
     size_t text_width() const;
 
     std::string m_text {};
+    // Layout passes measure the same text over and over, so it is kept
+    // until the text or the font changes.
+    mutable size_t m_text_width { NotMeasured };
     LG::Color m_text_color { LG::Color::Black };
     LG::Font m_font { LG::Font::system_font() };
 
@@ -43,8 +43,11 @@ protected:
     // the right location we ask the superview to return it.
     virtual std::optional<LG::Point<int>> subview_location(const View& subview) const override;
 
-private:
     void did_scroll(int x, int y);
+    // Called after the content offset is changed by scrolling.
+    virtual void content_offset_did_change() { }
+
+private:
     void recalc_content_props();
 
     LG::Size m_content_size {};
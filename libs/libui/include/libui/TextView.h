@@ -5,6 +5,7 @@
  */
 
 #pragma once
+#include <libfoundation/PieceTable.h>
 #include <libg/Size.h>
 #include <libui/Constants/Layout.h>
 #include <libui/EdgeInsets.h>
@@ -20,9 +21,13 @@ class TextView : public ScrollView {
 public:
     ~TextView() = default;
 
-    void set_text(const std::string& text) { m_text = text, recalc_text_size(), set_needs_display(); }
-    void set_text(std::string&& text) { m_text = std::move(text), recalc_text_size(), set_needs_display(); }
-    const std::string& text() const { return m_text; }
+    void set_text(const std::string& text) { m_text.set_text(text.data(), text.size()), recalc_text_size(), set_needs_display(); }
+    std::string text() const;
+
+    // Edits redraw only the lines they change, or the lines below too if
+    // the count of lines changes.
+    void insert_text(size_t offset, const std::string& text);
+    void erase_text(size_t offset, size_t len);
 
     void set_text_color(const LG::Color& color) { m_text_color = color, set_needs_display(); }
     const LG::Color& text_color() const { return m_text_color; }
@@ -40,8 +45,10 @@ protected:
 
 private:
     void recalc_text_size();
+    size_t line_width(size_t line) const;
+    void text_did_change(size_t first_line, size_t last_line, bool lines_moved);
 
-    std::string m_text {};
+    LFoundation::PieceTable m_text {};
     LG::Color m_text_color { LG::Color::Black };
     LG::Font m_font { LG::Font::system_font() };
 };
@@ -7,8 +7,11 @@
 #pragma once
 #include <libfoundation/Logger.h>
 #include <libg/Color.h>
+#include <libg/HitGrid.h>
+#include <libg/PixelBitmap.h>
 #include <libg/Point.h>
 #include <libg/Rect.h>
+#include <libg/Region.h>
 #include <libui/Constraint.h>
 #include <libui/ContextManager.h>
 #include <libui/EdgeInsets.h>
@@ -50,6 +53,7 @@ public:
     {
         T* subview = new T(this, std::forward<Args>(args)...);
         m_subviews.push_back(subview);
+        invalidate_hit_grid();
         did_add_subview(*subview);
         return *subview;
     }
@@ -70,18 +74,26 @@ public:
     virtual std::optional<View*> subview_at(const LG::Point<int>& point) const;
     View& hit_test(const LG::Point<int>& point);
 
+    // Subviews are found at a point through a grid of their frames which is
+    // built again after layout. Code which moves subviews by other means
+    // has to invalidate it.
+    inline void invalidate_hit_grid() { m_hit_grid.clear(); }
+
     inline const LG::Rect& frame() const { return m_frame; }
     inline const LG::Rect& bounds() const { return m_bounds; }
     inline LG::Rect& frame() { return m_frame; }
     inline LG::Rect& bounds() { return m_bounds; }
     inline LG::Point<int> center() { return LG::Point<int>(frame().mid_x(), frame().mid_y()); }
-    inline void set_width(size_t x) { m_frame.set_width(x), m_bounds.set_width(x), set_needs_display(); }
-    inline void set_height(size_t x) { m_frame.set_height(x), m_bounds.set_height(x), set_needs_display(); }
+    inline void set_width(size_t x) { m_frame.set_width(x), m_bounds.set_width(x), did_resize(); }
+    inline void set_height(size_t x) { m_frame.set_height(x), m_bounds.set_height(x), did_resize(); }
 
     inline void turn_on_constraint_based_layout(bool b) { m_constraint_based_layout = b; }
-    void add_constraint(const Constraint& constraint) { m_constrints.push_back(constraint); }
+    void add_constraint(const Constraint& constraint) { m_constrints.push_back(constraint), m_constraints_sorted = false; }
     const std::vector<UI::Constraint>& constraints() const { return m_constrints; }
 
+    // Solves the constraints in the order of their dependencies. Only the
+    // ones whose items or related items changed since the last solve are
+    // interpreted again.
     virtual void layout_subviews();
     inline void set_needs_layout()
     {
@@ -100,6 +112,13 @@ public:
     void set_needs_display(const LG::Rect&);
     inline void set_needs_display() { set_needs_display(bounds()); }
 
+    // A layer backed view keeps itself and its subviews drawn in a bitmap of
+    // its own. Only what changes in it is drawn again, the rest is blended
+    // from the layer, so a view over which the superview redraws or scrolls
+    // costs a copy.
+    void set_layer_backed(bool layer_backed);
+    inline bool is_layer_backed() const { return m_layer_backed; }
+
     inline bool is_hovered() const { return m_hovered; }
     inline bool is_active() const { return m_active; }
 
@@ -139,6 +158,12 @@ protected:
 
     virtual std::optional<LG::Point<int>> subview_location(const View& subview) const;
 
+    // Sends the mouse move to the subviews under the location and a mouse
+    // leave to the ones which were hovered before. Subviews are placed at
+    // their frames moved by -offset.
+    void send_mouse_move_to_subviews(const LG::Point<int>& location, const LG::Point<int>& offset);
+    void send_mouse_leave_to_subviews(const LG::Point<int>& location, const LG::Point<int>& offset);
+
     template <Constraint::Attribute attr>
     inline void add_interpreted_constraint_to_mask() { m_applied_constraints_mask |= (1 << (int)attr); }
 
@@ -147,18 +172,61 @@ protected:
 
     inline void constraint_interpreter(const Constraint& constraint);
 
+    // Returns true if the view was drawn from its layer.
+    bool display_from_layer(DisplayEvent&);
+
+    // Subviews are laid out again only if their size changed since they
+    // were laid out last time.
+    inline bool needs_layout() const { return !m_laid_out || m_laid_out_bounds != m_bounds; }
+
 private:
     void set_window(Window* window) { m_window = window; }
     void set_superview(View* superview) { m_superview = superview; }
 
+    inline void did_resize()
+    {
+        if (m_superview) {
+            m_superview->invalidate_hit_grid();
+        }
+        set_needs_display();
+    }
+
+    template <typename Callback>
+    void foreach_subview_at(const LG::Point<int>& point, Callback callback) const;
+
     View* m_superview { nullptr };
     Window* m_window { nullptr };
     std::vector<View*> m_subviews;
+    std::vector<View*> m_hovered_subviews;
     LG::Rect m_frame;
     LG::Rect m_bounds;
 
+    // Items of a constraint as indices of subviews, the view itself is
+    // ConstraintSelf, a view which is not a subview is ConstraintOther.
+    enum ConstraintItem {
+        ConstraintSelf = -1,
+        ConstraintOther = -2,
+    };
+    struct ConstraintItems {
+        int item;
+        int rel_item;
+    };
+
+    void sort_constraints();
+    int constraint_item_index(const View* item) const;
+
     bool m_constraint_based_layout { false };
     std::vector<Constraint> m_constrints {};
+    bool m_constraints_sorted { false };
+    std::vector<size_t> m_constraint_order;
+    std::vector<ConstraintItems> m_constraint_items;
+    bool m_laid_out { false };
+    LG::Rect m_laid_out_bounds;
+    std::vector<LG::Rect> m_laid_out_frames;
+
+    // Views with fewer subviews are scanned, the grid is not worth it.
+    static constexpr size_t HitGridMinSubviews = 16;
+    mutable LG::HitGrid<View*> m_hit_grid;
     uint32_t m_applied_constraints_mask { 0 }; // Constraints applied to this view;
 
     bool m_active { false };
@@ -166,6 +234,12 @@ private:
     bool m_focusable { false };
 
     LG::Color m_background_color { LG::Color::White };
+
+    bool m_layer_backed { false };
+    bool m_drawing_layer { false };
+    LG::PixelBitmap m_layer;
+    // Parts of the bounds which the layer has to get drawn again.
+    LG::Region m_layer_damage;
 };
 
 inline void View::constraint_interpreter(const Constraint& constraint)
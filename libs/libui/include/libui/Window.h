@@ -12,6 +12,7 @@
 #include <libfoundation/SharedBuffer.h>
 #include <libg/Color.h>
 #include <libg/PixelBitmap.h>
+#include <libg/Region.h>
 #include <libg/Size.h>
 #include <libg/string.h>
 #include <libui/MenuBar.h>
@@ -34,12 +35,15 @@ public:
     Window(const LG::Size& size, WindowType type = WindowType::Standard);
     Window(const LG::Size& size, const LG::string& path);
 
+    static constexpr int SurfaceCount = 3;
+
     int id() const { return m_id; }
     inline WindowType type() const { return m_type; }
 
     inline const LG::Rect& bounds() const { return m_bounds; }
-    LFoundation::SharedBuffer<LG::Color>& buffer() { return m_buffer; }
-    const LFoundation::SharedBuffer<LG::Color>& buffer() const { return m_buffer; }
+    // The buffer we draw into, the others are shown or wait to be shown.
+    LFoundation::SharedBuffer<LG::Color>& buffer() { return m_surfaces[m_back].buffer; }
+    const LFoundation::SharedBuffer<LG::Color>& buffer() const { return m_surfaces[m_back].buffer; }
 
     LG::PixelBitmap& bitmap() { return m_bitmap; }
     const LG::PixelBitmap& bitmap() const { return m_bitmap; }
@@ -69,14 +73,31 @@ public:
     bool did_format_change();
     bool did_buffer_change();
 
+    // Damage of one pump is merged and drawn with one DisplayEvent. While a
+    // presented frame is not shown by the server, damage is only collected.
+    void set_needs_display(const LG::Rect& rect);
+    bool present(const LG::Rect& damage);
+    void did_release_buffer(int buffer_id);
+    void did_frame_done();
+
     inline const LG::string& icon_path() const { return m_icon_path; }
 
     void receive_event(std::unique_ptr<LFoundation::Event> event) override;
 
 private:
+    struct Surface {
+        LFoundation::SharedBuffer<LG::Color> buffer;
+        bool busy { false };
+        // Damage presented since this buffer was presented last time.
+        LG::Rect missed_damage;
+    };
+
     void resize(ResizeEvent&);
     void setup_superview();
     void fill_with_opaque(const LG::Rect&);
+    void create_surfaces(const LG::Size& size);
+    void acquire_back_surface();
+    void copy_from_surface(Surface& src, const LG::Rect& rect);
 
     uint32_t m_id;
     BaseViewController* m_root_view_controller { nullptr };
@@ -86,7 +107,10 @@ private:
     WindowType m_type { WindowType::Standard };
     LG::Rect m_bounds;
     LG::PixelBitmap m_bitmap;
-    LFoundation::SharedBuffer<LG::Color> m_buffer;
+    Surface m_surfaces[SurfaceCount];
+    int m_back { 0 };
+    LG::Region m_damage;
+    bool m_frame_pending { false };
     LG::string m_icon_path { "/res/icons/apps/missing.icon" };
 
     MenuBar m_menubar;
@@ -29,7 +29,7 @@ void Button::display(const LG::Rect& rect)
     }
     ctx.fill_rounded(bounds(), LG::CornerMask(4));
 
-    size_t content_width = text_width();
+    size_t content_width = m_title_width;
     size_t content_height = text_height();
     LG::Point<int> text_start { content_edge_insets().left(), std::max(content_edge_insets().top(), int(bounds().height() - content_height) / 2) };
     if (alignment() == Text::Alignment::Center) {
@@ -38,14 +38,8 @@ void Button::display(const LG::Rect& rect)
         text_start.set_x(bounds().width() - content_width);
     }
 
-    auto& f = font();
-    const size_t letter_spacing = f.glyph_spacing();
-
     ctx.set_fill_color(title_color());
-    for (int i = 0; i < m_title.size(); i++) {
-        ctx.draw(text_start, f.glyph_bitmap(m_title[i]));
-        text_start.offset_by(f.glyph_width(m_title[i]) + letter_spacing, 0);
-    }
+    ctx.draw_text(text_start, font(), m_title.c_str(), m_title.size());
 }
 
 void Button::mouse_entered(const LG::Point<int>& location)
@@ -74,23 +68,19 @@ void Button::mouse_up()
 
 void Button::recalc_bounds()
 {
-    size_t new_width = text_width() + content_edge_insets().left() + content_edge_insets().right();
+    m_title_width = text_width();
+    size_t new_width = m_title_width + content_edge_insets().left() + content_edge_insets().right();
     size_t new_height = text_height() + content_edge_insets().top() + content_edge_insets().bottom();
     set_width(new_width);
     set_height(new_height);
 }
 
-size_t Button::text_width()
+size_t Button::text_width() const
 {
-    size_t width = 0;
-    auto& f = font();
-    const size_t letter_spacing = f.glyph_spacing();
-
-    for (int i = 0; i < m_title.size(); i++) {
-        width += f.glyph_width(m_title[i]);
+    if (!m_title.size()) {
+        return 0;
     }
-    width += std::max(size_t(0), m_title.size() - 1) * letter_spacing;
-    return width;
+    return font().text_width(m_title.c_str(), m_title.size()) - font().glyph_spacing();
 }
 
 size_t Button::text_height() const
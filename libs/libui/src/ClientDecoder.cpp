@@ -64,7 +64,7 @@ std::unique_ptr<Message> ClientDecoder::handle(const KeyboardMessage& msg)
 
 std::unique_ptr<Message> ClientDecoder::handle(const DisplayMessage& msg)
 {
-    m_event_loop.add(App::the().window(), new DisplayEvent(msg.rect()));
+    App::the().window().set_needs_display(msg.rect());
     return nullptr;
 }
 
@@ -93,6 +93,23 @@ std::unique_ptr<Message> ClientDecoder::handle(const MenuBarActionMessage& msg)
     return nullptr;
 }
 
+std::unique_ptr<Message> ClientDecoder::handle(const BufferReleasedMessage& msg)
+{
+    // Not deferred: a window waiting for a free buffer pumps messages itself.
+    if (App::the().window().id() == msg.win_id()) {
+        App::the().window().did_release_buffer(msg.buffer_id());
+    }
+    return nullptr;
+}
+
+std::unique_ptr<Message> ClientDecoder::handle(const FrameDoneMessage& msg)
+{
+    if (App::the().window().id() == msg.win_id()) {
+        App::the().window().did_frame_done();
+    }
+    return nullptr;
+}
+
 // Notifiers
 std::unique_ptr<Message> ClientDecoder::handle(const NotifyWindowStatusChangedMessage& msg)
 {
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <algorithm>
+#include <libui/CollectionView.h>
+
+namespace UI {
+
+CollectionView::CollectionView(View* superview, const LG::Rect& frame)
+    : ScrollView(superview, frame)
+{
+}
+
+CollectionView::CollectionView(View* superview, Window* window, const LG::Rect& frame)
+    : ScrollView(superview, window, frame)
+{
+}
+
+void CollectionView::reload_data()
+{
+    m_row_count = m_number_of_rows ? m_number_of_rows() : 0;
+    content_size().set_width(bounds().width());
+    content_size().set_height(m_row_count * m_row_height);
+
+    int max_y = std::max(0, (int)content_size().height() - (int)bounds().height());
+    content_offset().set_y(std::min(content_offset().y(), max_y));
+    update_visible_cells(true);
+    set_needs_display();
+}
+
+void CollectionView::reload_rows(const std::vector<size_t>& rows)
+{
+    if (!m_configure_cell) {
+        return;
+    }
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        size_t row = rows[i];
+        if (row < m_first_visible_row || row >= m_first_visible_row + m_visible_cells.size()) {
+            continue;
+        }
+        auto& cell = *m_visible_cells[row - m_first_visible_row];
+        m_configure_cell(cell, row);
+        cell.set_needs_display();
+    }
+}
+
+void CollectionView::layout_subviews()
+{
+    ScrollView::layout_subviews();
+    content_size().set_width(bounds().width());
+    update_visible_cells(false);
+}
+
+void CollectionView::content_offset_did_change()
+{
+    update_visible_cells(false);
+}
+
+// A free cell is put above the content, where it is never seen nor hit.
+void CollectionView::park_cell(View& cell)
+{
+    cell.frame().set_y(-(int)m_row_height - 1);
+    m_free_cells.push_back(&cell);
+}
+
+void CollectionView::update_visible_cells(bool reconfigure)
+{
+    if (!m_make_cell) {
+        return;
+    }
+
+    int offset_y = content_offset().y();
+    size_t first_row = std::min((size_t)offset_y / m_row_height, m_row_count);
+    size_t end_row = std::min((offset_y + bounds().height() + m_row_height - 1) / m_row_height, m_row_count);
+
+    // Cells which still show their rows stay with them, the others are freed.
+    std::vector<View*> cells;
+    for (size_t row = first_row; row < end_row; row++) {
+        cells.push_back(nullptr);
+    }
+    for (size_t i = 0; i < m_visible_cells.size(); i++) {
+        size_t row = m_first_visible_row + i;
+        if (!reconfigure && row >= first_row && row < end_row) {
+            cells[row - first_row] = m_visible_cells[i];
+        } else {
+            park_cell(*m_visible_cells[i]);
+        }
+    }
+
+    for (size_t row = first_row; row < end_row; row++) {
+        auto*& cell = cells[row - first_row];
+        if (cell) {
+            continue;
+        }
+
+        if (!m_free_cells.empty()) {
+            cell = m_free_cells.back();
+            m_free_cells.pop_back();
+        } else {
+            cell = m_make_cell();
+        }
+
+        cell->frame().set_x(0);
+        cell->frame().set_y(row * m_row_height);
+        if (cell->frame().width() != bounds().width() || cell->frame().height() != m_row_height) {
+            cell->set_width(bounds().width());
+            cell->set_height(m_row_height);
+        }
+        if (m_configure_cell) {
+            m_configure_cell(*cell, row);
+        }
+    }
+
+    m_first_visible_row = first_row;
+    m_visible_cells = std::move(cells);
+    invalidate_hit_grid();
+}
+
+} // namespace UI
@@ -5,6 +5,8 @@
  */
 
 #include <libfoundation/Logger.h>
+#include <libfoundation/SharedBuffer.h>
+#include <libg/ImageLoaders/PNGLoader.h>
 #include <libipc/ClientConnection.h>
 #include <libui/Connection.h>
 #include <libui/Window.h>
@@ -64,6 +66,11 @@ void Connection::setup_listners()
             Connection::the().listen();
         },
         nullptr);
+
+    // Messages sent within a pump go to the server with one write.
+    LFoundation::EventLoop::the().add_pump_end_handler([] {
+        Connection::the().flush();
+    });
 }
 
 void Connection::greeting()
@@ -71,6 +78,7 @@ void Connection::greeting()
     auto resp_message = send_sync_message<GreetMessageReply>(GreetMessage(getpid()));
     m_connection_id = resp_message->connection_id();
     m_connection_with_server.set_accepted_key(m_connection_id);
+    m_connection_with_server.attach_ring();
 #ifdef DEBUG_CONNECTION
     Logger::debug << "Got greet with server" << std::endl;
 #endif
@@ -85,4 +93,35 @@ int Connection::new_window(const Window& window)
 #endif
     return resp_message->window_id();
 }
-} // namespace UI
\ No newline at end of file
+
+static LG::PixelBitmap image_from_reply(const GetImageMessageReply& reply, const std::string& path, const LG::Size& size)
+{
+    if (reply.buffer_id() >= 0) {
+        LFoundation::SharedBuffer<LG::Color> buffer(reply.buffer_id());
+        if (buffer.alive()) {
+            return LG::PixelBitmap(buffer.data(), reply.width(), reply.height(), LG::PixelBitmapFormat(reply.format()));
+        }
+    }
+
+    LG::PNG::PNGLoader loader;
+    LG::PixelBitmap bitmap = loader.load_from_file(path);
+    if (size.width() && size.height() && (size.width() != bitmap.width() || size.height() != bitmap.height())) {
+        return bitmap.scaled(size);
+    }
+    return bitmap;
+}
+
+LG::PixelBitmap Connection::image(const std::string& path, const LG::Size& size)
+{
+    auto resp_message = send_sync_message<GetImageMessageReply>(GetImageMessage(key(), LG::string(path.c_str()), size.width(), size.height()));
+    return image_from_reply(*resp_message, path, size);
+}
+
+void Connection::image_async(const std::string& path, const LG::Size& size, ImageCallback callback)
+{
+    send_request(GetImageMessage(key(), LG::string(path.c_str()), size.width(), size.height()), [path, size, callback](std::unique_ptr<Message> msg) {
+        callback(image_from_reply(*static_cast<GetImageMessageReply*>(msg.get()), path, size));
+    });
+}
+
+} // namespace UI
@@ -36,7 +36,7 @@ void Label::display(const LG::Rect& rect)
     bool need_to_stop_rendering_text = (txt_width > label_width);
     size_t width_when_stop_rendering_text = content_edge_insets().left() + label_width - dots_width;
 
-    size_t content_width = text_width();
+    size_t content_width = txt_width;
     size_t content_height = text_height();
     LG::Point<int> text_start { content_edge_insets().left(), std::max(content_edge_insets().top(), int(bounds().height() - content_height) / 2) };
     if (alignment() == Text::Alignment::Center) {
@@ -82,18 +82,15 @@ void Label::recalc_bounds()
 
 size_t Label::text_width() const
 {
-    if (!m_text.size()) {
-        return 0;
+    if (m_text_width != NotMeasured) {
+        return m_text_width;
     }
 
-    size_t width = 0;
-    auto& f = font();
-    const size_t letter_spacing = f.glyph_spacing();
-
-    for (int i = 0; i < m_text.size(); i++) {
-        width += f.glyph_width(m_text[i]) + letter_spacing;
+    m_text_width = 0;
+    if (m_text.size()) {
+        m_text_width = font().text_width(m_text.c_str(), m_text.size()) - font().glyph_spacing();
     }
-    return width - letter_spacing;
+    return m_text_width;
 }
 
 size_t Label::text_height() const
@@ -15,7 +15,9 @@ void Menu::add_item(const MenuItem& item)
     int host_window_id = m_menubar.host_window_id();
     int item_id = m_menubar.add_menu_item(item);
     auto& connection = App::the().connection();
-    auto resp_message = connection.send_sync_message<MenuBarCreateItemMessageReply>(MenuBarCreateItemMessage(connection.key(), host_window_id, menu_id(), item_id, item.title()));
+    // Only the status comes back, so items of a menu are sent without
+    // waiting for each other.
+    connection.send_request(MenuBarCreateItemMessage(connection.key(), host_window_id, menu_id(), item_id, item.title()), nullptr);
 }
 
 Menu& MenuBar::add_menu(LG::string&& title)
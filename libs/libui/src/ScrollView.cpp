@@ -37,6 +37,7 @@ void ScrollView::did_scroll(int n_x, int n_y)
     int max_y = std::max(0, (int)content_size().height() - (int)bounds().height());
     content_offset().set_x(std::max(0, std::min(x + n_x, max_x)));
     content_offset().set_y(std::max(0, std::min(y + n_y, max_y)));
+    content_offset_did_change();
     set_needs_display();
 }
 
@@ -54,14 +55,9 @@ std::optional<LG::Point<int>> ScrollView::subview_location(const View& subview)
 
 std::optional<View*> ScrollView::subview_at(const LG::Point<int>& point) const
 {
-    for (int i = subviews().size() - 1; i >= 0; --i) {
-        auto frame = subviews()[i]->frame();
-        frame.offset_by(-m_content_offset);
-        if (frame.contains(point)) {
-            return subviews()[i];
-        }
-    }
-    return {};
+    auto content_point = point;
+    content_point.offset_by(m_content_offset);
+    return View::subview_at(content_point);
 }
 
 void ScrollView::receive_mouse_move_event(MouseEvent& event)
@@ -71,24 +67,7 @@ void ScrollView::receive_mouse_move_event(MouseEvent& event)
         mouse_entered(location);
     }
 
-    foreach_subview([&](View& subview) -> bool {
-        auto frame = subview.frame();
-        frame.offset_by(-m_content_offset);
-        bool event_hits_subview = frame.contains(event.x(), event.y());
-        if (subview.is_hovered() && !event_hits_subview) {
-            LG::Point<int> point(event.x(), event.y());
-            point.offset_by(-frame.origin());
-            MouseLeaveEvent mle(point.x(), point.y());
-            subview.receive_mouse_leave_event(mle);
-        } else if (event_hits_subview) {
-            LG::Point<int> point(event.x(), event.y());
-            point.offset_by(-frame.origin());
-            MouseEvent me(point.x(), point.y());
-            subview.receive_mouse_move_event(me);
-        }
-        return true;
-    });
-
+    send_mouse_move_to_subviews(location, m_content_offset);
     mouse_moved(location);
     Responder::receive_mouse_move_event(event);
 }
@@ -96,6 +75,10 @@ void ScrollView::receive_mouse_move_event(MouseEvent& event)
 void ScrollView::receive_display_event(DisplayEvent& event)
 {
     event.bounds().intersect(bounds());
+    if (display_from_layer(event)) {
+        return;
+    }
+
     display(event.bounds());
     foreach_subview([&](View& subview) -> bool {
         auto bounds = event.bounds();
@@ -113,11 +96,6 @@ void ScrollView::receive_display_event(DisplayEvent& event)
     });
     did_display(event.bounds());
 
-    if (!has_superview()) {
-        // Only superview sends invalidate_message to server.
-        bool success = send_invalidate_message_to_server(event.bounds());
-    }
-
     Responder::receive_display_event(event);
 }
 
@@ -159,6 +159,7 @@ void StackView::recalc_subviews_positions()
             primary_coord += m_views[i]->frame().height() + spacing;
         }
     }
+    invalidate_hit_grid();
 }
 
 } // namespace UI
\ No newline at end of file
@@ -21,6 +21,48 @@ TextView::TextView(View* superview, Window* window, const LG::Rect& frame)
 {
 }
 
+std::string TextView::text() const
+{
+    std::string res;
+    res.reserve(m_text.size() + 1);
+    m_text.for_each_chunk(0, m_text.size(), [&](const char* data, size_t len) {
+        res.append(data, len);
+    });
+    return res;
+}
+
+void TextView::insert_text(size_t offset, const std::string& text)
+{
+    size_t line = m_text.line_of(offset);
+    size_t line_count = m_text.line_count();
+    m_text.insert(offset, text.data(), text.size());
+    text_did_change(line, line + m_text.line_count() - line_count, line_count != m_text.line_count());
+}
+
+void TextView::erase_text(size_t offset, size_t len)
+{
+    size_t line = m_text.line_of(offset);
+    size_t line_count = m_text.line_count();
+    m_text.erase(offset, len);
+    text_did_change(line, line, line_count != m_text.line_count());
+}
+
+// The content only grows on edits, it is fit to the text again by set_text().
+void TextView::text_did_change(size_t first_line, size_t last_line, bool lines_moved)
+{
+    const int line_height = font().glyph_height();
+    for (size_t line = first_line; line <= last_line; line++) {
+        content_size().set_width(std::max(content_size().width(), line_width(line)));
+    }
+    content_size().set_height(std::max(content_size().height(), m_text.line_count() * line_height));
+
+    int min_y = (int)first_line * line_height - content_offset().y();
+    int height = lines_moved ? bounds().height() - min_y : line_height;
+    if (height > 0) {
+        set_needs_display(LG::Rect(0, min_y, bounds().width(), height));
+    }
+}
+
 void TextView::display(const LG::Rect& rect)
 {
     LG::Context ctx = graphics_current_context();
@@ -28,25 +70,27 @@ void TextView::display(const LG::Rect& rect)
 
     auto& f = font();
     const size_t letter_spacing = f.glyph_spacing();
-    const size_t line_height = f.glyph_height();
+    const int line_height = f.glyph_height();
 
+    // Only the lines within the rect are walked.
     int start_x = -content_offset().x();
-    int start_y = -content_offset().y();
-    int cur_x = start_x;
-    int cur_y = start_y;
-
-    for (int i = 0; i < m_text.size(); i++) {
-        if (m_text[i] == '\n') {
-            cur_x = start_x;
-            cur_y += line_height;
-            continue;
-        }
-
-        size_t glyph_width = f.glyph_width(m_text[i]) + letter_spacing;
-        if (bounds().contains(cur_x, cur_y) || bounds().contains(cur_x + glyph_width, cur_y + line_height)) {
-            ctx.draw({ cur_x, cur_y }, f.glyph_bitmap(m_text[i]));
-        }
-        cur_x += glyph_width;
+    int first_y = std::max(0, rect.min_y() + content_offset().y());
+    int last_y = rect.max_y() + content_offset().y();
+    size_t first_line = first_y / line_height;
+    size_t last_line = std::min((size_t)std::max(0, last_y) / line_height, m_text.line_count() - 1);
+
+    for (size_t line = first_line; last_y >= 0 && line <= last_line; line++) {
+        int cur_x = start_x;
+        int cur_y = (int)line * line_height - content_offset().y();
+        m_text.for_each_chunk(m_text.line_start(line), m_text.line_length(line), [&](const char* data, size_t len) {
+            for (size_t i = 0; i < len && cur_x <= rect.max_x(); i++) {
+                size_t glyph_width = f.glyph_width(data[i]) + letter_spacing;
+                if (cur_x + (int)glyph_width >= rect.min_x()) {
+                    ctx.draw({ cur_x, cur_y }, f.glyph_bitmap(data[i]));
+                }
+                cur_x += glyph_width;
+            }
+        });
     }
 
     display_scroll_indicators(ctx);
@@ -62,29 +106,28 @@ void TextView::mouse_exited()
     set_hovered(false);
 }
 
+size_t TextView::line_width(size_t line) const
+{
+    if (font().fixed_width()) {
+        return font().text_width(nullptr, m_text.line_length(line));
+    }
+
+    size_t width = 0;
+    m_text.for_each_chunk(m_text.line_start(line), m_text.line_length(line), [&](const char* data, size_t len) {
+        width += font().text_width(data, len);
+    });
+    return width;
+}
+
 void TextView::recalc_text_size()
 {
-    const size_t letter_spacing = font().glyph_spacing();
     const size_t line_height = font().glyph_height();
 
-    int cur_x = 0;
     int max_x = 0;
-    int cur_y = 0;
-
-    for (int i = 0; i < m_text.size(); i++) {
-        if (m_text[i] == '\n') {
-            std::max(max_x, cur_x);
-            cur_x = 0;
-            cur_y += line_height;
-            continue;
-        }
-
-        size_t glyph_width = font().glyph_width(m_text[i]) + letter_spacing;
-        cur_x += glyph_width;
+    for (size_t line = 0; line < m_text.line_count(); line++) {
+        max_x = std::max(max_x, (int)line_width(line));
     }
-
-    std::max(max_x, cur_x);
-    content_size().set(LG::Size(cur_x, cur_y + line_height));
+    content_size().set(LG::Size(max_x, m_text.line_count() * line_height));
 }
 
-} // namespace UI
\ No newline at end of file
+} // namespace UI
@@ -4,7 +4,9 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <algorithm>
 #include <libfoundation/EventLoop.h>
+#include <libfoundation/Memory.h>
 #include <libg/Color.h>
 #include <libui/Context.h>
 #include <libui/View.h>
@@ -31,12 +33,36 @@ void View::remove_from_superview()
 {
 }
 
-std::optional<View*> View::subview_at(const LG::Point<int>& point) const
+// Calls the callback for the subviews whose frames contain the point, in
+// the order they were added.
+template <typename Callback>
+void View::foreach_subview_at(const LG::Point<int>& point, Callback callback) const
 {
-    for (int i = subviews().size() - 1; i >= 0; --i) {
-        if (subviews()[i]->frame().contains(point)) {
-            return subviews()[i];
+    if (m_subviews.size() < HitGridMinSubviews) {
+        for (size_t i = 0; i < m_subviews.size(); i++) {
+            if (m_subviews[i]->frame().contains(point)) {
+                callback(*m_subviews[i]);
+            }
+        }
+        return;
+    }
+
+    if (!m_hit_grid.built()) {
+        m_hit_grid.clear();
+        for (size_t i = 0; i < m_subviews.size(); i++) {
+            m_hit_grid.add(m_subviews[i]->frame(), m_subviews[i]);
         }
+        m_hit_grid.build();
+    }
+    m_hit_grid.foreach_containing(point, [&](View* subview) { callback(*subview); });
+}
+
+std::optional<View*> View::subview_at(const LG::Point<int>& point) const
+{
+    View* topmost = nullptr;
+    foreach_subview_at(point, [&](View& subview) { topmost = &subview; });
+    if (topmost) {
+        return topmost;
     }
     return {};
 }
@@ -61,11 +87,128 @@ LG::Rect View::frame_in_window()
     return rect;
 }
 
+int View::constraint_item_index(const View* item) const
+{
+    if (!item || item == this) {
+        return ConstraintSelf;
+    }
+    for (int i = 0; i < m_subviews.size(); i++) {
+        if (m_subviews[i] == item) {
+            return i;
+        }
+    }
+    return ConstraintOther;
+}
+
+// A constraint goes after the ones which set its related item, and after
+// the ones added before it for the same item, as Bottom and Right read
+// what Top and Left have set. The earliest added constraint which is ready
+// goes first, constraints left in a cycle keep the order they were added.
+void View::sort_constraints()
+{
+    size_t count = m_constrints.size();
+    m_constraint_items.clear();
+    for (size_t i = 0; i < count; i++) {
+        auto& constraint = m_constrints[i];
+        m_constraint_items.push_back({ constraint_item_index(constraint.item()), constraint_item_index(constraint.rel_item()) });
+    }
+
+    auto depends_on = [&](size_t i, size_t j) -> bool {
+        auto& items = m_constraint_items[i];
+        auto& other = m_constraint_items[j];
+        if (items.item == other.item && j < i) {
+            return true;
+        }
+        return items.rel_item >= 0 && items.rel_item == other.item;
+    };
+
+    std::vector<size_t> pending_deps;
+    for (size_t i = 0; i < count; i++) {
+        size_t deps = 0;
+        for (size_t j = 0; j < count; j++) {
+            if (i != j && depends_on(i, j)) {
+                deps++;
+            }
+        }
+        pending_deps.push_back(deps);
+    }
+
+    std::vector<bool> placed;
+    for (size_t i = 0; i < count; i++) {
+        placed.push_back(false);
+    }
+
+    m_constraint_order.clear();
+    while (m_constraint_order.size() < count) {
+        size_t next = count;
+        for (size_t i = 0; i < count; i++) {
+            if (!placed[i] && pending_deps[i] == 0) {
+                next = i;
+                break;
+            }
+        }
+        if (next == count) {
+            for (size_t i = 0; i < count && next == count; i++) {
+                if (!placed[i]) {
+                    next = i;
+                }
+            }
+        }
+
+        placed[next] = true;
+        m_constraint_order.push_back(next);
+        for (size_t i = 0; i < count; i++) {
+            if (!placed[i] && pending_deps[i] && depends_on(i, next)) {
+                pending_deps[i]--;
+            }
+        }
+    }
+    m_constraints_sorted = true;
+}
+
 void View::layout_subviews()
 {
-    // TODO: Apply topsort to find the right order.
-    for (const auto& constraint : m_constrints) {
+    // Items which changed since the last solve, the view itself is last.
+    // New constraints are solved all over.
+    size_t subviews_count = m_subviews.size();
+    bool resolve_all = !m_laid_out || !m_constraints_sorted || m_laid_out_frames.size() != subviews_count;
+    if (!m_constraints_sorted) {
+        sort_constraints();
+    }
+    std::vector<bool> changed;
+    for (size_t i = 0; i < subviews_count; i++) {
+        changed.push_back(resolve_all || m_laid_out_frames[i] != m_subviews[i]->frame());
+    }
+    changed.push_back(resolve_all || m_laid_out_bounds != m_bounds);
+
+    auto is_changed = [&](int index) -> bool {
+        if (index == ConstraintOther) {
+            return true;
+        }
+        return changed[index == ConstraintSelf ? subviews_count : index];
+    };
+
+    for (size_t i = 0; i < m_constraint_order.size(); i++) {
+        size_t index = m_constraint_order[i];
+        auto& constraint = m_constrints[index];
+        auto& items = m_constraint_items[index];
+        if (!is_changed(items.item) && !is_changed(items.rel_item)) {
+            continue;
+        }
+
+        auto frame = constraint.item()->frame();
         constraint_interpreter(constraint);
+        if (items.item >= 0 && frame != constraint.item()->frame()) {
+            changed[items.item] = true;
+        }
+    }
+
+    invalidate_hit_grid();
+    m_laid_out = true;
+    m_laid_out_bounds = m_bounds;
+    m_laid_out_frames.clear();
+    for (size_t i = 0; i < subviews_count; i++) {
+        m_laid_out_frames.push_back(m_subviews[i]->frame());
     }
 }
 
@@ -78,6 +221,9 @@ void View::set_needs_display(const LG::Rect& rect)
 {
     auto display_rect = rect;
     display_rect.intersect(bounds());
+    if (m_layer_backed) {
+        m_layer_damage.unite(display_rect);
+    }
     if (has_superview()) {
         auto location = superview()->subview_location(*this);
         display_rect.offset_by(location.value());
@@ -87,6 +233,51 @@ void View::set_needs_display(const LG::Rect& rect)
     }
 }
 
+void View::set_layer_backed(bool layer_backed)
+{
+    m_layer_backed = layer_backed;
+    m_layer = LG::PixelBitmap();
+    m_layer_damage = LG::Region();
+}
+
+// The layer is drawn with the view alone in it, so it stays right whatever
+// is drawn under the view. Damaged parts are cleared to transparent and the
+// view draws them into the layer with its subviews, then the layer is
+// blended into the current context.
+bool View::display_from_layer(DisplayEvent& event)
+{
+    if (!m_layer_backed || m_drawing_layer) {
+        return false;
+    }
+
+    if (m_layer.width() != bounds().width() || m_layer.height() != bounds().height()) {
+        m_layer = LG::PixelBitmap(bounds().width(), bounds().height(), LG::PixelBitmapFormat::RGBA_Premultiplied);
+        m_layer_damage = LG::Region(bounds());
+    }
+
+    if (!m_layer_damage.empty()) {
+        auto damage = std::move(m_layer_damage);
+        auto& areas = damage.rects();
+        m_drawing_layer = true;
+        graphics_push_context(LG::Context(m_layer));
+        for (int i = 0; i < areas.size(); i++) {
+            auto area = areas[i].intersection(bounds());
+            for (int y = area.min_y(); y <= area.max_y(); y++) {
+                LFoundation::fast_set(reinterpret_cast<uint32_t*>(&m_layer[y][area.min_x()]), LG::Color(0, 0, 0, 0).u32(), area.width());
+            }
+            DisplayEvent own_event(area);
+            receive_display_event(own_event);
+        }
+        graphics_pop_context();
+        m_drawing_layer = false;
+    }
+
+    LG::Context ctx = graphics_current_context();
+    ctx.add_clip(event.bounds());
+    ctx.draw({ 0, 0 }, m_layer);
+    return true;
+}
+
 void View::display(const LG::Rect& rect)
 {
     LG::Context ctx = graphics_current_context();
@@ -138,24 +329,51 @@ void View::receive_mouse_move_event(MouseEvent& event)
         mouse_entered(location);
     }
 
-    foreach_subview([&](View& subview) -> bool {
-        bool event_hits_subview = subview.frame().contains(event.x(), event.y());
-        if (subview.is_hovered() && !event_hits_subview) {
-            LG::Point<int> point(event.x(), event.y());
-            point.offset_by(-subview.frame().origin());
+    send_mouse_move_to_subviews(location, LG::Point<int>(0, 0));
+    mouse_moved(location);
+    Responder::receive_mouse_move_event(event);
+}
+
+void View::send_mouse_move_to_subviews(const LG::Point<int>& location, const LG::Point<int>& offset)
+{
+    auto content_location = location;
+    content_location.offset_by(offset);
+
+    std::vector<View*> hovered_subviews;
+    foreach_subview_at(content_location, [&](View& subview) { hovered_subviews.push_back(&subview); });
+
+    for (auto* subview : m_hovered_subviews) {
+        if (subview->is_hovered() && std::find(hovered_subviews.begin(), hovered_subviews.end(), subview) == hovered_subviews.end()) {
+            auto point = content_location;
+            point.offset_by(-subview->frame().origin());
             MouseLeaveEvent mle(point.x(), point.y());
-            subview.receive_mouse_leave_event(mle);
-        } else if (event_hits_subview) {
-            LG::Point<int> point(event.x(), event.y());
-            point.offset_by(-subview.frame().origin());
-            MouseEvent me(point.x(), point.y());
-            subview.receive_mouse_move_event(me);
+            subview->receive_mouse_leave_event(mle);
         }
-        return true;
-    });
+    }
 
-    mouse_moved(location);
-    Responder::receive_mouse_move_event(event);
+    for (auto* subview : hovered_subviews) {
+        auto point = content_location;
+        point.offset_by(-subview->frame().origin());
+        MouseEvent me(point.x(), point.y());
+        subview->receive_mouse_move_event(me);
+    }
+    m_hovered_subviews = std::move(hovered_subviews);
+}
+
+void View::send_mouse_leave_to_subviews(const LG::Point<int>& location, const LG::Point<int>& offset)
+{
+    auto content_location = location;
+    content_location.offset_by(offset);
+
+    for (auto* subview : m_hovered_subviews) {
+        if (subview->is_hovered()) {
+            auto point = content_location;
+            point.offset_by(-subview->frame().origin());
+            MouseLeaveEvent mle(point.x(), point.y());
+            subview->receive_mouse_leave_event(mle);
+        }
+    }
+    m_hovered_subviews.clear();
 }
 
 void View::receive_mouse_action_event(MouseActionEvent& event)
@@ -175,16 +393,7 @@ void View::receive_mouse_leave_event(MouseLeaveEvent& event)
         return;
     }
 
-    foreach_subview([&](View& subview) -> bool {
-        if (subview.is_hovered()) {
-            LG::Point<int> point(event.x(), event.y());
-            point.offset_by(-subview.frame().origin());
-            MouseLeaveEvent mle(point.x(), point.y());
-            subview.receive_mouse_leave_event(mle);
-        }
-        return true;
-    });
-
+    send_mouse_leave_to_subviews(LG::Point<int>(event.x(), event.y()), LG::Point<int>(0, 0));
     mouse_exited();
     Responder::receive_mouse_leave_event(event);
 }
@@ -219,6 +428,10 @@ void View::receive_keydown_event(KeyDownEvent&)
 void View::receive_display_event(DisplayEvent& event)
 {
     event.bounds().intersect(bounds());
+    if (display_from_layer(event)) {
+        return;
+    }
+
     display(event.bounds());
     foreach_subview([&](View& subview) -> bool {
         auto bounds = event.bounds();
@@ -233,11 +446,6 @@ void View::receive_display_event(DisplayEvent& event)
     });
     did_display(event.bounds());
 
-    if (!has_superview()) {
-        // Only superview sends invalidate_message to server.
-        bool success = send_invalidate_message_to_server(event.bounds());
-    }
-
     Responder::receive_display_event(event);
 }
 
@@ -249,7 +457,7 @@ bool View::receive_layout_event(const LayoutEvent& event, bool force_layout_if_n
     }
 
     foreach_subview([&](View& subview) -> bool {
-        bool found_target = subview.receive_layout_event(event, need_to_layout);
+        bool found_target = subview.receive_layout_event(event, need_to_layout && subview.needs_layout());
         return need_to_layout || !found_target;
     });
 
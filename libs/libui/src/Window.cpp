@@ -14,25 +14,25 @@ namespace UI {
 
 Window::Window(const LG::Size& size, WindowType type)
     : m_bounds(0, 0, size.width(), size.height())
-    , m_buffer(size_t(size.width() * size.height()))
     , m_bitmap()
     , m_type(type)
 {
+    create_surfaces(size);
     m_id = Connection::the().new_window(*this);
     m_menubar.set_host_window_id(m_id);
-    m_bitmap = LG::PixelBitmap(m_buffer.data(), bounds().width(), bounds().height());
+    m_bitmap = LG::PixelBitmap(buffer().data(), bounds().width(), bounds().height());
     App::the().set_window(this);
 }
 
 Window::Window(const LG::Size& size, const LG::string& icon_path)
     : m_bounds(0, 0, size.width(), size.height())
-    , m_buffer(size_t(size.width() * size.height()))
     , m_bitmap()
     , m_icon_path(icon_path)
 {
+    create_surfaces(size);
     m_id = Connection::the().new_window(*this);
     m_menubar.set_host_window_id(m_id);
-    m_bitmap = LG::PixelBitmap(m_buffer.data(), bounds().width(), bounds().height());
+    m_bitmap = LG::PixelBitmap(buffer().data(), bounds().width(), bounds().height());
     App::the().set_window(this);
 }
 
@@ -48,8 +48,24 @@ bool Window::set_frame_style(const LG::Color& color, TextStyle ts)
     return App::the().connection().send_async_message(msg);
 }
 
+void Window::create_surfaces(const LG::Size& size)
+{
+    for (int i = 0; i < SurfaceCount; i++) {
+        m_surfaces[i].buffer.create(size_t(size.width() * size.height()));
+    }
+}
+
 bool Window::did_buffer_change()
 {
+    // The server shows the back buffer from now on, the others get all
+    // content copied before they are drawn into. Nothing presented is
+    // pending anymore.
+    m_frame_pending = false;
+    for (int i = 0; i < SurfaceCount; i++) {
+        m_surfaces[i].busy = false;
+        m_surfaces[i].missed_damage = (i == m_back) ? LG::Rect() : bounds();
+    }
+
     m_bitmap.set_data(buffer().data());
     m_bitmap.set_size({ bounds().width(), bounds().height() });
 
@@ -64,9 +80,107 @@ bool Window::did_buffer_change()
     return App::the().connection().send_async_message(msg);
 }
 
+void Window::set_needs_display(const LG::Rect& rect)
+{
+    if (rect.empty()) {
+        return;
+    }
+
+    // Only the first damage of a pump posts the event, the rest is merged
+    // into the region and drawn with it. Damage which comes while a frame is
+    // pending waits for did_frame_done().
+    if (m_damage.empty() && !m_frame_pending) {
+        LFoundation::EventLoop::the().add(*this, new DisplayEvent(rect));
+    }
+    m_damage.unite(rect);
+}
+
+void Window::did_frame_done()
+{
+    m_frame_pending = false;
+    if (!m_damage.empty()) {
+        LFoundation::EventLoop::the().add(*this, new DisplayEvent(m_damage.bounds()));
+    }
+}
+
+bool Window::present(const LG::Rect& damage)
+{
+    auto& back = m_surfaces[m_back];
+    PresentMessage msg(Connection::the().key(), id(), back.buffer.id(), damage);
+    bool success = App::the().connection().send_async_message(msg);
+    m_frame_pending = success;
+
+    back.busy = true;
+    back.missed_damage = LG::Rect();
+    for (int i = 0; i < SurfaceCount; i++) {
+        auto& missed = m_surfaces[i].missed_damage;
+        if (i == m_back) {
+            continue;
+        }
+        if (missed.empty()) {
+            missed = damage;
+        } else {
+            missed.unite(damage);
+        }
+    }
+
+    acquire_back_surface();
+    return success;
+}
+
+void Window::did_release_buffer(int buffer_id)
+{
+    for (int i = 0; i < SurfaceCount; i++) {
+        if (m_surfaces[i].buffer.id() == buffer_id) {
+            m_surfaces[i].busy = false;
+        }
+    }
+}
+
+// Waits for the server to release a buffer if all of them are busy, then
+// brings it up to date with the buffer presented last.
+void Window::acquire_back_surface()
+{
+    int presented = m_back;
+    for (;;) {
+        for (int i = 0; i < SurfaceCount; i++) {
+            if (!m_surfaces[i].busy) {
+                m_back = i;
+                break;
+            }
+        }
+        if (m_back != presented) {
+            break;
+        }
+        Connection::the().listen_sync();
+    }
+
+    auto& back = m_surfaces[m_back];
+    copy_from_surface(m_surfaces[presented], back.missed_damage);
+    back.missed_damage = LG::Rect();
+    m_bitmap.set_data(back.buffer.data());
+}
+
+void Window::copy_from_surface(Surface& src, const LG::Rect& rect)
+{
+    auto copy_bounds = rect;
+    copy_bounds.intersect(bounds());
+    if (copy_bounds.empty()) {
+        return;
+    }
+
+    auto* dest_ptr = reinterpret_cast<uint32_t*>(buffer().data());
+    auto* src_ptr = reinterpret_cast<uint32_t*>(src.buffer.data());
+    size_t offset = copy_bounds.min_y() * bounds().width() + copy_bounds.min_x();
+    for (int y = 0; y < copy_bounds.height(); y++) {
+        LFoundation::fast_copy(dest_ptr + offset, src_ptr + offset, copy_bounds.width());
+        offset += bounds().width();
+    }
+}
+
 bool Window::did_format_change()
 {
-    if (bitmap().format() == LG::PixelBitmapFormat::RGBA) {
+    if (bitmap().has_alpha_channel()) {
         // Set full bitmap as opaque, to mix colors correctly.
         fill_with_opaque(bounds());
     }
@@ -119,18 +233,22 @@ void Window::receive_event(std::unique_ptr<LFoundation::Event> event)
         }
     }
 
-    if (event->type() == Event::Type::DisplayEvent) {
-        if (m_superview) {
-            DisplayEvent& own_event = *(DisplayEvent*)event.get();
+    if (event->type() == Event::Type::DisplayEvent && !m_frame_pending) {
+        auto damage = std::move(m_damage);
+        if (m_superview && !damage.empty()) {
+            auto& areas = damage.rects();
+            for (int i = 0; i < areas.size(); i++) {
+                // If the window is in RGBA mode, we have to fill this rect
+                // with opaque color before superview will mix it's color on
+                // top of bitmap.
+                if (bitmap().has_alpha_channel()) {
+                    fill_with_opaque(areas[i]);
+                }
 
-            // If the window is in RGBA mode, we have to fill this rect
-            // with opaque color before superview will mix it's color on
-            // top of bitmap.
-            if (bitmap().format() == LG::PixelBitmapFormat::RGBA) {
-                fill_with_opaque(own_event.bounds());
+                DisplayEvent own_event(areas[i]);
+                m_superview->receive_display_event(own_event);
             }
-
-            m_superview->receive_display_event(own_event);
+            present(damage.bounds());
         }
     }
 
@@ -165,8 +283,10 @@ void Window::resize(ResizeEvent& resize_event)
     }
 
     size_t new_size = resize_event.bounds().width() * resize_event.bounds().height();
-    if (m_buffer.size() != new_size) [[likely]] {
-        m_buffer.resize(resize_event.bounds().width() * resize_event.bounds().height());
+    if (buffer().size() != new_size) [[likely]] {
+        for (int i = 0; i < SurfaceCount; i++) {
+            m_surfaces[i].buffer.resize(new_size);
+        }
         did_buffer_change();
     }
 }
@@ -19,13 +19,13 @@ public:
     int reply_id() const override { return 2; }
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
     }
 
 private:
@@ -44,14 +44,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
     uint32_t connection_id() const { return m_connection_id; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_connection_id); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_connection_id);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_connection_id);
     }
 
 private:
@@ -79,18 +79,18 @@ public:
     uint32_t height() const { return m_height; }
     int buffer_id() const { return m_buffer_id; }
     LG::string icon_path() const { return m_icon_path; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_type) + Encoder::encoded_size(m_width) + Encoder::encoded_size(m_height) + Encoder::encoded_size(m_buffer_id) + Encoder::encoded_size(m_icon_path); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_type);
-        Encoder::append(buffer, m_width);
-        Encoder::append(buffer, m_height);
-        Encoder::append(buffer, m_buffer_id);
-        Encoder::append(buffer, m_icon_path);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_type);
+        Encoder::store(data, offset, m_width);
+        Encoder::store(data, offset, m_height);
+        Encoder::store(data, offset, m_buffer_id);
+        Encoder::store(data, offset, m_icon_path);
     }
 
 private:
@@ -114,14 +114,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_window_id);
     }
 
 private:
@@ -141,14 +141,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_window_id);
     }
 
 private:
@@ -168,14 +168,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
     uint32_t status() const { return m_status; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_status); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_status);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_status);
     }
 
 private:
@@ -201,17 +201,17 @@ public:
     int buffer_id() const { return m_buffer_id; }
     int format() const { return m_format; }
     LG::Rect bounds() const { return m_bounds; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_buffer_id) + Encoder::encoded_size(m_format) + Encoder::encoded_size(m_bounds); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_buffer_id);
-        Encoder::append(buffer, m_format);
-        Encoder::append(buffer, m_bounds);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_window_id);
+        Encoder::store(data, offset, m_buffer_id);
+        Encoder::store(data, offset, m_format);
+        Encoder::store(data, offset, m_bounds);
     }
 
 private:
@@ -238,16 +238,16 @@ public:
     uint32_t window_id() const { return m_window_id; }
     uint32_t color() const { return m_color; }
     int text_style() const { return m_text_style; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_color) + Encoder::encoded_size(m_text_style); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_color);
-        Encoder::append(buffer, m_text_style);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_window_id);
+        Encoder::store(data, offset, m_color);
+        Encoder::store(data, offset, m_text_style);
     }
 
 private:
@@ -271,15 +271,15 @@ public:
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
     LG::string title() const { return m_title; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_title); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_title);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_window_id);
+        Encoder::store(data, offset, m_title);
     }
 
 private:
@@ -302,15 +302,15 @@ public:
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
     LG::Rect rect() const { return m_rect; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_rect); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_rect);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_window_id);
+        Encoder::store(data, offset, m_rect);
     }
 
 private:
@@ -333,15 +333,15 @@ public:
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
     uint32_t target_window_id() const { return m_target_window_id; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_target_window_id); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_target_window_id);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_window_id);
+        Encoder::store(data, offset, m_target_window_id);
     }
 
 private:
@@ -364,15 +364,15 @@ public:
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
     LG::string title() const { return m_title; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_title); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_title);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_window_id);
+        Encoder::store(data, offset, m_title);
     }
 
 private:
@@ -395,15 +395,15 @@ public:
     int decoder_magic() const override { return 320; }
     int status() const { return m_status; }
     uint32_t menu_id() const { return m_menu_id; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_status) + Encoder::encoded_size(m_menu_id); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_status);
-        Encoder::append(buffer, m_menu_id);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_status);
+        Encoder::store(data, offset, m_menu_id);
     }
 
 private:
@@ -430,17 +430,17 @@ public:
     uint32_t menu_id() const { return m_menu_id; }
     int item_id() const { return m_item_id; }
     LG::string title() const { return m_title; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_menu_id) + Encoder::encoded_size(m_item_id) + Encoder::encoded_size(m_title); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_menu_id);
-        Encoder::append(buffer, m_item_id);
-        Encoder::append(buffer, m_title);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_window_id);
+        Encoder::store(data, offset, m_menu_id);
+        Encoder::store(data, offset, m_item_id);
+        Encoder::store(data, offset, m_title);
     }
 
 private:
@@ -463,14 +463,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
     int status() const { return m_status; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_status); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_status);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_status);
     }
 
 private:
@@ -478,6 +478,217 @@ private:
     int m_status;
 };
 
+class PresentMessage : public Message {
+public:
+    PresentMessage(message_key_t key, uint32_t window_id, int buffer_id, LG::Rect damage)
+        : m_key(key)
+        , m_window_id(window_id)
+        , m_buffer_id(buffer_id)
+        , m_damage(damage)
+    {
+    }
+    int id() const override { return 16; }
+    int reply_id() const override { return -1; }
+    int key() const override { return m_key; }
+    int decoder_magic() const override { return 320; }
+    uint32_t window_id() const { return m_window_id; }
+    int buffer_id() const { return m_buffer_id; }
+    LG::Rect damage() const { return m_damage; }
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_buffer_id) + Encoder::encoded_size(m_damage); }
+    void encode_to(uint8_t* data) const override
+    {
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_window_id);
+        Encoder::store(data, offset, m_buffer_id);
+        Encoder::store(data, offset, m_damage);
+    }
+
+private:
+    message_key_t m_key;
+    uint32_t m_window_id;
+    int m_buffer_id;
+    LG::Rect m_damage;
+};
+
+class GetImageMessage : public Message {
+public:
+    GetImageMessage(message_key_t key, LG::string path, uint32_t width, uint32_t height)
+        : m_key(key)
+        , m_path(path)
+        , m_width(width)
+        , m_height(height)
+    {
+    }
+    int id() const override { return 17; }
+    int reply_id() const override { return 18; }
+    int key() const override { return m_key; }
+    int decoder_magic() const override { return 320; }
+    LG::string path() const { return m_path; }
+    uint32_t width() const { return m_width; }
+    uint32_t height() const { return m_height; }
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_path) + Encoder::encoded_size(m_width) + Encoder::encoded_size(m_height); }
+    void encode_to(uint8_t* data) const override
+    {
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_path);
+        Encoder::store(data, offset, m_width);
+        Encoder::store(data, offset, m_height);
+    }
+
+private:
+    message_key_t m_key;
+    LG::string m_path;
+    uint32_t m_width;
+    uint32_t m_height;
+};
+
+class GetImageMessageReply : public Message {
+public:
+    GetImageMessageReply(message_key_t key, int buffer_id, uint32_t width, uint32_t height, int format)
+        : m_key(key)
+        , m_buffer_id(buffer_id)
+        , m_width(width)
+        , m_height(height)
+        , m_format(format)
+    {
+    }
+    int id() const override { return 18; }
+    int reply_id() const override { return -1; }
+    int key() const override { return m_key; }
+    int decoder_magic() const override { return 320; }
+    int buffer_id() const { return m_buffer_id; }
+    uint32_t width() const { return m_width; }
+    uint32_t height() const { return m_height; }
+    int format() const { return m_format; }
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_buffer_id) + Encoder::encoded_size(m_width) + Encoder::encoded_size(m_height) + Encoder::encoded_size(m_format); }
+    void encode_to(uint8_t* data) const override
+    {
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_buffer_id);
+        Encoder::store(data, offset, m_width);
+        Encoder::store(data, offset, m_height);
+        Encoder::store(data, offset, m_format);
+    }
+
+private:
+    message_key_t m_key;
+    int m_buffer_id;
+    uint32_t m_width;
+    uint32_t m_height;
+    int m_format;
+};
+
+class GetCompositorStatsMessage : public Message {
+public:
+    GetCompositorStatsMessage(message_key_t key, int overlay)
+        : m_key(key)
+        , m_overlay(overlay)
+    {
+    }
+    int id() const override { return 19; }
+    int reply_id() const override { return 20; }
+    int key() const override { return m_key; }
+    int decoder_magic() const override { return 320; }
+    int overlay() const { return m_overlay; }
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_overlay); }
+    void encode_to(uint8_t* data) const override
+    {
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_overlay);
+    }
+
+private:
+    message_key_t m_key;
+    int m_overlay;
+};
+
+class GetCompositorStatsMessageReply : public Message {
+public:
+    GetCompositorStatsMessageReply(message_key_t key, uint32_t frames, uint32_t frames_skipped, uint32_t pixels_damaged, uint32_t pixels_painted, uint32_t pixels_copied, uint32_t back_copy_us, uint32_t move_copy_us, uint32_t wallpaper_us, uint32_t windows_us, uint32_t popup_us, uint32_t menu_bar_us, uint32_t cursor_us, uint32_t swap_us)
+        : m_key(key)
+        , m_frames(frames)
+        , m_frames_skipped(frames_skipped)
+        , m_pixels_damaged(pixels_damaged)
+        , m_pixels_painted(pixels_painted)
+        , m_pixels_copied(pixels_copied)
+        , m_back_copy_us(back_copy_us)
+        , m_move_copy_us(move_copy_us)
+        , m_wallpaper_us(wallpaper_us)
+        , m_windows_us(windows_us)
+        , m_popup_us(popup_us)
+        , m_menu_bar_us(menu_bar_us)
+        , m_cursor_us(cursor_us)
+        , m_swap_us(swap_us)
+    {
+    }
+    int id() const override { return 20; }
+    int reply_id() const override { return -1; }
+    int key() const override { return m_key; }
+    int decoder_magic() const override { return 320; }
+    uint32_t frames() const { return m_frames; }
+    uint32_t frames_skipped() const { return m_frames_skipped; }
+    uint32_t pixels_damaged() const { return m_pixels_damaged; }
+    uint32_t pixels_painted() const { return m_pixels_painted; }
+    uint32_t pixels_copied() const { return m_pixels_copied; }
+    uint32_t back_copy_us() const { return m_back_copy_us; }
+    uint32_t move_copy_us() const { return m_move_copy_us; }
+    uint32_t wallpaper_us() const { return m_wallpaper_us; }
+    uint32_t windows_us() const { return m_windows_us; }
+    uint32_t popup_us() const { return m_popup_us; }
+    uint32_t menu_bar_us() const { return m_menu_bar_us; }
+    uint32_t cursor_us() const { return m_cursor_us; }
+    uint32_t swap_us() const { return m_swap_us; }
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_frames) + Encoder::encoded_size(m_frames_skipped) + Encoder::encoded_size(m_pixels_damaged) + Encoder::encoded_size(m_pixels_painted) + Encoder::encoded_size(m_pixels_copied) + Encoder::encoded_size(m_back_copy_us) + Encoder::encoded_size(m_move_copy_us) + Encoder::encoded_size(m_wallpaper_us) + Encoder::encoded_size(m_windows_us) + Encoder::encoded_size(m_popup_us) + Encoder::encoded_size(m_menu_bar_us) + Encoder::encoded_size(m_cursor_us) + Encoder::encoded_size(m_swap_us); }
+    void encode_to(uint8_t* data) const override
+    {
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_frames);
+        Encoder::store(data, offset, m_frames_skipped);
+        Encoder::store(data, offset, m_pixels_damaged);
+        Encoder::store(data, offset, m_pixels_painted);
+        Encoder::store(data, offset, m_pixels_copied);
+        Encoder::store(data, offset, m_back_copy_us);
+        Encoder::store(data, offset, m_move_copy_us);
+        Encoder::store(data, offset, m_wallpaper_us);
+        Encoder::store(data, offset, m_windows_us);
+        Encoder::store(data, offset, m_popup_us);
+        Encoder::store(data, offset, m_menu_bar_us);
+        Encoder::store(data, offset, m_cursor_us);
+        Encoder::store(data, offset, m_swap_us);
+    }
+
+private:
+    message_key_t m_key;
+    uint32_t m_frames;
+    uint32_t m_frames_skipped;
+    uint32_t m_pixels_damaged;
+    uint32_t m_pixels_painted;
+    uint32_t m_pixels_copied;
+    uint32_t m_back_copy_us;
+    uint32_t m_move_copy_us;
+    uint32_t m_wallpaper_us;
+    uint32_t m_windows_us;
+    uint32_t m_popup_us;
+    uint32_t m_menu_bar_us;
+    uint32_t m_cursor_us;
+    uint32_t m_swap_us;
+};
+
 class BaseWindowServerDecoder : public MessageDecoder {
 public:
     BaseWindowServerDecoder() { }
@@ -512,6 +723,22 @@ public:
         uint32_t var_target_window_id;
         uint32_t var_menu_id;
         int var_item_id;
+        LG::Rect var_damage;
+        LG::string var_path;
+        int var_overlay;
+        uint32_t var_frames;
+        uint32_t var_frames_skipped;
+        uint32_t var_pixels_damaged;
+        uint32_t var_pixels_painted;
+        uint32_t var_pixels_copied;
+        uint32_t var_back_copy_us;
+        uint32_t var_move_copy_us;
+        uint32_t var_wallpaper_us;
+        uint32_t var_windows_us;
+        uint32_t var_popup_us;
+        uint32_t var_menu_bar_us;
+        uint32_t var_cursor_us;
+        uint32_t var_swap_us;
 
         switch (msg_id) {
         case 1:
@@ -575,12 +802,158 @@ public:
         case 15:
             Encoder::decode(buf, decoded_msg_len, var_status);
             return new MenuBarCreateItemMessageReply(secret_key, var_status);
+        case 16:
+            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_buffer_id);
+            Encoder::decode(buf, decoded_msg_len, var_damage);
+            return new PresentMessage(secret_key, var_window_id, var_buffer_id, var_damage);
+        case 17:
+            Encoder::decode(buf, decoded_msg_len, var_path);
+            Encoder::decode(buf, decoded_msg_len, var_width);
+            Encoder::decode(buf, decoded_msg_len, var_height);
+            return new GetImageMessage(secret_key, var_path, var_width, var_height);
+        case 18:
+            Encoder::decode(buf, decoded_msg_len, var_buffer_id);
+            Encoder::decode(buf, decoded_msg_len, var_width);
+            Encoder::decode(buf, decoded_msg_len, var_height);
+            Encoder::decode(buf, decoded_msg_len, var_format);
+            return new GetImageMessageReply(secret_key, var_buffer_id, var_width, var_height, var_format);
+        case 19:
+            Encoder::decode(buf, decoded_msg_len, var_overlay);
+            return new GetCompositorStatsMessage(secret_key, var_overlay);
+        case 20:
+            Encoder::decode(buf, decoded_msg_len, var_frames);
+            Encoder::decode(buf, decoded_msg_len, var_frames_skipped);
+            Encoder::decode(buf, decoded_msg_len, var_pixels_damaged);
+            Encoder::decode(buf, decoded_msg_len, var_pixels_painted);
+            Encoder::decode(buf, decoded_msg_len, var_pixels_copied);
+            Encoder::decode(buf, decoded_msg_len, var_back_copy_us);
+            Encoder::decode(buf, decoded_msg_len, var_move_copy_us);
+            Encoder::decode(buf, decoded_msg_len, var_wallpaper_us);
+            Encoder::decode(buf, decoded_msg_len, var_windows_us);
+            Encoder::decode(buf, decoded_msg_len, var_popup_us);
+            Encoder::decode(buf, decoded_msg_len, var_menu_bar_us);
+            Encoder::decode(buf, decoded_msg_len, var_cursor_us);
+            Encoder::decode(buf, decoded_msg_len, var_swap_us);
+            return new GetCompositorStatsMessageReply(secret_key, var_frames, var_frames_skipped, var_pixels_damaged, var_pixels_painted, var_pixels_copied, var_back_copy_us, var_move_copy_us, var_wallpaper_us, var_windows_us, var_popup_us, var_menu_bar_us, var_cursor_us, var_swap_us);
         default:
             decoded_msg_len = saved_dml;
             return nullptr;
         }
     }
 
+    // Decodes the message into a temporary and handles it, the message
+    // itself is not allocated.
+    std::unique_ptr<Message> dispatch(const char* buf, size_t size) override
+    {
+        int msg_id, decoder_magic;
+        size_t decoded_msg_len = 0;
+        Encoder::decode(buf, decoded_msg_len, decoder_magic);
+        Encoder::decode(buf, decoded_msg_len, msg_id);
+        if (magic() != decoder_magic) {
+            return nullptr;
+        }
+        message_key_t secret_key;
+        Encoder::decode(buf, decoded_msg_len, secret_key);
+
+        uint32_t var_connection_id;
+        int var_type;
+        uint32_t var_width;
+        uint32_t var_height;
+        int var_buffer_id;
+        LG::string var_icon_path;
+        uint32_t var_window_id;
+        uint32_t var_status;
+        int var_format;
+        LG::Rect var_bounds;
+        uint32_t var_color;
+        int var_text_style;
+        LG::string var_title;
+        LG::Rect var_rect;
+        uint32_t var_target_window_id;
+        uint32_t var_menu_id;
+        int var_item_id;
+        LG::Rect var_damage;
+        LG::string var_path;
+        int var_overlay;
+        uint32_t var_frames;
+        uint32_t var_frames_skipped;
+        uint32_t var_pixels_damaged;
+        uint32_t var_pixels_painted;
+        uint32_t var_pixels_copied;
+        uint32_t var_back_copy_us;
+        uint32_t var_move_copy_us;
+        uint32_t var_wallpaper_us;
+        uint32_t var_windows_us;
+        uint32_t var_popup_us;
+        uint32_t var_menu_bar_us;
+        uint32_t var_cursor_us;
+        uint32_t var_swap_us;
+
+        switch (msg_id) {
+        case 1:
+            return handle(GreetMessage(secret_key));
+        case 3:
+            Encoder::decode(buf, decoded_msg_len, var_type);
+            Encoder::decode(buf, decoded_msg_len, var_width);
+            Encoder::decode(buf, decoded_msg_len, var_height);
+            Encoder::decode(buf, decoded_msg_len, var_buffer_id);
+            Encoder::decode(buf, decoded_msg_len, var_icon_path);
+            return handle(CreateWindowMessage(secret_key, var_type, var_width, var_height, var_buffer_id, var_icon_path));
+        case 5:
+            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            return handle(DestroyWindowMessage(secret_key, var_window_id));
+        case 7:
+            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_buffer_id);
+            Encoder::decode(buf, decoded_msg_len, var_format);
+            Encoder::decode(buf, decoded_msg_len, var_bounds);
+            return handle(SetBufferMessage(secret_key, var_window_id, var_buffer_id, var_format, var_bounds));
+        case 8:
+            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_color);
+            Encoder::decode(buf, decoded_msg_len, var_text_style);
+            return handle(SetBarStyleMessage(secret_key, var_window_id, var_color, var_text_style));
+        case 9:
+            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_title);
+            return handle(SetTitleMessage(secret_key, var_window_id, var_title));
+        case 10:
+            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_rect);
+            return handle(InvalidateMessage(secret_key, var_window_id, var_rect));
+        case 11:
+            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_target_window_id);
+            return handle(AskBringToFrontMessage(secret_key, var_window_id, var_target_window_id));
+        case 12:
+            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_title);
+            return handle(MenuBarCreateMenuMessage(secret_key, var_window_id, var_title));
+        case 14:
+            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_menu_id);
+            Encoder::decode(buf, decoded_msg_len, var_item_id);
+            Encoder::decode(buf, decoded_msg_len, var_title);
+            return handle(MenuBarCreateItemMessage(secret_key, var_window_id, var_menu_id, var_item_id, var_title));
+        case 16:
+            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_buffer_id);
+            Encoder::decode(buf, decoded_msg_len, var_damage);
+            return handle(PresentMessage(secret_key, var_window_id, var_buffer_id, var_damage));
+        case 17:
+            Encoder::decode(buf, decoded_msg_len, var_path);
+            Encoder::decode(buf, decoded_msg_len, var_width);
+            Encoder::decode(buf, decoded_msg_len, var_height);
+            return handle(GetImageMessage(secret_key, var_path, var_width, var_height));
+        case 19:
+            Encoder::decode(buf, decoded_msg_len, var_overlay);
+            return handle(GetCompositorStatsMessage(secret_key, var_overlay));
+        default:
+            return nullptr;
+        }
+    }
+
     std::unique_ptr<Message> handle(const Message& msg) override
     {
         if (magic() != msg.decoder_magic()) {
@@ -608,6 +981,12 @@ public:
             return handle(static_cast<const MenuBarCreateMenuMessage&>(msg));
         case 14:
             return handle(static_cast<const MenuBarCreateItemMessage&>(msg));
+        case 16:
+            return handle(static_cast<const PresentMessage&>(msg));
+        case 17:
+            return handle(static_cast<const GetImageMessage&>(msg));
+        case 19:
+            return handle(static_cast<const GetCompositorStatsMessage&>(msg));
         default:
             return nullptr;
         }
@@ -623,6 +1002,9 @@ public:
     virtual std::unique_ptr<Message> handle(const AskBringToFrontMessage& msg) { return nullptr; }
     virtual std::unique_ptr<Message> handle(const MenuBarCreateMenuMessage& msg) { return nullptr; }
     virtual std::unique_ptr<Message> handle(const MenuBarCreateItemMessage& msg) { return nullptr; }
+    virtual std::unique_ptr<Message> handle(const PresentMessage& msg) { return nullptr; }
+    virtual std::unique_ptr<Message> handle(const GetImageMessage& msg) { return nullptr; }
+    virtual std::unique_ptr<Message> handle(const GetCompositorStatsMessage& msg) { return nullptr; }
 };
 
 class MouseMoveMessage : public Message {
@@ -641,16 +1023,16 @@ public:
     int win_id() const { return m_win_id; }
     uint32_t x() const { return m_x; }
     uint32_t y() const { return m_y; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_x) + Encoder::encoded_size(m_y); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_x);
-        Encoder::append(buffer, m_y);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+        Encoder::store(data, offset, m_x);
+        Encoder::store(data, offset, m_y);
     }
 
 private:
@@ -678,17 +1060,17 @@ public:
     int type() const { return m_type; }
     uint32_t x() const { return m_x; }
     uint32_t y() const { return m_y; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_type) + Encoder::encoded_size(m_x) + Encoder::encoded_size(m_y); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_type);
-        Encoder::append(buffer, m_x);
-        Encoder::append(buffer, m_y);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+        Encoder::store(data, offset, m_type);
+        Encoder::store(data, offset, m_x);
+        Encoder::store(data, offset, m_y);
     }
 
 private:
@@ -715,16 +1097,16 @@ public:
     int win_id() const { return m_win_id; }
     uint32_t x() const { return m_x; }
     uint32_t y() const { return m_y; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_x) + Encoder::encoded_size(m_y); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_x);
-        Encoder::append(buffer, m_y);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+        Encoder::store(data, offset, m_x);
+        Encoder::store(data, offset, m_y);
     }
 
 private:
@@ -752,17 +1134,17 @@ public:
     int wheel_data() const { return m_wheel_data; }
     uint32_t x() const { return m_x; }
     uint32_t y() const { return m_y; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_wheel_data) + Encoder::encoded_size(m_x) + Encoder::encoded_size(m_y); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_wheel_data);
-        Encoder::append(buffer, m_x);
-        Encoder::append(buffer, m_y);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+        Encoder::store(data, offset, m_wheel_data);
+        Encoder::store(data, offset, m_x);
+        Encoder::store(data, offset, m_y);
     }
 
 private:
@@ -787,15 +1169,15 @@ public:
     int decoder_magic() const override { return 737; }
     int win_id() const { return m_win_id; }
     uint32_t kbd_key() const { return m_kbd_key; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_kbd_key); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_kbd_key);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+        Encoder::store(data, offset, m_kbd_key);
     }
 
 private:
@@ -816,14 +1198,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 737; }
     LG::Rect rect() const { return m_rect; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_rect); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_rect);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_rect);
     }
 
 private:
@@ -843,14 +1225,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 737; }
     int win_id() const { return m_win_id; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
     }
 
 private:
@@ -872,15 +1254,15 @@ public:
     int decoder_magic() const override { return 737; }
     int win_id() const { return m_win_id; }
     LG::Rect rect() const { return m_rect; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_rect); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_rect);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+        Encoder::store(data, offset, m_rect);
     }
 
 private:
@@ -901,14 +1283,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 737; }
     int reason() const { return m_reason; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_reason); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_reason);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_reason);
     }
 
 private:
@@ -930,15 +1312,15 @@ public:
     int decoder_magic() const override { return 737; }
     int win_id() const { return m_win_id; }
     int item_id() const { return m_item_id; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_item_id); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_item_id);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+        Encoder::store(data, offset, m_item_id);
     }
 
 private:
@@ -963,16 +1345,16 @@ public:
     int win_id() const { return m_win_id; }
     int changed_window_id() const { return m_changed_window_id; }
     int type() const { return m_type; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_changed_window_id) + Encoder::encoded_size(m_type); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_changed_window_id);
-        Encoder::append(buffer, m_type);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+        Encoder::store(data, offset, m_changed_window_id);
+        Encoder::store(data, offset, m_type);
     }
 
 private:
@@ -998,16 +1380,16 @@ public:
     int win_id() const { return m_win_id; }
     int changed_window_id() const { return m_changed_window_id; }
     LG::string icon_path() const { return m_icon_path; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_changed_window_id) + Encoder::encoded_size(m_icon_path); }
+    void encode_to(uint8_t* data) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_changed_window_id);
-        Encoder::append(buffer, m_icon_path);
-        return buffer;
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+        Encoder::store(data, offset, m_changed_window_id);
+        Encoder::store(data, offset, m_icon_path);
     }
 
 private:
@@ -1017,6 +1399,64 @@ private:
     LG::string m_icon_path;
 };
 
+class BufferReleasedMessage : public Message {
+public:
+    BufferReleasedMessage(message_key_t key, int win_id, int buffer_id)
+        : m_key(key)
+        , m_win_id(win_id)
+        , m_buffer_id(buffer_id)
+    {
+    }
+    int id() const override { return 13; }
+    int reply_id() const override { return -1; }
+    int key() const override { return m_key; }
+    int decoder_magic() const override { return 737; }
+    int win_id() const { return m_win_id; }
+    int buffer_id() const { return m_buffer_id; }
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_buffer_id); }
+    void encode_to(uint8_t* data) const override
+    {
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+        Encoder::store(data, offset, m_buffer_id);
+    }
+
+private:
+    message_key_t m_key;
+    int m_win_id;
+    int m_buffer_id;
+};
+
+class FrameDoneMessage : public Message {
+public:
+    FrameDoneMessage(message_key_t key, int win_id)
+        : m_key(key)
+        , m_win_id(win_id)
+    {
+    }
+    int id() const override { return 14; }
+    int reply_id() const override { return -1; }
+    int key() const override { return m_key; }
+    int decoder_magic() const override { return 737; }
+    int win_id() const { return m_win_id; }
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id); }
+    void encode_to(uint8_t* data) const override
+    {
+        size_t offset = 0;
+        Encoder::store(data, offset, decoder_magic());
+        Encoder::store(data, offset, id());
+        Encoder::store(data, offset, key());
+        Encoder::store(data, offset, m_win_id);
+    }
+
+private:
+    message_key_t m_key;
+    int m_win_id;
+};
+
 class BaseWindowClientDecoder : public MessageDecoder {
 public:
     BaseWindowClientDecoder() { }
@@ -1045,6 +1485,7 @@ public:
         int var_item_id;
         int var_changed_window_id;
         LG::string var_icon_path;
+        int var_buffer_id;
 
         switch (msg_id) {
         case 1:
@@ -1100,12 +1541,112 @@ public:
             Encoder::decode(buf, decoded_msg_len, var_changed_window_id);
             Encoder::decode(buf, decoded_msg_len, var_icon_path);
             return new NotifyWindowIconChangedMessage(secret_key, var_win_id, var_changed_window_id, var_icon_path);
+        case 13:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_buffer_id);
+            return new BufferReleasedMessage(secret_key, var_win_id, var_buffer_id);
+        case 14:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            return new FrameDoneMessage(secret_key, var_win_id);
         default:
             decoded_msg_len = saved_dml;
             return nullptr;
         }
     }
 
+    // Decodes the message into a temporary and handles it, the message
+    // itself is not allocated.
+    std::unique_ptr<Message> dispatch(const char* buf, size_t size) override
+    {
+        int msg_id, decoder_magic;
+        size_t decoded_msg_len = 0;
+        Encoder::decode(buf, decoded_msg_len, decoder_magic);
+        Encoder::decode(buf, decoded_msg_len, msg_id);
+        if (magic() != decoder_magic) {
+            return nullptr;
+        }
+        message_key_t secret_key;
+        Encoder::decode(buf, decoded_msg_len, secret_key);
+
+        int var_win_id;
+        uint32_t var_x;
+        uint32_t var_y;
+        int var_type;
+        int var_wheel_data;
+        uint32_t var_kbd_key;
+        LG::Rect var_rect;
+        int var_reason;
+        int var_item_id;
+        int var_changed_window_id;
+        LG::string var_icon_path;
+        int var_buffer_id;
+
+        switch (msg_id) {
+        case 1:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_x);
+            Encoder::decode(buf, decoded_msg_len, var_y);
+            return handle(MouseMoveMessage(secret_key, var_win_id, var_x, var_y));
+        case 2:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_type);
+            Encoder::decode(buf, decoded_msg_len, var_x);
+            Encoder::decode(buf, decoded_msg_len, var_y);
+            return handle(MouseActionMessage(secret_key, var_win_id, var_type, var_x, var_y));
+        case 3:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_x);
+            Encoder::decode(buf, decoded_msg_len, var_y);
+            return handle(MouseLeaveMessage(secret_key, var_win_id, var_x, var_y));
+        case 4:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_wheel_data);
+            Encoder::decode(buf, decoded_msg_len, var_x);
+            Encoder::decode(buf, decoded_msg_len, var_y);
+            return handle(MouseWheelMessage(secret_key, var_win_id, var_wheel_data, var_x, var_y));
+        case 5:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_kbd_key);
+            return handle(KeyboardMessage(secret_key, var_win_id, var_kbd_key));
+        case 6:
+            Encoder::decode(buf, decoded_msg_len, var_rect);
+            return handle(DisplayMessage(secret_key, var_rect));
+        case 7:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            return handle(WindowCloseRequestMessage(secret_key, var_win_id));
+        case 8:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_rect);
+            return handle(ResizeMessage(secret_key, var_win_id, var_rect));
+        case 9:
+            Encoder::decode(buf, decoded_msg_len, var_reason);
+            return handle(DisconnectMessage(secret_key, var_reason));
+        case 10:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_item_id);
+            return handle(MenuBarActionMessage(secret_key, var_win_id, var_item_id));
+        case 11:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_changed_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_type);
+            return handle(NotifyWindowStatusChangedMessage(secret_key, var_win_id, var_changed_window_id, var_type));
+        case 12:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_changed_window_id);
+            Encoder::decode(buf, decoded_msg_len, var_icon_path);
+            return handle(NotifyWindowIconChangedMessage(secret_key, var_win_id, var_changed_window_id, var_icon_path));
+        case 13:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, decoded_msg_len, var_buffer_id);
+            return handle(BufferReleasedMessage(secret_key, var_win_id, var_buffer_id));
+        case 14:
+            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            return handle(FrameDoneMessage(secret_key, var_win_id));
+        default:
+            return nullptr;
+        }
+    }
+
     std::unique_ptr<Message> handle(const Message& msg) override
     {
         if (magic() != msg.decoder_magic()) {
@@ -1137,6 +1678,10 @@ public:
             return handle(static_cast<const NotifyWindowStatusChangedMessage&>(msg));
         case 12:
             return handle(static_cast<const NotifyWindowIconChangedMessage&>(msg));
+        case 13:
+            return handle(static_cast<const BufferReleasedMessage&>(msg));
+        case 14:
+            return handle(static_cast<const FrameDoneMessage&>(msg));
         default:
             return nullptr;
         }
@@ -1154,4 +1699,6 @@ public:
     virtual std::unique_ptr<Message> handle(const MenuBarActionMessage& msg) { return nullptr; }
     virtual std::unique_ptr<Message> handle(const NotifyWindowStatusChangedMessage& msg) { return nullptr; }
     virtual std::unique_ptr<Message> handle(const NotifyWindowIconChangedMessage& msg) { return nullptr; }
+    virtual std::unique_ptr<Message> handle(const BufferReleasedMessage& msg) { return nullptr; }
+    virtual std::unique_ptr<Message> handle(const FrameDoneMessage& msg) { return nullptr; }
 };
@@ -14,28 +14,121 @@ BaseWindow::BaseWindow(int connection_id, int id, const CreateWindowMessage& msg
     : m_id(id)
     , m_connection_id(connection_id)
     , m_type((WindowType)msg.type())
-    , m_buffer(msg.buffer_id())
     , m_content_bitmap()
     , m_bounds(0, 0, 0, 0)
     , m_content_bounds(0, 0, 0, 0)
 {
+    m_buffers[0].open(msg.buffer_id());
 }
 
 BaseWindow::BaseWindow(BaseWindow&& win)
     : m_id(win.m_id)
     , m_connection_id(win.m_connection_id)
-    , m_buffer(win.m_buffer)
     , m_content_bitmap(std::move(win.m_content_bitmap))
     , m_bounds(win.m_bounds)
     , m_content_bounds(win.m_content_bounds)
+    , m_displayed(win.m_displayed)
+    , m_pending(win.m_pending)
 {
+    for (int i = 0; i < SurfaceCount; i++) {
+        m_buffers[i] = win.m_buffers[i];
+    }
+}
+
+int BaseWindow::surface_of(int buffer_id)
+{
+    int free_surface = -1;
+    for (int i = 0; i < SurfaceCount; i++) {
+        if (m_buffers[i].alive() && m_buffers[i].id() == buffer_id) {
+            return i;
+        }
+        if (!m_buffers[i].alive() && free_surface < 0) {
+            free_surface = i;
+        }
+    }
+
+    if (free_surface < 0) {
+        return -1;
+    }
+    m_buffers[free_surface].open(buffer_id);
+    return m_buffers[free_surface].alive() ? free_surface : -1;
+}
+
+void BaseWindow::release_buffer(int surface)
+{
+    BufferReleasedMessage msg(connection_id(), id(), m_buffers[surface].id());
+    Connection::the().send_async_message(msg);
 }
 
 void BaseWindow::set_buffer(int buffer_id, LG::Size sz, LG::PixelBitmapFormat fmt)
 {
-    m_buffer.open(buffer_id);
-    m_content_bitmap = LG::PixelBitmap(m_buffer.data(), sz.width(), sz.height());
+    // Resized buffers keep their ids and are got again to map new pages.
+    // The client resizes all its buffers at once and forgets what it has
+    // presented, so the pending one is dropped without a release.
+    for (int i = 0; i < SurfaceCount; i++) {
+        if (m_buffers[i].alive()) {
+            m_buffers[i].open(m_buffers[i].id());
+        }
+    }
+    m_pending = -1;
+
+    int surface = surface_of(buffer_id);
+    if (surface < 0) {
+        return;
+    }
+    m_displayed = surface;
+    m_content_bitmap = LG::PixelBitmap(m_buffers[m_displayed].data(), sz.width(), sz.height());
     m_content_bitmap.set_format(fmt);
 }
 
+// Mailbox semantics: only the latest presented buffer waits to be shown,
+// a buffer it replaces goes back to the client at once.
+bool BaseWindow::present(int buffer_id)
+{
+    int surface = surface_of(buffer_id);
+    if (surface < 0) {
+        return false;
+    }
+
+    if (m_pending >= 0 && m_pending != surface && m_pending != m_displayed) {
+        release_buffer(m_pending);
+    }
+    m_pending = surface;
+    m_frame_requested = true;
+    return true;
+}
+
+void BaseWindow::latch_pending_buffer()
+{
+    if (m_pending < 0) {
+        return;
+    }
+
+    int prev_displayed = m_displayed;
+    m_displayed = m_pending;
+    m_pending = -1;
+    m_content_bitmap.set_data(m_buffers[m_displayed].data());
+    if (prev_displayed != m_displayed) {
+        release_buffer(prev_displayed);
+    }
+}
+
+void BaseWindow::send_frame_done()
+{
+    if (!m_frame_requested) {
+        return;
+    }
+
+    m_frame_requested = false;
+    FrameDoneMessage msg(connection_id(), id());
+    Connection::the().send_async_message(msg);
+}
+
+void BaseWindow::free_buffers()
+{
+    for (int i = 0; i < SurfaceCount; i++) {
+        m_buffers[i].free();
+    }
+}
+
 } // namespace WinServer
\ No newline at end of file
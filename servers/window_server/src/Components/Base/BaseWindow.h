@@ -30,7 +30,13 @@ public:
     BaseWindow(BaseWindow&& win);
     ~BaseWindow() = default;
 
+    static constexpr int SurfaceCount = 3;
+
     void set_buffer(int buffer_id, LG::Size sz, LG::PixelBitmapFormat fmt);
+    bool present(int buffer_id);
+    void latch_pending_buffer();
+    void send_frame_done();
+    void free_buffers();
 
     inline int id() const { return m_id; }
     inline int connection_id() const { return m_connection_id; }
@@ -38,7 +44,7 @@ public:
     inline WindowEventMask event_mask() const { return m_event_mask; }
     inline void set_event_mask(WindowEventMask mask) { m_event_mask = mask; }
 
-    inline LFoundation::SharedBuffer<LG::Color>& buffer() { return m_buffer; }
+    inline LFoundation::SharedBuffer<LG::Color>& buffer() { return m_buffers[m_displayed]; }
     inline LG::PixelBitmap& content_bitmap() { return m_content_bitmap; }
     inline const LG::PixelBitmap& content_bitmap() const { return m_content_bitmap; }
 
@@ -66,6 +72,10 @@ public:
     virtual void did_size_change(const LG::Size& size) { }
 
 protected:
+    int surface_of(int buffer_id);
+    void release_buffer(int surface);
+
+
     int m_id { -1 };
     int m_connection_id { -1 };
     bool m_visible { true };
@@ -74,7 +84,13 @@ protected:
     LG::Rect m_bounds;
     LG::Rect m_content_bounds;
     LG::PixelBitmap m_content_bitmap;
-    LFoundation::SharedBuffer<LG::Color> m_buffer;
+    // The client draws into one buffer while we show another, the third
+    // one may wait to be shown on the next refresh.
+    LFoundation::SharedBuffer<LG::Color> m_buffers[SurfaceCount];
+    int m_displayed { 0 };
+    int m_pending { -1 };
+    // The client waits for FrameDoneMessage before it draws again.
+    bool m_frame_requested { false };
 };
 
 } // namespace WinServer
\ No newline at end of file
@@ -16,23 +16,12 @@ namespace Helpers {
 
     [[gnu::always_inline]] inline static size_t text_width(const std::string& text, const LG::Font& f)
     {
-        size_t width = 0;
-        const size_t letter_spacing = f.glyph_spacing();
-
-        for (int i = 0; i < text.size(); i++) {
-            width += f.glyph_width(text[i]) + letter_spacing;
-        }
-        return width;
+        return f.text_width(text.c_str(), text.size());
     }
 
     [[gnu::always_inline]] inline static void draw_text(LG::Context& ctx, LG::Point<int> pt, const std::string& text, const LG::Font& f)
     {
-        const size_t letter_spacing = f.glyph_spacing();
-
-        for (int i = 0; i < text.size(); i++) {
-            ctx.draw(pt, f.glyph_bitmap(text[i]));
-            pt.offset_by(f.glyph_width(text[i]) + letter_spacing, 0);
-        }
+        ctx.draw_text(pt, f, text.c_str(), text.size());
     }
 
 } // namespace Helpers
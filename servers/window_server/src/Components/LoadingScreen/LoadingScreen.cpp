@@ -28,6 +28,7 @@ LoadingScreen::LoadingScreen()
 
     LG::Context ctx(m_screen.display_bitmap());
     ctx.draw({ content_min_x, content_min_y }, m_logo);
+    m_screen.flush(LG::Rect(content_min_x, content_min_y, m_logo.bounds().width(), m_logo.bounds().height()));
 }
 
 void LoadingScreen::display_status_bar(int progress, int out_of)
@@ -40,6 +41,7 @@ void LoadingScreen::display_status_bar(int progress, int out_of)
 
     ctx.set_fill_color(LG::Color::White);
     ctx.fill_rounded(LG::Rect(m_progress_line_min_x, m_progress_line_min_y, widthp, progress_line_height()), LG::CornerMask(4));
+    m_screen.flush(LG::Rect(m_progress_line_min_x, m_progress_line_min_y, progress_line_width(), progress_line_height()));
 }
 
 } // namespace WinServer
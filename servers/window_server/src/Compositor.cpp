@@ -16,6 +16,9 @@
 #include <libfoundation/EventLoop.h>
 #include <libfoundation/Memory.h>
 #include <libg/Context.h>
+#include <libg/Font.h>
+#include <stdio.h>
+#include <string.h>
 
 namespace WinServer {
 
@@ -32,15 +35,30 @@ Compositor::Compositor()
 {
     s_WinServer_Compositor_the = this;
     invalidate(Screen::the().bounds());
+}
+
+// A frame is drawn only if there is damage, and at the next vblank, so the
+// server doesn't wake up while the screen stays the same. Damage which comes
+// before the frame is drawn goes into it.
+void Compositor::schedule_frame()
+{
+    int delay = Screen::the().ms_to_next_vblank();
+    if (delay < 0) {
+        delay = 1000 / 60;
+    }
+
+    m_frame_scheduled = true;
+    m_frame_deadline_us = CompositorStats::now_us() + delay * 1000;
     LFoundation::EventLoop::the().add(LFoundation::Timer([] {
         Compositor::the().refresh();
     },
-        1000 / 60, LFoundation::Timer::Repeat));
+        delay));
 }
 
-void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& areas)
+void Compositor::copy_changes_to_second_buffer(const LG::Region& region)
 {
     auto& screen = Screen::the();
+    auto& areas = region.rects();
 
     for (int i = 0; i < areas.size(); i++) {
         auto bounds = areas[i].intersection(screen.bounds());
@@ -48,22 +66,285 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
         auto* buf2_ptr = reinterpret_cast<uint32_t*>(&screen.write_bitmap()[bounds.min_y()][bounds.min_x()]);
         for (int j = 0; j < bounds.height(); j++) {
             LFoundation::fast_copy(buf2_ptr, buf1_ptr, bounds.width());
-            buf1_ptr += screen.width();
-            buf2_ptr += screen.width();
+            buf1_ptr += screen.display_bitmap().stride();
+            buf2_ptr += screen.write_bitmap().stride();
         }
     }
 }
 
-[[gnu::flatten]] void Compositor::refresh()
+// The front window if its opaque content covers the whole screen. Nothing
+// behind it is seen then, not even its own frame.
+const BaseWindow* Compositor::fullscreen_window() const
+{
+    auto& screen = Screen::the();
+    auto& windows = WindowManager::the().windows();
+    for (auto it = windows.begin(); it != windows.end(); it++) {
+        auto& window = *(*it);
+        if (!window.visible()) {
+            continue;
+        }
+#ifdef TARGET_DESKTOP
+        auto opaque_bounds = window.opaque_bounds();
+#elif TARGET_MOBILE
+        auto opaque_bounds = window.content_bounds();
+        if (window.content_bitmap().has_alpha_channel()) {
+            return nullptr;
+        }
+        opaque_bounds.set_width(std::min(opaque_bounds.width(), window.content_bitmap().width()));
+        opaque_bounds.set_height(std::min(opaque_bounds.height(), window.content_bitmap().height()));
+#endif // TARGET_DESKTOP
+        return opaque_bounds.contains(screen.bounds()) ? &window : nullptr;
+    }
+    return nullptr;
+}
+
+// The damage is copied row by row from the buffer of the client, without
+// clipping or blending. Overlays are drawn over it after as on any frame.
+void Compositor::scan_out_window(const BaseWindow& window, const LG::Region& invalidated_region)
 {
-    if (m_invalidated_areas.size() == 0) {
+    auto& screen = Screen::the();
+    auto& write_bitmap = screen.write_bitmap();
+    auto& content_bitmap = window.content_bitmap();
+    auto& content_bounds = window.content_bounds();
+    auto& areas = invalidated_region.rects();
+
+    for (int i = 0; i < areas.size(); i++) {
+        auto bounds = areas[i].intersection(screen.bounds());
+        if (bounds.empty()) {
+            continue;
+        }
+        auto* src_ptr = reinterpret_cast<const uint32_t*>(&content_bitmap[bounds.min_y() - content_bounds.min_y()][bounds.min_x() - content_bounds.min_x()]);
+        auto* dst_ptr = reinterpret_cast<uint32_t*>(&write_bitmap[bounds.min_y()][bounds.min_x()]);
+        for (int j = 0; j < bounds.height(); j++) {
+            LFoundation::fast_copy(dst_ptr, src_ptr, bounds.width());
+            src_ptr += content_bitmap.stride();
+            dst_ptr += write_bitmap.stride();
+        }
+    }
+}
+
+// Frames whose vblank passed while this one waited to be drawn were skipped.
+void Compositor::count_frame_skips()
+{
+    const uint64_t frame_us = 1000000 / 60;
+    uint64_t now = CompositorStats::now_us();
+    if (now > m_frame_deadline_us + frame_us) {
+        m_stats.frames_skipped += (now - m_frame_deadline_us) / frame_us;
+    }
+}
+
+// Every area drawn is counted, so pixels under translucent windows count
+// once for each layer.
+void Compositor::count_painted_pixels(const LG::Region& invalidated_region)
+{
+    auto& invalidated_areas = invalidated_region.rects();
+    uint32_t painted = 0;
+
+    auto count_covered = [&](const LG::Rect& bounds) {
+        for (int i = 0; i < invalidated_areas.size(); i++) {
+            if (invalidated_areas[i].intersects(bounds)) {
+                painted += CompositorStats::area(invalidated_areas[i].intersection(bounds));
+            }
+        }
+    };
+
+#ifdef TARGET_DESKTOP
+    painted += CompositorStats::area(m_wallpaper_region);
+    for (int i = 0; i < m_window_areas.size(); i++) {
+        painted += CompositorStats::area(m_window_areas[i]);
+    }
+#elif TARGET_MOBILE
+    auto& windows = WindowManager::the().windows();
+    if (windows.size() <= 1) {
+        painted += CompositorStats::area(invalidated_region);
+    }
+    if (windows.begin() != windows.end()) {
+        count_covered((*windows.begin())->bounds());
+    }
+#endif // TARGET_DESKTOP
+
+    if (m_popup.visible()) {
+        count_covered(m_popup.bounds());
+    }
+    count_covered(m_menu_bar.bounds());
+    if (!m_cursor_manager.hardware_cursor()) {
+        auto cursor_bounds = m_cursor_manager.current_cursor().bounds();
+        cursor_bounds.origin().set(m_cursor_manager.draw_position());
+        count_covered(cursor_bounds);
+    }
+    if (m_stats_overlay) {
+        count_covered(stats_overlay_bounds());
+    }
+    m_stats.pixels_painted = painted;
+}
+
+void Compositor::set_stats_overlay(bool enabled)
+{
+    if (m_stats_overlay != enabled) {
+        m_stats_overlay = enabled;
+        invalidate(stats_overlay_bounds());
+    }
+}
+
+LG::Rect Compositor::stats_overlay_bounds() const
+{
+    const int width = 240;
+    const int height = 60;
+    return LG::Rect(Screen::the().width() - width - 8, m_menu_bar.height() + 8, width, height);
+}
+
+// The frame being drawn is not measured yet, so the stats shown are of the
+// frame before.
+void Compositor::draw_stats_overlay(LG::Context& ctx, const CompositorStats& stats)
+{
+    auto& font = LG::Font::system_font();
+    auto bounds = stats_overlay_bounds();
+    auto& us = stats.phase_us;
+    char lines[4][64];
+    snprintf(lines[0], sizeof(lines[0]), "frames %u skipped %u", stats.frames, stats.frames_skipped);
+    snprintf(lines[1], sizeof(lines[1]), "px damaged %u painted %u copied %u", stats.pixels_damaged, stats.pixels_painted, stats.pixels_copied);
+    snprintf(lines[2], sizeof(lines[2]), "us copy %u move %u wall %u win %u", us[CompositorStats::BackCopy], us[CompositorStats::MoveCopy], us[CompositorStats::Wallpaper], us[CompositorStats::Windows]);
+    snprintf(lines[3], sizeof(lines[3]), "us popup %u menu %u cursor %u swap %u", us[CompositorStats::Popup], us[CompositorStats::MenuBar], us[CompositorStats::Cursor], us[CompositorStats::Swap]);
+
+    ctx.set_fill_color(LG::Color(0, 0, 0, 200));
+    ctx.fill(bounds);
+    ctx.set_fill_color(LG::Color::White);
+    for (int i = 0; i < 4; i++) {
+        ctx.draw_text({ bounds.min_x() + 6, bounds.min_y() + 4 + i * ((int)font.glyph_height() + 2) }, font, lines[i], strlen(lines[i]));
+    }
+}
+
+// Presented buffers are on screen now, their clients may draw the next frame.
+void Compositor::send_frame_callbacks()
+{
+    auto& windows = WindowManager::the().windows();
+    for (auto it = windows.begin(); it != windows.end(); it++) {
+        (*it)->send_frame_done();
+    }
+}
+
+#ifdef TARGET_DESKTOP
+// Walks windows front to back. Every window gets the damage which is not
+// covered by opaque windows in front of it, then its own opaque part is cut
+// out for the ones behind. Each pixel is drawn only by the windows which
+// are seen in it.
+void Compositor::cull_occluded_areas(const LG::Region& invalidated_region)
+{
+    auto& windows = WindowManager::the().windows();
+    m_window_areas.clear_remain_capacity();
+    m_window_area_starts.clear_remain_capacity();
+    m_wallpaper_region = invalidated_region;
+
+    for (auto it = windows.begin(); it != windows.end(); it++) {
+        auto& window = *(*it);
+        m_window_area_starts.push_back(m_window_areas.size());
+        if (!window.visible()) {
+            continue;
+        }
+
+        auto& uncovered_areas = m_wallpaper_region.rects();
+        for (int i = 0; i < uncovered_areas.size(); i++) {
+            if (uncovered_areas[i].intersects(window.bounds())) {
+                m_window_areas.push_back(uncovered_areas[i].intersection(window.bounds()));
+            }
+        }
+        m_wallpaper_region.subtract(window.opaque_bounds());
+    }
+    m_window_area_starts.push_back(m_window_areas.size());
+}
+
+void Compositor::window_did_move(Desktop::Window& window, const LG::Rect& old_bounds)
+{
+    // Only one window is moved by copying in a frame, others are drawn.
+    if (m_moved_window_id >= 0 && m_moved_window_id != window.id()) {
+        invalidate(old_bounds);
+        invalidate(window.bounds());
         return;
     }
 
+    if (m_moved_window_id < 0) {
+        m_moved_window_id = window.id();
+        m_moved_from_bounds = old_bounds;
+    }
+    request_frame();
+}
+
+// The opaque part of the moved window is copied within the write buffer
+// from where it was shown on the last frame. What was damaged since then,
+// or is covered by anything in front of the window, either there or at the
+// new place, is not taken as copied and is drawn again with the frame and
+// the area the window has left.
+void Compositor::copy_moved_window(LG::Region& invalidated_region, LG::Region& copied_region)
+{
     auto& screen = Screen::the();
     auto& wm = WindowManager::the();
-    auto invalidated_areas = std::move(m_invalidated_areas);
-    LG::Context ctx(screen.write_bitmap());
+    auto* window = wm.window(m_moved_window_id);
+    auto old_bounds = m_moved_from_bounds;
+    m_moved_window_id = -1;
+
+    if (!window) {
+        invalidated_region.unite(old_bounds);
+        return;
+    }
+
+    int dx = window->bounds().min_x() - old_bounds.min_x();
+    int dy = window->bounds().min_y() - old_bounds.min_y();
+    auto src = window->opaque_bounds();
+    src.offset_by(-dx, -dy);
+    src.intersect(screen.bounds());
+    src.intersect(LG::Rect(screen.bounds().min_x() - dx, screen.bounds().min_y() - dy, screen.width(), screen.height()));
+
+    if (window->visible() && (dx || dy) && !src.empty()) {
+        LG::Region occluders;
+        for (auto* front_window : wm.windows()) {
+            if (front_window == window) {
+                break;
+            }
+            if (front_window->visible()) {
+                occluders.unite(front_window->bounds());
+            }
+        }
+        occluders.unite(m_menu_bar.bounds());
+        if (m_popup.visible()) {
+            occluders.unite(m_popup.bounds());
+        }
+        if (!m_cursor_manager.hardware_cursor()) {
+            auto cursor_bounds = m_cursor_manager.current_cursor().bounds();
+            cursor_bounds.origin().set(m_cursor_manager.draw_position());
+            occluders.unite(cursor_bounds);
+        }
+
+        copied_region.unite(src);
+        copied_region.subtract(invalidated_region);
+        copied_region.subtract(occluders);
+        copied_region.offset_by(dx, dy);
+        copied_region.subtract(invalidated_region);
+        copied_region.subtract(occluders);
+
+        // Rows go against the move, so none is overwritten before it is
+        // copied. A row moved sideways may overlap itself.
+        auto& bitmap = screen.write_bitmap();
+        int first_row = dy > 0 ? src.max_y() : src.min_y();
+        int step = dy > 0 ? -1 : 1;
+        for (int i = 0, y = first_row; i < src.height(); i++, y += step) {
+            memmove(&bitmap[y + dy][src.min_x() + dx], &bitmap[y][src.min_x()], src.width() * sizeof(LG::Color));
+        }
+    }
+
+    invalidated_region.unite(old_bounds);
+    invalidated_region.unite(window->bounds());
+    invalidated_region.subtract(copied_region);
+}
+#endif // TARGET_DESKTOP
+
+// Draws the wallpaper and the windows in the invalidated region. It runs
+// on the compositor workers for tiles of the region at once, so it reads
+// only what refresh() has prepared and allocates nothing.
+void Compositor::compose_windows(LG::Context& ctx, const LG::Region& invalidated_region)
+{
+    auto& wm = WindowManager::the();
+    auto& windows = wm.windows();
+    auto& invalidated_areas = invalidated_region.rects();
 
     auto is_window_area_invalidated = [&](const std::vector<LG::Rect>& areas, const LG::Rect& area) -> bool {
         for (int i = 0; i < areas.size(); i++) {
@@ -74,6 +355,7 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
         return false;
     };
 
+    uint64_t started_at = CompositorStats::now_us();
     auto draw_wallpaper_for_area = [&](const LG::Rect& area) {
         ctx.add_clip(area);
         ctx.draw({ 0, 0 }, m_resource_manager.background());
@@ -81,11 +363,19 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
     };
 
 #ifdef TARGET_DESKTOP
+    // Until the client gives a buffer of the new size after a resize, the
+    // last buffer is clipped and what it doesn't cover is filled.
     auto draw_window = [&](Desktop::Window& window, const LG::Rect& area) {
         ctx.add_clip(area);
         ctx.add_clip(window.bounds());
         window.frame().draw(ctx);
-        ctx.draw_rounded(window.content_bounds().origin(), window.content_bitmap(), window.corner_mask());
+        auto& content_bounds = window.content_bounds();
+        auto& content_bitmap = window.content_bitmap();
+        if (content_bitmap.width() < content_bounds.width() || content_bitmap.height() < content_bounds.height()) {
+            ctx.set_fill_color(window.color());
+            ctx.fill(content_bounds);
+        }
+        ctx.draw_rounded(content_bounds.origin(), content_bitmap, window.corner_mask());
         ctx.reset_clip();
     };
 #elif TARGET_MOBILE
@@ -98,8 +388,9 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
 #endif // TARGET_DESKTOP
 
 #ifdef TARGET_DESKTOP
-    for (int i = 0; i < invalidated_areas.size(); i++) {
-        draw_wallpaper_for_area(invalidated_areas[i]);
+    auto& wallpaper_areas = m_wallpaper_region.rects();
+    for (int i = 0; i < wallpaper_areas.size(); i++) {
+        draw_wallpaper_for_area(wallpaper_areas[i]);
     }
 #elif TARGET_MOBILE
     // Draw wallpaper only in case when WM contains only homescreen app.
@@ -109,15 +400,16 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
         }
     }
 #endif // TARGET_DESKTOP
+    m_stats.end_phase(CompositorStats::Wallpaper, started_at);
 
-    auto& windows = wm.windows();
+    started_at = CompositorStats::now_us();
 #ifdef TARGET_DESKTOP
+    size_t window_index = m_window_area_starts.size() - 1;
     for (auto it = windows.rbegin(); it != windows.rend(); it++) {
         auto& window = *(*it);
-        if (window.visible() && is_window_area_invalidated(invalidated_areas, window.bounds())) {
-            for (int i = 0; i < invalidated_areas.size(); i++) {
-                draw_window(window, invalidated_areas[i]);
-            }
+        window_index--;
+        for (size_t i = m_window_area_starts[window_index]; i < m_window_area_starts[window_index + 1]; i++) {
+            draw_window(window, m_window_areas[i]);
         }
     }
 #elif TARGET_MOBILE
@@ -131,7 +423,112 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
         }
     }
 #endif // TARGET_DESKTOP
+    m_stats.end_phase(CompositorStats::Windows, started_at);
+}
+
+[[gnu::flatten]] void Compositor::refresh()
+{
+    m_frame_scheduled = false;
+    count_frame_skips();
+    auto& screen = Screen::the();
+    auto& wm = WindowManager::the();
+    auto& windows = wm.windows();
+    for (auto it = windows.begin(); it != windows.end(); it++) {
+        (*it)->latch_pending_buffer();
+    }
+
+#ifdef TARGET_DESKTOP
+    bool has_moved_window = m_moved_window_id >= 0;
+#else
+    bool has_moved_window = false;
+#endif // TARGET_DESKTOP
+    if (m_invalidated_region.empty() && !has_moved_window) {
+        send_frame_callbacks();
+        return;
+    }
+
+    auto last_stats = m_stats;
+    for (int i = 0; i < CompositorStats::PhaseCount; i++) {
+        m_stats.phase_us[i] = 0;
+    }
+    m_stats.frames++;
+    m_stats.pixels_damaged = CompositorStats::area(m_invalidated_region);
+
+    // The region keeps damage merged, so no pixel is drawn twice.
+    auto invalidated_region = std::move(m_invalidated_region);
+
+    // A window which covers the screen is copied straight from its buffer,
+    // nothing else is composed. A moved window is handled by drawing.
+    const BaseWindow* fullscreen = has_moved_window ? nullptr : fullscreen_window();
+
+    // The write buffer was shown before the last frame, so it misses only
+    // the damage of that frame. What is damaged again is drawn anyway, the
+    // rest is copied from the buffer on screen. A flushing screen has one
+    // buffer, it misses nothing. Under a fullscreen window the missed part
+    // is copied from the client instead, as it costs the same and the
+    // overlays are drawn over it in place.
+    uint64_t started_at = CompositorStats::now_us();
+    if (!screen.flushes_damage() && fullscreen) {
+        invalidated_region.unite(m_second_buffer_damage);
+    } else if (!screen.flushes_damage()) {
+        m_second_buffer_damage.subtract(invalidated_region);
+        copy_changes_to_second_buffer(m_second_buffer_damage);
+    }
+    m_stats.end_phase(CompositorStats::BackCopy, started_at);
+
+    // Pixels which are changed by copying rather than drawing.
+    LG::Region copied_region;
+#ifdef TARGET_DESKTOP
+    if (has_moved_window) {
+        started_at = CompositorStats::now_us();
+        copy_moved_window(invalidated_region, copied_region);
+        m_stats.end_phase(CompositorStats::MoveCopy, started_at);
+    }
+#endif // TARGET_DESKTOP
+    m_stats.pixels_copied = CompositorStats::area(copied_region);
 
+    // The overlay follows every frame which is drawn anyway.
+    if (m_stats_overlay) {
+        invalidated_region.unite(stats_overlay_bounds());
+    }
+
+    auto& write_bitmap = screen.write_bitmap();
+    if (fullscreen) {
+        started_at = CompositorStats::now_us();
+        scan_out_window(*fullscreen, invalidated_region);
+        m_stats.end_phase(CompositorStats::Windows, started_at);
+        m_stats.pixels_painted = 0;
+        m_stats.pixels_copied += CompositorStats::area(invalidated_region);
+    } else {
+#ifdef TARGET_DESKTOP
+        cull_occluded_areas(invalidated_region);
+        for (auto it = windows.begin(); it != windows.end(); it++) {
+            if ((*it)->visible()) {
+                (*it)->frame().update_cache();
+            }
+        }
+#endif // TARGET_DESKTOP
+        count_painted_pixels(invalidated_region);
+
+        // The damage is drawn in bands of rows, each band by one thread with
+        // a context whose bitmap is the band. Popups, the menu bar and the
+        // cursor are small and are drawn after, on this thread.
+        auto damage_bounds = invalidated_region.bounds();
+        int tiles = (damage_bounds.height() + TileHeight - 1) / TileHeight;
+        m_workers.run(tiles, [&](int tile) {
+            int min_y = damage_bounds.min_y() + tile * TileHeight;
+            int height = std::min((int)TileHeight, damage_bounds.max_y() - min_y + 1);
+            LG::PixelBitmap band = write_bitmap.view(LG::Rect(0, min_y, write_bitmap.width(), height));
+            LG::Context band_ctx(band);
+            band_ctx.set_draw_offset(LG::Point<int>(0, -min_y));
+            compose_windows(band_ctx, invalidated_region);
+        });
+    }
+
+    auto& invalidated_areas = invalidated_region.rects();
+    LG::Context ctx(write_bitmap);
+
+    started_at = CompositorStats::now_us();
     if (m_popup.visible()) {
         for (int i = 0; i < invalidated_areas.size(); i++) {
             ctx.add_clip(invalidated_areas[i]);
@@ -139,12 +536,15 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
             ctx.reset_clip();
         }
     }
+    m_stats.end_phase(CompositorStats::Popup, started_at);
 
+    started_at = CompositorStats::now_us();
     for (int i = 0; i < invalidated_areas.size(); i++) {
         ctx.add_clip(invalidated_areas[i]);
         m_menu_bar.draw(ctx);
         ctx.reset_clip();
     }
+    m_stats.end_phase(CompositorStats::MenuBar, started_at);
 
 #ifdef TARGET_MOBILE
     for (int i = 0; i < invalidated_areas.size(); i++) {
@@ -154,16 +554,32 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
     }
 #endif // TARGET_MOBILE
 
-    auto mouse_draw_position = m_cursor_manager.draw_position();
-    auto& current_mouse_bitmap = m_cursor_manager.current_cursor();
-    for (int i = 0; i < invalidated_areas.size(); i++) {
-        ctx.add_clip(invalidated_areas[i]);
-        ctx.draw(mouse_draw_position, current_mouse_bitmap);
+    if (m_stats_overlay) {
+        ctx.add_clip(stats_overlay_bounds());
+        draw_stats_overlay(ctx, last_stats);
         ctx.reset_clip();
     }
 
-    screen.swap_buffers();
-    copy_changes_to_second_buffer(invalidated_areas);
+    started_at = CompositorStats::now_us();
+    if (!m_cursor_manager.hardware_cursor()) {
+        auto mouse_draw_position = m_cursor_manager.draw_position();
+        auto& current_mouse_bitmap = m_cursor_manager.current_cursor();
+        for (int i = 0; i < invalidated_areas.size(); i++) {
+            ctx.add_clip(invalidated_areas[i]);
+            ctx.draw(mouse_draw_position, current_mouse_bitmap);
+            ctx.reset_clip();
+        }
+    }
+    m_stats.end_phase(CompositorStats::Cursor, started_at);
+
+    started_at = CompositorStats::now_us();
+    invalidated_region.unite(copied_region);
+    screen.swap_buffers(invalidated_region);
+    m_stats.end_phase(CompositorStats::Swap, started_at);
+    if (!screen.flushes_damage()) {
+        m_second_buffer_damage = std::move(invalidated_region);
+    }
+    send_frame_callbacks();
 }
 
-} // namespace WinServer
\ No newline at end of file
+} // namespace WinServer
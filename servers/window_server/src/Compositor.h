@@ -6,12 +6,17 @@
 
 #pragma once
 #include "../shared/Connections/WSConnection.h"
+#include "CompositorStats.h"
+#include "CompositorWorkers.h"
 #include "ServerDecoder.h"
+#include <libg/Context.h>
+#include <libg/Region.h>
 #include <libipc/ServerConnection.h>
 #include <vector>
 
 namespace WinServer {
 
+class BaseWindow;
 class CursorManager;
 class ResourceManager;
 class MenuBar;
@@ -19,6 +24,11 @@ class MenuBar;
 class ControlBar;
 #endif // TARGET_MOBILE
 class Popup;
+#ifdef TARGET_DESKTOP
+namespace Desktop {
+    class Window;
+}
+#endif // TARGET_DESKTOP
 
 class Compositor {
 public:
@@ -32,42 +42,38 @@ public:
 
     void refresh();
 
-    void optimized_invalidate_insert(std::vector<LG::Rect>& data, const LG::Rect& inv_area)
+    inline void invalidate(const LG::Rect& area)
     {
-        auto area = inv_area;
-        bool intersects = false;
-        int int_index = 0;
-        for (auto& rect : data) {
-            if (rect.contains(area)) {
-                return;
-            }
+        m_invalidated_region.unite(area);
+        if (!m_frame_scheduled && !m_invalidated_region.empty()) {
+            schedule_frame();
         }
+    }
 
-        for (auto& rect : data) {
-            if (rect.intersects(area)) {
-                intersects = true;
-                break;
-            }
-            int_index++;
+    // A frame is drawn even without damage, so the windows which presented
+    // get their frame callbacks.
+    inline void request_frame()
+    {
+        if (!m_frame_scheduled) {
+            schedule_frame();
         }
+    }
 
-        if (!intersects) {
-            data.push_back(area);
-            return;
-        }
+#ifdef TARGET_DESKTOP
+    // The window was moved from old_bounds. Its pixels which are on screen
+    // are copied to the new place on the next refresh, only what they don't
+    // cover is drawn again.
+    void window_did_move(Desktop::Window& window, const LG::Rect& old_bounds);
+#endif // TARGET_DESKTOP
 
-        data[int_index].unite(area);
-        for (int i = int_index + 1; i < data.size(); i++) {
-            if (data[int_index].intersects(data[i])) {
-                data[int_index].unite(data[i]);
-                std::swap(data[i], data.back());
-                data.pop_back();
-                i--;
-            }
-        }
-    }
+    inline const CompositorStats& stats() const { return m_stats; }
+
+    // The overlay shows the stats in a corner of the screen. It is drawn
+    // again only with frames which have other damage, so it doesn't keep
+    // the compositor busy by itself.
+    inline bool stats_overlay() const { return m_stats_overlay; }
+    void set_stats_overlay(bool enabled);
 
-    inline void invalidate(const LG::Rect& area) { optimized_invalidate_insert(m_invalidated_areas, area); }
     inline CursorManager& cursor_manager() { return m_cursor_manager; }
     inline const CursorManager& cursor_manager() const { return m_cursor_manager; }
     inline ResourceManager& resource_manager() { return m_resource_manager; }
@@ -85,9 +91,45 @@ public:
 #endif // TARGET_MOBILE
 
 private:
-    void copy_changes_to_second_buffer(const std::vector<LG::Rect>& areas);
+    // Rows of the damage which a worker draws at a time.
+    static constexpr size_t TileHeight = 64;
+
+    void schedule_frame();
+    void compose_windows(LG::Context& ctx, const LG::Region& invalidated_region);
+    void copy_changes_to_second_buffer(const LG::Region& region);
+    const BaseWindow* fullscreen_window() const;
+    void scan_out_window(const BaseWindow& window, const LG::Region& invalidated_region);
+    void send_frame_callbacks();
+    void count_frame_skips();
+    void count_painted_pixels(const LG::Region& invalidated_region);
+    LG::Rect stats_overlay_bounds() const;
+    void draw_stats_overlay(LG::Context& ctx, const CompositorStats& stats);
+#ifdef TARGET_DESKTOP
+    void cull_occluded_areas(const LG::Region& invalidated_region);
+    void copy_moved_window(LG::Region& invalidated_region, LG::Region& copied_region);
+#endif // TARGET_DESKTOP
 
-    std::vector<LG::Rect> m_invalidated_areas;
+    CompositorWorkers m_workers;
+    LG::Region m_invalidated_region;
+    bool m_frame_scheduled { false };
+    // When the scheduled frame should be drawn, frames missed after it are
+    // counted as skipped.
+    uint64_t m_frame_deadline_us { 0 };
+    CompositorStats m_stats;
+    bool m_stats_overlay { false };
+    // Damage of the last frame, the write buffer has not got it yet.
+    LG::Region m_second_buffer_damage;
+#ifdef TARGET_DESKTOP
+    // Filled by cull_occluded_areas() on every refresh, kept to reuse the
+    // storage. Areas of the n-th window from the front start at
+    // m_window_area_starts[n], what is left uncovered is in m_wallpaper_region.
+    std::vector<LG::Rect> m_window_areas;
+    std::vector<size_t> m_window_area_starts;
+    LG::Region m_wallpaper_region;
+    // The window which moved since the last refresh and its bounds then.
+    int m_moved_window_id { -1 };
+    LG::Rect m_moved_from_bounds;
+#endif // TARGET_DESKTOP
     MenuBar& m_menu_bar;
     Popup& m_popup;
     CursorManager& m_cursor_manager;
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+#include <ctime>
+#include <libg/Rect.h>
+#include <libg/Region.h>
+
+namespace WinServer {
+
+// What Compositor::refresh() spent on the last frame and what it drew.
+// Times are in microseconds. Wallpaper and windows are drawn in bands on
+// several threads at once, their times are summed over the bands.
+struct CompositorStats {
+    enum Phase {
+        BackCopy,
+        MoveCopy,
+        Wallpaper,
+        Windows,
+        Popup,
+        MenuBar,
+        Cursor,
+        Swap,
+        PhaseCount,
+    };
+
+    inline static uint64_t now_us()
+    {
+        std::timespec tp;
+        clock_gettime(CLOCK_MONOTONIC, &tp);
+        return (uint64_t)tp.tv_sec * 1000000 + tp.tv_nsec / 1000;
+    }
+
+    inline static uint32_t area(const LG::Rect& rect) { return rect.width() * rect.height(); }
+
+    inline static uint32_t area(const LG::Region& region)
+    {
+        uint32_t res = 0;
+        auto& rects = region.rects();
+        for (int i = 0; i < rects.size(); i++) {
+            res += area(rects[i]);
+        }
+        return res;
+    }
+
+    // Adds the time since the phase started, may be called from a worker.
+    inline void end_phase(Phase phase, uint64_t started_at)
+    {
+        __atomic_add_fetch(&phase_us[phase], (uint32_t)(now_us() - started_at), __ATOMIC_RELAXED);
+    }
+
+    // Totals since the server started.
+    uint32_t frames { 0 };
+    uint32_t frames_skipped { 0 };
+
+    // Of the last frame. Painted pixels count every pixel each time it is
+    // written, so overdraw makes them exceed the damage, copied pixels are
+    // moved on screen instead of drawn.
+    uint32_t pixels_damaged { 0 };
+    uint32_t pixels_painted { 0 };
+    uint32_t pixels_copied { 0 };
+    uint32_t phase_us[PhaseCount] {};
+};
+
+} // namespace WinServer
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "CompositorWorkers.h"
+#include <libfoundation/Logger.h>
+
+namespace WinServer {
+
+CompositorWorkers::CompositorWorkers()
+{
+    pthread_mutex_init(&m_lock, nullptr);
+    pthread_cond_init(&m_start_cond, nullptr);
+    pthread_cond_init(&m_done_cond, nullptr);
+
+    // Without workers the compositor draws every tile itself.
+    for (int i = 0; i < MaxWorkers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, nullptr, worker_main, this) != 0) {
+            Logger::debug << "CompositorWorkers: can't start a worker" << std::endl;
+            break;
+        }
+        m_workers++;
+    }
+}
+
+void* CompositorWorkers::worker_main(void* arg)
+{
+    auto& self = *reinterpret_cast<CompositorWorkers*>(arg);
+    uint32_t seen_generation = 0;
+    for (;;) {
+        pthread_mutex_lock(&self.m_lock);
+        while (self.m_generation == seen_generation) {
+            pthread_cond_wait(&self.m_start_cond, &self.m_lock);
+        }
+        seen_generation = self.m_generation;
+        pthread_mutex_unlock(&self.m_lock);
+
+        self.take_jobs();
+
+        pthread_mutex_lock(&self.m_lock);
+        if (--self.m_busy == 0) {
+            pthread_cond_signal(&self.m_done_cond);
+        }
+        pthread_mutex_unlock(&self.m_lock);
+    }
+    return nullptr;
+}
+
+void CompositorWorkers::take_jobs()
+{
+    for (;;) {
+        int index = __atomic_fetch_add(&m_next, 1, __ATOMIC_RELAXED);
+        if (index >= m_count) {
+            return;
+        }
+        (*m_job)(index);
+    }
+}
+
+void CompositorWorkers::run(int count, const std::function<void(int)>& job)
+{
+    if (!m_workers || count <= 1) {
+        for (int i = 0; i < count; i++) {
+            job(i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    m_job = &job;
+    m_count = count;
+    m_next = 0;
+    m_busy = m_workers;
+    m_generation++;
+    pthread_cond_broadcast(&m_start_cond);
+    pthread_mutex_unlock(&m_lock);
+
+    take_jobs();
+
+    pthread_mutex_lock(&m_lock);
+    while (m_busy) {
+        pthread_cond_wait(&m_done_cond, &m_lock);
+    }
+    m_job = nullptr;
+    pthread_mutex_unlock(&m_lock);
+}
+
+} // namespace WinServer
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+#include <functional>
+#include <pthread.h>
+
+namespace WinServer {
+
+// Threads which draw tiles of a frame together with the compositor. Jobs
+// run on several threads at once, so they must not allocate: malloc is not
+// thread safe here.
+class CompositorWorkers {
+public:
+    // The kernel brings up to 4 cpus, the compositor takes one of them.
+    static constexpr int MaxWorkers = 3;
+
+    CompositorWorkers();
+    ~CompositorWorkers() = default;
+
+    inline int workers() const { return m_workers; }
+
+    // Calls job for every index below count, on the workers and on the
+    // calling thread, and returns when all the jobs are done.
+    void run(int count, const std::function<void(int)>& job);
+
+private:
+    static void* worker_main(void* arg);
+    void take_jobs();
+
+    int m_workers { 0 };
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_start_cond;
+    pthread_cond_t m_done_cond;
+    uint32_t m_generation { 0 };
+    int m_busy { 0 };
+
+    const std::function<void(int)>* m_job { nullptr };
+    int m_count { 0 };
+    int m_next { 0 };
+};
+
+} // namespace WinServer
@@ -8,6 +8,7 @@
 #include "Event.h"
 #include <libfoundation/EventLoop.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 namespace WinServer {
 
@@ -17,25 +18,130 @@ Connection::Connection(int connection_fd)
     : m_connection_fd(connection_fd)
     , m_server_decoder()
     , m_client_decoder()
-    , m_connection_with_clients(m_connection_fd, m_server_decoder, m_client_decoder)
 {
     s_WinServer_Connection_the = this;
+    m_connection_fds.push_back(-1); // Connection ids start with 1.
     int err = bind(m_connection_fd, "/tmp/win.sock", 13);
     if (!err) {
         LFoundation::EventLoop::the().add(
             m_connection_fd, [] {
-                Connection::the().listen();
+                Connection::the().accept_client();
             },
             nullptr);
+
+        // Messages to a client within a pump go with one write.
+        LFoundation::EventLoop::the().add_pump_end_handler([] {
+            Connection::the().flush_clients();
+        });
+    }
+}
+
+void Connection::accept_client()
+{
+    int client_fd = accept(m_connection_fd);
+    if (client_fd < 0) {
+        return;
+    }
+
+    m_clients.push_back(Client { client_fd, ServerConnection<WindowServerDecoder, BaseWindowClientDecoder>(client_fd, m_server_decoder, m_client_decoder) });
+    m_clients.back().connection.set_coalescer(coalesce_mouse_moves);
+    LFoundation::EventLoop::the().add(
+        client_fd, [client_fd] {
+            Connection::the().listen(client_fd);
+        },
+        nullptr);
+}
+
+void Connection::listen(int client_fd)
+{
+    for (auto it = m_clients.begin(); it != m_clients.end(); ++it) {
+        if (it->fd != client_fd) {
+            continue;
+        }
+
+        // Handlers ask for the socket of the message being served.
+        m_serving_fd = client_fd;
+        bool alive = it->connection.pump_messages();
+        m_serving_fd = -1;
+        if (!alive) {
+            disconnect_client(it);
+        }
+        return;
+    }
+}
+
+void Connection::flush_clients()
+{
+    for (auto& client : m_clients) {
+        client.connection.flush();
+    }
+}
+
+// A mouse move which is still queued for the client is superseded by the
+// next one of the same window, so its point is just replaced.
+bool Connection::coalesce_mouse_moves(uint8_t* last, size_t last_len, const Message& next)
+{
+    static const int mouse_move_id = MouseMoveMessage(0, 0, 0, 0).id();
+    if (next.decoder_magic() != the().m_client_decoder.magic() || next.id() != mouse_move_id) {
+        return false;
+    }
+
+    auto& move = static_cast<const MouseMoveMessage&>(next);
+    int decoder_magic, msg_id, key, win_id;
+    size_t offset = 0;
+    Encoder::decode((const char*)last, offset, decoder_magic);
+    Encoder::decode((const char*)last, offset, msg_id);
+    Encoder::decode((const char*)last, offset, key);
+    Encoder::decode((const char*)last, offset, win_id);
+    if (decoder_magic != next.decoder_magic() || msg_id != next.id() || key != next.key() || win_id != move.win_id()) {
+        return false;
+    }
+
+    Encoder::store(last, offset, move.x());
+    Encoder::store(last, offset, move.y());
+    return true;
+}
+
+void Connection::disconnect_client(std::list<Client>::iterator client)
+{
+    for (int& fd : m_connection_fds) {
+        if (fd == client->fd) {
+            fd = -1;
+        }
+    }
+    LFoundation::EventLoop::the().remove(client->fd);
+    client->connection.close();
+    close(client->fd);
+    m_clients.erase(client);
+}
+
+int Connection::alloc_connection()
+{
+    m_connection_fds.push_back(m_serving_fd);
+    return m_connection_fds.size() - 1;
+}
+
+bool Connection::send_async_message(const Message& msg) const
+{
+    int key = msg.key();
+    if (key <= 0 || key >= m_connection_fds.size() || m_connection_fds[key] < 0) {
+        return false;
+    }
+
+    for (auto& client : m_clients) {
+        if (client.fd == m_connection_fds[key]) {
+            return client.connection.send_message(msg);
+        }
     }
+    return false;
 }
 
 void Connection::receive_event(std::unique_ptr<LFoundation::Event> event)
 {
     if (event->type() == WinServer::Event::Type::SendEvent) {
         std::unique_ptr<SendEvent> send_event = std::move(event);
-        m_connection_with_clients.send_message(*send_event->message());
+        send_async_message(*send_event->message());
     }
 }
 
-} // namespace WinServer
\ No newline at end of file
+} // namespace WinServer
@@ -9,6 +9,8 @@
 #include "ServerDecoder.h"
 #include <libfoundation/EventReceiver.h>
 #include <libipc/ServerConnection.h>
+#include <list>
+#include <vector>
 
 namespace WinServer {
 
@@ -22,21 +24,31 @@ public:
 
     explicit Connection(int connection_fd);
 
-    inline void listen()
-    {
-        m_connection_with_clients.pump_messages();
-    }
+    void accept_client();
+    void listen(int client_fd);
 
-    inline bool send_async_message(const Message& msg) const { return m_connection_with_clients.send_message(msg); }
-    inline int alloc_connection() { return ++m_connections_number; }
+    bool send_async_message(const Message& msg) const;
+    void flush_clients();
+    int alloc_connection();
     void receive_event(std::unique_ptr<LFoundation::Event> event) override;
 
 private:
+    struct Client {
+        int fd;
+        ServerConnection<WindowServerDecoder, BaseWindowClientDecoder> connection;
+    };
+
+    void disconnect_client(std::list<Client>::iterator client);
+    static bool coalesce_mouse_moves(uint8_t* last, size_t last_len, const Message& next);
+
     int m_connection_fd;
-    int m_connections_number { 0 };
-    ServerConnection<WindowServerDecoder, BaseWindowClientDecoder> m_connection_with_clients;
+    int m_serving_fd { -1 };
     WindowServerDecoder m_server_decoder;
     BaseWindowClientDecoder m_client_decoder;
+    std::list<Client> m_clients;
+    // Socket of every connection id handed out by alloc_connection(), -1
+    // once the client is gone.
+    std::vector<int> m_connection_fds;
 };
 
-} // namespace WinServer
\ No newline at end of file
+} // namespace WinServer
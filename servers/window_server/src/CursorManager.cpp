@@ -23,6 +23,12 @@ CursorManager::CursorManager()
     s_WinServer_CursorManager_the = this;
     LG::PNG::PNGLoader loader;
     m_std_cursor = loader.load_from_file(CURSOR_PATH);
+
+    if (m_screen.has_hardware_cursor() && m_std_cursor.width() <= BGA_CURSOR_SIZE && m_std_cursor.height() <= BGA_CURSOR_SIZE) {
+        m_screen.set_cursor(m_std_cursor, CURSOR_OFFSET, CURSOR_OFFSET);
+        m_screen.move_cursor(m_mouse_x, m_mouse_y);
+        m_hardware_cursor = true;
+    }
 }
 
 } // namespace WinServer
\ No newline at end of file
@@ -47,6 +47,8 @@ public:
     inline const LG::PixelBitmap& current_cursor() const { return std_cursor(); }
     inline const LG::PixelBitmap& std_cursor() const { return m_std_cursor; }
     inline LG::Point<int> draw_position() { return { m_mouse_x - CURSOR_OFFSET, m_mouse_y - CURSOR_OFFSET }; }
+    // The cursor is on a plane of the display, the compositor doesn't draw it.
+    inline bool hardware_cursor() const { return m_hardware_cursor; }
 
     inline int x() const
     {
@@ -156,6 +158,7 @@ private:
     bool m_mouse_right_button_pressed { false };
     uint32_t m_mask_changed_objects { 0 };
     bool m_mouse_changed_button_status { false };
+    bool m_hardware_cursor { false };
 
     Screen& m_screen;
     LG::PixelBitmap m_std_cursor;
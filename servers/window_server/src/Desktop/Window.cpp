@@ -16,7 +16,7 @@ Window::Window(int connection_id, int id, const CreateWindowMessage& msg)
 {
     m_bounds = LG::Rect(0, 0, msg.width() + frame().left_border_size() + frame().right_border_size(), msg.height() + frame().top_border_size() + frame().bottom_border_size());
     m_content_bounds = LG::Rect(m_frame.left_border_size(), m_frame.top_border_size(), msg.width(), msg.height());
-    m_content_bitmap = LG::PixelBitmap(m_buffer.data(), content_bounds().width(), content_bounds().height());
+    m_content_bitmap = LG::PixelBitmap(buffer().data(), content_bounds().width(), content_bounds().height());
 
     // Creating standard menubar directory entry.
     m_menubar_content.push_back(MenuDir("App", 0));
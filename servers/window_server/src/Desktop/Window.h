@@ -9,6 +9,7 @@
 #include "../Components/MenuBar/MenuItem.h"
 #include "../Connection.h"
 #include "WindowFrame.h"
+#include <algorithm>
 #include <libfoundation/SharedBuffer.h>
 #include <libg/PixelBitmap.h>
 #include <libg/Rect.h>
@@ -48,6 +49,22 @@ public:
 
     inline const LG::CornerMask& corner_mask() const { return m_corner_mask; }
 
+    // Part of the window which hides everything behind it. The frame and
+    // the rows of rounded corners are left out, content with alpha hides
+    // nothing. Only the part covered by the buffer counts, it may be of the
+    // old size while a resize is in flight.
+    inline LG::Rect opaque_bounds() const
+    {
+        size_t top_cut = m_corner_mask.top_rounded() ? m_corner_mask.radius() : 0;
+        size_t bottom_cut = m_corner_mask.bottom_rounded() ? m_corner_mask.radius() : 0;
+        size_t width = std::min(content_bounds().width(), content_bitmap().width());
+        size_t height = std::min(content_bounds().height(), content_bitmap().height());
+        if (content_bitmap().has_alpha_channel() || height <= top_cut + bottom_cut) {
+            return LG::Rect(0, 0, 0, 0);
+        }
+        return LG::Rect(content_bounds().min_x(), content_bounds().min_y() + top_cut, width, height - top_cut - bottom_cut);
+    }
+
     inline const LG::string& icon_path() const { return m_icon_path; }
 
     inline std::vector<MenuDir>& menubar_content() { return m_menubar_content; }
@@ -7,10 +7,11 @@
 // includes
 #include "WindowFrame.h"
 #include "../Components/Elements/Button.h"
+#include "../ResourceManager.h"
 #include "../WindowManager.h"
 #include "Window.h"
+#include <libfoundation/Memory.h>
 #include <libg/Font.h>
-#include <libg/ImageLoaders/PNGLoader.h>
 #include <libg/Rect.h>
 #include <utility>
 
@@ -96,6 +97,7 @@ void WindowFrame::set_app_name(const std::string& title)
         new_control->set_title(title);
         m_control_panel_buttons.push_back(new_control);
     }
+    invalidate_cache();
     WinServer::Compositor::the().invalidate(bounds());
 }
 
@@ -109,6 +111,7 @@ void WindowFrame::set_app_name(std::string&& title)
         new_control->set_font(LG::Font::system_bold_font());
         m_control_panel_buttons.push_back(new_control);
     }
+    invalidate_cache();
     WinServer::Compositor::the().invalidate(bounds());
 }
 
@@ -117,38 +120,40 @@ void WindowFrame::add_control(const std::string& title)
     auto* new_control = new Button();
     new_control->set_title(title);
     m_control_panel_buttons.push_back(new_control);
+    invalidate_cache();
     WinServer::Compositor::the().invalidate(bounds());
 }
 
-void WindowFrame::draw(LG::Context& ctx)
+void WindowFrame::draw_into_cache()
 {
-    if (!visible()) {
-        return;
-    }
-    int x = m_window.bounds().min_x();
-    int y = m_window.bounds().min_y();
     size_t width = m_window.bounds().width();
     size_t height = m_window.bounds().height();
+    if (m_cache.width() != width || m_cache.height() != height) {
+        m_cache = LG::PixelBitmap(width, height, LG::PixelBitmapFormat::RGBA_Premultiplied);
+    }
+    for (int y = 0; y < height; y++) {
+        LFoundation::fast_set(reinterpret_cast<uint32_t*>(&m_cache[y][0]), LG::Color(0, 0, 0, 0).u32(), width);
+    }
 
-    int right_x = x + width - right_border_size();
-    int bottom_y = y + height - bottom_border_size();
+    LG::Context ctx(m_cache);
+    int right_x = width - right_border_size();
 
     ctx.set_fill_color(color());
-    ctx.fill_rounded(LG::Rect(x + left_border_size(), y + std_top_border_frame_size(), width - 2 * left_border_size(), top_border_size() - std_top_border_frame_size()), LG::CornerMask(4, true, false));
+    ctx.fill_rounded(LG::Rect(left_border_size(), std_top_border_frame_size(), width - 2 * left_border_size(), top_border_size() - std_top_border_frame_size()), LG::CornerMask(4, true, false));
     if (active()) {
         ctx.set_fill_color(Color::Shadow);
 
-        auto shading_rect = LG::Rect(x + left_border_size(), y + std_top_border_frame_size(), width - 2 * left_border_size(), height - std_top_border_frame_size() - std_bottom_border_size());
+        auto shading_rect = LG::Rect(left_border_size(), std_top_border_frame_size(), width - 2 * left_border_size(), height - std_top_border_frame_size() - std_bottom_border_size());
         ctx.draw_box_shading(shading_rect, LG::Shading(LG::Shading::Type::Box, 0, LG::Shading::SystemSpread), LG::CornerMask(LG::CornerMask::SystemRadius));
     }
 
     ctx.set_fill_color(m_text_colors[(int)active()]);
-    ctx.draw({ x + spacing(), y + icon_y_offset() }, icon());
+    ctx.draw({ spacing(), icon_y_offset() }, icon());
 
     constexpr int start_controls_offset = icon_width() + 2 * spacing();
-    int start_controls = x + start_controls_offset;
+    int start_controls = start_controls_offset;
     for (int i = 0; i < m_control_panel_buttons.size(); i++) {
-        m_control_panel_buttons[i]->display(ctx, { start_controls, y + text_y_offset() });
+        m_control_panel_buttons[i]->display(ctx, { start_controls, text_y_offset() });
         start_controls += spacing() + m_control_panel_buttons[i]->bounds().width();
     }
 
@@ -160,9 +165,53 @@ void WindowFrame::draw(LG::Context& ctx)
             ctx.set_fill_color(m_text_colors[(int)active()]);
         }
 
-        m_window_control_buttons[i]->display(ctx, { start_buttons, y + button_y_offset() });
+        m_window_control_buttons[i]->display(ctx, { start_buttons, button_y_offset() });
         start_buttons += -spacing() - m_window_control_buttons[i]->bounds().width();
     }
+    m_cache_valid = true;
+}
+
+void WindowFrame::update_cache()
+{
+    const auto& window_bounds = m_window.bounds();
+    if (!m_cache_valid || m_cache.width() != window_bounds.width() || m_cache.height() != window_bounds.height()) {
+        draw_into_cache();
+    }
+}
+
+void WindowFrame::draw(LG::Context& ctx)
+{
+    if (!visible()) {
+        return;
+    }
+    update_cache();
+
+    // The opaque content is drawn over the frame, the bitmap is blended
+    // only above, below and at the sides of it.
+    const auto& window_bounds = m_window.bounds();
+    auto opaque = m_window.opaque_bounds();
+    LG::Rect areas[4];
+    int areas_count = 0;
+    if (opaque.empty()) {
+        areas[areas_count++] = window_bounds;
+    } else {
+        int x = window_bounds.min_x();
+        int width = window_bounds.width();
+        areas[areas_count++] = LG::Rect(x, window_bounds.min_y(), width, opaque.min_y() - window_bounds.min_y());
+        areas[areas_count++] = LG::Rect(x, opaque.max_y() + 1, width, window_bounds.max_y() - opaque.max_y());
+        areas[areas_count++] = LG::Rect(x, opaque.min_y(), opaque.min_x() - x, opaque.height());
+        areas[areas_count++] = LG::Rect(opaque.max_x() + 1, opaque.min_y(), window_bounds.max_x() - opaque.max_x(), opaque.height());
+    }
+
+    auto clip = ctx.clip();
+    for (int i = 0; i < areas_count; i++) {
+        if (areas[i].empty()) {
+            continue;
+        }
+        ctx.add_clip(areas[i]);
+        ctx.draw(window_bounds.origin(), m_cache);
+        ctx.set_clip(clip);
+    }
 }
 
 void WindowFrame::invalidate(WinServer::Compositor& compositor) const
@@ -236,12 +285,17 @@ void WindowFrame::set_text_style(TextStyle ts)
     default:
         break;
     }
+    invalidate_cache();
 }
 
 void WindowFrame::reload_icon()
 {
-    LG::PNG::PNGLoader loader;
-    m_icon = loader.load_from_file(m_window.icon_path() + "/12x12.png");
+    if (auto* image = ResourceManager::the().image(m_window.icon_path() + "/12x12.png", LG::Size(12, 12))) {
+        m_icon = image->bitmap;
+    } else {
+        m_icon = LG::PixelBitmap();
+    }
+    invalidate_cache();
 }
 
 } 
\ No newline at end of file
@@ -27,7 +27,13 @@ public:
     WindowFrame(Window& window, std::vector<Button*>&& control_panel_buttons, std::vector<Button*>&& window_control_buttons);
     ~WindowFrame() = default;
 
+    // The frame is drawn once into a bitmap and blended from it after.
+    // The bitmap is drawn again only when the size, the title, the icon,
+    // the style or the active state of the window changes.
     void draw(LG::Context&);
+    // Draws the bitmap again if it is out of date. Drawing may run on
+    // several threads, so the compositor calls it before.
+    void update_cache();
     static constexpr size_t std_app_header_size() { return 26; }
     static constexpr size_t std_top_border_frame_size() { return 4; }
     static constexpr size_t std_top_border_size() { return std_top_border_frame_size() + std_app_header_size(); }
@@ -56,7 +62,7 @@ public:
 
     inline LG::Color& color() { return m_color; }
     inline const LG::Color& color() const { return m_color; }
-    inline void set_color(const LG::Color& clr) { m_color = clr; }
+    inline void set_color(const LG::Color& clr) { m_color = clr, invalidate_cache(); }
 
     inline TextStyle text_style() const { return m_text_style; }
     void set_text_style(TextStyle ts);
@@ -65,10 +71,17 @@ public:
     {
         m_top_border_size = visible ? std_top_border_size() : 0;
         m_visible = visible;
+        invalidate_cache();
     }
 
     bool visible() const { return m_visible; }
-    void set_active(bool active) { m_active = active; }
+    void set_active(bool active)
+    {
+        if (m_active != active) {
+            m_active = active;
+            invalidate_cache();
+        }
+    }
     bool active() const { return m_active; }
 
     void invalidate(WinServer::Compositor& compositor) const;
@@ -82,7 +95,11 @@ public:
     static constexpr int text_y_offset() { return 9 + std_top_border_frame_size(); }
     static constexpr int button_y_offset() { return 8 + std_top_border_frame_size(); }
 
+    inline void invalidate_cache() { m_cache_valid = false; }
+
 private:
+    void draw_into_cache();
+
     Window& m_window;
     std::vector<Button*> m_window_control_buttons;
     std::vector<Button*> m_control_panel_buttons;
@@ -93,6 +110,9 @@ private:
     bool m_visible { true };
     bool m_active { true };
 
+    LG::PixelBitmap m_cache {};
+    bool m_cache_valid { false };
+
     TextStyle m_text_style;
 };
 
@@ -23,41 +23,83 @@ public:
     Devices();
     ~Devices() = default;
 
+    // All packets which are ready are read at once and motion is merged into
+    // one event, so the cursor and the hovered window are updated once per
+    // pump. A packet which changes buttons or scrolls ends the merged motion,
+    // clicks keep their place and order.
     inline void pump_mouse() const
     {
         LFoundation::EventLoop& el = LFoundation::EventLoop::the();
         WindowManager& wm = WindowManager::the();
 
+        MousePacket pending {};
+        bool has_pending = false;
+
         char buf[512];
-        int read_cnt = read(m_mouse_fd, buf, sizeof(buf));
-        if (read_cnt <= 0) {
-            return;
+        for (;;) {
+            int read_cnt = read(m_mouse_fd, buf, sizeof(buf));
+            if (read_cnt <= 0) {
+                break;
+            }
+
+            auto* packet_buf = reinterpret_cast<MousePacket*>(buf);
+            for (int offset = 0, cnt = 0; offset < read_cnt; offset += sizeof(MousePacket), cnt++) {
+                auto& packet = packet_buf[cnt];
+                if (has_pending && !pending.wheel_data && pending.button_states == packet.button_states) {
+                    pending.x_offset = merge_offsets(pending.x_offset, packet.x_offset);
+                    pending.y_offset = merge_offsets(pending.y_offset, packet.y_offset);
+                    pending.wheel_data = packet.wheel_data;
+                    pending.time_ms = packet.time_ms;
+                    continue;
+                }
+
+                if (has_pending) {
+                    el.add(wm, new MouseEvent(pending));
+                }
+                pending = packet;
+                has_pending = true;
+            }
+
+            if (read_cnt < sizeof(buf)) {
+                break;
+            }
         }
 
-        auto* packet_buf = reinterpret_cast<MousePacket*>(buf);
-        for (int offset = 0, cnt = 0; offset < read_cnt; offset += sizeof(MousePacket), cnt++) {
-            el.add(wm, new MouseEvent(packet_buf[cnt]));
+        if (has_pending) {
+            el.add(wm, new MouseEvent(pending));
         }
     }
 
+    // Keys are never merged, all which are ready are passed on in order.
     inline void pump_keyboard() const
     {
         LFoundation::EventLoop& el = LFoundation::EventLoop::the();
         WindowManager& wm = WindowManager::the();
 
         char buf[512];
-        int read_cnt = read(m_keyboard_fd, buf, sizeof(buf));
-        if (read_cnt <= 0) {
-            return;
-        }
+        for (;;) {
+            int read_cnt = read(m_keyboard_fd, buf, sizeof(buf));
+            if (read_cnt <= 0) {
+                return;
+            }
 
-        auto* packet_buf = reinterpret_cast<KeyboardPacket*>(buf);
-        for (int offset = 0, cnt = 0; offset < read_cnt; offset += sizeof(KeyboardPacket), cnt++) {
-            el.add(wm, new KeyboardEvent(packet_buf[cnt]));
+            auto* packet_buf = reinterpret_cast<KeyboardPacket*>(buf);
+            for (int offset = 0, cnt = 0; offset < read_cnt; offset += sizeof(KeyboardPacket), cnt++) {
+                el.add(wm, new KeyboardEvent(packet_buf[cnt]));
+            }
+
+            if (read_cnt < sizeof(buf)) {
+                return;
+            }
         }
     }
 
 private:
+    static inline int16_t merge_offsets(int16_t a, int16_t b)
+    {
+        return std::max(-32768, std::min(32767, (int)a + (int)b));
+    }
+
     int m_mouse_fd;
     int m_keyboard_fd;
 };
@@ -15,7 +15,7 @@ Window::Window(int connection_id, int id, const CreateWindowMessage& msg)
 {
     m_bounds = LG::Rect(0, 0, msg.width(), msg.height());
     m_content_bounds = LG::Rect(0, 0, msg.width(), msg.height());
-    m_content_bitmap = LG::PixelBitmap(m_buffer.data(), content_bounds().width(), content_bounds().height());
+    m_content_bitmap = LG::PixelBitmap(buffer().data(), content_bounds().width(), content_bounds().height());
 }
 
 Window::Window(Window&& win)
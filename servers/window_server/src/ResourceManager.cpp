@@ -5,7 +5,14 @@
  */
 
 #include "ResourceManager.h"
+#include "Screen.h"
+#include <cstring>
+#include <fcntl.h>
+#include <libfoundation/Logger.h>
 #include <libg/ImageLoaders/PNGLoader.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace WinServer {
 
@@ -14,8 +21,102 @@ ResourceManager* s_WinServer_ResourceManager_the = nullptr;
 ResourceManager::ResourceManager()
 {
     s_WinServer_ResourceManager_the = this;
+    load_background("/res/wallpapers/mountain_orange.png");
+}
+
+// The wallpaper is kept at the size of the screen and opaque, so the
+// compositor copies it rows at a time instead of blending it.
+void ResourceManager::load_background(const std::string& path)
+{
+    LG::PNG::PNGLoader loader;
+    LG::PixelBitmap wallpaper = loader.load_from_file(path);
+    auto& screen = Screen::the();
+    if (wallpaper.width() != screen.width() || wallpaper.height() != screen.height()) {
+        wallpaper = wallpaper.scaled(LG::Size(screen.width(), screen.height()));
+    }
+
+    // What is seen through the wallpaper is black.
+    if (wallpaper.has_alpha_channel()) {
+        for (int y = 0; y < wallpaper.height(); y++) {
+            for (int x = 0; x < wallpaper.width(); x++) {
+                LG::Color& clr = wallpaper[y][x];
+                if (!wallpaper.is_premultiplied()) {
+                    clr = clr.premultiplied();
+                }
+                clr.set_alpha(255);
+            }
+        }
+        wallpaper.set_format(LG::PixelBitmapFormat::RGB);
+    }
+    m_background = std::move(wallpaper);
+}
+
+SharedImage* ResourceManager::find_image(const std::string& path, const LG::Size& size)
+{
+    for (auto& image : m_images) {
+        if (image.size.width() != size.width() || image.size.height() != size.height()) {
+            continue;
+        }
+        if (image.path.size() == path.size() && memcmp(image.path.c_str(), path.c_str(), path.size()) == 0) {
+            return &image;
+        }
+    }
+    return nullptr;
+}
+
+const SharedImage* ResourceManager::image(const std::string& path, const LG::Size& size)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    fstat_t stat;
+    fstat(fd, &stat);
+
+    SharedImage* image = find_image(path, size);
+    if (image && image->mtime == stat.mtime && image->file_size == stat.size) {
+        close(fd);
+        return image;
+    }
+
+    uint8_t* ptr = (uint8_t*)mmap(NULL, stat.size, PROT_READ, MAP_PRIVATE, fd, 0);
     LG::PNG::PNGLoader loader;
-    m_background = loader.load_from_file("/res/wallpapers/mountain_orange.png");
+    LG::PixelBitmap decoded = loader.load_from_mem(ptr);
+    munmap(ptr, stat.size);
+    close(fd);
+
+    size_t pixels = decoded.width() * decoded.height();
+    if (!pixels) {
+        Logger::debug << "ResourceManager: can't load " << path.c_str() << std::endl;
+        return nullptr;
+    }
+
+    if (size.width() && size.height() && (size.width() != decoded.width() || size.height() != decoded.height())) {
+        decoded = decoded.scaled(size);
+        pixels = decoded.width() * decoded.height();
+    }
+
+    LFoundation::SharedBuffer<LG::Color> buffer(pixels);
+    if (!buffer.alive()) {
+        return nullptr;
+    }
+    decoded.copy_to(buffer.data());
+    buffer.seal();
+
+    // Bitmaps of the old version may still be in use, so its buffer stays
+    // mapped. A file changes rarely, so it is not worth tracking them.
+    if (!image) {
+        m_images.push_back(SharedImage());
+        image = &m_images.back();
+        image->path = path;
+        image->size = size;
+    }
+    image->mtime = stat.mtime;
+    image->file_size = stat.size;
+    image->buffer = buffer;
+    image->bitmap = LG::PixelBitmap(buffer.data(), decoded.width(), decoded.height(), decoded.format());
+    return image;
 }
 
-} // namespace WinServer
\ No newline at end of file
+} // namespace WinServer
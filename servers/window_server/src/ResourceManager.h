@@ -5,11 +5,25 @@
  */
 
 #pragma once
+#include <libfoundation/SharedBuffer.h>
 #include <libg/PixelBitmap.h>
 #include <libg/Point.h>
+#include <libg/Size.h>
+#include <string>
+#include <vector>
 
 namespace WinServer {
 
+// A decoded image in a sealed shared buffer, clients map it read-only.
+struct SharedImage {
+    std::string path;
+    LG::Size size;
+    uint32_t mtime;
+    uint32_t file_size;
+    LFoundation::SharedBuffer<LG::Color> buffer;
+    LG::PixelBitmap bitmap;
+};
+
 class ResourceManager {
 public:
     inline static ResourceManager& the()
@@ -22,8 +36,19 @@ public:
 
     inline const LG::PixelBitmap& background() const { return m_background; }
 
+    // Decodes the image once for all processes, it is decoded again only
+    // when mtime or size of the file change. An image of another size is
+    // scaled to the size once, so it is drawn with a plain copy or blend.
+    // An empty size keeps the image as is. Returns nullptr if it can't be
+    // loaded.
+    const SharedImage* image(const std::string& path, const LG::Size& size = LG::Size());
+
 private:
+    SharedImage* find_image(const std::string& path, const LG::Size& size);
+    void load_background(const std::string& path);
+
     LG::PixelBitmap m_background;
+    std::vector<SharedImage> m_images;
 };
 
-} // namespace WinServer
\ No newline at end of file
+} // namespace WinServer
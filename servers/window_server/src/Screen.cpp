@@ -7,6 +7,7 @@
 #include "Screen.h"
 #include "Compositor.h"
 #include <cstring>
+#include <algorithm>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -24,10 +25,36 @@ Screen::Screen()
     s_WinServer_Screen_the = this;
     m_screen_fd = open("/dev/bga", O_RDWR);
     m_bounds = LG::Rect(0, 0, ioctl(m_screen_fd, BGA_GET_WIDTH, 0), ioctl(m_screen_fd, BGA_GET_HEIGHT, 0));
+    int accel_ops = ioctl(m_screen_fd, BGA_GET_ACCEL_OPS, 0);
+    if (accel_ops > 0) {
+        m_accel_ops = accel_ops;
+    }
+
+    int depth = ioctl(m_screen_fd, BGA_GET_DEPTH, 0);
+    if (depth == 2) {
+        m_depth = depth;
+    }
+
+    size_t screen_buffer_size = width() * height() * this->depth();
+    if (is_shadowed()) {
+        auto* scanout = reinterpret_cast<uint8_t*>(mmap(NULL, 1, PROT_READ | PROT_WRITE, MAP_SHARED, m_screen_fd, 0));
+        m_scanout_buffers[0] = reinterpret_cast<uint16_t*>(scanout);
+        m_scanout_buffers[1] = reinterpret_cast<uint16_t*>(scanout + screen_buffer_size);
+        m_scanout_damage = LG::Region(bounds());
+
+        m_display_bitmap = LG::PixelBitmap(width(), height());
+        m_write_bitmap = LG::PixelBitmap(m_display_bitmap.data(), width(), height(), LG::RGB, m_display_bitmap.stride());
+        m_display_bitmap_ptr = &m_display_bitmap;
+        m_write_bitmap_ptr = &m_write_bitmap;
+        m_active_buffer = 0;
+        return;
+    }
 
-    size_t screen_buffer_size = width() * height() * depth();
     auto* first_buffer = reinterpret_cast<LG::Color*>(mmap(NULL, 1, PROT_READ | PROT_WRITE, MAP_SHARED, m_screen_fd, 0));
     auto* second_buffer = reinterpret_cast<LG::Color*>(reinterpret_cast<uint8_t*>(first_buffer) + screen_buffer_size);
+    if (flushes_damage()) {
+        second_buffer = first_buffer;
+    }
 
     m_display_bitmap = LG::PixelBitmap(first_buffer, width(), height());
     m_write_bitmap = LG::PixelBitmap(second_buffer, width(), height());
@@ -38,11 +65,106 @@ Screen::Screen()
     m_active_buffer = 0;
 }
 
-void Screen::swap_buffers()
+void Screen::swap_buffers(const LG::Region& damage)
 {
-    m_write_bitmap_ptr.swap(m_display_bitmap_ptr);
-    m_active_buffer ^= 1;
+    // Keeps input irqs on the cpu we draw on, so their data is cache hot.
+    // The kernel does nothing if they are there already.
+    if (m_pins_irqs) {
+        m_pins_irqs = ioctl(m_screen_fd, BGA_PIN_IRQS, 1) == 0;
+    }
+
+    if (is_shadowed()) {
+        present_shadow(damage);
+        return;
+    }
+
+    if (!flushes_damage()) {
+        m_write_bitmap_ptr.swap(m_display_bitmap_ptr);
+        m_active_buffer ^= 1;
+        ioctl(m_screen_fd, BGA_SWAP_BUFFERS, m_active_buffer);
+        return;
+    }
+
+    auto& areas = damage.rects();
+    m_flush_rects.clear_remain_capacity();
+    for (int i = 0; i < areas.size(); i++) {
+        auto area = areas[i].intersection(bounds());
+        if (area.empty()) {
+            continue;
+        }
+        m_flush_rects.push_back(bga_rect { (unsigned)area.min_x(), (unsigned)area.min_y(), (unsigned)area.width(), (unsigned)area.height() });
+    }
+
+    bga_flush_rects flush_rects { (unsigned)m_flush_rects.size(), m_flush_rects.data() };
+    ioctl(m_screen_fd, BGA_FLUSH_RECTS, (uint32_t)&flush_rects);
+}
+
+// The damage of this and the last frame is converted into the hidden
+// buffer, which is flipped to then. Only the damage crosses the bus, at
+// 2 bytes a pixel.
+void Screen::present_shadow(const LG::Region& damage)
+{
+    int hidden = m_active_buffer ^ 1;
+    m_scanout_damage.unite(damage);
+    auto& areas = m_scanout_damage.rects();
+    for (int i = 0; i < areas.size(); i++) {
+        auto area = areas[i].intersection(bounds());
+        if (area.empty()) {
+            continue;
+        }
+        uint16_t* dst = m_scanout_buffers[hidden] + area.min_y() * width() + area.min_x();
+        for (int y = area.min_y(); y <= area.max_y(); y++, dst += width()) {
+            LG::convert_to_rgb565(dst, &m_display_bitmap[y][area.min_x()], area.width());
+        }
+    }
+
+    m_active_buffer = hidden;
     ioctl(m_screen_fd, BGA_SWAP_BUFFERS, m_active_buffer);
+    m_scanout_damage = damage;
+}
+
+void Screen::flush(const LG::Rect& area)
+{
+    if (flushes_damage()) {
+        swap_buffers(LG::Region(area));
+    }
+}
+
+// The cursor plane takes straight alpha in a fixed square, the image is put
+// at its top left corner.
+void Screen::set_cursor(const LG::PixelBitmap& cursor, int hot_x, int hot_y)
+{
+    if (!has_hardware_cursor()) {
+        return;
+    }
+
+    auto* pixels = new uint32_t[BGA_CURSOR_SIZE * BGA_CURSOR_SIZE] {};
+    size_t width = std::min(cursor.width(), (size_t)BGA_CURSOR_SIZE);
+    size_t height = std::min(cursor.height(), (size_t)BGA_CURSOR_SIZE);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            auto clr = cursor[y][x];
+            if (cursor.is_premultiplied()) {
+                clr = clr.unpremultiplied();
+            }
+            uint32_t alpha = cursor.has_alpha_channel() ? clr.alpha() : 255;
+            pixels[y * BGA_CURSOR_SIZE + x] = (alpha << 24) | (clr.u32() & 0xffffff);
+        }
+    }
+
+    bga_cursor hw_cursor { pixels, (unsigned)hot_x, (unsigned)hot_y };
+    ioctl(m_screen_fd, BGA_SET_CURSOR, (uint32_t)&hw_cursor);
+    delete[] pixels;
+}
+
+void Screen::move_cursor(int x, int y)
+{
+    ioctl(m_screen_fd, BGA_MOVE_CURSOR, (x << 16) | y);
+}
+
+int Screen::ms_to_next_vblank() const
+{
+    return ioctl(m_screen_fd, BGA_GET_NEXT_VBLANK, 0);
 }
 
 } // namespace WinServer
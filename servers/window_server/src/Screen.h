@@ -7,7 +7,10 @@
 #pragma once
 #include <libg/Color.h>
 #include <libg/PixelBitmap.h>
+#include <libg/Region.h>
 #include <memory>
+#include <sys/ioctl.h>
+#include <vector>
 
 namespace WinServer {
 
@@ -21,7 +24,24 @@ public:
 
     Screen();
 
-    void swap_buffers();
+    // Shows what was drawn to the write bitmap. The damage is what changed
+    // since the last call, a display which flushes needs only that.
+    void swap_buffers(const LG::Region& damage);
+    // Shows an area drawn straight to the display bitmap.
+    void flush(const LG::Rect& area);
+    int ms_to_next_vblank() const;
+
+    void set_cursor(const LG::PixelBitmap& cursor, int hot_x, int hot_y);
+    void move_cursor(int x, int y);
+
+    inline uint32_t accel_ops() const { return m_accel_ops; }
+    // Both bitmaps are one buffer, its damage is sent to the screen and
+    // nothing is flipped.
+    inline bool flushes_damage() const { return (m_accel_ops & BGA_ACCEL_FLUSH) || is_shadowed(); }
+    // The screen takes RGB565, it is drawn in a 32 bit shadow buffer which
+    // is converted to the scanout buffers when presented.
+    inline bool is_shadowed() const { return m_depth == 2; }
+    inline bool has_hardware_cursor() const { return m_accel_ops & BGA_ACCEL_CURSOR; }
 
     inline size_t width() { return m_bounds.width(); }
     inline size_t height() const { return m_bounds.height(); }
@@ -35,11 +55,21 @@ public:
     inline const LG::PixelBitmap& display_bitmap() const { return *m_display_bitmap_ptr; }
 
 private:
+    void present_shadow(const LG::Region& damage);
+
     int m_screen_fd;
     LG::Rect m_bounds;
     uint32_t m_depth;
+    uint32_t m_accel_ops { 0 };
+    bool m_pins_irqs { true };
 
     int m_active_buffer;
+    std::vector<bga_rect> m_flush_rects;
+
+    uint16_t* m_scanout_buffers[2] { nullptr, nullptr };
+    // The hidden scanout buffer was shown before the last frame, so it
+    // misses the damage of that frame.
+    LG::Region m_scanout_damage;
 
     LG::PixelBitmap m_write_bitmap;
     LG::PixelBitmap m_display_bitmap;
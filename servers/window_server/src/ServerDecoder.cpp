@@ -7,6 +7,7 @@
 #include "ServerDecoder.h"
 #include "Desktop/Window.h"
 #include "Mobile/Window.h"
+#include "ResourceManager.h"
 #include "WindowManager.h"
 
 namespace WinServer {
@@ -53,6 +54,7 @@ std::unique_ptr<Message> WindowServerDecoder::handle(const SetBufferMessage& msg
 
     LG::Size new_size = { msg.bounds().width(), msg.bounds().height() };
     window->did_size_change(new_size);
+    WindowManager::the().invalidate_window_grid();
     window->set_buffer(msg.buffer_id(), new_size, LG::PixelBitmapFormat(msg.format()));
     return nullptr;
 }
@@ -83,6 +85,26 @@ std::unique_ptr<Message> WindowServerDecoder::handle(const InvalidateMessage& ms
     return nullptr;
 }
 
+std::unique_ptr<Message> WindowServerDecoder::handle(const PresentMessage& msg)
+{
+    auto& wm = WindowManager::the();
+    auto* window = wm.window(msg.window_id());
+    if (!window || window->connection_id() != msg.key()) {
+        return nullptr;
+    }
+    if (!window->present(msg.buffer_id())) {
+        return nullptr;
+    }
+
+    // The buffer is latched by the compositor on its next refresh.
+    auto rect = msg.damage();
+    rect.offset_by(window->content_bounds().origin());
+    rect.intersect(window->content_bounds());
+    Compositor::the().invalidate(rect);
+    Compositor::the().request_frame();
+    return nullptr;
+}
+
 #ifdef TARGET_DESKTOP
 std::unique_ptr<Message> WindowServerDecoder::handle(const SetTitleMessage& msg)
 {
@@ -174,4 +196,28 @@ std::unique_ptr<Message> WindowServerDecoder::handle(const AskBringToFrontMessag
     return nullptr;
 }
 
-} // namespace WinServer
\ No newline at end of file
+std::unique_ptr<Message> WindowServerDecoder::handle(const GetImageMessage& msg)
+{
+    auto* image = ResourceManager::the().image(msg.path(), LG::Size(msg.width(), msg.height()));
+    if (!image) {
+        return new GetImageMessageReply(msg.key(), -1, 0, 0, 0);
+    }
+    return new GetImageMessageReply(msg.key(), image->buffer.id(), image->bitmap.width(), image->bitmap.height(), image->bitmap.format());
+}
+
+// A negative overlay leaves the overlay as it is.
+std::unique_ptr<Message> WindowServerDecoder::handle(const GetCompositorStatsMessage& msg)
+{
+    auto& compositor = Compositor::the();
+    if (msg.overlay() >= 0) {
+        compositor.set_stats_overlay(msg.overlay());
+    }
+
+    auto& stats = compositor.stats();
+    auto& us = stats.phase_us;
+    return new GetCompositorStatsMessageReply(msg.key(), stats.frames, stats.frames_skipped, stats.pixels_damaged, stats.pixels_painted, stats.pixels_copied,
+        us[CompositorStats::BackCopy], us[CompositorStats::MoveCopy], us[CompositorStats::Wallpaper], us[CompositorStats::Windows],
+        us[CompositorStats::Popup], us[CompositorStats::MenuBar], us[CompositorStats::Cursor], us[CompositorStats::Swap]);
+}
+
+} // namespace WinServer
@@ -23,9 +23,12 @@ public:
     virtual std::unique_ptr<Message> handle(const SetTitleMessage& msg) override;
     virtual std::unique_ptr<Message> handle(const SetBufferMessage& msg) override;
     virtual std::unique_ptr<Message> handle(const InvalidateMessage& msg) override;
+    virtual std::unique_ptr<Message> handle(const PresentMessage& msg) override;
     virtual std::unique_ptr<Message> handle(const MenuBarCreateMenuMessage& msg) override;
     virtual std::unique_ptr<Message> handle(const MenuBarCreateItemMessage& msg) override;
     virtual std::unique_ptr<Message> handle(const AskBringToFrontMessage& msg) override;
+    virtual std::unique_ptr<Message> handle(const GetImageMessage& msg) override;
+    virtual std::unique_ptr<Message> handle(const GetCompositorStatsMessage& msg) override;
 };
 
 } // namespace WinServer
\ No newline at end of file
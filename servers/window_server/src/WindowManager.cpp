@@ -45,6 +45,7 @@ void WindowManager::setup_dock(Window* window)
     window->set_event_mask(WindowEvent::IconChange | WindowEvent::WindowStatus);
 #endif // TARGET_DESKTOP
     m_dock_window = window;
+    invalidate_window_grid();
 }
 
 void WindowManager::add_window(Window* window)
@@ -53,6 +54,7 @@ void WindowManager::add_window(Window* window)
         setup_dock(window);
     }
     m_windows.push_back(window);
+    invalidate_window_grid();
     set_active_window(window);
     notify_window_status_changed(window->id(), WindowStatusUpdateType::Created);
 }
@@ -88,12 +90,14 @@ void WindowManager::remove_window(Window* window)
     }
     remove_window_from_screen(window);
     m_windows.erase(std::find(m_windows.begin(), m_windows.end(), window));
+    invalidate_window_grid();
     notify_window_status_changed(window->id(), WindowStatusUpdateType::Removed);
 #ifdef TARGET_MOBILE
     if (auto* top_window = get_top_standard_window_in_view(); top_window) {
         m_active_window = top_window;
     }
 #endif
+    window->free_buffers();
     delete window;
 }
 
@@ -104,11 +108,13 @@ void WindowManager::minimize_window(Window& window)
     window.set_visible(false);
     m_windows.erase(std::find(m_windows.begin(), m_windows.end(), window_ptr));
     m_windows.push_back(window_ptr);
+    invalidate_window_grid();
 }
 
 void WindowManager::resize_window(Window& window, const LG::Size& size)
 {
     window.did_size_change(size);
+    invalidate_window_grid();
     send_event(new ResizeMessage(window.connection_id(), window.id(), LG::Rect(0, 0, size.width(), size.height())));
     m_compositor.invalidate(window.bounds());
 }
@@ -193,16 +199,42 @@ bool WindowManager::continue_window_move()
     }
 
     auto bounds = movable_window()->bounds();
-    m_compositor.invalidate(movable_window()->bounds());
     move_window(movable_window(), m_cursor_manager.get<CursorManager::Params::OffsetX>(), m_cursor_manager.get<CursorManager::Params::OffsetY>());
-    bounds.unite(movable_window()->bounds());
-    m_compositor.invalidate(bounds);
+    m_compositor.window_did_move(*movable_window(), bounds);
     return true;
 }
 #endif // TARGET_DESKTOP
 
+WindowManager::Window* WindowManager::window_at(const LG::Point<int>& point)
+{
+    if (!m_window_grid.built()) {
+        m_window_grid.clear();
+        for (auto* window : m_windows) {
+            if (window->visible()) {
+                m_window_grid.add(window->bounds(), window);
+            }
+        }
+        m_window_grid.build();
+    }
+
+    // Windows are added from the top, so the first one hit is on top.
+    Window* top_window = nullptr;
+    m_window_grid.foreach_containing(point, [&](Window* window) {
+        if (!top_window) {
+            top_window = window;
+        }
+    });
+    return top_window;
+}
+
 void WindowManager::update_mouse_position(std::unique_ptr<LFoundation::Event> mouse_event)
 {
+    if (m_cursor_manager.hardware_cursor()) {
+        m_cursor_manager.update_position((WinServer::MouseEvent*)mouse_event.get());
+        m_screen.move_cursor(m_cursor_manager.x(), m_cursor_manager.y());
+        return;
+    }
+
     auto invalidate_bounds = m_cursor_manager.current_cursor().bounds();
     invalidate_bounds.origin().set(m_cursor_manager.draw_position());
     m_compositor.invalidate(invalidate_bounds);
@@ -247,48 +279,40 @@ void WindowManager::receive_mouse_event(std::unique_ptr<LFoundation::Event> even
     }
 
     // Checking and dispatching mouse move for windows/
-    for (auto* window_ptr : m_windows) {
+    if (auto* window_ptr = window_at(LG::Point<int>(m_cursor_manager.x(), m_cursor_manager.y())); window_ptr) {
         auto& window = *window_ptr;
-        if (!window.visible()) {
-            continue;
+        if (m_cursor_manager.pressed<CursorManager::Params::LeftButton>() && m_active_window != &window) {
+            set_active_window(window);
+        }
+        if (m_cursor_manager.pressed<CursorManager::Params::RightButton>() && m_active_window != &window) {
+            set_active_window(window);
         }
 
-        if (window.bounds().contains(m_cursor_manager.x(), m_cursor_manager.y())) {
-            if (m_cursor_manager.pressed<CursorManager::Params::LeftButton>() && m_active_window != &window) {
-                set_active_window(window);
-            }
-            if (m_cursor_manager.pressed<CursorManager::Params::RightButton>() && m_active_window != &window) {
-                set_active_window(window);
+        if (window.frame().bounds().contains(m_cursor_manager.x(), m_cursor_manager.y())) {
+            if (m_cursor_manager.pressed<CursorManager::Params::LeftButton>()) {
+                auto tap_point = LG::Point<int>(m_cursor_manager.x() - window.frame().bounds().min_x(), m_cursor_manager.y() - window.frame().bounds().min_y());
+                window.frame().receive_tap_event(tap_point);
+                start_window_move(window);
             }
-
-            if (window.frame().bounds().contains(m_cursor_manager.x(), m_cursor_manager.y())) {
-                if (m_cursor_manager.pressed<CursorManager::Params::LeftButton>()) {
-                    auto tap_point = LG::Point<int>(m_cursor_manager.x() - window.frame().bounds().min_x(), m_cursor_manager.y() - window.frame().bounds().min_y());
-                    window.frame().receive_tap_event(tap_point);
-                    start_window_move(window);
-                }
-            } else if (window.content_bounds().contains(m_cursor_manager.x(), m_cursor_manager.y())) {
-                LG::Point<int> point(m_cursor_manager.x(), m_cursor_manager.y());
-                point.offset_by(-window.content_bounds().origin());
-                send_event(new MouseMoveMessage(window.connection_id(), window.id(), point.x(), point.y()));
-                new_hovered_window = &window;
-
-                if (m_cursor_manager.is_changed<CursorManager::Params::Buttons>()) {
-                    auto buttons_state = MouseActionState();
-                    if (m_cursor_manager.is_changed<CursorManager::Params::LeftButton>()) {
-                        // TODO: May be remove if?
-                        if (m_cursor_manager.pressed<CursorManager::Params::LeftButton>()) {
-                            buttons_state.set(MouseActionType::LeftMouseButtonPressed);
-                        } else {
-                            buttons_state.set(MouseActionType::LeftMouseButtonReleased);
-                        }
+        } else if (window.content_bounds().contains(m_cursor_manager.x(), m_cursor_manager.y())) {
+            LG::Point<int> point(m_cursor_manager.x(), m_cursor_manager.y());
+            point.offset_by(-window.content_bounds().origin());
+            send_event(new MouseMoveMessage(window.connection_id(), window.id(), point.x(), point.y()));
+            new_hovered_window = &window;
+
+            if (m_cursor_manager.is_changed<CursorManager::Params::Buttons>()) {
+                auto buttons_state = MouseActionState();
+                if (m_cursor_manager.is_changed<CursorManager::Params::LeftButton>()) {
+                    // TODO: May be remove if?
+                    if (m_cursor_manager.pressed<CursorManager::Params::LeftButton>()) {
+                        buttons_state.set(MouseActionType::LeftMouseButtonPressed);
+                    } else {
+                        buttons_state.set(MouseActionType::LeftMouseButtonReleased);
                     }
-
-                    send_event(new MouseActionMessage(window.connection_id(), window.id(), buttons_state.state(), point.x(), point.y()));
                 }
-            }
 
-            break;
+                send_event(new MouseActionMessage(window.connection_id(), window.id(), buttons_state.state(), point.x(), point.y()));
+            }
         }
     }
 
@@ -405,6 +429,7 @@ void WindowManager::notify_window_icon_changed(int changed_window_id)
 #ifdef TARGET_DESKTOP
 void WindowManager::on_window_style_change(Window& window)
 {
+    invalidate_window_grid();
     if (window.visible()) {
         window.frame().invalidate(m_compositor);
     }
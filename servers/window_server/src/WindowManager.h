@@ -18,6 +18,7 @@
 #include <algorithm>
 #include <libfoundation/EventLoop.h>
 #include <libfoundation/EventReceiver.h>
+#include <libg/HitGrid.h>
 #include <libipc/ServerConnection.h>
 #include <list>
 #include <vector>
@@ -64,6 +65,7 @@ public:
             m_windows.erase(std::find(m_windows.begin(), m_windows.end(), window));
             m_windows.push_back(window);
         }
+        invalidate_window_grid();
     }
 
     Window* get_top_standard_window_in_view() const;
@@ -85,6 +87,7 @@ public:
         }
         window->bounds().offset_by(x_offset, y_offset);
         window->content_bounds().offset_by(x_offset, y_offset);
+        invalidate_window_grid();
     }
 
     inline void do_bring_to_front(Window& window)
@@ -92,6 +95,7 @@ public:
         auto* window_ptr = &window;
         m_windows.erase(std::find(m_windows.begin(), m_windows.end(), window_ptr));
         m_windows.push_front(window_ptr);
+        invalidate_window_grid();
     }
     void bring_to_front(Window& window);
 
@@ -115,9 +119,16 @@ public:
 
     void on_window_style_change(Window& win);
 
+    // Visible windows are found under the cursor through a grid of their
+    // bounds. It has to be invalidated when windows move, resize, change
+    // their order or visibility.
+    inline void invalidate_window_grid() { m_window_grid.clear(); }
+
 private:
     void remove_window_from_screen(Window* window);
 
+    Window* window_at(const LG::Point<int>& point);
+
     void start_window_move(Window& window);
     bool continue_window_move();
 
@@ -134,6 +145,7 @@ private:
     inline void send_event(Message* msg) { m_event_loop.add(m_connection, new SendEvent(msg)); }
 
     std::list<Window*> m_windows;
+    LG::HitGrid<Window*> m_window_grid;
 
     Screen& m_screen;
     Connection& m_connection;
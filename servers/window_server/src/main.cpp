@@ -22,23 +22,8 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
-#ifdef TARGET_DESKTOP
-#define LAUNCH_PATH "/System/dock"
-#elif TARGET_MOBILE
-#define LAUNCH_PATH "/System/homescreen"
-#endif
-
-void start_dock()
-{
-    if (fork()) {
-        execve(LAUNCH_PATH, nullptr, nullptr);
-        std::abort();
-    }
-}
-
 void screen_init()
 {
-    start_dock();
     nice(-3);
     new WinServer::Screen();
     new WinServer::LoadingScreen();
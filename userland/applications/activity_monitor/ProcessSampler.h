@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/procstat.h>
+#include <unistd.h>
+#include <vector>
+
+// Takes a snapshot of all processes with one read of /proc/statbin and
+// diffs it against the previous one. The CPU load of a process is its share
+// of the ticks all cpus spent between the two samples.
+class ProcessSampler {
+public:
+    struct Row {
+        int pid;
+        int ppid;
+        uint32_t prio;
+        uint32_t ticks;
+        int cpu_load;
+
+        bool same_text(const Row& other) const { return pid == other.pid && ppid == other.ppid && prio == other.prio && cpu_load == other.cpu_load; }
+    };
+
+    ProcessSampler()
+        : m_buf(sizeof(procstat_header_t) + 64 * sizeof(procstat_t))
+    {
+    }
+
+    // elapsed_ticks is the sum of the ticks of all cpus since the last
+    // sample. Returns false if the snapshot could not be read.
+    bool sample(uint32_t elapsed_ticks)
+    {
+        const procstat_header_t* header = read_snapshot();
+        if (!header) {
+            return false;
+        }
+
+        std::vector<Row> rows;
+        rows.reserve(header->count);
+        const uint8_t* record = (const uint8_t*)(header + 1);
+        size_t old_index = 0;
+        for (uint32_t i = 0; i < header->count; i++, record += header->record_size) {
+            const auto* stat = (const procstat_t*)record;
+            Row row = { stat->pid, stat->ppid, stat->prio, stat->user_ticks + stat->system_ticks, 0 };
+
+            // Both snapshots are ordered by the slot of a process, so the old
+            // row of a pid is found by walking forward.
+            while (old_index < m_rows.size() && m_rows[old_index].pid != row.pid) {
+                old_index++;
+            }
+            if (old_index < m_rows.size() && elapsed_ticks) {
+                uint32_t used = row.ticks - m_rows[old_index].ticks;
+                row.cpu_load = std::min(used * 100 / elapsed_ticks, (uint32_t)100);
+            }
+            if (old_index == m_rows.size()) {
+                old_index = 0;
+            }
+            rows.push_back(row);
+        }
+
+        m_layout_changed = rows.size() != m_rows.size();
+        m_changed_rows.clear();
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (m_layout_changed || rows[i].pid != m_rows[i].pid) {
+                m_layout_changed = true;
+                break;
+            }
+            if (!rows[i].same_text(m_rows[i])) {
+                m_changed_rows.push_back(i);
+            }
+        }
+        m_rows = std::move(rows);
+        return true;
+    }
+
+    const std::vector<Row>& rows() const { return m_rows; }
+
+    // Rows whose text differs from the last sample. It is valid only if no
+    // process came or went, otherwise the whole list has to be reloaded.
+    const std::vector<size_t>& changed_rows() const { return m_changed_rows; }
+    bool layout_changed() const { return m_layout_changed; }
+
+private:
+    const procstat_header_t* read_snapshot()
+    {
+        for (;;) {
+            int fd = open("/proc/statbin", O_RDONLY);
+            if (fd < 0) {
+                return nullptr;
+            }
+            int len = read(fd, (char*)m_buf.data(), m_buf.size());
+            close(fd);
+            if (len < (int)sizeof(procstat_header_t)) {
+                return nullptr;
+            }
+
+            // A full buffer may have cut the list short, it is grown and read again.
+            const auto* header = (const procstat_header_t*)m_buf.data();
+            if (m_buf.size() - len >= header->record_size) {
+                return header;
+            }
+            m_buf.resize(m_buf.size() * 2);
+        }
+    }
+
+    std::vector<uint8_t> m_buf;
+    std::vector<Row> m_rows;
+    std::vector<size_t> m_changed_rows;
+    bool m_layout_changed { true };
+};
@@ -24,49 +24,109 @@ void TerminalView::recalc_dimensions(const LG::Rect& frame)
     m_max_rows = (frame.height() - padding() - UI::SafeArea::Bottom) / glyph_height();
     m_max_cols = (frame.width() - 2 * padding()) / glyph_width();
     // FIXME: Add copy and resize on window resize.
-    m_display_data = (char*)malloc(m_max_rows * m_max_cols);
-    memset((uint8_t*)m_display_data, 0, m_max_rows * m_max_cols);
+    m_dirty_rows = (bool*)malloc(m_max_rows * sizeof(bool));
+    alloc_lines(m_scrollback_limit);
+}
+
+void TerminalView::set_scrollback_limit(size_t limit)
+{
+    alloc_lines(limit);
+    set_needs_display();
+}
+
+void TerminalView::alloc_lines(size_t scrollback_limit)
+{
+    size_t ring_rows = m_max_rows + scrollback_limit;
+    char* lines = (char*)malloc(ring_rows * m_max_cols);
+    memset((uint8_t*)lines, 0, ring_rows * m_max_cols);
+    if (m_lines) {
+        for (size_t i = 0; i < m_max_rows; i++) {
+            memcpy((uint8_t*)&lines[i * m_max_cols], (uint8_t*)line(i), m_max_cols);
+        }
+        free(m_lines);
+    }
+
+    m_lines = lines;
+    m_scrollback_limit = scrollback_limit;
+    m_ring_rows = ring_rows;
+    m_top_line = 0;
+    m_history_rows = 0;
+    m_view_offset = 0;
+    m_needs_full_display = true;
 }
 
 void TerminalView::display(const LG::Rect& rect)
 {
     LG::Context ctx = UI::graphics_current_context();
-    ctx.add_clip(rect);
+    if (m_needs_full_display) {
+        ctx.set_fill_color(background_color());
+        ctx.fill(bounds());
+        memset((uint8_t*)m_dirty_rows, true, m_max_rows * sizeof(bool));
+        m_scrolled_lines = 0;
+        m_needs_full_display = false;
+    }
 
-    ctx.set_fill_color(background_color());
-    ctx.fill(bounds());
+    if (m_scrolled_lines) {
+        size_t lines = std::min(m_scrolled_lines, m_max_rows);
+        LG::Rect moved_rows(0, padding() + lines * glyph_height(), bounds().width(), (m_max_rows - lines) * glyph_height());
+        ctx.copy_rect(moved_rows, { 0, padding() });
+        m_scrolled_lines = 0;
+    }
 
+    // Dirty rows are drawn whole, even if a part of them is out of rect: each
+    // of them has been invalidated in full, so it is all inside the damage.
     auto& f = font();
-    ctx.set_fill_color(font_color());
-    LG::Point<int> text_start { padding(), padding() };
-
-    for (int i = 0; i < m_max_rows; i++) {
-        for (int j = 0; j < m_max_cols; j++) {
-            int idx = i * m_max_cols + j;
-            ctx.draw(text_start, f.glyph_bitmap(m_display_data[idx]));
-            text_start.offset_by(glyph_width(), 0);
+    for (size_t i = 0; i < m_max_rows; i++) {
+        if (!m_dirty_rows[i]) {
+            continue;
+        }
+        m_dirty_rows[i] = false;
+
+        auto row = row_rect(i);
+        ctx.set_fill_color(background_color());
+        ctx.fill(row);
+        ctx.set_fill_color(font_color());
+        ctx.draw_text({ padding(), row.min_y() }, f, visible_line(i), m_max_cols, glyph_width());
+
+        if (i == m_row && !m_view_offset) {
+            ctx.set_fill_color(cursor_color());
+            auto cursor_left_corner = pos_on_screen();
+            ctx.fill(LG::Rect(cursor_left_corner.x(), cursor_left_corner.y(), cursor_width(), glyph_height()));
         }
-        text_start.set_x(padding());
-        text_start.offset_by(0, glyph_height());
     }
+}
 
-    ctx.set_fill_color(cursor_color());
-    auto cursor_left_corner = pos_on_screen();
-    ctx.fill(LG::Rect(cursor_left_corner.x(), cursor_left_corner.y(), cursor_width(), glyph_height()));
+void TerminalView::invalidate_dirty_rows()
+{
+    if (m_scrolled_lines) {
+        set_needs_display();
+        return;
+    }
+
+    for (size_t i = 0; i < m_max_rows; i++) {
+        if (m_dirty_rows[i]) {
+            set_needs_display(row_rect(i));
+        }
+    }
 }
 
 void TerminalView::scroll_line()
 {
     data_do_new_line();
-    set_needs_display();
+    invalidate_dirty_rows();
 }
 
 void TerminalView::data_do_new_line()
 {
-    char* data_plus_line = m_display_data + (m_max_cols);
-    char* data_end_minus_line = m_display_data + (m_max_rows - 1) * m_max_cols;
-    memmove((uint8_t*)m_display_data, (uint8_t*)data_plus_line, (m_max_rows - 1) * m_max_cols);
-    memset((uint8_t*)data_end_minus_line, 0, m_max_cols);
+    // The top line stays in the ring as scrollback, the oldest one is reused.
+    m_top_line = (m_top_line + 1) % m_ring_rows;
+    memset((uint8_t*)line(m_max_rows - 1), 0, m_max_cols);
+    m_history_rows = std::min(m_history_rows + 1, m_scrollback_limit);
+
+    // The pixels of the rows move up with them, so do their dirty marks.
+    memmove((uint8_t*)m_dirty_rows, (uint8_t*)(m_dirty_rows + 1), (m_max_rows - 1) * sizeof(bool));
+    m_dirty_rows[m_max_rows - 1] = true;
+    m_scrolled_lines++;
 }
 
 WindowStatus TerminalView::cursor_positions_do_new_line()
@@ -128,11 +188,30 @@ void TerminalView::decrement_counter()
     did_move_cursor();
 }
 
+void TerminalView::scroll_to_bottom()
+{
+    if (m_view_offset) {
+        m_view_offset = 0;
+        m_needs_full_display = true;
+        set_needs_display();
+    }
+}
+
+void TerminalView::mouse_wheel_event(int wheel_data)
+{
+    int offset = std::max(0, std::min((int)m_view_offset - wheel_data * 3, (int)m_history_rows));
+    if (offset != (int)m_view_offset) {
+        m_view_offset = offset;
+        m_needs_full_display = true;
+        set_needs_display();
+    }
+}
+
 void TerminalView::put_char(char c)
 {
-    auto pt = pos_on_screen();
-    set_needs_display(LG::Rect(pt.x(), pt.y(), glyph_width(), glyph_height()));
-    m_display_data[pos_in_data()] = c;
+    scroll_to_bottom();
+    data_set_char(c);
+    invalidate_dirty_rows();
 }
 
 void TerminalView::push_back_char(char c)
@@ -147,15 +226,7 @@ void TerminalView::push_back_char(char c)
 
 void TerminalView::put_text(const std::string& data)
 {
-    auto current_pos = pos_on_screen();
-    LG::Point<int> top_left_update_location { current_pos.x(), current_pos.y() };
-    LG::Point<int> bottom_right_update_location { current_pos.x(), current_pos.y() };
-    auto set_to_redraw_full_screen = [&]() {
-        data_do_new_line();
-        top_left_update_location = { bounds().min_x(), bounds().min_y() };
-        bottom_right_update_location = { bounds().max_x(), bounds().max_y() };
-    };
-
+    scroll_to_bottom();
     will_move_cursor();
     int n = data.size();
     for (int i = 0; i < n; i++) {
@@ -163,26 +234,16 @@ void TerminalView::put_text(const std::string& data)
         if (c == '\n') {
             auto status = cursor_positions_do_new_line();
             if (status == DoNewLine) {
-                set_to_redraw_full_screen();
+                data_do_new_line();
             }
         } else {
-            auto pt = pos_on_screen();
             data_set_char(c);
             auto status = cursor_position_move_right();
             if (status == DoNewLine) {
-                set_to_redraw_full_screen();
-            } else {
-                top_left_update_location.set_x(std::min(top_left_update_location.x(), pt.x()));
-                top_left_update_location.set_y(std::min(top_left_update_location.y(), pt.y()));
-                bottom_right_update_location.set_x(std::max(bottom_right_update_location.x(), pt.x() + glyph_width()));
-                bottom_right_update_location.set_y(std::max(bottom_right_update_location.y(), pt.y() + glyph_height()));
+                data_do_new_line();
             }
         }
     }
-
-    auto w = bottom_right_update_location.x() - top_left_update_location.x() + 1;
-    auto h = bottom_right_update_location.y() - top_left_update_location.y() + 1;
-    set_needs_display(LG::Rect(top_left_update_location.x(), top_left_update_location.y(), w, h));
     did_move_cursor();
 }
 
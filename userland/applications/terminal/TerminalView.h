@@ -24,7 +24,11 @@ public:
     inline int glyph_height() const { return font().glyph_height(); }
 
     inline LG::Point<int> pos_on_screen() const { return { (int)m_col * glyph_width() + padding(), (int)m_row * glyph_height() + padding() }; }
-    inline int pos_in_data() const { return m_max_cols * m_row + m_col; }
+
+    // Lines which scrolled off the top are kept up to this count, and can be
+    // brought back with the mouse wheel. Changing it drops the lines kept so far.
+    inline size_t scrollback_limit() const { return m_scrollback_limit; }
+    void set_scrollback_limit(size_t limit);
 
     void put_char(char c);
     void put_text(const std::string& data);
@@ -32,6 +36,7 @@ public:
     void display(const LG::Rect& rect) override;
     void receive_keyup_event(UI::KeyUpEvent&) override;
     void receive_keydown_event(UI::KeyDownEvent&) override;
+    void mouse_wheel_event(int wheel_data) override;
 
     int ptmx() const { return m_ptmx; }
 
@@ -42,9 +47,15 @@ private:
     WindowStatus cursor_position_move_right();
     WindowStatus cursor_position_move_left();
     void data_do_new_line();
+    // The screen is the last m_max_rows lines of the ring, the lines above
+    // it are the scrollback.
+    inline char* line(size_t row) { return &m_lines[((m_top_line + row) % m_ring_rows) * m_max_cols]; }
+    inline const char* visible_line(size_t row) const { return &m_lines[((m_top_line + m_ring_rows - m_view_offset + row) % m_ring_rows) * m_max_cols]; }
+
     inline void data_set_char(char c)
     {
-        m_display_data[pos_in_data()] = c;
+        line(m_row)[m_col] = c;
+        m_dirty_rows[m_row] = true;
     }
 
     void scroll_line();
@@ -53,19 +64,20 @@ private:
     void decrement_counter();
 
     void recalc_dimensions(const LG::Rect&);
+    void alloc_lines(size_t scrollback_limit);
+    void scroll_to_bottom();
     void push_back_char(char c);
     void send_input();
 
-    inline void will_move_cursor()
-    {
-        auto pt = pos_on_screen();
-        set_needs_display(LG::Rect(pt.x(), pt.y(), cursor_width() + spacing(), glyph_height()));
-    }
+    inline LG::Rect row_rect(size_t row) const { return LG::Rect(0, padding() + row * glyph_height(), bounds().width(), glyph_height()); }
+    void invalidate_dirty_rows();
+
+    inline void will_move_cursor() { m_dirty_rows[m_row] = true; }
 
     inline void did_move_cursor()
     {
-        auto pt = pos_on_screen();
-        set_needs_display(LG::Rect(pt.x(), pt.y(), cursor_width() + spacing(), glyph_height()));
+        m_dirty_rows[m_row] = true;
+        invalidate_dirty_rows();
     }
 
     LG::Color m_background_color { LG::Color(47, 47, 53) };
@@ -83,5 +95,16 @@ private:
     size_t m_max_rows { 0 };
     size_t m_col { 0 };
     size_t m_row { 0 };
-    char* m_display_data { nullptr };
+    char* m_lines { nullptr };
+    size_t m_scrollback_limit { 1000 };
+    size_t m_ring_rows { 0 };
+    size_t m_top_line { 0 };
+    size_t m_history_rows { 0 };
+    size_t m_view_offset { 0 };
+
+    // Only dirty rows are drawn again, the rest stay in the window buffer as they
+    // are. Lines scrolled since the last display are moved there as pixels.
+    bool* m_dirty_rows { nullptr };
+    size_t m_scrolled_lines { 0 };
+    bool m_needs_full_display { true };
 };
\ No newline at end of file
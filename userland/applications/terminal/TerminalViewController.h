@@ -23,10 +23,13 @@ public:
     {
         LFoundation::EventLoop::the().add(
             view().ptmx(), [this] {
-                char text[256];
-                int cnt = read(view().ptmx(), text, 255);
-                text[cnt] = '\0';
-                view().put_text(std::string(text, cnt));
+                // The pty keeps less than ReadBatch bytes, so a single read takes
+                // everything written so far. The view draws it all at once when
+                // the window displays next.
+                int cnt = read(view().ptmx(), m_read_buffer, ReadBatch);
+                if (cnt > 0) {
+                    view().put_text(std::string(m_read_buffer, cnt));
+                }
             },
             nullptr);
     }
@@ -37,4 +40,6 @@ public:
     }
 
 private:
+    static constexpr size_t ReadBatch = 16 * 1024;
+    char m_read_buffer[ReadBatch];
 };
\ No newline at end of file
@@ -7,6 +7,7 @@
 // includes
 #include <pthread.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +17,10 @@
 #define true (1)
 #define false (0)
 
+#define CMD_PATH_MAX (256)
+#define CMD_NAME_MAX (32)
+#define CMD_HASH_SIZE (64)
+
 char* _cmd_app;
 char* _cmd_buffer;
 char** _cmd_parsed_buffer;
@@ -23,6 +28,26 @@ static int _cmd_buffer_position = 0;
 static int _cmd_parsed_buffer_position = 0;
 static int running_job = 0;
 
+/**
+ * There is no environment in libc yet, so PATH and the working dir are
+ * kept by the shell. The working dir is the logical one, like $PWD.
+ */
+static char _cmd_path_var[CMD_PATH_MAX] = "/bin";
+static char _cmd_cwd[CMD_PATH_MAX] = "/";
+
+/**
+ * Commands found in PATH are remembered, so a command probes the
+ * filesystem only the first time it is run. The table is open addressed
+ * and is cleared as a whole when PATH changes or it fills up.
+ */
+struct cmd_hash_entry {
+    char name[CMD_NAME_MAX];
+    char path[CMD_PATH_MAX];
+    int hits;
+};
+static struct cmd_hash_entry _cmd_hash_table[CMD_HASH_SIZE];
+static int _cmd_hash_count = 0;
+
 uint32_t _is_cmd_internal();
 void _cmd_buffer_clear();
 void _cmd_loop();
@@ -38,20 +63,259 @@ uint32_t _cmd_getkeycode();
 enum internal_cmd_code {
     CMD_NONE = 0,
     CMD_CD,
+    CMD_PWD,
+    CMD_ECHO,
+    CMD_TRUE,
+    CMD_FALSE,
+    CMD_EXPORT,
+    CMD_HASH,
+    CMD_ASSIGN,
+    CMD_COUNT,
+};
+
+static const char* _cmd_internal_names[CMD_COUNT] = {
+    [CMD_CD] = "cd",
+    [CMD_PWD] = "pwd",
+    [CMD_ECHO] = "echo",
+    [CMD_TRUE] = "true",
+    [CMD_FALSE] = "false",
+    [CMD_EXPORT] = "export",
+    [CMD_HASH] = "hash",
 };
 
+static uint32_t _cmd_hash_name(const char* name)
+{
+    uint32_t hash = 5381;
+    while (*name) {
+        hash = hash * 33 + (uint8_t)*name++;
+    }
+    return hash;
+}
+
+static void _cmd_hash_clear()
+{
+    memset(_cmd_hash_table, 0, sizeof(_cmd_hash_table));
+    _cmd_hash_count = 0;
+}
+
+static struct cmd_hash_entry* _cmd_hash_find(const char* name)
+{
+    uint32_t slot = _cmd_hash_name(name) % CMD_HASH_SIZE;
+    for (int i = 0; i < CMD_HASH_SIZE; i++) {
+        struct cmd_hash_entry* entry = &_cmd_hash_table[(slot + i) % CMD_HASH_SIZE];
+        if (!entry->name[0]) {
+            return NULL;
+        }
+        if (strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void _cmd_hash_add(const char* name, const char* path)
+{
+    if (_cmd_hash_count >= CMD_HASH_SIZE / 2) {
+        _cmd_hash_clear();
+    }
+
+    uint32_t slot = _cmd_hash_name(name) % CMD_HASH_SIZE;
+    while (_cmd_hash_table[slot].name[0]) {
+        slot = (slot + 1) % CMD_HASH_SIZE;
+    }
+    strncpy(_cmd_hash_table[slot].name, name, CMD_NAME_MAX - 1);
+    strncpy(_cmd_hash_table[slot].path, path, CMD_PATH_MAX - 1);
+    _cmd_hash_table[slot].hits = 0;
+    _cmd_hash_count++;
+}
+
+static int _cmd_file_exists(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+/**
+ * Puts the path to run for the command into res. Names with a slash are
+ * taken as they are, others are looked up in the hash table and then in
+ * every dir of PATH.
+ */
+static int _cmd_resolve(const char* name, char* res)
+{
+    if (strchr(name, '/')) {
+        strncpy(res, name, CMD_PATH_MAX - 1);
+        return true;
+    }
+
+    size_t namelen = strlen(name);
+    if (namelen >= CMD_NAME_MAX) {
+        return false;
+    }
+
+    struct cmd_hash_entry* entry = _cmd_hash_find(name);
+    if (entry) {
+        entry->hits++;
+        strcpy(res, entry->path);
+        return true;
+    }
+
+    const char* dir = _cmd_path_var;
+    while (*dir) {
+        const char* end = strchr(dir, ':');
+        size_t dirlen = end ? (size_t)(end - dir) : strlen(dir);
+        if (dirlen && dirlen + namelen + 2 <= CMD_PATH_MAX) {
+            memcpy(res, dir, dirlen);
+            res[dirlen] = '/';
+            memcpy(res + dirlen + 1, name, namelen + 1);
+            if (_cmd_file_exists(res)) {
+                _cmd_hash_add(name, res);
+                return true;
+            }
+        }
+        if (!end) {
+            break;
+        }
+        dir = end + 1;
+    }
+    return false;
+}
+
+static int _cmd_set_var(const char* assignment)
+{
+    if (memcmp(assignment, "PATH=", 5) != 0) {
+        return 0;
+    }
+
+    const char* value = assignment + 5;
+    if (strlen(value) >= CMD_PATH_MAX) {
+        return -1;
+    }
+    if (strcmp(value, _cmd_path_var) != 0) {
+        strcpy(_cmd_path_var, value);
+        _cmd_hash_clear();
+    }
+    return 0;
+}
+
+/**
+ * Applies path to the logical working dir in place, dropping "." and
+ * resolving ".." by name the way cd of other shells does.
+ */
+static void _cmd_cwd_apply(const char* path)
+{
+    char buf[CMD_PATH_MAX];
+    if (path[0] == '/') {
+        strncpy(buf, path, CMD_PATH_MAX - 1);
+    } else {
+        snprintf(buf, CMD_PATH_MAX, "%s/%s", _cmd_cwd, path);
+    }
+    buf[CMD_PATH_MAX - 1] = '\0';
+
+    size_t len = 0;
+    char* part = buf;
+    while (*part) {
+        while (*part == '/') {
+            part++;
+        }
+        char* end = part;
+        while (*end && *end != '/') {
+            end++;
+        }
+        size_t partlen = end - part;
+        if (partlen == 2 && part[0] == '.' && part[1] == '.') {
+            while (len > 0 && _cmd_cwd[--len] != '/') {
+            }
+        } else if (partlen && !(partlen == 1 && part[0] == '.')) {
+            _cmd_cwd[len++] = '/';
+            memcpy(_cmd_cwd + len, part, partlen);
+            len += partlen;
+        }
+        part = end;
+    }
+
+    if (!len) {
+        _cmd_cwd[len++] = '/';
+    }
+    _cmd_cwd[len] = '\0';
+}
+
 uint32_t _is_cmd_internal()
 {
-    if (memcmp(_cmd_buffer, "cd", 2) == 0) {
-        return CMD_CD;
+    const char* name = _cmd_parsed_buffer[0];
+    for (int code = CMD_NONE + 1; code < CMD_COUNT; code++) {
+        if (_cmd_internal_names[code] && strcmp(name, _cmd_internal_names[code]) == 0) {
+            return code;
+        }
+    }
+    if (strchr(name, '=')) {
+        return CMD_ASSIGN;
     }
     return CMD_NONE;
 }
 
+/**
+ * Builtins run in the shell itself, without a fork and an exec.
+ */
 int _cmd_do_internal(uint32_t code)
 {
-    if (code == CMD_CD) {
-        return chdir(_cmd_parsed_buffer[1]);
+    char** argv = _cmd_parsed_buffer;
+    switch (code) {
+    case CMD_CD: {
+        const char* path = argv[1] ? argv[1] : "/";
+        int res = chdir(path);
+        if (res == 0) {
+            _cmd_cwd_apply(path);
+        }
+        return res;
+    }
+
+    case CMD_PWD:
+        write(1, _cmd_cwd, strlen(_cmd_cwd));
+        write(1, "\n", 1);
+        return 0;
+
+    case CMD_ECHO:
+        for (int i = 1; argv[i]; i++) {
+            if (i > 1) {
+                write(1, " ", 1);
+            }
+            write(1, argv[i], strlen(argv[i]));
+        }
+        write(1, "\n", 1);
+        return 0;
+
+    case CMD_TRUE:
+        return 0;
+
+    case CMD_FALSE:
+        return 1;
+
+    case CMD_EXPORT:
+        for (int i = 1; argv[i]; i++) {
+            _cmd_set_var(argv[i]);
+        }
+        return 0;
+
+    case CMD_ASSIGN:
+        return _cmd_set_var(argv[0]);
+
+    case CMD_HASH:
+        if (argv[1] && strcmp(argv[1], "-r") == 0) {
+            _cmd_hash_clear();
+            return 0;
+        }
+        for (int i = 0; i < CMD_HASH_SIZE; i++) {
+            struct cmd_hash_entry* entry = &_cmd_hash_table[i];
+            if (entry->name[0]) {
+                printf("%d\t%s\n", entry->hits, entry->path);
+            }
+        }
+        fflush(stdout);
+        return 0;
     }
     return 0;
 }
@@ -102,19 +366,25 @@ void _cmd_processor()
 
     _cmd_buffer[_cmd_buffer_position - 1] = '\0';
     _cmd_parsed_buffer[_cmd_parsed_buffer_position] = 0;
+    if (!_cmd_parsed_buffer_position) {
+        return;
+    }
 
     uint32_t cmd = _is_cmd_internal();
     if (cmd == CMD_NONE) {
-        uint32_t namelen = strlen(_cmd_parsed_buffer[0]);
-        memcpy(_cmd_app + 5, _cmd_buffer, namelen + 1);
+        if (!_cmd_resolve(_cmd_parsed_buffer[0], _cmd_app)) {
+            return;
+        }
 
-        int res = fork();
-        if (!res) {
-            execve(_cmd_app, &_cmd_parsed_buffer[1], 0);
-            exit(-1);
+        pid_t pid;
+        if (posix_spawn(&pid, _cmd_app, NULL, NULL, &_cmd_parsed_buffer[1], NULL) == 0) {
+            running_job = pid;
+            wait(pid);
         } else {
-            running_job = res;
-            wait(res);
+            /* The binary may be gone, the next run looks it up again. */
+            if (_cmd_hash_find(_cmd_parsed_buffer[0])) {
+                _cmd_hash_clear();
+            }
         }
     } else {
         _cmd_do_internal(cmd);
@@ -148,10 +418,9 @@ int main()
     sigaction(3, inter);
     ioctl(0, TIOCSPGRP, getpgid(getpid()));
     ioctl(0, TIOCGPGRP, 0);
-    _cmd_app = malloc(256);
+    _cmd_app = malloc(CMD_PATH_MAX);
     _cmd_buffer = malloc(256);
     _cmd_parsed_buffer = malloc(256 * sizeof(char*));
-    memcpy(_cmd_app, "/bin/", 5);
     _cmd_loop();
 
     return 0;
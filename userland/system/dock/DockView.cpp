@@ -4,9 +4,10 @@
 #include <libfoundation/EventLoop.h>
 #include <libfoundation/KeyboardMapping.h>
 #include <libg/Color.h>
-#include <libg/ImageLoaders/PNGLoader.h>
 #include <libui/App.h>
+#include <libui/Connection.h>
 #include <libui/Context.h>
+#include <spawn.h>
 #include <unistd.h>
 
 static DockView* this_view;
@@ -41,24 +42,41 @@ void DockView::display(const LG::Rect& rect)
     // Drawing launched icons
     int offsetx = fast_access_dock.min_x() + padding();
     for (auto& entity : m_fast_launch_entites) {
-        ctx.draw({ offsetx, 2 }, entity.icon());
-        offsetx += entity.icon().bounds().width() + padding();
+        draw_icon(ctx, offsetx, entity.icon());
+        offsetx += icon_size() + padding();
     }
 
     offsetx = opened_apps_dock.min_x() + padding();
     for (auto& entity : m_dock_entites) {
-        ctx.draw({ offsetx, 2 }, entity.icon());
-        ctx.fill(LG::Rect(offsetx, 34, 32, 2));
-        offsetx += entity.icon().bounds().width() + padding();
+        draw_icon(ctx, offsetx, entity.icon());
+        ctx.set_fill_color(LG::Color(255, 255, 255, 135));
+        ctx.fill(LG::Rect(offsetx, 34, icon_size(), 2));
+        offsetx += icon_size() + padding();
     }
 }
 
+// Icons come from the server after the dock is up, a slot stays empty
+// until its icon is there.
+void DockView::draw_icon(LG::Context& ctx, int x, const LG::PixelBitmap& icon)
+{
+    if (!icon.width()) {
+        ctx.set_fill_color(LG::Color(255, 255, 255, 60));
+        ctx.fill_rounded(LG::Rect(x, 2, icon_size(), icon_size()), LG::CornerMask(6));
+        return;
+    }
+    ctx.draw({ x, 2 }, icon);
+}
+
 void DockView::new_fast_launch_entity(const LG::string& icon_path, LG::string&& exec_path)
 {
-    LG::PNG::PNGLoader loader;
     m_fast_launch_entites.push_back(FastLaunchEntity());
-    m_fast_launch_entites.back().set_icon(loader.load_from_file(icon_path + "/32x32.png"));
-    m_fast_launch_entites.back().set_path_to_exec(std::move(exec_path));
+    auto* ent = &m_fast_launch_entites.back();
+    ent->set_path_to_exec(std::move(exec_path));
+    // Fast-launch entities are never removed, so the pointer stays valid.
+    UI::Connection::the().image_async(icon_path + "/32x32.png", LG::Size(icon_size(), icon_size()), [this, ent](LG::PixelBitmap icon) {
+        ent->set_icon(std::move(icon));
+        set_needs_display();
+    });
     set_needs_display();
 }
 
@@ -88,21 +106,22 @@ void DockView::remove_entity(int window_id)
 
 void DockView::set_icon(int window_id, const LG::string& path)
 {
-    auto* ent = find_entity(window_id);
-    if (!ent) {
+    if (!find_entity(window_id)) {
         return;
     }
-    LG::PNG::PNGLoader loader;
-    ent->set_icon(loader.load_from_file(path + "/32x32.png"));
-    set_needs_display();
+
+    // The window may be gone by the time the icon comes.
+    UI::Connection::the().image_async(path + "/32x32.png", LG::Size(icon_size(), icon_size()), [this, window_id](LG::PixelBitmap icon) {
+        if (auto* ent = find_entity(window_id)) {
+            ent->set_icon(std::move(icon));
+            set_needs_display();
+        }
+    });
 }
 
 void DockView::launch(const FastLaunchEntity& ent)
 {
-    if (fork() == 0) {
-        execve(ent.path_to_exec().c_str(), 0, 0);
-        std::abort();
-    }
+    posix_spawn(nullptr, ent.path_to_exec().c_str(), nullptr, nullptr, nullptr, nullptr);
 }
 
 void DockView::mouse_down(const LG::Point<int>& location)
@@ -114,7 +133,7 @@ void DockView::mouse_down(const LG::Point<int>& location)
         if (it.contains(location)) {
             launch(entity);
         }
-        offsetx += entity.icon().bounds().width() + 8;
+        offsetx += icon_size() + 8;
     }
 
     offsetx += 8;
@@ -126,6 +145,6 @@ void DockView::mouse_down(const LG::Point<int>& location)
             app.connection().send_async_message(msg);
             return;
         }
-        offsetx += entity.icon().bounds().width() + 8;
+        offsetx += icon_size() + 8;
     }
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include "DockEntity.h"
 #include "FastLaunchEntity.h"
+#include <libg/Context.h>
 #include <libg/Font.h>
 #include <libui/View.h>
 #include <list>
@@ -15,6 +16,7 @@ public:
 
     static constexpr size_t padding() { return 8; }
     static constexpr size_t dock_view_height() { return 36; }
+    static constexpr size_t icon_size() { return 32; }
 
     void display(const LG::Rect& rect) override;
     void mouse_down(const LG::Point<int>& location) override;
@@ -28,6 +30,7 @@ public:
 
 private:
     void launch(const FastLaunchEntity& ent);
+    void draw_icon(LG::Context& ctx, int x, const LG::PixelBitmap& icon);
 
     std::list<FastLaunchEntity> m_fast_launch_entites {};
     std::list<DockEntity> m_dock_entites {};
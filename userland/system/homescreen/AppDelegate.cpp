@@ -13,7 +13,7 @@ public:
     bool application() override
     {
         auto& window = std::pranaos::construct<HomeScreenWindow>(window_size());
-        window.set_bitmap_format(LG::PixelBitmapFormat::RGBA); // Turning on Alpha channel
+        window.set_bitmap_format(LG::PixelBitmapFormat::RGBA_Premultiplied); // Turning on Alpha channel
         auto& dock_view = window.create_superview<HomeScreenView, HomeScreenViewController>();
 
         window.set_title("Homescreen");
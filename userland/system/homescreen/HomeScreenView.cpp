@@ -5,8 +5,8 @@
 #include <libfoundation/EventLoop.h>
 #include <libfoundation/KeyboardMapping.h>
 #include <libg/Color.h>
-#include <libg/ImageLoaders/PNGLoader.h>
 #include <libui/App.h>
+#include <libui/Connection.h>
 #include <libui/Context.h>
 #include <libui/StackView.h>
 #include <unistd.h>
@@ -69,7 +69,6 @@ void HomeScreenView::display(const LG::Rect& rect)
 void HomeScreenView::new_grid_entity(const LG::string& title, const LG::string& icon_path, LG::string&& exec_path)
 {
     // TODO: Add pages.
-    LG::PNG::PNGLoader loader;
     int row_to_put_to = 0;
     for (int i = 0; i < grid_entities_per_column(); i++) {
         if (m_grid_stackviews[i]->subviews().size() < grid_entities_per_row()) {
@@ -81,7 +80,7 @@ void HomeScreenView::new_grid_entity(const LG::string& title, const LG::string&
     icon_view.add_constraint(UI::Constraint(icon_view, UI::Constraint::Attribute::Height, UI::Constraint::Relation::Equal, icon_view_size()));
     icon_view.add_constraint(UI::Constraint(icon_view, UI::Constraint::Attribute::Width, UI::Constraint::Relation::Equal, icon_view_size()));
     icon_view.set_title(title);
-    icon_view.entity().set_icon(loader.load_from_file(icon_path + "/48x48.png"));
+    icon_view.set_icon_path(icon_path + "/48x48.png");
     icon_view.entity().set_path_to_exec(std::move(exec_path));
     set_needs_layout();
 }
@@ -92,11 +91,10 @@ void HomeScreenView::new_fast_launch_entity(const LG::string& title, const LG::s
         return;
     }
 
-    LG::PNG::PNGLoader loader;
     auto& icon_view = m_dock_stackview->add_arranged_subview<IconView>();
     icon_view.add_constraint(UI::Constraint(icon_view, UI::Constraint::Attribute::Height, UI::Constraint::Relation::Equal, icon_view_size()));
     icon_view.add_constraint(UI::Constraint(icon_view, UI::Constraint::Attribute::Width, UI::Constraint::Relation::Equal, icon_view_size()));
-    icon_view.entity().set_icon(loader.load_from_file(icon_path + "/48x48.png"));
+    icon_view.set_icon_path(icon_path + "/48x48.png");
     icon_view.entity().set_path_to_exec(std::move(exec_path));
     set_needs_layout();
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "IconView.h"
 #include "HomeScreenView.h"
+#include <libui/Connection.h>
 #include <libui/Context.h>
 #include <libui/Label.h>
 
@@ -8,6 +9,8 @@ IconView::IconView(View* superview, const LG::Rect& frame)
 {
     m_label = &add_subview<UI::Label>(LG::Rect(0, HomeScreenView::icon_view_size() - 12, HomeScreenView::icon_view_size(), 12));
     m_label->set_alignment(UI::Text::Alignment::Center);
+    // Icons stay the same while the home screen redraws around them.
+    set_layer_backed(true);
 }
 
 void IconView::display(const LG::Rect& rect)
@@ -15,5 +18,29 @@ void IconView::display(const LG::Rect& rect)
     const int offset_x = (HomeScreenView::icon_view_size() - HomeScreenView::icon_size()) / 2;
     LG::Context ctx = UI::graphics_current_context();
     ctx.add_clip(rect);
+
+    if (!m_icon_requested) {
+        request_icon();
+    }
+    if (!m_launch_entity.icon().width()) {
+        ctx.set_fill_color(LG::Color(255, 255, 255, 60));
+        ctx.fill_rounded(LG::Rect(offset_x, 0, HomeScreenView::icon_size(), HomeScreenView::icon_size()), LG::CornerMask(10));
+        return;
+    }
     ctx.draw({ offset_x, 0 }, m_launch_entity.icon());
+}
+
+void IconView::request_icon()
+{
+    m_icon_requested = true;
+    if (m_icon_path.empty()) {
+        return;
+    }
+
+    // Icon views live as long as the home screen.
+    auto size = LG::Size(HomeScreenView::icon_size(), HomeScreenView::icon_size());
+    UI::Connection::the().image_async(m_icon_path, size, [this](LG::PixelBitmap icon) {
+        m_launch_entity.set_icon(std::move(icon));
+        set_needs_display();
+    });
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <libui/Label.h>
 #include <libui/View.h>
 #include <list>
+#include <spawn.h>
 #include <string>
 #include <unistd.h>
 
@@ -25,18 +26,23 @@ public:
         m_label->set_text(title);
     }
 
+    // The icon is asked for when the view is displayed the first time, so
+    // icons which are never shown are never decoded.
+    void set_icon_path(const std::string& path) { m_icon_path = path, m_icon_requested = false; }
+
     FastLaunchEntity& entity() { return m_launch_entity; }
     const FastLaunchEntity& entity() const { return m_launch_entity; }
 
 private:
     void launch(const std::string& path_to_exec)
     {
-        if (fork() == 0) {
-            execve(path_to_exec.c_str(), 0, 0);
-            std::abort();
-        }
+        posix_spawn(nullptr, path_to_exec.c_str(), nullptr, nullptr, nullptr, nullptr);
     }
 
+    void request_icon();
+
     UI::Label* m_label;
     FastLaunchEntity m_launch_entity;
+    std::string m_icon_path;
+    bool m_icon_requested { false };
 };
\ No newline at end of file
@@ -1,11 +1,96 @@
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
 #include <unistd.h>
 
+/**
+ * Services are started as soon as the service they come after is up, so
+ * ones which don't depend on each other come up in parallel. A service is
+ * up once its ready path exists, or right after its start if it has none.
+ */
+enum service_state {
+    SERVICE_WAITING,
+    SERVICE_STARTED,
+    SERVICE_UP,
+};
+
+struct service {
+    const char* path;
+    int after; /* index of the service to wait for, -1 for none */
+    const char* ready_path;
+    int state;
+    int pid;
+};
+
+#ifdef TARGET_DESKTOP
+#define SHELL_PATH "/System/dock"
+#elif TARGET_MOBILE
+#define SHELL_PATH "/System/homescreen"
+#endif
+
+static struct service services[] = {
+    { .path = "/System/window_server", .after = -1, .ready_path = "/tmp/win.sock" },
+    { .path = SHELL_PATH, .after = 0, .ready_path = NULL },
+};
+#define SERVICES_COUNT (sizeof(services) / sizeof(struct service))
+
+static int service_is_ready(struct service* service)
+{
+    if (!service->ready_path) {
+        return 1;
+    }
+
+    int fd = open(service->ready_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    close(fd);
+    return 1;
+}
+
+static void service_start(struct service* service)
+{
+    int pid = fork();
+    if (pid == 0) {
+        execve(service->path, NULL, NULL);
+        exit(1);
+    }
+    service->pid = pid;
+    service->state = SERVICE_STARTED;
+}
+
+static int services_step()
+{
+    int pending = 0;
+    for (int i = 0; i < SERVICES_COUNT; i++) {
+        struct service* service = &services[i];
+        if (service->state == SERVICE_WAITING) {
+            if (service->after < 0 || services[service->after].state == SERVICE_UP) {
+                service_start(service);
+            }
+        }
+        if (service->state == SERVICE_STARTED && service_is_ready(service)) {
+            service->state = SERVICE_UP;
+        }
+        if (service->state != SERVICE_UP) {
+            pending++;
+        }
+    }
+    return pending;
+}
+
 int main(int argc, char** argv)
 {
 #ifdef BENCHMARK
     execve("/bin/bench", 0, 0);
     return 0;
 #endif
-    execve("/System/window_server", 0, 0);
+    while (services_step()) {
+        sched_yield();
+    }
+
+    for (int i = 0; i < SERVICES_COUNT; i++) {
+        wait(services[i].pid);
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -3,19 +3,26 @@
 #include <ctime>
 #include <sys/time.h>
 
-#define RUN_BENCH(name, x) for (bench_run = 0, bench_pno = bench_no, gettimeofday(&tv, &tz); bench_run < x; gettimeofday(&ttv, &tz), printf("[BENCH][%s] %d (usec)\n", name, to_usec()), fflush(stdout), bench_run++, gettimeofday(&tv, &tz))
+/**
+ * The body runs warmup + x times, only the last x runs are timed. Every
+ * bench prints one line with its samples and their min, median and p99
+ * in ns, which bench.py parses.
+ */
+#define BENCH_WARMUP_RUNS (1)
+#define BENCH_MAX_RUNS (64)
 
-extern int bench_pno;
-extern int bench_no;
-extern int bench_run;
-extern timeval_t tv, ttv;
-extern timezone_t tz;
+#define RUN_BENCH(name, x) for (bench_begin(name, x, BENCH_WARMUP_RUNS); bench_next();)
+// For benches whose first run is the one to measure, like faults on fresh pages.
+#define RUN_BENCH_COLD(name, x) for (bench_begin(name, x, 0); bench_next();)
 
-static inline int to_usec()
-{
-    int sec = ttv.tv_sec - tv.tv_sec;
-    int diff = ttv.tv_usec - tv.tv_usec;
-    return sec * 1000000 + diff;
-}
+void bench_begin(const char* name, int runs, int warmup);
+bool bench_next();
 
-void bench_pngloader();
\ No newline at end of file
+void bench_kernel();
+void bench_malloc();
+void bench_string();
+void bench_fs();
+void bench_pngloader();
+void bench_graphics();
+void bench_ipc();
+void bench_compress();
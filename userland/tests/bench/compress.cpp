@@ -0,0 +1,39 @@
+#include "common.h"
+#include <cstdio>
+#include <cstring>
+#include <libfoundation/compress/lz4.h>
+
+static const size_t data_size = 64 * 1024;
+static char data[data_size];
+static char packed[LZ4_COMPRESS_BOUND(data_size)];
+static char unpacked[data_size];
+static lz4_ctx_t ctx;
+
+void bench_compress()
+{
+    // Text-like data: words from a small dictionary with varying numbers.
+    static const char* words[] = { "window ", "buffer ", "event ", "pixel ", "thread ", "= ", "{\n", "}\n" };
+    size_t len = 0;
+    for (int i = 0; len < data_size - 16; i++) {
+        len += snprintf(data + len, 16, "%s%d ", words[(i * 7) % 8], i % 97);
+    }
+
+    int packed_len = 0;
+    RUN_BENCH("LZ4 COMPRESS 64K", 3)
+    {
+        for (int i = 0; i < 16; i++) {
+            packed_len = lz4_compress(&ctx, data, data_size, packed, sizeof(packed));
+        }
+    }
+
+    RUN_BENCH("LZ4 DECOMPRESS 64K", 3)
+    {
+        for (int i = 0; i < 16; i++) {
+            lz4_decompress(packed, packed_len, unpacked, sizeof(unpacked));
+        }
+    }
+
+    if (memcmp(data, unpacked, data_size)) {
+        printf("LZ4 roundtrip mismatch\n");
+    }
+}
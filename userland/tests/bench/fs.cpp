@@ -0,0 +1,65 @@
+#include "common.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define BENCH_FILE_PATH "/home/root/.bench"
+#define BENCH_FILE_SIZE (1024 * 1024)
+#define BENCH_CHUNK (4096)
+
+static char chunk[BENCH_CHUNK];
+
+// Offsets are picked by an LCG, so every run touches the same blocks.
+static off_t next_random_offset(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return (off_t)((seed >> 8) % (BENCH_FILE_SIZE / BENCH_CHUNK)) * BENCH_CHUNK;
+}
+
+void bench_fs()
+{
+    int fd = open(BENCH_FILE_PATH, O_RDWR | O_CREAT | O_TRUNC);
+    if (fd < 0) {
+        return;
+    }
+
+    RUN_BENCH("EXT2 SEQ WRITE", 3)
+    {
+        lseek(fd, 0, SEEK_SET);
+        for (int i = 0; i < BENCH_FILE_SIZE / BENCH_CHUNK; i++) {
+            write(fd, chunk, BENCH_CHUNK);
+        }
+        fsync(fd);
+    }
+
+    RUN_BENCH("EXT2 SEQ READ", 3)
+    {
+        lseek(fd, 0, SEEK_SET);
+        for (int i = 0; i < BENCH_FILE_SIZE / BENCH_CHUNK; i++) {
+            read(fd, chunk, BENCH_CHUNK);
+        }
+    }
+
+    uint32_t seed = 1;
+    RUN_BENCH("EXT2 RANDOM WRITE", 3)
+    {
+        for (int i = 0; i < 128; i++) {
+            lseek(fd, next_random_offset(seed), SEEK_SET);
+            write(fd, chunk, BENCH_CHUNK);
+        }
+        fsync(fd);
+    }
+
+    seed = 1;
+    RUN_BENCH("EXT2 RANDOM READ", 3)
+    {
+        for (int i = 0; i < 128; i++) {
+            lseek(fd, next_random_offset(seed), SEEK_SET);
+            read(fd, chunk, BENCH_CHUNK);
+        }
+    }
+
+    close(fd);
+    unlink(BENCH_FILE_PATH);
+}
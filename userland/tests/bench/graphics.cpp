@@ -0,0 +1,73 @@
+#include "common.h"
+#include <cstring>
+#include <libg/Context.h>
+#include <libg/ImageLoaders/PNGLoader.h>
+
+#define BENCH_SCREEN_WIDTH (1024)
+#define BENCH_SCREEN_HEIGHT (768)
+
+static const char* sample_text = "The quick brown fox jumps over the lazy dog 0123456789";
+
+void bench_graphics()
+{
+    LG::PixelBitmap screen(BENCH_SCREEN_WIDTH, BENCH_SCREEN_HEIGHT);
+    LG::PixelBitmap window(400, 300);
+    LG::PixelBitmap translucent(400, 300, LG::PixelBitmapFormat::RGBA);
+    for (size_t y = 0; y < translucent.height(); y++) {
+        for (size_t x = 0; x < translucent.width(); x++) {
+            translucent[y][x] = LG::Color(40, 80, 120, 128);
+        }
+    }
+
+    LG::PNG::PNGLoader loader;
+    LG::PixelBitmap wallpaper = loader.load_from_file("/res/wallpapers/mountain_orange.png");
+    LG::Context ctx(screen);
+
+    RUN_BENCH("LIBG FILL", 3)
+    {
+        ctx.set_fill_color(LG::Color::LightSystemBackground);
+        for (int i = 0; i < 20; i++) {
+            ctx.fill(LG::Rect(0, 0, BENCH_SCREEN_WIDTH, BENCH_SCREEN_HEIGHT));
+        }
+    }
+
+    RUN_BENCH("LIBG BLIT", 3)
+    {
+        for (int i = 0; i < 100; i++) {
+            ctx.draw({ (i * 7) % 600, (i * 5) % 400 }, window);
+        }
+    }
+
+    RUN_BENCH("LIBG BLEND", 3)
+    {
+        for (int i = 0; i < 100; i++) {
+            ctx.draw({ (i * 7) % 600, (i * 5) % 400 }, translucent);
+        }
+    }
+
+    RUN_BENCH("LIBG TEXT", 3)
+    {
+        ctx.set_fill_color(LG::Color::Black);
+        for (int i = 0; i < 500; i++) {
+            ctx.draw_text({ 10, (i * 13) % 740 }, LG::Font::system_font(), sample_text, strlen(sample_text));
+        }
+    }
+
+    // What the compositor does for a frame with a few windows on screen:
+    // wallpaper, shadows, rounded windows, the menu bar and its text.
+    RUN_BENCH("COMPOSITOR FRAME", 3)
+    {
+        for (int frame = 0; frame < 10; frame++) {
+            ctx.set(LG::Point<int>(0, 0), wallpaper);
+            for (int win = 0; win < 4; win++) {
+                LG::Rect bounds(60 + win * 120, 60 + win * 80, window.width(), window.height());
+                ctx.draw_box_shading(bounds, LG::Shading(LG::Shading::Box, 0, LG::Shading::SystemSpread), LG::CornerMask(4));
+                ctx.draw_rounded(bounds.origin(), window, LG::CornerMask(4));
+            }
+            ctx.set_fill_color(LG::Color(255, 255, 255, 200));
+            ctx.mix(LG::Rect(0, 0, BENCH_SCREEN_WIDTH, 24));
+            ctx.set_fill_color(LG::Color::Black);
+            ctx.draw_text({ 8, 6 }, LG::Font::system_bold_font(), sample_text, 20);
+        }
+    }
+}
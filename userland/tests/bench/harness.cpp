@@ -0,0 +1,103 @@
+#include "common.h"
+#include <cstdint>
+#include <cstdio>
+
+#ifdef __i386__
+typedef uint64_t bench_cycles_t;
+#elif __arm__
+typedef uint32_t bench_cycles_t;
+#endif
+
+static const char* bench_name;
+static int bench_runs;
+static int bench_warmup;
+static int bench_run;
+static bench_cycles_t bench_start_cycles;
+static timeval_t bench_start_tv;
+static timezone_t bench_tz;
+static uint64_t bench_samples[BENCH_MAX_RUNS];
+
+// The counter the kernel measures in the time page: the TSC on x86 and the
+// PMU cycle counter on arm, both are readable from userspace.
+static inline bench_cycles_t bench_cycles()
+{
+#ifdef __i386__
+    uint32_t lo, hi;
+    asm volatile("rdtsc"
+                 : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#elif __arm__
+    uint32_t res;
+    asm volatile("mrc p15, 0, %0, c9, c13, 0"
+                 : "=r"(res));
+    return res;
+#endif
+}
+
+static inline void bench_start()
+{
+    gettimeofday(&bench_start_tv, &bench_tz);
+    bench_start_cycles = bench_cycles();
+}
+
+// Falls back to gettimeofday() till the kernel has measured the counter.
+static uint64_t bench_stop()
+{
+    bench_cycles_t cycles = bench_cycles() - bench_start_cycles;
+    uint32_t cycles_per_second = ((volatile time_page_t*)TIME_PAGE_VADDR)->cycles_per_second;
+    if (cycles_per_second) {
+        return (uint64_t)((double)cycles * 1e9 / cycles_per_second);
+    }
+
+    timeval_t tv;
+    gettimeofday(&tv, &bench_tz);
+    return ((uint64_t)(tv.tv_sec - bench_start_tv.tv_sec) * 1000000 + (tv.tv_usec - bench_start_tv.tv_usec)) * 1000;
+}
+
+static void bench_report()
+{
+    int n = bench_runs;
+    for (int i = 1; i < n; i++) {
+        uint64_t val = bench_samples[i];
+        int j = i - 1;
+        for (; j >= 0 && bench_samples[j] > val; j--) {
+            bench_samples[j + 1] = bench_samples[j];
+        }
+        bench_samples[j + 1] = val;
+    }
+
+    int p99 = (n * 99 + 99) / 100 - 1;
+    printf("[BENCH][%s] {\"unit\": \"ns\", \"samples\": [", bench_name);
+    for (int i = 0; i < n; i++) {
+        printf(i ? ", %llu" : "%llu", bench_samples[i]);
+    }
+    printf("], \"min\": %llu, \"median\": %llu, \"p99\": %llu}\n", bench_samples[0], bench_samples[n / 2], bench_samples[p99]);
+    fflush(stdout);
+}
+
+void bench_begin(const char* name, int runs, int warmup)
+{
+    bench_name = name;
+    bench_runs = runs < BENCH_MAX_RUNS ? runs : BENCH_MAX_RUNS;
+    bench_warmup = warmup;
+    bench_run = -1;
+}
+
+bool bench_next()
+{
+    if (bench_run >= 0) {
+        uint64_t elapsed = bench_stop();
+        if (bench_run >= bench_warmup) {
+            bench_samples[bench_run - bench_warmup] = elapsed;
+        }
+    }
+
+    bench_run++;
+    if (bench_run == bench_warmup + bench_runs) {
+        bench_report();
+        return false;
+    }
+
+    bench_start();
+    return true;
+}
@@ -0,0 +1,61 @@
+#include "../../../servers/window_server/shared/Connections/WSConnection.h"
+#include "common.h"
+#include <libfoundation/EventLoop.h>
+
+class BenchReceiver : public LFoundation::EventReceiver {
+public:
+    void receive_event(std::unique_ptr<LFoundation::Event> event) override { m_received++; }
+
+private:
+    int m_received { 0 };
+};
+
+static void bench_ipc_coding()
+{
+    EncodedMessage buffer;
+    buffer.reserve(1000 * MouseMoveMessage(0, 0, 0, 0).encoded_size());
+
+    RUN_BENCH("IPC ENCODE", 3)
+    {
+        for (int round = 0; round < 10; round++) {
+            buffer.clear();
+            for (int i = 0; i < 1000; i++) {
+                MouseMoveMessage(1, 2, i, i).encode_into(buffer);
+            }
+        }
+    }
+
+    BaseWindowClientDecoder decoder;
+    RUN_BENCH("IPC DECODE", 3)
+    {
+        for (int round = 0; round < 10; round++) {
+            size_t offset = 0;
+            while (offset < buffer.size()) {
+                decoder.decode((const char*)buffer.data(), buffer.size(), offset);
+            }
+        }
+    }
+}
+
+static void bench_event_loop()
+{
+    LFoundation::EventLoop loop;
+    BenchReceiver receiver;
+
+    // Events stay queued while the pump runs, so it never blocks.
+    RUN_BENCH("EVENTLOOP DISPATCH", 3)
+    {
+        for (int round = 0; round < 10; round++) {
+            for (int i = 0; i < 1000; i++) {
+                loop.add(receiver, new LFoundation::Event(LFoundation::Event::Type::Other));
+            }
+            loop.pump();
+        }
+    }
+}
+
+void bench_ipc()
+{
+    bench_ipc_coding();
+    bench_event_loop();
+}
@@ -0,0 +1,227 @@
+#include "common.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/shared_buffer.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define BENCH_PAGE_SIZE (4096)
+#define BENCH_FAULT_PAGES (256)
+#define BENCH_SOCKET_PATH "/tmp/bench.sock"
+
+static char socket_buffer[16 * 1024];
+
+static void bench_fork()
+{
+    RUN_BENCH("FORK", 3)
+    {
+        for (int i = 0; i < 20; i++) {
+            int pid = fork();
+            if (pid < 0) {
+                return;
+            }
+            if (pid) {
+                wait(pid);
+            } else {
+                exit(0);
+            }
+        }
+    }
+}
+
+static void bench_syscall()
+{
+    RUN_BENCH("SYSCALL", 3)
+    {
+        for (int i = 0; i < 10000; i++) {
+            getpid();
+        }
+    }
+}
+
+static void touch_pages(char* ptr, int pages)
+{
+    for (int i = 0; i < pages; i++) {
+        ptr[i * BENCH_PAGE_SIZE] = (char)i;
+    }
+}
+
+static void bench_page_faults()
+{
+    RUN_BENCH("PAGE FAULT ANON", 3)
+    {
+        char* ptr = (char*)mmap(NULL, BENCH_FAULT_PAGES * BENCH_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
+        touch_pages(ptr, BENCH_FAULT_PAGES);
+        munmap(ptr, BENCH_FAULT_PAGES * BENCH_PAGE_SIZE);
+    }
+
+    // The child owns the COW copies, so it measures the faults itself.
+    char* shared = (char*)mmap(NULL, BENCH_FAULT_PAGES * BENCH_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
+    touch_pages(shared, BENCH_FAULT_PAGES);
+    for (int run = 0; run < 3; run++) {
+        int pid = fork();
+        if (pid < 0) {
+            break;
+        }
+        if (pid) {
+            wait(pid);
+            continue;
+        }
+
+        RUN_BENCH_COLD("PAGE FAULT COW", 1)
+        {
+            touch_pages(shared, BENCH_FAULT_PAGES);
+        }
+        exit(0);
+    }
+    munmap(shared, BENCH_FAULT_PAGES * BENCH_PAGE_SIZE);
+
+    int fd = open("/res/wallpapers/mountain_orange.png", O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    RUN_BENCH("PAGE FAULT FILE", 3)
+    {
+        char* ptr = (char*)mmap(NULL, 64 * BENCH_PAGE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+        volatile char sum = 0;
+        for (int i = 0; i < 64; i++) {
+            sum += ptr[i * BENCH_PAGE_SIZE];
+        }
+        munmap(ptr, 64 * BENCH_PAGE_SIZE);
+    }
+    close(fd);
+}
+
+/**
+ * The child echoes everything back, so a one byte message measures two
+ * switches and a big one measures the copies through the socket.
+ */
+static int start_echo_peer(int* child)
+{
+    unlink(BENCH_SOCKET_PATH);
+    int server_fd = socket(PF_LOCAL, 0, 0);
+    if (server_fd < 0 || bind(server_fd, BENCH_SOCKET_PATH, strlen(BENCH_SOCKET_PATH)) < 0) {
+        return -1;
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (!pid) {
+        int fd = socket(PF_LOCAL, 0, 0);
+        connect(fd, BENCH_SOCKET_PATH, strlen(BENCH_SOCKET_PATH));
+        for (;;) {
+            ssize_t len = read(fd, socket_buffer, sizeof(socket_buffer));
+            if (len <= 0 || socket_buffer[0] == 'q') {
+                exit(0);
+            }
+            write(fd, socket_buffer, len);
+        }
+    }
+
+    *child = pid;
+    return accept(server_fd);
+}
+
+static void roundtrip(int fd, size_t len)
+{
+    write(fd, socket_buffer, len);
+    for (size_t got = 0; got < len;) {
+        ssize_t res = read(fd, socket_buffer, len - got);
+        if (res <= 0) {
+            return;
+        }
+        got += res;
+    }
+}
+
+static void bench_local_socket()
+{
+    int child;
+    int fd = start_echo_peer(&child);
+    if (fd < 0) {
+        return;
+    }
+
+    memset(socket_buffer, 'x', sizeof(socket_buffer));
+    RUN_BENCH("CONTEXT SWITCH", 3)
+    {
+        for (int i = 0; i < 1000; i++) {
+            roundtrip(fd, 1);
+        }
+    }
+
+    RUN_BENCH("LOCAL SOCKET LATENCY", 3)
+    {
+        for (int i = 0; i < 1000; i++) {
+            roundtrip(fd, 64);
+        }
+    }
+
+    RUN_BENCH("LOCAL SOCKET THROUGHPUT", 3)
+    {
+        for (int i = 0; i < 256; i++) {
+            roundtrip(fd, sizeof(socket_buffer));
+        }
+    }
+
+    socket_buffer[0] = 'q';
+    write(fd, socket_buffer, 1);
+    wait(child);
+    close(fd);
+    unlink(BENCH_SOCKET_PATH);
+}
+
+static void bench_shared_buffer()
+{
+    RUN_BENCH("SHBUF CREATE MAP", 3)
+    {
+        for (int i = 0; i < 100; i++) {
+            uint8_t* buf;
+            uint8_t* mapped;
+            int id = shared_buffer_create(&buf, 64 * 1024);
+            if (id < 0) {
+                return;
+            }
+            shared_buffer_get(id, &mapped);
+            mapped[0] = 1;
+            shared_buffer_free(id);
+        }
+    }
+}
+
+static void bench_exec()
+{
+    char* argv[] = { (char*)"/bin/bench", (char*)"--exit", nullptr };
+    char* envp[] = { nullptr };
+
+    RUN_BENCH("EXEC", 3)
+    {
+        for (int i = 0; i < 10; i++) {
+            int pid = fork();
+            if (pid < 0) {
+                return;
+            }
+            if (pid) {
+                wait(pid);
+            } else {
+                execve(argv[0], argv, envp);
+                exit(1);
+            }
+        }
+    }
+}
+
+void bench_kernel()
+{
+    bench_fork();
+    bench_syscall();
+    bench_page_faults();
+    bench_local_socket();
+    bench_shared_buffer();
+    bench_exec();
+}
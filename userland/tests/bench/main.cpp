@@ -1,38 +1,25 @@
 #include "common.h"
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
 
-char* bench_name;
-int bench_pno = -1;
-int bench_no = 0;
-int bench_run = 0;
-timeval_t tv, ttv;
-timezone_t tz;
-
-void bench_kernel()
+int main(int argc, char** argv)
 {
-    RUN_BENCH("FORK", 3)
-    {
-        for (int i = 0; i < 20; i++) {
-            int pid = fork();
-            if (pid < 0) {
-                return;
-            }
-            if (pid) {
-                wait(pid);
-            } else {
-                exit(0);
-            }
-        }
+    // The EXEC bench runs the binary itself, which should only exit.
+    if (argc > 1 && !strcmp(argv[1], "--exit")) {
+        return 0;
     }
-}
 
-int main(int argc, char** argv)
-{
     bench_kernel();
+    bench_malloc();
+    bench_string();
+    bench_compress();
+    bench_fs();
     bench_pngloader();
+    bench_graphics();
+    bench_ipc();
     printf("[BENCH END]\n\n");
     fflush(stdout);
     return 0;
-}
\ No newline at end of file
+}
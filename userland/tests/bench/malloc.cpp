@@ -0,0 +1,30 @@
+#include "common.h"
+#include <cstdio>
+#include <cstdlib>
+
+#define BENCH_MALLOC_BATCH (256)
+
+static void* pointers[BENCH_MALLOC_BATCH];
+
+// One size of every kind of chunk: slab classes, region chunks and large
+// allocations which get their own mapping.
+static const size_t sizes[] = { 16, 64, 256, 512, 2048, 16 * 1024, 64 * 1024 };
+
+void bench_malloc()
+{
+    char name[32];
+    for (size_t size : sizes) {
+        snprintf(name, sizeof(name), "MALLOC %d", (int)size);
+        RUN_BENCH(name, 3)
+        {
+            for (int round = 0; round < 16; round++) {
+                for (int i = 0; i < BENCH_MALLOC_BATCH; i++) {
+                    pointers[i] = malloc(size);
+                }
+                for (int i = 0; i < BENCH_MALLOC_BATCH; i++) {
+                    free(pointers[i]);
+                }
+            }
+        }
+    }
+}
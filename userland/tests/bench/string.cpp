@@ -0,0 +1,66 @@
+#include "common.h"
+#include <cstdio>
+#include <cstring>
+
+static char buffer[64 * 1024];
+
+void bench_string()
+{
+    // Inserting a character in edit and scrolling rows in terminal shift a
+    // buffer up by a single byte.
+    RUN_BENCH("MEMMOVE BACKWARD UNALIGNED", 3)
+    {
+        for (int i = 0; i < 64; i++) {
+            memmove(buffer + 1, buffer, sizeof(buffer) - 1);
+        }
+    }
+
+    RUN_BENCH("MEMMOVE BACKWARD ALIGNED", 3)
+    {
+        for (int i = 0; i < 64; i++) {
+            memmove(buffer + 64, buffer, sizeof(buffer) - 64);
+        }
+    }
+
+    RUN_BENCH("MEMMOVE FORWARD", 3)
+    {
+        for (int i = 0; i < 64; i++) {
+            memmove(buffer, buffer + 1, sizeof(buffer) - 1);
+        }
+    }
+
+    // Sizes of a struct copy, a text line, a row of pixels and a tile.
+    static const size_t sizes[] = { 16, 256, 4096, 64 * 1024 };
+    static char src[64 * 1024];
+    char name[32];
+    for (size_t size : sizes) {
+        int rounds = (256 * 1024) / size;
+
+        snprintf(name, sizeof(name), "MEMCPY %d", (int)size);
+        RUN_BENCH(name, 3)
+        {
+            for (int i = 0; i < rounds; i++) {
+                memcpy(buffer, src, size);
+            }
+        }
+
+        snprintf(name, sizeof(name), "MEMSET %d", (int)size);
+        RUN_BENCH(name, 3)
+        {
+            for (int i = 0; i < rounds; i++) {
+                memset(buffer, i, size);
+            }
+        }
+
+        memset(src, 'a', size - 1);
+        src[size - 1] = '\0';
+        snprintf(name, sizeof(name), "STRLEN %d", (int)size);
+        RUN_BENCH(name, 3)
+        {
+            volatile size_t len;
+            for (int i = 0; i < rounds; i++) {
+                len = strlen(src);
+            }
+        }
+    }
+}
@@ -6,7 +6,7 @@ public:
     AppDelegate() = default;
     virtual ~AppDelegate() = default;
 
-    LG::Size preferred_desktop_window_size() const override { return LG::Size(200, 140); }
+    LG::Size preferred_desktop_window_size() const override { return LG::Size(200, 300); }
     const char* icon_path() const override { return "/res/icons/apps/activity_monitor.icon"; }
 
     virtual bool application() override
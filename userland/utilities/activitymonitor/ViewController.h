@@ -6,9 +6,11 @@
 
 #pragma once
 #include "GraphView.h"
+#include "ProcessSampler.h"
 #include <libfoundation/ProcessInfo.h>
 #include <libui/App.h>
 #include <libui/Button.h>
+#include <libui/CollectionView.h>
 #include <libui/Label.h>
 #include <libui/StackView.h>
 #include <libui/View.h>
@@ -50,7 +52,22 @@ public:
         view().add_constraint(UI::Constraint(cpu_graphs_stackview, UI::Constraint::Attribute::Left, UI::Constraint::Relation::Equal, UI::SafeArea::Left));
         view().add_constraint(UI::Constraint(cpu_graphs_stackview, UI::Constraint::Attribute::Right, UI::Constraint::Relation::Equal, UI::SafeArea::Right));
         view().add_constraint(UI::Constraint(cpu_graphs_stackview, UI::Constraint::Attribute::Top, UI::Constraint::Relation::Equal, cpu_label, UI::Constraint::Attribute::Bottom, 1, 8));
-        view().add_constraint(UI::Constraint(cpu_graphs_stackview, UI::Constraint::Attribute::Bottom, UI::Constraint::Relation::Equal, UI::SafeArea::Bottom));
+        view().add_constraint(UI::Constraint(cpu_graphs_stackview, UI::Constraint::Attribute::Height, UI::Constraint::Relation::Equal, 100));
+
+        auto& process_list = view().add_subview<UI::CollectionView>(LG::Rect(0, 0, 184, 160));
+        view().add_constraint(UI::Constraint(process_list, UI::Constraint::Attribute::Left, UI::Constraint::Relation::Equal, UI::SafeArea::Left));
+        view().add_constraint(UI::Constraint(process_list, UI::Constraint::Attribute::Right, UI::Constraint::Relation::Equal, UI::SafeArea::Right));
+        view().add_constraint(UI::Constraint(process_list, UI::Constraint::Attribute::Top, UI::Constraint::Relation::Equal, cpu_graphs_stackview, UI::Constraint::Attribute::Bottom, 1, 8));
+        view().add_constraint(UI::Constraint(process_list, UI::Constraint::Attribute::Bottom, UI::Constraint::Relation::Equal, UI::SafeArea::Bottom));
+
+        process_list.set_cell_type<UI::Label>();
+        process_list.set_row_height(16);
+        process_list.set_number_of_rows([this]() { return m_sampler.rows().size(); });
+        process_list.set_configure_cell([this](UI::View& cell, size_t row) {
+            auto& info = m_sampler.rows()[row];
+            static_cast<UI::Label&>(cell).set_text(std::to_string(info.pid) + "  " + std::to_string(info.cpu_load) + "%  prio " + std::to_string(info.prio) + "  ppid " + std::to_string(info.ppid));
+        });
+        m_process_list = &process_list;
 
         for (int i = 0; i < cpu_count(); i++) {
             auto& graph = cpu_graphs_stackview.add_arranged_subview<GraphView>(200);
@@ -68,22 +85,33 @@ public:
             1000, LFoundation::Timer::Repeat));
     }
 
+    // Returns the ticks all cpus spent since the last call.
     int update_cpu_load()
     {
         int fd_proc_stat = open("/proc/stat", O_RDONLY);
-        int offset = 0;
-        read(fd_proc_stat, buf, sizeof(buf));
+        int len = read(fd_proc_stat, buf, sizeof(buf) - 1);
+        close(fd_proc_stat);
+        if (len <= 0) {
+            return 0;
+        }
+        buf[len] = '\0';
 
-        for (int i = 0; i < cpu_count(); i++) {
+        int elapsed_ticks = 0;
+        const char* line = buf;
+        for (int i = 0; i < cpu_count() && line; i++) {
             int user_time, system_time, idle_time;
             int num;
-            offset += sscanf(buf + offset, "cpu%d %d 0 %d %d\n", &num, &user_time, &system_time, &idle_time);
+            sscanf(line, "cpu%d %d 0 %d %d\n", &num, &user_time, &system_time, &idle_time);
+            line = strchr(line, '\n');
+            line = line ? line + 1 : nullptr;
+
             int diff_user_time = user_time - state.cpu_old_user_time[i];
             int diff_system_time = system_time - state.cpu_old_system_time[i];
             int diff_idle_time = idle_time - state.cpu_old_idle_time[i];
             state.cpu_old_user_time[i] = user_time;
             state.cpu_old_system_time[i] = system_time;
             state.cpu_old_idle_time[i] = idle_time;
+            elapsed_ticks += diff_user_time + diff_system_time + diff_idle_time;
 
             if (diff_user_time + diff_system_time + diff_idle_time == 0) {
                 state.cpu_load[i] = 0;
@@ -93,20 +121,34 @@ public:
 
             cpu_graphs[i]->add_new_value(state.cpu_load[i]);
         }
+        return elapsed_ticks;
+    }
+
+    // Only rows whose text changed are configured again, the whole list is
+    // reloaded just when processes come or go.
+    void update_processes(int elapsed_ticks)
+    {
+        if (!m_sampler.sample(elapsed_ticks)) {
+            return;
+        }
 
-        close(fd_proc_stat);
-        return 0;
+        if (m_sampler.layout_changed()) {
+            m_process_list->reload_data();
+        } else {
+            m_process_list->reload_rows(m_sampler.changed_rows());
+        }
     }
 
     void update_data()
     {
-        update_cpu_load();
+        update_processes(update_cpu_load());
     }
 
 private:
     int m_cpu_count;
-    int fd_proc_stat;
     std::vector<GraphView*> cpu_graphs;
+    UI::CollectionView* m_process_list { nullptr };
+    ProcessSampler m_sampler;
 
     struct State {
         std::vector<int> cpu_load;
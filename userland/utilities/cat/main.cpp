@@ -1,6 +1,8 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mapped_file.h>
+#include <sys/sendfile.h>
 #include <unistd.h>
 
 #define BUF_SIZE 512
@@ -16,6 +18,37 @@ void cat(int fd)
     }
 }
 
+#define SENDFILE_CHUNK (64 * 1024)
+
+// The kernel moves a file to stdout itself, so the data never comes here.
+// If it can't, the file is mapped and handed to stdout at once, which writes
+// it straight from the mapping when it does not fit the stdout buffer.
+void cat_file(int fd)
+{
+    fflush(stdout);
+    ssize_t sent = sendfile(STDOUT_FILENO, fd, nullptr, SENDFILE_CHUNK);
+    if (sent >= 0) {
+        while (sent > 0) {
+            sent = sendfile(STDOUT_FILENO, fd, nullptr, SENDFILE_CHUNK);
+        }
+        if (sent < 0) {
+            exit(1);
+        }
+        return;
+    }
+
+    mapped_file_t file;
+    if (mapped_file_map_fd(fd, &file) < 0) {
+        cat(fd);
+        return;
+    }
+
+    if (file.size && fwrite(file.data, file.size, 1, stdout) != file.size) {
+        exit(1);
+    }
+    mapped_file_close(&file);
+}
+
 int main(int argc, char** argv)
 {
     int fd, i;
@@ -30,7 +63,7 @@ int main(int argc, char** argv)
             printf("cat: hey cat you dont have access to read this dir :)");
             return 1;
         }
-        cat(fd);
+        cat_file(fd);
         close(fd);
     }
     return 0;
@@ -1,176 +1,109 @@
 #include "file.h"
 #include "viewer.h"
 #include <fcntl.h>
+#include <libfoundation/PieceTable.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-file_view_area_t view_area;
+static LFoundation::PieceTable text;
+static int file_fd;
+static char was_changed;
 
-static int _file_get_size_of_first_line()
+static int _file_load()
 {
-    int res = 0;
-    for (int i = view_area.start; i < view_area.data_len; i++) {
-        res++;
-        if (view_area.buffer[i] == '\n') {
-            return res;
+    size_t capacity = 4096;
+    size_t len = 0;
+    char* data = (char*)malloc(capacity);
+    for (;;) {
+        if (len == capacity) {
+            capacity *= 2;
+            data = (char*)realloc(data, capacity);
         }
-    }
-    return view_area.data_len - view_area.start;
-}
-
-static void _file_find_start(uint32_t old_offset)
-{
-    old_offset -= 2;
-    while (old_offset > view_area.offset) {
-        if (view_area.buffer[old_offset - view_area.offset] == '\n') {
-            view_area.start = old_offset - view_area.offset + 1;
-            return;
+        int read_cnt = read(file_fd, data + len, capacity - len);
+        if (read_cnt < 0) {
+            free(data);
+            return -1;
+        }
+        if (read_cnt == 0) {
+            break;
         }
-        old_offset--;
+        len += read_cnt;
     }
-    view_area.start = 0;
-}
-
-static inline int _file_remaining_size()
-{
-    return view_area.data_len - view_area.start;
-}
-
-static inline int _file_is_last_line_in_buf()
-{
-    return 1;
-}
 
-int _file_buf_flush()
-{
-    /* FIXME: for now we think that we have all file in our buffer */
-    lseek(view_area.fd, view_area.offset, SEEK_SET);
-    view_area.data_len = write(view_area.fd, view_area.buffer, view_area.data_len);
+    text.set_text(data, len);
+    free(data);
+    was_changed = 0;
     return 0;
 }
 
-int _file_buf_reload(int offset_in_file)
+int file_open(char* path)
 {
-    /* TODO: Get real file size */
-    view_area.buf_len = 4000;
-    view_area.buffer = (char*)malloc(view_area.buf_len);
+    if ((file_fd = open(path, O_RDWR)) < 0) {
+        return -1;
+    }
 
-    view_area.start = 0;
-    view_area.offset = offset_in_file;
-    view_area.was_changed = 0;
-    lseek(view_area.fd, view_area.offset, SEEK_SET);
-    view_area.data_len = read(view_area.fd, view_area.buffer, view_area.buf_len);
-    if (view_area.data_len < 0) {
+    if (_file_load() < 0) {
         return -1;
     }
-    return 0;
+
+    viewer_display();
+    return file_fd;
 }
 
-int file_line_len(int offset)
+void file_exit()
 {
-    int res = 0;
-    for (int i = offset; i < view_area.data_len; i++) {
-        res++;
-        if (view_area.buffer[i] == '\n') {
-            return res;
-        }
-    }
-    return view_area.data_len - view_area.start;
+    close(file_fd);
 }
 
-int file_line_len_backwards(int offset)
+int file_line_count()
 {
-
-    int res = 1;
-    for (int i = offset - 1; i >= view_area.offset; i--) {
-        if (view_area.buffer[i] == '\n') {
-            return res;
-        }
-        res++;
-    }
-    return offset;
+    return text.line_count();
 }
 
-int file_open(char* path)
+int file_line_start(int line)
 {
-    int n;
-    if ((view_area.fd = open(path, O_RDWR)) < 0) {
-        return -1;
-    }
-
-    _file_buf_reload(0);
-    if (view_area.data_len < 0) {
-        return -1;
-    }
-
-    viewer_display(view_area.buffer, view_area.start, _file_remaining_size());
-
-    return view_area.fd;
+    return text.line_start(line);
 }
 
-void file_exit()
+int file_line_len(int line)
 {
-    close(view_area.fd);
+    return text.line_length(line);
 }
 
-/**
- * file_paste_char pastes and flush updates to disk.
- */
-int file_paste_char(char c, int offset)
+int file_copy(int offset, char* buf, int len)
 {
-    view_area.was_changed = 1;
-    view_area.data_len++;
-
-    memmove(view_area.buffer + offset + 1, view_area.buffer + offset, view_area.data_len - offset - 1);
-    view_area.buffer[offset] = c;
-    viewer_cursor_next();
-    viewer_display(view_area.buffer, view_area.start, _file_remaining_size());
+    return text.copy_to(offset, buf, len);
 }
 
 /**
- * file_paste_char pastes and flush updates to disk.
+ * file_paste_char pastes a char, only the lines it changes are redrawn.
  */
-int file_save()
+int file_paste_char(char c, int offset)
 {
-    if (view_area.was_changed) {
-        _file_buf_flush();
-    }
+    text.insert(offset, &c, 1);
+    was_changed = 1;
+    viewer_char_pasted(c);
+    return 0;
 }
 
 /**
- * Scroll functions update file buffer, to contain line scrolled to.
+ * file_save writes the pieces in order, chars are only ever added, so the
+ * file never gets shorter.
  */
-int file_scroll_up()
+int file_save()
 {
-    if (view_area.line == 0 || view_area.start == 0) {
-        return -1;
-    }
-    view_area.line--;
-    int old_offset_in_file = view_area.offset + view_area.start;
-    int offset_in_file = view_area.offset + view_area.start - SCREEN_X;
-    if (offset_in_file < 0) {
-        offset_in_file = 0;
+    if (!was_changed) {
+        return 0;
     }
 
-    if (offset_in_file >= view_area.offset) {
-        view_area.start = offset_in_file - view_area.offset;
-        _file_find_start(old_offset_in_file);
-        viewer_display(view_area.buffer, view_area.start, _file_remaining_size());
-    } else {
-        _file_buf_reload(offset_in_file);
-        _file_find_start(old_offset_in_file);
-        viewer_display(view_area.buffer, view_area.start, _file_remaining_size());
-    }
+    lseek(file_fd, 0, SEEK_SET);
+    int res = 0;
+    text.for_each_chunk(0, text.size(), [&](const char* data, size_t len) {
+        if (write(file_fd, data, len) != (int)len) {
+            res = -1;
+        }
+    });
+    was_changed = res < 0;
+    return res;
 }
-
-int file_scroll_down()
-{
-    int line_size = _file_get_size_of_first_line();
-    view_area.start += line_size;
-    if (!_file_is_last_line_in_buf()) {
-        _file_buf_reload(view_area.offset + view_area.start);
-    }
-    viewer_display(view_area.buffer, view_area.start, _file_remaining_size());
-    view_area.line++;
-}
\ No newline at end of file
@@ -6,23 +6,15 @@
 #include <stdint.h>
 #endif
 
-struct file_view_area {
-    char* buffer;
-    int start; /* offset in buffer where the line starts */
-    int offset; /* offset in file */
-    int data_len;
-    int buf_len;
-    int line;
-    char was_changed;
-    int fd;
-};
-typedef struct file_view_area file_view_area_t;
-
+/**
+ * The text lives in a LFoundation::PieceTable, so pasting a char costs
+ * O(log n) in any file and lines are found by their index.
+ */
 int file_open(char* path);
 void file_exit();
 int file_save();
-int file_line_len(int offset);
-int file_line_len_backwards(int offset);
+int file_line_count();
+int file_line_start(int line);
+int file_line_len(int line);
+int file_copy(int offset, char* buf, int len);
 int file_paste_char(char c, int offset);
-int file_scroll_up();
-int file_scroll_down();
@@ -3,19 +3,16 @@
 #include <stdlib.h>
 #include <unistd.h>
 
-int out_x, out_y;
+/**
+ * Every row of the screen shows one line of the file from top_line on, the
+ * part past SCREEN_X is clipped. Rows are drawn only when their line has
+ * changed or the screen is scrolled.
+ */
+int top_line;
 int cursor_x, cursor_y;
-char* displaying_buffer;
-int working_with_offset;
-
-static int _viewer_get_offset(int cx, int cy)
-{
-    return cy * SCREEN_X + cx;
-}
 
 void viewer_clear_screen()
 {
-    out_x = out_y = 0;
     write(STDOUT, "\x1b[2J", 4);
     write(STDOUT, "\x1b[H", 3);
 }
@@ -49,43 +46,45 @@ void _viewer_set_cursor_to_start()
     write(STDOUT, "\x1b[H", 3);
 }
 
-void _viewer_new_line()
+static inline int _viewer_cursor_line()
 {
-    write(STDOUT, "\n", 1);
+    return top_line + cursor_y;
 }
 
-char _viewer_has_space_to_print(char c)
+static void _viewer_draw_row(int row)
 {
-    if (c == '\n') {
-        if (out_y == SCREEN_Y - 1) {
-            return 0;
+    char buf[SCREEN_X];
+    int line = top_line + row;
+    _viewer_set_cursor(0, row);
+    if (line < file_line_count()) {
+        int len = file_line_len(line);
+        if (len > SCREEN_X) {
+            len = SCREEN_X;
         }
+        write(STDOUT, buf, file_copy(file_line_start(line), buf, len));
     } else {
-        if (out_x == SCREEN_X - 1 && out_y == SCREEN_Y - 1) {
-            return 0;
-        }
+        write(STDOUT, "~", 1);
     }
-    return 1;
+    write(STDOUT, "\x1b[K", 3);
 }
 
-char _viewer_display_one(char c)
+static void _viewer_draw_rows(int from, int to)
 {
-    if (_viewer_has_space_to_print(c)) {
-        if (c == '\n') {
-            out_x = 0;
-            out_y++;
-            _viewer_new_line();
-        } else {
-            write(STDOUT, &c, 1);
-            out_x++;
-            if (out_x == SCREEN_X) {
-                out_x = 0;
-                out_y++;
-            }
-        }
-        return 1;
+    for (int row = from; row < to; row++) {
+        _viewer_draw_row(row);
+    }
+    _viewer_set_cursor(cursor_x, cursor_y);
+}
+
+static void _viewer_clamp_cursor_x()
+{
+    int len = file_line_len(_viewer_cursor_line());
+    if (cursor_x > len) {
+        cursor_x = len;
+    }
+    if (cursor_x > SCREEN_X - 1) {
+        cursor_x = SCREEN_X - 1;
     }
-    return 0;
 }
 
 static void _log_dec(uint32_t dec)
@@ -107,94 +106,88 @@ static void _log_dec(uint32_t dec)
     }
 }
 
-void viewer_display(char* buf, int start, int len)
+void viewer_display()
 {
-    displaying_buffer = buf;
-    int last_cx = 0;
     viewer_clear_screen();
-    for (int i = start; i < start + len; i++) {
-        if (out_x <= cursor_x && out_y == cursor_y) {
-            working_with_offset = i;
-            last_cx = out_x;
-        }
-        if (!_viewer_display_one(buf[i])) {
-            goto out;
-        }
-    }
-
-    while (out_y < SCREEN_Y - 1) {
-        out_y++;
-        write(STDOUT, "\n~", 2);
-    }
-out:
-    cursor_x = last_cx;
-    _viewer_set_cursor(cursor_x, cursor_y);
+    _viewer_draw_rows(0, SCREEN_Y);
 }
 
 void viewer_cursor_left()
 {
     if (cursor_x) {
         cursor_x--;
-        working_with_offset--;
         _viewer_set_cursor(cursor_x, cursor_y);
     }
 }
 
 void viewer_cursor_right()
 {
-    if (displaying_buffer) {
-        if (displaying_buffer[working_with_offset] != '\n') {
-            cursor_x++;
-            working_with_offset++;
-            _viewer_set_cursor(cursor_x, cursor_y);
-        }
+    if (cursor_x < file_line_len(_viewer_cursor_line()) && cursor_x < SCREEN_X - 1) {
+        cursor_x++;
+        _viewer_set_cursor(cursor_x, cursor_y);
     }
 }
 
 void viewer_cursor_up()
 {
+    if (!_viewer_cursor_line()) {
+        return;
+    }
+
     if (!cursor_y) {
-        file_scroll_up();
-    } else {
-        working_with_offset -= file_line_len_backwards(working_with_offset);
-        cursor_y--;
-        int new_line_len = file_line_len_backwards(working_with_offset) - 1;
-        if (cursor_x >= new_line_len) {
-            cursor_x = (new_line_len) % SCREEN_X;
-        }
-        working_with_offset -= (new_line_len);
-        working_with_offset += cursor_x;
-        _viewer_set_cursor(cursor_x, cursor_y);
+        top_line--;
+        _viewer_clamp_cursor_x();
+        _viewer_draw_rows(0, SCREEN_Y);
+        return;
     }
+    cursor_y--;
+    _viewer_clamp_cursor_x();
+    _viewer_set_cursor(cursor_x, cursor_y);
 }
 
 void viewer_cursor_down()
 {
+    if (_viewer_cursor_line() + 1 >= file_line_count()) {
+        return;
+    }
+
     if (cursor_y == SCREEN_Y - 1) {
-        file_scroll_down();
-    } else {
-        working_with_offset += file_line_len(working_with_offset);
-        cursor_y++;
-        if (cursor_x >= file_line_len(working_with_offset)) {
-            cursor_x = file_line_len(working_with_offset) - 1;
-        }
-        working_with_offset += cursor_x;
-        _viewer_set_cursor(cursor_x, cursor_y);
+        top_line++;
+        _viewer_clamp_cursor_x();
+        _viewer_draw_rows(0, SCREEN_Y);
+        return;
     }
+    cursor_y++;
+    _viewer_clamp_cursor_x();
+    _viewer_set_cursor(cursor_x, cursor_y);
 }
 
-void viewer_cursor_next()
+/**
+ * A char changes only its row, a newline moves the rows below it down.
+ */
+void viewer_char_pasted(char c)
 {
-    cursor_x++;
-    if (cursor_x == SCREEN_X) {
-        cursor_y++;
-        cursor_x = 0;
+    if (c != '\n') {
+        if (cursor_x < SCREEN_X - 1) {
+            cursor_x++;
+        }
+        _viewer_draw_rows(cursor_y, cursor_y + 1);
+        return;
+    }
+
+    cursor_x = 0;
+    if (cursor_y == SCREEN_Y - 1) {
+        top_line++;
+        _viewer_draw_rows(0, SCREEN_Y);
+        return;
     }
+    cursor_y++;
+    _viewer_draw_rows(cursor_y - 1, SCREEN_Y);
 }
 
 int viewer_get_cursor_offset_in_file()
 {
-    return working_with_offset;
+    return file_line_start(_viewer_cursor_line()) + cursor_x;
 }
 
 void viewer_enter_menu_mode()
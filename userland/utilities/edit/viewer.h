@@ -6,11 +6,11 @@
 #define SCREEN_Y 24
 
 void viewer_clear_screen();
-void viewer_display(char* buf, int start, int len);
+void viewer_display();
 void viewer_enter_menu_mode();
 void viewer_cursor_left();
 void viewer_cursor_right();
 void viewer_cursor_up();
 void viewer_cursor_down();
-void viewer_cursor_next();
+void viewer_char_pasted(char c);
 int viewer_get_cursor_offset_in_file();
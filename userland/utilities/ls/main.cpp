@@ -5,7 +5,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-#define BUF_SIZE 1024
+#define BUF_SIZE 8192
 
 struct linux_dirent {
     uint32_t inode;
@@ -15,6 +15,54 @@ struct linux_dirent {
     char* name;
 };
 
+static char mode_char(mode_t mode)
+{
+    switch (mode & 0xF000) {
+    case S_IFDIR:
+        return 'd';
+    case S_IFCHR:
+        return 'c';
+    case S_IFBLK:
+        return 'b';
+    case S_IFLNK:
+        return 'l';
+    case S_IFIFO:
+        return 'p';
+    case S_IFSOCK:
+        return 's';
+    default:
+        return '-';
+    }
+}
+
+/* With -l every entry comes with its stat, so one call lists many files. */
+static int list_long(int fd, char* buf, char show_inodes, char show_private)
+{
+    for (;;) {
+        int nread = getdents_stat(fd, buf, BUF_SIZE);
+        if (nread < 0) {
+            printf("ls: Operation not permitted\n");
+            return -1;
+        }
+
+        if (nread == 0) {
+            return 0;
+        }
+
+        for (int bpos = 0; bpos < nread;) {
+            dirent_stat_t* d = (dirent_stat_t*)(buf + bpos);
+            if (d->d_name[0] != '.' || show_private) {
+                printf("%c %8d %s", mode_char(d->d_stat.mode), d->d_stat.size, d->d_name);
+                if (show_inodes) {
+                    printf(" %d", d->d_ino);
+                }
+                printf("\n");
+            }
+            bpos += d->d_reclen;
+        }
+    }
+}
+
 int main(int argc, char** argv)
 {
     int fd, nread;
@@ -25,12 +73,15 @@ int main(int argc, char** argv)
     char has_path = 0;
     char show_inodes = 0;
     char show_private = 0;
+    char show_long = 0;
 
     for (int i = 1; i < argc; i++) {
         if (memcmp(argv[i], "-i", 3) == 0) {
             show_inodes = 1;
         } else if (memcmp(argv[i], "-a", 3) == 0) {
             show_private = 1;
+        } else if (memcmp(argv[i], "-l", 3) == 0) {
+            show_long = 1;
         } else {
             has_path = 1;
         }
@@ -46,6 +97,11 @@ int main(int argc, char** argv)
         printf("ls: Operation not permitted\n");
         return -1;
     }
+
+    if (show_long) {
+        return list_long(fd, buf, show_inodes, show_private);
+    }
+
     for (;;) {
         nread = getdents(fd, buf, BUF_SIZE);
         if (nread < 0) {
@@ -0,0 +1,284 @@
+#include <bits/profiler.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define KERNEL_IMAGE "/boot/kernel.bin"
+#define DEFAULT_SAMPLES 1000
+#define MAX_IMAGES 16
+#define MAX_ENTRIES 512
+#define PATH_LEN 128
+
+struct image {
+    char path[PATH_LEN];
+    Elf32_Sym* syms;
+    uint32_t nsyms;
+    char* strtab;
+};
+
+struct entry {
+    int image;
+    int sym; // -1 if the pc has no symbol, then addr is kept
+    uint32_t addr;
+    uint32_t self;
+    uint32_t total;
+    uint32_t last_sample;
+};
+
+static image images[MAX_IMAGES];
+static int nimages = 0;
+static entry entries[MAX_ENTRIES];
+static int nentries = 0;
+
+static char* read_file(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    fstat_t stat;
+    if (fstat(fd, &stat) < 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    char* data = (char*)malloc(stat.size);
+    if (!data) {
+        close(fd);
+        return nullptr;
+    }
+
+    uint32_t done = 0;
+    while (done < stat.size) {
+        int n = read(fd, data + done, stat.size - done);
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    close(fd);
+
+    if (done != stat.size) {
+        free(data);
+        return nullptr;
+    }
+    return data;
+}
+
+/**
+ * Keeps only the symtab and its strtab of the image, the rest of the file
+ * is not needed to symbolise.
+ */
+static void load_symbols(image* img)
+{
+    char* data = read_file(img->path);
+    if (!data) {
+        return;
+    }
+
+    Elf32_Ehdr* ehdr = (Elf32_Ehdr*)data;
+    if (ehdr->e_ident[0] != ELFMAG0 || ehdr->e_ident[1] != ELFMAG1 || ehdr->e_ident[2] != ELFMAG2 || ehdr->e_ident[3] != ELFMAG3) {
+        free(data);
+        return;
+    }
+
+    Elf32_Shdr* shdrs = (Elf32_Shdr*)(data + ehdr->e_shoff);
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+        if (shdrs[i].sh_type != SHT_SYMTAB || shdrs[i].sh_link >= ehdr->e_shnum) {
+            continue;
+        }
+
+        Elf32_Shdr* strtab = &shdrs[shdrs[i].sh_link];
+        img->syms = (Elf32_Sym*)malloc(shdrs[i].sh_size);
+        img->strtab = (char*)malloc(strtab->sh_size);
+        if (!img->syms || !img->strtab) {
+            break;
+        }
+        memcpy(img->syms, data + shdrs[i].sh_offset, shdrs[i].sh_size);
+        memcpy(img->strtab, data + strtab->sh_offset, strtab->sh_size);
+        img->nsyms = shdrs[i].sh_size / sizeof(Elf32_Sym);
+        break;
+    }
+    free(data);
+}
+
+static int find_image(const char* path)
+{
+    for (int i = 0; i < nimages; i++) {
+        if (strcmp(images[i].path, path) == 0) {
+            return i;
+        }
+    }
+
+    if (nimages == MAX_IMAGES) {
+        return -1;
+    }
+
+    image* img = &images[nimages];
+    strncpy(img->path, path, PATH_LEN - 1);
+    load_symbols(img);
+    return nimages++;
+}
+
+/**
+ * Samples of user code are looked up in the executable of the thread,
+ * pcs inside shared libraries are reported as raw addresses.
+ */
+static int image_of(profiler_sample_t* sample)
+{
+    if (!(sample->flags & PROFILER_SAMPLE_USER)) {
+        return find_image(KERNEL_IMAGE);
+    }
+
+    char proc_path[32];
+    char path[PATH_LEN];
+    snprintf(proc_path, sizeof(proc_path), "/proc/%d/exe", sample->tid);
+    int fd = open(proc_path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int n = read(fd, path, PATH_LEN - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    path[n] = '\0';
+    return find_image(path);
+}
+
+static int symbol_of(image* img, uint32_t pc)
+{
+    for (uint32_t i = 0; i < img->nsyms; i++) {
+        Elf32_Sym* sym = &img->syms[i];
+        if (ELF32_ST_TYPE(sym->st_info) != STT_FUNC) {
+            continue;
+        }
+        if (sym->st_value <= pc && pc < sym->st_value + sym->st_size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static entry* entry_of(int img, uint32_t pc)
+{
+    int sym = img >= 0 ? symbol_of(&images[img], pc) : -1;
+    for (int i = 0; i < nentries; i++) {
+        if (entries[i].image == img && entries[i].sym == sym && (sym >= 0 || entries[i].addr == pc)) {
+            return &entries[i];
+        }
+    }
+
+    if (nentries == MAX_ENTRIES) {
+        return nullptr;
+    }
+
+    entry* e = &entries[nentries++];
+    e->image = img;
+    e->sym = sym;
+    e->addr = pc;
+    e->self = 0;
+    e->total = 0;
+    e->last_sample = 0;
+    return e;
+}
+
+/**
+ * Self counts samples where the function was interrupted, total counts
+ * samples where it was anywhere on the chain, once per sample.
+ */
+static void account(profiler_sample_t* sample, uint32_t sample_id)
+{
+    int img = image_of(sample);
+    for (uint32_t i = 0; i < sample->depth && i < PROFILER_MAX_DEPTH; i++) {
+        entry* e = entry_of(img, sample->pcs[i]);
+        if (!e) {
+            continue;
+        }
+        if (i == 0) {
+            e->self++;
+        }
+        if (e->last_sample != sample_id) {
+            e->total++;
+            e->last_sample = sample_id;
+        }
+    }
+}
+
+static void print_report(uint32_t nsamples)
+{
+    for (int i = 1; i < nentries; i++) {
+        entry e = entries[i];
+        int j = i - 1;
+        while (j >= 0 && (entries[j].self < e.self || (entries[j].self == e.self && entries[j].total < e.total))) {
+            entries[j + 1] = entries[j];
+            j--;
+        }
+        entries[j + 1] = e;
+    }
+
+    printf("%d samples\n", nsamples);
+    printf("  self  total  symbol\n");
+    for (int i = 0; i < nentries; i++) {
+        entry* e = &entries[i];
+        const char* path = e->image >= 0 ? images[e->image].path : "?";
+        if (e->sym >= 0) {
+            image* img = &images[e->image];
+            printf("%6d %6d  %s (%s)\n", e->self, e->total, img->strtab + img->syms[e->sym].st_name, path);
+        } else {
+            printf("%6d %6d  0x%x (%s)\n", e->self, e->total, e->addr, path);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t wanted = DEFAULT_SAMPLES;
+    if (argc > 1) {
+        wanted = atoi(argv[1]);
+    }
+    if (!wanted) {
+        printf("usage: prof [samples]\n");
+        return 1;
+    }
+
+    profiler_sample_t* samples = (profiler_sample_t*)malloc(wanted * sizeof(profiler_sample_t));
+    if (!samples) {
+        printf("prof: not enough memory\n");
+        return 1;
+    }
+
+    int fd = open("/dev/profiler", O_RDWR);
+    if (fd < 0) {
+        printf("prof: can't open /dev/profiler\n");
+        return 1;
+    }
+
+    if (write(fd, "1", 1) != 1) {
+        printf("prof: can't start profiler\n");
+        return 1;
+    }
+
+    uint32_t nsamples = 0;
+    while (nsamples < wanted) {
+        int n = read(fd, (char*)&samples[nsamples], (wanted - nsamples) * sizeof(profiler_sample_t));
+        if (n <= 0) {
+            break;
+        }
+        nsamples += n / sizeof(profiler_sample_t);
+    }
+    write(fd, "0", 1);
+    close(fd);
+
+    for (uint32_t i = 0; i < nsamples; i++) {
+        account(&samples[i], i + 1);
+    }
+    print_report(nsamples);
+    return 0;
+}
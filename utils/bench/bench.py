@@ -1,3 +1,5 @@
+import json
+import math
 import subprocess
 import sys
 import os
@@ -11,10 +13,13 @@ process = subprocess.Popen(
     "./bench.sh", stdout=subprocess.PIPE, preexec_fn=os.setpgrp)
 string = ""
 
-sum_of_benchs = {}
-count_of_benchs = {}
+results_path = sys.argv[2] if len(sys.argv) > 2 else "bench_results.json"
 
-# For github CI
+# Samples in ns of every bench, a bench may be printed several times (by
+# forked children), its samples are merged.
+samples_of_benchs = {}
+
+# For github CI, in usec
 expected_benchmark_results = {
     "x86": {
         "FORK": 320000,
@@ -27,38 +32,74 @@ expected_benchmark_results = {
 }
 
 
+# Two-sided 95% quantiles of Student's t, by degrees of freedom.
+t_quantiles = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+               2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086]
+
+
+def stats_of(samples):
+    samples = sorted(samples)
+    n = len(samples)
+    mean = sum(samples) / n
+    ci = 0.0
+    if n > 1:
+        stddev = math.sqrt(sum((x - mean) ** 2 for x in samples) / (n - 1))
+        t = t_quantiles[n - 2] if n - 2 < len(t_quantiles) else 1.96
+        ci = t * stddev / math.sqrt(n)
+    return {
+        "runs": n,
+        "min": samples[0],
+        "median": samples[n // 2],
+        "p99": samples[max(0, math.ceil(n * 0.99) - 1)],
+        "mean": mean,
+        "ci95": ci,
+        "samples": samples,
+    }
+
+
 def print_results():
     print(colored("Bench results:", color="white", attrs=["bold"]))
-    res=[]
-    mper=0.0
-    for key, value in sum_of_benchs.items():
-        new_val=int(value / count_of_benchs[key])
-        percent=(1 - new_val /
-                   expected_benchmark_results[target_arch][key]) * 100
-        res.append([key, expected_benchmark_results[target_arch][key],
-                    new_val, "{:.2f}%".format(percent)])
-        mper=min(mper, percent)
-
-    data=tabulate(
-        res, headers=['Test', 'Expected ({0})'.format(target_arch), 'Got', 'Diff'], tablefmt='orgtbl')
+    expected = expected_benchmark_results[target_arch]
+    res = []
+    report = {}
+    regressions = []
+    for key, samples in samples_of_benchs.items():
+        st = stats_of(samples)
+        report[key] = st
+        usec = lambda ns: int(ns / 1000)
+        row = [key, usec(st["min"]), usec(st["median"]), usec(st["p99"]),
+               "{0}±{1}".format(usec(st["mean"]), usec(st["ci95"]))]
+
+        # Benches with no expected number yet are shown, but can't fail CI.
+        if key not in expected:
+            res.append(row + ["-", "-"])
+            continue
+
+        percent = (1 - st["mean"] / 1000 / expected[key]) * 100
+        res.append(row + [expected[key], "{:.2f}%".format(percent)])
+        # A regression only counts when the whole interval is beyond the
+        # limit, so a noisy run doesn't fail CI.
+        if (st["mean"] - st["ci95"]) / 1000 > expected[key] * 1.5:
+            regressions.append(key)
+
+    data = tabulate(
+        res, headers=['Test', 'Min', 'Median', 'P99', 'Mean (95% CI)', 'Expected ({0})'.format(target_arch), 'Diff'], tablefmt='orgtbl')
     print(data)
-    if (mper < -50):
-        print(colored("Crashing: too big performance drop ({0}%)!!!".format(mper), color="red", attrs=["bold"]))
+
+    with open(results_path, "w") as out:
+        json.dump({"arch": target_arch, "unit": "ns", "benchs": report}, out, indent=2)
+
+    if regressions:
+        print(colored("Crashing: too big performance drop in {0}!!!".format(", ".join(regressions)), color="red", attrs=["bold"]))
         exit(1)
 
 
 def process_string(string):
-    if (string.startswith("[BENCH]")):
-        end_of_date=string.find(" (usec)")
-        start_of_date=string.find("] ") + 2
-        pr=string[8:start_of_date - 2]
-        it=int(string[start_of_date:end_of_date])
-        if count_of_benchs.get(pr, None) is None:
-            sum_of_benchs[pr]=0
-            count_of_benchs[pr]=0
-
-        sum_of_benchs[pr] += it
-        count_of_benchs[pr] += 1
+    if (string.startswith("[BENCH][")):
+        start_of_data = string.find("] ")
+        pr = string[8:start_of_data]
+        data = json.loads(string[start_of_data + 2:])
+        samples_of_benchs.setdefault(pr, []).extend(data["samples"])
 
     if (string.startswith("[BENCH END]")):
         os.killpg(os.getpgid(process.pid), signal.SIGTERM)
@@ -65,19 +65,21 @@ class Generator:
             self.out(res+" {}", 1)
 
     def message_create_encoder(self, msg):
-        self.out("EncodedMessage encode() const override".format(
-            msg.decoder_magic), 1)
-        self.out("{", 1)
+        header_fields = 3 if msg.protected else 2
+        size = "{0} * sizeof(uint32_t)".format(header_fields)
+        for i in msg.params:
+            size += " + Encoder::encoded_size(m_{0})".format(i[1])
+        self.out("size_t encoded_size() const override {{ return {0}; }}".format(size), 1)
 
-        self.out("EncodedMessage buffer;", 2)
-        self.out("Encoder::append(buffer, decoder_magic());", 2)
-        self.out("Encoder::append(buffer, id());", 2)
+        self.out("void encode_to(uint8_t* data) const override", 1)
+        self.out("{", 1)
+        self.out("size_t offset = 0;", 2)
+        self.out("Encoder::store(data, offset, decoder_magic());", 2)
+        self.out("Encoder::store(data, offset, id());", 2)
         if msg.protected:
-            self.out("Encoder::append(buffer, key());", 2)
+            self.out("Encoder::store(data, offset, key());", 2)
         for i in msg.params:
-            self.out("Encoder::append(buffer, m_{0});".format(i[1]), 2)
-
-        self.out("return buffer;", 2)
+            self.out("Encoder::store(data, offset, m_{0});".format(i[1]), 2)
         self.out("}", 1)
 
     def generate_message(self, msg):
@@ -99,7 +101,7 @@ class Generator:
                     self.out("{0} var_{1};".format(i[0], i[1]), offset)
                     var_names.add('var_{0}'.format(i[1]))
 
-    def decoder_decode_message(self, msg, offset=0):
+    def decoder_decode_message(self, msg, offset=0, dispatch=False):
         params_str = ""
         if msg.protected:
             params_str = "secret_key, "
@@ -111,7 +113,10 @@ class Generator:
         for i in msg.params:
             self.out(
                 "Encoder::decode(buf, decoded_msg_len, var_{0});".format(i[1]), offset)
-        self.out("return new {0}({1});".format(msg.name, params_str), offset)
+        if dispatch:
+            self.out("return handle({0}({1}));".format(msg.name, params_str), offset)
+        else:
+            self.out("return new {0}({1});".format(msg.name, params_str), offset)
 
     def decoder_create_std_funcs(self, decoder):
         self.out("int magic() const {{ return {0}; }}".format(
@@ -154,6 +159,43 @@ class Generator:
         self.out("}", 1)
         self.out("", 1)
 
+    def decoder_create_dispatch(self, decoder):
+        self.out("// Decodes the message into a temporary and handles it, the message", 1)
+        self.out("// itself is not allocated.", 1)
+        self.out(
+            "std::unique_ptr<Message> dispatch(const char* buf, size_t size) override", 1)
+        self.out("{", 1)
+        self.out("int msg_id, decoder_magic;", 2)
+        self.out("size_t decoded_msg_len = 0;", 2)
+        self.out("Encoder::decode(buf, decoded_msg_len, decoder_magic);", 2)
+        self.out("Encoder::decode(buf, decoded_msg_len, msg_id);", 2)
+        self.out("if (magic() != decoder_magic) {", 2)
+        self.out("return nullptr;", 3)
+        self.out("}", 2)
+
+        if decoder.protected:
+            self.out("message_key_t secret_key;", 2)
+            self.out("Encoder::decode(buf, decoded_msg_len, secret_key);", 2)
+            self.out("", 0)
+
+        self.decoder_create_vars(decoder.messages, 2)
+
+        unique_msg_id = 1
+        self.out("", 2)
+        self.out("switch (msg_id) {", 2)
+        for (name, params) in decoder.messages.items():
+            if name in decoder.functions:
+                self.out("case {0}:".format(unique_msg_id), 2)
+                self.decoder_decode_message(
+                    Message(name, unique_msg_id, 0, decoder.magic, params, decoder.protected), 3, dispatch=True)
+            unique_msg_id += 1
+
+        self.out("default:", 2)
+        self.out("return nullptr;", 3)
+        self.out("}", 2)
+        self.out("}", 1)
+        self.out("", 1)
+
     def decoder_create_handle(self, decoder):
         self.out("std::unique_ptr<Message> handle(const Message& msg) override", 1)
         self.out("{", 1)
@@ -189,6 +231,7 @@ class Generator:
         self.out("{0}() {{}}".format(decoder.name), 1)
         self.decoder_create_std_funcs(decoder)
         self.decoder_create_decode(decoder)
+        self.decoder_create_dispatch(decoder)
         self.decoder_create_handle(decoder)
         self.decoder_create_virtual_handle(decoder)
         self.out("};")
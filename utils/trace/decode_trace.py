@@ -0,0 +1,45 @@
+import struct
+import sys
+
+# Keep in sync with kernel/include/libkern/bits/trace.h
+RECORD = struct.Struct("<IIHHIIII")
+
+events = {
+    1: ("SCHED_SWITCH", "prev={a} next={b} prio={c}"),
+    2: ("PAGE_FAULT", "vaddr={a:#x} info={b:#x}"),
+    3: ("SYSCALL_ENTER", "id={a} p1={b:#x} p2={c:#x}"),
+    4: ("SYSCALL_EXIT", "id={a} ret={b_signed}"),
+    5: ("BLOCK_ISSUE", "dev={a} lba={b} count={count} {rw}"),
+    6: ("BLOCK_COMPLETE", "dev={a} lba={b} status={c_signed}"),
+    7: ("IPC_SEND", "sock={a:#x} len={b} written={c}"),
+}
+
+
+def signed(x):
+    return x - (1 << 32) if x & (1 << 31) else x
+
+
+def decode(data):
+    records = []
+    for off in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        records.append(RECORD.unpack_from(data, off))
+    # Records of one cpu are in order, merge cpus by ticks.
+    records.sort(key=lambda r: r[0])
+    return records
+
+
+def print_record(rec):
+    ticks, cycles, event, cpu, tid, a, b, c = rec
+    name, fmt = events.get(event, ("UNKNOWN({})".format(event), "a={a:#x} b={b:#x} c={c:#x}"))
+    args = fmt.format(a=a, b=b, c=c, b_signed=signed(b), c_signed=signed(c),
+                      count=c & 0x7fffffff, rw="W" if c >> 31 else "R")
+    print("{:>10} {:>10} cpu{} tid {:<5} {:<15} {}".format(ticks, cycles, cpu, tid, name, args))
+
+
+if len(sys.argv) < 2:
+    print("usage: decode_trace.py <dump of /dev/trace>")
+    sys.exit(1)
+
+with open(sys.argv[1], "rb") as f:
+    for rec in decode(f.read()):
+        print_record(rec)